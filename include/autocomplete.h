@@ -1,81 +1,131 @@
 #ifndef AUTOCOMPLETE_H
 #define AUTOCOMPLETE_H
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <unordered_map>
-#include <unordered_set>
-#include <algorithm>
 #include <memory>
 
+#include "text_buffer.h"
+#include "workspace_vocabulary.h"
+
 class PieceTable;
 
+/**
+ * WordFrequencies - identifiers of one text, counted and ranked by prefix
+ *
+ * Words (identifiers of three or more characters) are kept in one array
+ * sorted case-insensitively, so the candidates for a prefix are a range
+ * found by binary search. Ranges too long to scan on a keystroke get a
+ * cached list of their best kTopK words, kept current as counts change and
+ * rebuilt only when a word that was on it falls out of place.
+ */
+class WordFrequencies {
+public:
+    static constexpr size_t kTopK = 16;           // Longest cached list; suggest() scans beyond it
+    static constexpr size_t kScanLimit = 256;     // Ranges longer than this get a cached list
+
+    void clear();
+    // Count the words of text up or down
+    void add_text(const std::string& text) { count_words(text, 1, true); }
+    void remove_text(const std::string& text) { count_words(text, -1, true); }
+    void rebuild(const TextBuffer& document);
+
+    // Words longer than prefix that start with it, ignoring case; most
+    // frequent first, ties in byte order
+    std::vector<std::string> suggest(const std::string& prefix, size_t max_items) const;
+
+    int frequency(const std::string& word) const;
+    size_t size() const { return words_.size(); }    // Including words counted down to zero
+
+private:
+    struct Word {
+        std::string text;
+        std::string key;        // Lower-cased text
+        int count = 0;
+    };
+    struct TopList {
+        std::vector<uint32_t> ids;      // Best first; only words longer than the prefix
+        bool stale = false;
+    };
+
+    // keep_sorted false leaves new words out of sorted_, for a bulk sort
+    void count_words(const std::string& text, int delta, bool keep_sorted);
+    void count_word(const std::string& word, int delta, bool keep_sorted);
+    bool ordered(uint32_t a, uint32_t b) const;     // By key, then text
+    bool better(uint32_t a, uint32_t b) const;      // By count, then text
+    void update_top(TopList& top, uint32_t id, bool increased) const;
+    // [first, last) of sorted_ whose keys start with key
+    std::pair<size_t, size_t> range(const std::string& key) const;
+    void fill_top(const std::string& key, size_t first, size_t last, size_t max_items,
+                  std::vector<uint32_t>& out) const;
+
+    std::vector<Word> words_;
+    std::unordered_map<std::string, uint32_t> ids_;
+    std::vector<uint32_t> sorted_;                      // Word ids by (key, text)
+    mutable std::unordered_map<std::string, TopList> tops_;    // Lower-cased prefix -> its best words
+    mutable std::string probe_;                         // Reused for prefix lookups in tops_
+};
+
+/**
+ * AutocompleteManager - completions from the open document and the workspace
+ *
+ * Each attached document has its own WordFrequencies, built once and then
+ * kept current from its edits: each change recounts just the identifiers
+ * touching the edited range, so undo, redo, paste, replace-all and
+ * switching tabs need no rebuild. Suggestions list the active document's
+ * words first, then the workspace's (a WorkspaceVocabulary snapshot from
+ * the indexer, shared by every tab and read without locking).
+ */
 class AutocompleteManager {
 public:
-    void rebuild_from_document(const std::shared_ptr<PieceTable>& doc) {
-        freq_.clear();
-        if (!doc) return;
-        size_t lines = doc->get_line_count();
-        for (size_t i = 0; i < lines; ++i) {
-            const std::string line = doc->get_line(i);
-            add_words_from_line(line);
-        }
-    }
+    static constexpr size_t kTopK = WordFrequencies::kTopK;
+    static constexpr size_t kScanLimit = WordFrequencies::kScanLimit;
+
+    AutocompleteManager();
+    ~AutocompleteManager();
+    AutocompleteManager(const AutocompleteManager&) = delete;
+    AutocompleteManager& operator=(const AutocompleteManager&) = delete;
+
+    // Counts doc into a detached set of words, which becomes the active one
+    void rebuild_from_document(const std::shared_ptr<TextBuffer>& doc);
+    // Makes document the active one, counting it the first time; its edits
+    // are followed until it is released
+    void attach(const std::shared_ptr<PieceTable>& document);
+    void release(const PieceTable* document);
+    void detach();      // Releases every document
 
-    void on_text_inserted(const std::string& text) { add_words_from_line(text); }
-
-    std::vector<std::string> suggest(const std::string& prefix, size_t max_items = 8) const {
-        if (prefix.empty()) return {};
-        std::vector<std::pair<std::string,int>> candidates;
-        for (const auto& kv : freq_) {
-            const std::string& w = kv.first;
-            if (w.size() <= prefix.size()) continue;
-            if (starts_with_case_insensitive(w, prefix)) candidates.emplace_back(w, kv.second);
-        }
-        std::sort(candidates.begin(), candidates.end(), [&](auto& a, auto& b){
-            if (a.second != b.second) return a.second > b.second;
-            return a.first < b.first;
-        });
-        std::vector<std::string> out;
-        for (size_t i = 0; i < candidates.size() && out.size() < max_items; ++i) out.push_back(candidates[i].first);
-        return out;
+    void set_workspace_vocabulary(std::shared_ptr<const WorkspaceVocabulary> vocabulary) {
+        workspace_ = std::move(vocabulary);
     }
 
+    // Count words of the active set up or down
+    void add_text(const std::string& text) { active_->add_text(text); }
+    void remove_text(const std::string& text) { active_->remove_text(text); }
+
+    // The active document's matches, then the workspace's with other keys
+    std::vector<std::string> suggest(const std::string& prefix, size_t max_items = 8) const;
+
+    int frequency(const std::string& word) const { return active_->frequency(word); }
+    size_t vocabulary_size() const { return active_->size(); }
+    size_t attached_count() const { return layers_.size(); }
+
 private:
-    std::unordered_map<std::string,int> freq_;
+    struct Layer {
+        WordFrequencies words;
+        std::weak_ptr<PieceTable> document;
+        size_t listener_id = 0;
+    };
 
-    static bool is_ident_char(char c) {
-        unsigned char uc = static_cast<unsigned char>(c);
-        return std::isalnum(uc) || c == '_';
-    }
-    static bool is_ident_start(char c) {
-        unsigned char uc = static_cast<unsigned char>(c);
-        return std::isalpha(uc) || c == '_';
-    }
-    static bool starts_with_case_insensitive(const std::string& s, const std::string& p) {
-        if (s.size() < p.size()) return false;
-        for (size_t i = 0; i < p.size(); ++i) {
-            char a = static_cast<char>(std::tolower(static_cast<unsigned char>(s[i])));
-            char b = static_cast<char>(std::tolower(static_cast<unsigned char>(p[i])));
-            if (a != b) return false;
-        }
-        return true;
-    }
-    void add_words_from_line(const std::string& line) {
-        size_t i = 0, n = line.size();
-        while (i < n) {
-            if (is_ident_start(line[i])) {
-                size_t j = i + 1;
-                while (j < n && is_ident_char(line[j])) j++;
-                std::string w = line.substr(i, j - i);
-                // ignore very short tokens
-                if (w.size() >= 3) freq_[w]++;
-                i = j;
-            } else {
-                i++;
-            }
-        }
-    }
+    static void on_change(WordFrequencies& words, const PieceTable& document, size_t position,
+                          size_t inserted_length, const std::string& removed);
+
+    WordFrequencies loose_;                 // From rebuild_from_document()
+    WordFrequencies* active_;
+    std::unordered_map<const PieceTable*, std::unique_ptr<Layer>> layers_;
+    std::shared_ptr<const WorkspaceVocabulary> workspace_;
 };
 
 #endif // AUTOCOMPLETE_H
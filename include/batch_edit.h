@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class PieceTable;
+
+namespace editor {
+
+/**
+ * BatchEdit - a scripted edit program applied to many files, headless
+ *
+ * The program is sed-like, one command per line ('#' starts a comment):
+ *
+ *     [address]s/regex/replacement/[gi]   replace the first match on each
+ *                                         line (every one with g; i ignores
+ *                                         case); $1-$9 insert groups
+ *     [address]d                          delete the lines
+ *     [address]i text                     insert a line before each line
+ *     [address]a text                     append a line after each line
+ *
+ * An address is a line N, a range N,M (1-based, '$' is the last line) or
+ * /regex/ for every line with a match; none means every line. Any
+ * character may delimit s and /regex/, and "\<delimiter>" stands for it.
+ * Unlike sed, commands run one after the other over the whole document,
+ * so line numbers are those left by the commands before.
+ *
+ * Documents are the editor's own: each file is mapped into a PieceTable,
+ * searched with FindDialog and RegexEngine, and, when something changed,
+ * its pieces are streamed out (unchanged text straight from the mapping)
+ * and renamed over the original. Files are independent, so run() edits
+ * them on every core of the shared thread pool.
+ */
+class BatchEdit {
+public:
+    struct Command {
+        enum class Kind { Substitute, Delete, Insert, Append };
+        enum class Address { All, Lines, Matching };
+        Kind kind = Kind::Substitute;
+        Address address = Address::All;
+        size_t first = 0;               // Lines: 0-based, inclusive
+        size_t last = 0;                // SIZE_MAX for '$'
+        std::string anchor;             // Matching: regex a line must match
+        std::string pattern;            // Substitute
+        std::string text;               // Replacement, or the inserted line
+        bool global = false;
+        bool case_sensitive = true;
+    };
+
+    struct FileResult {
+        std::string path;
+        size_t edits = 0;
+        std::string error;              // Empty unless the file was left alone on failure
+    };
+
+    struct Result {
+        size_t files = 0;               // Files read
+        size_t changed = 0;             // Files with at least one edit
+        size_t edits = 0;
+        std::vector<FileResult> touched;    // Changed or failed files, in input order
+        bool ok() const {
+            for (const FileResult& file : touched) {
+                if (!file.error.empty()) return false;
+            }
+            return true;
+        }
+    };
+
+    // Compile a program; false (and error() says why, with its line) if a
+    // command or one of its regexes is malformed
+    bool parse(const std::string& program);
+    const std::string& error() const { return error_; }
+    const std::vector<Command>& commands() const { return commands_; }
+
+    // Run the program over document as one undo step; returns the edits made
+    size_t apply(PieceTable& document) const;
+    // Run it over files in parallel, writing back the ones that changed
+    // unless dry_run
+    Result run(const std::vector<std::string>& paths, bool dry_run = false) const;
+
+    // Files under paths: files as given, directories walked recursively
+    // (hidden entries skipped), sorted
+    static std::vector<std::string> expand_paths(const std::vector<std::string>& paths);
+
+private:
+    bool parse_command(const std::string& line, Command& command);
+    FileResult edit_file(const std::string& path, bool dry_run) const;
+
+    std::vector<Command> commands_;
+    std::string error_;
+};
+
+} // namespace editor
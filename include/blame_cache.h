@@ -0,0 +1,148 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "piece_table.h"
+
+namespace editor {
+
+/**
+ * BlameCache - the commit behind each line of an open document
+ *
+ * Blame is worked out on a worker thread from `git blame --incremental`
+ * of the file at HEAD and cached by HEAD's blob id, so switching back to
+ * a file, or HEAD moving without touching it, costs one blob id lookup.
+ * The blamed lines are then laid over the document by an in-process line
+ * diff (DiffEngine) against HEAD's text: lines the document has that HEAD
+ * does not are local and get no commit.
+ *
+ * After that the document's edits do not go back to git or the diff. The
+ * change listener splices the line-to-commit map in place - edited lines
+ * become local, the rest move with them - including edits made while a
+ * blame was in flight, which are replayed onto its result when it lands.
+ * commit_at is an index lookup, and a Commit carries its label ready to
+ * draw, so painting the visible lines costs nothing per frame.
+ */
+class BlameCache {
+public:
+    struct Commit {
+        std::string id;
+        std::string author;
+        int64_t time = 0;               // Author time, seconds since the epoch
+        std::string summary;
+        std::string label;              // "<short id> <author> <yyyy-mm-dd>"
+    };
+    // A file's blame: the commit of each line of the blamed text
+    struct Blame {
+        std::vector<Commit> commits;
+        std::vector<uint32_t> line_commits;
+    };
+
+    // Blob id of a file in HEAD; false when it is not there
+    using BlobIdFn = std::function<bool(const std::string& path, std::string& blob_id)>;
+    // Contents of a blob
+    using BlobTextFn = std::function<bool(const std::string& blob_id, std::string& text)>;
+    // `git blame --incremental` output for a file at HEAD
+    using BlameFn = std::function<bool(const std::string& path, std::string& output)>;
+
+    // All three are called on the worker thread only
+    BlameCache(BlobIdFn blob_id, BlobTextFn blob_text, BlameFn blame);
+    ~BlameCache();
+
+    BlameCache(const BlameCache&) = delete;
+    BlameCache& operator=(const BlameCache&) = delete;
+
+    // Blame document as path (no-op if already doing so); nullptr or an
+    // empty path stops
+    void set_document(const std::shared_ptr<PieceTable>& document, const std::string& path);
+    // HEAD moved (commit, checkout): look up the blob id again. Cached
+    // blame stays; an unchanged file finds its id in the cache.
+    void invalidate_base();
+
+    // Queue a blame when the document or HEAD changed and none is in
+    // flight. Cheap otherwise; call every frame.
+    void update();
+    // Adopt a finished blame; true when there was one
+    bool take_results();
+    // Blocks until no blame is queued or running
+    void wait_idle();
+
+    // Commit of a document line, or nullptr (local, or not blamed yet)
+    const Commit* commit_at(size_t line) const;
+
+    // Parse `git blame --incremental` output; false if it is malformed
+    static bool parse_incremental(std::string_view output, Blame& blame);
+
+    static constexpr size_t kMaxCachedBlobs = 32;
+    static constexpr uint32_t kLocal = UINT32_MAX;
+
+private:
+    // A blob's blame and its line hashes, shared with the results
+    struct Entry {
+        Blame blame;
+        std::vector<uint64_t> hashes;
+    };
+    struct Job {
+        size_t generation = 0;
+        std::string path;
+        std::shared_ptr<const DocumentSnapshot> snapshot;
+    };
+    struct Result {
+        size_t generation = 0;
+        std::shared_ptr<const Entry> entry;
+        std::vector<uint32_t> lines;
+    };
+
+    void on_change(const PieceTable::Change& change);
+    static void splice(std::vector<uint32_t>& lines, size_t first, size_t removed, size_t inserted);
+    void worker_loop();
+    void run_job(const Job& job, Result& result);
+    std::shared_ptr<const Entry> entry_for(const std::string& path);
+
+    BlobIdFn blob_id_;
+    BlobTextFn blob_text_;
+    BlameFn blame_;
+
+    // UI thread
+    std::shared_ptr<PieceTable> document_;
+    size_t listener_id_ = 0;
+    std::string path_;
+    size_t generation_ = 0;
+    bool dirty_ = false;
+    bool in_flight_ = false;
+    // Line splices since the snapshot in flight: (first line, lines removed,
+    // local lines inserted)
+    std::vector<size_t> splices_;
+    std::shared_ptr<const Entry> entry_;
+    std::vector<uint32_t> lines_;                   // Commit index per document line
+
+    // Shared with the worker
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    bool has_job_ = false;
+    bool running_ = false;
+    bool stopping_ = false;
+    bool base_stale_ = false;
+    Job job_;
+    bool has_result_ = false;
+    Result result_;
+
+    // Worker thread
+    std::unordered_map<std::string, std::string> blob_ids_;         // path -> HEAD blob id ("" untracked)
+    std::unordered_map<std::string, std::shared_ptr<const Entry>> blobs_;
+    std::deque<std::string> blob_order_;                            // Cached ids, oldest first
+
+    std::thread thread_;
+};
+
+} // namespace editor
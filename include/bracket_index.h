@@ -0,0 +1,147 @@
+#ifndef BRACKET_INDEX_H
+#define BRACKET_INDEX_H
+
+#include "code_folding.h"
+#include "piece_table.h"
+#include "syntax_highlighter.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * BracketIndex - the brackets of a document and how they pair up
+ *
+ * Each line is lexed with the SyntaxHighlighter from the state the line
+ * before left, and keeps the (), [] and {} outside strings and comments.
+ * Lines are the nodes of an implicit treap (ordered by line number) whose
+ * nodes sum up their subtree per bracket kind: the net depth change and
+ * the lowest depth reached on the way. From that, the bracket matching an
+ * open one is the first line where the running depth dips below zero,
+ * found in one descent, and likewise backwards for the open bracket
+ * enclosing a position - O(log n) however far apart the pair is.
+ *
+ * An edit splits out the edited lines, lexes their replacements and
+ * merges them back; lines after them are lexed again only while the
+ * out-state differs from before (a comment or string opened or closed),
+ * like HighlightCache. Kinds pair independently, so a stray ')' does not
+ * upset the {} blocks around it.
+ *
+ * As a FoldLineSource it gives CodeFoldingManager lexer-aware braces.
+ */
+class BracketIndex : public FoldLineSource {
+public:
+    enum class Kind : uint8_t { Round, Square, Curly };
+    static constexpr size_t kKinds = 3;
+
+    struct Bracket {
+        uint32_t column;
+        Kind kind;
+        bool open;
+    };
+
+    struct Pair {
+        size_t open_line = 0;
+        size_t open_column = 0;
+        size_t close_line = 0;
+        size_t close_column = 0;
+        Kind kind = Kind::Round;
+    };
+
+    explicit BracketIndex(const SyntaxHighlighter* highlighter);
+    ~BracketIndex() override;
+
+    BracketIndex(const BracketIndex&) = delete;
+    BracketIndex& operator=(const BracketIndex&) = delete;
+
+    // Index a document and follow its edits (no-op if already bound);
+    // nullptr unbinds
+    void set_document(const std::shared_ptr<PieceTable>& document);
+
+    // FoldLineSource: index a document whose edits the owner passes in
+    void attach(const std::shared_ptr<PieceTable>& document) override;
+    void apply(const PieceTable::Change& change) override;
+    void line_braces(size_t line, bool& opens, bool& closes) const override;
+    size_t changed_end() const override { return changed_end_; }
+
+    size_t line_count() const;
+    // Brackets of a line, by column
+    const std::vector<Bracket>& brackets(size_t line) const;
+
+    // The pair of the bracket at (line, column); false if there is no
+    // bracket there or it has no partner
+    bool match(size_t line, size_t column, Pair& out) const;
+    // Innermost pair of a kind around a position (brackets before column on
+    // line count as before it); false if there is none or it is unclosed
+    bool enclosing(size_t line, size_t column, Kind kind, Pair& out) const;
+    // Innermost pair of any kind
+    bool enclosing(size_t line, size_t column, Pair& out) const;
+    // Lines opening the {} blocks a line is inside, outermost first and
+    // each line once - the headers sticky scroll pins
+    void headers(size_t line, std::vector<size_t>& out) const;
+    // Open brackets of a kind still unclosed before a position (rainbow
+    // colour of a bracket there)
+    size_t depth(size_t line, size_t column, Kind kind) const;
+
+    // Bytes of the line nodes, for the memory report
+    size_t get_memory_bytes() const;
+
+private:
+    static constexpr uint32_t kNil = UINT32_MAX;
+
+    // A run of brackets of one kind, counting open +1 and close -1
+    struct Summary {
+        int32_t delta = 0;          // Sum
+        int32_t min_prefix = 0;     // Lowest running sum, 0 at the start included
+        // Highest sum of a suffix, the empty one included
+        int32_t max_suffix() const { return delta - min_prefix; }
+    };
+
+    struct Node {
+        uint32_t left = kNil;
+        uint32_t right = kNil;
+        uint32_t priority = 0;
+        uint32_t size = 1;                      // Lines in the subtree
+        SyntaxHighlighter::LineState out;       // Lexer state after the line
+        std::vector<Bracket> brackets;
+        Summary line[kKinds];
+        Summary tree[kKinds];                   // Of the subtree
+    };
+
+    static Summary combine(const Summary& a, const Summary& b);
+    uint32_t size(uint32_t node) const { return node == kNil ? 0 : nodes_[node].size; }
+    void pull(uint32_t node);
+    std::pair<uint32_t, uint32_t> split(uint32_t node, size_t count);
+    uint32_t merge(uint32_t a, uint32_t b);
+    uint32_t build(const std::vector<uint32_t>& order);
+    uint32_t make_node();
+    void free_tree(uint32_t node);
+    const Node* node_at(size_t line) const;
+    uint32_t last_node(uint32_t node) const;
+
+    void rebuild();
+    void lex(const std::string& text, const SyntaxHighlighter::LineState& in, Node& node);
+    bool relex(uint32_t node, size_t& line, SyntaxHighlighter::LineState& state);
+    void on_change(const PieceTable::Change& change);
+
+    size_t find_forward(uint32_t node, size_t base, size_t from, size_t kind, int32_t& depth) const;
+    size_t find_backward(uint32_t node, size_t base, size_t last, size_t kind, int32_t& sum) const;
+    bool close_after(size_t line, size_t column, Kind kind, size_t& close_line, size_t& close_column) const;
+    bool open_before(size_t line, size_t column, Kind kind, size_t& open_line, size_t& open_column) const;
+    Summary prefix(uint32_t node, size_t count, size_t kind) const;
+
+    const SyntaxHighlighter* highlighter_;
+    SyntaxHighlighter::Language language_;
+    std::shared_ptr<PieceTable> document_;
+    size_t listener_id_ = 0;
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> free_;
+    uint32_t root_ = kNil;
+    uint32_t seed_ = 0x9e3779b9u;
+    size_t changed_end_ = 0;
+    std::string scratch_;
+    std::vector<Token> tokens_;
+    std::vector<Bracket> empty_;
+};
+
+#endif // BRACKET_INDEX_H
@@ -1,19 +1,56 @@
 #ifndef BUILD_ERROR_PARSER_H
 #define BUILD_ERROR_PARSER_H
 
+#include <cstddef>
+#include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 struct BuildError {
     std::string file;
     int line = 0;
+    int column = 0;    // 0 when the compiler gave none
     std::string message;
     std::string type; // error, warning, note
 };
 
+/**
+ * BuildErrorParser - diagnostics from compiler output, as it arrives
+ *
+ * Output is fed in whatever chunks the build produces; complete lines are
+ * matched as soon as their newline is seen and only a trailing partial
+ * line is kept, so errors reach the owner while the build is still
+ * running and memory does not grow with the log. Lines are matched by
+ * hand-written scanners, one pass each, for the GCC/Clang form
+ * (file:line[:column]: kind: message) and the MSVC form
+ * (file(line[,column]): kind CODE: message).
+ */
 class BuildErrorParser {
 public:
+    using ErrorCallback = std::function<void(const BuildError& error)>;
+
+    explicit BuildErrorParser(ErrorCallback on_error = nullptr);
+
+    void feed(const char* data, size_t size);
+    void feed(const std::string& output) { feed(output.data(), output.size()); }
+    // Parses a last line the output did not end with a newline
+    void finish();
+
+    // Everything found so far, in output order
+    const std::vector<BuildError>& errors() const { return errors_; }
+
+    // One line, without its newline; false when it is not a diagnostic
+    static bool parse_line(std::string_view line, BuildError& error);
+    // Whole output at once
     static std::vector<BuildError> parse(const std::string& build_output);
+
+private:
+    void parse_complete_line(std::string_view line);
+
+    ErrorCallback on_error_;
+    std::vector<BuildError> errors_;
+    std::string partial_;   // Start of a line whose newline has not arrived
 };
 
 #endif // BUILD_ERROR_PARSER_H
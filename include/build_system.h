@@ -23,7 +23,10 @@ public:
     BuildSystem(const std::string& workspace_root);
     BuildSystemType detect_type() const;
     std::vector<BuildCommand> get_default_commands() const;
-    void run_command(const BuildCommand& cmd, std::function<void(const std::string& output)> on_output);
+    // Runs cmd through the platform shell, stderr merged into stdout, and
+    // hands on_output each chunk as the command writes it. Returns the
+    // exit code, or -1 when the command could not be started.
+    int run_command(const BuildCommand& cmd, std::function<void(const std::string& output)> on_output);
     static BuildSystemType detect_in_dir(const std::string& dir);
 private:
     std::string root_;
@@ -2,14 +2,32 @@
 
 #include <vector>
 #include <map>
+#include <memory>
 #include <string>
-#include <algorithm>
+#include <string_view>
+#include <cstdint>
+#include "piece_table.h"
 
 /**
  * Code Folding Manager
- * 
+ *
  * Detects foldable regions based on braces and indentation,
  * manages fold/unfold state, and provides visual controls.
+ *
+ * Regions are kept sorted by start line; brace regions nest, so a
+ * region is found by binary search. Folded regions are flattened into
+ * disjoint hidden ranges with a running count of hidden lines, which
+ * makes is_line_visible and the document <-> display line mapping
+ * O(log folds) instead of a scan over every region.
+ *
+ * Detection works from a per-line summary (opens / closes a brace). When
+ * bound to a document, an edit re-reads only the edited lines and
+ * re-derives only the regions that touch them; the rest shift by the
+ * line delta and keep their fold state. Only an edit that unbalances the
+ * braces around it falls back to a rescan - of the summaries, not text.
+ *
+ * A plain scan counts braces in strings and comments too; with a
+ * FoldLineSource (BracketIndex) the braces come from a lexer instead.
  */
 
 struct FoldRegion {
@@ -17,193 +35,149 @@ struct FoldRegion {
     size_t end_line = 0;        // Ending line (inclusive)
     bool is_folded = false;     // Current fold state
     int indent_level = 0;       // Indentation level
-    
+
     FoldRegion() = default;
-    FoldRegion(size_t start, size_t end, int indent = 0) 
+    FoldRegion(size_t start, size_t end, int indent = 0)
         : start_line(start), end_line(end), indent_level(indent) {}
-    
+
     bool contains_line(size_t line) const {
         return line >= start_line && line <= end_line;
     }
-    
+
     size_t line_count() const {
         return end_line >= start_line ? (end_line - start_line + 1) : 0;
     }
 };
 
+/**
+ * FoldLineSource - the braces of a document's lines, from something that
+ * knows the language
+ *
+ * CodeFoldingManager passes each edit on with apply() before it reads any
+ * line back, so the source needs no change listener of its own and is
+ * always current when asked.
+ */
+class FoldLineSource {
+public:
+    virtual ~FoldLineSource() = default;
+
+    // Start over on a document (nullptr: none)
+    virtual void attach(const std::shared_ptr<PieceTable>& document) = 0;
+    virtual void apply(const PieceTable::Change& change) = 0;
+    // Whether a line opens / closes a {} block
+    virtual void line_braces(size_t line, bool& opens, bool& closes) const = 0;
+    // End (exclusive) of the lines the last apply() read again - past the
+    // edit when it opened or closed a comment or string
+    virtual size_t changed_end() const = 0;
+};
+
 class CodeFoldingManager {
 public:
     CodeFoldingManager() = default;
-    
+    ~CodeFoldingManager();
+
+    CodeFoldingManager(const CodeFoldingManager&) = delete;
+    CodeFoldingManager& operator=(const CodeFoldingManager&) = delete;
+
     // Analyze document and detect foldable regions
-    void analyze_document(const std::vector<std::string>& lines) {
-        regions_.clear();
-        
-        // Detect brace-based regions (C++, JavaScript, etc.)
-        detect_brace_regions(lines);
-        
-        // Detect indentation-based regions (Python, YAML, etc.)
-        // detect_indent_regions(lines);
-    }
-    
+    void analyze_document(const std::vector<std::string>& lines);
+
+    // Analyze document and keep regions current as it is edited (no-op if
+    // already bound); nullptr unbinds
+    void set_document(const std::shared_ptr<PieceTable>& document);
+
+    // Take braces from source rather than the raw text (re-analyzes a
+    // bound document); nullptr goes back to the text
+    void set_line_source(std::shared_ptr<FoldLineSource> source);
+    const FoldLineSource* line_source() const { return source_.get(); }
+
     // Toggle fold state for region at line
-    bool toggle_fold(size_t line) {
-        for (auto& region : regions_) {
-            if (region.start_line == line) {
-                region.is_folded = !region.is_folded;
-                return true;
-            }
-        }
-        return false;
-    }
-    
+    bool toggle_fold(size_t line);
+
     // Fold region at line
-    void fold(size_t line) {
-        for (auto& region : regions_) {
-            if (region.start_line == line) {
-                region.is_folded = true;
-                return;
-            }
-        }
-    }
-    
+    void fold(size_t line);
+
     // Unfold region at line
-    void unfold(size_t line) {
-        for (auto& region : regions_) {
-            if (region.start_line == line) {
-                region.is_folded = false;
-                return;
-            }
-        }
-    }
-    
+    void unfold(size_t line);
+
     // Fold all regions
-    void fold_all() {
-        for (auto& region : regions_) {
-            region.is_folded = true;
-        }
-    }
-    
+    void fold_all();
+
     // Unfold all regions
-    void unfold_all() {
-        for (auto& region : regions_) {
-            region.is_folded = false;
-        }
-    }
-    
+    void unfold_all();
+
     // Check if a line should be visible (not folded)
-    bool is_line_visible(size_t line) const {
-        for (const auto& region : regions_) {
-            if (region.is_folded && line > region.start_line && line <= region.end_line) {
-                return false;
-            }
-        }
-        return true;
-    }
-    
+    bool is_line_visible(size_t line) const;
+
+    // True when any region is folded
+    bool has_folds() const { return !hidden_.empty(); }
+
+    // Lines hidden by folds, and the visible line count of a document
+    size_t hidden_line_count() const { return hidden_.empty() ? 0 : hidden_.back().hidden_before + hidden_.back().count(); }
+    size_t visible_line_count(size_t total_lines) const;
+
+    // Display lines are the visible lines, numbered from 0 on screen order.
+    // Document line shown as display line display_line
+    size_t display_to_document_line(size_t display_line) const;
+    // Display line of a document line; a hidden line maps to its fold header
+    size_t document_to_display_line(size_t line) const;
+    // First visible line at or after line
+    size_t next_visible_line(size_t line) const;
+    // End (exclusive) of the unbroken run of visible lines containing a
+    // visible line: the next hidden line, or SIZE_MAX
+    size_t visible_run_end(size_t line) const;
+
     // Get foldable region at line (if exists)
-    const FoldRegion* get_region_at_line(size_t line) const {
-        for (const auto& region : regions_) {
-            if (region.start_line == line) {
-                return &region;
-            }
-        }
-        return nullptr;
-    }
-    
-    // Get all regions
+    const FoldRegion* get_region_at_line(size_t line) const;
+
+    // Get all regions, sorted by start line
     const std::vector<FoldRegion>& get_regions() const {
         return regions_;
     }
-    
+
     // Get visible line indices (after folding)
-    std::vector<size_t> get_visible_lines(size_t total_lines) const {
-        std::vector<size_t> visible;
-        for (size_t i = 0; i < total_lines; ++i) {
-            if (is_line_visible(i)) {
-                visible.push_back(i);
-            }
-        }
-        return visible;
-    }
-    
+    std::vector<size_t> get_visible_lines(size_t total_lines) const;
+
     // Save fold state
-    std::map<size_t, bool> get_fold_state() const {
-        std::map<size_t, bool> state;
-        for (const auto& region : regions_) {
-            state[region.start_line] = region.is_folded;
-        }
-        return state;
-    }
-    
+    std::map<size_t, bool> get_fold_state() const;
+
     // Restore fold state
-    void restore_fold_state(const std::map<size_t, bool>& state) {
-        for (auto& region : regions_) {
-            auto it = state.find(region.start_line);
-            if (it != state.end()) {
-                region.is_folded = it->second;
-            }
-        }
-    }
-    
+    void restore_fold_state(const std::map<size_t, bool>& state);
+
 private:
+    // Brace events of one line, the only input detection needs
+    struct LineFacts {
+        uint8_t flags = 0;
+        int indent = 0;
+    };
+    static constexpr uint8_t kOpens = 1;
+    static constexpr uint8_t kCloses = 2;
+
+    // Lines [first, last] hidden by an outermost folded region
+    struct HiddenRange {
+        size_t first;
+        size_t last;
+        size_t hidden_before;       // Hidden lines above first
+        size_t count() const { return last - first + 1; }
+    };
+
     std::vector<FoldRegion> regions_;
-    
-    void detect_brace_regions(const std::vector<std::string>& lines) {
-        std::vector<size_t> brace_stack;  // Stack of opening brace line numbers
-        std::vector<int> indent_stack;    // Stack of indentation levels
-        
-        for (size_t i = 0; i < lines.size(); ++i) {
-            const std::string& line = lines[i];
-            
-            // Calculate indentation
-            int indent = 0;
-            for (char c : line) {
-                if (c == ' ') indent++;
-                else if (c == '\t') indent += 4;
-                else break;
-            }
-            
-            // Skip empty lines and comments
-            std::string trimmed = trim(line);
-            if (trimmed.empty() || (trimmed.length() >= 2 && trimmed[0] == '/' && trimmed[1] == '/')) {
-                continue;
-            }
-            
-            // Look for opening braces
-            size_t open_pos = trimmed.find('{');
-            if (open_pos != std::string::npos) {
-                brace_stack.push_back(i);
-                indent_stack.push_back(indent);
-            }
-            
-            // Look for closing braces
-            size_t close_pos = trimmed.find('}');
-            if (close_pos != std::string::npos && !brace_stack.empty()) {
-                size_t start_line = brace_stack.back();
-                size_t end_line = i;
-                int region_indent = indent_stack.back();
-                
-                brace_stack.pop_back();
-                indent_stack.pop_back();
-                
-                // Only create region if it spans multiple lines
-                if (end_line > start_line + 1) {
-                    regions_.emplace_back(start_line, end_line, region_indent);
-                }
-            }
-        }
-    }
-    
-    static std::string trim(const std::string& str) {
-        size_t start = 0;
-        while (start < str.length() && (str[start] == ' ' || str[start] == '\t')) {
-            start++;
-        }
-        size_t end = str.length();
-        while (end > start && (str[end-1] == ' ' || str[end-1] == '\t' || str[end-1] == '\r' || str[end-1] == '\n')) {
-            end--;
-        }
-        return str.substr(start, end - start);
-    }
+    std::vector<LineFacts> facts_;
+    std::vector<HiddenRange> hidden_;
+    std::shared_ptr<PieceTable> document_;
+    size_t listener_id_ = 0;
+    std::shared_ptr<FoldLineSource> source_;
+
+    static LineFacts scan_line(std::string_view line);
+    // scan_line with the braces from source_, when there is one
+    LineFacts line_facts(size_t line, std::string_view text) const;
+    // Matches braces over facts_[first, last] from an empty stack. Strict:
+    // false if a close has no open in the range or an open stays unclosed;
+    // otherwise those braces are ignored, as for a whole document.
+    bool detect_regions(size_t first, size_t last, bool strict, std::vector<FoldRegion>& out) const;
+    static bool is_balanced(const std::vector<LineFacts>& facts, size_t first, size_t last);
+    void rebuild_regions();
+    void rebuild_hidden();
+    void on_change(const PieceTable::Change& change);
+    FoldRegion* find_region(size_t line);
 };
@@ -0,0 +1,123 @@
+#pragma once
+#include "text_buffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class PieceTable;
+
+namespace editor {
+
+/**
+ * ColumnLayout - display columns of logical lines, computed on demand
+ *
+ * The view is a grid of cells, but a line's bytes do not map one to one
+ * onto it: a UTF-8 sequence is one character, a base letter and its
+ * combining marks (or an emoji ZWJ sequence, or a flag) are one cluster,
+ * East Asian wide characters and emoji take two cells, and a tab runs to
+ * the next tab stop. A cluster always takes at least one cell, so every
+ * cluster boundary has its own column and the mapping inverts.
+ *
+ * A line's map lists only the clusters that are not one ASCII byte in one
+ * cell; between them bytes and columns advance together, so an ASCII line
+ * stores nothing and is recognized 16 bytes at a time with SSE2 or NEON.
+ * Maps are built by streaming the line through bounded get_text reads and
+ * cached like WrapLayout's rows: dropped when their line is edited,
+ * shifted when lines above are, all of them when the tab width changes,
+ * and trim() keeps the neighborhood of the viewport.
+ */
+class ColumnLayout {
+public:
+    // A cluster that does not take one cell per byte
+    struct Span {
+        uint32_t byte;          // Start within the line
+        uint32_t column;        // Display column of that start
+        uint16_t bytes;
+        uint16_t columns;
+    };
+
+    // Byte <-> column map of one line
+    struct LineMap {
+        std::vector<Span> spans;        // By byte (and so by column)
+        uint32_t bytes = 0;             // Length without the terminator
+
+        bool simple() const { return spans.empty(); }
+        size_t width() const { return column_of(bytes); }
+        // Column where the cluster holding byte starts; past the end each
+        // byte is a column (virtual space)
+        size_t column_of(size_t byte) const;
+        // Start of the cluster covering column, likewise past the end
+        size_t byte_at(size_t column) const;
+        // Cluster boundaries either side of byte (for caret movement)
+        size_t next_boundary(size_t byte) const;
+        size_t prev_boundary(size_t byte) const;
+    };
+
+    ColumnLayout() = default;
+    ~ColumnLayout();
+
+    ColumnLayout(const ColumnLayout&) = delete;
+    ColumnLayout& operator=(const ColumnLayout&) = delete;
+
+    void set_document(const std::shared_ptr<TextBuffer>& document);
+    void set_tab_width(size_t tab_width);
+    size_t tab_width() const { return tab_width_; }
+
+    const LineMap& line(size_t line);
+
+    void invalidate() { lines_.clear(); }
+    // Drop cached lines outside [first - kSlack, last + kSlack]
+    void trim(size_t first, size_t last);
+    size_t cached_lines() const { return lines_.size(); }
+
+    static constexpr size_t kSlack = 256;
+    static constexpr size_t kReadChunk = 64 * 1024;
+    static constexpr size_t kDefaultTabWidth = 4;
+
+    // Cells a codepoint takes on its own: 0 for combining marks and
+    // other zero-width characters, 2 for wide ones, 1 otherwise
+    static int codepoint_width(uint32_t codepoint);
+    // Decodes the codepoint at text[i] and moves i past it; a malformed
+    // byte is U+FFFD, one byte long
+    static uint32_t decode(const char* text, size_t length, size_t& i);
+    // End of the cluster starting at text[i], and the cells it takes at
+    // display column `column` (tabs depend on it)
+    static size_t next_cluster(const char* text, size_t length, size_t i, size_t column, size_t tab_width,
+                               size_t& columns);
+    // Bytes from text on that are plain ASCII other than tab: one cell each
+    static size_t ascii_run(const char* text, size_t length);
+
+    // Map of text, a whole line without its terminator
+    static void map_text(const char* text, size_t length, size_t tab_width, LineMap& map);
+    static LineMap map_text(const std::string& text, size_t tab_width = kDefaultTabWidth) {
+        LineMap map;
+        map_text(text.data(), text.size(), tab_width, map);
+        return map;
+    }
+    // Cells text takes when it starts at display column start_column
+    static size_t display_width(const char* text, size_t length, size_t tab_width = kDefaultTabWidth,
+                                size_t start_column = 0);
+    static size_t display_width(const std::string& text, size_t tab_width = kDefaultTabWidth,
+                                size_t start_column = 0) {
+        return display_width(text.data(), text.size(), tab_width, start_column);
+    }
+    // Bytes of the longest run of whole clusters of text, starting at
+    // start_column, that fits in columns cells
+    static size_t fit_columns(const char* text, size_t length, size_t columns, size_t tab_width = kDefaultTabWidth,
+                              size_t start_column = 0);
+
+private:
+    LineMap layout_line(size_t line) const;
+    void on_change(size_t first_line, size_t removed_newlines, size_t inserted_newlines);
+
+    std::shared_ptr<TextBuffer> document_;
+    std::shared_ptr<PieceTable> listened_;
+    size_t listener_id_ = 0;
+    size_t tab_width_ = kDefaultTabWidth;
+    std::unordered_map<size_t, LineMap> lines_;
+};
+
+} // namespace editor
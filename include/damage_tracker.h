@@ -0,0 +1,67 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+namespace editor {
+
+// Half-open pixel rectangle [left, right) x [top, bottom), like a Win32 RECT
+struct DamageRect {
+    int left = 0;
+    int top = 0;
+    int right = 0;
+    int bottom = 0;
+
+    bool empty() const { return right <= left || bottom <= top; }
+    bool intersects(const DamageRect& other) const {
+        return left < other.right && other.left < right && top < other.bottom && other.top < bottom;
+    }
+    bool contains(const DamageRect& other) const {
+        return left <= other.left && top <= other.top && right >= other.right && bottom >= other.bottom;
+    }
+};
+
+/**
+ * DamageTracker - what the next paint has to redraw, and what it can move
+ *
+ * Callers report damage as they change state (an edited line, the caret
+ * cell, a panel) instead of invalidating the whole window. Scrolling is
+ * recorded as a blit of the pixels already in the back buffer plus the
+ * rows it exposes; damage recorded before the scroll moves with it. The
+ * paint replays scrolls() in order, redraws only what intersects rects(),
+ * then calls clear().
+ *
+ * Rects that overlap or touch are merged; past kMaxRects the list
+ * collapses to its bounding box, so testing a row stays cheap.
+ */
+class DamageTracker {
+public:
+    struct Scroll {
+        DamageRect area;
+        int dy;         // Pixels; positive moves content down
+    };
+
+    void invalidate(const DamageRect& rect);
+    void invalidate_all();
+    // Moves the contents of area by dy and damages the rows it exposes
+    void scroll(const DamageRect& area, int dy);
+
+    bool full() const { return full_; }
+    bool empty() const { return !full_ && rects_.empty() && scrolls_.empty(); }
+    bool intersects(const DamageRect& rect) const;
+
+    const std::vector<DamageRect>& rects() const { return rects_; }
+    const std::vector<Scroll>& scrolls() const { return scrolls_; }
+    void clear();
+
+    static constexpr size_t kMaxRects = 16;
+    static constexpr size_t kMaxScrolls = 4;
+
+private:
+    void add(DamageRect rect);
+
+    bool full_ = false;
+    std::vector<DamageRect> rects_;
+    std::vector<Scroll> scrolls_;
+};
+
+} // namespace editor
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class DocumentSnapshot;
+class ThreadPool;
+
+namespace editor {
+
+/**
+ * DiffEngine - line diff of two documents, in-process
+ *
+ * Lines are hashed once to 64 bits and compared as hashes from then on.
+ * The common head and tail are stripped first. What is left is cut at
+ * patience anchors - lines that occur exactly once on each side, kept
+ * where their order agrees (longest increasing run) - into independent
+ * regions, which are diffed on a ThreadPool when one is given. Within a
+ * region, histogram diff splits at the least frequent common line and
+ * recurses; a region whose common lines are all more frequent than
+ * kMaxChain goes to linear-space Myers (middle snake), and one further
+ * than kMaxEditCost edits apart is reported as replaced whole.
+ *
+ * Each region marks the changed lines of its own slice of two flag
+ * arrays, so regions need no merging; the hunks are read off the flags.
+ */
+class DiffEngine {
+public:
+    // Lines [old_start, old_start + old_count) of the old side became
+    // [new_start, new_start + new_count) of the new side; a count is 0 for
+    // a pure insertion or deletion, whose start is where it happened
+    struct Hunk {
+        size_t old_start = 0;
+        size_t old_count = 0;
+        size_t new_start = 0;
+        size_t new_count = 0;
+    };
+
+    // One hash per line: '\n' separated, the '\r' of CRLF dropped
+    static void hash_lines(const DocumentSnapshot& snapshot, std::vector<uint64_t>& hashes);
+
+    // Hunks turning old_lines into new_lines, in order
+    static std::vector<Hunk> diff(const std::vector<uint64_t>& old_lines, const std::vector<uint64_t>& new_lines,
+                                  ThreadPool* pool = nullptr);
+    static std::vector<Hunk> diff(const DocumentSnapshot& old_text, const DocumentSnapshot& new_text,
+                                  ThreadPool* pool = nullptr);
+
+    // The line of the other side level with line, for synchronized
+    // scrolling: inside a hunk, the same distance into the other side's
+    // part of it (clamped)
+    static size_t map_line(const std::vector<Hunk>& hunks, size_t line, bool from_old);
+    // Hunk with line on one side, or nullptr
+    static const Hunk* hunk_at(const std::vector<Hunk>& hunks, size_t line, bool old_side);
+
+    static constexpr size_t kMaxChain = 64;             // Histogram: more frequent lines don't split
+    static constexpr size_t kMaxEditCost = 4096;        // Myers: give up past this many edits
+    static constexpr size_t kTaskLines = 8192;          // Regions per pool task, in lines
+};
+
+} // namespace editor
@@ -0,0 +1,141 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "git_integration.h"
+#include "piece_table.h"
+
+namespace editor {
+
+/**
+ * DiffGutter - change markers of an open document against its HEAD version
+ *
+ * The diff runs in-process on a worker thread, over one 64-bit hash per
+ * line. HEAD's text is loaded once per blob id and its hashes are cached
+ * by id, so switching back to a file or reopening it costs one blob id
+ * lookup. The document side is kept up to date from the change
+ * listener: update() hands the worker a snapshot together with the line
+ * ranges edited since the last one, and only those lines are hashed again.
+ * The diff itself trims the common head and tail and runs Myers on what is
+ * left, which for a file being edited is a few lines.
+ *
+ * Hunk lines are 0-based document lines. A deletion is marked on the line
+ * above where the text was (line 0 for the top of the file). A diff
+ * further than kMaxEditDistance apart is not worked out line by line; the
+ * whole differing middle is marked modified.
+ */
+class DiffGutter {
+public:
+    // Blob id of a file in HEAD; false when it is not there (untracked, or
+    // no commit yet) and the file gets no markers
+    using BlobIdFn = std::function<bool(const std::string& path, std::string& blob_id)>;
+    // Contents of a blob
+    using BlobTextFn = std::function<bool(const std::string& blob_id, std::string& text)>;
+
+    // Both are called on the worker thread only
+    DiffGutter(BlobIdFn blob_id, BlobTextFn blob_text);
+    ~DiffGutter();
+
+    DiffGutter(const DiffGutter&) = delete;
+    DiffGutter& operator=(const DiffGutter&) = delete;
+
+    // Track document as path (no-op if already tracking it); nullptr or an
+    // empty path stops. Until the first diff is in the markers are hunks:
+    // none, or those the document had when it was last shown.
+    void set_document(const std::shared_ptr<PieceTable>& document, const std::string& path,
+                      std::vector<GitDiffHunk> hunks = {});
+    // HEAD moved (commit, checkout): look up every blob id again. Cached
+    // blob hashes stay; an unchanged file finds its id in the cache.
+    void invalidate_base();
+
+    // Queue a diff if the document changed since the last one and none is
+    // in flight. Cheap when nothing changed; call every frame.
+    void update();
+    // Adopt the newest finished diff; true when the markers changed
+    bool take_results();
+    // Blocks until no diff is queued or running
+    void wait_idle();
+
+    const std::vector<GitDiffHunk>& hunks() const { return hunks_; }
+    // Hunk marking line, or nullptr
+    const GitDiffHunk* hunk_at(size_t line) const;
+
+    // Line hashes as the diff sees them: '\n' separated, a '\r' before it
+    // dropped, as DocumentSnapshot::get_line reads lines
+    static void hash_lines(std::string_view text, std::vector<uint64_t>& hashes);
+    static uint64_t hash_line(std::string_view line);
+    static void diff_lines(const std::vector<uint64_t>& base, const std::vector<uint64_t>& current,
+                           std::vector<GitDiffHunk>& hunks);
+
+    static constexpr size_t kMaxEditDistance = 1024;
+    static constexpr size_t kMaxCachedBlobs = 32;
+
+private:
+    struct Job {
+        size_t generation = 0;
+        std::string path;
+        std::shared_ptr<const DocumentSnapshot> snapshot;
+        bool rehash_all = false;
+        size_t dirty_first = 0;             // Lines [dirty_first, dirty_last) need hashing again
+        size_t dirty_last = 0;
+        // Line splices since the last job, in order: (first line, lines
+        // removed, lines inserted)
+        std::vector<size_t> splices;
+    };
+    struct Result {
+        size_t generation = 0;
+        std::vector<GitDiffHunk> hunks;
+    };
+
+    void on_change(const PieceTable::Change& change);
+    void worker_loop();
+    void run_job(Job& job);
+    std::shared_ptr<const std::vector<uint64_t>> base_for(const std::string& path);
+
+    BlobIdFn blob_id_;
+    BlobTextFn blob_text_;
+
+    // UI thread
+    std::shared_ptr<PieceTable> document_;
+    size_t listener_id_ = 0;
+    std::string path_;
+    size_t generation_ = 0;
+    bool dirty_ = false;
+    bool rehash_all_ = true;
+    size_t dirty_first_ = 0;
+    size_t dirty_last_ = 0;
+    std::vector<size_t> splices_;
+    std::vector<GitDiffHunk> hunks_;
+
+    // Shared with the worker
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    bool has_job_ = false;
+    bool running_ = false;
+    bool stopping_ = false;
+    bool base_stale_ = false;
+    Job job_;
+    bool has_result_ = false;
+    Result result_;
+
+    // Worker thread
+    size_t worker_generation_ = static_cast<size_t>(-1);
+    std::vector<uint64_t> lines_;                                   // Current document's line hashes
+    std::unordered_map<std::string, std::string> blob_ids_;         // path -> HEAD blob id ("" untracked)
+    std::unordered_map<std::string, std::shared_ptr<const std::vector<uint64_t>>> blobs_;
+    std::deque<std::string> blob_order_;                            // Cached ids, oldest first
+
+    std::thread thread_;
+};
+
+} // namespace editor
@@ -0,0 +1,136 @@
+#ifndef DOCUMENT_JOURNAL_H
+#define DOCUMENT_JOURNAL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class PieceTable;
+class DocumentSnapshot;
+
+namespace editor {
+
+/**
+ * DocumentJournal - crash-recovery log of one document's edits
+ *
+ * Every change of the document is appended to a journal file under
+ * <workspace>/.velocity/journal/ as a small checksummed record. The UI
+ * thread only encodes records and queues them; a writer thread appends
+ * whatever has queued up with one write (group commit) and syncs the file
+ * to the disk at most once per sync interval, so a burst of typing costs
+ * one fsync and a crash loses at most the last interval of edits.
+ *
+ * The journal starts with a header naming the file and the length and
+ * hash of the text the edits apply to (the text itself for untitled
+ * documents). recover() checks the file on disk against it and replays
+ * the edits, stopping at the first torn or corrupt record.
+ *
+ * save_async() writes a snapshot of the document on the writer thread,
+ * streaming its pieces into a temporary file that is synced and renamed
+ * over the target, then restarts the journal against the saved text.
+ */
+class DocumentJournal {
+public:
+    static constexpr std::chrono::milliseconds kDefaultSyncInterval{200};
+
+    // Runs on the writer thread; GUI consumers marshal it to their UI thread
+    using SaveCallback = std::function<void(bool ok)>;
+
+    DocumentJournal();
+    ~DocumentJournal();     // Closes, keeping the journal
+
+    DocumentJournal(const DocumentJournal&) = delete;
+    DocumentJournal& operator=(const DocumentJournal&) = delete;
+
+    // Start journaling document, whose current text is file_path's content
+    // (file_path empty for an untitled document). Replaces an existing
+    // journal at journal_path. Returns false if it cannot be created.
+    bool open(PieceTable& document, const std::string& journal_path, const std::string& file_path,
+              std::chrono::milliseconds sync_interval = kDefaultSyncInterval);
+    // Stop following the document and join the writer after it has synced
+    // everything queued; discard deletes the journal (a clean close)
+    void close(bool discard);
+    bool is_open() const { return document_ != nullptr; }
+    const std::string& journal_path() const { return journal_path_; }
+
+    // Block until every edit made so far is on the disk
+    void flush();
+    // Save the document's current text to path off the calling thread;
+    // done (optional) reports the outcome once the file has been replaced
+    void save_async(const std::string& path, SaveCallback done = nullptr);
+
+    // Records queued and fsyncs issued since open, for tests and stats
+    uint64_t records_written() const;
+    uint64_t sync_count() const;
+
+    struct Recovered {
+        std::string file_path;      // Empty for an untitled document
+        std::string text;           // The document as of the last intact record
+        size_t records = 0;         // Edits replayed
+        bool torn = false;          // Bytes after them were cut off or corrupt
+    };
+    // Rebuild a document from a journal. Fails if the journal is unreadable
+    // or the file it was based on has changed since.
+    static bool recover(const std::string& journal_path, Recovered& out, std::string& error);
+
+    // Where a file's journal lives in a workspace, and the journals there
+    static std::string journal_path_for(const std::string& workspace_dir, const std::string& file_path);
+    static std::vector<std::string> find_journals(const std::string& workspace_dir);
+    // Where the document's undo history spills (PieceTable::set_history_spill),
+    // next to its journal
+    static std::string history_path_for(const std::string& journal_path);
+
+    // Write a snapshot's pieces to path through a synced temporary file and
+    // an atomic rename (PlatformFile::write_file_binary); usable from any thread
+    static bool write_snapshot(const DocumentSnapshot& snapshot, const std::string& path);
+
+private:
+    struct Item {
+        enum class Kind { Record, Restart, Save };
+        Kind kind = Kind::Record;
+        std::string bytes;                                      // Record
+        uint32_t records = 0;                                   // Records in bytes
+        std::shared_ptr<const DocumentSnapshot> snapshot;       // Restart, Save
+        std::string path;                                       // File the text is (to be) saved as
+        SaveCallback done;
+    };
+
+    void enqueue(Item item);
+    void run();
+    void write_items(std::vector<Item>& items);
+    void restart(const DocumentSnapshot& base, const std::string& file_path);
+
+    PieceTable* document_ = nullptr;
+    size_t listener_id_ = 0;
+    std::string journal_path_;
+    std::chrono::milliseconds sync_interval_{kDefaultSyncInterval};
+    std::thread writer_;
+
+    // Writer thread only
+    std::FILE* file_ = nullptr;
+    std::string batch_;                 // Records of one group commit
+    std::chrono::steady_clock::time_point last_sync_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;      // Writer: items queued, flush or stop wanted
+    std::condition_variable synced_;    // flush(): synced_through_ advanced
+    std::vector<Item> queue_;
+    uint64_t queued_ = 0;               // Items ever queued; the others count through these
+    uint64_t written_through_ = 0;
+    uint64_t synced_through_ = 0;
+    uint64_t records_ = 0;
+    uint64_t syncs_ = 0;
+    bool flush_wanted_ = false;
+    bool stopping_ = false;
+};
+
+} // namespace editor
+
+#endif // DOCUMENT_JOURNAL_H
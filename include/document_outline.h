@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "piece_table.h"
+#include "symbol_tags.h"
+
+class BracketIndex;
+
+namespace editor {
+
+/**
+ * DocumentOutline - the symbols a document defines and which of them a
+ * line is inside, for the outline and the breadcrumb bar
+ *
+ * Definitions come from SymbolTags, one line at a time, into a list
+ * sorted by line. The change listener splices it like BlameCache does:
+ * the edited lines' definitions go, the lines are scanned again, and the
+ * definitions after them move by the lines the edit added or removed - no
+ * reparse and no language server round trip.
+ *
+ * Nesting is the BracketIndex's: the {} blocks around a line are found in
+ * O(log n) each, and the definition owning a block is the one on the line
+ * that opens it, or on the line before when the brace starts its own line
+ * (Allman style). So the breadcrumb path of a line costs O(depth log n),
+ * and asking again for the same line of an unchanged document, as every
+ * scroll does for the top line, costs nothing. Languages without braces
+ * (Python) get the outline but no nesting.
+ */
+class DocumentOutline {
+public:
+    struct Symbol {
+        std::string name;
+        size_t line = 0;
+        size_t column = 0;
+        size_t end_line = 0;        // Line closing its block; its own line if it has none
+        size_t depth = 0;           // Symbols whose blocks it is inside
+    };
+
+    DocumentOutline() = default;
+    ~DocumentOutline();
+
+    DocumentOutline(const DocumentOutline&) = delete;
+    DocumentOutline& operator=(const DocumentOutline&) = delete;
+
+    // Scan a document and follow its edits (no-op if already bound to it in
+    // that language); nullptr unbinds
+    void set_document(const std::shared_ptr<PieceTable>& document, SymbolTags::Language language);
+
+    // Symbols whose blocks contain line, outermost first
+    const std::vector<Symbol>& path_at(size_t line, const BracketIndex& brackets);
+    // Every definition in order, with its block and nesting
+    const std::vector<Symbol>& symbols(const BracketIndex& brackets);
+    size_t definition_count() const { return definitions_.size(); }
+
+private:
+    void scan_lines(size_t first, size_t count, std::vector<SymbolTags::Definition>& out);
+    void on_change(const PieceTable::Change& change);
+    // The definition whose block opens on line, or nullptr
+    const SymbolTags::Definition* owner_of(size_t line, const BracketIndex& brackets) const;
+    // Lines opening and closing the {} block a definition opens; false if
+    // it opens none
+    bool block_of(const SymbolTags::Definition& definition, const BracketIndex& brackets, size_t& open_line,
+                  size_t& close_line) const;
+    Symbol make_symbol(const SymbolTags::Definition& definition, const BracketIndex& brackets) const;
+
+    std::shared_ptr<PieceTable> document_;
+    size_t listener_id_ = 0;
+    SymbolTags::Language language_ = SymbolTags::Language::None;
+    std::vector<SymbolTags::Definition> definitions_;     // By line, then column
+
+    // Last answers, valid while the document version and the brackets
+    // they were read from are unchanged
+    struct Key {
+        size_t version = SIZE_MAX;
+        const BracketIndex* brackets = nullptr;
+        size_t bracket_lines = 0;
+        bool operator==(const Key& other) const {
+            return version == other.version && brackets == other.brackets && bracket_lines == other.bracket_lines;
+        }
+    };
+    Key key(const BracketIndex& brackets) const;
+    std::vector<Symbol> path_;
+    size_t path_line_ = SIZE_MAX;
+    Key path_key_;
+    std::vector<Symbol> symbols_;
+    Key symbols_key_;
+    std::vector<size_t> headers_;
+};
+
+} // namespace editor
@@ -0,0 +1,86 @@
+#ifndef DOCUMENT_SNAPSHOT_H
+#define DOCUMENT_SNAPSHOT_H
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include "prefix_index.h"
+
+namespace editor { class MappedFile; }
+
+/**
+ * DocumentSnapshot - immutable view of a PieceTable at one version
+ *
+ * Made by PieceTable::snapshot(). Taking one copies the piece list, not the
+ * text: both buffers are append-only and their storage is shared with the
+ * snapshot, so later edits never touch what it points at. Any number of
+ * threads may read a snapshot while the table keeps being edited, and it
+ * stays valid after the table is gone.
+ *
+ * Offset and line lookups are binary searches over flat prefix-sum arrays
+ * (32-bit below 4 GB) rather than a tree descent.
+ *
+ * Line metrics come from the table's newline counts. While the table is
+ * still indexing in the background, the first line query counts the
+ * unindexed part on the calling thread instead.
+ */
+class DocumentSnapshot {
+public:
+    size_t get_version() const { return version_; }
+    size_t get_total_length() const { return total_length_; }
+    size_t get_line_count() const;
+    
+    std::string get_text(size_t start, size_t length) const;
+    std::string get_text() const { return get_text(0, total_length_); }
+    // Line without its terminator (and the '\r' of CRLF)
+    std::string get_line(size_t line_number) const;
+    size_t get_line_start(size_t line_number) const;
+    
+    // Contiguous text from position to the end of the piece containing it,
+    // empty at the end. Advance by its size to walk the document.
+    std::string_view chunk_at(size_t position) const;
+    
+    size_t get_piece_count() const { return segments_.size(); }
+    // True when part of the text is read through a file mapping
+    bool is_mapped() const { return original_mapping_ != nullptr; }
+    // Bytes used by the piece list and its lookup arrays
+    size_t get_index_bytes() const;
+    
+private:
+    friend class PieceTable;
+    DocumentSnapshot() = default;
+    
+    struct Segment {
+        const char* data;
+        size_t length;
+        size_t buffer_offset;       // Offset of data in its source buffer
+        bool original;
+        size_t newlines;            // Exact unless lines_exact_ is false
+    };
+    
+    size_t segment_at(size_t position) const;
+    size_t nth_newline(const Segment& segment, size_t n) const;
+    void ensure_lines() const;
+    
+    std::vector<Segment> segments_;
+    PrefixIndex starts_;                        // Document offset of each segment
+    size_t total_length_ = 0;
+    size_t version_ = 0;
+    
+    // Keep the buffers the segments point into alive
+    std::shared_ptr<const std::string> original_storage_;
+    std::shared_ptr<editor::MappedFile> original_mapping_;
+    std::vector<std::shared_ptr<char>> add_chunks_;
+    // The table's original newline index once it is complete (never changes
+    // afterwards), for O(log n) line lookups inside original pieces
+    std::shared_ptr<const std::vector<size_t>> original_newlines_;
+    
+    // newlines_before_[i] = newlines in segments before i; built on first use
+    bool lines_exact_ = true;
+    mutable std::once_flag lines_once_;
+    mutable PrefixIndex newlines_before_;
+};
+
+#endif // DOCUMENT_SNAPSHOT_H
@@ -0,0 +1,112 @@
+#pragma once
+#include "find_dialog.h"
+#include "thread_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class PieceTable;
+class DocumentSnapshot;
+
+namespace editor {
+
+// A stretch of the document as a transform sees it
+struct TransformChunk {
+    size_t offset = 0;                  // Where text starts in the document
+    std::string text;                   // Whole lines unless split_anywhere
+    std::string output;                 // What replaces text
+    std::vector<int64_t> state;         // scan's summary, then what link hands it
+};
+
+/**
+ * DocumentTransform - a rewrite of the whole document (sort lines, format
+ * JSON) built from per-chunk stages the pipeline runs on every core
+ *
+ * map turns each chunk into its output on the pool. A transform whose
+ * output depends on what came before (JSON's nesting) first scans every
+ * chunk in parallel into a small summary, and link folds the summaries
+ * in document order into the state each chunk starts in; link may also
+ * reject the document. One that combines lines across chunks (sort's
+ * merge) gets every mapped chunk at the end and may move output between
+ * them: only the concatenation matters. map polls the token on long
+ * chunks. Stages run on pool workers and must not touch the editor.
+ */
+struct DocumentTransform {
+    std::string id;                     // "sort_lines", or "<plugin id>.<name>"
+    std::string title;
+    bool split_anywhere = false;        // Chunks may end mid-line (one-line JSON)
+    std::function<void(TransformChunk&)> scan;                                  // Optional
+    std::function<bool(std::vector<TransformChunk>&, std::string& error)> link; // Optional
+    std::function<void(TransformChunk&, const CancellationToken&)> map;
+    std::function<void(std::vector<TransformChunk>&)> combine;                  // Optional
+
+    // Stable byte order of lines (ASCII case folded unless case_sensitive)
+    static DocumentTransform sort_lines(bool case_sensitive = true);
+    // The first of each set of equal lines, in place
+    static DocumentTransform unique_lines();
+    // Leading whitespace redone in tabs or spaces, keeping its width
+    static DocumentTransform reindent(size_t tab_width, bool use_spaces);
+    // One member or element per line, nested by indent spaces
+    static DocumentTransform pretty_json(size_t indent = 2);
+};
+
+/**
+ * TransformPipeline - runs a DocumentTransform over a snapshot in parallel
+ * and applies the result as one undo step
+ *
+ * The snapshot is cut into chunks of about chunk_bytes at line starts and
+ * every stage but link and combine runs on the shared pool, each task
+ * copying its own chunk out. The calling thread takes chunks as well, so
+ * run() may be called from a pool task. Chunks that come out unchanged
+ * are dropped, so apply() replaces only what changed; the undo step points
+ * at the old pieces and the new text instead of holding a copy of the
+ * document.
+ * Progress is reported from workers as chunks finish; a cancelled run
+ * stops at the next chunk and its result is never applied.
+ */
+class TransformPipeline {
+public:
+    static constexpr size_t kChunkBytes = 4 * 1024 * 1024;
+    using ProgressFn = std::function<void(size_t done, size_t total)>;
+
+    struct Result {
+        size_t version = 0;             // Of the snapshot it was computed from
+        size_t chunks = 0;
+        std::vector<ReplaceEdit> edits; // The changed chunks, in document order
+        bool cancelled = false;
+        std::string error;              // Why link rejected the document
+        bool ok() const { return !cancelled && error.empty(); }
+    };
+
+    // Blocks until done; call off the UI thread (a pool task is fine)
+    static Result run(const DocumentSnapshot& snapshot, const DocumentTransform& transform,
+                      CancellationToken cancel = CancellationToken(), ProgressFn progress = nullptr,
+                      size_t chunk_bytes = kChunkBytes);
+    // False (and nothing changes) unless result is ok and the document is
+    // still at its version
+    static bool apply(PieceTable& document, Result& result);
+    // run() on a snapshot of document, then apply()
+    static bool transform(PieceTable& document, const DocumentTransform& transform, size_t chunk_bytes = kChunkBytes);
+};
+
+/**
+ * TransformRegistry - the transforms the editor offers: the built-ins
+ * that take no settings, and any plugins register through PluginAPI
+ */
+class TransformRegistry {
+public:
+    TransformRegistry();
+
+    // Replaces a transform with the same id; false without an id or map
+    bool add(DocumentTransform transform);
+    bool remove(const std::string& id);
+    const DocumentTransform* find(const std::string& id) const;
+    const std::vector<DocumentTransform>& transforms() const { return transforms_; }
+
+private:
+    std::vector<DocumentTransform> transforms_;
+};
+
+} // namespace editor
@@ -0,0 +1,78 @@
+#ifndef DOCUMENT_VIEW_H
+#define DOCUMENT_VIEW_H
+
+#include "piece_table.h"
+#include "viewport.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class CodeFoldingManager;
+
+/**
+ * DocumentView - one view's state over a document other views share
+ *
+ * Split panes show the same PieceTable rather than copies of it: each pane
+ * is a DocumentView with its own cursors and selection, its own scroll
+ * position and soft-wrap layout (a Viewport) and its own folds (a
+ * CodeFoldingManager, created the first time the view folds).
+ *
+ * Every view follows the document's changes, whichever view made them:
+ * cursors and the selection move with the text they were on, the top line
+ * stays on the same text when lines come or go above it, and the edited
+ * lines are collected so the view repaints only those rows.
+ */
+class DocumentView {
+public:
+    DocumentView(size_t visible_lines = 35, size_t visible_columns = 100);
+    ~DocumentView();
+
+    DocumentView(const DocumentView&) = delete;
+    DocumentView& operator=(const DocumentView&) = delete;
+
+    // Show document (nullptr shows nothing); cursors, scroll and folds
+    // start over
+    void set_document(const std::shared_ptr<PieceTable>& document);
+    const std::shared_ptr<PieceTable>& document() const { return document_; }
+
+    Viewport& viewport() { return viewport_; }
+    const Viewport& viewport() const { return viewport_; }
+    CodeFoldingManager& folding();
+    bool has_folding() const { return folding_ != nullptr; }
+
+    // Caret state, kept by the editor and moved by edits from any view
+    size_t cursor_pos = 0;
+    bool has_selection = false;
+    size_t selection_start = 0;
+    size_t selection_end = 0;
+    std::vector<size_t> extra_cursors;
+
+    // Keep the top line on the text it showed before the edits since the
+    // last call; call before laying the view out (the folds must have
+    // seen the edits first)
+    void update();
+    // Lines edited since the last call, as numbered now; last is SIZE_MAX
+    // when lines were added or removed, since every row below moves.
+    // False when nothing changed.
+    bool take_damage(size_t& first_line, size_t& last_line);
+
+    // Where an offset taken before an edit is after it: an offset inside
+    // the removed range, or at the edit, ends up after the inserted text
+    static size_t map_offset(size_t offset, const PieceTable::Change& change);
+
+private:
+    void on_change(const PieceTable::Change& change);
+
+    std::shared_ptr<PieceTable> document_;
+    size_t listener_id_ = 0;
+    Viewport viewport_;
+    std::unique_ptr<CodeFoldingManager> folding_;
+
+    size_t top_line_ = 0;           // Top line as moved by edits, until update()
+    bool top_moved_ = false;
+    size_t damage_first_ = SIZE_MAX;
+    size_t damage_last_ = 0;
+};
+
+#endif // DOCUMENT_VIEW_H
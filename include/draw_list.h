@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace editor {
+
+enum class DrawKind : uint8_t {
+    Rect,   // Filled [x0, x1) x [y0, y1)
+    Line,   // 1px from (x0, y0) to (x1, y1), both ends included
+    Run     // Glyph run at (x0, y0); x1 = cell advance (per display column), 0 for the font's own
+};
+
+// Colors are 0xAARRGGBB throughout
+struct DrawCommand {
+    DrawKind kind;
+    int32_t x0, y0, x1, y1;
+    uint32_t color;             // Rect and Line; Run: opaque background under it, 0 if none
+    uint32_t text_offset;       // Run: bytes in DrawList::text()
+    uint32_t text_length;
+    uint32_t span_offset;       // Run: entries in DrawList::spans()
+    uint32_t span_count;
+};
+
+// Consecutive bytes of a run drawn in one color; a run's spans cover its text
+struct ColorSpan {
+    uint32_t length;
+    uint32_t color;
+};
+
+/**
+ * DrawList - one frame's (or pane's) primitives, recorded for a single submit
+ *
+ * Commands, run text and color spans each live in one contiguous array
+ * that keeps its capacity across clear(), so building a frame does not
+ * allocate once the list has warmed up. A syntax-colored line is one
+ * Run: its bytes are copied once and each token only adds a ColorSpan.
+ * Commands are painted in the order they were added.
+ */
+class DrawList {
+public:
+    void clear();
+
+    void add_rect(int x, int y, int width, int height, uint32_t color);
+    void add_line(int x1, int y1, int x2, int y2, uint32_t color);
+
+    // Opens a run; append_run adds text to it until the next command.
+    // background promises the run's cells are otherwise that solid color,
+    // which lets a renderer reuse an earlier image of the same run.
+    void begin_run(int x, int y, int advance = 0, uint32_t background = 0);
+    void append_run(std::string_view text, uint32_t color);
+    void add_text(std::string_view text, int x, int y, uint32_t color, int advance = 0) {
+        begin_run(x, y, advance);
+        append_run(text, color);
+    }
+
+    const std::vector<DrawCommand>& commands() const { return commands_; }
+    const std::string& text() const { return text_; }
+    const std::vector<ColorSpan>& spans() const { return spans_; }
+
+    std::string_view run_text(const DrawCommand& run) const {
+        return std::string_view(text_).substr(run.text_offset, run.text_length);
+    }
+    bool empty() const { return commands_.empty(); }
+
+private:
+    std::vector<DrawCommand> commands_;
+    std::string text_;
+    std::vector<ColorSpan> spans_;
+};
+
+} // namespace editor
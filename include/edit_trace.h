@@ -0,0 +1,145 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+#include "frame_stats.h"
+#include "piece_table.h"
+#include "text_buffer.h"
+
+namespace editor {
+
+/**
+ * EditTrace - a recorded or generated editing session, for replay
+ *
+ * A trace is a sequence of edit operations in document offsets, each
+ * valid against the text left by the ones before. The file format is
+ * line based so recorded sessions diff and trim by hand:
+ *
+ *     # edit-trace 1
+ *     i <position> <text>          insert
+ *     d <position> <length>        delete
+ *     m <count>                    multi-cursor edit, then count lines
+ *     e <position> <length> <text>   (pre-edit offsets, sorted)
+ *     u / r / b                    undo, redo, break the typing group
+ *
+ * Text escapes \n, \r, \t and \\; the initial text is not stored (replays
+ * name it), so a trace can be replayed over any fixture it fits.
+ */
+struct EditTrace {
+    struct Op {
+        enum class Kind { Insert, Remove, MultiEdit, Undo, Redo, Break };
+        Kind kind = Kind::Insert;
+        size_t position = 0;
+        size_t length = 0;
+        std::string text;
+        std::vector<PieceTable::Edit> edits;    // MultiEdit only
+    };
+
+    std::string name;
+    std::vector<Op> ops;
+
+    void insert(size_t position, std::string text);
+    void remove(size_t position, size_t length);
+    void multi_edit(std::vector<PieceTable::Edit> edits);
+    void undo() { push(Op::Kind::Undo); }
+    void redo() { push(Op::Kind::Redo); }
+    void break_group() { push(Op::Kind::Break); }
+
+    // Edits only; undo, redo and breaks are not counted
+    size_t edit_count() const;
+
+    void write(std::ostream& out) const;
+    // False (with the line number in error) on a malformed line
+    bool read(std::istream& in, std::string* error = nullptr);
+    bool save(const std::string& path) const;
+    bool load(const std::string& path, std::string* error = nullptr);
+
+    // Synthetic sessions over a document of initial_length bytes; the same
+    // seed gives the same trace. All edits stay in range of the text the
+    // trace itself leaves behind.
+    //   typing:       words typed at a few places, with backspaces and undo
+    //   random:       inserts and deletes of 1-64 bytes anywhere
+    //   paste_storm:  pastes of paste_size bytes and cuts of about as much
+    //   multi_cursor: bursts of keystrokes at `cursors` carets at once
+    static EditTrace typing(size_t initial_length, size_t keystrokes, uint32_t seed = 1);
+    static EditTrace random(size_t initial_length, size_t ops, uint32_t seed = 1);
+    static EditTrace paste_storm(size_t initial_length, size_t pastes, size_t paste_size = 4096, uint32_t seed = 1);
+    static EditTrace multi_cursor(size_t initial_length, size_t bursts, size_t cursors = 32, uint32_t seed = 1);
+
+private:
+    void push(Op::Kind kind) {
+        Op op;
+        op.kind = kind;
+        ops.push_back(std::move(op));
+    }
+};
+
+/**
+ * EditTraceRecorder - records a live document's edits as a trace
+ *
+ * Listens to the document's changes, so everything that edits it (typing,
+ * multi-cursor, undo, plugins) lands in the trace as plain edits; undo is
+ * recorded as the edits it made, not as an undo.
+ */
+class EditTraceRecorder {
+public:
+    EditTraceRecorder() = default;
+    ~EditTraceRecorder();
+
+    EditTraceRecorder(const EditTraceRecorder&) = delete;
+    EditTraceRecorder& operator=(const EditTraceRecorder&) = delete;
+
+    // Start recording document; nullptr stops
+    void attach(const std::shared_ptr<PieceTable>& document);
+    const EditTrace& trace() const { return trace_; }
+    EditTrace& trace() { return trace_; }
+
+private:
+    std::shared_ptr<PieceTable> document_;
+    size_t listener_id_ = 0;
+    EditTrace trace_;
+};
+
+/**
+ * ReplayResult - throughput and per-operation latency of one replay
+ *
+ * Latency samples are nanoseconds (LatencyHistogram is unit agnostic), one
+ * per trace operation.
+ */
+struct ReplayResult {
+    std::string target;         // "PieceTable", "pipeline", ...
+    std::string trace;
+    size_t ops = 0;             // Operations timed (buffers skip breaks)
+    double seconds = 0.0;
+    LatencyHistogram latency_ns;
+    std::string final_text;
+
+    double ops_per_second() const { return seconds > 0.0 ? ops / seconds : 0.0; }
+    // "PieceTable  typing  120000 ops  8.1 Mops/s  p50 90 ns  p99 410 ns  max 12.0 us"
+    std::string format() const;
+};
+
+// Replay trace over a fresh buffer of the given backend holding initial
+ReplayResult replay(const EditTrace& trace, const std::string& initial, TextBufferBackend backend);
+
+/**
+ * PipelineCounters - work the GUI-less edit pipeline did during a replay
+ */
+struct PipelineCounters {
+    size_t tokenized_lines = 0;     // HighlightCache re-tokenizing after edits
+    size_t lsp_batches = 0;         // Non-empty LspDocumentSync::take() calls
+    size_t lsp_changes = 0;
+    size_t undo_steps = 0;          // Left on the UndoManager at the end
+};
+
+// Replay through what an edit costs short of painting: UndoManager
+// commands (keystrokes merged as typing is), the highlight cache
+// re-tokenizing the edited line, and LSP didChange changes taken every
+// lsp_batch operations (one debounce window of typing)
+ReplayResult replay_pipeline(const EditTrace& trace, const std::string& initial, size_t lsp_batch = 8,
+                             PipelineCounters* counters = nullptr);
+
+} // namespace editor
@@ -1,29 +1,38 @@
+#ifndef EDITOR_CORE_H
+#define EDITOR_CORE_H
+
 #include "gap_buffer.h"
+#include <string>
 
+/**
+ * EditorCore - minimal editor over a GapBuffer, the small-file fast path
+ *
+ * Positional edits move the gap to the edit; typing at the cursor is an
+ * append into the gap.
+ */
 class EditorCore {
 public:
-    EditorCore() : buffer(1024) {}
-
-    void insert_text(const std::string& text) {
-        buffer.insert(text);
-    }
+    EditorCore();
 
-    void move_cursor(size_t pos) {
-        buffer.move_cursor(pos);
-    }
+    bool open(const std::string& filename);
+    bool save(const std::string& filename);
 
-    void erase(size_t count) {
-        buffer.erase(count);
-    }
+    // Edits at an explicit position
+    void insert(size_t pos, const std::string& text);
+    void erase(size_t pos, size_t len);
 
-    std::string get_text() const {
-        return buffer.get_text();
-    }
+    // Edits at the cursor
+    void insert_text(const std::string& text) { buffer_.insert(text); }
+    void move_cursor(size_t pos) { buffer_.move_cursor(pos); }
+    void erase(size_t count) { buffer_.erase(count); }
 
-    size_t length() const {
-        return buffer.length();
-    }
+    std::string get_text() const;
+    size_t length() const { return buffer_.length(); }
+    void clear();
 
 private:
-    GapBuffer buffer;
-};
\ No newline at end of file
+    GapBuffer buffer_;
+    std::string filename_;
+};
+
+#endif // EDITOR_CORE_H
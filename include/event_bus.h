@@ -0,0 +1,103 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include "plugin_api.h"
+
+class PieceTable;
+
+namespace editor {
+
+// One event of a frame. DocumentChanged: bytes [position, position +
+// length) were replaced by inserted bytes. SelectionChanged: the selection
+// is [position, position + length). CursorMoved: the caret is at position.
+// The other events concern the document as a whole.
+struct EventRecord {
+    EditorEvent type = EditorEvent::DocumentChanged;
+    int document = 0;
+    size_t position = 0;
+    size_t length = 0;
+    size_t inserted = 0;
+};
+
+// Which records a listener is given
+struct EventFilter {
+    static constexpr int kAnyDocument = -1;
+    static constexpr uint32_t kAllTypes = 0xFFFFFFFF;
+
+    uint32_t types = kAllTypes;         // Bits of type_bit()
+    int document = kAnyDocument;
+
+    static uint32_t type_bit(EditorEvent type) { return 1u << static_cast<uint32_t>(type); }
+    bool matches(const EventRecord& record) const {
+        return (types & type_bit(record.type)) && (document == kAnyDocument || document == record.document);
+    }
+};
+
+// A listener's records for one frame, contiguous and in publish order;
+// valid only during the call
+struct EventBatch {
+    const EventRecord* records = nullptr;
+    size_t count = 0;
+
+    const EventRecord* begin() const { return records; }
+    const EventRecord* end() const { return records + count; }
+};
+
+/**
+ * EventBus - editor events delivered once per frame, in batches
+ *
+ * publish() only appends a record; flush(), once per frame, hands each
+ * listener every record its filter accepts in a single call, and skips a
+ * listener altogether when nothing in the frame concerns it. Records are
+ * merged as they arrive: typing that extends the previous insertion, and
+ * deletions running on from the previous one, grow that record instead of
+ * adding another, and only the last cursor and selection of a document
+ * survive a frame. A paste, a replace-all or a burst of keystrokes thus
+ * costs each interested listener one call over a compact edit list.
+ *
+ * Used from the UI thread. Listeners may publish (the records go to the
+ * next frame), subscribe and unsubscribe while being called.
+ */
+class EventBus {
+public:
+    using Listener = std::function<void(const EventBatch& batch)>;
+
+    size_t subscribe(const EventFilter& filter, Listener listener);
+    void unsubscribe(size_t id);
+
+    void publish(const EventRecord& record);
+    // Publishes the document's edits as DocumentChanged records; returns
+    // the change listener id, for document.remove_change_listener()
+    size_t watch_document(PieceTable& document, int document_id);
+
+    // Delivers the frame's records; returns the number of listeners called
+    size_t flush();
+    size_t pending() const { return records_.size() - dead_count_; }
+
+private:
+    struct Subscriber {
+        size_t id;
+        EventFilter filter;
+        Listener listener;
+        bool removed = false;
+    };
+
+    // Merges record into the last edit of its document when they adjoin
+    bool merge_edit(const EventRecord& record);
+
+    std::vector<EventRecord> records_;
+    std::vector<uint8_t> dead_;                 // Replaced by a later cursor or selection record
+    size_t dead_count_ = 0;
+    std::unordered_map<uint64_t, size_t> latest_;   // (document, type) -> record index this frame
+    std::vector<EventRecord> delivering_;
+    std::vector<EventRecord> scratch_;          // One listener's filtered records
+    std::vector<Subscriber> subscribers_;
+    std::vector<Subscriber> added_;             // Subscribed during flush()
+    bool flushing_ = false;
+    size_t next_id_ = 1;
+};
+
+} // namespace editor
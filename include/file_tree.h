@@ -5,6 +5,9 @@
 #include <windows.h>
 #include <commctrl.h>
 #include <filesystem>
+#include <algorithm>
+#include "file_watcher.h"
+#include "gitignore.h"
 
 namespace fs = std::filesystem;
 
@@ -13,25 +16,43 @@ struct TreeNode {
     std::string full_path;
     bool is_directory;
     bool is_expanded;
-    HTREEITEM tree_item;  // Win32 TreeView handle
+    bool is_loaded;       // Children scanned; directories are read on first expand
+    HTREEITEM tree_item;  // Win32 TreeView handle, null while not shown
+    TreeNode* parent;
     std::vector<std::unique_ptr<TreeNode>> children;
     
-    TreeNode(const std::string& name, const std::string& path, bool is_dir)
+    TreeNode(const std::string& name, const std::string& path, bool is_dir, TreeNode* parent = nullptr)
         : name(name)
         , full_path(path)
         , is_directory(is_dir)
         , is_expanded(false)
-        , tree_item(nullptr) {}
+        , is_loaded(false)
+        , tree_item(nullptr)
+        , parent(parent) {}
 };
 
+/**
+ * FileTree - workspace tree behind the Win32 TreeView
+ *
+ * Directories are read one level at a time when first expanded, so opening
+ * a large repository costs a single directory listing. TreeView items exist
+ * only for the children of expanded directories: collapsing a directory
+ * deletes its items again (the scanned nodes stay cached and are kept
+ * current by apply_changes), so the control's item count follows what can
+ * actually be scrolled to rather than the size of the workspace. Entry
+ * types come from the directory iterator's cached data, and .gitignore
+ * files are honoured as their directories are read; .git is never shown.
+ */
 class FileTree {
 public:
     FileTree() : root_(nullptr), tree_hwnd_(nullptr) {}
     
-    // Load directory structure
+    // Load the root directory's entries (deeper levels load on expansion)
     void load_directory(const std::string& path) {
         root_path_ = path;
-        root_ = scan_directory(path);
+        ignore_.clear();
+        root_ = std::make_unique<TreeNode>(fs::path(path).filename().string(), path, true);
+        load_children(root_.get());
     }
     
     // Get root node
@@ -40,27 +61,76 @@ public:
     // Set the Win32 TreeView control handle
     void set_tree_control(HWND hwnd) { tree_hwnd_ = hwnd; }
     
-    // Populate Win32 TreeView control
+    // Populate Win32 TreeView control with the root and its entries
     void populate_tree_view() {
         if (!tree_hwnd_ || !root_) return;
         
         // Clear existing items
         TreeView_DeleteAllItems(tree_hwnd_);
+        forget_items(root_.get());
         
-        // Add root and children
-        populate_node(TVI_ROOT, root_.get());
+        insert_item(TVI_ROOT, root_.get(), TVI_LAST);
+        expand_node(root_.get());
     }
 
+    // Rescan from the root, keeping expanded directories expanded
     void reload() {
         if (root_path_.empty()) return;
-        root_ = scan_directory(root_path_);
+        std::vector<std::string> expanded;
+        if (root_) collect_expanded(root_.get(), expanded);
+        load_directory(root_path_);
         populate_tree_view();
+        for (const std::string& path : expanded) {
+            TreeNode* node = find_node_by_path(path);
+            if (node && node->is_directory) expand_node(node);
+        }
+    }
+    
+    // TVN_ITEMEXPANDING (TVE_EXPAND): read the directory if needed and
+    // create items for its children. Safe to call for expanded items.
+    void on_item_expanding(HTREEITEM item) {
+        TreeNode* node = find_node_by_item(item);
+        if (node && node->is_directory) show_children(node);
+    }
+    
+    // TVN_ITEMEXPANDED (TVE_COLLAPSE): delete the children's items again
+    void on_item_collapsed(HTREEITEM item) {
+        TreeNode* node = find_node_by_item(item);
+        if (!node || !node->is_directory || !tree_hwnd_) return;
+        node->is_expanded = false;
+        for (auto& child : node->children) forget_items(child.get());
+        TreeView_Expand(tree_hwnd_, item, TVE_COLLAPSE | TVE_COLLAPSERESET);
     }
     
-    // Find node by TreeView item handle
+    // Apply a FileWatcher batch in place: nodes and their TreeView items are
+    // added or removed under the parent instead of rescanning everything.
+    // Changes inside directories that were never expanded cost nothing.
+    void apply_changes(const std::vector<editor::FileChange>& changes) {
+        for (const auto& change : changes) {
+            bool lost_events = change.is_directory && fs::path(change.path) == fs::path(root_path_);
+            if (lost_events || fs::path(change.path).filename() == ".gitignore") {
+                reload();   // Events were lost, or the ignore rules changed
+                return;
+            }
+            if (change.kind == editor::FileChange::Kind::Removed) {
+                remove_path(change.path);
+            } else if (change.kind == editor::FileChange::Kind::Created) {
+                add_path(change.path);
+            } else if (change.is_directory) {
+                remove_path(change.path);
+                add_path(change.path);
+            }
+        }
+    }
+    
+    // Find node by TreeView item handle (items carry their node as lParam)
     TreeNode* find_node_by_item(HTREEITEM item) {
-        if (!root_) return nullptr;
-        return find_node_recursive(root_.get(), item);
+        if (!tree_hwnd_ || !item) return nullptr;
+        TVITEMA tvi = {};
+        tvi.mask = TVIF_PARAM;
+        tvi.hItem = item;
+        if (!TreeView_GetItem(tree_hwnd_, &tvi)) return nullptr;
+        return reinterpret_cast<TreeNode*>(tvi.lParam);
     }
     
     // Get file icon index based on extension
@@ -86,82 +156,166 @@ private:
     std::string root_path_;
     std::unique_ptr<TreeNode> root_;
     HWND tree_hwnd_;
+    GitIgnore ignore_;  // Patterns of every .gitignore read so far
     
-    // Recursively scan directory
-    std::unique_ptr<TreeNode> scan_directory(const std::string& path) {
-        fs::path p(path);
-        
-        if (!fs::exists(p)) return nullptr;
-        
-        auto node = std::make_unique<TreeNode>(
-            p.filename().string(),
-            path,
-            fs::is_directory(p)
-        );
+    // '/'-separated path below the root, "" for the root itself
+    std::string relative_path(const std::string& path) const {
+        std::string relative = fs::path(path).lexically_relative(root_path_).generic_string();
+        return relative == "." ? std::string() : relative;
+    }
+    
+    // Read one directory level; types come from the iterator's cached
+    // entry data instead of a stat per comparison
+    void load_children(TreeNode* node) {
+        node->is_loaded = true;
+        std::string relative = relative_path(node->full_path);
+        ignore_.load_file(node->full_path, relative);
         
-        if (fs::is_directory(p)) {
-            try {
-                std::vector<fs::path> entries;
-                for (const auto& entry : fs::directory_iterator(p)) {
-                    entries.push_back(entry.path());
-                }
-                
-                // Sort: directories first, then alphabetically
-                std::sort(entries.begin(), entries.end(), [](const fs::path& a, const fs::path& b) {
-                    bool a_is_dir = fs::is_directory(a);
-                    bool b_is_dir = fs::is_directory(b);
-                    if (a_is_dir != b_is_dir) return a_is_dir > b_is_dir;
-                    return a.filename().string() < b.filename().string();
-                });
-                
-                // Recursively add children
-                for (const auto& entry : entries) {
-                    auto child = scan_directory(entry.string());
-                    if (child) {
-                        node->children.push_back(std::move(child));
-                    }
-                }
-            } catch (const fs::filesystem_error&) {
-                // Skip directories we can't read
-            }
+        std::vector<std::unique_ptr<TreeNode>> children;
+        std::error_code ec;
+        for (fs::directory_iterator it(node->full_path, ec), end; !ec && it != end; it.increment(ec)) {
+            std::error_code type_ec;
+            bool is_dir = it->is_directory(type_ec);
+            std::string name = it->path().filename().string();
+            if (is_hidden(relative.empty() ? name : relative + "/" + name, name, is_dir)) continue;
+            children.push_back(std::make_unique<TreeNode>(name, it->path().string(), is_dir, node));
+        }
+        std::sort(children.begin(), children.end(),
+                  [](const auto& a, const auto& b) { return sorts_before(*a, *b); });
+        node->children = std::move(children);
+    }
+    
+    bool is_hidden(const std::string& relative, const std::string& name, bool is_dir) const {
+        return (is_dir && name == ".git") || ignore_.is_ignored(relative, is_dir);
+    }
+    
+    // Directories first, then alphabetically
+    static bool sorts_before(const TreeNode& a, const TreeNode& b) {
+        if (a.is_directory != b.is_directory) return a.is_directory;
+        return a.name < b.name;
+    }
+    
+    void show_children(TreeNode* node) {
+        if (!node->is_loaded) load_children(node);
+        node->is_expanded = true;
+        if (!tree_hwnd_ || !node->tree_item) return;
+        for (auto& child : node->children) {
+            if (!child->tree_item) insert_item(node->tree_item, child.get(), TVI_LAST);
+        }
+        update_has_children(node);
+    }
+    
+    void expand_node(TreeNode* node) {
+        show_children(node);
+        if (tree_hwnd_ && node->tree_item) TreeView_Expand(tree_hwnd_, node->tree_item, TVE_EXPAND);
+    }
+    
+    // Item handles below a node die with the items (collapse reset, clear)
+    static void forget_items(TreeNode* node) {
+        node->tree_item = nullptr;
+        node->is_expanded = false;
+        for (auto& child : node->children) forget_items(child.get());
+    }
+    
+    static void collect_expanded(const TreeNode* node, std::vector<std::string>& paths) {
+        for (const auto& child : node->children) {
+            if (!child->is_expanded) continue;
+            paths.push_back(child->full_path);     // Parents before children
+            collect_expanded(child.get(), paths);
+        }
+    }
+    
+    // Loaded parent of a path below the root, and the path's last component
+    TreeNode* find_parent(const std::string& path, std::string& name) {
+        if (!root_) return nullptr;
+        std::vector<std::string> parts;
+        for (const auto& part : fs::path(path).lexically_relative(root_path_)) {
+            parts.push_back(part.string());
         }
+        if (parts.empty() || parts[0] == "." || parts[0] == "..") return nullptr;
         
-        return node;
+        TreeNode* node = root_.get();
+        for (size_t i = 0; i + 1 < parts.size() && node; ++i) {
+            auto it = std::find_if(node->children.begin(), node->children.end(),
+                                   [&](const auto& child) { return child->name == parts[i]; });
+            node = it != node->children.end() && (*it)->is_directory ? it->get() : nullptr;
+        }
+        name = parts.back();
+        return node && node->is_loaded ? node : nullptr;
     }
     
-    // Populate TreeView with nodes
-    void populate_node(HTREEITEM parent, TreeNode* node) {
-        if (!node) return;
+    TreeNode* find_node_by_path(const std::string& path) {
+        std::string name;
+        TreeNode* parent = find_parent(path, name);
+        if (!parent) return nullptr;
+        for (auto& child : parent->children) {
+            if (child->name == name) return child.get();
+        }
+        return nullptr;
+    }
+    
+    void add_path(const std::string& path) {
+        std::string name;
+        TreeNode* parent = find_parent(path, name);
+        if (!parent) return;        // Not loaded yet: read when expanded
+        auto& siblings = parent->children;
+        for (const auto& child : siblings) {
+            if (child->name == name) return;
+        }
+        std::error_code ec;
+        fs::directory_entry entry(path, ec);
+        if (ec || !entry.exists(ec)) return;
+        bool is_dir = entry.is_directory(ec);
+        std::string relative = relative_path(path);
+        if (is_hidden(relative, name, is_dir)) return;
         
+        auto node = std::make_unique<TreeNode>(name, path, is_dir, parent);
+        auto pos = std::find_if(siblings.begin(), siblings.end(),
+                                [&](const auto& sibling) { return sorts_before(*node, *sibling); });
+        HTREEITEM after = pos == siblings.begin() ? TVI_FIRST : (*(pos - 1))->tree_item;
+        TreeNode* added = node.get();
+        siblings.insert(pos, std::move(node));
+        if (tree_hwnd_ && parent->tree_item) {
+            if (parent->is_expanded && after) insert_item(parent->tree_item, added, after);
+            update_has_children(parent);
+        }
+    }
+    
+    void remove_path(const std::string& path) {
+        std::string name;
+        TreeNode* parent = find_parent(path, name);
+        if (!parent) return;
+        auto& siblings = parent->children;
+        auto it = std::find_if(siblings.begin(), siblings.end(),
+                               [&](const auto& child) { return child->name == name; });
+        if (it == siblings.end()) return;
+        if (tree_hwnd_ && (*it)->tree_item) TreeView_DeleteItem(tree_hwnd_, (*it)->tree_item);
+        siblings.erase(it);
+        if (tree_hwnd_ && parent->tree_item) update_has_children(parent);
+    }
+    
+    void update_has_children(TreeNode* node) {
+        TVITEMA item = {};
+        item.mask = TVIF_CHILDREN;
+        item.hItem = node->tree_item;
+        item.cChildren = node->children.empty() ? 0 : 1;
+        TreeView_SetItem(tree_hwnd_, &item);
+    }
+    
+    // Insert one item; unread directories get an expand button until a
+    // first expansion shows whether they have entries
+    void insert_item(HTREEITEM parent, TreeNode* node, HTREEITEM insert_after) {
         TVINSERTSTRUCTA tvis = {};
         tvis.hParent = parent;
-        tvis.hInsertAfter = TVI_LAST;
+        tvis.hInsertAfter = insert_after;
         tvis.item.mask = TVIF_TEXT | TVIF_PARAM | TVIF_CHILDREN | TVIF_IMAGE | TVIF_SELECTEDIMAGE;
         tvis.item.pszText = const_cast<char*>(node->name.c_str());
         tvis.item.lParam = reinterpret_cast<LPARAM>(node);
-        tvis.item.cChildren = node->is_directory && !node->children.empty() ? 1 : 0;
+        tvis.item.cChildren = node->is_directory && (!node->is_loaded || !node->children.empty()) ? 1 : 0;
         int icon_idx = get_icon_index(node->name, node->is_directory);
         tvis.item.iImage = icon_idx;
         tvis.item.iSelectedImage = icon_idx;
         
         node->tree_item = TreeView_InsertItem(tree_hwnd_, &tvis);
-        
-        // Add children
-        for (auto& child : node->children) {
-            populate_node(node->tree_item, child.get());
-        }
-    }
-    
-    // Find node by TreeView item handle recursively
-    TreeNode* find_node_recursive(TreeNode* node, HTREEITEM item) {
-        if (!node) return nullptr;
-        if (node->tree_item == item) return node;
-        
-        for (auto& child : node->children) {
-            TreeNode* found = find_node_recursive(child.get(), item);
-            if (found) return found;
-        }
-        
-        return nullptr;
     }
 };
@@ -0,0 +1,115 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace editor {
+
+// One coalesced change below a watched root. Paths are the root joined
+// with the relative path, in the platform's separator.
+struct FileChange {
+    enum class Kind {
+        Created,
+        Modified,
+        Removed
+    };
+    Kind kind;
+    std::string path;
+    // Known for Created/Modified; Removed entries may be directories even
+    // when false (Windows does not say), so consumers drop whole subtrees
+    bool is_directory = false;
+};
+
+// Whether a path lies inside one of the roots and outside the directories
+// workspace crawls skip: anything starting with '.' and node_modules
+inline bool is_in_workspace(const std::vector<std::string>& roots, const std::string& path) {
+    for (const std::string& root : roots) {
+        std::filesystem::path relative = std::filesystem::path(path).lexically_relative(root);
+        if (relative.empty()) continue;
+        if (relative.native() == std::filesystem::path(".").native()) return true;
+        bool skipped = false;
+        for (const std::filesystem::path& part : relative) {
+            std::string name = part.string();
+            if (name.empty() || name[0] == '.' || name == "node_modules") {   // Also "..": outside the root
+                skipped = true;
+                break;
+            }
+        }
+        if (!skipped) return true;
+    }
+    return false;
+}
+
+// Recursive directory watcher: inotify on Linux, FSEvents on macOS and
+// ReadDirectoryChangesW on Windows. Raw events are coalesced per path and
+// delivered as one sorted batch once the tree has been quiet for the
+// debounce interval (or kMaxLatency after the first event of a burst), so
+// a checkout or build touching thousands of files costs one callback.
+//
+// Like the indexer crawl, directories starting with '.' and node_modules
+// are ignored - except the files directly inside <root>/.git (HEAD, index,
+// ...), which is how commits and checkouts become visible. When the
+// platform drops events (queue overflow) the root is reported as a
+// Modified directory and consumers rescan it.
+class FileWatcher {
+public:
+    using Callback = std::function<void(const std::vector<FileChange>& changes)>;
+
+    static constexpr std::chrono::milliseconds kDefaultDebounce{100};
+    static constexpr std::chrono::milliseconds kMaxLatency{1000};
+
+    FileWatcher();
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Watch root recursively. The callback runs on the watcher's own thread;
+    // GUI consumers marshal the batch to their UI thread. Restarts if already
+    // watching. Returns false if the platform watch could not be set up.
+    bool start(const std::string& root, Callback callback,
+               std::chrono::milliseconds debounce = kDefaultDebounce);
+    // Stop and join; pending (undelivered) changes are dropped. Must not be
+    // called from the callback.
+    void stop();
+
+    bool is_running() const { return running_; }
+    const std::string& get_root() const { return root_; }
+
+    // Whether a path relative to the root is outside the watched set
+    static bool is_ignored(const std::string& relative_path);
+
+private:
+    struct Backend;
+
+    // Called by the backend for every raw event
+    void record(FileChange::Kind kind, const std::string& path, bool is_directory);
+    void dispatch_loop();
+
+    std::string root_;
+    Callback callback_;
+    std::chrono::milliseconds debounce_{kDefaultDebounce};
+    std::unique_ptr<Backend> backend_;
+    std::thread dispatcher_;
+    bool running_ = false;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::map<std::string, FileChange> pending_;     // Sorted: parents first
+    std::chrono::steady_clock::time_point first_event_;
+    std::chrono::steady_clock::time_point last_event_;
+    bool stopping_ = false;
+};
+
+} // namespace editor
+
+#endif // FILE_WATCHER_H
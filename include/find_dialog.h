@@ -2,9 +2,15 @@
 #define FIND_DIALOG_H
 
 #include <windows.h>
+#include <functional>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
+class PieceTable;
+class RegexEngine;
+
 /**
  * SearchMatch represents a single match in the document
  */
@@ -15,8 +21,27 @@ struct SearchMatch {
     size_t length;    // Length of match
 };
 
+/**
+ * ReplaceEdit - one planned replacement; the document is left untouched
+ */
+struct ReplaceEdit {
+    size_t position;            // Start of the match
+    size_t length;              // Bytes replaced
+    std::string text;           // Replacement, with $n already expanded
+};
+
 /**
  * FindDialog - Implements find and replace functionality
+ *
+ * Searches stream over the document's chunks (PieceTable pieces, or a
+ * single std::string) with a Boyer-Moore-Horspool matcher, so the document
+ * is never copied into one string. Case-insensitive matching folds bytes
+ * through a table instead of lowercasing copies, line and column advance
+ * incrementally from the previous match, and matches may span chunks.
+ *
+ * With set_use_regex the search text is a RegexEngine pattern (compiled
+ * once and reused through its cache), empty matches are skipped, and
+ * replacements expand $0-$9 / ${n} from the match's groups.
  */
 class FindDialog {
 public:
@@ -40,6 +65,17 @@ public:
                        size_t start_pos,
                        SearchMatch& match);
     
+    // Same searches straight over a document's pieces
+    std::vector<SearchMatch> find_all(const PieceTable& document, const std::string& search_text);
+    // Matches starting in [begin, end), in order, until visit returns false.
+    // Literal matches may overlap when asked; regex matches never do, and
+    // only see the text up to the end of the line holding end.
+    void scan_range(const PieceTable& document, const std::string& search_text, size_t begin, size_t end,
+                    bool overlapping, const std::function<bool(const SearchMatch& match)>& visit);
+    bool find_next(const PieceTable& document, const std::string& search_text, size_t start_pos, SearchMatch& match);
+    bool find_previous(const PieceTable& document, const std::string& search_text, size_t start_pos,
+                       SearchMatch& match);
+    
     // Replace operations  
     bool replace_current(std::string& document_text,
                         const SearchMatch& match,
@@ -49,12 +85,20 @@ public:
                     const std::string& search_text,
                     const std::string& replace_text);
     
+    // The edits replace_all would make, in document order, without making them
+    std::vector<ReplaceEdit> plan_replace_all(const PieceTable& document, const std::string& search_text,
+                                              const std::string& replace_text);
+    // Apply planned edits back to front, so earlier offsets stay valid
+    static void apply_edits(PieceTable& document, const std::vector<ReplaceEdit>& edits);
+    
     // Settings
     void set_case_sensitive(bool enabled) { case_sensitive_ = enabled; }
     bool is_case_sensitive() const { return case_sensitive_; }
     
     void set_use_regex(bool enabled) { use_regex_ = enabled; }
     bool is_use_regex() const { return use_regex_; }
+    // Why the last regex search text did not compile ("" if it did)
+    const std::string& get_regex_error() const { return regex_error_; }
     
     // Match navigation
     void set_matches(const std::vector<SearchMatch>& matches) {
@@ -62,6 +106,16 @@ public:
         current_match_index_ = 0;
     }
     
+    // Replace the matches but stay on the current one (or the next after it)
+    void update_matches(const std::vector<SearchMatch>& matches) {
+        size_t position = current_match_index_ < matches_.size() ? matches_[current_match_index_].position : 0;
+        matches_ = matches;
+        current_match_index_ = 0;
+        while (current_match_index_ + 1 < matches_.size() && matches_[current_match_index_].position < position) {
+            current_match_index_++;
+        }
+    }
+    
     size_t get_current_match_index() const { return current_match_index_; }
     size_t get_match_count() const { return matches_.size(); }
     
@@ -100,11 +154,14 @@ private:
     bool use_regex_;
     std::vector<SearchMatch> matches_;
     size_t current_match_index_;
+    std::string regex_error_;
+    std::shared_ptr<const RegexEngine> last_regex_;     // For replace_current's groups
     
-    bool matches_at_position(const std::string& text, size_t pos, 
-                             const std::string& search_text) const;
+    // nullptr (and regex_error_ set) when the pattern does not compile
+    std::shared_ptr<const RegexEngine> compile_regex(const std::string& pattern);
     
-    std::string to_lower(const std::string& str) const;
+    // Window scanned per step by find_previous, walking back from the cursor
+    static constexpr size_t kBackwardWindow = 64 * 1024;
 };
 
 #endif // FIND_DIALOG_H
@@ -0,0 +1,115 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "plugin_api.h"
+
+namespace editor {
+
+/**
+ * LatencyHistogram - microsecond samples in log-linear buckets
+ *
+ * HDR-style: each power of two is split into 32 linear sub-buckets, so a
+ * recorded value is known to about 3% at any magnitude while the whole
+ * histogram stays a fixed array. Values below 32 us are exact. Percentiles
+ * report the upper edge of their bucket (never above the true maximum).
+ */
+class LatencyHistogram {
+public:
+    static constexpr size_t kSubBuckets = 32;
+    static constexpr size_t kBuckets = 60 * kSubBuckets;
+
+    LatencyHistogram() : counts_(kBuckets, 0) {}
+
+    void record(uint64_t micros);
+    void reset();
+
+    uint64_t count() const { return count_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0.0; }
+    // p in [0, 100]; 0 when empty
+    uint64_t percentile(double p) const;
+
+    static size_t bucket_of(uint64_t micros);
+    static uint64_t bucket_upper(size_t bucket);
+
+private:
+    std::vector<uint64_t> counts_;
+    uint64_t count_ = 0;
+    uint64_t max_ = 0;
+    uint64_t sum_ = 0;
+};
+
+/**
+ * FrameStats - input latency, paint phases and frame pacing for the HUD
+ *
+ * Input latency runs from the oldest keystroke not yet on screen to the
+ * paint that presents it. Frame intervals are the gaps between presents
+ * while the editor is busy; a gap longer than kIdleGap is idle time and
+ * is not a frame. Paint phases are timed by the caller with Timer.
+ *
+ * The same numbers are readable as settings, "perf.<metric>.<stat>" with
+ * stat one of p50, p99, max (milliseconds) or count, so a plugin host can
+ * forward them through PluginAPI::get_setting; reset_command() is the
+ * matching command. UI thread only.
+ */
+class FrameStats {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Metric {
+        InputLatency,
+        FrameInterval,
+        Paint,          // Whole WM_PAINT
+        Highlight,      // Scheduling and fetching tokens
+        TextDraw,
+        Minimap,
+        Terminal,
+        Count
+    };
+    static constexpr size_t kMetrics = static_cast<size_t>(Metric::Count);
+    static constexpr std::chrono::milliseconds kIdleGap{250};
+
+    static const char* name(Metric metric);
+
+    void note_input(Clock::time_point when = Clock::now());
+    // The pending input changed nothing on screen: no latency to measure
+    void drop_input() { input_pending_ = false; }
+    bool input_pending() const { return input_pending_; }
+    // A frame reached the screen
+    void frame_presented(Clock::time_point when = Clock::now());
+    void record(Metric metric, Clock::duration elapsed);
+    void reset();
+
+    const LatencyHistogram& histogram(Metric metric) const { return histograms_[static_cast<size_t>(metric)]; }
+    // "p50 0.42  p99 3.10  max 8.77 ms" for the HUD
+    std::string summary(Metric metric) const;
+
+    bool get_setting(const std::string& key, std::string& value) const;
+    std::vector<std::string> setting_keys() const;
+    Command reset_command();
+
+    // Times one phase of a frame
+    class Timer {
+    public:
+        Timer(FrameStats& stats, Metric metric) : stats_(stats), metric_(metric), start_(Clock::now()) {}
+        ~Timer() { stats_.record(metric_, Clock::now() - start_); }
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+    private:
+        FrameStats& stats_;
+        Metric metric_;
+        Clock::time_point start_;
+    };
+
+private:
+    LatencyHistogram histograms_[kMetrics];
+    bool input_pending_ = false;
+    Clock::time_point oldest_input_{};
+    bool presented_ = false;
+    Clock::time_point last_present_{};
+};
+
+} // namespace editor
@@ -1,68 +1,144 @@
 #ifndef GAP_BUFFER_H
 #define GAP_BUFFER_H
 
-#include <vector>
 #include <string>
+#include <string_view>
+#include <memory>
+#include <cstring>
+#include <algorithm>
 
+/**
+ * GapBuffer - contiguous text with a movable gap at the cursor
+ *
+ * Text before the cursor sits at the front of the storage and text after
+ * it at the back. Moving the cursor is one memmove of the bytes between
+ * the old and new position, inserting at the cursor is a memcpy into the
+ * gap, and deleting just widens the gap. Storage grows geometrically and
+ * is never zero-filled.
+ */
 class GapBuffer {
 public:
     GapBuffer(size_t initial_capacity = 1024)
-        : buffer(initial_capacity, '\0'), gap_start(0), gap_end(initial_capacity) {}
+        : buffer(initial_capacity ? new char[initial_capacity] : nullptr)
+        , capacity(initial_capacity), gap_start(0), gap_end(initial_capacity) {}
 
     void insert(char c) {
-        if (gap_start == gap_end) expand();
+        if (gap_start == gap_end) reserve_gap(1);
         buffer[gap_start++] = c;
     }
 
+    // Insert at the cursor; the cursor ends up after the new text
     void insert(const std::string& str) {
-        for (char c : str) insert(c);
+        insert(str.data(), str.size());
+    }
+
+    void insert(const char* data, size_t size) {
+        if (size == 0) return;
+        if (gap_end - gap_start < size) reserve_gap(size);
+        std::memcpy(buffer.get() + gap_start, data, size);
+        gap_start += size;
+    }
+
+    void insert(size_t pos, const std::string& str) {
+        move_cursor(pos);
+        insert(str);
     }
 
     void move_cursor(size_t pos) {
+        pos = (std::min)(pos, length());
         if (pos < gap_start) {
-            // Move gap left
-            while (gap_start > pos) {
-                buffer[--gap_end] = buffer[--gap_start];
-            }
+            // Bytes [pos, gap_start) move to the back of the gap
+            size_t count = gap_start - pos;
+            std::memmove(buffer.get() + gap_end - count, buffer.get() + pos, count);
+            gap_start -= count;
+            gap_end -= count;
         } else if (pos > gap_start) {
-            // Move gap right
-            while (gap_start < pos) {
-                buffer[gap_start++] = buffer[gap_end++];
-            }
+            // Bytes after the gap up to pos move to its front
+            size_t count = pos - gap_start;
+            std::memmove(buffer.get() + gap_start, buffer.get() + gap_end, count);
+            gap_start += count;
+            gap_end += count;
         }
     }
 
+    size_t cursor() const { return gap_start; }
+
+    // Delete count bytes after the cursor
     void erase(size_t count) {
-        gap_end += count;
-        if (gap_end > buffer.size()) gap_end = buffer.size();
+        gap_end += (std::min)(count, capacity - gap_end);
+    }
+
+    // Delete count bytes before the cursor (backspace)
+    void erase_before(size_t count) {
+        gap_start -= (std::min)(count, gap_start);
+    }
+
+    // Delete [pos, pos + count), moving the gap only up to the nearer end
+    // of the range
+    void erase(size_t pos, size_t count) {
+        size_t total = length();
+        if (pos >= total) return;
+        count = (std::min)(count, total - pos);
+        if (pos + count <= gap_start) {
+            move_cursor(pos + count);
+            erase_before(count);
+        } else if (pos >= gap_start) {
+            move_cursor(pos);
+            erase(count);
+        } else {
+            // The range straddles the gap: widen it on both sides
+            gap_end += pos + count - gap_start;
+            gap_start = pos;
+        }
+    }
+
+    void clear() {
+        gap_start = 0;
+        gap_end = capacity;
+    }
+
+    // Make room for at least size more bytes without further reallocation
+    void reserve(size_t size) {
+        if (gap_end - gap_start < size) reserve_gap(size);
+    }
+
+    char at(size_t pos) const {
+        return pos < gap_start ? buffer[pos] : buffer[pos + (gap_end - gap_start)];
     }
 
     std::string get_text() const {
         std::string result;
-        result.reserve(buffer.size() - (gap_end - gap_start));
-        result.append(buffer.begin(), buffer.begin() + gap_start);
-        result.append(buffer.begin() + gap_end, buffer.end());
+        result.reserve(length());
+        result.append(buffer.get(), gap_start);
+        result.append(buffer.get() + gap_end, capacity - gap_end);
         return result;
     }
 
     size_t length() const {
-        return buffer.size() - (gap_end - gap_start);
+        return capacity - (gap_end - gap_start);
     }
+    size_t size() const { return length(); }
+
+    // The text is these two views back to back
+    std::string_view before_gap() const { return std::string_view(buffer.get(), gap_start); }
+    std::string_view after_gap() const { return std::string_view(buffer.get() + gap_end, capacity - gap_end); }
 
 private:
-    std::vector<char> buffer;
+    std::unique_ptr<char[]> buffer;
+    size_t capacity;
     size_t gap_start, gap_end;
 
-    void expand() {
-        size_t old_size = buffer.size();
-        size_t new_size = old_size * 2;
-        std::vector<char> new_buffer(new_size, '\0');
-        // Copy before gap
-        std::copy(buffer.begin(), buffer.begin() + gap_start, new_buffer.begin());
-        // Copy after gap
-        size_t after_gap = old_size - gap_end;
-        std::copy(buffer.begin() + gap_end, buffer.end(), new_buffer.begin() + new_size - after_gap);
-        gap_end = new_size - after_gap;
+    // Grow so the gap holds at least needed bytes. Doubling keeps repeated
+    // inserts amortized O(1); new storage is left uninitialized.
+    void reserve_gap(size_t needed) {
+        size_t used = length();
+        size_t new_capacity = (std::max)(capacity * 2, used + needed + 64);
+        std::unique_ptr<char[]> new_buffer(new char[new_capacity]);
+        size_t after_gap = capacity - gap_end;
+        if (gap_start > 0) std::memcpy(new_buffer.get(), buffer.get(), gap_start);
+        if (after_gap > 0) std::memcpy(new_buffer.get() + new_capacity - after_gap, buffer.get() + gap_end, after_gap);
+        gap_end = new_capacity - after_gap;
+        capacity = new_capacity;
         buffer = std::move(new_buffer);
     }
 };
@@ -0,0 +1,56 @@
+#ifndef GAP_TEXT_BUFFER_H
+#define GAP_TEXT_BUFFER_H
+
+#include "text_buffer.h"
+#include "gap_buffer.h"
+#include <deque>
+
+/**
+ * GapTextBuffer - TextBuffer backend over a GapBuffer, for small files
+ *
+ * Edits near the previous one only move a few bytes of gap, and the text is
+ * just two contiguous runs. The line index is rebuilt from scratch on the
+ * first query after an edit, which is cheap at the sizes this backend is
+ * picked for (TextBuffer::kSmallFileLimit). Undo keeps the edited text.
+ */
+class GapTextBuffer : public TextBuffer {
+public:
+    GapTextBuffer();
+    explicit GapTextBuffer(const std::string& initial_text);
+    
+    void insert(size_t position, const std::string& text) override;
+    void remove(size_t position, size_t length) override;
+    void undo() override;
+    void redo() override;
+    bool can_undo() const override { return !undo_history_.empty(); }
+    bool can_redo() const override { return !redo_history_.empty(); }
+    
+    std::string get_text(size_t start, size_t length) const override;
+    std::string get_line(size_t line_number) const override;
+    size_t get_line_count() const override;
+    size_t get_total_length() const override { return buffer_.length(); }
+    size_t get_line_start(size_t line_number) const override;
+    size_t get_line_at(size_t position) const override;
+    std::vector<std::string> get_lines_range(size_t start_line, size_t count) const override;
+    TextBufferBackend backend() const override { return TextBufferBackend::GapBuffer; }
+    
+private:
+    struct Edit {
+        bool is_insert;
+        size_t position;
+        std::string text;
+    };
+    
+    GapBuffer buffer_;
+    std::deque<Edit> undo_history_;
+    std::deque<Edit> redo_history_;
+    static constexpr size_t kMaxHistory = 1000;
+    // Offset of the first byte of every line
+    mutable std::vector<size_t> line_starts_;
+    mutable bool lines_dirty_;
+    
+    void apply(const Edit& edit, bool forward);
+    void ensure_lines() const;
+};
+
+#endif // GAP_TEXT_BUFFER_H
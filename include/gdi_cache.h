@@ -0,0 +1,53 @@
+#pragma once
+#include <windows.h>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+class Theme;
+
+namespace editor {
+
+/**
+ * GdiCache - the brushes, pens and fonts the paint path draws with
+ *
+ * Painting used to create and delete a GDI object for every rectangle it
+ * filled, every frame. Here each is created the first time a color (and
+ * width, or size) is asked for and handed out again after; the caller
+ * never deletes what it gets. Handles stay valid until the next
+ * begin_frame(), which is the only place objects are released: when the
+ * theme's revision moved - its colors are the bulk of what is cached -
+ * or when so many distinct ones piled up that they are worth dropping.
+ * Call it at the start of WM_PAINT, before anything is selected into a DC.
+ */
+class GdiCache {
+public:
+    GdiCache() = default;
+    ~GdiCache();
+
+    GdiCache(const GdiCache&) = delete;
+    GdiCache& operator=(const GdiCache&) = delete;
+
+    void begin_frame(const Theme& theme);
+
+    HBRUSH brush(COLORREF color);
+    HPEN pen(COLORREF color, int width = 1, int style = PS_SOLID);
+    // Fixed-pitch ClearType font of face at height pixels
+    HFONT font(int height, int weight = FW_NORMAL, const wchar_t* face = L"Consolas");
+
+    size_t size() const { return brushes_.size() + pens_.size() + fonts_.size(); }
+    // Objects created since construction; flat while painting means no churn
+    uint64_t created() const { return created_; }
+    void clear();
+
+    static constexpr size_t kMaxObjects = 512;
+
+private:
+    uint64_t theme_revision_ = 0;
+    uint64_t created_ = 0;
+    std::unordered_map<COLORREF, HBRUSH> brushes_;
+    std::unordered_map<uint64_t, HPEN> pens_;           // color | width << 32 | style << 48
+    std::unordered_map<std::wstring, HFONT> fonts_;     // height, weight and face
+};
+
+} // namespace editor
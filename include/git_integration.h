@@ -5,6 +5,10 @@
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <functional>
+#include <mutex>
+#include "file_watcher.h"
+#include "git_status_worker.h"
 
 /**
  * Git file status enumeration
@@ -45,6 +49,11 @@ struct GitDiffHunk {
  * - File status tracking
  * - Basic diff viewing
  * - Commit/branch operations via git command execution
+ *
+ * Status never blocks the caller: refresh_status and apply_file_changes
+ * hand the query to a GitStatusWorker, and take_status_results merges
+ * what it found into the caches on the caller's thread. The status
+ * callback fires on the worker thread whenever results are waiting.
  */
 class GitManager {
 public:
@@ -56,8 +65,20 @@ public:
     bool is_git_repository() const { return is_repo_; }
     std::string get_repo_root() const { return repo_root_; }
     
-    // Status operations
+    // Status operations (asynchronous; see take_status_results)
     void refresh_status();
+    // Re-query only the paths in a FileWatcher batch; anything under .git
+    // (commit, checkout, staging) falls back to refresh_status and returns
+    // true, as HEAD may have moved
+    bool apply_file_changes(const std::vector<editor::FileChange>& changes);
+    // Called on the worker thread when results are ready to take
+    void set_status_callback(std::function<void()> callback) { status_callback_ = std::move(callback); }
+    // Merges finished queries into the caches; true if any were waiting
+    bool take_status_results();
+    // Waits for queries in flight and merges them, for callers that need
+    // the status as of now (the commit dialog)
+    void wait_for_status();
+    bool status_pending() const { return status_worker_ && status_worker_->busy(); }
     GitFileStatus get_file_status(const std::string& file_path) const;
     std::vector<std::string> get_modified_files() const;
     std::vector<std::string> get_staged_files() const;
@@ -66,6 +87,14 @@ public:
     // Diff operations
     std::vector<GitDiffHunk> get_file_diff(const std::string& file_path) const;
     std::string get_file_diff_text(const std::string& file_path) const;
+    // HEAD's blob id for a file and a blob's contents, answered by two
+    // long-lived `git cat-file` processes started on first use. These are
+    // what editor::DiffGutter diffs against; safe from any one thread.
+    bool get_head_blob_id(const std::string& file_path, std::string& blob_id);
+    bool get_blob_text(const std::string& blob_id, std::string& text);
+    // `git blame --incremental` of a file as of HEAD, for editor::BlameCache;
+    // runs one git process and is safe from any thread
+    bool get_blame(const std::string& file_path, std::string& output) const;
     
     // Staging operations
     bool stage_file(const std::string& file_path);
@@ -85,9 +114,13 @@ public:
     bool delete_branch(const std::string& branch_name);
     
 private:
+    struct CatFile;
+    
     // Helper functions
-    std::string execute_git_command(const std::string& command) const;
-    void parse_status_output(const std::string& output);
+    // Runs git with args in the repository; stdout and stderr together
+    std::string execute_git(const std::vector<std::string>& args) const;
+    void apply_status_result(const editor::GitStatusWorker::Result& result);
+    void record_status(const editor::GitStatusEntry& entry);
     void parse_diff_output(const std::string& output, std::vector<GitDiffHunk>& hunks) const;
     std::string make_relative_path(const std::string& file_path) const;
     
@@ -100,6 +133,13 @@ private:
     std::vector<std::string> staged_files_;
     std::vector<std::string> modified_files_;
     std::vector<std::string> untracked_files_;
+    
+    std::function<void()> status_callback_;
+    std::unique_ptr<editor::GitStatusWorker> status_worker_;
+    
+    std::mutex cat_file_mutex_;
+    std::unique_ptr<CatFile> blob_ids_;         // git cat-file --batch-check
+    std::unique_ptr<CatFile> blob_reader_;      // git cat-file --batch
 };
 
 #endif // GIT_INTEGRATION_H
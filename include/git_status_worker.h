@@ -0,0 +1,87 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace editor {
+
+// One line of `git status --porcelain -z`: the two status letters and the
+// repository-relative path (the new name for a rename)
+struct GitStatusEntry {
+    char index = ' ';
+    char worktree = ' ';
+    std::string path;
+};
+
+/**
+ * GitStatusWorker - runs git status queries on a thread of its own
+ *
+ * Requests only record what is wanted: a whole-tree query, or a set of
+ * paths. Requests that arrive while a query runs are merged into the next
+ * one, so a burst of saves costs one git invocation, and a full request
+ * swallows any path requests pending with it. More than kMaxPaths paths
+ * become a full query, as their pathspecs would not fit a command line.
+ *
+ * Each query's result waits in a queue for the owner's thread to take;
+ * the ready callback fires on the worker thread after each one so the
+ * owner can schedule that (post a window message, say). Results come out
+ * in the order the queries ran, so applying them in turn always leaves
+ * the newest answer for every path.
+ */
+class GitStatusWorker {
+public:
+    // Runs `git status --porcelain -z` limited to pathspecs (the whole tree
+    // when empty) into output; false when git could not be run
+    using RunFn = std::function<bool(const std::vector<std::string>& pathspecs, std::string& output)>;
+    using ReadyFn = std::function<void()>;
+
+    struct Result {
+        bool full = false;                      // Replaces everything known
+        std::vector<std::string> paths;         // Otherwise replaces these and what is below them
+        std::vector<GitStatusEntry> entries;
+    };
+
+    explicit GitStatusWorker(RunFn run, ReadyFn ready = nullptr);
+    ~GitStatusWorker();
+
+    GitStatusWorker(const GitStatusWorker&) = delete;
+    GitStatusWorker& operator=(const GitStatusWorker&) = delete;
+
+    void request_full();
+    void request_paths(const std::vector<std::string>& paths);
+
+    // Next finished result, oldest first
+    bool take(Result& result);
+    // A query is queued or running
+    bool busy() const;
+    // Blocks until nothing is queued or running
+    void wait_idle();
+
+    static void parse_porcelain(const std::string& output, std::vector<GitStatusEntry>& entries);
+
+    static constexpr size_t kMaxPaths = 64;
+
+private:
+    void worker_loop();
+
+    RunFn run_;
+    ReadyFn ready_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    bool pending_full_ = false;
+    std::vector<std::string> pending_paths_;
+    std::unordered_set<std::string> pending_set_;
+    bool running_ = false;
+    bool stopping_ = false;
+    std::deque<Result> results_;
+    std::thread thread_;
+};
+
+} // namespace editor
@@ -0,0 +1,46 @@
+#ifndef GITIGNORE_H
+#define GITIGNORE_H
+
+#include <string>
+#include <vector>
+
+/**
+ * GitIgnore - .gitignore pattern matching for workspace pruning
+ *
+ * Patterns from any number of .gitignore files are added with the
+ * directory they came from (relative to the workspace root, '/'-separated),
+ * and apply only below it. The usual rules hold: '#' comments, '!'
+ * negation, a trailing '/' for directories only, a leading or inner '/'
+ * anchoring the pattern to its directory (otherwise it matches the name at
+ * any depth), '*', '?', '[...]' and '**'. Later patterns win.
+ *
+ * Only the path itself is tested - a file below an ignored directory is not
+ * reported as ignored - so callers walk the tree top-down and stop at
+ * ignored directories, as git does.
+ */
+class GitIgnore {
+public:
+    // Parse the text of a .gitignore found in base ("" for the root)
+    void add_patterns(const std::string& text, const std::string& base = "");
+    // Read <directory>/.gitignore if present; base as above
+    bool load_file(const std::string& directory, const std::string& base);
+
+    bool is_ignored(const std::string& relative_path, bool is_directory) const;
+
+    bool empty() const { return patterns_.empty(); }
+    void clear() { patterns_.clear(); }
+
+    // Glob match of a '/'-separated path with gitignore semantics
+    static bool match(const char* pattern, const char* path);
+
+private:
+    struct Pattern {
+        std::string base;           // Directory of the .gitignore, "" for the root
+        std::string glob;           // Relative to base; unanchored ones start with "**/"
+        bool negated = false;
+        bool directory_only = false;
+    };
+    std::vector<Pattern> patterns_;
+};
+
+#endif // GITIGNORE_H
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+namespace editor {
+
+// Coverage bitmap of one glyph, positioned relative to the top-left of its
+// text cell (so y = 0 is the top of the line, as with GDI's TextOut)
+struct GlyphBitmap {
+    int width = 0;
+    int height = 0;
+    int offset_x = 0;
+    int offset_y = 0;
+    int advance = 0;
+    std::vector<uint8_t> coverage;   // width * height, 0-255
+};
+
+// Platform font -> glyph bitmaps; false if the codepoint has no glyph
+using GlyphRasterizer = std::function<bool(uint32_t codepoint, GlyphBitmap& glyph)>;
+
+// Where a glyph lives in the atlas, in texels
+struct AtlasGlyph {
+    uint16_t x = 0;
+    uint16_t y = 0;
+    uint16_t width = 0;
+    uint16_t height = 0;
+    int16_t offset_x = 0;
+    int16_t offset_y = 0;
+    int16_t advance = 0;
+};
+
+/**
+ * GlyphAtlas - single-channel texture holding every glyph drawn so far
+ *
+ * Glyphs are rasterized once, on first use, and packed into shelves (rows
+ * as tall as their tallest glyph), so a frame of text needs no per-glyph
+ * texture binds. Texel (0, 0) is opaque white: rectangles and lines are
+ * drawn as quads sampling it, which puts them in the same draw call as
+ * the text. The CPU copy is authoritative; the backend uploads only the
+ * dirty rectangle after each batch of new glyphs. When the atlas fills up
+ * it doubles (up to kMaxSize, glyph texel positions stay valid), and past
+ * that it starts over empty - generation() tells callers their cached
+ * lookups are stale.
+ */
+class GlyphAtlas {
+public:
+    explicit GlyphAtlas(GlyphRasterizer rasterizer, int size = kInitialSize);
+
+    // The glyph for codepoint, rasterizing and packing it if new; nullptr
+    // if the font has no glyph for it
+    const AtlasGlyph* glyph(uint32_t codepoint);
+
+    int size() const { return size_; }
+    const uint8_t* pixels() const { return pixels_.data(); }
+    size_t generation() const { return generation_; }
+
+    // Region changed since the last clear_dirty(); empty when width == 0
+    struct Rect { int x = 0, y = 0, width = 0, height = 0; };
+    const Rect& dirty() const { return dirty_; }
+    void clear_dirty() { dirty_ = Rect{}; }
+    // The texture must be recreated at size() (it grew or was reset)
+    bool resized() const { return resized_; }
+    void clear_resized() { resized_ = false; }
+
+    size_t glyph_count() const { return glyphs_.size(); }
+
+    static constexpr int kInitialSize = 1024;
+    static constexpr int kMaxSize = 4096;
+    static constexpr int kPadding = 1;
+
+private:
+    bool place(int width, int height, int& x, int& y);
+    void grow();
+    void reset();
+    void mark_dirty(int x, int y, int width, int height);
+
+    struct Shelf {
+        int y;
+        int height;
+        int used;       // Width taken so far
+    };
+
+    GlyphRasterizer rasterizer_;
+    int size_;
+    std::vector<uint8_t> pixels_;
+    std::vector<Shelf> shelves_;
+    std::unordered_map<uint32_t, AtlasGlyph> glyphs_;
+    std::unordered_map<uint32_t, bool> missing_;
+    Rect dirty_;
+    bool resized_ = true;
+    size_t generation_ = 0;
+};
+
+} // namespace editor
@@ -3,6 +3,8 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include "draw_list.h"
+#include "glyph_atlas.h"
 
 namespace editor {
 
@@ -13,7 +15,8 @@ enum class GpuBackend {
     Metal,
     DirectX12,
     OpenGL,
-    WGPU
+    WGPU,
+    Software    // CPU rasterizer into framebuffer(); always available
 };
 
 struct GpuRendererConfig {
@@ -23,6 +26,29 @@ struct GpuRendererConfig {
     bool enable_vsync = true;
     bool enable_hdr = false;
     bool debug = false;
+
+    // Window to render into (HWND on Windows); the OpenGL backend creates
+    // its own context on it
+    void* native_window = nullptr;
+    // Or: a host-owned OpenGL 3.3 context (e.g. GtkGLArea) that is current
+    // whenever the renderer is called, its loader and its buffer swap
+    std::function<void*(const char* name)> gl_get_proc_address;
+    std::function<void()> gl_swap_buffers;
+
+    // Font for draw_text; glyphs come from rasterizer, or from the
+    // platform font named here when it is empty (GDI on Windows)
+    std::string font_family = "Consolas";
+    int font_size = 16;
+    GlyphRasterizer rasterizer;
+
+    uint32_t clear_color = 0xFF1E1E1E;     // 0xAARRGGBB, like every color here
+};
+
+// Counters for the last finished frame
+struct GpuFrameStats {
+    size_t draw_calls = 0;
+    size_t quads = 0;
+    size_t atlas_upload_bytes = 0;
 };
 
 class GpuRenderer {
@@ -35,10 +61,20 @@ public:
     virtual void draw_text(const std::string& text, int x, int y, uint32_t color) = 0;
     virtual void draw_rect(int x, int y, int w, int h, uint32_t color) = 0;
     virtual void draw_line(int x1, int y1, int x2, int y2, uint32_t color) = 0;
+    // Appends a whole recorded list between begin_frame and end_frame:
+    // one virtual call however many primitives it holds
+    virtual void submit(const DrawList& list) = 0;
     virtual void present() = 0;
     virtual void shutdown() = 0;
 
-    // Factory
+    virtual GpuBackend backend() const = 0;
+    virtual const GpuFrameStats& frame_stats() const = 0;
+    // Pixels of the last frame (0xAARRGGBB rows), for the Software backend;
+    // nullptr when the frame lives on the GPU
+    virtual const uint32_t* framebuffer() const { return nullptr; }
+
+    // Factory: nullptr when the requested backend is not available here.
+    // Auto picks OpenGL when a window or host context is given, else Software.
     static GpuRenderer* create(const GpuRendererConfig& config);
 };
 
@@ -0,0 +1,111 @@
+#ifndef HEX_BUFFER_H
+#define HEX_BUFFER_H
+
+#include "text_buffer.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * HexBuffer - hex dump view of a binary file, as a TextBuffer
+ *
+ * Bytes are read straight from a file mapping (or an owned copy for small
+ * inputs) and shown as fixed-width rows, hexdump -C style:
+ *
+ *     00000010  48 65 6c 6c 6f 20 77 6f  72 6c 64 0a 00 00 00 00  |Hello world.....|
+ *
+ * Row N covers bytes [N * kBytesPerRow, (N + 1) * kBytesPerRow) and every
+ * row is row_width() characters, so line starts and line lookups are
+ * arithmetic: there is no line index, and a Viewport over a multi-gigabyte
+ * core dump formats only the rows it shows.
+ *
+ * The length is fixed. insert() and remove() do nothing; bytes change with
+ * overwrite(), which goes into a sparse patch table (one entry per changed
+ * byte) laid over the mapping, and undo()/redo() step through overwrites.
+ * write_patches() stores them in place in the file.
+ */
+class HexBuffer : public TextBuffer {
+public:
+    static constexpr size_t kBytesPerRow = 16;
+    static constexpr uint64_t npos = static_cast<uint64_t>(-1);
+
+    explicit HexBuffer(std::shared_ptr<editor::MappedFile> mapping);
+    explicit HexBuffer(std::string bytes);
+    // Map path; nullptr if it cannot be mapped
+    static std::shared_ptr<HexBuffer> open(const std::string& path);
+    // NUL bytes in the first kSniffBytes: not worth showing as text
+    static constexpr size_t kSniffBytes = 8192;
+    static bool looks_binary(const char* data, size_t size);
+
+    // Bytes, with patches applied
+    uint64_t byte_count() const { return size_; }
+    uint8_t byte_at(uint64_t offset) const;
+    // Up to length bytes from offset into out; returns how many
+    size_t read(uint64_t offset, size_t length, uint8_t* out) const;
+
+    // Replace bytes at offset (one undo step); false, changing nothing, if
+    // they run past the end
+    bool overwrite(uint64_t offset, const std::string& bytes);
+    bool is_patched(uint64_t offset) const { return patches_.count(offset) != 0; }
+    size_t patch_count() const { return patches_.size(); }
+    void discard_patches();
+    // Write the patched bytes into path in place (the file keeps its
+    // length); patches the mapping already shows are dropped
+    bool write_patches(const std::string& path);
+
+    // First offset at or after from where pattern occurs, patches included;
+    // npos if none. The mapping is scanned with TextScan::find_bytes.
+    uint64_t find(const std::string& pattern, uint64_t from = 0) const;
+    // "DE AD be ef", "deadbeef" - false on odd or non-hex digits
+    static bool parse_hex(const std::string& text, std::string& out);
+
+    // Row geometry
+    uint64_t row_count() const { return (size_ + kBytesPerRow - 1) / kBytesPerRow; }
+    size_t row_width() const { return offset_digits_ + 70; }
+    std::string format_row(uint64_t row) const;
+    // Text position of a byte's hex digits, and the byte under a text
+    // position (false off the hex and character columns)
+    size_t position_of_byte(uint64_t offset) const;
+    bool byte_at_position(size_t position, uint64_t& offset) const;
+
+    // TextBuffer
+    void insert(size_t, const std::string&) override {}
+    void remove(size_t, size_t) override {}
+    void undo() override;
+    void redo() override;
+    bool can_undo() const override { return !undo_history_.empty(); }
+    bool can_redo() const override { return !redo_history_.empty(); }
+
+    std::string get_text(size_t start, size_t length) const override;
+    std::string get_line(size_t line_number) const override;
+    size_t get_line_count() const override;
+    size_t get_total_length() const override;
+    size_t get_line_start(size_t line_number) const override;
+    size_t get_line_at(size_t position) const override;
+    std::vector<std::string> get_lines_range(size_t start_line, size_t count) const override;
+    TextBufferBackend backend() const override { return TextBufferBackend::Hex; }
+
+private:
+    // One overwrite: the bytes before and after it
+    struct Overwrite {
+        uint64_t offset;
+        std::string before;
+        std::string after;
+    };
+
+    void apply(uint64_t offset, const std::string& bytes);
+    bool matches_at(uint64_t offset, const std::string& pattern) const;
+
+    std::shared_ptr<editor::MappedFile> mapping_;
+    std::string owned_;
+    const char* data_ = nullptr;
+    uint64_t size_ = 0;
+    size_t offset_digits_ = 8;
+    std::map<uint64_t, uint8_t> patches_;
+    std::vector<Overwrite> undo_history_;
+    std::vector<Overwrite> redo_history_;
+};
+
+#endif // HEX_BUFFER_H
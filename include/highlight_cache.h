@@ -0,0 +1,143 @@
+#ifndef HIGHLIGHT_CACHE_H
+#define HIGHLIGHT_CACHE_H
+
+#include "piece_table.h"
+#include "semantic_tokens.h"
+#include "syntax_highlighter.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * HighlightCache - Per-line highlighter results kept between frames
+ *
+ * Each entry holds a line's tokens and out-state. An edit (reported by the
+ * document's change listener) only marks the edited lines dirty; entries
+ * after them are kept, shifted to their new line numbers, and are trusted
+ * again as soon as re-tokenizing reaches a line whose out-state matches the
+ * cached one. Typing inside a line therefore re-tokenizes just that line,
+ * and scrolling back to an already visited region tokenizes nothing.
+ *
+ * With set_background(true) tokenizing moves onto the shared ThreadPool,
+ * one drain task per cache at a time (Visible priority for the viewport,
+ * Background for the in-order pass). The UI thread copies the lines it wants into prioritized batches (viewport,
+ * then a margin around it, then the rest of the document in order) and
+ * merges finished batches in poll(); paint draws whatever
+ * get_ready_tokens() has and plain text for the rest. Viewport batches
+ * ahead of the known states start from a guessed in-state, so their
+ * tokens are provisional until the in-order pass reaches them.
+ *
+ * A language server's semantic tokens (set_semantic_tokens) are laid over
+ * the lexer's by get_display_tokens(), one line at a time as paint asks
+ * for it; the merged line is kept until either side changes.
+ */
+class HighlightCache {
+public:
+    explicit HighlightCache(SyntaxHighlighter* highlighter);
+    ~HighlightCache();
+    
+    HighlightCache(const HighlightCache&) = delete;
+    HighlightCache& operator=(const HighlightCache&) = delete;
+    
+    // Bind to a document (no-op if already bound); clears cached lines
+    void set_document(const std::shared_ptr<PieceTable>& document);
+    
+    // Tokens of a line, tokenizing (and caching) whatever is missing
+    const std::vector<Token>& get_tokens(size_t line);
+    
+    // Highlighter state at the beginning of a line
+    SyntaxHighlighter::LineState state_before(size_t line);
+    
+    // Background mode - tokenize on a worker thread instead of on demand
+    void set_background(bool enabled);
+    bool is_background() const { return job_ != nullptr; }
+    // Queue work for the current viewport (call every paint; cheap when
+    // nothing is missing)
+    void schedule(size_t top_line, size_t visible_count);
+    // Merge finished batches - returns true when new tokens became ready
+    bool poll();
+    // false: no in-order pass over the whole document, only up to the
+    // viewport when it is within kCatchUpLines of the known states (large
+    // files; tokens further down stay provisional)
+    void set_full_pass(bool enabled) { full_pass_ = enabled; }
+    bool is_full_pass() const { return full_pass_; }
+    // Tokens computed so far; empty when the line isn't ready (draw plain)
+    const std::vector<Token>& get_ready_tokens(size_t line) const;
+    
+    // Semantic tokens of the bound document, kept in step with its edits;
+    // cleared when another document is bound
+    void set_semantic_tokens(std::shared_ptr<editor::SemanticTokenOverlay> overlay);
+    const std::shared_ptr<editor::SemanticTokenOverlay>& semantic_tokens() const { return semantic_; }
+    // get_ready_tokens() with the semantic tokens of the line laid over them
+    const std::vector<Token>& get_display_tokens(size_t line);
+    
+    void invalidate_from(size_t line);
+    // Drop cached tokens of lines [first, last) but keep their states - for
+    // ranges a parser reports as changed without a line-state difference
+    void invalidate_tokens(size_t first, size_t last);
+    void clear();
+    
+    // Number of leading lines whose out-state is known to be current
+    size_t valid_lines() const { return valid_; }
+    // Total tokenize_line calls made - for tests and the perf HUD
+    size_t tokenize_count() const { return tokenize_count_; }
+    // Bytes of cached line states and tokens, for the memory report
+    size_t get_memory_bytes() const;
+    
+private:
+    static constexpr uint64_t kNotMerged = static_cast<uint64_t>(-1);
+    
+    struct Entry {
+        SyntaxHighlighter::LineState out;
+        std::vector<Token> tokens;
+        bool has_tokens = false;
+        bool changed = true;        // Text edited (or never seen) - must be re-tokenized
+        bool comparable = false;    // out is the in-state the next cached line was built from
+        bool provisional = false;   // tokens came from a guessed in-state
+        std::vector<Token> merged;  // tokens with semantic tokens over them; empty: none apply
+        uint64_t merged_generation = kNotMerged;    // Overlay generation merged was built for
+    };
+    struct Batch;
+    struct HighlightJob;
+    
+    static constexpr size_t kBatchLines = 2000;     // Lines per in-order background batch
+    static constexpr size_t kCatchUpLines = 20000;  // In-order reach without the full pass
+    
+    void on_change(const PieceTable::Change& change);
+    void check_language();
+    void ensure_states(size_t line);
+    void store(size_t line, const SyntaxHighlighter::LineState& out, std::vector<Token>* tokens);
+    void publish(size_t line, bool exact, const SyntaxHighlighter::LineState& out, std::vector<Token>& tokens);
+    size_t ready_line_count() const;
+    bool make_batch(size_t first, size_t last, bool in_order, Batch& batch);
+    void queue_next_batch();
+    
+    SyntaxHighlighter* highlighter_;
+    std::shared_ptr<PieceTable> document_;
+    size_t listener_id_;
+    SyntaxHighlighter::Language language_;
+    // entries_[0, valid_) are current. Entries past valid_ survived an edit:
+    // unchanged ones are correct if their line's in-state is unchanged.
+    std::vector<Entry> entries_;
+    size_t valid_;
+    size_t tokenize_count_;
+    std::string scratch_;
+    std::vector<Token> scratch_tokens_;     // tokenize_line's reused output
+    std::vector<Token> empty_;
+    std::vector<Token> uncached_;
+    
+    std::shared_ptr<editor::SemanticTokenOverlay> semantic_;
+    std::vector<editor::SemanticTokenOverlay::Span> spans_;
+    std::vector<Token> pieces_;     // Lexer tokens outside the semantic spans
+    
+    // Background mode
+    std::shared_ptr<HighlightJob> job_;      // Shared with its drain task
+    size_t generation_;             // Bumped whenever queued results would go stale
+    size_t scheduled_top_;
+    size_t scheduled_count_;
+    size_t scheduled_generation_;
+    size_t batch_generation_;       // Generation of the queued in-order batch
+    bool full_pass_;
+};
+
+#endif // HIGHLIGHT_CACHE_H
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace editor {
+
+/**
+ * HistorySpill - a file of compressed blocks that a document pages its
+ * old undo history and cold add-buffer text out to
+ *
+ * Blocks are LZ4-compressed (kept raw when that does not shrink them)
+ * and appended; the caller keeps the Block that says where one went and
+ * reads it back whole. Nothing in the file outlives the document: it is
+ * created on the first write, truncated if a crashed session left one
+ * behind, and deleted with the spill. Blocks no longer needed (a redo
+ * branch an edit discarded, a batch read back) are released; once they
+ * make up most of the file, compact() moves the live ones down over them
+ * and truncates it.
+ */
+class HistorySpill {
+public:
+    struct Block {
+        uint64_t offset = 0;
+        uint64_t stored = 0;        // Bytes in the file
+        uint64_t size = 0;          // Bytes once read back
+    };
+
+    explicit HistorySpill(std::string path);
+    ~HistorySpill();                // Deletes the file
+
+    HistorySpill(const HistorySpill&) = delete;
+    HistorySpill& operator=(const HistorySpill&) = delete;
+
+    // Append data; false (and failed() from then on) if the file cannot be written
+    bool write(std::string_view data, Block& block);
+    bool read(const Block& block, std::string& data);
+    bool read(const Block& block, char* data);      // block.size bytes
+    // The block will not be read again
+    void release(const Block& block) { dead_ += block.stored; }
+    // Everything is dead, or enough of it to be worth moving the rest
+    bool should_compact() const {
+        return dead_ > 0 && (dead_ >= end_ || (dead_ >= kCompactBytes && dead_ * 2 >= end_));
+    }
+    // Pack the live blocks (all of them, whose offsets it updates) at the
+    // front of the file and truncate it behind them
+    bool compact(const std::vector<Block*>& live);
+
+    const std::string& path() const { return path_; }
+    bool failed() const { return failed_; }
+    uint64_t file_bytes() const { return end_; }
+    uint64_t dead_bytes() const { return dead_; }
+
+private:
+    static constexpr uint64_t kCompactBytes = 8 * 1024 * 1024;
+
+    bool seek(uint64_t offset);
+
+    std::string path_;
+    std::FILE* file_ = nullptr;
+    uint64_t end_ = 0;
+    uint64_t dead_ = 0;             // Bytes of released blocks
+    bool failed_ = false;
+};
+
+} // namespace editor
@@ -1,12 +1,25 @@
 #ifndef INDEXER_H
 #define INDEXER_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
+#include <memory>
+#include <functional>
+#include <list>
 #include <unordered_map>
-#include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <atomic>
+#include "persistent_index.h"
+#include "prefix_index.h"
+#include "text_buffer.h"
+#include "file_watcher.h"
+#include "workspace_vocabulary.h"
+
+namespace editor { class MappedFile; }
+
+class TaskGroup;
 
 /**
  * SearchResult - Result from the indexer search
@@ -16,13 +29,41 @@ struct SearchResult {
     size_t line_number;
     size_t column;
     std::string line_content;
+    size_t length = 0;      // Match length (find_in_files)
 };
 
 /**
  * BackgroundIndexer - Separate service for project analysis
  * 
- * Runs in background thread, maintains inverted index
+ * Maintains an inverted index over the workspace. index_workspace crawls
+ * the root folders on the shared work-stealing ThreadPool at Background
+ * priority, so it yields to interactive work: every worker reads and tokenizes into its own shard and shards are
+ * merged into the shared index in batches, so the index lock is taken
+ * once per batch rather than once per file.
+ *
+ * With open_persistent_index the last saved index is mapped as a read-only
+ * base and serves searches at once; the crawl then only re-reads files
+ * whose mtime or size changed, and their new versions (plus anything
+ * passed to index_file) shadow the base entries. The merged result is
+ * written back when the crawl finishes.
+ *
+ * The index holds no copy of the text: each file keeps a line-offset
+ * table, and line content for results and regex verification is read on
+ * demand - from the open document if the lookup set with
+ * set_document_lookup knows the path, otherwise from a mapping of the file.
  * This allows instant search even in million-line codebases
+ *
+ * Tokenizing also runs SymbolTags over each line, so symbol definitions
+ * are indexed (and persisted) with the words and go-to-definition works
+ * from a cold start, before any language server has loaded the project.
+ *
+ * search() ranks whole files rather than returning postings in the order
+ * files happened to be indexed: a file scores by how often it has the
+ * word, how close it is to the open files and how recently it was used
+ * (set_ranking_context). Only the top files' postings are turned into
+ * results, so lines are read for at most max_results of them. The last
+ * few answers are kept, tagged with the index generation, which every
+ * change to the index or the ranking context bumps.
  */
 class BackgroundIndexer {
 public:
@@ -32,36 +73,258 @@ public:
     // Index operations
     void index_file(const std::string& file_path, const std::string& content);
     void remove_file(const std::string& file_path);
+    // Crawl and index every text file under the roots (WorkspaceState::root_folders)
+    // in the background; starts the pool if needed
+    void index_workspace(const std::vector<std::string>& root_folders);
+    // Block until the crawl has finished and everything is searchable
+    void wait_for_indexing();
+    // Apply a FileWatcher batch after index_workspace: changed files are
+    // re-read on the pool, removed files and directories dropped and new
+    // directories crawled. Paths outside the roots or skipped by the crawl
+    // are ignored, and so are paths indexed from a buffer with index_file.
+    // Stop the watcher before stopping the indexer.
+    void apply_file_changes(const std::vector<editor::FileChange>& changes);
     
-    // Search - returns results from in-memory index
+    // Map <workspace_dir>/.velocity/index.bin as the base index and save
+    // there after each crawl. Returns false if there was no usable index
+    // (saving is still enabled). Call before index_workspace.
+    bool open_persistent_index(const std::string& workspace_dir);
+    bool save_persistent_index();
+    static std::string get_persistent_index_file(const std::string& workspace_dir);
+    
+    // Open buffers by path (e.g. from TabManager::find_document), preferred
+    // over the file on disk for line content. Called with the index locked,
+    // so it must not call back into the indexer.
+    using DocumentLookup = std::function<std::shared_ptr<TextBuffer>(const std::string& path)>;
+    void set_document_lookup(DocumentLookup lookup);
+    // Bytes held for line offset tables (the text itself is never kept)
+    size_t get_line_table_bytes() const;
+    // Free the line offset tables (memory pressure); results then scan the
+    // text of their file for line starts. Returns the bytes freed.
+    size_t drop_line_tables();
+    // Bytes held, by part, for the memory report; walks the whole index
+    struct MemoryUsage {
+        size_t words = 0;           // Word -> postings map
+        size_t trigrams = 0;        // Trigram -> files map
+        size_t files = 0;           // Per-file entries: paths, reverse maps, buffer texts
+        size_t line_tables = 0;
+        size_t spellings = 0;       // Spellings kept for the vocabulary
+        size_t heap() const { return words + trigrams + files + line_tables + spellings; }
+    };
+    MemoryUsage get_memory_usage() const;
+    
+    // Search - a whole word (case-insensitive), best files first; a file's
+    // occurrences stay together, in order
     std::vector<SearchResult> search(const std::string& query, size_t max_results = 100);
+    // Files search favours: near the open ones, and the recently used
+    // (WorkspaceManager::get_recent_files, most recent first)
+    void set_ranking_context(std::vector<std::string> open_files, std::vector<std::string> recent_files);
+    // Bumped by every change to what search can return
+    uint64_t generation() const;
+    
+    // Where a symbol is defined (exact spelling), by the SymbolTags pass
+    std::vector<SearchResult> find_definitions(const std::string& symbol, size_t max_results = 100);
+    // Occurrences of an identifier, matched case-sensitively; definitions included
+    std::vector<SearchResult> find_references(const std::string& symbol, size_t max_results = 1000);
+    
+    // Find in files: substring or regex (RegexEngine) matches anywhere in a
+    // line. Candidate files come from intersecting trigram lists; only those
+    // are scanned. A regex without a usable literal scans every file.
+    std::vector<SearchResult> find_in_files(const std::string& pattern, bool use_regex = false,
+                                            bool case_sensitive = false, size_t max_results = 1000);
+    // Files that may contain the pattern, by the same trigram plan as
+    // find_in_files but without reading them (for workspace replace)
+    std::vector<std::string> candidate_files(const std::string& pattern, bool use_regex = false) const;
+    // Literal runs that every match of the regex must contain (the planner's input)
+    static std::vector<std::string> regex_literals(const std::string& pattern);
     
     // Status
     bool is_indexing() const { return is_indexing_.load(); }
     size_t get_indexed_file_count() const;
+    // Postings held for the word, including ones of removed files not yet purged
+    size_t get_posting_count(const std::string& word) const;
     
-    // Start/stop background indexing
+    // Every indexed identifier with its number of occurrences, as of the
+    // last publish. Lock-free; call from any thread. A new snapshot is
+    // published when a crawl or a batch of file changes finishes.
+    std::shared_ptr<const WorkspaceVocabulary> vocabulary() const;
+    // Publish now, e.g. after index_file or remove_file (takes the index
+    // lock to count, builds the snapshot outside it)
+    void publish_vocabulary();
+    
+    // Start/stop the worker pool; stop abandons an unfinished crawl
     void start();
     void stop();
     
+    // Files larger than this are skipped by the crawl
+    static constexpr size_t kMaxFileSize = 8 * 1024 * 1024;
+    // Recent search() answers kept
+    static constexpr size_t kQueryCacheSize = 16;
+    
 private:
-    // Inverted index: word -> list of (file, line, column)
-    struct Location {
-        std::string file_path;
-        size_t line_number;
-        size_t column;
+    // One occurrence of a word; file_id indexes files_
+    using Posting = IndexPosting;
+    
+    // A definition is a posting of its exact spelling after this byte,
+    // which no word contains; it shares the words' bookkeeping and storage
+    static constexpr char kDefinitionMark = '\x01';
+    
+    // Postings of removed files stay in place (and are skipped by search)
+    // until they make up half the list, so dropping a file costs only its
+    // own words, amortized
+    struct PostingList {
+        std::vector<Posting> postings;
+        size_t stale = 0;
+    };
+    using IndexEntry = std::pair<const std::string, PostingList>;
+    
+    // Files containing a (case-folded) trigram, with the same stale scheme
+    struct TrigramList {
+        std::vector<uint32_t> files;
+        size_t stale = 0;
     };
     
-    std::unordered_map<std::string, std::vector<Location>> index_;
-    std::unordered_map<std::string, std::vector<std::string>> file_lines_;
+    struct FileEntry {
+        std::string path;
+        // line_count + 1 offsets; line i spans [starts[i], starts[i + 1] - 1)
+        PrefixIndex line_starts;
+        // Text given to index_file, which need not exist on disk
+        std::shared_ptr<const std::string> content;
+        // Reverse map: every word this file contributed and how often
+        std::vector<std::pair<IndexEntry*, uint32_t>> terms;
+        // Sorted distinct trigrams, for membership tests during intersection
+        std::vector<uint32_t> trigrams;
+        uint64_t mtime = 0;     // 0 when indexed from an editor buffer
+        uint64_t size = 0;
+        // Stale word and trigram entries still referencing this id; it is reused at zero
+        size_t pending = 0;
+        bool live = false;
+    };
+    
+    // Inverted index: word -> postings. Elements are node-based, so the
+    // IndexEntry pointers in FileEntry::terms survive rehashing.
+    std::unordered_map<std::string, PostingList> index_;
+    std::unordered_map<uint32_t, TrigramList> trigrams_;
+    std::unordered_map<std::string, uint32_t> file_ids_;
+    std::vector<FileEntry> files_;
+    std::vector<uint32_t> free_ids_;
+    
+    // Mapped index from the last session; entries are shadowed (by id)
+    // when the file is re-indexed, removed or gone
+    std::shared_ptr<PersistentIndex> base_;
+    std::unordered_map<std::string, uint32_t> base_ids_;
+    std::vector<uint8_t> base_shadowed_;
+    std::vector<uint8_t> base_seen_;    // Unchanged files found by the crawl
+    size_t base_live_ = 0;
+    std::string persistent_path_;
+    bool dirty_ = false;                // Changed since the base was written
+    
+    DocumentLookup document_lookup_;
+    mutable std::mutex index_mutex_;
+    
+    // Spellings seen for lower-cased words, for the vocabulary; never
+    // pruned. Words of unchanged base files have none until re-read.
+    std::unordered_map<std::string, std::string> spellings_;
+    std::shared_ptr<const WorkspaceVocabulary> vocabulary_;    // std::atomic_load/atomic_store only
+    uint64_t vocabulary_generation_ = 0;
+    
+    // Search ranking and its answers, valid for one generation
+    uint64_t generation_ = 0;
+    std::vector<std::string> open_files_;
+    std::vector<std::string> recent_files_;
+    struct CachedQuery {
+        std::string key;
+        size_t max_results;
+        uint64_t generation;
+        std::vector<SearchResult> results;
+    };
+    std::list<CachedQuery> query_cache_;        // Most recently asked first
+    
+    // Line text of one indexed file, from wherever it currently lives
+    class LineSource {
+    public:
+        size_t line_count() const;
+        std::string_view line(size_t line_number);
+        
+    private:
+        friend class BackgroundIndexer;
+        std::shared_ptr<TextBuffer> document_;
+        std::shared_ptr<editor::MappedFile> mapping_;
+        std::shared_ptr<const std::string> content_;
+        const char* data_ = nullptr;
+        size_t size_ = 0;
+        const PrefixIndex* starts_ = nullptr;       // In-memory files
+        PrefixIndex scanned_;                       // Files whose table was dropped
+        const uint64_t* base_starts_ = nullptr;     // Base files
+        size_t count_ = 0;
+        std::string scratch_;
+    };
+    LineSource lines_of_locked(uint32_t file_id) const;
+    // Results for the postings of key, base first; with exact, only those
+    // whose text at the posting is exact
+    void collect_locked(const std::string& key, const std::string* exact, size_t length, size_t max_results,
+                        std::vector<SearchResult>& results) const;
+    // Results for the postings of key from the best-scoring files
+    void rank_locked(const std::string& key, size_t max_results, std::vector<SearchResult>& results) const;
+    double file_score_locked(std::string_view path, size_t occurrences) const;
+    // Files passing the trigram plan for the pattern (base ids when base is
+    // true), until visit returns false
+    using CandidateVisitor = std::function<bool(std::string_view path, bool base, uint32_t file_id)>;
+    void for_each_candidate_locked(const std::string& pattern, bool use_regex, const CandidateVisitor& visit) const;
+    LineSource base_lines_of_locked(uint32_t base_id) const;
+    LineSource open_lines_locked(const std::string& path, const std::shared_ptr<const std::string>& content) const;
+    
+    // A tokenized file not yet in the index (postings lack the file id)
+    struct ParsedFile {
+        std::string path;
+        PrefixIndex line_starts;
+        std::shared_ptr<const std::string> content;
+        std::unordered_map<std::string, std::vector<Posting>> words;
+        std::vector<uint32_t> trigrams;
+        // Lower-cased word -> its first spelling with capitals
+        std::unordered_map<std::string, std::string> spellings;
+        size_t postings = 0;
+        uint64_t mtime = 0;
+        uint64_t size = 0;
+    };
+    
+    // Per-worker staging area. Only its worker touches it during a crawl;
+    // the mutex is for the final flush and stays uncontended.
+    struct Shard {
+        std::mutex mutex;
+        std::vector<ParsedFile> files;
+        size_t postings = 0;
+    };
+    static constexpr size_t kMergeBatch = 64 * 1024;   // Postings per merge
     
-    std::thread indexing_thread_;
-    std::mutex index_mutex_;
+    std::unique_ptr<TaskGroup> tasks_;      // Crawl tasks on the shared pool; null when stopped
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<size_t> outstanding_;   // Crawl tasks not yet finished
+    std::mutex crawl_mutex_;
+    std::vector<std::string> roots_;    // Everything index_workspace was given
+    bool full_crawl_ = false;           // A workspace crawl is in progress
+    std::condition_variable crawl_done_;
     std::atomic<bool> is_indexing_;
     std::atomic<bool> should_stop_;
     
-    void indexing_worker();
-    void tokenize_and_index(const std::string& file_path, const std::string& content);
+    static ParsedFile tokenize(const std::string& file_path, std::string_view content);
+    void merge_locked(ParsedFile&& file);
+    void remove_file_locked(const std::string& file_path);
+    void crawl_directory(const std::string& directory);
+    void crawl_file(const std::string& path, uint64_t size);
+    static bool read_file(const std::string& path, ParsedFile& file);
+    void reindex_file(const std::string& path);
+    bool is_buffer_locked(const std::string& file_path) const;
+    // Drop a file, or every non-buffer file below a directory (only those
+    // no longer on disk with missing_only)
+    void remove_tree_locked(const std::string& path, bool missing_only);
+    void finish_crawl();
+    void shadow_base_locked(uint32_t base_id);
+    void flush_shard(Shard& shard);
+    void submit_crawl_task(std::function<void()> task);
+    void compact(IndexEntry* entry);
+    void compact_trigram(uint32_t trigram, TrigramList& list);
+    bool release_entry(uint32_t file_id);
 };
 
 #endif // INDEXER_H
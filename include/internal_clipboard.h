@@ -0,0 +1,52 @@
+#pragma once
+#include "piece_table.h"
+#include <cstddef>
+#include <memory>
+
+class DocumentSnapshot;
+
+namespace editor {
+
+/**
+ * InternalClipboard - copied text held as pieces of the document it came from
+ *
+ * Copying takes the range's Span and a snapshot of the document, both
+ * O(pieces): no text is read. Pasting back into the same document inserts
+ * the span itself; pasting into another one shares the snapshot's buffers
+ * (PieceTable::insert_shared). Either way a 500 MB region moves between
+ * tabs without a copy, and the copied text stays readable after its tab
+ * is closed or edited.
+ *
+ * Other applications only see the text when they ask for it: write_utf16()
+ * streams the snapshot's pieces into the system clipboard's memory
+ * (delayed rendering), carrying a UTF-8 sequence split across pieces over.
+ */
+class InternalClipboard {
+public:
+    // Remember [start, start + length) of document
+    void copy(const std::shared_ptr<PieceTable>& document, size_t start, size_t length);
+    void clear();
+    bool empty() const { return length_ == 0; }
+    size_t length() const { return length_; }
+
+    // Insert the text at position of target as one undo step; returns the
+    // bytes inserted
+    size_t paste(PieceTable& target, size_t position) const;
+    // The text as UTF-16 into out, which must hold length() units; returns
+    // the units written (malformed bytes become U+FFFD)
+    size_t write_utf16(char16_t* out) const;
+
+    // Call after document.release_mapping(), before its file is replaced:
+    // text copied from document's mapping is copied out of it, since the
+    // snapshot would otherwise keep reading the old file - O(bytes)
+    void release_mapping(const PieceTable& document);
+
+private:
+    std::weak_ptr<PieceTable> source_;
+    PieceTable::Span span_;                         // In source_'s buffers
+    std::shared_ptr<const DocumentSnapshot> snapshot_;
+    size_t start_ = 0;                              // Of the text in snapshot_
+    size_t length_ = 0;
+};
+
+} // namespace editor
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace editor {
+
+// FNV-1a over the word, seeded, with a final fold so the low bits (the
+// slot) see the high ones
+constexpr uint32_t keyword_hash(const char* text, size_t length, uint32_t seed) {
+    uint32_t hash = 2166136261u ^ seed;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<unsigned char>(text[i]);
+        hash *= 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+/**
+ * KeywordTable - a perfect hash over a fixed word list, built at compile time
+ *
+ * The constructor tries seeds until every word lands in its own slot, so a
+ * lookup is one hash, one slot read and at most one comparison, with no
+ * allocation. Declare tables constexpr and static_assert(valid()): a list
+ * no seed separates fails the build instead of misbehaving. Slots must be
+ * a power of two; keeping them ~10x the word count finds a seed quickly.
+ */
+template <size_t N, size_t Slots = 1024>
+class KeywordTable {
+public:
+    static_assert(N > 0 && N < 255, "slots store word index + 1 in a byte");
+    static_assert((Slots & (Slots - 1)) == 0, "Slots must be a power of two");
+
+    constexpr explicit KeywordTable(const std::string_view (&words)[N]) {
+        for (size_t i = 0; i < N; ++i) {
+            words_[i] = words[i];
+            min_length_ = words[i].size() < min_length_ ? words[i].size() : min_length_;
+            max_length_ = words[i].size() > max_length_ ? words[i].size() : max_length_;
+        }
+        for (uint32_t seed = 0; seed < kMaxSeeds; ++seed) {
+            if (try_seed(seed)) {
+                seed_ = seed;
+                valid_ = true;
+                return;
+            }
+        }
+    }
+
+    constexpr bool valid() const { return valid_; }
+    constexpr uint32_t seed() const { return seed_; }
+    static constexpr size_t size() { return N; }
+
+    constexpr bool contains(const char* text, size_t length) const {
+        if (length < min_length_ || length > max_length_) return false;
+        uint8_t index = slots_[keyword_hash(text, length, seed_) & (Slots - 1)];
+        return index != 0 && words_[index - 1] == std::string_view(text, length);
+    }
+    constexpr bool contains(std::string_view word) const { return contains(word.data(), word.size()); }
+
+private:
+    static constexpr uint32_t kMaxSeeds = 100000;
+
+    constexpr bool try_seed(uint32_t seed) {
+        for (size_t slot = 0; slot < Slots; ++slot) slots_[slot] = 0;
+        for (size_t i = 0; i < N; ++i) {
+            size_t slot = keyword_hash(words_[i].data(), words_[i].size(), seed) & (Slots - 1);
+            if (slots_[slot] != 0) return false;
+            slots_[slot] = static_cast<uint8_t>(i + 1);
+        }
+        return true;
+    }
+
+    std::string_view words_[N] = {};
+    uint8_t slots_[Slots] = {};
+    size_t min_length_ = static_cast<size_t>(-1);
+    size_t max_length_ = 0;
+    uint32_t seed_ = 0;
+    bool valid_ = false;
+};
+
+// Stands in for a table where a language has no keywords
+struct NoKeywords {
+    constexpr bool contains(const char*, size_t) const { return false; }
+};
+
+} // namespace editor
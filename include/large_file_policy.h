@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <map>
+#include <string>
+
+class PieceTable;
+
+namespace editor {
+
+// Subsystems whose cost grows with the whole document
+enum class LargeFileFeature {
+    Minimap,            // Density preview of the whole document
+    Folding,            // Region analysis of every line
+    Autocomplete,       // Word counts of the document
+    TreeSitter,         // Full parse
+    LanguageServer,     // didOpen with the whole text, then didChange
+    FullHighlight,      // Background highlighting past the viewport
+    Count
+};
+
+enum class FeatureMode {
+    On,
+    Defer,      // Not started on open; starts the first time the user asks for it
+    Off
+};
+
+/**
+ * LargeFilePolicy - which subsystems a document is too big for
+ *
+ * Past any threshold (bytes, lines, or the longest line, since one
+ * minified line is as bad as a million short ones) a document goes into
+ * large-file mode: editing, search and viewport highlighting stay, and
+ * each expensive subsystem is deferred or turned off as configured.
+ *
+ * Configured from WorkspaceSettings::custom_settings:
+ *
+ *     large_file.enabled = true | false
+ *     large_file.max_bytes = 32MB           (K, M, G suffixes)
+ *     large_file.max_lines = 1000000
+ *     large_file.max_line_length = 20000
+ *     large_file.<feature> = on | defer | off     (feature as in name())
+ *
+ * Malformed values keep the default.
+ */
+class LargeFilePolicy {
+public:
+    static constexpr size_t kFeatures = static_cast<size_t>(LargeFileFeature::Count);
+    // How much of a document evaluate() reads to find its longest line
+    static constexpr size_t kLineSampleBytes = 1024 * 1024;
+
+    struct Decision {
+        bool large = false;
+        std::string reason;     // "120.0 MB over the 32.0 MB limit"
+        FeatureMode modes[kFeatures] = {};
+
+        FeatureMode mode(LargeFileFeature feature) const { return modes[static_cast<size_t>(feature)]; }
+        bool allows(LargeFileFeature feature) const { return mode(feature) == FeatureMode::On; }
+        // The user asked for a deferred feature: it runs from now on
+        bool resume(LargeFileFeature feature);
+        // What was turned off, for the status bar; empty when not large
+        std::string message() const;
+    };
+
+    LargeFilePolicy();
+
+    void load(const std::map<std::string, std::string>& settings);
+
+    bool enabled() const { return enabled_; }
+    size_t max_bytes() const { return max_bytes_; }
+    size_t max_lines() const { return max_lines_; }
+    size_t max_line_length() const { return max_line_length_; }
+    FeatureMode configured(LargeFileFeature feature) const { return modes_[static_cast<size_t>(feature)]; }
+
+    Decision evaluate(size_t bytes, size_t lines, size_t longest_line) const;
+    // Lines are those indexed so far; the longest line is sampled from
+    // the first kLineSampleBytes
+    Decision evaluate(const PieceTable& document) const;
+
+    static const char* name(LargeFileFeature feature);         // "language_server"
+    static const char* description(LargeFileFeature feature);  // "language server"
+    // "32MB", "512k", "1000" - false if malformed
+    static bool parse_size(const std::string& text, size_t& out);
+
+private:
+    bool enabled_ = true;
+    size_t max_bytes_ = 32 * 1024 * 1024;
+    size_t max_lines_ = 1000000;
+    size_t max_line_length_ = 20000;
+    FeatureMode modes_[kFeatures];
+};
+
+} // namespace editor
@@ -0,0 +1,51 @@
+#pragma once
+#include "draw_list.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace editor {
+
+/**
+ * LineRunCache - which rendered line images are still good
+ *
+ * Maps a glyph run's look (bytes, color spans, cell advance, background)
+ * to one of a fixed number of slots; the renderer keeps the slot's
+ * pixels (a row of an offscreen bitmap, say) and blits them instead of
+ * drawing the text again. Theme and fold changes need no explicit
+ * invalidation: they change the colors or the runs, hence the key.
+ * Slots are recycled least recently used first, so capacity should be a
+ * few screens of rows to keep one frame from evicting its own lines.
+ */
+class LineRunCache {
+public:
+    explicit LineRunCache(size_t capacity = 0) { set_capacity(capacity); }
+
+    // Key of a run command of list drawn over an opaque background
+    static uint64_t key_of(const DrawList& list, const DrawCommand& run, uint32_t background);
+
+    // Slot holding key; hit is false when the slot was (re)assigned and
+    // its pixels must be drawn before use
+    size_t acquire(uint64_t key, bool& hit);
+
+    void set_capacity(size_t capacity);
+    size_t capacity() const { return slots_.size(); }
+    void clear();
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+
+private:
+    struct Slot {
+        uint64_t key = 0;
+        uint64_t last_use = 0;
+        bool used = false;
+    };
+    std::vector<Slot> slots_;
+    std::unordered_map<uint64_t, size_t> index_;
+    uint64_t clock_ = 0;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
+
+} // namespace editor
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+class PieceTable;
+
+namespace editor {
+
+/**
+ * LogFollower - keeps a document in step with a file that keeps growing
+ *
+ * poll() stats the file and reads only the bytes past those already taken
+ * (at most kMaxReadBytes per call, the rest on the next one), then appends
+ * them with PieceTable::append_external: nothing before them is touched,
+ * only their newlines are indexed and they stay off the undo history.
+ *
+ * A file that got shorter (truncated) or whose first bytes changed
+ * (rotated: renamed away and created anew) is read again from the start
+ * into a fresh document; document() then returns it and the caller swaps
+ * it in. A rotated file that starts with the same kFingerprintBytes as the
+ * old one and is already longer goes unnoticed.
+ *
+ * Polling is a stat and a kFingerprintBytes read, cheap enough for a UI
+ * timer; followed logs are usually outside the workspace a FileWatcher
+ * covers. User edits to the document do not disturb following - the file
+ * offset is kept apart from the document's length.
+ */
+class LogFollower {
+public:
+    enum class Result {
+        Unchanged,
+        Appended,   // New bytes went on the end of document()
+        Reset,      // Truncated or rotated: document() is a new document
+        Missing     // Not there (between rotation and re-creation); kept as is
+    };
+
+    static constexpr size_t kMaxReadBytes = 8 * 1024 * 1024;
+    static constexpr size_t kFingerprintBytes = 256;
+
+    // Follow path, whose first `offset` bytes document holds already.
+    // False if the file cannot be opened.
+    bool start(const std::string& path, std::shared_ptr<PieceTable> document, uint64_t offset);
+    // The same with the whole document being the file as it was read
+    bool start(const std::string& path, std::shared_ptr<PieceTable> document);
+    void stop();
+    bool is_following() const { return document_ != nullptr; }
+
+    Result poll();
+
+    const std::string& path() const { return path_; }
+    const std::shared_ptr<PieceTable>& document() const { return document_; }
+    uint64_t offset() const { return offset_; }             // File bytes taken so far
+    size_t last_appended() const { return last_appended_; } // By the last poll()
+    size_t reset_count() const { return resets_; }
+
+private:
+    bool read_fingerprint(std::string& out) const;
+    Result reset();
+
+    std::string path_;
+    std::shared_ptr<PieceTable> document_;
+    uint64_t offset_ = 0;
+    std::string fingerprint_;       // First bytes of the file, up to kFingerprintBytes
+    size_t last_appended_ = 0;
+    size_t resets_ = 0;
+};
+
+} // namespace editor
@@ -8,6 +8,10 @@
 #include <unordered_map>
 #include <windows.h>
 #include "../external/json/json.hpp"
+#include "lsp_document_sync.h"
+#include "lsp_encode.h"
+#include "lsp_io_reactor.h"
+#include "lsp_types.h"
 
 /**
  * LSP Client - Language Server Protocol client implementation
@@ -15,81 +19,96 @@
  */
 class LSPClient {
 public:
-    struct Position {
-        int line;      // 0-based
-        int character; // 0-based (UTF-16 code unit)
-    };
-
-    struct Range {
-        Position start;
-        Position end;
-    };
-
-    struct Location {
-        std::string uri;
-        Range range;
-    };
-
-    struct Diagnostic {
-        Range range;
-        int severity; // 1=Error, 2=Warning, 3=Info, 4=Hint
-        std::string message;
-        std::string source;
-    };
-
-    struct CompletionItem {
-        std::string label;
-        int kind; // 1=Text, 2=Method, 3=Function, 6=Variable, etc.
-        std::string detail;
-        std::string documentation;
-        std::string insertText;
-    };
-
-    struct Hover {
-        std::string contents;
-        Range range;
-    };
+    using Position = editor::LspPosition;
+    using Range = editor::LspRange;
+    using Location = editor::LspLocation;
+    using Diagnostic = editor::LspDiagnostic;
+    using CompletionItem = editor::LspCompletionItem;
+    using Hover = editor::LspHover;
+    using SemanticTokens = editor::LspSemanticTokens;
 
     using DiagnosticsCallback = std::function<void(const std::string& uri, const std::vector<Diagnostic>&)>;
     using CompletionCallback = std::function<void(const std::vector<CompletionItem>&)>;
     using HoverCallback = std::function<void(const Hover&)>;
     using LocationCallback = std::function<void(const std::vector<Location>&)>;
+    using SemanticTokensCallback = std::function<void(const SemanticTokens&)>;
 
-    LSPClient();
+    // Clients given the same reactor share its reader thread; without one
+    // the client gets a reactor of its own
+    explicit LSPClient(std::shared_ptr<editor::LspIoReactor> reactor = nullptr);
     ~LSPClient();
 
     // Server lifecycle
     bool start_server(const std::string& server_command, const std::string& workspace_root);
+    // Blocks until the server answers (up to a second)
     bool initialize(const std::string& workspace_root);
+    // Sends initialize and returns; is_running() once the answer has been
+    // processed. Document notifications sent meanwhile are held until then.
+    bool initialize_async(const std::string& workspace_root);
+    // Asks the server to exit, terminating it after a grace period. retire()
+    // leaves the waiting to the reactor thread instead of blocking.
     void shutdown();
+    void retire();
     bool is_running() const;
-
-    // Document synchronization
+    bool is_starting() const;
+    // The server's output ended (it exited or crashed) and every message it
+    // sent has been processed
+    bool has_exited() const;
+
+    // Negotiated in initialize: Position.character units, and whether the
+    // server accepts range changes (TextDocumentSyncKind.Incremental)
+    editor::PositionEncoding position_encoding() const;
+    bool incremental_sync() const;
+    // The server's semantic token legend (tokenTypes; empty when it has no
+    // semantic tokens), and whether it answers semanticTokens/full/delta
+    const std::vector<std::string>& semantic_token_types() const;
+    bool semantic_tokens_delta() const;
+
+    // Document synchronization. Each didChange carries the document's next
+    // version, counted from 1 at did_open
     void did_open(const std::string& uri, const std::string& language_id, const std::string& text);
     void did_change(const std::string& uri, const std::string& text);
+    // The same, streamed from the document's pieces without a copy of the
+    // text (LspDocumentMessage); for files of any size
+    void did_open(const std::string& uri, const std::string& language_id, const PieceTable& document);
+    void did_change(const std::string& uri, const PieceTable& document);
+    void did_change(const std::string& uri, const std::vector<editor::LspContentChange>& changes);
     void did_save(const std::string& uri);
     void did_close(const std::string& uri);
 
+    // Requests where only the newest answer matters. Issuing one cancels
+    // the previous one of its kind still in flight ($/cancelRequest), and a
+    // late response to a cancelled request is dropped without being parsed.
+    enum class RequestKind { Completion, Hover, Definition, References, SemanticTokens, Count };
+    void cancel_request(RequestKind kind);
+
     // Language features
     void request_completion(const std::string& uri, int line, int character, CompletionCallback callback);
     void request_hover(const std::string& uri, int line, int character, HoverCallback callback);
     void request_definition(const std::string& uri, int line, int character, LocationCallback callback);
     void request_references(const std::string& uri, int line, int character, LocationCallback callback);
+    // Tokens of the whole document; given the resultId of the tokens held,
+    // a server that does deltas sends only the edits to them
+    void request_semantic_tokens(const std::string& uri, const std::string& previous_result_id,
+                                 SemanticTokensCallback callback);
 
     // Callbacks
     void set_diagnostics_callback(DiagnosticsCallback callback);
 
-    // Process incoming messages (call periodically)
+    // Handle every message the reader thread has decoded since the last
+    // call (call periodically from the thread that issues requests)
     void process_messages();
 
 public:
     struct Impl;
     std::unique_ptr<Impl> impl_;
 
+    int begin_request(RequestKind kind);
     void send_request(const std::string& method, const nlohmann::json& params, int request_id);
     void send_notification(const std::string& method, const nlohmann::json& params);
-    std::string read_message();
+    void stop(bool wait);
     void write_message(const std::string& message);
+    void write_document_message(const editor::LspDocumentMessage& message);
     void handle_message(const std::string& message);
     void handle_response(int id, const nlohmann::json& result);
     void handle_notification(const std::string& method, const nlohmann::json& params);
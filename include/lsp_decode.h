@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include "lsp_types.h"
+
+namespace editor {
+
+/**
+ * Streaming decoders for the high-volume LSP messages
+ *
+ * A completion list or a project's diagnostics can run to megabytes.
+ * These walk the message body once with a SAX parser and fill the
+ * client structures as values go by; members they do not need (text
+ * edits, related information, data) are skipped without building them,
+ * and there is no intermediate document to convert from.
+ *
+ * All return false for a body that is not valid JSON; the outputs are
+ * cleared first either way.
+ */
+
+// A textDocument/completion response: result is CompletionItem[], a
+// CompletionList or null. False also when the response carries no result
+// (an error).
+bool decode_completion_response(std::string_view body, std::vector<LspCompletionItem>& items);
+
+// A textDocument/publishDiagnostics notification
+bool decode_publish_diagnostics(std::string_view body, std::string& uri, std::vector<LspDiagnostic>& diagnostics);
+
+// A textDocument/semanticTokens/full or full/delta response: SemanticTokens
+// or SemanticTokensDelta (tokens.delta set). False also when result is
+// null or missing.
+bool decode_semantic_tokens_response(std::string_view body, LspSemanticTokens& tokens);
+
+} // namespace editor
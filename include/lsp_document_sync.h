@@ -0,0 +1,105 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "piece_table.h"
+
+namespace editor {
+
+// Unit of LSP Position.character, as negotiated with the server
+enum class PositionEncoding {
+    Utf8,       // Bytes
+    Utf16       // UTF-16 code units, the protocol default
+};
+
+// One TextDocumentContentChangeEvent; changes apply in order, each in the
+// coordinates left by the one before
+struct LspContentChange {
+    bool full = false;          // text replaces the document; range unused
+    int start_line = 0;
+    int start_character = 0;
+    int end_line = 0;
+    int end_character = 0;
+    std::string text;
+};
+
+/**
+ * LspDocumentSync - didChange payloads built from a document's edits
+ *
+ * Listens to a PieceTable and turns each edit into a range change in the
+ * server's position encoding, reading only the edited line's prefix and
+ * the edit's own text. Bursts are coalesced while they are queued: typing
+ * at the end of the previous change extends its text, backspacing over
+ * text it inserted trims it, and an insert where a removal left off turns
+ * it into a replacement. Past kMaxChanges queued changes or kMaxBytes of
+ * queued text the queue collapses to a single full-text change, read
+ * when it is taken.
+ *
+ * due() says when to send: debounce() after the last edit, or
+ * max_latency() after the first one so continuous typing still reaches
+ * the server. Versions are the client's; this only builds the changes.
+ */
+class LspDocumentSync {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    LspDocumentSync() = default;
+    ~LspDocumentSync();
+
+    LspDocumentSync(const LspDocumentSync&) = delete;
+    LspDocumentSync& operator=(const LspDocumentSync&) = delete;
+
+    // Start tracking document as uri (already opened on the server), with
+    // nothing queued; nullptr stops tracking
+    void set_document(const std::shared_ptr<PieceTable>& document, const std::string& uri);
+    const std::shared_ptr<PieceTable>& document() const { return document_; }
+    const std::string& uri() const { return uri_; }
+
+    void set_encoding(PositionEncoding encoding) { encoding_ = encoding; }
+    // false: the server only takes full text (TextDocumentSyncKind.Full)
+    void set_incremental(bool incremental) { incremental_ = incremental; }
+    void set_debounce(std::chrono::milliseconds debounce, std::chrono::milliseconds max_latency);
+
+    bool has_pending() const { return full_ || !pending_.empty(); }
+    // The queue has collapsed to the full text: a caller that can stream
+    // the document itself sends it and calls set_document() instead of take()
+    bool full_pending() const { return full_; }
+    bool due(Clock::time_point now = Clock::now()) const;
+    // Moves the queued changes into out (cleared first); false if none
+    bool take(std::vector<LspContentChange>& out);
+
+    static constexpr size_t kMaxChanges = 64;
+    static constexpr size_t kMaxBytes = 1024 * 1024;
+
+private:
+    struct Tail {
+        size_t offset = 0;      // Document offset just past the last change's text
+        int line = 0;           // Same point as an LSP position
+        int character = 0;
+    };
+
+    void on_change(const PieceTable::Change& change);
+    int units(const std::string& text, size_t from = 0) const;
+    void advance(int& line, int& character, const std::string& text) const;
+    void collapse();
+
+    std::shared_ptr<PieceTable> document_;
+    size_t listener_id_ = 0;
+    std::string uri_;
+
+    PositionEncoding encoding_ = PositionEncoding::Utf16;
+    bool incremental_ = true;
+    std::chrono::milliseconds debounce_{150};
+    std::chrono::milliseconds max_latency_{500};
+
+    std::vector<LspContentChange> pending_;
+    size_t pending_bytes_ = 0;
+    bool full_ = false;
+    Tail tail_;
+    Clock::time_point first_edit_;
+    Clock::time_point last_edit_;
+};
+
+} // namespace editor
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+
+class PieceTable;
+
+namespace editor {
+
+// Receives an encoded message in pieces; false stops the write
+using LspSink = std::function<bool(const char* data, size_t size)>;
+
+// Bytes text takes as the contents of a JSON string, and appending it so
+std::size_t json_escaped_length(std::string_view text);
+void append_json_escaped(std::string_view text, std::string& out);
+
+/**
+ * LspDocumentMessage - a notification that carries a whole document,
+ * written straight from its pieces
+ *
+ * didOpen and full-text didChange hold the entire file in one JSON string.
+ * Built as a DOM and dumped, a 300 MB generated file costs the DOM, the
+ * dump and the framed copy. Here only the members around the text are
+ * formatted; the text's escaped length is counted in one pass over the
+ * document's chunks, so Content-Length is known before the first byte
+ * goes out, and a second pass escapes it into the sink block by block:
+ * only a block of about kBlockSize is held at a time.
+ *
+ * The message refers to the document: write it before the next edit.
+ */
+class LspDocumentMessage {
+public:
+    static LspDocumentMessage did_open(const std::string& uri, const std::string& language_id, int version,
+                                       const PieceTable& document);
+    // textDocument/didChange whose one change replaces the text
+    static LspDocumentMessage full_change(const std::string& uri, int version, const PieceTable& document);
+
+    std::size_t body_length() const { return head_.size() + text_length_ + tail_.size(); }
+    // The Content-Length header (unless with_header is false) and the body.
+    // False if the sink refused a piece
+    bool write(const LspSink& sink, bool with_header = true) const;
+
+    static constexpr std::size_t kBlockSize = 64 * 1024;
+
+private:
+    LspDocumentMessage(std::string head, std::string tail, const PieceTable& document);
+
+    std::string head_;          // Up to the text's opening quote
+    std::string tail_;          // From its closing quote
+    const PieceTable* document_;
+    std::size_t text_length_ = 0;
+};
+
+} // namespace editor
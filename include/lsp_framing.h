@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace editor {
+
+/**
+ * LspFraming - splits a byte stream into base-protocol messages
+ *
+ * The reader fills the buffer in large blocks (prepare, then commit what
+ * it read) and next() walks the Content-Length headers in place, copying
+ * out only message bodies. The header scan resumes where it stopped, so a
+ * message arriving in many reads is not rescanned from its start.
+ * Consumed bytes are reclaimed by shifting the tail down once they
+ * outweigh it, keeping the buffer's size near the largest message.
+ *
+ * A header block without a Content-Length is skipped.
+ */
+class LspFraming {
+public:
+    // Space for at least size more bytes, to be followed by commit(bytes read)
+    char* prepare(size_t size);
+    void commit(size_t size) { end_ += size; }
+    void feed(const char* data, size_t size);
+
+    // Moves the next complete body into message; false until one arrives
+    bool next(std::string& message);
+
+    size_t buffered() const { return end_ - begin_; }
+    void clear() { begin_ = end_ = scan_ = 0; }
+
+    static constexpr size_t kReadSize = 64 * 1024;
+
+private:
+    void compact();
+
+    std::vector<char> buffer_;
+    size_t begin_ = 0;      // First unconsumed byte
+    size_t end_ = 0;        // One past the last byte read
+    size_t scan_ = 0;       // Header terminator search resumes here
+};
+
+// Top-level "id" and "method" of a message body, found by skipping over
+// the other members without building them: enough to drop a response
+// nobody waits for, or route a message to its decoder, before parsing it
+struct MessageHead {
+    bool has_id = false;        // An integer id
+    long long id = 0;
+    std::string_view method;    // Empty for a response; points into the body
+
+    bool is_response() const { return has_id && method.empty(); }
+};
+bool peek_message_head(std::string_view body, MessageHead& head);
+
+} // namespace editor
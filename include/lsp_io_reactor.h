@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lsp_framing.h"
+#include "spsc_queue.h"
+
+namespace editor {
+
+/**
+ * LspIoReactor - one thread reading every language server's output
+ *
+ * Each server is a channel: a non-blocking read function over its pipe,
+ * the framing state of its stream and an inbox of decoded messages that
+ * the UI thread drains. The thread sweeps all channels, reading each
+ * until it has nothing waiting; when a sweep finds no data it sleeps,
+ * backing off from 1 ms to kMaxIdleWait, and any new channel or task
+ * wakes it. A full inbox parks the message in hand and stops reading
+ * that channel until the UI catches up, so nothing is dropped and one
+ * chatty server does not starve the others.
+ *
+ * Tasks are small jobs polled on the same thread until they report done,
+ * such as waiting out a retired server's exit without blocking the UI.
+ */
+class LspIoReactor {
+public:
+    // Reads what is waiting without blocking: bytes read, 0 when nothing
+    // is, -1 once the stream has ended
+    using ReadFn = std::function<long long(char* buffer, size_t size)>;
+    // Polled until it returns true; finish means the reactor is going away
+    // and the task must wrap up in this call
+    using Task = std::function<bool(bool finish)>;
+
+    struct Channel {
+        SpscQueue<std::string> inbox{1024};
+        std::atomic<bool> closed{false};    // Stream ended; the inbox may still hold messages
+
+    private:
+        friend class LspIoReactor;
+        ReadFn read;
+        LspFraming framing;
+        std::string parked;                 // Decoded but the inbox was full
+        bool has_parked = false;
+        std::atomic<bool> removed{false};
+    };
+
+    LspIoReactor();
+    ~LspIoReactor();
+
+    LspIoReactor(const LspIoReactor&) = delete;
+    LspIoReactor& operator=(const LspIoReactor&) = delete;
+
+    std::shared_ptr<Channel> add_channel(ReadFn read);
+    // The channel's read function is not called again once this returns
+    void remove_channel(const std::shared_ptr<Channel>& channel);
+    void add_task(Task task);
+
+    size_t channel_count() const;
+
+    static constexpr int kMaxIdleWait = 8;      // Milliseconds
+
+private:
+    void run();
+    bool service(Channel& channel);
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::vector<std::shared_ptr<Channel>> channels_;
+    std::vector<Task> tasks_;
+    std::mutex read_mutex_;                 // Held while a sweep calls read functions
+    bool changed_ = false;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+} // namespace editor
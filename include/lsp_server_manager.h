@@ -0,0 +1,116 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "lsp_client.h"
+#include "lsp_io_reactor.h"
+
+namespace editor {
+
+struct LspServerConfig {
+    std::string name;                       // One process per name, e.g. "clangd"
+    std::string command;                    // Command line that starts it on stdio
+    std::vector<std::string> languages;     // Language ids it serves
+    size_t max_document_bytes = 0;          // Larger documents are not sent to it (0: no limit)
+};
+
+/**
+ * LspServerManager - the language servers of a workspace, one per configured server
+ *
+ * Documents are routed to a server by language id; a server is started
+ * the first time a document of one of its languages opens, and all of
+ * them share one LspIoReactor thread for their output. Starting never
+ * blocks: initialize is sent and the document notifications wait behind
+ * it.
+ *
+ * process_messages() does the housekeeping on the UI thread's schedule.
+ * A server that crashed is restarted after a backoff and its documents
+ * are reopened with their current text (from the reopen callback); one
+ * that crashes kMaxRestarts times within kRestartWindow is given up on.
+ * A server not used for the idle timeout is retired to reclaim its
+ * memory and started again, documents and all, when next needed.
+ *
+ * Documents are sent streamed from their pieces. One above its
+ * language's size limit is not opened at all - servers index generated
+ * files of hundreds of MB slowly, if at all - and open_document() says
+ * so, leaving the editor's own index to answer for it.
+ */
+class LspServerManager {
+public:
+    using Clock = std::chrono::steady_clock;
+    // An open document as it is now, to reopen it on a restarted server;
+    // anything queued for it before is stale
+    using ReopenFn = std::function<std::shared_ptr<PieceTable>(const std::string& uri)>;
+
+    explicit LspServerManager(std::string workspace_root);
+    ~LspServerManager();
+
+    LspServerManager(const LspServerManager&) = delete;
+    LspServerManager& operator=(const LspServerManager&) = delete;
+
+    void add_server(LspServerConfig config);
+    // clangd, pyright and gopls
+    static std::vector<LspServerConfig> default_servers();
+    // Language id for a file name by extension; empty when unknown
+    static std::string language_for_path(const std::string& path);
+
+    // Opens uri on the server for language_id, starting it if needed;
+    // nullptr when no server handles the language, it cannot be started,
+    // or the document is over the language's size limit
+    LSPClient* open_document(const std::string& uri, const std::string& language_id, const PieceTable& document);
+    // Largest document sent to a server for language_id (0: no limit).
+    // set_size_limit overrides the limit of the language's server config
+    size_t size_limit(const std::string& language_id) const;
+    void set_size_limit(const std::string& language_id, size_t bytes) { size_limits_[language_id] = bytes; }
+    bool over_size_limit(const std::string& language_id, size_t bytes) const;
+    void close_document(const std::string& uri);
+    // Server of an open document, or nullptr. launch brings back a server
+    // that was retired while idle and counts as use; without launch the
+    // lookup leaves the server alone.
+    LSPClient* client_for(const std::string& uri, bool launch = true);
+
+    void set_diagnostics_callback(LSPClient::DiagnosticsCallback callback);
+    void set_reopen_callback(ReopenFn reopen) { reopen_ = std::move(reopen); }
+    void set_idle_timeout(std::chrono::seconds timeout) { idle_timeout_ = timeout; }
+
+    // Drains every server's messages, restarts crashed servers and retires
+    // idle ones. Call periodically from the UI thread.
+    void process_messages(Clock::time_point now = Clock::now());
+
+    size_t running_servers() const;
+
+    static constexpr int kMaxRestarts = 3;
+    static constexpr std::chrono::seconds kRestartWindow{60};
+
+private:
+    struct Server {
+        LspServerConfig config;
+        std::unique_ptr<LSPClient> client;
+        std::vector<std::string> documents;     // Open uris routed here
+        Clock::time_point last_used;
+        int crashes = 0;
+        Clock::time_point first_crash;
+        bool restart_pending = false;
+        Clock::time_point restart_at;
+        bool failed = false;                    // Would not start, or crashed too often; left stopped
+    };
+
+    Server* server_for_language(const std::string& language_id) const;
+    bool start(Server& server, Clock::time_point now);
+    void on_crash(Server& server, Clock::time_point now);
+
+    std::string workspace_root_;
+    std::shared_ptr<LspIoReactor> reactor_;
+    std::vector<std::unique_ptr<Server>> servers_;
+    std::unordered_map<std::string, Server*> documents_;            // uri -> server
+    std::unordered_map<std::string, std::string> languages_;        // uri -> language id
+    std::unordered_map<std::string, size_t> size_limits_;           // language id -> bytes
+    LSPClient::DiagnosticsCallback diagnostics_callback_;
+    ReopenFn reopen_;
+    std::chrono::seconds idle_timeout_{600};
+};
+
+} // namespace editor
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace editor {
+
+// Protocol structures the client hands to the editor; LSPClient exposes
+// them under its own names (LSPClient::Diagnostic, ...)
+
+struct LspPosition {
+    int line = 0;          // 0-based
+    int character = 0;     // 0-based, in the negotiated position encoding
+};
+
+struct LspRange {
+    LspPosition start;
+    LspPosition end;
+};
+
+struct LspLocation {
+    std::string uri;
+    LspRange range;
+};
+
+struct LspDiagnostic {
+    LspRange range;
+    int severity = 1;      // 1=Error, 2=Warning, 3=Info, 4=Hint
+    std::string message;
+    std::string source;
+};
+
+struct LspCompletionItem {
+    std::string label;
+    int kind = 1;          // 1=Text, 2=Method, 3=Function, 6=Variable, etc.
+    std::string detail;
+    std::string documentation;
+    std::string insertText;
+};
+
+struct LspHover {
+    std::string contents;
+    LspRange range;
+};
+
+// One SemanticTokensEdit: replace delete_count integers of the previous
+// data array, starting at start, with data
+struct LspSemanticTokensEdit {
+    uint32_t start = 0;
+    uint32_t delete_count = 0;
+    std::vector<uint32_t> data;
+};
+
+// A semanticTokens/full or full/delta result. data holds five integers a
+// token (line delta, start delta, length, type, modifiers) when delta is
+// false; edits apply to the data of previous result otherwise.
+struct LspSemanticTokens {
+    std::string result_id;
+    bool delta = false;
+    std::vector<uint32_t> data;
+    std::vector<LspSemanticTokensEdit> edits;
+};
+
+} // namespace editor
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+namespace editor {
+
+/**
+ * LZ4 block format - fast compression for data paged out to disk
+ *
+ * Only the raw block format (no frame, no checksums): the caller keeps
+ * the uncompressed size. The compressor is the greedy single-probe one,
+ * which does a few hundred MB/s and typically halves source text; the
+ * decompressor checks every length and offset against both buffers, so a
+ * corrupt block fails instead of writing out of bounds. Blocks are
+ * readable by any LZ4 implementation's LZ4_decompress_safe.
+ */
+// Compressed size of size bytes in the worst case (incompressible data)
+inline size_t lz4_bound(size_t size) { return size + size / 255 + 16; }
+
+std::string lz4_compress(const char* data, size_t size);
+// out_size must be the exact uncompressed size; false if the block is corrupt
+bool lz4_decompress(const char* data, size_t size, char* out, size_t out_size);
+
+} // namespace editor
@@ -0,0 +1,107 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace editor {
+
+class MemoryReport;
+
+enum class MemoryPressureLevel : uint8_t { Normal, Moderate, Critical };
+
+/**
+ * MemoryPressureMonitor - gives memory back before the system pages the
+ * editor out
+ *
+ * The system says when memory runs short: a low-memory resource
+ * notification on Windows, PSI triggers on Linux (the editor's cgroup's
+ * memory.pressure when it has one, else /proc/pressure/memory, with
+ * memory.events "high" counts as the fallback), a dispatch memory-pressure
+ * source on macOS. Its thread only records the level and calls the wake
+ * hook; poll() on the UI thread does the shedding.
+ *
+ * Caches are shed in the order they were added, each from the level it
+ * was added with: Moderate ones on any pressure, Critical ones only when
+ * the system is about to swap. Add the cheapest to rebuild first. A level
+ * is shed at most once per kCooldown, and level() stays raised until
+ * kQuietPeriod passes without a signal, so caches can hold off refilling
+ * meanwhile. What each cache gave back is kept for the memory report.
+ */
+class MemoryPressureMonitor {
+public:
+    // Drops what the cache holds; returns the bytes freed
+    using ShedFn = std::function<size_t()>;
+    // Runs on the monitor's thread when pressure is signalled; GUI
+    // consumers post to their UI thread and call poll() there
+    using WakeFn = std::function<void()>;
+
+    struct Eviction {
+        std::string cache;
+        size_t times = 0;               // Sheds that freed anything
+        size_t bytes = 0;               // Freed in total
+    };
+
+    static constexpr std::chrono::seconds kCooldown{10};
+    static constexpr std::chrono::seconds kQuietPeriod{30};
+
+    MemoryPressureMonitor();
+    ~MemoryPressureMonitor();       // Stops the platform source
+
+    MemoryPressureMonitor(const MemoryPressureMonitor&) = delete;
+    MemoryPressureMonitor& operator=(const MemoryPressureMonitor&) = delete;
+
+    // Next in the shedding order
+    void add_cache(const std::string& name, ShedFn shed, MemoryPressureLevel from = MemoryPressureLevel::Moderate);
+
+    // Listen to the platform's signals; false when it has none (the
+    // monitor still sheds on signal()). Restarts if already listening.
+    bool start(WakeFn wake = nullptr);
+    void stop();
+
+    // Pressure seen now; any thread (the platform source, a test)
+    void signal(MemoryPressureLevel level);
+    // Signalled level, back to Normal after kQuietPeriod without a signal
+    MemoryPressureLevel level() const;
+
+    // UI thread: shed for the highest level signalled since the last call,
+    // unless that level was shed within kCooldown. Returns the bytes freed.
+    size_t poll();
+    // Shed every cache added for level or below, in order, now
+    size_t shed(MemoryPressureLevel level);
+
+    const std::vector<Eviction>& evictions() const { return evictions_; }
+    // Evictions so far, as the report's "shed under pressure" lines
+    void report(MemoryReport& report) const;
+
+    static const char* level_name(MemoryPressureLevel level);
+
+private:
+    struct Backend;
+    struct Cache {
+        std::string name;
+        ShedFn shed;
+        MemoryPressureLevel from;
+    };
+    using Clock = std::chrono::steady_clock;
+
+    std::vector<Cache> caches_;
+    std::vector<Eviction> evictions_;   // Parallel to caches_
+    Clock::time_point last_shed_[3] = {};
+    bool shed_once_[3] = {};
+
+    WakeFn wake_;
+    std::atomic<uint8_t> pending_{0};   // Highest level signalled since poll()
+    mutable std::mutex signal_mutex_;
+    MemoryPressureLevel signalled_ = MemoryPressureLevel::Normal;
+    Clock::time_point signalled_at_{};
+
+    std::unique_ptr<Backend> backend_;
+};
+
+} // namespace editor
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace editor {
+
+/**
+ * MemoryReport - bytes held, by owner and subsystem
+ *
+ * Subsystems account for themselves (PieceTable::get_memory_usage,
+ * BackgroundIndexer::get_memory_usage, ...); the editor collects their
+ * numbers here under an owner, a document's name or a shared one such as
+ * "workspace", and format() breaks the total down both ways. Sizes count
+ * what the containers hold (capacities, node estimates), not allocator
+ * overhead, so they come out a little under RSS. Mapped file bytes are
+ * reported apart: they are page cache, not heap. So are the bytes caches
+ * gave back under memory pressure (MemoryPressureMonitor), which no longer
+ * count toward any total.
+ */
+class MemoryReport {
+public:
+    struct Entry {
+        std::string owner;
+        std::string subsystem;
+        size_t bytes = 0;
+        bool mapped = false;
+    };
+    struct Shed {
+        std::string cache;
+        size_t bytes = 0;       // Freed in total
+        size_t times = 0;
+    };
+
+    void add(const std::string& owner, const std::string& subsystem, size_t bytes, bool mapped = false);
+
+    // A cache that gave memory back under pressure
+    void add_shed(const std::string& cache, size_t bytes, size_t times);
+
+    const std::vector<Entry>& entries() const { return entries_; }
+    const std::vector<Shed>& shed() const { return shed_; }
+    size_t total() const;       // Heap only
+    size_t mapped_total() const;
+    size_t owner_total(const std::string& owner) const;
+    size_t subsystem_total(const std::string& subsystem) const;
+
+    // Per owner, then per subsystem, largest first; then what was shed
+    std::string format() const;
+    static std::string format_bytes(size_t bytes);
+
+private:
+    std::vector<Entry> entries_;
+    std::vector<Shed> shed_;
+};
+
+// Heap bytes behind common containers, for the subsystems' accounting
+inline size_t heap_bytes(const std::string& text) {
+    // Short strings live inside the object; an empty one has the inline capacity
+    static const size_t inline_capacity = std::string().capacity();
+    return text.capacity() > inline_capacity ? text.capacity() + 1 : 0;
+}
+template <typename T>
+size_t heap_bytes(const std::vector<T>& items) {
+    return items.capacity() * sizeof(T);
+}
+// Nodes and buckets of a node-based hash map or set (contents not included)
+template <typename Map>
+size_t node_bytes(const Map& map) {
+    return map.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void*)) + map.bucket_count() * sizeof(void*);
+}
+
+} // namespace editor
@@ -4,12 +4,17 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <cstdint>
+#include "gdi_cache.h"
+#include "minimap_density.h"
 
 /**
  * Minimap - Document Overview
  * 
  * Provides a bird's-eye view of the entire document on the right side
  * with syntax color preview, visible region indicator, and click-to-scroll.
+ * The preview itself is a MinimapDensity bitmap kept up to date off the
+ * paint path.
  */
 
 class Minimap {
@@ -33,74 +38,30 @@ public:
         char_height_ = height;
     }
     
-    // Render the minimap
-    void render(HDC hdc, const RECT& area, const std::vector<std::string>& lines, 
-                size_t top_line, size_t visible_line_count, 
-                const std::vector<COLORREF>& syntax_colors) {
+    // Render the minimap: one blit of density's bitmap (sized to area), then
+    // the visible region blended over it - no per-line work in the frame
+    void render(HDC hdc, editor::GdiCache& gdi, const RECT& area, const editor::MinimapDensity& density,
+                size_t top_line, size_t visible_line_count) {
         if (!visible_) return;
         
-        // Draw background
-        HBRUSH bgBrush = CreateSolidBrush(RGB(25, 25, 30));
-        FillRect(hdc, &area, bgBrush);
-        DeleteObject(bgBrush);
-        
-        // Calculate minimap metrics
-        int map_height = area.bottom - area.top;
-        int total_lines = lines.size();
-        if (total_lines == 0) return;
-        
-        // Scale factor for fitting all lines
-        float line_scale = (float)map_height / (float)total_lines;
-        
-        // Render document preview
-        for (size_t i = 0; i < lines.size(); ++i) {
-            int y = area.top + (int)(i * line_scale);
-            if (y >= area.bottom) break;
-            
-            render_line_preview(hdc, area.left, y, area.right - area.left, 
-                              lines[i], i < syntax_colors.size() ? syntax_colors[i] : RGB(180, 180, 180));
-        }
-        
-        // Draw visible region indicator
-        int visible_start_y = area.top + (int)(top_line * line_scale);
-        int visible_height = (int)(visible_line_count * line_scale);
-        if (visible_height < 3) visible_height = 3; // Minimum height for visibility
-        
-        RECT visible_rect = {
-            area.left,
-            visible_start_y,
-            area.right,
-            visible_start_y + visible_height
-        };
-        
-        // Semi-transparent overlay
-        HBRUSH visibleBrush = CreateSolidBrush(RGB(80, 120, 200));
-        HPEN visiblePen = CreatePen(PS_SOLID, 1, RGB(100, 150, 255));
-        HPEN oldPen = (HPEN)SelectObject(hdc, visiblePen);
-        HBRUSH oldBrush = (HBRUSH)SelectObject(hdc, GetStockObject(NULL_BRUSH));
-        
-        // Draw border
-        Rectangle(hdc, visible_rect.left, visible_rect.top, visible_rect.right, visible_rect.bottom);
-        
-        // Draw semi-transparent fill (simulate with dithered pattern)
-        for (int y = visible_rect.top; y < visible_rect.bottom; y += 2) {
-            for (int x = visible_rect.left; x < visible_rect.right; x += 2) {
-                SetPixel(hdc, x, y, RGB(80, 120, 200));
-            }
+        int width = area.right - area.left;
+        int height = area.bottom - area.top;
+        if (density.width() != width || density.height() != height) {
+            // Not derived for this size yet - show the empty background
+            FillRect(hdc, &area, gdi.brush(RGB(25, 25, 30)));
+            return;
         }
+        blit(hdc, area.left, area.top, width, height, density.pixels());
         
-        SelectObject(hdc, oldPen);
-        SelectObject(hdc, oldBrush);
-        DeleteObject(visiblePen);
-        DeleteObject(visibleBrush);
+        // Visible region indicator: a translucent band with a solid border
+        int first = 0, last = 0;
+        density.viewport_rows(top_line, visible_line_count, first, last);
+        if (first >= last) return;
+        density.blend_rows(first, last, 0xFF5078C8, band_);
+        blit(hdc, area.left, area.top + first, width, last - first, band_.data());
         
-        // Draw border around minimap
-        HPEN borderPen = CreatePen(PS_SOLID, 1, RGB(60, 60, 70));
-        oldPen = (HPEN)SelectObject(hdc, borderPen);
-        MoveToEx(hdc, area.left, area.top, nullptr);
-        LineTo(hdc, area.left, area.bottom);
-        SelectObject(hdc, oldPen);
-        DeleteObject(borderPen);
+        RECT visible_rect = { area.left, area.top + first, area.right, area.top + last };
+        FrameRect(hdc, &visible_rect, gdi.brush(RGB(100, 150, 255)));
     }
     
     // Handle click on minimap - returns line number to scroll to
@@ -135,31 +96,16 @@ private:
     int char_width_;
     int char_height_;
     int max_chars_per_line_;
+    std::vector<uint32_t> band_;    // Blended visible rows, reused across frames
     
-    void render_line_preview(HDC hdc, int x, int y, int width, 
-                            const std::string& line, COLORREF color) {
-        if (line.empty()) return;
-        
-        // Simplified rendering - just draw a colored horizontal line representing code
-        int line_length = (std::min)((int)line.size(), max_chars_per_line_);
-        int preview_width = (line_length * width) / max_chars_per_line_;
-        if (preview_width < 1) preview_width = 1;
-        
-        // Determine color intensity based on line content
-        int non_space_count = 0;
-        for (char c : line) {
-            if (c != ' ' && c != '\t') non_space_count++;
-        }
-        
-        if (non_space_count > 0) {
-            HPEN linePen = CreatePen(PS_SOLID, 1, color);
-            HPEN oldPen = (HPEN)SelectObject(hdc, linePen);
-            
-            MoveToEx(hdc, x + 2, y, nullptr);
-            LineTo(hdc, x + 2 + preview_width, y);
-            
-            SelectObject(hdc, oldPen);
-            DeleteObject(linePen);
-        }
+    static void blit(HDC hdc, int x, int y, int width, int height, const uint32_t* pixels) {
+        BITMAPINFO info = {};
+        info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        info.bmiHeader.biWidth = width;
+        info.bmiHeader.biHeight = -height;     // Top-down rows
+        info.bmiHeader.biPlanes = 1;
+        info.bmiHeader.biBitCount = 32;
+        info.bmiHeader.biCompression = BI_RGB;
+        SetDIBitsToDevice(hdc, x, y, width, height, 0, 0, 0, height, pixels, &info, DIB_RGB_COLORS);
     }
 };
@@ -0,0 +1,84 @@
+#pragma once
+#include "piece_table.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace editor {
+
+/**
+ * MinimapDensity - the minimap as a downsampled color bitmap
+ *
+ * One pixel row per minimap row, as many columns as the minimap is wide;
+ * pixels are 0xAARRGGBB (a top-down 32-bit DIB as is). Row r stands for
+ * the lines [r * lines / height, (r + 1) * lines / height) - the same
+ * mapping Minimap::handle_click uses - and is derived from at most
+ * kSamplesPerRow of them: each column is the fraction of sampled lines
+ * with a non-blank character there, tinted with the line's color. A row
+ * therefore costs the same to derive in a 100-line file and a
+ * million-line one.
+ *
+ * Rows are re-derived lazily. An edit that keeps the line count dirties
+ * just the rows of the edited lines; one that adds or removes lines
+ * moves every bucket boundary and dirties all rows. update() re-derives
+ * a bounded number of dirty rows per call, so a frame's minimap work is
+ * constant: a few rows plus one blit of pixels().
+ */
+class MinimapDensity {
+public:
+    // Color of a line's preview (e.g. its first token's color), 0xAARRGGBB
+    using LineColor = std::function<uint32_t(const std::string& line)>;
+
+    explicit MinimapDensity(LineColor line_color = nullptr);
+    ~MinimapDensity();
+
+    MinimapDensity(const MinimapDensity&) = delete;
+    MinimapDensity& operator=(const MinimapDensity&) = delete;
+
+    // Bind to a document (no-op if already bound); dirties every row
+    void set_document(const std::shared_ptr<PieceTable>& document);
+    void resize(int width, int height);
+
+    // Re-derives up to max_rows dirty rows; true if any pixel changed
+    bool update(size_t max_rows = kRowsPerUpdate);
+    bool is_complete() const { return dirty_count_ == 0; }
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+    const uint32_t* pixels() const { return pixels_.data(); }
+
+    // Rows covering the visible lines [top_line, top_line + count), at least 3 tall
+    void viewport_rows(size_t top_line, size_t count, int& first, int& last) const;
+    // Copy of rows [first, last) with color blended over them at 1/3 opacity
+    void blend_rows(int first, int last, uint32_t color, std::vector<uint32_t>& out) const;
+
+    static constexpr size_t kSamplesPerRow = 4;
+    static constexpr size_t kRowsPerUpdate = 256;
+    static constexpr int kMaxChars = 80;        // Columns of text the width stands for
+    static constexpr int kTextLeft = 2;         // Border column, then padding
+    static constexpr uint32_t kBackground = 0xFF19191E;
+    static constexpr uint32_t kBorder = 0xFF3C3C46;
+    static constexpr uint32_t kDefaultColor = 0xFFB4B4B4;
+
+private:
+    void on_change(const PieceTable::Change& change);
+    void mark_dirty(int first_row, int last_row);
+    void mark_all_dirty();
+    void derive_row(int row);
+    int row_of_line(size_t line) const;
+
+    LineColor line_color_;
+    std::shared_ptr<PieceTable> document_;
+    size_t listener_id_ = 0;
+    size_t line_count_ = 0;
+    int width_ = 0;
+    int height_ = 0;
+    std::vector<uint32_t> pixels_;
+    std::vector<bool> dirty_;
+    size_t dirty_count_ = 0;
+    int next_row_ = 0;          // Where the next update() resumes scanning
+};
+
+} // namespace editor
@@ -0,0 +1,144 @@
+#ifndef PERSISTENT_INDEX_H
+#define PERSISTENT_INDEX_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace editor { class MappedFile; }
+
+/**
+ * IndexPosting - one word occurrence, as stored on disk and in memory
+ */
+struct IndexPosting {
+    uint32_t file_id;
+    uint32_t line_number;
+    uint32_t column;
+};
+
+/**
+ * PersistentIndex - read-only search index served straight from a mapping
+ *
+ * The file is a header followed by 8-byte aligned sections: file records
+ * (path, mtime, size and line offsets - the text itself stays in the
+ * source file and is read on demand), word records sorted by
+ * word with their postings, and trigram records sorted by trigram with
+ * ascending file ids. Lookups binary-search the records in place, so
+ * opening costs one mmap plus a bounds check of the records - nothing is
+ * parsed into heap structures. Values are in native byte order; a marker
+ * in the header rejects files written on a different architecture, and
+ * the version rejects older layouts.
+ */
+class PersistentIndex {
+public:
+    static constexpr uint32_t kVersion = 3;
+
+    // nullptr if the file is missing, truncated, corrupt or of another version
+    static std::shared_ptr<PersistentIndex> open(const std::string& path);
+
+    struct FileInfo {
+        std::string_view path;
+        uint64_t mtime;
+        uint64_t size;
+        uint32_t line_count;
+    };
+
+    size_t file_count() const { return file_count_; }
+    FileInfo file(uint32_t file_id) const;
+    // line_count + 1 byte offsets into the source file; line i spans
+    // [starts[i], starts[i + 1] - 1)
+    const uint64_t* line_starts(uint32_t file_id) const;
+
+    // Postings of a word (nullptr and count 0 if absent)
+    const IndexPosting* word_postings(std::string_view word, size_t& count) const;
+    // Ascending ids of the files containing a case-folded trigram
+    const uint32_t* trigram_files(uint32_t trigram, size_t& count) const;
+
+    // Visit every record (used when rewriting the index)
+    template <typename Fn> void for_each_word(Fn&& fn) const;
+    template <typename Fn> void for_each_trigram(Fn&& fn) const;
+
+    /**
+     * Writer - accumulates files, postings and trigrams and writes the
+     * layout above. write() goes through a temporary file and a rename, so
+     * readers mapping the old index keep a valid view.
+     */
+    class Writer {
+    public:
+        uint32_t add_file(std::string_view path, uint64_t mtime, uint64_t size,
+                          std::vector<uint64_t> line_starts);
+        void add_postings(std::string_view word, const IndexPosting* postings, size_t count);
+        void add_trigram(uint32_t trigram, uint32_t file_id);
+        bool write(const std::string& path) const;
+
+    private:
+        struct File {
+            std::string path;
+            uint64_t mtime;
+            uint64_t size;
+            std::vector<uint64_t> line_starts;  // line_count + 1 entries
+        };
+        std::vector<File> files_;
+        std::map<std::string, std::vector<IndexPosting>, std::less<>> words_;
+        std::map<uint32_t, std::vector<uint32_t>> trigrams_;
+    };
+
+    // On-disk records
+    struct FileRecord {
+        uint64_t path_offset;
+        uint32_t path_length;
+        uint32_t line_count;
+        uint64_t lines_offset;      // uint64_t[line_count + 1]
+        uint64_t mtime;
+        uint64_t size;
+    };
+    struct WordRecord {
+        uint64_t word_offset;
+        uint32_t word_length;
+        uint32_t posting_count;
+        uint64_t postings_offset;
+    };
+    struct TrigramRecord {
+        uint32_t trigram;
+        uint32_t file_count;
+        uint64_t files_offset;
+    };
+
+private:
+    PersistentIndex() = default;
+
+    const char* at(uint64_t offset) const { return data_ + offset; }
+    std::string_view word_of(const WordRecord& record) const {
+        return std::string_view(at(record.word_offset), record.word_length);
+    }
+
+    std::shared_ptr<editor::MappedFile> mapping_;
+    const char* data_ = nullptr;
+    const FileRecord* files_ = nullptr;
+    const WordRecord* words_ = nullptr;
+    const TrigramRecord* trigrams_ = nullptr;
+    size_t file_count_ = 0;
+    size_t word_count_ = 0;
+    size_t trigram_count_ = 0;
+};
+
+template <typename Fn>
+void PersistentIndex::for_each_word(Fn&& fn) const {
+    for (size_t i = 0; i < word_count_; ++i) {
+        fn(word_of(words_[i]), reinterpret_cast<const IndexPosting*>(at(words_[i].postings_offset)),
+           static_cast<size_t>(words_[i].posting_count));
+    }
+}
+
+template <typename Fn>
+void PersistentIndex::for_each_trigram(Fn&& fn) const {
+    for (size_t i = 0; i < trigram_count_; ++i) {
+        fn(trigrams_[i].trigram, reinterpret_cast<const uint32_t*>(at(trigrams_[i].files_offset)),
+           static_cast<size_t>(trigrams_[i].file_count));
+    }
+}
+
+#endif // PERSISTENT_INDEX_H
@@ -1,9 +1,19 @@
 #ifndef PIECE_TABLE_H
 #define PIECE_TABLE_H
 
+#include <algorithm>
 #include <vector>
+#include <deque>
 #include <string>
+#include <string_view>
 #include <memory>
+#include <functional>
+#include "text_buffer.h"
+#include "slab_pool.h"
+#include "history_spill.h"
+
+namespace editor { class MappedFile; }
+class DocumentSnapshot;
 
 /**
  * Piece represents a segment of text from either the original buffer or add buffer
@@ -23,58 +33,462 @@ struct Piece {
 /**
  * PieceTable - High-performance text buffer for million-line files
  * 
- * Uses piece table data structure which is O(1) for most operations
- * and maintains undo/redo history efficiently
+ * Pieces are kept in a red-black tree ordered by document position.
+ * Every node caches the byte length and newline count of its subtree,
+ * so insert, remove, offset lookup and line lookup are all O(log n)
+ * in the number of pieces. Nodes come from a per-table SlabPool, so edits
+ * don't hit the heap and destroying the table frees them in one go.
+ * Undo/redo history is kept as edit deltas that
+ * reference buffer ranges (Span), never copies of the text, capped by
+ * count and bytes. An undo step is one transaction (begin_transaction /
+ * commit_transaction) or a run of contiguous single-line edits (typing,
+ * repeated backspace) that coalesced. With a history spill set, steps past
+ * the caps and add-buffer chunks that only history still refers to are
+ * paged out to a compressed file instead, and read back when undo or
+ * redo reaches them.
+ *
+ * The original buffer is either an owned string or a read-only memory
+ * mapping of the file, so opening a file does not copy its contents.
+ * Offsets are raw bytes; CRLF line endings are kept as-is in the buffer and
+ * the '\r' is only dropped when whole lines are returned.
+ *
+ * snapshot() hands out an immutable DocumentSnapshot of the current version
+ * for readers on other threads (LSP sync, indexer, autosave, highlighting).
+ *
+ * With LineIndexing::Background the newline index of a mapped file is built
+ * in chunks on a worker thread. Until it finishes, get_line_count() is an
+ * estimate and only the first get_indexed_line_count() lines are addressable.
  */
-class PieceTable {
+class PieceTable : public TextBuffer {
+    struct PieceNode;
+    
 public:
+    enum class LineIndexing { Eager, Background };
+    
     PieceTable();
     explicit PieceTable(const std::string& initial_text);
+    // Use a mapped file as the original buffer without copying it
+    explicit PieceTable(std::shared_ptr<editor::MappedFile> mapping,
+                        LineIndexing indexing = LineIndexing::Eager);
+    ~PieceTable();
     
-    // Core editing operations - all O(1) or O(log n) complexity
-    void insert(size_t position, const std::string& text);
-    void remove(size_t position, size_t length);
+    // Tree nodes are owned by the table - copying is not supported
+    PieceTable(const PieceTable&) = delete;
+    PieceTable& operator=(const PieceTable&) = delete;
+    
+    // Core editing operations - all O(log n) in the number of pieces
+    void insert(size_t position, const std::string& text) override;
+    void remove(size_t position, size_t length) override;
+    // Text that arrived from outside (a followed log growing on disk) goes
+    // on the end like the file it extends: the same O(log n) insert, only
+    // its own newlines are indexed, and it is not an edit - nothing goes on
+    // the undo history and no keystroke group absorbs it
+    void append_external(const std::string& text);
     // Alias for test compatibility
     void delete_range(size_t position, size_t length) { remove(position, length); }
-    // Undo/redo API for test compatibility
-    void undo();
-    void redo();
+    // Undo/redo - one step is a transaction or a coalesced run of keystrokes
+    void undo() override;
+    void redo() override;
+    bool can_undo() const override { return !undo_history_.empty() || !spilled_undo_.empty(); }
+    bool can_redo() const override { return !redo_history_.empty() || !spilled_redo_.empty(); }
+    // Every edit until the matching commit undoes as one step (nestable)
+    void begin_transaction();
+    void commit_transaction();
+    // Start a new undo step even if the next edit continues the last one
+    void break_undo_group() { undo_group_open_ = false; }
+    size_t get_undo_count() const { return undo_history_.size() + spilled_step_count(spilled_undo_); }
+    size_t get_redo_count() const { return redo_history_.size() + spilled_step_count(spilled_redo_); }
+    // Increases whenever an edit starts a new undo step
+    size_t get_undo_serial() const { return undo_serial_; }
+    // Bytes of piece records held by the undo history (the text itself
+    // lives in the buffers exactly once)
+    size_t get_history_bytes() const { return undo_bytes_ + redo_bytes_; }
+    // Steps and piece bytes kept in memory; past them the oldest steps are
+    // dropped, or spilled when a spill is set
+    void set_history_limits(size_t max_steps, size_t max_bytes);
+    // Page history out to a file at path instead of dropping it: the oldest
+    // steps past the limits go in compressed batches, and so do add-buffer
+    // chunks no longer in the text once those exceed memory_budget. The
+    // file is removed with the table. An empty path pages everything back
+    // and turns spilling off (steps past the limits are dropped again).
+    void set_history_spill(const std::string& path, size_t memory_budget = kSpillBudget);
+    bool is_spilling() const { return spill_ != nullptr; }
+    static constexpr size_t kSpillBudget = 32 * 1024 * 1024;
+    
+    /**
+     * Span - the pieces that make up a range of text
+     *
+     * Both buffers are append-only, so a span stays valid after its range
+     * is removed and re-inserting it restores the text without copying it.
+     * Costs O(pieces) memory regardless of the text length.
+     */
+    struct Span {
+        std::vector<Piece> pieces;
+        size_t length = 0;
+        size_t newlines = 0;
+        
+        void append(const Span& other);
+        void prepend(const Span& other);
+    };
+    Span get_span(size_t start, size_t length) const;
+    void insert_span(size_t position, const Span& span);
+    std::string get_span_text(const Span& span) const;
+    // Insert [start, start + length) of another document's snapshot without
+    // copying its text: each large piece joins the add buffer as a chunk of
+    // its own that keeps the snapshot alive. Small pieces, and pieces of a
+    // file mapping (the file may be overwritten), are copied. One undo step;
+    // O(pieces) plus a newline scan of the shared text.
+    void insert_shared(size_t position, const std::shared_ptr<const DocumentSnapshot>& source,
+                       size_t start, size_t length);
+    static constexpr size_t kShareMinimum = 4096;
     
     // Query operations
-    std::string get_text(size_t start, size_t length) const;
-    std::string get_line(size_t line_number) const;
-    size_t get_line_count() const;
-    size_t get_total_length() const;
+    std::string get_text(size_t start, size_t length) const override;
+    std::string get_line(size_t line_number) const override;
+    size_t get_line_count() const override;
+    size_t get_total_length() const override;
+    // Offset of the first byte of a line / line containing an offset - O(log n)
+    size_t get_line_start(size_t line_number) const override;
+    size_t get_line_at(size_t position) const override;
+    
+    // Line and byte column of an offset (clamped to the text) - O(log n)
+    struct LineColumn {
+        size_t line;
+        size_t column;
+    };
+    LineColumn offset_to_line_col(size_t offset) const;
+    // Offset of a byte column, clamped to the end of the line's text
+    // (before its \n or \r\n); lines past the end give the length - O(log n)
+    size_t line_col_to_offset(size_t line, size_t column) const;
+    // The same with columns in UTF-16 code units, LSP's default encoding;
+    // these also read the line up to the column
+    LineColumn offset_to_line_utf16(size_t offset) const;
+    size_t line_utf16_to_offset(size_t line, size_t column) const;
+    
+    // Immutable view of the current text, safe to read from any thread while
+    // this table keeps being edited - O(pieces), no text is copied
+    std::shared_ptr<const DocumentSnapshot> snapshot() const;
+    // Increases with every edit, including undo/redo
+    size_t get_version() const { return version_; }
+    size_t get_piece_count() const { return node_pool_.live_count(); }
+    // Bytes held by the piece tree's nodes
+    size_t get_index_bytes() const { return node_pool_.live_count() * sizeof(PieceNode); }
+    
+    // Bytes held, by part, for the memory report
+    struct MemoryUsage {
+        size_t original = 0;        // Original text held in memory
+        size_t mapped = 0;          // Original text read through a file mapping
+        size_t add_buffer = 0;      // Add buffer chunks, unused tails included
+        size_t shared = 0;          // Text pasted from other documents' buffers, not held here
+        size_t line_index = 0;      // Newline offsets of both buffers
+        size_t piece_tree = 0;      // Node slabs
+        size_t undo_history = 0;
+        size_t spilled = 0;         // History and add-buffer text paged out to the spill file
+        size_t heap() const { return original + add_buffer + line_index + piece_tree + undo_history; }
+    };
+    MemoryUsage get_memory_usage() const;
+    
+    /**
+     * Change - description of one edit, delivered to change listeners
+     * after the table has been updated. Views derived from the text
+     * (highlighting, folding, parsers) use it to invalidate only what moved.
+     */
+    struct Change {
+        size_t position;            // Byte offset of the edit
+        size_t removed_length;
+        size_t inserted_length;
+        size_t first_line;          // Line containing position
+        size_t removed_newlines;
+        size_t inserted_newlines;
+        size_t column;              // Byte column of position within first_line
+        size_t old_end_column;      // Byte column where the removed range ended (pre-edit)
+        const Span* removed_span = nullptr;     // Removed pieces; valid only during the callback
+    };
+    using ChangeListener = std::function<void(const Change&)>;
+    size_t add_change_listener(ChangeListener listener);    // Returns an id for removal
+    void remove_change_listener(size_t id);
+    
+    // True when the original buffer is a live file mapping
+    bool is_mapped() const { return original_mapping_ != nullptr; }
+    // Copy the mapped original buffer into memory and drop the mapping.
+    // Must be called before the mapped file is overwritten or truncated;
+    // snapshots taken earlier keep reading the mapping, so drop them too.
+    void release_mapping();
+    
+    // Background line indexing - poll from the UI thread to merge finished
+    // chunks. Returns true when the line metrics changed.
+    bool poll_line_index();
+    void finish_line_index();   // Block until the whole file is indexed
+    bool is_indexing() const { return index_job_ != nullptr; }
+    double get_index_progress() const;
+    // Lines whose extent is already known (== get_line_count() when idle)
+    size_t get_indexed_line_count() const;
     
     // For rendering - get visible lines efficiently
-    std::vector<std::string> get_lines_range(size_t start_line, size_t count) const;
+    std::vector<std::string> get_lines_range(size_t start_line, size_t count) const override;
+    TextBufferBackend backend() const override { return TextBufferBackend::PieceTable; }
+    
+    /**
+     * ChunkIterator - read-only views of the document, one per piece
+     *
+     * Views point straight into the original/add buffers, so iterating
+     * never copies text. Any edit invalidates the iterator.
+     */
+    class ChunkIterator {
+    public:
+        bool done() const { return remaining_ == 0; }
+        std::string_view operator*() const;
+        ChunkIterator& operator++();
+        size_t position() const { return position_; }   // Document offset of the current view
+        
+    private:
+        friend class PieceTable;
+        ChunkIterator(const PieceTable* table, const PieceNode* node, size_t offset_in_piece,
+                      size_t position, size_t remaining);
+        
+        const PieceTable* table_;
+        const PieceNode* node_;
+        size_t offset_in_piece_;
+        size_t position_;
+        size_t remaining_;
+    };
+    ChunkIterator chunks(size_t start = 0, size_t length = std::string_view::npos) const;
+    
+    /**
+     * LineCursor - walks lines without allocating
+     *
+     * A line inside a single piece comes back as a view into the buffer; only
+     * lines that span pieces are assembled, into a scratch string reused across
+     * calls. Views stay valid until the next call to next() or any edit.
+     * Line terminators (and the '\r' of CRLF) are not part of the view.
+     */
+    class LineCursor {
+    public:
+        bool next(std::string_view& line);    // false once past the last line
+        size_t line_number() const { return line_number_; }       // Of the line last returned
+        size_t line_start() const { return line_start_; }         // Document offset of that line
+        size_t next_line_start() const { return next_start_; }    // Offset just past its terminator
+        
+    private:
+        friend class PieceTable;
+        LineCursor(ChunkIterator chunks, size_t first_line, size_t start, bool empty);
+        
+        ChunkIterator chunks_;
+        std::string_view chunk_;    // Unconsumed part of the current piece
+        std::string scratch_;
+        size_t line_number_;
+        size_t line_start_;
+        size_t next_start_;
+        bool started_;
+        bool finished_;
+    };
+    LineCursor lines(size_t start_line = 0) const;
     
-    // Batch insert: yhdistää useita insert-operaatioita yhdeksi
-    void batch_insert(const std::vector<std::pair<size_t, std::string>>& inserts) {
-        for (const auto& ins : inserts) {
-            insert(ins.first, ins.second);
-        }
+    /**
+     * Edit - one replacement in a multi-range edit: [position, position +
+     * length) becomes text, in the coordinates from before the whole batch
+     */
+    struct Edit {
+        size_t position;
+        size_t length;
+        std::string text;
+    };
+    // Apply edits sorted by position and not overlapping (inserts may share
+    // a position) as one undo step. All inserted text goes to the add
+    // buffer in one append; the edits are applied back to front, so each
+    // is a single O(log n) tree update. False, changing nothing, if the
+    // edits are unsorted, overlap or run past the end.
+    bool apply_edits(const std::vector<Edit>& edits);
+    // Move offsets (cursors) taken before apply_edits(edits) to where the
+    // same text is after it; an offset inside or at a replaced range ends
+    // up after its replacement - O(log edits) per offset
+    static void map_offsets(const std::vector<Edit>& edits, size_t* offsets, size_t count);
+    
+    // Inserts at pre-batch offsets, in any order; see apply_edits()
+    bool batch_insert(const std::vector<std::pair<size_t, std::string>>& inserts) {
+        std::vector<Edit> edits;
+        edits.reserve(inserts.size());
+        for (const auto& ins : inserts) edits.push_back({ins.first, 0, ins.second});
+        std::stable_sort(edits.begin(), edits.end(),
+                         [](const Edit& a, const Edit& b) { return a.position < b.position; });
+        return apply_edits(edits);
     }
     
 private:
-    std::vector<Piece> pieces_;
-    std::string original_buffer_;
-    std::string add_buffer_;
-    // Line index for O(1) line access
-    mutable std::vector<size_t> line_cache_;
-    mutable bool line_cache_valid_;
-    void rebuild_line_cache() const;
-    size_t position_to_piece_index(size_t position) const;
+    friend class DocumentSnapshot;
+    
+    /**
+     * PieceNode - red-black tree node holding a single piece
+     *
+     * subtree_length / subtree_newlines cover the node and both children,
+     * which lets lookups descend by byte offset or by line number.
+     */
+    struct PieceNode {
+        Piece piece;
+        size_t newlines;            // '\n' count inside this piece
+        size_t subtree_length;
+        size_t subtree_newlines;
+        PieceNode* left;
+        PieceNode* right;
+        PieceNode* parent;
+        bool red;
+        
+        PieceNode(const Piece& p, size_t nl, PieceNode* nil)
+            : piece(p), newlines(nl), subtree_length(p.length), subtree_newlines(nl)
+            , left(nil), right(nil), parent(nil), red(true) {}
+    };
+    
+    SlabPool<PieceNode> node_pool_;     // Owns every node except the sentinel
+    PieceNode nil_storage_;     // Black sentinel with zero metrics
+    PieceNode* nil_;
+    PieceNode* root_;
+    // Original buffer: owned text or a mapped file, accessed through data/size.
+    // Both are shared so snapshots can outlive the table.
+    std::shared_ptr<const std::string> original_storage_;
+    std::shared_ptr<editor::MappedFile> original_mapping_;
+    const char* original_data_;
+    size_t original_size_;
+    
+    /**
+     * AddChunk - fixed-capacity block of the add buffer
+     *
+     * Chunks never move or reallocate once created, so text that snapshots
+     * point into stays put while new text is appended behind it. Offsets into
+     * the add buffer are virtual: a chunk covers [base, base + capacity) and
+     * the next one starts one past that, so no piece can run across chunks.
+     * A shared chunk is full from the start and points into another
+     * document's buffers (insert_shared).
+     */
+    struct AddChunk {
+        std::shared_ptr<char> data;     // Null while paged out
+        size_t base;
+        size_t capacity;
+        size_t size;
+        bool shared = false;
+        bool spilled = false;           // block holds its text (it is full by then)
+        editor::HistorySpill::Block block;
+    };
+    // Mutable: reading a span pages its chunks back in (page_in)
+    mutable std::vector<AddChunk> add_chunks_;
+    mutable size_t add_resident_ = 0;   // Capacity of the chunks in memory, shared ones aside
+    static constexpr size_t kAddChunk = 64 * 1024;
+    // Sorted offsets of every '\n' in each buffer. Both buffers are append-only,
+    // so these only ever grow at the back and never need a rescan. The
+    // original index is shared with snapshots once it is complete.
+    std::shared_ptr<std::vector<size_t>> original_newlines_;
+    std::vector<size_t> add_newlines_;
+    size_t version_ = 0;
+    
+    // Background indexing state. Only original bytes below original_indexed_
+    // appear in original_newlines_; index_frontier_ is the document position
+    // of that boundary, kept up to date across edits.
+    struct LineIndexJob;
+    std::unique_ptr<LineIndexJob> index_job_;
+    size_t original_indexed_;
+    size_t index_frontier_;
+    static constexpr size_t kIndexChunk = 4 * 1024 * 1024;
+    
+    // Buffer access and piece metrics
+    const char* piece_data(Piece::Source source, size_t offset) const {
+        return source == Piece::Source::ORIGINAL ? original_data_ + offset : add_data(offset);
+    }
+    const char* add_data(size_t offset) const;
+    size_t append_add(const char* text, size_t length);     // Returns the add buffer offset
+    size_t append_add(const std::string& text) { return append_add(text.data(), text.size()); }
+    const std::vector<size_t>& newlines_for(Piece::Source source) const {
+        return source == Piece::Source::ORIGINAL ? *original_newlines_ : add_newlines_;
+    }
+    void init_original(const char* data, size_t size);
+    static void index_newlines(const char* data, size_t size, size_t from, std::vector<size_t>& out);
+    size_t count_newlines(Piece::Source source, size_t offset, size_t length) const;
+    size_t nth_newline(const Piece& piece, size_t n) const;
+    char char_at(size_t position) const;
+    
+    // Tree navigation
+    PieceNode* find_node(size_t position, size_t& node_start) const;
+    PieceNode* first_node() const;
+    PieceNode* last_node() const;
+    PieceNode* next_node(PieceNode* node) const;
+    PieceNode* prev_node(PieceNode* node) const;
+    size_t line_start_offset(size_t line) const;
+    size_t newlines_before(size_t position) const;
+    void refresh_original_metrics();
+    
+    // Tree mutation
+    PieceNode* insert_before(PieceNode* node, const Piece& piece, size_t newlines);
+    PieceNode* insert_after(PieceNode* node, const Piece& piece, size_t newlines);
+    void attach(PieceNode* parent, PieceNode* child, bool as_left);
+    void erase_node(PieceNode* node);
+    void resize_node(PieceNode* node, size_t offset, size_t length, size_t newlines);
+    void update_metrics(PieceNode* node);
+    void update_to_root(PieceNode* node);
+    void rotate_left(PieceNode* x);
+    void rotate_right(PieceNode* x);
+    void insert_fixup(PieceNode* z);
+    void erase_fixup(PieceNode* x);
+    void transplant(PieceNode* u, PieceNode* v);
+    
     // Delta-based undo/redo
     enum class EditType { Insert, Remove };
     struct EditAction {
         EditType type;
         size_t position;
-        std::string text;
+        Span span;      // Inserted or removed pieces
     };
-    std::vector<EditAction> undo_history_;
-    std::vector<EditAction> redo_history_;
+    void notify_change(const Change& change);
+    std::vector<std::pair<size_t, ChangeListener>> change_listeners_;
+    size_t next_listener_id_ = 1;
+    
+    struct UndoStep {
+        std::vector<EditAction> edits;  // Applied in order; undone in reverse
+    };
+    // A batch of the oldest steps of a history, paged out
+    struct SpilledSteps {
+        editor::HistorySpill::Block block;
+        size_t steps;
+    };
+    static size_t step_bytes(const UndoStep& step);
+    static size_t spilled_step_count(const std::vector<SpilledSteps>& spilled);
+    static bool merge_edit(EditAction& last, EditType type, size_t position, const Span& span);
+    void record_edit(EditType type, size_t position, const Span& span);
+    void push_history(std::deque<UndoStep>& history, size_t& bytes, std::vector<SpilledSteps>& spilled,
+                      UndoStep step);
+    // Bring the history back within the limits: spill its oldest steps, or drop them
+    void trim_history(std::deque<UndoStep>& history, size_t& bytes, std::vector<SpilledSteps>& spilled);
+    bool spill_steps(std::deque<UndoStep>& history, size_t& bytes, std::vector<SpilledSteps>& spilled);
+    // Read the most recent spilled batch back to the front of history
+    bool page_in_steps(std::deque<UndoStep>& history, size_t& bytes, std::vector<SpilledSteps>& spilled);
+    void forget_spilled_history();
+    // Drop spilled batches that will not be read again, compacting the file
+    // once they are most of it
+    void release_spilled(std::vector<SpilledSteps>& spilled);
+    void compact_spill();
+    // The add-buffer chunks a span's text is in, read back if paged out
+    bool page_in(const Span& span) const;
+    bool page_in(const UndoStep& step) const;
+    // Page out chunks no piece of the text is in, oldest first, down to the budget
+    void spill_cold_chunks();
+    size_t chunk_index(size_t offset) const;
+    
+    std::deque<UndoStep> undo_history_;
+    std::deque<UndoStep> redo_history_;
+    size_t undo_bytes_ = 0;
+    size_t redo_bytes_ = 0;
+    size_t undo_serial_ = 0;
+    size_t transaction_depth_ = 0;
+    bool transaction_started_ = false;  // The open transaction already has its step
+    bool undo_group_open_ = false;      // undo_history_.back() may absorb the next keystroke
+    bool replaying_ = false;            // Inside undo()/redo() - don't record
     static constexpr size_t kMaxHistory = 1000;
+    static constexpr size_t kMaxHistoryBytes = 64 * 1024 * 1024;
+    size_t max_history_ = kMaxHistory;
+    size_t max_history_bytes_ = kMaxHistoryBytes;
+    
+    std::unique_ptr<editor::HistorySpill> spill_;
+    size_t spill_budget_ = kSpillBudget;
+    size_t spill_check_at_ = 0;         // add_resident_ at which cold chunks are looked for again
+    std::vector<SpilledSteps> spilled_undo_;    // Oldest first
+    std::vector<SpilledSteps> spilled_redo_;    // Farthest first
 };
 
 #endif // PIECE_TABLE_H
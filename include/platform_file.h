@@ -2,8 +2,11 @@
 #define PLATFORM_FILE_H
 
 #include <string>
+#include <string_view>
 #include <vector>
+#include <memory>
 #include <cstdint>
+#include <cstdio>
 #include <filesystem>
 
 namespace editor {
@@ -46,6 +49,35 @@ inline FilePermission operator&(FilePermission a, FilePermission b) {
     return static_cast<FilePermission>(static_cast<uint32_t>(a) & static_cast<uint32_t>(b));
 }
 
+// Read-only memory-mapped view of a whole file (mmap / CreateFileMapping).
+// The view stays valid for the lifetime of the object, so consumers such as
+// PieceTable hold it through a shared_ptr instead of copying the bytes.
+class MappedFile {
+public:
+    static std::shared_ptr<MappedFile> open(const std::string& path);
+    ~MappedFile();
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    const std::string& path() const { return path_; }
+
+private:
+    MappedFile() = default;
+    
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    std::string path_;
+#ifdef _WIN32
+    void* file_handle_ = nullptr;
+    void* mapping_handle_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
 // Platform-agnostic file operations
 class PlatformFile {
 public:
@@ -64,6 +96,19 @@ public:
     static bool write_file(const std::string& path, const std::string& content, LineEnding line_ending = LineEnding::Auto);
     static bool write_file_binary(const std::string& path, const std::vector<uint8_t>& data);
     
+    // Write spans in order (a document's pieces, say) without joining them.
+    // Every line break - \n, \r\n or a lone \r - is written as line_ending,
+    // converted on the way through a fixed-size buffer, so memory use does
+    // not grow with the text. The data goes to a temporary file next to
+    // path, synced and then renamed over it (see replace_file).
+    static bool write_file(const std::string& path, const std::vector<std::string_view>& spans,
+                           LineEnding line_ending = LineEnding::Auto);
+    // The same without conversion: spans go out by gathered writes (writev)
+    static bool write_file_binary(const std::string& path, const std::vector<std::string_view>& spans);
+    
+    // Map a file read-only without copying it (nullptr on failure)
+    static std::shared_ptr<MappedFile> map_file(const std::string& path);
+    
     // File metadata
     static bool exists(const std::string& path);
     static bool is_file(const std::string& path);
@@ -77,6 +122,11 @@ public:
     static bool copy_file(const std::string& from, const std::string& to, bool overwrite = false);
     static bool move_file(const std::string& from, const std::string& to);
     static bool rename_file(const std::string& from, const std::string& to);
+    // Rename over an existing file in one step, so readers see the old file
+    // or the new one and never a partial write (same volume only)
+    static bool replace_file(const std::string& from, const std::string& to);
+    // Flush a stdio stream and force its data to the disk (fsync / _commit)
+    static bool sync_file(std::FILE* file);
     
     // Directory operations
     static bool create_directory(const std::string& path);
@@ -13,9 +13,13 @@ namespace editor {
 #ifdef _WIN32
 using ProcessHandle = void*; // HANDLE
 using PipeHandle = void*;    // HANDLE
+constexpr ProcessHandle kInvalidProcess = nullptr;
+constexpr PipeHandle kInvalidPipe = nullptr;
 #else
 using ProcessHandle = int;   // pid_t
 using PipeHandle = int;      // file descriptor
+constexpr ProcessHandle kInvalidProcess = -1;
+constexpr PipeHandle kInvalidPipe = -1;
 #endif
 
 // Process exit status
@@ -31,6 +35,16 @@ struct ProcessIO {
     bool redirect_stdout = false;
     bool redirect_stderr = false;
     bool merge_stderr_to_stdout = false;
+    // Output pipes are for a ProcessIoLoop rather than read_stdout /
+    // read_stderr (Windows: overlapped named pipes, as IOCP needs)
+    bool async_output = false;
+    // Attach the child's stdin, stdout and stderr to a pseudo terminal of
+    // columns x rows (ConPTY on Windows) instead; write_stdin types into
+    // it, the stdout pipe carries what it displays (overlapped on
+    // Windows, as for async_output) and the other flags are ignored
+    bool pseudo_terminal = false;
+    int columns = 80;
+    int rows = 24;
 };
 
 // Process startup options
@@ -38,6 +52,7 @@ struct ProcessOptions {
     std::string working_directory;
     std::vector<std::pair<std::string, std::string>> environment; // key-value pairs
     bool create_new_console = false;  // Windows: CREATE_NEW_CONSOLE
+    bool hide_window = false;         // Windows: CREATE_NO_WINDOW
     bool detached = false;            // Unix: setsid()
     ProcessIO io;
 };
@@ -77,12 +92,19 @@ public:
     bool terminate(int timeout_ms = 5000); // Graceful termination
     bool kill();                           // Force kill
     
-    // I/O operations (if pipes are redirected)
+    // I/O operations (if pipes are redirected). Reads return what is
+    // available within timeout_ms (0 = don't wait, -1 = until data or the
+    // end of the stream); false when nothing was read.
     bool write_stdin(const std::string& data);
     bool read_stdout(std::string& data, int timeout_ms = 0);
     bool read_stderr(std::string& data, int timeout_ms = 0);
+    // For a pseudo terminal this closes the terminal itself, and with it
+    // the output: the child is hung up
     bool close_stdin();
     
+    // New size of the pseudo terminal; the child is told of it
+    bool resize_terminal(int columns, int rows);
+    
     // Get pipe handles for custom I/O handling
     PipeHandle get_stdin_pipe() const { return stdin_pipe_; }
     PipeHandle get_stdout_pipe() const { return stdout_pipe_; }
@@ -102,7 +124,12 @@ private:
     uint32_t pid_;
     int exit_code_;
     bool running_;
+    bool pseudo_terminal_;
+    void* pseudo_console_;  // Windows: HPCON of a pseudo_terminal process
     
+    bool start_pseudo_terminal(const std::string& executable,
+                               const std::vector<std::string>& args,
+                               const ProcessOptions& options);
     void cleanup();
     bool create_pipe(PipeHandle& read_handle, PipeHandle& write_handle);
     void close_pipe(PipeHandle& handle);
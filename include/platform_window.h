@@ -50,6 +50,9 @@ public:
     virtual void run_event_loop() = 0;
     virtual void process_events() = 0;  // Process pending events without blocking
     virtual void request_redraw() = 0;
+    // Only area needs repainting; the next PaintEvent's damaged_rect
+    // covers it. Backends without partial repaints redraw everything
+    virtual void request_redraw_area(const Rect& area) { (void)area; request_redraw(); }
     
     // Drawing
     virtual PlatformGraphicsContext get_graphics_context() = 0;
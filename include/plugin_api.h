@@ -5,11 +5,14 @@
 #include <vector>
 #include <functional>
 #include <cstdint>
+#include "wasm_engine.h"
+#include "document_transform.h"
+
+class PieceTable;
 
 namespace editor {
 
 // Forward declarations
-class PieceTable;
 class EditorWindow;
 
 // Plugin capability flags
@@ -42,6 +45,17 @@ struct PluginMetadata {
     std::string description;     // Short description
     PluginCapability capabilities;  // Required capabilities
     std::vector<std::string> dependencies;  // Other plugin IDs this depends on
+    // Asked for in the module's velocity.engine section; once loaded, the
+    // engine actually running it
+    WasmEngineKind engine = WasmEngineKind::Interpreter;
+};
+
+// One edit of a batch; position and length are byte offsets in the
+// document as it was before the batch
+struct TextEdit {
+    size_t position = 0;
+    size_t length = 0;          // Bytes replaced
+    std::string text;
 };
 
 // Document manipulation API (host functions callable from WASM)
@@ -49,6 +63,19 @@ struct DocumentAPI {
     // Get document content
     std::function<std::string(int doc_id)> get_text;
     
+    // Size of the document, for sizing reads
+    std::function<size_t(int doc_id)> get_length;
+    std::function<size_t(int doc_id)> get_line_count;
+    
+    // Copy whole lines into out (a region of the plugin's linear memory),
+    // up to capacity bytes; returns the bytes written and sets lines_copied.
+    // Prefer this to get_text for anything larger than a few lines.
+    std::function<size_t(int doc_id, size_t first_line, size_t line_count, char* out, size_t capacity,
+                         size_t& lines_copied)> read_lines;
+    
+    // Apply a batch of edits, in document order, as one undo step
+    std::function<bool(int doc_id, const std::vector<TextEdit>& edits)> apply_edits;
+    
     // Insert text at position
     std::function<bool(int doc_id, size_t pos, const std::string& text)> insert_text;
     
@@ -130,6 +157,13 @@ public:
     // Unregister command
     virtual bool unregister_command(const std::string& command_id) = 0;
     
+    // Register a whole-document transform (see DocumentTransform), with an
+    // id of "<plugin id>.<name>"; its stages run on pool workers
+    virtual bool register_transform(const DocumentTransform& transform) = 0;
+    
+    // Unregister transform
+    virtual bool unregister_transform(const std::string& transform_id) = 0;
+    
     // Add event listener
     virtual int add_event_listener(EditorEvent event, EventCallback callback) = 0;
     
@@ -0,0 +1,90 @@
+#ifndef PLUGIN_CATALOG_H
+#define PLUGIN_CATALOG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "wasm_engine.h"
+
+class ThreadPool;
+
+namespace editor {
+
+// What scanning found out about one plugin module, without instantiating it
+struct PluginDescriptor {
+    std::string path;
+    std::string id;                                 // File name without .wasm
+    uint64_t hash = 0;                              // Of the file's content
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    bool valid = false;
+    std::string error;                              // Why it is not valid
+    // From the module's "velocity.activation" custom section: events such
+    // as onLanguage:cpp, onCommand:<id> or onEvent:DocumentSaved. None
+    // (or "*") means the plugin is loaded at startup.
+    std::vector<std::string> activation_events;
+    std::vector<std::string> exports;               // Exported function names
+    // From the "velocity.engine" section: "compiled" for plugins that
+    // spend their time computing (formatters, linters)
+    WasmEngineKind engine = WasmEngineKind::Interpreter;
+    bool from_cache = false;                        // Not validated again this scan
+
+    bool loads_at_startup() const;
+    bool activated_by(const std::string& event) const;
+};
+
+/**
+ * PluginCatalog - finds and validates plugin modules without loading them
+ *
+ * scan() checks each module on a thread pool: the file is read and hashed
+ * and its sections walked for structure, exports and activation events,
+ * which is all that startup needs; parsing into wasm3 and instantiating
+ * waits until a plugin is first activated. Results are cached by content
+ * hash, and a file whose size and modification time match its cache
+ * entry is not read at all, so a warm start costs a stat per plugin. The
+ * cache is a small text file, rewritten by save() when scan() changed it.
+ */
+class PluginCatalog {
+public:
+    // An empty cache_path keeps the cache in memory only
+    explicit PluginCatalog(std::string cache_path = "");
+
+    // Every .wasm file under directory, in path order
+    std::vector<PluginDescriptor> scan(const std::string& directory, ThreadPool& pool);
+    bool save();
+
+    // Checks the module's structure and fills exports and activation events
+    static bool inspect_module(const uint8_t* data, size_t size, PluginDescriptor& descriptor);
+    static uint64_t hash_bytes(const uint8_t* data, size_t size);
+
+    static constexpr const char* kActivationSection = "velocity.activation";
+    static constexpr const char* kEngineSection = "velocity.engine";
+
+private:
+    struct Entry {
+        std::string path;
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        uint64_t hash = 0;
+        bool valid = false;
+        std::string error;
+        std::vector<std::string> activation_events;
+        std::vector<std::string> exports;
+        WasmEngineKind engine = WasmEngineKind::Interpreter;
+    };
+
+    void load();
+    void describe(const std::string& path, PluginDescriptor& descriptor) const;
+
+    std::string cache_path_;
+    bool loaded_ = false;
+    bool dirty_ = false;
+    std::unordered_map<std::string, Entry> by_path_;
+    std::unordered_map<uint64_t, Entry> by_hash_;
+};
+
+} // namespace editor
+
+#endif // PLUGIN_CATALOG_H
@@ -0,0 +1,50 @@
+#ifndef PLUGIN_DOCUMENT_ACCESS_H
+#define PLUGIN_DOCUMENT_ACCESS_H
+
+#include "plugin_api.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class PieceTable;
+
+namespace editor {
+
+/**
+ * PluginDocumentAccess - document reads and edits sized for plugins
+ *
+ * Reads copy only what a plugin asks for, straight from the piece table's
+ * buffers into a region it set aside once in its linear memory: no
+ * std::string of the document is built on the host, and nothing is
+ * serialized a second time. Edits come back as one list in a flat binary
+ * encoding the plugin writes into its memory, applied as a single
+ * transaction (one undo step) instead of a host call per edit.
+ *
+ * Edit list encoding, little endian:
+ *   u32 count, then per edit: u64 position, u64 length, u32 text size,
+ *   text bytes
+ */
+class PluginDocumentAccess {
+public:
+    // Copies whole lines [first_line, first_line + line_count), with their
+    // terminators, into out; stops before a line that would overflow
+    // capacity. Returns the bytes written; lines_copied says how many
+    // lines they hold (0 when the first line alone does not fit).
+    static size_t copy_lines(const PieceTable& document, size_t first_line, size_t line_count, char* out,
+                             size_t capacity, size_t& lines_copied);
+    // Copies bytes [position, position + length), at most capacity of them
+    static size_t copy_range(const PieceTable& document, size_t position, size_t length, char* out,
+                             size_t capacity);
+
+    static bool decode_edits(const uint8_t* data, size_t size, std::vector<TextEdit>& edits);
+    static void encode_edits(const std::vector<TextEdit>& edits, std::vector<uint8_t>& out);
+
+    // Edits must be in document order, not overlap and lie inside the
+    // document; otherwise nothing is changed
+    static bool apply_edits(PieceTable& document, const std::vector<TextEdit>& edits);
+};
+
+} // namespace editor
+
+#endif // PLUGIN_DOCUMENT_ACCESS_H
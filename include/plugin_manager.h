@@ -3,6 +3,9 @@
 
 #include "plugin_api.h"
 #include "wasm_runtime.h"
+#include "plugin_worker.h"
+#include "plugin_catalog.h"
+#include "event_bus.h"
 #include <memory>
 #include <unordered_map>
 #include <string>
@@ -10,10 +13,13 @@
 
 namespace editor {
 
-// Represents a loaded plugin instance
+// Represents a loaded plugin instance. Once loaded, its runtime is only
+// used from its PluginWorker's thread: calls queue there and are timed
+// against the budget, so a slow plugin cannot stall the caller.
 class Plugin {
 public:
-    Plugin(const std::string& id, const std::string& path);
+    Plugin(const std::string& id, const std::string& path, const PluginBudget& budget = PluginBudget(),
+           WasmEngineKind engine = WasmEngineKind::Interpreter);
     ~Plugin();
     
     // Load and initialize the plugin
@@ -43,17 +49,33 @@ public:
     // Get plugin path
     const std::string& path() const { return path_; }
     
-    // Call a plugin function
+    // Call a plugin function and wait for it (up to the budget's hang limit)
     bool call_function(const std::string& func_name, const std::vector<int64_t>& args = {}, int64_t* result = nullptr);
     
+    // Queue a call without waiting; a queued call with the same nonzero
+    // coalesce_key takes these arguments instead
+    bool post_call(const std::string& func_name, const std::vector<int64_t>& args, uint64_t coalesce_key = 0);
+    
+    // Exports plugin_on_event(event, argument)
+    bool handles_events() const { return handles_events_; }
+    
+    // Time spent, overruns and whether the plugin was throttled or disabled
+    PluginMetrics metrics() const;
+    
+    // Bytes held by its wasm runtime (linear memory, stack, module)
+    size_t get_memory_usage() const { return runtime_ ? runtime_->get_memory_usage() : 0; }
+    
     // Get last error
     const std::string& get_error() const;
     
 private:
     PluginMetadata metadata_;
     std::string path_;
-    std::unique_ptr<WasmRuntime> runtime_;
+    std::shared_ptr<WasmRuntime> runtime_;     // Shared with the worker, which may outlive a hung call
+    std::unique_ptr<PluginWorker> worker_;
+    PluginBudget budget_;
     bool activated_;
+    bool handles_events_;
     std::string error_message_;
     
     void set_error(const std::string& error);
@@ -75,8 +97,25 @@ public:
     // Scan directory for plugins
     std::vector<std::string> scan_plugins(const std::string& directory);
     
-    // Load plugin from file
-    bool load_plugin(const std::string& path);
+    // Load plugin from file, on engine if it is built in
+    bool load_plugin(const std::string& path, WasmEngineKind engine = WasmEngineKind::Interpreter);
+    
+    // Registers every plugin under directory. Modules are validated in
+    // parallel (or taken from the catalog cache); those with no activation
+    // events are loaded, also in parallel, and activated, the rest wait for
+    // trigger_activation. Returns the number of modules found.
+    size_t discover_plugins(const std::string& directory);
+    
+    // Loads and activates the waiting plugins declaring event (e.g.
+    // "onLanguage:cpp", "onCommand:hello.add"); returns how many
+    size_t trigger_activation(const std::string& event);
+    
+    // Known from discover_plugins but not loaded yet
+    bool is_plugin_pending(const std::string& plugin_id) const { return pending_.count(plugin_id) != 0; }
+    size_t pending_plugin_count() const { return pending_.size(); }
+    
+    // Where the catalog keeps validated module descriptors between runs
+    void set_cache_path(const std::string& path) { cache_path_ = path; }
     
     // Unload plugin by ID
     bool unload_plugin(const std::string& plugin_id);
@@ -108,9 +147,27 @@ public:
     // Set plugin API (used by host to provide API to plugins)
     void set_plugin_api(PluginAPI* api) { api_ = api; }
     
+    // Budget given to plugins loaded from now on
+    void set_plugin_budget(const PluginBudget& budget) { budget_ = budget; }
+    
+    // Queue an event for every activated plugin that handles events and is
+    // not disabled; events of one kind still queued are coalesced into the
+    // newest. Plugins waiting for onEvent:<event> are activated first.
+    // Returns the number of plugins it was queued for.
+    size_t dispatch_event(EditorEvent event, int64_t argument = 0);
+    
+    // An EventBus frame: one dispatch_event() per kind of event in it, with
+    // the number of records of that kind as argument. Subscribe it with
+    // bus.subscribe({}, [&](const EventBatch& b) { manager.dispatch_events(b); }).
+    size_t dispatch_events(const EventBatch& batch);
+    
 private:
     std::unordered_map<std::string, std::unique_ptr<Plugin>> plugins_;
+    std::unordered_map<std::string, PluginDescriptor> pending_;    // Waiting for an activation event
+    std::unique_ptr<PluginCatalog> catalog_;
+    std::string cache_path_;
     PluginAPI* api_;
+    PluginBudget budget_;
     std::string error_message_;
     bool initialized_;
     
@@ -0,0 +1,103 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace editor {
+
+// Limits a PluginWorker holds its plugin to
+struct PluginBudget {
+    std::chrono::milliseconds call_time{50};        // Longest a call should take
+    std::chrono::milliseconds hang_time{2000};      // A call still running this long is abandoned
+    std::chrono::milliseconds throttle_pause{100};  // Between calls while throttled
+    int disable_after = 5;                          // Overruns before disabling
+    int recover_after = 8;                          // Calls within budget that end throttling
+    size_t max_queue = 1024;                        // Posts beyond this are dropped
+};
+
+// How a PluginWorker treats its plugin
+enum class PluginState { Running, Throttled, Disabled };
+
+// What a PluginWorker's plugin has cost so far
+struct PluginMetrics {
+    PluginState state = PluginState::Running;
+    uint64_t calls = 0;
+    uint64_t failures = 0;
+    uint64_t overruns = 0;
+    uint64_t coalesced = 0;             // Posts merged into a queued call
+    uint64_t dropped = 0;               // Posts refused: queue full or disabled
+    std::chrono::microseconds total_time{0};
+    std::chrono::microseconds max_time{0};
+    size_t queued = 0;
+};
+
+/**
+ * PluginWorker - runs one plugin's calls on a thread of its own
+ *
+ * The owner queues calls and returns at once, so a slow plugin delays
+ * only itself. A call posted with a coalesce key replaces the arguments of
+ * a queued call with the same key instead of queueing another: a burst
+ * of cursor moves costs one call with the latest position.
+ *
+ * Every call is timed against the budget. A call over budget throttles
+ * the plugin: it is then given a pause between calls, and its events keep
+ * coalescing while it waits, until enough calls in a row are back within
+ * budget. Too many overruns before that, or one call running past the
+ * hang limit, disable it: the queue is dropped and nothing more is run.
+ * wasm3 cannot interrupt a running call, so a hung call is abandoned
+ * rather than stopped; stop() detaches the thread in that case, and the
+ * state it uses stays alive with it.
+ */
+class PluginWorker {
+public:
+    // Runs func(args), filling result and, on failure, error
+    using InvokeFn = std::function<bool(const std::string& func, const std::vector<int64_t>& args, int64_t* result,
+                                        std::string& error)>;
+
+    explicit PluginWorker(InvokeFn invoke, PluginBudget budget = PluginBudget());
+    ~PluginWorker();
+
+    PluginWorker(const PluginWorker&) = delete;
+    PluginWorker& operator=(const PluginWorker&) = delete;
+
+    // Queues a call; coalesce_key 0 never coalesces. False when refused.
+    bool post(const std::string& func, const std::vector<int64_t>& args, uint64_t coalesce_key = 0);
+    // Queues a call and waits for it, up to the hang limit
+    bool call(const std::string& func, const std::vector<int64_t>& args, int64_t* result, std::string& error);
+
+    PluginMetrics metrics() const;
+    PluginState state() const;
+    // Blocks until the queue is empty and no call runs, or timeout passes
+    bool wait_idle(std::chrono::milliseconds timeout);
+    // Ends the thread after the running call; queued calls are dropped
+    void stop();
+
+private:
+    struct Completion;
+    struct Task {
+        std::string func;
+        std::vector<int64_t> args;
+        uint64_t coalesce_key = 0;
+        std::shared_ptr<Completion> completion;     // Set for call()
+    };
+    struct Shared;
+
+    static void worker_loop(std::shared_ptr<Shared> shared);
+    // Disables the plugin when the running call has passed the hang limit
+    static void check_hung(Shared& shared);
+    // Fails the waiting callers of queued calls and empties the queue
+    static void drop_queue(Shared& shared, const char* reason);
+
+    std::shared_ptr<Shared> shared_;
+    std::thread thread_;
+};
+
+} // namespace editor
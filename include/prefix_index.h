@@ -0,0 +1,72 @@
+#ifndef PREFIX_INDEX_H
+#define PREFIX_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * PrefixIndex - sorted offsets (prefix sums) in one contiguous array
+ *
+ * Entries are stored as 32-bit values when every value fits, halving the
+ * cache footprint for documents under 4 GB, and searched with a branchless
+ * binary search whose probes compile to conditional moves instead of
+ * unpredictable branches. Entries must be pushed in non-decreasing order.
+ */
+class PrefixIndex {
+public:
+    // Drop all entries; values up to max_value will be pushed next
+    void reset(size_t max_value, size_t count_hint = 0) {
+        compact_ = max_value <= UINT32_MAX;
+        narrow_.clear();
+        wide_.clear();
+        if (compact_) narrow_.reserve(count_hint);
+        else wide_.reserve(count_hint);
+    }
+    
+    void push_back(size_t value) {
+        if (compact_) narrow_.push_back(static_cast<uint32_t>(value));
+        else wide_.push_back(static_cast<uint64_t>(value));
+    }
+    
+    size_t operator[](size_t index) const {
+        return compact_ ? narrow_[index] : static_cast<size_t>(wide_[index]);
+    }
+    size_t size() const { return compact_ ? narrow_.size() : wide_.size(); }
+    size_t back() const { return (*this)[size() - 1]; }
+    bool empty() const { return size() == 0; }
+    bool is_compact() const { return compact_; }
+    size_t bytes() const { return narrow_.capacity() * sizeof(uint32_t) + wide_.capacity() * sizeof(uint64_t); }
+    
+    // Number of entries <= value (std::upper_bound)
+    size_t upper_bound(size_t value) const {
+        return compact_ ? search<uint32_t, false>(narrow_.data(), narrow_.size(), value)
+                        : search<uint64_t, false>(wide_.data(), wide_.size(), value);
+    }
+    // Number of entries < value (std::lower_bound)
+    size_t lower_bound(size_t value) const {
+        return compact_ ? search<uint32_t, true>(narrow_.data(), narrow_.size(), value)
+                        : search<uint64_t, true>(wide_.data(), wide_.size(), value);
+    }
+    
+private:
+    template <typename T, bool kStrict>
+    static size_t search(const T* data, size_t count, size_t value) {
+        if (count == 0) return 0;
+        const T* base = data;
+        while (count > 1) {
+            size_t half = count / 2;
+            bool right = kStrict ? base[half] < value : base[half] <= value;
+            base = right ? base + half : base;
+            count -= half;
+        }
+        bool past = kStrict ? *base < value : *base <= value;
+        return static_cast<size_t>(base - data) + past;
+    }
+    
+    bool compact_ = true;
+    std::vector<uint32_t> narrow_;
+    std::vector<uint64_t> wide_;
+};
+
+#endif // PREFIX_INDEX_H
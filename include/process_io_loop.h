@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include "platform_process.h"
+
+namespace editor {
+
+/**
+ * ProcessIoLoop - one thread reading the output pipes of child processes
+ *
+ * Each watched pipe is registered with the platform's readiness or
+ * completion mechanism (epoll on Linux, kqueue on macOS and the BSDs, an
+ * I/O completion port on Windows), and the thread sleeps in it until one
+ * of them has data, so any number of children costs one thread and no
+ * polling. What is read goes to the pipe's callback on the loop thread;
+ * the callback gets an empty read once, at the end of the stream, after
+ * which the pipe is no longer watched. The pipe stays open; its owner
+ * closes it, after unwatch if the stream has not ended.
+ *
+ * On Windows the pipe must be overlapped: start the process with
+ * ProcessIO::async_output.
+ */
+class ProcessIoLoop {
+public:
+    using ReadFn = std::function<void(const char* data, size_t size)>;
+
+    ProcessIoLoop();
+    ~ProcessIoLoop();
+
+    ProcessIoLoop(const ProcessIoLoop&) = delete;
+    ProcessIoLoop& operator=(const ProcessIoLoop&) = delete;
+
+    // The process-wide loop, started on first use and stopped when the
+    // last holder lets go of it
+    static std::shared_ptr<ProcessIoLoop> shared();
+
+    // Watches pipe until its stream ends or unwatch; 0 if it cannot be
+    size_t watch(PipeHandle pipe, ReadFn on_read);
+    // on_read is not called again once this returns; from inside a
+    // callback it takes effect after that callback
+    void unwatch(size_t id);
+
+    size_t watch_count() const;
+
+    static constexpr size_t kReadSize = 64 * 1024;
+
+private:
+    struct Backend;
+    struct Watch;
+
+    void run();
+    std::shared_ptr<Watch> find(size_t id) const;
+    // Calls on_read unless the watch was removed; false if it was
+    bool deliver(Watch& watch, const char* data, size_t size);
+    void erase(size_t id);
+
+    std::unique_ptr<Backend> backend_;
+    mutable std::mutex mutex_;
+    std::unordered_map<size_t, std::shared_ptr<Watch>> watches_;
+    size_t next_id_ = 1;
+    std::recursive_mutex dispatch_mutex_;   // Held while a callback runs
+    std::thread thread_;
+};
+
+} // namespace editor
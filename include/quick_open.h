@@ -0,0 +1,150 @@
+#ifndef QUICK_OPEN_H
+#define QUICK_OPEN_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "file_watcher.h"
+
+class ThreadPool;
+
+/**
+ * QuickOpenMatch - one ranked path from a quick-open query
+ */
+struct QuickOpenMatch {
+    std::string path;
+    int score;
+    std::vector<uint32_t> positions;    // Matched byte offsets, for highlighting
+};
+
+/**
+ * QuickOpenIndex - fuzzy file finder over every path in the workspace
+ *
+ * Paths live in fixed 1 MB chunks that never move, described by a
+ * contiguous entry table, next to a parallel array of 64-bit character
+ * masks (letters, digits and a few separators each own a bit). A query is
+ * first reduced to its mask; the prefilter is a branch-free AND/compare
+ * over that array, so most paths are rejected without touching their
+ * text. Survivors get an fzf-style score: the query must appear as a
+ * case-insensitive subsequence, the tightest window is picked, and
+ * matches at word boundaries, in the file name and in runs score higher.
+ *
+ * Scans are split across a thread pool, each worker keeping its own top-K.
+ * When a query extends the previous one, only the previous matches are
+ * rescanned. search_async runs the latest query on a background thread,
+ * publishes partial top-K lists as chunks complete and drops superseded
+ * queries, so typing never waits on a stale search.
+ *
+ * The table is fed by index_workspace (a parallel crawl that skips the
+ * same directories as the indexer) and kept current by apply_file_changes
+ * with FileWatcher batches. Removed paths leave a tombstone until they
+ * outnumber the live ones, then the table is compacted.
+ */
+class QuickOpenIndex {
+public:
+    QuickOpenIndex();
+    ~QuickOpenIndex();
+    QuickOpenIndex(const QuickOpenIndex&) = delete;
+    QuickOpenIndex& operator=(const QuickOpenIndex&) = delete;
+
+    // Table maintenance
+    void add_path(const std::string& path);
+    void remove_path(const std::string& path);
+    void apply_file_changes(const std::vector<editor::FileChange>& changes);
+    // Crawl the roots in the background (adds to what is already there)
+    void index_workspace(const std::vector<std::string>& root_folders);
+    void wait_for_indexing();
+    void clear();
+
+    size_t get_path_count() const;
+    // Bytes held by the path chunks, entry table, masks and lookup map
+    size_t get_memory_usage() const;
+
+    // Best max_results paths for the query, best first
+    std::vector<QuickOpenMatch> search(const std::string& query, size_t max_results = 50);
+
+    // Asynchronous search: callback(results, complete) runs on the search
+    // thread, with partial lists while the scan is going and a final call
+    // with complete == true. A newer call supersedes a pending or running
+    // one, whose callback then stops being called.
+    using ResultCallback = std::function<void(const std::vector<QuickOpenMatch>& results, bool complete)>;
+    void search_async(const std::string& query, size_t max_results, ResultCallback callback);
+    // Drop the pending or running async query
+    void cancel_async();
+
+    // Score of one path against a query; -1 if the query is not a subsequence
+    static int score(std::string_view path, std::string_view query, std::vector<uint32_t>* positions = nullptr);
+
+    static constexpr size_t kChunkSize = 1 << 20;
+
+private:
+    struct Entry {
+        const char* path;
+        uint32_t length;
+        uint32_t name_start;    // Offset of the file name
+    };
+    struct Candidate {
+        int score;
+        uint32_t id;
+    };
+
+    static uint64_t mask_of(std::string_view text);
+    static bool better(const Candidate& a, const Candidate& b, const std::vector<Entry>& entries);
+
+    // Everything below is guarded by mutex_
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    size_t chunk_used_ = kChunkSize;
+    std::vector<Entry> entries_;
+    std::vector<uint64_t> masks_;                   // Parallel to entries_; 0 = removed
+    std::unordered_map<std::string_view, uint32_t> ids_;
+    size_t removed_ = 0;
+    std::vector<std::string> roots_;                // Given to index_workspace
+    uint64_t version_ = 0;                          // Bumped by every change
+    // Paths matching the last query, for refining an extended query
+    std::string last_query_;
+    uint64_t last_version_ = 0;
+    std::vector<uint32_t> last_matches_;
+    bool has_last_ = false;
+
+    void add_locked(std::string_view path);
+    void remove_locked(std::string_view path);
+    void remove_tree_locked(const std::string& directory);
+    void compact_locked();
+
+    // One scan over ids [begin, end) of the candidate list (or of the table)
+    using Progress = std::function<bool(const std::vector<Candidate>& top)>;
+    std::vector<Candidate> scan_locked(const std::string& folded, size_t max_results, const Progress& progress,
+                                       bool& cancelled);
+    std::vector<QuickOpenMatch> materialize_locked(const std::vector<Candidate>& top, const std::string& query) const;
+
+    // Crawl, on the shared ThreadPool at Background priority; scans that
+    // outgrow one thread borrow it at Interactive
+    std::atomic<size_t> outstanding_{0};
+    std::mutex crawl_mutex_;
+    std::condition_variable crawl_done_;
+    void crawl_directory(const std::string& directory);
+    void submit_crawl_task(std::function<void()> task);
+
+    // Async search thread: the latest request wins
+    std::thread search_thread_;
+    std::mutex async_mutex_;
+    std::condition_variable async_wake_;
+    std::string async_query_;
+    size_t async_max_ = 0;
+    ResultCallback async_callback_;
+    bool async_pending_ = false;
+    bool async_stopping_ = false;
+    std::atomic<uint64_t> async_generation_{0};
+    void async_loop();
+};
+
+#endif // QUICK_OPEN_H
@@ -0,0 +1,138 @@
+#ifndef REGEX_ENGINE_H
+#define REGEX_ENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * RegexEngine - linear-time regular expressions for find, replace and parsers
+ *
+ * Patterns compile to a small instruction program that is run as a Pike VM:
+ * every live thread advances one byte at a time, duplicates are merged, so
+ * a search costs O(text * program) whatever the pattern - no catastrophic
+ * backtracking. Threads are kept in priority order and a loop stops after
+ * an iteration that matched empty, which gives the same leftmost-first
+ * results (and captures) as a backtracking engine such as std::regex.
+ *
+ * Syntax is the ECMAScript subset that can run in linear time: literals and
+ * escapes (\uXXXX matches the code point's UTF-8), '.', classes ([a-z],
+ * [^...], \d \w \s and negations), groups (capturing and (?:...)), '|',
+ * greedy and lazy * + ? {n} {n,} {n,m}, and the assertions ^ $ (at line
+ * boundaries), \b \B, \A \z. Backreferences, lookaround and escaped letters
+ * or digits with no meaning are rejected. Matching is bytewise; case
+ * folding is ASCII.
+ *
+ * When no thread is alive the scan skips straight to the next byte that can
+ * start a match. Text may be given as consecutive chunks (PieceTable
+ * pieces), which are read in place.
+ */
+class RegexEngine {
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    struct Match {
+        size_t position = 0;
+        size_t length = 0;
+        // [begin, end) per group, group 0 being the whole match; npos for
+        // groups that did not take part
+        std::vector<size_t> groups;
+
+        bool has_group(size_t group) const { return 2 * group + 1 < groups.size() && groups[2 * group] != npos; }
+        size_t group_begin(size_t group) const { return groups[2 * group]; }
+        size_t group_end(size_t group) const { return groups[2 * group + 1]; }
+    };
+    // Return false to stop the scan
+    using Visitor = std::function<bool(const Match& match)>;
+
+    RegexEngine() = default;
+    explicit RegexEngine(const std::string& pattern, bool case_sensitive = true);
+
+    bool ok() const { return !program_.empty(); }
+    // Why the pattern did not compile ("" when it did)
+    const std::string& error() const { return error_; }
+    // Capturing groups, including group 0
+    size_t group_count() const { return slot_count_ / 2; }
+
+    // First match starting at or after start
+    bool search(std::string_view text, size_t start, Match& match) const;
+
+    // Successive non-overlapping matches from start, left to right. chunks
+    // are consecutive pieces of one text beginning at offset 0.
+    void for_each_match(std::string_view text, size_t start, const Visitor& visit) const;
+    void for_each_match(const std::vector<std::string_view>& chunks, size_t start, const Visitor& visit) const;
+
+    // Replacement with $0-$9, ${n} and $$ expanded from a match in text
+    static std::string expand(std::string_view replacement, const Match& match, std::string_view text);
+
+    // Compiled pattern from a small process-wide cache, so searches repeated
+    // while typing do not recompile. Failed compiles are cached too.
+    static std::shared_ptr<const RegexEngine> cached(const std::string& pattern, bool case_sensitive = true);
+    static constexpr size_t kCacheSize = 32;
+
+    // Compile limits: instructions after expanding counted repetitions
+    static constexpr size_t kMaxProgram = 20000;
+    static constexpr int kMaxRepeat = 1000;
+
+private:
+    enum class Op : uint8_t {
+        Byte,       // arg
+        Set,        // sets_[x]
+        Any,        // Anything but '\n'
+        Split,      // x first, then y
+        Jump,       // x
+        Save,       // Capture slot x
+        Assert,     // Assertion arg
+        Iterate,    // Starts an iteration of a loop whose body can match empty
+        Progress,   // Back to loop x if the iteration consumed input, else exit y
+        Match
+    };
+    enum Assertion : uint8_t {
+        LineStart,
+        LineEnd,
+        TextStart,
+        TextEnd,
+        WordBoundary,
+        NotWordBoundary
+    };
+    struct Inst {
+        Op op;
+        uint8_t arg;
+        uint32_t x;
+        uint32_t y;
+    };
+    struct ByteSet {
+        bool has[256];
+    };
+
+    class Parser;
+    class Input;
+    struct Threads;
+
+    std::vector<Inst> program_;
+    std::vector<ByteSet> sets_;
+    size_t slot_count_ = 0;
+    // Per pc inside Iterate loops: the first of its extra thread states, see
+    // add_thread; 0 for the rest
+    std::vector<uint32_t> fresh_states_;
+    size_t state_count_ = 0;
+    std::string error_;
+    bool first_byte_[256] = {};     // Bytes that can start a match
+    bool skip_ = false;             // first_byte_ is usable: no empty match
+    int single_first_ = -1;         // The only possible first byte, for memchr
+
+    void compute_first_bytes();
+    uint32_t state(uint32_t pc, uint32_t fresh) const {
+        return fresh == 0 || fresh_states_[pc] == 0 ? pc : fresh_states_[pc] + fresh - 1;
+    }
+    bool run(Input& input, size_t start, Threads& current, Threads& next, std::vector<size_t>& work,
+             Match& match) const;
+    void add_thread(Threads& list, uint32_t pc, size_t pos, std::vector<size_t>& caps, Input& input) const;
+    bool holds(uint8_t assertion, size_t pos, Input& input) const;
+};
+
+#endif // REGEX_ENGINE_H
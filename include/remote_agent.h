@@ -0,0 +1,73 @@
+#pragma once
+#include "remote_protocol.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+class BackgroundIndexer;
+class PieceTable;
+
+namespace editor {
+
+/**
+ * RemoteAgent - the headless end of a remote workspace, next to the files
+ *
+ * Run on the build host (editor_demo --agent <root>, started by ssh), it
+ * keeps the documents, the index and every file system call local to the
+ * files: a listing is one round trip however many entries it stats, a
+ * search runs against the agent's own BackgroundIndexer, and a document
+ * is a PieceTable over a mapping of the file that the client sees only
+ * through the lines it asks for and the edits it sends.
+ *
+ * The agent is driven by whoever owns the stream: receive() takes bytes
+ * as they arrive and answers through send, from the calling thread. Edits
+ * must come numbered in order; one that skips a version closes its
+ * document with an Error, and the client reopens it.
+ */
+class RemoteAgent {
+public:
+    using SendFn = std::function<void(std::string frame)>;
+
+    RemoteAgent(std::string root, SendFn send);
+    ~RemoteAgent();
+
+    RemoteAgent(const RemoteAgent&) = delete;
+    RemoteAgent& operator=(const RemoteAgent&) = delete;
+
+    // Say hello and start indexing the root in the background
+    void start();
+    // Bytes from the client; false once the stream is corrupt
+    bool receive(const char* data, size_t size);
+
+    size_t open_documents() const { return documents_.size(); }
+    // For tests: wait until the first crawl is searchable
+    void wait_for_index();
+
+private:
+    struct Document {
+        std::string path;
+        std::shared_ptr<PieceTable> text;
+        uint64_t version = 0;
+        bool acknowledge = false;       // Edits arrived since the last Ack
+    };
+
+    void handle(const RemoteFrame& frame);
+    void handle_document(uint32_t channel, const RemoteFrame& frame);
+    void open(uint32_t channel, RemoteReader& reader);
+    void list(RemoteReader& reader);
+    void search(RemoteReader& reader);
+    void fail(uint32_t channel, const std::string& message);
+    // Path below the root, or "" if it leaves it
+    std::string resolve(const std::string& relative) const;
+    std::string relative(const std::string& path) const;
+
+    std::string root_;
+    SendFn send_;
+    RemoteFraming framing_;
+    std::unordered_map<uint32_t, Document> documents_;
+    std::unique_ptr<BackgroundIndexer> indexer_;
+};
+
+} // namespace editor
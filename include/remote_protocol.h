@@ -0,0 +1,104 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace editor {
+
+/**
+ * Remote workspace protocol - frames between the editor and the agent that
+ * runs next to the files (RemoteAgent), over one byte stream (ssh's stdio)
+ *
+ * A frame is [u32 size][u32 channel][u8 type][payload], integers
+ * little-endian, size counting channel, type and payload. Channel 0 carries
+ * the workspace requests (listings, search); each open document has a
+ * channel of its own, so a long search result never holds up a keystroke's
+ * acknowledgement behind it in a parser, and responses need no ids: every
+ * channel is answered in order.
+ *
+ * Documents move as deltas. The client asks for the lines of its viewport
+ * and sends edits as (line, column) ranges, each numbered with the version
+ * it produces; the agent applies them in order and acknowledges the last
+ * version of every batch it read. Compression is left to the transport
+ * (ssh -C).
+ */
+enum class RemoteMessage : uint8_t {
+    Hello = 1,      // a->c  protocol version, root
+    Open,           // c->a  path (relative to the root)
+    Opened,         // a->c  version, line count, length
+    ReadLines,      // c->a  first, count
+    Lines,          // a->c  version, line count, first, lines to the end
+    Edit,           // c->a  version, line, column, end line, end column, text
+    Ack,            // a->c  version
+    Save,           // c->a
+    Saved,          // a->c  version saved, ok
+    Close,          // c->a
+    List,           // c->a  directory
+    Entries,        // a->c  directory, count, (name, is directory, size)...
+    Search,         // c->a  pattern, regex, case sensitive, max results
+    Results,        // a->c  count, (path, line, column, length, text)...
+    Error           // a->c  message; on a document channel the document is closed
+};
+
+constexpr uint32_t kRemoteProtocolVersion = 1;
+
+struct RemoteFrame {
+    uint32_t channel = 0;
+    RemoteMessage type = RemoteMessage::Error;
+    std::string payload;
+};
+
+// Builds one frame; the size is filled in by finish()
+class RemoteWriter {
+public:
+    RemoteWriter(uint32_t channel, RemoteMessage type);
+    RemoteWriter& u8(uint8_t value);
+    RemoteWriter& u32(uint32_t value);
+    RemoteWriter& u64(uint64_t value);
+    RemoteWriter& str(std::string_view value);      // u32 length, bytes
+    std::string finish();
+
+private:
+    std::string frame_;
+};
+
+// Reads a payload; a read past its end fails and fails every read after it
+class RemoteReader {
+public:
+    explicit RemoteReader(std::string_view payload) : data_(payload) {}
+    bool u8(uint8_t& value);
+    bool u32(uint32_t& value);
+    bool u64(uint64_t& value);
+    bool str(std::string& value);
+    bool ok() const { return ok_; }
+    bool at_end() const { return pos_ == data_.size(); }
+
+private:
+    bool take(void* out, size_t size);
+
+    std::string_view data_;
+    size_t pos_ = 0;
+    bool ok_ = true;
+};
+
+// Splits the byte stream into frames, however the reads cut it
+class RemoteFraming {
+public:
+    void feed(const char* data, size_t size);
+    // The next complete frame; false until one arrives. A frame whose size
+    // is below the header or above kMaxFrame sets failed(): the stream is lost
+    bool next(RemoteFrame& frame);
+    bool failed() const { return failed_; }
+    size_t buffered() const { return buffer_.size() - begin_; }
+
+    static constexpr size_t kMaxFrame = 256u * 1024 * 1024;
+
+private:
+    std::string buffer_;
+    size_t begin_ = 0;
+    bool failed_ = false;
+};
+
+} // namespace editor
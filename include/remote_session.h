@@ -0,0 +1,167 @@
+#pragma once
+#include "indexer.h"
+#include "remote_protocol.h"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace editor {
+
+class PlatformProcess;
+class ProcessIoLoop;
+
+/**
+ * RemoteDocument - the editor's side of a document open on a RemoteAgent
+ *
+ * Only a window of lines around the viewport is held, fetched with
+ * request_lines(). Edits are predicted: edit() changes the window and the
+ * line count at once and sends the delta, so typing never waits on the
+ * network. Unacknowledged edits are kept, and a window the agent sent
+ * from before them has them applied again when it arrives, so what is
+ * shown always includes everything typed.
+ */
+class RemoteDocument {
+public:
+    struct Edit {
+        uint64_t version;       // The version this edit makes
+        size_t line;
+        size_t column;          // Byte columns
+        size_t end_line;
+        size_t end_column;
+        std::string text;
+    };
+
+    bool is_open() const { return open_; }
+    bool failed() const { return !error_.empty(); }
+    const std::string& error() const { return error_; }
+    const std::string& path() const { return path_; }
+
+    // Lines with every local edit applied
+    size_t line_count() const { return line_count_; }
+    uint64_t version() const { return version_; }
+    uint64_t acknowledged() const { return acknowledged_; }
+    size_t pending_edits() const { return pending_.size(); }
+
+    // Lines [first, first + count) are on screen: unless the window holds
+    // them, a screen more on each side is asked for
+    void request_lines(size_t first, size_t count);
+    // A line from the window; false if it is not there (yet)
+    bool get_line(size_t line, std::string& text) const;
+
+    // Replace [line:column, end_line:end_column) with text
+    void edit(size_t line, size_t column, size_t end_line, size_t end_column, const std::string& text);
+    // Write the agent's copy to its file; saved_version() follows
+    void save();
+    uint64_t saved_version() const { return saved_version_; }
+
+private:
+    friend class RemoteSession;
+    RemoteDocument(uint32_t channel, std::string path, std::function<void(std::string)> send);
+
+    void handle(const RemoteFrame& frame);
+    void apply_to_window(const Edit& edit);
+
+    uint32_t channel_;
+    std::string path_;
+    std::function<void(std::string)> send_;
+    bool open_ = false;
+    std::string error_;
+    size_t line_count_ = 0;
+    uint64_t version_ = 0;
+    uint64_t acknowledged_ = 0;
+    uint64_t saved_version_ = 0;
+    std::deque<Edit> pending_;
+    // The window, in current (predicted) line numbers
+    size_t first_ = 0;
+    std::vector<std::string> lines_;
+    bool window_valid_ = false;
+    bool request_pending_ = false;
+};
+
+/**
+ * RemoteSession - a connection to a RemoteAgent
+ *
+ * connect() starts the agent through a command - ssh_command() gives
+ * "ssh -C -T host editor_demo --agent root", so ssh compresses the
+ * stream - and reads its output on the shared ProcessIoLoop. attach()
+ * uses a transport of the caller's instead, which hands the agent's
+ * bytes to receive(). Either way frames are queued as they arrive and
+ * delivered by poll() on the thread that owns the session: documents,
+ * listings and search results change only there.
+ *
+ * Workspace requests are answered in order on channel 0, so their
+ * callbacks are kept in a queue; a failed one gets an empty answer and
+ * last_error() says why.
+ */
+class RemoteSession {
+public:
+    using SendFn = std::function<void(std::string frame)>;
+    struct Entry {
+        std::string name;
+        bool directory = false;
+        uint64_t size = 0;
+    };
+    using ListFn = std::function<void(const std::string& directory, std::vector<Entry> entries)>;
+    using SearchFn = std::function<void(std::vector<SearchResult> results)>;
+
+    RemoteSession();
+    ~RemoteSession();
+
+    RemoteSession(const RemoteSession&) = delete;
+    RemoteSession& operator=(const RemoteSession&) = delete;
+
+    static std::vector<std::string> ssh_command(const std::string& host, const std::string& root,
+                                                const std::string& agent = "editor_demo");
+    // Start command[0] with the rest as arguments and talk over its stdio
+    bool connect(const std::vector<std::string>& command);
+    void attach(SendFn send);
+    void disconnect();
+
+    // Bytes from the agent, on any thread
+    void receive(const char* data, size_t size);
+    // Deliver what has arrived; returns the frames handled
+    size_t poll();
+
+    bool connected() const { return connected_; }      // Hello received
+    bool lost() const;                                  // Stream ended or corrupt
+    const std::string& root() const { return root_; }
+    const std::string& last_error() const { return last_error_; }
+
+    std::shared_ptr<RemoteDocument> open(const std::string& path);
+    void close(const std::shared_ptr<RemoteDocument>& document);
+    void list(const std::string& directory, ListFn done);
+    void search(const std::string& pattern, bool regex, bool case_sensitive, size_t max_results, SearchFn done);
+
+private:
+    void send(std::string frame);
+    void handle_workspace(const RemoteFrame& frame);
+
+    SendFn send_;
+    std::unique_ptr<PlatformProcess> process_;
+    std::shared_ptr<ProcessIoLoop> io_loop_;
+    size_t watch_id_ = 0;
+
+    mutable std::mutex mutex_;      // Guards what receive() touches
+    RemoteFraming framing_;
+    std::vector<RemoteFrame> arrived_;
+    bool lost_ = false;
+
+    bool connected_ = false;
+    std::string root_;
+    std::string last_error_;
+    uint32_t next_channel_ = 1;
+    std::unordered_map<uint32_t, std::shared_ptr<RemoteDocument>> documents_;
+    struct Request {
+        RemoteMessage answer;
+        ListFn list;
+        SearchFn search;
+    };
+    std::deque<Request> requests_;
+};
+
+} // namespace editor
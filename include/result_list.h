@@ -0,0 +1,136 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class PieceTable;
+struct SearchResult;
+
+namespace editor {
+
+/**
+ * ResultList - the rows of a search, references or diagnostics panel,
+ * filled while the producer is still running and read a screen at a time
+ *
+ * A result is kept as (file id, line, column, length) in 28 bytes; the
+ * text of its line is not. Producers on any thread add one file's hits at
+ * a time, so a file's results stay together under its header row, and
+ * the panel can paint the first screen while the rest is still coming.
+ * rows() reads the preview lines of only the rows asked for, from the
+ * open document of the file if there is one, else from a mapping of it;
+ * a few recently read files are kept. Diagnostics carry their message
+ * instead, held in one shared arena.
+ *
+ * reset() starts a new set and returns its generation; additions tagged
+ * with an older one, from a producer still finishing a search the user
+ * has since replaced, are dropped.
+ */
+class ResultList {
+public:
+    enum class Kind : uint8_t { Match, Reference, Error, Warning, Note };
+
+    struct Hit {
+        Hit() = default;
+        Hit(size_t line, size_t column, size_t length, Kind kind = Kind::Match, std::string_view message = {})
+            : line(line), column(column), length(length), kind(kind), message(message) {}
+
+        size_t line = 0;
+        size_t column = 0;
+        size_t length = 0;
+        Kind kind = Kind::Match;
+        std::string_view message;       // Diagnostics: shown instead of the line
+    };
+
+    struct Row {
+        bool header = false;            // File row: path only
+        size_t result = 0;              // Index of the result (not of the row)
+        std::string path;
+        size_t line = 0;
+        size_t column = 0;
+        size_t length = 0;
+        Kind kind = Kind::Match;
+        std::string text;               // Preview line or message ("" for headers)
+    };
+
+    // Open buffer for a path, or nullptr to read the file
+    using DocumentLookup = std::function<std::shared_ptr<PieceTable>(const std::string& path)>;
+
+    ResultList();
+    ~ResultList();
+    ResultList(const ResultList&) = delete;
+    ResultList& operator=(const ResultList&) = delete;
+
+    // Empty the list for a new set of results; returns its generation
+    uint64_t reset();
+    // A file's hits, appended as one group. Any thread; false (and
+    // nothing added) if generation is no longer current
+    bool add(uint64_t generation, const std::string& path, const std::vector<Hit>& hits);
+    // Indexer or language server results: runs of the same file become groups
+    bool add(uint64_t generation, const std::vector<SearchResult>& results, Kind kind = Kind::Match);
+    // The producer is done with generation
+    void finish(uint64_t generation);
+
+    uint64_t generation() const;
+    bool complete() const;
+    size_t size() const;                // Results
+    size_t file_count() const;
+    size_t row_count() const;           // Results plus one header row per group
+    // Bumped by every change, for the panel to repaint only then
+    uint64_t revision() const;
+
+    // Rows [first, first + count), previews included. Call from one thread
+    // (the UI's): the preview cache is not shared.
+    void rows(size_t first, size_t count, std::vector<Row>& out);
+    // One result, without its preview; false past the end
+    bool get(size_t result, Row& out) const;
+    // Distinct files with results, in first-result order
+    std::vector<std::string> files() const;
+
+    void set_document_lookup(DocumentLookup lookup) { lookup_ = std::move(lookup); }
+    // Bytes held by the results and their messages (not by the preview cache)
+    size_t memory_bytes() const;
+
+    static constexpr size_t kPreviewFiles = 8;
+
+private:
+    struct Entry {
+        uint32_t file;
+        uint32_t line;
+        uint32_t column;
+        uint32_t length;
+        uint32_t message;           // Offset into messages_
+        uint32_t message_length;
+        Kind kind;
+    };
+    struct Group {
+        size_t first;               // Index of its first result
+        uint32_t file;
+    };
+
+    void fill(const Entry& entry, size_t index, Row& row) const;
+    std::string preview(const std::string& path, size_t line);
+
+    mutable std::mutex mutex_;
+    uint64_t generation_ = 0;
+    uint64_t revision_ = 0;
+    bool complete_ = true;
+    std::deque<Entry> entries_;     // Grows without moving what is there
+    std::vector<Group> groups_;
+    std::vector<std::string> paths_;
+    std::unordered_map<std::string, uint32_t> file_ids_;
+    std::string messages_;
+
+    // Documents recently read for previews, most recent first
+    DocumentLookup lookup_;
+    std::list<std::pair<std::string, std::shared_ptr<PieceTable>>> preview_files_;
+};
+
+} // namespace editor
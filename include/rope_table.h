@@ -4,48 +4,78 @@
 #include <memory>
 #include <string>
 #include <vector>
+#include <deque>
+#include "text_buffer.h"
 
 /**
- * RopeNode - solmu Rope-puussa
+ * RopeNode - immutable node of a RopeTable
+ *
+ * Leaves hold the text; every node caches the length, newline count and
+ * height of its subtree. Nodes are never changed after creation, so edits
+ * copy only the path they touch and ropes share everything else.
  */
-class RopeNode {
-public:
-    std::shared_ptr<RopeNode> left;
-    std::shared_ptr<RopeNode> right;
-    std::string data;
-    size_t weight; // vasemman alipuun pituus
-
-    RopeNode(const std::string& str)
-        : left(nullptr), right(nullptr), data(str), weight(str.length()) {}
-    RopeNode(std::shared_ptr<RopeNode> l, std::shared_ptr<RopeNode> r)
-        : left(l), right(r), data(""), weight(l ? l->length() : 0) {}
-
-    size_t length() const {
-        if (!left && !right) return data.length();
-        size_t l = left ? left->length() : 0;
-        size_t r = right ? right->length() : 0;
-        return l + r;
-    }
+struct RopeNode {
+    std::shared_ptr<const RopeNode> left;
+    std::shared_ptr<const RopeNode> right;
+    std::string data;       // Leaves only
+    size_t length;
+    size_t newlines;
+    int height;             // 1 for a leaf
+    
+    bool is_leaf() const { return !left; }
 };
 
 /**
- * RopeTable - puupohjainen tekstirakenne
+ * RopeTable - balanced rope with the PieceTable query API
+ *
+ * The tree is kept AVL-balanced by joining and splitting, so insert,
+ * remove, offset lookup and line lookup are O(log n). Leaves hold between
+ * kMinLeaf and kMaxLeaf bytes (except a document shorter than kMinLeaf):
+ * the leaves an edit leaves behind at its seams are merged or re-chunked.
+ *
+ * Because nodes are shared, copying a RopeTable is O(1) and gives an
+ * independent snapshot, and every undo step is just the previous root.
  */
-class RopeTable {
+class RopeTable : public TextBuffer {
 public:
     RopeTable();
     explicit RopeTable(const std::string& initial_text);
-
-    void insert(size_t position, const std::string& text);
-    void remove(size_t position, size_t length);
-    std::string get_text(size_t start, size_t length) const;
-    size_t get_total_length() const;
-
+    
+    // Editing - O(log n)
+    void insert(size_t position, const std::string& text) override;
+    void remove(size_t position, size_t length) override;
+    // Alias for test compatibility
+    void delete_range(size_t position, size_t length) { remove(position, length); }
+    // Undo/redo restore earlier roots - O(1)
+    void undo() override;
+    void redo() override;
+    bool can_undo() const override { return !undo_history_.empty(); }
+    bool can_redo() const override { return !redo_history_.empty(); }
+    
+    // Query operations, matching PieceTable
+    std::string get_text(size_t start, size_t length) const override;
+    std::string get_line(size_t line_number) const override;
+    size_t get_line_count() const override;
+    size_t get_total_length() const override;
+    size_t get_line_start(size_t line_number) const override;
+    size_t get_line_at(size_t position) const override;
+    std::vector<std::string> get_lines_range(size_t start_line, size_t count) const override;
+    TextBufferBackend backend() const override { return TextBufferBackend::Rope; }
+    
+    // Tree shape, for tests and benchmarks
+    int get_height() const;
+    size_t get_leaf_count() const;
+    
+    static constexpr size_t kMinLeaf = 256;
+    static constexpr size_t kMaxLeaf = 1024;
+    
 private:
-    std::shared_ptr<RopeNode> root_;
-    // apumetodit
-    std::shared_ptr<RopeNode> concat(std::shared_ptr<RopeNode> left, std::shared_ptr<RopeNode> right);
-    std::pair<std::shared_ptr<RopeNode>, std::shared_ptr<RopeNode>> split(std::shared_ptr<RopeNode> node, size_t pos);
+    std::shared_ptr<const RopeNode> root_;
+    std::deque<std::shared_ptr<const RopeNode>> undo_history_;
+    std::deque<std::shared_ptr<const RopeNode>> redo_history_;
+    static constexpr size_t kMaxHistory = 1000;
+    
+    void push_undo();
 };
 
 #endif // ROPE_TABLE_H
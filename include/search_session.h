@@ -0,0 +1,90 @@
+#ifndef SEARCH_SESSION_H
+#define SEARCH_SESSION_H
+
+#include "find_dialog.h"
+#include "piece_table.h"
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * SearchSession - search-as-you-type over one document
+ *
+ * Instead of a fresh find_all per keystroke, the session keeps the
+ * matches found so far and a list of document ranges still to scan, and
+ * step() works through them a budget of bytes at a time, so a long search
+ * is spread across frames and the match count grows as it goes.
+ *
+ * Literal candidates are kept overlapping (the published matches are the
+ * leftmost non-overlapping ones, as find_all returns), so a query that
+ * extends the previous one only re-checks the previous candidates plus
+ * whatever was still unscanned. Edits reported by the document's change
+ * listener shift the candidates behind the edit, drop the ones it touched
+ * and queue just the dirtied region for a rescan. Regex queries, case or
+ * mode changes and shortened queries start over; a new query or cancel()
+ * abandons the work left.
+ *
+ * Settings (case, regex) come from the FindDialog, which also runs the
+ * scans; it must outlive the session.
+ */
+class SearchSession {
+public:
+    explicit SearchSession(FindDialog* finder);
+    ~SearchSession();
+
+    SearchSession(const SearchSession&) = delete;
+    SearchSession& operator=(const SearchSession&) = delete;
+
+    // Bind to a document (no-op if already bound); restarts the search
+    void set_document(const std::shared_ptr<PieceTable>& document);
+
+    // Search for query from now on; "" clears the matches
+    void set_query(const std::string& query);
+    const std::string& query() const { return query_; }
+
+    // Scan or re-check about budget bytes of pending work. Returns true
+    // when the published matches changed.
+    bool step(size_t budget = kDefaultBudget);
+    // Drop the pending work, keeping what was found so far
+    void cancel();
+
+    bool is_complete() const { return verify_.empty() && pending_.empty(); }
+    // Bytes of document still to scan - for progress display
+    size_t pending_bytes() const;
+
+    // Matches found so far, in document order
+    const std::vector<SearchMatch>& matches() const;
+    // Bumped whenever matches() changes
+    size_t generation() const { return generation_; }
+
+    // Work done per frame when step() is called without a budget
+    static constexpr size_t kDefaultBudget = 4 * 1024 * 1024;
+
+private:
+    using Range = std::pair<size_t, size_t>;    // [begin, end)
+
+    void restart();
+    void on_change(const PieceTable::Change& change);
+    void add_pending(size_t begin, size_t end);
+    bool matches_at(size_t position) const;
+
+    FindDialog* finder_;
+    std::shared_ptr<PieceTable> document_;
+    size_t listener_id_;
+
+    std::string query_;
+    bool case_sensitive_;
+    bool use_regex_;
+
+    std::vector<SearchMatch> candidates_;   // Found for query_, sorted (overlapping when literal)
+    std::vector<SearchMatch> verify_;       // Previous query's candidates still to re-check
+    size_t verify_next_;
+    std::vector<Range> pending_;            // Unscanned ranges, sorted and disjoint
+
+    mutable std::vector<SearchMatch> published_;
+    mutable bool published_stale_;
+    size_t generation_;
+};
+
+#endif // SEARCH_SESSION_H
@@ -0,0 +1,89 @@
+#pragma once
+#include "lsp_document_sync.h"
+#include "lsp_types.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace editor {
+
+// What a semantic token is drawn as; the server's legend names map onto these
+enum class SemanticKind : uint8_t { None, Type, Function, Variable, Keyword, String, Number, Comment, Macro };
+
+/**
+ * SemanticTokenOverlay - a language server's semantic tokens for one document
+ *
+ * Holds the result as the server encodes it: a flat array of five integers
+ * a token, relative to the token before. A full/delta result edits that
+ * array in place, so after an edit only the changed integers cross the
+ * pipe and nothing is re-decoded. A checkpoint every kCheckpointTokens
+ * tokens records its absolute position; spans() decodes one line by
+ * walking from the nearest checkpoint, so only the lines being drawn are
+ * ever turned into spans.
+ *
+ * Document edits made after the tokens were requested are recorded
+ * (on_change) and lines are mapped through them: lines below an edit
+ * shift, edited lines show no semantic tokens until the next result.
+ * generation() changes whenever spans() could answer differently.
+ */
+class SemanticTokenOverlay {
+public:
+    // A token within a line, in bytes
+    struct Span {
+        uint32_t start;
+        uint32_t length;
+        SemanticKind kind;
+    };
+
+    static constexpr size_t kCheckpointTokens = 64;
+
+    // tokenTypes of the server's legend
+    void set_legend(const std::vector<std::string>& token_types);
+    void set_encoding(PositionEncoding encoding) { encoding_ = encoding; }
+    static SemanticKind kind_of(const std::string& token_type);
+
+    // resultId of the tokens held; empty when a full request is needed
+    const std::string& result_id() const { return result_id_; }
+    // Edits seen so far: pass the value taken when the request went out to
+    // apply(), so the edits the result already reflects are dropped
+    size_t mark() const { return edits_base_ + edits_.size(); }
+    // false (and the tokens cleared) when a delta does not fit the data held
+    bool apply(const LspSemanticTokens& result, size_t mark);
+    void clear();
+
+    // Lines [first_line, first_line + removed] became [first_line, first_line + inserted]
+    void on_change(size_t first_line, size_t removed_newlines, size_t inserted_newlines);
+
+    // Tokens of a document line whose text is line_text, in order
+    void spans(size_t line, std::string_view line_text, std::vector<Span>& out) const;
+
+    size_t token_count() const { return data_.size() / 5; }
+    uint64_t generation() const { return generation_; }
+    size_t get_memory_bytes() const;
+
+private:
+    struct Checkpoint {
+        uint32_t line;
+        uint32_t start;
+    };
+    struct LineEdit {
+        size_t first_line;
+        size_t removed;
+        size_t inserted;
+    };
+
+    void rebuild_checkpoints();
+    bool map_line(size_t line, size_t& data_line) const;
+
+    std::vector<uint32_t> data_;
+    std::vector<Checkpoint> checkpoints_;   // Token k * kCheckpointTokens
+    std::vector<SemanticKind> kinds_;       // By legend index
+    std::string result_id_;
+    std::vector<LineEdit> edits_;           // Since the request of the data held
+    size_t edits_base_ = 0;                 // Edits dropped from the front of edits_
+    PositionEncoding encoding_ = PositionEncoding::Utf16;
+    uint64_t generation_ = 0;
+};
+
+} // namespace editor
@@ -0,0 +1,78 @@
+#ifndef SLAB_POOL_H
+#define SLAB_POOL_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * SlabPool - per-owner allocator for fixed-size nodes
+ *
+ * Objects are carved out of slabs of kSlabObjects and freed slots are
+ * reused through an intrusive free list, so creating and destroying tree
+ * nodes never touches the general-purpose heap after warm-up and the nodes
+ * of one document sit close together. Dropping the pool releases every
+ * slab at once; T must be trivially destructible for that to be valid.
+ * Not thread-safe - each pool belongs to one owner.
+ */
+template <typename T, size_t kSlabObjects = 256>
+class SlabPool {
+    static_assert(std::is_trivially_destructible<T>::value, "SlabPool releases slabs without running destructors");
+    
+public:
+    SlabPool() = default;
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+    
+    template <typename... Args>
+    T* create(Args&&... args) {
+        Slot* slot = free_list_;
+        if (slot) {
+            free_list_ = slot->next;
+        } else {
+            if (used_in_slab_ == kSlabObjects || slabs_.empty()) {
+                slabs_.emplace_back(new Slot[kSlabObjects]);
+                used_in_slab_ = 0;
+            }
+            slot = &slabs_.back()[used_in_slab_++];
+        }
+        ++live_;
+        return new (slot->storage) T(std::forward<Args>(args)...);
+    }
+    
+    void destroy(T* object) {
+        Slot* slot = reinterpret_cast<Slot*>(object);
+        slot->next = free_list_;
+        free_list_ = slot;
+        --live_;
+    }
+    
+    // Free every object in one go
+    void clear() {
+        slabs_.clear();
+        free_list_ = nullptr;
+        used_in_slab_ = 0;
+        live_ = 0;
+    }
+    
+    size_t live_count() const { return live_; }
+    size_t slab_count() const { return slabs_.size(); }
+    // Bytes of every slab, free slots included
+    size_t reserved_bytes() const { return slabs_.size() * kSlabObjects * sizeof(Slot); }
+    
+private:
+    union Slot {
+        Slot* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+    
+    std::vector<std::unique_ptr<Slot[]>> slabs_;
+    Slot* free_list_ = nullptr;
+    size_t used_in_slab_ = 0;
+    size_t live_ = 0;
+};
+
+#endif // SLAB_POOL_H
@@ -0,0 +1,101 @@
+#ifndef STARTUP_SCHEDULER_H
+#define STARTUP_SCHEDULER_H
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * StartupTimeline - when each phase of startup began and ended
+ *
+ * Times are milliseconds since the origin (process start, as near as the
+ * caller can get). Any thread may record; format() lists the phases by
+ * start time for a trace dump, so a slow phase or one that moved in front
+ * of the first frame shows up in a diff of two dumps.
+ */
+class StartupTimeline {
+public:
+    struct Phase {
+        std::string name;
+        double start_ms = 0;
+        double end_ms = 0;          // Equals start_ms for a mark
+        bool background = false;    // Ran off the UI thread
+    };
+
+    explicit StartupTimeline(std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now());
+
+    // A moment (e.g. "first frame")
+    void mark(const std::string& name);
+    // A phase; end() takes begin()'s result
+    size_t begin(const std::string& name, bool background = false);
+    void end(size_t phase);
+
+    double elapsed_ms() const;
+    // Time of the first mark or phase start called name; -1 if none
+    double time_of(const std::string& name) const;
+    std::vector<Phase> phases() const;      // By start time
+    // One line per phase: start, duration, name ("[bg]" off the UI thread)
+    std::string format() const;
+
+private:
+    std::chrono::steady_clock::time_point origin_;
+    mutable std::mutex mutex_;
+    std::vector<Phase> phases_;
+};
+
+/**
+ * StartupScheduler - brings subsystems up after the first frame
+ *
+ * The window paints its first frame with only the document and viewport;
+ * everything else is registered here and started from it. Background
+ * tasks run concurrently, each on its own thread, and may hand a finish
+ * step to the UI thread (for the part that touches windows or shared
+ * editor state). Idle tasks run on the UI thread one per step(), so input
+ * is handled between them. Every task is recorded in the timeline.
+ */
+class StartupScheduler {
+public:
+    using Task = std::function<void()>;
+
+    explicit StartupScheduler(StartupTimeline& timeline) : timeline_(timeline) {}
+    ~StartupScheduler();    // Waits for running background work
+
+    StartupScheduler(const StartupScheduler&) = delete;
+    StartupScheduler& operator=(const StartupScheduler&) = delete;
+
+    // work runs off the UI thread; finish (optional) runs in a later step()
+    void add_background(const std::string& name, Task work, Task finish = nullptr);
+    void add_idle(const std::string& name, Task task);
+
+    // Launch the background work. notify runs on the finishing thread
+    // whenever a finish step is ready; post it to the UI thread and call
+    // step() there.
+    void start(std::function<void()> notify = nullptr);
+    // UI thread: run the finish steps that are ready and at most one idle
+    // task. Returns true while anything is left.
+    bool step();
+    bool is_done() const;
+
+private:
+    struct Item {
+        std::string name;
+        Task work;
+        Task finish;
+    };
+
+    StartupTimeline& timeline_;
+    std::vector<Item> background_;
+    std::deque<Item> idle_;
+    std::vector<std::thread> threads_;
+
+    mutable std::mutex mutex_;
+    std::vector<Item> finished_;        // Background work done, finish pending
+    size_t running_ = 0;
+};
+
+#endif // STARTUP_SCHEDULER_H
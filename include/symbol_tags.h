@@ -0,0 +1,38 @@
+#ifndef SYMBOL_TAGS_H
+#define SYMBOL_TAGS_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * SymbolTags - where a source file defines its symbols, line by line
+ *
+ * A tags pass in the spirit of ctags and Tree-sitter's tags queries, but
+ * with no grammar: per language, the identifier after a defining keyword
+ * (class, struct, def, fn, func, type, ...) is a definition, and in the
+ * C family so is the name before the first '(' of a line that does not
+ * end in ';' and is not a control statement. It looks at each line on
+ * its own, so it runs in the indexer's tokenize pass at no extra reads;
+ * answers are approximate and a language server has the precise ones.
+ */
+class SymbolTags {
+public:
+    enum class Language { None, CFamily, Python, JavaScript, Rust, Go };
+
+    struct Definition {
+        std::string name;
+        uint32_t line;
+        uint32_t column;
+    };
+
+    // From the file extension; None for files without a tags pass
+    static Language language_for_path(std::string_view path);
+
+    // Append the definitions on one line (line_number is recorded as given)
+    static void scan_line(Language language, std::string_view line, uint32_t line_number,
+                          std::vector<Definition>& out);
+};
+
+#endif // SYMBOL_TAGS_H
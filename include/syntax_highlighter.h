@@ -3,8 +3,6 @@
 
 #include <string>
 #include <vector>
-#include <unordered_set>
-#include <unordered_map>
 #include <cctype>
 #include <windows.h>
 #include "treesitter_bridge.h"
@@ -19,7 +17,11 @@ struct Token {
         STRING,
         COMMENT,
         NUMBER,
-        PREPROCESSOR
+        PREPROCESSOR,
+        // From a language server's semantic tokens only
+        TYPE,
+        FUNCTION,
+        VARIABLE
     };
     
     Type type;
@@ -33,6 +35,9 @@ struct Token {
             case COMMENT:      return RGB(87, 166, 74);    // Green
             case NUMBER:       return RGB(181, 206, 168);  // Light green
             case PREPROCESSOR: return RGB(155, 155, 155);  // Gray
+            case TYPE:         return RGB(78, 201, 176);   // Teal
+            case FUNCTION:     return RGB(220, 220, 170);  // Pale yellow
+            case VARIABLE:     return RGB(156, 220, 254);  // Light blue
             case NORMAL:
             default:           return RGB(220, 220, 220);  // White
         }
@@ -41,6 +46,12 @@ struct Token {
 
 /**
  * SyntaxHighlighter - Simple C++ syntax highlighting
+ *
+ * Each language's lexer is a template instance chosen once per line, with
+ * its comment and string rules fixed at compile time; keywords come from
+ * constexpr perfect-hash tables (KeywordTable) and character classes
+ * from a 256-entry table, so the per-character loop does no language
+ * checks, no locale calls and no allocation.
  */
 class SyntaxHighlighter {
 public:
@@ -50,16 +61,24 @@ public:
         bool in_block_comment = false;     // /* ... */ or /*# ... #*/ style
         bool in_triple_string = false;     // Python/Markdown code fences
         char string_delim = 0;             // ' or " or ` for template strings
+
+        bool operator==(const LineState& other) const {
+            return in_block_comment == other.in_block_comment &&
+                   in_triple_string == other.in_triple_string &&
+                   string_delim == other.string_delim;
+        }
+        bool operator!=(const LineState& other) const { return !(*this == other); }
     };
 
     SyntaxHighlighter() { set_language(Language::Cpp); }
 
     void set_language(Language lang) {
         language_ = lang;
-        rebuild_keywords();
         // Tree-sitter bridge removed for minimal build
     }
 
+    Language get_language() const { return language_; }
+
     void set_language_by_filename(const std::string& filename) {
         auto dot = filename.find_last_of('.')
 ;        std::string ext = (dot == std::string::npos) ? std::string() : filename.substr(dot + 1);
@@ -88,11 +107,19 @@ public:
         // Tree-sitter bridge removed for minimal build
     }
     
-    // Incremental tokenization with line state
-    std::vector<Token> tokenize_line(const std::string& line, const LineState& in_state, LineState& out_state);
+    // Incremental tokenization with line state, into tokens (cleared first).
+    // Pass the same vector line after line so its capacity is reused.
+    void tokenize_line(const std::string& line, const LineState& in_state, LineState& out_state,
+                       std::vector<Token>& tokens) const;
+
+    std::vector<Token> tokenize_line(const std::string& line, const LineState& in_state, LineState& out_state) const {
+        std::vector<Token> tokens;
+        tokenize_line(line, in_state, out_state, tokens);
+        return tokens;
+    }
 
     // Backwards-compatible single-line tokenization (no cross-line state)
-    std::vector<Token> tokenize_line(const std::string& line) {
+    std::vector<Token> tokenize_line(const std::string& line) const {
         LineState s_in{}, s_out{}; return tokenize_line(line, s_in, s_out);
     }
 
@@ -100,52 +127,6 @@ public:
     
 private:
     Language language_ = Language::Cpp;
-    std::unordered_set<std::string> keywords_;
-
-    bool is_line_comment_start(const std::string& line, size_t i) const {
-        if (language_ == Language::Python || language_ == Language::YAML) return line[i] == '#';
-        if (language_ == Language::JSON) return false;
-        return (i + 1 < line.size() && line[i] == '/' && line[i+1] == '/');
-    }
-
-    bool is_block_comment_start(const std::string& line, size_t i) const {
-        if (language_ == Language::JSON || language_ == Language::YAML || language_ == Language::Markdown || language_ == Language::Python) return false;
-        return (i + 1 < line.size() && line[i] == '/' && line[i+1] == '*');
-    }
-
-    bool is_preprocessor_start(const std::string& line, size_t i) const {
-        if (language_ == Language::Cpp || language_ == Language::JavaScript || language_ == Language::TypeScript || language_ == Language::Rust || language_ == Language::Go) {
-            return line[i] == '#';
-        }
-        if (language_ == Language::YAML) {
-            // Start of document marker or key-like header (---)
-            return (i + 2 < line.size() && line[i] == '-' && line[i+1] == '-' && line[i+2] == '-');
-        }
-        if (language_ == Language::Markdown) {
-            return line[i] == '#';
-        }
-        return false;
-    }
-
-    void rebuild_keywords() {
-        keywords_.clear();
-        switch (language_) {
-            case Language::Cpp: keywords_ = cpp_keywords(); break;
-            case Language::Python: keywords_ = python_keywords(); break;
-            case Language::JavaScript: keywords_ = javascript_keywords(); break;
-            case Language::TypeScript: {
-                keywords_ = javascript_keywords();
-                auto ts = typescript_extras(); keywords_.insert(ts.begin(), ts.end());
-                break;
-            }
-            case Language::Rust: keywords_ = rust_keywords(); break;
-            case Language::Go: keywords_ = go_keywords(); break;
-            case Language::JSON: keywords_ = json_keywords(); break;
-            case Language::YAML: keywords_ = yaml_keywords(); break;
-            case Language::Markdown: keywords_.clear(); break;
-            default: break;
-        }
-    }
 
     static std::string language_to_id(Language lang) {
         switch (lang) {
@@ -161,33 +142,6 @@ private:
             default: return "";
         }
     }
-
-    static std::unordered_set<std::string> cpp_keywords() {
-        return {
-            "alignas","alignof","and","and_eq","asm","auto","bitand","bitor","bool","break","case","catch","char","char16_t","char32_t","class","compl","const","constexpr","const_cast","continue","decltype","default","delete","do","double","dynamic_cast","else","enum","explicit","export","extern","false","float","for","friend","goto","if","inline","int","long","mutable","namespace","new","noexcept","not","not_eq","nullptr","operator","or","or_eq","private","protected","public","register","reinterpret_cast","return","short","signed","sizeof","static","static_assert","static_cast","struct","switch","template","this","thread_local","throw","true","try","typedef","typeid","typename","union","unsigned","using","virtual","void","volatile","wchar_t","while","xor","xor_eq","override","final"
-        };
-    }
-    static std::unordered_set<std::string> python_keywords() {
-        return {"and","as","assert","break","class","continue","def","del","elif","else","except","False","finally","for","from","global","if","import","in","is","lambda","None","nonlocal","not","or","pass","raise","return","True","try","while","with","yield"};
-    }
-    static std::unordered_set<std::string> javascript_keywords() {
-        return {"break","case","catch","class","const","continue","debugger","default","delete","do","else","export","extends","finally","for","function","if","import","in","instanceof","let","new","return","super","switch","this","throw","try","typeof","var","void","while","with","yield","true","false","null","undefined"};
-    }
-    static std::unordered_set<std::string> typescript_extras() {
-        return {"interface","type","enum","implements","readonly","keyof","unknown","never"};
-    }
-    static std::unordered_set<std::string> rust_keywords() {
-        return {"as","break","const","continue","crate","else","enum","extern","false","fn","for","if","impl","in","let","loop","match","mod","move","mut","pub","ref","return","self","Self","static","struct","super","trait","true","type","unsafe","use","where","while"};
-    }
-    static std::unordered_set<std::string> go_keywords() {
-        return {"break","default","func","interface","select","case","defer","go","map","struct","chan","else","goto","package","switch","const","fallthrough","if","range","type","continue","for","import","return","var"};
-    }
-    static std::unordered_set<std::string> json_keywords() {
-        return {"true","false","null"};
-    }
-    static std::unordered_set<std::string> yaml_keywords() {
-        return {"true","false","null","y","n","on","off"};
-    }
 };
 
 #endif // SYNTAX_HIGHLIGHTER_H
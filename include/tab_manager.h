@@ -2,21 +2,51 @@
 #define TAB_MANAGER_H
 
 #include "piece_table.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <string>
 
+struct TabViewState;
+
 /**
  * EditorTab - Represents a single open document/file
+ *
+ * The document may use any TextBuffer backend; piece_table() gives the
+ * PieceTable-only services (transactions, change listeners, snapshots).
+ *
+ * A hibernated tab has no document: TabManager dropped it to stay within
+ * its memory budget and keeps only what bringing it back needs - the path
+ * and its mtime, the cursor and scroll position, and for a modified tab
+ * the journal its text was spilled to.
  */
 struct EditorTab {
-    std::shared_ptr<PieceTable> document;
+    std::shared_ptr<TextBuffer> document;
     std::string file_path;
     std::string display_name;
     bool is_modified;
     size_t cursor_pos;
+    size_t top_line = 0;
+    
+    uint64_t id = 0;                        // Unique within the manager, kept across moves
+    TextBufferBackend backend = TextBufferBackend::Auto;
+    uint64_t last_active = 0;               // Manager's clock when last made active
+    uint64_t mtime = 0;                     // file_path's mtime when hibernated
+    size_t cursor_line = 0;                 // Cursor's line when hibernated
+    std::string spill_path;                 // Journal holding a hibernated modified tab's text
+    std::shared_future<std::shared_ptr<TextBuffer>> reload;  // Valid while reloading
+    bool preloading = false;                // The reload is a preload, not an activation
+    // Highlighting, folds, wrap layout and git markers of the document,
+    // parked while the tab is in the background; dropped with the document
+    std::shared_ptr<TabViewState> view_state;
     
-    EditorTab(std::shared_ptr<PieceTable> doc, const std::string& path = "")
+    EditorTab(std::shared_ptr<TextBuffer> doc, const std::string& path = "")
         : document(doc)
         , file_path(path)
         , display_name(path.empty() ? "Untitled" : extract_filename(path))
@@ -24,6 +54,14 @@ struct EditorTab {
         , cursor_pos(0)
     {}
     
+    // The document as a piece table, or null for other backends
+    std::shared_ptr<PieceTable> piece_table() const {
+        return std::dynamic_pointer_cast<PieceTable>(document);
+    }
+    
+    bool is_hibernated() const { return document == nullptr; }
+    bool is_reloading() const { return reload.valid(); }
+    
 private:
     static std::string extract_filename(const std::string& path) {
         size_t last_slash = path.find_last_of("/\\");
@@ -36,19 +74,50 @@ private:
 
 /**
  * TabManager - Manages multiple open documents/tabs
+ *
+ * With a memory budget set, enforce_budget() hibernates the least recently
+ * active tabs until the resident documents fit: an unmodified file is just
+ * dropped (it reloads from disk), a modified or untitled one is first
+ * spilled to a journal in the spill workspace (and kept resident when there
+ * is none). Making a hibernated tab active starts reloading it on a
+ * background thread; complete_reloads() installs the finished documents.
+ *
+ * A restored session starts out the same way: add_hibernated_tab() makes
+ * placeholders that cost no I/O, the active one is loaded first, and
+ * preload_tabs() queues the rest most recently used first. One loader
+ * thread reads them in that order; a tab being switched to jumps the
+ * queue, and preloading stops once the budget is full.
  */
 class TabManager {
 public:
-    TabManager() : active_tab_index_(0) {
+    // Runs on the loading thread when a reload finishes; GUI consumers
+    // post to their UI thread and call complete_reloads() there
+    using ReloadNotify = std::function<void()>;
+    // Called for each tab just before its document is dropped
+    using HibernateHook = std::function<void(EditorTab&)>;
+    
+
+    // Tabs get default_backend unless new_tab asks for another one; Auto
+    // picks by content size
+    explicit TabManager(TextBufferBackend default_backend = TextBufferBackend::Auto)
+        : active_tab_index_(0), default_backend_(default_backend) {
         // Start with one empty tab
         new_tab();
     }
+    ~TabManager();      // Joins the loader; queued loads are dropped
+    
+    TabManager(const TabManager&) = delete;
+    TabManager& operator=(const TabManager&) = delete;
     
     // Tab operations
-    size_t new_tab(const std::string& content = "", const std::string& file_path = "") {
-        auto doc = std::make_shared<PieceTable>(content);
+    size_t new_tab(const std::string& content = "", const std::string& file_path = "",
+                   TextBufferBackend backend = TextBufferBackend::Auto) {
+        if (backend == TextBufferBackend::Auto) backend = default_backend_;
+        auto doc = TextBuffer::create(content, backend);
         tabs_.emplace_back(doc, file_path);
-        active_tab_index_ = tabs_.size() - 1;
+        tabs_.back().id = ++next_id_;
+        tabs_.back().backend = backend;
+        set_active_tab(tabs_.size() - 1);
         return active_tab_index_;
     }
     
@@ -62,10 +131,14 @@ public:
             return false;
         }
         
+        cancel_load(tabs_[index].id);
+        discard_spill(tabs_[index]);
         tabs_.erase(tabs_.begin() + index);
         
         // Adjust active tab index
-        if (active_tab_index_ >= tabs_.size()) {
+        if (index < active_tab_index_) {
+            active_tab_index_--;
+        } else if (active_tab_index_ >= tabs_.size()) {
             active_tab_index_ = tabs_.size() - 1;
         }
         
@@ -100,6 +173,10 @@ public:
         }
 
         // Clear all tabs and create a fresh untitled tab
+        for (auto& tab : tabs_) {
+            cancel_load(tab.id);
+            discard_spill(tab);
+        }
         tabs_.clear();
         active_tab_index_ = 0;
         new_tab();
@@ -109,21 +186,30 @@ public:
     // Navigation
     void next_tab() {
         if (tabs_.empty()) return;
-        active_tab_index_ = (active_tab_index_ + 1) % tabs_.size();
+        set_active_tab((active_tab_index_ + 1) % tabs_.size());
     }
     
     void previous_tab() {
         if (tabs_.empty()) return;
-        if (active_tab_index_ == 0) {
-            active_tab_index_ = tabs_.size() - 1;
-        } else {
-            active_tab_index_--;
+        set_active_tab(active_tab_index_ == 0 ? tabs_.size() - 1 : active_tab_index_ - 1);
+    }
+    
+    // Document of the tab showing file_path, or nullptr if it isn't open
+    // (or is hibernated)
+    std::shared_ptr<TextBuffer> find_document(const std::string& file_path) const {
+        for (const auto& tab : tabs_) {
+            if (!file_path.empty() && tab.file_path == file_path) return tab.document;
         }
+        return nullptr;
     }
     
+    // A hibernated tab starts reloading; its document arrives through
+    // complete_reloads()
     void set_active_tab(size_t index) {
         if (index < tabs_.size()) {
             active_tab_index_ = index;
+            tabs_[index].last_active = ++clock_;
+            if (tabs_[index].is_hibernated()) wake_tab(index);
         }
     }
     
@@ -154,9 +240,77 @@ public:
     
     const std::vector<EditorTab>& get_all_tabs() const { return tabs_; }
     
+    // Hibernation
+    void set_memory_budget(size_t bytes) { memory_budget_ = bytes; }   // 0: no limit
+    size_t get_memory_budget() const { return memory_budget_; }
+    // Workspace whose journal directory takes spilled tabs; none keeps
+    // modified and untitled tabs resident
+    void set_spill_workspace(const std::string& workspace_dir) { spill_workspace_ = workspace_dir; }
+    void set_reload_notify(ReloadNotify notify) {
+        std::lock_guard<std::mutex> lock(load_mutex_);
+        reload_notify_ = std::move(notify);
+    }
+    
+    // Estimated bytes a document keeps resident: its text, line index and
+    // undo history
+    static size_t resident_bytes(const TextBuffer& document);
+    size_t get_resident_bytes() const;
+    
+    // Hibernate inactive tabs, least recently active first, until the rest
+    // fit the budget; returns how many were hibernated
+    size_t enforce_budget(const HibernateHook& before = nullptr);
+    // Drop one inactive tab's document; false if it cannot be (active,
+    // already hibernated, or modified with nowhere to spill)
+    bool hibernate_tab(size_t index, const HibernateHook& before = nullptr);
+    // Start reloading a hibernated tab in the background, ahead of any
+    // preloads
+    bool wake_tab(size_t index);
+    
+    // Append a tab for file_path without reading it (a restored session's
+    // tab); it loads when activated or preloaded. last_active orders the
+    // preloads, larger is more recent. Returns its index.
+    size_t add_hibernated_tab(const std::string& file_path, size_t cursor_pos = 0, size_t top_line = 0,
+                              uint64_t last_active = 0);
+    // Queue every hibernated tab that was not spilled for loading, most
+    // recently active first; returns how many were queued
+    size_t preload_tabs();
+    // Install the documents of finished reloads (wait: block for all of
+    // them). A reload that failed leaves its tab hibernated and its spill
+    // in place. Returns the number installed.
+    size_t complete_reloads(bool wait = false);
+    
 private:
+    struct LoadRequest {
+        uint64_t tab_id = 0;
+        bool preload = false;
+        std::string spill_path;
+        std::string file_path;
+        TextBufferBackend backend = TextBufferBackend::Auto;
+        std::shared_ptr<std::promise<std::shared_ptr<TextBuffer>>> promise;
+    };
+    
+    bool can_hibernate(const EditorTab& tab) const;
+    void discard_spill(EditorTab& tab);
+    void queue_load(EditorTab& tab, bool preload);
+    void cancel_load(uint64_t tab_id);
+    void cancel_preloads();
+    void loader_loop();
+    
     std::vector<EditorTab> tabs_;
     size_t active_tab_index_;
+    TextBufferBackend default_backend_;
+    uint64_t next_id_ = 0;
+    uint64_t clock_ = 0;
+    size_t memory_budget_ = 0;
+    std::string spill_workspace_;
+    
+    // Loader thread, started by the first load
+    std::thread loader_;
+    std::mutex load_mutex_;
+    std::condition_variable load_wake_;
+    std::deque<LoadRequest> load_queue_;    // Wakes at the front, preloads behind
+    ReloadNotify reload_notify_;
+    bool load_stopping_ = false;
 };
 
 #endif // TAB_MANAGER_H
@@ -0,0 +1,33 @@
+#ifndef TAB_VIEW_STATE_H
+#define TAB_VIEW_STATE_H
+
+#include "code_folding.h"
+#include "document_outline.h"
+#include "git_integration.h"
+#include "highlight_cache.h"
+#include "syntax_highlighter.h"
+#include "viewport.h"
+#include <memory>
+#include <vector>
+
+/**
+ * TabViewState - what the editor derived from a tab's document, kept with
+ * the tab while another one is shown
+ *
+ * Showing a document builds state that costs O(file) to recompute: the
+ * highlighter's line states, the fold scan, the wrap layout, the git diff.
+ * Switching away parks it here and switching back moves it into place,
+ * so a tab switch costs a few pointer moves and one paint. Each part keeps
+ * following its document's edits while parked; the highlighter's
+ * background thread is stopped and restarted around it.
+ */
+struct TabViewState {
+    Viewport::State viewport;                   // Scroll position, wrap layout
+    std::unique_ptr<HighlightCache> highlight;
+    std::unique_ptr<CodeFoldingManager> folding;
+    std::unique_ptr<editor::DocumentOutline> outline;   // Definitions for the scope line
+    std::vector<GitDiffHunk> hunks;             // Markers shown until a fresh diff is in
+    SyntaxHighlighter::Language language = SyntaxHighlighter::Language::Auto;    // Auto: not shown yet
+};
+
+#endif // TAB_VIEW_STATE_H
@@ -0,0 +1,78 @@
+#ifndef TASK_COROUTINE_H
+#define TASK_COROUTINE_H
+
+// C++20 coroutine front end of the task scheduler; built with
+// -DENABLE_COROUTINES=ON, which defines EDITOR_COROUTINES
+#if defined(EDITOR_COROUTINES)
+
+#include "thread_pool.h"
+#include <coroutine>
+#include <exception>
+
+/**
+ * DetachedTask - a coroutine that starts at once and frees itself at the end
+ *
+ * Written top to bottom, a job hops between threads with co_await:
+ *
+ *     DetachedTask reload(...) {
+ *         if (!co_await resume_on(ThreadPool::shared(), TaskPriority::Background, token)) co_return;
+ *         auto text = read_file(path);                 // on a worker
+ *         if (!co_await resume_on(ui_queue, token)) co_return;
+ *         document->replace_all(text);                 // on the UI thread
+ *     }
+ *
+ * Each co_await resume_on yields false when the token was cancelled by the
+ * time the coroutine got there; the coroutine is always resumed (so its
+ * frame is freed) and returns. Locals live in the frame, so whatever the
+ * coroutine refers to across a hop must outlive it, as with any task.
+ */
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+// Continue on a worker of pool (or of a TaskGroup) at priority
+template <typename Executor>
+struct ResumeOnPool {
+    Executor& executor;
+    TaskPriority priority;
+    CancellationToken cancel;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        // No token for the executor: a dropped task would leak the frame
+        executor.submit([handle] { handle.resume(); }, priority);
+    }
+    bool await_resume() const noexcept { return !cancel.cancelled(); }
+};
+
+// Continue on the UI thread, in its next drain()
+struct ResumeOnQueue {
+    MainThreadQueue& queue;
+    CancellationToken cancel;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) {
+        queue.post([handle] { handle.resume(); });
+    }
+    bool await_resume() const noexcept { return !cancel.cancelled(); }
+};
+
+template <typename Executor>
+ResumeOnPool<Executor> resume_on(Executor& executor, TaskPriority priority = TaskPriority::Visible,
+                                 CancellationToken cancel = CancellationToken()) {
+    return {executor, priority, std::move(cancel)};
+}
+
+inline ResumeOnQueue resume_on(MainThreadQueue& queue, CancellationToken cancel = CancellationToken()) {
+    return {queue, std::move(cancel)};
+}
+
+#endif // EDITOR_COROUTINES
+
+#endif // TASK_COROUTINE_H
@@ -1,84 +1,96 @@
 #pragma once
 
-#include <windows.h>
+#include <atomic>
+#include <functional>
 #include <string>
 #include <vector>
 #include <deque>
 #include <memory>
+#include <mutex>
+#include "platform_process.h"
+#include "process_io_loop.h"
+#include "terminal_screen.h"
 
 /**
- * EmbeddedTerminal - Integrated terminal panel for Win32 editor
- * 
+ * EmbeddedTerminal - Integrated terminal panel
+ *
  * Features:
- * - Process spawning (PowerShell, CMD)
- * - Asynchronous I/O with pipes
- * - VT100-style ANSI escape sequence support
- * - Scrollback buffer
+ * - Shell on a pseudo terminal (ConPTY on Windows, a POSIX pty elsewhere),
+ *   so prompts, line editing and colors behave as in a real terminal
+ * - Output read by the shared ProcessIoLoop and parsed by a VT state
+ *   machine into a grid of cells with a ring-buffer scrollback
+ * - Output coalescing: however fast the shell writes, the owner is
+ *   notified once and parses everything pending in one update() per frame
  * - Command history
- * - Text selection and copy
  */
 class EmbeddedTerminal {
 public:
-    EmbeddedTerminal();
+    // Called on the I/O thread when output arrives and none was waiting
+    // since the last update(): at most once per update, so posting a
+    // redraw from it cannot flood the UI
+    using OutputCallback = std::function<void()>;
+
+    EmbeddedTerminal(int columns = 80, int rows = 24);
     ~EmbeddedTerminal();
-    
-    // Terminal lifecycle
-    bool start_shell(const std::string& shell_path = "powershell.exe");
+
+    // Terminal lifecycle; an empty shell_path starts the platform shell
+    bool start_shell(const std::string& shell_path = "");
     void stop_shell();
-    bool is_running() const { return process_running_; }
-    
-    // Input/Output
+    bool is_running() const { return process_running_ && !process_exited_; }
+
+    // Input, as the keys' bytes; a line is sent with Enter's CR
     void send_input(const std::string& text);
     void send_line(const std::string& line);
-    std::string get_output(); // Get and clear pending output
-    
-    // Display buffer access
-    const std::vector<std::string>& get_buffer() const { return buffer_; }
-    size_t get_buffer_size() const { return buffer_.size(); }
-    size_t get_cursor_line() const { return cursor_line_; }
-    size_t get_cursor_column() const { return cursor_col_; }
-    
-    // Scrolling
+
+    void set_output_callback(OutputCallback callback);
+    // Parses what the shell wrote since the last call; true when the
+    // screen changed. Call from the UI thread, once per frame.
+    bool update();
+
+    const editor::TerminalScreen& screen() const { return screen_; }
+    // Resizes the screen and tells the shell
+    void resize(int columns, int rows);
+
+    // Scrolling: lines scrolled back into history from the bottom
     void set_scroll_offset(int offset) { scroll_offset_ = offset; }
     int get_scroll_offset() const { return scroll_offset_; }
-    
+
     // History
     void add_to_history(const std::string& command);
     std::string history_prev();
     std::string history_next();
-    
+
     // Clear
     void clear();
-    
+    // Give back the scrollback's memory (memory pressure); returns the bytes freed
+    size_t drop_scrollback();
+
+    // Most output parsed per update(); the rest waits for the next frame
+    static constexpr size_t kMaxOutputPerUpdate = 4 * 1024 * 1024;
+
 private:
+    void on_output(const char* data, size_t size);
+
     // Process management
-    HANDLE process_handle_;
-    HANDLE thread_handle_;
-    HANDLE stdin_write_;
-    HANDLE stdout_read_;
+    std::unique_ptr<editor::PlatformProcess> process_;
+    std::shared_ptr<editor::ProcessIoLoop> io_loop_;
+    size_t output_watch_;
     bool process_running_;
-    
-    // Display buffer
-    std::vector<std::string> buffer_;
-    size_t cursor_line_;
-    size_t cursor_col_;
+    std::atomic<bool> process_exited_;      // Output ended; set on the I/O loop thread
+
+    // Display
+    editor::TerminalScreen screen_;
     int scroll_offset_;
-    
+
     // Command history
     std::deque<std::string> history_;
     int history_index_;
     static const size_t MAX_HISTORY = 100;
-    
-    // Pending output
+
+    // Output waiting for update(), appended on the I/O loop thread
+    std::mutex output_mutex_;
     std::string pending_output_;
-    
-    // ANSI escape sequence parser
-    void process_output(const std::string& output);
-    void parse_ansi_escape(const std::string& seq);
-    void append_text(const std::string& text);
-    
-    // Background reading
-    static DWORD WINAPI read_output_thread(LPVOID param);
-    HANDLE reader_thread_;
-    CRITICAL_SECTION output_mutex_;
+    bool output_notified_;                  // Callback fired since the last update()
+    OutputCallback output_callback_;
+    std::string parsing_;                   // UI thread: output being parsed
 };
@@ -0,0 +1,161 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "vt_parser.h"
+
+namespace editor {
+
+// One character cell. Colors are kDefaultColor, a palette index
+// (kPaletteColor | 0-255) or 24-bit (kRgbColor | 0xRRGGBB).
+struct TerminalCell {
+    static constexpr uint32_t kDefaultColor = 0;
+    static constexpr uint32_t kPaletteColor = 0x01000000;
+    static constexpr uint32_t kRgbColor = 0x02000000;
+
+    enum Attribute : uint16_t {
+        Bold = 1 << 0,
+        Dim = 1 << 1,
+        Italic = 1 << 2,
+        Underline = 1 << 3,
+        Inverse = 1 << 4,
+        Hidden = 1 << 5,
+        Strikethrough = 1 << 6,
+    };
+
+    char32_t ch = U' ';
+    uint32_t foreground = kDefaultColor;
+    uint32_t background = kDefaultColor;
+    uint16_t attributes = 0;
+
+    bool operator==(const TerminalCell& other) const {
+        return ch == other.ch && foreground == other.foreground && background == other.background &&
+               attributes == other.attributes;
+    }
+};
+
+/**
+ * TerminalScreen - the grid a VT stream draws on, with its scrollback
+ *
+ * Rows live in a ring of fixed capacity (the screen plus the scrollback
+ * limit). A line scrolling off the top of the screen becomes history
+ * where it is; once the ring is full the oldest row is recycled as the
+ * new bottom one, so scrolling costs O(1) and allocates nothing however
+ * much output goes by. The alternate screen (full-screen programs) is a
+ * second ring with no scrollback.
+ *
+ * Lines are indexed oldest first: [0, history_size()) is scrollback and
+ * the next rows() lines are the screen. Every character takes one cell;
+ * wide characters are not given two. Rows are cut or padded on resize,
+ * not reflowed.
+ */
+class TerminalScreen : private VtParser::Handler {
+public:
+    struct Row {
+        std::vector<TerminalCell> cells;
+        bool wrapped = false;               // Continues onto the next row
+    };
+
+    TerminalScreen(int columns, int rows, size_t scrollback = kDefaultScrollback);
+
+    TerminalScreen(const TerminalScreen&) = delete;
+    TerminalScreen& operator=(const TerminalScreen&) = delete;
+
+    void feed(const char* data, size_t size);
+    void resize(int columns, int rows);
+    // Full reset; scrollback is dropped as well
+    void reset();
+
+    int columns() const { return columns_; }
+    int rows() const { return rows_; }
+    size_t history_size() const;
+    size_t line_count() const { return history_size() + rows_; }
+    const Row& line(size_t index) const;
+    const Row& screen_row(int row) const { return line(history_size() + row); }
+    // Line as UTF-8, trailing blanks dropped
+    std::string line_text(size_t index) const;
+
+    int cursor_row() const { return cursor_row_; }
+    int cursor_column() const { return cursor_column_ < columns_ ? cursor_column_ : columns_ - 1; }
+    bool cursor_visible() const { return cursor_visible_; }
+    bool alternate_screen() const { return active_ == &alternate_; }
+    const std::string& title() const { return title_; }
+
+    // Bumped by every change, for redraw checks
+    uint64_t generation() const { return generation_; }
+    // Bytes of both screens' rows, scrollback included
+    size_t get_memory_bytes() const;
+    // Drop the main screen's scrollback, keeping what is on screen; it
+    // fills again with new output. Returns the bytes freed.
+    size_t drop_history();
+
+    // Replies the program asked for (cursor position, device attributes),
+    // to be written back to it
+    bool take_responses(std::string& responses);
+
+    static constexpr size_t kDefaultScrollback = 10000;
+
+private:
+    struct Buffer {
+        std::vector<Row> ring;
+        size_t first = 0;                   // Oldest line
+        size_t count = 0;                   // Lines in use, at least rows
+        size_t scrollback = 0;
+    };
+
+    // VtParser::Handler
+    void print_ascii(const char* text, size_t size) override;
+    void print(char32_t ch) override;
+    void execute(uint8_t control) override;
+    void csi_dispatch(const int* params, size_t count, uint8_t marker, uint8_t intermediate,
+                      uint8_t final) override;
+    void esc_dispatch(uint8_t intermediate, uint8_t final) override;
+    void osc_dispatch(const std::string& data) override;
+
+    void init_buffer(Buffer& buffer, size_t scrollback);
+    Row& row(int screen_row);
+    TerminalCell blank() const;
+    void clear_row(Row& row, int from, int to);
+    void put(char32_t ch);
+    void line_feed();
+    void reverse_index();
+    // Moves rows [top, bottom] of the screen up (count > 0) or down
+    void scroll_region(int top, int bottom, int count);
+    void scroll_up(int count);
+    void move_cursor(int row, int column);
+    void set_mode(int mode, bool on, bool private_mode);
+    void select_graphic_rendition(const int* params, size_t count);
+    void switch_screen(bool alternate);
+
+    VtParser parser_;
+    int columns_;
+    int rows_;
+    Buffer main_;
+    Buffer alternate_;
+    Buffer* active_;
+
+    int cursor_row_ = 0;
+    int cursor_column_ = 0;                 // columns_ means a wrap is pending
+    bool cursor_visible_ = true;
+    bool autowrap_ = true;
+    bool origin_mode_ = false;
+    int scroll_top_ = 0;
+    int scroll_bottom_ = 0;
+    TerminalCell pen_;                      // Colors and attributes of new text
+
+    struct SavedCursor {
+        int row = 0;
+        int column = 0;
+        TerminalCell pen;
+        bool origin_mode = false;
+    };
+    SavedCursor saved_;
+    SavedCursor saved_main_;                // Restored leaving the alternate screen
+
+    std::string title_;
+    std::string responses_;
+    uint64_t generation_ = 0;
+};
+
+} // namespace editor
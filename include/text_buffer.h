@@ -0,0 +1,64 @@
+#ifndef TEXT_BUFFER_H
+#define TEXT_BUFFER_H
+
+#include <vector>
+#include <string>
+#include <memory>
+
+namespace editor { class MappedFile; }
+
+/**
+ * TextBufferBackend - storage strategy behind a TextBuffer
+ *
+ * Auto picks by workload: a gap buffer for small files, where edits at the
+ * cursor are a memmove and reads are contiguous; the piece table for
+ * anything larger; and a mapped piece table (open_mapped) for huge,
+ * read-mostly files such as logs. Hex is a fixed-length hex dump of a
+ * binary file (HexBuffer); Auto never picks it.
+ */
+enum class TextBufferBackend { Auto, GapBuffer, PieceTable, Rope, Hex };
+
+/**
+ * TextBuffer - document text storage shared by every backend
+ *
+ * Views and other consumers that only read lines and make plain edits work
+ * against this interface, so the backend can be chosen per file. Offsets
+ * are raw bytes and lines are returned without their terminator (or the
+ * '\r' of CRLF), exactly as PieceTable does.
+ */
+class TextBuffer {
+public:
+    virtual ~TextBuffer() = default;
+    
+    virtual void insert(size_t position, const std::string& text) = 0;
+    virtual void remove(size_t position, size_t length) = 0;
+    // How much one undo step covers is up to the backend (PieceTable
+    // coalesces typing into words)
+    virtual void undo() = 0;
+    virtual void redo() = 0;
+    virtual bool can_undo() const = 0;
+    virtual bool can_redo() const = 0;
+    
+    virtual std::string get_text(size_t start, size_t length) const = 0;
+    virtual std::string get_line(size_t line_number) const = 0;
+    virtual size_t get_line_count() const = 0;
+    virtual size_t get_total_length() const = 0;
+    virtual size_t get_line_start(size_t line_number) const = 0;
+    virtual size_t get_line_at(size_t position) const = 0;
+    virtual std::vector<std::string> get_lines_range(size_t start_line, size_t count) const = 0;
+    
+    virtual TextBufferBackend backend() const = 0;
+    
+    // Files below this size get the gap buffer under Auto
+    static constexpr size_t kSmallFileLimit = 256 * 1024;
+    
+    static TextBufferBackend choose_backend(size_t size);
+    static const char* backend_name(TextBufferBackend backend);
+    // New buffer holding content, with the backend resolved by choose_backend for Auto
+    static std::shared_ptr<TextBuffer> create(const std::string& content,
+                                              TextBufferBackend backend = TextBufferBackend::Auto);
+    // Piece table over a file mapping, indexed in the background - nothing is copied
+    static std::shared_ptr<TextBuffer> open_mapped(std::shared_ptr<editor::MappedFile> mapping);
+};
+
+#endif // TEXT_BUFFER_H
@@ -0,0 +1,40 @@
+#ifndef TEXT_SCAN_H
+#define TEXT_SCAN_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * TextScan - Vectorized byte scanning kernels shared by the text engine
+ *
+ * Newline counting and line-start discovery are the hottest loops when
+ * opening or searching large files. These kernels process 16/32 bytes per
+ * step using SSE2/AVX2 on x86 and NEON on ARM, with a scalar fallback.
+ * The best implementation is selected once at startup.
+ */
+class TextScan {
+public:
+    // Number of '\n' bytes in [data, data + length)
+    static size_t count_newlines(const char* data, size_t length);
+
+    // Append base + offset of every '\n' in [data, data + length) to out
+    static void find_newlines(const char* data, size_t length, size_t base, std::vector<size_t>& out);
+
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    // Offset of the first occurrence of needle in [data, data + length), or
+    // npos. Blocks are tested for the needle's first and last bytes at once
+    // and only those candidates are compared in full, so binary data full
+    // of the first byte (zeros in a core dump) does not slow it down.
+    static size_t find_bytes(const char* data, size_t length, const char* needle, size_t needle_length);
+
+    // Name of the kernel in use ("avx2", "sse2", "neon" or "scalar")
+    static const char* active_kernel();
+
+    // Reference implementations, exposed for tests and benchmarks
+    static size_t count_newlines_scalar(const char* data, size_t length);
+    static void find_newlines_scalar(const char* data, size_t length, size_t base, std::vector<size_t>& out);
+    static size_t find_bytes_scalar(const char* data, size_t length, const char* needle, size_t needle_length);
+};
+
+#endif // TEXT_SCAN_H
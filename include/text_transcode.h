@@ -0,0 +1,60 @@
+#ifndef TEXT_TRANSCODE_H
+#define TEXT_TRANSCODE_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * TextTranscode - Vectorized line-break and encoding kernels for text I/O
+ *
+ * The conversions between how text arrives (files with CRLF or a BOM, the
+ * clipboard's UTF-16) and how the editor keeps it (UTF-8, LF) run over the
+ * whole text on every load, paste and paint. Blocks of 16 bytes are
+ * checked at once with SSE2 on x86 and NEON on ARM, so text that needs no
+ * work - ASCII, or lines without '\r' - is skipped or copied a block at a
+ * time; only the bytes around a '\r' or a multi-byte sequence take the
+ * scalar path.
+ */
+class TextTranscode {
+public:
+    enum class Encoding {
+        UTF8,           // Also plain ASCII, or no BOM at all
+        UTF8_BOM,
+        UTF16LE,
+        UTF16BE
+    };
+
+    struct LineBreaks {
+        size_t lf = 0;          // Lone '\n'
+        size_t crlf = 0;
+        size_t cr = 0;          // Lone '\r'
+    };
+
+    // Encoding announced by a byte order mark, and the mark's length
+    static Encoding detect_bom(const char* data, size_t length, size_t& bom_length);
+
+    // Line breaks of each kind in [data, data + length)
+    static LineBreaks count_line_breaks(const char* data, size_t length);
+
+    // Rewrite every \r\n and lone \r in place as \n; returns the new length
+    static size_t normalize_to_lf(char* data, size_t length);
+    static void normalize_to_lf(std::string& text) { text.resize(normalize_to_lf(&text[0], text.size())); }
+
+    static bool is_valid_utf8(const char* data, size_t length);
+
+    // Decode UTF-8 into out, which must hold length units (UTF-16 never
+    // needs more units than UTF-8 has bytes). Malformed bytes become
+    // U+FFFD, one each. Returns the units written.
+    static size_t utf8_to_utf16(const char* data, size_t length, char16_t* out);
+    static std::u16string utf8_to_utf16(const std::string& text);
+    // Encode UTF-16 as UTF-8; unpaired surrogates become U+FFFD
+    static std::string utf16_to_utf8(const char16_t* data, size_t length);
+    // Zero-extend each byte to one unit (the ASCII path of utf8_to_utf16),
+    // for views whose columns are bytes
+    static void widen_bytes(const char* data, size_t length, char16_t* out);
+
+    // Name of the kernel in use ("sse2", "neon" or "scalar")
+    static const char* active_kernel();
+};
+
+#endif // TEXT_TRANSCODE_H
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <unordered_map>
 #include <windows.h>
@@ -70,6 +71,8 @@ public:
     // Getters
     const ColorScheme& get_colors() const { return current_scheme_; }
     std::string get_current_theme() const { return current_theme_name_; }
+    // Bumped whenever the colors change, for caches built from them
+    uint64_t revision() const { return revision_; }
     std::vector<std::string> get_available_themes() const;
     
     // Built-in themes
@@ -80,6 +83,7 @@ public:
 private:
     ColorScheme current_scheme_;
     std::string current_theme_name_;
+    uint64_t revision_ = 1;
     std::unordered_map<std::string, ColorScheme> built_in_themes_;
     
     void initialize_built_in_themes();
@@ -0,0 +1,204 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * How soon a task should run. Workers take the most urgent class queued;
+ * Background and Idle tasks never hold the last free worker, so
+ * Interactive and Visible work starts at once however much is queued
+ * behind it.
+ */
+enum class TaskPriority : uint8_t {
+    Interactive,    // The user is waiting on it (a keystroke's search)
+    Visible,        // What is on screen (highlighting, a diff being shown)
+    Background,     // Indexing, crawls
+    Idle            // Only when nothing else wants the cores
+};
+
+/**
+ * CancellationToken - a flag a task checks to learn it is no longer wanted
+ *
+ * A default token is never cancelled. A task whose token is cancelled by
+ * the time a worker takes it is dropped without running; one already
+ * running polls cancelled() at convenient points.
+ */
+class CancellationToken {
+public:
+    CancellationToken() = default;
+    bool cancelled() const { return flag_ && flag_->load(std::memory_order_relaxed); }
+
+private:
+    friend class CancellationSource;
+    explicit CancellationToken(std::shared_ptr<std::atomic<bool>> flag) : flag_(std::move(flag)) {}
+    std::shared_ptr<std::atomic<bool>> flag_;
+};
+
+// Hands out tokens and cancels them all at once
+class CancellationSource {
+public:
+    CancellationSource() : flag_(std::make_shared<std::atomic<bool>>(false)) {}
+    CancellationToken token() const { return CancellationToken(flag_); }
+    void cancel() { flag_->store(true, std::memory_order_relaxed); }
+    bool cancelled() const { return flag_->load(std::memory_order_relaxed); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag_;
+};
+
+/**
+ * ThreadPool - fixed set of workers with per-worker queues and work stealing
+ *
+ * Each worker owns a deque per priority class. Tasks submitted from a
+ * worker go to the back of its own deque and are popped LIFO, so recursive
+ * work (a directory task spawning its children) stays cache-warm on one
+ * core; idle workers steal from the front of the other deques, taking the
+ * oldest and usually largest pieces of work. Tasks submitted from outside
+ * are spread round robin. A worker looks for the most urgent class first,
+ * at home and then by stealing, before it considers the next one. The
+ * destructor runs every queued task before joining.
+ *
+ * shared() is the pool the editor's subsystems use, so together they
+ * never ask for more threads than there are cores; TaskGroup waits for
+ * one subsystem's tasks in it, and MainThreadQueue carries results back
+ * to the UI thread.
+ */
+class ThreadPool {
+public:
+    static constexpr size_t kPriorities = 4;
+
+    // threads == 0 sizes the pool to the machine
+    explicit ThreadPool(size_t threads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // The process-wide pool, sized to the machine and started on first use
+    static ThreadPool& shared();
+
+    void submit(std::function<void()> task, TaskPriority priority = TaskPriority::Visible,
+                CancellationToken cancel = CancellationToken());
+
+    // Block until every submitted task has finished. Must not be called
+    // from a task.
+    void wait_idle();
+
+    size_t size() const { return workers_.size(); }
+
+    // Index of the calling worker in [0, size()), or npos off the pool
+    size_t current_worker() const;
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+private:
+    struct Task {
+        std::function<void()> run;
+        CancellationToken cancel;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks[kPriorities];
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    std::atomic<size_t> queued_urgent_{0};  // Interactive and Visible tasks waiting in some deque
+    std::atomic<size_t> queued_low_{0};     // Background and Idle ones
+    std::atomic<size_t> running_low_{0};    // Background and Idle tasks taken by a worker
+    size_t low_limit_ = 1;                  // Workers they may hold at once
+    std::atomic<size_t> pending_{0};        // Submitted and not yet finished
+    std::atomic<size_t> next_queue_{0};
+    bool stopping_ = false;
+
+    static bool is_low(size_t priority) { return priority >= static_cast<size_t>(TaskPriority::Background); }
+    bool runnable() const;
+    void worker_loop(size_t index);
+    bool try_pop(size_t index, Task& task, bool& low);
+    bool pop_class(size_t index, size_t priority, Task& task);
+};
+
+/**
+ * TaskGroup - tasks submitted together, to wait for just them
+ *
+ * On a pool shared with other subsystems wait_idle would wait for their
+ * work too. wait() must not be called from one of the group's own tasks;
+ * the destructor waits.
+ */
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool = ThreadPool::shared()) : pool_(pool) {}
+    ~TaskGroup() { wait(); }
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    // A cancelled task counts as finished without running
+    void submit(std::function<void()> task, TaskPriority priority = TaskPriority::Visible,
+                CancellationToken cancel = CancellationToken());
+    void wait();
+    ThreadPool& pool() const { return pool_; }
+
+private:
+    ThreadPool& pool_;
+    std::mutex mutex_;
+    std::condition_variable done_;
+    size_t pending_ = 0;
+};
+
+/**
+ * MainThreadQueue - continuations for the UI thread
+ *
+ * Any thread posts; the UI thread runs them in drain(). notify is called
+ * (on the posting thread) when the queue goes from empty to not, to wake
+ * the UI thread - the window posts itself a message and drains there.
+ */
+class MainThreadQueue {
+public:
+    void set_notify(std::function<void()> notify);
+    void post(std::function<void()> task);
+    // Run what has been posted, in order; returns how many ran
+    size_t drain();
+
+private:
+    std::mutex mutex_;
+    std::vector<std::function<void()>> tasks_;
+    std::function<void()> notify_;
+};
+
+// work() on a ThreadPool or TaskGroup, then then(result) on the UI thread;
+// neither runs once cancel is cancelled. work may return void, and then
+// takes nothing. A TaskGroup lets the owner of ui wait out work in flight.
+template <typename Executor, typename Work, typename Then>
+void run_then(Executor& executor, MainThreadQueue& ui, Work work, Then then,
+              TaskPriority priority = TaskPriority::Visible, CancellationToken cancel = CancellationToken()) {
+    executor.submit([&ui, work = std::move(work), then = std::move(then), cancel]() mutable {
+        if constexpr (std::is_void_v<decltype(work())>) {
+            work();
+            if (cancel.cancelled()) return;
+            ui.post([then = std::move(then), cancel]() mutable {
+                if (!cancel.cancelled()) then();
+            });
+        } else {
+            auto result = std::make_shared<decltype(work())>(work());
+            if (cancel.cancelled()) return;
+            ui.post([then = std::move(then), cancel, result]() mutable {
+                if (!cancel.cancelled()) then(std::move(*result));
+            });
+        }
+    }, priority, cancel);
+}
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,131 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace editor {
+
+/**
+ * Tracer - spans and counters from hot paths, exported as a Chrome trace
+ *
+ * Each thread records into a ring buffer of its own, so recording takes
+ * no shared lock (the buffer's mutex only meets the exporter) and a busy
+ * thread overwrites its oldest events rather than growing. While tracing
+ * is off, a span costs one relaxed atomic load. write_chrome_trace()
+ * emits the Trace Event JSON that chrome://tracing and ui.perfetto.dev
+ * open directly.
+ *
+ * Names and categories must be string literals (they are kept by pointer);
+ * anything built at run time goes in a span's detail.
+ */
+class Tracer {
+public:
+    struct Event {
+        const char* category = nullptr;
+        const char* name = nullptr;
+        char phase = 'X';           // 'X' span, 'C' counter
+        uint64_t start_ns = 0;      // Since the tracer's origin
+        uint64_t duration_ns = 0;
+        int64_t value = 0;          // Counters
+        std::string detail;
+    };
+
+    static Tracer& instance();
+
+    // Begin recording; buffers made from here on hold events_per_thread
+    void start(size_t events_per_thread = 1 << 16);
+    void stop();
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+    // Drop everything recorded so far
+    void clear();
+
+    static uint64_t now_ns();
+    void record(Event&& event);
+    // Shown as the calling thread's name in the viewer
+    void set_thread_name(const std::string& name);
+
+    // Recorded events, oldest first per thread, paired with a thread id
+    std::vector<std::pair<uint32_t, Event>> snapshot() const;
+    void write_chrome_trace(std::ostream& out) const;
+    bool export_chrome_trace(const std::string& path) const;
+
+private:
+    struct ThreadBuffer {
+        uint32_t tid = 0;
+        std::string thread_name;
+        mutable std::mutex mutex;
+        std::vector<Event> events;
+        uint64_t written = 0;       // Ever recorded; the ring holds the newest
+    };
+
+    Tracer() = default;
+    ThreadBuffer& buffer();
+
+    static std::atomic<bool> enabled_;
+    std::atomic<size_t> capacity_{1 << 16};
+    mutable std::mutex registry_mutex_;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+};
+
+/**
+ * TraceScope - records a span from construction to destruction
+ */
+class TraceScope {
+public:
+    TraceScope(const char* category, const char* name) {
+        if (Tracer::enabled()) {
+            category_ = category;
+            name_ = name;
+            start_ns_ = Tracer::now_ns();
+        }
+    }
+    ~TraceScope();
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    bool active() const { return name_ != nullptr; }
+    void set_detail(std::string detail) { detail_ = std::move(detail); }
+
+private:
+    const char* category_ = nullptr;
+    const char* name_ = nullptr;
+    uint64_t start_ns_ = 0;
+    std::string detail_;
+};
+
+inline void trace_counter(const char* category, const char* name, int64_t value) {
+    if (!Tracer::enabled()) return;
+    Tracer::Event event;
+    event.category = category;
+    event.name = name;
+    event.phase = 'C';
+    event.start_ns = Tracer::now_ns();
+    event.value = value;
+    Tracer::instance().record(std::move(event));
+}
+
+} // namespace editor
+
+// Instrumentation points. Building with DISABLE_TRACING compiles them out,
+// detail expressions included; otherwise a detail is only evaluated while
+// tracing is on. Each scope macro declares a variable, so it must stand
+// as a statement of its own block.
+#define EDITOR_TRACE_CONCAT_(a, b) a##b
+#define EDITOR_TRACE_CONCAT(a, b) EDITOR_TRACE_CONCAT_(a, b)
+#ifdef DISABLE_TRACING
+#define EDITOR_TRACE_SCOPE(category, name) ((void)0)
+#define EDITOR_TRACE_SCOPE_DETAIL(category, name, detail) ((void)0)
+#define EDITOR_TRACE_COUNTER(category, name, value) ((void)0)
+#else
+#define EDITOR_TRACE_SCOPE(category, name) \
+    ::editor::TraceScope EDITOR_TRACE_CONCAT(trace_scope_, __LINE__)(category, name)
+#define EDITOR_TRACE_SCOPE_DETAIL(category, name, detail) \
+    ::editor::TraceScope EDITOR_TRACE_CONCAT(trace_scope_, __LINE__)(category, name); \
+    if (EDITOR_TRACE_CONCAT(trace_scope_, __LINE__).active()) EDITOR_TRACE_CONCAT(trace_scope_, __LINE__).set_detail(detail)
+#define EDITOR_TRACE_COUNTER(category, name, value) ::editor::trace_counter(category, name, value)
+#endif
@@ -7,6 +7,7 @@
 #include <unordered_map>
 
 #include <windows.h>
+#include "piece_table.h"
 
 struct Token; // forward from syntax_highlighter.h
 
@@ -24,9 +25,26 @@ public:
     // Initialize parser for given language, returns true if supported and backend available
     bool initialize(const std::string& lang_id);
 
-    // Incrementally (re)parse full text. For simplicity, we accept full text for now.
+    // Parse full text from a copy of the lines (full reparse every call)
     void set_document_text(const std::vector<std::string>& lines);
 
+    // Parse a document in place - the parser reads straight from the piece
+    // table through a TSInput callback, so no joined copy is made. The
+    // document must outlive the bridge or be replaced before destruction.
+    void set_document(const PieceTable* document);
+
+    // Line range [first, last) whose tokens may differ after an edit
+    struct LineRange {
+        size_t first;
+        size_t last;
+    };
+
+    // Incremental reparse after an edit to the bound document (call from its
+    // change listener). Edits the old tree with ts_tree_edit, reparses against
+    // it and appends the lines to refresh: the edited lines plus every range
+    // Tree-sitter reports as structurally changed.
+    void apply_edit(const PieceTable::Change& change, std::vector<LineRange>& changed_lines);
+
     // Tokenize a single line using the parse tree. Returns true if tokens were produced by TS.
     bool get_line_tokens(size_t line_index, std::vector<Token>& out_tokens) const;
 
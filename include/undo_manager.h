@@ -3,7 +3,11 @@
 
 #include <string>
 #include <vector>
+#include <deque>
 #include <memory>
+#include "piece_table.h"
+
+namespace editor { class InternalClipboard; }
 
 /**
  * Command represents a single text editing operation that can be undone/redone
@@ -14,10 +18,17 @@ public:
     virtual void execute() = 0;
     virtual void undo() = 0;
     virtual void redo() { execute(); }
+    
+    // Document whose own history records this edit. UndoManager then keeps
+    // no copy of the command and undoes through the document instead.
+    virtual PieceTable* document() const { return nullptr; }
 };
 
 /**
  * InsertCommand - Represents text insertion that can be undone
+ *
+ * The text is only held until execute(); afterwards it lives in the
+ * document's add buffer and the document's history references it there.
  */
 class InsertCommand : public Command {
 public:
@@ -26,6 +37,7 @@ public:
     
     void execute() override;
     void undo() override;
+    PieceTable* document() const override { return document_; }
     
 private:
     PieceTable* document_;
@@ -35,54 +47,126 @@ private:
 
 /**
  * DeleteCommand - Represents text deletion that can be undone
+ *
+ * The document records the removed pieces (PieceTable::Span), so deleting
+ * a huge region costs O(pieces) memory and no text copy.
  */
 class DeleteCommand : public Command {
 public:
     DeleteCommand(class PieceTable* doc, size_t pos, size_t len)
-        : document_(doc), position_(pos), length_(len), deleted_text_() {}
+        : document_(doc), position_(pos), length_(len) {}
     
     void execute() override;
     void undo() override;
+    PieceTable* document() const override { return document_; }
     
 private:
     PieceTable* document_;
     size_t position_;
     size_t length_;
-    std::string deleted_text_;
+};
+
+/**
+ * MultiEditCommand - Replacements at many places (multi-cursor typing),
+ * applied by PieceTable::apply_edits as one undo step
+ *
+ * The edits are sorted, non-overlapping and in pre-edit coordinates; the
+ * texts are released after execute() like InsertCommand's.
+ */
+class MultiEditCommand : public Command {
+public:
+    MultiEditCommand(class PieceTable* doc, std::vector<PieceTable::Edit> edits)
+        : document_(doc), edits_(std::move(edits)) {}
+    
+    void execute() override;
+    void undo() override;
+    PieceTable* document() const override { return document_; }
+    
+private:
+    PieceTable* document_;
+    std::vector<PieceTable::Edit> edits_;
+};
+
+/**
+ * PasteCommand - Inserts the internal clipboard's pieces (see
+ * InternalClipboard::paste), so pasting copies no text
+ *
+ * The clipboard only has to outlive execute(); redo goes through the
+ * document's history like the other commands.
+ */
+class PasteCommand : public Command {
+public:
+    PasteCommand(class PieceTable* doc, size_t pos, const editor::InternalClipboard& clipboard)
+        : document_(doc), position_(pos), clipboard_(&clipboard) {}
+    
+    void execute() override;
+    void undo() override;
+    PieceTable* document() const override { return document_; }
+    
+private:
+    PieceTable* document_;
+    size_t position_;
+    const editor::InternalClipboard* clipboard_;
 };
 
 /**
  * UndoManager - Manages undo/redo stack with configurable depth
+ *
+ * Document edits are recorded once, by the PieceTable's transactional
+ * history; a step here only remembers which document to undo. Commands
+ * that don't belong to a document are kept and undone themselves. The
+ * oldest steps are dropped from the front of a deque in O(1).
  */
 class UndoManager {
 public:
-    explicit UndoManager(size_t max_depth = 1000) 
-        : current_index_(0), max_depth_(max_depth) {}
+    explicit UndoManager(size_t max_depth = 1000)
+        : current_index_(0), max_depth_(max_depth), transaction_(nullptr),
+          transaction_serial_(0), transaction_depth_(0) {}
+    
+    // Execute and add command to history. A mergeable command (a keystroke)
+    // joins the previous mergeable one when the document can coalesce them,
+    // so a typed word undoes in one step.
+    void execute(std::unique_ptr<Command> cmd, bool mergeable = false);
+    // End the current keystroke group (e.g. the cursor was moved)
+    void break_group();
     
-    // Execute and add command to history
-    void execute(std::unique_ptr<Command> cmd);
+    // Every command on doc until commit becomes one atomic undo step
+    // (multi-cursor typing, replace all). Nestable.
+    void begin_transaction(PieceTable* doc);
+    void commit_transaction();
     
     // Undo/redo operations
     bool can_undo() const { return current_index_ > 0; }
-    bool can_redo() const { return current_index_ < commands_.size(); }
+    bool can_redo() const { return current_index_ < steps_.size(); }
     
     void undo();
     void redo();
     
     // Clear history
     void clear() {
-        commands_.clear();
+        steps_.clear();
         current_index_ = 0;
     }
     
     size_t get_undo_count() const { return current_index_; }
-    size_t get_redo_count() const { return commands_.size() - current_index_; }
+    size_t get_redo_count() const { return steps_.size() - current_index_; }
+    // Bytes of the step records; document edits' history is the document's
+    size_t get_memory_bytes() const { return steps_.size() * sizeof(Step); }
     
 private:
-    std::vector<std::unique_ptr<Command>> commands_;
+    struct Step {
+        PieceTable* document;               // Undo through its history, or
+        std::unique_ptr<Command> command;   // a command without a document
+    };
+    
+    std::deque<Step> steps_;
     size_t current_index_;
     size_t max_depth_;
+    PieceTable* transaction_;
+    size_t transaction_serial_;
+    size_t transaction_depth_;
     
+    void push_step(Step step);
     void trim_to_depth();
 };
 
@@ -1,47 +1,145 @@
 #ifndef VIEWPORT_H
 #define VIEWPORT_H
 
-#include "piece_table.h"
+#include "text_buffer.h"
+#include <memory>
 #include <vector>
 #include <string>
 
+class CodeFoldingManager;
+namespace editor { class ColumnLayout; class WrapLayout; }
+
+// One screen row: a slice of a document line
+struct ViewRow {
+    size_t line = 0;            // Document line
+    size_t column = 0;          // Byte column of the line where the row starts
+    bool continues = false;     // Soft wrap: the line goes on in the next row
+    std::string text;           // At most visible_columns display columns from column
+};
+
 /**
  * Viewport - Virtual scrolling renderer
  * 
  * Only renders visible lines to maintain 60fps even with million-line files
  * This is the key to zero-latency scrolling in large projects
+ *
+ * With a CodeFoldingManager attached, scrolling works in display lines:
+ * folded lines take no row, so a screen always shows visible_lines lines
+ * and moving past 10k folds costs two O(log folds) lookups. The top line
+ * is still kept (and reported) as a document line.
+ *
+ * Rows never materialize a whole line: each is a bounded get_text read
+ * starting at its column, so a megabyte-long line costs a screen width.
+ * Without soft wrap a row starts at the left column (horizontal scroll)
+ * and is cut at the width in display columns, as the ColumnLayout the
+ * view shares with its painter counts them (tabs, wide characters).
+ * With soft wrap a line takes as many rows as its WrapLayout says, the
+ * top may be any row of a line, and scrolling counts rows; wrap offsets
+ * are only computed for lines it passes.
  */
 class Viewport {
 public:
     Viewport(size_t visible_lines, size_t visible_columns);
+    ~Viewport();
+    
+    Viewport(const Viewport&) = delete;
+    Viewport& operator=(const Viewport&) = delete;
     
     // Set the document to display
-    void set_document(std::shared_ptr<PieceTable> document);
+    void set_document(std::shared_ptr<TextBuffer> document);
     
-    // Scrolling operations - O(1) complexity
+    // What showing one document has built up: its scroll position and the
+    // wrap offsets computed so far (the layout keeps following edits)
+    struct State {
+        State();
+        ~State();
+        State(State&&);
+        State& operator=(State&&);
+        
+        std::shared_ptr<TextBuffer> document;
+        size_t top_line = 0;
+        size_t top_row = 0;
+        size_t left_column = 0;
+        std::unique_ptr<editor::WrapLayout> wrap;
+        std::unique_ptr<editor::ColumnLayout> columns;
+    };
+    // Hand the current document's state over and show nothing; a later
+    // restore_state() shows it again without scrolling or wrapping anew
+    State take_state();
+    // A wrap layout is made or dropped to match the current soft-wrap mode
+    void restore_state(State state);
+    // Folds to skip (not owned; nullptr shows every line)
+    void set_folding(const CodeFoldingManager* folding) { folding_ = folding; }
+    // Screen size in rows and display columns; the wrap width follows the columns
+    void set_size(size_t visible_lines, size_t visible_columns);
+    
+    void set_soft_wrap(bool enabled);
+    bool is_soft_wrap() const { return wrap_ != nullptr; }
+    // Display columns of the current document's lines, for painting,
+    // hit testing and caret movement
+    editor::ColumnLayout& column_layout() const { return *columns_; }
+    void set_tab_width(size_t tab_width);
+    
+    // First column shown when not wrapping
+    void set_left_column(size_t column) { left_column_ = column; }
+    size_t get_left_column() const { return left_column_; }
+    
+    // Scrolling operations - O(1) complexity; soft wrap scrolls by rows
     void scroll_up(size_t lines = 1);
     void scroll_down(size_t lines = 1);
     void scroll_to_line(size_t line);
+    // Last screenful; and whether the last line is on screen (a followed
+    // log keeps scrolling only while it is)
+    void scroll_to_end();
+    bool is_at_end() const;
     
-    // Get current visible content
+    // Get current visible content: one row per screen row
+    std::vector<ViewRow> get_visible_rows() const;
     std::vector<std::string> get_visible_lines() const;
+    // Document line of each row get_visible_lines() returns
+    std::vector<size_t> get_visible_line_numbers() const;
     
     // Viewport properties
-    size_t get_top_line() const { return top_line_; }
+    size_t get_top_line() const;            // Document line on the first row
+    size_t get_top_row() const { return wrap_ ? top_row_ : 0; }    // Its row, under soft wrap
+    size_t get_top_display_line() const;
+    size_t get_display_line_count() const;  // Document lines minus folded ones
     size_t get_visible_line_count() const { return visible_lines_; }
     
+    // Document line on screen row `row` (may be past the document's end)
+    size_t document_line_at(size_t row) const;
+    // Line and starting column of screen row `row`; false past the document
+    bool row_position(size_t row, size_t& line, size_t& column) const;
+    // Screen row showing a byte column of a document line; SIZE_MAX above
+    // the top, and a folded line shares its header's row
+    size_t row_of_line(size_t line, size_t column = 0) const;
+    
     // Performance metrics
     double get_last_render_time_ms() const { return last_render_time_ms_; }
     
 private:
-    std::shared_ptr<PieceTable> document_;
+    std::shared_ptr<TextBuffer> document_;
+    const CodeFoldingManager* folding_ = nullptr;
     size_t top_line_;
+    size_t top_row_ = 0;        // Soft wrap: row of top_line_ on the first screen row
+    size_t left_column_ = 0;
     size_t visible_lines_;
     size_t visible_columns_;
+    std::unique_ptr<editor::WrapLayout> wrap_;
+    std::unique_ptr<editor::ColumnLayout> columns_;
     
     double last_render_time_ms_;
     
     void clamp_scroll_position();
+    size_t to_display(size_t line) const;
+    size_t to_document(size_t display_line) const;
+    size_t next_line(size_t line) const;     // Next unfolded line
+    size_t prev_line(size_t line) const;     // Previous unfolded line (line > 0)
+    // Line and column of up to count rows from the top, without their text
+    void layout_rows(size_t count, std::vector<ViewRow>& rows) const;
+    // Up to length bytes of line from column; max_columns > 0 also cuts
+    // the text at that many display columns
+    std::string read_row(size_t line, size_t column, size_t length, size_t max_columns) const;
 };
 
 #endif // VIEWPORT_H
@@ -0,0 +1,104 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace editor {
+
+/**
+ * VtParser - table-driven parser for the VT/xterm control sequences
+ *
+ * Follows the DEC state machine (Paul Williams' description, as xterm and
+ * most emulators do): every byte is looked up in a table by the current
+ * state, which yields the action to take and the next state, so there is
+ * no branching on sequence syntax. Text in the ground state is UTF-8; 8-bit
+ * C1 controls are not recognised, as in a UTF-8 xterm. Runs of printable
+ * ASCII go to the handler in one call, which is what keeps a terminal
+ * fed a large log cheap.
+ *
+ * CSI parameters are numbers separated by ';' or ':' (colon subparameters
+ * are flattened); 0 stands for a missing one. Sequences that overflow the
+ * parameter list are still dispatched with what fit.
+ */
+class VtParser {
+public:
+    class Handler {
+    public:
+        virtual ~Handler() = default;
+        // Printable ASCII, size > 0
+        virtual void print_ascii(const char* text, size_t size) = 0;
+        // A decoded non-ASCII character (U+FFFD for malformed UTF-8)
+        virtual void print(char32_t ch) = 0;
+        // C0 control: BS, HT, LF, CR, ...
+        virtual void execute(uint8_t control) = 0;
+        // ESC [ <marker> <params> <intermediate> <final>; marker is one of
+        // "<=>?" or 0, intermediate the last of 0x20-0x2F or 0
+        virtual void csi_dispatch(const int* params, size_t count, uint8_t marker, uint8_t intermediate,
+                                  uint8_t final) = 0;
+        // ESC <intermediate> <final>
+        virtual void esc_dispatch(uint8_t intermediate, uint8_t final) = 0;
+        // ESC ] <data> BEL (or ST)
+        virtual void osc_dispatch(const std::string& data) { (void)data; }
+    };
+
+    explicit VtParser(Handler& handler);
+
+    void feed(const char* data, size_t size);
+    // Back to the ground state, dropping any partial sequence
+    void reset();
+
+    static constexpr size_t kMaxParams = 16;
+    static constexpr size_t kMaxOscLength = 4096;
+
+private:
+    enum State : uint8_t {
+        Ground,
+        Escape,
+        EscapeIntermediate,
+        CsiEntry,
+        CsiParam,
+        CsiIntermediate,
+        CsiIgnore,
+        OscString,
+        IgnoreString,           // DCS, SOS, PM and APC: skipped up to ST
+        kStateCount
+    };
+    enum Action : uint8_t {
+        None,
+        Print,
+        Utf8,
+        Execute,
+        Clear,
+        Collect,
+        Param,
+        EscDispatch,
+        CsiDispatch,
+        OscPut,
+        OscEnd,
+    };
+    struct Transition {
+        uint8_t action;
+        uint8_t next;
+    };
+    using Table = Transition[kStateCount][256];
+
+    static const Table& table();
+    void perform(Action action, uint8_t byte);
+    void print_utf8(uint8_t byte);
+
+    Handler& handler_;
+    State state_ = Ground;
+
+    int params_[kMaxParams];
+    size_t param_count_ = 0;            // Parameters started so far
+    bool param_overflow_ = false;       // Past kMaxParams; the rest is dropped
+    uint8_t marker_ = 0;
+    uint8_t intermediate_ = 0;
+    std::string osc_;
+
+    char32_t utf8_code_ = 0;
+    int utf8_remaining_ = 0;            // Continuation bytes still expected
+    char32_t utf8_min_ = 0;             // Smallest code point the length allows
+};
+
+} // namespace editor
@@ -0,0 +1,96 @@
+#ifndef WASM_ENGINE_H
+#define WASM_ENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace editor {
+
+// Which WebAssembly implementation runs a plugin
+enum class WasmEngineKind : uint8_t {
+    Interpreter,    // wasm3: loads at once, slowest calls
+    Compiled        // WAMR: wamrc AOT modules, or plain .wasm through its JIT
+};
+
+// "interpreter" / "compiled", as in a module's velocity.engine section
+inline const char* wasm_engine_name(WasmEngineKind kind) {
+    return kind == WasmEngineKind::Compiled ? "compiled" : "interpreter";
+}
+
+inline bool parse_wasm_engine(const std::string& name, WasmEngineKind& kind) {
+    if (name == "interpreter") {
+        kind = WasmEngineKind::Interpreter;
+    } else if (name == "compiled") {
+        kind = WasmEngineKind::Compiled;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+enum class WasmValueType : uint8_t { I32, I64, F32, F64 };
+
+union WasmValue {
+    int32_t i32;
+    int64_t i64;
+    float f32;
+    double f64;
+};
+
+/**
+ * WasmEngine - one WebAssembly implementation behind WasmRuntime
+ *
+ * An engine holds an instantiated module and calls into it with values
+ * already in their parameter types. WasmRuntime does the rest - name
+ * lookup and handle caching, argument conversion and checking, error
+ * text - so a plugin behaves the same whichever engine runs it. An
+ * engine is used from one thread at a time.
+ */
+class WasmEngine {
+public:
+    static constexpr uint32_t kMaxArgs = 16;
+
+    // A resolved export; native is the engine's own function object
+    struct Function {
+        void* native = nullptr;
+        const char* name = "";
+        uint32_t arg_count = 0;
+        uint32_t result_count = 0;
+        WasmValueType arg_types[kMaxArgs] = {};
+        WasmValueType result_type = WasmValueType::I32;
+    };
+
+    virtual ~WasmEngine() = default;
+
+    virtual WasmEngineKind kind() const = 0;
+    virtual bool initialize(size_t stack_size_bytes) = 0;
+    // Keeps its own copy of the bytes if it needs them after loading
+    virtual bool load(const uint8_t* bytes, size_t size) = 0;
+    // Exported function names of the loaded modules
+    virtual void exports(std::vector<std::string>& names) const = 0;
+    // Fills everything but name
+    virtual bool resolve(const std::string& name, Function& function) = 0;
+    // args holds function.arg_count values; result is written if the
+    // function returns one
+    virtual bool call(const Function& function, const WasmValue* args, WasmValue* result) = 0;
+    // Bytes [offset, offset + size) of linear memory, or nullptr
+    virtual uint8_t* memory_region(uint32_t offset, uint32_t size) = 0;
+    // Linear memory, stacks and module bytes
+    virtual size_t memory_usage() const = 0;
+
+    const std::string& error() const { return error_; }
+
+protected:
+    std::string error_;
+};
+
+// nullptr when kind is not built in (the compiled engine needs WAMR)
+std::unique_ptr<WasmEngine> make_wasm_engine(WasmEngineKind kind);
+bool wasm_engine_available(WasmEngineKind kind);
+
+} // namespace editor
+
+#endif // WASM_ENGINE_H
@@ -5,19 +5,36 @@
 #include <memory>
 #include <vector>
 #include <functional>
-
-// Forward declarations for wasm3 types
-struct M3Environment;
-struct M3Runtime;
-struct M3Module;
-struct M3Function;
+#include <unordered_map>
+#include <cstdint>
+#include "wasm_engine.h"
 
 namespace editor {
 
-// WASM runtime wrapper using wasm3
+/**
+ * WasmRuntime - runs a plugin's WebAssembly module on a WasmEngine
+ *
+ * The engine is the wasm3 interpreter, or with WAMR built in (ENABLE_WAMR)
+ * compiled code for plugins that ask for it: formatters and linters spend
+ * their time in loops the interpreter runs many times slower than native.
+ * The compiled engine loads "<name>.aot" (built by wamrc) next to the
+ * .wasm when there is one, else JIT-compiles the .wasm. Without WAMR a
+ * request for it falls back to the interpreter; engine() tells which runs.
+ *
+ * Exports are resolved (and compiled) once, when their module loads, into
+ * FunctionHandles that carry the signature. A call through a handle passes
+ * its arguments to the engine as typed binary values: no lookup by name and
+ * no formatting to strings and back, which matters for handlers that run on
+ * every keystroke. call_function() by name is a hash lookup in that cache.
+ */
 class WasmRuntime {
 public:
-    WasmRuntime();
+    static constexpr uint32_t kMaxArgs = WasmEngine::kMaxArgs;
+
+    // A resolved function; valid until reset()
+    using FunctionHandle = WasmEngine::Function;
+
+    explicit WasmRuntime(WasmEngineKind engine = WasmEngineKind::Interpreter);
     ~WasmRuntime();
 
     // Disable copy
@@ -33,9 +50,22 @@ public:
     // Load WASM module from memory
     bool load_module_from_memory(const uint8_t* wasm_bytes, size_t size);
     
+    // Cached handle of a function, resolving names not exported at load
+    // time on first use; nullptr when there is no such function
+    const FunctionHandle* find_function(const std::string& func_name);
+    
+    // Calls through a handle. Arguments and the result are converted to
+    // and from the function's parameter types (i32, i64, f32, f64).
+    bool call(const FunctionHandle& function, const int64_t* args, size_t arg_count, int64_t* result = nullptr);
+    
     // Find and call exported function
     bool call_function(const std::string& func_name, const std::vector<int64_t>& args, int64_t* result = nullptr);
     
+    // Bytes [offset, offset + size) of the module's linear memory: where a
+    // host function reads or fills a region the plugin passed it. nullptr
+    // when out of bounds; valid until the memory grows.
+    uint8_t* memory_region(uint32_t offset, uint32_t size);
+    
     // Link host function (C++ function callable from WASM)
     using HostFunction = std::function<int64_t(const std::vector<int64_t>&)>;
     bool link_host_function(const std::string& module_name, const std::string& func_name, HostFunction func);
@@ -44,18 +74,25 @@ public:
     const std::string& get_error() const { return error_message_; }
     
     // Check if runtime is initialized
-    bool is_initialized() const { return runtime_ != nullptr; }
+    bool is_initialized() const { return engine_ != nullptr; }
+    
+    // The engine running the module: the one asked for, unless it is not built in
+    WasmEngineKind engine() const { return engine_ ? engine_->kind() : requested_; }
+    
+    // Linear memory, stacks and module bytes (or compiled code)
+    size_t get_memory_usage() const;
     
     // Reset runtime (unload all modules)
     void reset();
     
 private:
-    M3Environment* env_;
-    M3Runtime* runtime_;
-    M3Module* module_;
+    WasmEngineKind requested_;
+    std::unique_ptr<WasmEngine> engine_;
+    bool has_module_ = false;
     std::string error_message_;
-    size_t stack_size_;
+    std::unordered_map<std::string, FunctionHandle> functions_;
     
+    bool resolve(const std::string& func_name, FunctionHandle& handle);
     void set_error(const std::string& error);
 };
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <map>
@@ -14,6 +15,7 @@ struct FileState {
     std::string path;
     size_t cursor_pos = 0;
     size_t scroll_offset = 0;
+    uint64_t last_active = 0;   // Larger was active more recently; orders the restore
     
     FileState() = default;
     FileState(const std::string& p, size_t cursor = 0, size_t scroll = 0)
@@ -68,7 +70,10 @@ public:
     
     // Recent files (MRU - Most Recently Used)
     void add_recent_file(const std::string& filepath);
+    // Entries are not checked against the disk when loaded (startup would
+    // stat every one); whoever opens a stale one removes it
     const std::vector<std::string>& get_recent_files() const { return recent_files_; }
+    void remove_recent_file(const std::string& filepath);
     void clear_recent_files();
     
     // Recent workspaces
@@ -204,7 +209,8 @@ inline bool WorkspaceState::save(const std::string& filepath) const {
         file << "    {\n";
         file << "      \"path\": \"" << escape(f.path) << "\",\n";
         file << "      \"cursor_pos\": " << f.cursor_pos << ",\n";
-        file << "      \"scroll_offset\": " << f.scroll_offset << "\n";
+        file << "      \"scroll_offset\": " << f.scroll_offset << ",\n";
+        file << "      \"last_active\": " << f.last_active << "\n";
         file << "    }";
         if (i < open_files.size() - 1) file << ",";
         file << "\n";
@@ -282,6 +288,12 @@ inline bool WorkspaceState::load(const std::string& filepath) {
                     current_file.scroll_offset = std::stoull(line.substr(pos + 1));
                 }
             }
+            else if (line.find("\"last_active\":") != std::string::npos) {
+                size_t pos = line.find(':');
+                if (pos != std::string::npos) {
+                    current_file.last_active = std::stoull(line.substr(pos + 1));
+                }
+            }
             else if (line.find('}') != std::string::npos && !current_file.path.empty()) {
                 open_files.push_back(current_file);
                 current_file = FileState();
@@ -334,6 +346,13 @@ inline void WorkspaceManager::add_recent_file(const std::string& filepath) {
     save_recent_lists();
 }
 
+inline void WorkspaceManager::remove_recent_file(const std::string& filepath) {
+    auto it = std::find(recent_files_.begin(), recent_files_.end(), filepath);
+    if (it == recent_files_.end()) return;
+    recent_files_.erase(it);
+    save_recent_lists();
+}
+
 inline void WorkspaceManager::add_recent_workspace(const std::string& workspace_dir) {
     // Normalize path
     std::string normalized = fs::absolute(workspace_dir).string();
@@ -409,7 +428,7 @@ inline bool WorkspaceManager::load_recent_lists() {
         if (file.is_open()) {
             std::string line;
             while (std::getline(file, line) && recent_files_.size() < MAX_RECENT_FILES) {
-                if (!line.empty() && fs::exists(line)) {
+                if (!line.empty()) {
                     recent_files_.push_back(line);
                 }
             }
@@ -422,7 +441,7 @@ inline bool WorkspaceManager::load_recent_lists() {
         if (file.is_open()) {
             std::string line;
             while (std::getline(file, line) && recent_workspaces_.size() < MAX_RECENT_WORKSPACES) {
-                if (!line.empty() && fs::exists(line)) {
+                if (!line.empty()) {
                     recent_workspaces_.push_back(line);
                 }
             }
@@ -0,0 +1,82 @@
+#ifndef WORKSPACE_REPLACE_H
+#define WORKSPACE_REPLACE_H
+
+#include "find_dialog.h"
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class BackgroundIndexer;
+class PieceTable;
+namespace editor { class MappedFile; }
+
+/**
+ * WorkspaceReplace - find and replace across the workspace
+ *
+ * plan() scans the candidate files on a thread pool (the indexer's
+ * trigram plan picks them, so files that cannot match are never read) and
+ * returns one edit list per file that has matches; nothing is rewritten
+ * while planning. Open documents are searched through their PieceTable,
+ * other files through a read-only mapping wrapped in one.
+ *
+ * apply() changes open documents with one transaction each, so a single
+ * undo restores a file. Files on disk are streamed - unchanged spans
+ * straight from the mapping, the replacements in between - into a temp
+ * file next to the original. Only when every temp file is written (and no
+ * file changed on disk since the plan) are they renamed over the
+ * originals; otherwise the temps are removed and nothing is touched.
+ */
+class WorkspaceReplace {
+public:
+    // Open buffer for a path, or nullptr to read the file from disk
+    using DocumentLookup = std::function<std::shared_ptr<PieceTable>(const std::string& path)>;
+    // Apply edits to an open document; the default wraps them in the
+    // document's own transaction (the GUI routes them through its UndoManager)
+    using DocumentApply = std::function<void(PieceTable& document, const std::vector<ReplaceEdit>& edits)>;
+
+    struct Options {
+        bool use_regex = false;
+        bool case_sensitive = false;
+    };
+
+    struct FileEdits {
+        std::string path;
+        std::vector<ReplaceEdit> edits;             // Document order
+        std::shared_ptr<PieceTable> document;       // Open buffer, or nullptr
+        std::shared_ptr<editor::MappedFile> mapping;   // The planned-over file
+        std::filesystem::file_time_type mtime{};
+    };
+
+    struct Result {
+        bool ok = false;
+        size_t files = 0;
+        size_t replacements = 0;
+        std::string error;      // First failure when !ok
+    };
+
+    WorkspaceReplace();
+    ~WorkspaceReplace();
+    WorkspaceReplace(const WorkspaceReplace&) = delete;
+    WorkspaceReplace& operator=(const WorkspaceReplace&) = delete;
+
+    // Files worth scanning for pattern: the indexer's candidates
+    static std::vector<std::string> candidate_files(const BackgroundIndexer& indexer, const std::string& pattern,
+                                                    const Options& options);
+
+    // Edit lists for every file with at least one match, in input order
+    std::vector<FileEdits> plan(const std::vector<std::string>& files, const std::string& pattern,
+                                const std::string& replacement, const Options& options,
+                                const DocumentLookup& lookup = nullptr);
+
+    // Make the planned edits: disk files all-or-nothing, then open documents
+    Result apply(std::vector<FileEdits>& plan, const DocumentApply& apply_document = nullptr);
+
+    // Stream data with edits spliced in to path (no rename); false on I/O error
+    static bool write_edited(const std::string& path, const char* data, size_t size,
+                             const std::vector<ReplaceEdit>& edits);
+};
+
+#endif // WORKSPACE_REPLACE_H
@@ -0,0 +1,52 @@
+#ifndef WORKSPACE_VOCABULARY_H
+#define WORKSPACE_VOCABULARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * WorkspaceVocabulary - every identifier of a workspace with its count
+ *
+ * An immutable snapshot: built once by the indexer, then shared by pointer
+ * and read from any thread without locking. Words are sorted by their
+ * lower-cased key, so a prefix is a range found by binary search, and the
+ * best words of every prefix range too long to scan are computed at build
+ * time.
+ */
+class WorkspaceVocabulary {
+public:
+    static constexpr size_t kTopK = 16;
+    static constexpr size_t kScanLimit = 256;
+
+    struct Word {
+        std::string key;        // Lower-cased
+        std::string text;       // As spelled in the source, when known; else key
+        uint32_t count = 0;
+    };
+
+    // Words may come in any order; one per key
+    static std::shared_ptr<const WorkspaceVocabulary> build(std::vector<Word> words, uint64_t generation);
+
+    // Up to max_items words longer than prefix starting with it (ignoring
+    // case), most frequent first, ties by key
+    void suggest(const std::string& prefix, size_t max_items, std::vector<const Word*>& out) const;
+
+    size_t size() const { return words_.size(); }
+    uint64_t generation() const { return generation_; }
+    const Word* find(const std::string& key) const;
+
+private:
+    std::pair<size_t, size_t> range(const std::string& key) const;
+    void best(size_t key_length, size_t first, size_t last, size_t max_items, std::vector<uint32_t>& out) const;
+
+    std::vector<Word> words_;
+    std::unordered_map<std::string, std::vector<uint32_t>> tops_;  // Prefix -> best word indices
+    uint64_t generation_ = 0;
+};
+
+#endif // WORKSPACE_VOCABULARY_H
@@ -0,0 +1,66 @@
+#pragma once
+#include "text_buffer.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+class PieceTable;
+
+namespace editor {
+
+/**
+ * WrapLayout - soft-wrap rows of logical lines, computed on demand
+ *
+ * A line's rows are described by the byte column each one starts at
+ * (the first is always 0). Rows break after the last space or tab that
+ * fits in columns(), or hard at columns() when a word is longer, never
+ * inside a UTF-8 sequence. Offsets are computed the first time a line is
+ * asked for - in practice only lines near the viewport - by streaming
+ * the line through bounded get_text reads, so a megabyte-long line is
+ * scanned once and never copied whole.
+ *
+ * Cached lines are dropped when edited (through the document's change
+ * listener when it is a PieceTable; call invalidate() otherwise) and all
+ * of them when the width changes; entries after an edit just shift.
+ * trim() keeps the cache to the neighborhood of the viewport.
+ */
+class WrapLayout {
+public:
+    WrapLayout() = default;
+    ~WrapLayout();
+
+    WrapLayout(const WrapLayout&) = delete;
+    WrapLayout& operator=(const WrapLayout&) = delete;
+
+    void set_document(const std::shared_ptr<TextBuffer>& document);
+    void set_columns(size_t columns);
+    size_t columns() const { return columns_; }
+
+    // Byte columns where the rows of line start; {0} for a short line
+    const std::vector<uint32_t>& row_starts(size_t line);
+    size_t row_count(size_t line) { return row_starts(line).size(); }
+    // Row of line that shows byte column
+    size_t row_of_column(size_t line, size_t column);
+
+    void invalidate() { lines_.clear(); }
+    // Drop cached lines outside [first - kSlack, last + kSlack]
+    void trim(size_t first, size_t last);
+    size_t cached_lines() const { return lines_.size(); }
+
+    static constexpr size_t kSlack = 256;
+    static constexpr size_t kReadChunk = 64 * 1024;
+
+private:
+    std::vector<uint32_t> layout_line(size_t line) const;
+    void on_change(size_t first_line, size_t removed_newlines, size_t inserted_newlines);
+
+    std::shared_ptr<TextBuffer> document_;
+    std::shared_ptr<PieceTable> listened_;
+    size_t listener_id_ = 0;
+    size_t columns_ = 80;
+    std::unordered_map<size_t, std::vector<uint32_t>> lines_;
+};
+
+} // namespace editor
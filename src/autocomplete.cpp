@@ -0,0 +1,297 @@
+#include "autocomplete.h"
+#include "piece_table.h"
+#include <algorithm>
+#include <cctype>
+
+namespace {
+
+bool is_ident_char(char c) {
+    unsigned char uc = static_cast<unsigned char>(c);
+    return std::isalnum(uc) || c == '_';
+}
+
+bool is_ident_start(char c) {
+    unsigned char uc = static_cast<unsigned char>(c);
+    return std::isalpha(uc) || c == '_';
+}
+
+std::string lower(const std::string& text) {
+    std::string key(text);
+    for (char& c : key) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return key;
+}
+
+const size_t kRunChunk = 64;
+
+// Identifier characters running back from position
+std::string ident_run_before(const PieceTable& document, size_t position) {
+    std::string run;
+    while (position > 0) {
+        size_t start = position > kRunChunk ? position - kRunChunk : 0;
+        std::string chunk = document.get_text(start, position - start);
+        size_t i = chunk.size();
+        while (i > 0 && is_ident_char(chunk[i - 1])) --i;
+        run.insert(0, chunk, i, std::string::npos);
+        if (i > 0) break;
+        position = start;
+    }
+    return run;
+}
+
+// Identifier characters running on from position
+std::string ident_run_after(const PieceTable& document, size_t position) {
+    std::string run;
+    size_t total = document.get_total_length();
+    while (position < total) {
+        std::string chunk = document.get_text(position, std::min(kRunChunk, total - position));
+        size_t i = 0;
+        while (i < chunk.size() && is_ident_char(chunk[i])) ++i;
+        run.append(chunk, 0, i);
+        if (i < chunk.size()) break;
+        position += chunk.size();
+    }
+    return run;
+}
+
+} // namespace
+
+void WordFrequencies::clear() {
+    words_.clear();
+    ids_.clear();
+    sorted_.clear();
+    tops_.clear();
+}
+
+void WordFrequencies::rebuild(const TextBuffer& document) {
+    clear();
+    // Pull lines in batches so the buffer's line index is walked once
+    // per batch instead of being descended for every single line
+    const size_t kBatch = 1024;
+    size_t lines = document.get_line_count();
+    for (size_t i = 0; i < lines; i += kBatch) {
+        for (const auto& line : document.get_lines_range(i, kBatch)) {
+            count_words(line, 1, false);
+        }
+    }
+    // One sort instead of an insertion per new word
+    sorted_.resize(words_.size());
+    for (size_t i = 0; i < sorted_.size(); ++i) sorted_[i] = static_cast<uint32_t>(i);
+    std::sort(sorted_.begin(), sorted_.end(), [this](uint32_t a, uint32_t b) { return ordered(a, b); });
+}
+
+std::vector<std::string> WordFrequencies::suggest(const std::string& prefix, size_t max_items) const {
+    if (prefix.empty() || max_items == 0) return {};
+    std::string key = lower(prefix);
+    std::pair<size_t, size_t> found = range(key);
+    std::vector<uint32_t> scanned;
+    const std::vector<uint32_t>* best = &scanned;
+    if (found.second - found.first > kScanLimit && max_items <= kTopK) {
+        auto cached = tops_.try_emplace(key);
+        TopList& top = cached.first->second;
+        if (cached.second || top.stale) {
+            fill_top(key, found.first, found.second, kTopK, top.ids);
+            top.stale = false;
+        }
+        best = &top.ids;
+    } else {
+        fill_top(key, found.first, found.second, max_items, scanned);
+    }
+    std::vector<std::string> out;
+    for (size_t i = 0; i < best->size() && out.size() < max_items; ++i) out.push_back(words_[(*best)[i]].text);
+    return out;
+}
+
+AutocompleteManager::AutocompleteManager()
+    : active_(&loose_) {}
+
+AutocompleteManager::~AutocompleteManager() {
+    detach();
+}
+
+void AutocompleteManager::rebuild_from_document(const std::shared_ptr<TextBuffer>& doc) {
+    loose_.clear();
+    if (doc) loose_.rebuild(*doc);
+    active_ = &loose_;
+}
+
+void AutocompleteManager::attach(const std::shared_ptr<PieceTable>& document) {
+    if (!document) {
+        active_ = &loose_;
+        return;
+    }
+    auto found = layers_.find(document.get());
+    if (found != layers_.end() && found->second->document.lock() == document) {
+        active_ = &found->second->words;
+        return;
+    }
+    // A layer left by a destroyed document whose address was reused
+    if (found != layers_.end()) layers_.erase(found);
+
+    auto layer = std::make_unique<Layer>();
+    Layer* owned = layer.get();
+    PieceTable* doc = document.get();
+    owned->words.rebuild(*doc);
+    owned->document = document;
+    owned->listener_id = doc->add_change_listener([owned, doc](const PieceTable::Change& change) {
+        std::string removed;
+        if (change.removed_length > 0) {
+            if (!change.removed_span) {
+                // The removed words are unknown: count everything again
+                owned->words.rebuild(*doc);
+                return;
+            }
+            removed = doc->get_span_text(*change.removed_span);
+        }
+        on_change(owned->words, *doc, change.position, change.inserted_length, removed);
+    });
+    active_ = &owned->words;
+    layers_[doc] = std::move(layer);
+}
+
+void AutocompleteManager::release(const PieceTable* document) {
+    auto found = layers_.find(document);
+    if (found == layers_.end()) return;
+    if (active_ == &found->second->words) active_ = &loose_;
+    if (auto owner = found->second->document.lock()) {
+        owner->remove_change_listener(found->second->listener_id);
+    }
+    layers_.erase(found);
+}
+
+void AutocompleteManager::detach() {
+    while (!layers_.empty()) release(layers_.begin()->first);
+}
+
+void AutocompleteManager::on_change(WordFrequencies& words, const PieceTable& document, size_t position,
+                                    size_t inserted_length, const std::string& removed) {
+    // The words around the edit: the identifier it was typed into, say,
+    // is counted down as it was and up as it is now
+    std::string before = ident_run_before(document, position);
+    std::string after = ident_run_after(document, position + inserted_length);
+    words.remove_text(before + removed + after);
+    words.add_text(before + document.get_text(position, inserted_length) + after);
+}
+
+std::vector<std::string> AutocompleteManager::suggest(const std::string& prefix, size_t max_items) const {
+    std::vector<std::string> out = active_->suggest(prefix, max_items);
+    if (!workspace_ || out.size() >= max_items) return out;
+
+    // Workspace words the document already offered, in any case, are skipped
+    std::vector<std::string> keys;
+    for (const std::string& word : out) keys.push_back(lower(word));
+    std::vector<const WorkspaceVocabulary::Word*> shared;
+    workspace_->suggest(prefix, max_items + keys.size(), shared);
+    for (const WorkspaceVocabulary::Word* word : shared) {
+        if (out.size() >= max_items) break;
+        if (std::find(keys.begin(), keys.end(), word->key) == keys.end()) out.push_back(word->text);
+    }
+    return out;
+}
+
+int WordFrequencies::frequency(const std::string& word) const {
+    auto found = ids_.find(word);
+    return found == ids_.end() ? 0 : words_[found->second].count;
+}
+
+void WordFrequencies::count_words(const std::string& text, int delta, bool keep_sorted) {
+    size_t i = 0, n = text.size();
+    while (i < n) {
+        if (is_ident_start(text[i])) {
+            size_t j = i + 1;
+            while (j < n && is_ident_char(text[j])) j++;
+            // ignore very short tokens
+            if (j - i >= 3) count_word(text.substr(i, j - i), delta, keep_sorted);
+            i = j;
+        } else {
+            i++;
+        }
+    }
+}
+
+void WordFrequencies::count_word(const std::string& word, int delta, bool keep_sorted) {
+    uint32_t id;
+    auto found = ids_.find(word);
+    if (found != ids_.end()) {
+        id = found->second;
+    } else {
+        if (delta <= 0) return;
+        id = static_cast<uint32_t>(words_.size());
+        words_.push_back(Word{word, lower(word), 0});
+        ids_.emplace(word, id);
+        if (keep_sorted) {
+            sorted_.insert(std::lower_bound(sorted_.begin(), sorted_.end(), id,
+                                            [this](uint32_t a, uint32_t b) { return ordered(a, b); }),
+                           id);
+        }
+    }
+
+    Word& entry = words_[id];
+    int old_count = entry.count;
+    entry.count = std::max(0, old_count + delta);
+    if (entry.count == old_count || tops_.empty()) return;
+    for (size_t length = 1; length < entry.key.size(); ++length) {
+        probe_.assign(entry.key, 0, length);
+        auto top = tops_.find(probe_);
+        if (top != tops_.end()) update_top(top->second, id, entry.count > old_count);
+    }
+}
+
+bool WordFrequencies::ordered(uint32_t a, uint32_t b) const {
+    int keys = words_[a].key.compare(words_[b].key);
+    return keys != 0 ? keys < 0 : words_[a].text < words_[b].text;
+}
+
+bool WordFrequencies::better(uint32_t a, uint32_t b) const {
+    if (words_[a].count != words_[b].count) return words_[a].count > words_[b].count;
+    return words_[a].text < words_[b].text;
+}
+
+void WordFrequencies::update_top(TopList& top, uint32_t id, bool increased) const {
+    if (top.stale) return;
+    // The list holds the best min(kTopK, candidates) words; everything off
+    // it ranks no higher than its last entry
+    std::vector<uint32_t>& ids = top.ids;
+    auto place = [&] {
+        ids.insert(std::lower_bound(ids.begin(), ids.end(), id, [this](uint32_t a, uint32_t b) { return better(a, b); }),
+                   id);
+    };
+    auto at = std::find(ids.begin(), ids.end(), id);
+    if (at == ids.end()) {
+        if (!increased) return;
+        if (ids.size() < kTopK) {
+            place();
+        } else if (better(id, ids.back())) {
+            place();
+            ids.pop_back();
+        }
+        return;
+    }
+    bool full = ids.size() == kTopK;
+    ids.erase(at);
+    if (words_[id].count > 0) place();
+    // A word counted down to last place, or off the list, may now rank
+    // below one that was not on it
+    if (!increased && full && (ids.size() < kTopK || ids.back() == id)) top.stale = true;
+}
+
+std::pair<size_t, size_t> WordFrequencies::range(const std::string& key) const {
+    auto first = std::lower_bound(sorted_.begin(), sorted_.end(), key,
+                                  [this](uint32_t id, const std::string& k) { return words_[id].key < k; });
+    auto last = std::partition_point(first, sorted_.end(), [&](uint32_t id) {
+        return words_[id].key.compare(0, key.size(), key) == 0;
+    });
+    return {static_cast<size_t>(first - sorted_.begin()), static_cast<size_t>(last - sorted_.begin())};
+}
+
+void WordFrequencies::fill_top(const std::string& key, size_t first, size_t last, size_t max_items,
+                                   std::vector<uint32_t>& out) const {
+    out.clear();
+    for (size_t i = first; i < last; ++i) {
+        const Word& word = words_[sorted_[i]];
+        if (word.count > 0 && word.key.size() > key.size()) out.push_back(sorted_[i]);
+    }
+    size_t keep = std::min(max_items, out.size());
+    std::partial_sort(out.begin(), out.begin() + keep, out.end(),
+                      [this](uint32_t a, uint32_t b) { return better(a, b); });
+    out.resize(keep);
+}
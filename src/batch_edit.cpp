@@ -0,0 +1,369 @@
+#include "batch_edit.h"
+#include "find_dialog.h"
+#include "piece_table.h"
+#include "platform_file.h"
+#include "regex_engine.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+namespace editor {
+
+namespace {
+
+using Command = BatchEdit::Command;
+using LineRanges = std::vector<std::pair<size_t, size_t>>;     // Inclusive, ascending
+
+// Text up to an unescaped delimiter, which "\<delimiter>" stands for;
+// other escapes are kept for the regex
+bool read_delimited(const std::string& line, size_t& pos, char delimiter, std::string& out) {
+    while (pos < line.size()) {
+        char c = line[pos];
+        if (c == '\\' && pos + 1 < line.size()) {
+            if (line[pos + 1] != delimiter) out += c;
+            out += line[pos + 1];
+            pos += 2;
+            continue;
+        }
+        ++pos;
+        if (c == delimiter) return true;
+        out += c;
+    }
+    return false;
+}
+
+bool read_line_number(const std::string& line, size_t& pos, size_t& number) {
+    if (pos < line.size() && line[pos] == '$') {
+        ++pos;
+        number = SIZE_MAX;
+        return true;
+    }
+    size_t start = pos;
+    number = 0;
+    while (pos < line.size() && std::isdigit(static_cast<unsigned char>(line[pos]))) {
+        number = number * 10 + (line[pos++] - '0');
+    }
+    if (pos == start || number == 0) return false;
+    --number;
+    return true;
+}
+
+void skip_blanks(const std::string& line, size_t& pos) {
+    while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t')) ++pos;
+}
+
+std::vector<std::string_view> views_of(const PieceTable& document) {
+    std::vector<std::string_view> views;
+    views.reserve(document.get_piece_count());
+    for (auto it = document.chunks(); !it.done(); ++it) views.push_back(*it);
+    return views;
+}
+
+bool ends_with_newline(const PieceTable& document) {
+    size_t total = document.get_total_length();
+    return total > 0 && document.get_text(total - 1, 1)[0] == '\n';
+}
+
+// Lines as sed counts them: a final newline does not start one more
+size_t content_lines(const PieceTable& document) {
+    size_t lines = document.get_line_count();
+    return lines > 1 && ends_with_newline(document) ? lines - 1 : lines;
+}
+
+// Offset just past a line's terminator (the end for the last line)
+size_t line_end(const PieceTable& document, size_t line) {
+    return line + 1 < document.get_line_count() ? document.get_line_start(line + 1) : document.get_total_length();
+}
+
+// The document's own line break, for the lines i and a add
+std::string newline_of(const PieceTable& document) {
+    if (document.get_line_count() < 2) return "\n";
+    size_t end = document.get_line_start(1);
+    return end >= 2 && document.get_text(end - 2, 1)[0] == '\r' ? "\r\n" : "\n";
+}
+
+LineRanges addressed_lines(const PieceTable& document, const Command& command) {
+    size_t lines = content_lines(document);
+    LineRanges ranges;
+    switch (command.address) {
+    case Command::Address::All:
+        ranges.emplace_back(0, lines - 1);
+        break;
+    case Command::Address::Lines: {
+        size_t first = command.first == SIZE_MAX ? lines - 1 : command.first;
+        size_t last = (std::min)(command.last, lines - 1);
+        if (first <= last) ranges.emplace_back(first, last);
+        break;
+    }
+    case Command::Address::Matching: {
+        auto regex = RegexEngine::cached(command.anchor);
+        regex->for_each_match(views_of(document), 0, [&](const RegexEngine::Match& hit) {
+            size_t line = document.get_line_at(hit.position);
+            if (line >= lines) return false;
+            if (!ranges.empty() && ranges.back().second + 1 >= line) {
+                ranges.back().second = (std::max)(ranges.back().second, line);
+            } else {
+                ranges.emplace_back(line, line);
+            }
+            return true;
+        });
+        break;
+    }
+    }
+    return ranges;
+}
+
+std::vector<ReplaceEdit> plan_substitute(const PieceTable& document, const Command& command, const LineRanges& ranges) {
+    std::vector<ReplaceEdit> edits;
+    auto regex = RegexEngine::cached(command.pattern, command.case_sensitive);
+    size_t range = 0;
+    size_t last_line = SIZE_MAX;
+    regex->for_each_match(views_of(document), 0, [&](const RegexEngine::Match& hit) {
+        size_t line = document.get_line_at(hit.position);
+        while (range < ranges.size() && ranges[range].second < line) ++range;
+        if (range == ranges.size()) return false;
+        if (line < ranges[range].first || (!command.global && line == last_line)) return true;
+        last_line = line;
+        // Groups lie inside the match, so only the match text is read to expand them
+        RegexEngine::Match local = hit;
+        local.position = 0;
+        for (size_t& offset : local.groups) {
+            if (offset != RegexEngine::npos) offset -= hit.position;
+        }
+        std::string text = document.get_text(hit.position, hit.length);
+        edits.push_back({hit.position, hit.length, RegexEngine::expand(command.text, local, text)});
+        return true;
+    });
+    return edits;
+}
+
+std::vector<ReplaceEdit> plan_lines(const PieceTable& document, const Command& command, const LineRanges& ranges) {
+    std::vector<ReplaceEdit> edits;
+    if (command.kind == Command::Kind::Delete) {
+        for (const auto& range : ranges) {
+            size_t start = document.get_line_start(range.first);
+            edits.push_back({start, line_end(document, range.second) - start, std::string()});
+        }
+        return edits;
+    }
+    std::string newline = newline_of(document);
+    bool before = command.kind == Command::Kind::Insert;
+    for (const auto& range : ranges) {
+        for (size_t line = range.first; line <= range.second; ++line) {
+            if (before) {
+                edits.push_back({document.get_line_start(line), 0, command.text + newline});
+            } else if (line + 1 < document.get_line_count()) {
+                edits.push_back({line_end(document, line), 0, command.text + newline});
+            } else {
+                edits.push_back({document.get_total_length(), 0, newline + command.text});
+            }
+        }
+    }
+    return edits;
+}
+
+} // namespace
+
+bool BatchEdit::parse(const std::string& program) {
+    commands_.clear();
+    error_.clear();
+    size_t number = 0;
+    for (size_t start = 0; start <= program.size();) {
+        size_t end = program.find('\n', start);
+        if (end == std::string::npos) end = program.size();
+        std::string line = program.substr(start, end - start);
+        start = end + 1;
+        ++number;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        size_t pos = 0;
+        skip_blanks(line, pos);
+        if (pos == line.size() || line[pos] == '#') continue;
+        Command command;
+        if (!parse_command(line.substr(pos), command)) {
+            error_ = "line " + std::to_string(number) + ": " + error_;
+            commands_.clear();
+            return false;
+        }
+        commands_.push_back(std::move(command));
+    }
+    return true;
+}
+
+bool BatchEdit::parse_command(const std::string& line, Command& command) {
+    size_t pos = 0;
+    if (line[pos] == '/') {
+        ++pos;
+        command.address = Command::Address::Matching;
+        if (!read_delimited(line, pos, '/', command.anchor)) {
+            error_ = "unterminated address";
+            return false;
+        }
+        std::shared_ptr<const RegexEngine> anchor = RegexEngine::cached(command.anchor);
+        if (!anchor->ok()) {
+            error_ = anchor->error();
+            return false;
+        }
+    } else if (line[pos] == '$' || std::isdigit(static_cast<unsigned char>(line[pos]))) {
+        command.address = Command::Address::Lines;
+        if (!read_line_number(line, pos, command.first)) {
+            error_ = "bad line number";
+            return false;
+        }
+        command.last = command.first;
+        if (pos < line.size() && line[pos] == ',') {
+            ++pos;
+            if (!read_line_number(line, pos, command.last)) {
+                error_ = "bad line number";
+                return false;
+            }
+        }
+    }
+    skip_blanks(line, pos);
+    char name = pos < line.size() ? line[pos++] : '\0';
+    switch (name) {
+    case 's': {
+        command.kind = Command::Kind::Substitute;
+        char delimiter = pos < line.size() ? line[pos++] : '\0';
+        if (delimiter == '\0' || delimiter == '\\' || std::isalnum(static_cast<unsigned char>(delimiter)) ||
+            std::isspace(static_cast<unsigned char>(delimiter))) {
+            error_ = "bad delimiter";
+            return false;
+        }
+        if (!read_delimited(line, pos, delimiter, command.pattern) ||
+            !read_delimited(line, pos, delimiter, command.text)) {
+            error_ = "unterminated s command";
+            return false;
+        }
+        for (; pos < line.size(); ++pos) {
+            if (line[pos] == 'g') command.global = true;
+            else if (line[pos] == 'i') command.case_sensitive = false;
+            else if (line[pos] != ' ' && line[pos] != '\t') {
+                error_ = std::string("unknown flag '") + line[pos] + "'";
+                return false;
+            }
+        }
+        if (command.pattern.empty()) {
+            error_ = "empty pattern";
+            return false;
+        }
+        std::shared_ptr<const RegexEngine> regex = RegexEngine::cached(command.pattern, command.case_sensitive);
+        if (!regex->ok()) {
+            error_ = regex->error();
+            return false;
+        }
+        return true;
+    }
+    case 'd':
+        command.kind = Command::Kind::Delete;
+        skip_blanks(line, pos);
+        if (pos != line.size()) {
+            error_ = "text after d";
+            return false;
+        }
+        return true;
+    case 'i':
+    case 'a':
+        command.kind = name == 'i' ? Command::Kind::Insert : Command::Kind::Append;
+        skip_blanks(line, pos);
+        command.text = line.substr(pos);
+        return true;
+    default:
+        error_ = name ? std::string("unknown command '") + name + "'" : "missing command";
+        return false;
+    }
+}
+
+size_t BatchEdit::apply(PieceTable& document) const {
+    size_t count = 0;
+    document.begin_transaction();
+    for (const Command& command : commands_) {
+        LineRanges ranges = addressed_lines(document, command);
+        if (ranges.empty()) continue;
+        std::vector<ReplaceEdit> edits = command.kind == Command::Kind::Substitute
+                                             ? plan_substitute(document, command, ranges)
+                                             : plan_lines(document, command, ranges);
+        FindDialog::apply_edits(document, edits);
+        count += edits.size();
+    }
+    document.commit_transaction();
+    return count;
+}
+
+BatchEdit::FileResult BatchEdit::edit_file(const std::string& path, bool dry_run) const {
+    FileResult result;
+    result.path = path;
+    std::shared_ptr<MappedFile> mapping = PlatformFile::map_file(path);
+    if (!mapping) {
+        result.error = "cannot read " + path;
+        return result;
+    }
+    auto document = std::make_unique<PieceTable>(mapping);
+    result.edits = apply(*document);
+    if (result.edits == 0 || dry_run) return result;
+
+    // Streamed to a temp first: the mapping the unchanged text is read from
+    // has to be closed before its file can be replaced (on Windows)
+    std::string temp = path + ".velocity-batch.tmp";
+    bool ok = PlatformFile::write_file_binary(temp, views_of(*document));
+    document.reset();
+    mapping.reset();
+    FilePermission permissions = FilePermission::None;
+    if (ok && PlatformFile::get_permissions(path, permissions)) PlatformFile::set_permissions(temp, permissions);
+    ok = ok && PlatformFile::replace_file(temp, path);
+    if (!ok) {
+        PlatformFile::delete_file(temp);
+        result.error = "cannot write " + path;
+    }
+    return result;
+}
+
+BatchEdit::Result BatchEdit::run(const std::vector<std::string>& paths, bool dry_run) const {
+    std::vector<FileResult> files(paths.size());
+    // Someone is waiting on the whole batch
+    TaskGroup workers;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        workers.submit([this, &paths, &files, i, dry_run]() { files[i] = edit_file(paths[i], dry_run); },
+                       TaskPriority::Interactive);
+    }
+    workers.wait();
+
+    Result result;
+    result.files = paths.size();
+    for (FileResult& file : files) {
+        if (file.edits == 0 && file.error.empty()) continue;
+        if (file.edits > 0) result.changed++;
+        result.edits += file.edits;
+        result.touched.push_back(std::move(file));
+    }
+    return result;
+}
+
+std::vector<std::string> BatchEdit::expand_paths(const std::vector<std::string>& paths) {
+    namespace fs = std::filesystem;
+    std::vector<std::string> files;
+    for (const std::string& path : paths) {
+        std::error_code error;
+        if (!fs::is_directory(path, error)) {
+            files.push_back(path);
+            continue;
+        }
+        fs::recursive_directory_iterator it(path, fs::directory_options::skip_permission_denied, error);
+        for (; !error && it != fs::recursive_directory_iterator(); it.increment(error)) {
+            if (it->path().filename().string().rfind('.', 0) == 0) {
+                if (it->is_directory(error)) it.disable_recursion_pending();
+                continue;
+            }
+            if (it->is_regular_file(error)) files.push_back(it->path().string());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+} // namespace editor
@@ -0,0 +1,299 @@
+#include "blame_cache.h"
+#include "diff_engine.h"
+#include "diff_gutter.h"
+#include "document_snapshot.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace editor {
+
+namespace {
+
+// Days since 1970-01-01 to a civil date (proleptic Gregorian)
+void civil_from_days(int64_t days, int& year, unsigned& month, unsigned& day) {
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned doe = static_cast<unsigned>(days - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    day = doy - (153 * mp + 2) / 5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = static_cast<int>(yoe + era * 400 + (month <= 2));
+}
+
+std::string make_label(const BlameCache::Commit& commit) {
+    int64_t days = commit.time / 86400 - (commit.time % 86400 < 0 ? 1 : 0);
+    int year;
+    unsigned month, day;
+    civil_from_days(days, year, month, day);
+    char date[32];          // Fits any int year, so never truncated
+    std::snprintf(date, sizeof(date), "%04d-%02u-%02u", year, month, day);
+    return commit.id.substr(0, 8) + " " + commit.author + " " + date;
+}
+
+bool starts_with(std::string_view text, std::string_view prefix) {
+    return text.size() >= prefix.size() && text.compare(0, prefix.size(), prefix) == 0;
+}
+
+} // namespace
+
+BlameCache::BlameCache(BlobIdFn blob_id, BlobTextFn blob_text, BlameFn blame)
+    : blob_id_(std::move(blob_id)), blob_text_(std::move(blob_text)), blame_(std::move(blame)),
+      thread_([this] { worker_loop(); }) {}
+
+BlameCache::~BlameCache() {
+    set_document(nullptr, std::string());
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+}
+
+void BlameCache::set_document(const std::shared_ptr<PieceTable>& document, const std::string& path) {
+    std::shared_ptr<PieceTable> tracked = path.empty() ? nullptr : document;
+    if (tracked == document_ && (!tracked || path == path_)) return;
+    if (document_) document_->remove_change_listener(listener_id_);
+    document_ = tracked;
+    path_ = tracked ? path : std::string();
+    ++generation_;
+    entry_.reset();
+    lines_.clear();
+    splices_.clear();
+    in_flight_ = false;
+    dirty_ = document_ != nullptr;
+    if (document_) {
+        listener_id_ = document_->add_change_listener([this](const PieceTable::Change& change) { on_change(change); });
+    }
+}
+
+void BlameCache::invalidate_base() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        base_stale_ = true;
+    }
+    dirty_ = document_ != nullptr;
+}
+
+void BlameCache::on_change(const PieceTable::Change& change) {
+    size_t first = change.first_line;
+    size_t removed = change.removed_newlines + 1;
+    size_t inserted = change.inserted_newlines + 1;
+    if (change.inserted_length == 0 && change.column == 0 && change.old_end_column == 0) {
+        // Whole lines deleted: the line after them is untouched
+        removed = change.removed_newlines;
+        inserted = 0;
+    } else if (change.removed_length == 0 && change.inserted_newlines > 0) {
+        // Whole lines inserted above a line, or below one (Enter at its end)
+        size_t end = change.position + change.inserted_length;
+        auto line_break_at = [this](size_t position) {
+            std::string byte = document_->get_text(position, 1);
+            return byte.empty() || byte[0] == '\n' || byte[0] == '\r';
+        };
+        if (change.column == 0 && document_->get_text(end - 1, 1) == "\n") {
+            removed = 0;
+            inserted = change.inserted_newlines;
+        } else if (line_break_at(change.position) && line_break_at(end)) {
+            first += 1;
+            removed = 0;
+            inserted = change.inserted_newlines;
+        }
+    }
+    if (removed == 0 && inserted == 0) return;
+    if (entry_) splice(lines_, first, removed, inserted);
+    // The blame in flight is for the text before this edit
+    if (in_flight_) splices_.insert(splices_.end(), {first, removed, inserted});
+}
+
+void BlameCache::splice(std::vector<uint32_t>& lines, size_t first, size_t removed, size_t inserted) {
+    first = (std::min)(first, lines.size());
+    removed = (std::min)(removed, lines.size() - first);
+    size_t kept = (std::min)(removed, inserted);
+    std::fill(lines.begin() + first, lines.begin() + first + kept, kLocal);
+    if (removed > kept) {
+        lines.erase(lines.begin() + first + kept, lines.begin() + first + removed);
+    } else if (inserted > kept) {
+        lines.insert(lines.begin() + first + kept, inserted - kept, kLocal);
+    }
+}
+
+void BlameCache::update() {
+    if (!dirty_ || !document_) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // One job at a time: a change of base meanwhile queues the next one
+        if (has_job_ || in_flight_) return;
+        job_.generation = generation_;
+        job_.path = path_;
+        job_.snapshot = document_->snapshot();
+        has_job_ = true;
+    }
+    wake_.notify_one();
+    splices_.clear();
+    in_flight_ = true;
+    dirty_ = false;
+}
+
+bool BlameCache::take_results() {
+    Result result;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!has_result_) return false;
+        result = std::move(result_);
+        has_result_ = false;
+    }
+    // Finished for a document no longer blamed
+    if (result.generation != generation_) return false;
+    in_flight_ = false;
+    for (size_t i = 0; i + 2 < splices_.size(); i += 3) {
+        splice(result.lines, splices_[i], splices_[i + 1], splices_[i + 2]);
+    }
+    splices_.clear();
+    entry_ = std::move(result.entry);
+    lines_ = entry_ ? std::move(result.lines) : std::vector<uint32_t>();
+    return true;
+}
+
+void BlameCache::wait_idle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return !has_job_ && !running_; });
+}
+
+const BlameCache::Commit* BlameCache::commit_at(size_t line) const {
+    if (line >= lines_.size() || lines_[line] == kLocal) return nullptr;
+    return &entry_->blame.commits[lines_[line]];
+}
+
+bool BlameCache::parse_incremental(std::string_view output, Blame& blame) {
+    blame.commits.clear();
+    blame.line_commits.clear();
+    std::unordered_map<std::string, uint32_t> index;
+    uint32_t current = kLocal;
+    size_t final_line = 0;
+    size_t count = 0;
+    while (!output.empty()) {
+        size_t end = output.find('\n');
+        std::string_view line = output.substr(0, end);
+        output.remove_prefix(end == std::string_view::npos ? output.size() : end + 1);
+        if (line.empty()) continue;
+
+        if (current == kLocal) {
+            // "<id> <source line> <result line> <lines>" opens a group
+            size_t space = line.find(' ');
+            if (space != 40 && space != 64) return false;
+            std::string id(line.substr(0, space));
+            std::string numbers(line.substr(space + 1));
+            char* next = nullptr;
+            std::strtoull(numbers.c_str(), &next, 10);
+            final_line = std::strtoull(next, &next, 10);
+            count = std::strtoull(next, &next, 10);
+            if (final_line == 0 || count == 0) return false;
+            auto it = index.find(id);
+            if (it == index.end()) {
+                it = index.emplace(id, static_cast<uint32_t>(blame.commits.size())).first;
+                blame.commits.emplace_back();
+                blame.commits.back().id = id;
+            }
+            current = it->second;
+            continue;
+        }
+        // Headers come with a commit's first group only; "filename" ends every group
+        Commit& commit = blame.commits[current];
+        if (starts_with(line, "author ")) {
+            commit.author = std::string(line.substr(7));
+        } else if (starts_with(line, "author-time ")) {
+            commit.time = std::strtoll(std::string(line.substr(12)).c_str(), nullptr, 10);
+        } else if (starts_with(line, "summary ")) {
+            commit.summary = std::string(line.substr(8));
+        } else if (starts_with(line, "filename ")) {
+            size_t first = final_line - 1;
+            if (blame.line_commits.size() < first + count) blame.line_commits.resize(first + count, kLocal);
+            std::fill(blame.line_commits.begin() + first, blame.line_commits.begin() + first + count, current);
+            current = kLocal;
+        }
+    }
+    if (current != kLocal) return false;
+    for (Commit& commit : blame.commits) commit.label = make_label(commit);
+    return true;
+}
+
+void BlameCache::worker_loop() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            running_ = false;
+            idle_.notify_all();
+            wake_.wait(lock, [this] { return stopping_ || has_job_; });
+            if (stopping_) return;
+            job = std::move(job_);
+            job_ = Job();
+            has_job_ = false;
+            running_ = true;
+            if (base_stale_) {
+                blob_ids_.clear();
+                base_stale_ = false;
+            }
+        }
+        Result result;
+        run_job(job, result);
+        std::lock_guard<std::mutex> lock(mutex_);
+        result_ = std::move(result);
+        has_result_ = true;
+    }
+}
+
+void BlameCache::run_job(const Job& job, Result& result) {
+    result.generation = job.generation;
+    result.entry = entry_for(job.path);
+    if (!result.entry) return;
+
+    // Line up HEAD's lines with the document's; blamed lines carry over
+    // where they match, the rest are local
+    std::vector<uint64_t> current;
+    DiffEngine::hash_lines(*job.snapshot, current);
+    const Entry& entry = *result.entry;
+    auto blamed = [&entry](size_t line) {
+        return line < entry.blame.line_commits.size() ? entry.blame.line_commits[line] : kLocal;
+    };
+    result.lines.assign(current.size(), kLocal);
+    size_t old_line = 0;
+    size_t new_line = 0;
+    for (const DiffEngine::Hunk& hunk : DiffEngine::diff(entry.hashes, current)) {
+        while (new_line < hunk.new_start) result.lines[new_line++] = blamed(old_line++);
+        old_line += hunk.old_count;
+        new_line += hunk.new_count;
+    }
+    while (new_line < current.size()) result.lines[new_line++] = blamed(old_line++);
+}
+
+std::shared_ptr<const BlameCache::Entry> BlameCache::entry_for(const std::string& path) {
+    auto id_it = blob_ids_.find(path);
+    if (id_it == blob_ids_.end()) {
+        std::string id;
+        if (!blob_id_(path, id)) id.clear();
+        id_it = blob_ids_.emplace(path, id).first;
+    }
+    const std::string& id = id_it->second;
+    if (id.empty()) return nullptr;
+
+    auto blob_it = blobs_.find(id);
+    if (blob_it != blobs_.end()) return blob_it->second;
+    std::string text;
+    std::string output;
+    auto entry = std::make_shared<Entry>();
+    if (!blob_text_(id, text) || !blame_(path, output) || !parse_incremental(output, entry->blame)) return nullptr;
+    DiffGutter::hash_lines(text, entry->hashes);
+    if (blob_order_.size() == kMaxCachedBlobs) {
+        blobs_.erase(blob_order_.front());
+        blob_order_.pop_front();
+    }
+    blob_order_.push_back(id);
+    blobs_.emplace(id, entry);
+    return entry;
+}
+
+} // namespace editor
@@ -0,0 +1,463 @@
+#include "bracket_index.h"
+#include <algorithm>
+
+namespace {
+
+constexpr size_t kNotFound = static_cast<size_t>(-1);
+
+bool bracket_kind(char c, BracketIndex::Kind& kind, bool& open) {
+    switch (c) {
+        case '(': kind = BracketIndex::Kind::Round; open = true; return true;
+        case ')': kind = BracketIndex::Kind::Round; open = false; return true;
+        case '[': kind = BracketIndex::Kind::Square; open = true; return true;
+        case ']': kind = BracketIndex::Kind::Square; open = false; return true;
+        case '{': kind = BracketIndex::Kind::Curly; open = true; return true;
+        case '}': kind = BracketIndex::Kind::Curly; open = false; return true;
+        default: return false;
+    }
+}
+
+} // namespace
+
+BracketIndex::BracketIndex(const SyntaxHighlighter* highlighter)
+    : highlighter_(highlighter), language_(highlighter->get_language()) {}
+
+BracketIndex::~BracketIndex() {
+    if (document_ && listener_id_) document_->remove_change_listener(listener_id_);
+}
+
+void BracketIndex::set_document(const std::shared_ptr<PieceTable>& document) {
+    if (document == document_ && (listener_id_ || !document)) return;
+    attach(document);
+    if (document_) {
+        listener_id_ = document_->add_change_listener([this](const PieceTable::Change& change) {
+            on_change(change);
+        });
+    }
+}
+
+void BracketIndex::attach(const std::shared_ptr<PieceTable>& document) {
+    if (document_ && listener_id_) document_->remove_change_listener(listener_id_);
+    listener_id_ = 0;
+    document_ = document;
+    rebuild();
+}
+
+void BracketIndex::apply(const PieceTable::Change& change) {
+    on_change(change);
+}
+
+// ---- Treap ----
+
+BracketIndex::Summary BracketIndex::combine(const Summary& a, const Summary& b) {
+    Summary s;
+    s.delta = a.delta + b.delta;
+    s.min_prefix = (std::min)(a.min_prefix, a.delta + b.min_prefix);
+    return s;
+}
+
+void BracketIndex::pull(uint32_t index) {
+    Node& node = nodes_[index];
+    node.size = 1 + size(node.left) + size(node.right);
+    for (size_t k = 0; k < kKinds; ++k) {
+        Summary s = node.left == kNil ? node.line[k] : combine(nodes_[node.left].tree[k], node.line[k]);
+        node.tree[k] = node.right == kNil ? s : combine(s, nodes_[node.right].tree[k]);
+    }
+}
+
+std::pair<uint32_t, uint32_t> BracketIndex::split(uint32_t index, size_t count) {
+    if (index == kNil) return {kNil, kNil};
+    Node& node = nodes_[index];
+    size_t left_size = size(node.left);
+    if (count <= left_size) {
+        auto parts = split(node.left, count);
+        nodes_[index].left = parts.second;
+        pull(index);
+        return {parts.first, index};
+    }
+    auto parts = split(node.right, count - left_size - 1);
+    nodes_[index].right = parts.first;
+    pull(index);
+    return {index, parts.second};
+}
+
+uint32_t BracketIndex::merge(uint32_t a, uint32_t b) {
+    if (a == kNil) return b;
+    if (b == kNil) return a;
+    if (nodes_[a].priority > nodes_[b].priority) {
+        uint32_t right = merge(nodes_[a].right, b);
+        nodes_[a].right = right;
+        pull(a);
+        return a;
+    }
+    uint32_t left = merge(a, nodes_[b].left);
+    nodes_[b].left = left;
+    pull(b);
+    return b;
+}
+
+// Treap over nodes in line order, in O(n): each node pops the lower
+// priority ones off the right spine and takes them as its left subtree
+uint32_t BracketIndex::build(const std::vector<uint32_t>& order) {
+    std::vector<uint32_t> spine;
+    for (uint32_t index : order) {
+        uint32_t last = kNil;
+        while (!spine.empty() && nodes_[spine.back()].priority < nodes_[index].priority) {
+            last = spine.back();
+            spine.pop_back();
+            pull(last);
+        }
+        nodes_[index].left = last;
+        nodes_[index].right = kNil;
+        if (!spine.empty()) nodes_[spine.back()].right = index;
+        spine.push_back(index);
+    }
+    while (spine.size() > 1) {
+        pull(spine.back());
+        spine.pop_back();
+    }
+    if (spine.empty()) return kNil;
+    pull(spine.back());
+    return spine.back();
+}
+
+uint32_t BracketIndex::make_node() {
+    uint32_t index;
+    if (!free_.empty()) {
+        index = free_.back();
+        free_.pop_back();
+        nodes_[index].left = nodes_[index].right = kNil;
+    } else {
+        index = static_cast<uint32_t>(nodes_.size());
+        nodes_.emplace_back();
+    }
+    // xorshift32
+    seed_ ^= seed_ << 13;
+    seed_ ^= seed_ >> 17;
+    seed_ ^= seed_ << 5;
+    nodes_[index].priority = seed_;
+    return index;
+}
+
+void BracketIndex::free_tree(uint32_t index) {
+    std::vector<uint32_t> stack;
+    if (index != kNil) stack.push_back(index);
+    while (!stack.empty()) {
+        Node& node = nodes_[stack.back()];
+        free_.push_back(stack.back());
+        stack.pop_back();
+        if (node.left != kNil) stack.push_back(node.left);
+        if (node.right != kNil) stack.push_back(node.right);
+        node.brackets.clear();
+    }
+}
+
+const BracketIndex::Node* BracketIndex::node_at(size_t line) const {
+    uint32_t index = root_;
+    while (index != kNil) {
+        const Node& node = nodes_[index];
+        size_t left_size = size(node.left);
+        if (line < left_size) {
+            index = node.left;
+        } else if (line == left_size) {
+            return &node;
+        } else {
+            line -= left_size + 1;
+            index = node.right;
+        }
+    }
+    return nullptr;
+}
+
+uint32_t BracketIndex::last_node(uint32_t index) const {
+    while (index != kNil && nodes_[index].right != kNil) index = nodes_[index].right;
+    return index;
+}
+
+// ---- Lexing and edits ----
+
+void BracketIndex::lex(const std::string& text, const SyntaxHighlighter::LineState& in, Node& node) {
+    highlighter_->tokenize_line(text, in, node.out, tokens_);
+    node.brackets.clear();
+    for (auto& summary : node.line) summary = Summary();
+    size_t token = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        Kind kind;
+        bool open;
+        if (!bracket_kind(text[i], kind, open)) continue;
+        // Tokens come in column order; skip the ones ending before i
+        while (token < tokens_.size() && tokens_[token].start + tokens_[token].length <= i) ++token;
+        if (token < tokens_.size() && tokens_[token].start <= i &&
+            (tokens_[token].type == Token::STRING || tokens_[token].type == Token::COMMENT)) {
+            continue;
+        }
+        node.brackets.push_back({static_cast<uint32_t>(i), kind, open});
+        Summary& summary = node.line[static_cast<size_t>(kind)];
+        summary.delta += open ? 1 : -1;
+        summary.min_prefix = (std::min)(summary.min_prefix, summary.delta);
+    }
+}
+
+void BracketIndex::rebuild() {
+    nodes_.clear();
+    free_.clear();
+    root_ = kNil;
+    language_ = highlighter_->get_language();
+    changed_end_ = 0;
+    if (!document_) return;
+    size_t count = document_->get_line_count();
+    nodes_.reserve(count);
+    std::vector<uint32_t> order;
+    order.reserve(count);
+    SyntaxHighlighter::LineState state;
+    auto cursor = document_->lines();
+    std::string_view line;
+    while (cursor.next(line)) {
+        uint32_t index = make_node();
+        scratch_.assign(line.data(), line.size());
+        lex(scratch_, state, nodes_[index]);
+        state = nodes_[index].out;
+        order.push_back(index);
+    }
+    root_ = build(order);
+    changed_end_ = order.size();
+}
+
+// Lexes the lines of a subtree in order from state while the out-states
+// come out different from before; true once one matches (the rest of the
+// document is unaffected)
+bool BracketIndex::relex(uint32_t index, size_t& line, SyntaxHighlighter::LineState& state) {
+    if (index == kNil) return false;
+    bool settled = relex(nodes_[index].left, line, state);
+    if (!settled) {
+        SyntaxHighlighter::LineState before = nodes_[index].out;
+        scratch_ = document_->get_line(line++);
+        lex(scratch_, state, nodes_[index]);
+        state = nodes_[index].out;
+        settled = state == before || relex(nodes_[index].right, line, state);
+    }
+    pull(index);
+    return settled;
+}
+
+void BracketIndex::on_change(const PieceTable::Change& change) {
+    if (!document_) return;
+    size_t first = change.first_line;
+    size_t old_last = first + change.removed_newlines;
+    size_t new_last = first + change.inserted_newlines;
+    if (old_last >= line_count() || highlighter_->get_language() != language_) {
+        rebuild();
+        return;
+    }
+
+    auto head = split(root_, first);
+    auto rest = split(head.second, old_last - first + 1);
+    SyntaxHighlighter::LineState old_out = nodes_[last_node(rest.first)].out;
+    free_tree(rest.first);
+
+    SyntaxHighlighter::LineState state;
+    if (head.first != kNil) state = nodes_[last_node(head.first)].out;
+    uint32_t edited = kNil;
+    for (size_t line = first; line <= new_last; ++line) {
+        uint32_t index = make_node();
+        scratch_ = document_->get_line(line);
+        lex(scratch_, state, nodes_[index]);
+        state = nodes_[index].out;
+        pull(index);
+        edited = merge(edited, index);
+    }
+
+    size_t line = new_last + 1;
+    if (state != old_out) relex(rest.second, line, state);
+    changed_end_ = line;
+    root_ = merge(merge(head.first, edited), rest.second);
+}
+
+// ---- Queries ----
+
+size_t BracketIndex::line_count() const {
+    return size(root_);
+}
+
+const std::vector<BracketIndex::Bracket>& BracketIndex::brackets(size_t line) const {
+    const Node* node = node_at(line);
+    return node ? node->brackets : empty_;
+}
+
+void BracketIndex::line_braces(size_t line, bool& opens, bool& closes) const {
+    opens = closes = false;
+    for (const auto& bracket : brackets(line)) {
+        if (bracket.kind != Kind::Curly) continue;
+        if (bracket.open) opens = true;
+        else closes = true;
+    }
+}
+
+// First line at or after from (within the subtree whose first line is
+// base) where depth plus the line's running sum goes below zero; depth
+// takes the sums of the lines passed over
+size_t BracketIndex::find_forward(uint32_t index, size_t base, size_t from, size_t kind, int32_t& depth) const {
+    if (index == kNil) return kNotFound;
+    const Node& node = nodes_[index];
+    if (base + node.size <= from) return kNotFound;
+    if (base >= from && depth + node.tree[kind].min_prefix >= 0) {
+        depth += node.tree[kind].delta;
+        return kNotFound;
+    }
+    size_t found = find_forward(node.left, base, from, kind, depth);
+    if (found != kNotFound) return found;
+    size_t self = base + size(node.left);
+    if (self >= from) {
+        if (depth + node.line[kind].min_prefix < 0) return self;
+        depth += node.line[kind].delta;
+    }
+    return find_forward(node.right, self + 1, from, kind, depth);
+}
+
+// Last line at or before last where sum plus a suffix of the line reaches
+// one - an open bracket nothing after it closes
+size_t BracketIndex::find_backward(uint32_t index, size_t base, size_t last, size_t kind, int32_t& sum) const {
+    if (index == kNil || base > last) return kNotFound;
+    const Node& node = nodes_[index];
+    if (base + node.size - 1 <= last && sum + node.tree[kind].max_suffix() < 1) {
+        sum += node.tree[kind].delta;
+        return kNotFound;
+    }
+    size_t self = base + size(node.left);
+    size_t found = find_backward(node.right, self + 1, last, kind, sum);
+    if (found != kNotFound) return found;
+    if (self <= last) {
+        if (sum + node.line[kind].max_suffix() >= 1) return self;
+        sum += node.line[kind].delta;
+    }
+    return find_backward(node.left, base, last, kind, sum);
+}
+
+// The close bracket ending the block that is open just after (line, column)
+bool BracketIndex::close_after(size_t line, size_t column, Kind kind, size_t& close_line, size_t& close_column) const {
+    int32_t depth = 0;
+    size_t at = line;
+    for (;;) {
+        for (const auto& bracket : brackets(at)) {
+            if (bracket.kind != kind || (at == line && bracket.column <= column)) continue;
+            depth += bracket.open ? 1 : -1;
+            if (depth < 0) {
+                close_line = at;
+                close_column = bracket.column;
+                return true;
+            }
+        }
+        if (at != line) return false;   // The descent said this line would do it
+        at = find_forward(root_, 0, line + 1, static_cast<size_t>(kind), depth);
+        if (at == kNotFound) return false;
+    }
+}
+
+// The open bracket of the block a position before (line, column) is in
+bool BracketIndex::open_before(size_t line, size_t column, Kind kind, size_t& open_line, size_t& open_column) const {
+    int32_t sum = 0;
+    size_t at = line;
+    for (;;) {
+        const auto& list = brackets(at);
+        for (auto it = list.rbegin(); it != list.rend(); ++it) {
+            if (it->kind != kind || (at == line && it->column >= column)) continue;
+            sum += it->open ? 1 : -1;
+            if (sum > 0) {
+                open_line = at;
+                open_column = it->column;
+                return true;
+            }
+        }
+        if (at != line || line == 0) return false;
+        at = find_backward(root_, 0, line - 1, static_cast<size_t>(kind), sum);
+        if (at == kNotFound) return false;
+    }
+}
+
+bool BracketIndex::match(size_t line, size_t column, Pair& out) const {
+    const auto& list = brackets(line);
+    auto it = std::lower_bound(list.begin(), list.end(), column,
+                               [](const Bracket& bracket, size_t c) { return bracket.column < c; });
+    if (it == list.end() || it->column != column) return false;
+    out.kind = it->kind;
+    if (it->open) {
+        out.open_line = line;
+        out.open_column = column;
+        return close_after(line, column, it->kind, out.close_line, out.close_column);
+    }
+    out.close_line = line;
+    out.close_column = column;
+    return open_before(line, column, it->kind, out.open_line, out.open_column);
+}
+
+bool BracketIndex::enclosing(size_t line, size_t column, Kind kind, Pair& out) const {
+    out.kind = kind;
+    return open_before(line, column, kind, out.open_line, out.open_column) &&
+           close_after(out.open_line, out.open_column, kind, out.close_line, out.close_column);
+}
+
+bool BracketIndex::enclosing(size_t line, size_t column, Pair& out) const {
+    bool found = false;
+    for (size_t k = 0; k < kKinds; ++k) {
+        Pair pair;
+        if (!enclosing(line, column, static_cast<Kind>(k), pair)) continue;
+        // Innermost: the latest open
+        if (!found || pair.open_line > out.open_line ||
+            (pair.open_line == out.open_line && pair.open_column > out.open_column)) {
+            out = pair;
+            found = true;
+        }
+    }
+    return found;
+}
+
+void BracketIndex::headers(size_t line, std::vector<size_t>& out) const {
+    out.clear();
+    Pair pair;
+    size_t column = 0;
+    while (enclosing(line, column, Kind::Curly, pair)) {
+        if (out.empty() || out.back() != pair.open_line) out.push_back(pair.open_line);
+        line = pair.open_line;
+        column = pair.open_column;
+    }
+    std::reverse(out.begin(), out.end());
+}
+
+// Sum of the first count lines of a subtree
+BracketIndex::Summary BracketIndex::prefix(uint32_t index, size_t count, size_t kind) const {
+    Summary s;
+    while (index != kNil && count > 0) {
+        const Node& node = nodes_[index];
+        if (count >= node.size) return combine(s, node.tree[kind]);
+        size_t left_size = size(node.left);
+        if (count <= left_size) {
+            index = node.left;
+            continue;
+        }
+        if (node.left != kNil) s = combine(s, nodes_[node.left].tree[kind]);
+        s = combine(s, node.line[kind]);
+        count -= left_size + 1;
+        index = node.right;
+    }
+    return s;
+}
+
+size_t BracketIndex::depth(size_t line, size_t column, Kind kind) const {
+    Summary s = prefix(root_, line, static_cast<size_t>(kind));
+    for (const auto& bracket : brackets(line)) {
+        if (bracket.column >= column) break;
+        if (bracket.kind != kind) continue;
+        Summary one;
+        one.delta = bracket.open ? 1 : -1;
+        one.min_prefix = (std::min)(0, one.delta);
+        s = combine(s, one);
+    }
+    // Closes without an open below them don't count
+    return static_cast<size_t>(s.delta - s.min_prefix);
+}
+
+size_t BracketIndex::get_memory_bytes() const {
+    size_t bytes = nodes_.capacity() * sizeof(Node) + free_.capacity() * sizeof(uint32_t);
+    for (const auto& node : nodes_) bytes += node.brackets.capacity() * sizeof(Bracket);
+    return bytes;
+}
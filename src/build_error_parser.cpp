@@ -1,31 +1,159 @@
 #include "build_error_parser.h"
-#include <regex>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool is_alpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+// Digits at pos, advancing it; false when there are none
+bool scan_number(std::string_view text, size_t& pos, int& value) {
+    size_t start = pos;
+    int result = 0;
+    while (pos < text.size() && is_digit(text[pos])) {
+        if (result < 100000000) result = result * 10 + (text[pos] - '0');
+        ++pos;
+    }
+    value = result;
+    return pos > start;
+}
+
+bool consume(std::string_view text, size_t& pos, std::string_view expected) {
+    if (text.substr(pos, expected.size()) != expected) return false;
+    pos += expected.size();
+    return true;
+}
+
+// "kind: message" or, where codes are allowed, "kind CODE: message"
+bool scan_kind_and_message(std::string_view text, size_t pos, bool allow_code, BuildError& error) {
+    static const struct { std::string_view word; const char* type; } kinds[] = {
+        {"fatal error", "error"},
+        {"error", "error"},
+        {"warning", "warning"},
+        {"note", "note"},
+    };
+    const char* type = nullptr;
+    for (const auto& kind : kinds) {
+        if (consume(text, pos, kind.word)) {
+            type = kind.type;
+            break;
+        }
+    }
+    if (!type) return false;
+    if (allow_code && pos < text.size() && text[pos] == ' ') {
+        size_t code = pos + 1;
+        while (code < text.size() && (is_alpha(text[code]) || is_digit(text[code]))) ++code;
+        if (code > pos + 1) pos = code;
+    }
+    if (!consume(text, pos, ": ") || pos == text.size()) return false;
+    error.type = type;
+    error.message.assign(text.substr(pos));
+    return true;
+}
+
+// file:line[:column]: kind: message (GCC, Clang)
+bool parse_gcc(std::string_view line, BuildError& error) {
+    // A drive letter's colon is part of the file name
+    size_t from = 0;
+    if (line.size() > 2 && is_alpha(line[0]) && line[1] == ':' && (line[2] == '\\' || line[2] == '/')) {
+        from = 2;
+    }
+    for (size_t colon = line.find(':', from); colon != std::string_view::npos; colon = line.find(':', colon + 1)) {
+        size_t pos = colon + 1;
+        int line_number = 0;
+        if (!scan_number(line, pos, line_number) || pos == line.size() || line[pos] != ':') continue;
+        if (colon == 0) return false;
+        ++pos;
+        int column = 0;
+        size_t after_column = pos;
+        if (scan_number(line, after_column, column) && after_column < line.size() && line[after_column] == ':') {
+            pos = after_column + 1;
+        } else {
+            column = 0;
+        }
+        if (!consume(line, pos, " ") || !scan_kind_and_message(line, pos, false, error)) return false;
+        error.file.assign(line.substr(0, colon));
+        error.line = line_number;
+        error.column = column;
+        return true;
+    }
+    return false;
+}
+
+// file(line[,column]): kind CODE: message (MSVC)
+bool parse_msvc(std::string_view line, BuildError& error) {
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string_view::npos) return false;
+    line.remove_prefix(start);
+    // Paths may hold parentheses of their own ("Program Files (x86)")
+    for (size_t paren = line.find('('); paren != std::string_view::npos; paren = line.find('(', paren + 1)) {
+        size_t pos = paren + 1;
+        int line_number = 0;
+        if (!scan_number(line, pos, line_number)) continue;
+        int column = 0;
+        if (pos < line.size() && line[pos] == ',' && !scan_number(line, ++pos, column)) continue;
+        if (!consume(line, pos, "): ")) continue;
+        if (paren == 0 || !scan_kind_and_message(line, pos, true, error)) return false;
+        error.file.assign(line.substr(0, paren));
+        error.line = line_number;
+        error.column = column;
+        return true;
+    }
+    return false;
+}
+
+} // namespace
+
+BuildErrorParser::BuildErrorParser(ErrorCallback on_error)
+    : on_error_(std::move(on_error)) {}
+
+void BuildErrorParser::feed(const char* data, size_t size) {
+    const char* end = data + size;
+    while (data < end) {
+        const char* newline = static_cast<const char*>(memchr(data, '\n', end - data));
+        if (!newline) {
+            partial_.append(data, end);
+            return;
+        }
+        if (partial_.empty()) {
+            parse_complete_line(std::string_view(data, newline - data));
+        } else {
+            partial_.append(data, newline);
+            parse_complete_line(partial_);
+            partial_.clear();
+        }
+        data = newline + 1;
+    }
+}
+
+void BuildErrorParser::finish() {
+    if (!partial_.empty()) {
+        parse_complete_line(partial_);
+        partial_.clear();
+    }
+}
+
+void BuildErrorParser::parse_complete_line(std::string_view line) {
+    BuildError error;
+    if (!parse_line(line, error)) return;
+    errors_.push_back(std::move(error));
+    if (on_error_) on_error_(errors_.back());
+}
+
+bool BuildErrorParser::parse_line(std::string_view line, BuildError& error) {
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    return parse_gcc(line, error) || parse_msvc(line, error);
+}
 
 std::vector<BuildError> BuildErrorParser::parse(const std::string& build_output) {
-    std::vector<BuildError> errors;
-    std::regex gcc_clang_regex(R"(([^:\n]+):(\d+):(\d+): (error|warning|note): (.+))");
-    std::smatch match;
-    std::string::const_iterator searchStart(build_output.cbegin());
-    while (std::regex_search(searchStart, build_output.cend(), match, gcc_clang_regex)) {
-        BuildError err;
-        err.file = match[1];
-        err.line = std::stoi(match[2]);
-        err.type = match[4];
-        err.message = match[5];
-        errors.push_back(err);
-        searchStart = match.suffix().first;
-    }
-    // MSVC style: file(line): error|warning|note Cxxxx: message
-    std::regex msvc_regex(R"(([^\(\)]+)\((\d+)\): (error|warning|note) [A-Za-z0-9]+: (.+))");
-    searchStart = build_output.cbegin();
-    while (std::regex_search(searchStart, build_output.cend(), match, msvc_regex)) {
-        BuildError err;
-        err.file = match[1];
-        err.line = std::stoi(match[2]);
-        err.type = match[3];
-        err.message = match[4];
-        errors.push_back(err);
-        searchStart = match.suffix().first;
-    }
-    return errors;
+    BuildErrorParser parser;
+    parser.feed(build_output);
+    parser.finish();
+    return parser.errors_;
 }
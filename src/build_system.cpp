@@ -1,8 +1,6 @@
 #include "build_system.h"
 #include <filesystem>
-#include <cstdlib>
-#include <iostream>
-#include <sstream>
+#include "platform_process.h"
 
 BuildSystem::BuildSystem(const std::string& workspace_root)
     : root_(workspace_root), type_(detect_in_dir(workspace_root)) {}
@@ -42,18 +40,31 @@ std::vector<BuildCommand> BuildSystem::get_default_commands() const {
     return cmds;
 }
 
-void BuildSystem::run_command(const BuildCommand& cmd, std::function<void(const std::string& output)> on_output) {
-    std::string full_cmd = "cd " + cmd.working_dir + " && " + cmd.command;
-    std::array<char, 128> buffer;
-    std::string result;
-    FILE* pipe = _popen(full_cmd.c_str(), "r");
-    if (!pipe) {
-        on_output("Failed to run command: " + full_cmd);
-        return;
+int BuildSystem::run_command(const BuildCommand& cmd, std::function<void(const std::string& output)> on_output) {
+    editor::ProcessOptions options;
+    options.working_directory = cmd.working_dir;
+    options.hide_window = true;
+    options.io.redirect_stdout = true;
+    options.io.merge_stderr_to_stdout = true;
+#ifdef _WIN32
+    std::string shell = editor::ProcessUtils::get_shell();
+    std::vector<std::string> args = {"/c", cmd.command};
+#else
+    // Not $SHELL: build commands are written for a POSIX shell
+    std::string shell = "/bin/sh";
+    std::vector<std::string> args = {"-c", cmd.command};
+#endif
+    editor::PlatformProcess process;
+    if (!process.start(shell, args, options)) {
+        on_output("Failed to run command: " + cmd.command + "\n");
+        return -1;
     }
-    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-        result += buffer.data();
+    std::string chunk;
+    while (process.read_stdout(chunk, -1)) {
+        on_output(chunk);
+        chunk.clear();
     }
-    _pclose(pipe);
-    on_output(result);
+    editor::ProcessExit exit_info{};
+    if (!process.wait(exit_info)) return -1;
+    return exit_info.exit_code;
 }
@@ -0,0 +1,344 @@
+#include "code_folding.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+
+bool by_start(const FoldRegion& a, const FoldRegion& b) {
+    return a.start_line < b.start_line;
+}
+
+} // namespace
+
+CodeFoldingManager::~CodeFoldingManager() {
+    if (document_) document_->remove_change_listener(listener_id_);
+}
+
+CodeFoldingManager::LineFacts CodeFoldingManager::scan_line(std::string_view line) {
+    LineFacts facts;
+    size_t start = 0;
+    for (; start < line.size(); ++start) {
+        if (line[start] == ' ') facts.indent++;
+        else if (line[start] == '\t') facts.indent += 4;
+        else break;
+    }
+    size_t end = line.size();
+    while (end > start && (line[end - 1] == ' ' || line[end - 1] == '\t' || line[end - 1] == '\r' || line[end - 1] == '\n')) {
+        end--;
+    }
+    std::string_view trimmed = line.substr(start, end - start);
+    // Empty lines and line comments never open or close a region
+    if (trimmed.empty() || (trimmed.size() >= 2 && trimmed[0] == '/' && trimmed[1] == '/')) return facts;
+    if (trimmed.find('{') != std::string_view::npos) facts.flags |= kOpens;
+    if (trimmed.find('}') != std::string_view::npos) facts.flags |= kCloses;
+    return facts;
+}
+
+CodeFoldingManager::LineFacts CodeFoldingManager::line_facts(size_t line, std::string_view text) const {
+    LineFacts facts = scan_line(text);
+    if (source_ && document_) {
+        bool opens, closes;
+        source_->line_braces(line, opens, closes);
+        facts.flags = (opens ? kOpens : 0) | (closes ? kCloses : 0);
+    }
+    return facts;
+}
+
+void CodeFoldingManager::analyze_document(const std::vector<std::string>& lines) {
+    if (document_) document_->remove_change_listener(listener_id_);
+    document_.reset();
+    if (source_) source_->attach(nullptr);
+    facts_.clear();
+    facts_.reserve(lines.size());
+    for (const auto& line : lines) facts_.push_back(scan_line(line));
+    rebuild_regions();
+}
+
+void CodeFoldingManager::set_document(const std::shared_ptr<PieceTable>& document) {
+    if (document == document_) return;
+    if (document_) document_->remove_change_listener(listener_id_);
+    document_ = document;
+    listener_id_ = 0;
+    facts_.clear();
+    if (source_) source_->attach(document_);
+    if (document_) {
+        facts_.reserve(document_->get_line_count());
+        auto cursor = document_->lines();
+        std::string_view line;
+        while (cursor.next(line)) facts_.push_back(line_facts(cursor.line_number(), line));
+        listener_id_ = document_->add_change_listener([this](const PieceTable::Change& change) {
+            on_change(change);
+        });
+    }
+    rebuild_regions();
+}
+
+void CodeFoldingManager::set_line_source(std::shared_ptr<FoldLineSource> source) {
+    if (source_) source_->attach(nullptr);
+    source_ = std::move(source);
+    if (!document_) return;
+    auto state = get_fold_state();
+    auto document = document_;
+    set_document(nullptr);
+    set_document(document);
+    restore_fold_state(state);
+}
+
+bool CodeFoldingManager::detect_regions(size_t first, size_t last, bool strict, std::vector<FoldRegion>& out) const {
+    std::vector<size_t> brace_stack;  // Stack of opening brace line numbers
+    for (size_t i = first; i <= last && i < facts_.size(); ++i) {
+        const LineFacts& facts = facts_[i];
+        if (facts.flags & kOpens) brace_stack.push_back(i);
+        if (facts.flags & kCloses) {
+            if (brace_stack.empty()) {
+                if (strict) return false;
+                continue;
+            }
+            size_t start_line = brace_stack.back();
+            brace_stack.pop_back();
+            // Only create region if it spans multiple lines
+            if (i > start_line + 1) out.emplace_back(start_line, i, facts_[start_line].indent);
+        }
+    }
+    return !strict || brace_stack.empty();
+}
+
+bool CodeFoldingManager::is_balanced(const std::vector<LineFacts>& facts, size_t first, size_t last) {
+    size_t depth = 0;
+    for (size_t i = first; i <= last && i < facts.size(); ++i) {
+        if (facts[i].flags & kOpens) depth++;
+        if (facts[i].flags & kCloses) {
+            if (depth == 0) return false;
+            depth--;
+        }
+    }
+    return depth == 0;
+}
+
+void CodeFoldingManager::rebuild_regions() {
+    regions_.clear();
+    if (!facts_.empty()) detect_regions(0, facts_.size() - 1, false, regions_);
+    std::sort(regions_.begin(), regions_.end(), by_start);
+    rebuild_hidden();
+}
+
+void CodeFoldingManager::on_change(const PieceTable::Change& change) {
+    size_t first = change.first_line;
+    size_t old_last = first + change.removed_newlines;
+    size_t new_last = first + change.inserted_newlines;
+    if (old_last >= facts_.size()) {
+        // Edit past what was scanned (e.g. lines still being indexed): start over
+        auto state = get_fold_state();
+        auto document = document_;
+        set_document(nullptr);
+        set_document(document);
+        restore_fold_state(state);
+        return;
+    }
+    if (source_) source_->apply(change);
+    auto shift = [&](size_t line) { return line - old_last + new_last; };
+
+    // Lines whose regions are re-derived: the edit plus every region touching it.
+    // Regions nest, so everything else lies wholly before or after this span.
+    size_t span_first = first;
+    size_t span_last = old_last;
+    for (const auto& region : regions_) {
+        if (region.start_line > old_last) break;
+        if (region.end_line >= first) {
+            span_first = (std::min)(span_first, region.start_line);
+            span_last = (std::max)(span_last, region.end_line);
+        }
+    }
+    bool old_balanced = is_balanced(facts_, span_first, span_last);
+
+    // Folded regions of the span, keyed by where their header line is now
+    std::map<size_t, bool> span_state;
+    auto before_end = std::lower_bound(regions_.begin(), regions_.end(), FoldRegion(span_first, span_first), by_start);
+    auto after_begin = std::upper_bound(before_end, regions_.end(), FoldRegion(span_last, span_last), by_start);
+    for (auto it = before_end; it != after_begin; ++it) {
+        if (!it->is_folded) continue;
+        if (it->start_line < first) span_state[it->start_line] = true;
+        else if (it->start_line > old_last) span_state[shift(it->start_line)] = true;
+        else if (it->start_line == first) span_state[first] = true;
+    }
+
+    // Only the edited lines are read back from the document
+    std::vector<LineFacts> fresh;
+    fresh.reserve(new_last - first + 1);
+    for (size_t line = first; line <= new_last; ++line) fresh.push_back(line_facts(line, document_->get_line(line)));
+    facts_.erase(facts_.begin() + first, facts_.begin() + old_last + 1);
+    facts_.insert(facts_.begin() + first, fresh.begin(), fresh.end());
+
+    // A comment or string the edit opened or closed changes braces below it
+    bool moved = false;
+    if (source_) {
+        size_t end = (std::min)(source_->changed_end(), facts_.size());
+        for (size_t line = new_last + 1; line < end; ++line) {
+            uint8_t flags = line_facts(line, std::string_view()).flags;
+            if (facts_[line].flags != flags) {
+                facts_[line].flags = flags;
+                moved = true;
+            }
+        }
+    }
+
+    std::vector<FoldRegion> derived;
+    if (moved || !old_balanced || !detect_regions(span_first, shift(span_last), true, derived)) {
+        // The edit changed which braces pair up outside the span
+        std::map<size_t, bool> state;
+        for (const auto& region : regions_) {
+            if (!region.is_folded) continue;
+            if (region.start_line < first) state[region.start_line] = true;
+            else if (region.start_line > old_last) state[shift(region.start_line)] = true;
+        }
+        rebuild_regions();
+        restore_fold_state(state);
+        return;
+    }
+
+    std::sort(derived.begin(), derived.end(), by_start);
+    for (auto& region : derived) {
+        region.is_folded = span_state.count(region.start_line) != 0;
+    }
+    for (auto it = after_begin; it != regions_.end(); ++it) {
+        it->start_line = shift(it->start_line);
+        it->end_line = shift(it->end_line);
+    }
+    size_t at = before_end - regions_.begin();
+    regions_.erase(before_end, after_begin);
+    regions_.insert(regions_.begin() + at, derived.begin(), derived.end());
+    rebuild_hidden();
+}
+
+void CodeFoldingManager::rebuild_hidden() {
+    hidden_.clear();
+    size_t hidden = 0;
+    for (const auto& region : regions_) {
+        if (!region.is_folded || region.end_line <= region.start_line) continue;
+        // Inside an outer folded region: already hidden
+        if (!hidden_.empty() && region.start_line <= hidden_.back().last) continue;
+        hidden_.push_back({region.start_line + 1, region.end_line, hidden});
+        hidden += region.end_line - region.start_line;
+    }
+}
+
+FoldRegion* CodeFoldingManager::find_region(size_t line) {
+    auto it = std::lower_bound(regions_.begin(), regions_.end(), FoldRegion(line, line), by_start);
+    return it != regions_.end() && it->start_line == line ? &*it : nullptr;
+}
+
+const FoldRegion* CodeFoldingManager::get_region_at_line(size_t line) const {
+    return const_cast<CodeFoldingManager*>(this)->find_region(line);
+}
+
+bool CodeFoldingManager::toggle_fold(size_t line) {
+    FoldRegion* region = find_region(line);
+    if (!region) return false;
+    region->is_folded = !region->is_folded;
+    rebuild_hidden();
+    return true;
+}
+
+void CodeFoldingManager::fold(size_t line) {
+    if (FoldRegion* region = find_region(line)) {
+        region->is_folded = true;
+        rebuild_hidden();
+    }
+}
+
+void CodeFoldingManager::unfold(size_t line) {
+    if (FoldRegion* region = find_region(line)) {
+        region->is_folded = false;
+        rebuild_hidden();
+    }
+}
+
+void CodeFoldingManager::fold_all() {
+    for (auto& region : regions_) region.is_folded = true;
+    rebuild_hidden();
+}
+
+void CodeFoldingManager::unfold_all() {
+    for (auto& region : regions_) region.is_folded = false;
+    hidden_.clear();
+}
+
+bool CodeFoldingManager::is_line_visible(size_t line) const {
+    auto it = std::upper_bound(hidden_.begin(), hidden_.end(), line,
+                               [](size_t l, const HiddenRange& range) { return l < range.first; });
+    if (it == hidden_.begin()) return true;
+    return line > (--it)->last;
+}
+
+size_t CodeFoldingManager::visible_line_count(size_t total_lines) const {
+    size_t hidden = 0;
+    for (auto it = hidden_.rbegin(); it != hidden_.rend(); ++it) {
+        // Ranges normally end inside the document; clip the ones that don't
+        if (it->first >= total_lines) continue;
+        hidden = it->hidden_before + ((std::min)(it->last, total_lines - 1) - it->first + 1);
+        break;
+    }
+    return total_lines - hidden;
+}
+
+size_t CodeFoldingManager::display_to_document_line(size_t display_line) const {
+    // first - hidden_before is the display line just past each fold header
+    auto it = std::upper_bound(hidden_.begin(), hidden_.end(), display_line,
+                               [](size_t v, const HiddenRange& range) { return v < range.first - range.hidden_before; });
+    if (it == hidden_.begin()) return display_line;
+    --it;
+    return display_line + it->hidden_before + it->count();
+}
+
+size_t CodeFoldingManager::document_to_display_line(size_t line) const {
+    auto it = std::upper_bound(hidden_.begin(), hidden_.end(), line,
+                               [](size_t l, const HiddenRange& range) { return l < range.first; });
+    if (it == hidden_.begin()) return line;
+    --it;
+    if (line <= it->last) return it->first - 1 - it->hidden_before;
+    return line - it->hidden_before - it->count();
+}
+
+size_t CodeFoldingManager::next_visible_line(size_t line) const {
+    auto it = std::upper_bound(hidden_.begin(), hidden_.end(), line,
+                               [](size_t l, const HiddenRange& range) { return l < range.first; });
+    if (it == hidden_.begin()) return line;
+    --it;
+    return line <= it->last ? it->last + 1 : line;
+}
+
+size_t CodeFoldingManager::visible_run_end(size_t line) const {
+    auto it = std::upper_bound(hidden_.begin(), hidden_.end(), line,
+                               [](size_t l, const HiddenRange& range) { return l < range.first; });
+    return it == hidden_.end() ? SIZE_MAX : it->first;
+}
+
+std::vector<size_t> CodeFoldingManager::get_visible_lines(size_t total_lines) const {
+    std::vector<size_t> visible;
+    visible.reserve(visible_line_count(total_lines));
+    size_t line = 0;
+    for (const auto& range : hidden_) {
+        for (; line < range.first && line < total_lines; ++line) visible.push_back(line);
+        line = range.last + 1;
+    }
+    for (; line < total_lines; ++line) visible.push_back(line);
+    return visible;
+}
+
+std::map<size_t, bool> CodeFoldingManager::get_fold_state() const {
+    std::map<size_t, bool> state;
+    for (const auto& region : regions_) {
+        state[region.start_line] = region.is_folded;
+    }
+    return state;
+}
+
+void CodeFoldingManager::restore_fold_state(const std::map<size_t, bool>& state) {
+    for (auto& region : regions_) {
+        auto it = state.find(region.start_line);
+        if (it != state.end()) {
+            region.is_folded = it->second;
+        }
+    }
+    rebuild_hidden();
+}
@@ -0,0 +1,372 @@
+#include "column_layout.h"
+#include "piece_table.h"
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define COLUMN_LAYOUT_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define COLUMN_LAYOUT_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace editor {
+
+namespace {
+
+struct Range {
+    uint32_t first;
+    uint32_t last;
+};
+
+// Combining marks, joiners, variation selectors, emoji modifiers, Hangul
+// medial and final jamo, tags - and format characters, which join nothing
+const Range kZeroWidth[] = {
+    {0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF}, {0x05C1, 0x05C2},
+    {0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0610, 0x061A}, {0x064B, 0x065F}, {0x0670, 0x0670},
+    {0x06D6, 0x06DC}, {0x06DF, 0x06E4}, {0x06E7, 0x06E8}, {0x06EA, 0x06ED}, {0x0711, 0x0711},
+    {0x0730, 0x074A}, {0x07A6, 0x07B0}, {0x07EB, 0x07F3}, {0x0816, 0x082D}, {0x0859, 0x085B},
+    {0x08D3, 0x08E1}, {0x08E3, 0x0902}, {0x093A, 0x093A}, {0x093C, 0x093C}, {0x0941, 0x0948},
+    {0x094D, 0x094D}, {0x0951, 0x0957}, {0x0962, 0x0963}, {0x0981, 0x0981}, {0x09BC, 0x09BC},
+    {0x09C1, 0x09C4}, {0x09CD, 0x09CD}, {0x09E2, 0x09E3}, {0x0A01, 0x0A02}, {0x0A3C, 0x0A3C},
+    {0x0A41, 0x0A51}, {0x0A70, 0x0A71}, {0x0A75, 0x0A75}, {0x0A81, 0x0A82}, {0x0ABC, 0x0ABC},
+    {0x0AC1, 0x0AC8}, {0x0ACD, 0x0ACD}, {0x0AE2, 0x0AE3}, {0x0B01, 0x0B01}, {0x0B3C, 0x0B3C},
+    {0x0B3F, 0x0B3F}, {0x0B41, 0x0B44}, {0x0B4D, 0x0B4D}, {0x0BC0, 0x0BC0}, {0x0BCD, 0x0BCD},
+    {0x0C3E, 0x0C40}, {0x0C46, 0x0C56}, {0x0CBC, 0x0CBC}, {0x0CCC, 0x0CCD}, {0x0D41, 0x0D44},
+    {0x0D4D, 0x0D4D}, {0x0DCA, 0x0DCA}, {0x0DD2, 0x0DD6}, {0x0E31, 0x0E31}, {0x0E34, 0x0E3A},
+    {0x0E47, 0x0E4E}, {0x0EB1, 0x0EB1}, {0x0EB4, 0x0EBC}, {0x0EC8, 0x0ECD}, {0x0F18, 0x0F19},
+    {0x0F35, 0x0F35}, {0x0F37, 0x0F37}, {0x0F39, 0x0F39}, {0x0F71, 0x0F7E}, {0x0F80, 0x0F84},
+    {0x0F86, 0x0F87}, {0x0F8D, 0x0FBC}, {0x102D, 0x1030}, {0x1032, 0x1037}, {0x1039, 0x103A},
+    {0x1160, 0x11FF}, {0x135D, 0x135F}, {0x1712, 0x1714}, {0x17B4, 0x17B5}, {0x17B7, 0x17BD},
+    {0x17C6, 0x17C6}, {0x17C9, 0x17D3}, {0x180B, 0x180D}, {0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF},
+    {0x200B, 0x200F}, {0x202A, 0x202E}, {0x2060, 0x2064}, {0x20D0, 0x20F0}, {0x2CEF, 0x2CF1},
+    {0x2DE0, 0x2DFF}, {0x302A, 0x302D}, {0x3099, 0x309A}, {0xA66F, 0xA672}, {0xA674, 0xA67D},
+    {0xA69E, 0xA69F}, {0xA6F0, 0xA6F1}, {0xA802, 0xA802}, {0xA806, 0xA806}, {0xA80B, 0xA80B},
+    {0xA825, 0xA826}, {0xA8C4, 0xA8C5}, {0xA8E0, 0xA8F1}, {0xD7B0, 0xD7FF}, {0xFB1E, 0xFB1E},
+    {0xFE00, 0xFE0F}, {0xFE20, 0xFE2F}, {0xFEFF, 0xFEFF}, {0x1F3FB, 0x1F3FF}, {0xE0001, 0xE0001},
+    {0xE0020, 0xE007F}, {0xE0100, 0xE01EF},
+};
+
+// East Asian Wide and Fullwidth, and emoji shown as such by default
+const Range kWide[] = {
+    {0x1100, 0x115F}, {0x231A, 0x231B}, {0x2329, 0x232A}, {0x23E9, 0x23EC}, {0x23F0, 0x23F0},
+    {0x23F3, 0x23F3}, {0x25FD, 0x25FE}, {0x2614, 0x2615}, {0x2648, 0x2653}, {0x267F, 0x267F},
+    {0x2693, 0x2693}, {0x26A1, 0x26A1}, {0x26AA, 0x26AB}, {0x26BD, 0x26BE}, {0x26C4, 0x26C5},
+    {0x26CE, 0x26CE}, {0x26D4, 0x26D4}, {0x26EA, 0x26EA}, {0x26F2, 0x26F3}, {0x26F5, 0x26F5},
+    {0x26FA, 0x26FA}, {0x26FD, 0x26FD}, {0x2705, 0x2705}, {0x270A, 0x270B}, {0x2728, 0x2728},
+    {0x274C, 0x274C}, {0x274E, 0x274E}, {0x2753, 0x2755}, {0x2757, 0x2757}, {0x2795, 0x2797},
+    {0x27B0, 0x27B0}, {0x27BF, 0x27BF}, {0x2B1B, 0x2B1C}, {0x2B50, 0x2B50}, {0x2B55, 0x2B55},
+    {0x2E80, 0x303E}, {0x3041, 0x33FF}, {0x3400, 0x4DBF}, {0x4E00, 0x9FFF}, {0xA000, 0xA4CF},
+    {0xA960, 0xA97F}, {0xAC00, 0xD7A3}, {0xF900, 0xFAFF}, {0xFE10, 0xFE19}, {0xFE30, 0xFE6F},
+    {0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x16FE0, 0x16FE4}, {0x17000, 0x18AFF}, {0x1B000, 0x1B2FF},
+    {0x1F004, 0x1F004}, {0x1F0CF, 0x1F0CF}, {0x1F18E, 0x1F18E}, {0x1F191, 0x1F19A}, {0x1F200, 0x1F251},
+    {0x1F300, 0x1F64F}, {0x1F680, 0x1F6FF}, {0x1F7E0, 0x1F7EB}, {0x1F90C, 0x1F9FF}, {0x1FA70, 0x1FAFF},
+    {0x20000, 0x2FFFD}, {0x30000, 0x3FFFD},
+};
+
+template <size_t N>
+bool in_table(const Range (&table)[N], uint32_t codepoint) {
+    if (codepoint < table[0].first || codepoint > table[N - 1].last) return false;
+    const Range* it = std::upper_bound(table, table + N, codepoint,
+                                       [](uint32_t cp, const Range& range) { return cp < range.first; });
+    return it != table && codepoint <= (it - 1)->last;
+}
+
+const uint32_t kZeroWidthJoiner = 0x200D;
+
+bool is_regional_indicator(uint32_t codepoint) {
+    return codepoint >= 0x1F1E6 && codepoint <= 0x1F1FF;
+}
+
+// Zero-width characters that stand alone rather than extend the cluster
+// before them (spaces, direction marks, the BOM)
+bool is_format(uint32_t codepoint) {
+    return (codepoint >= 0x200B && codepoint <= 0x200F && codepoint != 0x200C) ||
+           (codepoint >= 0x202A && codepoint <= 0x202E) || (codepoint >= 0x2060 && codepoint <= 0x2064) ||
+           codepoint == 0xFEFF;
+}
+
+// Longer runs of marks ("zalgo" text) are split into several clusters
+const size_t kMaxClusterBytes = 256;
+// Bytes held back at the end of a read, since the next may continue
+// their cluster: the longest cluster and the codepoint after it
+const size_t kCarry = kMaxClusterBytes + 4;
+
+// Spans of the clusters of text that start before limit; column is the
+// display column of text[0] and moves past them. Returns the bytes taken.
+size_t add_spans(const char* text, size_t length, size_t limit, size_t base, size_t tab_width, size_t& column,
+                 std::vector<ColumnLayout::Span>& spans) {
+    size_t i = 0;
+    while (i < limit) {
+        size_t run = ColumnLayout::ascii_run(text + i, limit - i);
+        // The last ASCII byte before something else may take combining marks
+        if (run > 0 && i + run < length) run--;
+        i += run;
+        column += run;
+        if (i >= limit) break;
+        size_t columns = 0;
+        size_t end = ColumnLayout::next_cluster(text, length, i, column, tab_width, columns);
+        if (end - i != 1 || columns != 1) {
+            spans.push_back({static_cast<uint32_t>(base + i), static_cast<uint32_t>(column),
+                             static_cast<uint16_t>(end - i),
+                             static_cast<uint16_t>(columns)});
+        }
+        column += columns;
+        i = end;
+    }
+    return i;
+}
+
+} // namespace
+
+int ColumnLayout::codepoint_width(uint32_t codepoint) {
+    if (codepoint < 0x300) return 1;
+    if (in_table(kZeroWidth, codepoint)) return 0;
+    return in_table(kWide, codepoint) ? 2 : 1;
+}
+
+uint32_t ColumnLayout::decode(const char* text, size_t length, size_t& i) {
+    unsigned char c = static_cast<unsigned char>(text[i++]);
+    if (c < 0x80) return c;
+    int extra = c >= 0xF8 ? -1 : c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC2 ? 1 : -1;
+    if (extra < 0 || i + extra > length) return 0xFFFD;
+    uint32_t codepoint = c & (0x3F >> extra);
+    for (int k = 0; k < extra; ++k) {
+        unsigned char next = static_cast<unsigned char>(text[i + k]);
+        if ((next & 0xC0) != 0x80) return 0xFFFD;
+        codepoint = (codepoint << 6) | (next & 0x3F);
+    }
+    i += extra;
+    return codepoint;
+}
+
+size_t ColumnLayout::next_cluster(const char* text, size_t length, size_t i, size_t column, size_t tab_width,
+                                  size_t& columns) {
+    if (text[i] == '\t') {
+        tab_width = (std::max)(tab_width, size_t(1));
+        columns = tab_width - column % tab_width;
+        return i + 1;
+    }
+    size_t end = i;
+    uint32_t base = decode(text, length, end);
+    int width = codepoint_width(base);
+    if (is_format(base)) {
+        columns = 1;
+        return end;
+    }
+    if (is_regional_indicator(base) && end < length) {
+        // A pair of them is one flag
+        size_t next = end;
+        if (is_regional_indicator(decode(text, length, next))) {
+            end = next;
+            width = 2;
+        }
+    }
+    while (end < length && end - i < kMaxClusterBytes) {
+        size_t next = end;
+        uint32_t codepoint = decode(text, length, next);
+        if (codepoint == kZeroWidthJoiner) {
+            // Joins the next character into the cluster (emoji sequences)
+            end = next;
+            if (end < length && end - i < kMaxClusterBytes) decode(text, length, end);
+        } else if (codepoint >= 0x300 && !is_format(codepoint) && codepoint_width(codepoint) == 0) {
+            end = next;
+        } else {
+            break;
+        }
+    }
+    columns = (std::max)(width, 1);
+    return end;
+}
+
+size_t ColumnLayout::ascii_run(const char* text, size_t length) {
+    size_t i = 0;
+#if defined(COLUMN_LAYOUT_SSE2)
+    const __m128i tab = _mm_set1_epi8('\t');
+    for (; i + 16 <= length; i += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        if (_mm_movemask_epi8(_mm_or_si128(bytes, _mm_cmpeq_epi8(bytes, tab))) != 0) break;
+    }
+#elif defined(COLUMN_LAYOUT_NEON)
+    const uint8x16_t tab = vdupq_n_u8('\t');
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t*>(text + i));
+        if (vmaxvq_u8(vorrq_u8(bytes, vceqq_u8(bytes, tab))) >= 0x80) break;
+    }
+#endif
+    while (i < length) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x80 || c == '\t') break;
+        ++i;
+    }
+    return i;
+}
+
+void ColumnLayout::map_text(const char* text, size_t length, size_t tab_width, LineMap& map) {
+    map.spans.clear();
+    size_t column = 0;
+    map.bytes = static_cast<uint32_t>(add_spans(text, length, length, 0, tab_width, column, map.spans));
+}
+
+size_t ColumnLayout::display_width(const char* text, size_t length, size_t tab_width, size_t start_column) {
+    size_t column = start_column;
+    for (size_t i = 0; i < length;) {
+        size_t run = ascii_run(text + i, length - i);
+        if (run > 0 && i + run < length) run--;
+        i += run;
+        column += run;
+        if (i >= length) break;
+        size_t columns = 0;
+        i = next_cluster(text, length, i, column, tab_width, columns);
+        column += columns;
+    }
+    return column - start_column;
+}
+
+size_t ColumnLayout::fit_columns(const char* text, size_t length, size_t columns, size_t tab_width,
+                                 size_t start_column) {
+    size_t column = start_column;
+    size_t limit = start_column + columns;
+    size_t i = 0;
+    while (i < length && column < limit) {
+        size_t run = (std::min)(ascii_run(text + i, length - i), limit - column);
+        if (run > 0 && i + run < length) run--;
+        i += run;
+        column += run;
+        if (i >= length || column >= limit) break;
+        size_t width = 0;
+        size_t end = next_cluster(text, length, i, column, tab_width, width);
+        if (column + width > limit) break;
+        column += width;
+        i = end;
+    }
+    return i;
+}
+
+size_t ColumnLayout::LineMap::column_of(size_t byte) const {
+    auto it = std::upper_bound(spans.begin(), spans.end(), byte,
+                               [](size_t b, const Span& span) { return b < span.byte; });
+    if (it == spans.begin()) return byte;
+    const Span& span = *(it - 1);
+    if (byte < span.byte + span.bytes) return span.column;
+    return span.column + span.columns + (byte - span.byte - span.bytes);
+}
+
+size_t ColumnLayout::LineMap::byte_at(size_t column) const {
+    auto it = std::upper_bound(spans.begin(), spans.end(), column,
+                               [](size_t c, const Span& span) { return c < span.column; });
+    if (it == spans.begin()) return column;
+    const Span& span = *(it - 1);
+    if (column < span.column + span.columns) return span.byte;
+    return span.byte + span.bytes + (column - span.column - span.columns);
+}
+
+size_t ColumnLayout::LineMap::next_boundary(size_t byte) const {
+    auto it = std::upper_bound(spans.begin(), spans.end(), byte,
+                               [](size_t b, const Span& span) { return b < span.byte; });
+    if (it != spans.begin()) {
+        const Span& span = *(it - 1);
+        if (byte < span.byte + span.bytes) return span.byte + span.bytes;
+    }
+    return byte + 1;
+}
+
+size_t ColumnLayout::LineMap::prev_boundary(size_t byte) const {
+    if (byte == 0) return 0;
+    auto it = std::upper_bound(spans.begin(), spans.end(), byte - 1,
+                               [](size_t b, const Span& span) { return b < span.byte; });
+    if (it != spans.begin()) {
+        const Span& span = *(it - 1);
+        if (byte - 1 < span.byte + span.bytes) return span.byte;
+    }
+    return byte - 1;
+}
+
+ColumnLayout::~ColumnLayout() {
+    if (listened_) listened_->remove_change_listener(listener_id_);
+}
+
+void ColumnLayout::set_document(const std::shared_ptr<TextBuffer>& document) {
+    if (document == document_) return;
+    if (listened_) listened_->remove_change_listener(listener_id_);
+    listened_.reset();
+    listener_id_ = 0;
+    document_ = document;
+    lines_.clear();
+    listened_ = std::dynamic_pointer_cast<PieceTable>(document_);
+    if (listened_) {
+        listener_id_ = listened_->add_change_listener([this](const PieceTable::Change& change) {
+            on_change(change.first_line, change.removed_newlines, change.inserted_newlines);
+        });
+    }
+}
+
+void ColumnLayout::set_tab_width(size_t tab_width) {
+    tab_width = (std::max)(tab_width, size_t(1));
+    if (tab_width == tab_width_) return;
+    tab_width_ = tab_width;
+    lines_.clear();
+}
+
+void ColumnLayout::on_change(size_t first_line, size_t removed_newlines, size_t inserted_newlines) {
+    size_t old_last = first_line + removed_newlines;
+    std::unordered_map<size_t, LineMap> shifted;
+    shifted.reserve(lines_.size());
+    for (auto& entry : lines_) {
+        if (entry.first < first_line) {
+            shifted.emplace(entry.first, std::move(entry.second));
+        } else if (entry.first > old_last) {
+            shifted.emplace(entry.first - removed_newlines + inserted_newlines, std::move(entry.second));
+        }
+    }
+    lines_.swap(shifted);
+}
+
+const ColumnLayout::LineMap& ColumnLayout::line(size_t line) {
+    auto it = lines_.find(line);
+    if (it == lines_.end()) it = lines_.emplace(line, layout_line(line)).first;
+    return it->second;
+}
+
+ColumnLayout::LineMap ColumnLayout::layout_line(size_t line) const {
+    LineMap map;
+    if (!document_ || line >= document_->get_line_count()) return map;
+
+    size_t line_start = document_->get_line_start(line);
+    size_t total = document_->get_total_length();
+    // Bytes read but not yet mapped: the last few of a read may be a
+    // cluster the next read continues
+    std::string pending;
+    size_t base = 0;        // Line offset of pending[0]
+    size_t column = 0;      // Its display column
+    for (size_t offset = 0;;) {
+        bool last = line_start + offset >= total;
+        if (!last) {
+            std::string chunk = document_->get_text(line_start + offset, (std::min)(kReadChunk, total - line_start - offset));
+            offset += chunk.size();
+            size_t newline = chunk.find('\n');
+            if (newline != std::string::npos) chunk.resize(newline);
+            last = chunk.empty() || newline != std::string::npos || line_start + offset >= total;
+            pending += chunk;
+            if (newline != std::string::npos && !pending.empty() && pending.back() == '\r') pending.pop_back();
+        }
+        size_t limit = last ? pending.size() : pending.size() > kCarry ? pending.size() - kCarry : 0;
+        size_t taken = add_spans(pending.data(), pending.size(), limit, base, tab_width_, column, map.spans);
+        pending.erase(0, taken);
+        base += taken;
+        if (last) break;
+    }
+    map.bytes = static_cast<uint32_t>(base + pending.size());
+    return map;
+}
+
+void ColumnLayout::trim(size_t first, size_t last) {
+    size_t low = first > kSlack ? first - kSlack : 0;
+    size_t high = last + kSlack;
+    for (auto it = lines_.begin(); it != lines_.end();) {
+        if (it->first < low || it->first > high) it = lines_.erase(it);
+        else ++it;
+    }
+}
+
+} // namespace editor
@@ -0,0 +1,99 @@
+#include "damage_tracker.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace editor {
+
+namespace {
+
+long long area(const DamageRect& r) {
+    return static_cast<long long>(r.right - r.left) * (r.bottom - r.top);
+}
+
+DamageRect bounds(const DamageRect& a, const DamageRect& b) {
+    return {std::min(a.left, b.left), std::min(a.top, b.top), std::max(a.right, b.right), std::max(a.bottom, b.bottom)};
+}
+
+} // namespace
+
+void DamageTracker::invalidate(const DamageRect& rect) {
+    if (full_ || rect.empty()) return;
+    add(rect);
+}
+
+void DamageTracker::add(DamageRect rect) {
+    // Absorb every rect the union would not waste pixels on (same row or
+    // column band, overlapping or touching); repeat as the union grows
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (size_t i = 0; i < rects_.size(); ++i) {
+            const DamageRect& other = rects_[i];
+            if (other.contains(rect)) return;
+            DamageRect joined = bounds(rect, other);
+            bool touching = rect.left <= other.right && other.left <= rect.right && rect.top <= other.bottom &&
+                            other.top <= rect.bottom;
+            if (touching && area(joined) <= area(rect) + area(other)) {
+                rect = joined;
+                rects_.erase(rects_.begin() + i);
+                merged = true;
+                break;
+            }
+        }
+    }
+    rects_.push_back(rect);
+    if (rects_.size() > kMaxRects) {
+        DamageRect all = rects_[0];
+        for (const DamageRect& r : rects_) all = bounds(all, r);
+        rects_.assign(1, all);
+    }
+}
+
+void DamageTracker::invalidate_all() {
+    full_ = true;
+    rects_.clear();
+    scrolls_.clear();
+}
+
+void DamageTracker::scroll(const DamageRect& area, int dy) {
+    if (full_ || area.empty() || dy == 0) return;
+    int height = area.bottom - area.top;
+    if (std::abs(dy) >= height || scrolls_.size() >= kMaxScrolls) {
+        invalidate(area);
+        return;
+    }
+    // Pending damage inside the area travels with the pixels; the original
+    // spot stays damaged too, which is conservative but never stale
+    std::vector<DamageRect> moved;
+    for (const DamageRect& r : rects_) {
+        if (!r.intersects(area)) continue;
+        DamageRect shifted{std::max(r.left, area.left), std::max(r.top, area.top) + dy,
+                           std::min(r.right, area.right), std::min(r.bottom, area.bottom) + dy};
+        shifted.top = std::max(shifted.top, area.top);
+        shifted.bottom = std::min(shifted.bottom, area.bottom);
+        if (!shifted.empty()) moved.push_back(shifted);
+    }
+    for (const DamageRect& r : moved) add(r);
+    scrolls_.push_back({area, dy});
+    if (dy > 0) {
+        add({area.left, area.top, area.right, area.top + dy});
+    } else {
+        add({area.left, area.bottom + dy, area.right, area.bottom});
+    }
+}
+
+bool DamageTracker::intersects(const DamageRect& rect) const {
+    if (full_) return true;
+    for (const DamageRect& r : rects_) {
+        if (r.intersects(rect)) return true;
+    }
+    return false;
+}
+
+void DamageTracker::clear() {
+    full_ = false;
+    rects_.clear();
+    scrolls_.clear();
+}
+
+} // namespace editor
@@ -0,0 +1,403 @@
+#include "diff_engine.h"
+#include "document_snapshot.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+namespace editor {
+
+namespace {
+
+constexpr uint64_t kFnvOffset = 14695981039346656037ull;
+constexpr uint64_t kFnvPrime = 1099511628211ull;
+constexpr size_t kNone = static_cast<size_t>(-1);
+
+// Lines [a0, a1) of the old side against [b0, b1) of the new side
+struct Region {
+    size_t a0, a1, b0, b1;
+};
+
+// The two sides and their changed-line flags; every region writes only
+// the flags of its own lines
+struct Sides {
+    const uint64_t* a;
+    const uint64_t* b;
+    char* a_changed;
+    char* b_changed;
+};
+
+void mark_changed(const Sides& sides, const Region& r) {
+    std::fill(sides.a_changed + r.a0, sides.a_changed + r.a1, 1);
+    std::fill(sides.b_changed + r.b0, sides.b_changed + r.b1, 1);
+}
+
+// Drop equal lines off both ends; false when nothing differs
+bool trim(const Sides& sides, Region& r) {
+    while (r.a0 < r.a1 && r.b0 < r.b1 && sides.a[r.a0] == sides.b[r.b0]) ++r.a0, ++r.b0;
+    while (r.a0 < r.a1 && r.b0 < r.b1 && sides.a[r.a1 - 1] == sides.b[r.b1 - 1]) --r.a1, --r.b1;
+    return r.a0 < r.a1 || r.b0 < r.b1;
+}
+
+// Linear-space Myers: the furthest-reaching paths are run from both
+// corners at once until they overlap, the region is split at that point
+// and both halves go again. false when the paths need more than
+// kMaxEditCost edits to meet.
+class Myers {
+public:
+    explicit Myers(const Sides& sides) : sides_(sides) {}
+
+    bool run(const Region& region) {
+        stack_.assign(1, region);
+        bool first = true;
+        while (!stack_.empty()) {
+            Region r = stack_.back();
+            stack_.pop_back();
+            if (!trim(sides_, r)) continue;
+            if (r.a0 == r.a1 || r.b0 == r.b1) {
+                mark_changed(sides_, r);
+                continue;
+            }
+            size_t x, y;
+            if (!bisect(r, x, y)) {
+                // Only the whole region can be over the limit; its parts are cheaper
+                if (first) return false;
+                mark_changed(sides_, r);
+                continue;
+            }
+            first = false;
+            stack_.push_back({r.a0 + x, r.a1, r.b0 + y, r.b1});
+            stack_.push_back({r.a0, r.a0 + x, r.b0, r.b0 + y});
+        }
+        return true;
+    }
+
+private:
+    // After Myers' "An O(ND) Difference Algorithm", section 4b, in the form
+    // diff-match-patch uses: paths that run off the grid narrow the range
+    // of diagonals instead of being clamped
+    bool bisect(const Region& r, size_t& split_x, size_t& split_y) {
+        const uint64_t* a = sides_.a + r.a0;
+        const uint64_t* b = sides_.b + r.b0;
+        const ptrdiff_t n = static_cast<ptrdiff_t>(r.a1 - r.a0);
+        const ptrdiff_t m = static_cast<ptrdiff_t>(r.b1 - r.b0);
+        const ptrdiff_t max_d = (std::min)((n + m + 1) / 2, static_cast<ptrdiff_t>(DiffEngine::kMaxEditCost));
+        const ptrdiff_t offset = max_d + 1;
+        const ptrdiff_t length = 2 * offset + 1;
+        forward_.assign(static_cast<size_t>(length), -1);
+        backward_.assign(static_cast<size_t>(length), -1);
+        forward_[offset + 1] = 0;
+        backward_[offset + 1] = 0;
+        const ptrdiff_t delta = n - m;
+        const bool front = (delta & 1) != 0;
+        ptrdiff_t k1_start = 0, k1_end = 0, k2_start = 0, k2_end = 0;
+        for (ptrdiff_t d = 0; d <= max_d; ++d) {
+            for (ptrdiff_t k1 = -d + k1_start; k1 <= d - k1_end; k1 += 2) {
+                ptrdiff_t at = offset + k1;
+                ptrdiff_t x1 = (k1 == -d || (k1 != d && forward_[at - 1] < forward_[at + 1])) ? forward_[at + 1]
+                                                                                              : forward_[at - 1] + 1;
+                ptrdiff_t y1 = x1 - k1;
+                while (x1 < n && y1 < m && a[x1] == b[y1]) ++x1, ++y1;
+                forward_[at] = x1;
+                if (x1 > n) {
+                    k1_end += 2;
+                } else if (y1 > m) {
+                    k1_start += 2;
+                } else if (front) {
+                    ptrdiff_t other = offset + delta - k1;
+                    if (other >= 0 && other < length && backward_[other] != -1 && x1 >= n - backward_[other]) {
+                        split_x = static_cast<size_t>(x1);
+                        split_y = static_cast<size_t>(y1);
+                        return true;
+                    }
+                }
+            }
+            for (ptrdiff_t k2 = -d + k2_start; k2 <= d - k2_end; k2 += 2) {
+                ptrdiff_t at = offset + k2;
+                ptrdiff_t x2 = (k2 == -d || (k2 != d && backward_[at - 1] < backward_[at + 1])) ? backward_[at + 1]
+                                                                                                : backward_[at - 1] + 1;
+                ptrdiff_t y2 = x2 - k2;
+                while (x2 < n && y2 < m && a[n - 1 - x2] == b[m - 1 - y2]) ++x2, ++y2;
+                backward_[at] = x2;
+                if (x2 > n) {
+                    k2_end += 2;
+                } else if (y2 > m) {
+                    k2_start += 2;
+                } else if (!front) {
+                    ptrdiff_t other = offset + delta - k2;
+                    if (other >= 0 && other < length && forward_[other] != -1) {
+                        ptrdiff_t x1 = forward_[other];
+                        ptrdiff_t y1 = offset + x1 - other;
+                        if (x1 >= n - x2) {
+                            split_x = static_cast<size_t>(x1);
+                            split_y = static_cast<size_t>(y1);
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    const Sides& sides_;
+    std::vector<Region> stack_;
+    std::vector<ptrdiff_t> forward_;
+    std::vector<ptrdiff_t> backward_;
+};
+
+// Histogram diff: split at the common line that is rarest on the old side
+// (its first occurrence), widened to the equal run around it, and go
+// again on both sides of it
+class Histogram {
+public:
+    explicit Histogram(const Sides& sides) : sides_(sides), myers_(sides) {}
+
+    void run(const Region& region) {
+        stack_.assign(1, region);
+        while (!stack_.empty()) {
+            Region r = stack_.back();
+            stack_.pop_back();
+            if (!trim(sides_, r)) continue;
+            if (r.a0 == r.a1 || r.b0 == r.b1) {
+                mark_changed(sides_, r);
+                continue;
+            }
+            // clear() costs the bucket count; don't pay a big region's for a small one
+            if (occurrences_.bucket_count() > 4 * (r.a1 - r.a0) + 64) occurrences_ = {};
+            else occurrences_.clear();
+            for (size_t i = r.a0; i < r.a1; ++i) {
+                Occurrence& occurrence = occurrences_[sides_.a[i]];
+                if (occurrence.count++ == 0) occurrence.first = i;
+            }
+            size_t best_count = kNone;
+            size_t best_i = 0;
+            size_t best_j = kNone;
+            for (size_t j = r.b0; j < r.b1 && best_count > 1; ++j) {
+                auto it = occurrences_.find(sides_.b[j]);
+                if (it == occurrences_.end() || it->second.count >= best_count) continue;
+                best_count = it->second.count;
+                best_i = it->second.first;
+                best_j = j;
+            }
+            if (best_j == kNone) {
+                mark_changed(sides_, r);        // Nothing in common
+                continue;
+            }
+            if (best_count > DiffEngine::kMaxChain) {
+                if (!myers_.run(r)) mark_changed(sides_, r);
+                continue;
+            }
+            size_t i0 = best_i, j0 = best_j;
+            while (i0 > r.a0 && j0 > r.b0 && sides_.a[i0 - 1] == sides_.b[j0 - 1]) --i0, --j0;
+            size_t i1 = best_i + 1, j1 = best_j + 1;
+            while (i1 < r.a1 && j1 < r.b1 && sides_.a[i1] == sides_.b[j1]) ++i1, ++j1;
+            stack_.push_back({i1, r.a1, j1, r.b1});
+            stack_.push_back({r.a0, i0, r.b0, j0});
+        }
+    }
+
+private:
+    struct Occurrence {
+        size_t count = 0;
+        size_t first = 0;
+    };
+
+    const Sides& sides_;
+    Myers myers_;
+    std::vector<Region> stack_;
+    std::unordered_map<uint64_t, Occurrence> occurrences_;
+};
+
+// Patience anchors of a region: lines once on each side, in the longest
+// run where their order agrees on both. The regions between them are
+// independent.
+void split_at_anchors(const Sides& sides, const Region& r, std::vector<Region>& out) {
+    struct Count {
+        uint32_t a = 0;
+        uint32_t b = 0;
+        size_t b_position = 0;
+    };
+    std::unordered_map<uint64_t, Count> counts;
+    counts.reserve(r.a1 - r.a0);
+    for (size_t i = r.a0; i < r.a1; ++i) ++counts[sides.a[i]].a;
+    for (size_t j = r.b0; j < r.b1; ++j) {
+        auto it = counts.find(sides.b[j]);
+        if (it == counts.end()) continue;
+        ++it->second.b;
+        it->second.b_position = j;
+    }
+    std::vector<std::pair<size_t, size_t>> unique;     // (old line, new line), by old line
+    for (size_t i = r.a0; i < r.a1; ++i) {
+        const Count& count = counts[sides.a[i]];
+        if (count.a == 1 && count.b == 1) unique.push_back({i, count.b_position});
+    }
+    counts = {};
+
+    // Longest increasing run of new lines, patience sorting style
+    std::vector<size_t> tails;                      // Index into unique of each pile's top
+    std::vector<size_t> previous(unique.size(), kNone);
+    for (size_t u = 0; u < unique.size(); ++u) {
+        auto pile = std::lower_bound(tails.begin(), tails.end(), unique[u].second,
+                                     [&](size_t t, size_t line) { return unique[t].second < line; });
+        if (pile != tails.begin()) previous[u] = *(pile - 1);
+        if (pile == tails.end()) tails.push_back(u);
+        else *pile = u;
+    }
+    std::vector<std::pair<size_t, size_t>> anchors;
+    for (size_t u = tails.empty() ? kNone : tails.back(); u != kNone; u = previous[u]) anchors.push_back(unique[u]);
+    std::reverse(anchors.begin(), anchors.end());
+
+    size_t a = r.a0, b = r.b0;
+    for (const auto& anchor : anchors) {
+        if (anchor.first > a || anchor.second > b) out.push_back({a, anchor.first, b, anchor.second});
+        a = anchor.first + 1;
+        b = anchor.second + 1;
+    }
+    if (a < r.a1 || b < r.b1) out.push_back({a, r.a1, b, r.b1});
+}
+
+} // namespace
+
+void DiffEngine::hash_lines(const DocumentSnapshot& snapshot, std::vector<uint64_t>& hashes) {
+    hashes.clear();
+    uint64_t hash = kFnvOffset;
+    bool pending_cr = false;    // Held back until known not to end a line
+    auto mix = [&hash](char c) { hash = (hash ^ static_cast<unsigned char>(c)) * kFnvPrime; };
+    for (size_t position = 0;;) {
+        std::string_view chunk = snapshot.chunk_at(position);
+        if (chunk.empty()) break;
+        for (char c : chunk) {
+            if (c == '\n') {
+                hashes.push_back(hash);
+                hash = kFnvOffset;
+                pending_cr = false;
+                continue;
+            }
+            if (pending_cr) mix('\r');
+            pending_cr = c == '\r';
+            if (!pending_cr) mix(c);
+        }
+        position += chunk.size();
+    }
+    if (pending_cr) mix('\r');
+    hashes.push_back(hash);
+}
+
+std::vector<DiffEngine::Hunk> DiffEngine::diff(const std::vector<uint64_t>& old_lines,
+                                               const std::vector<uint64_t>& new_lines, ThreadPool* pool) {
+    std::vector<char> old_changed(old_lines.size(), 0);
+    std::vector<char> new_changed(new_lines.size(), 0);
+    Sides sides{old_lines.data(), new_lines.data(), old_changed.data(), new_changed.data()};
+
+    Region whole{0, old_lines.size(), 0, new_lines.size()};
+    std::vector<Region> regions;
+    if (trim(sides, whole)) split_at_anchors(sides, whole, regions);
+
+    // Regions in batches of about kTaskLines lines
+    std::vector<std::pair<size_t, size_t>> batches;
+    size_t lines = 0;
+    for (size_t i = 0; i < regions.size(); ++i) {
+        if (batches.empty() || lines >= kTaskLines) {
+            batches.push_back({i, i});
+            lines = 0;
+        }
+        batches.back().second = i + 1;
+        lines += (regions[i].a1 - regions[i].a0) + (regions[i].b1 - regions[i].b0);
+    }
+    auto run_batch = [&sides, &regions](size_t first, size_t last) {
+        Histogram histogram(sides);
+        for (size_t i = first; i < last; ++i) histogram.run(regions[i]);
+    };
+    // Waiting on the pool from one of its own tasks could starve it
+    if (!pool || batches.size() < 2 || pool->current_worker() != ThreadPool::npos) {
+        for (const auto& batch : batches) run_batch(batch.first, batch.second);
+    } else {
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t remaining = batches.size();
+        for (const auto& batch : batches) {
+            pool->submit([&, batch]() {
+                run_batch(batch.first, batch.second);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--remaining == 0) done.notify_one();
+            });
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&remaining] { return remaining == 0; });
+    }
+
+    // Unchanged lines pair up in order; runs of changed ones make the hunks
+    std::vector<Hunk> hunks;
+    size_t i = 0, j = 0;
+    while (i < old_lines.size() || j < new_lines.size()) {
+        if (i < old_lines.size() && j < new_lines.size() && !old_changed[i] && !new_changed[j]) {
+            ++i, ++j;
+            continue;
+        }
+        Hunk hunk;
+        hunk.old_start = i;
+        hunk.new_start = j;
+        while (i < old_lines.size() && old_changed[i]) ++i;
+        while (j < new_lines.size() && new_changed[j]) ++j;
+        hunk.old_count = i - hunk.old_start;
+        hunk.new_count = j - hunk.new_start;
+        if (hunk.old_count == 0 && hunk.new_count == 0) break;     // Unpaired tail; can't happen
+        hunks.push_back(hunk);
+    }
+    return hunks;
+}
+
+std::vector<DiffEngine::Hunk> DiffEngine::diff(const DocumentSnapshot& old_text, const DocumentSnapshot& new_text,
+                                               ThreadPool* pool) {
+    std::vector<uint64_t> old_lines;
+    std::vector<uint64_t> new_lines;
+    if (pool && pool->current_worker() == ThreadPool::npos) {
+        std::mutex mutex;
+        std::condition_variable done;
+        bool hashed = false;
+        pool->submit([&]() {
+            hash_lines(new_text, new_lines);
+            std::lock_guard<std::mutex> lock(mutex);
+            hashed = true;
+            done.notify_one();
+        });
+        hash_lines(old_text, old_lines);
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&hashed] { return hashed; });
+    } else {
+        hash_lines(old_text, old_lines);
+        hash_lines(new_text, new_lines);
+    }
+    return diff(old_lines, new_lines, pool);
+}
+
+size_t DiffEngine::map_line(const std::vector<Hunk>& hunks, size_t line, bool from_old) {
+    auto it = std::upper_bound(hunks.begin(), hunks.end(), line, [from_old](size_t l, const Hunk& hunk) {
+        return l < (from_old ? hunk.old_start : hunk.new_start);
+    });
+    if (it == hunks.begin()) return line;
+    const Hunk& hunk = *(it - 1);
+    size_t start = from_old ? hunk.old_start : hunk.new_start;
+    size_t count = from_old ? hunk.old_count : hunk.new_count;
+    size_t other_start = from_old ? hunk.new_start : hunk.old_start;
+    size_t other_count = from_old ? hunk.new_count : hunk.old_count;
+    if (line < start + count) return other_start + (std::min)(line - start, other_count > 0 ? other_count - 1 : 0);
+    return line - (start + count) + other_start + other_count;
+}
+
+const DiffEngine::Hunk* DiffEngine::hunk_at(const std::vector<Hunk>& hunks, size_t line, bool old_side) {
+    auto it = std::upper_bound(hunks.begin(), hunks.end(), line, [old_side](size_t l, const Hunk& hunk) {
+        return l < (old_side ? hunk.old_start : hunk.new_start);
+    });
+    if (it == hunks.begin()) return nullptr;
+    const Hunk& hunk = *(it - 1);
+    size_t start = old_side ? hunk.old_start : hunk.new_start;
+    size_t count = old_side ? hunk.old_count : hunk.new_count;
+    return line < start + count ? &hunk : nullptr;
+}
+
+} // namespace editor
@@ -0,0 +1,363 @@
+#include "diff_gutter.h"
+#include "document_snapshot.h"
+#include <algorithm>
+
+namespace editor {
+
+namespace {
+
+constexpr uint64_t kFnvOffset = 14695981039346656037ull;
+constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+// Hashes lines fed in arbitrary pieces, the same way hash_line hashes a
+// whole one; a '\r' is held back until it is known not to end a line
+class LineHasher {
+public:
+    explicit LineHasher(std::vector<uint64_t>& hashes) : hashes_(hashes) {}
+
+    void feed(std::string_view text) {
+        for (char c : text) {
+            if (c == '\n') {
+                hashes_.push_back(hash_);
+                hash_ = kFnvOffset;
+                pending_cr_ = false;
+                continue;
+            }
+            if (pending_cr_) mix('\r');
+            pending_cr_ = c == '\r';
+            if (!pending_cr_) mix(c);
+        }
+    }
+    void finish() {
+        if (pending_cr_) mix('\r');
+        hashes_.push_back(hash_);
+    }
+
+private:
+    void mix(char c) { hash_ = (hash_ ^ static_cast<unsigned char>(c)) * kFnvPrime; }
+
+    std::vector<uint64_t>& hashes_;
+    uint64_t hash_ = kFnvOffset;
+    bool pending_cr_ = false;
+};
+
+void hash_snapshot(const DocumentSnapshot& snapshot, std::vector<uint64_t>& hashes) {
+    hashes.clear();
+    LineHasher hasher(hashes);
+    for (size_t position = 0;;) {
+        std::string_view chunk = snapshot.chunk_at(position);
+        if (chunk.empty()) break;
+        hasher.feed(chunk);
+        position += chunk.size();
+    }
+    hasher.finish();
+}
+
+void add_hunk(std::vector<GitDiffHunk>& hunks, size_t start, size_t deleted, size_t inserted) {
+    if (inserted > 0) {
+        hunks.push_back({start, inserted, deleted > 0 ? GitDiffHunk::Type::Modified : GitDiffHunk::Type::Added});
+    } else if (deleted > 0) {
+        // Deletions above and below the first line both mark line 0
+        size_t line = start > 0 ? start - 1 : 0;
+        if (hunks.empty() || hunks.back().start_line + hunks.back().line_count <= line) {
+            hunks.push_back({line, 1, GitDiffHunk::Type::Deleted});
+        }
+    }
+}
+
+} // namespace
+
+DiffGutter::DiffGutter(BlobIdFn blob_id, BlobTextFn blob_text)
+    : blob_id_(std::move(blob_id)), blob_text_(std::move(blob_text)), thread_([this] { worker_loop(); }) {}
+
+DiffGutter::~DiffGutter() {
+    set_document(nullptr, std::string());
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+}
+
+void DiffGutter::set_document(const std::shared_ptr<PieceTable>& document, const std::string& path,
+                              std::vector<GitDiffHunk> hunks) {
+    std::shared_ptr<PieceTable> tracked = path.empty() ? nullptr : document;
+    if (tracked == document_ && (!tracked || path == path_)) return;
+    if (document_) document_->remove_change_listener(listener_id_);
+    document_ = tracked;
+    path_ = tracked ? path : std::string();
+    ++generation_;
+    hunks_ = tracked ? std::move(hunks) : std::vector<GitDiffHunk>();
+    splices_.clear();
+    rehash_all_ = true;
+    dirty_ = document_ != nullptr;
+    if (document_) {
+        listener_id_ = document_->add_change_listener([this](const PieceTable::Change& change) { on_change(change); });
+    }
+}
+
+void DiffGutter::invalidate_base() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        base_stale_ = true;
+    }
+    dirty_ = document_ != nullptr;
+}
+
+void DiffGutter::on_change(const PieceTable::Change& change) {
+    dirty_ = true;
+    if (rehash_all_) return;
+    size_t line = change.first_line;
+    size_t removed = change.removed_newlines;
+    size_t inserted = change.inserted_newlines;
+    splices_.insert(splices_.end(), {line, removed + 1, inserted + 1});
+
+    // One dirty range covers every edit since the last job, in the
+    // document's current lines; move the old one past this edit first
+    size_t first = line;
+    size_t last = line + inserted + 1;
+    if (dirty_last_ > dirty_first_) {
+        if (dirty_first_ > line + removed) {
+            dirty_first_ = dirty_first_ + inserted - removed;
+            dirty_last_ = dirty_last_ + inserted - removed;
+        } else if (dirty_last_ > line) {
+            dirty_first_ = (std::min)(dirty_first_, line);
+            dirty_last_ = dirty_last_ + inserted > removed ? dirty_last_ + inserted - removed : 0;
+        }
+        first = (std::min)(first, dirty_first_);
+        last = (std::max)(last, dirty_last_);
+    }
+    dirty_first_ = first;
+    dirty_last_ = last;
+}
+
+void DiffGutter::update() {
+    if (!dirty_ || !document_) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // One job at a time: edits meanwhile go into the next one
+        if (has_job_) return;
+        job_.generation = generation_;
+        job_.path = path_;
+        job_.snapshot = document_->snapshot();
+        job_.rehash_all = rehash_all_;
+        job_.dirty_first = dirty_first_;
+        job_.dirty_last = dirty_last_;
+        job_.splices.swap(splices_);
+        has_job_ = true;
+    }
+    wake_.notify_one();
+    splices_.clear();
+    dirty_ = false;
+    rehash_all_ = false;
+    dirty_first_ = dirty_last_ = 0;
+}
+
+bool DiffGutter::take_results() {
+    Result result;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!has_result_) return false;
+        result = std::move(result_);
+        has_result_ = false;
+    }
+    // Finished for a document no longer shown
+    if (result.generation != generation_) return false;
+    bool changed = result.hunks.size() != hunks_.size() ||
+        !std::equal(hunks_.begin(), hunks_.end(), result.hunks.begin(), [](const GitDiffHunk& a, const GitDiffHunk& b) {
+            return a.start_line == b.start_line && a.line_count == b.line_count && a.type == b.type;
+        });
+    hunks_ = std::move(result.hunks);
+    return changed;
+}
+
+void DiffGutter::wait_idle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return !has_job_ && !running_; });
+}
+
+const GitDiffHunk* DiffGutter::hunk_at(size_t line) const {
+    // Hunks are sorted and do not overlap: the last one starting at or
+    // before line is the only candidate
+    auto it = std::upper_bound(hunks_.begin(), hunks_.end(), line,
+                               [](size_t value, const GitDiffHunk& hunk) { return value < hunk.start_line; });
+    if (it == hunks_.begin()) return nullptr;
+    --it;
+    return line < it->start_line + it->line_count ? &*it : nullptr;
+}
+
+void DiffGutter::worker_loop() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            running_ = false;
+            idle_.notify_all();
+            wake_.wait(lock, [this] { return stopping_ || has_job_; });
+            if (stopping_) return;
+            job = std::move(job_);
+            job_ = Job();
+            has_job_ = false;
+            running_ = true;
+            if (base_stale_) {
+                blob_ids_.clear();
+                base_stale_ = false;
+            }
+        }
+        run_job(job);
+    }
+}
+
+void DiffGutter::run_job(Job& job) {
+    const DocumentSnapshot& snapshot = *job.snapshot;
+    size_t line_count = snapshot.get_line_count();
+    bool rehash = job.rehash_all || job.generation != worker_generation_;
+    if (!rehash) {
+        for (size_t i = 0; i + 2 < job.splices.size(); i += 3) {
+            size_t line = job.splices[i];
+            size_t removed = job.splices[i + 1];
+            size_t inserted = job.splices[i + 2];
+            if (line + removed > lines_.size()) {
+                rehash = true;
+                break;
+            }
+            lines_.erase(lines_.begin() + line, lines_.begin() + line + removed);
+            lines_.insert(lines_.begin() + line, inserted, 0);
+        }
+        rehash = rehash || lines_.size() != line_count;
+    }
+    if (rehash) {
+        hash_snapshot(snapshot, lines_);
+    } else {
+        for (size_t line = job.dirty_first; line < job.dirty_last && line < line_count; ++line) {
+            lines_[line] = hash_line(snapshot.get_line(line));
+        }
+    }
+    worker_generation_ = job.generation;
+    job.snapshot.reset();
+
+    Result result;
+    result.generation = job.generation;
+    if (auto base = base_for(job.path)) diff_lines(*base, lines_, result.hunks);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    result_ = std::move(result);
+    has_result_ = true;
+}
+
+std::shared_ptr<const std::vector<uint64_t>> DiffGutter::base_for(const std::string& path) {
+    auto id_it = blob_ids_.find(path);
+    if (id_it == blob_ids_.end()) {
+        std::string id;
+        if (!blob_id_(path, id)) id.clear();
+        id_it = blob_ids_.emplace(path, id).first;
+    }
+    const std::string& id = id_it->second;
+    if (id.empty()) return nullptr;
+
+    auto blob_it = blobs_.find(id);
+    if (blob_it != blobs_.end()) return blob_it->second;
+    std::string text;
+    if (!blob_text_(id, text)) return nullptr;
+    auto hashes = std::make_shared<std::vector<uint64_t>>();
+    hash_lines(text, *hashes);
+    if (blob_order_.size() == kMaxCachedBlobs) {
+        blobs_.erase(blob_order_.front());
+        blob_order_.pop_front();
+    }
+    blob_order_.push_back(id);
+    blobs_.emplace(id, hashes);
+    return hashes;
+}
+
+void DiffGutter::hash_lines(std::string_view text, std::vector<uint64_t>& hashes) {
+    hashes.clear();
+    LineHasher hasher(hashes);
+    hasher.feed(text);
+    hasher.finish();
+}
+
+uint64_t DiffGutter::hash_line(std::string_view line) {
+    uint64_t hash = kFnvOffset;
+    for (char c : line) hash = (hash ^ static_cast<unsigned char>(c)) * kFnvPrime;
+    return hash;
+}
+
+void DiffGutter::diff_lines(const std::vector<uint64_t>& base, const std::vector<uint64_t>& current,
+                            std::vector<GitDiffHunk>& hunks) {
+    hunks.clear();
+    size_t head = 0;
+    while (head < base.size() && head < current.size() && base[head] == current[head]) ++head;
+    size_t tail = 0;
+    while (tail < base.size() - head && tail < current.size() - head &&
+           base[base.size() - 1 - tail] == current[current.size() - 1 - tail]) {
+        ++tail;
+    }
+    const uint64_t* a = base.data() + head;
+    const uint64_t* b = current.data() + head;
+    long n = static_cast<long>(base.size() - head - tail);
+    long m = static_cast<long>(current.size() - head - tail);
+    if (n == 0 || m == 0) {
+        add_hunk(hunks, head, n, m);
+        return;
+    }
+
+    // Myers: v[k] is the furthest x reached on diagonal k = x - y; trace[d]
+    // keeps v for diagonals [-(d-1), d-1] as it was before step d
+    long limit = (std::min)(n + m, static_cast<long>(kMaxEditDistance));
+    std::vector<long> v(2 * limit + 3, 0);
+    long offset = limit + 1;
+    std::vector<std::vector<long>> trace;
+    long distance = -1;
+    for (long d = 0; d <= limit && distance < 0; ++d) {
+        trace.emplace_back(d == 0 ? v.begin() : v.begin() + offset - (d - 1),
+                           d == 0 ? v.begin() : v.begin() + offset + d);
+        for (long k = -d; k <= d; k += 2) {
+            long x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) ? v[offset + k + 1]
+                                                                                   : v[offset + k - 1] + 1;
+            long y = x - k;
+            while (x < n && y < m && a[x] == b[y]) ++x, ++y;
+            v[offset + k] = x;
+            if (x >= n && y >= m) {
+                distance = d;
+                break;
+            }
+        }
+    }
+    if (distance < 0) {
+        // Too far apart to be worth lining up
+        add_hunk(hunks, head, n, m);
+        return;
+    }
+
+    // Walk back from the end collecting the matched pairs; the gaps
+    // between consecutive matches are the hunks
+    std::vector<std::pair<long, long>> matches;
+    long x = n, y = m;
+    for (long d = distance; d > 0; --d) {
+        const std::vector<long>& previous = trace[d];
+        auto at = [&](long k) { return previous[k + d - 1]; };
+        long k = x - y;
+        long prev_k = (k == -d || (k != d && at(k - 1) < at(k + 1))) ? k + 1 : k - 1;
+        long prev_x = at(prev_k);
+        long prev_y = prev_x - prev_k;
+        // The snake after this step's one insertion or deletion
+        while (x > prev_x && y > prev_y) matches.emplace_back(--x, --y);
+        x = prev_x;
+        y = prev_y;
+    }
+    while (x > 0 && y > 0) matches.emplace_back(--x, --y);
+    std::reverse(matches.begin(), matches.end());
+    matches.emplace_back(n, m);
+
+    long last_x = -1, last_y = -1;
+    for (const auto& match : matches) {
+        add_hunk(hunks, head + static_cast<size_t>(last_y + 1), static_cast<size_t>(match.first - last_x - 1),
+                 static_cast<size_t>(match.second - last_y - 1));
+        last_x = match.first;
+        last_y = match.second;
+    }
+}
+
+} // namespace editor
@@ -0,0 +1,412 @@
+#include "document_journal.h"
+#include "document_snapshot.h"
+#include "piece_table.h"
+#include "platform_file.h"
+#include <algorithm>
+#include <cstring>
+
+namespace editor {
+
+namespace {
+
+const char kMagic[4] = {'V', 'J', 'N', 'L'};
+const uint32_t kVersion = 1;
+const char kInsert = 'I';
+const char kRemove = 'R';
+
+const uint64_t kFnv64Offset = 14695981039346656037ull;
+
+uint64_t fnv1a64(uint64_t hash, const char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint32_t fnv1a32(const char* data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Fixed-width little-endian integers, so journals move between machines
+void put_u32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+void put_u64(std::string& out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+// Every record ends with the checksum of its own bytes
+void seal(std::string& out, size_t record_start) {
+    put_u32(out, fnv1a32(out.data() + record_start, out.size() - record_start));
+}
+
+// Reads the integers back, failing instead of running past the end
+struct Reader {
+    const std::string& data;
+    size_t at = 0;
+
+    bool u32(uint32_t& value) {
+        if (data.size() - at < 4) return false;
+        value = 0;
+        for (int i = 0; i < 4; ++i) value |= static_cast<uint32_t>(static_cast<unsigned char>(data[at + i])) << (8 * i);
+        at += 4;
+        return true;
+    }
+    bool u64(uint64_t& value) {
+        if (data.size() - at < 8) return false;
+        value = 0;
+        for (int i = 0; i < 8; ++i) value |= static_cast<uint64_t>(static_cast<unsigned char>(data[at + i])) << (8 * i);
+        at += 8;
+        return true;
+    }
+    bool bytes(size_t length, std::string& out) {
+        if (data.size() - at < length) return false;
+        out.assign(data, at, length);
+        at += length;
+        return true;
+    }
+    // The checksum of everything since start
+    bool sealed(size_t start) {
+        size_t end = at;
+        uint32_t stored = 0;
+        return u32(stored) && stored == fnv1a32(data.data() + start, end - start);
+    }
+};
+
+bool read_all(const std::string& path, std::string& out) {
+    std::vector<uint8_t> data;
+    if (!PlatformFile::read_file_binary(path, data)) return false;
+    out.assign(data.begin(), data.end());
+    return true;
+}
+
+} // namespace
+
+DocumentJournal::DocumentJournal() = default;
+
+DocumentJournal::~DocumentJournal() {
+    close(false);
+}
+
+bool DocumentJournal::open(PieceTable& document, const std::string& journal_path, const std::string& file_path,
+                           std::chrono::milliseconds sync_interval) {
+    close(false);
+    PlatformFile::create_directories(PlatformFile::get_directory(journal_path));
+    file_ = std::fopen(journal_path.c_str(), "wb");
+    if (!file_) return false;
+
+    document_ = &document;
+    journal_path_ = journal_path;
+    sync_interval_ = sync_interval;
+    queued_ = written_through_ = synced_through_ = 0;
+    records_ = syncs_ = 0;
+    flush_wanted_ = stopping_ = false;
+    last_sync_ = std::chrono::steady_clock::now();
+
+    // The header is hashed from a snapshot on the writer thread, so opening
+    // a large file does not wait for it
+    Item header;
+    header.kind = Item::Kind::Restart;
+    header.snapshot = document.snapshot();
+    header.path = file_path;
+    enqueue(std::move(header));
+
+    listener_id_ = document.add_change_listener([this](const PieceTable::Change& change) {
+        Item item;
+        if (change.removed_length > 0) {
+            size_t start = item.bytes.size();
+            item.bytes.push_back(kRemove);
+            put_u64(item.bytes, change.position);
+            put_u64(item.bytes, change.removed_length);
+            seal(item.bytes, start);
+            item.records++;
+        }
+        if (change.inserted_length > 0) {
+            size_t start = item.bytes.size();
+            item.bytes.push_back(kInsert);
+            put_u64(item.bytes, change.position);
+            put_u32(item.bytes, static_cast<uint32_t>(change.inserted_length));
+            item.bytes += document_->get_text(change.position, change.inserted_length);
+            seal(item.bytes, start);
+            item.records++;
+        }
+        if (item.records > 0) enqueue(std::move(item));
+    });
+    writer_ = std::thread(&DocumentJournal::run, this);
+    return true;
+}
+
+void DocumentJournal::close(bool discard) {
+    if (!document_) return;
+    document_->remove_change_listener(listener_id_);
+    document_ = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    if (writer_.joinable()) writer_.join();
+    if (file_) std::fclose(file_);
+    file_ = nullptr;
+    queue_.clear();
+    batch_.clear();
+    if (discard) PlatformFile::delete_file(journal_path_);
+}
+
+void DocumentJournal::enqueue(Item item) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        records_ += item.records;
+        queue_.push_back(std::move(item));
+        queued_++;
+    }
+    wake_.notify_one();
+}
+
+void DocumentJournal::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!writer_.joinable()) return;
+    uint64_t target = queued_;
+    flush_wanted_ = true;
+    wake_.notify_one();
+    synced_.wait(lock, [&] { return synced_through_ >= target; });
+}
+
+void DocumentJournal::save_async(const std::string& path, SaveCallback done) {
+    Item item;
+    item.kind = Item::Kind::Save;
+    item.path = path;
+    item.done = std::move(done);
+    if (!document_) {
+        if (item.done) item.done(false);
+        return;
+    }
+    item.snapshot = document_->snapshot();
+    enqueue(std::move(item));
+}
+
+uint64_t DocumentJournal::records_written() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return records_;
+}
+
+uint64_t DocumentJournal::sync_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return syncs_;
+}
+
+void DocumentJournal::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        if (!queue_.empty()) {
+            // Everything queued so far goes out with one write; whatever
+            // arrives meanwhile joins the next one, under the same sync
+            std::vector<Item> items;
+            items.swap(queue_);
+            uint64_t through = queued_;
+            lock.unlock();
+            write_items(items);
+            lock.lock();
+            written_through_ = through;
+            continue;
+        }
+        if (synced_through_ < written_through_) {
+            auto due = last_sync_ + sync_interval_;
+            if (!flush_wanted_ && !stopping_ && std::chrono::steady_clock::now() < due) {
+                wake_.wait_until(lock, due);
+                continue;
+            }
+            uint64_t through = written_through_;
+            lock.unlock();
+            PlatformFile::sync_file(file_);
+            lock.lock();
+            last_sync_ = std::chrono::steady_clock::now();
+            synced_through_ = through;
+            syncs_++;
+            if (synced_through_ >= queued_) flush_wanted_ = false;
+            synced_.notify_all();
+            continue;
+        }
+        flush_wanted_ = false;
+        if (stopping_) break;
+        wake_.wait(lock);
+    }
+}
+
+void DocumentJournal::write_items(std::vector<Item>& items) {
+    auto append_batch = [this] {
+        if (file_ && !batch_.empty()) std::fwrite(batch_.data(), 1, batch_.size(), file_);
+        batch_.clear();
+    };
+    for (Item& item : items) {
+        switch (item.kind) {
+        case Item::Kind::Record:
+            batch_ += item.bytes;
+            break;
+        case Item::Kind::Restart:
+            append_batch();
+            restart(*item.snapshot, item.path);
+            break;
+        case Item::Kind::Save: {
+            append_batch();
+            bool ok = write_snapshot(*item.snapshot, item.path);
+            // The saved file is the new base: the edits before it are done with
+            if (ok) restart(*item.snapshot, item.path);
+            if (item.done) item.done(ok);
+            break;
+        }
+        }
+    }
+    append_batch();
+    // Handed to the OS now, so a crash of the editor alone loses nothing;
+    // only the fsync waits for the interval
+    if (file_) std::fflush(file_);
+}
+
+void DocumentJournal::restart(const DocumentSnapshot& base, const std::string& file_path) {
+    if (file_) std::fclose(file_);
+    file_ = std::fopen(journal_path_.c_str(), "wb");
+    if (!file_) return;
+
+    size_t total = base.get_total_length();
+    uint64_t hash = kFnv64Offset;
+    for (size_t position = 0; position < total;) {
+        std::string_view chunk = base.chunk_at(position);
+        if (chunk.empty()) break;
+        hash = fnv1a64(hash, chunk.data(), chunk.size());
+        position += chunk.size();
+    }
+    bool inline_text = file_path.empty();
+
+    std::string header(kMagic, sizeof(kMagic));
+    put_u32(header, kVersion);
+    put_u32(header, static_cast<uint32_t>(file_path.size()));
+    header += file_path;
+    put_u64(header, total);
+    put_u64(header, hash);
+    header.push_back(inline_text ? 1 : 0);
+    seal(header, 0);
+    std::fwrite(header.data(), 1, header.size(), file_);
+    if (!inline_text) return;
+    // An untitled document has no file to replay onto: its text comes along
+    for (size_t position = 0; position < total;) {
+        std::string_view chunk = base.chunk_at(position);
+        if (chunk.empty()) break;
+        std::fwrite(chunk.data(), 1, chunk.size(), file_);
+        position += chunk.size();
+    }
+}
+
+bool DocumentJournal::recover(const std::string& journal_path, Recovered& out, std::string& error) {
+    out = Recovered();
+    std::string data;
+    if (!read_all(journal_path, data)) {
+        error = "cannot read journal";
+        return false;
+    }
+    Reader reader{data};
+    std::string magic;
+    uint32_t version = 0, path_length = 0;
+    uint64_t base_length = 0, base_hash = 0;
+    std::string inline_flag;
+    if (!reader.bytes(sizeof(kMagic), magic) || std::memcmp(magic.data(), kMagic, sizeof(kMagic)) != 0 ||
+        !reader.u32(version) || version != kVersion || !reader.u32(path_length) ||
+        !reader.bytes(path_length, out.file_path) || !reader.u64(base_length) || !reader.u64(base_hash) ||
+        !reader.bytes(1, inline_flag) || !reader.sealed(0)) {
+        error = "not a journal, or its header is damaged";
+        return false;
+    }
+
+    std::string base;
+    if (inline_flag[0]) {
+        if (!reader.bytes(static_cast<size_t>(base_length), base)) {
+            error = "journal text is cut off";
+            return false;
+        }
+    } else if (!read_all(out.file_path, base)) {
+        error = "cannot read " + out.file_path;
+        return false;
+    }
+    if (base.size() != base_length || fnv1a64(kFnv64Offset, base.data(), base.size()) != base_hash) {
+        error = inline_flag[0] ? "journal text is damaged" : out.file_path + " has changed since the journal was started";
+        return false;
+    }
+
+    PieceTable document(base);
+    document.set_history_limits(1, 0);
+    while (reader.at < data.size()) {
+        size_t start = reader.at;
+        std::string kind, text;
+        uint64_t position = 0, length = 0;
+        uint32_t inserted = 0;
+        bool ok = reader.bytes(1, kind) && reader.u64(position);
+        if (ok && kind[0] == kInsert) {
+            ok = reader.u32(inserted) && reader.bytes(inserted, text) && reader.sealed(start) &&
+                 position <= document.get_total_length();
+            if (ok) document.insert(static_cast<size_t>(position), text);
+        } else if (ok && kind[0] == kRemove) {
+            ok = reader.u64(length) && reader.sealed(start) && position <= document.get_total_length() &&
+                 length <= document.get_total_length() - position;
+            if (ok) document.remove(static_cast<size_t>(position), static_cast<size_t>(length));
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            // Written last and never synced, most likely: nothing after it can apply
+            out.torn = true;
+            break;
+        }
+        out.records++;
+    }
+    out.text = document.get_text(0, document.get_total_length());
+    return true;
+}
+
+std::string DocumentJournal::journal_path_for(const std::string& workspace_dir, const std::string& file_path) {
+    std::string key = PlatformFile::normalize_path(file_path);
+    uint64_t hash = fnv1a64(kFnv64Offset, key.data(), key.size());
+    static const char kHex[] = "0123456789abcdef";
+    std::string name(16, '0');
+    for (int i = 15; i >= 0; --i, hash >>= 4) name[i] = kHex[hash & 0xF];
+    std::string directory = PlatformFile::join_path(PlatformFile::join_path(workspace_dir, ".velocity"), "journal");
+    return PlatformFile::join_path(directory, name + ".journal");
+}
+
+std::string DocumentJournal::history_path_for(const std::string& journal_path) {
+    return journal_path.substr(0, journal_path.size() - PlatformFile::get_extension(journal_path).size()) + ".history";
+}
+
+std::vector<std::string> DocumentJournal::find_journals(const std::string& workspace_dir) {
+    std::string directory = PlatformFile::join_path(PlatformFile::join_path(workspace_dir, ".velocity"), "journal");
+    std::vector<std::string> entries, journals;
+    if (!PlatformFile::list_directory(directory, entries)) return journals;
+    for (const std::string& entry : entries) {
+        std::string path = PlatformFile::join_path(directory, entry);
+        if (PlatformFile::get_extension(path) == ".journal") journals.push_back(path);
+    }
+    std::sort(journals.begin(), journals.end());
+    return journals;
+}
+
+bool DocumentJournal::write_snapshot(const DocumentSnapshot& snapshot, const std::string& path) {
+    // The pieces themselves are written: the text is never joined
+    std::vector<std::string_view> spans;
+    spans.reserve(snapshot.get_piece_count());
+    size_t total = snapshot.get_total_length();
+    for (size_t position = 0; position < total;) {
+        std::string_view chunk = snapshot.chunk_at(position);
+        if (chunk.empty()) break;
+        spans.push_back(chunk);
+        position += chunk.size();
+    }
+    return PlatformFile::write_file_binary(path, spans);
+}
+
+} // namespace editor
@@ -0,0 +1,164 @@
+#include "document_outline.h"
+#include "bracket_index.h"
+#include <algorithm>
+
+namespace editor {
+
+namespace {
+
+bool before_line(const SymbolTags::Definition& definition, size_t line) {
+    return definition.line < line;
+}
+
+bool after_line(size_t line, const SymbolTags::Definition& definition) {
+    return line < definition.line;
+}
+
+} // namespace
+
+DocumentOutline::~DocumentOutline() {
+    if (document_) document_->remove_change_listener(listener_id_);
+}
+
+void DocumentOutline::set_document(const std::shared_ptr<PieceTable>& document, SymbolTags::Language language) {
+    if (document == document_ && language == language_) return;
+    if (document_) document_->remove_change_listener(listener_id_);
+    document_ = document;
+    language_ = language;
+    definitions_.clear();
+    path_key_ = symbols_key_ = Key();
+    if (!document_) return;
+    scan_lines(0, SIZE_MAX, definitions_);
+    listener_id_ = document_->add_change_listener([this](const PieceTable::Change& change) { on_change(change); });
+}
+
+void DocumentOutline::scan_lines(size_t first, size_t count, std::vector<SymbolTags::Definition>& out) {
+    if (language_ == SymbolTags::Language::None) return;
+    PieceTable::LineCursor cursor = document_->lines(first);
+    std::string_view text;
+    for (size_t i = 0; i < count && cursor.next(text); ++i) {
+        SymbolTags::scan_line(language_, text, static_cast<uint32_t>(cursor.line_number()), out);
+    }
+}
+
+void DocumentOutline::on_change(const PieceTable::Change& change) {
+    // The edited lines' definitions are replaced, the ones after them move
+    size_t first = change.first_line;
+    size_t old_last = first + change.removed_newlines;
+    auto lo = std::lower_bound(definitions_.begin(), definitions_.end(), first, before_line);
+    auto hi = std::upper_bound(lo, definitions_.end(), old_last, after_line);
+    for (auto it = hi; it != definitions_.end(); ++it) {
+        it->line = static_cast<uint32_t>(it->line - change.removed_newlines + change.inserted_newlines);
+    }
+    std::vector<SymbolTags::Definition> scanned;
+    scan_lines(first, change.inserted_newlines + 1, scanned);
+    size_t at = lo - definitions_.begin();
+    definitions_.erase(lo, hi);
+    definitions_.insert(definitions_.begin() + at, std::make_move_iterator(scanned.begin()),
+                        std::make_move_iterator(scanned.end()));
+}
+
+DocumentOutline::Key DocumentOutline::key(const BracketIndex& brackets) const {
+    Key k;
+    k.version = document_ ? document_->get_version() : 0;
+    k.brackets = &brackets;
+    k.bracket_lines = brackets.line_count();
+    return k;
+}
+
+bool DocumentOutline::block_of(const SymbolTags::Definition& definition, const BracketIndex& brackets,
+                               size_t& open_line, size_t& close_line) const {
+    using Kind = BracketIndex::Kind;
+    if (definition.line >= brackets.line_count()) return false;
+    BracketIndex::Pair pair;
+    bool found = false;
+    // The first '{' after the name on its line
+    bool curly = false;
+    for (const auto& bracket : brackets.brackets(definition.line)) {
+        if (bracket.kind != Kind::Curly) continue;
+        curly = true;
+        if (bracket.open && bracket.column >= definition.column) {
+            found = brackets.match(definition.line, bracket.column, pair);
+            break;
+        }
+    }
+    // Or, with no braces on its line, one that starts the next line
+    size_t next = definition.line + 1;
+    if (!curly && next < brackets.line_count()) {
+        const auto& following = brackets.brackets(next);
+        if (!following.empty() && following.front().kind == Kind::Curly && following.front().open &&
+            document_->get_line(next).find_first_not_of(" \t") == following.front().column) {
+            found = brackets.match(next, following.front().column, pair);
+        }
+    }
+    if (!found) return false;
+    open_line = pair.open_line;
+    close_line = pair.close_line;
+    return true;
+}
+
+const SymbolTags::Definition* DocumentOutline::owner_of(size_t line, const BracketIndex& brackets) const {
+    // The last definition on the line itself, else one on the line before
+    size_t first = line > 0 ? line - 1 : 0;
+    for (size_t from = line + 1; from-- > first;) {
+        auto lo = std::lower_bound(definitions_.begin(), definitions_.end(), from, before_line);
+        auto hi = std::upper_bound(lo, definitions_.end(), from, after_line);
+        while (hi != lo) {
+            --hi;
+            size_t open_line = 0, close_line = 0;
+            if (block_of(*hi, brackets, open_line, close_line) && open_line == line) return &*hi;
+        }
+    }
+    return nullptr;
+}
+
+DocumentOutline::Symbol DocumentOutline::make_symbol(const SymbolTags::Definition& definition,
+                                                     const BracketIndex& brackets) const {
+    Symbol symbol;
+    symbol.name = definition.name;
+    symbol.line = definition.line;
+    symbol.column = definition.column;
+    symbol.end_line = symbol.line;
+    size_t open_line = 0;
+    block_of(definition, brackets, open_line, symbol.end_line);
+    return symbol;
+}
+
+const std::vector<DocumentOutline::Symbol>& DocumentOutline::path_at(size_t line, const BracketIndex& brackets) {
+    Key k = key(brackets);
+    if (line == path_line_ && k == path_key_) return path_;
+    path_line_ = line;
+    path_key_ = k;
+    path_.clear();
+    if (!document_ || line >= brackets.line_count()) return path_;
+    brackets.headers(line, headers_);
+    // A definition's own line shows it too
+    if (headers_.empty() || headers_.back() != line) headers_.push_back(line);
+    for (size_t header : headers_) {
+        const SymbolTags::Definition* owner = owner_of(header, brackets);
+        if (!owner) continue;
+        path_.push_back(make_symbol(*owner, brackets));
+        path_.back().depth = path_.size() - 1;
+    }
+    return path_;
+}
+
+const std::vector<DocumentOutline::Symbol>& DocumentOutline::symbols(const BracketIndex& brackets) {
+    Key k = key(brackets);
+    if (k == symbols_key_) return symbols_;
+    symbols_key_ = k;
+    symbols_.clear();
+    symbols_.reserve(definitions_.size());
+    // Ends of the blocks around the current definition, innermost last
+    std::vector<size_t> open;
+    for (const auto& definition : definitions_) {
+        Symbol symbol = make_symbol(definition, brackets);
+        while (!open.empty() && open.back() < symbol.line) open.pop_back();
+        symbol.depth = open.size();
+        if (symbol.end_line > symbol.line) open.push_back(symbol.end_line);
+        symbols_.push_back(std::move(symbol));
+    }
+    return symbols_;
+}
+
+} // namespace editor
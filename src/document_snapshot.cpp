@@ -0,0 +1,166 @@
+#include "document_snapshot.h"
+#include "piece_table.h"
+#include "text_scan.h"
+#include "platform_file.h"
+#include <algorithm>
+#include <cstring>
+
+std::shared_ptr<const DocumentSnapshot> PieceTable::snapshot() const {
+    std::shared_ptr<DocumentSnapshot> snap(new DocumentSnapshot());
+    snap->version_ = version_;
+    snap->total_length_ = get_total_length();
+    snap->original_storage_ = original_storage_;
+    snap->original_mapping_ = original_mapping_;
+    snap->add_chunks_.reserve(add_chunks_.size());
+    for (const AddChunk& chunk : add_chunks_) {
+        snap->add_chunks_.push_back(chunk.data);
+    }
+    // Until indexing finishes the original index still grows and the node
+    // counts past the frontier are incomplete
+    snap->lines_exact_ = !index_job_;
+    if (!index_job_) snap->original_newlines_ = original_newlines_;
+
+    snap->starts_.reset(snap->total_length_, node_pool_.live_count());
+    snap->segments_.reserve(node_pool_.live_count());
+    size_t position = 0;
+    for (PieceNode* node = first_node(); node != nil_; node = next_node(node)) {
+        const Piece& piece = node->piece;
+        snap->segments_.push_back({piece_data(piece.source, piece.offset), piece.length, piece.offset,
+                                   piece.source == Piece::Source::ORIGINAL, node->newlines});
+        snap->starts_.push_back(position);
+        position += piece.length;
+    }
+    return snap;
+}
+
+void PieceTable::insert_shared(size_t position, const std::shared_ptr<const DocumentSnapshot>& source,
+                               size_t start, size_t length) {
+    if (!source || start >= source->total_length_ || length == 0 || position > get_total_length()) return;
+    length = (std::min)(length, source->total_length_ - start);
+    Span span;
+    for (size_t i = source->segment_at(start); i < source->segments_.size() && span.length < length; ++i) {
+        const DocumentSnapshot::Segment& segment = source->segments_[i];
+        size_t skip = span.length == 0 ? start - source->starts_[i] : 0;
+        size_t take = (std::min)(segment.length - skip, length - span.length);
+        const char* data = segment.data + skip;
+        size_t offset = 0;
+        if (take >= kShareMinimum && !(segment.original && source->original_mapping_)) {
+            // A full chunk of its own, so nothing is ever appended behind it;
+            // the aliasing pointer keeps the whole snapshot (and its buffers) alive
+            offset = add_chunks_.empty() ? 0 : add_chunks_.back().base + add_chunks_.back().capacity + 1;
+            AddChunk chunk{std::shared_ptr<char>(source, const_cast<char*>(data)), offset, take, take, true, false, {}};
+            add_chunks_.push_back(std::move(chunk));
+            TextScan::find_newlines(data, take, offset, add_newlines_);
+        } else {
+            offset = append_add(data, take);
+        }
+        if (!span.pieces.empty() && span.pieces.back().offset + span.pieces.back().length == offset) {
+            span.pieces.back().length += take;      // Copied right behind the previous piece
+        } else {
+            span.pieces.emplace_back(Piece::Source::ADD, offset, take);
+        }
+        span.length += take;
+        span.newlines += count_newlines(Piece::Source::ADD, offset, take);
+    }
+    insert_span(position, span);
+}
+
+void DocumentSnapshot::ensure_lines() const {
+    std::call_once(lines_once_, [this]() {
+        std::vector<size_t> counted;
+        if (!lines_exact_) {
+            counted.reserve(segments_.size());
+            for (const Segment& segment : segments_) {
+                counted.push_back(TextScan::count_newlines(segment.data, segment.length));
+            }
+        }
+        size_t total = 0;
+        for (size_t i = 0; i < segments_.size(); ++i) {
+            total += lines_exact_ ? segments_[i].newlines : counted[i];
+        }
+        newlines_before_.reset(total, segments_.size() + 1);
+        total = 0;
+        for (size_t i = 0; i < segments_.size(); ++i) {
+            newlines_before_.push_back(total);
+            total += lines_exact_ ? segments_[i].newlines : counted[i];
+        }
+        newlines_before_.push_back(total);
+    });
+}
+
+size_t DocumentSnapshot::get_line_count() const {
+    ensure_lines();
+    return newlines_before_.back() + 1;
+}
+
+size_t DocumentSnapshot::segment_at(size_t position) const {
+    // Last segment starting at or before position
+    return starts_.upper_bound(position) - 1;
+}
+
+size_t DocumentSnapshot::nth_newline(const Segment& segment, size_t n) const {
+    // Offset (relative to the segment) of its n-th newline, 1-based
+    if (segment.original && original_newlines_) {
+        auto first = std::lower_bound(original_newlines_->begin(), original_newlines_->end(), segment.buffer_offset);
+        return *(first + (n - 1)) - segment.buffer_offset;
+    }
+    // Add buffer pieces are at most one chunk long, so scanning them is cheap
+    const char* p = segment.data;
+    const char* end = segment.data + segment.length;
+    while (true) {
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+        if (--n == 0) return static_cast<size_t>(nl - segment.data);
+        p = nl + 1;
+    }
+}
+
+size_t DocumentSnapshot::get_line_start(size_t line_number) const {
+    if (line_number == 0) return 0;
+    if (line_number >= get_line_count()) return total_length_;
+    // The segment holding the line_number-th newline: the first whose
+    // running total (newlines_before_[i + 1]) reaches line_number
+    size_t index = newlines_before_.lower_bound(line_number) - 1;
+    size_t n = line_number - newlines_before_[index];
+    return starts_[index] + nth_newline(segments_[index], n) + 1;
+}
+
+std::string DocumentSnapshot::get_line(size_t line_number) const {
+    if (line_number >= get_line_count()) return "";
+    size_t start = get_line_start(line_number);
+    size_t end = total_length_;
+    if (line_number + 1 < get_line_count()) {
+        end = get_line_start(line_number + 1) - 1;  // Exclude newline
+    }
+    std::string line = get_text(start, end - start);
+    if (end < total_length_ && !line.empty() && line.back() == '\r') line.pop_back();
+    return line;
+}
+
+std::string DocumentSnapshot::get_text(size_t start, size_t length) const {
+    std::string result;
+    if (start >= total_length_ || length == 0) return result;
+    size_t remaining = (std::min)(length, total_length_ - start);
+    result.reserve(remaining);
+    size_t index = segment_at(start);
+    size_t offset = start - starts_[index];
+    while (remaining > 0) {
+        const Segment& segment = segments_[index++];
+        size_t take = (std::min)(segment.length - offset, remaining);
+        result.append(segment.data + offset, take);
+        remaining -= take;
+        offset = 0;
+    }
+    return result;
+}
+
+std::string_view DocumentSnapshot::chunk_at(size_t position) const {
+    if (position >= total_length_) return std::string_view();
+    size_t index = segment_at(position);
+    size_t offset = position - starts_[index];
+    return std::string_view(segments_[index].data + offset, segments_[index].length - offset);
+}
+
+size_t DocumentSnapshot::get_index_bytes() const {
+    ensure_lines();
+    return segments_.capacity() * sizeof(Segment) + starts_.bytes() + newlines_before_.bytes();
+}
@@ -0,0 +1,479 @@
+#include "document_transform.h"
+#include "document_snapshot.h"
+#include "piece_table.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+
+namespace editor {
+
+namespace {
+
+// Start of the first line at or after position
+size_t next_line_start(const DocumentSnapshot& snapshot, size_t position) {
+    size_t total = snapshot.get_total_length();
+    for (size_t at = position - 1; at < total;) {
+        std::string_view piece = snapshot.chunk_at(at);
+        if (piece.empty()) break;
+        const void* newline = std::memchr(piece.data(), '\n', piece.size());
+        if (newline) return at + (static_cast<const char*>(newline) - piece.data()) + 1;
+        at += piece.size();
+    }
+    return total;
+}
+
+std::vector<size_t> chunk_starts(const DocumentSnapshot& snapshot, size_t chunk_bytes, bool anywhere) {
+    std::vector<size_t> starts{0};
+    size_t total = snapshot.get_total_length();
+    for (size_t at = chunk_bytes; at < total; at += chunk_bytes) {
+        if (!anywhere) at = next_line_start(snapshot, at);
+        if (at >= total) break;
+        starts.push_back(at);
+    }
+    return starts;
+}
+
+// Lines of text without their '\n' ('\r' stays); one that lacks the
+// '\n' (the document's last) is the last element
+std::vector<std::string_view> split_lines(std::string_view text) {
+    std::vector<std::string_view> lines;
+    for (size_t start = 0; start < text.size();) {
+        size_t end = text.find('\n', start);
+        if (end == std::string_view::npos) end = text.size();
+        lines.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+    return lines;
+}
+
+bool ends_with_newline(const std::vector<TransformChunk>& chunks) {
+    return !chunks.empty() && !chunks.back().text.empty() && chunks.back().text.back() == '\n';
+}
+
+// The document's last line has no terminator: give it the one its
+// neighbours have ("\r\n" or "\n") so it can move, and drop that again
+// from whatever ends up last
+std::string_view terminate_last(std::vector<std::string_view>& lines, const std::string& text, std::string& storage) {
+    if (lines.empty() || text.back() == '\n') return std::string_view();
+    bool crlf = lines.size() > 1 && !lines[lines.size() - 2].empty() && lines[lines.size() - 2].back() == '\r';
+    storage.assign(lines.back().data(), lines.back().size());
+    if (crlf) storage += '\r';
+    lines.back() = storage;
+    return crlf ? std::string_view("\r\n") : std::string_view("\n");
+}
+
+void drop_final_terminator(std::vector<TransformChunk>& chunks) {
+    for (auto it = chunks.rbegin(); it != chunks.rend(); ++it) {
+        std::string& output = it->output;
+        if (output.empty()) continue;
+        if (output.back() == '\n') output.pop_back();
+        if (!output.empty() && output.back() == '\r') output.pop_back();
+        return;
+    }
+}
+
+bool less_folded(std::string_view a, std::string_view b) {
+    size_t length = (std::min)(a.size(), b.size());
+    for (size_t i = 0; i < length; ++i) {
+        unsigned char x = static_cast<unsigned char>(a[i]), y = static_cast<unsigned char>(b[i]);
+        if (x >= 'A' && x <= 'Z') x += 'a' - 'A';
+        if (y >= 'A' && y <= 'Z') y += 'a' - 'A';
+        if (x != y) return x < y;
+    }
+    return a.size() < b.size();
+}
+
+// ----------------------------------------------------------------------------
+// JSON: whitespace outside strings is dropped and put back as line breaks
+// and indentation. Everything but string state and depth is local, and
+// those are what scan summarises for each state a chunk could start in.
+// ----------------------------------------------------------------------------
+
+enum JsonMode : int64_t { kOutside, kInString, kEscape };
+
+struct JsonState {
+    int64_t mode = kOutside;
+    int64_t depth = 0;
+    int64_t last = 0;           // Last byte outside strings, '"' for a string; 0 for none
+    int64_t space = 0;          // Whitespace since last
+};
+constexpr size_t kJsonFields = 4;
+
+bool is_literal(int64_t c) {
+    return c != 0 && !std::strchr("{}[],:\"", static_cast<int>(c));
+}
+
+void json_break(std::string* out, const JsonState& state, size_t indent) {
+    if (!out) return;
+    out->push_back('\n');
+    out->append(static_cast<size_t>((std::max)(state.depth, int64_t(0))) * indent, ' ');
+}
+
+void walk_json(std::string_view text, JsonState& state, size_t indent, std::string* out) {
+    for (char c : text) {
+        if (state.mode != kOutside) {
+            if (out) out->push_back(c);
+            if (state.mode == kEscape) state.mode = kInString;
+            else if (c == '\\') state.mode = kEscape;
+            else if (c == '"') {
+                state.mode = kOutside;
+                state.last = '"';
+                state.space = 0;
+            }
+            continue;
+        }
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r') {
+            state.space = 1;
+            continue;
+        }
+        if (c == '}' || c == ']') {
+            --state.depth;
+            if (state.last != '{' && state.last != '[') json_break(out, state, indent);
+        } else if (c == ',' || c == ':') {
+            // Stays on the line it ends
+        } else if (is_literal(state.last) && is_literal(c)) {
+            // Two literals apart: keep them apart
+            if (state.space && out) {
+                if (state.depth == 0) out->push_back('\n');
+                else out->push_back(' ');
+            }
+        } else if (state.last == '{' || state.last == '[' || state.last == ',') {
+            json_break(out, state, indent);
+        } else if (state.depth == 0 && state.last != 0 && state.last != ':') {
+            // The next of several top-level values
+            if (out) out->push_back('\n');
+        }
+        if (out) {
+            out->push_back(c);
+            if (c == ':') out->push_back(' ');
+        }
+        if (c == '{' || c == '[') ++state.depth;
+        if (c == '"') state.mode = kInString;
+        state.last = c;
+        state.space = 0;
+    }
+}
+
+// One stage over every chunk. The calling thread claims chunks alongside
+// helpers on the pool, so it never waits for a task that has not started:
+// run() may itself be a pool task (the GUI's is) without starving the pool.
+// Helpers that start once the chunks are gone return without touching them.
+struct StageWork {
+    std::function<void(size_t)> work;
+    size_t count = 0;
+    size_t next = 0;
+    size_t busy = 0;            // Chunks claimed and not finished
+    std::mutex mutex;
+    std::condition_variable idle;
+
+    void claim_all(const CancellationToken& cancel) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (next < count && !cancel.cancelled()) {
+            size_t index = next++;
+            ++busy;
+            lock.unlock();
+            work(index);
+            lock.lock();
+            if (--busy == 0) idle.notify_all();
+        }
+    }
+};
+
+bool run_stage(size_t count, std::function<void(size_t)> work, const CancellationToken& cancel) {
+    if (count == 0) return !cancel.cancelled();
+    auto stage = std::make_shared<StageWork>();
+    stage->work = std::move(work);
+    stage->count = count;
+    ThreadPool& pool = ThreadPool::shared();
+    // The caller takes a chunk too
+    size_t helpers = (std::min)(count - 1, pool.size());
+    for (size_t i = 0; i < helpers; ++i) {
+        pool.submit([stage, cancel]() { stage->claim_all(cancel); }, TaskPriority::Visible, cancel);
+    }
+    stage->claim_all(cancel);
+    std::unique_lock<std::mutex> lock(stage->mutex);
+    stage->idle.wait(lock, [&] { return stage->busy == 0; });
+    return !cancel.cancelled();
+}
+
+} // namespace
+
+// ============================================================================
+// Built-in transforms
+// ============================================================================
+
+DocumentTransform DocumentTransform::sort_lines(bool case_sensitive) {
+    DocumentTransform transform;
+    transform.id = case_sensitive ? "sort_lines" : "sort_lines_case_insensitive";
+    transform.title = case_sensitive ? "Sort Lines" : "Sort Lines (Ignore Case)";
+    auto less = [case_sensitive](std::string_view a, std::string_view b) {
+        return case_sensitive ? a < b : less_folded(a, b);
+    };
+    transform.map = [less](TransformChunk& chunk, const CancellationToken&) {
+        std::vector<std::string_view> lines = split_lines(chunk.text);
+        std::string last;
+        std::string_view added = terminate_last(lines, chunk.text, last);
+        std::stable_sort(lines.begin(), lines.end(), less);
+        chunk.output.reserve(chunk.text.size() + added.size());
+        for (std::string_view line : lines) {
+            chunk.output.append(line.data(), line.size());
+            chunk.output += '\n';
+        }
+    };
+    // Merge the sorted chunks back into chunks of about their old size;
+    // ties go to the earlier chunk, which keeps the sort stable
+    transform.combine = [less](std::vector<TransformChunk>& chunks) {
+        std::vector<std::vector<std::string_view>> runs(chunks.size());
+        for (size_t i = 0; i < chunks.size(); ++i) runs[i] = split_lines(chunks[i].output);
+        using Head = std::pair<size_t, size_t>;     // Run, line
+        auto later = [&](const Head& a, const Head& b) {
+            std::string_view x = runs[a.first][a.second], y = runs[b.first][b.second];
+            if (less(x, y)) return false;
+            if (less(y, x)) return true;
+            return a.first > b.first;
+        };
+        std::priority_queue<Head, std::vector<Head>, decltype(later)> heads(later);
+        for (size_t i = 0; i < runs.size(); ++i) {
+            if (!runs[i].empty()) heads.push({i, 0});
+        }
+        std::vector<std::string> merged(chunks.size());
+        size_t target = 0;
+        while (!heads.empty()) {
+            Head head = heads.top();
+            heads.pop();
+            while (target + 1 < chunks.size() && merged[target].size() >= chunks[target].text.size()) ++target;
+            std::string_view line = runs[head.first][head.second];
+            merged[target].append(line.data(), line.size());
+            merged[target] += '\n';
+            if (++head.second < runs[head.first].size()) heads.push(head);
+        }
+        for (size_t i = 0; i < chunks.size(); ++i) chunks[i].output = std::move(merged[i]);
+        if (!ends_with_newline(chunks)) drop_final_terminator(chunks);
+    };
+    return transform;
+}
+
+DocumentTransform DocumentTransform::unique_lines() {
+    DocumentTransform transform;
+    transform.id = "unique_lines";
+    transform.title = "Remove Duplicate Lines";
+    // Each chunk drops its own repeats in parallel; what is left is
+    // checked across chunks in order
+    auto keep_first = [](const std::string& text, std::unordered_set<std::string_view>& seen, std::string& out) {
+        std::vector<std::string_view> lines = split_lines(text);
+        std::string last;
+        terminate_last(lines, text, last);
+        for (std::string_view line : lines) {
+            std::string_view key = line;
+            if (!key.empty() && key.back() == '\r') key.remove_suffix(1);
+            if (!seen.insert(key).second) continue;
+            out.append(line.data(), line.size());
+            out += '\n';
+        }
+    };
+    transform.map = [keep_first](TransformChunk& chunk, const CancellationToken&) {
+        std::unordered_set<std::string_view> seen;
+        keep_first(chunk.text, seen, chunk.output);
+    };
+    transform.combine = [keep_first](std::vector<TransformChunk>& chunks) {
+        // Keys point into the mapped outputs, so they stay until the end
+        std::vector<std::string> kept(chunks.size());
+        std::unordered_set<std::string_view> seen;
+        for (size_t i = 0; i < chunks.size(); ++i) keep_first(chunks[i].output, seen, kept[i]);
+        for (size_t i = 0; i < chunks.size(); ++i) chunks[i].output = std::move(kept[i]);
+        if (!ends_with_newline(chunks)) drop_final_terminator(chunks);
+    };
+    return transform;
+}
+
+DocumentTransform DocumentTransform::reindent(size_t tab_width, bool use_spaces) {
+    DocumentTransform transform;
+    transform.id = use_spaces ? "reindent_spaces" : "reindent_tabs";
+    transform.title = use_spaces ? "Indent Using Spaces" : "Indent Using Tabs";
+    tab_width = (std::max)(tab_width, size_t(1));
+    transform.map = [tab_width, use_spaces](TransformChunk& chunk, const CancellationToken&) {
+        const std::string& text = chunk.text;
+        chunk.output.reserve(text.size());
+        for (size_t start = 0; start < text.size();) {
+            size_t column = 0, at = start;
+            for (; at < text.size() && (text[at] == ' ' || text[at] == '\t'); ++at) {
+                column = text[at] == '\t' ? (column / tab_width + 1) * tab_width : column + 1;
+            }
+            if (use_spaces) {
+                chunk.output.append(column, ' ');
+            } else {
+                chunk.output.append(column / tab_width, '\t');
+                chunk.output.append(column % tab_width, ' ');
+            }
+            size_t end = text.find('\n', at);
+            end = end == std::string::npos ? text.size() : end + 1;
+            chunk.output.append(text, at, end - at);
+            start = end;
+        }
+    };
+    return transform;
+}
+
+DocumentTransform DocumentTransform::pretty_json(size_t indent) {
+    DocumentTransform transform;
+    transform.id = "pretty_json";
+    transform.title = "Format JSON";
+    transform.split_anywhere = true;
+    // Where the chunk leaves things for each mode it could start in
+    transform.scan = [](TransformChunk& chunk) {
+        chunk.state.clear();
+        for (int64_t mode : {kOutside, kInString, kEscape}) {
+            JsonState state;
+            state.mode = mode;
+            walk_json(chunk.text, state, 0, nullptr);
+            chunk.state.insert(chunk.state.end(), {state.mode, state.depth, state.last, state.space});
+        }
+    };
+    transform.link = [](std::vector<TransformChunk>& chunks, std::string& error) {
+        JsonState state;
+        for (TransformChunk& chunk : chunks) {
+            auto first = chunk.state.begin() + state.mode * static_cast<int64_t>(kJsonFields);
+            std::vector<int64_t> end(first, first + kJsonFields);
+            chunk.state = {state.mode, state.depth, state.last, state.space};
+            state.mode = end[0];
+            state.depth += end[1];
+            if (end[2] != 0) {
+                state.last = end[2];
+                state.space = end[3];
+            } else {
+                state.space |= end[3];
+            }
+            if (state.depth < 0) {
+                error = "Not JSON: unbalanced brackets";
+                return false;
+            }
+        }
+        if (state.mode != kOutside) error = "Not JSON: unterminated string";
+        else if (state.depth != 0) error = "Not JSON: unbalanced brackets";
+        return error.empty();
+    };
+    transform.map = [indent](TransformChunk& chunk, const CancellationToken&) {
+        JsonState state{chunk.state[0], chunk.state[1], chunk.state[2], chunk.state[3]};
+        chunk.output.reserve(chunk.text.size() * 2);
+        walk_json(chunk.text, state, indent, &chunk.output);
+    };
+    transform.combine = [](std::vector<TransformChunk>& chunks) {
+        for (auto it = chunks.rbegin(); it != chunks.rend(); ++it) {
+            if (it->output.empty()) continue;
+            if (it->output.back() != '\n') it->output += '\n';
+            return;
+        }
+    };
+    return transform;
+}
+
+// ============================================================================
+// TransformPipeline
+// ============================================================================
+
+TransformPipeline::Result TransformPipeline::run(const DocumentSnapshot& snapshot, const DocumentTransform& transform,
+                                                 CancellationToken cancel, ProgressFn progress, size_t chunk_bytes) {
+    Result result;
+    result.version = snapshot.get_version();
+    if (!transform.map || snapshot.get_total_length() == 0) return result;
+
+    std::vector<size_t> starts = chunk_starts(snapshot, (std::max)(chunk_bytes, size_t(1)), transform.split_anywhere);
+    std::vector<TransformChunk> chunks(starts.size());
+    for (size_t i = 0; i < starts.size(); ++i) chunks[i].offset = starts[i];
+    size_t total = snapshot.get_total_length();
+    size_t stages = transform.scan ? 2 : 1;
+    std::atomic<size_t> done{0};
+    result.chunks = chunks.size();
+
+    // The first stage to reach a chunk copies its text out
+    auto parallel = [&](const std::function<void(TransformChunk&)>& stage) {
+        return run_stage(chunks.size(), [&](size_t i) {
+            TransformChunk& chunk = chunks[i];
+            if (chunk.text.empty()) {
+                size_t end = i + 1 < chunks.size() ? chunks[i + 1].offset : total;
+                chunk.text = snapshot.get_text(chunk.offset, end - chunk.offset);
+            }
+            stage(chunk);
+            size_t finished = done.fetch_add(1) + 1;
+            if (progress) progress(finished, chunks.size() * stages);
+        }, cancel);
+    };
+
+    if (transform.scan && !parallel(transform.scan)) {
+        result.cancelled = true;
+        return result;
+    }
+    if (transform.link && !transform.link(chunks, result.error)) return result;
+    if (!parallel([&](TransformChunk& chunk) { transform.map(chunk, cancel); })) {
+        result.cancelled = true;
+        return result;
+    }
+    if (transform.combine) transform.combine(chunks);
+
+    for (TransformChunk& chunk : chunks) {
+        if (chunk.output == chunk.text) continue;
+        result.edits.push_back({chunk.offset, chunk.text.size(), std::move(chunk.output)});
+    }
+    return result;
+}
+
+bool TransformPipeline::apply(PieceTable& document, Result& result) {
+    if (!result.ok() || document.get_version() != result.version) return false;
+    document.begin_transaction();
+    FindDialog::apply_edits(document, result.edits);
+    document.commit_transaction();
+    result.edits.clear();
+    return true;
+}
+
+bool TransformPipeline::transform(PieceTable& document, const DocumentTransform& transform, size_t chunk_bytes) {
+    Result result = run(*document.snapshot(), transform, CancellationToken(), nullptr, chunk_bytes);
+    return apply(document, result);
+}
+
+// ============================================================================
+// TransformRegistry
+// ============================================================================
+
+TransformRegistry::TransformRegistry() {
+    add(DocumentTransform::sort_lines());
+    add(DocumentTransform::sort_lines(false));
+    add(DocumentTransform::unique_lines());
+    add(DocumentTransform::pretty_json());
+}
+
+bool TransformRegistry::add(DocumentTransform transform) {
+    if (transform.id.empty() || !transform.map) return false;
+    for (DocumentTransform& existing : transforms_) {
+        if (existing.id == transform.id) {
+            existing = std::move(transform);
+            return true;
+        }
+    }
+    transforms_.push_back(std::move(transform));
+    return true;
+}
+
+bool TransformRegistry::remove(const std::string& id) {
+    auto it = std::find_if(transforms_.begin(), transforms_.end(),
+                           [&](const DocumentTransform& transform) { return transform.id == id; });
+    if (it == transforms_.end()) return false;
+    transforms_.erase(it);
+    return true;
+}
+
+const DocumentTransform* TransformRegistry::find(const std::string& id) const {
+    for (const DocumentTransform& transform : transforms_) {
+        if (transform.id == id) return &transform;
+    }
+    return nullptr;
+}
+
+} // namespace editor
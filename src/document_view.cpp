@@ -0,0 +1,91 @@
+#include "document_view.h"
+#include "code_folding.h"
+#include <algorithm>
+
+DocumentView::DocumentView(size_t visible_lines, size_t visible_columns)
+    : viewport_(visible_lines, visible_columns) {}
+
+DocumentView::~DocumentView() {
+    // The folds listen to the document too; they go first
+    viewport_.set_folding(nullptr);
+    folding_.reset();
+    if (document_) document_->remove_change_listener(listener_id_);
+}
+
+void DocumentView::set_document(const std::shared_ptr<PieceTable>& document) {
+    if (document_) document_->remove_change_listener(listener_id_);
+    viewport_.set_folding(nullptr);
+    folding_.reset();
+    document_ = document;
+    listener_id_ = 0;
+    viewport_.set_document(document_);
+    cursor_pos = 0;
+    has_selection = false;
+    selection_start = selection_end = 0;
+    extra_cursors.clear();
+    top_line_ = 0;
+    top_moved_ = false;
+    damage_first_ = SIZE_MAX;
+    damage_last_ = 0;
+    if (document_) {
+        listener_id_ = document_->add_change_listener([this](const PieceTable::Change& change) {
+            on_change(change);
+        });
+    }
+}
+
+CodeFoldingManager& DocumentView::folding() {
+    if (!folding_) {
+        folding_ = std::make_unique<CodeFoldingManager>();
+        folding_->set_document(document_);
+        viewport_.set_folding(folding_.get());
+    }
+    return *folding_;
+}
+
+size_t DocumentView::map_offset(size_t offset, const PieceTable::Change& change) {
+    if (offset < change.position) return offset;
+    if (offset < change.position + change.removed_length || offset == change.position) {
+        return change.position + change.inserted_length;
+    }
+    return offset - change.removed_length + change.inserted_length;
+}
+
+void DocumentView::on_change(const PieceTable::Change& change) {
+    cursor_pos = map_offset(cursor_pos, change);
+    selection_start = map_offset(selection_start, change);
+    selection_end = map_offset(selection_end, change);
+    for (size_t& cursor : extra_cursors) cursor = map_offset(cursor, change);
+
+    // Lines gained or lost above the top line move it with its text; a top
+    // line that was removed becomes the line the removal left
+    if (!top_moved_) top_line_ = viewport_.get_top_line();
+    if (change.first_line < top_line_) {
+        size_t removed_end = change.first_line + change.removed_newlines;
+        top_line_ = top_line_ <= removed_end ? change.first_line
+                                             : top_line_ - change.removed_newlines + change.inserted_newlines;
+        top_moved_ = true;
+    }
+
+    // Damage recorded earlier needs no shifting: lines below an edit only
+    // move when its line count changes, and then everything below is damaged
+    size_t first = change.first_line;
+    size_t last = change.removed_newlines == change.inserted_newlines ? first + change.inserted_newlines : SIZE_MAX;
+    damage_first_ = (std::min)(damage_first_, first);
+    damage_last_ = damage_last_ == SIZE_MAX ? SIZE_MAX : (std::max)(damage_last_, last);
+}
+
+void DocumentView::update() {
+    if (!top_moved_) return;
+    top_moved_ = false;
+    if (top_line_ != viewport_.get_top_line()) viewport_.scroll_to_line(top_line_);
+}
+
+bool DocumentView::take_damage(size_t& first_line, size_t& last_line) {
+    if (damage_first_ == SIZE_MAX) return false;
+    first_line = damage_first_;
+    last_line = damage_last_;
+    damage_first_ = SIZE_MAX;
+    damage_last_ = 0;
+    return true;
+}
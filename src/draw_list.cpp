@@ -0,0 +1,39 @@
+#include "draw_list.h"
+
+namespace editor {
+
+void DrawList::clear() {
+    commands_.clear();
+    text_.clear();
+    spans_.clear();
+}
+
+void DrawList::add_rect(int x, int y, int width, int height, uint32_t color) {
+    if (width <= 0 || height <= 0) return;
+    commands_.push_back({DrawKind::Rect, x, y, x + width, y + height, color, 0, 0, 0, 0});
+}
+
+void DrawList::add_line(int x1, int y1, int x2, int y2, uint32_t color) {
+    commands_.push_back({DrawKind::Line, x1, y1, x2, y2, color, 0, 0, 0, 0});
+}
+
+void DrawList::begin_run(int x, int y, int advance, uint32_t background) {
+    commands_.push_back({DrawKind::Run, x, y, advance, 0, background, static_cast<uint32_t>(text_.size()), 0,
+                         static_cast<uint32_t>(spans_.size()), 0});
+}
+
+void DrawList::append_run(std::string_view text, uint32_t color) {
+    if (text.empty() || commands_.empty() || commands_.back().kind != DrawKind::Run) return;
+    DrawCommand& run = commands_.back();
+    text_.append(text.data(), text.size());
+    run.text_length += static_cast<uint32_t>(text.size());
+    // Adjacent pieces in one color (plain text around an uncolored token) share a span
+    if (run.span_count > 0 && spans_.back().color == color) {
+        spans_.back().length += static_cast<uint32_t>(text.size());
+        return;
+    }
+    spans_.push_back({static_cast<uint32_t>(text.size()), color});
+    run.span_count++;
+}
+
+} // namespace editor
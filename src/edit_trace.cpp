@@ -0,0 +1,468 @@
+#include "edit_trace.h"
+#include "highlight_cache.h"
+#include "lsp_document_sync.h"
+#include "syntax_highlighter.h"
+#include "undo_manager.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <random>
+
+namespace editor {
+
+namespace {
+
+const char* const kHeader = "# edit-trace 1";
+
+std::string escape(const std::string& text) {
+    std::string out;
+    out.reserve(text.size());
+    for (char c : text) {
+        switch (c) {
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\\': out += "\\\\"; break;
+            default: out += c; break;
+        }
+    }
+    return out;
+}
+
+bool unescape(const std::string& text, std::string& out) {
+    out.clear();
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] != '\\') {
+            out += text[i];
+            continue;
+        }
+        if (++i == text.size()) return false;
+        switch (text[i]) {
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case '\\': out += '\\'; break;
+            default: return false;
+        }
+    }
+    return true;
+}
+
+// "<number> <number> ..." fields of a line after its tag; the text (if any)
+// is whatever follows the last number and its single separating space
+bool parse_fields(const std::string& line, size_t numbers, size_t* values, std::string* text) {
+    size_t at = 1;
+    for (size_t i = 0; i < numbers; ++i) {
+        if (at >= line.size() || line[at] != ' ') return false;
+        ++at;
+        size_t end = at;
+        while (end < line.size() && line[end] >= '0' && line[end] <= '9') ++end;
+        if (end == at) return false;
+        values[i] = static_cast<size_t>(std::stoull(line.substr(at, end - at)));
+        at = end;
+    }
+    if (!text) return at == line.size();
+    if (at == line.size()) return unescape(std::string(), *text);
+    if (line[at] != ' ') return false;
+    return unescape(line.substr(at + 1), *text);
+}
+
+// Identifiers, punctuation and the occasional newline, like source text
+std::string random_text(std::mt19937& rng, size_t length) {
+    static const char kChars[] = "abcdefghijklmnopqrstuvwxyz_ABCDEFGH0123456789 (){};=+-*/,.\n";
+    std::string text(length, ' ');
+    for (char& c : text) c = kChars[rng() % (sizeof(kChars) - 1)];
+    return text;
+}
+
+std::string format_ns(uint64_t ns) {
+    char text[32];
+    if (ns >= 1000000) std::snprintf(text, sizeof(text), "%.2f ms", ns / 1e6);
+    else if (ns >= 1000) std::snprintf(text, sizeof(text), "%.1f us", ns / 1e3);
+    else std::snprintf(text, sizeof(text), "%llu ns", static_cast<unsigned long long>(ns));
+    return text;
+}
+
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+} // namespace
+
+void EditTrace::insert(size_t position, std::string text) {
+    Op op;
+    op.kind = Op::Kind::Insert;
+    op.position = position;
+    op.text = std::move(text);
+    ops.push_back(std::move(op));
+}
+
+void EditTrace::remove(size_t position, size_t length) {
+    Op op;
+    op.kind = Op::Kind::Remove;
+    op.position = position;
+    op.length = length;
+    ops.push_back(std::move(op));
+}
+
+void EditTrace::multi_edit(std::vector<PieceTable::Edit> edits) {
+    Op op;
+    op.kind = Op::Kind::MultiEdit;
+    op.edits = std::move(edits);
+    ops.push_back(std::move(op));
+}
+
+size_t EditTrace::edit_count() const {
+    size_t count = 0;
+    for (const Op& op : ops) {
+        if (op.kind == Op::Kind::Insert || op.kind == Op::Kind::Remove || op.kind == Op::Kind::MultiEdit) count++;
+    }
+    return count;
+}
+
+void EditTrace::write(std::ostream& out) const {
+    out << kHeader << "\n";
+    if (!name.empty()) out << "# name " << name << "\n";
+    for (const Op& op : ops) {
+        switch (op.kind) {
+            case Op::Kind::Insert: out << "i " << op.position << " " << escape(op.text) << "\n"; break;
+            case Op::Kind::Remove: out << "d " << op.position << " " << op.length << "\n"; break;
+            case Op::Kind::MultiEdit:
+                out << "m " << op.edits.size() << "\n";
+                for (const PieceTable::Edit& edit : op.edits) {
+                    out << "e " << edit.position << " " << edit.length << " " << escape(edit.text) << "\n";
+                }
+                break;
+            case Op::Kind::Undo: out << "u\n"; break;
+            case Op::Kind::Redo: out << "r\n"; break;
+            case Op::Kind::Break: out << "b\n"; break;
+        }
+    }
+}
+
+bool EditTrace::read(std::istream& in, std::string* error) {
+    ops.clear();
+    std::string line;
+    size_t line_number = 0;
+    size_t edits_left = 0;
+    auto fail = [&]() {
+        if (error) *error = "line " + std::to_string(line_number) + ": malformed \"" + line + "\"";
+        return false;
+    };
+    while (std::getline(in, line)) {
+        line_number++;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+        if (line[0] == '#') {
+            if (line.compare(0, 7, "# name ") == 0) name = line.substr(7);
+            continue;
+        }
+        size_t values[2] = {0, 0};
+        std::string text;
+        if (edits_left > 0) {
+            if (line[0] != 'e' || !parse_fields(line, 2, values, &text)) return fail();
+            ops.back().edits.push_back({values[0], values[1], std::move(text)});
+            edits_left--;
+            continue;
+        }
+        switch (line[0]) {
+            case 'i':
+                if (!parse_fields(line, 1, values, &text)) return fail();
+                insert(values[0], std::move(text));
+                break;
+            case 'd':
+                if (!parse_fields(line, 2, values, nullptr)) return fail();
+                remove(values[0], values[1]);
+                break;
+            case 'm':
+                if (!parse_fields(line, 1, values, nullptr)) return fail();
+                multi_edit({});
+                edits_left = values[0];
+                break;
+            case 'u': case 'r': case 'b':
+                if (line.size() != 1) return fail();
+                push(line[0] == 'u' ? Op::Kind::Undo : line[0] == 'r' ? Op::Kind::Redo : Op::Kind::Break);
+                break;
+            default:
+                return fail();
+        }
+    }
+    if (edits_left > 0) {
+        if (error) *error = "line " + std::to_string(line_number) + ": multi-cursor edit cut short";
+        return false;
+    }
+    return true;
+}
+
+bool EditTrace::save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+    write(out);
+    return static_cast<bool>(out);
+}
+
+bool EditTrace::load(const std::string& path, std::string* error) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        if (error) *error = "cannot open " + path;
+        return false;
+    }
+    return read(in, error);
+}
+
+EditTrace EditTrace::typing(size_t initial_length, size_t keystrokes, uint32_t seed) {
+    static const char* kWords[] = {"value", "result", "if", "return", "buffer_size", "count", "std::string",
+                                   "for", "const", "auto", "index", "->", "nullptr", "0", "++i"};
+    std::mt19937 rng(seed);
+    EditTrace trace;
+    trace.name = "typing";
+    size_t length = initial_length;
+    size_t cursor = 0;
+    size_t typed = 0;       // Typed since the cursor last moved; backspace stays inside it
+    std::string word;       // Rest of the word being typed
+    for (size_t keystroke = 0; keystroke < keystrokes; ++keystroke) {
+        if (keystroke % 80 == 0) {
+            // Click somewhere else
+            cursor = length ? rng() % (length + 1) : 0;
+            typed = 0;
+            trace.break_group();
+        }
+        if (keystroke % 250 == 249) {
+            // Undo and redo leave the text as it was, so the trace stays in range
+            trace.undo();
+            trace.redo();
+            trace.break_group();
+        }
+        uint32_t roll = rng() % 20;
+        if (roll == 0 && typed > 0) {
+            trace.remove(--cursor, 1);
+            length--;
+            typed--;
+            continue;
+        }
+        std::string key;
+        if (word.empty()) {
+            key = roll == 1 ? "\n" : " ";
+            word = kWords[rng() % (sizeof(kWords) / sizeof(kWords[0]))];
+        } else {
+            key = word.substr(0, 1);
+            word.erase(0, 1);
+        }
+        trace.insert(cursor, key);
+        cursor++;
+        length++;
+        typed++;
+    }
+    return trace;
+}
+
+EditTrace EditTrace::random(size_t initial_length, size_t ops, uint32_t seed) {
+    std::mt19937 rng(seed);
+    EditTrace trace;
+    trace.name = "random";
+    size_t length = initial_length;
+    for (size_t i = 0; i < ops; ++i) {
+        size_t size = 1 + rng() % 64;
+        if (length > 0 && rng() % 2) {
+            size_t position = rng() % length;
+            size = (std::min)(size, length - position);
+            trace.remove(position, size);
+            length -= size;
+        } else {
+            trace.insert(length ? rng() % (length + 1) : 0, random_text(rng, size));
+            length += size;
+        }
+    }
+    return trace;
+}
+
+EditTrace EditTrace::paste_storm(size_t initial_length, size_t pastes, size_t paste_size, uint32_t seed) {
+    std::mt19937 rng(seed);
+    EditTrace trace;
+    trace.name = "paste_storm";
+    size_t length = initial_length;
+    std::string clipboard = random_text(rng, paste_size);
+    for (size_t i = 0; i < pastes; ++i) {
+        if (length > paste_size && rng() % 3 == 0) {
+            size_t size = paste_size / 2 + rng() % (paste_size + 1);
+            size = (std::min)(size, length);
+            trace.remove(rng() % (length - size + 1), size);
+            length -= size;
+        } else {
+            trace.insert(length ? rng() % (length + 1) : 0, clipboard);
+            length += clipboard.size();
+        }
+        trace.break_group();
+    }
+    return trace;
+}
+
+EditTrace EditTrace::multi_cursor(size_t initial_length, size_t bursts, size_t cursors, uint32_t seed) {
+    std::mt19937 rng(seed);
+    EditTrace trace;
+    trace.name = "multi_cursor";
+    size_t length = initial_length;
+    cursors = (std::max)(cursors, size_t(1));
+    for (size_t burst = 0; burst < bursts; ++burst) {
+        // Distinct carets, sorted
+        std::vector<size_t> carets;
+        for (size_t i = 0; i < cursors; ++i) carets.push_back(length ? rng() % (length + 1) : 0);
+        std::sort(carets.begin(), carets.end());
+        carets.erase(std::unique(carets.begin(), carets.end()), carets.end());
+        trace.break_group();
+
+        size_t typed = 0;
+        size_t keystrokes = 4 + rng() % 12;
+        for (size_t key = 0; key < keystrokes; ++key) {
+            std::vector<PieceTable::Edit> edits;
+            if (typed > 0 && rng() % 5 == 0) {
+                // Backspace at every caret, over what it typed this burst
+                for (size_t caret : carets) edits.push_back({caret - 1, 1, std::string()});
+                for (size_t i = 0; i < carets.size(); ++i) carets[i] -= i + 1;
+                length -= carets.size();
+                typed--;
+            } else {
+                std::string text(1, "abcdefgh_ (;"[rng() % 12]);
+                for (size_t caret : carets) edits.push_back({caret, 0, text});
+                for (size_t i = 0; i < carets.size(); ++i) carets[i] += i + 1;
+                length += carets.size();
+                typed++;
+            }
+            trace.multi_edit(std::move(edits));
+        }
+    }
+    return trace;
+}
+
+EditTraceRecorder::~EditTraceRecorder() {
+    attach(nullptr);
+}
+
+void EditTraceRecorder::attach(const std::shared_ptr<PieceTable>& document) {
+    if (document_) document_->remove_change_listener(listener_id_);
+    document_ = document;
+    if (!document_) return;
+    listener_id_ = document_->add_change_listener([this](const PieceTable::Change& change) {
+        if (change.removed_length > 0) trace_.remove(change.position, change.removed_length);
+        if (change.inserted_length > 0) {
+            trace_.insert(change.position, document_->get_text(change.position, change.inserted_length));
+        }
+    });
+}
+
+std::string ReplayResult::format() const {
+    char text[256];
+    double rate = ops_per_second();
+    char rate_text[32];
+    if (rate >= 1e6) std::snprintf(rate_text, sizeof(rate_text), "%.2f Mops/s", rate / 1e6);
+    else std::snprintf(rate_text, sizeof(rate_text), "%.1f Kops/s", rate / 1e3);
+    std::snprintf(text, sizeof(text), "%-12s %-13s %8zu ops  %13s  p50 %s  p99 %s  max %s", target.c_str(),
+                  trace.c_str(), ops, rate_text, format_ns(latency_ns.percentile(50)).c_str(),
+                  format_ns(latency_ns.percentile(99)).c_str(), format_ns(latency_ns.max()).c_str());
+    return text;
+}
+
+ReplayResult replay(const EditTrace& trace, const std::string& initial, TextBufferBackend backend) {
+    using Op = EditTrace::Op;
+    std::shared_ptr<TextBuffer> buffer = TextBuffer::create(initial, backend);
+    ReplayResult result;
+    result.target = backend == TextBufferBackend::GapBuffer ? "GapBuffer"
+                  : backend == TextBufferBackend::Rope ? "RopeTable" : "PieceTable";
+    result.trace = trace.name;
+
+    auto begin = std::chrono::steady_clock::now();
+    for (const Op& op : trace.ops) {
+        if (op.kind == Op::Kind::Break) continue;   // Backends keep no typing groups
+        auto start = std::chrono::steady_clock::now();
+        switch (op.kind) {
+            case Op::Kind::Insert: buffer->insert(op.position, op.text); break;
+            case Op::Kind::Remove: buffer->remove(op.position, op.length); break;
+            case Op::Kind::MultiEdit:
+                // Back to front, so earlier edits' pre-edit offsets still hold
+                for (auto edit = op.edits.rbegin(); edit != op.edits.rend(); ++edit) {
+                    if (edit->length > 0) buffer->remove(edit->position, edit->length);
+                    if (!edit->text.empty()) buffer->insert(edit->position, edit->text);
+                }
+                break;
+            case Op::Kind::Undo: buffer->undo(); break;
+            case Op::Kind::Redo: buffer->redo(); break;
+            case Op::Kind::Break: break;
+        }
+        result.latency_ns.record(elapsed_ns(start, std::chrono::steady_clock::now()));
+        result.ops++;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    result.final_text = buffer->get_text(0, buffer->get_total_length());
+    return result;
+}
+
+ReplayResult replay_pipeline(const EditTrace& trace, const std::string& initial, size_t lsp_batch,
+                             PipelineCounters* counters) {
+    using Op = EditTrace::Op;
+    auto document = std::make_shared<PieceTable>(initial);
+    UndoManager undo;
+    SyntaxHighlighter highlighter;
+    HighlightCache highlights(&highlighter);
+    highlights.set_document(document);
+    LspDocumentSync sync;
+    sync.set_document(document, "file:///trace.cpp");
+    std::vector<LspContentChange> changes;
+    PipelineCounters counts;
+
+    // Lines to repaint after each operation, as the view would
+    std::vector<size_t> edited_lines;
+    size_t listener = document->add_change_listener([&](const PieceTable::Change& change) {
+        edited_lines.push_back(change.first_line);
+    });
+    // Everything highlighted once, as after opening the file
+    if (document->get_line_count() > 0) highlights.get_tokens(document->get_line_count() - 1);
+    size_t tokenized_before = highlights.tokenize_count();
+
+    ReplayResult result;
+    result.target = "pipeline";
+    result.trace = trace.name;
+    lsp_batch = (std::max)(lsp_batch, size_t(1));
+    auto begin = std::chrono::steady_clock::now();
+    for (const Op& op : trace.ops) {
+        auto start = std::chrono::steady_clock::now();
+        edited_lines.clear();
+        switch (op.kind) {
+            case Op::Kind::Insert:
+                undo.execute(std::make_unique<InsertCommand>(document.get(), op.position, op.text), true);
+                break;
+            case Op::Kind::Remove:
+                undo.execute(std::make_unique<DeleteCommand>(document.get(), op.position, op.length), true);
+                break;
+            case Op::Kind::MultiEdit:
+                undo.execute(std::make_unique<MultiEditCommand>(document.get(), op.edits));
+                break;
+            case Op::Kind::Undo: undo.undo(); break;
+            case Op::Kind::Redo: undo.redo(); break;
+            case Op::Kind::Break: undo.break_group(); break;
+        }
+        for (size_t line : edited_lines) highlights.get_tokens(line);
+        if ((result.ops + 1) % lsp_batch == 0 && sync.take(changes)) {
+            counts.lsp_batches++;
+            counts.lsp_changes += changes.size();
+        }
+        result.latency_ns.record(elapsed_ns(start, std::chrono::steady_clock::now()));
+        result.ops++;
+    }
+    if (sync.take(changes)) {
+        counts.lsp_batches++;
+        counts.lsp_changes += changes.size();
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    document->remove_change_listener(listener);
+
+    counts.tokenized_lines = highlights.tokenize_count() - tokenized_before;
+    counts.undo_steps = undo.get_undo_count();
+    if (counters) *counters = counts;
+    result.final_text = document->get_text(0, document->get_total_length());
+    return result;
+}
+
+} // namespace editor
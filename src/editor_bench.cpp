@@ -0,0 +1,639 @@
+// editor_bench.cpp
+// Benchmark suite for the text engine, highlighting, search and completion.
+//
+//   editor_bench [--filter <substring>] [--json <file>] [--min-time <seconds>]
+//                [--huge] [--fixtures <dir>] [--trace <file> [--trace-text <file>]]
+//
+// Every benchmark runs against synthetic 1M-line source (and 10M lines with
+// --huge) plus the test_file_large*.txt fixtures. --json writes results in
+// Google Benchmark's JSON layout so existing comparison tooling can diff runs.
+// --trace adds a recorded editing session (see EditTrace) to the replay
+// benchmarks, applied over --trace-text or an empty document.
+
+#include "piece_table.h"
+#include "document_snapshot.h"
+#include "rope_table.h"
+#include "gap_text_buffer.h"
+#include "hex_buffer.h"
+#include "diff_engine.h"
+#include "internal_clipboard.h"
+#include "text_scan.h"
+#include "syntax_highlighter.h"
+#include "find_dialog.h"
+#include "indexer.h"
+#include "thread_pool.h"
+#include "quick_open.h"
+#include "autocomplete.h"
+#include "platform_file.h"
+#include "terminal_screen.h"
+#include "edit_trace.h"
+#ifdef VELOCITY_HAVE_WASM3
+#include "wasm_runtime.h"
+#include "wasm3.h"
+#endif
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef VELOCITY_SOURCE_DIR
+#define VELOCITY_SOURCE_DIR "."
+#endif
+
+namespace {
+
+struct Options {
+    std::string filter;
+    std::string json_path;
+    std::string fixtures = VELOCITY_SOURCE_DIR;
+    std::string trace_path;
+    std::string trace_text_path;
+    double min_time = 0.2;
+    bool huge = false;
+};
+
+struct Result {
+    std::string name;
+    size_t iterations;
+    double ns_per_iteration;
+    double items_per_second;
+};
+
+class Runner {
+public:
+    explicit Runner(const Options& options) : options_(options) {}
+
+    // Time body() (which processes `items` items per call) until min_time has
+    // elapsed, doubling the batch so timer overhead stays negligible
+    template <typename Body>
+    void run(const std::string& name, size_t items, Body&& body) {
+        if (!selected(name)) return;
+        body();     // Warm-up
+        size_t batch = 1;
+        double elapsed = 0.0;
+        while (true) {
+            auto start = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < batch; ++i) body();
+            elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (elapsed >= options_.min_time || batch >= (size_t(1) << 30)) break;
+            batch *= 2;
+        }
+        Result result{name, batch, elapsed * 1e9 / static_cast<double>(batch),
+                      static_cast<double>(items) * static_cast<double>(batch) / elapsed};
+        std::cout << pad(name, 56) << pad(std::to_string(result.iterations), 12)
+                  << result.ns_per_iteration << " ns\n";
+        results_.push_back(result);
+    }
+
+    bool selected(const std::string& name) const {
+        return options_.filter.empty() || name.find(options_.filter) != std::string::npos;
+    }
+
+    bool write_json(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out) return false;
+        out << "{\n  \"context\": {\n";
+        out << "    \"executable\": \"editor_bench\",\n";
+        out << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+        out << "    \"min_time\": " << options_.min_time << "\n  },\n";
+        out << "  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results_.size(); ++i) {
+            const Result& r = results_[i];
+            out << "    {\"name\": \"" << r.name << "\", \"run_type\": \"iteration\", \"iterations\": " << r.iterations
+                << ", \"real_time\": " << r.ns_per_iteration << ", \"cpu_time\": " << r.ns_per_iteration
+                << ", \"time_unit\": \"ns\", \"items_per_second\": " << r.items_per_second << "}"
+                << (i + 1 < results_.size() ? ",\n" : "\n");
+        }
+        out << "  ]\n}\n";
+        return true;
+    }
+
+private:
+    static std::string pad(const std::string& s, size_t width) {
+        return s.size() >= width ? s + " " : s + std::string(width - s.size(), ' ');
+    }
+
+    const Options& options_;
+    std::vector<Result> results_;
+};
+
+std::string synthetic_source(size_t lines) {
+    static const char* kLines[] = {
+        "    int value_%zu = compute(%zu, buffer_size); // update running total\n",
+        "    if (result != nullptr && result->count > %zu) {\n",
+        "        std::string label = \"item %zu\";\n",
+        "    }\n",
+        "/* block comment %zu spanning\n   a second line */\n",
+        "#define LIMIT_%zu 0x%zx\n",
+        "for (size_t i = 0; i < %zu; ++i) total += weights[i];\n",
+        "\n",
+    };
+    std::string text;
+    text.reserve(lines * 48);
+    char line[160];
+    size_t produced = 0;
+    for (size_t i = 0; produced < lines; ++i) {
+        const char* format = kLines[i % (sizeof(kLines) / sizeof(kLines[0]))];
+        int n = std::snprintf(line, sizeof(line), format, i, i);
+        text.append(line, static_cast<size_t>(n));
+        produced += std::count(line, line + n, '\n');
+    }
+    return text;
+}
+
+std::vector<std::string> all_lines(const std::string& text) {
+    std::vector<std::string> lines;
+    size_t start = 0;
+    while (start < text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos) end = text.size();
+        lines.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+    return lines;
+}
+
+template <typename Buffer>
+void bench_buffer_edits(Runner& runner, const std::string& prefix, const std::string& text) {
+    {
+        Buffer buffer(text);
+        std::mt19937_64 rng(1);
+        runner.run(prefix + "/random_insert", 1, [&]() {
+            buffer.insert(rng() % (buffer.get_total_length() + 1), "edit\n");
+        });
+    }
+    {
+        Buffer buffer(text);
+        std::mt19937_64 rng(2);
+        runner.run(prefix + "/random_delete", 1, [&]() {
+            // Refill small inputs so later iterations still delete something
+            if (buffer.get_total_length() < text.size() / 2 + 16) buffer.insert(0, text);
+            buffer.remove(rng() % (buffer.get_total_length() - 16), 8);
+        });
+    }
+}
+
+void bench_input(Runner& runner, const std::string& label, const std::string& text, bool full_suite) {
+    // Buffers
+    bench_buffer_edits<PieceTable>(runner, "PieceTable/" + label, text);
+    bench_buffer_edits<RopeTable>(runner, "RopeTable/" + label, text);
+    if (text.size() < TextBuffer::kSmallFileLimit * 64) {
+        bench_buffer_edits<GapTextBuffer>(runner, "GapBuffer/" + label, text);
+    }
+
+    PieceTable doc(text);
+    std::mt19937_64 rng(3);
+    size_t line_count = doc.get_line_count();
+    runner.run("PieceTable/" + label + "/line_lookup", 1, [&]() {
+        volatile size_t start = doc.get_line_start(rng() % line_count);
+        (void)start;
+    });
+    runner.run("PieceTable/" + label + "/get_lines_range_50", 50, [&]() {
+        volatile size_t n = doc.get_lines_range(rng() % line_count, 50).size();
+        (void)n;
+    });
+    auto snapshot = doc.snapshot();
+    runner.run("DocumentSnapshot/" + label + "/get_line", 1, [&]() {
+        volatile size_t n = snapshot->get_line(rng() % line_count).size();
+        (void)n;
+    });
+    if (!full_suite) return;
+
+    // Highlighting - one pass of 1000 consecutive lines with carried state
+    std::vector<std::string> lines = doc.get_lines_range(0, 1000);
+    SyntaxHighlighter highlighter;
+    std::vector<Token> token_buffer;
+    runner.run("SyntaxHighlighter/" + label + "/tokenize_1000_lines", lines.size(), [&]() {
+        SyntaxHighlighter::LineState state;
+        size_t tokens = 0;
+        for (const std::string& line : lines) {
+            SyntaxHighlighter::LineState out;
+            highlighter.tokenize_line(line, state, out, token_buffer);
+            tokens += token_buffer.size();
+            state = out;
+        }
+        volatile size_t sink = tokens;
+        (void)sink;
+    });
+
+    // Find in the whole document
+    FindDialog find;
+    runner.run("FindDialog/" + label + "/find_all", text.size(), [&]() {
+        volatile size_t n = find.find_all(text, "buffer_size").size();
+        (void)n;
+    });
+    runner.run("FindDialog/" + label + "/find_all_pieces", text.size(), [&]() {
+        volatile size_t n = find.find_all(doc, "buffer_size").size();
+        (void)n;
+    });
+    FindDialog regex_find;
+    regex_find.set_use_regex(true);
+    runner.run("FindDialog/" + label + "/find_all_regex", text.size(), [&]() {
+        volatile size_t n = regex_find.find_all(doc, "value_\\d+ = \\w+\\(").size();
+        (void)n;
+    });
+
+    // Word index over [up to] the first 100k lines, split into 1000-line files
+    BackgroundIndexer indexer;
+    std::vector<std::string> file_lines = all_lines(doc.get_text(0, doc.get_line_start(100000)));
+    for (size_t i = 0; i < file_lines.size(); i += 1000) {
+        std::string content;
+        for (size_t j = i; j < std::min(file_lines.size(), i + 1000); ++j) content += file_lines[j] + "\n";
+        indexer.index_file("file_" + std::to_string(i / 1000) + ".cpp", content);
+    }
+    runner.run("BackgroundIndexer/" + label + "/search", 1, [&]() {
+        volatile size_t n = indexer.search("weights", 100).size();
+        (void)n;
+    });
+    runner.run("BackgroundIndexer/" + label + "/find_in_files_literal", 1, [&]() {
+        volatile size_t n = indexer.find_in_files("label = \"item 4242", false, true).size();
+        (void)n;
+    });
+    runner.run("BackgroundIndexer/" + label + "/find_in_files_regex", 1, [&]() {
+        volatile size_t n = indexer.find_in_files("LIMIT_42[0-9]+ 0x", true).size();
+        (void)n;
+    });
+
+    AutocompleteManager autocomplete;
+    auto shared_doc = std::make_shared<PieceTable>(text);
+    autocomplete.attach(shared_doc);
+    runner.run("AutocompleteManager/" + label + "/suggest", 1, [&]() {
+        volatile size_t n = autocomplete.suggest("val").size();
+        (void)n;
+    });
+    // A keystroke inside a word and its backspace, recounted incrementally
+    runner.run("AutocompleteManager/" + label + "/edit", 1, [&]() {
+        shared_doc->insert(text.size() / 2, "x");
+        shared_doc->remove(text.size() / 2, 1);
+    });
+}
+
+// Offset -> piece lookups on a fragmented document: tree descent vs the
+// snapshot's prefix-sum array
+void bench_piece_lookup(Runner& runner) {
+    PieceTable doc(std::string(1000000, 'x'));
+    std::mt19937 rng(1);
+    for (int i = 0; i < 50000; ++i) {
+        doc.insert(rng() % doc.get_total_length(), "ab\n");
+    }
+    auto snapshot = doc.snapshot();
+    size_t length = doc.get_total_length();
+    runner.run("PieceTable/fragmented/chunk_at", 1, [&]() {
+        volatile size_t position = doc.chunks(rng() % length, 1).position();
+        (void)position;
+    });
+    runner.run("DocumentSnapshot/fragmented/chunk_at", 1, [&]() {
+        volatile size_t size = snapshot->chunk_at(rng() % length).size();
+        (void)size;
+    });
+}
+
+// Cold crawl of the repository's own sources on the full thread pool
+void bench_workspace_crawl(Runner& runner, const Options& options) {
+    std::vector<std::string> roots = {editor::PlatformFile::join_path(options.fixtures, "src"),
+                                      editor::PlatformFile::join_path(options.fixtures, "include")};
+    runner.run("BackgroundIndexer/crawl_source_tree", 1, [&]() {
+        BackgroundIndexer indexer;
+        indexer.index_workspace(roots);
+        indexer.wait_for_indexing();
+    });
+}
+
+// Quick-open queries over 1M synthetic paths, cold and refined as if typed
+void bench_quick_open(Runner& runner) {
+    static const char* kDirs[] = {"src", "include", "tests", "docs", "third_party/lib", "tools/build"};
+    static const char* kNames[] = {"piece_table", "syntax_highlighter", "file_watcher", "quick_open", "main_window"};
+    static const char* kExtensions[] = {".cpp", ".h", ".md", ".txt"};
+    QuickOpenIndex index;
+    char path[128];
+    for (size_t i = 0; i < 1000000; ++i) {
+        std::snprintf(path, sizeof(path), "/work/%s/module_%zu/%s_%zu%s", kDirs[i % 6], i / 64, kNames[i % 5], i % 97,
+                      kExtensions[i % 4]);
+        index.add_path(path);
+    }
+    // Alternating queries, neither extending the other, so each one is a full scan
+    bool flip = false;
+    runner.run("QuickOpenIndex/1M_paths/cold_query", 1, [&]() {
+        flip = !flip;
+        volatile size_t n = index.search(flip ? "qopn.cpp" : "synhl.h").size();
+        (void)n;
+    });
+    runner.run("QuickOpenIndex/1M_paths/typed_query", 1, [&]() {
+        size_t n = 0;
+        for (const char* query : {"f", "fi", "fil", "filew", "filewa", "filewat.h"}) n += index.search(query).size();
+        volatile size_t sink = n;
+        (void)sink;
+    });
+}
+
+// A colored build log through the VT parser and scrollback, in the pipe
+// reads' 64KB chunks: the `cat build.log` case
+void bench_terminal(Runner& runner) {
+    std::string log;
+    char line[160];
+    for (size_t i = 0; i < 100000; ++i) {
+        int n = i % 10 == 0
+            ? std::snprintf(line, sizeof(line), "\x1b[1msrc/module_%zu.cpp:%zu:7: \x1b[35mwarning:\x1b[0m unused variable 'x'\r\n", i, i)
+            : std::snprintf(line, sizeof(line), "[%zu/100000] Building CXX object src/module_%zu.cpp.o\r\n", i, i);
+        log.append(line, static_cast<size_t>(n));
+    }
+    editor::TerminalScreen screen(120, 40);
+    runner.run("TerminalScreen/build_log/feed", log.size(), [&]() {
+        for (size_t offset = 0; offset < log.size(); offset += 65536) {
+            screen.feed(log.data() + offset, (std::min)(size_t(65536), log.size() - offset));
+        }
+    });
+}
+
+// A 64MB core-dump-like image (mostly zero pages, some words of data):
+// byte-pattern search with the vectorized kernel against the memchr one,
+// and formatting a screen of hex rows anywhere in it
+void bench_hex_view(Runner& runner) {
+    std::string image(64 * 1024 * 1024, '\0');
+    uint32_t seed = 7;
+    for (size_t i = 0; i < image.size(); i += 4096) {
+        if ((i / 4096) % 4 != 0) continue;
+        for (size_t j = 0; j < 4096; j += 8) {
+            seed = seed * 1664525u + 1013904223u;
+            std::memcpy(&image[i + j], &seed, sizeof(seed));
+        }
+    }
+    const std::string pattern("\xde\xad\xbe\xef\x00\x00\x00\x01", 8);
+    image.replace(image.size() - 64, pattern.size(), pattern);
+    runner.run("TextScan/core_image/find_bytes", image.size(), [&]() {
+        TextScan::find_bytes(image.data(), image.size(), pattern.data(), pattern.size());
+    });
+    runner.run("TextScan/core_image/find_bytes_scalar", image.size(), [&]() {
+        TextScan::find_bytes_scalar(image.data(), image.size(), pattern.data(), pattern.size());
+    });
+    HexBuffer hex(image);
+    hex.overwrite(1 << 20, "patch");
+    runner.run("HexBuffer/core_image/find_patched", image.size(), [&]() { hex.find(pattern); });
+    std::mt19937 rng(3);
+    runner.run("HexBuffer/core_image/screen_of_rows", 50, [&]() {
+        size_t top = rng() % (hex.get_line_count() - 50);
+        hex.get_lines_range(top, 50);
+    });
+}
+
+// Two 1M-line config dumps a few hundred scattered edits apart, diffed
+// whole: hashing both, anchoring, and the per-region diffs inline and on
+// a pool
+void bench_diff(Runner& runner) {
+    std::string dump;
+    dump.reserve(40 * 1000000);
+    for (size_t line = 0; line < 1000000; ++line) {
+        if (line % 10 == 0) dump += "[section." + std::to_string(line / 10) + "]\n";
+        else if (line % 10 == 9) dump += "\n";
+        else dump += "key" + std::to_string(line % 10) + " = " + std::to_string(line * 2654435761u % 100000) + "\n";
+    }
+    PieceTable old_table(dump);
+    PieceTable new_table(dump);
+    std::mt19937 rng(79);
+    for (int edit = 0; edit < 300; ++edit) {
+        size_t at = new_table.get_line_start(rng() % (new_table.get_line_count() - 1));
+        if (edit % 2) new_table.insert(at, "changed = " + std::to_string(edit) + "\n");
+        else new_table.remove(at, new_table.get_line_start(new_table.get_line_at(at) + 1) - at);
+    }
+    auto old_snapshot = old_table.snapshot();
+    auto new_snapshot = new_table.snapshot();
+    ThreadPool pool;
+    runner.run("DiffEngine/config_1M/diff", 2000000, [&]() { editor::DiffEngine::diff(*old_snapshot, *new_snapshot); });
+    runner.run("DiffEngine/config_1M/diff_pool", 2000000, [&]() {
+        editor::DiffEngine::diff(*old_snapshot, *new_snapshot, &pool);
+    });
+}
+
+// Copying 64 MB out of one tab and pasting it into another: as text
+// (what the system clipboard round trip did) and as shared pieces
+void bench_clipboard(Runner& runner) {
+    auto source = std::make_shared<PieceTable>(synthetic_source(1600000));
+    for (size_t i = 1; i < 64; ++i) source->insert(source->get_total_length() * i / 64, "// edit\n");
+    size_t length = source->get_total_length();
+    runner.run("Clipboard/64MB/copy_paste_text", length, [&]() {
+        PieceTable target("");
+        target.insert(0, source->get_text(0, length));
+    });
+    runner.run("Clipboard/64MB/copy_paste_pieces", length, [&]() {
+        PieceTable target("");
+        editor::InternalClipboard clipboard;
+        clipboard.copy(source, 0, length);
+        clipboard.paste(target, 0);
+    });
+}
+
+// Editing sessions replayed on each backend and through the edit pipeline:
+// throughput goes to the results, per-operation latency percentiles are
+// printed below each one
+void bench_edit_traces(Runner& runner, const Options& options) {
+    std::string initial = synthetic_source(20000);
+    std::vector<std::pair<editor::EditTrace, std::string>> sessions = {
+        {editor::EditTrace::typing(initial.size(), 20000), initial},
+        {editor::EditTrace::random(initial.size(), 20000), initial},
+        {editor::EditTrace::paste_storm(initial.size(), 1000), initial},
+        {editor::EditTrace::multi_cursor(initial.size(), 200), initial},
+    };
+    if (!options.trace_path.empty()) {
+        editor::EditTrace recorded;
+        std::string error;
+        std::string text;
+        if (!recorded.load(options.trace_path, &error)) {
+            std::cerr << "Skipping trace " << options.trace_path << ": " << error << "\n";
+        } else if (!options.trace_text_path.empty() &&
+                   !editor::PlatformFile::read_file(options.trace_text_path, text, editor::LineEnding::LF)) {
+            std::cerr << "Skipping trace: cannot read " << options.trace_text_path << "\n";
+        } else {
+            if (recorded.name.empty()) recorded.name = "recorded";
+            sessions.emplace_back(std::move(recorded), std::move(text));
+        }
+    }
+
+    const std::pair<const char*, TextBufferBackend> kBackends[] = {
+        {"PieceTable", TextBufferBackend::PieceTable},
+        {"RopeTable", TextBufferBackend::Rope},
+        {"GapBuffer", TextBufferBackend::GapBuffer},
+    };
+    for (const auto& session : sessions) {
+        const editor::EditTrace& trace = session.first;
+        const std::string& text = session.second;
+        for (const auto& entry : kBackends) {
+            TextBufferBackend backend = entry.second;
+            std::string name = "EditTrace/" + trace.name + "/" + entry.first;
+            if (!runner.selected(name)) continue;
+            runner.run(name, trace.ops.size(), [&]() { editor::replay(trace, text, backend); });
+            std::cout << "  " << editor::replay(trace, text, backend).format() << "\n";
+        }
+        std::string name = "EditTrace/" + trace.name + "/pipeline";
+        if (!runner.selected(name)) continue;
+        runner.run(name, trace.ops.size(), [&]() { editor::replay_pipeline(trace, text); });
+        std::cout << "  " << editor::replay_pipeline(trace, text).format() << "\n";
+    }
+}
+
+#ifdef VELOCITY_HAVE_WASM3
+// A plugin handler's call: (export "add") (param i32 i32) (result i32),
+// by name with string arguments as calls used to go, and through the
+// runtime's resolved handle with binary ones
+void bench_wasm_calls(Runner& runner) {
+    static const uint8_t kAddModule[] = {
+        0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+        0x01, 0x07, 0x01, 0x60, 0x02, 0x7f, 0x7f, 0x01, 0x7f,     // type: (i32, i32) -> i32
+        0x03, 0x02, 0x01, 0x00,                                   // function 0 has type 0
+        0x07, 0x07, 0x01, 0x03, 'a', 'd', 'd', 0x00, 0x00,        // export "add"
+        0x0a, 0x09, 0x01, 0x07, 0x00, 0x20, 0x00, 0x20, 0x01, 0x6a, 0x0b,
+    };
+    const size_t kCalls = 1000;
+
+    IM3Environment env = m3_NewEnvironment();
+    IM3Runtime runtime = m3_NewRuntime(env, 64 * 1024, nullptr);
+    IM3Module module = nullptr;
+    if (m3_ParseModule(env, &module, kAddModule, sizeof(kAddModule)) || m3_LoadModule(runtime, module)) {
+        std::cerr << "Skipping wasm benchmarks: module failed to load\n";
+        m3_FreeRuntime(runtime);
+        m3_FreeEnvironment(env);
+        return;
+    }
+    runner.run("WasmRuntime/add/by_name_argv", kCalls, [&]() {
+        for (size_t i = 0; i < kCalls; ++i) {
+            IM3Function func = nullptr;
+            if (m3_FindFunction(&func, runtime, "add")) return;
+            std::string a = std::to_string(i), b = std::to_string(7);
+            const char* argv[] = { a.c_str(), b.c_str() };
+            m3_CallArgv(func, 2, argv);
+        }
+    });
+    m3_FreeRuntime(runtime);
+    m3_FreeEnvironment(env);
+
+    editor::WasmRuntime wasm;
+    if (!wasm.initialize() || !wasm.load_module_from_memory(kAddModule, sizeof(kAddModule))) return;
+    const editor::WasmRuntime::FunctionHandle* add = wasm.find_function("add");
+    if (!add) return;
+    runner.run("WasmRuntime/add/handle", kCalls, [&]() {
+        int64_t sum = 0;
+        for (size_t i = 0; i < kCalls; ++i) {
+            int64_t args[] = { static_cast<int64_t>(i), 7 };
+            int64_t result = 0;
+            wasm.call(*add, args, 2, &result);
+            sum += result;
+        }
+        volatile int64_t sink = sum;
+        (void)sink;
+    });
+    runner.run("WasmRuntime/add/call_function", kCalls, [&]() {
+        for (size_t i = 0; i < kCalls; ++i) {
+            wasm.call_function("add", { static_cast<int64_t>(i), 7 });
+        }
+    });
+}
+
+// The same compute-bound module on each engine built in: a plugin
+// spinning in a loop, as formatters and linters do, where the call
+// overhead is noise and the engine's code is everything
+void bench_wasm_engines(Runner& runner) {
+    // (export "spin") (param $n i32) (result i32): acc = acc * 31 + n, n times
+    static const uint8_t kSpinModule[] = {
+        0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+        0x01, 0x06, 0x01, 0x60, 0x01, 0x7f, 0x01, 0x7f,           // type: (i32) -> i32
+        0x03, 0x02, 0x01, 0x00,                                   // function 0 has type 0
+        0x07, 0x08, 0x01, 0x04, 's', 'p', 'i', 'n', 0x00, 0x00,   // export "spin"
+        0x0a, 0x26, 0x01, 0x24, 0x01, 0x01, 0x7f,                 // one i32 local: acc
+        0x02, 0x40, 0x03, 0x40,                                   // block loop
+        0x20, 0x00, 0x45, 0x0d, 0x01,                             //   br_if 1 (n == 0)
+        0x20, 0x01, 0x41, 0x1f, 0x6c, 0x20, 0x00, 0x6a, 0x21, 0x01, //   acc = acc * 31 + n
+        0x20, 0x00, 0x41, 0x01, 0x6b, 0x21, 0x00,                 //   n -= 1
+        0x0c, 0x00, 0x0b, 0x0b,                                   // br 0 end end
+        0x20, 0x01, 0x0b,                                         // acc
+    };
+    const size_t kCalls = 20;
+    const int64_t kIterations = 1000000;
+
+    for (editor::WasmEngineKind kind : { editor::WasmEngineKind::Interpreter, editor::WasmEngineKind::Compiled }) {
+        std::string name = std::string("WasmEngine/spin/") + editor::wasm_engine_name(kind);
+        if (!runner.selected(name)) continue;
+        if (!editor::wasm_engine_available(kind)) {
+            std::cout << "  " << name << ": not built in\n";
+            continue;
+        }
+        editor::WasmRuntime wasm(kind);
+        if (!wasm.initialize() || !wasm.load_module_from_memory(kSpinModule, sizeof(kSpinModule))) {
+            std::cerr << "Skipping " << name << ": " << wasm.get_error() << "\n";
+            continue;
+        }
+        const editor::WasmRuntime::FunctionHandle* spin = wasm.find_function("spin");
+        if (!spin) continue;
+        int64_t last = 0;
+        runner.run(name, kCalls, [&]() {
+            for (size_t i = 0; i < kCalls; ++i) {
+                wasm.call(*spin, &kIterations, 1, &last);
+            }
+        });
+        volatile int64_t sink = last;
+        (void)sink;
+    }
+}
+#endif
+
+void usage() {
+    std::cout << "editor_bench [--filter <substring>] [--json <file>] [--min-time <seconds>] [--huge] [--fixtures <dir>]\n"
+                 "             [--trace <file> [--trace-text <file>]]\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--filter" && has_value) options.filter = argv[++i];
+        else if (arg == "--json" && has_value) options.json_path = argv[++i];
+        else if (arg == "--fixtures" && has_value) options.fixtures = argv[++i];
+        else if (arg == "--trace" && has_value) options.trace_path = argv[++i];
+        else if (arg == "--trace-text" && has_value) options.trace_text_path = argv[++i];
+        else if (arg == "--min-time" && has_value) options.min_time = std::atof(argv[++i]);
+        else if (arg == "--huge") options.huge = true;
+        else {
+            usage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    Runner runner(options);
+    bench_piece_lookup(runner);
+    bench_workspace_crawl(runner, options);
+    bench_quick_open(runner);
+    bench_terminal(runner);
+    bench_hex_view(runner);
+    bench_diff(runner);
+    bench_clipboard(runner);
+    bench_edit_traces(runner, options);
+#ifdef VELOCITY_HAVE_WASM3
+    bench_wasm_calls(runner);
+    bench_wasm_engines(runner);
+#endif
+    bench_input(runner, "synthetic_1M", synthetic_source(1000000), true);
+    if (options.huge) bench_input(runner, "synthetic_10M", synthetic_source(10000000), true);
+    for (const char* fixture : {"test_file_large.txt", "test_file_large_gen.txt"}) {
+        std::string content;
+        std::string path = editor::PlatformFile::join_path(options.fixtures, fixture);
+        if (!editor::PlatformFile::read_file(path, content, editor::LineEnding::LF)) {
+            std::cerr << "Skipping missing fixture " << path << "\n";
+            continue;
+        }
+        bench_input(runner, fixture, content, false);
+    }
+
+    if (!options.json_path.empty() && !runner.write_json(options.json_path)) {
+        std::cerr << "Failed to write " << options.json_path << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -1,7 +1,38 @@
 #include "piece_table.h"
+#include "document_snapshot.h"
 #include <iostream>
 #include <chrono>
 #include <string>
+#include <random>
+#include <vector>
+
+// Offset -> piece lookups: red-black tree descent vs the flat 32-bit
+// prefix-sum array of a snapshot, on a fragmented document
+static void benchmark_piece_lookup() {
+    PieceTable doc(std::string(1000000, 'x'));
+    std::mt19937 rng(1);
+    for (int i = 0; i < 50000; ++i) {
+        doc.insert(rng() % doc.get_total_length(), "ab\n");
+    }
+    auto snapshot = doc.snapshot();
+    std::vector<size_t> probes(1000000);
+    for (size_t& p : probes) p = rng() % doc.get_total_length();
+
+    size_t sink = 0;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (size_t p : probes) sink += doc.chunks(p, 1).position();
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (size_t p : probes) sink += snapshot->chunk_at(p).size();
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    auto ns = [&](auto a, auto b) {
+        return std::chrono::duration<double, std::nano>(b - a).count() / static_cast<double>(probes.size());
+    };
+    std::cout << "Piece lookup over " << doc.get_piece_count() << " pieces:\n";
+    std::cout << "  tree:     " << ns(t0, t1) << " ns/lookup, " << doc.get_index_bytes() << " bytes\n";
+    std::cout << "  snapshot: " << ns(t1, t2) << " ns/lookup, " << snapshot->get_index_bytes() << " bytes\n";
+    std::cout << "  (checksum " << sink << ")\n";
+}
 
 int main() {
     PieceTable pt;
@@ -26,5 +57,6 @@ int main() {
     auto undo_end = std::chrono::high_resolution_clock::now();
     auto undo_ms = std::chrono::duration_cast<std::chrono::milliseconds>(undo_end - undo_start).count();
     std::cout << "Undo " << N << " operations in " << undo_ms << " ms\n";
+    benchmark_piece_lookup();
     return 0;
 }
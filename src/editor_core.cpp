@@ -2,18 +2,18 @@
 #include "gap_buffer.h"
 #include <fstream>
 #include <string>
+#include <iterator>
 
 EditorCore::EditorCore() : buffer_() {}
 
 bool EditorCore::open(const std::string& filename) {
     std::ifstream file(filename, std::ios::in | std::ios::binary);
     if (!file.is_open()) return false;
-    buffer_.clear();
-    std::string line;
-    while (std::getline(file, line)) {
-        buffer_.insert(buffer_.size(), line + "\n");
-    }
+    // Read the file in one block and insert it with a single reservation
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
     file.close();
+    buffer_.clear();
+    buffer_.insert(0, content);
     filename_ = filename;
     return true;
 }
@@ -21,7 +21,10 @@ bool EditorCore::open(const std::string& filename) {
 bool EditorCore::save(const std::string& filename) {
     std::ofstream file(filename, std::ios::out | std::ios::binary);
     if (!file.is_open()) return false;
-    file << buffer_.str();
+    std::string_view before = buffer_.before_gap();
+    std::string_view after = buffer_.after_gap();
+    file.write(before.data(), static_cast<std::streamsize>(before.size()));
+    file.write(after.data(), static_cast<std::streamsize>(after.size()));
     file.close();
     filename_ = filename;
     return true;
@@ -36,7 +39,7 @@ void EditorCore::erase(size_t pos, size_t len) {
 }
 
 std::string EditorCore::get_text() const {
-    return buffer_.str();
+    return buffer_.get_text();
 }
 
 void EditorCore::clear() {
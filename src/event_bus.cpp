@@ -0,0 +1,135 @@
+#include "event_bus.h"
+#include "piece_table.h"
+
+namespace editor {
+
+namespace {
+
+uint64_t latest_key(int document, EditorEvent type) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(document)) << 8) | static_cast<uint64_t>(type);
+}
+
+} // namespace
+
+size_t EventBus::subscribe(const EventFilter& filter, Listener listener) {
+    Subscriber subscriber{next_id_++, filter, std::move(listener)};
+    size_t id = subscriber.id;
+    (flushing_ ? added_ : subscribers_).push_back(std::move(subscriber));
+    return id;
+}
+
+void EventBus::unsubscribe(size_t id) {
+    for (std::vector<Subscriber>* list : {&subscribers_, &added_}) {
+        for (auto it = list->begin(); it != list->end(); ++it) {
+            if (it->id != id) continue;
+            // A listener being called is not destroyed under itself
+            if (flushing_) {
+                it->removed = true;
+            } else {
+                list->erase(it);
+            }
+            return;
+        }
+    }
+}
+
+bool EventBus::merge_edit(const EventRecord& record) {
+    auto latest = latest_.find(latest_key(record.document, EditorEvent::DocumentChanged));
+    if (latest == latest_.end()) return false;
+    EventRecord& previous = records_[latest->second];
+    size_t inserted_end = previous.position + previous.inserted;
+    if (record.position == inserted_end) {
+        // Continues right after the previous edit: typing, forward delete
+        previous.length += record.length;
+        previous.inserted += record.inserted;
+    } else if (record.position >= previous.position && record.position + record.length <= inserted_end) {
+        // Rewrites text the previous edit inserted: a typo corrected
+        previous.inserted = previous.inserted - record.length + record.inserted;
+    } else if (record.position + record.length == previous.position) {
+        // Ends where the previous edit starts: backspacing
+        previous.position = record.position;
+        previous.length += record.length;
+        previous.inserted += record.inserted;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void EventBus::publish(const EventRecord& record) {
+    if (record.type == EditorEvent::DocumentChanged && merge_edit(record)) return;
+    uint64_t key = latest_key(record.document, record.type);
+    if (record.type == EditorEvent::CursorMoved || record.type == EditorEvent::SelectionChanged) {
+        // Only the last position matters to anyone
+        auto latest = latest_.find(key);
+        if (latest != latest_.end() && !dead_[latest->second]) {
+            dead_[latest->second] = 1;
+            dead_count_++;
+        }
+    }
+    latest_[key] = records_.size();
+    records_.push_back(record);
+    dead_.push_back(0);
+}
+
+size_t EventBus::watch_document(PieceTable& document, int document_id) {
+    return document.add_change_listener([this, document_id](const PieceTable::Change& change) {
+        EventRecord record;
+        record.type = EditorEvent::DocumentChanged;
+        record.document = document_id;
+        record.position = change.position;
+        record.length = change.removed_length;
+        record.inserted = change.inserted_length;
+        publish(record);
+    });
+}
+
+size_t EventBus::flush() {
+    if (flushing_ || records_.empty()) return 0;
+    flushing_ = true;
+
+    // Records published by listeners belong to the next frame
+    delivering_.clear();
+    uint32_t present = 0;
+    for (size_t i = 0; i < records_.size(); ++i) {
+        if (dead_[i]) continue;
+        delivering_.push_back(records_[i]);
+        present |= EventFilter::type_bit(records_[i].type);
+    }
+    records_.clear();
+    dead_.clear();
+    dead_count_ = 0;
+    latest_.clear();
+
+    size_t called = 0;
+    for (size_t i = 0; i < subscribers_.size(); ++i) {
+        Subscriber& subscriber = subscribers_[i];
+        const EventFilter& filter = subscriber.filter;
+        if (subscriber.removed || !(filter.types & present)) continue;
+        EventBatch batch;
+        if (filter.document == EventFilter::kAnyDocument && (filter.types & present) == present) {
+            batch = {delivering_.data(), delivering_.size()};
+        } else {
+            scratch_.clear();
+            for (const EventRecord& record : delivering_) {
+                if (filter.matches(record)) scratch_.push_back(record);
+            }
+            if (scratch_.empty()) continue;
+            batch = {scratch_.data(), scratch_.size()};
+        }
+        subscriber.listener(batch);
+        called++;
+    }
+
+    flushing_ = false;
+    for (auto it = subscribers_.begin(); it != subscribers_.end();) {
+        it = it->removed ? subscribers_.erase(it) : it + 1;
+    }
+    for (Subscriber& subscriber : added_) {
+        if (!subscriber.removed) subscribers_.push_back(std::move(subscriber));
+    }
+    added_.clear();
+    return called;
+}
+
+} // namespace editor
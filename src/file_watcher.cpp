@@ -0,0 +1,495 @@
+#include "file_watcher.h"
+#include <filesystem>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <CoreServices/CoreServices.h>
+#include <dispatch/dispatch.h>
+#else
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <unordered_map>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace editor {
+
+namespace {
+
+bool is_separator(char c) {
+    return c == '/' || c == '\\';
+}
+
+// Path below root without the leading separator; false if outside root
+bool relative_to(const std::string& root, const std::string& path, std::string& relative) {
+    if (path.compare(0, root.size(), root) != 0) return false;
+    size_t start = root.size();
+    if (start < path.size() && !is_separator(path[start]) && !is_separator(root.back())) return false;
+    while (start < path.size() && is_separator(path[start])) ++start;
+    relative = path.substr(start);
+    return true;
+}
+
+std::string join(const std::string& directory, const std::string& name) {
+    if (directory.empty() || is_separator(directory.back())) return directory + name;
+    return directory + static_cast<char>(fs::path::preferred_separator) + name;
+}
+
+} // namespace
+
+// ============================================================================
+// Linux: one inotify watch per directory, added as directories appear
+// ============================================================================
+#if !defined(_WIN32) && !defined(__APPLE__)
+
+struct FileWatcher::Backend {
+    explicit Backend(FileWatcher& owner) : owner_(owner) {}
+
+    bool start(const std::string& root) {
+        fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd_ < 0) return false;
+        if (pipe(wake_) != 0) {
+            close(fd_);
+            fd_ = -1;
+            return false;
+        }
+        root_ = root;
+        if (!add_tree(root)) {
+            stop();
+            return false;
+        }
+        reader_ = std::thread(&Backend::run, this);
+        return true;
+    }
+
+    void stop() {
+        if (reader_.joinable()) {
+            char byte = 0;
+            ssize_t written = write(wake_[1], &byte, 1);
+            (void)written;
+            reader_.join();
+        }
+        for (int* fd : {&fd_, &wake_[0], &wake_[1]}) {
+            if (*fd >= 0) close(*fd);
+            *fd = -1;
+        }
+        directories_.clear();
+    }
+
+private:
+    static constexpr uint32_t kMask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE |
+                                      IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+    // Watch a directory and everything below it that is not ignored;
+    // <root>/.git is watched without its subdirectories
+    bool add_tree(const std::string& directory) {
+        std::string relative;
+        if (!relative_to(root_, directory, relative) || (!relative.empty() && is_ignored(relative))) {
+            return true;
+        }
+        int wd = inotify_add_watch(fd_, directory.c_str(), kMask);
+        if (wd < 0) return false;
+        directories_[wd] = directory;
+        if (relative == ".git") return true;
+
+        std::error_code ec;
+        for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+            std::error_code type_ec;
+            if (it->is_directory(type_ec) && !it->is_symlink(type_ec)) add_tree(it->path().string());
+        }
+        return true;
+    }
+
+    // A directory moved away keeps its watches under the old path
+    void drop_tree(const std::string& directory) {
+        for (auto it = directories_.begin(); it != directories_.end();) {
+            std::string relative;
+            if (relative_to(directory, it->second, relative)) {
+                inotify_rm_watch(fd_, it->first);
+                it = directories_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void handle(const inotify_event& event) {
+        if (event.mask & IN_Q_OVERFLOW) {
+            owner_.record(FileChange::Kind::Modified, root_, true);
+            return;
+        }
+        auto it = directories_.find(event.wd);
+        if (it == directories_.end()) return;
+        if (event.mask & IN_IGNORED) {
+            directories_.erase(it);
+            return;
+        }
+        // Events about the watched directory itself arrive through its parent
+        if (event.len == 0) return;
+
+        std::string path = join(it->second, event.name);
+        bool is_directory = (event.mask & IN_ISDIR) != 0;
+        if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+            if (is_directory) add_tree(path);
+            owner_.record(FileChange::Kind::Created, path, is_directory);
+        } else if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+            if (is_directory && (event.mask & IN_MOVED_FROM)) drop_tree(path);
+            owner_.record(FileChange::Kind::Removed, path, is_directory);
+        } else if (!is_directory) {
+            owner_.record(FileChange::Kind::Modified, path, false);
+        }
+    }
+
+    void run() {
+        alignas(inotify_event) char buffer[64 * 1024];
+        while (true) {
+            pollfd fds[2] = {{fd_, POLLIN, 0}, {wake_[0], POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            if (fds[1].revents) return;
+
+            ssize_t length = read(fd_, buffer, sizeof(buffer));
+            if (length <= 0) continue;
+            for (char* p = buffer; p < buffer + length;) {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+                handle(*event);
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+    }
+
+    FileWatcher& owner_;
+    std::string root_;
+    int fd_ = -1;
+    int wake_[2] = {-1, -1};
+    std::thread reader_;
+    std::unordered_map<int, std::string> directories_;  // Reader thread only once started
+};
+
+// ============================================================================
+// macOS: one FSEvents stream with per-file events on a private queue
+// ============================================================================
+#elif defined(__APPLE__)
+
+struct FileWatcher::Backend {
+    explicit Backend(FileWatcher& owner) : owner_(owner) {}
+
+    bool start(const std::string& root) {
+        root_ = root;
+        // FSEvents reports resolved paths (/private/var/... for /var/...)
+        std::error_code ec;
+        real_root_ = fs::weakly_canonical(root, ec).string();
+        if (ec) real_root_ = root;
+
+        CFStringRef path = CFStringCreateWithCString(nullptr, real_root_.c_str(), kCFStringEncodingUTF8);
+        CFArrayRef paths = CFArrayCreate(nullptr, reinterpret_cast<const void**>(&path), 1, &kCFTypeArrayCallBacks);
+        FSEventStreamContext context = {0, this, nullptr, nullptr, nullptr};
+        stream_ = FSEventStreamCreate(nullptr, &Backend::on_events, &context, paths, kFSEventStreamEventIdSinceNow,
+                                      0.05, kFSEventStreamCreateFlagFileEvents | kFSEventStreamCreateFlagNoDefer);
+        CFRelease(paths);
+        CFRelease(path);
+        if (!stream_) return false;
+
+        queue_ = dispatch_queue_create("velocity.file_watcher", DISPATCH_QUEUE_SERIAL);
+        FSEventStreamSetDispatchQueue(stream_, queue_);
+        if (!FSEventStreamStart(stream_)) {
+            stop();
+            return false;
+        }
+        return true;
+    }
+
+    void stop() {
+        if (stream_) {
+            FSEventStreamStop(stream_);
+            FSEventStreamInvalidate(stream_);
+            // Let a callback already running on the queue finish
+            dispatch_sync_f(queue_, nullptr, [](void*) {});
+            FSEventStreamRelease(stream_);
+            stream_ = nullptr;
+        }
+        if (queue_) {
+            dispatch_release(queue_);
+            queue_ = nullptr;
+        }
+    }
+
+private:
+    static void on_events(ConstFSEventStreamRef, void* info, size_t count, void* event_paths,
+                          const FSEventStreamEventFlags flags[], const FSEventStreamEventId[]) {
+        Backend* self = static_cast<Backend*>(info);
+        char** paths = static_cast<char**>(event_paths);
+        for (size_t i = 0; i < count; ++i) {
+            std::string relative;
+            if (!relative_to(self->real_root_, paths[i], relative)) continue;
+            std::string path = relative.empty() ? self->root_ : join(self->root_, relative);
+
+            if (flags[i] & (kFSEventStreamEventFlagMustScanSubDirs | kFSEventStreamEventFlagRootChanged)) {
+                self->owner_.record(FileChange::Kind::Modified, path, true);
+                continue;
+            }
+            // Flags of coalesced events accumulate, so the current state decides
+            bool is_directory = (flags[i] & kFSEventStreamEventFlagItemIsDir) != 0;
+            std::error_code ec;
+            if (!fs::exists(path, ec)) {
+                self->owner_.record(FileChange::Kind::Removed, path, is_directory);
+            } else if (flags[i] & (kFSEventStreamEventFlagItemCreated | kFSEventStreamEventFlagItemRenamed)) {
+                self->owner_.record(FileChange::Kind::Created, path, is_directory);
+            } else if (!is_directory) {
+                self->owner_.record(FileChange::Kind::Modified, path, false);
+            }
+        }
+    }
+
+    FileWatcher& owner_;
+    std::string root_;
+    std::string real_root_;
+    FSEventStreamRef stream_ = nullptr;
+    dispatch_queue_t queue_ = nullptr;
+};
+
+// ============================================================================
+// Windows: ReadDirectoryChangesW over the whole subtree
+// ============================================================================
+#else
+
+namespace {
+
+std::wstring widen(const std::string& text) {
+    int length = MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), nullptr, 0);
+    std::wstring wide(static_cast<size_t>(length), L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), &wide[0], length);
+    return wide;
+}
+
+std::string narrow(const wchar_t* text, int length) {
+    int size = WideCharToMultiByte(CP_UTF8, 0, text, length, nullptr, 0, nullptr, nullptr);
+    std::string result(static_cast<size_t>(size), '\0');
+    WideCharToMultiByte(CP_UTF8, 0, text, length, &result[0], size, nullptr, nullptr);
+    return result;
+}
+
+} // namespace
+
+struct FileWatcher::Backend {
+    explicit Backend(FileWatcher& owner) : owner_(owner) {}
+
+    bool start(const std::string& root) {
+        root_ = root;
+        directory_ = CreateFileW(widen(root).c_str(), FILE_LIST_DIRECTORY,
+                                 FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                                 FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+        if (directory_ == INVALID_HANDLE_VALUE) return false;
+        stop_event_ = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        reader_ = std::thread(&Backend::run, this);
+        return true;
+    }
+
+    void stop() {
+        if (reader_.joinable()) {
+            SetEvent(stop_event_);
+            reader_.join();
+        }
+        if (directory_ != INVALID_HANDLE_VALUE) CloseHandle(directory_);
+        if (stop_event_) CloseHandle(stop_event_);
+        directory_ = INVALID_HANDLE_VALUE;
+        stop_event_ = nullptr;
+    }
+
+private:
+    void handle(const FILE_NOTIFY_INFORMATION& info) {
+        std::string path = join(root_, narrow(info.FileName, static_cast<int>(info.FileNameLength / sizeof(WCHAR))));
+        std::error_code ec;
+        bool is_directory = fs::is_directory(path, ec);
+        switch (info.Action) {
+            case FILE_ACTION_ADDED:
+            case FILE_ACTION_RENAMED_NEW_NAME:
+                owner_.record(FileChange::Kind::Created, path, is_directory);
+                break;
+            case FILE_ACTION_REMOVED:
+            case FILE_ACTION_RENAMED_OLD_NAME:
+                owner_.record(FileChange::Kind::Removed, path, false);
+                break;
+            case FILE_ACTION_MODIFIED:
+                // A directory is "modified" whenever its entries change; those
+                // entries are reported on their own
+                if (!is_directory) owner_.record(FileChange::Kind::Modified, path, false);
+                break;
+        }
+    }
+
+    void run() {
+        OVERLAPPED overlapped = {};
+        overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        alignas(DWORD) char buffer[64 * 1024];
+        const DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+                             FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+
+        while (true) {
+            ResetEvent(overlapped.hEvent);
+            if (!ReadDirectoryChangesW(directory_, buffer, sizeof(buffer), TRUE, filter, nullptr, &overlapped, nullptr)) {
+                break;
+            }
+            HANDLE handles[2] = {overlapped.hEvent, stop_event_};
+            DWORD bytes = 0;
+            if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0) {
+                CancelIo(directory_);
+                GetOverlappedResult(directory_, &overlapped, &bytes, TRUE);
+                break;
+            }
+            if (!GetOverlappedResult(directory_, &overlapped, &bytes, FALSE)) break;
+            if (bytes == 0) {
+                // The kernel buffer overflowed and the events are lost
+                owner_.record(FileChange::Kind::Modified, root_, true);
+                continue;
+            }
+
+            const char* p = buffer;
+            while (true) {
+                const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(p);
+                handle(*info);
+                if (info->NextEntryOffset == 0) break;
+                p += info->NextEntryOffset;
+            }
+        }
+        CloseHandle(overlapped.hEvent);
+    }
+
+    FileWatcher& owner_;
+    std::string root_;
+    HANDLE directory_ = INVALID_HANDLE_VALUE;
+    HANDLE stop_event_ = nullptr;
+    std::thread reader_;
+};
+
+#endif
+
+// ============================================================================
+// Coalescing and delivery
+// ============================================================================
+
+FileWatcher::FileWatcher() = default;
+
+FileWatcher::~FileWatcher() {
+    stop();
+}
+
+bool FileWatcher::start(const std::string& root, Callback callback, std::chrono::milliseconds debounce) {
+    stop();
+
+    root_ = root;
+    while (root_.size() > 1 && is_separator(root_.back())) root_.pop_back();
+    callback_ = std::move(callback);
+    debounce_ = debounce;
+    pending_.clear();
+    stopping_ = false;
+
+    backend_ = std::make_unique<Backend>(*this);
+    if (!backend_->start(root_)) {
+        backend_.reset();
+        return false;
+    }
+    dispatcher_ = std::thread(&FileWatcher::dispatch_loop, this);
+    running_ = true;
+    return true;
+}
+
+void FileWatcher::stop() {
+    if (!running_) return;
+
+    // The backend first, so nothing is recorded after the dispatcher exits
+    backend_->stop();
+    backend_.reset();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    dispatcher_.join();
+    pending_.clear();
+    running_ = false;
+}
+
+bool FileWatcher::is_ignored(const std::string& relative_path) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= relative_path.size()) {
+        size_t end = start;
+        while (end < relative_path.size() && !is_separator(relative_path[end])) ++end;
+        if (end > start) parts.push_back(relative_path.substr(start, end - start));
+        start = end + 1;
+    }
+
+    for (size_t i = 0; i < parts.size(); ++i) {
+        if (parts[i] == "node_modules") return true;
+        if (parts[i][0] == '.') {
+            // <root>/.git and the files directly inside it stay visible
+            if (i == 0 && parts[i] == ".git" && parts.size() <= 2) continue;
+            return true;
+        }
+    }
+    return false;
+}
+
+void FileWatcher::record(FileChange::Kind kind, const std::string& path, bool is_directory) {
+    std::string relative;
+    if (!relative_to(root_, path, relative) || (!relative.empty() && is_ignored(relative))) return;
+
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool was_idle = pending_.empty();
+    if (was_idle) first_event_ = now;
+    last_event_ = now;
+
+    auto it = pending_.find(path);
+    if (it == pending_.end()) {
+        pending_.emplace(path, FileChange{kind, path, is_directory});
+    } else {
+        // Fold the new event into what the batch already says about the path
+        FileChange& change = it->second;
+        if (change.kind == FileChange::Kind::Created) {
+            if (kind == FileChange::Kind::Removed) pending_.erase(it);   // Never existed as far as consumers know
+        } else if (change.kind == FileChange::Kind::Removed && kind == FileChange::Kind::Created) {
+            change.kind = FileChange::Kind::Modified;                   // Replaced
+            change.is_directory = is_directory;
+        } else {
+            change.kind = kind;
+            change.is_directory = change.is_directory || is_directory;
+        }
+    }
+
+    // A busy dispatcher re-reads the deadline when it wakes on its own
+    if (was_idle) wake_.notify_one();
+}
+
+void FileWatcher::dispatch_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        wake_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+        if (stopping_) return;
+
+        // Deliver once the burst goes quiet, but never later than kMaxLatency
+        auto deadline = std::min(last_event_ + debounce_, first_event_ + kMaxLatency);
+        if (std::chrono::steady_clock::now() < deadline) {
+            wake_.wait_until(lock, deadline, [this] { return stopping_; });
+            continue;
+        }
+
+        std::vector<FileChange> batch;
+        batch.reserve(pending_.size());
+        for (auto& entry : pending_) batch.push_back(std::move(entry.second));
+        pending_.clear();
+
+        lock.unlock();
+        callback_(batch);
+        lock.lock();
+    }
+}
+
+} // namespace editor
@@ -1,132 +1,472 @@
 #include "find_dialog.h"
+#include "piece_table.h"
+#include "regex_engine.h"
+#include "text_scan.h"
 #include <algorithm>
-#include <cctype>
+#include <cstring>
+#include <functional>
 
-std::string FindDialog::to_lower(const std::string& str) const {
-    std::string result = str;
-    std::transform(result.begin(), result.end(), result.begin(),
-                   [](unsigned char c) { return std::tolower(c); });
-    return result;
+namespace {
+
+constexpr size_t npos = std::string::npos;
+
+struct FoldTable {
+    unsigned char map[256];
+    FoldTable() {
+        for (int c = 0; c < 256; ++c) map[c] = static_cast<unsigned char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+    }
+};
+const FoldTable kFold;
+
+/**
+ * Matcher - Boyer-Moore-Horspool over one contiguous buffer
+ *
+ * The skip table is indexed by raw bytes; when folding case both cases of
+ * a letter share an entry, so the shifts stay safe without copying text.
+ */
+class Matcher {
+public:
+    Matcher(const std::string& pattern, bool case_sensitive) : pattern_(pattern), fold_(!case_sensitive) {
+        if (fold_) {
+            for (char& c : pattern_) c = static_cast<char>(kFold.map[static_cast<unsigned char>(c)]);
+        }
+        size_t m = pattern_.size();
+        std::fill(std::begin(skip_), std::end(skip_), m);
+        for (size_t i = 0; i + 1 < m; ++i) skip_[static_cast<unsigned char>(pattern_[i])] = m - 1 - i;
+        if (fold_) {
+            for (int c = 0; c < 256; ++c) skip_[c] = skip_[kFold.map[c]];
+        }
+    }
+
+    size_t size() const { return pattern_.size(); }
+
+    // First start in [from, size - m] where the pattern matches, or npos
+    size_t find(const char* data, size_t size, size_t from) const {
+        size_t m = pattern_.size();
+        if (from >= size || size - from < m) return npos;
+        if (m == 1 && !fold_) {
+            const void* hit = std::memchr(data + from, pattern_[0], size - from);
+            return hit ? static_cast<size_t>(static_cast<const char*>(hit) - data) : npos;
+        }
+        const unsigned char* text = reinterpret_cast<const unsigned char*>(data);
+        for (size_t s = from; s + m <= size; s += skip_[text[s + m - 1]]) {
+            if (equal_at(text + s)) return s;
+        }
+        return npos;
+    }
+
+private:
+    bool equal_at(const unsigned char* text) const {
+        for (size_t i = pattern_.size(); i-- > 0;) {
+            unsigned char c = fold_ ? kFold.map[text[i]] : text[i];
+            if (c != static_cast<unsigned char>(pattern_[i])) return false;
+        }
+        return true;
+    }
+
+    std::string pattern_;   // Folded when case-insensitive
+    bool fold_;
+    size_t skip_[256];
+};
+
+/**
+ * MatchStream - runs a Matcher over consecutive chunks of a document
+ *
+ * The last m - 1 bytes of each chunk are held back (copied, that is all
+ * that is ever copied) and joined with the head of the next chunk, so a
+ * match spanning chunks is found once. Newlines are counted only over the
+ * bytes between one match and the next.
+ */
+class MatchStream {
+public:
+    using Visitor = std::function<bool(const SearchMatch& match)>;
+
+    // Chunks must start at start, which lies on line (starting at line_start)
+    MatchStream(const Matcher& matcher, bool overlapping, size_t start, size_t line, size_t line_start,
+                Visitor visit)
+        : matcher_(matcher), overlapping_(overlapping), visit_(std::move(visit)), next_allowed_(start),
+          counted_to_(start), line_(line), line_start_(line_start), tail_pos_(start) {}
+
+    // Feed the chunk at document offset base; false once the visitor stopped
+    bool feed(std::string_view chunk, size_t base) {
+        size_t m = matcher_.size();
+        if (!tail_.empty()) {
+            window_.assign(tail_);
+            window_.append(chunk.data(), std::min(chunk.size(), m - 1));
+            // Starts inside the tail that the window holds enough bytes to decide
+            size_t decided = window_.size() >= m ? std::min(tail_.size(), window_.size() - m + 1) : 0;
+            for (size_t s = next_allowed_ > tail_pos_ ? next_allowed_ - tail_pos_ : 0; s < decided;
+                 s = next_allowed_ - tail_pos_) {
+                size_t hit = matcher_.find(window_.data(), decided + m - 1, s);
+                if (hit == npos) break;
+                if (!report(window_.data(), tail_pos_, tail_pos_ + hit)) return false;
+            }
+            if (decided < tail_.size()) {
+                // The chunk was shorter than the pattern: it all joins the tail
+                count(window_.data(), tail_pos_, tail_pos_ + decided);
+                tail_.assign(window_, decided, npos);
+                tail_pos_ += decided;
+                return true;
+            }
+            count(window_.data(), tail_pos_, base);
+            tail_.clear();
+        }
+
+        for (size_t s = next_allowed_ > base ? next_allowed_ - base : 0;; s = next_allowed_ - base) {
+            size_t hit = matcher_.find(chunk.data(), chunk.size(), s);
+            if (hit == npos) break;
+            if (!report(chunk.data(), base, base + hit)) return false;
+        }
+        size_t keep = chunk.size() >= m - 1 ? chunk.size() - (m - 1) : 0;
+        keep = std::max(keep, std::min(next_allowed_ > base ? next_allowed_ - base : 0, chunk.size()));
+        count(chunk.data(), base, base + keep);
+        tail_.assign(chunk.data() + keep, chunk.size() - keep);
+        tail_pos_ = base + keep;
+        return true;
+    }
+
+private:
+    // Advance the line count over [counted_to_, to); data starts at data_pos
+    void count(const char* data, size_t data_pos, size_t to) {
+        if (to <= counted_to_) return;
+        const char* begin = data + (counted_to_ - data_pos);
+        size_t length = to - counted_to_;
+        size_t newlines = TextScan::count_newlines(begin, length);
+        if (newlines) {
+            line_ += newlines;
+            const char* last = begin + length;
+            while (*--last != '\n') {}
+            line_start_ = counted_to_ + static_cast<size_t>(last - begin) + 1;
+        }
+        counted_to_ = to;
+    }
+
+    bool report(const char* data, size_t data_pos, size_t position) {
+        count(data, data_pos, position);
+        SearchMatch match;
+        match.position = position;
+        match.line = line_;
+        match.column = position - line_start_;
+        match.length = matcher_.size();
+        next_allowed_ = position + (overlapping_ ? 1 : matcher_.size());
+        return visit_(match);
+    }
+
+    const Matcher& matcher_;
+    bool overlapping_;
+    Visitor visit_;
+    size_t next_allowed_;   // First offset a new match may start at
+    size_t counted_to_;     // Newlines before this offset are in line_
+    size_t line_;
+    size_t line_start_;
+    std::string tail_;      // Held-back bytes starting at tail_pos_
+    size_t tail_pos_;
+    std::string window_;
+};
+
+// Line and column of ascending positions over consecutive chunks, counting
+// only the bytes between one position and the next
+class LineTracker {
+public:
+    LineTracker(const std::vector<std::string_view>& chunks, size_t position, size_t line, size_t line_start)
+        : chunks_(chunks), counted_to_(position), line_(line), line_start_(line_start) {
+        while (chunk_ < chunks_.size() && chunk_start_ + chunks_[chunk_].size() <= position) {
+            chunk_start_ += chunks_[chunk_++].size();
+        }
+    }
+
+    void advance(size_t to) {
+        while (counted_to_ < to && chunk_ < chunks_.size()) {
+            std::string_view chunk = chunks_[chunk_];
+            size_t begin = counted_to_ - chunk_start_;
+            size_t end = std::min(chunk.size(), to - chunk_start_);
+            size_t newlines = TextScan::count_newlines(chunk.data() + begin, end - begin);
+            if (newlines) {
+                line_ += newlines;
+                line_start_ = chunk_start_ + chunk.rfind('\n', end - 1) + 1;
+            }
+            counted_to_ = chunk_start_ + end;
+            if (end == chunk.size()) {
+                chunk_start_ += chunk.size();
+                ++chunk_;
+            }
+        }
+    }
+
+    size_t line() const { return line_; }
+    size_t column(size_t position) const { return position - line_start_; }
+
+private:
+    const std::vector<std::string_view>& chunks_;
+    size_t chunk_ = 0;
+    size_t chunk_start_ = 0;
+    size_t counted_to_;
+    size_t line_;
+    size_t line_start_;
+};
+
+// Where the search text comes from: a plain string...
+struct StringSource {
+    const std::string& text;
+
+    size_t length() const { return text.size(); }
+    void locate(size_t position, size_t& line, size_t& line_start) const {
+        line = TextScan::count_newlines(text.data(), position);
+        size_t newline = position == 0 ? npos : text.rfind('\n', position - 1);
+        line_start = newline == npos ? 0 : newline + 1;
+    }
+    bool feed(MatchStream& stream, size_t begin, size_t end) const {
+        return stream.feed(std::string_view(text).substr(begin, end - begin), begin);
+    }
+    std::vector<std::string_view> views() const { return {std::string_view(text)}; }
+};
+
+// ...or the pieces of a document
+struct PieceSource {
+    const PieceTable& document;
+
+    size_t length() const { return document.get_total_length(); }
+    void locate(size_t position, size_t& line, size_t& line_start) const {
+        if (!document.is_indexing()) {
+            line = document.get_line_at(position);
+            line_start = document.get_line_start(line);
+            return;
+        }
+        // Line metrics are still being built: count up to the position
+        line = 0;
+        line_start = 0;
+        for (auto it = document.chunks(0, position); !it.done(); ++it) {
+            std::string_view chunk = *it;
+            size_t newlines = TextScan::count_newlines(chunk.data(), chunk.size());
+            if (newlines) {
+                line += newlines;
+                line_start = it.position() + chunk.rfind('\n') + 1;
+            }
+        }
+    }
+    bool feed(MatchStream& stream, size_t begin, size_t end) const {
+        for (auto it = document.chunks(begin, end - begin); !it.done(); ++it) {
+            if (!stream.feed(*it, it.position())) return false;
+        }
+        return true;
+    }
+    std::vector<std::string_view> views() const {
+        std::vector<std::string_view> chunks;
+        for (auto it = document.chunks(); !it.done(); ++it) chunks.push_back(*it);
+        return chunks;
+    }
+};
+
+template <typename Source>
+void scan(const Source& source, const Matcher& matcher, size_t begin, size_t end, bool overlapping,
+          MatchStream::Visitor visit) {
+    size_t line = 0;
+    size_t line_start = 0;
+    if (begin > 0) source.locate(begin, line, line_start);
+    MatchStream stream(matcher, overlapping, begin, line, line_start, std::move(visit));
+    source.feed(stream, begin, end);
+}
+
+// Non-empty regex matches from begin, which lies on line (from line_start)
+void regex_scan(const std::vector<std::string_view>& chunks, const RegexEngine& regex, size_t begin, size_t line,
+                size_t line_start, const MatchStream::Visitor& visit) {
+    LineTracker lines(chunks, begin, line, line_start);
+    regex.for_each_match(chunks, begin, [&](const RegexEngine::Match& hit) {
+        if (hit.length == 0) return true;
+        lines.advance(hit.position);
+        SearchMatch match;
+        match.position = hit.position;
+        match.line = lines.line();
+        match.column = lines.column(hit.position);
+        match.length = hit.length;
+        return visit(match);
+    });
 }
 
-bool FindDialog::matches_at_position(const std::string& text, size_t pos,
-                                     const std::string& search_text) const {
-    if (pos + search_text.length() > text.length()) {
+template <typename Source>
+std::vector<SearchMatch> find_all_in(const Source& source, const std::string& search_text, bool case_sensitive,
+                                     const RegexEngine* regex) {
+    std::vector<SearchMatch> matches;
+    auto collect = [&](const SearchMatch& match) {
+        matches.push_back(match);
+        return true;
+    };
+    if (regex) {
+        regex_scan(source.views(), *regex, 0, 0, 0, collect);
+    } else {
+        scan(source, Matcher(search_text, case_sensitive), 0, source.length(), false, collect);
+    }
+    return matches;
+}
+
+template <typename Source>
+bool find_next_in(const Source& source, const std::string& search_text, bool case_sensitive,
+                  const RegexEngine* regex, size_t start_pos, SearchMatch& match) {
+    if (start_pos >= source.length()) return false;
+    bool found = false;
+    auto first = [&](const SearchMatch& hit) {
+        match = hit;
+        found = true;
         return false;
+    };
+    if (regex) {
+        size_t line = 0;
+        size_t line_start = 0;
+        source.locate(start_pos, line, line_start);
+        regex_scan(source.views(), *regex, start_pos, line, line_start, first);
+    } else {
+        scan(source, Matcher(search_text, case_sensitive), start_pos, source.length(), false, first);
     }
-    
-    if (case_sensitive_) {
-        return text.compare(pos, search_text.length(), search_text) == 0;
+    return found;
+}
+
+// Last match starting before start_pos: windows of kBackwardWindow bytes
+// are scanned forward, walking back from start_pos until one holds a
+// match. Lines are counted relative to each window and fixed up once at
+// the end. Literal windows allow overlapping matches; regex windows take
+// the regex's own left-to-right matches from the window start.
+template <typename Source>
+bool find_previous_in(const Source& source, const std::string& search_text, bool case_sensitive,
+                      const RegexEngine* regex, size_t start_pos, size_t window, SearchMatch& match) {
+    start_pos = std::min(start_pos, source.length());
+    bool found = false;
+    auto keep_last = [&](const SearchMatch& hit) {
+        if (hit.position >= start_pos) return false;
+        match = hit;
+        found = true;
+        return true;
+    };
+    size_t begin = start_pos > window ? start_pos - window : 0;
+    if (regex) {
+        std::vector<std::string_view> chunks = source.views();
+        while (true) {
+            regex_scan(chunks, *regex, begin, 0, begin, keep_last);
+            if (found || begin == 0) break;
+            start_pos = begin;
+            begin = begin > window ? begin - window : 0;
+        }
     } else {
-        std::string text_substr = text.substr(pos, search_text.length());
-        return to_lower(text_substr) == to_lower(search_text);
+        Matcher matcher(search_text, case_sensitive);
+        size_t m = matcher.size();
+        size_t end = std::min(source.length(), start_pos + m - 1);
+        while (end > begin) {
+            MatchStream stream(matcher, true, begin, 0, begin, keep_last);
+            source.feed(stream, begin, end);
+            if (found || begin == 0) break;
+            // Matches starting before begin may still end inside this window
+            end = std::min(end, begin + m - 1);
+            start_pos = begin;
+            begin = begin > window ? begin - window : 0;
+        }
     }
+    if (found) {
+        size_t line_start = 0;
+        source.locate(match.position, match.line, line_start);
+        match.column = match.position - line_start;
+    }
+    return found;
+}
+
+} // namespace
+
+std::shared_ptr<const RegexEngine> FindDialog::compile_regex(const std::string& pattern) {
+    std::shared_ptr<const RegexEngine> regex = RegexEngine::cached(pattern, case_sensitive_);
+    regex_error_ = regex->error();
+    last_regex_ = regex->ok() ? regex : nullptr;
+    return last_regex_;
 }
 
 std::vector<SearchMatch> FindDialog::find_all(const std::string& document_text,
                                               const std::string& search_text) {
-    std::vector<SearchMatch> matches;
-    
-    if (search_text.empty()) {
-        return matches;
-    }
-    
-    // Find all occurrences
-    size_t pos = 0;
-    while (pos < document_text.length()) {
-        if (matches_at_position(document_text, pos, search_text)) {
-            SearchMatch match;
-            match.position = pos;
-            match.length = search_text.length();
-            
-            // Calculate line and column
-            size_t line = 0;
-            size_t line_start = 0;
-            for (size_t i = 0; i < pos; ++i) {
-                if (document_text[i] == '\n') {
-                    line++;
-                    line_start = i + 1;
-                }
+    std::shared_ptr<const RegexEngine> regex;
+    if (search_text.empty() || (use_regex_ && !(regex = compile_regex(search_text)))) {
+        return {};
+    }
+    return find_all_in(StringSource{document_text}, search_text, case_sensitive_, regex.get());
+}
+
+std::vector<SearchMatch> FindDialog::find_all(const PieceTable& document, const std::string& search_text) {
+    std::shared_ptr<const RegexEngine> regex;
+    if (search_text.empty() || (use_regex_ && !(regex = compile_regex(search_text)))) {
+        return {};
+    }
+    return find_all_in(PieceSource{document}, search_text, case_sensitive_, regex.get());
+}
+
+void FindDialog::scan_range(const PieceTable& document, const std::string& search_text, size_t begin, size_t end,
+                            bool overlapping, const std::function<bool(const SearchMatch& match)>& visit) {
+    std::shared_ptr<const RegexEngine> regex;
+    if (search_text.empty() || (use_regex_ && !(regex = compile_regex(search_text)))) {
+        return;
+    }
+    PieceSource source{document};
+    end = std::min(end, source.length());
+    if (begin >= end) return;
+    auto bounded = [&](const SearchMatch& match) { return match.position < end && visit(match); };
+    size_t line = 0;
+    size_t line_start = 0;
+    if (begin > 0) source.locate(begin, line, line_start);
+    if (regex) {
+        // Stop the text after the line holding end, so a range costs its own size
+        size_t cut = source.length();
+        for (auto it = document.chunks(end); !it.done(); ++it) {
+            std::string_view chunk = *it;
+            size_t newline = chunk.find('\n');
+            if (newline != std::string_view::npos) {
+                cut = it.position() + newline + 1;
+                break;
             }
-            match.line = line;
-            match.column = pos - line_start;
-            
-            matches.push_back(match);
-            pos += search_text.length();
-        } else {
-            pos++;
         }
+        std::vector<std::string_view> chunks;
+        for (auto it = document.chunks(0, cut); !it.done(); ++it) chunks.push_back(*it);
+        regex_scan(chunks, *regex, begin, line, line_start, bounded);
+        return;
     }
-    
-    return matches;
+    Matcher matcher(search_text, case_sensitive_);
+    MatchStream stream(matcher, overlapping, begin, line, line_start, bounded);
+    source.feed(stream, begin, std::min(source.length(), end + matcher.size() - 1));
 }
 
 bool FindDialog::find_next(const std::string& document_text,
                            const std::string& search_text,
                            size_t start_pos,
                            SearchMatch& match) {
-    if (search_text.empty()) {
+    std::shared_ptr<const RegexEngine> regex;
+    if (search_text.empty() || (use_regex_ && !(regex = compile_regex(search_text)))) {
         return false;
     }
-    
-    // Search forward from start_pos
-    for (size_t pos = start_pos; pos < document_text.length(); ++pos) {
-        if (matches_at_position(document_text, pos, search_text)) {
-            match.position = pos;
-            match.length = search_text.length();
-            
-            // Calculate line and column
-            size_t line = 0;
-            size_t line_start = 0;
-            for (size_t i = 0; i < pos; ++i) {
-                if (document_text[i] == '\n') {
-                    line++;
-                    line_start = i + 1;
-                }
-            }
-            match.line = line;
-            match.column = pos - line_start;
-            
-            return true;
-        }
+    return find_next_in(StringSource{document_text}, search_text, case_sensitive_, regex.get(), start_pos, match);
+}
+
+bool FindDialog::find_next(const PieceTable& document, const std::string& search_text, size_t start_pos,
+                           SearchMatch& match) {
+    std::shared_ptr<const RegexEngine> regex;
+    if (search_text.empty() || (use_regex_ && !(regex = compile_regex(search_text)))) {
+        return false;
     }
-    
-    return false;
+    return find_next_in(PieceSource{document}, search_text, case_sensitive_, regex.get(), start_pos, match);
 }
 
 bool FindDialog::find_previous(const std::string& document_text,
                                const std::string& search_text,
                                size_t start_pos,
                                SearchMatch& match) {
-    if (search_text.empty() || start_pos == 0) {
+    std::shared_ptr<const RegexEngine> regex;
+    if (search_text.empty() || start_pos == 0 || (use_regex_ && !(regex = compile_regex(search_text)))) {
         return false;
     }
-    
-    // Search backward from start_pos
-    for (size_t pos = start_pos - 1; pos < document_text.length(); --pos) {
-        if (matches_at_position(document_text, pos, search_text)) {
-            match.position = pos;
-            match.length = search_text.length();
-            
-            // Calculate line and column
-            size_t line = 0;
-            size_t line_start = 0;
-            for (size_t i = 0; i < pos; ++i) {
-                if (document_text[i] == '\n') {
-                    line++;
-                    line_start = i + 1;
-                }
-            }
-            match.line = line;
-            match.column = pos - line_start;
-            
-            return true;
-        }
-        
-        if (pos == 0) break;  // Prevent underflow
+    return find_previous_in(StringSource{document_text}, search_text, case_sensitive_, regex.get(), start_pos,
+                            kBackwardWindow, match);
+}
+
+bool FindDialog::find_previous(const PieceTable& document, const std::string& search_text, size_t start_pos,
+                               SearchMatch& match) {
+    std::shared_ptr<const RegexEngine> regex;
+    if (search_text.empty() || start_pos == 0 || (use_regex_ && !(regex = compile_regex(search_text)))) {
+        return false;
     }
-    
-    return false;
+    return find_previous_in(PieceSource{document}, search_text, case_sensitive_, regex.get(), start_pos,
+                            kBackwardWindow, match);
 }
 
 bool FindDialog::replace_current(std::string& document_text,
@@ -135,30 +475,89 @@ bool FindDialog::replace_current(std::string& document_text,
     if (match.position + match.length > document_text.length()) {
         return false;
     }
-    
-    document_text.replace(match.position, match.length, replace_text);
+
+    // A regex match is re-run in place to recover its groups
+    std::string replacement = replace_text;
+    RegexEngine::Match hit;
+    if (use_regex_ && last_regex_ && last_regex_->search(document_text, match.position, hit) &&
+        hit.position == match.position && hit.length == match.length) {
+        replacement = RegexEngine::expand(replace_text, hit, document_text);
+    }
+    document_text.replace(match.position, match.length, replacement);
     return true;
 }
 
 int FindDialog::replace_all(std::string& document_text,
                             const std::string& search_text,
                             const std::string& replace_text) {
-    if (search_text.empty()) {
+    std::shared_ptr<const RegexEngine> regex;
+    if (search_text.empty() || (use_regex_ && !(regex = compile_regex(search_text)))) {
         return 0;
     }
-    
+
+    // One pass into a new string instead of shifting the tail per match
+    std::string result;
+    size_t copied = 0;
     int replace_count = 0;
-    size_t pos = 0;
-    
-    while (pos < document_text.length()) {
-        if (matches_at_position(document_text, pos, search_text)) {
-            document_text.replace(pos, search_text.length(), replace_text);
-            replace_count++;
-            pos += replace_text.length();
-        } else {
-            pos++;
-        }
-    }
-    
+    auto replace = [&](size_t position, size_t length, const std::string& replacement) {
+        if (replace_count == 0) result.reserve(document_text.size());
+        result.append(document_text, copied, position - copied);
+        result += replacement;
+        copied = position + length;
+        replace_count++;
+    };
+    if (regex) {
+        regex->for_each_match(document_text, 0, [&](const RegexEngine::Match& hit) {
+            if (hit.length > 0) replace(hit.position, hit.length, RegexEngine::expand(replace_text, hit, document_text));
+            return true;
+        });
+    } else {
+        scan(StringSource{document_text}, Matcher(search_text, case_sensitive_), 0, document_text.size(), false,
+             [&](const SearchMatch& match) {
+                 replace(match.position, match.length, replace_text);
+                 return true;
+             });
+    }
+    if (replace_count > 0) {
+        result.append(document_text, copied, npos);
+        document_text.swap(result);
+    }
     return replace_count;
 }
+
+std::vector<ReplaceEdit> FindDialog::plan_replace_all(const PieceTable& document, const std::string& search_text,
+                                                      const std::string& replace_text) {
+    std::vector<ReplaceEdit> edits;
+    std::shared_ptr<const RegexEngine> regex;
+    if (search_text.empty() || (use_regex_ && !(regex = compile_regex(search_text)))) {
+        return edits;
+    }
+    PieceSource source{document};
+    if (regex) {
+        // Groups lie inside the match, so only the match text is read to expand them
+        regex->for_each_match(source.views(), 0, [&](const RegexEngine::Match& hit) {
+            if (hit.length == 0) return true;
+            RegexEngine::Match local = hit;
+            local.position = 0;
+            for (size_t& offset : local.groups) {
+                if (offset != RegexEngine::npos) offset -= hit.position;
+            }
+            std::string text = document.get_text(hit.position, hit.length);
+            edits.push_back({hit.position, hit.length, RegexEngine::expand(replace_text, local, text)});
+            return true;
+        });
+    } else {
+        scan(source, Matcher(search_text, case_sensitive_), 0, source.length(), false, [&](const SearchMatch& match) {
+            edits.push_back({match.position, match.length, replace_text});
+            return true;
+        });
+    }
+    return edits;
+}
+
+void FindDialog::apply_edits(PieceTable& document, const std::vector<ReplaceEdit>& edits) {
+    for (auto it = edits.rbegin(); it != edits.rend(); ++it) {
+        if (it->length > 0) document.remove(it->position, it->length);
+        if (!it->text.empty()) document.insert(it->position, it->text);
+    }
+}
@@ -0,0 +1,148 @@
+#include "frame_stats.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace editor {
+
+namespace {
+
+const char* const kStats[] = {"p50", "p99", "max", "count"};
+
+} // namespace
+
+size_t LatencyHistogram::bucket_of(uint64_t micros) {
+    if (micros < kSubBuckets) return static_cast<size_t>(micros);
+    int msb = 63;
+    while (!(micros >> msb)) msb--;
+    int shift = msb - 5;    // Keeps the top five bits below the leading one
+    size_t bucket = (static_cast<size_t>(shift) + 1) * kSubBuckets + ((micros >> shift) & (kSubBuckets - 1));
+    return (std::min)(bucket, kBuckets - 1);
+}
+
+uint64_t LatencyHistogram::bucket_upper(size_t bucket) {
+    if (bucket < kSubBuckets) return bucket;
+    size_t shift = bucket / kSubBuckets - 1;
+    uint64_t sub = bucket % kSubBuckets;
+    return ((kSubBuckets + sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t micros) {
+    counts_[bucket_of(micros)]++;
+    count_++;
+    sum_ += micros;
+    max_ = (std::max)(max_, micros);
+}
+
+void LatencyHistogram::reset() {
+    std::fill(counts_.begin(), counts_.end(), 0);
+    count_ = max_ = sum_ = 0;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    if (count_ == 0) return 0;
+    p = (std::min)((std::max)(p, 0.0), 100.0);
+    uint64_t rank = static_cast<uint64_t>(std::ceil(p / 100.0 * count_));
+    rank = (std::max)(rank, uint64_t(1));
+    uint64_t seen = 0;
+    for (size_t bucket = 0; bucket < kBuckets; ++bucket) {
+        seen += counts_[bucket];
+        if (seen >= rank) return (std::min)(bucket_upper(bucket), max_);
+    }
+    return max_;
+}
+
+const char* FrameStats::name(Metric metric) {
+    switch (metric) {
+        case Metric::InputLatency: return "input_latency";
+        case Metric::FrameInterval: return "frame_interval";
+        case Metric::Paint: return "paint";
+        case Metric::Highlight: return "highlight";
+        case Metric::TextDraw: return "text_draw";
+        case Metric::Minimap: return "minimap";
+        case Metric::Terminal: return "terminal";
+        case Metric::Count: break;
+    }
+    return "";
+}
+
+void FrameStats::note_input(Clock::time_point when) {
+    if (input_pending_) return;     // The oldest unpresented input counts
+    input_pending_ = true;
+    oldest_input_ = when;
+}
+
+void FrameStats::frame_presented(Clock::time_point when) {
+    if (input_pending_) {
+        record(Metric::InputLatency, when - oldest_input_);
+        input_pending_ = false;
+    }
+    if (presented_ && when - last_present_ <= kIdleGap) record(Metric::FrameInterval, when - last_present_);
+    presented_ = true;
+    last_present_ = when;
+}
+
+void FrameStats::record(Metric metric, Clock::duration elapsed) {
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    histograms_[static_cast<size_t>(metric)].record(static_cast<uint64_t>((std::max)(micros, decltype(micros)(0))));
+}
+
+void FrameStats::reset() {
+    for (auto& histogram : histograms_) histogram.reset();
+    input_pending_ = false;
+    presented_ = false;
+}
+
+std::string FrameStats::summary(Metric metric) const {
+    const LatencyHistogram& h = histogram(metric);
+    char text[96];
+    std::snprintf(text, sizeof(text), "p50 %.2f  p99 %.2f  max %.2f ms", h.percentile(50) / 1000.0,
+                  h.percentile(99) / 1000.0, h.max() / 1000.0);
+    return text;
+}
+
+bool FrameStats::get_setting(const std::string& key, std::string& value) const {
+    static const std::string prefix = "perf.";
+    if (key.compare(0, prefix.size(), prefix) != 0) return false;
+    size_t dot = key.rfind('.');
+    if (dot <= prefix.size()) return false;
+    std::string metric_name = key.substr(prefix.size(), dot - prefix.size());
+    std::string stat = key.substr(dot + 1);
+    for (size_t i = 0; i < kMetrics; ++i) {
+        if (metric_name != name(static_cast<Metric>(i))) continue;
+        const LatencyHistogram& h = histograms_[i];
+        char text[32];
+        if (stat == "count") {
+            std::snprintf(text, sizeof(text), "%llu", static_cast<unsigned long long>(h.count()));
+        } else if (stat == "p50" || stat == "p99" || stat == "max") {
+            uint64_t micros = stat == "max" ? h.max() : h.percentile(stat == "p50" ? 50 : 99);
+            std::snprintf(text, sizeof(text), "%.3f", micros / 1000.0);
+        } else {
+            return false;
+        }
+        value = text;
+        return true;
+    }
+    return false;
+}
+
+std::vector<std::string> FrameStats::setting_keys() const {
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < kMetrics; ++i) {
+        for (const char* stat : kStats) {
+            keys.push_back(std::string("perf.") + name(static_cast<Metric>(i)) + "." + stat);
+        }
+    }
+    return keys;
+}
+
+Command FrameStats::reset_command() {
+    Command command;
+    command.id = "perf.resetStats";
+    command.title = "Reset Performance Statistics";
+    command.category = "Performance";
+    command.handler = [this] { reset(); };
+    return command;
+}
+
+} // namespace editor
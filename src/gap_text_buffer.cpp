@@ -0,0 +1,125 @@
+#include "gap_text_buffer.h"
+#include "text_scan.h"
+#include <algorithm>
+
+GapTextBuffer::GapTextBuffer() : lines_dirty_(true) {}
+
+GapTextBuffer::GapTextBuffer(const std::string& initial_text)
+    : buffer_((std::max)(size_t(1024), initial_text.size() * 2))
+    , lines_dirty_(true) {
+    buffer_.insert(initial_text);
+}
+
+void GapTextBuffer::apply(const Edit& edit, bool forward) {
+    if (edit.is_insert == forward) {
+        buffer_.insert(edit.position, edit.text);
+    } else {
+        buffer_.erase(edit.position, edit.text.size());
+    }
+    lines_dirty_ = true;
+}
+
+void GapTextBuffer::insert(size_t position, const std::string& text) {
+    if (text.empty() || position > get_total_length()) return;
+    Edit edit{true, position, text};
+    apply(edit, true);
+    undo_history_.push_back(std::move(edit));
+    if (undo_history_.size() > kMaxHistory) undo_history_.pop_front();
+    redo_history_.clear();
+}
+
+void GapTextBuffer::remove(size_t position, size_t length) {
+    size_t total = get_total_length();
+    if (length == 0 || position >= total) return;
+    length = (std::min)(length, total - position);
+    Edit edit{false, position, get_text(position, length)};
+    apply(edit, true);
+    undo_history_.push_back(std::move(edit));
+    if (undo_history_.size() > kMaxHistory) undo_history_.pop_front();
+    redo_history_.clear();
+}
+
+void GapTextBuffer::undo() {
+    if (undo_history_.empty()) return;
+    apply(undo_history_.back(), false);
+    redo_history_.push_back(std::move(undo_history_.back()));
+    undo_history_.pop_back();
+}
+
+void GapTextBuffer::redo() {
+    if (redo_history_.empty()) return;
+    apply(redo_history_.back(), true);
+    undo_history_.push_back(std::move(redo_history_.back()));
+    redo_history_.pop_back();
+}
+
+std::string GapTextBuffer::get_text(size_t start, size_t length) const {
+    std::string result;
+    size_t total = get_total_length();
+    if (start >= total || length == 0) return result;
+    length = (std::min)(length, total - start);
+    result.reserve(length);
+    std::string_view before = buffer_.before_gap();
+    std::string_view after = buffer_.after_gap();
+    if (start < before.size()) {
+        size_t take = (std::min)(before.size() - start, length);
+        result.append(before.data() + start, take);
+        length -= take;
+        start = before.size();
+    }
+    if (length > 0) result.append(after.data() + (start - before.size()), length);
+    return result;
+}
+
+void GapTextBuffer::ensure_lines() const {
+    if (!lines_dirty_) return;
+    std::string_view before = buffer_.before_gap();
+    std::string_view after = buffer_.after_gap();
+    std::vector<size_t> newlines;
+    TextScan::find_newlines(before.data(), before.size(), 0, newlines);
+    TextScan::find_newlines(after.data(), after.size(), before.size(), newlines);
+    line_starts_.assign(1, 0);
+    for (size_t nl : newlines) line_starts_.push_back(nl + 1);
+    lines_dirty_ = false;
+}
+
+size_t GapTextBuffer::get_line_count() const {
+    ensure_lines();
+    return line_starts_.size();
+}
+
+size_t GapTextBuffer::get_line_start(size_t line_number) const {
+    ensure_lines();
+    if (line_number >= line_starts_.size()) return get_total_length();
+    return line_starts_[line_number];
+}
+
+size_t GapTextBuffer::get_line_at(size_t position) const {
+    ensure_lines();
+    position = (std::min)(position, get_total_length());
+    auto it = std::upper_bound(line_starts_.begin(), line_starts_.end(), position);
+    return static_cast<size_t>(it - line_starts_.begin()) - 1;
+}
+
+std::string GapTextBuffer::get_line(size_t line_number) const {
+    ensure_lines();
+    if (line_number >= line_starts_.size()) return "";
+    size_t start = line_starts_[line_number];
+    bool last = line_number + 1 == line_starts_.size();
+    size_t end = last ? get_total_length() : line_starts_[line_number + 1] - 1;  // Exclude newline
+    std::string line = get_text(start, end - start);
+    if (!last && !line.empty() && line.back() == '\r') line.pop_back();
+    return line;
+}
+
+std::vector<std::string> GapTextBuffer::get_lines_range(size_t start_line, size_t count) const {
+    std::vector<std::string> lines;
+    size_t line_count = get_line_count();
+    if (count == 0 || start_line >= line_count) return lines;
+    size_t end_line = (std::min)(start_line + count, line_count);
+    lines.reserve(end_line - start_line);
+    for (size_t line = start_line; line < end_line; ++line) {
+        lines.push_back(get_line(line));
+    }
+    return lines;
+}
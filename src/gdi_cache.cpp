@@ -0,0 +1,57 @@
+#include "gdi_cache.h"
+#include "theme.h"
+
+namespace editor {
+
+GdiCache::~GdiCache() {
+    clear();
+}
+
+void GdiCache::begin_frame(const Theme& theme) {
+    if (theme.revision() != theme_revision_ || size() > kMaxObjects) {
+        clear();
+        theme_revision_ = theme.revision();
+    }
+}
+
+HBRUSH GdiCache::brush(COLORREF color) {
+    HBRUSH& brush = brushes_[color];
+    if (!brush) {
+        brush = CreateSolidBrush(color);
+        ++created_;
+    }
+    return brush;
+}
+
+HPEN GdiCache::pen(COLORREF color, int width, int style) {
+    uint64_t key = uint64_t(color) | uint64_t(uint16_t(width)) << 32 | uint64_t(uint16_t(style)) << 48;
+    HPEN& pen = pens_[key];
+    if (!pen) {
+        pen = CreatePen(style, width, color);
+        ++created_;
+    }
+    return pen;
+}
+
+HFONT GdiCache::font(int height, int weight, const wchar_t* face) {
+    std::wstring key = std::to_wstring(height) + L"/" + std::to_wstring(weight) + L"/" + face;
+    HFONT& font = fonts_[key];
+    if (!font) {
+        font = CreateFontW(height, 0, 0, 0, weight, FALSE, FALSE, FALSE,
+                           DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
+                           CLEARTYPE_QUALITY, FIXED_PITCH | FF_MODERN, face);
+        ++created_;
+    }
+    return font;
+}
+
+void GdiCache::clear() {
+    for (auto& entry : brushes_) DeleteObject(entry.second);
+    for (auto& entry : pens_) DeleteObject(entry.second);
+    for (auto& entry : fonts_) DeleteObject(entry.second);
+    brushes_.clear();
+    pens_.clear();
+    fonts_.clear();
+}
+
+} // namespace editor
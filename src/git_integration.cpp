@@ -3,10 +3,113 @@
 #include <sstream>
 #include <algorithm>
 #include <filesystem>
-#include <windows.h>
+#include <cstdlib>
+#include "platform_process.h"
+#include "trace.h"
 
 namespace fs = std::filesystem;
 
+namespace {
+
+// Runs git with args in repo_root and collects its output, stderr included
+// unless a parser needs stdout alone. Output is kept byte for byte (-z
+// output has NULs in it). The caller's thread reads until git closes its
+// end, so this only suits commands that finish.
+bool run_git(const std::string& repo_root, const std::vector<std::string>& args, std::string& output,
+             bool with_stderr = true) {
+    EDITOR_TRACE_SCOPE_DETAIL("git", "git", args.empty() ? std::string() : args[0]);
+    editor::ProcessOptions options;
+    options.working_directory = repo_root;
+    options.hide_window = true;
+    options.io.redirect_stdout = true;
+    options.io.merge_stderr_to_stdout = with_stderr;
+    
+    editor::PlatformProcess process;
+    if (!process.start("git", args, options)) {
+        return false;
+    }
+    
+    std::string chunk;
+    while (process.read_stdout(chunk, -1)) {
+        output += chunk;
+        chunk.clear();
+    }
+    process.wait(5000);
+    return true;
+}
+
+} // namespace
+
+/**
+ * CatFile - one `git cat-file --batch` style process kept running
+ *
+ * Each query is a line on its stdin; the answer is a header line,
+ * followed for --batch by the object's bytes and a newline.
+ */
+struct GitManager::CatFile {
+    std::unique_ptr<editor::PlatformProcess> process;
+    std::string buffer;
+    
+    ~CatFile() { stop(); }
+    
+    bool start(const std::string& repo_root, const std::vector<std::string>& args) {
+        editor::ProcessOptions options;
+        options.working_directory = repo_root;
+        options.hide_window = true;
+        options.io.redirect_stdin = true;
+        options.io.redirect_stdout = true;
+        process = std::make_unique<editor::PlatformProcess>();
+        if (!process->start("git", args, options)) {
+            process.reset();
+            return false;
+        }
+        return true;
+    }
+    
+    void stop() {
+        // Closing its stdin ends the batch; it exits on its own
+        if (process) {
+            process->close_stdin();
+            if (!process->wait(1000)) process->terminate(1000);
+            process.reset();
+        }
+        buffer.clear();
+    }
+    
+    bool running() const { return process != nullptr; }
+    
+    // Sends one query line and reads the header line of the answer
+    bool query(const std::string& line, std::string& header) {
+        if (!process->write_stdin(line + "\n")) {
+            return false;
+        }
+        size_t newline;
+        while ((newline = buffer.find('\n')) == std::string::npos) {
+            if (!fill()) return false;
+        }
+        header.assign(buffer, 0, newline);
+        buffer.erase(0, newline + 1);
+        return true;
+    }
+    
+    // Reads size bytes of object data and the newline after them
+    bool read(size_t size, std::string& data) {
+        while (buffer.size() < size + 1) {
+            if (!fill()) return false;
+        }
+        data.assign(buffer, 0, size);
+        buffer.erase(0, size + 1);
+        return true;
+    }
+    
+    bool fill() {
+        std::string chunk;
+        if (!process->read_stdout(chunk, -1)) return false;
+        buffer += chunk;
+        return true;
+    }
+};
+
 GitManager::GitManager() 
     : is_repo_(false)
     , current_branch_("master")
@@ -27,9 +130,29 @@ bool GitManager::detect_repository(const std::string& directory) {
         if (fs::exists(git_dir) && fs::is_directory(git_dir)) {
             repo_root_ = current.string();
             is_repo_ = true;
+            {
+                std::lock_guard<std::mutex> lock(cat_file_mutex_);
+                blob_ids_.reset();
+                blob_reader_.reset();
+            }
+            
+            // Status queries run on their own thread, against this root
+            status_worker_.reset();
+            std::string root = repo_root_;
+            status_worker_ = std::make_unique<editor::GitStatusWorker>(
+                [root](const std::vector<std::string>& pathspecs, std::string& output) {
+                    // No optional locks: a background query must not
+                    // take index.lock from under the user's own git
+                    std::vector<std::string> args = {"--no-optional-locks", "status", "--porcelain", "-z", "--"};
+                    args.insert(args.end(), pathspecs.begin(), pathspecs.end());
+                    return run_git(root, args, output, false);
+                },
+                [this] {
+                    if (status_callback_) status_callback_();
+                });
             
             // Get current branch
-            std::string branch_output = execute_git_command("git rev-parse --abbrev-ref HEAD");
+            std::string branch_output = execute_git({"rev-parse", "--abbrev-ref", "HEAD"});
             if (!branch_output.empty()) {
                 current_branch_ = branch_output;
                 // Remove trailing newline
@@ -49,116 +172,114 @@ bool GitManager::detect_repository(const std::string& directory) {
     }
     
     is_repo_ = false;
+    status_worker_.reset();
     return false;
 }
 
-std::string GitManager::execute_git_command(const std::string& command) const {
+std::string GitManager::execute_git(const std::vector<std::string>& args) const {
     if (!is_repo_) return "";
-    
-    // Create pipe for reading command output
-    HANDLE hReadPipe, hWritePipe;
-    SECURITY_ATTRIBUTES sa = { sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE };
-    
-    if (!CreatePipe(&hReadPipe, &hWritePipe, &sa, 0)) {
-        return "";
-    }
-    
-    // Set up process startup info
-    STARTUPINFOA si = {};
-    si.cb = sizeof(STARTUPINFOA);
-    si.dwFlags = STARTF_USESTDHANDLES;
-    si.hStdOutput = hWritePipe;
-    si.hStdError = hWritePipe;
-    
-    PROCESS_INFORMATION pi = {};
-    
-    // Build command with directory change
-    std::string full_command = "cmd.exe /c cd /d \"" + repo_root_ + "\" && " + command;
-    
-    // Execute command
-    if (!CreateProcessA(nullptr, const_cast<char*>(full_command.c_str()),
-                       nullptr, nullptr, TRUE, CREATE_NO_WINDOW,
-                       nullptr, nullptr, &si, &pi)) {
-        CloseHandle(hReadPipe);
-        CloseHandle(hWritePipe);
-        return "";
-    }
-    
-    CloseHandle(hWritePipe);
-    
-    // Read output
     std::string output;
-    char buffer[4096];
-    DWORD bytes_read;
-    
-    while (ReadFile(hReadPipe, buffer, sizeof(buffer) - 1, &bytes_read, nullptr) && bytes_read > 0) {
-        buffer[bytes_read] = '\0';
-        output += buffer;
-    }
-    
-    WaitForSingleObject(pi.hProcess, 5000); // 5 second timeout
-    
-    CloseHandle(pi.hProcess);
-    CloseHandle(pi.hThread);
-    CloseHandle(hReadPipe);
-    
+    run_git(repo_root_, args, output);
     return output;
 }
 
 void GitManager::refresh_status() {
     if (!is_repo_) return;
-    
-    // Clear caches
-    file_status_.clear();
-    staged_files_.clear();
-    modified_files_.clear();
-    untracked_files_.clear();
-    
-    // Get git status
-    std::string status_output = execute_git_command("git status --porcelain");
-    parse_status_output(status_output);
+    status_worker_->request_full();
 }
 
-void GitManager::parse_status_output(const std::string& output) {
-    std::istringstream stream(output);
-    std::string line;
+bool GitManager::apply_file_changes(const std::vector<editor::FileChange>& changes) {
+    if (!is_repo_) return false;
     
-    while (std::getline(stream, line)) {
-        if (line.length() < 4) continue;
-        
-        char index_status = line[0];
-        char worktree_status = line[1];
-        std::string file_path = line.substr(3);
-        
-        // Remove quotes if present
-        if (!file_path.empty() && file_path[0] == '"') {
-            file_path = file_path.substr(1, file_path.length() - 2);
+    std::vector<std::string> paths;
+    for (const auto& change : changes) {
+        std::string path = make_relative_path(change.path);
+        if (path == ".git" || path.compare(0, 5, ".git/") == 0) {
+            refresh_status();
+            return true;
         }
-        
-        GitFileStatus status = GitFileStatus::Unmodified;
-        
-        // Parse status codes
-        if (index_status == '?' && worktree_status == '?') {
-            status = GitFileStatus::Untracked;
-            untracked_files_.push_back(file_path);
-        } else if (index_status == 'A' || worktree_status == 'A') {
-            status = GitFileStatus::Added;
-            if (index_status == 'A') staged_files_.push_back(file_path);
-        } else if (index_status == 'M' || worktree_status == 'M') {
-            status = GitFileStatus::Modified;
-            modified_files_.push_back(file_path);
-            if (index_status == 'M') staged_files_.push_back(file_path);
-        } else if (index_status == 'D' || worktree_status == 'D') {
-            status = GitFileStatus::Deleted;
-            if (index_status == 'D') staged_files_.push_back(file_path);
-        } else if (index_status == 'R' || worktree_status == 'R') {
-            status = GitFileStatus::Renamed;
+        paths.push_back(path);
+    }
+    status_worker_->request_paths(paths);
+    return false;
+}
+
+bool GitManager::take_status_results() {
+    if (!status_worker_) return false;
+    bool any = false;
+    editor::GitStatusWorker::Result result;
+    while (status_worker_->take(result)) {
+        apply_status_result(result);
+        any = true;
+    }
+    return any;
+}
+
+void GitManager::wait_for_status() {
+    if (!status_worker_) return;
+    status_worker_->wait_idle();
+    take_status_results();
+}
+
+void GitManager::apply_status_result(const editor::GitStatusWorker::Result& result) {
+    if (result.full) {
+        file_status_.clear();
+        staged_files_.clear();
+        modified_files_.clear();
+        untracked_files_.clear();
+    } else {
+        // Forget what was cached for these paths (and below them, for
+        // directories); git reported on all of them
+        const auto& paths = result.paths;
+        auto covered = [&paths](const std::string& file_path) {
+            for (const std::string& path : paths) {
+                if (file_path.compare(0, path.size(), path) == 0 &&
+                    (file_path.size() == path.size() || file_path[path.size()] == '/')) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        for (auto it = file_status_.begin(); it != file_status_.end();) {
+            it = covered(it->first) ? file_status_.erase(it) : std::next(it);
         }
-        
-        file_status_[file_path] = status;
+        for (auto* list : {&staged_files_, &modified_files_, &untracked_files_}) {
+            list->erase(std::remove_if(list->begin(), list->end(), covered), list->end());
+        }
+    }
+    for (const auto& entry : result.entries) {
+        record_status(entry);
     }
 }
 
+void GitManager::record_status(const editor::GitStatusEntry& entry) {
+    char index_status = entry.index;
+    char worktree_status = entry.worktree;
+    const std::string& file_path = entry.path;
+    
+    GitFileStatus status = GitFileStatus::Unmodified;
+    
+    // Parse status codes
+    if (index_status == '?' && worktree_status == '?') {
+        status = GitFileStatus::Untracked;
+        untracked_files_.push_back(file_path);
+    } else if (index_status == 'A' || worktree_status == 'A') {
+        status = GitFileStatus::Added;
+        if (index_status == 'A') staged_files_.push_back(file_path);
+    } else if (index_status == 'M' || worktree_status == 'M') {
+        status = GitFileStatus::Modified;
+        modified_files_.push_back(file_path);
+        if (index_status == 'M') staged_files_.push_back(file_path);
+    } else if (index_status == 'D' || worktree_status == 'D') {
+        status = GitFileStatus::Deleted;
+        if (index_status == 'D') staged_files_.push_back(file_path);
+    } else if (index_status == 'R' || worktree_status == 'R') {
+        status = GitFileStatus::Renamed;
+    }
+    
+    file_status_[file_path] = status;
+}
+
 GitFileStatus GitManager::get_file_status(const std::string& file_path) const {
     std::string rel_path = make_relative_path(file_path);
     auto it = file_status_.find(rel_path);
@@ -199,7 +320,7 @@ std::vector<GitDiffHunk> GitManager::get_file_diff(const std::string& file_path)
     if (!is_repo_) return hunks;
     
     std::string rel_path = make_relative_path(file_path);
-    std::string diff_output = execute_git_command("git diff --unified=0 \"" + rel_path + "\"");
+    std::string diff_output = execute_git({"diff", "--unified=0", "--", rel_path});
     
     parse_diff_output(diff_output, hunks);
     return hunks;
@@ -236,16 +357,68 @@ void GitManager::parse_diff_output(const std::string& output, std::vector<GitDif
     }
 }
 
+bool GitManager::get_head_blob_id(const std::string& file_path, std::string& blob_id) {
+    if (!is_repo_) return false;
+    std::lock_guard<std::mutex> lock(cat_file_mutex_);
+    if (!blob_ids_) {
+        blob_ids_ = std::make_unique<CatFile>();
+        if (!blob_ids_->start(repo_root_, {"cat-file", "--batch-check"})) return false;
+    }
+    if (!blob_ids_->running()) return false;
+    
+    // "<id> blob <size>", or "HEAD:<path> missing" when HEAD lacks it
+    std::string header;
+    if (!blob_ids_->query("HEAD:" + make_relative_path(file_path), header)) {
+        blob_ids_.reset();                      // Try a fresh process next time
+        return false;
+    }
+    size_t space = header.find(' ');
+    if (space == std::string::npos || header.compare(space, 6, " blob ") != 0) return false;
+    blob_id = header.substr(0, space);
+    return true;
+}
+
+bool GitManager::get_blob_text(const std::string& blob_id, std::string& text) {
+    if (!is_repo_) return false;
+    std::lock_guard<std::mutex> lock(cat_file_mutex_);
+    if (!blob_reader_) {
+        blob_reader_ = std::make_unique<CatFile>();
+        if (!blob_reader_->start(repo_root_, {"cat-file", "--batch"})) return false;
+    }
+    if (!blob_reader_->running()) return false;
+    
+    std::string header;
+    if (!blob_reader_->query(blob_id, header)) {
+        blob_reader_.reset();
+        return false;
+    }
+    size_t space = header.rfind(' ');
+    if (header.find(" missing") != std::string::npos || space == std::string::npos) return false;
+    size_t size = std::strtoull(header.c_str() + space + 1, nullptr, 10);
+    if (!blob_reader_->read(size, text)) {
+        blob_reader_.reset();
+        return false;
+    }
+    return true;
+}
+
+bool GitManager::get_blame(const std::string& file_path, std::string& output) const {
+    if (!is_repo_) return false;
+    output.clear();
+    return run_git(repo_root_, {"blame", "--incremental", "HEAD", "--", make_relative_path(file_path)}, output, false) &&
+           !output.empty();
+}
+
 std::string GitManager::get_file_diff_text(const std::string& file_path) const {
     if (!is_repo_) return "";
     std::string rel_path = make_relative_path(file_path);
-    return execute_git_command("git diff \"" + rel_path + "\"");
+    return execute_git({"diff", "--", rel_path});
 }
 
 bool GitManager::stage_file(const std::string& file_path) {
     if (!is_repo_) return false;
     std::string rel_path = make_relative_path(file_path);
-    std::string output = execute_git_command("git add \"" + rel_path + "\"");
+    std::string output = execute_git({"add", "--", rel_path});
     refresh_status();
     return true;
 }
@@ -253,14 +426,14 @@ bool GitManager::stage_file(const std::string& file_path) {
 bool GitManager::unstage_file(const std::string& file_path) {
     if (!is_repo_) return false;
     std::string rel_path = make_relative_path(file_path);
-    std::string output = execute_git_command("git reset HEAD \"" + rel_path + "\"");
+    std::string output = execute_git({"reset", "HEAD", "--", rel_path});
     refresh_status();
     return true;
 }
 
 bool GitManager::stage_all() {
     if (!is_repo_) return false;
-    execute_git_command("git add -A");
+    execute_git({"add", "-A"});
     refresh_status();
     return true;
 }
@@ -268,15 +441,8 @@ bool GitManager::stage_all() {
 bool GitManager::commit(const std::string& message) {
     if (!is_repo_ || message.empty()) return false;
     
-    // Escape quotes in message
-    std::string escaped_msg = message;
-    size_t pos = 0;
-    while ((pos = escaped_msg.find('"', pos)) != std::string::npos) {
-        escaped_msg.insert(pos, "\\");
-        pos += 2;
-    }
-    
-    std::string output = execute_git_command("git commit -m \"" + escaped_msg + "\"");
+    // The message goes to git as one argument, so it needs no escaping
+    std::string output = execute_git({"commit", "-m", message});
     refresh_status();
     return output.find("nothing to commit") == std::string::npos;
 }
@@ -284,18 +450,11 @@ bool GitManager::commit(const std::string& message) {
 bool GitManager::amend_commit(const std::string& message) {
     if (!is_repo_) return false;
     
-    std::string escaped_msg = message;
-    size_t pos = 0;
-    while ((pos = escaped_msg.find('"', pos)) != std::string::npos) {
-        escaped_msg.insert(pos, "\\");
-        pos += 2;
+    if (message.empty()) {
+        execute_git({"commit", "--amend", "--no-edit"});
+    } else {
+        execute_git({"commit", "--amend", "-m", message});
     }
-    
-    std::string cmd = message.empty() ? 
-        "git commit --amend --no-edit" : 
-        "git commit --amend -m \"" + escaped_msg + "\"";
-    
-    execute_git_command(cmd);
     refresh_status();
     return true;
 }
@@ -304,7 +463,7 @@ std::vector<std::string> GitManager::get_commit_history(int count) {
     std::vector<std::string> history;
     if (!is_repo_) return history;
     
-    std::string output = execute_git_command("git log -" + std::to_string(count) + " --oneline");
+    std::string output = execute_git({"log", "-" + std::to_string(count), "--oneline"});
     std::istringstream stream(output);
     std::string line;
     
@@ -321,7 +480,7 @@ std::vector<GitBranch> GitManager::get_branches() {
     std::vector<GitBranch> branches;
     if (!is_repo_) return branches;
     
-    std::string output = execute_git_command("git branch -v");
+    std::string output = execute_git({"branch", "-v"});
     std::istringstream stream(output);
     std::string line;
     
@@ -351,13 +510,13 @@ std::vector<GitBranch> GitManager::get_branches() {
 
 bool GitManager::create_branch(const std::string& branch_name) {
     if (!is_repo_ || branch_name.empty()) return false;
-    std::string output = execute_git_command("git branch \"" + branch_name + "\"");
+    std::string output = execute_git({"branch", branch_name});
     return output.find("fatal") == std::string::npos;
 }
 
 bool GitManager::switch_branch(const std::string& branch_name) {
     if (!is_repo_ || branch_name.empty()) return false;
-    std::string output = execute_git_command("git checkout \"" + branch_name + "\"");
+    std::string output = execute_git({"checkout", branch_name});
     
     if (output.find("fatal") == std::string::npos) {
         current_branch_ = branch_name;
@@ -369,6 +528,6 @@ bool GitManager::switch_branch(const std::string& branch_name) {
 
 bool GitManager::delete_branch(const std::string& branch_name) {
     if (!is_repo_ || branch_name.empty() || branch_name == current_branch_) return false;
-    std::string output = execute_git_command("git branch -d \"" + branch_name + "\"");
+    std::string output = execute_git({"branch", "-d", branch_name});
     return output.find("fatal") == std::string::npos;
 }
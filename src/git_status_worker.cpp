@@ -0,0 +1,112 @@
+#include "git_status_worker.h"
+
+namespace editor {
+
+GitStatusWorker::GitStatusWorker(RunFn run, ReadyFn ready)
+    : run_(std::move(run)), ready_(std::move(ready)), thread_([this] { worker_loop(); }) {}
+
+GitStatusWorker::~GitStatusWorker() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+}
+
+void GitStatusWorker::request_full() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_full_ = true;
+        pending_paths_.clear();
+        pending_set_.clear();
+    }
+    wake_.notify_one();
+}
+
+void GitStatusWorker::request_paths(const std::vector<std::string>& paths) {
+    if (paths.empty()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_full_) return;
+        for (const std::string& path : paths) {
+            if (pending_set_.insert(path).second) pending_paths_.push_back(path);
+        }
+        if (pending_paths_.size() > kMaxPaths) {
+            pending_full_ = true;
+            pending_paths_.clear();
+            pending_set_.clear();
+        }
+    }
+    wake_.notify_one();
+}
+
+bool GitStatusWorker::take(Result& result) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (results_.empty()) return false;
+    result = std::move(results_.front());
+    results_.pop_front();
+    return true;
+}
+
+bool GitStatusWorker::busy() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return running_ || pending_full_ || !pending_paths_.empty();
+}
+
+void GitStatusWorker::wait_idle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return !running_ && !pending_full_ && pending_paths_.empty(); });
+}
+
+void GitStatusWorker::worker_loop() {
+    for (;;) {
+        Result result;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            running_ = false;
+            idle_.notify_all();
+            wake_.wait(lock, [this] { return stopping_ || pending_full_ || !pending_paths_.empty(); });
+            if (stopping_) return;
+            result.full = pending_full_;
+            result.paths.swap(pending_paths_);
+            pending_full_ = false;
+            pending_set_.clear();
+            running_ = true;
+        }
+
+        std::string output;
+        // Could not run git: leave what is known as it is
+        if (!run_(result.paths, output)) continue;
+        parse_porcelain(output, result.entries);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            results_.push_back(std::move(result));
+        }
+        if (ready_) ready_();
+    }
+}
+
+void GitStatusWorker::parse_porcelain(const std::string& output, std::vector<GitStatusEntry>& entries) {
+    size_t pos = 0;
+    while (pos < output.size()) {
+        size_t end = output.find('\0', pos);
+        if (end == std::string::npos) end = output.size();
+        // "XY path"; a rename or copy is followed by its old path
+        if (end - pos >= 4 && output[pos + 2] == ' ') {
+            GitStatusEntry entry;
+            entry.index = output[pos];
+            entry.worktree = output[pos + 1];
+            entry.path.assign(output, pos + 3, end - pos - 3);
+            bool moved = entry.index == 'R' || entry.index == 'C';
+            entries.push_back(std::move(entry));
+            if (moved) {
+                end = output.find('\0', end + 1);
+                if (end == std::string::npos) end = output.size();
+            }
+        }
+        pos = end + 1;
+    }
+}
+
+} // namespace editor
@@ -0,0 +1,127 @@
+#include "gitignore.h"
+#include "platform_file.h"
+#include <fstream>
+#include <sstream>
+
+void GitIgnore::add_patterns(const std::string& text, const std::string& base) {
+    std::istringstream stream(text);
+    std::string line;
+    while (std::getline(stream, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        // Trailing spaces are dropped unless escaped
+        while (!line.empty() && line.back() == ' ' && (line.size() < 2 || line[line.size() - 2] != '\\')) {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') continue;
+
+        Pattern pattern;
+        pattern.base = base;
+        if (line[0] == '!') {
+            pattern.negated = true;
+            line.erase(0, 1);
+        }
+        if (!line.empty() && line.back() == '/') {
+            pattern.directory_only = true;
+            line.pop_back();
+        }
+        if (line.empty()) continue;
+
+        // A slash anywhere but the end anchors the pattern to base
+        if (line.find('/') == std::string::npos) {
+            pattern.glob = "**/" + line;
+        } else {
+            pattern.glob = line[0] == '/' ? line.substr(1) : line;
+        }
+        patterns_.push_back(std::move(pattern));
+    }
+}
+
+bool GitIgnore::load_file(const std::string& directory, const std::string& base) {
+    std::ifstream file(editor::PlatformFile::join_path(directory, ".gitignore"), std::ios::binary);
+    if (!file) return false;
+    std::ostringstream text;
+    text << file.rdbuf();
+    add_patterns(text.str(), base);
+    return true;
+}
+
+bool GitIgnore::is_ignored(const std::string& relative_path, bool is_directory) const {
+    for (auto it = patterns_.rbegin(); it != patterns_.rend(); ++it) {
+        const Pattern& pattern = *it;
+        if (pattern.directory_only && !is_directory) continue;
+
+        const char* path = relative_path.c_str();
+        if (!pattern.base.empty()) {
+            if (relative_path.compare(0, pattern.base.size(), pattern.base) != 0 ||
+                relative_path.size() <= pattern.base.size() || relative_path[pattern.base.size()] != '/') {
+                continue;
+            }
+            path += pattern.base.size() + 1;
+        }
+        if (match(pattern.glob.c_str(), path)) return !pattern.negated;
+    }
+    return false;
+}
+
+bool GitIgnore::match(const char* pattern, const char* path) {
+    while (*pattern) {
+        switch (*pattern) {
+            case '*': {
+                if (pattern[1] == '*') {
+                    while (*pattern == '*') ++pattern;
+                    if (*pattern == '\0') return true;         // "dir/**": everything inside
+                    if (*pattern == '/') {
+                        // "**/": zero or more whole directories
+                        ++pattern;
+                        for (const char* p = path; ; ++p) {
+                            if ((p == path || p[-1] == '/') && match(pattern, p)) return true;
+                            if (*p == '\0') return false;
+                        }
+                    }
+                }
+                while (*pattern == '*') ++pattern;
+                // A single star stays within one path component
+                for (const char* p = path; ; ++p) {
+                    if (match(pattern, p)) return true;
+                    if (*p == '\0' || *p == '/') return false;
+                }
+            }
+            case '?':
+                if (*path == '\0' || *path == '/') return false;
+                ++pattern;
+                ++path;
+                break;
+            case '[': {
+                if (*path == '\0' || *path == '/') return false;
+                const char* p = pattern + 1;
+                bool negate = *p == '!' || *p == '^';
+                if (negate) ++p;
+                bool matched = false;
+                // A ']' first is literal
+                for (bool first = true; *p && (first || *p != ']'); first = false) {
+                    char low = *p++;
+                    char high = low;
+                    if (*p == '-' && p[1] && p[1] != ']') {
+                        high = p[1];
+                        p += 2;
+                    }
+                    if (*path >= low && *path <= high) matched = true;
+                }
+                if (*p != ']') return false;    // Unterminated class matches nothing
+                if (matched == negate) return false;
+                pattern = p + 1;
+                ++path;
+                break;
+            }
+            case '\\':
+                if (pattern[1]) ++pattern;
+                [[fallthrough]];    // To the escaped literal
+            default:
+                if (*pattern != *path) return false;
+                ++pattern;
+                ++path;
+                break;
+        }
+    }
+    return *path == '\0';
+}
@@ -0,0 +1,125 @@
+#include "glyph_atlas.h"
+#include <algorithm>
+#include <cstring>
+
+namespace editor {
+
+GlyphAtlas::GlyphAtlas(GlyphRasterizer rasterizer, int size)
+    : rasterizer_(std::move(rasterizer))
+    , size_(size)
+{
+    reset();
+}
+
+void GlyphAtlas::reset() {
+    pixels_.assign(static_cast<size_t>(size_) * size_, 0);
+    shelves_.clear();
+    glyphs_.clear();
+    missing_.clear();
+    // The white texel rectangles and lines sample; its shelf is padded like any other
+    pixels_[0] = 255;
+    shelves_.push_back({0, 1 + kPadding, 1 + kPadding});
+    resized_ = true;
+    mark_dirty(0, 0, size_, size_);
+    ++generation_;
+}
+
+const AtlasGlyph* GlyphAtlas::glyph(uint32_t codepoint) {
+    auto it = glyphs_.find(codepoint);
+    if (it != glyphs_.end()) return &it->second;
+    if (missing_.count(codepoint) || !rasterizer_) return nullptr;
+
+    GlyphBitmap bitmap;
+    if (!rasterizer_(codepoint, bitmap) || bitmap.width > size_ || bitmap.height > size_ ||
+        bitmap.coverage.size() < static_cast<size_t>(bitmap.width) * bitmap.height) {
+        missing_[codepoint] = true;
+        return nullptr;
+    }
+    int x = 0;
+    int y = 0;
+    if (!place(bitmap.width, bitmap.height, x, y)) {
+        if (size_ < kMaxSize) {
+            grow();
+        } else {
+            reset();
+        }
+        if (!place(bitmap.width, bitmap.height, x, y)) {
+            missing_[codepoint] = true;
+            return nullptr;
+        }
+    }
+    for (int row = 0; row < bitmap.height; ++row) {
+        std::memcpy(&pixels_[static_cast<size_t>(y + row) * size_ + x],
+                    &bitmap.coverage[static_cast<size_t>(row) * bitmap.width], bitmap.width);
+    }
+    mark_dirty(x, y, bitmap.width, bitmap.height);
+
+    AtlasGlyph& glyph = glyphs_[codepoint];
+    glyph.x = static_cast<uint16_t>(x);
+    glyph.y = static_cast<uint16_t>(y);
+    glyph.width = static_cast<uint16_t>(bitmap.width);
+    glyph.height = static_cast<uint16_t>(bitmap.height);
+    glyph.offset_x = static_cast<int16_t>(bitmap.offset_x);
+    glyph.offset_y = static_cast<int16_t>(bitmap.offset_y);
+    glyph.advance = static_cast<int16_t>(bitmap.advance);
+    return &glyph;
+}
+
+bool GlyphAtlas::place(int width, int height, int& x, int& y) {
+    if (width == 0 || height == 0) {
+        // Spaces and the like take no texels
+        x = y = 0;
+        return true;
+    }
+    int padded_width = width + kPadding;
+    int padded_height = height + kPadding;
+    // Best fit: the lowest shelf tall enough with room left
+    Shelf* best = nullptr;
+    for (Shelf& shelf : shelves_) {
+        if (shelf.height >= padded_height && size_ - shelf.used >= padded_width &&
+            (!best || shelf.height < best->height)) {
+            best = &shelf;
+        }
+    }
+    // Only open a new shelf when the glyph would waste most of the best one
+    if (!best || best->height > padded_height * 2) {
+        int top = shelves_.empty() ? 0 : shelves_.back().y + shelves_.back().height;
+        if (size_ - top >= padded_height) {
+            shelves_.push_back({top, padded_height, 0});
+            best = &shelves_.back();
+        }
+    }
+    if (!best) return false;
+    x = best->used;
+    y = best->y;
+    best->used += padded_width;
+    return true;
+}
+
+void GlyphAtlas::grow() {
+    int old_size = size_;
+    std::vector<uint8_t> old = std::move(pixels_);
+    size_ *= 2;
+    pixels_.assign(static_cast<size_t>(size_) * size_, 0);
+    for (int row = 0; row < old_size; ++row) {
+        std::memcpy(&pixels_[static_cast<size_t>(row) * size_], &old[static_cast<size_t>(row) * old_size], old_size);
+    }
+    resized_ = true;
+    mark_dirty(0, 0, size_, size_);
+}
+
+void GlyphAtlas::mark_dirty(int x, int y, int width, int height) {
+    if (width <= 0 || height <= 0) return;
+    if (dirty_.width == 0) {
+        dirty_ = Rect{x, y, width, height};
+        return;
+    }
+    int right = std::max(dirty_.x + dirty_.width, x + width);
+    int bottom = std::max(dirty_.y + dirty_.height, y + height);
+    dirty_.x = std::min(dirty_.x, x);
+    dirty_.y = std::min(dirty_.y, y);
+    dirty_.width = right - dirty_.x;
+    dirty_.height = bottom - dirty_.y;
+}
+
+} // namespace editor
@@ -1,42 +1,723 @@
 #include "gpu_renderer.h"
-#include <iostream>
+#include "column_layout.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+
+#ifdef _WIN32
+#include <windows.h>
+#define VELOCITY_GLAPI __stdcall
+#else
+#define VELOCITY_GLAPI
+#endif
 
 namespace editor {
 
-class StubGpuRenderer : public GpuRenderer {
+namespace {
+
+// One quad per glyph, rectangle or line run; the whole frame is one instanced draw
+struct QuadInstance {
+    float x, y, width, height;          // Pixels, origin top-left
+    uint16_t u, v, texels_w, texels_h;  // Atlas texels sampled
+    uint32_t color;                     // 0xAARRGGBB
+};
+
+// Next codepoint of UTF-8 text; malformed bytes come out as U+FFFD
+uint32_t next_codepoint(std::string_view text, size_t& i) {
+    unsigned char c = static_cast<unsigned char>(text[i++]);
+    if (c < 0x80) return c;
+    int extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : -1;
+    if (extra < 0 || i + extra > text.size()) return 0xFFFD;
+    uint32_t codepoint = c & (0x3F >> extra);
+    for (int k = 0; k < extra; ++k) {
+        unsigned char next = static_cast<unsigned char>(text[i]);
+        if ((next & 0xC0) != 0x80) return 0xFFFD;
+        codepoint = (codepoint << 6) | (next & 0x3F);
+        ++i;
+    }
+    return codepoint;
+}
+
+#ifdef _WIN32
+// Glyphs from a GDI font via GetGlyphOutline (8-bit gray, 65 levels)
+GlyphRasterizer gdi_rasterizer(const std::string& family, int size) {
+    struct GdiFont {
+        HDC dc = nullptr;
+        HFONT font = nullptr;
+        HGDIOBJ previous = nullptr;
+        int ascent = 0;
+        ~GdiFont() {
+            if (dc) {
+                SelectObject(dc, previous);
+                DeleteDC(dc);
+            }
+            if (font) DeleteObject(font);
+        }
+    };
+    auto gdi = std::make_shared<GdiFont>();
+    std::wstring face(family.begin(), family.end());
+    gdi->dc = CreateCompatibleDC(nullptr);
+    gdi->font = CreateFontW(-size, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET, OUT_DEFAULT_PRECIS,
+                            CLIP_DEFAULT_PRECIS, ANTIALIASED_QUALITY, FIXED_PITCH | FF_MODERN, face.c_str());
+    if (!gdi->dc || !gdi->font) return nullptr;
+    gdi->previous = SelectObject(gdi->dc, gdi->font);
+    TEXTMETRICW metrics{};
+    GetTextMetricsW(gdi->dc, &metrics);
+    gdi->ascent = metrics.tmAscent;
+
+    return [gdi](uint32_t codepoint, GlyphBitmap& glyph) {
+        if (codepoint > 0xFFFF) return false;
+        const MAT2 identity = {{0, 1}, {0, 0}, {0, 0}, {0, 1}};
+        GLYPHMETRICS gm{};
+        UINT ch = static_cast<UINT>(codepoint);
+        DWORD bytes = GetGlyphOutlineW(gdi->dc, ch, GGO_GRAY8_BITMAP, &gm, 0, nullptr, &identity);
+        if (bytes == GDI_ERROR) return false;
+        glyph.advance = gm.gmCellIncX;
+        if (bytes == 0) return true;    // Blank glyph (space)
+        std::vector<uint8_t> raw(bytes);
+        if (GetGlyphOutlineW(gdi->dc, ch, GGO_GRAY8_BITMAP, &gm, bytes, raw.data(), &identity) == GDI_ERROR) {
+            return false;
+        }
+        size_t pitch = (gm.gmBlackBoxX + 3) & ~3u;     // Rows are DWORD aligned
+        glyph.width = static_cast<int>(gm.gmBlackBoxX);
+        glyph.height = static_cast<int>(gm.gmBlackBoxY);
+        glyph.offset_x = gm.gmptGlyphOrigin.x;
+        glyph.offset_y = gdi->ascent - gm.gmptGlyphOrigin.y;
+        glyph.coverage.resize(static_cast<size_t>(glyph.width) * glyph.height);
+        for (int row = 0; row < glyph.height; ++row) {
+            for (int col = 0; col < glyph.width; ++col) {
+                unsigned level = raw[row * pitch + col];
+                glyph.coverage[static_cast<size_t>(row) * glyph.width + col] =
+                    static_cast<uint8_t>(std::min(255u, level * 255 / 64));
+            }
+        }
+        return true;
+    };
+}
+#endif
+
+/**
+ * QuadRenderer - batching shared by the backends
+ *
+ * draw_* calls and submitted DrawLists only append quads to the frame's
+ * instance array; glyphs are resolved through the atlas as they are
+ * appended. end_frame uploads whatever the atlas gained and hands the
+ * backend the whole array for one draw.
+ */
+class QuadRenderer : public GpuRenderer {
 public:
     bool initialize(const GpuRendererConfig& config) override {
-        std::cout << "StubGpuRenderer initialized with backend: " << (int)config.backend << std::endl;
-        return true;
+        config_ = config;
+        width_ = std::max(1, config.width);
+        height_ = std::max(1, config.height);
+        cell_advance_ = std::max(1, config.font_size * 3 / 5);
+        GlyphRasterizer rasterizer = config.rasterizer;
+#ifdef _WIN32
+        if (!rasterizer) rasterizer = gdi_rasterizer(config.font_family, config.font_size);
+#endif
+        atlas_ = std::make_unique<GlyphAtlas>(std::move(rasterizer));
+        return initialize_backend();
     }
+
     void resize(int width, int height) override {
-        std::cout << "StubGpuRenderer resize: " << width << "x" << height << std::endl;
+        width_ = std::max(1, width);
+        height_ = std::max(1, height);
+        resize_backend();
     }
+
     void begin_frame() override {
-        std::cout << "StubGpuRenderer begin_frame" << std::endl;
+        quads_.clear();
     }
+
     void end_frame() override {
-        std::cout << "StubGpuRenderer end_frame" << std::endl;
+        stats_ = GpuFrameStats{};
+        if (!atlas_) return;
+        // A reset mid-frame moved glyphs under quads already queued; they
+        // are right again from the next frame
+        const GlyphAtlas::Rect& dirty = atlas_->dirty();
+        if (dirty.width > 0) {
+            stats_.atlas_upload_bytes = static_cast<size_t>(dirty.width) * dirty.height;
+            upload_atlas(atlas_->resized(), dirty);
+            atlas_->clear_dirty();
+            atlas_->clear_resized();
+        }
+        submit();
+        stats_.quads = quads_.size();
     }
+
     void draw_text(const std::string& text, int x, int y, uint32_t color) override {
-        std::cout << "StubGpuRenderer draw_text: '" << text << "' at (" << x << "," << y << ")" << std::endl;
+        push_glyphs(text, x, y, 0, color);
     }
+
     void draw_rect(int x, int y, int w, int h, uint32_t color) override {
-        std::cout << "StubGpuRenderer draw_rect: (" << x << "," << y << "," << w << "," << h << ")" << std::endl;
+        push_rect(x, y, w, h, color);
     }
+
     void draw_line(int x1, int y1, int x2, int y2, uint32_t color) override {
-        std::cout << "StubGpuRenderer draw_line: (" << x1 << "," << y1 << ") to (" << x2 << "," << y2 << ")" << std::endl;
+        push_line(x1, y1, x2, y2, color);
+    }
+
+    void submit(const DrawList& list) override {
+        const std::vector<ColorSpan>& spans = list.spans();
+        for (const DrawCommand& command : list.commands()) {
+            switch (command.kind) {
+            case DrawKind::Rect:
+                push_rect(command.x0, command.y0, command.x1 - command.x0, command.y1 - command.y0, command.color);
+                break;
+            case DrawKind::Line:
+                push_line(command.x0, command.y0, command.x1, command.y1, command.color);
+                break;
+            case DrawKind::Run: {
+                std::string_view text = list.run_text(command);
+                int pen = command.x0;
+                size_t offset = 0;
+                for (uint32_t i = 0; i < command.span_count; ++i) {
+                    const ColorSpan& span = spans[command.span_offset + i];
+                    pen = push_glyphs(text.substr(offset, span.length), pen, command.y0, command.x1, span.color);
+                    offset += span.length;
+                }
+                break;
+            }
+            }
+        }
     }
+
+    const GpuFrameStats& frame_stats() const override { return stats_; }
+
+protected:
+    // Quads for text starting at pen; advance > 0 puts every cluster on a
+    // fixed cell grid, as many cells as ColumnLayout gives it, with its
+    // marks drawn after its base. Returns the pen after the last glyph.
+    int push_glyphs(std::string_view text, int pen, int y, int advance, uint32_t color) {
+        if (!atlas_) return pen;
+        if (advance <= 0) {
+            for (size_t i = 0; i < text.size();) {
+                const AtlasGlyph* glyph = atlas_->glyph(next_codepoint(text, i));
+                push_glyph(glyph, pen, y, color);
+                pen += glyph ? glyph->advance : cell_advance_;
+            }
+            return pen;
+        }
+        size_t cell = 0;
+        for (size_t i = 0; i < text.size();) {
+            size_t cells = 0;
+            size_t end = ColumnLayout::next_cluster(text.data(), text.size(), i, cell, ColumnLayout::kDefaultTabWidth,
+                                                    cells);
+            int glyph_pen = pen;
+            for (size_t k = i; k < end;) {
+                uint32_t codepoint = ColumnLayout::decode(text.data(), end, k);
+                push_glyph(atlas_->glyph(codepoint), glyph_pen, y, color);
+                if (glyph_pen == pen) glyph_pen += (std::max)(ColumnLayout::codepoint_width(codepoint), 1) * advance;
+            }
+            pen += static_cast<int>(cells) * advance;
+            cell += cells;
+            i = end;
+        }
+        return pen;
+    }
+
+    void push_glyph(const AtlasGlyph* glyph, int pen, int y, uint32_t color) {
+        if (!glyph || glyph->width <= 0) return;
+        quads_.push_back({static_cast<float>(pen + glyph->offset_x), static_cast<float>(y + glyph->offset_y),
+                          static_cast<float>(glyph->width), static_cast<float>(glyph->height), glyph->x,
+                          glyph->y, glyph->width, glyph->height, color});
+    }
+
+    void push_rect(int x, int y, int w, int h, uint32_t color) {
+        if (w <= 0 || h <= 0) return;
+        // Texel (0, 0) is white: the quad is a solid fill in the same draw
+        quads_.push_back({static_cast<float>(x), static_cast<float>(y), static_cast<float>(w), static_cast<float>(h),
+                          0, 0, 1, 1, color});
+    }
+
+    void push_line(int x1, int y1, int x2, int y2, uint32_t color) {
+        int dx = std::abs(x2 - x1);
+        int dy = std::abs(y2 - y1);
+        if (dx == 0 || dy == 0) {
+            push_rect(std::min(x1, x2), std::min(y1, y2), dx + 1, dy + 1, color);
+            return;
+        }
+        // Bresenham, one quad per run of pixels along the major axis
+        int sx = x1 < x2 ? 1 : -1;
+        int sy = y1 < y2 ? 1 : -1;
+        bool steep = dy > dx;
+        int major = steep ? dy : dx;
+        int minor = steep ? dx : dy;
+        int error = major / 2;
+        int run_start = 0;
+        int x = x1;
+        int y = y1;
+        for (int step = 0; step <= major; ++step) {
+            error -= minor;
+            bool last = step == major;
+            if (error < 0 || last) {
+                int length = step - run_start + 1;
+                if (steep) {
+                    push_rect(x, sy > 0 ? y - (length - 1) : y, 1, length, color);
+                } else {
+                    push_rect(sx > 0 ? x - (length - 1) : x, y, length, 1, color);
+                }
+                run_start = step + 1;
+            }
+            if (error < 0) {
+                error += major;
+                if (steep) x += sx; else y += sy;
+            }
+            if (steep) y += sy; else x += sx;
+        }
+    }
+
+    virtual bool initialize_backend() = 0;
+    virtual void resize_backend() = 0;
+    virtual void upload_atlas(bool recreate, const GlyphAtlas::Rect& dirty) = 0;
+    virtual void submit() = 0;
+
+    GpuRendererConfig config_;
+    int width_ = 1;
+    int height_ = 1;
+    int cell_advance_ = 1;      // Pen advance for codepoints without a glyph
+    std::unique_ptr<GlyphAtlas> atlas_;
+    std::vector<QuadInstance> quads_;
+    GpuFrameStats stats_;
+};
+
+/**
+ * SoftwareRenderer - the same quads blended on the CPU
+ *
+ * Fallback where no GPU context is available, and the reference the
+ * tests read back through framebuffer().
+ */
+class SoftwareRenderer : public QuadRenderer {
+public:
+    GpuBackend backend() const override { return GpuBackend::Software; }
+    const uint32_t* framebuffer() const override { return pixels_.data(); }
+    void present() override {}
+    void shutdown() override { pixels_.clear(); }
+
+protected:
+    bool initialize_backend() override {
+        resize_backend();
+        return true;
+    }
+
+    void resize_backend() override {
+        pixels_.assign(static_cast<size_t>(width_) * height_, config_.clear_color);
+    }
+
+    void upload_atlas(bool, const GlyphAtlas::Rect&) override {}   // Sampled in place
+
+    void submit() override {
+        std::fill(pixels_.begin(), pixels_.end(), config_.clear_color);
+        const uint8_t* atlas = atlas_->pixels();
+        int atlas_size = atlas_->size();
+        for (const QuadInstance& quad : quads_) {
+            int x0 = static_cast<int>(quad.x);
+            int y0 = static_cast<int>(quad.y);
+            int x1 = std::min(width_, x0 + static_cast<int>(quad.width));
+            int y1 = std::min(height_, y0 + static_cast<int>(quad.height));
+            bool solid = quad.texels_w == 1 && quad.texels_h == 1 && quad.u == 0 && quad.v == 0;
+            for (int py = std::max(0, y0); py < y1; ++py) {
+                uint32_t* row = &pixels_[static_cast<size_t>(py) * width_];
+                for (int px = std::max(0, x0); px < x1; ++px) {
+                    unsigned coverage = solid ? 255 : atlas[static_cast<size_t>(quad.v + (py - y0)) * atlas_size +
+                                                            quad.u + (px - x0)];
+                    blend(row[px], quad.color, coverage);
+                }
+            }
+        }
+        stats_.draw_calls = 1;
+    }
+
+private:
+    static void blend(uint32_t& dst, uint32_t color, unsigned coverage) {
+        unsigned alpha = ((color >> 24) * coverage + 127) / 255;
+        if (alpha == 0) return;
+        uint32_t out = 0xFF000000u;
+        for (int shift = 0; shift < 24; shift += 8) {
+            unsigned s = (color >> shift) & 0xFF;
+            unsigned d = (dst >> shift) & 0xFF;
+            out |= ((s * alpha + d * (255 - alpha) + 127) / 255) << shift;
+        }
+        dst = out;
+    }
+
+    std::vector<uint32_t> pixels_;
+};
+
+// The slice of OpenGL 3.3 core the renderer uses, loaded at run time so no
+// GL headers or import libraries beyond opengl32 are needed
+namespace gl {
+using GLenum = unsigned int;
+using GLuint = unsigned int;
+using GLint = int;
+using GLsizei = int;
+using GLboolean = unsigned char;
+using GLbitfield = unsigned int;
+using GLfloat = float;
+using GLchar = char;
+using GLsizeiptr = std::ptrdiff_t;
+using GLintptr = std::ptrdiff_t;
+
+constexpr GLenum COLOR_BUFFER_BIT = 0x4000;
+constexpr GLenum TRIANGLE_STRIP = 0x0005;
+constexpr GLenum BLEND = 0x0BE2;
+constexpr GLenum SRC_ALPHA = 0x0302;
+constexpr GLenum ONE_MINUS_SRC_ALPHA = 0x0303;
+constexpr GLenum TEXTURE_2D = 0x0DE1;
+constexpr GLenum TEXTURE0 = 0x84C0;
+constexpr GLenum R8 = 0x8229;
+constexpr GLenum RED = 0x1903;
+constexpr GLenum BGRA = 0x80E1;
+constexpr GLenum UNSIGNED_BYTE = 0x1401;
+constexpr GLenum UNSIGNED_SHORT = 0x1403;
+constexpr GLenum FLOAT = 0x1406;
+constexpr GLenum TEXTURE_MIN_FILTER = 0x2801;
+constexpr GLenum TEXTURE_MAG_FILTER = 0x2800;
+constexpr GLenum TEXTURE_WRAP_S = 0x2802;
+constexpr GLenum TEXTURE_WRAP_T = 0x2803;
+constexpr GLenum NEAREST = 0x2600;
+constexpr GLenum CLAMP_TO_EDGE = 0x812F;
+constexpr GLenum UNPACK_ALIGNMENT = 0x0CF5;
+constexpr GLenum UNPACK_ROW_LENGTH = 0x0CF2;
+constexpr GLenum UNPACK_SKIP_PIXELS = 0x0CF4;
+constexpr GLenum UNPACK_SKIP_ROWS = 0x0CF3;
+constexpr GLenum ARRAY_BUFFER = 0x8892;
+constexpr GLenum STREAM_DRAW = 0x88E0;
+constexpr GLenum VERTEX_SHADER = 0x8B31;
+constexpr GLenum FRAGMENT_SHADER = 0x8B30;
+constexpr GLenum COMPILE_STATUS = 0x8B81;
+constexpr GLenum LINK_STATUS = 0x8B82;
+
+struct Api {
+#define VELOCITY_GL_FUNCTIONS(X)                                                                             \
+    X(void, Viewport, (GLint, GLint, GLsizei, GLsizei))                                                      \
+    X(void, ClearColor, (GLfloat, GLfloat, GLfloat, GLfloat))                                                \
+    X(void, Clear, (GLbitfield))                                                                             \
+    X(void, Enable, (GLenum))                                                                                \
+    X(void, BlendFunc, (GLenum, GLenum))                                                                     \
+    X(void, GenTextures, (GLsizei, GLuint*))                                                                 \
+    X(void, DeleteTextures, (GLsizei, const GLuint*))                                                        \
+    X(void, BindTexture, (GLenum, GLuint))                                                                   \
+    X(void, ActiveTexture, (GLenum))                                                                         \
+    X(void, TexParameteri, (GLenum, GLenum, GLint))                                                          \
+    X(void, TexImage2D, (GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*))       \
+    X(void, TexSubImage2D, (GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const void*))    \
+    X(void, PixelStorei, (GLenum, GLint))                                                                    \
+    X(void, GenBuffers, (GLsizei, GLuint*))                                                                  \
+    X(void, DeleteBuffers, (GLsizei, const GLuint*))                                                         \
+    X(void, BindBuffer, (GLenum, GLuint))                                                                    \
+    X(void, BufferData, (GLenum, GLsizeiptr, const void*, GLenum))                                          \
+    X(void, BufferSubData, (GLenum, GLintptr, GLsizeiptr, const void*))                                     \
+    X(void, GenVertexArrays, (GLsizei, GLuint*))                                                             \
+    X(void, DeleteVertexArrays, (GLsizei, const GLuint*))                                                    \
+    X(void, BindVertexArray, (GLuint))                                                                       \
+    X(void, EnableVertexAttribArray, (GLuint))                                                               \
+    X(void, VertexAttribPointer, (GLuint, GLint, GLenum, GLboolean, GLsizei, const void*))                  \
+    X(void, VertexAttribDivisor, (GLuint, GLuint))                                                           \
+    X(GLuint, CreateShader, (GLenum))                                                                        \
+    X(void, ShaderSource, (GLuint, GLsizei, const GLchar* const*, const GLint*))                            \
+    X(void, CompileShader, (GLuint))                                                                         \
+    X(void, GetShaderiv, (GLuint, GLenum, GLint*))                                                           \
+    X(void, DeleteShader, (GLuint))                                                                          \
+    X(GLuint, CreateProgram, ())                                                                             \
+    X(void, AttachShader, (GLuint, GLuint))                                                                  \
+    X(void, LinkProgram, (GLuint))                                                                           \
+    X(void, GetProgramiv, (GLuint, GLenum, GLint*))                                                          \
+    X(void, UseProgram, (GLuint))                                                                            \
+    X(void, DeleteProgram, (GLuint))                                                                         \
+    X(GLint, GetUniformLocation, (GLuint, const GLchar*))                                                    \
+    X(void, Uniform1i, (GLint, GLint))                                                                       \
+    X(void, Uniform1f, (GLint, GLfloat))                                                                     \
+    X(void, Uniform2f, (GLint, GLfloat, GLfloat))                                                            \
+    X(void, DrawArraysInstanced, (GLenum, GLint, GLsizei, GLsizei))
+
+#define VELOCITY_GL_MEMBER(ret, name, args) ret(VELOCITY_GLAPI* name) args = nullptr;
+    VELOCITY_GL_FUNCTIONS(VELOCITY_GL_MEMBER)
+#undef VELOCITY_GL_MEMBER
+
+    bool load(const std::function<void*(const char*)>& get_proc) {
+        bool ok = true;
+#define VELOCITY_GL_LOAD(ret, name, args)                                                  \
+    name = reinterpret_cast<ret(VELOCITY_GLAPI*) args>(get_proc("gl" #name));              \
+    ok = ok && name != nullptr;
+        VELOCITY_GL_FUNCTIONS(VELOCITY_GL_LOAD)
+#undef VELOCITY_GL_LOAD
+        return ok;
+    }
+};
+} // namespace gl
+
+const char* kVertexShader = R"(#version 330 core
+layout(location = 0) in vec4 rect;
+layout(location = 1) in vec4 texels;
+layout(location = 2) in vec4 color;
+uniform vec2 viewport;
+uniform float atlas_size;
+out vec2 uv;
+out vec4 tint;
+void main() {
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    vec2 pixel = rect.xy + corner * rect.zw;
+    gl_Position = vec4(pixel.x / viewport.x * 2.0 - 1.0, 1.0 - pixel.y / viewport.y * 2.0, 0.0, 1.0);
+    uv = (texels.xy + corner * texels.zw) / atlas_size;
+    tint = color;
+}
+)";
+
+const char* kFragmentShader = R"(#version 330 core
+in vec2 uv;
+in vec4 tint;
+uniform sampler2D atlas;
+out vec4 frag;
+void main() {
+    frag = vec4(tint.rgb, tint.a * texture(atlas, uv).r);
+}
+)";
+
+/**
+ * OpenGLRenderer - OpenGL 3.3 core backend
+ *
+ * The atlas is an R8 texture updated with glTexSubImage2D over the dirty
+ * rectangle only. Quads are streamed into one instance buffer (orphaned
+ * each frame) and drawn with a single glDrawArraysInstanced of a
+ * four-vertex strip; the vertex shader builds corners from gl_VertexID.
+ * On Windows the renderer creates its own WGL context on native_window;
+ * elsewhere it runs on a host context through gl_get_proc_address.
+ */
+class OpenGLRenderer : public QuadRenderer {
+public:
+    ~OpenGLRenderer() override { shutdown(); }
+
+    GpuBackend backend() const override { return GpuBackend::OpenGL; }
+
     void present() override {
-        std::cout << "StubGpuRenderer present" << std::endl;
+        if (config_.gl_swap_buffers) {
+            config_.gl_swap_buffers();
+            return;
+        }
+#ifdef _WIN32
+        if (dc_) SwapBuffers(dc_);
+#endif
     }
+
     void shutdown() override {
-        std::cout << "StubGpuRenderer shutdown" << std::endl;
+        if (!ready_) return;
+        make_current();
+        if (program_) api_.DeleteProgram(program_);
+        if (texture_) api_.DeleteTextures(1, &texture_);
+        if (buffer_) api_.DeleteBuffers(1, &buffer_);
+        if (vertex_array_) api_.DeleteVertexArrays(1, &vertex_array_);
+        program_ = texture_ = buffer_ = vertex_array_ = 0;
+        ready_ = false;
+#ifdef _WIN32
+        if (context_) {
+            wglMakeCurrent(nullptr, nullptr);
+            wglDeleteContext(context_);
+            context_ = nullptr;
+        }
+        if (dc_) {
+            ReleaseDC(static_cast<HWND>(config_.native_window), dc_);
+            dc_ = nullptr;
+        }
+#endif
+    }
+
+protected:
+    bool initialize_backend() override {
+        std::function<void*(const char*)> get_proc = config_.gl_get_proc_address;
+#ifdef _WIN32
+        if (!get_proc && config_.native_window && create_context()) {
+            HMODULE opengl = GetModuleHandleW(L"opengl32.dll");
+            get_proc = [opengl](const char* name) -> void* {
+                // wglGetProcAddress only knows post-1.1 entry points (and may return 1..3 or -1)
+                PROC proc = wglGetProcAddress(name);
+                auto value = reinterpret_cast<intptr_t>(proc);
+                if (value >= -1 && value <= 3) proc = GetProcAddress(opengl, name);
+                return reinterpret_cast<void*>(proc);
+            };
+        }
+#endif
+        if (!get_proc || !api_.load(get_proc) || !create_program()) return false;
+
+        api_.GenVertexArrays(1, &vertex_array_);
+        api_.BindVertexArray(vertex_array_);
+        api_.GenBuffers(1, &buffer_);
+        api_.BindBuffer(gl::ARRAY_BUFFER, buffer_);
+        const gl::GLsizei stride = sizeof(QuadInstance);
+        api_.EnableVertexAttribArray(0);
+        api_.VertexAttribPointer(0, 4, gl::FLOAT, 0, stride, reinterpret_cast<const void*>(offsetof(QuadInstance, x)));
+        api_.EnableVertexAttribArray(1);
+        api_.VertexAttribPointer(1, 4, gl::UNSIGNED_SHORT, 0, stride,
+                                 reinterpret_cast<const void*>(offsetof(QuadInstance, u)));
+        api_.EnableVertexAttribArray(2);
+        // 0xAARRGGBB is B, G, R, A in memory: GL_BGRA swizzles it back
+        api_.VertexAttribPointer(2, static_cast<gl::GLint>(gl::BGRA), gl::UNSIGNED_BYTE, 1, stride,
+                                 reinterpret_cast<const void*>(offsetof(QuadInstance, color)));
+        for (gl::GLuint attribute = 0; attribute < 3; ++attribute) api_.VertexAttribDivisor(attribute, 1);
+
+        api_.GenTextures(1, &texture_);
+        api_.Enable(gl::BLEND);
+        api_.BlendFunc(gl::SRC_ALPHA, gl::ONE_MINUS_SRC_ALPHA);
+        ready_ = true;
+        return true;
+    }
+
+    void resize_backend() override {}   // The viewport is set per frame
+
+    void upload_atlas(bool recreate, const GlyphAtlas::Rect& dirty) override {
+        if (!ready_) return;
+        make_current();
+        api_.ActiveTexture(gl::TEXTURE0);
+        api_.BindTexture(gl::TEXTURE_2D, texture_);
+        api_.PixelStorei(gl::UNPACK_ALIGNMENT, 1);
+        if (recreate) {
+            api_.TexImage2D(gl::TEXTURE_2D, 0, static_cast<gl::GLint>(gl::R8), atlas_->size(), atlas_->size(), 0,
+                            gl::RED, gl::UNSIGNED_BYTE, atlas_->pixels());
+            api_.TexParameteri(gl::TEXTURE_2D, gl::TEXTURE_MIN_FILTER, static_cast<gl::GLint>(gl::NEAREST));
+            api_.TexParameteri(gl::TEXTURE_2D, gl::TEXTURE_MAG_FILTER, static_cast<gl::GLint>(gl::NEAREST));
+            api_.TexParameteri(gl::TEXTURE_2D, gl::TEXTURE_WRAP_S, static_cast<gl::GLint>(gl::CLAMP_TO_EDGE));
+            api_.TexParameteri(gl::TEXTURE_2D, gl::TEXTURE_WRAP_T, static_cast<gl::GLint>(gl::CLAMP_TO_EDGE));
+            return;
+        }
+        // Just the new glyphs: rows of the dirty rectangle out of the full-width CPU copy
+        api_.PixelStorei(gl::UNPACK_ROW_LENGTH, atlas_->size());
+        api_.PixelStorei(gl::UNPACK_SKIP_PIXELS, dirty.x);
+        api_.PixelStorei(gl::UNPACK_SKIP_ROWS, dirty.y);
+        api_.TexSubImage2D(gl::TEXTURE_2D, 0, dirty.x, dirty.y, dirty.width, dirty.height, gl::RED,
+                           gl::UNSIGNED_BYTE, atlas_->pixels());
+        api_.PixelStorei(gl::UNPACK_ROW_LENGTH, 0);
+        api_.PixelStorei(gl::UNPACK_SKIP_PIXELS, 0);
+        api_.PixelStorei(gl::UNPACK_SKIP_ROWS, 0);
     }
+
+    void submit() override {
+        if (!ready_) return;
+        make_current();
+        uint32_t clear = config_.clear_color;
+        api_.Viewport(0, 0, width_, height_);
+        api_.ClearColor(((clear >> 16) & 0xFF) / 255.0f, ((clear >> 8) & 0xFF) / 255.0f, (clear & 0xFF) / 255.0f,
+                        ((clear >> 24) & 0xFF) / 255.0f);
+        api_.Clear(gl::COLOR_BUFFER_BIT);
+        if (quads_.empty()) return;
+
+        api_.UseProgram(program_);
+        api_.Uniform2f(viewport_location_, static_cast<float>(width_), static_cast<float>(height_));
+        api_.Uniform1f(atlas_size_location_, static_cast<float>(atlas_->size()));
+        api_.Uniform1i(atlas_location_, 0);
+        api_.ActiveTexture(gl::TEXTURE0);
+        api_.BindTexture(gl::TEXTURE_2D, texture_);
+        api_.BindVertexArray(vertex_array_);
+        api_.BindBuffer(gl::ARRAY_BUFFER, buffer_);
+        // Orphan last frame's storage so the driver never waits on it
+        auto bytes = static_cast<gl::GLsizeiptr>(quads_.size() * sizeof(QuadInstance));
+        api_.BufferData(gl::ARRAY_BUFFER, bytes, nullptr, gl::STREAM_DRAW);
+        api_.BufferSubData(gl::ARRAY_BUFFER, 0, bytes, quads_.data());
+        api_.DrawArraysInstanced(gl::TRIANGLE_STRIP, 0, 4, static_cast<gl::GLsizei>(quads_.size()));
+        stats_.draw_calls = 1;
+    }
+
+private:
+    bool create_program() {
+        auto compile = [&](gl::GLenum type, const char* source) -> gl::GLuint {
+            gl::GLuint shader = api_.CreateShader(type);
+            api_.ShaderSource(shader, 1, &source, nullptr);
+            api_.CompileShader(shader);
+            gl::GLint ok = 0;
+            api_.GetShaderiv(shader, gl::COMPILE_STATUS, &ok);
+            if (!ok) {
+                api_.DeleteShader(shader);
+                return 0;
+            }
+            return shader;
+        };
+        gl::GLuint vertex = compile(gl::VERTEX_SHADER, kVertexShader);
+        gl::GLuint fragment = compile(gl::FRAGMENT_SHADER, kFragmentShader);
+        if (vertex && fragment) {
+            program_ = api_.CreateProgram();
+            api_.AttachShader(program_, vertex);
+            api_.AttachShader(program_, fragment);
+            api_.LinkProgram(program_);
+            gl::GLint linked = 0;
+            api_.GetProgramiv(program_, gl::LINK_STATUS, &linked);
+            if (!linked) {
+                api_.DeleteProgram(program_);
+                program_ = 0;
+            }
+        }
+        if (vertex) api_.DeleteShader(vertex);
+        if (fragment) api_.DeleteShader(fragment);
+        if (!program_) return false;
+        viewport_location_ = api_.GetUniformLocation(program_, "viewport");
+        atlas_size_location_ = api_.GetUniformLocation(program_, "atlas_size");
+        atlas_location_ = api_.GetUniformLocation(program_, "atlas");
+        return true;
+    }
+
+    void make_current() {
+#ifdef _WIN32
+        if (context_ && wglGetCurrentContext() != context_) wglMakeCurrent(dc_, context_);
+#endif
+    }
+
+#ifdef _WIN32
+    bool create_context() {
+        HWND window = static_cast<HWND>(config_.native_window);
+        dc_ = GetDC(window);
+        if (!dc_) return false;
+        PIXELFORMATDESCRIPTOR format{};
+        format.nSize = sizeof(format);
+        format.nVersion = 1;
+        format.dwFlags = PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL | PFD_DOUBLEBUFFER;
+        format.iPixelType = PFD_TYPE_RGBA;
+        format.cColorBits = 32;
+        format.cAlphaBits = 8;
+        format.iLayerType = PFD_MAIN_PLANE;
+        int chosen = ChoosePixelFormat(dc_, &format);
+        if (!chosen || !SetPixelFormat(dc_, chosen, &format)) return false;
+        // Drivers hand a legacy context their newest compatibility profile,
+        // which has everything 3.3 core does
+        context_ = wglCreateContext(dc_);
+        if (!context_ || !wglMakeCurrent(dc_, context_)) return false;
+        using SwapInterval = BOOL(WINAPI*)(int);
+        auto swap_interval = reinterpret_cast<SwapInterval>(wglGetProcAddress("wglSwapIntervalEXT"));
+        if (swap_interval) swap_interval(config_.enable_vsync ? 1 : 0);
+        return true;
+    }
+
+    HDC dc_ = nullptr;
+    HGLRC context_ = nullptr;
+#endif
+
+    gl::Api api_;
+    bool ready_ = false;
+    gl::GLuint program_ = 0;
+    gl::GLuint texture_ = 0;
+    gl::GLuint buffer_ = 0;
+    gl::GLuint vertex_array_ = 0;
+    gl::GLint viewport_location_ = -1;
+    gl::GLint atlas_size_location_ = -1;
+    gl::GLint atlas_location_ = -1;
 };
 
+} // namespace
+
 GpuRenderer* GpuRenderer::create(const GpuRendererConfig& config) {
-    return new StubGpuRenderer();
+    switch (config.backend) {
+    case GpuBackend::Software:
+        return new SoftwareRenderer();
+    case GpuBackend::OpenGL:
+        return new OpenGLRenderer();
+    case GpuBackend::Auto:
+        if (config.gl_get_proc_address) return new OpenGLRenderer();
+#ifdef _WIN32
+        if (config.native_window) return new OpenGLRenderer();
+#endif
+        return new SoftwareRenderer();
+    default:
+        // Vulkan, Metal, DirectX 12 and WGPU have no backend yet
+        return nullptr;
+    }
 }
 
 } // namespace editor
@@ -2,6 +2,8 @@
 #include <iostream>
 #include <cassert>
 
+using namespace editor;
+
 int main() {
     GpuRendererConfig cfg;
     cfg.backend = GpuBackend::Auto;
@@ -12,11 +14,13 @@ int main() {
     GpuRenderer* renderer = GpuRenderer::create(cfg);
     assert(renderer);
     assert(renderer->initialize(cfg));
+    assert(renderer->backend() == GpuBackend::Software);
     renderer->begin_frame();
     renderer->draw_rect(10, 10, 100, 50, 0xFF00FF00);
     renderer->draw_text("Test", 20, 30, 0xFFFFFFFF);
     renderer->draw_line(10, 10, 110, 60, 0xFFFF0000);
     renderer->end_frame();
+    assert(renderer->frame_stats().draw_calls == 1);
     renderer->present();
     renderer->shutdown();
     delete renderer;
@@ -2,14 +2,19 @@
 #include <string>
 #include <vector>
 #include <cstddef>
+#include <cstdint>
 #include <fstream>
 #include <memory>
 #include <system_error>
 #include <utility>
 #include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <string_view>
 #include <iostream>
 #include <chrono>
 #include <mutex>
+#include <functional>
 #include <future>
 #include <thread>
 #include <atomic>
@@ -18,36 +23,99 @@
 #include <windows.h>
 #include <commctrl.h>
 #include "piece_table.h"
+#include "platform_file.h"
 #include "viewport.h"
+#include "document_view.h"
 #include "tab_manager.h"
+#include "tab_view_state.h"
 #include "workspace.h"
 #include "plugin_manager.h"
 #include "plugin_api.h"
 #include "syntax_highlighter.h"
 #include "find_dialog.h"
+#include "document_transform.h"
+#include "search_session.h"
+#include "workspace_replace.h"
 #include "theme.h"
 #include "terminal.h"
 #include "lsp_client.h"
+#include "lsp_document_sync.h"
+#include "lsp_server_manager.h"
 #include "git_integration.h"
+#include "diff_gutter.h"
+#include "diff_engine.h"
+#include "blame_cache.h"
+#include "thread_pool.h"
 #include "code_folding.h"
+#include "bracket_index.h"
+#include "document_outline.h"
+#include "result_list.h"
+#include "gdi_cache.h"
 #include "file_tree.h"
+#include "file_watcher.h"
+#include "document_journal.h"
 #include "undo_manager.h"
+#include "internal_clipboard.h"
+#include "highlight_cache.h"
+#include "draw_list.h"
+#include "text_transcode.h"
+#include "column_layout.h"
+#include "damage_tracker.h"
+#include "line_run_cache.h"
+#include "minimap.h"
+#include "minimap_density.h"
+#include "startup_scheduler.h"
+#include "trace.h"
+#include "frame_stats.h"
+#include "memory_report.h"
+#include "memory_pressure.h"
+#include "large_file_policy.h"
+#include "log_follower.h"
 
 public:
     enum class SplitMode { None, Horizontal, Vertical };
+    // Both panes are views of one document: cursors, scroll and folds are
+    // per pane, the text is not copied
     struct SplitPane {
-        std::shared_ptr<PieceTable> document;
-        Viewport viewport{35, 100};
-        int cursor_pos = 0;
-        bool has_selection = false;
-        size_t selection_start = 0;
-        size_t selection_end = 0;
+        DocumentView view;
         std::string file_path;
         bool is_modified = false;
-        std::vector<int> extra_cursors;
+        std::shared_ptr<HighlightCache> highlight;   // Line states for this pane's document
     };
     Win32TextEditor(HINSTANCE hInstance);
+    // Time startup from origin; trace_path (empty: none, "-": stderr) gets
+    // the timeline when the editor exits
+    void set_startup_trace(std::chrono::steady_clock::time_point origin, const std::string& trace_path) {
+        startup_timeline_ = std::make_unique<StartupTimeline>(origin);
+        startup_trace_path_ = trace_path;
+    }
+    void dump_startup_trace() const {
+        if (startup_trace_path_.empty()) return;
+        std::string trace = startup_timeline_->format();
+        if (startup_trace_path_ == "-") {
+            std::fputs(trace.c_str(), stderr);
+        } else {
+            std::ofstream(startup_trace_path_) << trace;
+        }
+    }
 private:
+    // The first frame shows the document alone; the other subsystems come
+    // up after it through startup_, on worker threads or on idle ticks
+    std::unique_ptr<StartupTimeline> startup_timeline_ = std::make_unique<StartupTimeline>();
+    std::unique_ptr<StartupScheduler> startup_;
+    std::string startup_trace_path_;
+    bool first_frame_painted_ = false;
+    bool first_input_seen_ = false;
+    // Keystroke-to-present latency, paint phases and frame pacing
+    editor::FrameStats frame_stats_;
+    bool show_perf_hud_ = false;
+    // Thresholds from the workspace settings, and what the shown document
+    // is too big for
+    editor::LargeFilePolicy large_file_policy_;
+    editor::LargeFilePolicy::Decision large_file_;
+    unsigned large_file_noted_ = 0;     // Features already reported as off
+    // Tail mode: a log file's appends come in as it grows
+    editor::LogFollower log_follower_;
     SplitPane pane1_;
     SplitPane pane2_;
     SplitMode split_mode_;
@@ -55,16 +123,47 @@ private:
     int splitter_pos_;
     bool dragging_splitter_;
     bool sync_scrolling_;
-    std::vector<int> extra_cursors_;
+    // Side-by-side compare (Ctrl+Shift+D): pane 1 shows the document, pane 2
+    // another file, and the lines of each hunk are tinted. The diff runs on
+    // snapshots on the shared pool and again after edits.
+    bool compare_active_ = false;
+    std::vector<editor::DiffEngine::Hunk> compare_hunks_;
+    bool compare_running_ = false;
+    CancellationSource compare_cancel_;                     // Cancelled when the compare closes
+    std::pair<size_t, size_t> compare_versions_{0, 0};     // Document versions the hunks are for
+    // Continuations of pool work, run on this thread at WM_UI_TASKS. The
+    // group is declared after the queue so it waits out its tasks first.
+    MainThreadQueue ui_tasks_;
+    TaskGroup ui_work_;
+    // Whole-document transforms (F9 and friends) run on a snapshot and are
+    // applied if the document has not changed meanwhile; Escape cancels
+    bool transform_running_ = false;
+    CancellationSource transform_cancel_;
+    size_t tab_size_ = 4;
+    bool use_spaces_ = true;
+    std::vector<size_t> extra_cursors_;
     int cursor_pos_;
     HWND hwnd_;
     std::unique_ptr<GitManager> git_manager_;
+    // Gutter change markers, diffed against HEAD off the UI thread
+    std::unique_ptr<editor::DiffGutter> diff_gutter_;
+    std::unique_ptr<editor::BlameCache> blame_cache_;
+    bool show_blame_ = false;              // Ctrl+Alt+B: commit of each line after its text
+    std::unique_ptr<editor::FileWatcher> file_watcher_;
     std::shared_ptr<PieceTable> document_;
     Viewport viewport_;
     std::unique_ptr<UndoManager> undo_manager_;
+    // What Ctrl+C took, as pieces; the system clipboard is only rendered
+    // from it when another application asks
+    editor::InternalClipboard clipboard_;
     std::unique_ptr<FindDialog> find_dialog_;
+    std::unique_ptr<SearchSession> search_session_;
+    size_t search_generation_;
+    bool search_jump_pending_;
     std::unique_ptr<SyntaxHighlighter> highlighter_;
+    std::unique_ptr<HighlightCache> highlight_cache_;
     std::unique_ptr<CodeFoldingManager> folding_manager_;
+    std::unique_ptr<editor::DocumentOutline> outline_;     // Symbols around the caret, for the stats box
     std::unique_ptr<Minimap> minimap_;
     bool show_file_tree_;
     int tree_panel_width_;
@@ -96,8 +195,13 @@ private:
     int tab_scroll_offset_;
 
         , find_dialog_(std::make_unique<FindDialog>())
+        , search_session_(std::make_unique<SearchSession>(find_dialog_.get()))
+        , search_generation_(0)
+        , search_jump_pending_(false)
         , highlighter_(std::make_unique<SyntaxHighlighter>())
-        , folding_manager_(std::make_unique<CodeFoldingManager>())
+        , highlight_cache_(std::make_unique<HighlightCache>(highlighter_.get()))
+        , folding_manager_(make_folding())
+        , outline_(std::make_unique<editor::DocumentOutline>())
         , minimap_(std::make_unique<Minimap>())
         , show_file_tree_(true)
         , tree_panel_width_(260)
@@ -134,29 +238,14 @@ private:
         , sync_scrolling_(false)
     {
         autocomplete_ = std::make_unique<AutocompleteManager>();
-        lsp_client_ = std::make_unique<LSPClient>();
         git_manager_ = std::make_unique<GitManager>();
         terminal_ = std::make_unique<EmbeddedTerminal>();
         theme_ = std::make_unique<Theme>();
         
-        // Try to start clangd if available (for C/C++ files)
-        // This is optional - editor works fine without it
-        char cwd[MAX_PATH];
-        GetCurrentDirectoryA(MAX_PATH, cwd);
-        lsp_client_->start_server("clangd", std::string(cwd));
-        lsp_client_->initialize(std::string(cwd));
-        
-        // Detect git repository
-        if (git_manager_->detect_repository(std::string(cwd))) {
-            git_manager_->refresh_status();
-        }
-        
-        // Set up diagnostics callback
-        lsp_client_->set_diagnostics_callback([this](const std::string& uri, const std::vector<LSPClient::Diagnostic>& diags) {
-            (void)uri;
-            current_diagnostics_ = diags;
-            InvalidateRect(hwnd_, nullptr, FALSE);
-        });
+        // Tokenize off the UI thread; paint shows plain text until lines are ready
+        highlight_cache_->set_background(true);
+        // Scroll and paint in display lines: folded lines take no row
+        viewport_.set_folding(folding_manager_.get());
         
         // Initialize with welcome text
         std::string welcome = 
@@ -200,10 +289,13 @@ private:
         // Initialize tab manager and first tab
         show_tabs_ = true;
         tab_bar_height_ = 28;
-        tab_manager_ = std::make_unique<TabManager>();
+        // The editor relies on piece-table undo transactions, change listeners
+        // and snapshots, so its tabs use that backend
+        tab_manager_ = std::make_unique<TabManager>(TextBufferBackend::PieceTable);
+        tab_manager_->set_memory_budget(kTabMemoryBudget);
         tab_manager_->new_tab(welcome, "");
         if (auto* tab = tab_manager_->get_active_tab()) {
-            document_ = tab->document;
+            document_ = tab->piece_table();
             current_file_ = tab->file_path;
         } else {
             document_ = std::make_shared<PieceTable>(welcome);
@@ -245,6 +337,15 @@ private:
             return false;
         }
         
+        HWND status_hwnd = hwnd_;
+        tab_manager_->set_reload_notify([status_hwnd] { PostMessageW(status_hwnd, WM_TAB_RELOADED, 0, 0); });
+        // However fast the shell writes, one message is in flight until
+        // the terminal's next update()
+        terminal_->set_output_callback([status_hwnd] { PostMessageW(status_hwnd, WM_TERMINAL_OUTPUT, 0, 0); });
+        ui_tasks_.set_notify([status_hwnd] { PostMessageW(status_hwnd, WM_UI_TASKS, 0, 0); });
+        watch_memory_pressure();
+        schedule_startup();
+        
         // Create monospace font
         hFont_ = CreateFontW(
             18, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE,
@@ -262,26 +363,6 @@ private:
         char_height_ = size.cy;
         ReleaseDC(hwnd_, hdc);
         
-        ShowWindow(hwnd_, SW_SHOW);
-        UpdateWindow(hwnd_);
-
-        // Create tooltip window for LSP hover
-        hover_tooltip_ = CreateWindowExW(
-            WS_EX_TOPMOST,
-            TOOLTIPS_CLASSW,
-            nullptr,
-            WS_POPUP | TTS_NOPREFIX | TTS_ALWAYSTIP,
-            CW_USEDEFAULT, CW_USEDEFAULT, CW_USEDEFAULT, CW_USEDEFAULT,
-            hwnd_,
-            nullptr,
-            hInstance_,
-            nullptr
-        );
-        
-        if (hover_tooltip_) {
-            SetWindowPos(hover_tooltip_, HWND_TOPMOST, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE);
-        }
-
         // Create file tree view control
         DWORD treeStyle = WS_CHILD | WS_VISIBLE | TVS_HASBUTTONS | TVS_HASLINES | TVS_LINESATROOT | TVS_SHOWSELALWAYS;
         RECT cr{}; GetClientRect(hwnd_, &cr);
@@ -298,16 +379,88 @@ private:
             GetCurrentDirectoryA(MAX_PATH, cwd);
             current_workspace_dir_ = cwd;
             file_tree_.set_tree_control(tree_hwnd_);
-            file_tree_.load_directory(std::string(cwd));
-            file_tree_.populate_tree_view();
+            // Filled in by startup once the directory is read
         }
         
-        // Try to load workspace state from previous session
+        // Try to load workspace state from previous session (placeholder
+        // tabs; the active one loads now, the rest after the first frame)
+        size_t restore = startup_timeline_->begin("restore workspace");
         load_workspace_state();
+        startup_timeline_->end(restore);
         
+        startup_timeline_->mark("window ready");
+        ShowWindow(hwnd_, SW_SHOW);
+        UpdateWindow(hwnd_);
         return true;
     }
     
+    // Everything the first frame can do without, in the order it is wanted
+    void schedule_startup() {
+        startup_ = std::make_unique<StartupScheduler>(*startup_timeline_);
+        char cwd[MAX_PATH] = {0};
+        GetCurrentDirectoryA(MAX_PATH, cwd);
+        std::string dir = cwd;
+        
+        // The directory walk is the slow part of the tree; the control is
+        // filled on the UI thread once it is done
+        startup_->add_background("file tree", [this, dir] { file_tree_.load_directory(dir); }, [this] {
+            if (!tree_hwnd_) return;
+            file_tree_.populate_tree_view();
+            start_file_watcher();
+        });
+        
+        // Git detection runs git; a manager of its own does it off the UI
+        // thread and replaces the idle one when done. Status arrives in the
+        // background, posted to the window
+        auto detected = std::make_shared<std::unique_ptr<GitManager>>(std::make_unique<GitManager>());
+        HWND hwnd = hwnd_;
+        startup_->add_background("git", [detected, dir, hwnd] {
+            (*detected)->set_status_callback([hwnd] { PostMessageW(hwnd, WM_GIT_STATUS, 0, 0); });
+            if (!(*detected)->detect_repository(dir)) detected->reset();
+        }, [this, detected] {
+            if (!*detected) return;
+            git_manager_ = std::move(*detected);
+            GitManager* git = git_manager_.get();
+            diff_gutter_ = std::make_unique<editor::DiffGutter>(
+                [git](const std::string& path, std::string& blob_id) { return git->get_head_blob_id(path, blob_id); },
+                [git](const std::string& blob_id, std::string& text) { return git->get_blob_text(blob_id, text); });
+            blame_cache_ = std::make_unique<editor::BlameCache>(
+                [git](const std::string& path, std::string& blob_id) { return git->get_head_blob_id(path, blob_id); },
+                [git](const std::string& blob_id, std::string& text) { return git->get_blob_text(blob_id, text); },
+                [git](const std::string& path, std::string& output) { return git->get_blame(path, output); });
+            // A status posted before the swap went to the old manager
+            git_manager_->take_status_results();
+            InvalidateRect(hwnd_, nullptr, FALSE);
+        });
+        
+        startup_->add_idle("language servers", [this] { start_language_servers(); });
+        startup_->add_idle("hover tooltip", [this] {
+            hover_tooltip_ = CreateWindowExW(
+                WS_EX_TOPMOST,
+                TOOLTIPS_CLASSW,
+                nullptr,
+                WS_POPUP | TTS_NOPREFIX | TTS_ALWAYSTIP,
+                CW_USEDEFAULT, CW_USEDEFAULT, CW_USEDEFAULT, CW_USEDEFAULT,
+                hwnd_,
+                nullptr,
+                hInstance_,
+                nullptr
+            );
+            if (hover_tooltip_) {
+                SetWindowPos(hover_tooltip_, HWND_TOPMOST, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE);
+            }
+        });
+    }
+    
+    // After the first frame: one step per idle tick, and whenever
+    // background work finishes
+    void step_startup() {
+        if (!startup_ || startup_->step()) return;
+        KillTimer(hwnd_, 7);
+        startup_.reset();
+        startup_timeline_->mark("startup complete");
+    }
+    
     int run() {
         MSG msg = {};
         LARGE_INTEGER frequency, last_time, current_time;
@@ -320,6 +473,9 @@ private:
         // Start FPS counter timer
         SetTimer(hwnd_, 2, 100, nullptr);
         
+        // Pick up background highlighting results about once per frame
+        SetTimer(hwnd_, 3, 16, nullptr);
+        
         // Suorituskykylokin tiedosto
         FILE* perf_log = fopen("performance_log.txt", "a");
         if (perf_log) {
@@ -330,8 +486,15 @@ private:
         double total_frame_time = 0.0;
 
         while (GetMessage(&msg, nullptr, 0, 0)) {
+            bool input = msg.message == WM_KEYDOWN || msg.message == WM_CHAR;
+            if (input) frame_stats_.note_input();
             TranslateMessage(&msg);
             DispatchMessage(&msg);
+            // Latency is measured up to the paint that shows the keystroke;
+            // one that invalidated nothing has none
+            if (input && frame_stats_.input_pending() && !GetUpdateRect(hwnd_, nullptr, FALSE)) {
+                frame_stats_.drop_input();
+            }
 
             QueryPerformanceCounter(&current_time);
             double delta = static_cast<double>(current_time.QuadPart - last_time.QuadPart) / frequency.QuadPart;
@@ -353,6 +516,7 @@ private:
         }
         KillTimer(hwnd_, 1);
         KillTimer(hwnd_, 2);
+        KillTimer(hwnd_, 3);
         return static_cast<int>(msg.wParam);
     }
 
@@ -363,11 +527,350 @@ private:
     
     // Tabs
     std::unique_ptr<TabManager> tab_manager_;
+    WorkspaceReplace workspace_replace_;
+    // Project search (Ctrl+Shift+F): results stream into the list, the
+    // panel reads only the rows it shows
+    bool show_project_search_ = false;
+    int results_panel_height_ = 320;
+    int project_search_focus_ = 0;
+    std::string project_search_query_;
+    std::string project_replace_query_;
+    std::string project_include_patterns_;
+    std::string project_exclude_patterns_;
+    std::atomic<bool> project_search_in_progress_{ false };
+    std::future<void> project_search_future_;
+    editor::ResultList project_results_;
+    size_t project_results_top_ = 0;       // First row shown
+    int selected_result_index_ = -1;
+    struct ResultRow {
+        bool is_header;
+        std::string file;
+        int result_index;
+    };
+    std::vector<ResultRow> result_rows_layout_;
+    std::vector<editor::ResultList::Row> result_rows_;     // Reused by every paint
     std::unique_ptr<editor::GpuRenderer> gpu_renderer_;
+    editor::GdiCache gdi_;                 // GDI objects of the paint path
+    editor::DrawList pane_draw_list_;      // Reused by every pane, every paint
+    editor::DamageTracker damage_;         // What the next paint redraws
+    HDC back_dc_ = nullptr;                // Back buffer kept between paints
+    HBITMAP back_bitmap_ = nullptr;
+    HGDIOBJ back_old_bitmap_ = nullptr;
+    SIZE back_size_{ 0, 0 };
+    editor::LineRunCache line_cache_;      // Which rows of line_cache_dc_ hold which line image
+    HDC line_cache_dc_ = nullptr;
+    HBITMAP line_cache_bitmap_ = nullptr;
+    HGDIOBJ line_cache_old_bitmap_ = nullptr;
+    SIZE line_cache_size_{ 0, 0 };
+    // Minimap preview; a line's color is its first token's, as the old sampler had it
+    editor::MinimapDensity minimap_density_{ [this](const std::string& line) {
+        auto tokens = highlighter_->tokenize_line(line);
+        return to_argb(tokens.empty() ? RGB(180, 180, 180) : tokens[0].get_color());
+    } };
+    std::wstring paint_text_;              // Widened run text for GDI replay
+    std::vector<INT> paint_dx_;            // Its cell advances, when not all ASCII
+    std::string run_text_;                 // A row with its tabs expanded
+    std::vector<size_t> run_offsets_;      // Where each byte of the row went in it
+    // Edits since the last didChange, sent as range changes once typing pauses
+    editor::LspDocumentSync lsp_sync_;
+    std::vector<editor::LspContentChange> lsp_changes_;
+    bool hover_requested_ = false;         // Hover asked for the current mouse position
+    bool semantic_tokens_due_ = false;     // The server's semantic tokens are behind the document
+    std::unique_ptr<editor::LspServerManager> lsp_servers_;    // Null until startup gets to it
+    // Language servers (clangd, pyright, gopls) start when a file of
+    // their language is opened; the editor works fine without them
+    void start_language_servers() {
+        char cwd[MAX_PATH];
+        GetCurrentDirectoryA(MAX_PATH, cwd);
+        lsp_servers_ = std::make_unique<editor::LspServerManager>(std::string(cwd));
+        for (auto& config : editor::LspServerManager::default_servers()) {
+            lsp_servers_->add_server(std::move(config));
+        }
+        // A restarted server reopens the synced document from its current text
+        lsp_servers_->set_reopen_callback([this](const std::string& uri) {
+            if (uri != lsp_sync_.uri()) return std::shared_ptr<PieceTable>();
+            auto document = lsp_sync_.document();
+            lsp_sync_.set_incremental(false);
+            lsp_sync_.set_document(document, uri);
+            return document;
+        });
+        lsp_servers_->set_diagnostics_callback([this](const std::string& uri, const std::vector<LSPClient::Diagnostic>& diags) {
+            // Every server reports here; only the shown file's count
+            if (uri != "file:///" + current_file_) return;
+            current_diagnostics_ = diags;
+            InvalidateRect(hwnd_, nullptr, FALSE);
+        });
+        // A file opened before the servers were up gets its didOpen now
+        if (document_) open_in_language_server();
+    }
+    void open_in_language_server() {
+        if (!large_file_.allows(editor::LargeFileFeature::LanguageServer)) return;
+        std::string lang_id = editor::LspServerManager::language_for_path(current_file_);
+        if (!lsp_servers_ || lang_id.empty()) return;
+        std::string uri = "file:///" + current_file_;
+        flush_lsp_changes();
+        if (lsp_servers_->over_size_limit(lang_id, document_->get_total_length())) {
+            // Definitions and references come from the editor's own scan instead
+            lsp_servers_->close_document(uri);
+            lsp_sync_.set_document(nullptr, std::string());
+            std::string note = "Too large for the " + lang_id + " language server (over " +
+                               std::to_string(lsp_servers_->size_limit(lang_id) / (1024 * 1024)) +
+                               " MB); using local symbols";
+            show_status_message(std::wstring(note.begin(), note.end()), 5000);
+            return;
+        }
+        LSPClient* lsp = lsp_servers_->open_document(uri, lang_id, *document_);
+        if (lsp) {
+            // Later edits reach the server as debounced didChange
+            // deltas; full text until it has said what it accepts
+            lsp_sync_.set_encoding(lsp->position_encoding());
+            lsp_sync_.set_incremental(lsp->is_running() && lsp->incremental_sync());
+            lsp_sync_.set_document(document_, uri);
+            semantic_tokens_due_ = true;
+        }
+    }
+    // Decide what the shown document is too big for, and say so
+    void apply_large_file_policy() {
+        large_file_ = document_ ? large_file_policy_.evaluate(*document_) : editor::LargeFilePolicy::Decision();
+        large_file_noted_ = 0;
+        if (highlight_cache_) highlight_cache_->set_full_pass(large_file_.allows(editor::LargeFileFeature::FullHighlight));
+        if (!large_file_.large) return;
+        std::string message = large_file_.message();
+        std::cout << message << "\n";
+        show_status_message(std::wstring(message.begin(), message.end()), 8000);
+    }
+    // The user asked for feature: true if it may run, starting it if it
+    // was deferred; a feature that is off is reported once per document
+    bool use_feature(editor::LargeFileFeature feature) {
+        using editor::LargeFileFeature;
+        if (large_file_.allows(feature)) return true;
+        std::string what = editor::LargeFilePolicy::description(feature);
+        if (!large_file_.resume(feature)) {
+            unsigned bit = 1u << static_cast<unsigned>(feature);
+            if (!(large_file_noted_ & bit)) {
+                large_file_noted_ |= bit;
+                std::string note = what + " is off for large files (large_file." +
+                                   editor::LargeFilePolicy::name(feature) + " in the workspace settings)";
+                show_status_message(std::wstring(note.begin(), note.end()), 3000);
+            }
+            return false;
+        }
+        switch (feature) {
+            case LargeFileFeature::Folding: refresh_folding(); break;
+            case LargeFileFeature::Autocomplete: attach_autocomplete(); break;
+            case LargeFileFeature::LanguageServer: open_in_language_server(); break;
+            case LargeFileFeature::FullHighlight: highlight_cache_->set_full_pass(true); break;
+            default: break;
+        }
+        std::string note = what + " started for this large file";
+        show_status_message(std::wstring(note.begin(), note.end()), 2000);
+        return true;
+    }
+    void attach_autocomplete() {
+        if (!autocomplete_) return;
+        if (large_file_.allows(editor::LargeFileFeature::Autocomplete)) {
+            autocomplete_->attach(document_);
+        } else {
+            autocomplete_->detach();
+        }
+    }
+    // Follow the shown file as it grows (Ctrl+Alt+F again stops)
+    void toggle_follow() {
+        if (log_follower_.is_following() && log_follower_.document() == document_) {
+            log_follower_.stop();
+            show_status_message(L"Stopped following", 2000);
+            return;
+        }
+        if (current_file_.empty() || !log_follower_.start(current_file_, document_)) {
+            show_status_message(L"Only a saved file can be followed", 3000);
+            return;
+        }
+        viewport_.scroll_to_end();
+        show_status_message(L"Following " + std::wstring(current_file_.begin(), current_file_.end()), 3000);
+        InvalidateRect(hwnd_, nullptr, FALSE);
+    }
+    void poll_follow() {
+        if (!log_follower_.is_following()) return;
+        EditorTab* tab = nullptr;
+        for (size_t i = 0; i < tab_manager_->get_tab_count() && !tab; ++i) {
+            EditorTab* candidate = tab_manager_->get_tab(i);
+            if (candidate->document == log_follower_.document()) tab = candidate;
+        }
+        // Closed or hibernated: nothing left to follow into
+        if (!tab) {
+            log_follower_.stop();
+            return;
+        }
+        bool shown = tab->document == document_;
+        bool at_end = shown && viewport_.is_at_end();
+        switch (log_follower_.poll()) {
+            case editor::LogFollower::Result::Appended:
+                if (!shown) return;
+                if (at_end) viewport_.scroll_to_end();
+                InvalidateRect(hwnd_, nullptr, FALSE);
+                break;
+            case editor::LogFollower::Result::Reset:
+                // Truncated or rotated: the tab starts over with the new file
+                tab->document = log_follower_.document();
+                tab->view_state.reset();
+                tab->top_line = 0;
+                tab->cursor_pos = 0;
+                tab->is_modified = false;
+                if (shown) {
+                    show_active_tab();
+                    viewport_.scroll_to_end();
+                    show_status_message(L"File was truncated or rotated; reloaded", 3000);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    // F12 without a language server (none for the language, or the file is
+    // over its size limit): definitions from the file's own tags pass,
+    // references as a project search for the word
+    void goto_local_symbol(bool references) {
+        if (!document_) return;
+        size_t line_index = get_cursor_line();
+        size_t line_start = document_->get_line_start(line_index);
+        std::string line = document_->get_line(line_index);
+        size_t col = (std::min)(cursor_pos_ - line_start, line.size());
+        auto is_ident = [](char c) { return std::isalnum((unsigned char)c) || c == '_'; };
+        size_t begin = col, end = col;
+        while (begin > 0 && is_ident(line[begin - 1])) --begin;
+        while (end < line.size() && is_ident(line[end])) ++end;
+        if (begin == end) return;
+        std::string word = line.substr(begin, end - begin);
+        if (references) {
+            project_search_query_ = word;
+            show_project_search_ = true;
+            start_project_search();
+            InvalidateRect(hwnd_, nullptr, FALSE);
+            return;
+        }
+        SymbolTags::Language language = SymbolTags::language_for_path(current_file_);
+        std::vector<SymbolTags::Definition> found;
+        auto cursor = document_->lines();
+        std::string_view text;
+        while (cursor.next(text)) {
+            found.clear();
+            SymbolTags::scan_line(language, text, (uint32_t)cursor.line_number(), found);
+            for (const auto& definition : found) {
+                if (definition.name != word) continue;
+                cursor_pos_ = cursor.line_start() + definition.column;
+                viewport_.scroll_to_line(definition.line > 10 ? definition.line - 10 : 0);
+                InvalidateRect(hwnd_, nullptr, FALSE);
+                return;
+            }
+        }
+        show_status_message(L"No definition found in this file", 2000);
+    }
+    // Server of the shown file; launch restarts one retired while idle
+    LSPClient* active_lsp(bool launch = true) {
+        if (!lsp_servers_ || current_file_.empty()) return nullptr;
+        return lsp_servers_->client_for("file:///" + current_file_, launch);
+    }
+    void flush_lsp_changes() {
+        if (!lsp_servers_ || !lsp_sync_.has_pending()) return;
+        LSPClient* lsp = lsp_servers_->client_for(lsp_sync_.uri());
+        // Edits made while the server starts are sent as full text once it is up
+        if (!lsp || !lsp->is_running()) return;
+        if (lsp_sync_.full_pending() && lsp_sync_.document()) {
+            // Streamed from the pieces rather than read into one string
+            auto document = lsp_sync_.document();
+            std::string uri = lsp_sync_.uri();
+            lsp->did_change(uri, *document);
+            lsp_sync_.set_document(document, uri);
+        } else {
+            if (!lsp_sync_.take(lsp_changes_)) return;
+            lsp->did_change(lsp_sync_.uri(), lsp_changes_);
+        }
+        lsp_sync_.set_encoding(lsp->position_encoding());
+        lsp_sync_.set_incremental(lsp->incremental_sync());
+        semantic_tokens_due_ = true;
+    }
+    // Semantic tokens of the synced document: the first request gets them
+    // all, later ones only the edits since the result the overlay holds
+    void request_semantic_tokens() {
+        if (!lsp_servers_ || !lsp_sync_.document() || lsp_sync_.document() != document_) return;
+        LSPClient* lsp = lsp_servers_->client_for(lsp_sync_.uri(), false);
+        if (!lsp || !lsp->is_running()) return;     // Still starting: asked again next tick
+        semantic_tokens_due_ = false;
+        if (lsp->semantic_token_types().empty()) return;
+        auto overlay = highlight_cache_->semantic_tokens();
+        if (!overlay) {
+            overlay = std::make_shared<editor::SemanticTokenOverlay>();
+            highlight_cache_->set_semantic_tokens(overlay);
+        }
+        if (overlay->result_id().empty()) overlay->set_legend(lsp->semantic_token_types());
+        overlay->set_encoding(lsp->position_encoding());
+        size_t mark = overlay->mark();
+        std::weak_ptr<editor::SemanticTokenOverlay> weak = overlay;
+        lsp->request_semantic_tokens(lsp_sync_.uri(), overlay->result_id(),
+                                     [this, weak, mark](const LSPClient::SemanticTokens& result) {
+            auto tokens = weak.lock();
+            if (!tokens) return;
+            // A delta that does not fit cleared the tokens: start over with a full request
+            if (!tokens->apply(result, mark)) semantic_tokens_due_ = true;
+            invalidate_rect(text_area_rect());
+        });
+    }
     bool show_tabs_ = false;
     int tab_bar_height_ = 28;
     std::vector<RECT> tab_rects_;
 
+    // File watcher batches arrive on its thread; lParam owns a heap copy
+    static constexpr UINT WM_FILES_CHANGED = WM_APP + 1;
+    // GitManager has status results waiting
+    static constexpr UINT WM_GIT_STATUS = WM_APP + 2;
+    // The terminal has output waiting to be parsed
+    static constexpr UINT WM_TERMINAL_OUTPUT = WM_APP + 3;
+    // A background save finished; wParam is its outcome, lParam owns the path
+    static constexpr UINT WM_SAVE_DONE = WM_APP + 4;
+    // A hibernated tab finished reloading in the background
+    static constexpr UINT WM_TAB_RELOADED = WM_APP + 5;
+    // Deferred startup work finished in the background; its UI part is due
+    static constexpr UINT WM_STARTUP_STEP = WM_APP + 6;
+    // Pool work has continuations waiting in ui_tasks_
+    static constexpr UINT WM_UI_TASKS = WM_APP + 7;
+    // The system is short of memory; caches are shed on the UI thread
+    static constexpr UINT WM_MEMORY_PRESSURE = WM_APP + 8;
+    editor::MemoryPressureMonitor memory_pressure_;
+    // Documents resident across all tabs; older tabs hibernate beyond it
+    static constexpr size_t kTabMemoryBudget = 512u * 1024 * 1024;
+    // The active tab is still reloading: nothing to edit yet
+    bool tab_loading_ = false;
+
+    // Crash-recovery journals of the open documents, under .velocity/journal
+    std::unordered_map<const PieceTable*, std::unique_ptr<editor::DocumentJournal>> journals_;
+    void start_journal() {
+        if (!document_ || current_workspace_dir_.empty() || journals_.count(document_.get())) return;
+        std::string key = current_file_.empty()
+            ? "untitled-" + std::to_string(reinterpret_cast<uintptr_t>(document_.get()))
+            : current_file_;
+        auto journal = std::make_unique<editor::DocumentJournal>();
+        std::string path = editor::DocumentJournal::journal_path_for(current_workspace_dir_, key);
+        if (!journal->open(*document_, path, current_file_)) return;
+        journals_[document_.get()] = std::move(journal);
+        // Old history and cold typed text page out next to the journal
+        document_->set_history_spill(editor::DocumentJournal::history_path_for(path));
+    }
+    // Closing a tab or the editor is deliberate: the journal goes with it
+    void end_journal(const PieceTable* document) {
+        auto found = journals_.find(document);
+        if (found == journals_.end()) return;
+        found->second->close(true);
+        journals_.erase(found);
+    }
+    void start_file_watcher() {
+        file_watcher_ = std::make_unique<editor::FileWatcher>();
+        HWND hwnd = hwnd_;
+        file_watcher_->start(current_workspace_dir_, [hwnd](const std::vector<editor::FileChange>& changes) {
+            auto copy = std::make_unique<std::vector<editor::FileChange>>(changes);
+            if (PostMessageW(hwnd, WM_FILES_CHANGED, 0, reinterpret_cast<LPARAM>(copy.get()))) copy.release();
+        });
+    }
+
     // Transient status message (e.g., replace-all count)
     std::wstring status_message_;
     std::chrono::steady_clock::time_point status_message_until_{};
@@ -401,7 +904,8 @@ private:
         // Simple commit dialog with message box
         // In the future, this could be a custom dialog with file list and checkboxes
         
-        // Get modified and staged files
+        // Get modified and staged files, as of now
+        git_manager_->wait_for_status();
         auto modified = git_manager_->get_modified_files();
         auto staged = git_manager_->get_staged_files();
         
@@ -442,8 +946,10 @@ private:
             std::string msg = "Update from editor";
             if (git_manager_->commit(msg)) {
                 show_status_message(L"Committed successfully!", 3000);
-                // Refresh git status
+                // Refresh git status; committed lines are unchanged now
                 git_manager_->refresh_status();
+                if (diff_gutter_) diff_gutter_->invalidate_base();
+                if (blame_cache_) blame_cache_->invalidate_base();
                 InvalidateRect(hwnd_, nullptr, TRUE);
             } else {
                 MessageBoxW(hwnd_, L"Commit failed. Check git configuration.", L"Error", MB_OK | MB_ICONERROR);
@@ -487,27 +993,7 @@ private:
         split_mode_ = SplitMode::Horizontal;
         splitter_pos_ = content_height / 2;  // Middle position
         
-        // Copy current state to pane1
-        pane1_.document = document_;
-        pane1_.viewport.set_document(document_);
-        pane1_.cursor_pos = cursor_pos_;
-        pane1_.has_selection = has_selection_;
-        pane1_.selection_start = selection_start_;
-        pane1_.selection_end = selection_end_;
-        pane1_.file_path = current_file_;
-        pane1_.is_modified = is_modified_;
-        pane1_.extra_cursors = extra_cursors_;
-        
-        // Initialize pane2 with same content (or blank)
-        pane2_.document = std::make_shared<PieceTable>(document_->get_text(0, document_->get_total_length()));
-        pane2_.viewport.set_document(pane2_.document);
-        pane2_.cursor_pos = 0;
-        pane2_.has_selection = false;
-        pane2_.file_path = current_file_;
-        pane2_.is_modified = false;
-        
-        active_pane_ = 0;
-        InvalidateRect(hwnd_, nullptr, TRUE);
+        open_split_panes();
     }
     
     void split_vertical() {
@@ -520,48 +1006,196 @@ private:
         split_mode_ = SplitMode::Vertical;
         splitter_pos_ = content_width / 2;  // Middle position
         
-        // Copy current state to pane1
-        pane1_.document = document_;
-        pane1_.viewport.set_document(document_);
-        pane1_.cursor_pos = cursor_pos_;
-        pane1_.has_selection = has_selection_;
-        pane1_.selection_start = selection_start_;
-        pane1_.selection_end = selection_end_;
-        pane1_.file_path = current_file_;
-        pane1_.is_modified = is_modified_;
-        pane1_.extra_cursors = extra_cursors_;
-        
-        // Initialize pane2 with same content (or blank)
-        pane2_.document = std::make_shared<PieceTable>(document_->get_text(0, document_->get_total_length()));
-        pane2_.viewport.set_document(pane2_.document);
-        pane2_.cursor_pos = 0;
-        pane2_.has_selection = false;
-        pane2_.file_path = current_file_;
-        pane2_.is_modified = false;
-        
+        open_split_panes();
+    }
+    
+    // Both panes show the current document; the second starts where the
+    // first is, and edits in either reach the other through the document
+    void open_split_panes() {
+        for (SplitPane* pane : {&pane1_, &pane2_}) {
+            pane->view.set_document(document_);
+            pane->view.viewport().scroll_to_line(viewport_.get_top_line());
+            pane->file_path = current_file_;
+            pane->is_modified = is_modified_;
+        }
         active_pane_ = 0;
+        store_active_pane();
+        pane2_.view.cursor_pos = cursor_pos_;
         InvalidateRect(hwnd_, nullptr, TRUE);
     }
     
+    // The editing state (cursor_pos_ and friends) belongs to the active pane
+    void store_active_pane() {
+        DocumentView& view = ((active_pane_ == 0) ? pane1_ : pane2_).view;
+        view.cursor_pos = cursor_pos_;
+        view.has_selection = has_selection_;
+        view.selection_start = selection_start_;
+        view.selection_end = selection_end_;
+        view.extra_cursors = extra_cursors_;
+    }
+    
+    void activate_pane(int pane) {
+        if (pane == active_pane_) return;
+        store_active_pane();
+        active_pane_ = pane;
+        auto& active = (active_pane_ == 0) ? pane1_ : pane2_;
+        document_ = active.view.document();
+        cursor_pos_ = active.view.cursor_pos;
+        has_selection_ = active.view.has_selection;
+        selection_start_ = active.view.selection_start;
+        selection_end_ = active.view.selection_end;
+        extra_cursors_ = active.view.extra_cursors;
+        current_file_ = active.file_path;
+    }
+    
     void close_split() {
         if (split_mode_ == SplitMode::None) return;  // Not split
         
         // Restore state from active pane
+        store_active_pane();
         auto& active = (active_pane_ == 0) ? pane1_ : pane2_;
-        document_ = active.document;
+        document_ = active.view.document();
         viewport_.set_document(document_);
-        cursor_pos_ = active.cursor_pos;
-        has_selection_ = active.has_selection;
-        selection_start_ = active.selection_start;
-        selection_end_ = active.selection_end;
+        viewport_.scroll_to_line(active.view.viewport().get_top_line());
+        cursor_pos_ = active.view.cursor_pos;
+        has_selection_ = active.view.has_selection;
+        selection_start_ = active.view.selection_start;
+        selection_end_ = active.view.selection_end;
         current_file_ = active.file_path;
         is_modified_ = active.is_modified;
-        extra_cursors_ = active.extra_cursors;
+        extra_cursors_ = active.view.extra_cursors;
         
+        // The panes stop following the document
+        pane1_.view.set_document(nullptr);
+        pane2_.view.set_document(nullptr);
         split_mode_ = SplitMode::None;
+        compare_active_ = false;
+        compare_hunks_.clear();
+        compare_cancel_.cancel();
+        compare_running_ = false;
         InvalidateRect(hwnd_, nullptr, TRUE);
     }
     
+    // Open another file in pane 2 of a vertical split, diffed against the document
+    void compare_with_file() {
+        OPENFILENAMEW ofn = {};
+        wchar_t filename[MAX_PATH] = L"";
+        ofn.lStructSize = sizeof(OPENFILENAMEW);
+        ofn.hwndOwner = hwnd_;
+        ofn.lpstrFilter = L"All Files (*.*)\0*.*\0";
+        ofn.lpstrFile = filename;
+        ofn.nMaxFile = MAX_PATH;
+        ofn.lpstrTitle = L"Compare with";
+        ofn.Flags = OFN_FILEMUSTEXIST | OFN_PATHMUSTEXIST;
+        if (!GetOpenFileNameW(&ofn)) return;
+        char narrow_filename[MAX_PATH];
+        WideCharToMultiByte(CP_UTF8, 0, filename, -1, narrow_filename, MAX_PATH, nullptr, nullptr);
+        auto mapping = editor::PlatformFile::map_file(narrow_filename);
+        if (!mapping) {
+            MessageBoxW(hwnd_, L"Failed to open file", L"Error", MB_OK | MB_ICONERROR);
+            return;
+        }
+        if (split_mode_ != SplitMode::None) close_split();
+        split_vertical();
+        pane2_.view.set_document(std::make_shared<PieceTable>(mapping, PieceTable::LineIndexing::Background));
+        pane2_.view.viewport().scroll_to_line(pane1_.view.viewport().get_top_line());
+        pane2_.view.cursor_pos = 0;
+        pane2_.file_path = narrow_filename;
+        pane2_.is_modified = false;
+        compare_active_ = true;
+        sync_scrolling_ = true;
+        compare_hunks_.clear();
+        compare_cancel_ = CancellationSource();
+        start_compare();
+    }
+
+    // The diff runs on a pool worker (hashing inline there) and the hunks
+    // come back through ui_tasks_; closing the compare drops them
+    void start_compare() {
+        auto old_text = pane1_.view.document()->snapshot();
+        auto new_text = pane2_.view.document()->snapshot();
+        compare_versions_ = { old_text->get_version(), new_text->get_version() };
+        compare_running_ = true;
+        run_then(ui_work_, ui_tasks_, [old_text, new_text]() {
+            return editor::DiffEngine::diff(*old_text, *new_text, &ThreadPool::shared());
+        }, [this](std::vector<editor::DiffEngine::Hunk> hunks) {
+            compare_running_ = false;
+            compare_hunks_ = std::move(hunks);
+            show_status_message(std::to_wstring(compare_hunks_.size()) + L" differences", 2000);
+            invalidate_rect(text_area_rect());
+        }, TaskPriority::Visible, compare_cancel_.token());
+    }
+
+    // Chunks are transformed on the pool; progress shows in the status bar
+    // whenever another tenth is done
+    void run_transform(const editor::DocumentTransform& transform) {
+        if (transform_running_ || !document_) return;
+        std::shared_ptr<PieceTable> document = document_;
+        auto snapshot = document->snapshot();
+        transform_cancel_ = CancellationSource();
+        transform_running_ = true;
+        std::wstring title(transform.title.begin(), transform.title.end());
+        show_status_message(title + L"...", 2000);
+        auto tenths = std::make_shared<std::atomic<size_t>>(0);
+        HWND hwnd = hwnd_;
+        auto progress = [this, title, tenths](size_t done, size_t total) {
+            size_t tenth = done * 10 / total;
+            if (tenth == 0 || tenths->exchange(tenth) == tenth) return;
+            ui_tasks_.post([this, title, tenth] {
+                if (transform_running_) show_status_message(title + L": " + std::to_wstring(tenth * 10) + L"%", 2000);
+            });
+        };
+        CancellationToken cancel = transform_cancel_.token();
+        run_then(ui_work_, ui_tasks_, [snapshot, transform, cancel, progress]() {
+            return editor::TransformPipeline::run(*snapshot, transform, cancel, progress);
+        }, [this, document, title, hwnd](editor::TransformPipeline::Result result) {
+            transform_running_ = false;
+            if (!result.error.empty()) {
+                show_status_message(std::wstring(result.error.begin(), result.error.end()), 3000);
+                return;
+            }
+            // One undo step, through the undo manager when it is the active tab's
+            bool active = document == document_;
+            if (active) undo_manager_->begin_transaction(document.get());
+            bool applied = editor::TransformPipeline::apply(*document, result);
+            if (active) undo_manager_->commit_transaction();
+            if (!applied) {
+                show_status_message(title + L": the document changed, not applied", 3000);
+                return;
+            }
+            if (active) {
+                cursor_pos_ = (int)(std::min)((size_t)cursor_pos_, document_->get_total_length());
+                is_modified_ = true;
+                mark_active_tab_modified();
+                update_title();
+            }
+            show_status_message(title + L": done", 2000);
+            InvalidateRect(hwnd, nullptr, TRUE);
+        }, TaskPriority::Visible, cancel);
+    }
+
+    // Start the next diff once either side was edited
+    void update_compare() {
+        if (!compare_active_ || compare_running_) return;
+        if (pane1_.view.document()->get_version() != compare_versions_.first ||
+            pane2_.view.document()->get_version() != compare_versions_.second) {
+            start_compare();
+        }
+    }
+
+    // The other pane follows the active one: by the same move, or in a
+    // compare to the line level with the active pane's top across the hunks
+    void follow_active_pane(const std::function<void(Viewport&)>& same_move) {
+        auto& pane = (active_pane_ == 0) ? pane1_ : pane2_;
+        auto& other = (active_pane_ == 0) ? pane2_ : pane1_;
+        if (compare_active_) {
+            size_t top = pane.view.viewport().get_top_line();
+            other.view.viewport().scroll_to_line(editor::DiffEngine::map_line(compare_hunks_, top, active_pane_ == 0));
+        } else {
+            same_move(other.view.viewport());
+        }
+    }
+
     void toggle_sync_scrolling() {
         sync_scrolling_ = !sync_scrolling_;
         std::wstring msg = sync_scrolling_ ? L"Synchronized scrolling: ON" : L"Synchronized scrolling: OFF";
@@ -632,11 +1266,8 @@ private:
     void scroll_view_up(int lines) {
         if (split_mode_ != SplitMode::None) {
             auto& pane = (active_pane_ == 0) ? pane1_ : pane2_;
-            pane.viewport.scroll_up(lines);
-            if (sync_scrolling_) {
-                auto& other = (active_pane_ == 0) ? pane2_ : pane1_;
-                other.viewport.scroll_up(lines);
-            }
+            pane.view.viewport().scroll_up(lines);
+            if (sync_scrolling_) follow_active_pane([lines](Viewport& other) { other.scroll_up(lines); });
         } else {
             viewport_.scroll_up(lines);
         }
@@ -645,11 +1276,8 @@ private:
     void scroll_view_down(int lines) {
         if (split_mode_ != SplitMode::None) {
             auto& pane = (active_pane_ == 0) ? pane1_ : pane2_;
-            pane.viewport.scroll_down(lines);
-            if (sync_scrolling_) {
-                auto& other = (active_pane_ == 0) ? pane2_ : pane1_;
-                other.viewport.scroll_down(lines);
-            }
+            pane.view.viewport().scroll_down(lines);
+            if (sync_scrolling_) follow_active_pane([lines](Viewport& other) { other.scroll_down(lines); });
         } else {
             viewport_.scroll_down(lines);
         }
@@ -658,11 +1286,8 @@ private:
     void scroll_to_line(size_t line) {
         if (split_mode_ != SplitMode::None) {
             auto& pane = (active_pane_ == 0) ? pane1_ : pane2_;
-            pane.viewport.scroll_to_line(line);
-            if (sync_scrolling_) {
-                auto& other = (active_pane_ == 0) ? pane2_ : pane1_;
-                other.viewport.scroll_to_line(line);
-            }
+            pane.view.viewport().scroll_to_line(line);
+            if (sync_scrolling_) follow_active_pane([line](Viewport& other) { other.scroll_to_line(line); });
         } else {
             viewport_.scroll_to_line(line);
         }
@@ -733,6 +1358,13 @@ private:
                                 open_file_from_path(node->full_path);
                             }
                         }
+                    } else if (hdr->code == TVN_ITEMEXPANDINGW || hdr->code == TVN_ITEMEXPANDINGA) {
+                        // Directories are read and their items created on demand
+                        LPNMTREEVIEWW tv = reinterpret_cast<LPNMTREEVIEWW>(lParam);
+                        if (tv->action & TVE_EXPAND) file_tree_.on_item_expanding(tv->itemNew.hItem);
+                    } else if (hdr->code == TVN_ITEMEXPANDEDW || hdr->code == TVN_ITEMEXPANDEDA) {
+                        LPNMTREEVIEWW tv = reinterpret_cast<LPNMTREEVIEWW>(lParam);
+                        if (tv->action & TVE_COLLAPSE) file_tree_.on_item_collapsed(tv->itemNew.hItem);
                     } else if (hdr->code == TVN_BEGINDRAGW || hdr->code == TVN_BEGINDRAGA) {
                         // Start drag operation in the file tree
                         LPNMTREEVIEWW tv = reinterpret_cast<LPNMTREEVIEWW>(lParam);
@@ -785,20 +1417,40 @@ private:
                 break;
             }
                 
-            case WM_CHAR:
+            case WM_CHAR: {
+                note_first_input();
+                if (tab_loading_) return 0;
+                EditSnapshot before = snapshot_edit_state();
                 on_char(static_cast<wchar_t>(wParam));
                 is_modified_ = true;
                 update_title();
-                InvalidateRect(hwnd_, nullptr, FALSE);
+                invalidate_after_edit(before);
                 return 0;
+            }
                 
-            case WM_KEYDOWN:
+            case WM_KEYDOWN: {
+                note_first_input();
+                // Plain editing and navigation keys damage the lines they touch;
+                // anything else may toggle panels or switch documents
+                bool ctrl = (GetKeyState(VK_CONTROL) & 0x8000) != 0;
+                bool local = !ctrl && (wParam == VK_LEFT || wParam == VK_RIGHT || wParam == VK_UP ||
+                                       wParam == VK_DOWN || wParam == VK_HOME || wParam == VK_END ||
+                                       wParam == VK_PRIOR || wParam == VK_NEXT || wParam == VK_BACK ||
+                                       wParam == VK_DELETE || wParam == VK_RETURN);
+                if (tab_loading_ && local) return 0;
+                EditSnapshot before = snapshot_edit_state();
                 on_key_down(wParam);
-                InvalidateRect(hwnd_, nullptr, FALSE);
+                if (local) {
+                    invalidate_after_edit(before);
+                } else {
+                    invalidate_all();
+                }
                 return 0;
+            }
                 
             case WM_LBUTTONDOWN: {
                 int mx = LOWORD(lParam), my = HIWORD(lParam);
+                undo_manager_->break_group();   // Typing after a click is a new undo step
                 int tabs_top = 10;
                 int tabs_bottom = tabs_top + (show_tabs_ ? tab_bar_height_ : 0);
                 
@@ -828,7 +1480,7 @@ private:
                 if (split_mode_ != SplitMode::None) {
                     int pane = get_pane_at_point(mx, my);
                     if (pane != active_pane_) {
-                        active_pane_ = pane;
+                        activate_pane(pane);
                         InvalidateRect(hwnd_, nullptr, FALSE);
                     }
                 }
@@ -931,8 +1583,9 @@ private:
                 }
                 if (wParam & MK_LBUTTON) {
                     // Dragging to select
+                    EditSnapshot before = snapshot_edit_state();
                     on_mouse_drag(LOWORD(lParam), HIWORD(lParam));
-                    InvalidateRect(hwnd_, nullptr, FALSE);
+                    invalidate_after_edit(before);
                 } else {
                     // Track hover for LSP tooltips
                     POINT mouse_pos = {LOWORD(lParam), HIWORD(lParam)};
@@ -942,6 +1595,10 @@ private:
                         last_hover_pos_ = mouse_pos;
                         hover_start_time_ = std::chrono::steady_clock::now();
                         hover_tooltip_shown_ = false;
+                        // The answer for the old position would only be thrown away
+                        LSPClient* lsp = hover_requested_ ? active_lsp(false) : nullptr;
+                        if (lsp) lsp->cancel_request(LSPClient::RequestKind::Hover);
+                        hover_requested_ = false;
                         if (hover_tooltip_) {
                             SendMessageW(hover_tooltip_, TTM_POP, 0, 0);  // Hide existing tooltip
                         }
@@ -953,6 +1610,19 @@ private:
                 // Scroll tabs when mouse is over the tab bar
                 POINT p{ GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam) };
                 ScreenToClient(hwnd_, &p);
+                RECT wheel_client;
+                GetClientRect(hwnd_, &wheel_client);
+                if (show_project_search_ && p.y >= wheel_client.bottom - results_panel_height_) {
+                    // The results list: rows move, the list reads the new ones on paint
+                    size_t step = 3;
+                    if (GET_WHEEL_DELTA_WPARAM(wParam) > 0) {
+                        project_results_top_ = project_results_top_ > step ? project_results_top_ - step : 0;
+                    } else {
+                        project_results_top_ += step;
+                    }
+                    InvalidateRect(hwnd_, nullptr, FALSE);
+                    return 0;
+                }
                 int tabs_top = 10;
                 int tabs_bottom = tabs_top + (show_tabs_ ? tab_bar_height_ : 0);
                 if (show_tabs_ && p.y >= tabs_top && p.y <= tabs_bottom) {
@@ -962,19 +1632,35 @@ private:
                     InvalidateRect(hwnd_, nullptr, FALSE);
                     return 0;
                 }
+                size_t old_top = viewport_.get_top_line();
                 on_mouse_wheel(GET_WHEEL_DELTA_WPARAM(wParam));
-                InvalidateRect(hwnd_, nullptr, FALSE);
+                if (split_mode_ == SplitMode::None) {
+                    scroll_text(old_top);
+                } else {
+                    invalidate_all();
+                }
                 return 0;
             }
                 
             case WM_TIMER:
+                if (wParam == 7) {
+                    step_startup();
+                    return 0;
+                }
                 if (wParam == 1) {
                     // Cursor blink timer
                     cursor_visible_ = !cursor_visible_;
                     cursor_blink_time_++;
+                    // The HUD catches up at blink pace: slower than kIdleGap,
+                    // so its own repaints never count as busy frames
+                    if (show_perf_hud_) {
+                        RECT client_rect;
+                        GetClientRect(hwnd_, &client_rect);
+                        invalidate_rect(perf_hud_rect(client_rect));
+                    }
                     
                     // Check for hover tooltip (show after 500ms of hovering)
-                    if (!hover_tooltip_shown_ && lsp_client_ && !current_file_.empty()) {
+                    if (!hover_tooltip_shown_ && !hover_requested_ && !current_file_.empty()) {
                         auto now = std::chrono::steady_clock::now();
                         auto hover_duration = std::chrono::duration_cast<std::chrono::milliseconds>(now - hover_start_time_).count();
                         
@@ -990,59 +1676,111 @@ private:
                             int text_x_offset = content_left + (show_line_numbers_ ? 70 : 0);
                             
                             if (mx >= text_x_offset && my >= content_top) {
-                                size_t line_idx = viewport_.get_top_line() + (my - content_top) / char_height_;
-                                size_t col_idx = (mx - text_x_offset) / char_width_;
+                                size_t line_idx = 0;
+                                size_t col_idx = 0;
+                                hit_test(mx - text_x_offset, my - content_top, line_idx, col_idx);
                                 
-                                lsp_client_->request_hover(
-                                    "file:///" + current_file_,
-                                    (int)line_idx,
-                                    (int)col_idx,
-                                    [this, screen_pt](const LSPClient::Hover& hover) {
-                                        if (!hover.contents.empty() && hover_tooltip_) {
-                                            // Show tooltip
-                                            hover_text_ = hover.contents;
+                                flush_lsp_changes();
+                                hover_requested_ = true;    // Once per resting position
+                                if (LSPClient* lsp = active_lsp()) {
+                                    lsp->request_hover(
+                                        "file:///" + current_file_,
+                                        (int)line_idx,
+                                        (int)col_idx,
+                                        [this, screen_pt](const LSPClient::Hover& hover) {
+                                            if (!hover.contents.empty() && hover_tooltip_) {
+                                                // Show tooltip
+                                                hover_text_ = hover.contents;
                                             
-                                            // Convert to wide string for tooltip
-                                            std::wstring wide_text;
-                                            for (char c : hover.contents) {
-                                                wide_text += (wchar_t)c;
-                                            }
+                                                // Convert to wide string for tooltip
+                                                std::wstring wide_text;
+                                                for (char c : hover.contents) {
+                                                    wide_text += (wchar_t)c;
+                                                }
                                             
-                                            TOOLINFOW ti = {};
-                                            ti.cbSize = sizeof(TOOLINFOW);
-                                            ti.uFlags = TTF_TRACK | TTF_ABSOLUTE;
-                                            ti.hwnd = hwnd_;
-                                            ti.lpszText = const_cast<wchar_t*>(wide_text.c_str());
+                                                TOOLINFOW ti = {};
+                                                ti.cbSize = sizeof(TOOLINFOW);
+                                                ti.uFlags = TTF_TRACK | TTF_ABSOLUTE;
+                                                ti.hwnd = hwnd_;
+                                                ti.lpszText = const_cast<wchar_t*>(wide_text.c_str());
                                             
-                                            SendMessageW(hover_tooltip_, TTM_ADDTOOLW, 0, (LPARAM)&ti);
-                                            SendMessageW(hover_tooltip_, TTM_TRACKACTIVATE, TRUE, (LPARAM)&ti);
+                                                SendMessageW(hover_tooltip_, TTM_ADDTOOLW, 0, (LPARAM)&ti);
+                                                SendMessageW(hover_tooltip_, TTM_TRACKACTIVATE, TRUE, (LPARAM)&ti);
                                             
-                                            POINT client_pt = screen_pt;
-                                            ClientToScreen(hwnd_, &client_pt);
-                                            SendMessageW(hover_tooltip_, TTM_TRACKPOSITION, 0, MAKELPARAM(client_pt.x, client_pt.y + 20));
+                                                POINT client_pt = screen_pt;
+                                                ClientToScreen(hwnd_, &client_pt);
+                                                SendMessageW(hover_tooltip_, TTM_TRACKPOSITION, 0, MAKELPARAM(client_pt.x, client_pt.y + 20));
                                             
-                                            hover_tooltip_shown_ = true;
+                                                hover_tooltip_shown_ = true;
+                                            }
                                         }
-                                    }
-                                );
+                                    );
+                                }
                             }
                         }
                     }
                     
-                    // Only invalidate the cursor area, not the whole window
-                    RECT cursor_rect;
-                    GetClientRect(hwnd_, &cursor_rect);
-                    cursor_rect.left = get_content_left();
-                    cursor_rect.right = cursor_rect.right - 230;
-                    InvalidateRect(hwnd_, &cursor_rect, FALSE);
+                    // Only the caret cell blinks
+                    invalidate_caret();
                 }
                 else if (wParam == 2) {
+                    // Merge background line index chunks; line count and scrollbar refine as it goes
+                    if (document_ && document_->is_indexing() && document_->poll_line_index()) {
+                        InvalidateRect(hwnd_, nullptr, FALSE);
+                    }
+                    poll_follow();
                     // FPS update timer - only update stats area
                     if (show_stats_) {
                         RECT stats_rect;
                         GetClientRect(hwnd_, &stats_rect);
-                        stats_rect.left = stats_rect.right - 220;
-                        InvalidateRect(hwnd_, &stats_rect, FALSE);
+                        invalidate_rect({ stats_rect.right - 220, 10, stats_rect.right - 10, 180 });
+                    }
+                }
+                else if (wParam == 3) {
+                    // Background highlighter finished some lines
+                    bool ready = highlight_cache_->poll();
+                    for (SplitPane* pane : {&pane1_, &pane2_}) {
+                        if (pane->highlight && pane->highlight->poll()) ready = true;
+                    }
+                    // Search-as-you-type continues a slice per frame; edits queue rescans too
+                    if (!find_text_.empty()) {
+                        search_session_->set_document(document_);   // Restarts after a tab switch
+                        search_session_->step();
+                        if (publish_search_matches()) ready = true;
+                    }
+                    // New colors and match marks only change the text area
+                    if (ready) {
+                        invalidate_rect(text_area_rect());
+                        invalidate_panels(false);
+                    }
+                    // Responses and diagnostics the LSP reader decoded since the last tick
+                    // (and restarts crashed servers, retires idle ones)
+                    if (lsp_servers_) lsp_servers_->process_messages();
+                    // Typing paused (or went on long enough): send what changed
+                    if (lsp_sync_.due()) flush_lsp_changes();
+                    if (semantic_tokens_due_) request_semantic_tokens();
+                    // Gutter markers follow the shown document; a diff goes out
+                    // after edits and comes back a frame or so later
+                    if (diff_gutter_) {
+                        diff_gutter_->set_document(document_, current_file_);
+                        diff_gutter_->update();
+                        if (diff_gutter_->take_results()) invalidate_rect(text_area_rect());
+                    }
+                    // Blame is worked out once per file version in HEAD; edits remap it
+                    if (blame_cache_) {
+                        blame_cache_->set_document(show_blame_ ? document_ : nullptr, current_file_);
+                        blame_cache_->update();
+                        if (blame_cache_->take_results()) invalidate_rect(text_area_rect());
+                    }
+                    update_compare();
+                    // Minimap rows dirtied by edits are re-derived a slice per tick
+                    if (minimap_shown() && split_mode_ == SplitMode::None && document_) {
+                        sync_minimap_density();
+                        if (minimap_density_.update()) {
+                            RECT client_rect;
+                            GetClientRect(hwnd_, &client_rect);
+                            invalidate_rect(minimap_rect(client_rect));
+                        }
                     }
                 }
                 return 0;
@@ -1055,6 +1793,8 @@ private:
                     MoveWindow(tree_hwnd_, 10, treeTop, show_file_tree_ ? tree_panel_width_ : 0, cr.bottom - treeTop - 10, TRUE);
                     ShowWindow(tree_hwnd_, show_file_tree_ ? SW_SHOW : SW_HIDE);
                 }
+                update_viewport_size();
+                if (show_terminal_) resize_terminal_to_panel();
                 InvalidateRect(hwnd_, nullptr, FALSE);
                 return 0;
                 
@@ -1066,7 +1806,7 @@ private:
                         MB_YESNOCANCEL | MB_ICONQUESTION);
                     
                     if (result == IDYES) {
-                        if (!save_file()) {
+                        if (!save_file(true)) {
                             return 0; // Cancel close if save failed
                         }
                     } else if (result == IDCANCEL) {
@@ -1075,10 +1815,111 @@ private:
                 }
                 // Save workspace state before closing
                 save_workspace_state();
+                while (!journals_.empty()) end_journal(journals_.begin()->first);
                 DestroyWindow(hwnd_);
                 return 0;
                 
+            case WM_STARTUP_STEP:
+                step_startup();
+                return 0;
+                
+            case WM_UI_TASKS:
+                ui_tasks_.drain();
+                return 0;
+                
+            case WM_MEMORY_PRESSURE:
+                if (size_t freed = memory_pressure_.poll()) {
+                    std::cout << "Memory pressure (" << editor::MemoryPressureMonitor::level_name(memory_pressure_.level())
+                              << "): shed " << editor::MemoryReport::format_bytes(freed) << "\n";
+                    InvalidateRect(hwnd_, nullptr, FALSE);
+                }
+                return 0;
+                
+            case WM_TAB_RELOADED: {
+                if (!tab_manager_) return 0;
+                tab_manager_->complete_reloads();
+                if (!tab_loading_) return 0;
+                auto* tab = tab_manager_->get_active_tab();
+                if (tab && !tab->is_hibernated()) {
+                    show_active_tab();
+                } else if (tab && !tab->is_reloading()) {
+                    show_status_message(L"Could not reload " + std::wstring(tab->display_name.begin(), tab->display_name.end()), 4000);
+                }
+                return 0;
+            }
+                
+            case WM_SAVE_DONE: {
+                std::unique_ptr<std::string> path(reinterpret_cast<std::string*>(lParam));
+                if (!wParam) {
+                    MessageBoxW(hwnd_, L"Failed to save file", L"Error", MB_OK | MB_ICONERROR);
+                    if (*path == current_file_) is_modified_ = true;
+                    update_title();
+                    return 0;
+                }
+                // Notify LSP of saved document
+                if (*path == current_file_) {
+                    if (LSPClient* lsp = active_lsp()) {
+                        flush_lsp_changes();
+                        lsp->did_save("file:///" + current_file_);
+                    }
+                }
+                return 0;
+            }
+                
+            case WM_FILES_CHANGED: {
+                std::unique_ptr<std::vector<editor::FileChange>> changes(
+                    reinterpret_cast<std::vector<editor::FileChange>*>(lParam));
+                file_tree_.apply_changes(*changes);
+                // Commit or checkout: the gutter's HEAD blobs may be others now
+                if (git_manager_->apply_file_changes(*changes)) {
+                    if (diff_gutter_) diff_gutter_->invalidate_base();
+                    if (blame_cache_) blame_cache_->invalidate_base();
+                }
+                InvalidateRect(hwnd_, nullptr, FALSE);
+                return 0;
+            }
+                
+            case WM_GIT_STATUS:
+                if (git_manager_->take_status_results()) InvalidateRect(hwnd_, nullptr, FALSE);
+                return 0;
+                
+            case WM_TERMINAL_OUTPUT:
+                // Parsed here, drawn with the next paint
+                if (terminal_->update() && show_terminal_) {
+                    RECT cr{}; GetClientRect(hwnd_, &cr);
+                    RECT term_rect = { 0, cr.bottom - terminal_panel_height_, cr.right, cr.bottom };
+                    InvalidateRect(hwnd_, &term_rect, FALSE);
+                }
+                return 0;
+                
+            case WM_RENDERFORMAT:
+                // Another application pastes: the clipboard is open for us
+                if (wParam == CF_UNICODETEXT) render_clipboard_text();
+                return 0;
+                
+            case WM_RENDERALLFORMATS:
+                // Closing while we still own the clipboard: render it now
+                if (OpenClipboard(hwnd_)) {
+                    if (GetClipboardOwner() == hwnd_) render_clipboard_text();
+                    CloseClipboard();
+                }
+                return 0;
+                
+            case WM_DESTROYCLIPBOARD:
+                // Someone else's text now; drop the pieces (and the buffers they keep)
+                clipboard_.clear();
+                return 0;
+                
             case WM_DESTROY:
+                // Background startup work writes into members; it ends first
+                startup_.reset();
+                compare_cancel_.cancel();
+                transform_cancel_.cancel();
+                ui_work_.wait();
+                if (file_watcher_) file_watcher_->stop();
+                memory_pressure_.stop();
+                release_back_buffer();
+                release_line_cache();
                 DeleteObject(hFont_);
                 PostQuitMessage(0);
                 return 0;
@@ -1088,21 +1929,36 @@ private:
     }
     
     void on_paint() {
-        PAINTSTRUCT ps;
-        HDC hdc = BeginPaint(hwnd_, &ps);
-        
-        // Set up double buffering
+        EDITOR_TRACE_SCOPE("ui", "WM_PAINT");
+        auto paint_start = editor::FrameStats::Clock::now();
         RECT client_rect;
         GetClientRect(hwnd_, &client_rect);
         
-        HDC memDC = CreateCompatibleDC(hdc);
-        HBITMAP memBitmap = CreateCompatibleBitmap(hdc, client_rect.right, client_rect.bottom);
-        HBITMAP oldBitmap = (HBITMAP)SelectObject(memDC, memBitmap);
+        // Invalidations that bypassed the tracker (window uncovered, plain
+        // InvalidateRect calls) are redrawn as well
+        adopt_untracked_damage(client_rect);
+        
+        PAINTSTRUCT ps;
+        HDC hdc = BeginPaint(hwnd_, &ps);
+        
+        // Double buffering with a persistent back buffer: pixels outside the
+        // damage are still right from the last paint. Scrolls move them
+        // first; everything below is clipped to what must be redrawn.
+        HDC memDC = ensure_back_buffer(hdc, client_rect);
+        ensure_line_cache(hdc, client_rect);
+        for (const auto& scroll : damage_.scrolls()) {
+            RECT area{ scroll.area.left, scroll.area.top, scroll.area.right, scroll.area.bottom };
+            ScrollDC(memDC, 0, scroll.dy, &area, &area, nullptr, nullptr);
+        }
+        HRGN damage_region = create_damage_region(client_rect, false);
+        SelectClipRgn(memDC, damage_region);
         
+        // Brushes, pens and fonts are kept across frames; a theme change drops them
+        gdi_.begin_frame(*theme_);
+
         // Clear background
-        HBRUSH bgBrush = CreateSolidBrush(theme_->get_colors().background);
+        HBRUSH bgBrush = gdi_.brush(theme_->get_colors().background);
         FillRect(memDC, &client_rect, bgBrush);
-        DeleteObject(bgBrush);
         
         // Set text rendering mode for smoother text
         SetBkMode(memDC, TRANSPARENT);
@@ -1119,6 +1975,9 @@ private:
             RECT pane2_rect = get_pane_rect(1);
             RECT splitter_rect = get_splitter_rect();
             
+            // The active pane's caret lives in the editor's state until now
+            store_active_pane();
+            
             // Render pane 1
             render_pane(memDC, pane1_rect, pane1_, active_pane_ == 0);
             
@@ -1126,12 +1985,11 @@ private:
             render_pane(memDC, pane2_rect, pane2_, active_pane_ == 1);
             
             // Render splitter
-            HBRUSH splitterBrush = CreateSolidBrush(RGB(60, 60, 70));
+            HBRUSH splitterBrush = gdi_.brush(RGB(60, 60, 70));
             FillRect(memDC, &splitter_rect, splitterBrush);
-            DeleteObject(splitterBrush);
             
             // Splitter drag handle indicator
-            HPEN splitterPen = CreatePen(PS_SOLID, 1, RGB(100, 100, 120));
+            HPEN splitterPen = gdi_.pen(RGB(100, 100, 120));
             HPEN oldPen = (HPEN)SelectObject(memDC, splitterPen);
             if (split_mode_ == SplitMode::Horizontal) {
                 int mid_x = (splitter_rect.left + splitter_rect.right) / 2;
@@ -1143,124 +2001,108 @@ private:
                 LineTo(memDC, splitter_rect.left + 1, mid_y + 15);
             }
             SelectObject(memDC, oldPen);
-            DeleteObject(splitterPen);
         } else {
             // Original single-view rendering
         // Render text lines
-        auto visible_lines = viewport_.get_visible_lines();
+        update_viewport_size();
+        auto visible_rows = viewport_.get_visible_rows();
         int y = get_content_top();
         size_t line_num = viewport_.get_top_line();
         size_t current_line = get_cursor_line();
         RECT client_rect_copy = client_rect;
         int base_left = get_content_left();
+        // The bracket at the caret and its partner get a box
+        BracketIndex::Pair bracket_pair;
+        bool has_bracket_pair = find_caret_bracket_pair(bracket_pair);
         
-        // Prepare incremental highlighter state up to top visible line
-        SyntaxHighlighter::LineState hl_state_pre{};
-        for (size_t li = 0; li < line_num; ++li) {
-            SyntaxHighlighter::LineState out{};
-            highlighter_->tokenize_line(document_->get_line(li), hl_state_pre, out);
-            hl_state_pre = out;
-        }
-        // Feed document to highlighter for TS (if enabled)
-        if (highlighter_) {
-            std::vector<std::string> all;
-            all.reserve(document_->get_line_count());
-            for (size_t i = 0; i < document_->get_line_count(); ++i) all.push_back(document_->get_line(i));
-            highlighter_->set_document_lines(all);
+        // Tokens come from the background highlighter; paint never tokenizes
+        {
+            editor::FrameStats::Timer timer(frame_stats_, editor::FrameStats::Metric::Highlight);
+            highlight_cache_->set_document(document_);
+            highlight_cache_->schedule(line_num, visible_rows.size());
+        }
+        if (folding_manager_ && large_file_.allows(editor::LargeFileFeature::Folding)) {
+            folding_manager_->set_document(document_);     // Follows tab switches
+            if (show_stats_) {
+                outline_->set_document(document_, SymbolTags::language_for_path(current_file_));
+            }
         }
+        auto text_start = editor::FrameStats::Clock::now();
 
-        for (const auto& line : visible_lines) {
-            // Skip folded lines
-            if (folding_manager_ && !folding_manager_->is_line_visible(line_num)) {
-                line_num++;
+        // The pane is recorded into one list and painted in a single pass
+        pane_draw_list_.clear();
+        // Folded lines are already left out; a wrapped line spans several rows
+        for (const ViewRow& view_row : visible_rows) {
+            const std::string& line = view_row.text;
+            line_num = view_row.line;
+            bool line_head = !viewport_.is_soft_wrap() || view_row.column == 0;   // Gets the number and fold box
+            
+            // Rows outside the damage keep the last paint's pixels
+            RECT row_rect{ base_left, y, client_rect_copy.right, y + char_height_ };
+            if (!RectVisible(memDC, &row_rect)) {
+                y += char_height_;
                 continue;
             }
             
             // Line number (gray) - only if enabled
             int text_x_offset = base_left; // Default offset when line numbers are hidden
             if (show_line_numbers_) {
-                // Prepare number string: relative or absolute
-                std::wstring line_num_str;
-                if (relative_line_numbers_) {
-                    if (line_num == current_line) {
-                        // Show absolute number for current line (like Vim)
-                        line_num_str = std::to_wstring(line_num + 1);
-                    } else {
-                        size_t diff = (line_num > current_line) ? (line_num - current_line) : (current_line - line_num);
-                        line_num_str = std::to_wstring(diff);
-                    }
-                } else {
-                    line_num_str = std::to_wstring(line_num + 1);
+                // Relative or absolute; the current line stays absolute (like Vim)
+                size_t shown = line_num + 1;
+                if (relative_line_numbers_ && line_num != current_line) {
+                    shown = (line_num > current_line) ? (line_num - current_line) : (current_line - line_num);
                 }
+                char number[24];
+                int digits = snprintf(number, sizeof(number), "%zu", shown);
 
                 // Draw gutter background
-                RECT gutter_rect{ base_left, y, base_left + 70, y + char_height_ };
-                HBRUSH gutterBrush = CreateSolidBrush(theme_->get_colors().gutter_background);
-                FillRect(memDC, &gutter_rect, gutterBrush);
-                DeleteObject(gutterBrush);
-
-                // Right-align numbers in gutter
-                SIZE num_sz{};
-                GetTextExtentPoint32W(memDC, line_num_str.c_str(), (int)line_num_str.length(), &num_sz);
+                pane_draw_list_.add_rect(base_left, y, 70, char_height_, to_argb(theme_->get_colors().gutter_background));
+
+                // Right-align numbers in gutter (fixed-pitch font)
                 int gutter_right = base_left + 70;
-                int num_x = gutter_right - num_sz.cx - 4; // small padding
-                SetTextColor(memDC, line_num == current_line ? 
-                    theme_->get_colors().line_number_active : theme_->get_colors().line_number);
-                TextOutW(memDC, num_x, y, line_num_str.c_str(), (int)line_num_str.length());
+                int num_x = gutter_right - digits * char_width_ - 4; // small padding
+                COLORREF number_color = line_num == current_line ?
+                    theme_->get_colors().line_number_active : theme_->get_colors().line_number;
+                if (line_head) {
+                    pane_draw_list_.add_text(std::string_view(number, digits), num_x, y, to_argb(number_color), char_width_);
+                }
                 
                 // Draw fold control if region exists at this line
-                if (folding_manager_) {
+                if (folding_manager_ && line_head) {
                     const auto* region = folding_manager_->get_region_at_line(line_num);
                     if (region && region->line_count() > 1) {
-                        // Draw fold indicator (triangle or +/-)
+                        // Draw fold indicator (+/-)
                         int fold_x = base_left + 4;
                         int fold_y = y + char_height_ / 2;
                         int fold_size = 6;
+                        uint32_t fold_color = to_argb(RGB(150, 150, 160));
                         
-                        HPEN foldPen = CreatePen(PS_SOLID, 1, RGB(150, 150, 160));
-                        HPEN oldPen = (HPEN)SelectObject(memDC, foldPen);
-                        
+                        pane_draw_list_.add_line(fold_x, fold_y, fold_x + fold_size - 1, fold_y, fold_color);
                         if (region->is_folded) {
-                            // Draw + sign (folded)
-                            MoveToEx(memDC, fold_x, fold_y, nullptr);
-                            LineTo(memDC, fold_x + fold_size, fold_y);
-                            MoveToEx(memDC, fold_x + fold_size/2, fold_y - fold_size/2, nullptr);
-                            LineTo(memDC, fold_x + fold_size/2, fold_y + fold_size/2);
-                        } else {
-                            // Draw - sign (expanded)
-                            MoveToEx(memDC, fold_x, fold_y, nullptr);
-                            LineTo(memDC, fold_x + fold_size, fold_y);
+                            // Vertical bar makes the + (folded)
+                            pane_draw_list_.add_line(fold_x + fold_size/2, fold_y - fold_size/2,
+                                                     fold_x + fold_size/2, fold_y + fold_size/2 - 1, fold_color);
                         }
-                        
-                        SelectObject(memDC, oldPen);
-                        DeleteObject(foldPen);
                     }
                 }
                 
                 // Draw git diff indicators in gutter
-                if (git_manager_ && git_manager_->is_git_repository() && !current_file_.empty()) {
-                    auto diff_hunks = git_manager_->get_file_diff(current_file_);
-                    for (const auto& hunk : diff_hunks) {
-                        if (line_num >= hunk.start_line && line_num < hunk.start_line + hunk.line_count) {
-                            // Draw colored bar on left edge of gutter
-                            COLORREF bar_color;
-                            switch (hunk.type) {
-                                case GitDiffHunk::Type::Added:
-                                    bar_color = RGB(100, 255, 100); // Green
-                                    break;
-                                case GitDiffHunk::Type::Modified:
-                                    bar_color = RGB(255, 200, 0); // Yellow
-                                    break;
-                                case GitDiffHunk::Type::Deleted:
-                                    bar_color = RGB(255, 100, 100); // Red
-                                    break;
-                            }
-                            RECT bar_rect{ base_left, y, base_left + 3, y + char_height_ };
-                            HBRUSH barBrush = CreateSolidBrush(bar_color);
-                            FillRect(memDC, &bar_rect, barBrush);
-                            DeleteObject(barBrush);
-                            break; // Only draw one indicator per line
+                if (diff_gutter_) {
+                    if (const GitDiffHunk* hunk = diff_gutter_->hunk_at(line_num)) {
+                        // Draw colored bar on left edge of gutter
+                        COLORREF bar_color;
+                        switch (hunk->type) {
+                            case GitDiffHunk::Type::Added:
+                                bar_color = RGB(100, 255, 100); // Green
+                                break;
+                            case GitDiffHunk::Type::Modified:
+                                bar_color = RGB(255, 200, 0); // Yellow
+                                break;
+                            case GitDiffHunk::Type::Deleted:
+                                bar_color = RGB(255, 100, 100); // Red
+                                break;
                         }
+                        pane_draw_list_.add_rect(base_left, y, 3, char_height_, to_argb(bar_color));
                     }
                 }
                 
@@ -1269,123 +2111,77 @@ private:
             
             // Current line highlighting (draw before text)
             if (line_num == current_line) {
-                RECT hl_rect{
-                    text_x_offset,
-                    y,
-                    client_rect_copy.right - (show_stats_ ? 230 : 10),
-                    y + char_height_
-                };
-                HBRUSH hlBrush = CreateSolidBrush(RGB(45, 45, 60));
-                FillRect(memDC, &hl_rect, hlBrush);
-                DeleteObject(hlBrush);
+                int hl_right = client_rect_copy.right - (show_stats_ ? 230 : 10);
+                pane_draw_list_.add_rect(text_x_offset, y, hl_right - text_x_offset, char_height_, to_argb(RGB(45, 45, 60)));
             }
 
             // Calculate line position in document
-            size_t line_start_pos = 0;
-            for (size_t i = 0; i < line_num; ++i) {
-                line_start_pos += document_->get_line(i).length() + 1;
-            }
+            size_t line_start_pos = document_->get_line_start(line_num) + view_row.column;
             
-            // Tokenize line for syntax highlighting (incremental state)
-            if (highlighter_) highlighter_->set_current_line_index(line_num);
-            SyntaxHighlighter::LineState hl_state_out{};
-            auto tokens = highlighter_->tokenize_line(line, hl_state_pre, hl_state_out);
-            hl_state_pre = hl_state_out;
-            
-            // Convert to wide string and render with selection highlighting and syntax colors
-            std::wstring wline;
-            for (size_t i = 0; i < line.length(); ++i) {
-                size_t char_pos = line_start_pos + i;
-                
-                // Check if character is in selection
-                if (has_selection_ && char_pos >= get_selection_start() && char_pos < get_selection_end()) {
-                    // Draw selection background
-                    RECT sel_rect = {
-                        static_cast<LONG>(text_x_offset + i * char_width_),
-                        y,
-                        static_cast<LONG>(text_x_offset + (i + 1) * char_width_),
-                        y + char_height_
-                    };
-                    HBRUSH selBrush = CreateSolidBrush(RGB(60, 60, 120));
-                    FillRect(memDC, &sel_rect, selBrush);
-                    DeleteObject(selBrush);
-                }
-                
-                wline += static_cast<wchar_t>(line[i]);
+            // Selection background: one rect for the selected columns of this line
+            bool plain_background = line_num != current_line;
+            const auto& line_map = viewport_.column_layout().line(line_num);
+            if (has_selection_ && add_selection_rect(line_map, view_row.column, line_start_pos, line.length(),
+                                                     get_selection_start(), get_selection_end(), text_x_offset, y)) {
+                plain_background = false;
             }
-            
-            // Render line with syntax highlighting
-            size_t last_pos = 0;
-            for (const auto& token : tokens) {
-                // Render any normal text before this token
-                if (token.start > last_pos) {
-                    SetTextColor(memDC, RGB(220, 220, 220));
-                    std::wstring segment = wline.substr(last_pos, token.start - last_pos);
-                    TextOutW(memDC, text_x_offset + last_pos * char_width_, y, segment.c_str(), segment.length());
+            if (has_bracket_pair) {
+                for (auto [bracket_line, bracket_column] : { std::make_pair(bracket_pair.open_line, bracket_pair.open_column),
+                                                             std::make_pair(bracket_pair.close_line, bracket_pair.close_column) }) {
+                    if (bracket_line != line_num || bracket_column < view_row.column ||
+                        bracket_column >= view_row.column + line.length()) {
+                        continue;
+                    }
+                    int bracket_x = text_x_offset + column_x(viewport_, line_num, view_row.column, bracket_column);
+                    pane_draw_list_.add_rect(bracket_x, y, char_width_, char_height_, to_argb(RGB(70, 70, 100)));
+                    plain_background = false;
                 }
-                
-                // Render token with appropriate color
-                SetTextColor(memDC, token.get_color());
-                std::wstring segment = wline.substr(token.start, token.length);
-                TextOutW(memDC, text_x_offset + token.start * char_width_, y, segment.c_str(), segment.length());
-                
-                last_pos = token.start + token.length;
             }
             
-            // Render any remaining text
-            if (last_pos < wline.length()) {
-                SetTextColor(memDC, RGB(220, 220, 220));
-                std::wstring segment = wline.substr(last_pos);
-                TextOutW(memDC, text_x_offset + last_pos * char_width_, y, segment.c_str(), segment.length());
+            // Syntax tokens for this line (with the server's semantic tokens
+            // over them) - empty (plain text) until the worker has it
+            const auto& tokens = highlight_cache_->get_display_tokens(line_num);
+            add_line_run(line, tokens, text_x_offset, y, plain_background, viewport_.column_layout(), line_num,
+                         view_row.column);
+            
+            // Blame after the line's text; only the painted rows are looked up
+            if (show_blame_ && blame_cache_ && view_row.column == 0) {
+                if (const auto* commit = blame_cache_->commit_at(line_num)) {
+                    int blame_x = text_x_offset + column_x(viewport_, line_num, 0, line.length()) + 4 * char_width_;
+                    pane_draw_list_.add_text(commit->label, blame_x, y, to_argb(RGB(110, 110, 130)), char_width_);
+                }
             }
             
             // Draw cursor if on this line
             if (cursor_visible_ && line_num == get_cursor_line()) {
                 size_t cursor_col = get_cursor_column();
-                if (cursor_col <= line.length()) {
-                    HPEN cursorPen = CreatePen(PS_SOLID, 2, RGB(255, 255, 0));
-                    HPEN oldPen = (HPEN)SelectObject(memDC, cursorPen);
-                    
-                    int cursor_x = text_x_offset + cursor_col * char_width_;
-                    MoveToEx(memDC, cursor_x, y, nullptr);
-                    LineTo(memDC, cursor_x, y + char_height_);
-                    
-                    SelectObject(memDC, oldPen);
-                    DeleteObject(cursorPen);
+                // At a wrap point the caret belongs to the next row
+                size_t row_end = view_row.column + line.length();
+                if (cursor_col >= view_row.column && (cursor_col < row_end || (cursor_col == row_end && !view_row.continues))) {
+                    int cursor_x = text_x_offset + column_x(viewport_, line_num, view_row.column, cursor_col);
+                    pane_draw_list_.add_rect(cursor_x - 1, y, 2, char_height_, to_argb(RGB(255, 255, 0)));
                 }
             }
             
             // Draw extra cursors if in multi-cursor mode
             if (cursor_visible_ && multi_cursor_mode_) {
+                size_t line_end = line_start_pos + line.length();
                 for (size_t extra_pos : extra_cursors_) {
                     // Skip if it's the main cursor position
                     if (extra_pos == cursor_pos_) continue;
                     
-                    // Check if this extra cursor is on current line
-                    size_t pos_counter = 0;
-                    for (size_t i = 0; i < line_num; ++i) {
-                        pos_counter += document_->get_line(i).length() + 1;
-                    }
-                    size_t line_end = pos_counter + line.length();
-                    
-                    if (extra_pos >= pos_counter && extra_pos <= line_end) {
-                        size_t col = extra_pos - pos_counter;
-                        HPEN extraCursorPen = CreatePen(PS_SOLID, 2, RGB(200, 200, 255));
-                        HPEN oldPen = (HPEN)SelectObject(memDC, extraCursorPen);
-                        
-                        int cursor_x = text_x_offset + col * char_width_;
-                        MoveToEx(memDC, cursor_x, y, nullptr);
-                        LineTo(memDC, cursor_x, y + char_height_);
-                        
-                        SelectObject(memDC, oldPen);
-                        DeleteObject(extraCursorPen);
+                    if (extra_pos >= line_start_pos && extra_pos <= line_end) {
+                        int cursor_x = text_x_offset + column_x(viewport_, line_num, view_row.column,
+                                                                view_row.column + (extra_pos - line_start_pos));
+                        pane_draw_list_.add_rect(cursor_x - 1, y, 2, char_height_, to_argb(RGB(200, 200, 255)));
                     }
                 }
             }
             
             y += char_height_;
-            line_num++;
         }
+        paint_draw_list(memDC, pane_draw_list_);
+        frame_stats_.record(editor::FrameStats::Metric::TextDraw, editor::FrameStats::Clock::now() - text_start);
 
         // Render diagnostics (error squiggles)
         if (!current_diagnostics_.empty()) {
@@ -1395,20 +2191,22 @@ private:
             int visible_lines = content_height / char_height_;
             for (const auto& diag : current_diagnostics_) {
                 size_t line_idx = diag.range.start.line;
-                if (line_idx >= viewport_.get_top_line() && line_idx < viewport_.get_top_line() + visible_lines) {
+                size_t diag_row = viewport_.row_of_line(line_idx);
+                bool diag_shown = !folding_manager_ || folding_manager_->is_line_visible(line_idx);
+                if (diag_shown && diag_row < (size_t)visible_lines) {
                     std::string line = document_->get_line(line_idx);
                     int text_x_offset = base_left + (show_line_numbers_ ? 70 : 0);
-                    int diag_y = get_content_top() + (int)(line_idx - viewport_.get_top_line()) * char_height_ + char_height_ - 2;
+                    int diag_y = get_content_top() + (int)diag_row * char_height_ + char_height_ - 2;
                     
                     size_t start_col = diag.range.start.character;
                     size_t end_col = (diag.range.end.line == line_idx) ? diag.range.end.character : line.length();
                     
                     // Draw red squiggle
-                    HPEN squiggle_pen = CreatePen(PS_SOLID, 1, RGB(255, 0, 0));
+                    HPEN squiggle_pen = gdi_.pen(RGB(255, 0, 0));
                     HPEN old_pen = (HPEN)SelectObject(memDC, squiggle_pen);
                     
-                    int x_start = text_x_offset + start_col * char_width_;
-                    int x_end = text_x_offset + end_col * char_width_;
+                    int x_start = text_x_offset + column_x(viewport_, line_idx, 0, start_col);
+                    int x_end = text_x_offset + column_x(viewport_, line_idx, 0, end_col);
                     
                     // Draw wavy underline
                     for (int x = x_start; x < x_end; x += 4) {
@@ -1418,7 +2216,6 @@ private:
                     }
                     
                     SelectObject(memDC, old_pen);
-                    DeleteObject(squiggle_pen);
                 }
             }
         }
@@ -1428,23 +2225,23 @@ private:
             size_t caret_line = get_cursor_line();
             size_t caret_col = get_cursor_column();
             int text_x_offset = base_left + (show_line_numbers_ ? 70 : 0);
-            int caret_x = text_x_offset + (int)caret_col * char_width_;
-            int caret_y = get_content_top() + (int)(caret_line - viewport_.get_top_line()) * char_height_ + char_height_;
+            int caret_x = text_x_offset + column_x(viewport_, caret_line, 0, caret_col);
+            int caret_y = get_content_top() + (int)viewport_.row_of_line(caret_line) * char_height_ + char_height_;
 
             int item_h = char_height_;
             int width = 240;
             int height = (int)std::min<size_t>(autocomplete_items_.size(), 8) * item_h + 4;
             RECT popup{ caret_x, caret_y, caret_x + width, caret_y + height };
-            HBRUSH bg = CreateSolidBrush(RGB(35, 35, 45));
-            FillRect(memDC, &popup, bg); DeleteObject(bg);
+            HBRUSH bg = gdi_.brush(RGB(35, 35, 45));
+            FillRect(memDC, &popup, bg);
             FrameRect(memDC, &popup, (HBRUSH)GetStockObject(GRAY_BRUSH));
 
             int y0 = popup.top + 2;
             for (size_t i = 0; i < autocomplete_items_.size() && i < 8; ++i) {
                 RECT item{ popup.left + 4, y0 + (int)i * item_h, popup.right - 4, y0 + (int)(i + 1) * item_h };
                 if ((int)i == autocomplete_index_) {
-                    HBRUSH sel = CreateSolidBrush(RGB(60, 60, 90));
-                    FillRect(memDC, &item, sel); DeleteObject(sel);
+                    HBRUSH sel = gdi_.brush(RGB(60, 60, 90));
+                    FillRect(memDC, &item, sel);
                 }
                 std::wstring w; for (char c : autocomplete_items_[i]) w += (wchar_t)c;
                 SetTextColor(memDC, RGB(220, 220, 220));
@@ -1459,12 +2256,14 @@ private:
         }
         
         // Render minimap
-        if (minimap_ && minimap_->is_visible() && split_mode_ == SplitMode::None) {
+        if (minimap_shown() && split_mode_ == SplitMode::None) {
+            editor::FrameStats::Timer timer(frame_stats_, editor::FrameStats::Metric::Minimap);
             render_minimap(memDC, client_rect);
         }
         
         // Render terminal panel
         if (show_terminal_) {
+            editor::FrameStats::Timer timer(frame_stats_, editor::FrameStats::Metric::Terminal);
             render_terminal(memDC, client_rect);
         }
         
@@ -1472,26 +2271,324 @@ private:
         if (show_stats_) {
             render_stats(memDC, client_rect);
         }
+        if (show_perf_hud_) {
+            render_perf_hud(memDC, client_rect);
+        }
         
-        // Copy to screen with one operation (no flickering)
-        BitBlt(hdc, 0, 0, client_rect.right, client_rect.bottom, memDC, 0, 0, SRCCOPY);
+        // Copy the invalidated part to screen with one operation (no flickering)
+        BitBlt(hdc, ps.rcPaint.left, ps.rcPaint.top, ps.rcPaint.right - ps.rcPaint.left,
+               ps.rcPaint.bottom - ps.rcPaint.top, memDC, ps.rcPaint.left, ps.rcPaint.top, SRCCOPY);
         
         // Cleanup
-        SelectObject(memDC, oldBitmap);
-        DeleteObject(memBitmap);
-        DeleteDC(memDC);
+        SelectClipRgn(memDC, nullptr);
+        DeleteObject(damage_region);
+        damage_.clear();
         
         EndPaint(hwnd_, &ps);
+        auto presented = editor::FrameStats::Clock::now();
+        frame_stats_.record(editor::FrameStats::Metric::Paint, presented - paint_start);
+        frame_stats_.frame_presented(presented);
+        
+        if (!first_frame_painted_) {
+            // The rest of startup begins once the document is on screen
+            first_frame_painted_ = true;
+            startup_timeline_->mark("first frame");
+            HWND hwnd = hwnd_;
+            if (startup_) {
+                startup_->start([hwnd] { PostMessageW(hwnd, WM_STARTUP_STEP, 0, 0); });
+                SetTimer(hwnd_, 7, 1, nullptr);
+            }
+        }
+    }
+    
+    void note_first_input() {
+        if (first_input_seen_) return;
+        first_input_seen_ = true;
+        startup_timeline_->mark("first input");
+    }
+
+    // ---- Damage tracking -------------------------------------------------
+
+    static editor::DamageRect to_damage(const RECT& rect) {
+        return { rect.left, rect.top, rect.right, rect.bottom };
+    }
+
+    HDC ensure_back_buffer(HDC hdc, const RECT& client_rect) {
+        int width = (std::max)(1L, client_rect.right);
+        int height = (std::max)(1L, client_rect.bottom);
+        if (back_dc_ && back_size_.cx == width && back_size_.cy == height) return back_dc_;
+        release_back_buffer();
+        back_dc_ = CreateCompatibleDC(hdc);
+        back_bitmap_ = CreateCompatibleBitmap(hdc, width, height);
+        back_old_bitmap_ = SelectObject(back_dc_, back_bitmap_);
+        back_size_ = { width, height };
+        damage_.invalidate_all();   // Nothing in the new buffer yet
+        return back_dc_;
+    }
+
+    void release_back_buffer() {
+        if (!back_dc_) return;
+        SelectObject(back_dc_, back_old_bitmap_);
+        DeleteObject(back_bitmap_);
+        DeleteDC(back_dc_);
+        back_dc_ = nullptr;
+        back_bitmap_ = nullptr;
+        back_size_ = { 0, 0 };
+    }
+
+    // Damage as a GDI region; with scrolls, also the areas they move
+    HRGN create_damage_region(const RECT& client_rect, bool with_scrolls) const {
+        if (damage_.full()) return CreateRectRgnIndirect(&client_rect);
+        HRGN region = CreateRectRgn(0, 0, 0, 0);
+        auto add = [&](const editor::DamageRect& r) {
+            HRGN part = CreateRectRgn(r.left, r.top, r.right, r.bottom);
+            CombineRgn(region, region, part, RGN_OR);
+            DeleteObject(part);
+        };
+        for (const auto& rect : damage_.rects()) add(rect);
+        if (with_scrolls) {
+            for (const auto& scroll : damage_.scrolls()) add(scroll.area);
+        }
+        return region;
+    }
+
+    void adopt_untracked_damage(const RECT& client_rect) {
+        HRGN update = CreateRectRgn(0, 0, 0, 0);
+        if (GetUpdateRgn(hwnd_, update, FALSE) > NULLREGION) {
+            HRGN tracked = create_damage_region(client_rect, true);
+            HRGN untracked = CreateRectRgn(0, 0, 0, 0);
+            if (CombineRgn(untracked, update, tracked, RGN_DIFF) > NULLREGION) {
+                RECT box{};
+                GetRgnBox(untracked, &box);
+                damage_.invalidate(to_damage(box));
+            }
+            DeleteObject(untracked);
+            DeleteObject(tracked);
+        }
+        DeleteObject(update);
+    }
+
+    void invalidate_rect(const RECT& rect) {
+        if (rect.right <= rect.left || rect.bottom <= rect.top) return;
+        damage_.invalidate(to_damage(rect));
+        InvalidateRect(hwnd_, &rect, FALSE);
+    }
+
+    void invalidate_all() {
+        damage_.invalidate_all();
+        InvalidateRect(hwnd_, nullptr, FALSE);
+    }
+
+    // Editor rows of the single view: from the content left edge to the window's
+    // Byte length of a line without its terminator, without reading the line
+    size_t line_length(size_t line) const {
+        size_t start = document_->get_line_start(line);
+        if (line + 1 >= document_->get_line_count()) return document_->get_total_length() - start;
+        size_t end = document_->get_line_start(line + 1) - 1;    // The '\n'
+        if (end > start && document_->get_text(end - 1, 1) == "\r") end--;
+        return end - start;
+    }
+
+    // Document position under a point of the single view's text (x from the
+    // text's left edge, y from the content top); a wrapped row's column
+    // stops at the row's end
+    size_t hit_test(int x, int y, size_t& line, size_t& column) {
+        size_t row = (size_t)(std::max)(0, y / char_height_);
+        size_t row_column = 0;
+        if (!viewport_.row_position(row, line, row_column)) {
+            line = document_->get_line_count() > 0 ? document_->get_line_count() - 1 : 0;
+            row_column = 0;
+        }
+        size_t row_end = line_length(line);
+        size_t next_line = 0;
+        size_t next_column = 0;
+        if (viewport_.is_soft_wrap() && viewport_.row_position(row + 1, next_line, next_column) &&
+            next_line == line && next_column > row_column) {
+            row_end = next_column - 1;
+        }
+        const auto& map = viewport_.column_layout().line(line);
+        size_t cell = map.column_of(row_column) + (size_t)(std::max)(0, x / char_width_);
+        column = (std::max)(row_column, (std::min)(map.byte_at(cell), row_end));
+        return (std::min)(document_->get_line_start(line) + column, document_->get_total_length());
+    }
+
+    // Rows and columns the single view shows; soft wrap keeps clear of the overlays
+    void update_viewport_size() {
+        RECT area = text_area_rect();
+        int text_left = area.left + (show_line_numbers_ ? 70 : 0);
+        int text_right = area.right;
+        if (viewport_.is_soft_wrap()) {
+            text_right -= show_stats_ ? 230 : 10;
+            if (minimap_shown()) {
+                text_right = (std::min)(text_right, (int)(area.right - minimap_->get_width() - 10));
+            }
+        }
+        int rows = (area.bottom - area.top + char_height_ - 1) / (std::max)(1, char_height_);
+        int columns = (text_right - text_left) / (std::max)(1, char_width_);
+        viewport_.set_size((size_t)(std::max)(1, rows), (size_t)(std::max)(1, columns));
+    }
+
+    RECT text_area_rect() {
+        RECT client_rect;
+        GetClientRect(hwnd_, &client_rect);
+        return { get_content_left(), get_content_top(), client_rect.right, get_content_bottom(client_rect) };
+    }
+
+    // Rows showing document lines [first, last]; folded lines take no row
+    void invalidate_lines(size_t first, size_t last) {
+        if (split_mode_ != SplitMode::None) {
+            invalidate_rect(text_area_rect());
+            return;
+        }
+        RECT area = text_area_rect();
+        size_t rows = (size_t)((area.bottom - area.top) / char_height_) + 1;
+        size_t top_row = viewport_.row_of_line(first);
+        size_t bottom_row = viewport_.row_of_line(last, SIZE_MAX);
+        if (bottom_row == SIZE_MAX) return;     // All above the screen
+        if (top_row == SIZE_MAX) top_row = 0;
+        if (top_row >= rows) return;
+        // A re-wrapped line may take a different number of rows and move the rest
+        bottom_row = viewport_.is_soft_wrap() ? rows - 1 : (std::min)(bottom_row, rows - 1);
+        invalidate_rect({ area.left, area.top + (int)top_row * char_height_, area.right,
+                          area.top + (int)(bottom_row + 1) * char_height_ });
+    }
 
-        // GPU renderer test (stub)
-        if (gpu_renderer_) {
-            gpu_renderer_->begin_frame();
-            gpu_renderer_->draw_rect(10, 10, 200, 100, 0xFF00FF00); // Green rect
-            gpu_renderer_->draw_text("GPU Test", 30, 50, 0xFFFFFFFF); // White text
-            gpu_renderer_->draw_line(10, 10, 210, 110, 0xFFFF0000); // Red line
-            gpu_renderer_->end_frame();
-            gpu_renderer_->present();
+    // The blinking caret's cell only
+    void invalidate_caret() {
+        if (split_mode_ != SplitMode::None) {
+            invalidate_rect(get_pane_rect(active_pane_));
+            return;
+        }
+        if (multi_cursor_mode_ && !extra_cursors_.empty()) {
+            invalidate_rect(text_area_rect());
+            return;
+        }
+        size_t line = get_cursor_line();
+        size_t column = cursor_pos_ - document_->get_line_start(line);
+        RECT area = text_area_rect();
+        size_t row = viewport_.row_of_line(line, column);
+        if (row == SIZE_MAX || row >= (size_t)((area.bottom - area.top) / char_height_) + 1) return;
+        size_t row_line = 0;
+        size_t row_column = 0;
+        if (!viewport_.row_position(row, row_line, row_column) || row_line != line || row_column > column) {
+            row_column = 0;
+        }
+        int y = area.top + (int)row * char_height_;
+        int text_x_offset = get_content_left() + (show_line_numbers_ ? 70 : 0);
+        int cursor_x = text_x_offset + column_x(viewport_, line, row_column, column);
+        invalidate_rect({ cursor_x - 1, y, cursor_x + 1, y + char_height_ });
+    }
+
+    // Panels that summarize the document: stats box, minimap, tab bar
+    void invalidate_panels(bool content_changed) {
+        RECT client_rect;
+        GetClientRect(hwnd_, &client_rect);
+        if (show_stats_) {
+            invalidate_rect({ client_rect.right - 220, 10, client_rect.right - 10, 180 });
+        }
+        if (minimap_shown() && split_mode_ == SplitMode::None) {
+            invalidate_rect({ client_rect.right - minimap_->get_width() - 10, get_content_top(), client_rect.right - 10,
+                              client_rect.bottom });
+        }
+        if (content_changed && show_tabs_) {
+            invalidate_rect({ 0, 10, client_rect.right, 10 + tab_bar_height_ });
+        }
+    }
+
+    // View state a keystroke or drag may change, to damage only what moved
+    struct EditSnapshot {
+        const PieceTable* document;
+        size_t top_line;
+        size_t line_count;
+        size_t length;
+        size_t cursor_line;
+        size_t selection_first;
+        size_t selection_last;
+        size_t bracket_open_line;   // Lines of the bracket pair at the caret
+        size_t bracket_close_line;
+        bool overlay;   // Find/replace/project search/autocomplete/multi-cursor: redraw everything
+    };
+
+    EditSnapshot snapshot_edit_state() const {
+        EditSnapshot snap{};
+        snap.document = document_.get();
+        snap.top_line = viewport_.get_top_line();
+        snap.line_count = document_->get_line_count();
+        snap.length = document_->get_total_length();
+        snap.cursor_line = get_cursor_line();
+        snap.selection_first = snap.selection_last = snap.cursor_line;
+        if (has_selection_) {
+            snap.selection_first = document_->get_line_at(get_selection_start());
+            snap.selection_last = document_->get_line_at(get_selection_end());
+        }
+        snap.bracket_open_line = snap.bracket_close_line = snap.cursor_line;
+        BracketIndex::Pair pair;
+        if (find_caret_bracket_pair(pair)) {
+            snap.bracket_open_line = pair.open_line;
+            snap.bracket_close_line = pair.close_line;
+        }
+        snap.overlay = split_mode_ != SplitMode::None || show_find_ || show_replace_ || show_project_search_ ||
+                       show_autocomplete_ || multi_cursor_mode_;
+        return snap;
+    }
+
+    void invalidate_after_edit(const EditSnapshot& before) {
+        EditSnapshot after = snapshot_edit_state();
+        if (before.overlay || after.overlay || before.document != after.document) {
+            invalidate_all();
+            return;
+        }
+        bool content_changed = before.length != after.length || before.line_count != after.line_count;
+        if (before.top_line != after.top_line) {
+            if (content_changed) {
+                invalidate_rect(text_area_rect());
+            } else {
+                scroll_text(before.top_line);
+            }
+        }
+        size_t first = (std::min)({ before.cursor_line, before.selection_first, after.cursor_line, after.selection_first });
+        size_t last = (std::max)({ before.cursor_line, before.selection_last, after.cursor_line, after.selection_last });
+        // Lines below an inserted or removed newline all move
+        if (before.line_count != after.line_count) last = (std::max)(before.line_count, after.line_count);
+        invalidate_lines(first, last);
+        // A matched bracket's partner may be lines away
+        for (size_t line : { before.bracket_open_line, before.bracket_close_line,
+                             after.bracket_open_line, after.bracket_close_line }) {
+            if (line < first || line > last) invalidate_lines(line, line);
+        }
+        invalidate_panels(content_changed);
+    }
+
+    // After the single view scrolled from old_top: move the pixels, draw the new rows
+    void scroll_text(size_t old_top) {
+        size_t new_top = viewport_.get_top_line();
+        if (new_top == old_top) return;
+        if (split_mode_ != SplitMode::None || show_project_search_ || show_autocomplete_) {
+            invalidate_rect(text_area_rect());
+            invalidate_panels(false);
+            return;
         }
+        RECT client_rect;
+        GetClientRect(hwnd_, &client_rect);
+        RECT area = text_area_rect();
+        // Only the rows under no overlay move: the stats box and minimap stay put
+        int overlay_left = client_rect.right - 10;
+        if (show_stats_) overlay_left = client_rect.right - 230;
+        if (minimap_shown()) {
+            overlay_left = (std::min)(overlay_left, (int)(client_rect.right - minimap_->get_width() - 10));
+        }
+        RECT moved{ area.left, area.top, overlay_left, area.bottom };
+        long long limit = area.bottom - area.top;   // Farther than a screen redraws it all
+        // Rows moved, counted in display lines so folds between the tops don't count
+        size_t old_display = folding_manager_ ? folding_manager_->document_to_display_line(old_top) : old_top;
+        long long moved_rows = (long long)old_display - (long long)viewport_.get_top_display_line();
+        long long dy = moved_rows * char_height_;
+        dy = (std::max)(-limit, (std::min)(limit, dy));
+        damage_.scroll(to_damage(moved), (int)dy);
+        InvalidateRect(hwnd_, &moved, FALSE);
+        // Long lines run on under the overlays; those strips are redrawn
+        invalidate_rect({ overlay_left, area.top, area.right, area.bottom });
+        invalidate_panels(false);
     }
     
     void SetTextRenderingHint(HDC hdc) {
@@ -1513,6 +2610,8 @@ private:
 
     void render_tabs(HDC hdc, const RECT& client_rect) {
         if (!show_tabs_ || !tab_manager_) return;
+        RECT bar_rect{ 0, 10, client_rect.right, 10 + tab_bar_height_ };
+        if (!RectVisible(hdc, &bar_rect)) return;   // Undamaged: tab_rects_ are still current
         tab_rects_.clear();
         const int view_left = 10;
         const int view_right = client_rect.right - 10;
@@ -1537,16 +2636,14 @@ private:
             RECT r{ x, y, x + w, y + h };
             tab_rects_.push_back(r);
             if (r.right >= view_left && r.left <= view_right) {
-                HBRUSH brush = CreateSolidBrush(i == tab_manager_->get_active_tab_index() ? RGB(50,50,60) : RGB(35,35,40));
+                HBRUSH brush = gdi_.brush(i == tab_manager_->get_active_tab_index() ? RGB(50,50,60) : RGB(35,35,40));
                 FillRect(hdc, &r, brush);
-                DeleteObject(brush);
-                HPEN pen = CreatePen(PS_SOLID, 1, RGB(80,80,90));
+                HPEN pen = gdi_.pen(RGB(80,80,90));
                 HPEN oldPen = (HPEN)SelectObject(hdc, pen);
                 HBRUSH oldBrush = (HBRUSH)SelectObject(hdc, GetStockObject(NULL_BRUSH));
                 Rectangle(hdc, r.left, r.top, r.right, r.bottom);
                 SelectObject(hdc, oldBrush);
                 SelectObject(hdc, oldPen);
-                DeleteObject(pen);
                 SetTextColor(hdc, RGB(200,200,210));
                 SetBkMode(hdc, TRANSPARENT);
                 TextOutW(hdc, x + padding_x, y + (h - sz.cy)/2, wname.c_str(), (int)wname.length());
@@ -1558,17 +2655,16 @@ private:
         bool overflow_left = tab_scroll_offset_ > 0;
         bool overflow_right = (view_left + total_width) > view_right;
         if (overflow_left) {
-            HPEN pen = CreatePen(PS_SOLID, 2, RGB(160,160,170));
+            HPEN pen = gdi_.pen(RGB(160,160,170), 2);
             HPEN old = (HPEN)SelectObject(hdc, pen);
             MoveToEx(hdc, view_left + 2, y + tab_bar_height_/2, nullptr);
             LineTo(hdc, view_left + 10, y + tab_bar_height_/2 - 6);
             MoveToEx(hdc, view_left + 2, y + tab_bar_height_/2, nullptr);
             LineTo(hdc, view_left + 10, y + tab_bar_height_/2 + 6);
             SelectObject(hdc, old);
-            DeleteObject(pen);
         }
         if (overflow_right) {
-            HPEN pen = CreatePen(PS_SOLID, 2, RGB(160,160,170));
+            HPEN pen = gdi_.pen(RGB(160,160,170), 2);
             HPEN old = (HPEN)SelectObject(hdc, pen);
             int xr = view_right - 2;
             MoveToEx(hdc, xr - 8, y + tab_bar_height_/2 - 6, nullptr);
@@ -1576,7 +2672,6 @@ private:
             MoveToEx(hdc, xr - 8, y + tab_bar_height_/2 + 6, nullptr);
             LineTo(hdc, xr, y + tab_bar_height_/2);
             SelectObject(hdc, old);
-            DeleteObject(pen);
         }
 
         // Clamp scroll offset if content became smaller
@@ -1589,67 +2684,304 @@ private:
 
     void switch_to_tab(size_t index) {
         if (!tab_manager_) return;
-        // Persist current state to active tab
-        if (auto* cur = tab_manager_->get_active_tab()) {
+        // Persist current state to the tab on screen (new_tab has already
+        // made the new one active); a reloading tab's placeholder has none
+        if (EditorTab* cur = shown_tab()) {
             cur->cursor_pos = cursor_pos_;
+            cur->top_line = viewport_.get_top_line();
             cur->is_modified = is_modified_;
             cur->file_path = current_file_;
+            park_view_state(*cur);
         }
+        // A hibernated tab starts reloading here; until it arrives the
+        // editor shows an empty, read-only document
         tab_manager_->set_active_tab(index);
-        if (auto* tab = tab_manager_->get_active_tab()) {
-            document_ = tab->document;
-            current_file_ = tab->file_path;
-            cursor_pos_ = tab->cursor_pos;
-            is_modified_ = tab->is_modified;
-            viewport_.set_document(document_);
-            if (highlighter_) {
-                highlighter_->set_language_by_filename(current_file_);
+        show_active_tab();
+        
+        // Stay within the memory budget; a tab's journal ends with its
+        // document (a modified one is spilled to a journal of its own)
+        tab_manager_->set_spill_workspace(current_workspace_dir_);
+        tab_manager_->enforce_budget([this](EditorTab& tab) { before_hibernate(tab); });
+    }
+    
+    void before_hibernate(EditorTab& tab) {
+        if (auto table = tab.piece_table()) {
+            if (autocomplete_) autocomplete_->release(table.get());
+            end_journal(table.get());
+        }
+    }
+    
+    // Caches shed under memory pressure, cheapest to rebuild first: the
+    // line images come back with the next paint, hidden tabs' tokens when
+    // they are shown, the scrollback is lost, and hibernated tabs reload
+    // from disk or their journal
+    void watch_memory_pressure() {
+        using editor::MemoryPressureLevel;
+        memory_pressure_.add_cache("rendered line cache", [this] {
+            size_t bytes = (size_t)line_cache_size_.cx * line_cache_size_.cy * 4;
+            release_line_cache();
+            return bytes;
+        });
+        memory_pressure_.add_cache("hidden tabs' highlight cache", [this] {
+            size_t bytes = 0;
+            for (size_t i = 0; i < tab_manager_->get_tab_count(); ++i) {
+                EditorTab* tab = tab_manager_->get_tab(i);
+                if (!tab->view_state || !tab->view_state->highlight) continue;
+                bytes += tab->view_state->highlight->get_memory_bytes();
+                tab->view_state->highlight.reset();
             }
+            return bytes;
+        });
+        memory_pressure_.add_cache("terminal scrollback", [this] {
+            return terminal_ ? terminal_->drop_scrollback() : 0;
+        }, MemoryPressureLevel::Critical);
+        memory_pressure_.add_cache("inactive tabs", [this] {
+            size_t before = tab_manager_->get_resident_bytes();
+            EditorTab* shown = shown_tab();
+            for (size_t i = 0; i < tab_manager_->get_tab_count(); ++i) {
+                if (tab_manager_->get_tab(i) == shown || i == tab_manager_->get_active_tab_index()) continue;
+                tab_manager_->hibernate_tab(i, [this](EditorTab& tab) { before_hibernate(tab); });
+            }
+            size_t after = tab_manager_->get_resident_bytes();
+            return before > after ? before - after : 0;
+        }, MemoryPressureLevel::Critical);
+        HWND hwnd = hwnd_;
+        memory_pressure_.start([hwnd] { PostMessageW(hwnd, WM_MEMORY_PRESSURE, 0, 0); });
+    }
+    
+    void show_active_tab() {
+        auto* tab = tab_manager_->get_active_tab();
+        if (!tab) return;
+        tab_loading_ = tab->is_hibernated();
+        document_ = tab_loading_ ? std::make_shared<PieceTable>("") : tab->piece_table();
+        current_file_ = tab->file_path;
+        cursor_pos_ = tab_loading_ ? 0 : tab->cursor_pos;
+        has_selection_ = false;
+        is_modified_ = tab->is_modified;
+        std::shared_ptr<TabViewState> parked;
+        if (!tab_loading_) parked = std::move(tab->view_state);
+        TabViewState fresh;
+        unpark_view_state(parked ? *parked : fresh, tab->top_line);
+        apply_large_file_policy();
+        if (!tab_loading_) {
+            attach_autocomplete();
+            start_journal();
         }
         update_title();
         InvalidateRect(hwnd_, nullptr, FALSE);
     }
     
-    void render_terminal(HDC hdc, const RECT& client_rect) {
-        // Get fresh terminal output
-        terminal_->get_output();
+    EditorTab* shown_tab() {
+        for (size_t i = 0; i < tab_manager_->get_tab_count(); ++i) {
+            EditorTab* tab = tab_manager_->get_tab(i);
+            if (tab->document && tab->document == document_) return tab;
+        }
+        return nullptr;
+    }
+    
+    // Folding over the lexer's brackets, which also answer bracket matching
+    std::unique_ptr<CodeFoldingManager> make_folding() {
+        auto folding = std::make_unique<CodeFoldingManager>();
+        folding->set_line_source(std::make_shared<BracketIndex>(highlighter_.get()));
+        return folding;
+    }
+
+    // The pair of the bracket just after or before the caret
+    bool find_caret_bracket_pair(BracketIndex::Pair& pair) const {
+        if (!folding_manager_ || !folding_manager_->line_source()) return false;
+        const auto* brackets = static_cast<const BracketIndex*>(folding_manager_->line_source());
+        size_t line = get_cursor_line();
+        if (line >= brackets->line_count()) return false;
+        size_t column = get_cursor_column();
+        return brackets->match(line, column, pair) || (column > 0 && brackets->match(line, column - 1, pair));
+    }
+
+    // Move what showing the document built up into its tab
+    void park_view_state(EditorTab& tab) {
+        auto state = std::make_shared<TabViewState>();
+        highlight_cache_->set_background(false);
+        state->highlight = std::move(highlight_cache_);
+        state->folding = std::move(folding_manager_);
+        state->outline = std::move(outline_);
+        viewport_.set_folding(nullptr);
+        state->viewport = viewport_.take_state();
+        if (diff_gutter_) state->hunks = diff_gutter_->hunks();
+        state->language = highlighter_->get_language();
+        tab.view_state = std::move(state);
+    }
+    
+    // Show document_ with a tab's parked state, or start afresh (at
+    // top_line) for a document never shown or replaced since
+    void unpark_view_state(TabViewState& state, size_t top_line) {
+        bool same = state.viewport.document == document_;
+        if (state.language == SyntaxHighlighter::Language::Auto) {
+            highlighter_->set_language_by_filename(current_file_);
+        } else if (state.language != highlighter_->get_language()) {
+            highlighter_->set_language(state.language);
+        }
+        highlight_cache_ = same && state.highlight ? std::move(state.highlight)
+                                                   : std::make_unique<HighlightCache>(highlighter_.get());
+        highlight_cache_->set_background(true);
+        folding_manager_ = same && state.folding ? std::move(state.folding) : make_folding();
+        outline_ = same && state.outline ? std::move(state.outline) : std::make_unique<editor::DocumentOutline>();
+        viewport_.set_folding(folding_manager_.get());
+        if (same) {
+            viewport_.restore_state(std::move(state.viewport));
+        } else {
+            viewport_.set_document(document_);
+            viewport_.scroll_to_line(top_line);
+        }
+        if (diff_gutter_) diff_gutter_->set_document(document_, current_file_, same ? std::move(state.hunks)
+                                                                                    : std::vector<GitDiffHunk>());
+    }
+    
+    // Ctrl+F1: what each document and subsystem holds, to the console and
+    // in a message box
+    void show_memory_report() {
+        editor::MemoryReport report;
+        auto add_document = [&report](const std::string& owner, const TextBuffer& document) {
+            auto* table = dynamic_cast<const PieceTable*>(&document);
+            if (!table) {
+                report.add(owner, "text", TabManager::resident_bytes(document));
+                return;
+            }
+            PieceTable::MemoryUsage usage = table->get_memory_usage();
+            report.add(owner, "original buffer", usage.original);
+            report.add(owner, "original buffer", usage.mapped, true);
+            report.add(owner, "add buffer", usage.add_buffer);
+            report.add(owner, "line index", usage.line_index);
+            report.add(owner, "piece tree", usage.piece_tree);
+            report.add(owner, "undo history", usage.undo_history);
+        };
+        EditorTab* shown = tab_manager_ ? shown_tab() : nullptr;
+        if (tab_manager_) {
+            for (const EditorTab& tab : tab_manager_->get_all_tabs()) {
+                std::string owner = tab.file_path.empty() ? tab.display_name : tab.file_path;
+                if (!tab.document) {
+                    report.add(owner + " (hibernated)", "tab", sizeof(EditorTab));
+                    continue;
+                }
+                add_document(owner, *tab.document);
+                if (&tab == shown) {
+                    report.add(owner, "highlight cache", highlight_cache_->get_memory_bytes());
+                } else if (tab.view_state && tab.view_state->highlight) {
+                    report.add(owner, "highlight cache", tab.view_state->highlight->get_memory_bytes());
+                }
+            }
+        }
+        if (!shown && document_) {
+            add_document(current_file_.empty() ? "untitled" : current_file_, *document_);
+            report.add(current_file_.empty() ? "untitled" : current_file_, "highlight cache",
+                       highlight_cache_->get_memory_bytes());
+        }
+        for (SplitPane* pane : { &pane1_, &pane2_ }) {
+            if (pane->highlight) report.add("split panes", "highlight cache", pane->highlight->get_memory_bytes());
+        }
+        report.add("editor", "undo steps", undo_manager_->get_memory_bytes());
+        if (terminal_) report.add("editor", "terminal scrollback", terminal_->screen().get_memory_bytes());
+        memory_pressure_.report(report);
         
+        std::string text = report.format();
+        std::cout << text << "\n";
+        MessageBoxW(hwnd_, std::wstring(text.begin(), text.end()).c_str(), L"Memory Report", MB_OK | MB_ICONINFORMATION);
+    }
+    
+    // Terminal grid: the panel below its title bar, above the input line
+    void resize_terminal_to_panel() {
+        RECT cr{}; GetClientRect(hwnd_, &cr);
+        int columns = (cr.right - 20) / (std::max)(char_width_, 1);
+        int rows = (terminal_panel_height_ - 35 - char_height_) / (std::max)(char_height_, 1);
+        terminal_->resize((std::max)(columns, 20), (std::max)(rows, 2));
+    }
+    
+    static COLORREF terminal_color(uint32_t color, COLORREF fallback) {
+        using editor::TerminalCell;
+        static const COLORREF kAnsi[16] = {
+            RGB(0, 0, 0), RGB(205, 49, 49), RGB(13, 188, 121), RGB(229, 229, 16),
+            RGB(36, 114, 200), RGB(188, 63, 188), RGB(17, 168, 205), RGB(229, 229, 229),
+            RGB(102, 102, 102), RGB(241, 76, 76), RGB(35, 209, 139), RGB(245, 245, 67),
+            RGB(59, 142, 234), RGB(214, 112, 214), RGB(41, 184, 219), RGB(255, 255, 255)
+        };
+        if (color & TerminalCell::kRgbColor) {
+            return RGB((color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF);
+        }
+        if (!(color & TerminalCell::kPaletteColor)) return fallback;
+        int index = color & 0xFF;
+        if (index < 16) return kAnsi[index];
+        if (index < 232) {
+            // 6x6x6 color cube
+            static const int kLevels[6] = { 0, 95, 135, 175, 215, 255 };
+            index -= 16;
+            return RGB(kLevels[index / 36], kLevels[(index / 6) % 6], kLevels[index % 6]);
+        }
+        int gray = 8 + (index - 232) * 10;
+        return RGB(gray, gray, gray);
+    }
+    
+    void render_terminal(HDC hdc, const RECT& client_rect) {
         // Calculate terminal panel position (bottom of window)
         int term_top = client_rect.bottom - terminal_panel_height_;
         RECT term_rect = { 0, term_top, client_rect.right, client_rect.bottom };
+        if (!RectVisible(hdc, &term_rect)) return;
         
         // Background
-        HBRUSH termBgBrush = CreateSolidBrush(RGB(20, 20, 25));
+        const COLORREF term_bg = RGB(20, 20, 25);
+        const COLORREF term_fg = RGB(220, 220, 220);
+        HBRUSH termBgBrush = gdi_.brush(term_bg);
         FillRect(hdc, &term_rect, termBgBrush);
-        DeleteObject(termBgBrush);
         
         // Border
-        HPEN borderPen = CreatePen(PS_SOLID, 1, RGB(70, 70, 80));
+        HPEN borderPen = gdi_.pen(RGB(70, 70, 80));
         HPEN oldPen = (HPEN)SelectObject(hdc, borderPen);
         MoveToEx(hdc, term_rect.left, term_rect.top, nullptr);
         LineTo(hdc, term_rect.right, term_rect.top);
         SelectObject(hdc, oldPen);
-        DeleteObject(borderPen);
         
         // Title bar
         SetTextColor(hdc, RGB(180, 180, 200));
         TextOutA(hdc, 10, term_rect.top + 5, "TERMINAL", 8);
         
-        // Render terminal buffer
-        const auto& buffer = terminal_->get_buffer();
+        // Screen rows, or history when scrolled back; each row is drawn in
+        // runs of cells sharing colors
+        const editor::TerminalScreen& screen = terminal_->screen();
+        size_t visible_lines = static_cast<size_t>(screen.rows());
+        size_t scroll_offset = static_cast<size_t>((std::max)(terminal_->get_scroll_offset(), 0));
+        size_t first_line = screen.history_size() - (std::min)(scroll_offset, screen.history_size());
         int y = term_rect.top + 30;
-        int scroll_offset = terminal_->get_scroll_offset();
-        size_t start_line = (scroll_offset > 0) ? scroll_offset : 0;
-        size_t visible_lines = (terminal_panel_height_ - 30) / char_height_;
-        
-        SetTextColor(hdc, RGB(220, 220, 220));
-        for (size_t i = start_line; i < buffer.size() && i < start_line + visible_lines; ++i) {
-            const std::string& line = buffer[i];
-            if (!line.empty()) {
-                TextOutA(hdc, 10, y, line.c_str(), static_cast<int>(line.size()));
+        std::wstring run;
+        int old_bk_mode = SetBkMode(hdc, OPAQUE);
+        for (size_t i = first_line; i < first_line + visible_lines && i < screen.line_count(); ++i) {
+            const auto& cells = screen.line(i).cells;
+            size_t end = cells.size();
+            while (end > 0 && cells[end - 1] == editor::TerminalCell()) --end;
+            for (size_t start = 0; start < end;) {
+                const editor::TerminalCell& first = cells[start];
+                size_t stop = start;
+                run.clear();
+                while (stop < end && cells[stop].foreground == first.foreground &&
+                       cells[stop].background == first.background && cells[stop].attributes == first.attributes) {
+                    char32_t ch = cells[stop].ch;
+                    if (ch >= 0x10000) {
+                        ch -= 0x10000;
+                        run += static_cast<wchar_t>(0xD800 + (ch >> 10));
+                        run += static_cast<wchar_t>(0xDC00 + (ch & 0x3FF));
+                    } else {
+                        run += static_cast<wchar_t>(ch);
+                    }
+                    ++stop;
+                }
+                COLORREF fg = terminal_color(first.foreground, term_fg);
+                COLORREF bg = terminal_color(first.background, term_bg);
+                if (first.attributes & editor::TerminalCell::Inverse) std::swap(fg, bg);
+                if (first.attributes & editor::TerminalCell::Hidden) fg = bg;
+                SetTextColor(hdc, fg);
+                SetBkColor(hdc, bg);
+                TextOutW(hdc, 10 + static_cast<int>(start) * char_width_, y, run.c_str(), static_cast<int>(run.size()));
+                start = stop;
             }
             y += char_height_;
         }
+        SetBkMode(hdc, old_bk_mode);
         
         // Input line
         int input_y = client_rect.bottom - char_height_ - 5;
@@ -1660,20 +2992,72 @@ private:
         // Cursor in terminal input
         if (cursor_visible_) {
             int cursor_x = 10 + (2 + terminal_input_cursor_) * char_width_;
-            HPEN cursorPen = CreatePen(PS_SOLID, 2, RGB(100, 255, 100));
+            HPEN cursorPen = gdi_.pen(RGB(100, 255, 100), 2);
             oldPen = (HPEN)SelectObject(hdc, cursorPen);
             MoveToEx(hdc, cursor_x, input_y, nullptr);
             LineTo(hdc, cursor_x, input_y + char_height_);
             SelectObject(hdc, oldPen);
-            DeleteObject(cursorPen);
         }
     }
     
+    RECT perf_hud_rect(const RECT& client_rect) const {
+        return { client_rect.right - 430, client_rect.bottom - 150, client_rect.right - 10, client_rect.bottom - 10 };
+    }
+    
+    // Shift+F1: latency and paint-phase percentiles since startup (or reset)
+    void render_perf_hud(HDC hdc, const RECT& client_rect) {
+        RECT hud = perf_hud_rect(client_rect);
+        if (!RectVisible(hdc, &hud)) return;
+        HBRUSH brush = gdi_.brush(RGB(20, 20, 25));
+        FillRect(hdc, &hud, brush);
+        FrameRect(hdc, &hud, (HBRUSH)GetStockObject(GRAY_BRUSH));
+        
+        using Metric = editor::FrameStats::Metric;
+        static const std::pair<Metric, const wchar_t*> rows[] = {
+            { Metric::InputLatency, L"Key to screen" }, { Metric::FrameInterval, L"Frame interval" },
+            { Metric::Paint, L"Paint" }, { Metric::Highlight, L"  Highlight" }, { Metric::TextDraw, L"  Text" },
+            { Metric::Minimap, L"  Minimap" }, { Metric::Terminal, L"  Terminal" },
+        };
+        std::wostringstream text;
+        for (const auto& [metric, label] : rows) {
+            std::string summary = frame_stats_.summary(metric);
+            text << std::left << std::setw(16) << label << std::wstring(summary.begin(), summary.end()) << L"\n";
+        }
+        SetTextColor(hdc, RGB(100, 255, 100));
+        RECT text_rect{ hud.left + 8, hud.top + 6, hud.right - 8, hud.bottom - 6 };
+        DrawTextW(hdc, text.str().c_str(), -1, &text_rect, DT_LEFT | DT_TOP);
+    }
+    
+    // The definitions whose blocks hold the caret, outermost first:
+    // "Scope: Editor > Buffer > insert"
+    void append_scope(std::wostringstream& stats) {
+        if (!folding_manager_ || !folding_manager_->line_source() ||
+            !large_file_.allows(editor::LargeFileFeature::Folding)) {
+            return;
+        }
+        const auto* brackets = static_cast<const BracketIndex*>(folding_manager_->line_source());
+        const auto& path = outline_->path_at(get_cursor_line(), *brackets);
+        if (path.empty()) return;
+        std::wstring scope;
+        for (const auto& symbol : path) {
+            if (!scope.empty()) scope += L" > ";
+            for (char c : symbol.name) scope += static_cast<wchar_t>(c);
+        }
+        stats << L"Scope: " << scope << L"\n";
+    }
+
     void render_stats(HDC hdc, const RECT& client_rect) {
+        RECT stats_bounds{ client_rect.right - 220, 10, client_rect.right - 10, 180 };
+        if (!RectVisible(hdc, &stats_bounds)) return;
+        
         std::wostringstream stats;
         stats << L"FPS: " << static_cast<int>(fps_) << L"\n";
         stats << L"Frame: " << std::fixed << std::setprecision(2) << last_frame_time_ << L"ms\n";
-        stats << L"Lines: " << document_->get_line_count() << L"\n";
+        stats << L"Lines: " << document_->get_line_count();
+        if (document_->is_indexing()) {
+            stats << L" (~" << static_cast<int>(document_->get_index_progress() * 100) << L"%)";
+        }
+        stats << L"\n";
         stats << L"Chars: " << document_->get_total_length() << L"\n";
         stats << L"Cursor: " << get_cursor_line() + 1 << L":" << get_cursor_column() + 1;
         if (multi_cursor_mode_ && !extra_cursors_.empty()) {
@@ -1681,6 +3065,7 @@ private:
         }
         stats << L"\n";
         stats << L"View: " << viewport_.get_top_line() + 1 << L"\n";
+        append_scope(stats);
         stats << L"Render: " << std::fixed << std::setprecision(2) 
               << viewport_.get_last_render_time_ms() << L"ms\n";
         
@@ -1729,7 +3114,7 @@ private:
         if (is_modified_) {
             stats << L"[Modified]\n";
         }
-        stats << L"\nF1: Toggle stats";
+        stats << L"\nF1: Toggle stats  Shift+F1: Perf HUD";
         if (show_find_) {
             stats << L"\nF3: Find next";
         }
@@ -1742,18 +3127,16 @@ private:
             180
         };
 
-        HBRUSH statsBrush = CreateSolidBrush(RGB(20, 20, 25));
+        HBRUSH statsBrush = gdi_.brush(RGB(20, 20, 25));
         FillRect(hdc, &stats_rect, statsBrush);
-        DeleteObject(statsBrush);
         
         // Draw border
-        HPEN borderPen = CreatePen(PS_SOLID, 1, RGB(60, 200, 60));
+        HPEN borderPen = gdi_.pen(RGB(60, 200, 60));
         HPEN oldPen = (HPEN)SelectObject(hdc, borderPen);
         HBRUSH oldBrush = (HBRUSH)SelectObject(hdc, GetStockObject(NULL_BRUSH));
         Rectangle(hdc, stats_rect.left, stats_rect.top, stats_rect.right, stats_rect.bottom);
         SelectObject(hdc, oldPen);
         SelectObject(hdc, oldBrush);
-        DeleteObject(borderPen);
         
         // Stats text
         SetTextColor(hdc, RGB(100, 255, 100));
@@ -1761,61 +3144,48 @@ private:
         text_rect.left += 10;
         text_rect.top += 10;
         
-        HFONT smallFont = CreateFontW(
-            14, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE,
-            DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
-            CLEARTYPE_QUALITY, FIXED_PITCH | FF_MODERN,
-            L"Consolas"
-        );
+        HFONT smallFont = gdi_.font(14);
         HFONT oldFont = (HFONT)SelectObject(hdc, smallFont);
         
         DrawTextW(hdc, stats.str().c_str(), -1, &text_rect, DT_LEFT | DT_TOP);
         
         SelectObject(hdc, oldFont);
-        DeleteObject(smallFont);
     }
     
-    void render_minimap(HDC hdc, const RECT& client_rect) {
-        if (!minimap_ || !document_) return;
-        
-        int minimap_width = minimap_->get_width();
-        int content_top = get_content_top();
-        
-        RECT minimap_rect = {
-            client_rect.right - minimap_width - 10,
-            content_top,
+    // Visible, and the document is not too large for it
+    bool minimap_shown() const {
+        return minimap_ && minimap_->is_visible() && large_file_.allows(editor::LargeFileFeature::Minimap);
+    }
+    RECT minimap_rect(const RECT& client_rect) const {
+        return {
+            client_rect.right - minimap_->get_width() - 10,
+            get_content_top(),
             client_rect.right - 10,
             client_rect.bottom - (show_project_search_ ? results_panel_height_ : 0)
         };
+    }
+
+    // Keeps the density bitmap sized and bound to the active document
+    void sync_minimap_density() {
+        RECT client_rect;
+        GetClientRect(hwnd_, &client_rect);
+        RECT area = minimap_rect(client_rect);
+        minimap_density_.set_document(document_);
+        minimap_density_.resize(area.right - area.left, area.bottom - area.top);
+    }
+    
+    void render_minimap(HDC hdc, const RECT& client_rect) {
+        if (!minimap_ || !document_) return;
         
-        // Get all lines
-        std::vector<std::string> lines;
-        lines.reserve(document_->get_line_count());
-        for (size_t i = 0; i < document_->get_line_count(); ++i) {
-            lines.push_back(document_->get_line(i));
-        }
-        if (highlighter_) highlighter_->set_document_lines(lines);
-        
-        // Generate syntax colors for minimap (simplified)
-        std::vector<COLORREF> colors;
-        for (size_t li = 0; li < lines.size(); ++li) {
-            const auto& line = lines[li];
-            // Determine color based on content
-            COLORREF line_color = RGB(180, 180, 180); // Default
-            
-            if (highlighter_) highlighter_->set_current_line_index(li);
-            auto tokens = highlighter_->tokenize_line(line);
-            if (!tokens.empty()) {
-                // Use color of first significant token
-                line_color = tokens[0].get_color();
-            }
-            
-            colors.push_back(line_color);
-        }
+        RECT area = minimap_rect(client_rect);
+        if (!RectVisible(hdc, &area)) return;
         
-        // Render minimap
-        minimap_->render(hdc, minimap_rect, lines, viewport_.get_top_line(), 
-                        viewport_.get_visible_lines().size(), colors);
+        // Rows are derived on timer 3; the first paint after a resize or
+        // document switch derives one slice so the minimap is never blank
+        sync_minimap_density();
+        minimap_density_.update();
+        minimap_->render(hdc, gdi_, area, minimap_density_, viewport_.get_top_line(),
+                         viewport_.get_visible_lines().size());
     }
 
     // --- Project-wide Search: helpers ---
@@ -1883,16 +3253,14 @@ private:
         if (project_search_in_progress_) return;
         project_search_in_progress_ = true;
         selected_result_index_ = -1;
-        {
-            std::lock_guard<std::mutex> lock(project_results_mutex_);
-            project_results_.clear();
-        }
+        project_results_top_ = 0;
+        project_results_.set_document_lookup([this](const std::string& path) {
+            return tab_manager_ ? std::dynamic_pointer_cast<PieceTable>(tab_manager_->find_document(path)) : nullptr;
+        });
+        uint64_t generation = project_results_.reset();
         std::string root = current_workspace_dir_.empty() ? std::string(".") : current_workspace_dir_;
         std::string query = project_search_query_;
-        auto includes = project_include_patterns_;
-        auto excludes = project_exclude_patterns_;
-        project_search_future_ = std::async(std::launch::async, [this, root, query, includes, excludes]() {
-            std::vector<ProjectSearchResult> results;
+        project_search_future_ = std::async(std::launch::async, [this, root, query, generation]() {
             std::vector<std::string> files;
             try {
                 for (auto it = std::filesystem::recursive_directory_iterator(root, std::filesystem::directory_options::skip_permission_denied); it != std::filesystem::recursive_directory_iterator(); ++it) {
@@ -1904,40 +3272,32 @@ private:
                 }
             } catch (...) {}
 
-            // Parallel scan in batches
-            const size_t max_parallel = (std::max)(2u, std::thread::hardware_concurrency());
-            std::atomic<size_t> index{0};
-            auto worker = [&]() {
-                size_t i;
-                while ((i = index.fetch_add(1)) < files.size()) {
-                    const std::string& f = files[i];
-                    std::ifstream in(f, std::ios::binary);
-                    if (!in) continue;
-                    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
-                    in.close();
-
-                    size_t start = 0;
-                    while (true) {
-                        size_t pos = content.find(query, start);
-                        if (pos == std::string::npos) break;
-                        // Compute line/column and extract line text
-                        size_t line = 0, col = 0, last_nl = 0;
-                        for (size_t k = 0; k < pos; ++k) if (content[k] == '\n') { line++; last_nl = k + 1; }
-                        col = pos - last_nl;
-                        size_t line_end = content.find('\n', pos);
-                        std::string line_text = content.substr(last_nl, (line_end == std::string::npos ? content.size() : line_end) - last_nl);
-                        ProjectSearchResult r{ f, line, col, line_text };
-                        {
-                            std::lock_guard<std::mutex> lock(project_results_mutex_);
-                            project_results_.push_back(std::move(r));
+            // Each file's hits go to the list as one group as soon as it is
+            // scanned; only positions are kept, the panel reads the lines it shows
+            TaskGroup workers;
+            for (const std::string& f : files) {
+                workers.submit([this, &f, &query, generation]() {
+                    auto mapping = editor::PlatformFile::map_file(f);
+                    if (!mapping || query.empty()) return;
+                    std::string_view content(mapping->data(), mapping->size());
+                    std::vector<editor::ResultList::Hit> hits;
+                    size_t line = 0, line_start = 0, counted = 0;
+                    for (size_t pos = content.find(query); pos != std::string_view::npos;
+                         pos = content.find(query, pos + query.size())) {
+                        // Newlines are counted once, from the last hit on
+                        for (; counted < pos; ++counted) {
+                            if (content[counted] == '\n') {
+                                ++line;
+                                line_start = counted + 1;
+                            }
                         }
-                        start = pos + (query.empty() ? 1 : query.size());
+                        hits.push_back({ line, pos - line_start, query.size() });
                     }
-                }
-            };
-            std::vector<std::thread> threads;
-            for (size_t t = 0; t < max_parallel; ++t) threads.emplace_back(worker);
-            for (auto& th : threads) th.join();
+                    project_results_.add(generation, f, hits);
+                }, TaskPriority::Interactive);
+            }
+            workers.wait();
+            project_results_.finish(generation);
 
             project_search_in_progress_ = false;
             InvalidateRect(hwnd_, nullptr, FALSE);
@@ -1945,15 +3305,11 @@ private:
     }
 
     void open_result_at_index(int idx) {
-        std::lock_guard<std::mutex> lock(project_results_mutex_);
-        if (idx < 0 || idx >= (int)project_results_.size()) return;
-        const auto& r = project_results_[idx];
-        open_file_from_path(r.file_path);
+        editor::ResultList::Row r;
+        if (idx < 0 || !project_results_.get((size_t)idx, r)) return;
+        open_file_from_path(r.path);
         // Move cursor to line/column
-        size_t pos = 0;
-        for (size_t i = 0; i < r.line; ++i) pos += document_->get_line(i).length() + 1;
-        pos += (std::min)(r.column, document_->get_line(r.line).length());
-        cursor_pos_ = pos;
+        cursor_pos_ = document_->line_col_to_offset(r.line, r.column);
         viewport_.scroll_to_line(r.line);
         InvalidateRect(hwnd_, nullptr, FALSE);
     }
@@ -1962,208 +3318,386 @@ private:
         std::string find = project_search_query_;
         std::string repl = project_replace_query_;
         if (find.empty()) return;
-        size_t replaced_total = 0;
-        std::vector<std::string> touched_files;
 
-        // Gather distinct files from results
-        {
-            std::lock_guard<std::mutex> lock(project_results_mutex_);
-            std::vector<std::string> files;
-            for (const auto& r : project_results_) files.push_back(r.file_path);
-            std::sort(files.begin(), files.end());
-            files.erase(std::unique(files.begin(), files.end()), files.end());
-            for (const auto& f : files) {
-                std::ifstream in(f, std::ios::binary);
-                if (!in) continue;
-                std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
-                in.close();
-                size_t count = 0, pos = 0;
-                while ((pos = content.find(find, pos)) != std::string::npos) {
-                    content.replace(pos, find.size(), repl);
-                    pos += repl.size();
-                    ++count;
-                }
-                if (count > 0) {
-                    std::ofstream out(f, std::ios::binary | std::ios::trunc);
-                    if (out) { out.write(content.data(), content.size()); out.close(); }
-                    replaced_total += count;
-                    touched_files.push_back(f);
-                }
+        // Distinct files from the results; they are rescanned, so stale results do no harm
+        std::vector<std::string> files = project_results_.files();
+
+        // Open tabs are edited in place (one undo step each), other files on disk
+        auto lookup = [this](const std::string& path) {
+            return std::dynamic_pointer_cast<PieceTable>(tab_manager_->find_document(path));
+        };
+        auto apply_document = [this](PieceTable& document, const std::vector<ReplaceEdit>& edits) {
+            undo_manager_->begin_transaction(&document);
+            FindDialog::apply_edits(document, edits);
+            undo_manager_->commit_transaction();
+        };
+        WorkspaceReplace::Options options;
+        options.case_sensitive = true;
+        auto plan = workspace_replace_.plan(files, find, repl, options, lookup);
+        WorkspaceReplace::Result result = workspace_replace_.apply(plan, apply_document);
+        for (const auto& file : plan) {
+            if (file.document && file.document == document_) {
+                is_modified_ = true;
+                mark_active_tab_modified();
             }
         }
+
         // Re-run search to refresh results
         start_project_search();
-        // Status message
         std::wostringstream msg;
-        msg << L"Replaced " << replaced_total << L" occurrences in " << touched_files.size() << L" files";
+        if (result.ok) {
+            msg << L"Replaced " << result.replacements << L" occurrences in " << result.files << L" files";
+        } else {
+            msg << L"Replace aborted: " << std::wstring(result.error.begin(), result.error.end());
+        }
         show_status_message(msg.str(), 3000);
+        InvalidateRect(hwnd_, nullptr, FALSE);
+    }
+
+    // COLORREF (0x00BBGGRR) as the draw lists' 0xAARRGGBB
+    static uint32_t to_argb(COLORREF color) {
+        return 0xFF000000u | (GetRValue(color) << 16) | (GetGValue(color) << 8) | GetBValue(color);
+    }
+
+    // x of byte column `column` of a line, from the left edge of a row that
+    // starts at byte column row_column
+    int column_x(Viewport& view, size_t line, size_t row_column, size_t column) {
+        const auto& map = view.column_layout().line(line);
+        size_t left = map.column_of(row_column);
+        size_t cell = map.column_of(column);
+        return cell > left ? (int)(cell - left) * char_width_ : 0;
+    }
+
+    // Selected columns of one row as a single rect; false if none are.
+    // The row is row_length bytes of a line from byte column row_column,
+    // at document offset row_start.
+    bool add_selection_rect(const editor::ColumnLayout::LineMap& map, size_t row_column, size_t row_start,
+                            size_t row_length, size_t sel_start, size_t sel_end, int text_x_offset, int y) {
+        size_t row_end = row_start + row_length;
+        if (sel_start >= row_end || sel_end <= row_start) return false;
+        size_t left = map.column_of(row_column);
+        size_t from = map.column_of(row_column + (std::max)(sel_start, row_start) - row_start) - left;
+        size_t to = map.column_of(row_column + (std::min)(sel_end, row_end) - row_start) - left;
+        pane_draw_list_.add_rect(text_x_offset + (int)from * char_width_, y, (int)(to - from) * char_width_,
+                                 char_height_, to_argb(RGB(60, 60, 120)));
+        return true;
+    }
+
+    // A line as one glyph run on the character grid, one color span per token.
+    // Over the plain editor background the run may be replayed from the line cache.
+    // line is the part of document line line_num from byte column `column` on
+    // (a wrapped row); tokens are positioned in the whole line
+    void add_line_run(const std::string& line, const std::vector<Token>& tokens, int text_x_offset, int y,
+                      bool plain_background, editor::ColumnLayout& layout, size_t line_num, size_t column = 0) {
+        const uint32_t plain = to_argb(RGB(220, 220, 220));
+        std::string_view text(line);
+        // Tabs become spaces up to their stops, which keeps the run on the
+        // grid; token offsets move with the bytes
+        bool expanded = line.find('\t') != std::string::npos;
+        if (expanded) {
+            size_t tab_width = layout.tab_width();
+            size_t cell = layout.line(line_num).column_of(column);
+            run_text_.clear();
+            run_offsets_.resize(line.size() + 1);
+            for (size_t i = 0; i < line.size();) {
+                size_t cells = 0;
+                size_t end = editor::ColumnLayout::next_cluster(line.data(), line.size(), i, cell, tab_width, cells);
+                for (size_t k = i; k < end; ++k) run_offsets_[k] = run_text_.size() + (k - i);
+                if (line[i] == '\t') run_text_.append(cells, ' ');
+                else run_text_.append(line, i, end - i);
+                cell += cells;
+                i = end;
+            }
+            run_offsets_[line.size()] = run_text_.size();
+            text = run_text_;
+        }
+        auto piece = [&](size_t from, size_t to) {
+            return expanded ? text.substr(run_offsets_[from], run_offsets_[to] - run_offsets_[from])
+                            : text.substr(from, to - from);
+        };
+        pane_draw_list_.begin_run(text_x_offset, y, char_width_,
+                                  plain_background ? to_argb(theme_->get_colors().background) : 0);
+        size_t last_pos = 0;
+        for (const auto& token : tokens) {
+            size_t token_end = token.start + token.length;
+            if (token_end <= column) continue;           // Ends on an earlier row
+            size_t start = (std::max)(token.start, column) - column;
+            if (start >= line.length()) break;          // Viewport truncated the line
+            if (start < last_pos) continue;             // Overlaps the previous token
+            if (start > last_pos) {
+                pane_draw_list_.append_run(piece(last_pos, start), plain);
+            }
+            size_t end = (std::min)(token_end - column, line.length());
+            pane_draw_list_.append_run(piece(start, end), to_argb(token.get_color()));
+            last_pos = end;
+        }
+        if (last_pos < line.length()) {
+            pane_draw_list_.append_run(piece(last_pos, line.length()), plain);
+        }
+    }
+
+    // Line images for runs over an opaque background: one row of
+    // line_cache_dc_ per LineRunCache slot, sized to the window
+    void ensure_line_cache(HDC hdc, const RECT& client_rect) {
+        int width = (std::max)(1L, client_rect.right);
+        // Three screens of rows: a frame never evicts its own lines
+        size_t rows = (size_t)(std::max)(1, (int)client_rect.bottom / (std::max)(1, char_height_)) * 3;
+        if (line_cache_dc_ && line_cache_size_.cx == width && line_cache_.capacity() == rows) return;
+        release_line_cache();
+        // Shed under memory pressure: lines are drawn directly until it passes
+        if (memory_pressure_.level() != editor::MemoryPressureLevel::Normal) return;
+        line_cache_dc_ = CreateCompatibleDC(hdc);
+        line_cache_bitmap_ = CreateCompatibleBitmap(hdc, width, (int)rows * char_height_);
+        line_cache_old_bitmap_ = SelectObject(line_cache_dc_, line_cache_bitmap_);
+        line_cache_size_ = { width, (LONG)rows * char_height_ };
+        SelectObject(line_cache_dc_, hFont_);
+        SetBkMode(line_cache_dc_, TRANSPARENT);
+        SetTextRenderingHint(line_cache_dc_);
+        line_cache_.set_capacity(rows);
+    }
+
+    void release_line_cache() {
+        if (!line_cache_dc_) return;
+        SelectObject(line_cache_dc_, line_cache_old_bitmap_);
+        DeleteObject(line_cache_bitmap_);
+        DeleteDC(line_cache_dc_);
+        line_cache_dc_ = nullptr;
+        line_cache_bitmap_ = nullptr;
+        line_cache_size_ = { 0, 0 };
+        line_cache_.clear();
+    }
+
+    // Draws a run's spans with its first cell at (x, y). On the cell grid
+    // ASCII widens byte for byte; other text is decoded, and each cluster
+    // gets the cells ColumnLayout gives it through ExtTextOutW's advances.
+    void paint_run_text(HDC dc, const editor::DrawList& list, const editor::DrawCommand& command, int x, int y) {
+        std::string_view text = list.run_text(command);
+        static_assert(sizeof(wchar_t) == sizeof(char16_t), "GDI text is UTF-16");
+        const auto& spans = list.spans();
+        size_t offset = 0;
+        for (uint32_t i = 0; i < command.span_count; ++i) {
+            const editor::ColorSpan& span = spans[command.span_offset + i];
+            const char* bytes = text.data() + offset;
+            SetTextColor(dc, RGB((span.color >> 16) & 0xFF, (span.color >> 8) & 0xFF, span.color & 0xFF));
+            if (command.x1 > 0 && editor::ColumnLayout::ascii_run(bytes, span.length) < span.length) {
+                int cells = layout_run_text(bytes, span.length, command.x1);
+                ExtTextOutW(dc, x, y, 0, nullptr, paint_text_.data(), (UINT)paint_text_.size(), paint_dx_.data());
+                x += cells * command.x1;
+            } else {
+                paint_text_.resize(span.length);
+                TextTranscode::widen_bytes(bytes, span.length, reinterpret_cast<char16_t*>(&paint_text_[0]));
+                ExtTextOutW(dc, x, y, 0, nullptr, paint_text_.data(), span.length, nullptr);
+                if (command.x1 > 0) {
+                    x += (int)span.length * command.x1;
+                } else {
+                    SIZE size{};
+                    GetTextExtentPoint32W(dc, paint_text_.data(), span.length, &size);
+                    x += size.cx;
+                }
+            }
+            offset += span.length;
+        }
+    }
+
+    // UTF-16 of text into paint_text_ with a cluster's advance on its first
+    // unit (marks after it draw over it); returns the cells taken
+    int layout_run_text(const char* text, size_t length, int advance) {
+        paint_text_.clear();
+        paint_dx_.clear();
+        size_t cell = 0;
+        for (size_t i = 0; i < length;) {
+            size_t cells = 0;
+            size_t end = editor::ColumnLayout::next_cluster(text, length, i, cell, editor::ColumnLayout::kDefaultTabWidth,
+                                                            cells);
+            bool first = true;
+            for (size_t k = i; k < end;) {
+                uint32_t codepoint = editor::ColumnLayout::decode(text, end, k);
+                if (codepoint >= 0x10000) {
+                    codepoint -= 0x10000;
+                    paint_text_.push_back((wchar_t)(0xD800 + (codepoint >> 10)));
+                    paint_text_.push_back((wchar_t)(0xDC00 + (codepoint & 0x3FF)));
+                    paint_dx_.push_back(first ? (INT)cells * advance : 0);
+                    paint_dx_.push_back(0);
+                } else {
+                    paint_text_.push_back((wchar_t)codepoint);
+                    paint_dx_.push_back(first ? (INT)cells * advance : 0);
+                }
+                first = false;
+            }
+            cell += cells;
+            i = end;
+        }
+        return (int)cell;
+    }
+
+    // A grid run over an opaque background as one blit from the line cache,
+    // drawing it into its slot first on a miss. False if it is not cacheable.
+    bool paint_cached_run(HDC dc, const editor::DrawList& list, const editor::DrawCommand& command) {
+        if (!line_cache_dc_ || command.color == 0 || command.x1 <= 0 || command.text_length == 0) return false;
+        std::string_view text = list.run_text(command);
+        int cells = (int)editor::ColumnLayout::display_width(text.data(), text.size());
+        int width = (std::min)(cells * command.x1, (int)line_cache_size_.cx);
+        bool hit = false;
+        size_t slot = line_cache_.acquire(editor::LineRunCache::key_of(list, command, command.color), hit);
+        int slot_y = (int)slot * char_height_;
+        if (!hit) {
+            RECT row{ 0, slot_y, width, slot_y + char_height_ };
+            SetDCBrushColor(line_cache_dc_, RGB((command.color >> 16) & 0xFF, (command.color >> 8) & 0xFF,
+                                                command.color & 0xFF));
+            FillRect(line_cache_dc_, &row, (HBRUSH)GetStockObject(DC_BRUSH));
+            paint_run_text(line_cache_dc_, list, command, 0, slot_y);
+        }
+        BitBlt(dc, command.x0, command.y0, width, char_height_, line_cache_dc_, 0, slot_y, SRCCOPY);
+        return true;
+    }
+
+    // Replays a recorded list into GDI. The DC brush and pen are recolored
+    // instead of creating a GDI object per primitive; runs are one blit
+    // from the line cache, or one ExtTextOutW per color span.
+    void paint_draw_list(HDC dc, const editor::DrawList& list) {
+        auto to_colorref = [](uint32_t argb) {
+            return RGB((argb >> 16) & 0xFF, (argb >> 8) & 0xFF, argb & 0xFF);
+        };
+        HBRUSH dc_brush = (HBRUSH)GetStockObject(DC_BRUSH);
+        HGDIOBJ old_pen = SelectObject(dc, GetStockObject(DC_PEN));
+        for (const editor::DrawCommand& command : list.commands()) {
+            switch (command.kind) {
+            case editor::DrawKind::Rect: {
+                RECT r{ command.x0, command.y0, command.x1, command.y1 };
+                SetDCBrushColor(dc, to_colorref(command.color));
+                FillRect(dc, &r, dc_brush);
+                break;
+            }
+            case editor::DrawKind::Line:
+                SetDCPenColor(dc, to_colorref(command.color));
+                MoveToEx(dc, command.x0, command.y0, nullptr);
+                LineTo(dc, command.x1, command.y1);
+                SetPixel(dc, command.x1, command.y1, to_colorref(command.color));   // LineTo stops short
+                break;
+            case editor::DrawKind::Run: {
+                if (!paint_cached_run(dc, list, command)) {
+                    paint_run_text(dc, list, command, command.x0, command.y0);
+                }
+                break;
+            }
+            }
+        }
+        SelectObject(dc, old_pen);
     }
 
     void render_pane(HDC memDC, const RECT& pane_rect, SplitPane& pane, bool is_active) {
-        // Clip rendering to pane bounds
-        HRGN clipRegion = CreateRectRgnIndirect(&pane_rect);
-        SelectClipRgn(memDC, clipRegion);
+        // Clip rendering to pane bounds (within the paint's damage)
+        if (!RectVisible(memDC, &pane_rect)) return;
+        SaveDC(memDC);
+        IntersectClipRect(memDC, pane_rect.left, pane_rect.top, pane_rect.right, pane_rect.bottom);
         
-        auto& doc = pane.document;
-        auto& vp = pane.viewport;
+        pane.view.update();
+        auto& doc = pane.view.document();
+        auto& vp = pane.view.viewport();
         
         auto visible_lines = vp.get_visible_lines();
         int y = pane_rect.top;
         size_t line_num = vp.get_top_line();
         
         // Calculate current line from cursor position
-        size_t current_line = 0;
-        size_t pos_counter = 0;
-        for (size_t i = 0; i < doc->get_line_count(); ++i) {
-            size_t line_len = doc->get_line(i).length() + 1;
-            if (pane.cursor_pos < pos_counter + line_len) {
-                current_line = i;
-                break;
-            }
-            pos_counter += line_len;
-        }
+        size_t current_line = doc->get_line_at(pane.view.cursor_pos);
         
         int text_x_offset = pane_rect.left;
         if (show_line_numbers_) {
             text_x_offset += 70;
         }
         
-        // Prepare incremental state up to pane's top visible line
-        SyntaxHighlighter::LineState pane_state{};
-        for (size_t li = 0; li < line_num; ++li) {
-            SyntaxHighlighter::LineState tmp{};
-            highlighter_->tokenize_line(doc->get_line(li), pane_state, tmp);
-            pane_state = tmp;
+        // Syntax tokens are cached per pane and computed in the background
+        if (!pane.highlight) {
+            pane.highlight = std::make_shared<HighlightCache>(highlighter_.get());
+            pane.highlight->set_background(true);
         }
+        pane.highlight->set_document(doc);
+        pane.highlight->schedule(line_num, visible_lines.size());
 
+        pane_draw_list_.clear();
         for (const auto& line : visible_lines) {
+            RECT row_rect{ pane_rect.left, y, pane_rect.right, y + char_height_ };
+            if (!RectVisible(memDC, &row_rect)) {
+                y += char_height_;
+                line_num++;
+                if (y >= pane_rect.bottom) break;
+                continue;
+            }
+            
             // Line numbers
             if (show_line_numbers_) {
-                std::wstring line_num_str;
-                if (relative_line_numbers_) {
-                    if (line_num == current_line) {
-                        line_num_str = std::to_wstring(line_num + 1);
-                    } else {
-                        size_t diff = (line_num > current_line) ? (line_num - current_line) : (current_line - line_num);
-                        line_num_str = std::to_wstring(diff);
-                    }
-                } else {
-                    line_num_str = std::to_wstring(line_num + 1);
+                size_t shown = line_num + 1;
+                if (relative_line_numbers_ && line_num != current_line) {
+                    shown = (line_num > current_line) ? (line_num - current_line) : (current_line - line_num);
                 }
+                char number[24];
+                int digits = snprintf(number, sizeof(number), "%zu", shown);
                 
-                RECT gutter_rect{ pane_rect.left, y, pane_rect.left + 70, y + char_height_ };
-                HBRUSH gutterBrush = CreateSolidBrush(RGB(35, 35, 45));
-                FillRect(memDC, &gutter_rect, gutterBrush);
-                DeleteObject(gutterBrush);
-                
-                SIZE num_sz{};
-                GetTextExtentPoint32W(memDC, line_num_str.c_str(), (int)line_num_str.length(), &num_sz);
-                int num_x = pane_rect.left + 70 - num_sz.cx - 4;
-                SetTextColor(memDC, RGB(100, 100, 120));
-                TextOutW(memDC, num_x, y, line_num_str.c_str(), (int)line_num_str.length());
+                pane_draw_list_.add_rect(pane_rect.left, y, 70, char_height_, to_argb(RGB(35, 35, 45)));
+                int num_x = pane_rect.left + 70 - digits * char_width_ - 4;
+                pane_draw_list_.add_text(std::string_view(number, digits), num_x, y, to_argb(RGB(100, 100, 120)),
+                                         char_width_);
                 
                 // Draw git diff indicators in gutter
-                if (git_manager_ && git_manager_->is_git_repository() && !current_file_.empty()) {
-                    auto diff_hunks = git_manager_->get_file_diff(current_file_);
-                    for (const auto& hunk : diff_hunks) {
-                        if (line_num >= hunk.start_line && line_num < hunk.start_line + hunk.line_count) {
-                            COLORREF bar_color;
-                            switch (hunk.type) {
-                                case GitDiffHunk::Type::Added:
-                                    bar_color = RGB(100, 255, 100);
-                                    break;
-                                case GitDiffHunk::Type::Modified:
-                                    bar_color = RGB(255, 200, 0);
-                                    break;
-                                case GitDiffHunk::Type::Deleted:
-                                    bar_color = RGB(255, 100, 100);
-                                    break;
-                            }
-                            RECT bar_rect{ pane_rect.left, y, pane_rect.left + 3, y + char_height_ };
-                            HBRUSH barBrush = CreateSolidBrush(bar_color);
-                            FillRect(memDC, &bar_rect, barBrush);
-                            DeleteObject(barBrush);
-                            break;
+                if (diff_gutter_ && doc == document_) {
+                    if (const GitDiffHunk* hunk = diff_gutter_->hunk_at(line_num)) {
+                        COLORREF bar_color;
+                        switch (hunk->type) {
+                            case GitDiffHunk::Type::Added:
+                                bar_color = RGB(100, 255, 100);
+                                break;
+                            case GitDiffHunk::Type::Modified:
+                                bar_color = RGB(255, 200, 0);
+                                break;
+                            case GitDiffHunk::Type::Deleted:
+                                bar_color = RGB(255, 100, 100);
+                                break;
                         }
+                        pane_draw_list_.add_rect(pane_rect.left, y, 3, char_height_, to_argb(bar_color));
                     }
                 }
             }
             
             // Current line highlighting
             if (is_active && line_num == current_line) {
-                RECT hl_rect{ text_x_offset, y, pane_rect.right - 10, y + char_height_ };
-                HBRUSH hlBrush = CreateSolidBrush(RGB(45, 45, 60));
-                FillRect(memDC, &hl_rect, hlBrush);
-                DeleteObject(hlBrush);
+                int hl_right = pane_rect.right - 10;
+                pane_draw_list_.add_rect(text_x_offset, y, hl_right - text_x_offset, char_height_, to_argb(RGB(45, 45, 60)));
             }
             
             // Calculate line position
-            size_t line_start_pos = 0;
-            for (size_t i = 0; i < line_num; ++i) {
-                line_start_pos += doc->get_line(i).length() + 1;
-            }
+            size_t line_start_pos = doc->get_line_start(line_num);
             
-            // Tokenize and render (incremental)
-            if (highlighter_) highlighter_->set_current_line_index(line_num);
-            SyntaxHighlighter::LineState st_out{};
-            auto tokens = highlighter_->tokenize_line(line, pane_state, st_out);
-            pane_state = st_out;
-            std::wstring wline;
-            for (size_t i = 0; i < line.length(); ++i) {
-                size_t char_pos = line_start_pos + i;
-                
-                // Selection highlighting
-                if (pane.has_selection && char_pos >= (std::min)(pane.selection_start, pane.selection_end) && 
-                    char_pos < (std::max)(pane.selection_start, pane.selection_end)) {
-                    RECT sel_rect = {
-                        static_cast<LONG>(text_x_offset + i * char_width_),
-                        y,
-                        static_cast<LONG>(text_x_offset + (i + 1) * char_width_),
-                        y + char_height_
-                    };
-                    HBRUSH selBrush = CreateSolidBrush(RGB(60, 60, 120));
-                    FillRect(memDC, &sel_rect, selBrush);
-                    DeleteObject(selBrush);
+            // Selection highlighting
+            bool plain_background = !(is_active && line_num == current_line);
+            // Compare: removed lines red on the left, added green on the right, changed amber on both
+            if (compare_active_) {
+                bool old_side = &pane == &pane1_;
+                if (const auto* hunk = editor::DiffEngine::hunk_at(compare_hunks_, line_num, old_side)) {
+                    COLORREF tint = hunk->old_count > 0 && hunk->new_count > 0 ? RGB(70, 60, 30)
+                                  : old_side ? RGB(75, 35, 35) : RGB(35, 70, 40);
+                    pane_draw_list_.add_rect(text_x_offset, y, pane_rect.right - text_x_offset, char_height_, to_argb(tint));
+                    plain_background = false;
                 }
-                
-                wline += static_cast<wchar_t>(line[i]);
             }
-            
-            // Render with syntax highlighting
-            size_t last_pos = 0;
-            for (const auto& token : tokens) {
-                if (token.start > last_pos) {
-                    SetTextColor(memDC, RGB(220, 220, 220));
-                    std::wstring segment = wline.substr(last_pos, token.start - last_pos);
-                    TextOutW(memDC, text_x_offset + last_pos * char_width_, y, segment.c_str(), segment.length());
-                }
-                
-                SetTextColor(memDC, token.get_color());
-                std::wstring segment = wline.substr(token.start, token.length);
-                TextOutW(memDC, text_x_offset + token.start * char_width_, y, segment.c_str(), segment.length());
-                
-                last_pos = token.start + token.length;
+            const DocumentView& view = pane.view;
+            if (view.has_selection &&
+                add_selection_rect(vp.column_layout().line(line_num), 0, line_start_pos, line.length(),
+                                   (std::min)(view.selection_start, view.selection_end),
+                                   (std::max)(view.selection_start, view.selection_end), text_x_offset, y)) {
+                plain_background = false;
             }
             
-            if (last_pos < wline.length()) {
-                SetTextColor(memDC, RGB(220, 220, 220));
-                std::wstring segment = wline.substr(last_pos);
-                TextOutW(memDC, text_x_offset + last_pos * char_width_, y, segment.c_str(), segment.length());
-            }
+            // Cached tokens for this line (plain text until ready)
+            const auto& tokens = pane.highlight->get_ready_tokens(line_num);
+            add_line_run(line, tokens, text_x_offset, y, plain_background, vp.column_layout(), line_num);
             
             // Draw cursor if active pane
             if (cursor_visible_ && is_active && line_num == current_line) {
-                size_t cursor_col = pane.cursor_pos - line_start_pos;
+                size_t cursor_col = pane.view.cursor_pos - line_start_pos;
                 if (cursor_col <= line.length()) {
-                    HPEN cursorPen = CreatePen(PS_SOLID, 2, RGB(255, 255, 0));
-                    HPEN oldPen = (HPEN)SelectObject(memDC, cursorPen);
-                    
-                    int cursor_x = text_x_offset + cursor_col * char_width_;
-                    MoveToEx(memDC, cursor_x, y, nullptr);
-                    LineTo(memDC, cursor_x, y + char_height_);
-                    
-                    SelectObject(memDC, oldPen);
-                    DeleteObject(cursorPen);
+                    int cursor_x = text_x_offset + column_x(vp, line_num, 0, cursor_col);
+                    pane_draw_list_.add_rect(cursor_x - 1, y, 2, char_height_, to_argb(RGB(255, 255, 0)));
                 }
             }
             
@@ -2172,45 +3706,42 @@ private:
             
             if (y >= pane_rect.bottom) break;
         }
+        paint_draw_list(memDC, pane_draw_list_);
         
         // Draw active pane indicator border
         if (is_active) {
-            HPEN activePen = CreatePen(PS_SOLID, 2, RGB(80, 160, 255));
+            HPEN activePen = gdi_.pen(RGB(80, 160, 255), 2);
             HPEN oldPen = (HPEN)SelectObject(memDC, activePen);
             HBRUSH oldBrush = (HBRUSH)SelectObject(memDC, GetStockObject(NULL_BRUSH));
             Rectangle(memDC, pane_rect.left, pane_rect.top, pane_rect.right, pane_rect.bottom);
             SelectObject(memDC, oldPen);
             SelectObject(memDC, oldBrush);
-            DeleteObject(activePen);
         }
         
-        // Reset clip region
-        SelectClipRgn(memDC, nullptr);
-        DeleteObject(clipRegion);
+        // Restore the paint's clip region
+        RestoreDC(memDC, -1);
     }
 
     void render_project_search_panel(HDC hdc, const RECT& client_rect) {
         RECT panel{ 10, client_rect.bottom - results_panel_height_, client_rect.right - 10, client_rect.bottom - 10 };
-        HBRUSH bg = CreateSolidBrush(RGB(24, 24, 30));
-        FillRect(hdc, &panel, bg); DeleteObject(bg);
-        HPEN pen = CreatePen(PS_SOLID, 1, RGB(80, 80, 100));
+        HBRUSH bg = gdi_.brush(RGB(24, 24, 30));
+        FillRect(hdc, &panel, bg);
+        HPEN pen = gdi_.pen(RGB(80, 80, 100));
         HPEN oldPen = (HPEN)SelectObject(hdc, pen);
         HBRUSH oldBrush = (HBRUSH)SelectObject(hdc, GetStockObject(NULL_BRUSH));
         Rectangle(hdc, panel.left, panel.top, panel.right, panel.bottom);
-        SelectObject(hdc, oldPen); DeleteObject(pen); SelectObject(hdc, oldBrush);
+        SelectObject(hdc, oldPen); SelectObject(hdc, oldBrush);
 
         SetTextColor(hdc, RGB(200, 200, 220));
-        HFONT smallFont = CreateFontW(14, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE,
-            DEFAULT_CHARSET, OUT_DEFAULT_PRECIS, CLIP_DEFAULT_PRECIS,
-            CLEARTYPE_QUALITY, FIXED_PITCH | FF_MODERN, L"Consolas");
+        HFONT smallFont = gdi_.font(14);
         HFONT oldFont = (HFONT)SelectObject(hdc, smallFont);
 
         int x = panel.left + 10; int y = panel.top + 10;
         auto draw_label = [&](const wchar_t* w, int& yy){ RECT r{ x, yy, panel.right - 10, yy + 18 }; DrawTextW(hdc, w, -1, &r, DT_LEFT | DT_TOP); yy += 18; };
         auto draw_input = [&](const std::string& s, bool focused, int& yy){
             RECT r{ x, yy, panel.right - 10, yy + 22 };
-            HBRUSH ib = CreateSolidBrush(focused ? RGB(40, 40, 60) : RGB(30, 30, 40));
-            FillRect(hdc, &r, ib); DeleteObject(ib);
+            HBRUSH ib = gdi_.brush(focused ? RGB(40, 40, 60) : RGB(30, 30, 40));
+            FillRect(hdc, &r, ib);
             std::wstring ws; for (char c : s) ws += (wchar_t)c;
             r.left += 6; DrawTextW(hdc, ws.c_str(), -1, &r, DT_LEFT | DT_VCENTER | DT_SINGLELINE);
             yy += 26;
@@ -2225,59 +3756,47 @@ private:
         // Results area header
         int results_top = y + 4;
         RECT sep{ panel.left + 4, results_top, panel.right - 4, results_top + 1 };
-        HBRUSH sb = CreateSolidBrush(RGB(60, 60, 80)); FillRect(hdc, &sep, sb); DeleteObject(sb);
+        HBRUSH sb = gdi_.brush(RGB(60, 60, 80)); FillRect(hdc, &sep, sb);
 
         // Results info
-        std::wstring info;
-        if (project_search_in_progress_) info = L"Searching...";
-        else {
-            std::lock_guard<std::mutex> lock(project_results_mutex_);
-            info = L"Results: "; info += std::to_wstring(project_results_.size());
-        }
+        std::wstring info = project_search_in_progress_ ? L"Searching... " : L"Results: ";
+        info += std::to_wstring(project_results_.size());
+        if (project_search_in_progress_) info += L" so far";
         RECT ir{ panel.left + 8, results_top + 6, panel.right - 10, results_top + 28 };
         DrawTextW(hdc, info.c_str(), -1, &ir, DT_LEFT | DT_TOP);
 
-        // Results list grouped by file
+        // Only the rows that fit are fetched, previews included
         int list_top = results_top + 28;
         int row_h = char_height_ + 4;
+        size_t visible = (size_t)(std::max)(0, (int)(panel.bottom - 8 - list_top) / row_h);
+        size_t row_count = project_results_.row_count();
+        project_results_top_ = (std::min)(project_results_top_, row_count > visible ? row_count - visible : 0);
+        project_results_.rows(project_results_top_, visible, result_rows_);
         result_rows_layout_.clear();
         int draw_y = list_top;
-        {
-            std::lock_guard<std::mutex> lock(project_results_mutex_);
-            // Group by file
-            std::map<std::string, std::vector<int>> groups;
-            for (int i = 0; i < (int)project_results_.size(); ++i) {
-                groups[project_results_[i].file_path].push_back(i);
-            }
-            for (auto& kv : groups) {
-                // Header
-                std::wstring wfile; for (char c : kv.first) wfile += (wchar_t)c;
+        for (const auto& r : result_rows_) {
+            if (r.header) {
+                std::wstring wfile; for (char c : r.path) wfile += (wchar_t)c;
                 SetTextColor(hdc, RGB(160, 200, 255));
                 RECT hr{ panel.left + 8, draw_y, panel.right - 10, draw_y + row_h };
                 DrawTextW(hdc, wfile.c_str(), -1, &hr, DT_LEFT | DT_VCENTER | DT_SINGLELINE);
-                result_rows_layout_.push_back(ResultRow{ true, kv.first, -1 });
-                draw_y += row_h;
-                // Items
+                result_rows_layout_.push_back(ResultRow{ true, r.path, -1 });
+            } else {
                 SetTextColor(hdc, RGB(220, 220, 220));
-                for (int idx : kv.second) {
-                    const auto& r = project_results_[idx];
-                    std::wostringstream line;
-                    line << (r.line + 1) << L":" << (r.column + 1) << L"  ";
-                    std::wstring wline; for (char c : r.line_text) wline += (wchar_t)c;
-                    std::wstring ws = line.str() + wline;
-                    RECT rr{ panel.left + 26, draw_y, panel.right - 10, draw_y + row_h };
-                    if (idx == selected_result_index_) {
-                        HBRUSH sel = CreateSolidBrush(RGB(50, 70, 110)); FillRect(hdc, &rr, sel); DeleteObject(sel);
-                    }
-                    DrawTextW(hdc, ws.c_str(), -1, &rr, DT_LEFT | DT_VCENTER | DT_SINGLELINE | DT_END_ELLIPSIS);
-                    result_rows_layout_.push_back(ResultRow{ false, kv.first, idx });
-                    draw_y += row_h;
-                    if (draw_y > panel.bottom - 8) break; // clip
+                std::wostringstream line;
+                line << (r.line + 1) << L":" << (r.column + 1) << L"  ";
+                std::wstring wline; for (char c : r.text) wline += (wchar_t)c;
+                std::wstring ws = line.str() + wline;
+                RECT rr{ panel.left + 26, draw_y, panel.right - 10, draw_y + row_h };
+                if ((int)r.result == selected_result_index_) {
+                    HBRUSH sel = gdi_.brush(RGB(50, 70, 110)); FillRect(hdc, &rr, sel);
                 }
-                if (draw_y > panel.bottom - 8) break;
+                DrawTextW(hdc, ws.c_str(), -1, &rr, DT_LEFT | DT_VCENTER | DT_SINGLELINE | DT_END_ELLIPSIS);
+                result_rows_layout_.push_back(ResultRow{ false, r.path, (int)r.result });
             }
+            draw_y += row_h;
         }
-        SelectObject(hdc, oldFont); DeleteObject(smallFont);
+        SelectObject(hdc, oldFont);
     }
 
     void mark_active_tab_modified() {
@@ -2347,64 +3866,30 @@ private:
             std::string str(1, c);
             
             if (multi_cursor_mode_ && !extra_cursors_.empty()) {
-                // Multi-cursor insertion - sort cursors and insert from end to start
-                std::vector<size_t> all_cursors = extra_cursors_;
-                all_cursors.push_back(cursor_pos_);
-                std::sort(all_cursors.begin(), all_cursors.end(), std::greater<size_t>());
-                
-                // Remove duplicates
-                all_cursors.erase(std::unique(all_cursors.begin(), all_cursors.end()), all_cursors.end());
-                
-                // Insert at each cursor from end to start
-                for (size_t pos : all_cursors) {
-                    auto cmd = std::make_unique<InsertCommand>(document_.get(), pos, str);
-                    undo_manager_->execute(std::move(cmd));
-                }
-                
-                // Update all cursor positions
-                cursor_pos_++;
-                for (size_t& pos : extra_cursors_) {
-                    pos++;
-                }
+                edit_at_cursors(0, str);
             } else {
-                // Single cursor insertion
+                // Single cursor insertion - consecutive keystrokes undo as one step
                 auto cmd = std::make_unique<InsertCommand>(document_.get(), cursor_pos_, str);
-                undo_manager_->execute(std::move(cmd));
+                undo_manager_->execute(std::move(cmd), true);
                 cursor_pos_++;
             }
             
             is_modified_ = true;
             mark_active_tab_modified();
             
-            // Notify LSP of document change
-            if (lsp_client_ && !current_file_.empty()) {
-                lsp_client_->did_change(
-                    "file:///" + current_file_,
-                    document_->get_text(0, document_->get_total_length())
-                );
-            }
-            
             // Reset cursor blink
             cursor_visible_ = true;
             cursor_blink_time_ = 0;
 
-            // Update autocomplete cache on insert
-            if (autocomplete_) autocomplete_->on_text_inserted(str);
-
             // Autocomplete trigger: only when single cursor and identifier characters
             auto is_ident_char = [](char chx){ unsigned char uc = (unsigned char)chx; return std::isalnum(uc) || chx == '_'; };
             auto is_ident_start = [](char chx){ unsigned char uc = (unsigned char)chx; return std::isalpha(uc) || chx == '_'; };
             if (!multi_cursor_mode_ && is_ident_char(c)) {
                 // Determine line and column and build prefix
-                size_t pos = 0, line_index = 0, line_start = 0;
-                for (size_t i = 0; i < document_->get_line_count(); ++i) {
-                    std::string line = document_->get_line(i);
-                    size_t line_len = line.length() + 1; // +1 for newline
-                    if (pos + line_len > cursor_pos_) { line_index = i; line_start = pos; break; }
-                    pos += line_len;
-                }
+                PieceTable::LineColumn at = document_->offset_to_line_col(cursor_pos_);
+                size_t line_index = at.line, line_start = cursor_pos_ - at.column;
                 std::string line = document_->get_line(line_index);
-                size_t col = cursor_pos_ - line_start; // after insertion
+                size_t col = at.column; // after insertion
                 // Scan left to find start of identifier
                 size_t start = (col == 0) ? 0 : col - 1;
                 while (start > 0 && is_ident_char(line[start-1])) start--;
@@ -2412,12 +3897,15 @@ private:
                     std::string prefix = line.substr(start, (std::min)(col, line.size()) - start);
                     if (prefix.size() >= 2) {
                         // Try LSP completion first
-                        if (lsp_client_ && use_lsp_completion_ && !current_file_.empty()) {
+                        LSPClient* lsp = use_lsp_completion_ && use_feature(editor::LargeFileFeature::LanguageServer)
+                            ? active_lsp() : nullptr;
+                        if (lsp) {
                             // Request completion from LSP server
-                            lsp_client_->request_completion(
+                            flush_lsp_changes();
+                            lsp->request_completion(
                                 "file:///" + current_file_,
                                 (int)line_index,
-                                (int)col,
+                                (int)document_->offset_to_line_utf16(cursor_pos_).column,
                                 [this, line_start, start](const std::vector<LSPClient::CompletionItem>& completions) {
                                     if (!completions.empty()) {
                                         autocomplete_items_.clear();
@@ -2430,7 +3918,7 @@ private:
                                     }
                                 }
                             );
-                        } else if (autocomplete_) {
+                        } else if (autocomplete_ && use_feature(editor::LargeFileFeature::Autocomplete)) {
                             // Fallback to word-based completion
                             auto items = autocomplete_->suggest(prefix);
                             // Remove exact-match duplicate
@@ -2461,7 +3949,7 @@ private:
     
     void on_mouse_click(int x, int y) {
         // Check minimap click first
-        if (minimap_ && minimap_->is_visible() && split_mode_ == SplitMode::None) {
+        if (minimap_shown() && split_mode_ == SplitMode::None) {
             RECT client_rect; 
             GetClientRect(hwnd_, &client_rect);
             int minimap_width = minimap_->get_width();
@@ -2524,7 +4012,7 @@ private:
         int gutter_left = get_content_left();
         if (show_line_numbers_ && x >= gutter_left && x < gutter_left + 20) {
             int line_index = (y - get_content_top()) / char_height_;
-            size_t clicked_line = viewport_.get_top_line() + line_index;
+            size_t clicked_line = viewport_.document_line_at(line_index);
             if (clicked_line < document_->get_line_count() && folding_manager_) {
                 if (folding_manager_->toggle_fold(clicked_line)) {
                     InvalidateRect(hwnd_, nullptr, TRUE);
@@ -2535,29 +4023,9 @@ private:
         
         if (x < text_offset) return; // Clicked on line numbers area or margin
         
-        int line_index = (y - get_content_top()) / char_height_;
-        size_t clicked_line = viewport_.get_top_line() + line_index;
-        
-        if (clicked_line >= document_->get_line_count()) {
-            clicked_line = document_->get_line_count() > 0 ? document_->get_line_count() - 1 : 0;
-        }
-        
-        // Calculate column using actual character width
-        int col_index = (x - text_offset) / char_width_;
-        if (col_index < 0) col_index = 0;
-        
-        // Get the line content to check bounds
-        std::string line = document_->get_line(clicked_line);
-        if (col_index > static_cast<int>(line.length())) {
-            col_index = line.length();
-        }
-        
-        // Calculate cursor position in document
-        size_t clicked_pos = 0;
-        for (size_t i = 0; i < clicked_line; ++i) {
-            clicked_pos += document_->get_line(i).length() + 1; // +1 for newline
-        }
-        clicked_pos += col_index;
+        size_t clicked_line = 0;
+        size_t col_index = 0;
+        size_t clicked_pos = hit_test(x - text_offset, y - get_content_top(), clicked_line, col_index);
         
         // Clamp to document bounds
         if (clicked_pos > document_->get_total_length()) {
@@ -2599,27 +4067,9 @@ private:
         int text_offset = (show_line_numbers_ ? 70 : 0) + get_content_left();
         if (x < text_offset) return;
         
-        int line_index = (y - get_content_top()) / char_height_;
-        size_t clicked_line = viewport_.get_top_line() + line_index;
-        
-        if (clicked_line >= document_->get_line_count()) {
-            clicked_line = document_->get_line_count() > 0 ? document_->get_line_count() - 1 : 0;
-        }
-        
-        int col_index = (x - text_offset) / char_width_;
-        if (col_index < 0) col_index = 0;
-        
-        std::string line = document_->get_line(clicked_line);
-        if (col_index > static_cast<int>(line.length())) {
-            col_index = line.length();
-        }
-        
-        // Calculate new cursor position
-        size_t new_pos = 0;
-        for (size_t i = 0; i < clicked_line; ++i) {
-            new_pos += document_->get_line(i).length() + 1;
-        }
-        new_pos += col_index;
+        size_t clicked_line = 0;
+        size_t col_index = 0;
+        size_t new_pos = hit_test(x - text_offset, y - get_content_top(), clicked_line, col_index);
         
         // Check for column selection mode (Alt+Shift)
         bool column_mode = (GetKeyState(VK_MENU) & 0x8000) && (GetKeyState(VK_SHIFT) & 0x8000);
@@ -2639,10 +4089,7 @@ private:
             multi_cursor_mode_ = true;
             
             for (size_t l = start_line; l <= end_line && l < document_->get_line_count(); ++l) {
-                size_t line_pos = 0;
-                for (size_t i = 0; i < l; ++i) {
-                    line_pos += document_->get_line(i).length() + 1;
-                }
+                size_t line_pos = document_->line_col_to_offset(l, 0);
                 
                 std::string line_text = document_->get_line(l);
                 size_t actual_col = (std::min)(end_col, line_text.length());
@@ -2688,18 +4135,23 @@ private:
         }
 
         if (key == VK_ESCAPE) {
-            if (show_project_search_) {
+            if (transform_running_) {
+                transform_cancel_.cancel();
+                transform_running_ = false;
+                show_status_message(L"Transform cancelled", 1500);
+                return;
+            } else if (show_project_search_) {
                 show_project_search_ = false;
                 return;
             } else if (show_find_) {
                 show_find_ = false;
                 find_text_ = "";
-                find_dialog_->clear_matches();
+                clear_find_matches();
             } else if (show_replace_) {
                 show_replace_ = false;
                 find_text_ = "";
                 replace_text_ = "";
-                find_dialog_->clear_matches();
+                clear_find_matches();
             } else if (multi_cursor_mode_) {
                 // Clear multi-cursor mode
                 multi_cursor_mode_ = false;
@@ -2729,7 +4181,7 @@ private:
                     if (!find_text_.empty()) {
                         perform_find();
                     } else {
-                        find_dialog_->clear_matches();
+                        clear_find_matches();
                     }
                 }
                 return;
@@ -2742,7 +4194,7 @@ private:
                         if (!find_text_.empty()) {
                             perform_find();
                         } else {
-                            find_dialog_->clear_matches();
+                            clear_find_matches();
                         }
                     }
                 } else {
@@ -2753,10 +4205,13 @@ private:
                         is_modified_ = true;
                         mark_active_tab_modified();
             
-            if (cursor_pos_ > 0) {
+            if (multi_cursor_mode_ && !extra_cursors_.empty()) {
+                edit_at_cursors(1, "");
+                update_title();
+            } else if (cursor_pos_ > 0) {
                 // Use undo manager for deletion
                 auto cmd = std::make_unique<DeleteCommand>(document_.get(), cursor_pos_ - 1, 1);
-                undo_manager_->execute(std::move(cmd));
+                undo_manager_->execute(std::move(cmd), true);
                 cursor_pos_--;
                 is_modified_ = true;
                 is_modified_ = true;
@@ -2768,7 +4223,7 @@ private:
             if (cursor_pos_ < document_->get_total_length()) {
                 // Use undo manager for deletion
                 auto cmd = std::make_unique<DeleteCommand>(document_.get(), cursor_pos_, 1);
-                undo_manager_->execute(std::move(cmd));
+                undo_manager_->execute(std::move(cmd), true);
                 is_modified_ = true;
                 mark_active_tab_modified();
                 update_title();
@@ -2793,10 +4248,24 @@ private:
             }
         }
         else if (key == VK_LEFT) {
-            if (cursor_pos_ > 0) cursor_pos_--;
+            // A cluster at a time (a base and its marks, a wide character)
+            size_t line = get_cursor_line();
+            size_t column = cursor_pos_ - document_->get_line_start(line);
+            if (column > 0) {
+                cursor_pos_ -= column - viewport_.column_layout().line(line).prev_boundary(column);
+            } else if (cursor_pos_ > 0) {
+                cursor_pos_--;
+            }
         }
         else if (key == VK_RIGHT) {
-            if (cursor_pos_ < document_->get_total_length()) cursor_pos_++;
+            size_t line = get_cursor_line();
+            size_t column = cursor_pos_ - document_->get_line_start(line);
+            const auto& map = viewport_.column_layout().line(line);
+            if (column < map.bytes) {
+                cursor_pos_ += map.next_boundary(column) - column;
+            } else if (cursor_pos_ < document_->get_total_length()) {
+                cursor_pos_++;
+            }
         }
         else if (key == VK_UP) {
             scroll_view_up(1);
@@ -2820,7 +4289,7 @@ private:
         else if (key == VK_OEM_4 && (GetKeyState(VK_CONTROL) & 0x8000) && (GetKeyState(VK_SHIFT) & 0x8000)) {
             // Ctrl+Shift+[ - Fold region at cursor
             size_t line = get_cursor_line();
-            if (folding_manager_->toggle_fold(line)) {
+            if (use_feature(editor::LargeFileFeature::Folding) && folding_manager_->toggle_fold(line)) {
                 InvalidateRect(hwnd_, nullptr, TRUE);
             }
         }
@@ -2832,7 +4301,7 @@ private:
         }
         else if (key == L'0' && (GetKeyState(VK_CONTROL) & 0x8000) && (GetKeyState(VK_MENU) & 0x8000)) {
             // Ctrl+Alt+0 - Fold all (using Alt instead of K for simplicity)
-            folding_manager_->fold_all();
+            if (use_feature(editor::LargeFileFeature::Folding)) folding_manager_->fold_all();
             InvalidateRect(hwnd_, nullptr, TRUE);
         }
         else if (key == L'9' && (GetKeyState(VK_CONTROL) & 0x8000) && (GetKeyState(VK_MENU) & 0x8000)) {
@@ -2840,6 +4309,18 @@ private:
             folding_manager_->unfold_all();
             InvalidateRect(hwnd_, nullptr, TRUE);
         }
+        else if (key == L'B' && (GetKeyState(VK_CONTROL) & 0x8000) && (GetKeyState(VK_MENU) & 0x8000)) {
+            // Ctrl+Alt+B - Toggle blame annotations
+            if (blame_cache_) {
+                show_blame_ = !show_blame_;
+                show_status_message(show_blame_ ? L"Blame: on" : L"Blame: off", 1500);
+                invalidate_rect(text_area_rect());
+            }
+        }
+        else if (key == L'F' && (GetKeyState(VK_CONTROL) & 0x8000) && (GetKeyState(VK_MENU) & 0x8000)) {
+            // Ctrl+Alt+F - Follow the file as it grows (tail -f)
+            toggle_follow();
+        }
         else if (key == L'F' && (GetKeyState(VK_CONTROL) & 0x8000) && (GetKeyState(VK_SHIFT) & 0x8000)) {
             // Ctrl+Shift+F - Toggle Project-wide Search panel
             show_project_search_ = !show_project_search_;
@@ -2889,7 +4370,7 @@ private:
         }
         else if (key == L'T' && (GetKeyState(VK_CONTROL) & 0x8000) && (GetKeyState(VK_SHIFT) & 0x8000)) {
             // Ctrl+Shift+T - Toggle Tree-sitter preference (if integrated)
-            if (highlighter_) {
+            if (highlighter_ && use_feature(editor::LargeFileFeature::TreeSitter)) {
                 bool cur = highlighter_->get_prefer_treesitter();
                 highlighter_->set_prefer_treesitter(!cur);
                 InvalidateRect(hwnd_, nullptr, FALSE);
@@ -2903,7 +4384,7 @@ private:
             show_replace_ = false;
             if (show_find_) {
                 find_text_.clear();
-                find_dialog_->clear_matches();
+                clear_find_matches();
             }
         }
         else if (key == L'G' && (GetKeyState(VK_CONTROL) & 0x8000) && (GetKeyState(VK_SHIFT) & 0x8000)) {
@@ -2921,8 +4402,9 @@ private:
         else if (key == VK_OEM_3 && (GetKeyState(VK_CONTROL) & 0x8000)) {
             // Ctrl+` - Toggle terminal
             show_terminal_ = !show_terminal_;
-            if (show_terminal_ && !terminal_->is_running()) {
-                terminal_->start_shell("powershell.exe");
+            if (show_terminal_) {
+                resize_terminal_to_panel();
+                if (!terminal_->is_running()) terminal_->start_shell("powershell.exe");
             }
             InvalidateRect(hwnd_, nullptr, TRUE);
         }
@@ -2933,7 +4415,7 @@ private:
             if (show_replace_) {
                 find_text_.clear();
                 replace_text_.clear();
-                find_dialog_->clear_matches();
+                clear_find_matches();
             }
         }
         else if (key == L'A' && (GetKeyState(VK_CONTROL) & 0x8000)) {
@@ -2946,22 +4428,21 @@ private:
             multi_cursor_mode_ = false;
             extra_cursors_.clear();
         }
+        else if (key == L'D' && (GetKeyState(VK_CONTROL) & 0x8000) && (GetKeyState(VK_SHIFT) & 0x8000)) {
+            // Ctrl+Shift+D - Compare with a file side by side
+            compare_with_file();
+        }
         else if (key == L'D' && (GetKeyState(VK_CONTROL) & 0x8000) && !(GetKeyState(VK_SHIFT) & 0x8000)) {
             // Ctrl+D - Add next occurrence to multi-cursor
             if (has_selection_) {
                 std::string selected = get_selected_text();
                 if (!selected.empty()) {
-                    // Build document text
-                    std::string doc_text;
-                    for (size_t i = 0; i < document_->get_line_count(); ++i) {
-                        doc_text += document_->get_line(i) + "\n";
-                    }
-                    
                     // Find next occurrence after current selection
-                    size_t search_start = get_selection_end();
-                    size_t pos = doc_text.find(selected, search_start);
-                    
-                    if (pos != std::string::npos) {
+                    FindDialog exact;
+                    exact.set_case_sensitive(true);
+                    SearchMatch match;
+                    if (exact.find_next(*document_, selected, get_selection_end(), match)) {
+                        size_t pos = match.position;
                         // Enable multi-cursor mode
                         multi_cursor_mode_ = true;
                         
@@ -2981,17 +4462,7 @@ private:
                         has_selection_ = true;
                         
                         // Scroll to new cursor
-                        size_t line = 0;
-                        size_t char_count = 0;
-                        for (size_t i = 0; i < document_->get_line_count(); ++i) {
-                            size_t line_len = document_->get_line(i).length() + 1;
-                            if (char_count + line_len > pos) {
-                                line = i;
-                                break;
-                            }
-                            char_count += line_len;
-                        }
-                        viewport_.scroll_to_line(line);
+                        viewport_.scroll_to_line(match.line);
                     }
                 }
             } else {
@@ -3004,18 +4475,12 @@ private:
             if (has_selection_) {
                 std::string selected = get_selected_text();
                 if (!selected.empty()) {
-                    // Build document text
-                    std::string doc_text;
-                    for (size_t i = 0; i < document_->get_line_count(); ++i) {
-                        doc_text += document_->get_line(i) + "\n";
-                    }
-                    
                     // Find all occurrences
+                    FindDialog exact;
+                    exact.set_case_sensitive(true);
                     extra_cursors_.clear();
-                    size_t pos = 0;
-                    while ((pos = doc_text.find(selected, pos)) != std::string::npos) {
-                        extra_cursors_.push_back(pos + selected.length());
-                        pos += selected.length();
+                    for (const SearchMatch& match : exact.find_all(*document_, selected)) {
+                        extra_cursors_.push_back(match.position + match.length);
                     }
                     
                     if (!extra_cursors_.empty()) {
@@ -3039,7 +4504,6 @@ private:
         else if (key == L'V' && (GetKeyState(VK_CONTROL) & 0x8000)) {
             // Ctrl+V - Paste
             paste_from_clipboard();
-            if (autocomplete_) autocomplete_->rebuild_from_document(document_);
         }
         else if (key == L'R' && (GetKeyState(VK_CONTROL) & 0x8000) && !(GetKeyState(VK_SHIFT) & 0x8000)) {
             // Ctrl+R - Replace current match (in replace mode)
@@ -3067,25 +4531,23 @@ private:
         else if (key == L'R' && (GetKeyState(VK_CONTROL) & 0x8000) && (GetKeyState(VK_SHIFT) & 0x8000)) {
             // Ctrl+Shift+R - Replace All
             if (show_replace_ && !find_text_.empty()) {
-                // Build full document text
-                std::string doc_text;
-                for (size_t i = 0; i < document_->get_line_count(); ++i) {
-                    doc_text += document_->get_line(i) + "\n";
-                }
-                int replaced = find_dialog_->replace_all(doc_text, find_text_, replace_text_);
+                // Edit the matches in place, back to front, as one undo step;
+                // the session stops tracking edits until the new search
+                auto matches = find_dialog_->find_all(*document_, find_text_);
+                search_session_->set_query("");
+                int replaced = static_cast<int>(matches.size());
                 if (replaced > 0) {
-                    // Replace document content
-                    document_ = std::make_shared<PieceTable>(doc_text);
-                    viewport_.set_document(document_);
+                    undo_manager_->begin_transaction(document_.get());
+                    for (auto it = matches.rbegin(); it != matches.rend(); ++it) {
+                        undo_manager_->execute(std::make_unique<DeleteCommand>(document_.get(), it->position, it->length));
+                        if (!replace_text_.empty()) {
+                            undo_manager_->execute(std::make_unique<InsertCommand>(document_.get(), it->position, replace_text_));
+                        }
+                    }
+                    undo_manager_->commit_transaction();
                     cursor_pos_ = 0;
                     is_modified_ = true;
                     mark_active_tab_modified();
-                    if (tab_manager_) {
-                        if (auto* tab = tab_manager_->get_active_tab()) {
-                            tab->document = document_;
-                        }
-                    }
-                    if (autocomplete_) autocomplete_->rebuild_from_document(document_);
                     // Refresh matches
                     perform_find();
                     update_title();
@@ -3108,16 +4570,35 @@ private:
                 }
             }
         }
+        else if (key == VK_F1 && (GetKeyState(VK_CONTROL) & 0x8000)) {
+            // Ctrl+F1 - Memory report
+            show_memory_report();
+        }
+        else if (key == VK_F1 && (GetKeyState(VK_SHIFT) & 0x8000)) {
+            // Shift+F1 - Toggle performance HUD
+            show_perf_hud_ = !show_perf_hud_;
+            InvalidateRect(hwnd_, nullptr, FALSE);
+        }
         else if (key == VK_F1) {
             show_stats_ = !show_stats_;
         }
         else if (key == VK_F2) {
             show_line_numbers_ = !show_line_numbers_;
         }
+        else if (key == L'Z' && (GetKeyState(VK_CONTROL) & 0x8000) && (GetKeyState(VK_MENU) & 0x8000)) {
+            // Ctrl+Alt+Z - Toggle soft wrap
+            viewport_.set_soft_wrap(!viewport_.is_soft_wrap());
+            update_viewport_size();
+            InvalidateRect(hwnd_, nullptr, FALSE);
+        }
         else if (key == L'M' && (GetKeyState(VK_CONTROL) & 0x8000)) {
-            // Ctrl+M - Toggle minimap
+            // Ctrl+M - Toggle minimap; on a large file that hides it, asks for it
             if (minimap_) {
-                minimap_->set_visible(!minimap_->is_visible());
+                if (minimap_shown() || large_file_.allows(editor::LargeFileFeature::Minimap)) {
+                    minimap_->set_visible(!minimap_->is_visible());
+                } else {
+                    minimap_->set_visible(use_feature(editor::LargeFileFeature::Minimap) || minimap_->is_visible());
+                }
                 InvalidateRect(hwnd_, nullptr, TRUE);
             }
         }
@@ -3143,6 +4624,16 @@ private:
             }
             InvalidateRect(hwnd_, nullptr, TRUE);
         }
+        else if (key == VK_F9) {
+            // F9 - Sort lines, Shift+F9 - Remove duplicate lines,
+            // Ctrl+F9 - Format JSON, Ctrl+Shift+F9 - Reindent per the workspace
+            bool ctrl = GetKeyState(VK_CONTROL) & 0x8000;
+            bool shift = GetKeyState(VK_SHIFT) & 0x8000;
+            if (ctrl && shift) run_transform(editor::DocumentTransform::reindent(tab_size_, use_spaces_));
+            else if (ctrl) run_transform(editor::DocumentTransform::pretty_json());
+            else if (shift) run_transform(editor::DocumentTransform::unique_lines());
+            else run_transform(editor::DocumentTransform::sort_lines());
+        }
         else if (key == VK_F5) {
             // Toggle relative line numbers  
             relative_line_numbers_ = !relative_line_numbers_;
@@ -3151,13 +4642,17 @@ private:
             // F12 - Go to definition / Shift+F12 - Find references
             bool shift = GetKeyState(VK_SHIFT) & 0x8000;
             
-            if (lsp_client_ && !current_file_.empty()) {
-                size_t line_idx = get_cursor_line();
-                size_t col_idx = get_cursor_column();
+            LSPClient* lsp = active_lsp();
+            if (lsp) {
+                // LSP columns count UTF-16 code units
+                PieceTable::LineColumn at = document_->offset_to_line_utf16(cursor_pos_);
+                size_t line_idx = at.line;
+                size_t col_idx = at.column;
                 
                 if (shift) {
                     // Find all references
-                    lsp_client_->request_references(
+                    flush_lsp_changes();
+                    lsp->request_references(
                         "file:///" + current_file_,
                         (int)line_idx,
                         (int)col_idx,
@@ -3183,12 +4678,7 @@ private:
                                     }
                                 }
                                 
-                                size_t target_pos = 0;
-                                for (int i = 0; i < loc.range.start.line && (size_t)i < document_->get_line_count(); ++i) {
-                                    target_pos += document_->get_line(i).length() + 1;
-                                }
-                                target_pos += loc.range.start.character;
-                                cursor_pos_ = target_pos;
+                                cursor_pos_ = document_->line_utf16_to_offset(loc.range.start.line, loc.range.start.character);
                                 
                                 size_t line = get_cursor_line();
                                 viewport_.scroll_to_line(line > 10 ? line - 10 : 0);
@@ -3200,7 +4690,8 @@ private:
                     );
                 } else {
                     // Go to definition
-                    lsp_client_->request_definition(
+                    flush_lsp_changes();
+                    lsp->request_definition(
                         "file:///" + current_file_,
                         (int)line_idx,
                         (int)col_idx,
@@ -3218,12 +4709,7 @@ private:
                                     std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
                                     document_ = std::make_unique<PieceTable>(content);
                                     
-                                    size_t target_pos = 0;
-                                    for (int i = 0; i < loc.range.start.line && (size_t)i < document_->get_line_count(); ++i) {
-                                        target_pos += document_->get_line(i).length() + 1;
-                                    }
-                                    target_pos += loc.range.start.character;
-                                    cursor_pos_ = target_pos;
+                                    cursor_pos_ = document_->line_utf16_to_offset(loc.range.start.line, loc.range.start.character);
                                     
                                     size_t line = get_cursor_line();
                                     viewport_.scroll_to_line(line > 10 ? line - 10 : 0);
@@ -3233,6 +4719,8 @@ private:
                         }
                     );
                 }
+            } else {
+                goto_local_symbol(shift);
             }
         }
         else if (key == VK_TAB && (GetKeyState(VK_CONTROL) & 0x8000)) {
@@ -3269,7 +4757,10 @@ private:
             // Ctrl+W - Close tab
             if (tab_manager_) {
                 size_t cur = tab_manager_->get_active_tab_index();
+                const PieceTable* closing = document_.get();
                 if (tab_manager_->close_tab(cur)) {
+                    if (autocomplete_) autocomplete_->release(closing);
+                    end_journal(closing);
                     size_t newIndex = cur;
                     size_t count = tab_manager_->get_tab_count();
                     if (newIndex >= count) newIndex = (count > 0 ? count - 1 : 0);
@@ -3281,6 +4772,8 @@ private:
             // Ctrl+Shift+W - Close all tabs
             if (tab_manager_) {
                 tab_manager_->close_all_tabs();
+                if (autocomplete_) autocomplete_->detach();
+                while (!journals_.empty()) end_journal(journals_.begin()->first);
                 switch_to_tab(0);
                 is_modified_ = false;
                 update_title();
@@ -3351,21 +4844,18 @@ private:
             
             auto start = std::chrono::high_resolution_clock::now();
             
-            // Read file
-            std::ifstream file(narrow_filename, std::ios::binary);
-            if (!file) {
+            // Map the file instead of reading it - open time does not depend on size
+            auto mapping = editor::PlatformFile::map_file(narrow_filename);
+            if (!mapping) {
                 MessageBoxW(hwnd_, L"Failed to open file", L"Error", MB_OK | MB_ICONERROR);
                 return false;
             }
             
-            std::string content((std::istreambuf_iterator<char>(file)),
-                               std::istreambuf_iterator<char>());
-            file.close();
-            
             // Load into current tab's document
             if (tab_manager_) {
-                // Replace current document content by creating a new PieceTable
-                document_ = std::make_shared<PieceTable>(content);
+                // Replace current document content by creating a new PieceTable.
+                // Line starts are indexed in the background so the first frame is not blocked.
+                document_ = std::make_shared<PieceTable>(mapping, PieceTable::LineIndexing::Background);
                 if (auto* tab = tab_manager_->get_active_tab()) {
                     tab->document = document_;
                     tab->file_path = narrow_filename;
@@ -3374,7 +4864,7 @@ private:
                     tab->is_modified = false;
                 }
             } else {
-                document_ = std::make_shared<PieceTable>(content);
+                document_ = std::make_shared<PieceTable>(mapping, PieceTable::LineIndexing::Background);
             }
             viewport_.set_document(document_);
             cursor_pos_ = 0;
@@ -3383,13 +4873,10 @@ private:
             if (highlighter_) {
                 highlighter_->set_language_by_filename(current_file_);
             }
+            apply_large_file_policy();
             
             // Notify LSP server about opened document
-            if (lsp_client_ && lsp_client_->is_running()) {
-                std::string uri = "file:///" + current_file_;
-                std::string lang_id = "cpp"; // Detect from extension in real impl
-                lsp_client_->did_open(uri, lang_id, content);
-            }
+            open_in_language_server();
             
             // Add to recent files
             workspace_manager_.add_recent_file(narrow_filename);
@@ -3399,9 +4886,10 @@ private:
             
             std::cout << "Loaded in: " << duration.count() << " ms\n";
             std::cout << "Lines: " << document_->get_line_count() << "\n";
-            std::cout << "Size: " << content.length() << " bytes\n\n";
+            std::cout << "Size: " << document_->get_total_length() << " bytes\n\n";
             
-            if (autocomplete_) autocomplete_->rebuild_from_document(document_);
+            attach_autocomplete();
+            start_journal();
             update_title();
             InvalidateRect(hwnd_, nullptr, TRUE);
             return true;
@@ -3410,7 +4898,10 @@ private:
         return false;
     }
     
-    bool save_file() {
+    // Writes on the document's journal thread; wait blocks until the file
+    // has been replaced (closing the editor)
+    bool save_file(bool wait = false) {
+        if (tab_loading_) return false;     // The placeholder must not overwrite the file
         std::string filename = current_file_;
         
         // If no current file, show save dialog
@@ -3441,29 +4932,45 @@ private:
         
         auto start = std::chrono::high_resolution_clock::now();
         
-        // Get all text from document
-        std::string content = document_->get_text(0, document_->get_total_length());
-        
-        // Write to file
-        std::ofstream file(filename, std::ios::binary);
-        if (!file) {
+        // The document may still be backed by a mapping of the file being overwritten
+        document_->release_mapping();
+        clipboard_.release_mapping(*document_);
+        size_t size = document_->get_total_length();
+        
+        // The pieces are streamed to a temporary file renamed over the target,
+        // off this thread unless the caller waits
+        bool ok = true;
+        auto found = journals_.find(document_.get());
+        if (found != journals_.end() && !wait) {
+            HWND hwnd = hwnd_;
+            found->second->save_async(filename, [hwnd, filename](bool saved) {
+                auto path = std::make_unique<std::string>(filename);
+                if (PostMessageW(hwnd, WM_SAVE_DONE, saved, reinterpret_cast<LPARAM>(path.get()))) path.release();
+            });
+        } else if (found != journals_.end()) {
+            std::promise<bool> saved;
+            found->second->save_async(filename, [&saved](bool result) { saved.set_value(result); });
+            ok = saved.get_future().get();
+        } else {
+            ok = editor::DocumentJournal::write_snapshot(*document_->snapshot(), filename);
+        }
+        if (!ok) {
             MessageBoxW(hwnd_, L"Failed to save file", L"Error", MB_OK | MB_ICONERROR);
             return false;
         }
-        
-        file.write(content.c_str(), content.length());
-        file.close();
-        
-        // Notify LSP of saved document
-        if (lsp_client_ && !current_file_.empty()) {
-            lsp_client_->did_save("file:///" + current_file_);
+        if (wait || found == journals_.end()) {
+            // Notify LSP of saved document
+            if (LSPClient* lsp = active_lsp()) {
+                flush_lsp_changes();
+                lsp->did_save("file:///" + current_file_);
+            }
         }
         
         auto end = std::chrono::high_resolution_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
         
-        std::cout << "Saved in: " << duration.count() << " ms\n";
-        std::cout << "Size: " << content.length() << " bytes\n\n";
+        std::cout << (wait || found == journals_.end() ? "Saved in: " : "Save queued in: ") << duration.count() << " ms\n";
+        std::cout << "Size: " << size << " bytes\n\n";
         
         current_file_ = filename;
         is_modified_ = false;
@@ -3510,38 +5017,20 @@ private:
     }
     
     void refresh_folding() {
-        if (!folding_manager_ || !document_) return;
-        
-        // Get all lines from document
-        std::vector<std::string> lines;
-        for (size_t i = 0; i < document_->get_line_count(); ++i) {
-            lines.push_back(document_->get_line(i));
-        }
+        if (!folding_manager_ || !document_ || !large_file_.allows(editor::LargeFileFeature::Folding)) return;
         
         // Save current fold state
         auto fold_state = folding_manager_->get_fold_state();
         
-        // Re-analyze document
-        folding_manager_->analyze_document(lines);
+        // Re-analyze document; later edits update the regions they touch
+        folding_manager_->set_document(document_);
         
         // Restore previous fold state where possible
         folding_manager_->restore_fold_state(fold_state);
     }
     
     size_t get_cursor_line() const {
-        size_t pos = 0;
-        size_t line = 0;
-        
-        for (size_t i = 0; i < document_->get_line_count(); ++i) {
-            size_t line_len = document_->get_line(i).length() + 1; // +1 for newline
-            if (pos + line_len > cursor_pos_) {
-                return i;
-            }
-            pos += line_len;
-            line = i;
-        }
-        
-        return line;
+        return document_->get_line_at(cursor_pos_);
     }
     
     size_t get_selection_start() const {
@@ -3560,54 +5049,72 @@ private:
         return document_->get_text(start, end - start);
     }
     
+    // The selection as pieces, announced to the system clipboard without
+    // its text (delayed rendering)
     bool copy_to_clipboard() {
         if (!has_selection_) return false;
         
-        std::string text = get_selected_text();
-        if (text.empty()) return false;
+        size_t start = get_selection_start();
+        size_t length = get_selection_end() - start;
+        if (length == 0) return false;
         
         if (!OpenClipboard(hwnd_)) {
             std::cout << "Failed to open clipboard\n";
             return false;
         }
         
+        // Emptying sends us WM_DESTROYCLIPBOARD if we owned it, so copy after
         EmptyClipboard();
-        
-        // Allocate global memory for the text
-        HGLOBAL hMem = GlobalAlloc(GMEM_MOVEABLE, text.size() + 1);
-        if (!hMem) {
-            CloseClipboard();
-            return false;
-        }
-        
-        // Copy text to allocated memory
-        char* pMem = static_cast<char*>(GlobalLock(hMem));
-        memcpy(pMem, text.c_str(), text.size() + 1);
-        GlobalUnlock(hMem);
-        
-        // Set clipboard data
-        SetClipboardData(CF_TEXT, hMem);
+        clipboard_.copy(document_, start, length);
+        SetClipboardData(CF_UNICODETEXT, nullptr);
         CloseClipboard();
         
-        std::cout << "Copied " << text.size() << " characters to clipboard\n";
+        std::cout << "Copied " << length << " bytes to clipboard\n";
         return true;
     }
     
+    // WM_RENDERFORMAT: the pieces streamed into the clipboard's memory
+    void render_clipboard_text() {
+        if (clipboard_.empty()) return;
+        // UTF-16 with room for the terminator (never more units than the
+        // UTF-8 has bytes)
+        HGLOBAL hMem = GlobalAlloc(GMEM_MOVEABLE, (clipboard_.length() + 1) * sizeof(char16_t));
+        if (!hMem) return;
+        char16_t* pMem = static_cast<char16_t*>(GlobalLock(hMem));
+        size_t units = clipboard_.write_utf16(pMem);
+        pMem[units] = u'\0';
+        GlobalUnlock(hMem);
+        if (!SetClipboardData(CF_UNICODETEXT, hMem)) GlobalFree(hMem);
+    }
+    
     void paste_from_clipboard() {
+        if (tab_loading_) return;
+        if (GetClipboardOwner() == hwnd_ && !clipboard_.empty()) {
+            // Our own copy: its pieces go in, no text is read
+            if (has_selection_) {
+                delete_selection();
+            }
+            undo_manager_->execute(std::make_unique<PasteCommand>(document_.get(), cursor_pos_, clipboard_));
+            cursor_pos_ += clipboard_.length();
+            is_modified_ = true;
+            update_title();
+            std::cout << "Pasted " << clipboard_.length() << " bytes from the internal clipboard\n";
+            return;
+        }
         if (!OpenClipboard(hwnd_)) {
             std::cout << "Failed to open clipboard\n";
             return;
         }
         
-        HANDLE hData = GetClipboardData(CF_TEXT);
+        HANDLE hData = GetClipboardData(CF_UNICODETEXT);
         if (!hData) {
             CloseClipboard();
             return;
         }
         
-        char* pText = static_cast<char*>(GlobalLock(hData));
+        const char16_t* pText = static_cast<const char16_t*>(GlobalLock(hData));
         if (pText) {
-            std::string text(pText);
+            std::string text = TextTranscode::utf16_to_utf8(pText, std::char_traits<char16_t>::length(pText));
             GlobalUnlock(hData);
             
             // Delete selection if any
@@ -3645,31 +5152,42 @@ private:
     }
     
     size_t get_cursor_column() const {
-        size_t pos = 0;
-        
-        for (size_t i = 0; i < document_->get_line_count(); ++i) {
-            std::string line = document_->get_line(i);
-            size_t line_len = line.length() + 1; // +1 for newline
-            
-            if (pos + line_len > cursor_pos_) {
-                return cursor_pos_ - pos;
-            }
-            pos += line_len;
-        }
-        
-        return 0;
+        return document_->offset_to_line_col(cursor_pos_).column;
+    }
+    
+    // Replace the `before` bytes preceding every cursor with text as one
+    // edit and one undo step, then move all cursors in a single pass
+    void edit_at_cursors(size_t before, const std::string& text) {
+        std::vector<size_t> cursors = extra_cursors_;
+        cursors.push_back(cursor_pos_);
+        std::sort(cursors.begin(), cursors.end());
+        cursors.erase(std::unique(cursors.begin(), cursors.end()), cursors.end());
+        
+        std::vector<PieceTable::Edit> edits;
+        edits.reserve(cursors.size());
+        size_t previous_end = 0;
+        for (size_t pos : cursors) {
+            size_t start = pos - (std::min)(before, pos);
+            // Cursors closer together than the range share one edit
+            if (!edits.empty() && start < previous_end) start = previous_end;
+            edits.push_back({start, pos - start, text});
+            previous_end = pos;
+        }
+        undo_manager_->execute(std::make_unique<MultiEditCommand>(document_.get(), edits));
+        
+        size_t primary = cursor_pos_;
+        PieceTable::map_offsets(edits, &primary, 1);
+        cursor_pos_ = static_cast<int>(primary);
+        PieceTable::map_offsets(edits, extra_cursors_.data(), extra_cursors_.size());
+        is_modified_ = true;
+        mark_active_tab_modified();
     }
     
     void find_next() {
         if (find_text_.empty()) return;
         
-        std::string doc_text;
-        for (size_t i = 0; i < document_->get_line_count(); ++i) {
-            doc_text += document_->get_line(i) + "\n";
-        }
-        
         SearchMatch match;
-        if (find_dialog_->find_next(doc_text, find_text_, cursor_pos_ + 1, match)) {
+        if (find_dialog_->find_next(*document_, find_text_, cursor_pos_ + 1, match)) {
             cursor_pos_ = match.position;
             viewport_.scroll_to_line(match.line);
         }
@@ -3678,36 +5196,46 @@ private:
     void find_previous() {
         if (find_text_.empty()) return;
         
-        std::string doc_text;
-        for (size_t i = 0; i < document_->get_line_count(); ++i) {
-            doc_text += document_->get_line(i) + "\n";
-        }
-        
         SearchMatch match;
-        if (find_dialog_->find_previous(doc_text, find_text_, cursor_pos_, match)) {
+        if (find_dialog_->find_previous(*document_, find_text_, cursor_pos_, match)) {
             cursor_pos_ = match.position;
             viewport_.scroll_to_line(match.line);
         }
     }
     
+    // Search as you type: the session refines the last matches or scans a
+    // first slice now; the timer carries on with the rest
     void perform_find() {
         if (find_text_.empty()) return;
         
-        std::string doc_text;
-        for (size_t i = 0; i < document_->get_line_count(); ++i) {
-            doc_text += document_->get_line(i) + "\n";
-        }
-        
-        auto matches = find_dialog_->find_all(doc_text, find_text_);
-        find_dialog_->set_matches(matches);
-        
-        if (find_dialog_->has_matches()) {
+        search_session_->set_document(document_);
+        search_session_->set_query(find_text_);
+        search_session_->step();
+        search_jump_pending_ = true;
+        publish_search_matches();
+    }
+    
+    // Hand the session's matches to the find dialog; true if they changed
+    bool publish_search_matches() {
+        if (search_generation_ == search_session_->generation() && !search_jump_pending_) return false;
+        search_generation_ = search_session_->generation();
+        find_dialog_->update_matches(search_session_->matches());
+        
+        // Jump to the first match once one turns up
+        if (search_jump_pending_ && find_dialog_->has_matches()) {
             const SearchMatch* match = find_dialog_->get_current_match();
-            if (match) {
-                cursor_pos_ = match->position;
-                viewport_.scroll_to_line(match->line);
-            }
+            cursor_pos_ = match->position;
+            viewport_.scroll_to_line(match->line);
+            search_jump_pending_ = false;
         }
+        if (search_session_->is_complete()) search_jump_pending_ = false;
+        return true;
+    }
+    
+    void clear_find_matches() {
+        search_session_->set_query("");
+        search_jump_pending_ = false;
+        find_dialog_->clear_matches();
     }
     
     // Workspace management functions
@@ -3730,7 +5258,9 @@ private:
                     FileState fs;
                     fs.path = tabs[i].file_path;
                     fs.cursor_pos = tabs[i].cursor_pos;
-                    fs.scroll_offset = viewport_.get_top_line();
+                    fs.scroll_offset = i == tab_manager_->get_active_tab_index() ? viewport_.get_top_line()
+                                                                                 : tabs[i].top_line;
+                    fs.last_active = tabs[i].last_active;
                     state.open_files.push_back(fs);
                 }
             }
@@ -3750,34 +5280,28 @@ private:
         
         WorkspaceState state;
         if (workspace_manager_.load_workspace(current_workspace_dir_, state)) {
+            large_file_policy_.load(state.settings.custom_settings);
+            viewport_.set_tab_width((size_t)(std::max)(1, state.settings.tab_size));
+            tab_size_ = (size_t)(std::max)(1, state.settings.tab_size);
+            use_spaces_ = state.settings.use_spaces;
             // Close all tabs first
             if (tab_manager_) {
                 tab_manager_->close_all_tabs();
             }
             
-            // Load each file into a tab
-            for (const auto& file_state : state.open_files) {
-                if (fs::exists(file_state.path)) {
-                    std::ifstream file(file_state.path, std::ios::binary);
-                    if (file) {
-                        std::string content((std::istreambuf_iterator<char>(file)),
-                                          std::istreambuf_iterator<char>());
-                        file.close();
-                        
-                        auto doc = std::make_shared<PieceTable>(content);
-                        if (tab_manager_) {
-                            tab_manager_->new_tab(content, file_state.path);
-                            if (auto* tab = tab_manager_->get_active_tab()) {
-                                tab->cursor_pos = file_state.cursor_pos;
-                            }
-                        }
-                    }
+            // Tabs come back as placeholders, nothing is read here: the
+            // active one loads first, the rest behind it most recent first
+            // (a file that is gone just stays a placeholder)
+            if (tab_manager_ && !state.open_files.empty()) {
+                size_t first = tab_manager_->get_tab_count();
+                for (const auto& file_state : state.open_files) {
+                    tab_manager_->add_hibernated_tab(file_state.path, file_state.cursor_pos,
+                                                     file_state.scroll_offset, file_state.last_active);
                 }
-            }
-            
-            // Switch to the previously active tab
-            if (tab_manager_ && static_cast<size_t>(state.active_tab_index) < tab_manager_->get_all_tabs().size()) {
-                switch_to_tab(state.active_tab_index);
+                size_t active = static_cast<size_t>((std::max)(state.active_tab_index, 0));
+                switch_to_tab(first + (std::min)(active, state.open_files.size() - 1));
+                tab_manager_->close_tab(0);     // The empty tab close_all_tabs left
+                tab_manager_->preload_tabs();
             }
         }
     }
@@ -3868,7 +5392,12 @@ private:
         
         // Open the selected file
         if (selected_index >= 0 && selected_index < (int)recent_files.size()) {
-            const std::string& filepath = recent_files[selected_index];
+            std::string filepath = recent_files[selected_index];
+            if (!fs::exists(filepath)) {
+                workspace_manager_.remove_recent_file(filepath);
+                MessageBoxW(hwnd_, L"The file no longer exists", L"Recent Files", MB_OK | MB_ICONWARNING);
+                return;
+            }
             open_file_from_path(filepath);
         }
     }
@@ -3886,18 +5415,21 @@ private:
             size_t idx = tab_manager_->new_tab(content, path);
             switch_to_tab(idx);
             is_modified_ = false;
-            if (autocomplete_) autocomplete_->rebuild_from_document(document_);
+            start_journal();
             update_title();
         } else {
             if (split_mode_ != SplitMode::None) {
                 // Open in active pane
                 auto& pane = (active_pane_ == 0) ? pane1_ : pane2_;
-                pane.document = std::make_shared<PieceTable>(content);
-                pane.viewport.set_document(pane.document);
+                pane.view.set_document(std::make_shared<PieceTable>(content));
                 pane.file_path = path;
                 pane.is_modified = false;
-                pane.cursor_pos = 0;
-                pane.has_selection = false;
+                // Edits go to the active pane's document
+                document_ = pane.view.document();
+                current_file_ = path;
+                cursor_pos_ = 0;
+                has_selection_ = false;
+                extra_cursors_.clear();
             } else {
                 document_ = std::make_shared<PieceTable>(content);
                 viewport_.set_document(document_);
@@ -3907,7 +5439,9 @@ private:
                     highlighter_->set_language_by_filename(current_file_);
                 }
             }
-            if (autocomplete_) autocomplete_->rebuild_from_document(document_);
+            apply_large_file_policy();
+            attach_autocomplete();
+            start_journal();
             update_title();
         }
         refresh_folding();
@@ -3958,7 +5492,30 @@ private:
     }
 };
 
-int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int) {
+int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR lpCmdLine, int) {
+    auto process_start = std::chrono::steady_clock::now();
+    std::string cmd_line = lpCmdLine ? lpCmdLine : "";
+    // "--flag" or "--flag=value"; fallback when given without a value
+    auto flag_value = [&cmd_line](const std::string& flag, const std::string& fallback) {
+        size_t found = cmd_line.find(flag);
+        if (found == std::string::npos) return std::string();
+        size_t value = found + flag.size();
+        if (value >= cmd_line.size() || cmd_line[value] != '=') return fallback;
+        size_t value_end = cmd_line.find(' ', value + 1);
+        std::string path = cmd_line.substr(value + 1, value_end == std::string::npos ? std::string::npos : value_end - value - 1);
+        return path.empty() ? fallback : path;
+    };
+    // --startup-trace[=path]: the startup timeline goes to path (stderr
+    // without one) when the editor exits
+    std::string trace_path = flag_value("--startup-trace", "-");
+    // --trace[=path]: spans from the hot paths, written as a Chrome trace
+    // (chrome://tracing, ui.perfetto.dev) when the editor exits
+    std::string chrome_trace_path = flag_value("--trace", "editor_trace.json");
+    if (!chrome_trace_path.empty()) {
+        editor::Tracer::instance().start();
+        editor::Tracer::instance().set_thread_name("UI");
+    }
+
     // Allocate console for debug output
     AllocConsole();
     FILE* fp;
@@ -3980,6 +5537,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int) {
     std::cout << "Watch how it stays at 60fps even with huge files.\n\n";
 
     Win32TextEditor editor(hInstance);
+    editor.set_startup_trace(process_start, trace_path);
 
     auto startup_mid = std::chrono::high_resolution_clock::now();
 
@@ -3997,6 +5555,12 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int) {
     log << "Editor startup time: " << ms_total << " ms (init: " << ms_init << " ms, window: " << ms_window << " ms)\n";
     log.close();
 
-    return editor.run();
+    int result = editor.run();
+    editor.dump_startup_trace();
+    if (!chrome_trace_path.empty()) {
+        editor::Tracer::instance().stop();
+        editor::Tracer::instance().export_chrome_trace(chrome_trace_path);
+    }
+    return result;
 };
 
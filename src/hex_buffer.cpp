@@ -0,0 +1,299 @@
+#include "hex_buffer.h"
+#include "platform_file.h"
+#include "text_scan.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const char kHexDigits[] = "0123456789abcdef";
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool seek(std::FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, static_cast<long long>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+} // namespace
+
+HexBuffer::HexBuffer(std::shared_ptr<editor::MappedFile> mapping)
+    : mapping_(std::move(mapping)) {
+    data_ = mapping_->data();
+    size_ = mapping_->size();
+    while (offset_digits_ < 16 && (size_ >> (4 * offset_digits_)) != 0) ++offset_digits_;
+}
+
+HexBuffer::HexBuffer(std::string bytes)
+    : owned_(std::move(bytes)) {
+    data_ = owned_.data();
+    size_ = owned_.size();
+    while (offset_digits_ < 16 && (size_ >> (4 * offset_digits_)) != 0) ++offset_digits_;
+}
+
+std::shared_ptr<HexBuffer> HexBuffer::open(const std::string& path) {
+    auto mapping = editor::PlatformFile::map_file(path);
+    return mapping ? std::make_shared<HexBuffer>(std::move(mapping)) : nullptr;
+}
+
+bool HexBuffer::looks_binary(const char* data, size_t size) {
+    return std::memchr(data, '\0', (std::min)(size, kSniffBytes)) != nullptr;
+}
+
+// ============================================================================
+// Bytes and patches
+// ============================================================================
+
+uint8_t HexBuffer::byte_at(uint64_t offset) const {
+    auto it = patches_.find(offset);
+    return it != patches_.end() ? it->second : static_cast<uint8_t>(data_[offset]);
+}
+
+size_t HexBuffer::read(uint64_t offset, size_t length, uint8_t* out) const {
+    if (offset >= size_) return 0;
+    length = static_cast<size_t>((std::min)(uint64_t(length), size_ - offset));
+    std::memcpy(out, data_ + offset, length);
+    for (auto it = patches_.lower_bound(offset); it != patches_.end() && it->first < offset + length; ++it) {
+        out[it->first - offset] = it->second;
+    }
+    return length;
+}
+
+void HexBuffer::apply(uint64_t offset, const std::string& bytes) {
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        uint8_t value = static_cast<uint8_t>(bytes[i]);
+        if (static_cast<uint8_t>(data_[offset + i]) == value) {
+            patches_.erase(offset + i);
+        } else {
+            patches_[offset + i] = value;
+        }
+    }
+}
+
+bool HexBuffer::overwrite(uint64_t offset, const std::string& bytes) {
+    if (offset > size_ || bytes.size() > size_ - offset) return false;
+    if (bytes.empty()) return true;
+    std::string before(bytes.size(), '\0');
+    read(offset, before.size(), reinterpret_cast<uint8_t*>(&before[0]));
+    apply(offset, bytes);
+    undo_history_.push_back({offset, std::move(before), bytes});
+    redo_history_.clear();
+    return true;
+}
+
+void HexBuffer::undo() {
+    if (undo_history_.empty()) return;
+    Overwrite step = std::move(undo_history_.back());
+    undo_history_.pop_back();
+    apply(step.offset, step.before);
+    redo_history_.push_back(std::move(step));
+}
+
+void HexBuffer::redo() {
+    if (redo_history_.empty()) return;
+    Overwrite step = std::move(redo_history_.back());
+    redo_history_.pop_back();
+    apply(step.offset, step.after);
+    undo_history_.push_back(std::move(step));
+}
+
+void HexBuffer::discard_patches() {
+    patches_.clear();
+    undo_history_.clear();
+    redo_history_.clear();
+}
+
+bool HexBuffer::write_patches(const std::string& path) {
+    if (patches_.empty()) return true;
+    std::FILE* file = std::fopen(path.c_str(), "r+b");
+    if (!file) return false;
+    bool ok = true;
+    // Runs of adjacent patched bytes go out in one write
+    std::string run;
+    for (auto it = patches_.begin(); ok && it != patches_.end();) {
+        uint64_t start = it->first;
+        run.clear();
+        for (; it != patches_.end() && it->first == start + run.size(); ++it) run.push_back(static_cast<char>(it->second));
+        ok = seek(file, start) && std::fwrite(run.data(), 1, run.size(), file) == run.size();
+    }
+    ok = editor::PlatformFile::sync_file(file) && ok;
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) return false;
+    // A shared view of the file shows the new bytes; keep any it does not
+    for (auto it = patches_.begin(); it != patches_.end();) {
+        it = static_cast<uint8_t>(data_[it->first]) == it->second ? patches_.erase(it) : std::next(it);
+    }
+    return true;
+}
+
+// ============================================================================
+// Search
+// ============================================================================
+
+bool HexBuffer::matches_at(uint64_t offset, const std::string& pattern) const {
+    if (offset > size_ || pattern.size() > size_ - offset) return false;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        if (byte_at(offset + i) != static_cast<uint8_t>(pattern[i])) return false;
+    }
+    return true;
+}
+
+uint64_t HexBuffer::find(const std::string& pattern, uint64_t from) const {
+    size_t length = pattern.size();
+    if (from > size_ || length > size_ - from) return npos;
+    if (length == 0) return from;
+
+    // Matches in the mapping, unless a patch inside them breaks them
+    uint64_t found = npos;
+    for (uint64_t position = from; position + length <= size_;) {
+        size_t at = TextScan::find_bytes(data_ + position, static_cast<size_t>(size_ - position), pattern.data(), length);
+        if (at == TextScan::npos) break;
+        uint64_t hit = position + at;
+        auto patch = patches_.lower_bound(hit);
+        if (patch == patches_.end() || patch->first >= hit + length || matches_at(hit, pattern)) {
+            found = hit;
+            break;
+        }
+        position = hit + 1;
+    }
+
+    // Matches a patch made: only windows covering a patched byte can hold one
+    uint64_t checked = from;
+    auto patch = patches_.lower_bound(from >= length - 1 ? from - (length - 1) : 0);
+    for (; patch != patches_.end(); ++patch) {
+        uint64_t start = (std::max)(checked, patch->first >= length - 1 ? patch->first - (length - 1) : 0);
+        if (start >= found) break;
+        for (uint64_t s = start; s <= patch->first && s < found; ++s) {
+            if (matches_at(s, pattern)) return s;
+        }
+        checked = patch->first + 1;
+    }
+    return found;
+}
+
+bool HexBuffer::parse_hex(const std::string& text, std::string& out) {
+    out.clear();
+    int high = -1;
+    for (char c : text) {
+        if (c == ' ' || c == '\t') {
+            if (high >= 0) return false;    // Digits pair up within a group
+            continue;
+        }
+        int value = hex_value(c);
+        if (value < 0) return false;
+        if (high < 0) {
+            high = value;
+        } else {
+            out.push_back(static_cast<char>(high * 16 + value));
+            high = -1;
+        }
+    }
+    return high < 0 && !out.empty();
+}
+
+// ============================================================================
+// Rows
+// ============================================================================
+
+std::string HexBuffer::format_row(uint64_t row) const {
+    if (row >= row_count()) return std::string();
+    std::string out(row_width(), ' ');
+    uint64_t offset = row * kBytesPerRow;
+    for (size_t i = 0; i < offset_digits_; ++i) {
+        out[offset_digits_ - 1 - i] = kHexDigits[(offset >> (4 * i)) & 0xf];
+    }
+    uint8_t bytes[kBytesPerRow];
+    size_t count = read(offset, kBytesPerRow, bytes);
+    size_t chars = offset_digits_ + 53;
+    out[chars - 1] = '|';
+    out[chars + kBytesPerRow] = '|';
+    for (size_t j = 0; j < count; ++j) {
+        size_t column = offset_digits_ + 2 + 3 * j + (j >= 8 ? 1 : 0);
+        out[column] = kHexDigits[bytes[j] >> 4];
+        out[column + 1] = kHexDigits[bytes[j] & 0xf];
+        out[chars + j] = bytes[j] >= 0x20 && bytes[j] < 0x7f ? static_cast<char>(bytes[j]) : '.';
+    }
+    return out;
+}
+
+size_t HexBuffer::position_of_byte(uint64_t offset) const {
+    uint64_t row = offset / kBytesPerRow;
+    size_t j = static_cast<size_t>(offset % kBytesPerRow);
+    return static_cast<size_t>(row * (row_width() + 1)) + offset_digits_ + 2 + 3 * j + (j >= 8 ? 1 : 0);
+}
+
+bool HexBuffer::byte_at_position(size_t position, uint64_t& offset) const {
+    uint64_t row = position / (row_width() + 1);
+    size_t column = position % (row_width() + 1);
+    size_t j = 0;
+    if (column >= offset_digits_ + 53 && column < offset_digits_ + 53 + kBytesPerRow) {
+        j = column - (offset_digits_ + 53);
+    } else if (column >= offset_digits_ + 2 && column < offset_digits_ + 51) {
+        size_t hex = column - (offset_digits_ + 2);
+        if (hex == 24) return false;            // The gap between the halves
+        if (hex > 24) --hex;
+        if (hex % 3 == 2) return false;         // Between two bytes
+        j = hex / 3;
+    } else {
+        return false;
+    }
+    offset = row * kBytesPerRow + j;
+    return offset < size_;
+}
+
+size_t HexBuffer::get_line_count() const {
+    uint64_t rows = row_count();
+    return rows > 0 ? static_cast<size_t>(rows) : 1;
+}
+
+size_t HexBuffer::get_total_length() const {
+    uint64_t rows = row_count();
+    return rows > 0 ? static_cast<size_t>(rows * (row_width() + 1) - 1) : 0;
+}
+
+size_t HexBuffer::get_line_start(size_t line_number) const {
+    return line_number < row_count() ? line_number * (row_width() + 1) : get_total_length();
+}
+
+size_t HexBuffer::get_line_at(size_t position) const {
+    uint64_t rows = row_count();
+    return rows > 0 ? static_cast<size_t>((std::min)(uint64_t(position / (row_width() + 1)), rows - 1)) : 0;
+}
+
+std::string HexBuffer::get_line(size_t line_number) const {
+    return format_row(line_number);
+}
+
+std::string HexBuffer::get_text(size_t start, size_t length) const {
+    size_t total = get_total_length();
+    if (start >= total) return std::string();
+    length = (std::min)(length, total - start);
+    size_t stride = row_width() + 1;
+    std::string out;
+    out.reserve(length);
+    while (out.size() < length) {
+        size_t position = start + out.size();
+        size_t row = position / stride;
+        size_t column = position % stride;
+        std::string line = format_row(row);
+        line.push_back('\n');   // Past the last row, cut off by length
+        out.append(line, column, length - out.size());
+    }
+    return out;
+}
+
+std::vector<std::string> HexBuffer::get_lines_range(size_t start_line, size_t count) const {
+    std::vector<std::string> lines;
+    uint64_t rows = row_count();
+    for (uint64_t row = start_line; row < rows && lines.size() < count; ++row) lines.push_back(format_row(row));
+    return lines;
+}
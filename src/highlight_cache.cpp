@@ -0,0 +1,464 @@
+#include "highlight_cache.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <deque>
+#include <mutex>
+
+/**
+ * Batch - consecutive lines to tokenize off the UI thread
+ *
+ * The text is copied on the UI thread, so the worker never touches the
+ * document. Results come back in the same struct.
+ */
+struct HighlightCache::Batch {
+    size_t generation;
+    size_t first_line;
+    bool exact;         // in is the real state of first_line (not a guess)
+    bool in_order;      // Part of the front-to-back pass over the document
+    SyntaxHighlighter::Language language;
+    SyntaxHighlighter::LineState in;
+    std::vector<std::string> lines;
+    std::vector<SyntaxHighlighter::LineState> outs;
+    std::vector<std::vector<Token>> tokens;
+};
+
+struct HighlightCache::HighlightJob : std::enable_shared_from_this<HighlightJob> {
+    std::mutex mutex;
+    std::deque<Batch> queue;        // Highest priority first
+    std::vector<Batch> ready;
+    bool draining = false;          // A drain task is queued or running
+    bool stop = false;
+    SyntaxHighlighter highlighter;  // Drain-owned copy; language follows each batch
+    
+    // Batches were queued: have one drain task on the shared pool take them.
+    // Viewport batches are Visible work, the in-order pass Background.
+    void kick() {
+        TaskPriority priority;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (draining || queue.empty()) return;
+            draining = true;
+            priority = queue.front().in_order ? TaskPriority::Background : TaskPriority::Visible;
+        }
+        ThreadPool::shared().submit([self = shared_from_this()]() { self->drain(); }, priority);
+    }
+    
+    void drain() {
+        for (;;) {
+            Batch batch;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (stop || queue.empty()) {
+                    draining = false;
+                    return;
+                }
+                batch = std::move(queue.front());
+                queue.pop_front();
+            }
+            if (highlighter.get_language() != batch.language) highlighter.set_language(batch.language);
+            SyntaxHighlighter::LineState state = batch.in;
+            batch.outs.resize(batch.lines.size());
+            batch.tokens.resize(batch.lines.size());
+            for (size_t i = 0; i < batch.lines.size(); ++i) {
+                highlighter.tokenize_line(batch.lines[i], state, batch.outs[i], batch.tokens[i]);
+                state = batch.outs[i];
+            }
+            batch.lines.clear();
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.push_back(std::move(batch));
+        }
+    }
+};
+
+HighlightCache::HighlightCache(SyntaxHighlighter* highlighter)
+    : highlighter_(highlighter)
+    , listener_id_(0)
+    , language_(highlighter ? highlighter->get_language() : SyntaxHighlighter::Language::Auto)
+    , valid_(0)
+    , tokenize_count_(0)
+    , generation_(0)
+    , scheduled_top_(0)
+    , scheduled_count_(0)
+    , scheduled_generation_(static_cast<size_t>(-1))
+    , batch_generation_(static_cast<size_t>(-1))
+    , full_pass_(true) {
+}
+
+HighlightCache::~HighlightCache() {
+    set_background(false);
+    if (document_) document_->remove_change_listener(listener_id_);
+}
+
+void HighlightCache::set_document(const std::shared_ptr<PieceTable>& document) {
+    if (document == document_) return;
+    if (document_) document_->remove_change_listener(listener_id_);
+    document_ = document;
+    listener_id_ = 0;
+    if (document_) {
+        listener_id_ = document_->add_change_listener([this](const PieceTable::Change& change) {
+            on_change(change);
+        });
+    }
+    if (semantic_) semantic_->clear();
+    clear();
+}
+
+void HighlightCache::clear() {
+    entries_.clear();
+    valid_ = 0;
+    ++generation_;
+}
+
+void HighlightCache::invalidate_from(size_t line) {
+    if (line < entries_.size()) entries_.resize(line);
+    valid_ = (std::min)(valid_, line);
+    ++generation_;
+}
+
+void HighlightCache::invalidate_tokens(size_t first, size_t last) {
+    last = (std::min)(last, entries_.size());
+    for (size_t line = first; line < last; ++line) {
+        entries_[line].tokens.clear();
+        entries_[line].has_tokens = false;
+        entries_[line].merged_generation = kNotMerged;
+    }
+}
+
+void HighlightCache::on_change(const PieceTable::Change& change) {
+    size_t first = change.first_line;
+    ++generation_;  // Queued background batches hold pre-edit text
+    if (semantic_) semantic_->on_change(first, change.removed_newlines, change.inserted_newlines);
+    if (first >= entries_.size()) return;
+    
+    // Old lines [first, first + removed_newlines] became new lines
+    // [first, first + inserted_newlines]; later entries just shift.
+    // The last edited line ends where the old last line did, so the old
+    // out-state stays the reference for detecting convergence.
+    size_t old_last = first + change.removed_newlines;
+    Entry last;
+    bool keep_last = old_last < entries_.size();
+    if (keep_last) {
+        last.out = entries_[old_last].out;
+        last.comparable = entries_[old_last].comparable;
+        // Old tokens stay visible (provisional) until the line is redone
+        last.tokens = std::move(entries_[old_last].tokens);
+        last.has_tokens = entries_[old_last].has_tokens;
+        last.provisional = true;
+    }
+    entries_.erase(entries_.begin() + first, entries_.begin() + (keep_last ? old_last + 1 : entries_.size()));
+    if (keep_last) {
+        entries_.insert(entries_.begin() + first, change.inserted_newlines, Entry());
+        entries_.insert(entries_.begin() + first + change.inserted_newlines, last);
+    }
+    valid_ = (std::min)(valid_, first);
+}
+
+void HighlightCache::check_language() {
+    if (highlighter_ && highlighter_->get_language() != language_) {
+        language_ = highlighter_->get_language();
+        clear();
+    }
+}
+
+void HighlightCache::store(size_t line, const SyntaxHighlighter::LineState& out, std::vector<Token>* tokens) {
+    // Called for line == valid_ with its freshly computed out-state
+    if (line >= entries_.size()) entries_.resize(line + 1);
+    Entry& entry = entries_[line];
+    bool converged = entry.comparable && entry.out == out;
+    entry.out = out;
+    entry.changed = false;
+    entry.comparable = true;
+    entry.provisional = false;
+    entry.merged_generation = kNotMerged;
+    if (tokens) {
+        entry.tokens.swap(*tokens);     // The old buffer goes back to be reused
+        entry.has_tokens = true;
+    } else {
+        entry.tokens.clear();
+        entry.has_tokens = false;
+    }
+    valid_ = line + 1;
+    if (converged) {
+        // Same out-state as before the edit: the following untouched lines
+        // see the same in-state, so their cached results still hold
+        while (valid_ < entries_.size() && !entries_[valid_].changed) {
+            Entry& kept = entries_[valid_++];
+            if (kept.provisional) {
+                // Built from a guessed in-state - redo once it's needed
+                kept.tokens.clear();
+                kept.has_tokens = false;
+                kept.provisional = false;
+                kept.merged_generation = kNotMerged;
+            }
+        }
+    }
+}
+
+void HighlightCache::ensure_states(size_t line) {
+    while (valid_ < line) {
+        // Cursor restarts whenever convergence skips ahead
+        size_t start = valid_;
+        auto cursor = document_->lines(start);
+        std::string_view text;
+        SyntaxHighlighter::LineState state = start ? entries_[start - 1].out : SyntaxHighlighter::LineState{};
+        bool advanced = false;
+        while (valid_ < line && cursor.next(text)) {
+            size_t current = cursor.line_number();
+            scratch_.assign(text.data(), text.size());
+            SyntaxHighlighter::LineState out{};
+            highlighter_->tokenize_line(scratch_, state, out, scratch_tokens_);
+            ++tokenize_count_;
+            store(current, out, nullptr);
+            state = out;
+            advanced = true;
+            if (valid_ != current + 1) break;
+        }
+        if (!advanced) break;   // Past the end of the document
+    }
+}
+
+SyntaxHighlighter::LineState HighlightCache::state_before(size_t line) {
+    check_language();
+    if (line == 0 || !highlighter_ || !document_) return {};
+    ensure_states(line);
+    size_t known = (std::min)(line, valid_);
+    return known ? entries_[known - 1].out : SyntaxHighlighter::LineState{};
+}
+
+const std::vector<Token>& HighlightCache::get_tokens(size_t line) {
+    check_language();
+    if (!highlighter_ || !document_ || line >= document_->get_line_count()) return empty_;
+    SyntaxHighlighter::LineState in = state_before(line);
+    // Catching up may have converged past this line
+    if (line < valid_ && entries_[line].has_tokens) return entries_[line].tokens;
+    scratch_ = document_->get_line(line);
+    SyntaxHighlighter::LineState out{};
+    highlighter_->tokenize_line(scratch_, in, out, scratch_tokens_);
+    ++tokenize_count_;
+    if (line <= valid_) {
+        if (line == valid_) {
+            store(line, out, &scratch_tokens_);
+        } else {
+            entries_[line].tokens.swap(scratch_tokens_);
+            entries_[line].has_tokens = true;
+        }
+        return entries_[line].tokens;
+    }
+    // Line not reachable yet (e.g. still being indexed) - nothing to cache against
+    uncached_.swap(scratch_tokens_);
+    return uncached_;
+}
+
+// ============================================================================
+// Background mode
+// ============================================================================
+
+void HighlightCache::set_background(bool enabled) {
+    if (enabled == (job_ != nullptr)) return;
+    if (enabled) {
+        job_ = std::make_shared<HighlightJob>();
+        scheduled_generation_ = static_cast<size_t>(-1);
+        batch_generation_ = static_cast<size_t>(-1);
+        return;
+    }
+    // A drain in progress finishes its batch and lets go of the job; no wait
+    {
+        std::lock_guard<std::mutex> lock(job_->mutex);
+        job_->stop = true;
+    }
+    job_.reset();
+}
+
+size_t HighlightCache::ready_line_count() const {
+    // Lines past the background line indexer come back empty - don't tokenize them yet
+    return document_->is_indexing() ? document_->get_indexed_line_count() : document_->get_line_count();
+}
+
+bool HighlightCache::make_batch(size_t first, size_t last, bool in_order, Batch& batch) {
+    last = (std::min)(last, ready_line_count());
+    if (!in_order) {
+        // Only the lines that have nothing to show yet
+        while (first < last && first < entries_.size() && entries_[first].has_tokens) ++first;
+        while (last > first && last - 1 < entries_.size() && entries_[last - 1].has_tokens) --last;
+    }
+    if (first >= last) return false;
+    
+    batch.generation = generation_;
+    batch.first_line = first;
+    batch.exact = first <= valid_;
+    batch.in_order = in_order;
+    batch.language = language_;
+    // Past the known states, the stale state of the line above is the best guess
+    batch.in = (first > 0 && first - 1 < entries_.size()) ? entries_[first - 1].out : SyntaxHighlighter::LineState{};
+    batch.lines.reserve(last - first);
+    auto cursor = document_->lines(first);
+    std::string_view text;
+    while (batch.lines.size() < last - first && cursor.next(text)) batch.lines.emplace_back(text);
+    return !batch.lines.empty();
+}
+
+void HighlightCache::schedule(size_t top_line, size_t visible_count) {
+    if (!job_ || !document_ || !highlighter_) return;
+    check_language();
+    if (top_line == scheduled_top_ && visible_count == scheduled_count_ && generation_ == scheduled_generation_) return;
+    scheduled_top_ = top_line;
+    scheduled_count_ = visible_count;
+    scheduled_generation_ = generation_;
+    
+    // Viewport first, then a screenful below and above it
+    std::vector<Batch> batches;
+    Batch batch;
+    if (make_batch(top_line, top_line + visible_count, false, batch)) batches.push_back(std::move(batch));
+    batch = Batch();
+    if (make_batch(top_line + visible_count, top_line + 2 * visible_count, false, batch)) batches.push_back(std::move(batch));
+    batch = Batch();
+    size_t above = top_line > visible_count ? top_line - visible_count : 0;
+    if (make_batch(above, top_line, false, batch)) batches.push_back(std::move(batch));
+    
+    {
+        std::lock_guard<std::mutex> lock(job_->mutex);
+        // Older viewport requests lost their priority; a current in-order batch keeps its place
+        for (auto& queued : job_->queue) {
+            if (queued.in_order && queued.generation == generation_) batches.push_back(std::move(queued));
+        }
+        job_->queue.assign(std::make_move_iterator(batches.begin()), std::make_move_iterator(batches.end()));
+    }
+    job_->kick();
+    if (batch_generation_ != generation_) queue_next_batch();
+}
+
+void HighlightCache::queue_next_batch() {
+    if (!full_pass_) {
+        // Catch up to the viewport when it is near the known states; far
+        // below them its guessed states stand
+        size_t view_end = scheduled_top_ + 2 * scheduled_count_;
+        if (valid_ >= view_end || valid_ + kCatchUpLines < scheduled_top_) return;
+    }
+    Batch batch;
+    if (!make_batch(valid_, valid_ + kBatchLines, true, batch)) return;
+    batch_generation_ = generation_;
+    {
+        std::lock_guard<std::mutex> lock(job_->mutex);
+        job_->queue.push_back(std::move(batch));
+    }
+    job_->kick();
+}
+
+void HighlightCache::publish(size_t line, bool exact, const SyntaxHighlighter::LineState& out, std::vector<Token>& tokens) {
+    if (exact && line == valid_) {
+        store(line, out, &tokens);
+        return;
+    }
+    if (line >= entries_.size()) entries_.resize(line + 1);
+    Entry& entry = entries_[line];
+    if (line < valid_) {
+        // Known line: exact results are final, guesses are not wanted
+        if (!exact) return;
+        entry.provisional = false;
+    } else {
+        entry.provisional = true;
+    }
+    entry.tokens = std::move(tokens);
+    entry.has_tokens = true;
+    entry.merged_generation = kNotMerged;
+}
+
+bool HighlightCache::poll() {
+    if (!job_) return false;
+    check_language();
+    std::vector<Batch> ready;
+    {
+        std::lock_guard<std::mutex> lock(job_->mutex);
+        ready.swap(job_->ready);
+    }
+    bool published = false;
+    for (auto& batch : ready) {
+        if (batch.generation != generation_) continue;  // Document changed since it was queued
+        if (batch.in_order) batch_generation_ = static_cast<size_t>(-1);
+        tokenize_count_ += batch.outs.size();
+        for (size_t i = 0; i < batch.outs.size(); ++i) {
+            publish(batch.first_line + i, batch.exact, batch.outs[i], batch.tokens[i]);
+        }
+        published = true;
+    }
+    if (batch_generation_ != generation_ && document_ && highlighter_) queue_next_batch();
+    if (published) scheduled_generation_ = static_cast<size_t>(-1);   // Re-check the viewport
+    return published;
+}
+
+size_t HighlightCache::get_memory_bytes() const {
+    size_t bytes = entries_.capacity() * sizeof(Entry) + scratch_.capacity() + uncached_.capacity() * sizeof(Token);
+    for (const Entry& entry : entries_) bytes += (entry.tokens.capacity() + entry.merged.capacity()) * sizeof(Token);
+    if (semantic_) bytes += semantic_->get_memory_bytes();
+    return bytes;
+}
+
+const std::vector<Token>& HighlightCache::get_ready_tokens(size_t line) const {
+    if (line < entries_.size() && entries_[line].has_tokens) return entries_[line].tokens;
+    return empty_;
+}
+
+// ============================================================================
+// Semantic tokens
+// ============================================================================
+
+void HighlightCache::set_semantic_tokens(std::shared_ptr<editor::SemanticTokenOverlay> overlay) {
+    semantic_ = std::move(overlay);
+    for (Entry& entry : entries_) {
+        entry.merged.clear();
+        entry.merged_generation = kNotMerged;
+    }
+}
+
+namespace {
+
+Token::Type token_type_of(editor::SemanticKind kind) {
+    switch (kind) {
+        case editor::SemanticKind::Type:     return Token::TYPE;
+        case editor::SemanticKind::Function: return Token::FUNCTION;
+        case editor::SemanticKind::Variable: return Token::VARIABLE;
+        case editor::SemanticKind::Keyword:  return Token::KEYWORD;
+        case editor::SemanticKind::String:   return Token::STRING;
+        case editor::SemanticKind::Number:   return Token::NUMBER;
+        case editor::SemanticKind::Comment:  return Token::COMMENT;
+        case editor::SemanticKind::Macro:    return Token::PREPROCESSOR;
+        case editor::SemanticKind::None:
+        default:                             return Token::NORMAL;
+    }
+}
+
+} // namespace
+
+const std::vector<Token>& HighlightCache::get_display_tokens(size_t line) {
+    const std::vector<Token>& lexed = get_ready_tokens(line);
+    if (!semantic_ || semantic_->token_count() == 0 || !document_ || line >= entries_.size()) return lexed;
+    Entry& entry = entries_[line];
+    if (entry.merged_generation == semantic_->generation()) return entry.merged.empty() ? lexed : entry.merged;
+    
+    entry.merged.clear();
+    entry.merged_generation = semantic_->generation();
+    scratch_ = document_->get_line(line);
+    semantic_->spans(line, scratch_, spans_);
+    if (spans_.empty()) return lexed;
+    
+    // Lexer tokens with the spans cut out of them, then both in order
+    pieces_.clear();
+    size_t first_span = 0;
+    for (const Token& token : lexed) {
+        size_t position = token.start;
+        size_t end = token.start + token.length;
+        while (first_span < spans_.size() && spans_[first_span].start + spans_[first_span].length <= position) ++first_span;
+        for (size_t i = first_span; i < spans_.size() && spans_[i].start < end; ++i) {
+            if (spans_[i].start > position) pieces_.push_back({token.type, position, spans_[i].start - position});
+            position = (std::max)(position, size_t(spans_[i].start + spans_[i].length));
+        }
+        if (position < end) pieces_.push_back({token.type, position, end - position});
+    }
+    auto piece = pieces_.begin();
+    for (const auto& span : spans_) {
+        for (; piece != pieces_.end() && piece->start < span.start; ++piece) entry.merged.push_back(*piece);
+        entry.merged.push_back({token_type_of(span.kind), span.start, span.length});
+    }
+    entry.merged.insert(entry.merged.end(), piece, pieces_.end());
+    return entry.merged;
+}
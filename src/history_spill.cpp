@@ -0,0 +1,102 @@
+#include "history_spill.h"
+#include "lz4_block.h"
+#include "platform_file.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace editor {
+
+HistorySpill::HistorySpill(std::string path) : path_(std::move(path)) {}
+
+HistorySpill::~HistorySpill() {
+    if (file_) {
+        std::fclose(file_);
+        PlatformFile::delete_file(path_);
+    }
+}
+
+bool HistorySpill::seek(uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file_, static_cast<long long>(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file_, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+}
+
+bool HistorySpill::write(std::string_view data, Block& block) {
+    if (failed_) return false;
+    if (!file_) {
+        PlatformFile::create_directories(PlatformFile::get_directory(path_));
+        file_ = std::fopen(path_.c_str(), "w+b");
+        if (!file_) {
+            failed_ = true;
+            return false;
+        }
+    }
+    std::string compressed = lz4_compress(data.data(), data.size());
+    std::string_view stored = compressed.size() < data.size() ? std::string_view(compressed) : data;
+    if (!seek(end_) || std::fwrite(stored.data(), 1, stored.size(), file_) != stored.size()) {
+        failed_ = true;
+        return false;
+    }
+    block.offset = end_;
+    block.stored = stored.size();
+    block.size = data.size();
+    end_ += stored.size();
+    return true;
+}
+
+bool HistorySpill::read(const Block& block, char* data) {
+    if (!file_ || block.offset + block.stored > end_) return false;
+    if (block.stored == block.size) {
+        // Kept raw: it did not compress
+        return seek(block.offset) && std::fread(data, 1, block.size, file_) == block.size;
+    }
+    std::string stored(block.stored, '\0');
+    if (!seek(block.offset) || std::fread(&stored[0], 1, stored.size(), file_) != stored.size()) return false;
+    return lz4_decompress(stored.data(), stored.size(), data, block.size);
+}
+
+bool HistorySpill::compact(const std::vector<Block*>& live) {
+    if (!file_ || failed_) return false;
+    std::vector<Block*> blocks(live);
+    std::sort(blocks.begin(), blocks.end(), [](const Block* a, const Block* b) { return a->offset < b->offset; });
+    // In file order each block moves down over space already vacated
+    uint64_t end = 0;
+    std::string stored;
+    for (Block* block : blocks) {
+        if (block->offset != end) {
+            stored.resize(block->stored);
+            if (!seek(block->offset) || std::fread(&stored[0], 1, stored.size(), file_) != stored.size() ||
+                !seek(end) || std::fwrite(stored.data(), 1, stored.size(), file_) != stored.size()) {
+                failed_ = true;
+                return false;
+            }
+            block->offset = end;
+        }
+        end += block->stored;
+    }
+    std::fflush(file_);
+#ifdef _WIN32
+    bool truncated = _chsize_s(_fileno(file_), static_cast<long long>(end)) == 0;
+#else
+    bool truncated = ftruncate(fileno(file_), static_cast<off_t>(end)) == 0;
+#endif
+    // Untruncated, the tail is only stale: later blocks are written over it
+    (void)truncated;
+    end_ = end;
+    dead_ = 0;
+    return true;
+}
+
+bool HistorySpill::read(const Block& block, std::string& data) {
+    data.assign(block.size, '\0');
+    return block.size == 0 || read(block, &data[0]);
+}
+
+} // namespace editor
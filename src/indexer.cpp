@@ -1,10 +1,42 @@
 #include "indexer.h"
-#include <sstream>
+#include "thread_pool.h"
+#include "text_scan.h"
+#include "platform_file.h"
+#include "persistent_index.h"
+#include "regex_engine.h"
+#include "trace.h"
+#include "memory_report.h"
+#include "symbol_tags.h"
 #include <algorithm>
 #include <cctype>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+
+// Three lower-cased bytes packed into the low 24 bits
+static uint32_t fold_trigram(const char* p) {
+    auto fold = [](char c) { return static_cast<uint32_t>(std::tolower(static_cast<unsigned char>(c))); };
+    return (fold(p[0]) << 16) | (fold(p[1]) << 8) | fold(p[2]);
+}
+
+// Line starts of a text from the vectorized newline scan, closed by a
+// sentinel as if a newline followed the text: line i spans
+// [starts[i], starts[i + 1] - 1)
+static void scan_line_starts(const char* data, size_t size, PrefixIndex& starts) {
+    std::vector<size_t> newlines;
+    TextScan::find_newlines(data, size, 0, newlines);
+    starts.reset(size + 1, newlines.size() + 2);
+    size_t line_start = 0;
+    for (size_t nl : newlines) {
+        starts.push_back(line_start);
+        line_start = nl + 1;
+    }
+    starts.push_back(line_start);
+    if (line_start < size) starts.push_back(size + 1);
+}
 
 BackgroundIndexer::BackgroundIndexer() 
-    : is_indexing_(false), should_stop_(false) {
+    : outstanding_(0), is_indexing_(false), should_stop_(false) {
 }
 
 BackgroundIndexer::~BackgroundIndexer() {
@@ -12,70 +44,390 @@ BackgroundIndexer::~BackgroundIndexer() {
 }
 
 void BackgroundIndexer::start() {
-    if (is_indexing_.load()) return;
+    if (tasks_) return;
     
     should_stop_.store(false);
-    is_indexing_.store(true);
-    indexing_thread_ = std::thread(&BackgroundIndexer::indexing_worker, this);
+    tasks_ = std::make_unique<TaskGroup>();
+    shards_.clear();
+    for (size_t i = 0; i < tasks_->pool().size(); ++i) {
+        shards_.push_back(std::make_unique<Shard>());
+    }
 }
 
 void BackgroundIndexer::stop() {
     should_stop_.store(true);
-    if (indexing_thread_.joinable()) {
-        indexing_thread_.join();
+    {
+        std::lock_guard<std::mutex> lock(crawl_mutex_);
+        full_crawl_ = false;
+    }
+    if (tasks_) {
+        // Queued crawl tasks see should_stop_ and return at once
+        tasks_->wait();
+        tasks_.reset();
     }
+    shards_.clear();
     is_indexing_.store(false);
 }
 
 void BackgroundIndexer::index_file(const std::string& file_path, const std::string& content) {
+    // Tokenize outside the lock; only the merge blocks searches. The text is
+    // kept: an editor buffer need not match (or exist) on disk.
+    auto text = std::make_shared<const std::string>(content);
+    ParsedFile file = tokenize(file_path, *text);
+    file.content = std::move(text);
+    
     std::lock_guard<std::mutex> lock(index_mutex_);
+    remove_file_locked(file_path);
+    merge_locked(std::move(file));
+}
+
+void BackgroundIndexer::index_workspace(const std::vector<std::string>& root_folders) {
+    start();
+    // Set up from a crawl task, so a previous crawl finishing right now
+    // sees it outstanding and leaves the new bookkeeping alone
+    submit_crawl_task([this, root_folders] {
+        {
+            std::lock_guard<std::mutex> lock(crawl_mutex_);
+            full_crawl_ = true;
+            for (const std::string& root : root_folders) {
+                if (std::find(roots_.begin(), roots_.end(), root) == roots_.end()) roots_.push_back(root);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(index_mutex_);
+            if (base_) base_seen_.assign(base_->file_count(), 0);
+        }
+        for (const std::string& root : root_folders) {
+            submit_crawl_task([this, root] { crawl_directory(root); });
+        }
+    });
+}
+
+void BackgroundIndexer::wait_for_indexing() {
+    std::unique_lock<std::mutex> lock(crawl_mutex_);
+    crawl_done_.wait(lock, [this] { return !is_indexing_.load(); });
+}
+
+void BackgroundIndexer::submit_crawl_task(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(crawl_mutex_);
+        outstanding_.fetch_add(1);
+        is_indexing_.store(true);
+    }
+    tasks_->submit([this, task = std::move(task)] {
+        if (!should_stop_.load()) task();
+        
+        // The last task of the crawl publishes every shard's leftovers
+        if (outstanding_.fetch_sub(1) == 1) {
+            finish_crawl();
+            std::lock_guard<std::mutex> lock(crawl_mutex_);
+            if (outstanding_.load() == 0) is_indexing_.store(false);
+            crawl_done_.notify_all();
+        }
+    }, TaskPriority::Background);
+}
+
+void BackgroundIndexer::finish_crawl() {
+    for (auto& shard : shards_) flush_shard(*shard);
+    if (should_stop_.load()) return;
+    
+    bool full_crawl;
+    {
+        // More work arrived meanwhile: its last task finishes instead
+        std::lock_guard<std::mutex> lock(crawl_mutex_);
+        if (outstanding_.load() != 0) return;
+        full_crawl = full_crawl_;
+        full_crawl_ = false;
+    }
+    publish_vocabulary();
+    // Incremental updates are not written back: on the next open their
+    // files fail the mtime check and are simply read again
+    if (!full_crawl) return;
+    
+    {
+        // Base files the crawl did not find unchanged were deleted meanwhile
+        // (changed ones are already shadowed by their new version)
+        std::lock_guard<std::mutex> lock(index_mutex_);
+        for (uint32_t id = 0; id < base_seen_.size(); ++id) {
+            if (!base_seen_[id] && !base_shadowed_[id]) shadow_base_locked(id);
+        }
+    }
+    if (!persistent_path_.empty()) save_persistent_index();
+}
+
+void BackgroundIndexer::crawl_directory(const std::string& directory) {
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+        const std::filesystem::directory_entry& entry = *it;
+        std::string name = entry.path().filename().string();
+        if (name.empty() || name[0] == '.') continue;   // .git, .velocity, ...
+        
+        std::error_code type_ec;
+        if (entry.is_directory(type_ec)) {
+            if (name == "node_modules") continue;
+            std::string path = entry.path().string();
+            submit_crawl_task([this, path] { crawl_directory(path); });
+        } else if (entry.is_regular_file(type_ec) && entry.file_size(type_ec) <= kMaxFileSize) {
+            std::string path = entry.path().string();
+            uint64_t size = entry.file_size(type_ec);
+            submit_crawl_task([this, path, size] { crawl_file(path, size); });
+        }
+    }
+}
+
+void BackgroundIndexer::crawl_file(const std::string& path, uint64_t size) {
+    uint64_t mtime = 0;
+    editor::PlatformFile::get_modified_time(path, mtime);
     
-    // Remove old entries for this file
-    for (auto& [word, locations] : index_) {
-        locations.erase(
-            std::remove_if(locations.begin(), locations.end(),
-                [&file_path](const Location& loc) {
-                    return loc.file_path == file_path;
-                }),
-            locations.end()
-        );
+    // Unchanged since the base index was written: nothing to read. base_ids_
+    // is only written by open_persistent_index, never during a crawl.
+    auto base_it = base_ids_.find(path);
+    if (base_it != base_ids_.end()) {
+        PersistentIndex::FileInfo info = base_->file(base_it->second);
+        if (info.mtime == mtime && info.size == size) {
+            base_seen_[base_it->second] = 1;
+            return;
+        }
     }
     
-    // Tokenize and index the new content
-    tokenize_and_index(file_path, content);
+    ParsedFile file;
+    if (!read_file(path, file)) return;
+    file.mtime = mtime;
+    file.size = size;
+    Shard& shard = *shards_[tasks_->pool().current_worker()];
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    shard.postings += file.postings;
+    shard.files.push_back(std::move(file));
+    if (shard.postings >= kMergeBatch) {
+        lock.unlock();
+        flush_shard(shard);
+    }
+}
+
+bool BackgroundIndexer::read_file(const std::string& path, ParsedFile& file) {
+    // Tokenized straight from a mapping; offsets refer to the raw bytes
+    auto mapping = editor::PlatformFile::map_file(path);
+    if (!mapping) return false;
+    std::string_view content(mapping->data(), mapping->size());
+    // Skip binaries: a NUL byte near the start
+    if (std::memchr(content.data(), '\0', std::min<size_t>(content.size(), 8192))) return false;
+    
+    file = tokenize(path, content);
+    return true;
+}
+
+void BackgroundIndexer::reindex_file(const std::string& path) {
+    std::error_code ec;
+    uint64_t size = std::filesystem::is_regular_file(path, ec) ? std::filesystem::file_size(path, ec) : 0;
+    uint64_t mtime = 0;
+    ParsedFile file;
+    bool readable = !ec && size <= kMaxFileSize && editor::PlatformFile::get_modified_time(path, mtime) &&
+                    read_file(path, file);
+    
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    if (is_buffer_locked(path)) return;
+    remove_file_locked(path);
+    if (!readable) return;
+    file.mtime = mtime;
+    file.size = size;
+    merge_locked(std::move(file));
+}
+
+void BackgroundIndexer::flush_shard(Shard& shard) {
+    std::vector<ParsedFile> files;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        files.swap(shard.files);
+        shard.postings = 0;
+    }
+    if (files.empty()) return;
+    EDITOR_TRACE_SCOPE("indexer", "merge batch");
+    EDITOR_TRACE_COUNTER("indexer", "batch files", static_cast<int64_t>(files.size()));
+    
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    for (ParsedFile& file : files) {
+        remove_file_locked(file.path);
+        merge_locked(std::move(file));
+    }
 }
 
 void BackgroundIndexer::remove_file(const std::string& file_path) {
     std::lock_guard<std::mutex> lock(index_mutex_);
+    remove_file_locked(file_path);
+}
+
+void BackgroundIndexer::apply_file_changes(const std::vector<editor::FileChange>& changes) {
+    if (!tasks_) return;
+    std::vector<std::string> roots;
+    {
+        std::lock_guard<std::mutex> lock(crawl_mutex_);
+        roots = roots_;
+    }
+    
+    for (const editor::FileChange& change : changes) {
+        if (!editor::is_in_workspace(roots, change.path)) continue;
+        const std::string& path = change.path;
+        
+        if (change.kind == editor::FileChange::Kind::Removed) {
+            std::lock_guard<std::mutex> lock(index_mutex_);
+            remove_tree_locked(path, false);
+        } else if (change.is_directory) {
+            // New, replaced or (after an overflow) unreliable: drop what is
+            // gone and crawl the rest, which skips unchanged base files
+            {
+                std::lock_guard<std::mutex> lock(index_mutex_);
+                remove_tree_locked(path, true);
+            }
+            submit_crawl_task([this, path] { crawl_directory(path); });
+        } else {
+            submit_crawl_task([this, path] { reindex_file(path); });
+        }
+    }
+}
+
+bool BackgroundIndexer::is_buffer_locked(const std::string& file_path) const {
+    auto it = file_ids_.find(file_path);
+    return it != file_ids_.end() && files_[it->second].content;
+}
+
+void BackgroundIndexer::remove_tree_locked(const std::string& path, bool missing_only) {
+    // A known file: no need to look for children
+    if (file_ids_.count(path) || base_ids_.count(path)) {
+        if (!is_buffer_locked(path)) remove_file_locked(path);
+        return;
+    }
+    
+    auto below = [&path](const std::string& candidate) {
+        return candidate.size() > path.size() && candidate.compare(0, path.size(), path) == 0 &&
+               (candidate[path.size()] == '/' || candidate[path.size()] == '\\');
+    };
+    std::vector<std::string> doomed;
+    for (const auto& entry : file_ids_) {
+        if (below(entry.first) && !files_[entry.second].content) doomed.push_back(entry.first);
+    }
+    for (const auto& entry : base_ids_) {
+        if (below(entry.first) && !base_shadowed_[entry.second]) doomed.push_back(entry.first);
+    }
+    for (const std::string& file_path : doomed) {
+        std::error_code ec;
+        if (missing_only && std::filesystem::exists(file_path, ec)) continue;
+        remove_file_locked(file_path);
+    }
+}
+
+void BackgroundIndexer::shadow_base_locked(uint32_t base_id) {
+    if (base_shadowed_[base_id]) return;
+    base_shadowed_[base_id] = 1;
+    --base_live_;
+    dirty_ = true;
+    ++generation_;
+}
+
+void BackgroundIndexer::remove_file_locked(const std::string& file_path) {
+    auto base_it = base_ids_.find(file_path);
+    if (base_it != base_ids_.end()) shadow_base_locked(base_it->second);
+    
+    auto id_it = file_ids_.find(file_path);
+    if (id_it == file_ids_.end()) return;
+    
+    uint32_t file_id = id_it->second;
+    file_ids_.erase(id_it);
+    dirty_ = true;
+    ++generation_;
     
-    // Remove all entries for this file
-    for (auto& [word, locations] : index_) {
-        locations.erase(
-            std::remove_if(locations.begin(), locations.end(),
-                [&file_path](const Location& loc) {
-                    return loc.file_path == file_path;
-                }),
-            locations.end()
-        );
+    FileEntry& file = files_[file_id];
+    file.live = false;
+    std::vector<std::pair<IndexEntry*, uint32_t>> terms;
+    terms.swap(file.terms);
+    std::vector<uint32_t> trigrams;
+    trigrams.swap(file.trigrams);
+    file.line_starts.reset(0);
+    file.content.reset();
+    
+    // Count every stale entry up front so compaction frees the id once
+    for (const auto& term : terms) file.pending += term.second;
+    file.pending += trigrams.size();
+    if (file.pending == 0) {
+        free_ids_.push_back(file_id);
+        return;
     }
     
-    file_lines_.erase(file_path);
+    // Only the words and trigrams this file contributed are touched
+    for (const auto& [entry, count] : terms) {
+        entry->second.stale += count;
+        if (entry->second.stale * 2 > entry->second.postings.size()) {
+            compact(entry);
+        }
+    }
+    for (uint32_t trigram : trigrams) {
+        auto it = trigrams_.find(trigram);
+        if (it == trigrams_.end()) continue;
+        if (++it->second.stale * 2 > it->second.files.size()) {
+            compact_trigram(trigram, it->second);
+        }
+    }
+}
+
+bool BackgroundIndexer::release_entry(uint32_t file_id) {
+    FileEntry& file = files_[file_id];
+    if (file.live) return false;
+    if (--file.pending == 0) free_ids_.push_back(file_id);
+    return true;
+}
+
+void BackgroundIndexer::compact(IndexEntry* entry) {
+    std::vector<Posting>& postings = entry->second.postings;
+    postings.erase(
+        std::remove_if(postings.begin(), postings.end(),
+            [this](const Posting& posting) { return release_entry(posting.file_id); }),
+        postings.end()
+    );
+    entry->second.stale = 0;
+    
+    // Live files never reference an empty list, so the word can go
+    if (postings.empty()) index_.erase(entry->first);
+}
+
+void BackgroundIndexer::compact_trigram(uint32_t trigram, TrigramList& list) {
+    list.files.erase(
+        std::remove_if(list.files.begin(), list.files.end(),
+            [this](uint32_t file_id) { return release_entry(file_id); }),
+        list.files.end()
+    );
+    list.stale = 0;
+    if (list.files.empty()) trigrams_.erase(trigram);
 }
 
-void BackgroundIndexer::tokenize_and_index(const std::string& file_path, const std::string& content) {
-    std::vector<std::string> lines;
-    std::istringstream stream(content);
-    std::string line;
+BackgroundIndexer::ParsedFile BackgroundIndexer::tokenize(const std::string& file_path, std::string_view content) {
+    ParsedFile file;
+    file.path = file_path;
     
-    while (std::getline(stream, line)) {
+    // Only the line offsets are kept, not the lines
+    scan_line_starts(content.data(), content.size(), file.line_starts);
+    std::vector<std::string_view> lines;
+    lines.reserve(file.line_starts.size());
+    for (size_t i = 0; i + 1 < file.line_starts.size(); ++i) {
+        size_t start = file.line_starts[i];
+        std::string_view line = content.substr(start, file.line_starts[i + 1] - 1 - start);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
         lines.push_back(line);
     }
     
-    file_lines_[file_path] = lines;
+    bool capitals = false;
+    auto add_posting = [&](const std::string& word, size_t line_num, size_t column) {
+        file.words[word].push_back({0, static_cast<uint32_t>(line_num), static_cast<uint32_t>(column)});
+        ++file.postings;
+        if (capitals && !file.spellings.count(word)) {
+            file.spellings.emplace(word, std::string(lines[line_num].substr(column, word.size())));
+        }
+    };
+    
+    SymbolTags::Language language = SymbolTags::language_for_path(file_path);
+    std::vector<SymbolTags::Definition> definitions;
     
     // Index each word in each line
     for (size_t line_num = 0; line_num < lines.size(); ++line_num) {
-        const std::string& current_line = lines[line_num];
+        std::string_view current_line = lines[line_num];
         std::string word;
         size_t column = 0;
         
@@ -85,16 +437,13 @@ void BackgroundIndexer::tokenize_and_index(const std::string& file_path, const s
             if (std::isalnum(c) || c == '_') {
                 if (word.empty()) {
                     column = i;
+                    capitals = false;
                 }
+                capitals |= std::isupper(static_cast<unsigned char>(c)) != 0;
                 word += std::tolower(c);
             } else {
                 if (!word.empty() && word.length() > 2) {
-                    Location loc;
-                    loc.file_path = file_path;
-                    loc.line_number = line_num;
-                    loc.column = column;
-                    
-                    index_[word].push_back(loc);
+                    add_posting(word, line_num, column);
                 }
                 word.clear();
             }
@@ -102,65 +451,772 @@ void BackgroundIndexer::tokenize_and_index(const std::string& file_path, const s
         
         // Don't forget the last word
         if (!word.empty() && word.length() > 2) {
-            Location loc;
-            loc.file_path = file_path;
-            loc.line_number = line_num;
-            loc.column = column;
-            
-            index_[word].push_back(loc);
+            add_posting(word, line_num, column);
+        }
+        
+        // Symbol definitions, under their exact spelling
+        definitions.clear();
+        SymbolTags::scan_line(language, current_line, static_cast<uint32_t>(line_num), definitions);
+        for (const SymbolTags::Definition& definition : definitions) {
+            file.words[kDefinitionMark + definition.name].push_back({0, definition.line, definition.column});
+            ++file.postings;
+        }
+        
+        // Case-folded trigrams; matches never span lines, so neither do these
+        for (size_t i = 0; i + 2 < current_line.length(); ++i) {
+            file.trigrams.push_back(fold_trigram(current_line.data() + i));
         }
     }
+    
+    std::sort(file.trigrams.begin(), file.trigrams.end());
+    file.trigrams.erase(std::unique(file.trigrams.begin(), file.trigrams.end()), file.trigrams.end());
+    return file;
 }
 
-std::vector<SearchResult> BackgroundIndexer::search(const std::string& query, size_t max_results) {
-    std::lock_guard<std::mutex> lock(index_mutex_);
+void BackgroundIndexer::merge_locked(ParsedFile&& parsed) {
+    ++generation_;
+    // Intern the path, reusing an id once no postings reference it
+    uint32_t file_id;
+    if (!free_ids_.empty()) {
+        file_id = free_ids_.back();
+        free_ids_.pop_back();
+    } else {
+        file_id = static_cast<uint32_t>(files_.size());
+        files_.emplace_back();
+    }
+    file_ids_[parsed.path] = file_id;
     
-    std::vector<SearchResult> results;
+    FileEntry& file = files_[file_id];
+    file.path = std::move(parsed.path);
+    file.line_starts = std::move(parsed.line_starts);
+    file.content = std::move(parsed.content);
+    file.mtime = parsed.mtime;
+    file.size = parsed.size;
+    file.live = true;
+    dirty_ = true;
+    
+    // One index lookup per distinct word; the reverse map gets one entry each
+    file.terms.reserve(parsed.words.size());
+    for (auto& [word, postings] : parsed.words) {
+        auto it = index_.try_emplace(word).first;
+        std::vector<Posting>& list = it->second.postings;
+        for (Posting& posting : postings) posting.file_id = file_id;
+        list.insert(list.end(), postings.begin(), postings.end());
+        file.terms.emplace_back(&*it, static_cast<uint32_t>(postings.size()));
+    }
+    for (uint32_t trigram : parsed.trigrams) {
+        trigrams_[trigram].files.push_back(file_id);
+    }
+    file.trigrams = std::move(parsed.trigrams);
+    for (auto& spelling : parsed.spellings) {
+        spellings_.emplace(spelling.first, std::move(spelling.second));
+    }
+}
+
+std::shared_ptr<const WorkspaceVocabulary> BackgroundIndexer::vocabulary() const {
+    return std::atomic_load(&vocabulary_);
+}
+
+void BackgroundIndexer::publish_vocabulary() {
+    std::unordered_map<std::string, uint32_t> counts;
+    std::shared_ptr<PersistentIndex> base;
+    std::vector<uint8_t> base_shadowed;
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(index_mutex_);
+        counts.reserve(index_.size());
+        for (const auto& entry : index_) {
+            if (entry.first[0] == kDefinitionMark) continue;
+            size_t live = entry.second.postings.size() - entry.second.stale;
+            if (live > 0) counts[entry.first] += static_cast<uint32_t>(live);
+        }
+        // The base is immutable: it is counted after the lock is released
+        base = base_;
+        base_shadowed = base_shadowed_;
+        generation = ++vocabulary_generation_;
+    }
+    if (base) {
+        base->for_each_word([&](std::string_view word, const Posting* postings, size_t count) {
+            if (word[0] == kDefinitionMark) return;
+            uint32_t live = 0;
+            for (size_t i = 0; i < count; ++i) {
+                uint32_t file_id = postings[i].file_id;
+                if (file_id < base_shadowed.size() && !base_shadowed[file_id]) ++live;
+            }
+            if (live > 0) counts[std::string(word)] += live;
+        });
+    }
     
+    std::vector<WorkspaceVocabulary::Word> words;
+    words.reserve(counts.size());
+    {
+        std::lock_guard<std::mutex> lock(index_mutex_);
+        for (auto& entry : counts) {
+            auto spelling = spellings_.find(entry.first);
+            std::string text = spelling != spellings_.end() ? spelling->second : entry.first;
+            words.push_back({entry.first, std::move(text), entry.second});
+        }
+    }
+    auto vocabulary = WorkspaceVocabulary::build(std::move(words), generation);
+    
+    // Publishers may race; the newest generation wins
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    auto current = std::atomic_load(&vocabulary_);
+    if (!current || current->generation() < generation) std::atomic_store(&vocabulary_, vocabulary);
+}
+
+std::vector<SearchResult> BackgroundIndexer::search(const std::string& query, size_t max_results) {
     // Convert query to lowercase for case-insensitive search
     std::string lower_query;
     for (char c : query) {
         lower_query += std::tolower(c);
     }
     
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    for (auto it = query_cache_.begin(); it != query_cache_.end(); ++it) {
+        if (it->generation != generation_ || it->key != lower_query || it->max_results != max_results) continue;
+        query_cache_.splice(query_cache_.begin(), query_cache_, it);
+        return it->results;
+    }
+    
+    std::vector<SearchResult> results;
+    rank_locked(lower_query, max_results, results);
+    // Answers from an older index are never asked for again
+    query_cache_.remove_if([this](const CachedQuery& cached) { return cached.generation != generation_; });
+    query_cache_.push_front({lower_query, max_results, generation_, results});
+    if (query_cache_.size() > kQueryCacheSize) query_cache_.pop_back();
+    return results;
+}
+
+void BackgroundIndexer::set_ranking_context(std::vector<std::string> open_files, std::vector<std::string> recent_files) {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    if (open_files == open_files_ && recent_files == recent_files_) return;
+    open_files_ = std::move(open_files);
+    recent_files_ = std::move(recent_files);
+    ++generation_;
+}
+
+uint64_t BackgroundIndexer::generation() const {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    return generation_;
+}
+
+namespace {
+
+bool is_separator(char c) {
+    return c == '/' || c == '\\';
+}
+
+// Directories the two paths share from their start, and how deep a's is
+void shared_directories(std::string_view a, std::string_view b, size_t& shared, size_t& depth) {
+    shared = depth = 0;
+    bool diverged = false;
+    size_t start = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (!is_separator(a[i])) continue;
+        ++depth;
+        if (!diverged && i < b.size() && is_separator(b[i]) && a.substr(start, i - start) == b.substr(start, i - start)) {
+            ++shared;
+        } else {
+            diverged = true;
+        }
+        start = i + 1;
+    }
+}
+
+} // namespace
+
+double BackgroundIndexer::file_score_locked(std::string_view path, size_t occurrences) const {
+    // Frequency counts with diminishing returns: a file with the word
+    // eight times is not eight times as good
+    double score = std::log2(1.0 + static_cast<double>(occurrences));
+    // Proximity: the share of the file's directories it has in common with
+    // the nearest open file (1 in the same directory)
+    double proximity = 0;
+    for (const std::string& open : open_files_) {
+        if (open == path) {
+            proximity = 1;
+            break;
+        }
+        size_t shared = 0, depth = 0;
+        shared_directories(path, open, shared, depth);
+        proximity = (std::max)(proximity, depth ? static_cast<double>(shared) / depth : 1.0);
+    }
+    score += proximity;
+    // Recency: 1 for the most recent file, falling off down the list
+    for (size_t i = 0; i < recent_files_.size(); ++i) {
+        if (recent_files_[i] != path) continue;
+        score += 0.5 * (1.0 - static_cast<double>(i) / recent_files_.size());
+        break;
+    }
+    return score;
+}
+
+void BackgroundIndexer::rank_locked(const std::string& key, size_t max_results, std::vector<SearchResult>& results) const {
+    // One candidate per file (its postings are adjacent), scored without
+    // reading a line
+    struct Candidate {
+        double score;
+        std::string_view path;
+        const Posting* postings;
+        size_t count;
+        uint32_t file_id;
+        bool base;
+    };
+    std::vector<Candidate> candidates;
+    auto add_runs = [&](const Posting* postings, size_t count, bool base) {
+        for (size_t i = 0, next = 0; i < count; i = next) {
+            uint32_t file_id = postings[i].file_id;
+            for (next = i + 1; next < count && postings[next].file_id == file_id; ++next) {}
+            std::string_view path;
+            if (base) {
+                if (file_id >= base_->file_count() || base_shadowed_[file_id]) continue;
+                path = base_->file(file_id).path;
+            } else {
+                if (!files_[file_id].live) continue;
+                path = files_[file_id].path;
+            }
+            candidates.push_back({file_score_locked(path, next - i), path, postings + i, next - i, file_id, base});
+        }
+    };
+    if (base_) {
+        size_t count = 0;
+        const Posting* postings = base_->word_postings(key, count);
+        add_runs(postings, count, true);
+    }
+    auto it = index_.find(key);
+    if (it != index_.end()) add_runs(it->second.postings.data(), it->second.postings.size(), false);
+    
+    // Best first; ties by path, so the order never depends on the crawl's
+    auto worse = [](const Candidate& a, const Candidate& b) {
+        return a.score != b.score ? a.score < b.score : a.path > b.path;
+    };
+    // Partial selection: the heap yields files one at a time, until they
+    // hold max_results postings
+    std::make_heap(candidates.begin(), candidates.end(), worse);
+    auto heap_end = candidates.end();
+    LineSource source;
+    while (heap_end != candidates.begin() && results.size() < max_results) {
+        std::pop_heap(candidates.begin(), heap_end, worse);
+        --heap_end;
+        const Candidate& best = *heap_end;
+        source = best.base ? base_lines_of_locked(best.file_id) : lines_of_locked(best.file_id);
+        for (size_t i = 0; i < best.count && results.size() < max_results; ++i) {
+            const Posting& posting = best.postings[i];
+            SearchResult result;
+            result.file_path = std::string(best.path);
+            result.line_number = posting.line_number;
+            result.column = posting.column;
+            result.line_content = std::string(source.line(posting.line_number));
+            results.push_back(std::move(result));
+        }
+    }
+}
+
+std::vector<SearchResult> BackgroundIndexer::find_definitions(const std::string& symbol, size_t max_results) {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    std::vector<SearchResult> results;
+    collect_locked(std::string(1, kDefinitionMark) + symbol, nullptr, symbol.size(), max_results, results);
+    return results;
+}
+
+std::vector<SearchResult> BackgroundIndexer::find_references(const std::string& symbol, size_t max_results) {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    std::string lower;
+    for (char c : symbol) lower += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    std::vector<SearchResult> results;
+    collect_locked(lower, &symbol, symbol.size(), max_results, results);
+    return results;
+}
+
+void BackgroundIndexer::collect_locked(const std::string& key, const std::string* exact, size_t length,
+                                       size_t max_results, std::vector<SearchResult>& results) const {
+    // Postings of one file are adjacent, so each file is opened once
+    LineSource source;
+    uint32_t source_id = UINT32_MAX;
+    auto add = [&](std::string path, const Posting& posting) {
+        std::string_view line = source.line(posting.line_number);
+        if (exact && line.substr((std::min)(size_t(posting.column), line.size()), exact->size()) != *exact) return;
+        SearchResult result;
+        result.file_path = std::move(path);
+        result.line_number = posting.line_number;
+        result.column = posting.column;
+        result.line_content = std::string(line);
+        result.length = length;
+        results.push_back(std::move(result));
+    };
+    
+    // Base postings first, skipping files indexed again since
+    if (base_) {
+        size_t count = 0;
+        const Posting* postings = base_->word_postings(key, count);
+        for (size_t i = 0; i < count && results.size() < max_results; ++i) {
+            const Posting& posting = postings[i];
+            if (posting.file_id >= base_->file_count() || base_shadowed_[posting.file_id]) continue;
+            if (posting.file_id != source_id) {
+                source = base_lines_of_locked(posting.file_id);
+                source_id = posting.file_id;
+            }
+            add(std::string(base_->file(posting.file_id).path), posting);
+        }
+    }
+    source_id = UINT32_MAX;
+    
     // Find in index
-    auto it = index_.find(lower_query);
-    if (it == index_.end()) {
-        return results;
+    auto it = index_.find(key);
+    if (it == index_.end()) return;
+    
+    // Convert postings to search results, skipping removed files
+    for (const Posting& posting : it->second.postings) {
+        if (results.size() >= max_results) break;
+        const FileEntry& file = files_[posting.file_id];
+        if (!file.live) continue;
+        if (posting.file_id != source_id) {
+            source = lines_of_locked(posting.file_id);
+            source_id = posting.file_id;
+        }
+        add(file.path, posting);
     }
+}
+
+std::vector<std::string> BackgroundIndexer::regex_literals(const std::string& pattern) {
+    std::vector<std::string> runs;
+    std::string run;
+    auto end_run = [&]() {
+        if (!run.empty()) runs.push_back(run);
+        run.clear();
+    };
+    // Index of the ']' closing the class that opens at i
+    auto skip_class = [&](size_t i) {
+        ++i;
+        if (i < pattern.size() && pattern[i] == '^') ++i;
+        if (i < pattern.size() && pattern[i] == ']') ++i;     // Leading ']' is a member
+        for (; i < pattern.size() && pattern[i] != ']'; ++i) {
+            if (pattern[i] == '\\') ++i;
+        }
+        return i;
+    };
+    // Index of the ')' closing the group that opens at i
+    auto skip_group = [&](size_t i) {
+        int depth = 0;
+        for (; i < pattern.size(); ++i) {
+            if (pattern[i] == '\\') ++i;
+            else if (pattern[i] == '[') i = skip_class(i);
+            else if (pattern[i] == '(') ++depth;
+            else if (pattern[i] == ')' && --depth == 0) break;
+        }
+        return i;
+    };
     
-    // Convert locations to search results
-    for (const auto& loc : it->second) {
-        if (results.size() >= max_results) {
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        switch (c) {
+        case '|':
+            return {};          // Top-level alternation: nothing is mandatory
+        case '\\':
+            if (i + 1 < pattern.size() && !std::isalnum(static_cast<unsigned char>(pattern[i + 1]))) {
+                run += pattern[++i];    // Escaped punctuation is a literal
+            } else {
+                ++i;                    // \d, \w, \b, \n, backreferences...
+                end_run();
+            }
+            break;
+        case '[':
+            i = skip_class(i);
+            end_run();
+            break;
+        case '(':
+            i = skip_group(i);
+            end_run();
+            break;
+        case '*':
+        case '?':
+            if (!run.empty()) run.pop_back();   // The previous atom is optional
+            end_run();
             break;
+        case '{':
+            if (i + 1 < pattern.size() && pattern[i + 1] == '0' && !run.empty()) run.pop_back();
+            i = std::min(pattern.find('}', i), pattern.size());
+            end_run();
+            break;
+        case '+':
+        case '.':
+        case '^':
+        case '$':
+            end_run();
+            break;
+        default:
+            run += c;
+        }
+    }
+    end_run();
+    return runs;
+}
+
+std::vector<SearchResult> BackgroundIndexer::find_in_files(const std::string& pattern, bool use_regex,
+                                                           bool case_sensitive, size_t max_results) {
+    std::vector<SearchResult> results;
+    if (pattern.empty()) return results;
+    
+    std::shared_ptr<const RegexEngine> regex;
+    if (use_regex) {
+        regex = RegexEngine::cached(pattern, case_sensitive);
+        if (!regex->ok()) return results;
+    }
+    
+    std::string folded_pattern = pattern;
+    if (!case_sensitive) {
+        for (char& c : folded_pattern) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    
+    // Verify one file against the pattern; false once max_results is reached
+    auto verify = [&](std::string_view path, LineSource source) {
+        for (size_t line = 0; line < source.line_count(); ++line) {
+            std::string_view text = source.line(line);
+            auto add = [&](size_t column, size_t length) {
+                SearchResult result;
+                result.file_path = std::string(path);
+                result.line_number = line;
+                result.column = column;
+                result.line_content = std::string(text);
+                result.length = length;
+                results.push_back(std::move(result));
+                return results.size() < max_results;
+            };
+            if (use_regex) {
+                bool more = true;
+                regex->for_each_match(text, 0, [&](const RegexEngine::Match& match) {
+                    if (match.length > 0) more = add(match.position, match.length);
+                    return more;
+                });
+                if (!more) return false;
+                continue;
+            }
+            std::string folded;
+            std::string_view haystack = text;
+            if (!case_sensitive) {
+                folded.assign(text.data(), text.size());
+                for (char& c : folded) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+                haystack = folded;
+            }
+            for (size_t pos = haystack.find(folded_pattern); pos != std::string_view::npos;
+                 pos = haystack.find(folded_pattern, pos + 1)) {
+                if (!add(pos, pattern.size())) return false;
+            }
         }
+        return true;
+    };
+    
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    for_each_candidate_locked(pattern, use_regex, [&](std::string_view path, bool base, uint32_t file_id) {
+        return verify(path, base ? base_lines_of_locked(file_id) : lines_of_locked(file_id));
+    });
+    return results;
+}
+
+std::vector<std::string> BackgroundIndexer::candidate_files(const std::string& pattern, bool use_regex) const {
+    std::vector<std::string> paths;
+    if (pattern.empty() || (use_regex && !RegexEngine::cached(pattern)->ok())) return paths;
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    for_each_candidate_locked(pattern, use_regex, [&](std::string_view path, bool, uint32_t) {
+        paths.emplace_back(path);
+        return true;
+    });
+    return paths;
+}
+
+void BackgroundIndexer::for_each_candidate_locked(const std::string& pattern, bool use_regex,
+                                                  const CandidateVisitor& visit) const {
+    // Plan: every trigram of every mandatory literal must be in the file
+    std::vector<uint32_t> required;
+    for (const std::string& literal : use_regex ? regex_literals(pattern) : std::vector<std::string>{pattern}) {
+        for (size_t i = 0; i + 2 < literal.size(); ++i) required.push_back(fold_trigram(literal.data() + i));
+    }
+    std::sort(required.begin(), required.end());
+    required.erase(std::unique(required.begin(), required.end()), required.end());
+    
+    // Base: its trigram lists are sorted, so the rarest drives and the
+    // others are binary-searched
+    if (base_) {
+        std::vector<std::pair<const uint32_t*, size_t>> lists;
+        bool possible = true;
+        for (uint32_t trigram : required) {
+            size_t count = 0;
+            const uint32_t* files = base_->trigram_files(trigram, count);
+            if (!files) possible = false;
+            lists.emplace_back(files, count);
+        }
+        std::sort(lists.begin(), lists.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
         
-        SearchResult result;
-        result.file_path = loc.file_path;
-        result.line_number = loc.line_number;
-        result.column = loc.column;
+        auto check = [&](uint32_t file_id) {
+            if (file_id >= base_->file_count() || base_shadowed_[file_id]) return true;
+            for (size_t i = 1; i < lists.size(); ++i) {
+                if (!std::binary_search(lists[i].first, lists[i].first + lists[i].second, file_id)) return true;
+            }
+            return visit(base_->file(file_id).path, true, file_id);
+        };
+        if (possible && !lists.empty()) {
+            for (size_t i = 0; i < lists[0].second; ++i) {
+                if (!check(lists[0].first[i])) return;
+            }
+        } else if (possible) {
+            for (uint32_t file_id = 0; file_id < base_->file_count(); ++file_id) {
+                if (!check(file_id)) return;
+            }
+        }
+    }
+    
+    // In-memory files: drive the intersection from the rarest trigram and
+    // probe the others in each candidate's own sorted trigram set
+    const std::vector<uint32_t>* driver = nullptr;
+    for (uint32_t trigram : required) {
+        auto it = trigrams_.find(trigram);
+        if (it == trigrams_.end()) return;
+        if (!driver || it->second.files.size() < driver->size()) driver = &it->second.files;
+    }
+    std::vector<uint32_t> candidates;
+    if (driver) {
+        for (uint32_t file_id : *driver) {
+            const FileEntry& file = files_[file_id];
+            if (!file.live) continue;
+            bool all = std::all_of(required.begin(), required.end(), [&](uint32_t trigram) {
+                return std::binary_search(file.trigrams.begin(), file.trigrams.end(), trigram);
+            });
+            if (all) candidates.push_back(file_id);
+        }
+    } else {
+        for (uint32_t file_id = 0; file_id < files_.size(); ++file_id) {
+            if (files_[file_id].live) candidates.push_back(file_id);
+        }
+    }
+    for (uint32_t file_id : candidates) {
+        if (!visit(files_[file_id].path, false, file_id)) break;
+    }
+}
+
+size_t BackgroundIndexer::get_indexed_file_count() const {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    return file_ids_.size() + base_live_;
+}
+
+size_t BackgroundIndexer::get_posting_count(const std::string& word) const {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    auto it = index_.find(word);
+    return it == index_.end() ? 0 : it->second.postings.size();
+}
+
+std::string BackgroundIndexer::get_persistent_index_file(const std::string& workspace_dir) {
+    return editor::PlatformFile::join_path(editor::PlatformFile::join_path(workspace_dir, ".velocity"), "index.bin");
+}
+
+bool BackgroundIndexer::open_persistent_index(const std::string& workspace_dir) {
+    auto base = PersistentIndex::open(get_persistent_index_file(workspace_dir));
+    
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    persistent_path_ = get_persistent_index_file(workspace_dir);
+    base_ = base;
+    ++generation_;
+    base_ids_.clear();
+    base_shadowed_.assign(base_ ? base_->file_count() : 0, 0);
+    base_seen_.assign(base_shadowed_.size(), 0);
+    base_live_ = base_shadowed_.size();
+    if (!base_) return false;
+    
+    base_ids_.reserve(base_->file_count());
+    for (uint32_t id = 0; id < base_->file_count(); ++id) {
+        base_ids_.emplace(std::string(base_->file(id).path), id);
+    }
+    // Paths already indexed in memory take precedence
+    for (const auto& entry : file_ids_) {
+        auto it = base_ids_.find(entry.first);
+        if (it != base_ids_.end()) shadow_base_locked(it->second);
+    }
+    dirty_ = !file_ids_.empty();
+    return true;
+}
+
+bool BackgroundIndexer::save_persistent_index() {
+    PersistentIndex::Writer writer;
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(index_mutex_);
+        if (persistent_path_.empty()) return false;
+        if (!dirty_) return true;
+        path = persistent_path_;
         
-        // Get the line content
-        auto file_it = file_lines_.find(loc.file_path);
-        if (file_it != file_lines_.end() && loc.line_number < file_it->second.size()) {
-            result.line_content = file_it->second[loc.line_number];
+        // New ids: surviving base files first, then the in-memory ones
+        std::vector<uint32_t> base_map(base_ ? base_->file_count() : 0, UINT32_MAX);
+        std::vector<uint32_t> file_map(files_.size(), UINT32_MAX);
+        for (uint32_t id = 0; id < base_map.size(); ++id) {
+            if (base_shadowed_[id]) continue;
+            PersistentIndex::FileInfo info = base_->file(id);
+            const uint64_t* starts = base_->line_starts(id);
+            base_map[id] = writer.add_file(info.path, info.mtime, info.size,
+                                           std::vector<uint64_t>(starts, starts + info.line_count + 1));
+        }
+        for (uint32_t id = 0; id < files_.size(); ++id) {
+            const FileEntry& file = files_[id];
+            // Buffers from index_file have no file to read lines back from
+            if (!file.live || file.content) continue;
+            PrefixIndex scanned;
+            const PrefixIndex* table = &file.line_starts;
+            if (file.line_starts.empty()) {
+                // Dropped under memory pressure: scan the file once more
+                std::shared_ptr<editor::MappedFile> mapping = editor::PlatformFile::map_file(file.path);
+                if (!mapping) continue;
+                scan_line_starts(mapping->data(), mapping->size(), scanned);
+                table = &scanned;
+            }
+            std::vector<uint64_t> starts(table->size());
+            for (size_t i = 0; i < starts.size(); ++i) starts[i] = (*table)[i];
+            file_map[id] = writer.add_file(file.path, file.mtime, file.size, std::move(starts));
         }
         
-        results.push_back(result);
+        std::vector<Posting> kept;
+        auto keep = [&](const std::vector<uint32_t>& map, const Posting* postings, size_t count) {
+            kept.clear();
+            for (size_t i = 0; i < count; ++i) {
+                if (postings[i].file_id < map.size() && map[postings[i].file_id] != UINT32_MAX) {
+                    kept.push_back({map[postings[i].file_id], postings[i].line_number, postings[i].column});
+                }
+            }
+        };
+        if (base_) {
+            base_->for_each_word([&](std::string_view word, const Posting* postings, size_t count) {
+                keep(base_map, postings, count);
+                writer.add_postings(word, kept.data(), kept.size());
+            });
+            base_->for_each_trigram([&](uint32_t trigram, const uint32_t* ids, size_t count) {
+                for (size_t i = 0; i < count; ++i) {
+                    if (ids[i] < base_map.size() && base_map[ids[i]] != UINT32_MAX) writer.add_trigram(trigram, base_map[ids[i]]);
+                }
+            });
+        }
+        for (const auto& [word, list] : index_) {
+            keep(file_map, list.postings.data(), list.postings.size());
+            writer.add_postings(word, kept.data(), kept.size());
+        }
+        for (const auto& [trigram, list] : trigrams_) {
+            for (uint32_t id : list.files) {
+                if (file_map[id] != UINT32_MAX) writer.add_trigram(trigram, file_map[id]);
+            }
+        }
+        dirty_ = false;
     }
     
-    return results;
+    // Serialize and write outside the lock
+    editor::PlatformFile::create_directories(editor::PlatformFile::get_directory(path));
+    if (writer.write(path)) return true;
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    dirty_ = true;
+    return false;
 }
 
-size_t BackgroundIndexer::get_indexed_file_count() const {
-    std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(index_mutex_));
-    return file_lines_.size();
+void BackgroundIndexer::set_document_lookup(DocumentLookup lookup) {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    document_lookup_ = std::move(lookup);
+    ++generation_;         // Line content may now come from elsewhere
+}
+
+size_t BackgroundIndexer::get_line_table_bytes() const {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    size_t bytes = 0;
+    for (const FileEntry& file : files_) bytes += file.line_starts.bytes();
+    return bytes;
 }
 
-void BackgroundIndexer::indexing_worker() {
-    // This would normally watch for file changes and re-index
-    // For the demo, we just keep the thread alive
-    while (!should_stop_.load()) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+size_t BackgroundIndexer::drop_line_tables() {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    size_t bytes = 0;
+    for (FileEntry& file : files_) {
+        bytes += file.line_starts.bytes();
+        file.line_starts = PrefixIndex();
     }
+    return bytes;
+}
+
+BackgroundIndexer::MemoryUsage BackgroundIndexer::get_memory_usage() const {
+    using editor::heap_bytes;
+    using editor::node_bytes;
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    MemoryUsage usage;
+    usage.words = node_bytes(index_);
+    for (const auto& [word, list] : index_) usage.words += heap_bytes(word) + heap_bytes(list.postings);
+    usage.trigrams = node_bytes(trigrams_);
+    for (const auto& entry : trigrams_) usage.trigrams += heap_bytes(entry.second.files);
+    usage.files = heap_bytes(files_) + node_bytes(file_ids_) + heap_bytes(free_ids_);
+    for (const auto& entry : file_ids_) usage.files += heap_bytes(entry.first);
+    for (const FileEntry& file : files_) {
+        usage.files += heap_bytes(file.path) + heap_bytes(file.terms) + heap_bytes(file.trigrams);
+        if (file.content) usage.files += heap_bytes(*file.content);
+        usage.line_tables += file.line_starts.bytes();
+    }
+    usage.files += node_bytes(base_ids_) + heap_bytes(base_shadowed_) + heap_bytes(base_seen_);
+    for (const auto& entry : base_ids_) usage.files += heap_bytes(entry.first);
+    usage.spellings = node_bytes(spellings_);
+    for (const auto& [lower, spelling] : spellings_) usage.spellings += heap_bytes(lower) + heap_bytes(spelling);
+    return usage;
+}
+
+BackgroundIndexer::LineSource BackgroundIndexer::open_lines_locked(
+        const std::string& path, const std::shared_ptr<const std::string>& content) const {
+    LineSource source;
+    if (document_lookup_) source.document_ = document_lookup_(path);
+    if (source.document_) return source;
+    
+    if (content) {
+        source.content_ = content;
+        source.data_ = content->data();
+        source.size_ = content->size();
+    } else if ((source.mapping_ = editor::PlatformFile::map_file(path))) {
+        source.data_ = source.mapping_->data();
+        source.size_ = source.mapping_->size();
+    }
+    return source;
+}
+
+BackgroundIndexer::LineSource BackgroundIndexer::lines_of_locked(uint32_t file_id) const {
+    const FileEntry& file = files_[file_id];
+    LineSource source = open_lines_locked(file.path, file.content);
+    source.starts_ = &file.line_starts;
+    if (file.line_starts.empty() && file.live && source.data_) {
+        // Dropped under memory pressure: found again for this lookup only
+        scan_line_starts(source.data_, source.size_, source.scanned_);
+        source.starts_ = nullptr;
+    }
+    const PrefixIndex& starts = source.starts_ ? file.line_starts : source.scanned_;
+    source.count_ = starts.empty() ? 0 : starts.size() - 1;
+    return source;
+}
+
+BackgroundIndexer::LineSource BackgroundIndexer::base_lines_of_locked(uint32_t base_id) const {
+    PersistentIndex::FileInfo info = base_->file(base_id);
+    LineSource source = open_lines_locked(std::string(info.path), nullptr);
+    source.base_starts_ = base_->line_starts(base_id);
+    source.count_ = info.line_count;
+    return source;
+}
+
+size_t BackgroundIndexer::LineSource::line_count() const {
+    return document_ ? document_->get_line_count() : count_;
+}
+
+std::string_view BackgroundIndexer::LineSource::line(size_t line_number) {
+    if (document_) {
+        scratch_ = document_->get_line(line_number);
+        return scratch_;
+    }
+    if (line_number >= count_ || !data_) return {};
+    
+    // The scanned table lives in this source, which may have been moved
+    const PrefixIndex* starts = base_starts_ ? nullptr : starts_ ? starts_ : &scanned_;
+    size_t start = starts ? (*starts)[line_number] : static_cast<size_t>(base_starts_[line_number]);
+    size_t end = starts ? (*starts)[line_number + 1] : static_cast<size_t>(base_starts_[line_number + 1]);
+    // Drop the terminator; the file may have changed since it was indexed
+    if (end == 0 || start >= size_) return {};
+    end = std::min(end - 1, size_);
+    if (end <= start) return {};
+    std::string_view text(data_ + start, end - start);
+    if (text.back() == '\r') text.remove_suffix(1);
+    return text;
 }
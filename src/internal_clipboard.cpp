@@ -0,0 +1,97 @@
+#include "internal_clipboard.h"
+#include "document_snapshot.h"
+#include "text_transcode.h"
+#include <cstring>
+#include <string_view>
+
+namespace editor {
+
+namespace {
+
+size_t sequence_length(unsigned char lead) {
+    if (lead >= 0xF0 && lead <= 0xF7) return 4;
+    if (lead >= 0xE0) return lead <= 0xEF ? 3 : 1;
+    if (lead >= 0xC0) return 2;
+    return 1;
+}
+
+bool is_continuation(char c) {
+    return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+
+// Bytes at the end of text that start a sequence it does not finish
+size_t incomplete_tail(const char* text, size_t length) {
+    for (size_t back = 1; back <= 3 && back <= length; ++back) {
+        char c = text[length - back];
+        if (is_continuation(c)) continue;
+        return sequence_length(static_cast<unsigned char>(c)) > back ? back : 0;
+    }
+    return 0;
+}
+
+} // namespace
+
+void InternalClipboard::copy(const std::shared_ptr<PieceTable>& document, size_t start, size_t length) {
+    clear();
+    if (!document) return;
+    span_ = document->get_span(start, length);
+    if (span_.length == 0) return;
+    source_ = document;
+    snapshot_ = document->snapshot();
+    start_ = start;
+    length_ = span_.length;
+}
+
+void InternalClipboard::clear() {
+    source_.reset();
+    span_ = PieceTable::Span();
+    snapshot_.reset();
+    start_ = length_ = 0;
+}
+
+size_t InternalClipboard::paste(PieceTable& target, size_t position) const {
+    if (empty()) return 0;
+    size_t before = target.get_total_length();
+    // The span only means something in the buffers it was taken from
+    if (source_.lock().get() == &target) target.insert_span(position, span_);
+    else target.insert_shared(position, snapshot_, start_, length_);
+    return target.get_total_length() - before;
+}
+
+size_t InternalClipboard::write_utf16(char16_t* out) const {
+    size_t units = 0;
+    char carry[4];
+    size_t carried = 0;     // A sequence the previous piece ended inside
+    size_t end = start_ + length_;
+    for (size_t position = start_; position < end;) {
+        std::string_view chunk = snapshot_->chunk_at(position);
+        if (chunk.empty()) break;
+        chunk = chunk.substr(0, end - position);
+        position += chunk.size();
+        size_t used = 0;
+        if (carried > 0) {
+            size_t need = sequence_length(static_cast<unsigned char>(carry[0]));
+            while (carried < need && used < chunk.size() && is_continuation(chunk[used])) carry[carried++] = chunk[used++];
+            if (carried < need && used == chunk.size() && position < end) continue;     // A piece of one byte
+            units += TextTranscode::utf8_to_utf16(carry, carried, out + units);
+            carried = 0;
+        }
+        size_t tail = position < end ? incomplete_tail(chunk.data() + used, chunk.size() - used) : 0;
+        units += TextTranscode::utf8_to_utf16(chunk.data() + used, chunk.size() - used - tail, out + units);
+        std::memcpy(carry, chunk.data() + chunk.size() - tail, tail);
+        carried = tail;
+    }
+    if (carried > 0) units += TextTranscode::utf8_to_utf16(carry, carried, out + units);
+    return units;
+}
+
+void InternalClipboard::release_mapping(const PieceTable& document) {
+    if (!snapshot_ || !snapshot_->is_mapped() || source_.lock().get() != &document) return;
+    // The span stays valid (release_mapping keeps offsets); only the
+    // snapshot has to stop reading the file
+    PieceTable copy(document.get_span_text(span_));
+    snapshot_ = copy.snapshot();
+    start_ = 0;
+}
+
+} // namespace editor
@@ -0,0 +1,160 @@
+#include "large_file_policy.h"
+#include "memory_report.h"
+#include "piece_table.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace editor {
+
+namespace {
+
+const char* const kPrefix = "large_file.";
+
+bool parse_mode(const std::string& text, FeatureMode& out) {
+    if (text == "on") out = FeatureMode::On;
+    else if (text == "defer") out = FeatureMode::Defer;
+    else if (text == "off") out = FeatureMode::Off;
+    else return false;
+    return true;
+}
+
+// "a", "a and b", "a, b and c"
+std::string join(const std::string* items, size_t count) {
+    std::string out;
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0) out += i + 1 == count ? " and " : ", ";
+        out += items[i];
+    }
+    return out;
+}
+
+} // namespace
+
+LargeFilePolicy::LargeFilePolicy() {
+    modes_[static_cast<size_t>(LargeFileFeature::Minimap)] = FeatureMode::Off;
+    modes_[static_cast<size_t>(LargeFileFeature::Folding)] = FeatureMode::Defer;
+    modes_[static_cast<size_t>(LargeFileFeature::Autocomplete)] = FeatureMode::Defer;
+    modes_[static_cast<size_t>(LargeFileFeature::TreeSitter)] = FeatureMode::Off;
+    modes_[static_cast<size_t>(LargeFileFeature::LanguageServer)] = FeatureMode::Off;
+    modes_[static_cast<size_t>(LargeFileFeature::FullHighlight)] = FeatureMode::Off;
+}
+
+const char* LargeFilePolicy::name(LargeFileFeature feature) {
+    switch (feature) {
+        case LargeFileFeature::Minimap: return "minimap";
+        case LargeFileFeature::Folding: return "folding";
+        case LargeFileFeature::Autocomplete: return "autocomplete";
+        case LargeFileFeature::TreeSitter: return "tree_sitter";
+        case LargeFileFeature::LanguageServer: return "language_server";
+        case LargeFileFeature::FullHighlight: return "full_highlight";
+        case LargeFileFeature::Count: break;
+    }
+    return "";
+}
+
+const char* LargeFilePolicy::description(LargeFileFeature feature) {
+    switch (feature) {
+        case LargeFileFeature::Minimap: return "minimap";
+        case LargeFileFeature::Folding: return "folding";
+        case LargeFileFeature::Autocomplete: return "autocomplete";
+        case LargeFileFeature::TreeSitter: return "Tree-sitter";
+        case LargeFileFeature::LanguageServer: return "language server";
+        case LargeFileFeature::FullHighlight: return "highlighting outside the view";
+        case LargeFileFeature::Count: break;
+    }
+    return "";
+}
+
+bool LargeFilePolicy::parse_size(const std::string& text, size_t& out) {
+    size_t digits = 0;
+    while (digits < text.size() && std::isdigit(static_cast<unsigned char>(text[digits]))) ++digits;
+    if (digits == 0 || digits > 15) return false;
+    size_t value = static_cast<size_t>(std::stoull(text.substr(0, digits)));
+    std::string unit = text.substr(digits);
+    for (char& c : unit) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    if (unit == "K" || unit == "KB") value *= 1024;
+    else if (unit == "M" || unit == "MB") value *= 1024 * 1024;
+    else if (unit == "G" || unit == "GB") value *= size_t(1024) * 1024 * 1024;
+    else if (!unit.empty() && unit != "B") return false;
+    out = value;
+    return true;
+}
+
+void LargeFilePolicy::load(const std::map<std::string, std::string>& settings) {
+    for (const auto& [key, value] : settings) {
+        if (key.compare(0, std::strlen(kPrefix), kPrefix) != 0) continue;
+        std::string option = key.substr(std::strlen(kPrefix));
+        if (option == "enabled") {
+            if (value == "true" || value == "false") enabled_ = value == "true";
+        } else if (option == "max_bytes") {
+            parse_size(value, max_bytes_);
+        } else if (option == "max_lines") {
+            parse_size(value, max_lines_);
+        } else if (option == "max_line_length") {
+            parse_size(value, max_line_length_);
+        } else {
+            for (size_t i = 0; i < kFeatures; ++i) {
+                if (option == name(static_cast<LargeFileFeature>(i))) parse_mode(value, modes_[i]);
+            }
+        }
+    }
+}
+
+LargeFilePolicy::Decision LargeFilePolicy::evaluate(size_t bytes, size_t lines, size_t longest_line) const {
+    Decision decision;
+    if (!enabled_) return decision;
+    if (bytes > max_bytes_) {
+        decision.reason = MemoryReport::format_bytes(bytes) + " over the " + MemoryReport::format_bytes(max_bytes_) + " limit";
+    } else if (lines > max_lines_) {
+        decision.reason = std::to_string(lines) + " lines over the " + std::to_string(max_lines_) + " line limit";
+    } else if (longest_line > max_line_length_) {
+        decision.reason = "a " + std::to_string(longest_line) + "-character line over the " +
+                          std::to_string(max_line_length_) + " limit";
+    } else {
+        return decision;
+    }
+    decision.large = true;
+    std::copy(std::begin(modes_), std::end(modes_), std::begin(decision.modes));
+    return decision;
+}
+
+LargeFilePolicy::Decision LargeFilePolicy::evaluate(const PieceTable& document) const {
+    size_t bytes = document.get_total_length();
+    size_t longest = 0;
+    if (enabled_) {
+        std::string sample = document.get_text(0, (std::min)(bytes, kLineSampleBytes));
+        size_t start = 0;
+        while (start <= sample.size()) {
+            size_t end = sample.find('\n', start);
+            if (end == std::string::npos) end = sample.size();
+            longest = (std::max)(longest, end - start);
+            start = end + 1;
+        }
+    }
+    return evaluate(bytes, document.get_line_count(), longest);
+}
+
+bool LargeFilePolicy::Decision::resume(LargeFileFeature feature) {
+    FeatureMode& slot = modes[static_cast<size_t>(feature)];
+    if (slot != FeatureMode::Defer) return slot == FeatureMode::On;
+    slot = FeatureMode::On;
+    return true;
+}
+
+std::string LargeFilePolicy::Decision::message() const {
+    if (!large) return std::string();
+    std::string off[kFeatures], deferred[kFeatures];
+    size_t off_count = 0, deferred_count = 0;
+    for (size_t i = 0; i < kFeatures; ++i) {
+        const char* text = description(static_cast<LargeFileFeature>(i));
+        if (modes[i] == FeatureMode::Off) off[off_count++] = text;
+        else if (modes[i] == FeatureMode::Defer) deferred[deferred_count++] = text;
+    }
+    std::string out = "Large file mode (" + reason + ")";
+    if (off_count) out += ". Off: " + join(off, off_count);
+    if (deferred_count) out += ". Starts when used: " + join(deferred, deferred_count);
+    return out;
+}
+
+} // namespace editor
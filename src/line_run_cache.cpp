@@ -0,0 +1,70 @@
+#include "line_run_cache.h"
+
+namespace editor {
+
+namespace {
+
+constexpr uint64_t kFnvOffset = 1469598103934665603ull;
+constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+void mix(uint64_t& hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= kFnvPrime;
+    }
+}
+
+} // namespace
+
+uint64_t LineRunCache::key_of(const DrawList& list, const DrawCommand& run, uint32_t background) {
+    uint64_t hash = kFnvOffset;
+    std::string_view text = list.run_text(run);
+    mix(hash, text.data(), text.size());
+    mix(hash, &run.text_length, sizeof(run.text_length));
+    mix(hash, &run.x1, sizeof(run.x1));
+    mix(hash, &background, sizeof(background));
+    const ColorSpan* spans = list.spans().data() + run.span_offset;
+    for (uint32_t i = 0; i < run.span_count; ++i) {
+        mix(hash, &spans[i].length, sizeof(spans[i].length));
+        mix(hash, &spans[i].color, sizeof(spans[i].color));
+    }
+    return hash;
+}
+
+size_t LineRunCache::acquire(uint64_t key, bool& hit) {
+    ++clock_;
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        slots_[it->second].last_use = clock_;
+        hits_++;
+        hit = true;
+        return it->second;
+    }
+    // Least recently used slot; capacity is a few hundred rows at most
+    size_t victim = 0;
+    for (size_t i = 1; i < slots_.size(); ++i) {
+        if (slots_[i].last_use < slots_[victim].last_use) victim = i;
+    }
+    Slot& slot = slots_[victim];
+    if (slot.used) index_.erase(slot.key);
+    slot.key = key;
+    slot.used = true;
+    slot.last_use = clock_;
+    index_[key] = victim;
+    misses_++;
+    hit = false;
+    return victim;
+}
+
+void LineRunCache::set_capacity(size_t capacity) {
+    slots_.assign(capacity > 0 ? capacity : 1, Slot{});
+    index_.clear();
+}
+
+void LineRunCache::clear() {
+    for (Slot& slot : slots_) slot = Slot{};
+    index_.clear();
+}
+
+} // namespace editor
@@ -0,0 +1,83 @@
+#include "log_follower.h"
+#include "piece_table.h"
+#include "platform_file.h"
+#include <algorithm>
+#include <fstream>
+
+namespace editor {
+
+bool LogFollower::start(const std::string& path, std::shared_ptr<PieceTable> document, uint64_t offset) {
+    stop();
+    if (!document) return false;
+    path_ = path;
+    offset_ = offset;
+    if (!read_fingerprint(fingerprint_)) {
+        path_.clear();
+        return false;
+    }
+    document_ = std::move(document);
+    return true;
+}
+
+bool LogFollower::start(const std::string& path, std::shared_ptr<PieceTable> document) {
+    uint64_t offset = document ? document->get_total_length() : 0;
+    return start(path, std::move(document), offset);
+}
+
+void LogFollower::stop() {
+    document_.reset();
+    path_.clear();
+    fingerprint_.clear();
+    offset_ = 0;
+    last_appended_ = 0;
+}
+
+// The first bytes we have taken, so the fingerprint never covers bytes
+// that were not read into the document
+bool LogFollower::read_fingerprint(std::string& out) const {
+    std::ifstream in(path_, std::ios::binary);
+    if (!in) return false;
+    out.assign(static_cast<size_t>((std::min)(offset_, uint64_t(kFingerprintBytes))), '\0');
+    in.read(&out[0], static_cast<std::streamsize>(out.size()));
+    out.resize(static_cast<size_t>(in.gcount()));
+    return true;
+}
+
+LogFollower::Result LogFollower::poll() {
+    last_appended_ = 0;
+    if (!document_) return Result::Unchanged;
+    if (!PlatformFile::is_file(path_)) return Result::Missing;
+    uint64_t size = PlatformFile::get_file_size(path_);
+    if (size < offset_) return reset();
+    std::string prefix;
+    if (!read_fingerprint(prefix)) return Result::Missing;
+    if (prefix != fingerprint_) return reset();
+    if (size == offset_) return Result::Unchanged;
+
+    std::ifstream in(path_, std::ios::binary);
+    if (!in) return Result::Missing;
+    std::string bytes(static_cast<size_t>((std::min)(size - offset_, uint64_t(kMaxReadBytes))), '\0');
+    in.seekg(static_cast<std::streamoff>(offset_));
+    in.read(&bytes[0], static_cast<std::streamsize>(bytes.size()));
+    bytes.resize(static_cast<size_t>(in.gcount()));
+    if (bytes.empty()) return Result::Unchanged;
+
+    document_->append_external(bytes);
+    offset_ += bytes.size();
+    last_appended_ = bytes.size();
+    if (fingerprint_.size() < kFingerprintBytes) read_fingerprint(fingerprint_);
+    return Result::Appended;
+}
+
+// Start over in an empty document and take the new file like any append
+// (a large one over several polls)
+LogFollower::Result LogFollower::reset() {
+    document_ = std::make_shared<PieceTable>();
+    offset_ = 0;
+    fingerprint_.clear();
+    ++resets_;
+    poll();
+    return Result::Reset;
+}
+
+} // namespace editor
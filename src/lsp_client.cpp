@@ -1,5 +1,10 @@
 #include "lsp_client.h"
+#include "lsp_decode.h"
+#include "lsp_framing.h"
+#include "trace.h"
 #include "../external/json/json.hpp"
+#include <algorithm>
+#include <chrono>
 #include <sstream>
 #include <iostream>
 #include <atomic>
@@ -11,13 +16,32 @@ struct LSPClient::Impl {
     HANDLE child_stdout_read = nullptr;
     PROCESS_INFORMATION pi{};
     std::atomic<int> next_request_id{1};
-    std::unordered_map<int, std::function<void(const json&)>> pending_requests;
+    // A response goes to on_body as raw text when set (streaming decoders),
+    // else to on_result parsed
+    struct PendingRequest {
+        std::function<void(const json&)> on_result;
+        std::function<void(const std::string&)> on_body;
+    };
+    std::unordered_map<int, PendingRequest> pending_requests;
+    int in_flight[static_cast<int>(RequestKind::Count)] = {};   // Latest request id of each kind
     DiagnosticsCallback diagnostics_callback;
+    std::unordered_map<std::string, int> versions;     // Open documents by uri
+    editor::PositionEncoding position_encoding = editor::PositionEncoding::Utf16;
+    bool incremental_sync = false;
+    std::vector<std::string> semantic_token_types;
+    bool semantic_tokens_delta = false;
     bool initialized = false;
     bool running = false;
+    std::vector<std::string> deferred;     // Notifications written once initialized
+
+    // The reactor's thread reads the server's stdout into channel->inbox
+    std::shared_ptr<editor::LspIoReactor> reactor;
+    std::shared_ptr<editor::LspIoReactor::Channel> channel;
 };
 
-LSPClient::LSPClient() : impl_(new Impl) {}
+LSPClient::LSPClient(std::shared_ptr<editor::LspIoReactor> reactor) : impl_(new Impl) {
+    impl_->reactor = reactor ? std::move(reactor) : std::make_shared<editor::LspIoReactor>();
+}
 
 LSPClient::~LSPClient() {
     shutdown();
@@ -65,10 +89,33 @@ bool LSPClient::start_server(const std::string& server_command, const std::strin
     CloseHandle(child_stdout_write);
     
     impl_->running = true;
+    HANDLE output = impl_->child_stdout_read;
+    impl_->channel = impl_->reactor->add_channel([output](char* buffer, size_t size) -> long long {
+        // Anonymous pipes cannot be waited on: look before reading so the
+        // shared thread never blocks on one server
+        DWORD available = 0;
+        if (!PeekNamedPipe(output, nullptr, 0, nullptr, &available, nullptr)) return -1;
+        if (available == 0) return 0;
+        DWORD read = 0;
+        if (!ReadFile(output, buffer, (DWORD)(std::min)(size, (size_t)available), &read, nullptr)) return -1;
+        return read;
+    });
     return true;
 }
 
 bool LSPClient::initialize(const std::string& workspace_root) {
+    if (!initialize_async(workspace_root)) return false;
+
+    // Process messages until initialized
+    for (int i = 0; i < 100 && !impl_->initialized; ++i) {
+        process_messages();
+        Sleep(10);
+    }
+
+    return impl_->initialized;
+}
+
+bool LSPClient::initialize_async(const std::string& workspace_root) {
     if (!impl_->running) return false;
 
     json params = {
@@ -76,36 +123,69 @@ bool LSPClient::initialize(const std::string& workspace_root) {
         {"clientInfo", {{"name", "VelocityEditor"}, {"version", "0.4.0"}}},
         {"rootUri", "file:///" + workspace_root},
         {"capabilities", {
+            {"general", {{"positionEncodings", {"utf-8", "utf-16"}}}},
+            {"offsetEncoding", {"utf-8", "utf-16"}},   // clangd before LSP 3.17
             {"textDocument", {
+                {"synchronization", {{"didSave", true}}},
                 {"completion", {{"completionItem", {{"snippetSupport", false}}}}},
                 {"hover", {{"contentFormat", {"plaintext"}}}},
                 {"definition", {{"linkSupport", false}}},
                 {"references", {{"dynamicRegistration", false}}},
-                {"publishDiagnostics", {{"relatedInformation", false}}}
+                {"publishDiagnostics", {{"relatedInformation", false}}},
+                {"semanticTokens", {
+                    {"requests", {{"full", {{"delta", true}}}}},
+                    {"tokenTypes", {"namespace", "type", "class", "enum", "interface", "struct", "typeParameter",
+                                    "parameter", "variable", "property", "enumMember", "event", "function",
+                                    "method", "macro", "keyword", "modifier", "comment", "string", "number",
+                                    "regexp", "operator"}},
+                    {"tokenModifiers", json::array()},
+                    {"formats", {"relative"}},
+                    {"overlappingTokenSupport", false},
+                    {"multilineTokenSupport", false}
+                }}
             }}
         }}
     };
 
     int req_id = impl_->next_request_id++;
-    impl_->pending_requests[req_id] = [this](const json& result) {
-        (void)result; // Server capabilities in result.capabilities
+    impl_->pending_requests[req_id].on_result = [this](const json& result) {
+        json capabilities = result.value("capabilities", json::object());
+        std::string encoding = capabilities.value("positionEncoding", result.value("offsetEncoding", "utf-16"));
+        impl_->position_encoding = encoding == "utf-8" ? editor::PositionEncoding::Utf8
+                                                       : editor::PositionEncoding::Utf16;
+        // textDocumentSync is a TextDocumentSyncKind or TextDocumentSyncOptions
+        json sync = capabilities.value("textDocumentSync", json(1));
+        int kind = sync.is_number() ? sync.get<int>() : sync.value("change", 1);
+        impl_->incremental_sync = kind == 2;
+        // semanticTokensProvider.full is a boolean or { delta }
+        json semantic = capabilities.value("semanticTokensProvider", json());
+        if (semantic.is_object()) {
+            for (const auto& type : semantic.value("legend", json::object()).value("tokenTypes", json::array())) {
+                if (type.is_string()) impl_->semantic_token_types.push_back(type.get<std::string>());
+            }
+            json full = semantic.value("full", json(false));
+            impl_->semantic_tokens_delta = full.is_object() && full.value("delta", false);
+        }
         impl_->initialized = true;
-        // Send initialized notification
+        // Send initialized notification, then what was held back for it
         send_notification("initialized", json::object());
+        for (const std::string& message : impl_->deferred) write_message(message);
+        impl_->deferred.clear();
     };
 
     send_request("initialize", params, req_id);
-    
-    // Process messages until initialized
-    for (int i = 0; i < 100 && !impl_->initialized; ++i) {
-        process_messages();
-        Sleep(10);
-    }
-
-    return impl_->initialized;
+    return true;
 }
 
 void LSPClient::shutdown() {
+    stop(true);
+}
+
+void LSPClient::retire() {
+    stop(false);
+}
+
+void LSPClient::stop(bool wait) {
     if (!impl_->running) return;
 
     if (impl_->initialized) {
@@ -115,13 +195,42 @@ void LSPClient::shutdown() {
     }
 
     if (impl_->child_stdin_write) CloseHandle(impl_->child_stdin_write);
-    if (impl_->child_stdout_read) CloseHandle(impl_->child_stdout_read);
-    if (impl_->pi.hProcess) {
-        TerminateProcess(impl_->pi.hProcess, 0);
-        CloseHandle(impl_->pi.hProcess);
-        CloseHandle(impl_->pi.hThread);
+    impl_->child_stdin_write = nullptr;
+    impl_->reactor->remove_channel(impl_->channel);
+    impl_->channel.reset();
+
+    // Give the server a moment to honor exit before terminating it
+    HANDLE process = impl_->pi.hProcess;
+    HANDLE thread = impl_->pi.hThread;
+    HANDLE output = impl_->child_stdout_read;
+    auto reap = [process, thread, output](bool finish, DWORD wait_ms) {
+        if (process) {
+            if (WaitForSingleObject(process, finish ? wait_ms : 0) != WAIT_OBJECT_0) {
+                if (!finish) return false;
+                TerminateProcess(process, 0);
+            }
+            CloseHandle(process);
+            CloseHandle(thread);
+        }
+        if (output) CloseHandle(output);
+        return true;
+    };
+    if (wait) {
+        reap(true, 500);
+    } else {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        impl_->reactor->add_task([reap, deadline](bool finish) {
+            return reap(finish || std::chrono::steady_clock::now() >= deadline, 0);
+        });
     }
-
+    impl_->pi = PROCESS_INFORMATION{};
+    impl_->child_stdout_read = nullptr;
+
+    impl_->pending_requests.clear();
+    impl_->deferred.clear();
+    impl_->versions.clear();
+    impl_->semantic_token_types.clear();
+    impl_->semantic_tokens_delta = false;
     impl_->running = false;
     impl_->initialized = false;
 }
@@ -130,9 +239,34 @@ bool LSPClient::is_running() const {
     return impl_->running && impl_->initialized;
 }
 
+bool LSPClient::is_starting() const {
+    return impl_->running && !impl_->initialized;
+}
+
+bool LSPClient::has_exited() const {
+    return impl_->running && impl_->channel && impl_->channel->closed && impl_->channel->inbox.empty();
+}
+
+editor::PositionEncoding LSPClient::position_encoding() const {
+    return impl_->position_encoding;
+}
+
+bool LSPClient::incremental_sync() const {
+    return impl_->incremental_sync;
+}
+
+const std::vector<std::string>& LSPClient::semantic_token_types() const {
+    return impl_->semantic_token_types;
+}
+
+bool LSPClient::semantic_tokens_delta() const {
+    return impl_->semantic_tokens_delta;
+}
+
 void LSPClient::did_open(const std::string& uri, const std::string& language_id, const std::string& text) {
-    if (!is_running()) return;
+    if (!impl_->running) return;
 
+    impl_->versions[uri] = 1;
     json params = {
         {"textDocument", {
             {"uri", uri},
@@ -145,25 +279,63 @@ void LSPClient::did_open(const std::string& uri, const std::string& language_id,
 }
 
 void LSPClient::did_change(const std::string& uri, const std::string& text) {
-    if (!is_running()) return;
+    if (!impl_->running) return;
 
     json params = {
-        {"textDocument", {{"uri", uri}, {"version", 2}}},
+        {"textDocument", {{"uri", uri}, {"version", ++impl_->versions[uri]}}},
         {"contentChanges", {{{"text", text}}}}
     };
     send_notification("textDocument/didChange", params);
 }
 
+void LSPClient::did_open(const std::string& uri, const std::string& language_id, const PieceTable& document) {
+    if (!impl_->running) return;
+
+    impl_->versions[uri] = 1;
+    write_document_message(editor::LspDocumentMessage::did_open(uri, language_id, 1, document));
+}
+
+void LSPClient::did_change(const std::string& uri, const PieceTable& document) {
+    if (!impl_->running) return;
+
+    write_document_message(editor::LspDocumentMessage::full_change(uri, ++impl_->versions[uri], document));
+}
+
+void LSPClient::did_change(const std::string& uri, const std::vector<editor::LspContentChange>& changes) {
+    if (!impl_->running || changes.empty()) return;
+
+    json content_changes = json::array();
+    for (const auto& change : changes) {
+        if (change.full) {
+            content_changes.push_back({{"text", change.text}});
+            continue;
+        }
+        content_changes.push_back({
+            {"range", {
+                {"start", {{"line", change.start_line}, {"character", change.start_character}}},
+                {"end", {{"line", change.end_line}, {"character", change.end_character}}}
+            }},
+            {"text", change.text}
+        });
+    }
+    json params = {
+        {"textDocument", {{"uri", uri}, {"version", ++impl_->versions[uri]}}},
+        {"contentChanges", std::move(content_changes)}
+    };
+    send_notification("textDocument/didChange", params);
+}
+
 void LSPClient::did_save(const std::string& uri) {
-    if (!is_running()) return;
+    if (!impl_->running) return;
 
     json params = {{"textDocument", {{"uri", uri}}}};
     send_notification("textDocument/didSave", params);
 }
 
 void LSPClient::did_close(const std::string& uri) {
-    if (!is_running()) return;
+    if (!impl_->running) return;
 
+    impl_->versions.erase(uri);
     json params = {{"textDocument", {{"uri", uri}}}};
     send_notification("textDocument/didClose", params);
 }
@@ -176,19 +348,11 @@ void LSPClient::request_completion(const std::string& uri, int line, int charact
         {"position", {{"line", line}, {"character", character}}}
     };
 
-    int req_id = impl_->next_request_id++;
-    impl_->pending_requests[req_id] = [callback](const json& result) {
+    int req_id = begin_request(RequestKind::Completion);
+    // Lists run to thousands of items: decode them straight from the text
+    impl_->pending_requests[req_id].on_body = [callback](const std::string& body) {
         std::vector<CompletionItem> items;
-        json list = result.is_array() ? result : result.value("items", json::array());
-        for (const auto& item : list) {
-            CompletionItem ci;
-            ci.label = item.value("label", "");
-            ci.kind = item.value("kind", 1);
-            ci.detail = item.value("detail", "");
-            ci.insertText = item.value("insertText", ci.label);
-            items.push_back(ci);
-        }
-        callback(items);
+        if (editor::decode_completion_response(body, items)) callback(items);
     };
 
     send_request("textDocument/completion", params, req_id);
@@ -202,8 +366,8 @@ void LSPClient::request_hover(const std::string& uri, int line, int character, H
         {"position", {{"line", line}, {"character", character}}}
     };
 
-    int req_id = impl_->next_request_id++;
-    impl_->pending_requests[req_id] = [callback](const json& result) {
+    int req_id = begin_request(RequestKind::Hover);
+    impl_->pending_requests[req_id].on_result = [callback](const json& result) {
         Hover hover;
         if (result.contains("contents")) {
             auto contents = result["contents"];
@@ -227,8 +391,8 @@ void LSPClient::request_definition(const std::string& uri, int line, int charact
         {"position", {{"line", line}, {"character", character}}}
     };
 
-    int req_id = impl_->next_request_id++;
-    impl_->pending_requests[req_id] = [callback](const json& result) {
+    int req_id = begin_request(RequestKind::Definition);
+    impl_->pending_requests[req_id].on_result = [callback](const json& result) {
         std::vector<Location> locations;
         json locs = result.is_array() ? result : json::array({result});
         for (const auto& loc : locs) {
@@ -259,8 +423,8 @@ void LSPClient::request_references(const std::string& uri, int line, int charact
         {"context", {{"includeDeclaration", true}}}
     };
 
-    int req_id = impl_->next_request_id++;
-    impl_->pending_requests[req_id] = [callback](const json& result) {
+    int req_id = begin_request(RequestKind::References);
+    impl_->pending_requests[req_id].on_result = [callback](const json& result) {
         std::vector<Location> locations;
         if (result.is_array()) {
             for (const auto& loc : result) {
@@ -282,6 +446,24 @@ void LSPClient::request_references(const std::string& uri, int line, int charact
     send_request("textDocument/references", params, req_id);
 }
 
+void LSPClient::request_semantic_tokens(const std::string& uri, const std::string& previous_result_id,
+                                        SemanticTokensCallback callback) {
+    if (!is_running() || impl_->semantic_token_types.empty()) return;
+
+    bool delta = !previous_result_id.empty() && impl_->semantic_tokens_delta;
+    json params = {{"textDocument", {{"uri", uri}}}};
+    if (delta) params["previousResultId"] = previous_result_id;
+
+    int req_id = begin_request(RequestKind::SemanticTokens);
+    // Five integers a token for the whole file: decode them straight from the text
+    impl_->pending_requests[req_id].on_body = [callback](const std::string& body) {
+        SemanticTokens tokens;
+        if (editor::decode_semantic_tokens_response(body, tokens)) callback(tokens);
+    };
+
+    send_request(delta ? "textDocument/semanticTokens/full/delta" : "textDocument/semanticTokens/full", params, req_id);
+}
+
 void LSPClient::set_diagnostics_callback(DiagnosticsCallback callback) {
     impl_->diagnostics_callback = callback;
 }
@@ -289,19 +471,29 @@ void LSPClient::set_diagnostics_callback(DiagnosticsCallback callback) {
 void LSPClient::process_messages() {
     if (!impl_->running) return;
 
-    // Check if data is available (non-blocking)
-    DWORD bytes_avail = 0;
-    if (!PeekNamedPipe(impl_->child_stdout_read, nullptr, 0, nullptr, &bytes_avail, nullptr))
-        return;
-    
-    if (bytes_avail > 0) {
-        std::string message = read_message();
-        if (!message.empty()) {
-            handle_message(message);
-        }
+    // Drain the whole burst: the reactor has already done the waiting
+    std::string message;
+    while (impl_->channel && impl_->channel->inbox.try_pop(message)) {
+        handle_message(message);
     }
 }
 
+int LSPClient::begin_request(RequestKind kind) {
+    cancel_request(kind);
+    int req_id = impl_->next_request_id++;
+    impl_->in_flight[static_cast<int>(kind)] = req_id;
+    return req_id;
+}
+
+void LSPClient::cancel_request(RequestKind kind) {
+    int& req_id = impl_->in_flight[static_cast<int>(kind)];
+    // Already answered requests are no longer pending: nothing to cancel
+    if (req_id != 0 && impl_->pending_requests.erase(req_id) > 0 && is_running()) {
+        send_notification("$/cancelRequest", {{"id", req_id}});
+    }
+    req_id = 0;
+}
+
 void LSPClient::send_request(const std::string& method, const json& params, int request_id) {
     json message = {
         {"jsonrpc", "2.0"},
@@ -318,50 +510,17 @@ void LSPClient::send_notification(const std::string& method, const json& params)
         {"method", method},
         {"params", params}
     };
-    write_message(message.dump());
-}
-
-std::string LSPClient::read_message() {
-    // Read headers
-    std::string headers;
-    size_t content_length = 0;
-    
-    while (true) {
-        char ch;
-        DWORD read;
-        if (!ReadFile(impl_->child_stdout_read, &ch, 1, &read, nullptr) || read == 0)
-            return "";
-        
-        headers += ch;
-        if (headers.size() >= 2 && headers.substr(headers.size()-2) == "\r\n") {
-            std::string line = headers.substr(0, headers.size()-2);
-            headers.clear();
-            
-            if (line.empty()) break; // End of headers
-            
-            if (line.find("Content-Length:") == 0) {
-                content_length = std::stoul(line.substr(15));
-            }
-        }
-    }
-
-    if (content_length == 0) return "";
-
-    // Read content
-    std::string content(content_length, '\0');
-    DWORD total_read = 0;
-    while (total_read < content_length) {
-        DWORD read;
-        if (!ReadFile(impl_->child_stdout_read, &content[total_read], 
-                     (DWORD)(content_length - total_read), &read, nullptr))
-            return "";
-        total_read += read;
+    // Document notifications may be issued while the server starts up
+    if (!impl_->initialized) {
+        impl_->deferred.push_back(message.dump());
+        return;
     }
-
-    return content;
+    write_message(message.dump());
 }
 
 void LSPClient::write_message(const std::string& message) {
+    EDITOR_TRACE_SCOPE("lsp", "send");
+    EDITOR_TRACE_COUNTER("lsp", "sent bytes", static_cast<int64_t>(message.size()));
     std::ostringstream oss;
     oss << "Content-Length: " << message.size() << "\r\n\r\n" << message;
     std::string full_message = oss.str();
@@ -371,18 +530,65 @@ void LSPClient::write_message(const std::string& message) {
               (DWORD)full_message.size(), &written, nullptr);
 }
 
+void LSPClient::write_document_message(const editor::LspDocumentMessage& message) {
+    EDITOR_TRACE_SCOPE("lsp", "send document");
+    EDITOR_TRACE_COUNTER("lsp", "sent bytes", static_cast<int64_t>(message.body_length()));
+    // Held with the other notifications until the server is up: the text
+    // has to be copied then, since the document goes on changing
+    if (!impl_->initialized) {
+        std::string body;
+        body.reserve(message.body_length());
+        message.write([&body](const char* data, size_t size) {
+            body.append(data, size);
+            return true;
+        }, false);
+        impl_->deferred.push_back(std::move(body));
+        return;
+    }
+    HANDLE pipe = impl_->child_stdin_write;
+    message.write([pipe](const char* data, size_t size) -> bool {
+        DWORD written = 0;
+        return WriteFile(pipe, data, (DWORD)size, &written, nullptr) && written == size;
+    });
+}
+
 void LSPClient::handle_message(const std::string& message) {
+    EDITOR_TRACE_SCOPE("lsp", "receive");
+    EDITOR_TRACE_COUNTER("lsp", "received bytes", static_cast<int64_t>(message.size()));
+    // Route on id and method before parsing anything: responses to cancelled
+    // or superseded requests are dropped, high-volume messages are decoded
+    // as they stream past
+    editor::MessageHead head;
+    if (editor::peek_message_head(message, head)) {
+        if (head.is_response()) {
+            auto it = impl_->pending_requests.find(static_cast<int>(head.id));
+            if (it == impl_->pending_requests.end()) return;
+            if (it->second.on_body) {
+                auto on_body = std::move(it->second.on_body);
+                impl_->pending_requests.erase(it);
+                on_body(message);
+                return;
+            }
+        } else if (!head.has_id && head.method == "textDocument/publishDiagnostics") {
+            std::string uri;
+            std::vector<Diagnostic> diagnostics;
+            if (editor::decode_publish_diagnostics(message, uri, diagnostics) && impl_->diagnostics_callback) {
+                impl_->diagnostics_callback(uri, diagnostics);
+            }
+            return;
+        }
+    }
     try {
         json j = json::parse(message);
         
         if (j.contains("id")) {
             // Response
             int id = j["id"];
-            if (impl_->pending_requests.count(id)) {
-                if (j.contains("result")) {
-                    impl_->pending_requests[id](j["result"]);
-                }
-                impl_->pending_requests.erase(id);
+            auto it = impl_->pending_requests.find(id);
+            if (it != impl_->pending_requests.end()) {
+                auto on_result = std::move(it->second.on_result);
+                impl_->pending_requests.erase(it);
+                if (j.contains("result") && on_result) on_result(j["result"]);
             }
         } else if (j.contains("method")) {
             // Notification
@@ -396,10 +602,11 @@ void LSPClient::handle_message(const std::string& message) {
 }
 
 void LSPClient::handle_response(int id, const json& result) {
-    if (impl_->pending_requests.count(id)) {
-        impl_->pending_requests[id](result);
-        impl_->pending_requests.erase(id);
-    }
+    auto it = impl_->pending_requests.find(id);
+    if (it == impl_->pending_requests.end()) return;
+    auto on_result = std::move(it->second.on_result);
+    impl_->pending_requests.erase(it);
+    if (on_result) on_result(result);
 }
 
 void LSPClient::handle_notification(const std::string& method, const json& params) {
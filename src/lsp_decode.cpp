@@ -0,0 +1,251 @@
+#include "lsp_decode.h"
+#include "../external/json/json.hpp"
+
+namespace editor {
+
+namespace {
+
+using json = nlohmann::json;
+
+/**
+ * SaxDecoder - container bookkeeping shared by the decoders
+ *
+ * Each open object or array gets a role from Derived::child_role(parent
+ * role, key, is_object); everything under a kSkip container is ignored
+ * without asking. Scalars go to Derived::on_string / on_number with the
+ * innermost role and key, and Derived::on_end sees each container close.
+ */
+template <typename Derived>
+class SaxDecoder {
+public:
+    bool null() { return true; }
+    bool boolean(bool) { return true; }
+    bool number_integer(json::number_integer_t value) { return scalar_number(static_cast<long long>(value)); }
+    bool number_unsigned(json::number_unsigned_t value) { return scalar_number(static_cast<long long>(value)); }
+    bool number_float(json::number_float_t value, const json::string_t&) {
+        return scalar_number(static_cast<long long>(value));
+    }
+    bool string(json::string_t& value) {
+        if (role() != kSkip) derived().on_string(role(), value);
+        return true;
+    }
+    bool binary(json::binary_t&) { return true; }
+
+    bool start_object(std::size_t) { return open(true); }
+    bool start_array(std::size_t) { return open(false); }
+    bool end_object() { return close(); }
+    bool end_array() { return close(); }
+    bool key(json::string_t& name) {
+        if (role() != kSkip) {
+            key_.assign(name);
+            derived().on_key(role());
+        }
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) { return false; }
+
+    // Hooks Derived may hide
+    void on_key(int) {}
+    void on_end(int) {}
+
+protected:
+    static constexpr int kNone = 0;
+    static constexpr int kSkip = 1;
+    const std::string& current_key() const { return key_; }
+
+private:
+    Derived& derived() { return static_cast<Derived&>(*this); }
+    int role() const { return roles_.empty() ? kNone : roles_.back(); }
+
+    bool scalar_number(long long value) {
+        if (role() != kSkip) derived().on_number(role(), value);
+        return true;
+    }
+    bool open(bool object) {
+        int parent = role();
+        roles_.push_back(parent == kSkip ? kSkip : derived().child_role(parent, key_, object));
+        return true;
+    }
+    bool close() {
+        if (roles_.back() != kSkip) derived().on_end(roles_.back());
+        roles_.pop_back();
+        return true;
+    }
+
+    std::vector<int> roles_;
+    std::string key_;
+};
+
+class CompletionDecoder : public SaxDecoder<CompletionDecoder> {
+public:
+    explicit CompletionDecoder(std::vector<LspCompletionItem>& items) : items_(items) {}
+    bool has_result = false;
+
+    int child_role(int parent, const std::string& key, bool object) {
+        switch (parent) {
+        case kNone: return object ? kRoot : kSkip;
+        case kRoot:
+            if (key != "result") return kSkip;
+            return object ? kList : kItems;
+        case kList: return key == "items" && !object ? kItems : kSkip;
+        case kItems:
+            if (!object) return kSkip;
+            items_.emplace_back();
+            return kItem;
+        case kItem: return key == "documentation" && object ? kMarkup : kSkip;
+        default: return kSkip;
+        }
+    }
+    void on_key(int role) {
+        if (role == kRoot && current_key() == "result") has_result = true;
+    }
+    void on_string(int role, std::string& value) {
+        const std::string& key = current_key();
+        if (role == kItem) {
+            if (key == "label") items_.back().label = std::move(value);
+            else if (key == "detail") items_.back().detail = std::move(value);
+            else if (key == "insertText") items_.back().insertText = std::move(value);
+            else if (key == "documentation") items_.back().documentation = std::move(value);
+        } else if (role == kMarkup && key == "value") {
+            items_.back().documentation = std::move(value);
+        }
+    }
+    void on_number(int role, long long value) {
+        if (role == kItem && current_key() == "kind") items_.back().kind = static_cast<int>(value);
+    }
+    void on_end(int role) {
+        if (role == kItem && items_.back().insertText.empty()) items_.back().insertText = items_.back().label;
+    }
+
+private:
+    static constexpr int kRoot = 2, kList = 3, kItems = 4, kItem = 5, kMarkup = 6;
+    std::vector<LspCompletionItem>& items_;
+};
+
+class DiagnosticsDecoder : public SaxDecoder<DiagnosticsDecoder> {
+public:
+    DiagnosticsDecoder(std::string& uri, std::vector<LspDiagnostic>& diagnostics)
+        : uri_(uri), diagnostics_(diagnostics) {}
+
+    int child_role(int parent, const std::string& key, bool object) {
+        switch (parent) {
+        case kNone: return object ? kRoot : kSkip;
+        case kRoot: return key == "params" && object ? kParams : kSkip;
+        case kParams: return key == "diagnostics" && !object ? kList : kSkip;
+        case kList:
+            if (!object) return kSkip;
+            diagnostics_.emplace_back();
+            return kDiagnostic;
+        case kDiagnostic: return key == "range" && object ? kRange : kSkip;
+        case kRange:
+            if (!object) return kSkip;
+            return key == "start" ? kStart : key == "end" ? kEnd : kSkip;
+        default: return kSkip;
+        }
+    }
+    void on_string(int role, std::string& value) {
+        const std::string& key = current_key();
+        if (role == kParams && key == "uri") uri_ = std::move(value);
+        else if (role == kDiagnostic && key == "message") diagnostics_.back().message = std::move(value);
+        else if (role == kDiagnostic && key == "source") diagnostics_.back().source = std::move(value);
+    }
+    void on_number(int role, long long value) {
+        const std::string& key = current_key();
+        if (role == kDiagnostic) {
+            if (key == "severity") diagnostics_.back().severity = static_cast<int>(value);
+            return;
+        }
+        if (role != kStart && role != kEnd) return;
+        LspPosition& position = role == kStart ? diagnostics_.back().range.start : diagnostics_.back().range.end;
+        if (key == "line") position.line = static_cast<int>(value);
+        else if (key == "character") position.character = static_cast<int>(value);
+    }
+
+private:
+    static constexpr int kRoot = 2, kParams = 3, kList = 4, kDiagnostic = 5, kRange = 6, kStart = 7, kEnd = 8;
+    std::string& uri_;
+    std::vector<LspDiagnostic>& diagnostics_;
+};
+
+class SemanticTokensDecoder : public SaxDecoder<SemanticTokensDecoder> {
+public:
+    explicit SemanticTokensDecoder(LspSemanticTokens& tokens) : tokens_(tokens) {}
+    bool has_result = false;
+
+    int child_role(int parent, const std::string& key, bool object) {
+        switch (parent) {
+        case kNone: return object ? kRoot : kSkip;
+        case kRoot:
+            if (key != "result" || !object) return kSkip;
+            has_result = true;
+            return kResult;
+        case kResult:
+            if (object) return kSkip;
+            if (key == "data") return kData;
+            if (key != "edits") return kSkip;
+            tokens_.delta = true;
+            return kEdits;
+        case kEdits:
+            if (!object) return kSkip;
+            tokens_.edits.emplace_back();
+            return kEdit;
+        case kEdit: return key == "data" && !object ? kEditData : kSkip;
+        default: return kSkip;
+        }
+    }
+    void on_string(int role, std::string& value) {
+        if (role == kResult && current_key() == "resultId") tokens_.result_id = std::move(value);
+    }
+    void on_number(int role, long long value) {
+        uint32_t number = static_cast<uint32_t>(value);
+        if (role == kData) {
+            tokens_.data.push_back(number);
+        } else if (role == kEditData) {
+            tokens_.edits.back().data.push_back(number);
+        } else if (role == kEdit) {
+            const std::string& key = current_key();
+            if (key == "start") tokens_.edits.back().start = number;
+            else if (key == "deleteCount") tokens_.edits.back().delete_count = number;
+        }
+    }
+
+private:
+    static constexpr int kRoot = 2, kResult = 3, kData = 4, kEdits = 5, kEdit = 6, kEditData = 7;
+    LspSemanticTokens& tokens_;
+};
+
+} // namespace
+
+bool decode_completion_response(std::string_view body, std::vector<LspCompletionItem>& items) {
+    items.clear();
+    CompletionDecoder decoder(items);
+    if (!json::sax_parse(body.begin(), body.end(), &decoder)) {
+        items.clear();
+        return false;
+    }
+    return decoder.has_result;
+}
+
+bool decode_publish_diagnostics(std::string_view body, std::string& uri, std::vector<LspDiagnostic>& diagnostics) {
+    uri.clear();
+    diagnostics.clear();
+    DiagnosticsDecoder decoder(uri, diagnostics);
+    if (!json::sax_parse(body.begin(), body.end(), &decoder)) {
+        diagnostics.clear();
+        return false;
+    }
+    return true;
+}
+
+bool decode_semantic_tokens_response(std::string_view body, LspSemanticTokens& tokens) {
+    tokens = LspSemanticTokens();
+    SemanticTokensDecoder decoder(tokens);
+    if (!json::sax_parse(body.begin(), body.end(), &decoder)) {
+        tokens = LspSemanticTokens();
+        return false;
+    }
+    return decoder.has_result;
+}
+
+} // namespace editor
@@ -0,0 +1,155 @@
+#include "lsp_document_sync.h"
+#include <algorithm>
+
+namespace editor {
+
+LspDocumentSync::~LspDocumentSync() {
+    set_document(nullptr, std::string());
+}
+
+void LspDocumentSync::set_document(const std::shared_ptr<PieceTable>& document, const std::string& uri) {
+    if (document_) document_->remove_change_listener(listener_id_);
+    document_ = document;
+    uri_ = uri;
+    pending_.clear();
+    pending_bytes_ = 0;
+    full_ = false;
+    if (document_) {
+        listener_id_ = document_->add_change_listener([this](const PieceTable::Change& change) { on_change(change); });
+    }
+}
+
+void LspDocumentSync::set_debounce(std::chrono::milliseconds debounce, std::chrono::milliseconds max_latency) {
+    debounce_ = debounce;
+    max_latency_ = (std::max)(debounce, max_latency);
+}
+
+bool LspDocumentSync::due(Clock::time_point now) const {
+    if (!has_pending()) return false;
+    return now - last_edit_ >= debounce_ || now - first_edit_ >= max_latency_;
+}
+
+bool LspDocumentSync::take(std::vector<LspContentChange>& out) {
+    out.clear();
+    if (full_ && document_) {
+        LspContentChange change;
+        change.full = true;
+        change.text = document_->get_text(0, document_->get_total_length());
+        out.push_back(std::move(change));
+    } else {
+        out.swap(pending_);
+    }
+    pending_.clear();
+    pending_bytes_ = 0;
+    full_ = false;
+    return !out.empty();
+}
+
+void LspDocumentSync::on_change(const PieceTable::Change& change) {
+    Clock::time_point now = Clock::now();
+    if (!has_pending()) first_edit_ = now;
+    last_edit_ = now;
+    if (full_) return;
+    if (!incremental_ || change.removed_length > kMaxBytes ||
+        pending_bytes_ + change.inserted_length > kMaxBytes) {
+        collapse();
+        return;
+    }
+
+    // Where the edit starts, as a position; the line's prefix up to it is
+    // the same before and after the edit
+    auto start_character = [&]() {
+        if (encoding_ == PositionEncoding::Utf8) return static_cast<int>(change.column);
+        return units(document_->get_text(document_->get_line_start(change.first_line), change.column));
+    };
+
+    if (change.removed_length > 0) {
+        // Backspace over text the last change inserted
+        if (!pending_.empty() && change.removed_newlines == 0 &&
+            change.position + change.removed_length == tail_.offset &&
+            change.removed_length <= pending_.back().text.size()) {
+            std::string& text = pending_.back().text;
+            tail_.character -= units(text, text.size() - change.removed_length);
+            text.resize(text.size() - change.removed_length);
+            tail_.offset = change.position;
+            pending_bytes_ -= change.removed_length;
+            return;
+        }
+
+        LspContentChange removal;
+        removal.start_line = static_cast<int>(change.first_line);
+        removal.start_character = start_character();
+        removal.end_line = static_cast<int>(change.first_line + change.removed_newlines);
+        if (encoding_ == PositionEncoding::Utf8) {
+            removal.end_character = static_cast<int>(change.old_end_column);
+        } else {
+            if (!change.removed_span) {
+                collapse();
+                return;
+            }
+            std::string removed = document_->get_span_text(*change.removed_span);
+            size_t last_newline = removed.rfind('\n');
+            removal.end_character = last_newline == std::string::npos
+                ? removal.start_character + units(removed)
+                : units(removed, last_newline + 1);
+        }
+        tail_ = {change.position, removal.start_line, removal.start_character};
+        pending_.push_back(std::move(removal));
+    }
+
+    if (change.inserted_length > 0) {
+        std::string text = document_->get_text(change.position, change.inserted_length);
+        pending_bytes_ += text.size();
+        // Typing on from the last change, or replacing what it removed
+        if (!pending_.empty() && change.position == tail_.offset) {
+            advance(tail_.line, tail_.character, text);
+            tail_.offset += text.size();
+            pending_.back().text += text;
+            return;
+        }
+
+        LspContentChange insertion;
+        insertion.start_line = static_cast<int>(change.first_line);
+        insertion.start_character = start_character();
+        insertion.end_line = insertion.start_line;
+        insertion.end_character = insertion.start_character;
+        tail_ = {change.position + text.size(), insertion.start_line, insertion.start_character};
+        advance(tail_.line, tail_.character, text);
+        insertion.text = std::move(text);
+        pending_.push_back(std::move(insertion));
+    }
+
+    if (pending_.size() > kMaxChanges) collapse();
+}
+
+int LspDocumentSync::units(const std::string& text, size_t from) const {
+    if (from >= text.size()) return 0;
+    if (encoding_ == PositionEncoding::Utf8) return static_cast<int>(text.size() - from);
+    // One unit per code point, two for those outside the BMP (4-byte sequences)
+    int count = 0;
+    for (size_t i = from; i < text.size(); ++i) {
+        unsigned char byte = static_cast<unsigned char>(text[i]);
+        if ((byte & 0xC0) != 0x80) count += byte >= 0xF0 ? 2 : 1;
+    }
+    return count;
+}
+
+void LspDocumentSync::advance(int& line, int& character, const std::string& text) const {
+    size_t last_newline = text.rfind('\n');
+    if (last_newline == std::string::npos) {
+        character += units(text);
+        return;
+    }
+    for (char c : text) {
+        if (c == '\n') ++line;
+    }
+    character = units(text, last_newline + 1);
+}
+
+void LspDocumentSync::collapse() {
+    full_ = true;
+    pending_.clear();
+    pending_bytes_ = 0;
+}
+
+} // namespace editor
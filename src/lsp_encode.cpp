@@ -0,0 +1,110 @@
+#include "lsp_encode.h"
+#include "piece_table.h"
+#include <algorithm>
+
+namespace editor {
+
+namespace {
+
+// Escapes of the bytes JSON strings cannot hold as they are: 0 for none,
+// 2 for a backslash pair, 6 for \u00XX
+unsigned char escape_size(unsigned char c) {
+    if (c == '"' || c == '\\') return 2;
+    if (c >= 0x20) return 0;
+    if (c == '\b' || c == '\f' || c == '\n' || c == '\r' || c == '\t') return 2;
+    return 6;
+}
+
+void append_escape(unsigned char c, std::string& out) {
+    static const char hex[] = "0123456789abcdef";
+    out += '\\';
+    switch (c) {
+    case '"': out += '"'; break;
+    case '\\': out += '\\'; break;
+    case '\b': out += 'b'; break;
+    case '\f': out += 'f'; break;
+    case '\n': out += 'n'; break;
+    case '\r': out += 'r'; break;
+    case '\t': out += 't'; break;
+    default:
+        out += "u00";
+        out += hex[c >> 4];
+        out += hex[c & 0xF];
+        break;
+    }
+}
+
+std::string quoted(const std::string& value) {
+    std::string out = "\"";
+    append_json_escaped(value, out);
+    out += '"';
+    return out;
+}
+
+} // namespace
+
+std::size_t json_escaped_length(std::string_view text) {
+    std::size_t length = text.size();
+    for (char c : text) {
+        unsigned char size = escape_size(static_cast<unsigned char>(c));
+        if (size) length += size - 1;
+    }
+    return length;
+}
+
+void append_json_escaped(std::string_view text, std::string& out) {
+    // Runs that need no escape are appended whole
+    std::size_t run = 0;
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(text[i]);
+        if (!escape_size(c)) continue;
+        out.append(text.data() + run, i - run);
+        append_escape(c, out);
+        run = i + 1;
+    }
+    out.append(text.data() + run, text.size() - run);
+}
+
+LspDocumentMessage::LspDocumentMessage(std::string head, std::string tail, const PieceTable& document)
+    : head_(std::move(head)), tail_(std::move(tail)), document_(&document) {
+    for (auto chunk = document.chunks(); !chunk.done(); ++chunk) text_length_ += json_escaped_length(*chunk);
+}
+
+LspDocumentMessage LspDocumentMessage::did_open(const std::string& uri, const std::string& language_id,
+                                                int version, const PieceTable& document) {
+    std::string head = "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didOpen\",\"params\":{\"textDocument\":{\"uri\":" +
+                       quoted(uri) + ",\"languageId\":" + quoted(language_id) +
+                       ",\"version\":" + std::to_string(version) + ",\"text\":\"";
+    return LspDocumentMessage(std::move(head), "\"}}}", document);
+}
+
+LspDocumentMessage LspDocumentMessage::full_change(const std::string& uri, int version, const PieceTable& document) {
+    std::string head = "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\",\"params\":{\"textDocument\":{\"uri\":" +
+                       quoted(uri) + ",\"version\":" + std::to_string(version) +
+                       "},\"contentChanges\":[{\"text\":\"";
+    return LspDocumentMessage(std::move(head), "\"}]}}", document);
+}
+
+bool LspDocumentMessage::write(const LspSink& sink, bool with_header) const {
+    std::string block;
+    if (with_header) block = "Content-Length: " + std::to_string(body_length()) + "\r\n\r\n";
+    block += head_;
+    block.reserve(kBlockSize + 6);
+    for (auto chunk = document_->chunks(); !chunk.done(); ++chunk) {
+        std::string_view text = *chunk;
+        while (!text.empty()) {
+            // Fill the block up to its size; a piece larger than that is cut
+            std::size_t take = (std::min)(text.size(), kBlockSize > block.size() ? kBlockSize - block.size() : 0);
+            append_json_escaped(text.substr(0, take), block);
+            text.remove_prefix(take);
+            if (block.size() >= kBlockSize) {
+                if (!sink(block.data(), block.size())) return false;
+                block.clear();
+            }
+        }
+    }
+    block += tail_;
+    return sink(block.data(), block.size());
+}
+
+} // namespace editor
@@ -0,0 +1,171 @@
+#include "lsp_framing.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace editor {
+
+namespace {
+
+// Content-Length of a header block (header names are case-insensitive);
+// false if it has none
+bool content_length(const char* header, size_t size, size_t& length) {
+    static const char kName[] = "content-length";
+    const size_t name_size = sizeof(kName) - 1;
+    size_t line = 0;
+    while (line < size) {
+        size_t line_end = line;
+        while (line_end < size && header[line_end] != '\r') ++line_end;
+        if (line_end - line > name_size) {
+            size_t i = 0;
+            while (i < name_size && std::tolower(static_cast<unsigned char>(header[line + i])) == kName[i]) ++i;
+            if (i == name_size) {
+                size_t pos = line + name_size;
+                while (pos < line_end && (header[pos] == ':' || header[pos] == ' ')) ++pos;
+                if (pos < line_end && std::isdigit(static_cast<unsigned char>(header[pos]))) {
+                    length = 0;
+                    while (pos < line_end && std::isdigit(static_cast<unsigned char>(header[pos]))) {
+                        length = length * 10 + static_cast<size_t>(header[pos++] - '0');
+                    }
+                    return true;
+                }
+            }
+        }
+        line = line_end + 2;
+    }
+    return false;
+}
+
+void skip_space(std::string_view text, size_t& pos) {
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\r' || text[pos] == '\n')) ++pos;
+}
+
+// Past the closing quote of the string opening at pos
+bool skip_string(std::string_view text, size_t& pos) {
+    for (++pos; pos < text.size(); ++pos) {
+        if (text[pos] == '\\') ++pos;
+        else if (text[pos] == '"') {
+            ++pos;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Past the JSON value starting at pos, matching brackets but not checking
+// anything else about it
+bool skip_value(std::string_view text, size_t& pos) {
+    if (pos >= text.size()) return false;
+    if (text[pos] == '"') return skip_string(text, pos);
+    if (text[pos] != '{' && text[pos] != '[') {
+        while (pos < text.size() && text[pos] != ',' && text[pos] != '}' && text[pos] != ']') ++pos;
+        return true;
+    }
+    size_t depth = 0;
+    while (pos < text.size()) {
+        char c = text[pos];
+        if (c == '"') {
+            if (!skip_string(text, pos)) return false;
+            continue;
+        }
+        if (c == '{' || c == '[') ++depth;
+        else if ((c == '}' || c == ']') && --depth == 0) {
+            ++pos;
+            return true;
+        }
+        ++pos;
+    }
+    return false;
+}
+
+} // namespace
+
+bool peek_message_head(std::string_view body, MessageHead& head) {
+    head = MessageHead();
+    size_t pos = 0;
+    skip_space(body, pos);
+    if (pos >= body.size() || body[pos] != '{') return false;
+    ++pos;
+    for (;;) {
+        skip_space(body, pos);
+        if (pos >= body.size() || body[pos] != '"') break;
+        size_t key = pos + 1;
+        if (!skip_string(body, pos)) return false;
+        std::string_view name = body.substr(key, pos - 1 - key);
+        skip_space(body, pos);
+        if (pos >= body.size() || body[pos] != ':') return false;
+        ++pos;
+        skip_space(body, pos);
+        if (name == "id" && pos < body.size() && (body[pos] == '-' || std::isdigit(static_cast<unsigned char>(body[pos])))) {
+            bool negative = body[pos] == '-';
+            if (negative) ++pos;
+            long long value = 0;
+            while (pos < body.size() && std::isdigit(static_cast<unsigned char>(body[pos]))) {
+                value = value * 10 + (body[pos++] - '0');
+            }
+            head.id = negative ? -value : value;
+            head.has_id = true;
+        } else if (name == "method" && pos < body.size() && body[pos] == '"') {
+            size_t start = pos + 1;
+            if (!skip_string(body, pos)) return false;
+            head.method = body.substr(start, pos - 1 - start);
+        } else if (!skip_value(body, pos)) {
+            return false;
+        }
+        skip_space(body, pos);
+        if (pos >= body.size() || body[pos] != ',') break;
+        ++pos;
+    }
+    return true;
+}
+
+char* LspFraming::prepare(size_t size) {
+    if (buffer_.size() - end_ < size) {
+        // Shift down when what was consumed outweighs what is left
+        if (begin_ > 0 && begin_ >= end_ - begin_) compact();
+        if (buffer_.size() - end_ < size) buffer_.resize(end_ + size);
+    }
+    return buffer_.data() + end_;
+}
+
+void LspFraming::feed(const char* data, size_t size) {
+    std::memcpy(prepare(size), data, size);
+    commit(size);
+}
+
+bool LspFraming::next(std::string& message) {
+    static const char kTerminator[] = "\r\n\r\n";
+    for (;;) {
+        const char* base = buffer_.data();
+        const char* from = base + (std::max)(scan_, begin_);
+        const char* found = std::search(from, base + end_, kTerminator, kTerminator + 4);
+        if (found == base + end_) {
+            scan_ = end_ - begin_ >= 3 ? end_ - 3 : begin_;
+            return false;
+        }
+        size_t header_end = static_cast<size_t>(found - base);
+        size_t body = header_end + 4;
+        size_t length = 0;
+        if (!content_length(base + begin_, header_end - begin_, length)) {
+            begin_ = scan_ = body;
+            continue;
+        }
+        if (end_ - body < length) {
+            scan_ = header_end;     // Found again at once when the body is in
+            return false;
+        }
+        message.assign(base + body, length);
+        begin_ = scan_ = body + length;
+        if (begin_ == end_) begin_ = end_ = scan_ = 0;
+        return true;
+    }
+}
+
+void LspFraming::compact() {
+    std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+    end_ -= begin_;
+    scan_ = scan_ > begin_ ? scan_ - begin_ : 0;
+    begin_ = 0;
+}
+
+} // namespace editor
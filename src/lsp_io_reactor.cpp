@@ -0,0 +1,127 @@
+#include "lsp_io_reactor.h"
+#include <algorithm>
+#include <chrono>
+
+namespace editor {
+
+namespace {
+// Reads one channel gets per sweep before the others have their turn
+constexpr int kReadsPerSweep = 16;
+}
+
+LspIoReactor::LspIoReactor() : thread_([this] { run(); }) {}
+
+LspIoReactor::~LspIoReactor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    thread_.join();
+    for (Task& task : tasks_) task(true);
+}
+
+std::shared_ptr<LspIoReactor::Channel> LspIoReactor::add_channel(ReadFn read) {
+    auto channel = std::make_shared<Channel>();
+    channel->read = std::move(read);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        channels_.push_back(channel);
+        changed_ = true;
+    }
+    wake_.notify_one();
+    return channel;
+}
+
+void LspIoReactor::remove_channel(const std::shared_ptr<Channel>& channel) {
+    if (!channel) return;
+    channel->removed = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        channels_.erase(std::remove(channels_.begin(), channels_.end(), channel), channels_.end());
+        changed_ = true;
+    }
+    // Wait out a sweep that may be inside the channel's read function
+    std::lock_guard<std::mutex> reading(read_mutex_);
+}
+
+void LspIoReactor::add_task(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    wake_.notify_one();
+}
+
+size_t LspIoReactor::channel_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return channels_.size();
+}
+
+void LspIoReactor::run() {
+    std::vector<std::shared_ptr<Channel>> channels;
+    std::vector<Task> tasks;
+    int idle_wait = 1;
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) return;
+            if (changed_) {
+                channels = channels_;
+                changed_ = false;
+            }
+            tasks.swap(tasks_);
+        }
+
+        bool active = false;
+        {
+            std::lock_guard<std::mutex> reading(read_mutex_);
+            for (const auto& channel : channels) {
+                if (!channel->removed && service(*channel)) active = true;
+            }
+        }
+
+        // Unfinished tasks keep their place ahead of any added meanwhile
+        tasks.erase(std::remove_if(tasks.begin(), tasks.end(), [](Task& task) { return task(false); }), tasks.end());
+        std::unique_lock<std::mutex> lock(mutex_);
+        tasks_.insert(tasks_.begin(), std::make_move_iterator(tasks.begin()), std::make_move_iterator(tasks.end()));
+        tasks.clear();
+
+        if (active) {
+            idle_wait = 1;
+            continue;
+        }
+        wake_.wait_for(lock, std::chrono::milliseconds(idle_wait), [this] { return stopping_ || changed_; });
+        idle_wait = (std::min)(idle_wait * 2, kMaxIdleWait);
+    }
+}
+
+bool LspIoReactor::service(Channel& channel) {
+    bool active = false;
+    std::string message;
+    for (int reads = 0;; ++reads) {
+        if (channel.has_parked) {
+            if (!channel.inbox.try_push(std::move(channel.parked))) return active;
+            channel.has_parked = false;
+        }
+        while (channel.framing.next(message)) {
+            if (!channel.inbox.try_push(std::move(message))) {
+                channel.parked = std::move(message);
+                channel.has_parked = true;
+                return true;
+            }
+        }
+        if (channel.closed || reads == kReadsPerSweep) return active;
+
+        long long read = channel.read(channel.framing.prepare(LspFraming::kReadSize), LspFraming::kReadSize);
+        if (read < 0) {
+            channel.closed = true;
+            return active;
+        }
+        if (read == 0) return active;
+        channel.framing.commit(static_cast<size_t>(read));
+        active = true;
+    }
+}
+
+} // namespace editor
@@ -0,0 +1,165 @@
+#include "lsp_server_manager.h"
+#include <algorithm>
+#include <cctype>
+
+namespace editor {
+
+LspServerManager::LspServerManager(std::string workspace_root)
+    : workspace_root_(std::move(workspace_root)), reactor_(std::make_shared<LspIoReactor>()) {}
+
+// Servers go first (declared after the reactor) and shut down in turn
+LspServerManager::~LspServerManager() = default;
+
+void LspServerManager::add_server(LspServerConfig config) {
+    auto server = std::make_unique<Server>();
+    server->config = std::move(config);
+    servers_.push_back(std::move(server));
+}
+
+std::vector<LspServerConfig> LspServerManager::default_servers() {
+    return {
+        {"clangd", "clangd", {"c", "cpp", "objective-c", "objective-cpp"}, 16 * 1024 * 1024},
+        {"pyright", "pyright-langserver --stdio", {"python"}, 8 * 1024 * 1024},
+        {"gopls", "gopls", {"go"}, 16 * 1024 * 1024},
+    };
+}
+
+std::string LspServerManager::language_for_path(const std::string& path) {
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || path.find_first_of("/\\", dot) != std::string::npos) return std::string();
+    std::string ext = path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    if (ext == "c") return "c";
+    if (ext == "cpp" || ext == "cc" || ext == "cxx" || ext == "c++" || ext == "h" || ext == "hpp" ||
+        ext == "hh" || ext == "hxx" || ext == "inl") return "cpp";
+    if (ext == "m") return "objective-c";
+    if (ext == "mm") return "objective-cpp";
+    if (ext == "py" || ext == "pyi") return "python";
+    if (ext == "go") return "go";
+    return std::string();
+}
+
+LspServerManager::Server* LspServerManager::server_for_language(const std::string& language_id) const {
+    for (auto& server : servers_) {
+        const auto& languages = server->config.languages;
+        if (std::find(languages.begin(), languages.end(), language_id) != languages.end()) return server.get();
+    }
+    return nullptr;
+}
+
+size_t LspServerManager::size_limit(const std::string& language_id) const {
+    auto it = size_limits_.find(language_id);
+    if (it != size_limits_.end()) return it->second;
+    Server* server = server_for_language(language_id);
+    return server ? server->config.max_document_bytes : 0;
+}
+
+bool LspServerManager::over_size_limit(const std::string& language_id, size_t bytes) const {
+    size_t limit = size_limit(language_id);
+    return limit != 0 && bytes > limit;
+}
+
+LSPClient* LspServerManager::open_document(const std::string& uri, const std::string& language_id,
+                                           const PieceTable& document) {
+    Server* server = server_for_language(language_id);
+    if (!server || server->failed) return nullptr;
+    if (documents_.count(uri)) close_document(uri);
+    if (over_size_limit(language_id, document.get_total_length())) return nullptr;
+    if (!server->client && !start(*server, Clock::now())) return nullptr;
+
+    server->documents.push_back(uri);
+    documents_[uri] = server;
+    languages_[uri] = language_id;
+    server->last_used = Clock::now();
+    server->client->did_open(uri, language_id, document);
+    return server->client.get();
+}
+
+void LspServerManager::close_document(const std::string& uri) {
+    auto it = documents_.find(uri);
+    if (it == documents_.end()) return;
+    Server* server = it->second;
+    if (server->client) server->client->did_close(uri);
+    server->documents.erase(std::remove(server->documents.begin(), server->documents.end(), uri),
+                            server->documents.end());
+    documents_.erase(it);
+    languages_.erase(uri);
+}
+
+LSPClient* LspServerManager::client_for(const std::string& uri, bool launch) {
+    auto it = documents_.find(uri);
+    if (it == documents_.end()) return nullptr;
+    Server* server = it->second;
+    if (!launch) return server->client.get();
+    Clock::time_point now = Clock::now();
+    if (!server->client && (server->failed || !start(*server, now))) return nullptr;
+    server->last_used = now;
+    return server->client.get();
+}
+
+void LspServerManager::set_diagnostics_callback(LSPClient::DiagnosticsCallback callback) {
+    diagnostics_callback_ = std::move(callback);
+    for (auto& server : servers_) {
+        if (server->client) server->client->set_diagnostics_callback(diagnostics_callback_);
+    }
+}
+
+void LspServerManager::process_messages(Clock::time_point now) {
+    for (auto& server : servers_) {
+        if (server->client) {
+            server->client->process_messages();
+            if (server->client->has_exited()) {
+                server->client.reset();         // Already gone: shutdown does not wait
+                on_crash(*server, now);
+            } else if (now - server->last_used > idle_timeout_) {
+                server->client->retire();
+                server->client.reset();
+            }
+        }
+        if (!server->client && server->restart_pending && now >= server->restart_at) start(*server, now);
+    }
+}
+
+size_t LspServerManager::running_servers() const {
+    size_t count = 0;
+    for (const auto& server : servers_) {
+        if (server->client) ++count;
+    }
+    return count;
+}
+
+bool LspServerManager::start(Server& server, Clock::time_point now) {
+    server.restart_pending = false;
+    auto client = std::make_unique<LSPClient>(reactor_);
+    if (!client->start_server(server.config.command, workspace_root_) || !client->initialize_async(workspace_root_)) {
+        server.failed = true;                   // Not installed: do not try on every keystroke
+        return false;
+    }
+    client->set_diagnostics_callback(diagnostics_callback_);
+    // Documents it had before a crash or an idle retirement; they go out
+    // once the server has answered initialize
+    for (const std::string& uri : server.documents) {
+        std::shared_ptr<PieceTable> document = reopen_ ? reopen_(uri) : nullptr;
+        if (document) client->did_open(uri, languages_[uri], *document);
+    }
+    server.client = std::move(client);
+    server.last_used = now;
+    return true;
+}
+
+void LspServerManager::on_crash(Server& server, Clock::time_point now) {
+    if (server.crashes == 0 || now - server.first_crash > kRestartWindow) {
+        server.crashes = 0;
+        server.first_crash = now;
+    }
+    if (++server.crashes > kMaxRestarts) {
+        server.failed = true;
+        return;
+    }
+    // Nothing open: it starts again when a document needs it
+    if (server.documents.empty()) return;
+    server.restart_pending = true;
+    server.restart_at = now + std::chrono::seconds(1 << (server.crashes - 1));
+}
+
+} // namespace editor
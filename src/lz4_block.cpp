@@ -0,0 +1,111 @@
+#include "lz4_block.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace editor {
+
+namespace {
+
+constexpr size_t kMinMatch = 4;
+constexpr size_t kLastLiterals = 5;      // The block always ends in literals
+constexpr size_t kMatchLimit = 12;       // No match starts closer to the end
+constexpr size_t kMaxOffset = 65535;
+constexpr int kHashBits = 12;
+
+uint32_t read32(const char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+void put_length(std::string& out, size_t length) {
+    for (; length >= 255; length -= 255) out.push_back(static_cast<char>(255));
+    out.push_back(static_cast<char>(length));
+}
+
+void put_sequence(std::string& out, const char* literals, size_t literal_length, size_t offset, size_t match_length) {
+    size_t match_code = match_length - kMinMatch;
+    uint8_t token = static_cast<uint8_t>(((literal_length < 15 ? literal_length : 15) << 4) |
+                                         (match_code < 15 ? match_code : 15));
+    out.push_back(static_cast<char>(token));
+    if (literal_length >= 15) put_length(out, literal_length - 15);
+    out.append(literals, literal_length);
+    out.push_back(static_cast<char>(offset & 0xFF));
+    out.push_back(static_cast<char>(offset >> 8));
+    if (match_code >= 15) put_length(out, match_code - 15);
+}
+
+// A length continued in 255-bytes; false past the end of the input
+bool get_length(const char* data, size_t size, size_t& pos, size_t& length) {
+    uint8_t byte = 255;
+    while (byte == 255) {
+        if (pos >= size) return false;
+        byte = static_cast<uint8_t>(data[pos++]);
+        length += byte;
+    }
+    return true;
+}
+
+} // namespace
+
+std::string lz4_compress(const char* data, size_t size) {
+    std::string out;
+    out.reserve(lz4_bound(size));
+    size_t anchor = 0;
+    if (size > kMatchLimit) {
+        std::vector<size_t> table(size_t(1) << kHashBits, SIZE_MAX);
+        size_t last_start = size - kMatchLimit;
+        size_t match_end_limit = size - kLastLiterals;
+        for (size_t pos = 0; pos <= last_start;) {
+            uint32_t sequence = read32(data + pos);
+            uint32_t hash = (sequence * 2654435761u) >> (32 - kHashBits);
+            size_t candidate = table[hash];
+            table[hash] = pos;
+            if (candidate == SIZE_MAX || pos - candidate > kMaxOffset || read32(data + candidate) != sequence) {
+                ++pos;
+                continue;
+            }
+            size_t length = kMinMatch;
+            while (pos + length < match_end_limit && data[candidate + length] == data[pos + length]) ++length;
+            put_sequence(out, data + anchor, pos - anchor, pos - candidate, length);
+            pos += length;
+            anchor = pos;
+        }
+    }
+    size_t literal_length = size - anchor;
+    out.push_back(static_cast<char>((literal_length < 15 ? literal_length : 15) << 4));
+    if (literal_length >= 15) put_length(out, literal_length - 15);
+    out.append(data + anchor, literal_length);
+    return out;
+}
+
+bool lz4_decompress(const char* data, size_t size, char* out, size_t out_size) {
+    size_t in = 0, written = 0;
+    while (in < size) {
+        uint8_t token = static_cast<uint8_t>(data[in++]);
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !get_length(data, size, in, literal_length)) return false;
+        if (literal_length > size - in || literal_length > out_size - written) return false;
+        std::memcpy(out + written, data + in, literal_length);
+        in += literal_length;
+        written += literal_length;
+        if (in == size) break;      // The last sequence has no match
+
+        if (size - in < 2) return false;
+        size_t offset = static_cast<uint8_t>(data[in]) | (static_cast<size_t>(static_cast<uint8_t>(data[in + 1])) << 8);
+        in += 2;
+        if (offset == 0 || offset > written) return false;
+        size_t match_length = token & 15;
+        if (match_length == 15 && !get_length(data, size, in, match_length)) return false;
+        match_length += kMinMatch;
+        if (match_length > out_size - written) return false;
+        // Byte by byte: the match may overlap what it is copying
+        const char* from = out + written - offset;
+        for (size_t i = 0; i < match_length; ++i) out[written + i] = from[i];
+        written += match_length;
+    }
+    return written == out_size;
+}
+
+} // namespace editor
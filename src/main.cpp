@@ -1,10 +1,22 @@
 #include "piece_table.h"
 #include "viewport.h"
 #include "indexer.h"
+#include "memory_report.h"
+#include "batch_edit.h"
+#include "remote_agent.h"
+#include "platform_file.h"
+#include <filesystem>
 #include <iostream>
 #include <memory>
 #include <sstream>
 #include <chrono>
+#include <cstdio>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 /**
  * High-Performance Text Editor Demo
@@ -225,6 +237,122 @@ void print_architecture_summary() {
     std::cout << "   - Incremental parsing for syntax highlighting\n\n";
 }
 
+// --memory-report [path...]: files are opened as documents (and edited a
+// little, so the add buffer and history show), directories are indexed;
+// then the report of what each holds is printed
+int run_memory_report(const std::vector<std::string>& paths) {
+    editor::MemoryReport report;
+    std::vector<std::string> roots;
+    std::vector<std::unique_ptr<PieceTable>> documents;
+    for (const std::string& path : paths) {
+        if (std::filesystem::is_directory(path)) {
+            roots.push_back(path);
+            continue;
+        }
+        auto mapping = editor::MappedFile::open(path);
+        if (!mapping) {
+            std::cerr << "Cannot open " << path << "\n";
+            continue;
+        }
+        auto document = std::make_unique<PieceTable>(mapping);
+        document->insert(0, "// memory report\n");
+        document->remove(0, 3);
+        PieceTable::MemoryUsage usage = document->get_memory_usage();
+        report.add(path, "original buffer", usage.original);
+        report.add(path, "original buffer", usage.mapped, true);
+        report.add(path, "add buffer", usage.add_buffer);
+        report.add(path, "line index", usage.line_index);
+        report.add(path, "piece tree", usage.piece_tree);
+        report.add(path, "undo history", usage.undo_history);
+        documents.push_back(std::move(document));
+    }
+    if (!roots.empty()) {
+        BackgroundIndexer indexer;
+        indexer.start();
+        indexer.index_workspace(roots);
+        indexer.wait_for_indexing();
+        BackgroundIndexer::MemoryUsage usage = indexer.get_memory_usage();
+        report.add("workspace index", "index words", usage.words);
+        report.add("workspace index", "index trigrams", usage.trigrams);
+        report.add("workspace index", "index files", usage.files);
+        report.add("workspace index", "index line tables", usage.line_tables);
+        report.add("workspace index", "index spellings", usage.spellings);
+        indexer.stop();
+    }
+    std::cout << report.format();
+    return 0;
+}
+
+// --batch-edit (-e command | -f script)... [--dry-run] path...: the edit
+// program (see BatchEdit) is run over every file, directories recursively,
+// on all cores; prints the files it changed and exits 1 if any failed
+int run_batch_edit(const std::vector<std::string>& args) {
+    std::string program;
+    std::vector<std::string> paths;
+    bool dry_run = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if ((args[i] == "-e" || args[i] == "-f") && i + 1 < args.size()) {
+            std::string text = args[++i];
+            if (args[i - 1] == "-f" && !editor::PlatformFile::read_file(args[i], text)) {
+                std::cerr << "Cannot read " << args[i] << "\n";
+                return 2;
+            }
+            program += text + "\n";
+        } else if (args[i] == "--dry-run") {
+            dry_run = true;
+        } else {
+            paths.push_back(args[i]);
+        }
+    }
+    editor::BatchEdit batch;
+    if (!batch.parse(program)) {
+        std::cerr << "Bad edit program: " << batch.error() << "\n";
+        return 2;
+    }
+    if (batch.commands().empty() || paths.empty()) {
+        std::cerr << "Usage: editor_demo --batch-edit (-e command | -f script)... [--dry-run] path...\n";
+        return 2;
+    }
+    auto start = std::chrono::steady_clock::now();
+    editor::BatchEdit::Result result = batch.run(editor::BatchEdit::expand_paths(paths), dry_run);
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    for (const auto& file : result.touched) {
+        if (!file.error.empty()) std::cerr << file.error << "\n";
+        else std::cout << file.path << ": " << file.edits << " edits\n";
+    }
+    std::cout << result.files << " files, " << result.changed << (dry_run ? " would change, " : " changed, ")
+              << result.edits << " edits in " << elapsed.count() << " ms\n";
+    return result.ok() ? 0 : 1;
+}
+
+// --agent root: the remote workspace agent, speaking the remote protocol on
+// stdin/stdout (ssh -C -T host editor_demo --agent root); exits at the end
+// of its input
+int run_remote_agent(const std::string& root) {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    editor::RemoteAgent agent(root, [](std::string frame) {
+        std::fwrite(frame.data(), 1, frame.size(), stdout);
+        std::fflush(stdout);
+    });
+    agent.start();
+    // Read whatever has arrived rather than waiting for a full buffer, so a
+    // keystroke's edit is answered at once
+    std::vector<char> buffer(64 * 1024);
+    for (;;) {
+#ifdef _WIN32
+        int got = _read(_fileno(stdin), buffer.data(), static_cast<unsigned>(buffer.size()));
+#else
+        ssize_t got = ::read(STDIN_FILENO, buffer.data(), buffer.size());
+#endif
+        if (got <= 0) break;
+        if (!agent.receive(buffer.data(), static_cast<size_t>(got))) return 1;
+    }
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
     bool bench_mode = false;
     for (int i = 1; i < argc; ++i) {
@@ -232,6 +360,17 @@ int main(int argc, char* argv[]) {
         if (arg == "--bench" || arg == "--autotest") {
             bench_mode = true;
         }
+        if (arg == "--memory-report") {
+            std::vector<std::string> paths(argv + i + 1, argv + argc);
+            if (paths.empty()) paths.push_back(".");
+            return run_memory_report(paths);
+        }
+        if (arg == "--agent") {
+            return run_remote_agent(i + 1 < argc ? argv[i + 1] : ".");
+        }
+        if (arg == "--batch-edit") {
+            return run_batch_edit(std::vector<std::string>(argv + i + 1, argv + argc));
+        }
     }
 
     if (bench_mode) {
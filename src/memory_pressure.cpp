@@ -0,0 +1,371 @@
+#include "memory_pressure.h"
+#include "memory_report.h"
+#include <algorithm>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <dispatch/dispatch.h>
+#else
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace editor {
+
+#ifdef _WIN32
+
+// ============================================================================
+// Windows: the low-memory resource notification, and the memory load
+// between its signals
+// ============================================================================
+
+struct MemoryPressureMonitor::Backend {
+    explicit Backend(MemoryPressureMonitor& owner) : owner_(owner) {}
+
+    bool start() {
+        low_ = CreateMemoryResourceNotification(LowMemoryResourceNotification);
+        if (!low_) return false;
+        stop_ = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        if (!stop_) {
+            stop();
+            return false;
+        }
+        watcher_ = std::thread(&Backend::run, this);
+        return true;
+    }
+
+    void stop() {
+        if (watcher_.joinable()) {
+            SetEvent(stop_);
+            watcher_.join();
+        }
+        for (HANDLE* handle : {&low_, &stop_}) {
+            if (*handle) CloseHandle(*handle);
+            *handle = nullptr;
+        }
+    }
+
+private:
+    // Percent of physical memory in use from which pressure is moderate
+    static constexpr DWORD kModerateLoad = 90;
+
+    void run() {
+        HANDLE handles[2] = {stop_, low_};
+        for (;;) {
+            DWORD result = WaitForMultipleObjects(2, handles, FALSE, 1000);
+            if (result == WAIT_OBJECT_0 + 1) {
+                owner_.signal(MemoryPressureLevel::Critical);
+                // The notification stays set while memory is low
+                if (WaitForSingleObject(stop_, 1000) == WAIT_OBJECT_0) return;
+            } else if (result == WAIT_TIMEOUT) {
+                MEMORYSTATUSEX status = {};
+                status.dwLength = sizeof(status);
+                if (GlobalMemoryStatusEx(&status) && status.dwMemoryLoad >= kModerateLoad) {
+                    owner_.signal(MemoryPressureLevel::Moderate);
+                }
+            } else {
+                return;
+            }
+        }
+    }
+
+    MemoryPressureMonitor& owner_;
+    HANDLE low_ = nullptr;
+    HANDLE stop_ = nullptr;
+    std::thread watcher_;
+};
+
+#elif defined(__APPLE__)
+
+// ============================================================================
+// macOS: a dispatch memory-pressure source
+// ============================================================================
+
+struct MemoryPressureMonitor::Backend {
+    explicit Backend(MemoryPressureMonitor& owner) : owner_(owner) {}
+
+    bool start() {
+        queue_ = dispatch_queue_create("velocity.memory_pressure", DISPATCH_QUEUE_SERIAL);
+        source_ = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+                                         DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL, queue_);
+        if (!source_) {
+            stop();
+            return false;
+        }
+        dispatch_set_context(source_, this);
+        dispatch_source_set_event_handler_f(source_, &Backend::on_event);
+        dispatch_resume(source_);
+        return true;
+    }
+
+    void stop() {
+        if (source_) {
+            dispatch_source_cancel(source_);
+            // Let a handler already running on the queue finish
+            dispatch_sync_f(queue_, nullptr, [](void*) {});
+            dispatch_release(source_);
+            source_ = nullptr;
+        }
+        if (queue_) {
+            dispatch_release(queue_);
+            queue_ = nullptr;
+        }
+    }
+
+private:
+    static void on_event(void* context) {
+        Backend* self = static_cast<Backend*>(context);
+        unsigned long flags = dispatch_source_get_data(self->source_);
+        if (flags & DISPATCH_MEMORYPRESSURE_CRITICAL) {
+            self->owner_.signal(MemoryPressureLevel::Critical);
+        } else if (flags & DISPATCH_MEMORYPRESSURE_WARN) {
+            self->owner_.signal(MemoryPressureLevel::Moderate);
+        }
+    }
+
+    MemoryPressureMonitor& owner_;
+    dispatch_queue_t queue_ = nullptr;
+    dispatch_source_t source_ = nullptr;
+};
+
+#else
+
+// ============================================================================
+// Linux: PSI triggers on the cgroup's memory.pressure or the system's, else
+// the cgroup's memory.events counters
+// ============================================================================
+
+namespace {
+
+// The cgroup v2 directory of this process, "" when there is none
+std::string cgroup_directory() {
+    std::ifstream in("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 3, "0::") == 0 && line.size() > 4) return "/sys/fs/cgroup" + line.substr(3);
+    }
+    return std::string();
+}
+
+// A PSI trigger: the fd gets POLLPRI when stalls exceed the threshold
+// within the window. Unprivileged triggers need a window of whole 2 s.
+int open_trigger(const std::string& path, const char* trigger) {
+    int fd = open(path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) return -1;
+    if (write(fd, trigger, std::strlen(trigger) + 1) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// The "name value" counter of a memory.events file
+uint64_t event_count(const char* text, const char* name) {
+    size_t length = std::strlen(name);
+    for (const char* line = text; *line;) {
+        if (std::strncmp(line, name, length) == 0 && line[length] == ' ') {
+            return std::strtoull(line + length + 1, nullptr, 10);
+        }
+        const char* next = std::strchr(line, '\n');
+        if (!next) break;
+        line = next + 1;
+    }
+    return 0;
+}
+
+} // namespace
+
+struct MemoryPressureMonitor::Backend {
+    explicit Backend(MemoryPressureMonitor& owner) : owner_(owner) {}
+
+    bool start() {
+        std::string cgroup = cgroup_directory();
+        for (const std::string& path : {cgroup.empty() ? std::string() : cgroup + "/memory.pressure",
+                                         std::string("/proc/pressure/memory")}) {
+            if (path.empty()) continue;
+            // Some task stalled 150 ms, or all of them 100 ms, in 2 s
+            moderate_ = open_trigger(path, "some 150000 2000000");
+            if (moderate_ < 0) continue;
+            critical_ = open_trigger(path, "full 100000 2000000");
+            break;
+        }
+        if (moderate_ < 0 && !cgroup.empty()) {
+            events_ = open((cgroup + "/memory.events").c_str(), O_RDONLY | O_CLOEXEC);
+            if (events_ >= 0) read_events(high_, max_);
+        }
+        if (moderate_ < 0 && events_ < 0) return false;
+        if (pipe(wake_) != 0) {
+            stop();
+            return false;
+        }
+        watcher_ = std::thread(&Backend::run, this);
+        return true;
+    }
+
+    void stop() {
+        if (watcher_.joinable()) {
+            char byte = 0;
+            ssize_t written = write(wake_[1], &byte, 1);
+            (void)written;
+            watcher_.join();
+        }
+        for (int* fd : {&moderate_, &critical_, &events_, &wake_[0], &wake_[1]}) {
+            if (*fd >= 0) close(*fd);
+            *fd = -1;
+        }
+    }
+
+private:
+    bool read_events(uint64_t& high, uint64_t& max) {
+        char text[512];
+        ssize_t size = pread(events_, text, sizeof(text) - 1, 0);
+        if (size <= 0) return false;
+        text[size] = '\0';
+        high = event_count(text, "high");
+        max = event_count(text, "max");
+        return true;
+    }
+
+    void run() {
+        // memory.events changes are polled for as well: not every kernel
+        // wakes poll() on them
+        pollfd fds[3] = {{wake_[0], POLLIN, 0}, {moderate_, POLLPRI, 0}, {critical_, POLLPRI, 0}};
+        for (;;) {
+            int ready = ::poll(fds, 3, events_ >= 0 ? 1000 : -1);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            if (fds[0].revents) return;
+            // POLLERR: the cgroup went away
+            if ((fds[1].revents | fds[2].revents) & (POLLERR | POLLNVAL)) return;
+            if (fds[2].revents & POLLPRI) {
+                owner_.signal(MemoryPressureLevel::Critical);
+            } else if (fds[1].revents & POLLPRI) {
+                owner_.signal(MemoryPressureLevel::Moderate);
+            }
+            uint64_t high = 0, max = 0;
+            if (events_ >= 0 && read_events(high, max)) {
+                if (max > max_) {
+                    owner_.signal(MemoryPressureLevel::Critical);
+                } else if (high > high_) {
+                    owner_.signal(MemoryPressureLevel::Moderate);
+                }
+                high_ = high;
+                max_ = max;
+            }
+        }
+    }
+
+    MemoryPressureMonitor& owner_;
+    int moderate_ = -1;
+    int critical_ = -1;
+    int events_ = -1;
+    uint64_t high_ = 0;         // memory.events counts last read
+    uint64_t max_ = 0;
+    int wake_[2] = {-1, -1};
+    std::thread watcher_;
+};
+
+#endif
+
+MemoryPressureMonitor::MemoryPressureMonitor() = default;
+
+MemoryPressureMonitor::~MemoryPressureMonitor() {
+    stop();
+}
+
+void MemoryPressureMonitor::add_cache(const std::string& name, ShedFn shed, MemoryPressureLevel from) {
+    caches_.push_back({name, std::move(shed), from});
+    evictions_.push_back({name, 0, 0});
+}
+
+bool MemoryPressureMonitor::start(WakeFn wake) {
+    stop();
+    wake_ = std::move(wake);
+    backend_ = std::make_unique<Backend>(*this);
+    if (!backend_->start()) {
+        backend_.reset();
+        return false;
+    }
+    return true;
+}
+
+void MemoryPressureMonitor::stop() {
+    if (backend_) {
+        backend_->stop();
+        backend_.reset();
+    }
+}
+
+void MemoryPressureMonitor::signal(MemoryPressureLevel level) {
+    if (level == MemoryPressureLevel::Normal) return;
+    {
+        std::lock_guard<std::mutex> lock(signal_mutex_);
+        signalled_ = (std::max)(signalled_, level);
+        signalled_at_ = Clock::now();
+    }
+    uint8_t value = static_cast<uint8_t>(level);
+    uint8_t pending = pending_.load();
+    while (pending < value && !pending_.compare_exchange_weak(pending, value)) {
+    }
+    if (pending < value && wake_) wake_();
+}
+
+MemoryPressureLevel MemoryPressureMonitor::level() const {
+    std::lock_guard<std::mutex> lock(signal_mutex_);
+    if (signalled_ == MemoryPressureLevel::Normal || Clock::now() - signalled_at_ >= kQuietPeriod) {
+        return MemoryPressureLevel::Normal;
+    }
+    return signalled_;
+}
+
+size_t MemoryPressureMonitor::poll() {
+    {
+        // A quiet period resets the level a later signal is compared with
+        std::lock_guard<std::mutex> lock(signal_mutex_);
+        if (Clock::now() - signalled_at_ >= kQuietPeriod) signalled_ = MemoryPressureLevel::Normal;
+    }
+    auto level = static_cast<MemoryPressureLevel>(pending_.exchange(0));
+    if (level == MemoryPressureLevel::Normal) return 0;
+    size_t index = static_cast<size_t>(level);
+    Clock::time_point now = Clock::now();
+    if (shed_once_[index] && now - last_shed_[index] < kCooldown) return 0;
+    shed_once_[index] = true;
+    last_shed_[index] = now;
+    return shed(level);
+}
+
+size_t MemoryPressureMonitor::shed(MemoryPressureLevel level) {
+    size_t freed = 0;
+    for (size_t i = 0; i < caches_.size(); ++i) {
+        if (caches_[i].from > level) continue;
+        size_t bytes = caches_[i].shed ? caches_[i].shed() : 0;
+        if (bytes == 0) continue;
+        ++evictions_[i].times;
+        evictions_[i].bytes += bytes;
+        freed += bytes;
+    }
+    return freed;
+}
+
+void MemoryPressureMonitor::report(MemoryReport& report) const {
+    for (const Eviction& eviction : evictions_) report.add_shed(eviction.cache, eviction.bytes, eviction.times);
+}
+
+const char* MemoryPressureMonitor::level_name(MemoryPressureLevel level) {
+    switch (level) {
+    case MemoryPressureLevel::Moderate: return "moderate";
+    case MemoryPressureLevel::Critical: return "critical";
+    default: return "normal";
+    }
+}
+
+} // namespace editor
@@ -0,0 +1,104 @@
+#include "memory_report.h"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+
+namespace editor {
+
+void MemoryReport::add(const std::string& owner, const std::string& subsystem, size_t bytes, bool mapped) {
+    if (bytes == 0) return;
+    entries_.push_back({owner, subsystem, bytes, mapped});
+}
+
+void MemoryReport::add_shed(const std::string& cache, size_t bytes, size_t times) {
+    if (bytes == 0) return;
+    shed_.push_back({cache, bytes, times});
+}
+
+size_t MemoryReport::total() const {
+    size_t bytes = 0;
+    for (const Entry& entry : entries_) {
+        if (!entry.mapped) bytes += entry.bytes;
+    }
+    return bytes;
+}
+
+size_t MemoryReport::mapped_total() const {
+    size_t bytes = 0;
+    for (const Entry& entry : entries_) {
+        if (entry.mapped) bytes += entry.bytes;
+    }
+    return bytes;
+}
+
+size_t MemoryReport::owner_total(const std::string& owner) const {
+    size_t bytes = 0;
+    for (const Entry& entry : entries_) {
+        if (!entry.mapped && entry.owner == owner) bytes += entry.bytes;
+    }
+    return bytes;
+}
+
+size_t MemoryReport::subsystem_total(const std::string& subsystem) const {
+    size_t bytes = 0;
+    for (const Entry& entry : entries_) {
+        if (!entry.mapped && entry.subsystem == subsystem) bytes += entry.bytes;
+    }
+    return bytes;
+}
+
+std::string MemoryReport::format_bytes(size_t bytes) {
+    char text[32];
+    if (bytes >= 1024 * 1024 * 1024) {
+        std::snprintf(text, sizeof(text), "%.2f GB", bytes / (1024.0 * 1024 * 1024));
+    } else if (bytes >= 1024 * 1024) {
+        std::snprintf(text, sizeof(text), "%.1f MB", bytes / (1024.0 * 1024));
+    } else if (bytes >= 1024) {
+        std::snprintf(text, sizeof(text), "%.1f KB", bytes / 1024.0);
+    } else {
+        std::snprintf(text, sizeof(text), "%zu B", bytes);
+    }
+    return text;
+}
+
+std::string MemoryReport::format() const {
+    // Owners in the order they were first reported; their lines by size
+    std::vector<std::string> owners;
+    std::map<std::string, size_t> subsystems;
+    for (const Entry& entry : entries_) {
+        if (std::find(owners.begin(), owners.end(), entry.owner) == owners.end()) owners.push_back(entry.owner);
+        if (!entry.mapped) subsystems[entry.subsystem] += entry.bytes;
+    }
+
+    std::string out = "Memory: " + format_bytes(total());
+    if (mapped_total() != 0) out += " (+" + format_bytes(mapped_total()) + " mapped)";
+    out += "\n\nBy owner\n";
+    for (const std::string& owner : owners) {
+        out += "  " + owner + ": " + format_bytes(owner_total(owner)) + "\n";
+        std::vector<const Entry*> lines;
+        for (const Entry& entry : entries_) {
+            if (entry.owner == owner) lines.push_back(&entry);
+        }
+        std::stable_sort(lines.begin(), lines.end(), [](const Entry* a, const Entry* b) { return a->bytes > b->bytes; });
+        for (const Entry* entry : lines) {
+            out += "    " + entry->subsystem + ": " + format_bytes(entry->bytes) + (entry->mapped ? " mapped" : "") + "\n";
+        }
+    }
+
+    std::vector<std::pair<std::string, size_t>> sorted(subsystems.begin(), subsystems.end());
+    std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.second > b.second; });
+    out += "\nBy subsystem\n";
+    for (const auto& [subsystem, bytes] : sorted) {
+        out += "  " + subsystem + ": " + format_bytes(bytes) + "\n";
+    }
+    if (!shed_.empty()) {
+        out += "\nShed under memory pressure\n";
+        for (const Shed& shed : shed_) {
+            out += "  " + shed.cache + ": " + format_bytes(shed.bytes) + " in " + std::to_string(shed.times) +
+                   (shed.times == 1 ? " eviction\n" : " evictions\n");
+        }
+    }
+    return out;
+}
+
+} // namespace editor
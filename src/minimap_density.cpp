@@ -0,0 +1,170 @@
+#include "minimap_density.h"
+#include "column_layout.h"
+#include <algorithm>
+
+namespace editor {
+
+namespace {
+
+uint32_t lerp_color(uint32_t from, uint32_t to, unsigned weight) {    // weight 0..255
+    uint32_t out = 0xFF000000u;
+    for (int shift = 0; shift < 24; shift += 8) {
+        unsigned a = (from >> shift) & 0xFF;
+        unsigned b = (to >> shift) & 0xFF;
+        out |= ((a * (255 - weight) + b * weight + 127) / 255) << shift;
+    }
+    return out;
+}
+
+} // namespace
+
+MinimapDensity::MinimapDensity(LineColor line_color)
+    : line_color_(std::move(line_color))
+{}
+
+MinimapDensity::~MinimapDensity() {
+    if (document_) document_->remove_change_listener(listener_id_);
+}
+
+void MinimapDensity::set_document(const std::shared_ptr<PieceTable>& document) {
+    if (document == document_) return;
+    if (document_) document_->remove_change_listener(listener_id_);
+    document_ = document;
+    listener_id_ = 0;
+    line_count_ = document_ ? document_->get_line_count() : 0;
+    if (document_) {
+        listener_id_ = document_->add_change_listener([this](const PieceTable::Change& change) {
+            on_change(change);
+        });
+    }
+    mark_all_dirty();
+}
+
+void MinimapDensity::resize(int width, int height) {
+    width = std::max(0, width);
+    height = std::max(0, height);
+    if (width == width_ && height == height_) return;
+    width_ = width;
+    height_ = height;
+    pixels_.assign(static_cast<size_t>(width_) * height_, kBackground);
+    dirty_.assign(height_, false);
+    dirty_count_ = 0;
+    mark_all_dirty();
+}
+
+void MinimapDensity::on_change(const PieceTable::Change& change) {
+    size_t lines = document_->get_line_count();
+    if (lines != line_count_) {
+        // Every bucket boundary moved
+        line_count_ = lines;
+        mark_all_dirty();
+        return;
+    }
+    mark_dirty(row_of_line(change.first_line), row_of_line(change.first_line + change.inserted_newlines + 1));
+}
+
+int MinimapDensity::row_of_line(size_t line) const {
+    if (line_count_ == 0 || height_ == 0) return 0;
+    // Row whose bucket holds line (floor of the click mapping)
+    double row = static_cast<double>(line) * height_ / line_count_;
+    return static_cast<int>(std::min<double>(height_, row));
+}
+
+void MinimapDensity::mark_dirty(int first_row, int last_row) {
+    first_row = std::max(0, first_row - 1);
+    last_row = std::min(height_, last_row + 1);
+    for (int row = first_row; row < last_row; ++row) {
+        if (!dirty_[row]) {
+            dirty_[row] = true;
+            dirty_count_++;
+        }
+    }
+}
+
+void MinimapDensity::mark_all_dirty() {
+    std::fill(dirty_.begin(), dirty_.end(), true);
+    dirty_count_ = dirty_.size();
+    next_row_ = 0;
+}
+
+bool MinimapDensity::update(size_t max_rows) {
+    if (dirty_count_ == 0 || height_ == 0) return false;
+    size_t done = 0;
+    for (int scanned = 0; scanned < height_ && done < max_rows && dirty_count_ > 0; ++scanned) {
+        int row = next_row_;
+        next_row_ = (next_row_ + 1) % height_;
+        if (!dirty_[row]) continue;
+        derive_row(row);
+        dirty_[row] = false;
+        dirty_count_--;
+        done++;
+    }
+    return done > 0;
+}
+
+void MinimapDensity::derive_row(int row) {
+    uint32_t* out = &pixels_[static_cast<size_t>(row) * width_];
+    std::fill(out, out + width_, kBackground);
+    if (width_ > 0) out[0] = kBorder;
+    if (!document_ || line_count_ == 0) return;
+
+    size_t first = static_cast<size_t>(static_cast<double>(row) * line_count_ / height_);
+    size_t last = static_cast<size_t>(static_cast<double>(row + 1) * line_count_ / height_);
+    last = std::min(last, line_count_);
+    if (first >= last) return;      // Short document: rows between lines stay blank
+
+    int columns = width_ - kTextLeft;
+    if (columns <= 0) return;
+    size_t samples = std::min<size_t>(kSamplesPerRow, last - first);
+    // Per column: how many sampled lines are inked there, and their summed color
+    std::vector<unsigned> ink(columns, 0);
+    std::vector<unsigned> red(columns, 0), green(columns, 0), blue(columns, 0);
+    ColumnLayout::LineMap map;
+    for (size_t s = 0; s < samples; ++s) {
+        size_t line = first + (last - first) * s / samples;
+        std::string text = document_->get_line(line);
+        if (text.empty()) continue;
+        uint32_t color = line_color_ ? line_color_(text) : kDefaultColor;
+        // Display columns, so tabs indent and wide characters ink two; the
+        // bytes of kMaxChars four-byte characters are all that can show
+        ColumnLayout::map_text(text.data(), std::min(text.size(), kMaxChars * size_t(4)), ColumnLayout::kDefaultTabWidth,
+                               map);
+        for (int column = 0; column < columns; ++column) {
+            size_t ch = map.byte_at(static_cast<size_t>(column) * kMaxChars / columns);
+            if (ch >= map.bytes) break;
+            if (text[ch] == ' ' || text[ch] == '\t' || text[ch] == '\r') continue;
+            ink[column]++;
+            red[column] += (color >> 16) & 0xFF;
+            green[column] += (color >> 8) & 0xFF;
+            blue[column] += color & 0xFF;
+        }
+    }
+    for (int column = 0; column < columns; ++column) {
+        if (ink[column] == 0) continue;
+        unsigned n = ink[column];
+        uint32_t color = 0xFF000000u | ((red[column] / n) << 16) | ((green[column] / n) << 8) | (blue[column] / n);
+        unsigned weight = static_cast<unsigned>(255 * n / samples);
+        out[kTextLeft + column] = lerp_color(kBackground, color, weight);
+    }
+}
+
+void MinimapDensity::viewport_rows(size_t top_line, size_t count, int& first, int& last) const {
+    if (line_count_ == 0 || height_ == 0) {
+        first = last = 0;
+        return;
+    }
+    double scale = static_cast<double>(height_) / line_count_;
+    first = std::min(height_, static_cast<int>(top_line * scale));
+    last = std::min(height_, first + std::max(3, static_cast<int>(count * scale)));
+}
+
+void MinimapDensity::blend_rows(int first, int last, uint32_t color, std::vector<uint32_t>& out) const {
+    first = std::max(0, first);
+    last = std::min(height_, last);
+    out.clear();
+    if (first >= last) return;
+    out.assign(pixels_.begin() + static_cast<size_t>(first) * width_, pixels_.begin() + static_cast<size_t>(last) * width_);
+    for (uint32_t& pixel : out) pixel = lerp_color(pixel, color, 85);
+}
+
+} // namespace editor
@@ -0,0 +1,225 @@
+#include "persistent_index.h"
+#include "platform_file.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace {
+
+constexpr char kMagic[8] = {'V', 'E', 'L', 'I', 'D', 'X', '\0', '\0'};
+constexpr uint32_t kByteOrder = 0x01020304;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t file_count;
+    uint64_t word_count;
+    uint64_t trigram_count;
+    uint64_t files_offset;
+    uint64_t words_offset;
+    uint64_t trigrams_offset;
+    uint64_t total_size;
+};
+
+// [offset, offset + count * size) lies inside the file
+bool in_bounds(uint64_t offset, uint64_t count, size_t size, uint64_t file_size) {
+    return offset <= file_size && count <= (file_size - offset) / size;
+}
+
+void append(std::string& out, const void* data, size_t size) {
+    out.append(static_cast<const char*>(data), size);
+}
+
+void align8(std::string& out) {
+    out.resize((out.size() + 7) & ~size_t(7), '\0');
+}
+
+} // namespace
+
+std::shared_ptr<PersistentIndex> PersistentIndex::open(const std::string& path) {
+    auto mapping = editor::PlatformFile::map_file(path);
+    if (!mapping || mapping->size() < sizeof(Header)) return nullptr;
+
+    Header header;
+    std::memcpy(&header, mapping->data(), sizeof(header));
+    uint64_t size = mapping->size();
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+        header.byte_order != kByteOrder || header.total_size != size) {
+        return nullptr;
+    }
+    if (header.files_offset % 8 || header.words_offset % 8 || header.trigrams_offset % 8 ||
+        !in_bounds(header.files_offset, header.file_count, sizeof(FileRecord), size) ||
+        !in_bounds(header.words_offset, header.word_count, sizeof(WordRecord), size) ||
+        !in_bounds(header.trigrams_offset, header.trigram_count, sizeof(TrigramRecord), size)) {
+        return nullptr;
+    }
+
+    std::shared_ptr<PersistentIndex> index(new PersistentIndex());
+    index->data_ = mapping->data();
+    index->files_ = reinterpret_cast<const FileRecord*>(index->at(header.files_offset));
+    index->words_ = reinterpret_cast<const WordRecord*>(index->at(header.words_offset));
+    index->trigrams_ = reinterpret_cast<const TrigramRecord*>(index->at(header.trigrams_offset));
+    index->file_count_ = static_cast<size_t>(header.file_count);
+    index->word_count_ = static_cast<size_t>(header.word_count);
+    index->trigram_count_ = static_cast<size_t>(header.trigram_count);
+
+    // Every record must point inside the file; ids are checked where used
+    for (size_t i = 0; i < index->file_count_; ++i) {
+        const FileRecord& file = index->files_[i];
+        if (!in_bounds(file.path_offset, file.path_length, 1, size) || file.lines_offset % 8 ||
+            !in_bounds(file.lines_offset, uint64_t(file.line_count) + 1, sizeof(uint64_t), size)) {
+            return nullptr;
+        }
+    }
+    for (size_t i = 0; i < index->word_count_; ++i) {
+        const WordRecord& word = index->words_[i];
+        if (!in_bounds(word.word_offset, word.word_length, 1, size) || word.postings_offset % 4 ||
+            !in_bounds(word.postings_offset, word.posting_count, sizeof(IndexPosting), size)) {
+            return nullptr;
+        }
+    }
+    for (size_t i = 0; i < index->trigram_count_; ++i) {
+        const TrigramRecord& trigram = index->trigrams_[i];
+        if (trigram.files_offset % 4 || !in_bounds(trigram.files_offset, trigram.file_count, sizeof(uint32_t), size)) {
+            return nullptr;
+        }
+    }
+
+    index->mapping_ = std::move(mapping);
+    return index;
+}
+
+PersistentIndex::FileInfo PersistentIndex::file(uint32_t file_id) const {
+    const FileRecord& record = files_[file_id];
+    return {std::string_view(at(record.path_offset), record.path_length), record.mtime, record.size, record.line_count};
+}
+
+const uint64_t* PersistentIndex::line_starts(uint32_t file_id) const {
+    return reinterpret_cast<const uint64_t*>(at(files_[file_id].lines_offset));
+}
+
+const IndexPosting* PersistentIndex::word_postings(std::string_view word, size_t& count) const {
+    const WordRecord* end = words_ + word_count_;
+    const WordRecord* it = std::lower_bound(words_, end, word, [this](const WordRecord& record, std::string_view key) {
+        return word_of(record) < key;
+    });
+    if (it == end || word_of(*it) != word) {
+        count = 0;
+        return nullptr;
+    }
+    count = it->posting_count;
+    return reinterpret_cast<const IndexPosting*>(at(it->postings_offset));
+}
+
+const uint32_t* PersistentIndex::trigram_files(uint32_t trigram, size_t& count) const {
+    const TrigramRecord* end = trigrams_ + trigram_count_;
+    const TrigramRecord* it = std::lower_bound(trigrams_, end, trigram, [](const TrigramRecord& record, uint32_t key) {
+        return record.trigram < key;
+    });
+    if (it == end || it->trigram != trigram) {
+        count = 0;
+        return nullptr;
+    }
+    count = it->file_count;
+    return reinterpret_cast<const uint32_t*>(at(it->files_offset));
+}
+
+uint32_t PersistentIndex::Writer::add_file(std::string_view path, uint64_t mtime, uint64_t size,
+                                           std::vector<uint64_t> line_starts) {
+    File file;
+    file.path = std::string(path);
+    file.mtime = mtime;
+    file.size = size;
+    file.line_starts = std::move(line_starts);
+    if (file.line_starts.empty()) file.line_starts.push_back(0);
+    files_.push_back(std::move(file));
+    return static_cast<uint32_t>(files_.size() - 1);
+}
+
+void PersistentIndex::Writer::add_postings(std::string_view word, const IndexPosting* postings, size_t count) {
+    if (count == 0) return;
+    auto it = words_.find(word);
+    if (it == words_.end()) it = words_.emplace(std::string(word), std::vector<IndexPosting>()).first;
+    it->second.insert(it->second.end(), postings, postings + count);
+}
+
+void PersistentIndex::Writer::add_trigram(uint32_t trigram, uint32_t file_id) {
+    trigrams_[trigram].push_back(file_id);
+}
+
+bool PersistentIndex::Writer::write(const std::string& path) const {
+    std::string out(sizeof(Header), '\0');
+
+    // Blobs first, remembering where each landed
+    std::vector<FileRecord> files;
+    files.reserve(files_.size());
+    for (const File& file : files_) {
+        FileRecord record{};
+        record.path_offset = out.size();
+        record.path_length = static_cast<uint32_t>(file.path.size());
+        append(out, file.path.data(), file.path.size());
+        align8(out);
+        record.line_count = static_cast<uint32_t>(file.line_starts.size() - 1);
+        record.lines_offset = out.size();
+        append(out, file.line_starts.data(), file.line_starts.size() * sizeof(uint64_t));
+        record.mtime = file.mtime;
+        record.size = file.size;
+        files.push_back(record);
+    }
+
+    std::vector<WordRecord> words;
+    words.reserve(words_.size());
+    for (const auto& [word, postings] : words_) {
+        WordRecord record{};
+        record.word_offset = out.size();
+        record.word_length = static_cast<uint32_t>(word.size());
+        append(out, word.data(), word.size());
+        align8(out);
+        record.posting_count = static_cast<uint32_t>(postings.size());
+        record.postings_offset = out.size();
+        append(out, postings.data(), postings.size() * sizeof(IndexPosting));
+        align8(out);
+        words.push_back(record);
+    }
+
+    std::vector<TrigramRecord> trigrams;
+    trigrams.reserve(trigrams_.size());
+    std::vector<uint32_t> ids;
+    for (const auto& [trigram, file_ids] : trigrams_) {
+        ids = file_ids;
+        std::sort(ids.begin(), ids.end());
+        ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+        TrigramRecord record{};
+        record.trigram = trigram;
+        record.file_count = static_cast<uint32_t>(ids.size());
+        record.files_offset = out.size();
+        append(out, ids.data(), ids.size() * sizeof(uint32_t));
+        align8(out);
+        trigrams.push_back(record);
+    }
+
+    // Then the record tables and the header
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.byte_order = kByteOrder;
+    header.file_count = files.size();
+    header.word_count = words.size();
+    header.trigram_count = trigrams.size();
+    header.files_offset = out.size();
+    append(out, files.data(), files.size() * sizeof(FileRecord));
+    header.words_offset = out.size();
+    append(out, words.data(), words.size() * sizeof(WordRecord));
+    header.trigrams_offset = out.size();
+    append(out, trigrams.data(), trigrams.size() * sizeof(TrigramRecord));
+    header.total_size = out.size();
+    std::memcpy(&out[0], &header, sizeof(header));
+
+    std::string temp_path = path + ".tmp";
+    {
+        std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+        if (!file.write(out.data(), static_cast<std::streamsize>(out.size()))) return false;
+    }
+    return editor::PlatformFile::move_file(temp_path, path);
+}
@@ -1,242 +1,1503 @@
 #include "piece_table.h"
+#include "text_scan.h"
+#include "platform_file.h"
+#include "trace.h"
 #include <algorithm>
-#include <sstream>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
-PieceTable::PieceTable() : line_cache_valid_(false) {}
+/**
+ * LineIndexJob - worker that scans a mapped original buffer for newlines
+ *
+ * The worker only reads the (immutable) mapping and hands finished chunks
+ * over under the mutex; the table itself is never touched off the UI thread.
+ */
+struct PieceTable::LineIndexJob {
+    std::shared_ptr<editor::MappedFile> mapping;
+    std::thread worker;
+    std::mutex mutex;
+    std::vector<std::vector<size_t>> ready;    // Finished chunks, in file order
+    size_t ready_end = 0;                       // Bytes covered by ready chunks
+    std::atomic<bool> stop{false};
+    
+    void run(size_t from) {
+        const char* data = mapping->data();
+        size_t size = mapping->size();
+        for (size_t offset = from; offset < size && !stop; offset += kIndexChunk) {
+            size_t length = (std::min)(kIndexChunk, size - offset);
+            std::vector<size_t> chunk;
+            TextScan::find_newlines(data + offset, length, offset, chunk);
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.push_back(std::move(chunk));
+            ready_end = offset + length;
+        }
+    }
+};
+
+PieceTable::PieceTable()
+    : nil_storage_(Piece(Piece::Source::ADD, 0, 0), 0, nullptr)
+    , nil_(&nil_storage_)
+    , root_(&nil_storage_)
+    , original_data_("")
+    , original_size_(0)
+    , original_newlines_(std::make_shared<std::vector<size_t>>())
+    , original_indexed_(0)
+    , index_frontier_(0) {
+    nil_->left = nil_->right = nil_->parent = nil_;
+    nil_->red = false;
+}
 
 PieceTable::PieceTable(const std::string& initial_text)
-    : original_buffer_(initial_text), line_cache_valid_(false) {
-    if (!initial_text.empty()) {
-        pieces_.emplace_back(Piece::Source::ORIGINAL, 0, initial_text.length());
+    : PieceTable() {
+    original_storage_ = std::make_shared<const std::string>(initial_text);
+    init_original(original_storage_->data(), original_storage_->size());
+}
+
+PieceTable::PieceTable(std::shared_ptr<editor::MappedFile> mapping, LineIndexing indexing)
+    : PieceTable() {
+    if (!mapping) return;
+    original_mapping_ = std::move(mapping);
+    if (indexing == LineIndexing::Background && original_mapping_->size() > kIndexChunk) {
+        // Index the first chunk now so the first screen and the line count
+        // estimate are available immediately; the rest follows in the background
+        original_data_ = original_mapping_->data();
+        original_size_ = original_mapping_->size();
+        index_newlines(original_data_, kIndexChunk, 0, *original_newlines_);
+        original_indexed_ = kIndexChunk;
+        Piece piece(Piece::Source::ORIGINAL, 0, original_size_);
+        root_ = node_pool_.create(piece, original_newlines_->size(), nil_);
+        root_->red = false;
+        index_frontier_ = original_indexed_;
+        
+        index_job_.reset(new LineIndexJob());
+        index_job_->mapping = original_mapping_;
+        LineIndexJob* job = index_job_.get();
+        job->worker = std::thread([job]() { job->run(kIndexChunk); });
+        return;
     }
+    init_original(original_mapping_->data(), original_mapping_->size());
 }
 
-void PieceTable::insert(size_t position, const std::string& text) {
-    if (text.empty()) return;
-    line_cache_valid_ = false;
-    // Store undo action
-    undo_history_.push_back({EditType::Insert, position, text});
-    if (undo_history_.size() > kMaxHistory) undo_history_.erase(undo_history_.begin());
-    redo_history_.clear();
+void PieceTable::init_original(const char* data, size_t size) {
+    original_data_ = data;
+    original_size_ = size;
+    original_newlines_->reserve(TextScan::count_newlines(data, size));
+    index_newlines(data, size, 0, *original_newlines_);
+    original_indexed_ = size;
+    if (size > 0) {
+        Piece piece(Piece::Source::ORIGINAL, 0, size);
+        root_ = node_pool_.create(piece, original_newlines_->size(), nil_);
+        root_->red = false;
+    }
+}
+
+void PieceTable::release_mapping() {
+    if (!original_mapping_) return;
+    // The worker reads the mapping, so it has to be done before the file changes
+    finish_line_index();
+    // Offsets and the newline index stay valid - only the backing storage moves
+    original_storage_ = std::make_shared<const std::string>(original_data_, original_size_);
+    original_data_ = original_storage_->data();
+    original_mapping_.reset();
+}
+
+PieceTable::~PieceTable() {
+    if (index_job_) {
+        index_job_->stop = true;
+        index_job_->worker.join();
+    }
+    // Nodes live in node_pool_, which frees them all at once
+}
+
+// ============================================================================
+// Background line indexing
+// ============================================================================
+
+bool PieceTable::poll_line_index() {
+    if (!index_job_) return false;
+    std::vector<std::vector<size_t>> ready;
+    size_t ready_end = 0;
+    {
+        std::lock_guard<std::mutex> lock(index_job_->mutex);
+        ready.swap(index_job_->ready);
+        ready_end = index_job_->ready_end;
+    }
+    if (ready.empty()) return false;
     
-    // Find the piece containing the position
-    size_t current_pos = 0;
-    for (size_t i = 0; i < pieces_.size(); ++i) {
-        size_t piece_end = current_pos + pieces_[i].length;
-        
-        if (position >= current_pos && position <= piece_end) {
-            // Split the piece at the insertion point
-            size_t offset_in_piece = position - current_pos;
-            
-            // Add new text to add buffer
-            size_t add_offset = add_buffer_.length();
-            add_buffer_ += text;
-            
-            // Create new pieces
-            std::vector<Piece> new_pieces;
-            
-            // Keep pieces before insertion point
-            for (size_t j = 0; j < i; ++j) {
-                new_pieces.push_back(pieces_[j]);
+    for (const auto& chunk : ready) {
+        original_newlines_->insert(original_newlines_->end(), chunk.begin(), chunk.end());
+    }
+    original_indexed_ = ready_end;
+    refresh_original_metrics();
+    
+    if (original_indexed_ >= original_size_) {
+        index_job_->worker.join();
+        index_job_.reset();
+        index_frontier_ = get_total_length();
+    }
+    return true;
+}
+
+void PieceTable::finish_line_index() {
+    if (!index_job_) return;
+    index_job_->worker.join();
+    std::vector<std::vector<size_t>> ready;
+    ready.swap(index_job_->ready);
+    for (const auto& chunk : ready) {
+        original_newlines_->insert(original_newlines_->end(), chunk.begin(), chunk.end());
+    }
+    original_indexed_ = original_size_;
+    refresh_original_metrics();
+    index_job_.reset();
+    index_frontier_ = get_total_length();
+}
+
+void PieceTable::refresh_original_metrics() {
+    // ORIGINAL pieces before the frontier are fully indexed (insert_span
+    // pulls it back over any that are not), so every piece that gained
+    // newlines lies at or after it
+    size_t node_start = 0;
+    PieceNode* node = find_node(index_frontier_, node_start);
+    size_t frontier = get_total_length();
+    bool frontier_found = false;
+    while (node != nil_) {
+        const Piece& piece = node->piece;
+        if (piece.source == Piece::Source::ORIGINAL) {
+            if (piece.offset >= original_indexed_) {
+                if (!frontier_found) frontier = node_start;
+                frontier_found = true;
+                break;
             }
-            
-            // Split current piece if needed
-            if (offset_in_piece > 0) {
-                new_pieces.emplace_back(pieces_[i].source, pieces_[i].offset, offset_in_piece);
+            size_t newlines = count_newlines(piece.source, piece.offset, piece.length);
+            if (newlines != node->newlines) {
+                node->newlines = newlines;
+                update_to_root(node);
             }
-            
-            // Insert new text
-            new_pieces.emplace_back(Piece::Source::ADD, add_offset, text.length());
-            
-            // Add remaining part of split piece
-            if (offset_in_piece < pieces_[i].length) {
-                new_pieces.emplace_back(pieces_[i].source, 
-                                       pieces_[i].offset + offset_in_piece, 
-                                       pieces_[i].length - offset_in_piece);
+            if (!frontier_found && piece.offset + piece.length > original_indexed_) {
+                frontier = node_start + (original_indexed_ - piece.offset);
+                frontier_found = true;
             }
-            
-            // Add remaining pieces
-            for (size_t j = i + 1; j < pieces_.size(); ++j) {
-                new_pieces.push_back(pieces_[j]);
+        }
+        node_start += piece.length;
+        node = next_node(node);
+    }
+    index_frontier_ = frontier;
+}
+
+double PieceTable::get_index_progress() const {
+    if (!index_job_ || original_size_ == 0) return 1.0;
+    return static_cast<double>(original_indexed_) / static_cast<double>(original_size_);
+}
+
+size_t PieceTable::get_indexed_line_count() const {
+    if (!index_job_) return get_line_count();
+    // Lines terminated before the frontier are complete
+    return newlines_before(index_frontier_);
+}
+
+// ============================================================================
+// Piece metrics
+// ============================================================================
+
+void PieceTable::index_newlines(const char* data, size_t size, size_t from, std::vector<size_t>& out) {
+    TextScan::find_newlines(data + from, size - from, from, out);
+}
+
+size_t PieceTable::count_newlines(Piece::Source source, size_t offset, size_t length) const {
+    // Binary search in the buffer's newline index instead of scanning bytes
+    const std::vector<size_t>& newlines = newlines_for(source);
+    auto first = std::lower_bound(newlines.begin(), newlines.end(), offset);
+    auto last = std::lower_bound(first, newlines.end(), offset + length);
+    return static_cast<size_t>(last - first);
+}
+
+size_t PieceTable::nth_newline(const Piece& piece, size_t n) const {
+    // Offset (relative to the piece) of the n-th newline inside it, 1-based
+    const std::vector<size_t>& newlines = newlines_for(piece.source);
+    auto first = std::lower_bound(newlines.begin(), newlines.end(), piece.offset);
+    return *(first + (n - 1)) - piece.offset;
+}
+
+char PieceTable::char_at(size_t position) const {
+    size_t node_start = 0;
+    PieceNode* node = find_node(position, node_start);
+    if (node == nil_) return '\0';
+    return *piece_data(node->piece.source, node->piece.offset + (position - node_start));
+}
+
+size_t PieceTable::chunk_index(size_t offset) const {
+    auto it = std::upper_bound(add_chunks_.begin(), add_chunks_.end(), offset,
+                               [](size_t value, const AddChunk& chunk) { return value < chunk.base; });
+    return static_cast<size_t>(it - add_chunks_.begin()) - 1;
+}
+
+const char* PieceTable::add_data(size_t offset) const {
+    // Nearly all reads are of recent text, so try the newest chunk first
+    const AddChunk& last = add_chunks_.back();
+    if (offset >= last.base) return last.data.get() + (offset - last.base);
+    auto it = std::upper_bound(add_chunks_.begin(), add_chunks_.end(), offset,
+                               [](size_t value, const AddChunk& chunk) { return value < chunk.base; });
+    --it;
+    return it->data.get() + (offset - it->base);
+}
+
+PieceTable::MemoryUsage PieceTable::get_memory_usage() const {
+    MemoryUsage usage;
+    if (original_mapping_) {
+        usage.mapped = original_size_;
+    } else if (original_storage_) {
+        usage.original = original_storage_->capacity();
+    }
+    for (const AddChunk& chunk : add_chunks_) {
+        if (chunk.data) (chunk.shared ? usage.shared : usage.add_buffer) += chunk.capacity;
+    }
+    usage.line_index = add_newlines_.capacity() * sizeof(size_t);
+    if (original_newlines_) usage.line_index += original_newlines_->capacity() * sizeof(size_t);
+    usage.piece_tree = node_pool_.reserved_bytes();
+    usage.undo_history = get_history_bytes();
+    if (spill_) usage.spilled = static_cast<size_t>(spill_->file_bytes());
+    return usage;
+}
+
+size_t PieceTable::append_add(const char* text, size_t length) {
+    if (add_chunks_.empty() || add_chunks_.back().capacity - add_chunks_.back().size < length) {
+        // Text larger than a chunk gets a chunk of its own
+        size_t base = add_chunks_.empty() ? 0 : add_chunks_.back().base + add_chunks_.back().capacity + 1;
+        size_t capacity = (std::max)(kAddChunk, length);
+        add_chunks_.push_back({std::shared_ptr<char>(new char[capacity], std::default_delete<char[]>()),
+                               base, capacity, 0, false, false, {}});
+        add_resident_ += capacity;
+    }
+    AddChunk& chunk = add_chunks_.back();
+    if (length > 0) std::memcpy(chunk.data.get() + chunk.size, text, length);
+    size_t offset = chunk.base + chunk.size;
+    chunk.size += length;
+    TextScan::find_newlines(text, length, offset, add_newlines_);
+    return offset;
+}
+
+void PieceTable::update_metrics(PieceNode* node) {
+    node->subtree_length = node->left->subtree_length + node->piece.length + node->right->subtree_length;
+    node->subtree_newlines = node->left->subtree_newlines + node->newlines + node->right->subtree_newlines;
+}
+
+void PieceTable::update_to_root(PieceNode* node) {
+    while (node != nil_) {
+        update_metrics(node);
+        node = node->parent;
+    }
+}
+
+void PieceTable::resize_node(PieceNode* node, size_t offset, size_t length, size_t newlines) {
+    node->piece.offset = offset;
+    node->piece.length = length;
+    node->newlines = newlines;
+    update_to_root(node);
+}
+
+// ============================================================================
+// Tree navigation
+// ============================================================================
+
+PieceTable::PieceNode* PieceTable::find_node(size_t position, size_t& node_start) const {
+    // Returns the node whose range [node_start, node_start + length) contains position
+    PieceNode* node = root_;
+    node_start = 0;
+    while (node != nil_) {
+        size_t left_len = node->left->subtree_length;
+        if (position < left_len) {
+            node = node->left;
+        } else if (position < left_len + node->piece.length) {
+            node_start += left_len;
+            return node;
+        } else {
+            position -= left_len + node->piece.length;
+            node_start += left_len + node->piece.length;
+            node = node->right;
+        }
+    }
+    return nil_;
+}
+
+PieceTable::PieceNode* PieceTable::first_node() const {
+    PieceNode* node = root_;
+    if (node == nil_) return nil_;
+    while (node->left != nil_) node = node->left;
+    return node;
+}
+
+PieceTable::PieceNode* PieceTable::last_node() const {
+    PieceNode* node = root_;
+    if (node == nil_) return nil_;
+    while (node->right != nil_) node = node->right;
+    return node;
+}
+
+PieceTable::PieceNode* PieceTable::next_node(PieceNode* node) const {
+    if (node->right != nil_) {
+        node = node->right;
+        while (node->left != nil_) node = node->left;
+        return node;
+    }
+    PieceNode* parent = node->parent;
+    while (parent != nil_ && node == parent->right) {
+        node = parent;
+        parent = parent->parent;
+    }
+    return parent;
+}
+
+PieceTable::PieceNode* PieceTable::prev_node(PieceNode* node) const {
+    if (node->left != nil_) {
+        node = node->left;
+        while (node->right != nil_) node = node->right;
+        return node;
+    }
+    PieceNode* parent = node->parent;
+    while (parent != nil_ && node == parent->left) {
+        node = parent;
+        parent = parent->parent;
+    }
+    return parent;
+}
+
+size_t PieceTable::line_start_offset(size_t line) const {
+    // Offset just past the line-th newline (line 0 starts at offset 0)
+    if (line == 0) return 0;
+    PieceNode* node = root_;
+    size_t base = 0;
+    while (node != nil_) {
+        if (line <= node->left->subtree_newlines) {
+            node = node->left;
+            continue;
+        }
+        line -= node->left->subtree_newlines;
+        base += node->left->subtree_length;
+        if (line <= node->newlines) {
+            // The wanted newline lies inside this piece
+            return base + nth_newline(node->piece, line) + 1;
+        }
+        line -= node->newlines;
+        base += node->piece.length;
+        node = node->right;
+    }
+    return root_->subtree_length;
+}
+
+size_t PieceTable::newlines_before(size_t position) const {
+    // Number of '\n' bytes in [0, position)
+    size_t count = 0;
+    PieceNode* node = root_;
+    while (node != nil_) {
+        size_t left_len = node->left->subtree_length;
+        if (position < left_len) {
+            node = node->left;
+            continue;
+        }
+        count += node->left->subtree_newlines;
+        position -= left_len;
+        if (position < node->piece.length) {
+            return count + count_newlines(node->piece.source, node->piece.offset, position);
+        }
+        count += node->newlines;
+        position -= node->piece.length;
+        node = node->right;
+    }
+    return count;
+}
+
+// ============================================================================
+// Red-black tree maintenance
+// ============================================================================
+
+void PieceTable::rotate_left(PieceNode* x) {
+    PieceNode* y = x->right;
+    x->right = y->left;
+    if (y->left != nil_) y->left->parent = x;
+    y->parent = x->parent;
+    if (x->parent == nil_) {
+        root_ = y;
+    } else if (x == x->parent->left) {
+        x->parent->left = y;
+    } else {
+        x->parent->right = y;
+    }
+    y->left = x;
+    x->parent = y;
+    update_metrics(x);
+    update_metrics(y);
+}
+
+void PieceTable::rotate_right(PieceNode* x) {
+    PieceNode* y = x->left;
+    x->left = y->right;
+    if (y->right != nil_) y->right->parent = x;
+    y->parent = x->parent;
+    if (x->parent == nil_) {
+        root_ = y;
+    } else if (x == x->parent->right) {
+        x->parent->right = y;
+    } else {
+        x->parent->left = y;
+    }
+    y->right = x;
+    x->parent = y;
+    update_metrics(x);
+    update_metrics(y);
+}
+
+void PieceTable::attach(PieceNode* parent, PieceNode* child, bool as_left) {
+    child->parent = parent;
+    if (parent == nil_) {
+        root_ = child;
+    } else if (as_left) {
+        parent->left = child;
+    } else {
+        parent->right = child;
+    }
+    update_to_root(parent);
+    insert_fixup(child);
+}
+
+PieceTable::PieceNode* PieceTable::insert_before(PieceNode* node, const Piece& piece, size_t newlines) {
+    PieceNode* created = node_pool_.create(piece, newlines, nil_);
+    if (node == nil_) {
+        // Inserting before "end" means appending after the last piece
+        PieceNode* last = last_node();
+        attach(last, created, false);
+    } else if (node->left == nil_) {
+        attach(node, created, true);
+    } else {
+        PieceNode* pred = node->left;
+        while (pred->right != nil_) pred = pred->right;
+        attach(pred, created, false);
+    }
+    return created;
+}
+
+PieceTable::PieceNode* PieceTable::insert_after(PieceNode* node, const Piece& piece, size_t newlines) {
+    PieceNode* created = node_pool_.create(piece, newlines, nil_);
+    if (node->right == nil_) {
+        attach(node, created, false);
+    } else {
+        PieceNode* succ = node->right;
+        while (succ->left != nil_) succ = succ->left;
+        attach(succ, created, true);
+    }
+    return created;
+}
+
+void PieceTable::insert_fixup(PieceNode* z) {
+    while (z->parent->red) {
+        PieceNode* grand = z->parent->parent;
+        if (z->parent == grand->left) {
+            PieceNode* uncle = grand->right;
+            if (uncle->red) {
+                z->parent->red = false;
+                uncle->red = false;
+                grand->red = true;
+                z = grand;
+            } else {
+                if (z == z->parent->right) {
+                    z = z->parent;
+                    rotate_left(z);
+                }
+                z->parent->red = false;
+                z->parent->parent->red = true;
+                rotate_right(z->parent->parent);
+            }
+        } else {
+            PieceNode* uncle = grand->left;
+            if (uncle->red) {
+                z->parent->red = false;
+                uncle->red = false;
+                grand->red = true;
+                z = grand;
+            } else {
+                if (z == z->parent->left) {
+                    z = z->parent;
+                    rotate_right(z);
+                }
+                z->parent->red = false;
+                z->parent->parent->red = true;
+                rotate_left(z->parent->parent);
             }
-            
-            pieces_ = std::move(new_pieces);
-            return;
         }
-        
-        current_pos = piece_end;
     }
-    
-    // If position is at the end, simply append
-    if (position == current_pos) {
-        size_t add_offset = add_buffer_.length();
-        add_buffer_ += text;
-        pieces_.emplace_back(Piece::Source::ADD, add_offset, text.length());
+    root_->red = false;
+}
+
+void PieceTable::transplant(PieceNode* u, PieceNode* v) {
+    if (u->parent == nil_) {
+        root_ = v;
+    } else if (u == u->parent->left) {
+        u->parent->left = v;
+    } else {
+        u->parent->right = v;
     }
+    v->parent = u->parent;
+}
+
+void PieceTable::erase_node(PieceNode* z) {
+    PieceNode* y = z;
+    PieceNode* x = nil_;
+    bool y_was_red = y->red;
+
+    if (z->left == nil_) {
+        x = z->right;
+        transplant(z, z->right);
+    } else if (z->right == nil_) {
+        x = z->left;
+        transplant(z, z->left);
+    } else {
+        y = z->right;
+        while (y->left != nil_) y = y->left;
+        y_was_red = y->red;
+        x = y->right;
+        if (y->parent == z) {
+            x->parent = y;
+        } else {
+            transplant(y, y->right);
+            y->right = z->right;
+            y->right->parent = y;
+        }
+        transplant(z, y);
+        y->left = z->left;
+        y->left->parent = y;
+        y->red = z->red;
+    }
+
+    // Every node whose subtree changed lies on the path from x upwards
+    update_to_root(x->parent);
+    if (!y_was_red) erase_fixup(x);
+
+    nil_->parent = nil_;
+    node_pool_.destroy(z);
+}
+
+void PieceTable::erase_fixup(PieceNode* x) {
+    while (x != root_ && !x->red) {
+        if (x == x->parent->left) {
+            PieceNode* w = x->parent->right;
+            if (w->red) {
+                w->red = false;
+                x->parent->red = true;
+                rotate_left(x->parent);
+                w = x->parent->right;
+            }
+            if (!w->left->red && !w->right->red) {
+                w->red = true;
+                x = x->parent;
+            } else {
+                if (!w->right->red) {
+                    w->left->red = false;
+                    w->red = true;
+                    rotate_right(w);
+                    w = x->parent->right;
+                }
+                w->red = x->parent->red;
+                x->parent->red = false;
+                w->right->red = false;
+                rotate_left(x->parent);
+                x = root_;
+            }
+        } else {
+            PieceNode* w = x->parent->left;
+            if (w->red) {
+                w->red = false;
+                x->parent->red = true;
+                rotate_right(x->parent);
+                w = x->parent->left;
+            }
+            if (!w->right->red && !w->left->red) {
+                w->red = true;
+                x = x->parent;
+            } else {
+                if (!w->left->red) {
+                    w->right->red = false;
+                    w->red = true;
+                    rotate_left(w);
+                    w = x->parent->left;
+                }
+                w->red = x->parent->red;
+                x->parent->red = false;
+                w->left->red = false;
+                rotate_right(x->parent);
+                x = root_;
+            }
+        }
+    }
+    x->red = false;
+}
+
+// ============================================================================
+// Editing
+// ============================================================================
+
+void PieceTable::insert(size_t position, const std::string& text) {
+    if (text.empty() || position > get_total_length()) return;
+    EDITOR_TRACE_SCOPE("buffer", "PieceTable::insert");
+
+    // Add new text to add buffer
+    size_t add_offset = append_add(text);
+    Span span;
+    span.pieces.push_back(Piece(Piece::Source::ADD, add_offset, text.length()));
+    span.length = text.length();
+    span.newlines = count_newlines(Piece::Source::ADD, add_offset, text.length());
+    insert_span(position, span);
+}
+
+void PieceTable::append_external(const std::string& text) {
+    if (text.empty()) return;
+    undo_group_open_ = false;
+    bool replaying = replaying_;
+    replaying_ = true;
+    insert(get_total_length(), text);
+    replaying_ = replaying;
+}
+
+void PieceTable::insert_span(size_t position, const Span& span) {
+    if (span.length == 0 || position > get_total_length()) return;
+    // A span from history or the clipboard may be in chunks paged out since
+    if (!page_in(span)) return;
+    if (index_job_ && position <= index_frontier_) {
+        // Not-yet-indexed file text (a cut pasted back) breaks the file
+        // order refresh_original_metrics relies on: recount from here
+        bool unindexed = false;
+        for (const Piece& piece : span.pieces) {
+            if (piece.source == Piece::Source::ORIGINAL && piece.offset + piece.length > original_indexed_) {
+                unindexed = true;
+            }
+        }
+        index_frontier_ = unindexed ? position : index_frontier_ + span.length;
+    }
+    record_edit(EditType::Insert, position, span);
+    ++version_;
+
+    size_t first_line = change_listeners_.empty() ? 0 : newlines_before(position);
+    size_t newlines = 0;
+    size_t node_start = 0;
+    PieceNode* node = find_node(position, node_start);
+    size_t next_piece = 0;
+
+    if (node == nil_ || position == node_start) {
+        // Boundary insert: extend the preceding piece when the first new piece
+        // continues it in the same buffer (the common "typing" case)
+        PieceNode* prev = (node == nil_) ? last_node() : prev_node(node);
+        const Piece& first = span.pieces.front();
+        if (prev != nil_ && prev->piece.source == first.source &&
+            prev->piece.offset + prev->piece.length == first.offset) {
+            size_t piece_newlines = count_newlines(first.source, first.offset, first.length);
+            resize_node(prev, prev->piece.offset, prev->piece.length + first.length,
+                        prev->newlines + piece_newlines);
+            newlines += piece_newlines;
+            next_piece = 1;
+        }
+    } else {
+        // Split the piece at the insertion point; new pieces go before the tail
+        size_t offset_in_piece = position - node_start;
+        Piece tail(node->piece.source, node->piece.offset + offset_in_piece,
+                   node->piece.length - offset_in_piece);
+        size_t head_newlines = count_newlines(node->piece.source, node->piece.offset, offset_in_piece);
+        size_t tail_newlines = node->newlines - head_newlines;
+
+        resize_node(node, node->piece.offset, offset_in_piece, head_newlines);
+        node = insert_after(node, tail, tail_newlines);
+    }
+
+    for (; next_piece < span.pieces.size(); ++next_piece) {
+        const Piece& piece = span.pieces[next_piece];
+        size_t piece_newlines = count_newlines(piece.source, piece.offset, piece.length);
+        insert_before(node, piece, piece_newlines);
+        newlines += piece_newlines;
+    }
+
+    if (!change_listeners_.empty()) {
+        size_t column = position - line_start_offset(first_line);
+        notify_change({position, 0, span.length, first_line, 0, newlines, column, column});
+    }
+    if (!replaying_) spill_cold_chunks();
 }
 
 void PieceTable::remove(size_t position, size_t length) {
-    if (length == 0) return;
-    line_cache_valid_ = false;
-    // Store undo action (save removed text)
-    std::string removed = get_text(position, length);
-    undo_history_.push_back({EditType::Remove, position, removed});
-    if (undo_history_.size() > kMaxHistory) undo_history_.erase(undo_history_.begin());
-    redo_history_.clear();
-    
+    size_t total = get_total_length();
+    if (length == 0 || position >= total) return;
+    EDITOR_TRACE_SCOPE("buffer", "PieceTable::remove");
+    length = (std::min)(length, total - position);
+    if (index_job_) {
+        if (position + length <= index_frontier_) index_frontier_ -= length;
+        else if (position < index_frontier_) index_frontier_ = position;
+    }
+    // Undo keeps the removed pieces, not a copy of their text
+    Span removed = get_span(position, length);
+    size_t first_line = 0, column = 0, old_end_column = 0;
+    if (!change_listeners_.empty()) {
+        first_line = newlines_before(position);
+        column = position - line_start_offset(first_line);
+        old_end_column = position + length - line_start_offset(newlines_before(position + length));
+    }
+    record_edit(EditType::Remove, position, removed);
+    ++version_;
+
     size_t end_position = position + length;
-    size_t current_pos = 0;
-    std::vector<Piece> new_pieces;
-    for (const auto& piece : pieces_) {
-        size_t piece_end = current_pos + piece.length;
-        // Piece is completely before deletion range
-        if (piece_end <= position) {
-            new_pieces.push_back(piece);
-        }
-        // Piece is completely after deletion range
-        else if (current_pos >= end_position) {
-            new_pieces.push_back(piece);
-        }
-        // Piece overlaps with deletion range
-        else {
+    size_t node_start = 0;
+    PieceNode* node = find_node(position, node_start);
+
+    while (node != nil_ && node_start < end_position) {
+        PieceNode* next = next_node(node);
+        const Piece piece = node->piece;
+        size_t piece_end = node_start + piece.length;
+
+        if (position <= node_start && piece_end <= end_position) {
+            // Piece is completely inside deletion range
+            erase_node(node);
+        } else if (node_start < position && end_position < piece_end) {
+            // Deletion range is strictly inside this piece - split it
+            size_t keep_head = position - node_start;
+            size_t skip = end_position - node_start;
+            Piece tail(piece.source, piece.offset + skip, piece.length - skip);
+            size_t head_newlines = count_newlines(piece.source, piece.offset, keep_head);
+            size_t removed_newlines = count_newlines(piece.source, piece.offset + keep_head, skip - keep_head);
+            size_t tail_newlines = node->newlines - head_newlines - removed_newlines;
+            resize_node(node, piece.offset, keep_head, head_newlines);
+            insert_after(node, tail, tail_newlines);
+            break;
+        } else if (node_start < position) {
             // Keep part before deletion
-            if (current_pos < position) {
-                size_t keep_length = position - current_pos;
-                new_pieces.emplace_back(piece.source, piece.offset, keep_length);
-            }
+            size_t keep = position - node_start;
+            size_t cut_newlines = count_newlines(piece.source, piece.offset + keep, piece.length - keep);
+            resize_node(node, piece.offset, keep, node->newlines - cut_newlines);
+        } else {
             // Keep part after deletion
-            if (piece_end > end_position) {
-                size_t skip_length = end_position - current_pos;
-                size_t keep_length = piece_end - end_position;
-                new_pieces.emplace_back(piece.source, piece.offset + skip_length, keep_length);
-            }
+            size_t skip = end_position - node_start;
+            size_t cut_newlines = count_newlines(piece.source, piece.offset, skip);
+            resize_node(node, piece.offset + skip, piece.length - skip, node->newlines - cut_newlines);
         }
-        current_pos = piece_end;
+
+        node_start = piece_end;
+        node = next;
     }
-    pieces_ = std::move(new_pieces);
-}
 
-std::string PieceTable::get_text(size_t start, size_t length) const {
-    std::string result;
-    result.reserve(length);
-    size_t current_pos = 0;
-    size_t remaining = length;
-    for (const auto& piece : pieces_) {
-        if (remaining == 0) break;
-        size_t piece_end = current_pos + piece.length;
-        if (piece_end > start && current_pos < start + length) {
-            size_t offset_in_piece = (start > current_pos) ? (start - current_pos) : 0;
-            size_t copy_length = std::min(piece.length - offset_in_piece, remaining);
-            const std::string& source = (piece.source == Piece::Source::ORIGINAL)
-                                       ? original_buffer_ : add_buffer_;
-            // Käytetään appendia substrin sijaan
-            result.append(source, piece.offset + offset_in_piece, copy_length);
-            remaining -= copy_length;
-        }
-        current_pos = piece_end;
+    if (!change_listeners_.empty()) {
+        notify_change({position, length, 0, first_line, removed.newlines, 0, column, old_end_column, &removed});
     }
-    return result;
+    if (!replaying_) spill_cold_chunks();
 }
 
-void PieceTable::rebuild_line_cache() const {
-    line_cache_.clear();
-    line_cache_.push_back(0);
+bool PieceTable::apply_edits(const std::vector<Edit>& edits) {
+    EDITOR_TRACE_SCOPE("buffer", "PieceTable::apply_edits");
+    size_t total = get_total_length();
+    size_t previous_end = 0;
+    size_t inserted = 0;
+    for (const Edit& edit : edits) {
+        if (edit.position < previous_end || edit.position > total || edit.length > total - edit.position) {
+            return false;
+        }
+        previous_end = edit.position + edit.length;
+        inserted += edit.text.size();
+    }
+    if (edits.empty()) return true;
     
-    size_t pos = 0;
-    for (const auto& piece : pieces_) {
-        const std::string& source = (piece.source == Piece::Source::ORIGINAL) 
-                                   ? original_buffer_ : add_buffer_;
-        
-        for (size_t i = piece.offset; i < piece.offset + piece.length; ++i) {
-            pos++;
-            if (source[i] == '\n') {
-                line_cache_.push_back(pos);
-            }
+    // One add-buffer append (in a single chunk) for every edit's text
+    size_t add_offset = 0;
+    if (inserted > 0) {
+        std::string joined;
+        joined.reserve(inserted);
+        for (const Edit& edit : edits) joined += edit.text;
+        add_offset = append_add(joined);
+    }
+    
+    // Back to front, so the offsets of the edits still to come hold
+    begin_transaction();
+    size_t text_end = add_offset + inserted;
+    for (auto it = edits.rbegin(); it != edits.rend(); ++it) {
+        if (it->length > 0) remove(it->position, it->length);
+        if (it->text.empty()) continue;
+        text_end -= it->text.size();
+        Span span;
+        span.pieces.push_back(Piece(Piece::Source::ADD, text_end, it->text.size()));
+        span.length = it->text.size();
+        span.newlines = count_newlines(Piece::Source::ADD, text_end, it->text.size());
+        insert_span(it->position, span);
+    }
+    commit_transaction();
+    return true;
+}
+
+void PieceTable::map_offsets(const std::vector<Edit>& edits, size_t* offsets, size_t count) {
+    if (edits.empty()) return;
+    // shift[i]: how far edit i's start moves, from the edits before it
+    std::vector<ptrdiff_t> shift(edits.size());
+    ptrdiff_t delta = 0;
+    for (size_t i = 0; i < edits.size(); ++i) {
+        shift[i] = delta;
+        delta += static_cast<ptrdiff_t>(edits[i].text.size()) - static_cast<ptrdiff_t>(edits[i].length);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        size_t offset = offsets[i];
+        // The last edit starting at or before the offset
+        auto after = std::upper_bound(edits.begin(), edits.end(), offset,
+                                      [](size_t value, const Edit& edit) { return value < edit.position; });
+        if (after == edits.begin()) continue;
+        size_t index = static_cast<size_t>(after - edits.begin()) - 1;
+        const Edit& edit = edits[index];
+        size_t moved_start = static_cast<size_t>(static_cast<ptrdiff_t>(edit.position) + shift[index]);
+        if (offset >= edit.position + edit.length) {
+            ptrdiff_t own = static_cast<ptrdiff_t>(edit.text.size()) - static_cast<ptrdiff_t>(edit.length);
+            offsets[i] = static_cast<size_t>(static_cast<ptrdiff_t>(offset) + shift[index] + own);
+        } else {
+            offsets[i] = moved_start + edit.text.size();
+        }
+    }
+}
+
+// ============================================================================
+// Change listeners
+// ============================================================================
+
+size_t PieceTable::add_change_listener(ChangeListener listener) {
+    size_t id = next_listener_id_++;
+    change_listeners_.emplace_back(id, std::move(listener));
+    return id;
+}
+
+void PieceTable::remove_change_listener(size_t id) {
+    change_listeners_.erase(std::remove_if(change_listeners_.begin(), change_listeners_.end(),
+                                           [id](const auto& entry) { return entry.first == id; }),
+                            change_listeners_.end());
+}
+
+void PieceTable::notify_change(const Change& change) {
+    for (const auto& entry : change_listeners_) {
+        entry.second(change);
+    }
+}
+
+// ============================================================================
+// Queries
+// ============================================================================
+
+void PieceTable::Span::append(const Span& other) {
+    for (const Piece& piece : other.pieces) {
+        if (!pieces.empty() && pieces.back().source == piece.source &&
+            pieces.back().offset + pieces.back().length == piece.offset) {
+            pieces.back().length += piece.length;
+        } else {
+            pieces.push_back(piece);
         }
     }
+    length += other.length;
+    newlines += other.newlines;
+}
+
+void PieceTable::Span::prepend(const Span& other) {
+    Span joined = other;
+    joined.append(*this);
+    *this = std::move(joined);
+}
+
+PieceTable::Span PieceTable::get_span(size_t start, size_t length) const {
+    Span span;
+    size_t total = get_total_length();
+    if (start >= total || length == 0) return span;
+    size_t remaining = (std::min)(length, total - start);
     
-    line_cache_valid_ = true;
+    size_t node_start = 0;
+    PieceNode* node = find_node(start, node_start);
+    size_t offset_in_piece = start - node_start;
+    while (node != nil_ && remaining > 0) {
+        size_t take = (std::min)(node->piece.length - offset_in_piece, remaining);
+        Piece piece(node->piece.source, node->piece.offset + offset_in_piece, take);
+        span.newlines += take == node->piece.length ? node->newlines
+                                                    : count_newlines(piece.source, piece.offset, take);
+        span.pieces.push_back(piece);
+        span.length += take;
+        remaining -= take;
+        offset_in_piece = 0;
+        node = next_node(node);
+    }
+    return span;
 }
 
-size_t PieceTable::get_line_count() const {
-    if (!line_cache_valid_) {
-        rebuild_line_cache();
+std::string PieceTable::get_span_text(const Span& span) const {
+    std::string result;
+    if (!page_in(span)) return result;
+    result.reserve(span.length);
+    for (const Piece& piece : span.pieces) {
+        result.append(piece_data(piece.source, piece.offset), piece.length);
     }
-    return line_cache_.size();
+    return result;
+}
+
+std::string PieceTable::get_text(size_t start, size_t length) const {
+    std::string result;
+    size_t total = get_total_length();
+    if (start >= total || length == 0) return result;
+    size_t remaining = (std::min)(length, total - start);
+    result.reserve(remaining);
+
+    for (ChunkIterator it = chunks(start, remaining); !it.done(); ++it) {
+        std::string_view chunk = *it;
+        result.append(chunk.data(), chunk.size());
+    }
+    return result;
+}
+
+size_t PieceTable::get_line_count() const {
+    size_t known = root_->subtree_newlines + 1;
+    if (!index_job_ || original_indexed_ == 0) return known;
+    // Extrapolate the unscanned tail from the newline density seen so far
+    double density = static_cast<double>(original_newlines_->size()) / static_cast<double>(original_indexed_);
+    return known + static_cast<size_t>(density * static_cast<double>(original_size_ - original_indexed_));
 }
 
 size_t PieceTable::get_total_length() const {
-    size_t total = 0;
-    for (const auto& piece : pieces_) {
-        total += piece.length;
+    return root_->subtree_length;
+}
+
+size_t PieceTable::get_line_start(size_t line_number) const {
+    if (line_number >= get_line_count()) return get_total_length();
+    return line_start_offset(line_number);
+}
+
+size_t PieceTable::get_line_at(size_t position) const {
+    return newlines_before((std::min)(position, get_total_length()));
+}
+
+PieceTable::LineColumn PieceTable::offset_to_line_col(size_t offset) const {
+    offset = (std::min)(offset, get_total_length());
+    size_t line = newlines_before(offset);
+    return {line, offset - line_start_offset(line)};
+}
+
+size_t PieceTable::line_col_to_offset(size_t line, size_t column) const {
+    if (line >= get_line_count()) return get_total_length();
+    size_t start = line_start_offset(line);
+    size_t end = get_total_length();
+    if (line + 1 < get_line_count()) {
+        end = line_start_offset(line + 1) - 1;
+        if (end > start && char_at(end - 1) == '\r') --end;
     }
-    return total;
+    return start + (std::min)(column, end - start);
 }
 
-std::string PieceTable::get_line(size_t line_number) const {
-    if (!line_cache_valid_) {
-        rebuild_line_cache();
+PieceTable::LineColumn PieceTable::offset_to_line_utf16(size_t offset) const {
+    LineColumn position = offset_to_line_col(offset);
+    std::string prefix = get_text(offset - position.column, position.column);
+    // One unit per code point, two for those outside the BMP (4-byte sequences)
+    size_t units = 0;
+    for (char c : prefix) {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if ((byte & 0xC0) != 0x80) units += byte >= 0xF0 ? 2 : 1;
     }
-    
-    if (line_number >= line_cache_.size()) {
+    return {position.line, units};
+}
+
+size_t PieceTable::line_utf16_to_offset(size_t line, size_t column) const {
+    size_t start = line_col_to_offset(line, 0);
+    size_t end = line_col_to_offset(line, SIZE_MAX);
+    std::string text = get_text(start, end - start);
+    size_t units = 0;
+    size_t i = 0;
+    while (i < text.size() && units < column) {
+        unsigned char byte = static_cast<unsigned char>(text[i]);
+        units += byte >= 0xF0 ? 2 : 1;
+        // Past the lead byte to the next code point
+        ++i;
+        while (i < text.size() && (static_cast<unsigned char>(text[i]) & 0xC0) == 0x80) ++i;
+    }
+    return start + i;
+}
+
+std::string PieceTable::get_line(size_t line_number) const {
+    if (line_number >= get_line_count()) {
         return "";
     }
-    
-    size_t start = line_cache_[line_number];
-    size_t end = (line_number + 1 < line_cache_.size()) 
-                 ? line_cache_[line_number + 1] - 1  // Exclude newline
-                 : get_total_length();
-    
-    if (end > start && get_text(end - 1, 1) == "\n") {
-        end--;
+    if (index_job_ && line_number >= get_indexed_line_count()) {
+        return "";  // Not reached by the background indexer yet
     }
-    
+
+    size_t start = line_start_offset(line_number);
+    size_t end = get_total_length();
+    if (line_number + 1 < get_line_count()) {
+        end = line_start_offset(line_number + 1) - 1;  // Exclude newline
+        if (end > start && char_at(end - 1) == '\r') --end;  // ...and CR of CRLF
+    }
+
     return get_text(start, end - start);
 }
 
 std::vector<std::string> PieceTable::get_lines_range(size_t start_line, size_t count) const {
     std::vector<std::string> lines;
-    lines.reserve(count);
-    
-    for (size_t i = start_line; i < start_line + count; ++i) {
-        std::string line = get_line(i);
-        if (line.empty() && i >= get_line_count()) {
-            break;
+    size_t line_count = get_line_count();
+    if (count == 0 || start_line >= line_count) {
+        return lines;
+    }
+    lines.reserve((std::min)(count, line_count - start_line));
+
+    // Walk the pieces once from the first requested line, splitting on newlines
+    LineCursor cursor = this->lines(start_line);
+    std::string_view line;
+    while (lines.size() < count && cursor.next(line)) {
+        lines.emplace_back(line);
+    }
+    return lines;
+}
+
+// ============================================================================
+// Zero-copy iteration
+// ============================================================================
+
+PieceTable::ChunkIterator::ChunkIterator(const PieceTable* table, const PieceNode* node, size_t offset_in_piece,
+                                         size_t position, size_t remaining)
+    : table_(table)
+    , node_(node)
+    , offset_in_piece_(offset_in_piece)
+    , position_(position)
+    , remaining_(remaining) {
+}
+
+std::string_view PieceTable::ChunkIterator::operator*() const {
+    const Piece& piece = node_->piece;
+    size_t length = (std::min)(piece.length - offset_in_piece_, remaining_);
+    return std::string_view(table_->piece_data(piece.source, piece.offset + offset_in_piece_), length);
+}
+
+PieceTable::ChunkIterator& PieceTable::ChunkIterator::operator++() {
+    size_t length = (std::min)(node_->piece.length - offset_in_piece_, remaining_);
+    position_ += length;
+    remaining_ -= length;
+    offset_in_piece_ = 0;
+    node_ = table_->next_node(const_cast<PieceNode*>(node_));
+    if (node_ == table_->nil_) remaining_ = 0;
+    return *this;
+}
+
+PieceTable::ChunkIterator PieceTable::chunks(size_t start, size_t length) const {
+    size_t total = get_total_length();
+    if (start >= total || length == 0) {
+        return ChunkIterator(this, nil_, 0, total, 0);
+    }
+    size_t node_start = 0;
+    PieceNode* node = find_node(start, node_start);
+    return ChunkIterator(this, node, start - node_start, start, (std::min)(length, total - start));
+}
+
+PieceTable::LineCursor::LineCursor(ChunkIterator chunks, size_t first_line, size_t start, bool empty)
+    : chunks_(chunks)
+    , line_number_(first_line)
+    , line_start_(start)
+    , next_start_(start)
+    , started_(false)
+    , finished_(empty) {
+}
+
+bool PieceTable::LineCursor::next(std::string_view& line) {
+    if (finished_) return false;
+    if (started_) ++line_number_;
+    started_ = true;
+    line_start_ = next_start_;
+
+    // pending is a view of the line so far while it lies in one piece;
+    // once the line crosses a piece boundary it is collected in scratch_
+    std::string_view pending;
+    bool assembling = false;
+    while (true) {
+        if (chunk_.empty()) {
+            if (chunks_.done()) {
+                // Final line (after the last newline) is always part of the document
+                finished_ = true;
+                line = assembling ? std::string_view(scratch_) : pending;
+                return true;
+            }
+            chunk_ = *chunks_;
+            ++chunks_;
+            continue;
+        }
+        const char* nl = static_cast<const char*>(std::memchr(chunk_.data(), '\n', chunk_.size()));
+        size_t take = nl ? static_cast<size_t>(nl - chunk_.data()) : chunk_.size();
+        std::string_view part = chunk_.substr(0, take);
+        if (assembling) {
+            scratch_.append(part.data(), part.size());
+        } else if (pending.empty()) {
+            pending = part;
+        } else if (!part.empty()) {
+            scratch_.assign(pending.data(), pending.size());
+            scratch_.append(part.data(), part.size());
+            assembling = true;
+        }
+        if (!nl) {
+            next_start_ += chunk_.size();
+            chunk_ = std::string_view();
+            continue;
+        }
+        chunk_.remove_prefix(take + 1);
+        next_start_ += take + 1;
+        line = assembling ? std::string_view(scratch_) : pending;
+        // CR of a CRLF may sit at the end of the previous piece
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        return true;
+    }
+}
+
+PieceTable::LineCursor PieceTable::lines(size_t start_line) const {
+    // Same bound as get_line: the last indexed line may still be growing
+    bool past_end = start_line >= get_line_count() ||
+                    (index_job_ && start_line >= get_indexed_line_count());
+    size_t start = past_end ? get_total_length() : line_start_offset(start_line);
+    return LineCursor(chunks(start), start_line, start, past_end);
+}
+
+// ============================================================================
+// Undo history
+// ============================================================================
+
+size_t PieceTable::step_bytes(const UndoStep& step) {
+    size_t bytes = 0;
+    for (const auto& edit : step.edits) bytes += edit.span.pieces.size() * sizeof(Piece);
+    return bytes;
+}
+
+size_t PieceTable::spilled_step_count(const std::vector<SpilledSteps>& spilled) {
+    size_t steps = 0;
+    for (const SpilledSteps& batch : spilled) steps += batch.steps;
+    return steps;
+}
+
+void PieceTable::push_history(std::deque<UndoStep>& history, size_t& bytes, std::vector<SpilledSteps>& spilled,
+                              UndoStep step) {
+    bytes += step_bytes(step);
+    history.push_back(std::move(step));
+    trim_history(history, bytes, spilled);
+}
+
+void PieceTable::trim_history(std::deque<UndoStep>& history, size_t& bytes, std::vector<SpilledSteps>& spilled) {
+    if (history.size() <= 1 || (history.size() <= max_history_ && bytes <= max_history_bytes_)) return;
+    if (spill_ && spill_steps(history, bytes, spilled)) return;
+    // Drop the oldest steps in O(1) each; the newest is always kept. What
+    // was spilled before them can no longer be reached.
+    release_spilled(spilled);
+    while (history.size() > 1 && (history.size() > max_history_ || bytes > max_history_bytes_)) {
+        bytes -= step_bytes(history.front());
+        history.pop_front();
+    }
+}
+
+namespace {
+
+void put_u64(std::string& out, uint64_t value) {
+    char bytes[8];
+    std::memcpy(bytes, &value, sizeof(bytes));
+    out.append(bytes, sizeof(bytes));
+}
+
+bool get_u64(const std::string& in, size_t& pos, uint64_t& value) {
+    if (in.size() - pos < sizeof(value)) return false;
+    std::memcpy(&value, in.data() + pos, sizeof(value));
+    pos += sizeof(value);
+    return true;
+}
+
+} // namespace
+
+bool PieceTable::spill_steps(std::deque<UndoStep>& history, size_t& bytes, std::vector<SpilledSteps>& spilled) {
+    // Half the limits' worth goes at once, so spilling is rare and batches
+    // compress well
+    size_t count = 0, freed = 0;
+    while (history.size() - count > 1 &&
+           (history.size() - count > max_history_ / 2 || bytes - freed > max_history_bytes_ / 2)) {
+        freed += step_bytes(history[count]);
+        ++count;
+    }
+    // Per step: edit count; per edit: type, position, length, newlines,
+    // piece count; per piece: source, offset, length
+    std::string data;
+    for (size_t i = 0; i < count; ++i) {
+        put_u64(data, history[i].edits.size());
+        for (const EditAction& edit : history[i].edits) {
+            put_u64(data, edit.type == EditType::Insert ? 0 : 1);
+            put_u64(data, edit.position);
+            put_u64(data, edit.span.length);
+            put_u64(data, edit.span.newlines);
+            put_u64(data, edit.span.pieces.size());
+            for (const Piece& piece : edit.span.pieces) {
+                put_u64(data, piece.source == Piece::Source::ORIGINAL ? 0 : 1);
+                put_u64(data, piece.offset);
+                put_u64(data, piece.length);
+            }
         }
-        lines.push_back(line);
     }
+    SpilledSteps batch{{}, count};
+    if (!spill_->write(data, batch.block)) return false;
+    history.erase(history.begin(), history.begin() + static_cast<std::ptrdiff_t>(count));
+    bytes -= freed;
+    spilled.push_back(batch);
+    return true;
+}
+
+bool PieceTable::page_in_steps(std::deque<UndoStep>& history, size_t& bytes, std::vector<SpilledSteps>& spilled) {
+    if (spilled.empty()) return false;
+    SpilledSteps batch = spilled.back();
+    spilled.pop_back();
+    std::string data;
+    std::vector<UndoStep> steps(batch.steps);
+    bool ok = spill_ && spill_->read(batch.block, data);
+    // Back in memory; if spilled again it is written anew
+    if (spill_) spill_->release(batch.block);
+    size_t pos = 0;
+    for (UndoStep& step : steps) {
+        uint64_t edits = 0;
+        ok = ok && get_u64(data, pos, edits);
+        for (uint64_t e = 0; ok && e < edits; ++e) {
+            uint64_t type = 0, position = 0, length = 0, newlines = 0, pieces = 0;
+            ok = get_u64(data, pos, type) && get_u64(data, pos, position) && get_u64(data, pos, length) &&
+                 get_u64(data, pos, newlines) && get_u64(data, pos, pieces);
+            EditAction edit{type == 0 ? EditType::Insert : EditType::Remove, static_cast<size_t>(position), Span()};
+            edit.span.length = static_cast<size_t>(length);
+            edit.span.newlines = static_cast<size_t>(newlines);
+            for (uint64_t p = 0; ok && p < pieces; ++p) {
+                uint64_t source = 0, offset = 0, piece_length = 0;
+                ok = get_u64(data, pos, source) && get_u64(data, pos, offset) && get_u64(data, pos, piece_length);
+                edit.span.pieces.emplace_back(source == 0 ? Piece::Source::ORIGINAL : Piece::Source::ADD,
+                                              static_cast<size_t>(offset), static_cast<size_t>(piece_length));
+            }
+            step.edits.push_back(std::move(edit));
+        }
+    }
+    if (!ok) {
+        // Unreadable: the steps before it are out of reach as well
+        release_spilled(spilled);
+        return false;
+    }
+    for (auto it = steps.rbegin(); it != steps.rend(); ++it) {
+        bytes += step_bytes(*it);
+        history.push_front(std::move(*it));
+    }
+    compact_spill();
+    return true;
+}
+
+void PieceTable::forget_spilled_history() {
+    release_spilled(spilled_undo_);
+    release_spilled(spilled_redo_);
+}
+
+void PieceTable::release_spilled(std::vector<SpilledSteps>& spilled) {
+    if (spilled.empty()) return;
+    if (spill_) {
+        for (const SpilledSteps& batch : spilled) spill_->release(batch.block);
+    }
+    spilled.clear();
+    compact_spill();
+}
+
+void PieceTable::compact_spill() {
+    if (!spill_ || !spill_->should_compact()) return;
+    // Paged-out chunks stay live: their blocks are reused when they go again
+    std::vector<editor::HistorySpill::Block*> live;
+    for (SpilledSteps& batch : spilled_undo_) live.push_back(&batch.block);
+    for (SpilledSteps& batch : spilled_redo_) live.push_back(&batch.block);
+    for (AddChunk& chunk : add_chunks_) {
+        if (chunk.spilled) live.push_back(&chunk.block);
+    }
+    spill_->compact(live);
+}
+
+bool PieceTable::page_in(const Span& span) const {
+    for (const Piece& piece : span.pieces) {
+        if (piece.source != Piece::Source::ADD) continue;
+        AddChunk& chunk = add_chunks_[chunk_index(piece.offset)];
+        if (chunk.data) continue;
+        std::shared_ptr<char> data(new char[chunk.capacity], std::default_delete<char[]>());
+        if (!spill_ || !spill_->read(chunk.block, data.get())) return false;
+        chunk.data = std::move(data);
+        add_resident_ += chunk.capacity;
+    }
+    return true;
+}
+
+bool PieceTable::page_in(const UndoStep& step) const {
+    for (const EditAction& edit : step.edits) {
+        if (!page_in(edit.span)) return false;
+    }
+    return true;
+}
+
+void PieceTable::spill_cold_chunks() {
+    if (!spill_ || add_resident_ <= spill_budget_ || add_resident_ < spill_check_at_) return;
+    std::vector<bool> in_text(add_chunks_.size(), false);
+    for (PieceNode* node = first_node(); node != nil_; node = next_node(node)) {
+        if (node->piece.source == Piece::Source::ADD) in_text[chunk_index(node->piece.offset)] = true;
+    }
+    // The last chunk is still being appended to; shared ones are not ours
+    for (size_t i = 0; i + 1 < add_chunks_.size() && add_resident_ > spill_budget_; ++i) {
+        AddChunk& chunk = add_chunks_[i];
+        if (in_text[i] || chunk.shared || !chunk.data) continue;
+        // A chunk read back is unchanged: its block is still good
+        if (!chunk.spilled && !spill_->write(std::string_view(chunk.data.get(), chunk.size), chunk.block)) break;
+        chunk.spilled = true;
+        chunk.data.reset();
+        add_resident_ -= chunk.capacity;
+    }
+    // The rest is in the text; look again once a quarter budget more is in
+    spill_check_at_ = add_resident_ + spill_budget_ / 4;
+}
+
+void PieceTable::set_history_spill(const std::string& path, size_t memory_budget) {
+    if (spill_) {
+        // Everything comes back: history may still need any of it
+        for (AddChunk& chunk : add_chunks_) {
+            if (chunk.data || !chunk.spilled) continue;
+            std::shared_ptr<char> data(new char[chunk.capacity], std::default_delete<char[]>());
+            if (spill_->read(chunk.block, data.get())) {
+                chunk.data = std::move(data);
+                add_resident_ += chunk.capacity;
+            } else {
+                // Lost with the file: drop history, the only thing that could refer to it
+                undo_history_.clear();
+                redo_history_.clear();
+                undo_bytes_ = redo_bytes_ = 0;
+                chunk.data = std::make_shared<char>('\0');
+                chunk.size = chunk.capacity = 1;
+            }
+            chunk.spilled = false;
+        }
+        forget_spilled_history();
+        spill_.reset();
+    }
+    spill_check_at_ = 0;
+    if (!path.empty()) {
+        spill_ = std::make_unique<editor::HistorySpill>(path);
+        spill_budget_ = memory_budget;
+        spill_cold_chunks();
+    }
+    trim_history(undo_history_, undo_bytes_, spilled_undo_);
+    trim_history(redo_history_, redo_bytes_, spilled_redo_);
+}
+
+bool PieceTable::merge_edit(EditAction& last, EditType type, size_t position, const Span& span) {
+    // Keystrokes continue the previous edit when they pick up exactly where
+    // it ended and neither crosses a line break
+    if (last.type != type || last.span.newlines != 0 || span.newlines != 0) return false;
+    if (type == EditType::Insert && position == last.position + last.span.length) {
+        last.span.append(span);
+    } else if (type == EditType::Remove && position + span.length == last.position) {
+        last.span.prepend(span);    // Backspace
+        last.position = position;
+    } else if (type == EditType::Remove && position == last.position) {
+        last.span.append(span);     // Forward delete
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void PieceTable::record_edit(EditType type, size_t position, const Span& span) {
+    if (replaying_) return;
+    redo_history_.clear();
+    redo_bytes_ = 0;
+    release_spilled(spilled_redo_);
     
-    return lines;
+    bool extend = transaction_depth_ > 0 ? transaction_started_ : undo_group_open_;
+    if (extend && !undo_history_.empty()) {
+        // Part of the open transaction or keystroke group
+        UndoStep& step = undo_history_.back();
+        EditAction& last = step.edits.back();
+        size_t before = last.span.pieces.size();
+        if (merge_edit(last, type, position, span)) {
+            undo_bytes_ += (last.span.pieces.size() - before) * sizeof(Piece);
+            return;
+        }
+        if (transaction_depth_ > 0) {
+            step.edits.push_back({type, position, span});
+            undo_bytes_ += span.pieces.size() * sizeof(Piece);
+            return;
+        }
+    }
+    UndoStep step;
+    step.edits.push_back({type, position, span});
+    push_history(undo_history_, undo_bytes_, spilled_undo_, std::move(step));
+    ++undo_serial_;
+    transaction_started_ = transaction_depth_ > 0;
+    undo_group_open_ = transaction_depth_ == 0 && span.newlines == 0;
+}
+
+void PieceTable::begin_transaction() {
+    if (transaction_depth_++ == 0) {
+        transaction_started_ = false;
+        undo_group_open_ = false;
+    }
+}
+
+void PieceTable::commit_transaction() {
+    if (transaction_depth_ == 0) return;
+    if (--transaction_depth_ == 0) {
+        // A transaction never absorbs the keystrokes that follow it
+        transaction_started_ = false;
+        undo_group_open_ = false;
+    }
+}
+
+void PieceTable::set_history_limits(size_t max_steps, size_t max_bytes) {
+    max_history_ = (std::max)(max_steps, size_t(1));
+    max_history_bytes_ = max_bytes;
+    trim_history(undo_history_, undo_bytes_, spilled_undo_);
 }
 
 void PieceTable::undo() {
-    if (undo_history_.empty()) return;
-    EditAction action = undo_history_.back();
+    if (transaction_depth_ > 0) return;
+    if (undo_history_.empty() && !page_in_steps(undo_history_, undo_bytes_, spilled_undo_)) return;
+    if (!page_in(undo_history_.back())) {
+        // Its text is lost with the spill file: so is the way back
+        undo_history_.clear();
+        undo_bytes_ = 0;
+        release_spilled(spilled_undo_);
+        return;
+    }
+    UndoStep step = std::move(undo_history_.back());
     undo_history_.pop_back();
-    if (action.type == EditType::Insert) {
-        // Undo insert: remove inserted text
-        remove(action.position, action.text.length());
-        redo_history_.push_back(action);
-        if (redo_history_.size() > kMaxHistory) redo_history_.erase(redo_history_.begin());
-    } else if (action.type == EditType::Remove) {
-        // Undo remove: re-insert removed text
-        insert(action.position, action.text);
-        redo_history_.push_back(action);
-        if (redo_history_.size() > kMaxHistory) redo_history_.erase(redo_history_.begin());
+    undo_bytes_ -= step_bytes(step);
+    undo_group_open_ = false;
+    replaying_ = true;
+    for (auto it = step.edits.rbegin(); it != step.edits.rend(); ++it) {
+        if (it->type == EditType::Insert) {
+            // Undo insert: remove inserted text
+            remove(it->position, it->span.length);
+        } else {
+            // Undo remove: link the removed pieces back in
+            insert_span(it->position, it->span);
+        }
     }
+    replaying_ = false;
+    push_history(redo_history_, redo_bytes_, spilled_redo_, std::move(step));
+    spill_cold_chunks();
 }
 
 void PieceTable::redo() {
-    if (redo_history_.empty()) return;
-    EditAction action = redo_history_.back();
+    if (transaction_depth_ > 0) return;
+    if (redo_history_.empty() && !page_in_steps(redo_history_, redo_bytes_, spilled_redo_)) return;
+    if (!page_in(redo_history_.back())) {
+        redo_history_.clear();
+        redo_bytes_ = 0;
+        release_spilled(spilled_redo_);
+        return;
+    }
+    UndoStep step = std::move(redo_history_.back());
     redo_history_.pop_back();
-    if (action.type == EditType::Insert) {
-        insert(action.position, action.text);
-        undo_history_.push_back(action);
-        if (undo_history_.size() > kMaxHistory) undo_history_.erase(undo_history_.begin());
-    } else if (action.type == EditType::Remove) {
-        remove(action.position, action.text.length());
-        undo_history_.push_back(action);
-        if (undo_history_.size() > kMaxHistory) undo_history_.erase(undo_history_.begin());
+    redo_bytes_ -= step_bytes(step);
+    undo_group_open_ = false;
+    replaying_ = true;
+    for (const auto& edit : step.edits) {
+        if (edit.type == EditType::Insert) {
+            insert_span(edit.position, edit.span);
+        } else {
+            remove(edit.position, edit.span.length);
+        }
     }
+    replaying_ = false;
+    push_history(undo_history_, undo_bytes_, spilled_undo_, std::move(step));
+    spill_cold_chunks();
 }
@@ -1,15 +1,22 @@
 #include "platform_file.h"
+#include "text_scan.h"
+#include "text_transcode.h"
 #include <fstream>
-#include <sstream>
 #include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <ctime>
 
 #ifdef _WIN32
 #include <windows.h>
 #include <shlobj.h>
+#include <io.h>
 #include <sys/stat.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <pwd.h>
@@ -59,14 +66,32 @@ char PlatformFile::get_path_separator() {
 
 // File I/O with line ending conversion
 bool PlatformFile::read_file(const std::string& path, std::string& content, LineEnding output_ending) {
-    std::ifstream file(path, std::ios::binary);
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
     if (!file) return false;
     
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    content = buffer.str();
+    std::streamsize size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    content.resize(static_cast<size_t>(size));
+    if (size > 0 && !file.read(&content[0], size)) return false;
     
-    if (output_ending != LineEnding::Auto) {
+    // UTF-16 files (with a BOM) are decoded: the editor works in UTF-8
+    size_t bom = 0;
+    TextTranscode::Encoding encoding = TextTranscode::detect_bom(content.data(), content.size(), bom);
+    if (encoding == TextTranscode::Encoding::UTF16LE || encoding == TextTranscode::Encoding::UTF16BE) {
+        std::u16string units((content.size() - bom) / 2, u'\0');
+        for (size_t i = 0; i < units.size(); ++i) {
+            unsigned char first = static_cast<unsigned char>(content[bom + 2 * i]);
+            unsigned char second = static_cast<unsigned char>(content[bom + 2 * i + 1]);
+            units[i] = encoding == TextTranscode::Encoding::UTF16LE ? static_cast<char16_t>(first | (second << 8))
+                                                                   : static_cast<char16_t>((first << 8) | second);
+        }
+        content = TextTranscode::utf16_to_utf8(units.data(), units.size());
+    }
+    
+    if (output_ending == LineEnding::LF) {
+        // In place, and only past the first '\r'
+        TextTranscode::normalize_to_lf(content);
+    } else if (output_ending != LineEnding::Auto) {
         LineEnding detected = detect_line_ending(content);
         if (detected != output_ending) {
             content = convert_line_endings(content, detected, output_ending);
@@ -87,23 +112,215 @@ bool PlatformFile::read_file_binary(const std::string& path, std::vector<uint8_t
     return file.read(reinterpret_cast<char*>(data.data()), size).good();
 }
 
+namespace {
+
+// Collects writes for one vectored call: small ones are copied into a
+// fixed buffer, large ones are referenced where they lie, so no more than
+// kBufferSize bytes and kMaxSpans entries are held whatever is written.
+class GatherWriter {
+public:
+    static constexpr size_t kBufferSize = 64 * 1024;
+    static constexpr size_t kMaxSpans = 64;
+    static constexpr size_t kCopyBelow = 4096;      // A memcpy is cheaper than an iovec entry
+
+    GatherWriter() : buffer_(new char[kBufferSize]) {}
+    ~GatherWriter() { close(false); }
+
+    bool open(const std::string& path) {
+#ifdef _WIN32
+        handle_ = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        return handle_ != INVALID_HANDLE_VALUE;
+#else
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        return fd_ >= 0;
+#endif
+    }
+
+    // data must stay valid until the next flush
+    void add(const char* data, size_t size) {
+        if (size == 0 || !ok_) return;
+        if (count_ == kMaxSpans) flush();
+        if (size < kCopyBelow) {
+            if (used_ + size > kBufferSize) flush();
+            char* at = buffer_.get() + used_;
+            std::memcpy(at, data, size);
+            used_ += size;
+            if (count_ > 0 && entries_[count_ - 1].data + entries_[count_ - 1].size == at) {
+                entries_[count_ - 1].size += size;
+                return;
+            }
+            data = at;
+        }
+        entries_[count_++] = {data, size};
+    }
+
+    // Writes what is left; sync forces it to the disk first
+    bool close(bool sync) {
+        bool open = is_open();
+        if (open) flush();
+#ifdef _WIN32
+        if (open) {
+            if (sync && !FlushFileBuffers(handle_)) ok_ = false;
+            CloseHandle(handle_);
+        }
+        handle_ = INVALID_HANDLE_VALUE;
+#else
+        if (open) {
+            if (sync && fsync(fd_) != 0) ok_ = false;
+            if (::close(fd_) != 0) ok_ = false;
+        }
+        fd_ = -1;
+#endif
+        return open && ok_;
+    }
+
+private:
+    struct Entry {
+        const char* data;
+        size_t size;
+    };
+
+    bool is_open() const {
+#ifdef _WIN32
+        return handle_ != INVALID_HANDLE_VALUE;
+#else
+        return fd_ >= 0;
+#endif
+    }
+
+    void flush() {
+#ifdef _WIN32
+        // WriteFileGather wants page-sized, page-aligned buffers and an
+        // unbuffered handle; pieces are neither, so one WriteFile each
+        for (size_t i = 0; ok_ && i < count_; ++i) {
+            const char* data = entries_[i].data;
+            size_t left = entries_[i].size;
+            while (ok_ && left > 0) {
+                DWORD written = 0;
+                DWORD chunk = static_cast<DWORD>((std::min)(left, size_t(1) << 30));
+                ok_ = WriteFile(handle_, data, chunk, &written, nullptr) && written > 0;
+                data += written;
+                left -= written;
+            }
+        }
+#else
+        iovec vectors[kMaxSpans];
+        for (size_t i = 0; i < count_; ++i) {
+            vectors[i].iov_base = const_cast<char*>(entries_[i].data);
+            vectors[i].iov_len = entries_[i].size;
+        }
+        size_t first = 0;
+        while (ok_ && first < count_) {
+            ssize_t written = ::writev(fd_, vectors + first, static_cast<int>(count_ - first));
+            if (written < 0) {
+                if (errno != EINTR) ok_ = false;
+                continue;
+            }
+            // A short write resumes inside the entry it stopped in
+            size_t done = static_cast<size_t>(written);
+            while (first < count_ && done >= vectors[first].iov_len) done -= vectors[first++].iov_len;
+            if (first < count_) {
+                vectors[first].iov_base = static_cast<char*>(vectors[first].iov_base) + done;
+                vectors[first].iov_len -= done;
+            }
+        }
+#endif
+        count_ = 0;
+        used_ = 0;
+    }
+
+#ifdef _WIN32
+    HANDLE handle_ = INVALID_HANDLE_VALUE;
+#else
+    int fd_ = -1;
+#endif
+    std::unique_ptr<char[]> buffer_;
+    size_t used_ = 0;
+    Entry entries_[kMaxSpans];
+    size_t count_ = 0;
+    bool ok_ = true;
+};
+
+// Adds span with its line breaks written as ending. A \r ending the span
+// is held in pending_cr until the next span shows whether \n follows it.
+void add_converted(GatherWriter& out, std::string_view span, std::string_view ending, bool& pending_cr) {
+    size_t i = 0;
+    if (pending_cr) {
+        out.add(ending.data(), ending.size());
+        pending_cr = false;
+        if (!span.empty() && span[0] == '\n') i = 1;
+    }
+    size_t run = i;
+    for (; i < span.size(); ++i) {
+        char c = span[i];
+        if (c != '\r' && c != '\n') continue;
+        out.add(span.data() + run, i - run);
+        if (c == '\r' && i + 1 == span.size()) {
+            pending_cr = true;
+        } else {
+            out.add(ending.data(), ending.size());
+            if (c == '\r' && span[i + 1] == '\n') ++i;
+        }
+        run = i + 1;
+    }
+    out.add(span.data() + run, span.size() - run);
+}
+
+std::string_view ending_text(LineEnding ending) {
+    switch (ending) {
+    case LineEnding::CRLF: return "\r\n";
+    case LineEnding::CR: return "\r";
+    default: return "\n";
+    }
+}
+
+// Write to a temporary file beside path, then replace path with it; with
+// convert, line breaks are rewritten as ending
+bool write_spans_atomically(const std::string& path, const std::vector<std::string_view>& spans, bool convert,
+                            LineEnding ending) {
+    std::string temp = path + ".velocity-save.tmp";
+    GatherWriter out;
+    if (!out.open(temp)) return false;
+    bool pending_cr = false;
+    std::string_view ending_bytes = ending_text(ending);
+    for (std::string_view span : spans) {
+        if (convert) {
+            add_converted(out, span, ending_bytes, pending_cr);
+        } else {
+            out.add(span.data(), span.size());
+        }
+    }
+    if (pending_cr) out.add(ending_bytes.data(), ending_bytes.size());
+    bool ok = out.close(true);
+
+    // The replacement keeps the permissions of the file it replaces
+    FilePermission permissions = FilePermission::None;
+    if (ok && PlatformFile::get_permissions(path, permissions)) PlatformFile::set_permissions(temp, permissions);
+    ok = ok && PlatformFile::replace_file(temp, path);
+    if (!ok) PlatformFile::delete_file(temp);
+    return ok;
+}
+
+} // namespace
+
 bool PlatformFile::write_file(const std::string& path, const std::string& content, LineEnding line_ending) {
-    std::string output = content;
-    
     if (line_ending == LineEnding::Auto) {
         line_ending = get_platform_line_ending();
     }
     
-    LineEnding current = detect_line_ending(content);
-    if (current != line_ending) {
-        output = convert_line_endings(content, current, line_ending);
+    // Converted while written, rather than into a second copy of content
+    GatherWriter out;
+    if (!out.open(path)) return false;
+    if (detect_line_ending(content) == line_ending) {
+        out.add(content.data(), content.size());
+    } else {
+        bool pending_cr = false;
+        std::string_view ending = ending_text(line_ending);
+        add_converted(out, content, ending, pending_cr);
+        if (pending_cr) out.add(ending.data(), ending.size());
     }
-    
-    std::ofstream file(path, std::ios::binary);
-    if (!file) return false;
-    
-    file << output;
-    return file.good();
+    return out.close(false);
 }
 
 bool PlatformFile::write_file_binary(const std::string& path, const std::vector<uint8_t>& data) {
@@ -114,6 +331,80 @@ bool PlatformFile::write_file_binary(const std::string& path, const std::vector<
     return file.good();
 }
 
+bool PlatformFile::write_file(const std::string& path, const std::vector<std::string_view>& spans,
+                              LineEnding line_ending) {
+    if (line_ending == LineEnding::Auto) {
+        line_ending = get_platform_line_ending();
+    }
+    return write_spans_atomically(path, spans, true, line_ending);
+}
+
+bool PlatformFile::write_file_binary(const std::string& path, const std::vector<std::string_view>& spans) {
+    return write_spans_atomically(path, spans, false, LineEnding::LF);
+}
+
+// Memory-mapped files
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path) {
+    std::shared_ptr<MappedFile> mapped(new MappedFile());
+    mapped->path_ = path;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+    mapped->file_handle_ = file;
+    
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) return nullptr;
+    mapped->size_ = static_cast<size_t>(size.QuadPart);
+    if (mapped->size_ == 0) {
+        mapped->data_ = "";
+        return mapped;
+    }
+    
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) return nullptr;
+    mapped->mapping_handle_ = mapping;
+    
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) return nullptr;
+    mapped->data_ = static_cast<const char*>(view);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    mapped->fd_ = fd;
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return nullptr;
+    mapped->size_ = static_cast<size_t>(st.st_size);
+    if (mapped->size_ == 0) {
+        mapped->data_ = "";
+        return mapped;
+    }
+    
+    void* view = mmap(nullptr, mapped->size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (view == MAP_FAILED) return nullptr;
+    mapped->data_ = static_cast<const char*>(view);
+    // Editors read the file front-to-back on open (line indexing)
+    madvise(view, mapped->size_, MADV_SEQUENTIAL);
+#endif
+    return mapped;
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+    if (data_ && size_ > 0) UnmapViewOfFile(data_);
+    if (mapping_handle_) CloseHandle(mapping_handle_);
+    if (file_handle_) CloseHandle(file_handle_);
+#else
+    if (data_ && size_ > 0) munmap(const_cast<char*>(data_), size_);
+    if (fd_ >= 0) close(fd_);
+#endif
+}
+
+std::shared_ptr<MappedFile> PlatformFile::map_file(const std::string& path) {
+    return MappedFile::open(path);
+}
+
 // File metadata
 bool PlatformFile::exists(const std::string& path) {
     return std::filesystem::exists(path);
@@ -186,6 +477,23 @@ bool PlatformFile::rename_file(const std::string& from, const std::string& to) {
     return move_file(from, to);
 }
 
+bool PlatformFile::replace_file(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+bool PlatformFile::sync_file(std::FILE* file) {
+    if (!file || std::fflush(file) != 0) return false;
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+}
+
 // Directory operations
 bool PlatformFile::create_directory(const std::string& path) {
     try {
@@ -296,13 +604,11 @@ bool PlatformFile::is_executable(const std::string& path) {
 
 // Line ending detection and conversion
 LineEnding PlatformFile::detect_line_ending(const std::string& content) {
-    bool has_crlf = content.find("\r\n") != std::string::npos;
-    bool has_lf = content.find('\n') != std::string::npos;
-    bool has_cr = content.find('\r') != std::string::npos;
+    TextTranscode::LineBreaks breaks = TextTranscode::count_line_breaks(content.data(), content.size());
     
-    if (has_crlf) return LineEnding::CRLF;
-    if (has_lf) return LineEnding::LF;
-    if (has_cr) return LineEnding::CR;
+    if (breaks.crlf) return LineEnding::CRLF;
+    if (breaks.lf) return LineEnding::LF;
+    if (breaks.cr) return LineEnding::CR;
     
     return get_platform_line_ending();
 }
@@ -318,26 +624,23 @@ LineEnding PlatformFile::get_platform_line_ending() {
 std::string PlatformFile::convert_line_endings(const std::string& content, LineEnding from, LineEnding to) {
     if (from == to) return content;
     
-    // First normalize to LF
+    // First normalize to LF: every \r\n and lone \r, as the writers do
     std::string normalized = content;
-    if (from == LineEnding::CRLF) {
-        size_t pos = 0;
-        while ((pos = normalized.find("\r\n", pos)) != std::string::npos) {
-            normalized.replace(pos, 2, "\n");
-            pos += 1;
-        }
-    } else if (from == LineEnding::CR) {
-        std::replace(normalized.begin(), normalized.end(), '\r', '\n');
-    }
+    TextTranscode::normalize_to_lf(normalized);
     
     // Then convert to target
     if (to == LineEnding::CRLF) {
-        size_t pos = 0;
-        while ((pos = normalized.find('\n', pos)) != std::string::npos) {
-            normalized.replace(pos, 1, "\r\n");
-            pos += 2;
+        std::string expanded;
+        expanded.reserve(normalized.size() + TextScan::count_newlines(normalized.data(), normalized.size()));
+        size_t run = 0;
+        for (size_t pos; (pos = normalized.find('\n', run)) != std::string::npos; run = pos + 1) {
+            expanded.append(normalized, run, pos - run);
+            expanded += "\r\n";
         }
-    } else if (to == LineEnding::CR) {
+        expanded.append(normalized, run, std::string::npos);
+        return expanded;
+    }
+    if (to == LineEnding::CR) {
         std::replace(normalized.begin(), normalized.end(), '\n', '\r');
     }
     
@@ -5,7 +5,9 @@
 
 #ifdef _WIN32
 #include <windows.h>
+#include <atomic>
 #include <cstdint>
+#include <cstdio>
 #include <process.h>
 #else
 #include <unistd.h>
@@ -15,21 +17,106 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <spawn.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <cerrno>
 extern char **environ;
 #endif
 
 namespace editor {
 
+namespace {
+
+#ifdef _WIN32
+// Anonymous pipes cannot do overlapped I/O, so an async output pipe is a
+// uniquely named one: the overlapped read end stays here, the write end
+// is inherited by the child
+bool create_async_pipe(HANDLE& read_handle, HANDLE& write_handle, SECURITY_ATTRIBUTES* sa) {
+    static std::atomic<unsigned> serial{0};
+    char name[64];
+    snprintf(name, sizeof(name), "\\\\.\\pipe\\editor-%lu-%u",
+             static_cast<unsigned long>(GetCurrentProcessId()), serial++);
+    read_handle = CreateNamedPipeA(name, PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+                                   PIPE_TYPE_BYTE | PIPE_WAIT, 1, 65536, 65536, 0, NULL);
+    if (read_handle == INVALID_HANDLE_VALUE) return false;
+    write_handle = CreateFileA(name, GENERIC_WRITE, 0, sa, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (write_handle == INVALID_HANDLE_VALUE) {
+        CloseHandle(read_handle);
+        return false;
+    }
+    return true;
+}
+
+std::string build_command_line(const std::string& executable, const std::vector<std::string>& args) {
+    std::string cmdline = "\"" + executable + "\"";
+    for (const auto& arg : args) {
+        cmdline += " " + ProcessUtils::escape_argument(arg);
+    }
+    return cmdline;
+}
+
+bool read_pipe(HANDLE pipe, std::string& data, int timeout_ms) {
+    char buffer[4096];
+    DWORD read = 0;
+    if (timeout_ms >= 0) {
+        // Wait for data by peeking, so a quiet child does not block the read
+        DWORD waited = 0;
+        for (;;) {
+            DWORD available = 0;
+            if (!PeekNamedPipe(pipe, NULL, 0, NULL, &available, NULL)) return false;
+            if (available > 0) break;
+            if (waited >= static_cast<DWORD>(timeout_ms)) return false;
+            Sleep(1);
+            ++waited;
+        }
+    }
+    if (!ReadFile(pipe, buffer, sizeof(buffer), &read, NULL) || read == 0) return false;
+    data.assign(buffer, read);
+    return true;
+}
+#else
+// Pipe with both ends closed on exec; dup2 into the child's standard
+// handles clears the flag on the copies it keeps
+bool create_pipe_cloexec(int fds[2]) {
+    if (pipe(fds) != 0) return false;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+}
+
+bool read_pipe(int fd, std::string& data, int timeout_ms) {
+    pollfd pfd = { fd, POLLIN, 0 };
+    int ready;
+    do {
+        ready = poll(&pfd, 1, timeout_ms);
+    } while (ready < 0 && errno == EINTR);
+    if (ready <= 0) return false;
+    
+    char buffer[4096];
+    ssize_t bytes;
+    do {
+        bytes = read(fd, buffer, sizeof(buffer));
+    } while (bytes < 0 && errno == EINTR);
+    if (bytes <= 0) return false;
+    data.assign(buffer, static_cast<size_t>(bytes));
+    return true;
+}
+#endif
+
+} // namespace
+
 // PlatformProcess implementation
 
 PlatformProcess::PlatformProcess()
-    : process_handle_(nullptr)
-    , stdin_pipe_(nullptr)
-    , stdout_pipe_(nullptr)
-    , stderr_pipe_(nullptr)
+    : process_handle_(kInvalidProcess)
+    , stdin_pipe_(kInvalidPipe)
+    , stdout_pipe_(kInvalidPipe)
+    , stderr_pipe_(kInvalidPipe)
     , pid_(0)
     , exit_code_(0)
-    , running_(false) {
+    , running_(false)
+    , pseudo_terminal_(false)
+    , pseudo_console_(nullptr) {
 }
 
 PlatformProcess::~PlatformProcess() {
@@ -48,6 +135,10 @@ bool PlatformProcess::start(const std::string& executable,
     
     cleanup();
     
+    if (options.io.pseudo_terminal) {
+        return start_pseudo_terminal(executable, args, options);
+    }
+    
 #ifdef _WIN32
     // Windows implementation using CreateProcess
     HANDLE stdin_read = NULL, stdin_write = NULL;
@@ -66,29 +157,34 @@ bool PlatformProcess::start(const std::string& executable,
         stdin_pipe_ = stdin_write;
     }
     
+    auto create_output_pipe = [&](HANDLE& read_handle, HANDLE& write_handle) {
+        if (options.io.async_output) return create_async_pipe(read_handle, write_handle, &sa);
+        if (!CreatePipe(&read_handle, &write_handle, &sa, 0)) return false;
+        SetHandleInformation(read_handle, HANDLE_FLAG_INHERIT, 0);
+        return true;
+    };
+    
     if (options.io.redirect_stdout) {
-        if (!CreatePipe(&stdout_read, &stdout_write, &sa, 0)) {
+        if (!create_output_pipe(stdout_read, stdout_write)) {
+            if (stdin_read) CloseHandle(stdin_read);
             cleanup();
             return false;
         }
-        SetHandleInformation(stdout_read, HANDLE_FLAG_INHERIT, 0);
         stdout_pipe_ = stdout_read;
     }
     
     if (options.io.redirect_stderr && !options.io.merge_stderr_to_stdout) {
-        if (!CreatePipe(&stderr_read, &stderr_write, &sa, 0)) {
+        if (!create_output_pipe(stderr_read, stderr_write)) {
+            if (stdin_read) CloseHandle(stdin_read);
+            if (stdout_write) CloseHandle(stdout_write);
             cleanup();
             return false;
         }
-        SetHandleInformation(stderr_read, HANDLE_FLAG_INHERIT, 0);
         stderr_pipe_ = stderr_read;
     }
     
     // Build command line
-    std::string cmdline = "\"" + executable + "\"";
-    for (const auto& arg : args) {
-        cmdline += " " + ProcessUtils::escape_argument(arg);
-    }
+    std::string cmdline = build_command_line(executable, args);
     
     // Setup startup info
     STARTUPINFOA si;
@@ -105,6 +201,7 @@ bool PlatformProcess::start(const std::string& executable,
     
     DWORD flags = 0;
     if (options.create_new_console) flags |= CREATE_NEW_CONSOLE;
+    if (options.hide_window) flags |= CREATE_NO_WINDOW;
     
     // Create process
     BOOL success = CreateProcessA(
@@ -141,13 +238,20 @@ bool PlatformProcess::start(const std::string& executable,
     int stderr_fds[2] = {-1, -1};
     
     // Create pipes
+    auto close_child_ends = [&]() {
+        for (int fd : {stdin_fds[0], stdout_fds[1], stderr_fds[1]}) {
+            if (fd != -1) close(fd);
+        }
+    };
+    
     if (options.io.redirect_stdin) {
-        if (pipe(stdin_fds) != 0) return false;
+        if (!create_pipe_cloexec(stdin_fds)) return false;
         stdin_pipe_ = stdin_fds[1];  // Write end
     }
     
     if (options.io.redirect_stdout) {
-        if (pipe(stdout_fds) != 0) {
+        if (!create_pipe_cloexec(stdout_fds)) {
+            close_child_ends();
             cleanup();
             return false;
         }
@@ -155,15 +259,25 @@ bool PlatformProcess::start(const std::string& executable,
     }
     
     if (options.io.redirect_stderr && !options.io.merge_stderr_to_stdout) {
-        if (pipe(stderr_fds) != 0) {
+        if (!create_pipe_cloexec(stderr_fds)) {
+            close_child_ends();
             cleanup();
             return false;
         }
         stderr_pipe_ = stderr_fds[0];  // Read end
     }
     
+    // Built before forking: the child only execs
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(executable.c_str()));
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    
     pid_t pid = fork();
     if (pid < 0) {
+        close_child_ends();
         cleanup();
         return false;
     }
@@ -172,31 +286,25 @@ bool PlatformProcess::start(const std::string& executable,
         // Child process
         
         // Redirect I/O
+        // Everything else is closed on exec
         if (options.io.redirect_stdin) {
             dup2(stdin_fds[0], STDIN_FILENO);
-            close(stdin_fds[0]);
-            close(stdin_fds[1]);
         }
         
         if (options.io.redirect_stdout) {
             dup2(stdout_fds[1], STDOUT_FILENO);
-            close(stdout_fds[0]);
-            close(stdout_fds[1]);
         }
         
-        if (options.io.redirect_stderr) {
-            if (options.io.merge_stderr_to_stdout) {
-                dup2(STDOUT_FILENO, STDERR_FILENO);
-            } else {
-                dup2(stderr_fds[1], STDERR_FILENO);
-                close(stderr_fds[0]);
-                close(stderr_fds[1]);
-            }
+        // Merging needs no stderr pipe of its own, as on Windows
+        if (options.io.merge_stderr_to_stdout && options.io.redirect_stdout) {
+            dup2(STDOUT_FILENO, STDERR_FILENO);
+        } else if (options.io.redirect_stderr) {
+            dup2(stderr_fds[1], STDERR_FILENO);
         }
         
         // Change working directory
-        if (!options.working_directory.empty()) {
-            chdir(options.working_directory.c_str());
+        if (!options.working_directory.empty() && chdir(options.working_directory.c_str()) != 0) {
+            _exit(127);
         }
         
         // Set environment
@@ -209,14 +317,6 @@ bool PlatformProcess::start(const std::string& executable,
             setsid();
         }
         
-        // Build argv
-        std::vector<char*> argv;
-        argv.push_back(const_cast<char*>(executable.c_str()));
-        for (const auto& arg : args) {
-            argv.push_back(const_cast<char*>(arg.c_str()));
-        }
-        argv.push_back(nullptr);
-        
         // Execute
         execvp(executable.c_str(), argv.data());
         
@@ -225,10 +325,7 @@ bool PlatformProcess::start(const std::string& executable,
     }
     
     // Parent process
-    // Close child ends of pipes
-    if (stdin_fds[0] != -1) close(stdin_fds[0]);
-    if (stdout_fds[1] != -1) close(stdout_fds[1]);
-    if (stderr_fds[1] != -1) close(stderr_fds[1]);
+    close_child_ends();
     
     process_handle_ = pid;
     pid_ = pid;
@@ -238,6 +335,140 @@ bool PlatformProcess::start(const std::string& executable,
     return true;
 }
 
+bool PlatformProcess::start_pseudo_terminal(const std::string& executable,
+                                            const std::vector<std::string>& args,
+                                            const ProcessOptions& options) {
+#ifdef _WIN32
+    // ConPTY reads the child's input from one pipe and writes what the
+    // console displays, as VT sequences, to the other
+    HANDLE input_read = NULL, input_write = NULL;
+    HANDLE output_read = NULL, output_write = NULL;
+    if (!CreatePipe(&input_read, &input_write, NULL, 0)) return false;
+    if (!create_async_pipe(output_read, output_write, NULL)) {
+        CloseHandle(input_read);
+        CloseHandle(input_write);
+        return false;
+    }
+    
+    COORD size = { static_cast<SHORT>(options.io.columns), static_cast<SHORT>(options.io.rows) };
+    HPCON console = NULL;
+    HRESULT result = CreatePseudoConsole(size, input_read, output_write, 0, &console);
+    // The console keeps its own references to its ends
+    CloseHandle(input_read);
+    CloseHandle(output_write);
+    stdin_pipe_ = input_write;
+    stdout_pipe_ = output_read;
+    if (FAILED(result)) {
+        cleanup();
+        return false;
+    }
+    pseudo_console_ = console;
+    
+    SIZE_T attributes_size = 0;
+    InitializeProcThreadAttributeList(NULL, 1, 0, &attributes_size);
+    std::vector<char> attributes(attributes_size);
+    STARTUPINFOEXA si;
+    ZeroMemory(&si, sizeof(si));
+    si.StartupInfo.cb = sizeof(si);
+    si.lpAttributeList = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attributes.data());
+    if (!InitializeProcThreadAttributeList(si.lpAttributeList, 1, 0, &attributes_size)) {
+        cleanup();
+        return false;
+    }
+    
+    std::string cmdline = build_command_line(executable, args);
+    PROCESS_INFORMATION pi;
+    ZeroMemory(&pi, sizeof(pi));
+    // No handles are inherited: the console is the child's stdio
+    BOOL success =
+        UpdateProcThreadAttribute(si.lpAttributeList, 0, PROC_THREAD_ATTRIBUTE_PSEUDOCONSOLE,
+                                  console, sizeof(console), NULL, NULL) &&
+        CreateProcessA(NULL, const_cast<char*>(cmdline.c_str()), NULL, NULL, FALSE,
+                       EXTENDED_STARTUPINFO_PRESENT, NULL,
+                       options.working_directory.empty() ? NULL : options.working_directory.c_str(),
+                       &si.StartupInfo, &pi);
+    DeleteProcThreadAttributeList(si.lpAttributeList);
+    if (!success) {
+        cleanup();
+        return false;
+    }
+    
+    process_handle_ = pi.hProcess;
+    pid_ = pi.dwProcessId;
+    CloseHandle(pi.hThread);
+    running_ = true;
+    pseudo_terminal_ = true;
+    return true;
+#else
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0) return false;
+    fcntl(master, F_SETFD, FD_CLOEXEC);
+    const char* slave_name = nullptr;
+    if (grantpt(master) == 0 && unlockpt(master) == 0) {
+        slave_name = ptsname(master);
+    }
+    int slave = slave_name ? open(slave_name, O_RDWR | O_NOCTTY | O_CLOEXEC) : -1;
+    if (slave < 0) {
+        close(master);
+        return false;
+    }
+    
+    winsize size = {};
+    size.ws_col = static_cast<unsigned short>(options.io.columns);
+    size.ws_row = static_cast<unsigned short>(options.io.rows);
+    ioctl(master, TIOCSWINSZ, &size);
+    
+    // Writes go to the master and reads come from a duplicate of it, so
+    // the output can be watched and closed on its own
+    stdin_pipe_ = master;
+    stdout_pipe_ = fcntl(master, F_DUPFD_CLOEXEC, 0);
+    if (stdout_pipe_ == kInvalidPipe) {
+        close(slave);
+        cleanup();
+        return false;
+    }
+    
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(executable.c_str()));
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(slave);
+        cleanup();
+        return false;
+    }
+    
+    if (pid == 0) {
+        // A session of its own, with the terminal as its controlling one
+        setsid();
+        ioctl(slave, TIOCSCTTY, 0);
+        dup2(slave, STDIN_FILENO);
+        dup2(slave, STDOUT_FILENO);
+        dup2(slave, STDERR_FILENO);
+        
+        if (!options.working_directory.empty() && chdir(options.working_directory.c_str()) != 0) {
+            _exit(127);
+        }
+        for (const auto& env : options.environment) {
+            setenv(env.first.c_str(), env.second.c_str(), 1);
+        }
+        execvp(executable.c_str(), argv.data());
+        _exit(127);
+    }
+    
+    close(slave);
+    process_handle_ = pid;
+    pid_ = pid;
+    running_ = true;
+    pseudo_terminal_ = true;
+    return true;
+#endif
+}
+
 bool PlatformProcess::wait(int timeout_ms) {
     ProcessExit exit_info;
     return wait(exit_info, timeout_ms);
@@ -263,11 +494,20 @@ bool PlatformProcess::wait(ProcessExit& exit_info, int timeout_ms) {
     
     return false;
 #else
-    int status;
-    int options = (timeout_ms == 0) ? WNOHANG : 0;
-    
-    // For timeout, we'd need to poll
-    pid_t result = waitpid(process_handle_, &status, options);
+    int status = 0;
+    pid_t result;
+    if (timeout_ms < 0) {
+        do {
+            result = waitpid(process_handle_, &status, 0);
+        } while (result < 0 && errno == EINTR);
+    } else {
+        // No timed waitpid: poll it, a millisecond at a time
+        for (int waited = 0;; ++waited) {
+            result = waitpid(process_handle_, &status, WNOHANG);
+            if (result != 0 || waited >= timeout_ms) break;
+            usleep(1000);
+        }
+    }
     
     if (result == process_handle_) {
         if (WIFEXITED(status)) {
@@ -304,15 +544,12 @@ bool PlatformProcess::terminate(int timeout_ms) {
     if (!TerminateProcess(process_handle_, 0)) return false;
     return wait(timeout_ms);
 #else
-    if (kill(process_handle_, SIGTERM) != 0) return false;
-    
-    // Wait for graceful termination
-    for (int i = 0; i < timeout_ms / 100; ++i) {
-        if (!is_running()) return true;
-        usleep(100000); // 100ms
-    }
+    if (::kill(process_handle_, SIGTERM) != 0) return false;
     
-    return !is_running();
+    // Wait for graceful termination, then insist
+    if (wait(timeout_ms)) return true;
+    if (::kill(process_handle_, SIGKILL) != 0) return false;
+    return wait(-1);
 #endif
 }
 
@@ -327,113 +564,101 @@ bool PlatformProcess::kill() {
 }
 
 bool PlatformProcess::write_stdin(const std::string& data) {
-    if (!stdin_pipe_) return false;
+    if (stdin_pipe_ == kInvalidPipe) return false;
     
 #ifdef _WIN32
     DWORD written;
-    return WriteFile(stdin_pipe_, data.c_str(), data.size(), &written, NULL) != 0;
+    return WriteFile(stdin_pipe_, data.c_str(), static_cast<DWORD>(data.size()), &written, NULL) != 0 &&
+           written == data.size();
 #else
-    return write(stdin_pipe_, data.c_str(), data.size()) >= 0;
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t written = write(stdin_pipe_, data.data() + done, data.size() - done);
+        if (written < 0 && errno == EINTR) continue;
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Non-blocking (a terminal whose output a ProcessIoLoop
+            // watches shares the flag): wait for room
+            pollfd pfd = { stdin_pipe_, POLLOUT, 0 };
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        if (written <= 0) return false;
+        done += static_cast<size_t>(written);
+    }
+    return true;
 #endif
 }
 
 bool PlatformProcess::read_stdout(std::string& data, int timeout_ms) {
-    if (!stdout_pipe_) return false;
-    
-#ifdef _WIN32
-    DWORD available;
-    if (!PeekNamedPipe(stdout_pipe_, NULL, 0, NULL, &available, NULL)) return false;
-    if (available == 0) return false;
-    
-    char buffer[4096];
-    DWORD read;
-    if (ReadFile(stdout_pipe_, buffer, sizeof(buffer) - 1, &read, NULL)) {
-        buffer[read] = '\0';
-        data = std::string(buffer, read);
-        return true;
-    }
-    return false;
-#else
-    // Set non-blocking if timeout is 0
-    if (timeout_ms == 0) {
-        int flags = fcntl(stdout_pipe_, F_GETFL, 0);
-        fcntl(stdout_pipe_, F_SETFL, flags | O_NONBLOCK);
-    }
-    
-    char buffer[4096];
-    ssize_t bytes = read(stdout_pipe_, buffer, sizeof(buffer) - 1);
-    
-    if (bytes > 0) {
-        buffer[bytes] = '\0';
-        data = std::string(buffer, bytes);
-        return true;
-    }
-    
-    return false;
-#endif
+    if (stdout_pipe_ == kInvalidPipe) return false;
+    return read_pipe(stdout_pipe_, data, timeout_ms);
 }
 
 bool PlatformProcess::read_stderr(std::string& data, int timeout_ms) {
-    if (!stderr_pipe_) return false;
-    
-    // Similar to read_stdout
-#ifdef _WIN32
-    DWORD available;
-    if (!PeekNamedPipe(stderr_pipe_, NULL, 0, NULL, &available, NULL)) return false;
-    if (available == 0) return false;
-    
-    char buffer[4096];
-    DWORD read;
-    if (ReadFile(stderr_pipe_, buffer, sizeof(buffer) - 1, &read, NULL)) {
-        buffer[read] = '\0';
-        data = std::string(buffer, read);
-        return true;
-    }
-    return false;
-#else
-    char buffer[4096];
-    ssize_t bytes = read(stderr_pipe_, buffer, sizeof(buffer) - 1);
-    
-    if (bytes > 0) {
-        buffer[bytes] = '\0';
-        data = std::string(buffer, bytes);
-        return true;
-    }
-    
-    return false;
-#endif
+    if (stderr_pipe_ == kInvalidPipe) return false;
+    return read_pipe(stderr_pipe_, data, timeout_ms);
 }
 
 bool PlatformProcess::close_stdin() {
-    if (!stdin_pipe_) return false;
+    if (stdin_pipe_ == kInvalidPipe) return false;
     
     close_pipe(stdin_pipe_);
+    if (pseudo_terminal_) {
+        // The terminal only goes once every handle to it has: SIGHUP for
+        // the child on Unix, CTRL_CLOSE_EVENT under ConPTY
+        close_pipe(stdout_pipe_);
+#ifdef _WIN32
+        ClosePseudoConsole(static_cast<HPCON>(pseudo_console_));
+        pseudo_console_ = nullptr;
+#endif
+    }
     return true;
 }
 
+bool PlatformProcess::resize_terminal(int columns, int rows) {
+#ifdef _WIN32
+    if (!pseudo_console_) return false;
+    COORD size = { static_cast<SHORT>(columns), static_cast<SHORT>(rows) };
+    return !FAILED(ResizePseudoConsole(static_cast<HPCON>(pseudo_console_), size));
+#else
+    // Fails with ENOTTY unless stdin is a terminal; the kernel sends the
+    // child SIGWINCH
+    if (stdin_pipe_ == kInvalidPipe) return false;
+    winsize size = {};
+    size.ws_col = static_cast<unsigned short>(columns);
+    size.ws_row = static_cast<unsigned short>(rows);
+    return ioctl(stdin_pipe_, TIOCSWINSZ, &size) == 0;
+#endif
+}
+
 void PlatformProcess::cleanup() {
     close_pipe(stdin_pipe_);
     close_pipe(stdout_pipe_);
     close_pipe(stderr_pipe_);
     
 #ifdef _WIN32
+    // After the pipes: with its output unread, closing could wait on it
+    if (pseudo_console_) {
+        ClosePseudoConsole(static_cast<HPCON>(pseudo_console_));
+        pseudo_console_ = nullptr;
+    }
     if (process_handle_) {
         CloseHandle(process_handle_);
-        process_handle_ = NULL;
     }
 #endif
+    process_handle_ = kInvalidProcess;
+    pseudo_terminal_ = false;
 }
 
 void PlatformProcess::close_pipe(PipeHandle& handle) {
-    if (!handle) return;
+    if (handle == kInvalidPipe) return;
     
 #ifdef _WIN32
     CloseHandle(handle);
-    handle = NULL;
 #else
     close(handle);
-    handle = -1;
 #endif
+    handle = kInvalidPipe;
 }
 
 // ProcessUtils implementation
@@ -467,16 +692,10 @@ bool ProcessUtils::execute(const std::string& executable,
         return false;
     }
     
+    // Until the child closes its output (normally by exiting)
     output.clear();
     std::string chunk;
-    while (process.is_running()) {
-        if (process.read_stdout(chunk, 10)) {
-            output += chunk;
-        }
-    }
-    
-    // Read remaining output
-    while (process.read_stdout(chunk, 0)) {
+    while (process.read_stdout(chunk, -1)) {
         output += chunk;
     }
     
@@ -569,22 +788,30 @@ bool ProcessUtils::parse_command_line(const std::string& command_line,
 }
 
 std::string ProcessUtils::escape_argument(const std::string& arg) {
-    if (arg.find(' ') == std::string::npos && 
-        arg.find('"') == std::string::npos &&
-        arg.find('\'') == std::string::npos) {
+    if (!arg.empty() &&
+        arg.find_first_of(" \t\"'") == std::string::npos) {
         return arg;
     }
     
+    // The rules the Windows C runtime splits a command line by: backslashes
+    // are literal unless a quote follows them, so only a run before a quote
+    // (or before the closing quote) is doubled
     std::string escaped = "\"";
+    size_t backslashes = 0;
     for (char c : arg) {
+        if (c == '\\') {
+            ++backslashes;
+            continue;
+        }
         if (c == '"') {
-            escaped += "\\\"";
-        } else if (c == '\\') {
-            escaped += "\\\\";
+            escaped.append(backslashes * 2 + 1, '\\');
         } else {
-            escaped += c;
+            escaped.append(backslashes, '\\');
         }
+        backslashes = 0;
+        escaped += c;
     }
+    escaped.append(backslashes * 2, '\\');
     escaped += "\"";
     return escaped;
 }
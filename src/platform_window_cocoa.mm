@@ -177,6 +177,14 @@ public:
         }
     }
 
+    void request_redraw_area(const Rect& area) override {
+        @autoreleasepool {
+            if (view_) {
+                [view_ setNeedsDisplayInRect:NSMakeRect(area.x, area.y, area.width, area.height)];
+            }
+        }
+    }
+
     void* get_graphics_context() override {
         return graphics_context_;
     }
@@ -8,7 +8,11 @@
 #include <gdk/gdk.h>
 #include <cairo/cairo.h>
 #include <pango/pango.h>
+#include <pango/pangocairo.h>
+#include <algorithm>
+#include <list>
 #include <memory>
+#include <string_view>
 #include <unordered_map>
 #include <cstring>
 
@@ -23,8 +27,9 @@ public:
         : window_(nullptr)
         , drawing_area_(nullptr)
         , cairo_context_(nullptr)
-        , pango_layout_(nullptr)
+        , pango_context_(nullptr)
         , current_font_(nullptr)
+        , back_buffer_(nullptr)
         , width_(0)
         , height_(0)
         , in_paint_(false) {
@@ -83,9 +88,14 @@ public:
             current_font_ = nullptr;
         }
 
-        if (pango_layout_) {
-            g_object_unref(pango_layout_);
-            pango_layout_ = nullptr;
+        clear_layouts();
+        if (pango_context_) {
+            g_object_unref(pango_context_);
+            pango_context_ = nullptr;
+        }
+        if (back_buffer_) {
+            cairo_surface_destroy(back_buffer_);
+            back_buffer_ = nullptr;
         }
 
         if (window_) {
@@ -143,6 +153,26 @@ public:
     }
 
     void request_redraw() override {
+        full_damage_ = true;
+        if (drawing_area_) {
+            gtk_widget_queue_draw(drawing_area_);
+        }
+    }
+
+    // GTK4 dropped gtk_widget_queue_draw_area: the widget is always drawn
+    // whole, so the area is kept here and on_draw repaints only it into
+    // the back buffer
+    void request_redraw_area(const Rect& area) override {
+        if (area.width <= 0 || area.height <= 0) return;
+        if (damage_.width <= 0 || damage_.height <= 0) {
+            damage_ = area;
+        } else {
+            int left = (std::min)(damage_.x, area.x);
+            int top = (std::min)(damage_.y, area.y);
+            int right = (std::max)(damage_.x + damage_.width, area.x + area.width);
+            int bottom = (std::max)(damage_.y + damage_.height, area.y + area.height);
+            damage_ = Rect(left, top, right - left, bottom - top);
+        }
         if (drawing_area_) {
             gtk_widget_queue_draw(drawing_area_);
         }
@@ -178,33 +208,26 @@ public:
     }
 
     void set_font(PlatformFont font) override {
+        auto* desc = static_cast<PangoFontDescription*>(font);
+        if (current_font_ && pango_font_description_equal(current_font_, desc)) return;
         if (current_font_) {
             pango_font_description_free(current_font_);
         }
-        current_font_ = pango_font_description_copy(static_cast<PangoFontDescription*>(font));
+        current_font_ = pango_font_description_copy(desc);
+        // Cached layouts stay keyed by the font they were shaped with
+        char* name = pango_font_description_to_string(current_font_);
+        font_key_ = name;
+        font_key_ += '\0';
+        g_free(name);
     }
 
     Size measure_text(const std::string& text) override {
-        if (!cairo_context_ || !current_font_) {
+        if (!current_font_) {
             return Size{0, 0};
         }
 
-        // Create temporary layout if needed
-        PangoLayout* layout = pango_layout_;
-        if (!layout) {
-            layout = pango_cairo_create_layout(cairo_context_);
-        }
-
-        pango_layout_set_font_description(layout, current_font_);
-        pango_layout_set_text(layout, text.c_str(), -1);
-
         int w, h;
-        pango_layout_get_pixel_size(layout, &w, &h);
-
-        if (layout != pango_layout_) {
-            g_object_unref(layout);
-        }
-
+        pango_layout_get_pixel_size(layout_for(text), &w, &h);
         return Size{w, h};
     }
 
@@ -241,12 +264,7 @@ public:
     void draw_text(const std::string& text, int x, int y, const Color& color) override {
         if (!cairo_context_ || !current_font_) return;
 
-        if (!pango_layout_) {
-            pango_layout_ = pango_cairo_create_layout(cairo_context_);
-        }
-
-        pango_layout_set_font_description(pango_layout_, current_font_);
-        pango_layout_set_text(pango_layout_, text.c_str(), -1);
+        PangoLayout* layout = layout_for(text);
 
         cairo_set_source_rgba(cairo_context_,
             color.r / 255.0,
@@ -256,7 +274,7 @@ public:
         );
 
         cairo_move_to(cairo_context_, x, y);
-        pango_cairo_show_layout(cairo_context_, pango_layout_);
+        pango_cairo_show_layout(cairo_context_, layout);
     }
 
     void draw_line(int x1, int y1, int x2, int y2, const Color& color) override {
@@ -378,25 +396,68 @@ private:
 
     // Event handlers
     void on_draw(cairo_t* cr, int width, int height) {
-        cairo_context_ = cr;
+        // GTK4 gives a fresh surface every frame: the pixels outside the
+        // damage come from the back buffer, which is all that is repainted
+        if (!back_buffer_ || width != width_ || height != height_) {
+            if (back_buffer_) cairo_surface_destroy(back_buffer_);
+            back_buffer_ = cairo_surface_create_similar(cairo_get_target(cr), CAIRO_CONTENT_COLOR_ALPHA, width, height);
+            full_damage_ = true;
+        }
         width_ = width;
         height_ = height;
+        // A draw nobody asked for (first map, theme change) repaints it all
+        bool partial = !full_damage_ && damage_.width > 0 && damage_.height > 0;
+        PaintEvent event;
+        event.damaged_rect = partial ? damage_ : Rect(0, 0, width, height);
+        full_damage_ = false;
+        damage_ = Rect();
 
         if (on_paint) {
-            PaintEvent event;
+            cairo_t* buffer = cairo_create(back_buffer_);
+            cairo_rectangle(buffer, event.damaged_rect.x, event.damaged_rect.y,
+                            event.damaged_rect.width, event.damaged_rect.height);
+            cairo_clip(buffer);
+            if (pango_context_) pango_cairo_update_context(buffer, pango_context_);
+            cairo_context_ = buffer;
             on_paint(event);
+            cairo_context_ = nullptr;
+            cairo_destroy(buffer);
         }
+        cairo_set_source_surface(cr, back_buffer_, 0, 0);
+        cairo_paint(cr);
+    }
 
-        // GPU renderer test (stub)
-        if (gpu_renderer_) {
-            gpu_renderer_->begin_frame();
-            gpu_renderer_->draw_rect(10, 10, 200, 100, 0xFF00FF00); // Green rect
-            gpu_renderer_->draw_text("GPU Test", 30, 50, 0xFFFFFFFF); // White text
-            gpu_renderer_->draw_line(10, 10, 210, 110, 0xFFFF0000); // Red line
-            gpu_renderer_->end_frame();
-            gpu_renderer_->present();
+    // The layout of text in the current font, shaped once and kept while
+    // it is among the kLayoutCacheSize most recently drawn: a line drawn
+    // again is not itemized and shaped again. Color is the cairo source,
+    // not an attribute, so the same layout serves every color.
+    PangoLayout* layout_for(const std::string& text) {
+        if (!pango_context_) {
+            pango_context_ = pango_font_map_create_context(pango_cairo_font_map_get_default());
         }
-        cairo_context_ = nullptr;
+        std::string key = font_key_ + text;
+        auto found = layout_index_.find(key);
+        if (found != layout_index_.end()) {
+            layouts_.splice(layouts_.begin(), layouts_, found->second);
+            return found->second->layout;
+        }
+        PangoLayout* layout = pango_layout_new(pango_context_);
+        pango_layout_set_font_description(layout, current_font_);
+        pango_layout_set_text(layout, text.data(), (int)text.size());
+        layouts_.push_front(CachedLayout{ std::move(key), layout });
+        layout_index_.emplace(layouts_.front().key, layouts_.begin());
+        if (layouts_.size() > kLayoutCacheSize) {
+            layout_index_.erase(layouts_.back().key);
+            g_object_unref(layouts_.back().layout);
+            layouts_.pop_back();
+        }
+        return layout;
+    }
+
+    void clear_layouts() {
+        for (auto& cached : layouts_) g_object_unref(cached.layout);
+        layout_index_.clear();
+        layouts_.clear();
     }
 
     bool handle_key_event(guint keyval, guint keycode, GdkModifierType state, bool pressed) {
@@ -515,8 +576,20 @@ private:
     GtkWidget* window_;
     GtkWidget* drawing_area_;
     cairo_t* cairo_context_;
-    PangoLayout* pango_layout_;
+    PangoContext* pango_context_;
     PangoFontDescription* current_font_;
+    std::string font_key_;              // Description string of current_font_, NUL-terminated
+    // Shaped layouts by font key + text, most recently drawn first
+    struct CachedLayout {
+        std::string key;
+        PangoLayout* layout;
+    };
+    std::list<CachedLayout> layouts_;
+    std::unordered_map<std::string_view, std::list<CachedLayout>::iterator> layout_index_;
+    static constexpr size_t kLayoutCacheSize = 1024;
+    cairo_surface_t* back_buffer_;
+    Rect damage_;                       // Asked for since the last draw
+    bool full_damage_ = true;
     int width_;
     int height_;
     bool in_paint_;
@@ -31,6 +31,7 @@ public:
     void run_event_loop() override;
     void process_events() override;
     void request_redraw() override;
+    void request_redraw_area(const Rect& area) override;
     
     PlatformGraphicsContext get_graphics_context() override;
     void begin_paint() override;
@@ -199,6 +200,13 @@ void Win32Window::request_redraw() {
     }
 }
 
+void Win32Window::request_redraw_area(const Rect& area) {
+    if (hwnd_) {
+        RECT rect{ area.x, area.y, area.x + area.width, area.y + area.height };
+        InvalidateRect(hwnd_, &rect, FALSE);
+    }
+}
+
 PlatformGraphicsContext Win32Window::get_graphics_context() {
     return in_paint_ ? ps_.hdc : hdc_;
 }
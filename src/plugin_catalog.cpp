@@ -0,0 +1,302 @@
+#include "plugin_catalog.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace editor {
+
+namespace {
+
+const char kCacheHeader[] = "velocity-plugin-cache 2";
+
+// Bounds-checked reads from a module's bytes; every read fails once one has
+struct ModuleReader {
+    const uint8_t* p;
+    const uint8_t* end;
+    bool ok = true;
+
+    bool byte(uint8_t& value) {
+        if (!ok || p >= end) return ok = false;
+        value = *p++;
+        return true;
+    }
+    bool leb_u32(uint32_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            uint8_t b;
+            if (!byte(b)) return false;
+            value |= static_cast<uint32_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return ok = false;
+    }
+    bool name(std::string& value) {
+        uint32_t length;
+        if (!leb_u32(length)) return false;
+        if (static_cast<size_t>(end - p) < length) return ok = false;
+        value.assign(reinterpret_cast<const char*>(p), length);
+        p += length;
+        return true;
+    }
+};
+
+void split_words(const char* data, size_t size, const char* separators, std::vector<std::string>& words) {
+    size_t start = 0;
+    for (size_t i = 0; i <= size; ++i) {
+        if (i == size || std::strchr(separators, data[i]) || data[i] == '\0') {
+            if (i > start) words.emplace_back(data + start, i - start);
+            start = i + 1;
+        }
+    }
+}
+
+std::string join(const std::vector<std::string>& words) {
+    std::string text;
+    for (const std::string& word : words) {
+        if (!text.empty()) text += ',';
+        text += word;
+    }
+    return text;
+}
+
+} // namespace
+
+bool PluginDescriptor::loads_at_startup() const {
+    return activation_events.empty() ||
+           std::find(activation_events.begin(), activation_events.end(), "*") != activation_events.end();
+}
+
+bool PluginDescriptor::activated_by(const std::string& event) const {
+    return std::find(activation_events.begin(), activation_events.end(), event) != activation_events.end();
+}
+
+PluginCatalog::PluginCatalog(std::string cache_path)
+    : cache_path_(std::move(cache_path)) {}
+
+uint64_t PluginCatalog::hash_bytes(const uint8_t* data, size_t size) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+bool PluginCatalog::inspect_module(const uint8_t* data, size_t size, PluginDescriptor& descriptor) {
+    static const uint8_t kMagic[] = {0x00, 0x61, 0x73, 0x6d};
+    descriptor.valid = false;
+    descriptor.exports.clear();
+    descriptor.activation_events.clear();
+    descriptor.engine = WasmEngineKind::Interpreter;
+    if (size < 8 || std::memcmp(data, kMagic, 4) != 0) {
+        descriptor.error = "Not a WebAssembly module";
+        return false;
+    }
+    if (data[4] != 1 || data[5] != 0 || data[6] != 0 || data[7] != 0) {
+        descriptor.error = "Unsupported WebAssembly version";
+        return false;
+    }
+
+    ModuleReader module{data + 8, data + size};
+    while (module.p < module.end) {
+        uint8_t id;
+        uint32_t section_size;
+        if (!module.byte(id) || !module.leb_u32(section_size) ||
+            static_cast<size_t>(module.end - module.p) < section_size) {
+            descriptor.error = "Truncated section";
+            return false;
+        }
+        if (id > 13) {
+            descriptor.error = "Unknown section id " + std::to_string(id);
+            return false;
+        }
+        ModuleReader section{module.p, module.p + section_size};
+        module.p += section_size;
+        if (id == 0) {
+            std::string name;
+            if (!section.name(name)) {
+                descriptor.error = "Malformed custom section";
+                return false;
+            }
+            if (name == kActivationSection) {
+                split_words(reinterpret_cast<const char*>(section.p), static_cast<size_t>(section.end - section.p),
+                            " \t\r\n,", descriptor.activation_events);
+            } else if (name == kEngineSection) {
+                std::vector<std::string> words;
+                split_words(reinterpret_cast<const char*>(section.p), static_cast<size_t>(section.end - section.p),
+                            " \t\r\n", words);
+                if (words.size() != 1 || !parse_wasm_engine(words[0], descriptor.engine)) {
+                    descriptor.error = "Unknown engine in " + std::string(kEngineSection);
+                    return false;
+                }
+            }
+        } else if (id == 7) {
+            uint32_t count = 0;
+            section.leb_u32(count);
+            for (uint32_t i = 0; i < count && section.ok; ++i) {
+                std::string name;
+                uint8_t kind = 0;
+                uint32_t index = 0;
+                if (section.name(name) && section.byte(kind) && section.leb_u32(index) && kind == 0) {
+                    descriptor.exports.push_back(std::move(name));
+                }
+            }
+            if (!section.ok) {
+                descriptor.error = "Malformed export section";
+                return false;
+            }
+        }
+    }
+    descriptor.error.clear();
+    descriptor.valid = true;
+    return true;
+}
+
+void PluginCatalog::describe(const std::string& path, PluginDescriptor& descriptor) const {
+    descriptor.path = path;
+    descriptor.id = fs::path(path).stem().string();
+    std::error_code code;
+    descriptor.size = fs::file_size(path, code);
+    descriptor.mtime = static_cast<int64_t>(fs::last_write_time(path, code).time_since_epoch().count());
+    if (code) {
+        descriptor.error = "Cannot stat " + path;
+        return;
+    }
+
+    auto fill = [&](const Entry& entry) {
+        descriptor.hash = entry.hash;
+        descriptor.valid = entry.valid;
+        descriptor.error = entry.error;
+        descriptor.activation_events = entry.activation_events;
+        descriptor.exports = entry.exports;
+        descriptor.engine = entry.engine;
+        descriptor.from_cache = true;
+    };
+    // Unchanged since the cache entry was written: not even read
+    auto known = by_path_.find(path);
+    if (known != by_path_.end() && known->second.size == descriptor.size && known->second.mtime == descriptor.mtime) {
+        fill(known->second);
+        return;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    std::vector<uint8_t> bytes(static_cast<size_t>(descriptor.size));
+    if (!file || !file.read(reinterpret_cast<char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()))) {
+        descriptor.error = "Cannot read " + path;
+        return;
+    }
+    descriptor.hash = hash_bytes(bytes.data(), bytes.size());
+    auto same = by_hash_.find(descriptor.hash);
+    if (same != by_hash_.end()) {
+        fill(same->second);
+        return;
+    }
+    inspect_module(bytes.data(), bytes.size(), descriptor);
+}
+
+std::vector<PluginDescriptor> PluginCatalog::scan(const std::string& directory, ThreadPool& pool) {
+    load();
+    std::vector<std::string> paths;
+    std::error_code code;
+    for (auto it = fs::recursive_directory_iterator(directory, code); !code && it != fs::recursive_directory_iterator();
+         it.increment(code)) {
+        if (it->is_regular_file(code) && it->path().extension() == ".wasm") {
+            paths.push_back(it->path().string());
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+
+    // Each task writes only its own descriptor and reads the cache, which
+    // is not changed until they are all done
+    std::vector<PluginDescriptor> descriptors(paths.size());
+    TaskGroup tasks(pool);
+    for (size_t i = 0; i < paths.size(); ++i) {
+        tasks.submit([this, &paths, &descriptors, i] { describe(paths[i], descriptors[i]); });
+    }
+    tasks.wait();
+
+    for (const PluginDescriptor& descriptor : descriptors) {
+        if (descriptor.hash == 0 && !descriptor.valid) continue;   // Not read
+        Entry entry;
+        entry.path = descriptor.path;
+        entry.size = descriptor.size;
+        entry.mtime = descriptor.mtime;
+        entry.hash = descriptor.hash;
+        entry.valid = descriptor.valid;
+        entry.error = descriptor.error;
+        entry.activation_events = descriptor.activation_events;
+        entry.exports = descriptor.exports;
+        entry.engine = descriptor.engine;
+        auto known = by_path_.find(entry.path);
+        if (known == by_path_.end() || known->second.hash != entry.hash || known->second.mtime != entry.mtime ||
+            known->second.size != entry.size) {
+            dirty_ = true;
+        }
+        by_hash_[entry.hash] = entry;
+        by_path_[entry.path] = std::move(entry);
+    }
+    return descriptors;
+}
+
+void PluginCatalog::load() {
+    if (loaded_) return;
+    loaded_ = true;
+    if (cache_path_.empty()) return;
+    std::ifstream file(cache_path_);
+    std::string line;
+    if (!std::getline(file, line) || line != kCacheHeader) return;
+    while (std::getline(file, line)) {
+        std::vector<std::string> fields;
+        size_t start = 0;
+        for (size_t tab = line.find('\t'); fields.size() < 8; tab = line.find('\t', start)) {
+            if (tab == std::string::npos) break;
+            fields.push_back(line.substr(start, tab - start));
+            start = tab + 1;
+        }
+        if (fields.size() != 8) continue;
+        fields.push_back(line.substr(start));
+        Entry entry;
+        entry.path = fields[0];
+        entry.size = std::strtoull(fields[1].c_str(), nullptr, 10);
+        entry.mtime = std::strtoll(fields[2].c_str(), nullptr, 10);
+        entry.hash = std::strtoull(fields[3].c_str(), nullptr, 16);
+        entry.valid = fields[4] == "1";
+        split_words(fields[5].data(), fields[5].size(), ",", entry.activation_events);
+        split_words(fields[6].data(), fields[6].size(), ",", entry.exports);
+        if (!parse_wasm_engine(fields[7], entry.engine)) continue;
+        entry.error = fields[8];
+        by_hash_[entry.hash] = entry;
+        by_path_[entry.path] = std::move(entry);
+    }
+}
+
+bool PluginCatalog::save() {
+    if (cache_path_.empty() || !dirty_) return true;
+    std::string temp = cache_path_ + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::trunc);
+        if (!file) return false;
+        file << kCacheHeader << '\n';
+        for (const auto& pair : by_path_) {
+            const Entry& entry = pair.second;
+            std::ostringstream hash;
+            hash << std::hex << entry.hash;
+            file << entry.path << '\t' << entry.size << '\t' << entry.mtime << '\t' << hash.str() << '\t'
+                 << (entry.valid ? 1 : 0) << '\t' << join(entry.activation_events) << '\t' << join(entry.exports)
+                 << '\t' << wasm_engine_name(entry.engine) << '\t' << entry.error << '\n';
+        }
+        if (!file) return false;
+    }
+    std::error_code code;
+    fs::rename(temp, cache_path_, code);
+    if (code) return false;
+    dirty_ = false;
+    return true;
+}
+
+} // namespace editor
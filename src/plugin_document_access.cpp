@@ -0,0 +1,130 @@
+#include "plugin_document_access.h"
+#include "piece_table.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace editor {
+
+namespace {
+
+bool read_u32(const uint8_t*& data, const uint8_t* end, uint32_t& value) {
+    if (end - data < 4) return false;
+    value = 0;
+    for (int i = 3; i >= 0; --i) value = (value << 8) | data[i];
+    data += 4;
+    return true;
+}
+
+bool read_u64(const uint8_t*& data, const uint8_t* end, uint64_t& value) {
+    if (end - data < 8) return false;
+    value = 0;
+    for (int i = 7; i >= 0; --i) value = (value << 8) | data[i];
+    data += 8;
+    return true;
+}
+
+void write_le(std::vector<uint8_t>& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+} // namespace
+
+size_t PluginDocumentAccess::copy_range(const PieceTable& document, size_t position, size_t length, char* out,
+                                        size_t capacity) {
+    size_t total = document.get_total_length();
+    if (position >= total) return 0;
+    length = (std::min)({length, total - position, capacity});
+    size_t written = 0;
+    for (auto chunk = document.chunks(position, length); !chunk.done(); ++chunk) {
+        std::string_view view = *chunk;
+        std::memcpy(out + written, view.data(), view.size());
+        written += view.size();
+    }
+    return written;
+}
+
+size_t PluginDocumentAccess::copy_lines(const PieceTable& document, size_t first_line, size_t line_count,
+                                        char* out, size_t capacity, size_t& lines_copied) {
+    lines_copied = 0;
+    size_t available = document.get_line_count();
+    if (first_line >= available) return 0;
+    line_count = (std::min)(line_count, available - first_line);
+
+    // The most lines that fit: line starts grow with the line number, so
+    // search for the last end offset within capacity
+    size_t start = document.get_line_start(first_line);
+    size_t low = 0, high = line_count;
+    while (low < high) {
+        size_t mid = low + (high - low + 1) / 2;
+        if (document.get_line_start(first_line + mid) - start <= capacity) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    if (low == 0) return 0;
+    lines_copied = low;
+    size_t end = document.get_line_start(first_line + low);
+    return copy_range(document, start, end - start, out, capacity);
+}
+
+bool PluginDocumentAccess::decode_edits(const uint8_t* data, size_t size, std::vector<TextEdit>& edits) {
+    const uint8_t* end = data + size;
+    uint32_t count = 0;
+    if (!read_u32(data, end, count)) return false;
+    // Each edit takes at least 20 bytes; a count the data cannot hold is
+    // rejected before anything is reserved for it
+    if (count > static_cast<size_t>(end - data) / 20) return false;
+    edits.clear();
+    edits.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        uint64_t position = 0, length = 0;
+        uint32_t text_size = 0;
+        if (!read_u64(data, end, position) || !read_u64(data, end, length) || !read_u32(data, end, text_size) ||
+            static_cast<size_t>(end - data) < text_size) {
+            edits.clear();
+            return false;
+        }
+        TextEdit edit;
+        edit.position = static_cast<size_t>(position);
+        edit.length = static_cast<size_t>(length);
+        edit.text.assign(reinterpret_cast<const char*>(data), text_size);
+        data += text_size;
+        edits.push_back(std::move(edit));
+    }
+    return true;
+}
+
+void PluginDocumentAccess::encode_edits(const std::vector<TextEdit>& edits, std::vector<uint8_t>& out) {
+    write_le(out, edits.size(), 4);
+    for (const TextEdit& edit : edits) {
+        write_le(out, edit.position, 8);
+        write_le(out, edit.length, 8);
+        write_le(out, edit.text.size(), 4);
+        out.insert(out.end(), edit.text.begin(), edit.text.end());
+    }
+}
+
+bool PluginDocumentAccess::apply_edits(PieceTable& document, const std::vector<TextEdit>& edits) {
+    size_t total = document.get_total_length();
+    size_t previous_end = 0;
+    for (const TextEdit& edit : edits) {
+        if (edit.position < previous_end || edit.position > total || edit.length > total - edit.position) {
+            return false;
+        }
+        previous_end = edit.position + edit.length;
+    }
+    if (edits.empty()) return true;
+
+    // Back to front, so earlier offsets stay valid
+    document.begin_transaction();
+    for (auto it = edits.rbegin(); it != edits.rend(); ++it) {
+        if (it->length > 0) document.remove(it->position, it->length);
+        if (!it->text.empty()) document.insert(it->position, it->text);
+    }
+    document.commit_transaction();
+    return true;
+}
+
+} // namespace editor
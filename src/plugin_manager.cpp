@@ -1,4 +1,5 @@
 #include "plugin_manager.h"
+#include "thread_pool.h"
 #include <filesystem>
 #include <algorithm>
 
@@ -6,13 +7,34 @@ namespace fs = std::filesystem;
 
 namespace editor {
 
+namespace {
+
+const char* event_name(EditorEvent event) {
+    switch (event) {
+        case EditorEvent::DocumentOpened: return "DocumentOpened";
+        case EditorEvent::DocumentClosed: return "DocumentClosed";
+        case EditorEvent::DocumentChanged: return "DocumentChanged";
+        case EditorEvent::DocumentSaved: return "DocumentSaved";
+        case EditorEvent::SelectionChanged: return "SelectionChanged";
+        case EditorEvent::CursorMoved: return "CursorMoved";
+        case EditorEvent::ThemeChanged: return "ThemeChanged";
+        case EditorEvent::SettingsChanged: return "SettingsChanged";
+    }
+    return "";
+}
+
+} // namespace
+
 // Plugin implementation
-Plugin::Plugin(const std::string& id, const std::string& path)
+Plugin::Plugin(const std::string& id, const std::string& path, const PluginBudget& budget, WasmEngineKind engine)
     : path_(path)
     , runtime_(nullptr)
+    , budget_(budget)
     , activated_(false)
+    , handles_events_(false)
 {
     metadata_.id = id;
+    metadata_.engine = engine;
 }
 
 Plugin::~Plugin() {
@@ -31,7 +53,7 @@ bool Plugin::load() {
     }
 
     // Create WASM runtime
-    runtime_ = std::make_unique<WasmRuntime>();
+    runtime_ = std::make_shared<WasmRuntime>(metadata_.engine);
     
     // Initialize with 64KB stack
     if (!runtime_->initialize(64 * 1024)) {
@@ -39,6 +61,7 @@ bool Plugin::load() {
         runtime_.reset();
         return false;
     }
+    metadata_.engine = runtime_->engine();
 
     // Load WASM module
     if (!runtime_->load_module(path_)) {
@@ -62,6 +85,22 @@ bool Plugin::load() {
     metadata_.capabilities = PluginCapability::DocumentManipulation | 
                             PluginCapability::UIContributions |
                             PluginCapability::CommandRegistration;
+    handles_events_ = runtime_->find_function("plugin_on_event") != nullptr;
+    if (handles_events_) {
+        metadata_.capabilities = metadata_.capabilities | PluginCapability::EventListeners;
+    }
+
+    // From here on the runtime belongs to the worker's thread
+    std::shared_ptr<WasmRuntime> runtime = runtime_;
+    worker_ = std::make_unique<PluginWorker>(
+        [runtime](const std::string& func, const std::vector<int64_t>& args, int64_t* result, std::string& error) {
+            if (runtime->call_function(func, args, result)) {
+                return true;
+            }
+            error = runtime->get_error();
+            return false;
+        },
+        budget_);
 
     error_message_.clear();
     return true;
@@ -104,10 +143,11 @@ bool Plugin::unload() {
         deactivate();
     }
 
-    if (runtime_) {
-        runtime_->reset();
-        runtime_.reset();
-    }
+    // The worker's thread is detached if a call hung; the runtime is
+    // freed with the last reference to it, which may be that thread's
+    worker_.reset();
+    runtime_.reset();
+    handles_events_ = false;
 
     error_message_.clear();
     return true;
@@ -119,22 +159,42 @@ bool Plugin::call_function(const std::string& func_name, const std::vector<int64
         return false;
     }
 
-    bool success = runtime_->call_function(func_name, args, result);
+    std::string error;
+    bool success;
+    if (worker_) {
+        success = worker_->call(func_name, args, result, error);
+    } else {
+        success = runtime_->call_function(func_name, args, result);
+        error = runtime_->get_error();
+    }
     if (!success) {
         // Not all functions need to exist, so don't set error for missing functions
-        if (runtime_->get_error().find("Failed to find function") == std::string::npos) {
-            set_error(runtime_->get_error());
+        if (error.find("Failed to find function") == std::string::npos) {
+            set_error(error);
         }
     }
     
     return success;
 }
 
+bool Plugin::post_call(const std::string& func_name, const std::vector<int64_t>& args, uint64_t coalesce_key) {
+    if (!worker_) {
+        set_error("Plugin not loaded");
+        return false;
+    }
+    return worker_->post(func_name, args, coalesce_key);
+}
+
+PluginMetrics Plugin::metrics() const {
+    return worker_ ? worker_->metrics() : PluginMetrics();
+}
+
 const std::string& Plugin::get_error() const {
     if (!error_message_.empty()) {
         return error_message_;
     }
-    if (runtime_) {
+    // While the worker runs, the runtime's error belongs to its thread
+    if (runtime_ && !worker_) {
         return runtime_->get_error();
     }
     static const std::string empty;
@@ -191,7 +251,7 @@ std::vector<std::string> PluginManager::scan_plugins(const std::string& director
     return found_plugins;
 }
 
-bool PluginManager::load_plugin(const std::string& path) {
+bool PluginManager::load_plugin(const std::string& path, WasmEngineKind engine) {
     if (!initialized_) {
         set_error("PluginManager not initialized");
         return false;
@@ -208,7 +268,7 @@ bool PluginManager::load_plugin(const std::string& path) {
     }
 
     // Create and load plugin
-    auto plugin = std::make_unique<Plugin>(plugin_id, path);
+    auto plugin = std::make_unique<Plugin>(plugin_id, path, budget_, engine);
     if (!plugin->load()) {
         set_error("Failed to load plugin: " + plugin->get_error());
         return false;
@@ -231,6 +291,78 @@ bool PluginManager::load_plugin(const std::string& path) {
     return true;
 }
 
+size_t PluginManager::discover_plugins(const std::string& directory) {
+    if (!initialized_) {
+        set_error("PluginManager not initialized");
+        return 0;
+    }
+    if (!fs::is_directory(directory)) {
+        set_error("Plugin directory does not exist: " + directory);
+        return 0;
+    }
+
+    ThreadPool& pool = ThreadPool::shared();
+    if (!catalog_) {
+        catalog_ = std::make_unique<PluginCatalog>(cache_path_);
+    }
+    std::vector<PluginDescriptor> descriptors = catalog_->scan(directory, pool);
+    catalog_->save();
+
+    std::vector<std::unique_ptr<Plugin>> startup;
+    for (PluginDescriptor& descriptor : descriptors) {
+        if (!descriptor.valid) {
+            set_error("Invalid plugin " + descriptor.path + ": " + descriptor.error);
+            continue;
+        }
+        if (plugins_.count(descriptor.id) || pending_.count(descriptor.id)) {
+            continue;
+        }
+        if (descriptor.loads_at_startup()) {
+            startup.push_back(std::make_unique<Plugin>(descriptor.id, descriptor.path, budget_, descriptor.engine));
+        } else {
+            pending_[descriptor.id] = std::move(descriptor);
+        }
+    }
+
+    // Each plugin has a runtime of its own, so they load side by side
+    std::vector<char> loaded(startup.size(), 0);
+    TaskGroup loads(pool);
+    for (size_t i = 0; i < startup.size(); ++i) {
+        loads.submit([&startup, &loaded, i] { loaded[i] = startup[i]->load(); });
+    }
+    loads.wait();
+
+    for (size_t i = 0; i < startup.size(); ++i) {
+        if (!loaded[i]) {
+            set_error("Failed to load plugin: " + startup[i]->get_error());
+            continue;
+        }
+        if (!validate_plugin(startup[i].get())) {
+            continue;
+        }
+        std::string plugin_id = startup[i]->id();
+        plugins_[plugin_id] = std::move(startup[i]);
+        activate_plugin(plugin_id);
+    }
+    return descriptors.size();
+}
+
+size_t PluginManager::trigger_activation(const std::string& event) {
+    size_t activated = 0;
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        if (!it->second.activated_by(event)) {
+            ++it;
+            continue;
+        }
+        PluginDescriptor descriptor = std::move(it->second);
+        it = pending_.erase(it);
+        if (load_plugin(descriptor.path, descriptor.engine) && activate_plugin(descriptor.id)) {
+            activated++;
+        }
+    }
+    return activated;
+}
+
 bool PluginManager::unload_plugin(const std::string& plugin_id) {
     auto it = plugins_.find(plugin_id);
     if (it == plugins_.end()) {
@@ -316,6 +448,38 @@ bool PluginManager::is_plugin_activated(const std::string& plugin_id) const {
     return it != plugins_.end() && it->second->is_activated();
 }
 
+size_t PluginManager::dispatch_event(EditorEvent event, int64_t argument) {
+    if (!pending_.empty()) {
+        trigger_activation(std::string("onEvent:") + event_name(event));
+    }
+    size_t queued = 0;
+    for (auto& pair : plugins_) {
+        Plugin& plugin = *pair.second;
+        if (!plugin.is_activated() || !plugin.handles_events()) {
+            continue;
+        }
+        uint64_t coalesce_key = static_cast<uint64_t>(event) + 1;
+        if (plugin.post_call("plugin_on_event", {static_cast<int64_t>(event), argument}, coalesce_key)) {
+            queued++;
+        }
+    }
+    return queued;
+}
+
+size_t PluginManager::dispatch_events(const EventBatch& batch) {
+    int64_t counts[static_cast<int>(EditorEvent::SettingsChanged) + 1] = {};
+    for (const EventRecord& record : batch) {
+        counts[static_cast<int>(record.type)]++;
+    }
+    size_t queued = 0;
+    for (int type = 0; type <= static_cast<int>(EditorEvent::SettingsChanged); ++type) {
+        if (counts[type] > 0) {
+            queued += dispatch_event(static_cast<EditorEvent>(type), counts[type]);
+        }
+    }
+    return queued;
+}
+
 void PluginManager::set_error(const std::string& error) {
     error_message_ = error;
 }
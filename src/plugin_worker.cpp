@@ -0,0 +1,222 @@
+#include "plugin_worker.h"
+#include "trace.h"
+#include <algorithm>
+
+namespace editor {
+
+struct PluginWorker::Completion {
+    bool done = false;
+    bool ok = false;
+    int64_t result = 0;
+    std::string error;
+};
+
+// Everything the thread touches, so a detached thread never outlives it
+struct PluginWorker::Shared {
+    InvokeFn invoke;
+    PluginBudget budget;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;           // A call finished, or the plugin was disabled
+    std::deque<Task> queue;
+    bool stopping = false;
+    bool running_call = false;
+    std::chrono::steady_clock::time_point call_started;
+    int strikes = 0;                        // Overruns since throttling last ended
+    int good_streak = 0;                    // Calls within budget while throttled
+    PluginMetrics metrics;
+};
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+} // namespace
+
+PluginWorker::PluginWorker(InvokeFn invoke, PluginBudget budget)
+    : shared_(std::make_shared<Shared>()) {
+    shared_->invoke = std::move(invoke);
+    shared_->budget = budget;
+    thread_ = std::thread(&PluginWorker::worker_loop, shared_);
+}
+
+PluginWorker::~PluginWorker() {
+    stop();
+}
+
+bool PluginWorker::post(const std::string& func, const std::vector<int64_t>& args, uint64_t coalesce_key) {
+    std::lock_guard<std::mutex> lock(shared_->mutex);
+    check_hung(*shared_);
+    PluginMetrics& metrics = shared_->metrics;
+    if (shared_->stopping || metrics.state == PluginState::Disabled) {
+        metrics.dropped++;
+        return false;
+    }
+    if (coalesce_key != 0) {
+        for (Task& task : shared_->queue) {
+            if (task.coalesce_key == coalesce_key) {
+                task.func = func;
+                task.args = args;
+                metrics.coalesced++;
+                return true;
+            }
+        }
+    }
+    if (shared_->queue.size() >= shared_->budget.max_queue) {
+        metrics.dropped++;
+        return false;
+    }
+    shared_->queue.push_back(Task{func, args, coalesce_key, nullptr});
+    shared_->wake.notify_one();
+    return true;
+}
+
+bool PluginWorker::call(const std::string& func, const std::vector<int64_t>& args, int64_t* result,
+                        std::string& error) {
+    auto completion = std::make_shared<Completion>();
+    std::unique_lock<std::mutex> lock(shared_->mutex);
+    check_hung(*shared_);
+    if (shared_->stopping || shared_->metrics.state == PluginState::Disabled) {
+        error = "Plugin disabled";
+        return false;
+    }
+    shared_->queue.push_back(Task{func, args, 0, completion});
+    shared_->wake.notify_one();
+
+    // Wake now and then to notice a hung call: nothing else would
+    auto poll = (std::max)(shared_->budget.hang_time / 4, std::chrono::milliseconds(1));
+    while (!completion->done) {
+        if (shared_->metrics.state == PluginState::Disabled) {
+            error = "Plugin disabled: a call ran longer than " +
+                    std::to_string(shared_->budget.hang_time.count()) + "ms";
+            return false;
+        }
+        shared_->done.wait_for(lock, poll);
+        check_hung(*shared_);
+    }
+    if (result) *result = completion->result;
+    error = completion->error;
+    return completion->ok;
+}
+
+PluginMetrics PluginWorker::metrics() const {
+    std::lock_guard<std::mutex> lock(shared_->mutex);
+    check_hung(*shared_);
+    PluginMetrics metrics = shared_->metrics;
+    metrics.queued = shared_->queue.size();
+    return metrics;
+}
+
+PluginState PluginWorker::state() const {
+    return metrics().state;
+}
+
+bool PluginWorker::wait_idle(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(shared_->mutex);
+    return shared_->done.wait_for(lock, timeout, [&] {
+        return shared_->queue.empty() && !shared_->running_call;
+    });
+}
+
+void PluginWorker::stop() {
+    if (!thread_.joinable()) return;
+    bool finished = false;
+    {
+        std::unique_lock<std::mutex> lock(shared_->mutex);
+        shared_->stopping = true;
+        drop_queue(*shared_, "Plugin stopped");
+        shared_->wake.notify_all();
+        // The running call gets until the hang limit to return
+        finished = shared_->done.wait_for(lock, shared_->budget.hang_time, [&] { return !shared_->running_call; });
+    }
+    if (finished) {
+        thread_.join();
+    } else {
+        thread_.detach();
+    }
+}
+
+void PluginWorker::check_hung(Shared& shared) {
+    if (!shared.running_call || shared.metrics.state == PluginState::Disabled) return;
+    if (Clock::now() - shared.call_started < shared.budget.hang_time) return;
+    shared.metrics.state = PluginState::Disabled;
+    shared.metrics.overruns++;
+    drop_queue(shared, "Plugin disabled");
+    shared.done.notify_all();
+}
+
+void PluginWorker::drop_queue(Shared& shared, const char* reason) {
+    for (Task& task : shared.queue) {
+        if (task.completion) {
+            task.completion->error = reason;
+            task.completion->done = true;
+        }
+        shared.metrics.dropped++;
+    }
+    shared.queue.clear();
+}
+
+void PluginWorker::worker_loop(std::shared_ptr<Shared> shared) {
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    PluginMetrics& metrics = shared->metrics;
+    const PluginBudget& budget = shared->budget;
+    while (true) {
+        shared->wake.wait(lock, [&] { return shared->stopping || !shared->queue.empty(); });
+        if (shared->stopping) break;
+        if (metrics.state == PluginState::Throttled) {
+            // Events keep coalescing in the queue meanwhile
+            shared->wake.wait_for(lock, budget.throttle_pause, [&] { return shared->stopping; });
+            if (shared->stopping) break;
+            if (shared->queue.empty()) continue;
+        }
+
+        Task task = std::move(shared->queue.front());
+        shared->queue.pop_front();
+        shared->running_call = true;
+        shared->call_started = Clock::now();
+        lock.unlock();
+
+        int64_t result = 0;
+        std::string error;
+        bool ok;
+        {
+            EDITOR_TRACE_SCOPE_DETAIL("plugin", "plugin call", task.func);
+            ok = shared->invoke(task.func, task.args, &result, error);
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - shared->call_started);
+
+        lock.lock();
+        shared->running_call = false;
+        metrics.calls++;
+        if (!ok) metrics.failures++;
+        metrics.total_time += elapsed;
+        metrics.max_time = (std::max)(metrics.max_time, elapsed);
+        if (metrics.state != PluginState::Disabled) {
+            if (elapsed > budget.call_time) {
+                metrics.overruns++;
+                shared->good_streak = 0;
+                if (++shared->strikes >= budget.disable_after) {
+                    metrics.state = PluginState::Disabled;
+                    drop_queue(*shared, "Plugin disabled");
+                } else {
+                    metrics.state = PluginState::Throttled;
+                }
+            } else if (metrics.state == PluginState::Throttled && ++shared->good_streak >= budget.recover_after) {
+                metrics.state = PluginState::Running;
+                shared->strikes = 0;
+                shared->good_streak = 0;
+            }
+        }
+        if (task.completion) {
+            task.completion->ok = ok;
+            task.completion->result = result;
+            task.completion->error = error;
+            task.completion->done = true;
+        }
+        shared->done.notify_all();
+    }
+    drop_queue(*shared, "Plugin stopped");
+    shared->done.notify_all();
+}
+
+} // namespace editor
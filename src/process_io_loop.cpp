@@ -0,0 +1,300 @@
+#include "process_io_loop.h"
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#else
+#include <sys/event.h>
+#endif
+#endif
+
+namespace editor {
+
+struct ProcessIoLoop::Watch {
+    size_t id = 0;
+    PipeHandle pipe = kInvalidPipe;
+    ReadFn on_read;
+    std::atomic<bool> removed{false};
+#ifdef _WIN32
+    // The read in flight; both stay put until its completion is dequeued
+    OVERLAPPED overlapped;
+    char buffer[kReadSize];
+#endif
+};
+
+#ifdef _WIN32
+
+struct ProcessIoLoop::Backend {
+    HANDLE port = NULL;
+    std::atomic<bool> stopping{false};
+
+    // Issues the next overlapped read; a read that cannot be issued posts
+    // an empty completion, which the loop takes as the end of the stream
+    void start_read(Watch& watch) {
+        ZeroMemory(&watch.overlapped, sizeof(watch.overlapped));
+        if (!ReadFile(watch.pipe, watch.buffer, sizeof(watch.buffer), NULL, &watch.overlapped) &&
+            GetLastError() != ERROR_IO_PENDING) {
+            PostQueuedCompletionStatus(port, 0, watch.id, &watch.overlapped);
+        }
+    }
+};
+
+ProcessIoLoop::ProcessIoLoop() : backend_(std::make_unique<Backend>()) {
+    backend_->port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 1);
+    thread_ = std::thread([this] { run(); });
+}
+
+ProcessIoLoop::~ProcessIoLoop() {
+    backend_->stopping = true;
+    PostQueuedCompletionStatus(backend_->port, 0, 0, NULL);
+    thread_.join();
+    CloseHandle(backend_->port);
+}
+
+size_t ProcessIoLoop::watch(PipeHandle pipe, ReadFn on_read) {
+    auto watch = std::make_shared<Watch>();
+    watch->pipe = pipe;
+    watch->on_read = std::move(on_read);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        watch->id = next_id_++;
+        watches_[watch->id] = watch;
+    }
+    if (!CreateIoCompletionPort(pipe, backend_->port, watch->id, 0)) {
+        erase(watch->id);
+        return 0;
+    }
+    backend_->start_read(*watch);
+    return watch->id;
+}
+
+void ProcessIoLoop::unwatch(size_t id) {
+    std::shared_ptr<Watch> watch = find(id);
+    if (!watch) return;
+    watch->removed = true;
+    // The aborted read still completes; the loop forgets the watch then
+    CancelIoEx(watch->pipe, &watch->overlapped);
+    std::lock_guard<std::recursive_mutex> dispatch(dispatch_mutex_);
+}
+
+void ProcessIoLoop::run() {
+    for (;;) {
+        DWORD bytes = 0;
+        ULONG_PTR key = 0;
+        OVERLAPPED* overlapped = NULL;
+        BOOL ok = GetQueuedCompletionStatus(backend_->port, &bytes, &key, &overlapped, INFINITE);
+        if (!overlapped) {
+            if (backend_->stopping) break;
+            continue;
+        }
+        std::shared_ptr<Watch> watch = find(key);
+        if (!watch) continue;
+        if (ok && bytes > 0) {
+            if (deliver(*watch, watch->buffer, bytes)) {
+                backend_->start_read(*watch);
+            } else {
+                erase(key);
+            }
+            continue;
+        }
+        // Broken pipe (the child is gone), or cancelled by unwatch
+        deliver(*watch, nullptr, 0);
+        erase(key);
+    }
+
+    // Cancel what is still reading and wait for the buffers to be released
+    std::vector<std::shared_ptr<Watch>> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& entry : watches_) pending.push_back(entry.second);
+    }
+    for (auto& watch : pending) {
+        watch->removed = true;
+        CancelIoEx(watch->pipe, &watch->overlapped);
+    }
+    while (watch_count() > 0) {
+        DWORD bytes = 0;
+        ULONG_PTR key = 0;
+        OVERLAPPED* overlapped = NULL;
+        if (!GetQueuedCompletionStatus(backend_->port, &bytes, &key, &overlapped, 1000) && !overlapped) break;
+        if (overlapped) erase(key);
+    }
+}
+
+#else
+
+struct ProcessIoLoop::Backend {
+    int poller = -1;                        // epoll or kqueue descriptor
+    int wake[2] = {-1, -1};                 // Self-pipe; its read end is registered as id 0
+    std::atomic<bool> stopping{false};
+
+    bool add(int fd, size_t id) {
+#if defined(__linux__)
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = id;
+        return epoll_ctl(poller, EPOLL_CTL_ADD, fd, &event) == 0;
+#else
+        struct kevent event;
+        EV_SET(&event, fd, EVFILT_READ, EV_ADD, 0, 0, reinterpret_cast<void*>(static_cast<uintptr_t>(id)));
+        return kevent(poller, &event, 1, nullptr, 0, nullptr) == 0;
+#endif
+    }
+
+    void remove(int fd) {
+#if defined(__linux__)
+        epoll_event event = {};
+        epoll_ctl(poller, EPOLL_CTL_DEL, fd, &event);
+#else
+        struct kevent event;
+        EV_SET(&event, fd, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+        kevent(poller, &event, 1, nullptr, 0, nullptr);
+#endif
+    }
+
+    // Ids of the watches that are ready to read; blocks until there is one
+    int wait(size_t* ids, int capacity) {
+#if defined(__linux__)
+        epoll_event events[32];
+        int count = epoll_wait(poller, events, (std::min)(capacity, 32), -1);
+        for (int i = 0; i < count; ++i) ids[i] = static_cast<size_t>(events[i].data.u64);
+#else
+        struct kevent events[32];
+        int count = kevent(poller, nullptr, 0, events, (std::min)(capacity, 32), nullptr);
+        for (int i = 0; i < count; ++i) ids[i] = static_cast<size_t>(reinterpret_cast<uintptr_t>(events[i].udata));
+#endif
+        return count;
+    }
+};
+
+ProcessIoLoop::ProcessIoLoop() : backend_(std::make_unique<Backend>()) {
+#if defined(__linux__)
+    backend_->poller = epoll_create1(EPOLL_CLOEXEC);
+#else
+    backend_->poller = kqueue();
+#endif
+    if (pipe(backend_->wake) == 0) {
+        for (int fd : backend_->wake) {
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        }
+        backend_->add(backend_->wake[0], 0);
+    }
+    thread_ = std::thread([this] { run(); });
+}
+
+ProcessIoLoop::~ProcessIoLoop() {
+    backend_->stopping = true;
+    char byte = 0;
+    while (write(backend_->wake[1], &byte, 1) < 0 && errno == EINTR) {}
+    thread_.join();
+    for (int fd : {backend_->wake[0], backend_->wake[1], backend_->poller}) {
+        if (fd != -1) close(fd);
+    }
+}
+
+size_t ProcessIoLoop::watch(PipeHandle pipe, ReadFn on_read) {
+    // A readiness report is not a promise; reads must never block the loop
+    fcntl(pipe, F_SETFL, fcntl(pipe, F_GETFL, 0) | O_NONBLOCK);
+    auto watch = std::make_shared<Watch>();
+    watch->pipe = pipe;
+    watch->on_read = std::move(on_read);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        watch->id = next_id_++;
+        watches_[watch->id] = watch;
+    }
+    if (!backend_->add(pipe, watch->id)) {
+        erase(watch->id);
+        return 0;
+    }
+    return watch->id;
+}
+
+void ProcessIoLoop::unwatch(size_t id) {
+    std::shared_ptr<Watch> watch = find(id);
+    if (!watch) return;
+    watch->removed = true;
+    backend_->remove(watch->pipe);
+    erase(id);
+    std::lock_guard<std::recursive_mutex> dispatch(dispatch_mutex_);
+}
+
+void ProcessIoLoop::run() {
+    std::vector<char> buffer(kReadSize);
+    size_t ready[32];
+    for (;;) {
+        int count = backend_->wait(ready, 32);
+        if (count < 0 && errno != EINTR) break;
+        for (int i = 0; i < count; ++i) {
+            if (ready[i] == 0) {
+                char drain[64];
+                while (read(backend_->wake[0], drain, sizeof(drain)) > 0) {}
+                if (backend_->stopping) return;
+                continue;
+            }
+            std::shared_ptr<Watch> watch = find(ready[i]);
+            if (!watch) continue;
+            ssize_t bytes;
+            do {
+                bytes = read(watch->pipe, buffer.data(), buffer.size());
+            } while (bytes < 0 && errno == EINTR);
+            if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) continue;
+            if (bytes > 0) {
+                deliver(*watch, buffer.data(), static_cast<size_t>(bytes));
+                continue;
+            }
+            // End of the stream (or an error, which ends it as well)
+            backend_->remove(watch->pipe);
+            deliver(*watch, nullptr, 0);
+            erase(watch->id);
+        }
+    }
+}
+
+#endif
+
+std::shared_ptr<ProcessIoLoop> ProcessIoLoop::shared() {
+    static std::mutex mutex;
+    static std::weak_ptr<ProcessIoLoop> instance;
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<ProcessIoLoop> loop = instance.lock();
+    if (!loop) {
+        loop = std::make_shared<ProcessIoLoop>();
+        instance = loop;
+    }
+    return loop;
+}
+
+size_t ProcessIoLoop::watch_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return watches_.size();
+}
+
+std::shared_ptr<ProcessIoLoop::Watch> ProcessIoLoop::find(size_t id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = watches_.find(id);
+    return it == watches_.end() ? nullptr : it->second;
+}
+
+bool ProcessIoLoop::deliver(Watch& watch, const char* data, size_t size) {
+    std::lock_guard<std::recursive_mutex> dispatch(dispatch_mutex_);
+    if (watch.removed) return false;
+    watch.on_read(data, size);
+    return true;
+}
+
+void ProcessIoLoop::erase(size_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    watches_.erase(id);
+}
+
+} // namespace editor
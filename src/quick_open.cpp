@@ -0,0 +1,538 @@
+#include "quick_open.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+namespace {
+
+constexpr uint64_t kLive = uint64_t(1) << 63;   // Set in every live path's mask and every query's
+constexpr size_t kScanBlock = 8192;             // Paths per scan task
+constexpr auto kPublishInterval = std::chrono::milliseconds(4);
+
+struct Tables {
+    unsigned char fold[256];
+    uint64_t bit[256];
+    Tables() {
+        for (int c = 0; c < 256; ++c) {
+            fold[c] = static_cast<unsigned char>(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c == '\\' ? '/' : c);
+        }
+        // a-z, 0-9, '_', '-', '.', '/' own a bit; everything else shares the rest
+        for (int c = 0; c < 256; ++c) {
+            int f = fold[c];
+            int index;
+            if (f >= 'a' && f <= 'z') index = f - 'a';
+            else if (f >= '0' && f <= '9') index = 26 + (f - '0');
+            else if (f == '_') index = 36;
+            else if (f == '-') index = 37;
+            else if (f == '.') index = 38;
+            else if (f == '/') index = 39;
+            else index = 40 + f % 23;
+            bit[c] = uint64_t(1) << index;
+        }
+    }
+};
+const Tables kTables;
+
+inline unsigned char fold(char c) {
+    return kTables.fold[static_cast<unsigned char>(c)];
+}
+
+std::string fold_query(const std::string& query) {
+    std::string folded(query.size(), '\0');
+    for (size_t i = 0; i < query.size(); ++i) folded[i] = static_cast<char>(fold(query[i]));
+    return folded;
+}
+
+size_t name_start_of(std::string_view path) {
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string_view::npos ? 0 : slash + 1;
+}
+
+// Start of a word: after a separator, a lower-to-upper step or a letter-to-digit step
+bool is_boundary(std::string_view path, size_t i) {
+    if (i == 0) return true;
+    char prev = path[i - 1];
+    char cur = path[i];
+    if (prev == '/' || prev == '\\' || prev == '_' || prev == '-' || prev == '.' || prev == ' ') return true;
+    if (prev >= 'a' && prev <= 'z' && cur >= 'A' && cur <= 'Z') return true;
+    return !(prev >= '0' && prev <= '9') && cur >= '0' && cur <= '9';
+}
+
+// Tightest [start, end) at or after `from` holding the folded query as a
+// subsequence: the first end found scanning forward, then the latest start
+bool find_window(std::string_view path, std::string_view folded, size_t from, size_t& start, size_t& end) {
+    size_t q = 0;
+    size_t i = from;
+    for (; i < path.size(); ++i) {
+        if (fold(path[i]) == static_cast<unsigned char>(folded[q]) && ++q == folded.size()) break;
+    }
+    if (q < folded.size()) return false;
+    end = i + 1;
+    for (size_t j = end; j-- > from;) {
+        if (fold(path[j]) == static_cast<unsigned char>(folded[q - 1]) && --q == 0) {
+            start = j;
+            break;
+        }
+    }
+    return true;
+}
+
+int score_folded(std::string_view path, size_t name_start, std::string_view folded, std::string_view query,
+                 std::vector<uint32_t>* positions) {
+    if (folded.empty()) return 0;
+    size_t start = 0;
+    size_t end = 0;
+    // Prefer a match inside the file name
+    bool in_name = find_window(path, folded, name_start, start, end);
+    if (!in_name && !find_window(path, folded, 0, start, end)) return -1;
+
+    int score = in_name ? 12 : 0;
+    bool run = false;
+    size_t q = 0;
+    for (size_t i = start; i < end && q < folded.size(); ++i) {
+        if (fold(path[i]) != static_cast<unsigned char>(folded[q])) {
+            score -= run ? 3 : 1;   // Opening a gap costs more than extending it
+            run = false;
+            continue;
+        }
+        int points = 16;
+        if (is_boundary(path, i)) points += i == name_start ? 16 : 8;
+        if (run) points += 6;
+        if (i >= name_start) points += 4;
+        if (path[i] == query[q]) points += 1;
+        score += points;
+        run = true;
+        ++q;
+        if (positions) positions->push_back(static_cast<uint32_t>(i));
+    }
+    // Among equal matches, shorter paths first
+    return score - static_cast<int>(path.size() / 16);
+}
+
+} // namespace
+
+QuickOpenIndex::QuickOpenIndex() = default;
+
+QuickOpenIndex::~QuickOpenIndex() {
+    {
+        std::lock_guard<std::mutex> lock(async_mutex_);
+        async_stopping_ = true;
+        async_generation_.fetch_add(1);
+    }
+    async_wake_.notify_all();
+    if (search_thread_.joinable()) search_thread_.join();
+    wait_for_indexing();
+}
+
+uint64_t QuickOpenIndex::mask_of(std::string_view text) {
+    uint64_t mask = kLive;
+    for (char c : text) mask |= kTables.bit[static_cast<unsigned char>(c)];
+    return mask;
+}
+
+int QuickOpenIndex::score(std::string_view path, std::string_view query, std::vector<uint32_t>* positions) {
+    std::string folded = fold_query(std::string(query));
+    return score_folded(path, name_start_of(path), folded, query, positions);
+}
+
+bool QuickOpenIndex::better(const Candidate& a, const Candidate& b, const std::vector<Entry>& entries) {
+    if (a.score != b.score) return a.score > b.score;
+    if (entries[a.id].length != entries[b.id].length) return entries[a.id].length < entries[b.id].length;
+    return a.id < b.id;
+}
+
+// ============================================================================
+// Table
+// ============================================================================
+
+void QuickOpenIndex::add_path(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    add_locked(path);
+}
+
+void QuickOpenIndex::remove_path(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    remove_locked(path);
+}
+
+void QuickOpenIndex::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    chunks_.clear();
+    chunk_used_ = kChunkSize;
+    entries_.clear();
+    masks_.clear();
+    ids_.clear();
+    removed_ = 0;
+    last_matches_.clear();
+    has_last_ = false;
+    ++version_;
+}
+
+size_t QuickOpenIndex::get_path_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size() - removed_;
+}
+
+size_t QuickOpenIndex::get_memory_usage() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return chunks_.size() * kChunkSize + entries_.capacity() * sizeof(Entry) + masks_.capacity() * sizeof(uint64_t) +
+           ids_.size() * (sizeof(std::pair<std::string_view, uint32_t>) + 2 * sizeof(void*)) +
+           ids_.bucket_count() * sizeof(void*) + last_matches_.capacity() * sizeof(uint32_t);
+}
+
+void QuickOpenIndex::add_locked(std::string_view path) {
+    if (path.empty() || path.size() > kChunkSize || ids_.count(path)) return;
+    if (chunk_used_ + path.size() > kChunkSize) {
+        chunks_.push_back(std::make_unique<char[]>(kChunkSize));
+        chunk_used_ = 0;
+    }
+    char* data = chunks_.back().get() + chunk_used_;
+    std::memcpy(data, path.data(), path.size());
+    chunk_used_ += path.size();
+
+    std::string_view stored(data, path.size());
+    uint32_t id = static_cast<uint32_t>(entries_.size());
+    entries_.push_back({data, static_cast<uint32_t>(path.size()), static_cast<uint32_t>(name_start_of(stored))});
+    masks_.push_back(mask_of(stored));
+    ids_.emplace(stored, id);
+    ++version_;
+}
+
+void QuickOpenIndex::remove_locked(std::string_view path) {
+    auto it = ids_.find(path);
+    if (it == ids_.end()) return;
+    masks_[it->second] = 0;
+    ids_.erase(it);
+    ++removed_;
+    ++version_;
+    if (removed_ > 4096 && removed_ * 2 > entries_.size()) compact_locked();
+}
+
+void QuickOpenIndex::remove_tree_locked(const std::string& directory) {
+    std::vector<std::string_view> doomed;
+    for (const auto& entry : ids_) {
+        std::string_view path = entry.first;
+        if (path.size() > directory.size() && path.compare(0, directory.size(), directory) == 0 &&
+            (path[directory.size()] == '/' || path[directory.size()] == '\\')) {
+            doomed.push_back(path);
+        }
+    }
+    // Copies: compaction may move the text mid-loop
+    std::vector<std::string> paths(doomed.begin(), doomed.end());
+    for (const std::string& path : paths) remove_locked(path);
+}
+
+void QuickOpenIndex::compact_locked() {
+    std::vector<std::unique_ptr<char[]>> chunks;
+    std::vector<Entry> entries;
+    std::vector<uint64_t> masks;
+    chunks.swap(chunks_);
+    entries.swap(entries_);
+    masks.swap(masks_);
+    ids_.clear();
+    chunk_used_ = kChunkSize;
+    removed_ = 0;
+    entries_.reserve(entries.size() / 2);
+    masks_.reserve(entries.size() / 2);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (masks[i]) add_locked(std::string_view(entries[i].path, entries[i].length));
+    }
+}
+
+void QuickOpenIndex::apply_file_changes(const std::vector<editor::FileChange>& changes) {
+    std::vector<std::string> new_directories;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const editor::FileChange& change : changes) {
+            if (!editor::is_in_workspace(roots_, change.path)) continue;
+            if (change.kind == editor::FileChange::Kind::Removed) {
+                if (ids_.count(change.path)) remove_locked(change.path);
+                else remove_tree_locked(change.path);
+            } else if (change.is_directory) {
+                // After an overflow the directory is unreliable: drop what is
+                // gone, then crawl it (present paths are not added twice)
+                if (change.kind == editor::FileChange::Kind::Modified) {
+                    std::vector<std::string> below;
+                    for (const auto& entry : ids_) {
+                        if (entry.first.compare(0, change.path.size(), change.path) == 0) below.emplace_back(entry.first);
+                    }
+                    for (const std::string& path : below) {
+                        std::error_code ec;
+                        if (!std::filesystem::exists(path, ec)) remove_locked(path);
+                    }
+                }
+                new_directories.push_back(change.path);
+            } else {
+                add_locked(change.path);
+            }
+        }
+    }
+    for (const std::string& directory : new_directories) {
+        submit_crawl_task([this, directory] { crawl_directory(directory); });
+    }
+}
+
+// ============================================================================
+// Crawl
+// ============================================================================
+
+void QuickOpenIndex::index_workspace(const std::vector<std::string>& root_folders) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const std::string& root : root_folders) {
+            if (std::find(roots_.begin(), roots_.end(), root) == roots_.end()) roots_.push_back(root);
+        }
+    }
+    for (const std::string& root : root_folders) {
+        submit_crawl_task([this, root] { crawl_directory(root); });
+    }
+}
+
+void QuickOpenIndex::wait_for_indexing() {
+    std::unique_lock<std::mutex> lock(crawl_mutex_);
+    crawl_done_.wait(lock, [this] { return outstanding_.load() == 0; });
+}
+
+void QuickOpenIndex::submit_crawl_task(std::function<void()> task) {
+    outstanding_.fetch_add(1);
+    ThreadPool::shared().submit([this, task = std::move(task)] {
+        task();
+        if (outstanding_.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(crawl_mutex_);
+            crawl_done_.notify_all();
+        }
+    }, TaskPriority::Background);
+}
+
+void QuickOpenIndex::crawl_directory(const std::string& directory) {
+    std::vector<std::string> files;
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+        std::string name = it->path().filename().string();
+        if (name.empty() || name[0] == '.') continue;
+        std::error_code type_ec;
+        if (it->is_directory(type_ec)) {
+            if (name == "node_modules") continue;
+            std::string path = it->path().string();
+            submit_crawl_task([this, path] { crawl_directory(path); });
+        } else if (it->is_regular_file(type_ec)) {
+            files.push_back(it->path().string());
+        }
+    }
+    if (files.empty()) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const std::string& file : files) add_locked(file);
+}
+
+// ============================================================================
+// Search
+// ============================================================================
+
+std::vector<QuickOpenIndex::Candidate> QuickOpenIndex::scan_locked(const std::string& folded, size_t max_results,
+                                                                   const Progress& progress, bool& cancelled) {
+    // Shared with the pool tasks, which may start after the scan is over;
+    // those find no block left and never touch the table
+    struct State {
+        std::mutex mutex;
+        std::condition_variable idle;
+        std::vector<uint32_t> candidates;   // Empty: scan the whole table
+        bool use_candidates = false;
+        size_t count = 0;
+        size_t blocks = 0;
+        size_t next_block = 0;
+        size_t in_flight = 0;
+        bool cancelled = false;
+        std::vector<Candidate> top;                     // Heap, worst first
+        std::vector<std::vector<uint32_t>> matches;     // Per block, for refinement
+    };
+    auto state = std::make_shared<State>();
+    if (has_last_ && last_version_ == version_ && folded.compare(0, last_query_.size(), last_query_) == 0) {
+        // Extending the query can only drop paths
+        state->candidates = std::move(last_matches_);
+        state->use_candidates = true;
+        state->count = state->candidates.size();
+    } else {
+        state->count = entries_.size();
+    }
+    has_last_ = false;
+    state->blocks = (state->count + kScanBlock - 1) / kScanBlock;
+    state->matches.resize(state->blocks);
+
+    uint64_t query_mask = mask_of(folded);
+    auto worse = [this](const Candidate& a, const Candidate& b) { return better(a, b, entries_); };
+    auto offer = [&](std::vector<Candidate>& heap, const Candidate& candidate) {
+        if (heap.size() < max_results) {
+            heap.push_back(candidate);
+            std::push_heap(heap.begin(), heap.end(), worse);
+        } else if (better(candidate, heap.front(), entries_)) {
+            std::pop_heap(heap.begin(), heap.end(), worse);
+            heap.back() = candidate;
+            std::push_heap(heap.begin(), heap.end(), worse);
+        }
+    };
+    auto sorted = [&](std::vector<Candidate> heap) {
+        std::sort_heap(heap.begin(), heap.end(), worse);
+        return heap;
+    };
+
+    auto scan_block = [this, state, folded, query_mask, &offer](size_t block, std::vector<Candidate>& heap) {
+        size_t begin = block * kScanBlock;
+        size_t end = std::min(state->count, begin + kScanBlock);
+        std::vector<uint32_t>& matches = state->matches[block];
+        uint8_t hits[kScanBlock];
+        if (!state->use_candidates) {
+            // Branch-free prefilter over the contiguous mask array
+            const uint64_t* masks = masks_.data() + begin;
+            for (size_t i = 0; i < end - begin; ++i) hits[i] = (masks[i] & query_mask) == query_mask;
+        } else {
+            for (size_t i = 0; i < end - begin; ++i) {
+                hits[i] = (masks_[state->candidates[begin + i]] & query_mask) == query_mask;
+            }
+        }
+        for (size_t i = 0; i < end - begin; ++i) {
+            if (!hits[i]) continue;
+            uint32_t id = state->use_candidates ? state->candidates[begin + i] : static_cast<uint32_t>(begin + i);
+            const Entry& entry = entries_[id];
+            int points = score_folded(std::string_view(entry.path, entry.length), entry.name_start, folded, folded,
+                                      nullptr);
+            if (points < 0) continue;
+            matches.push_back(id);
+            offer(heap, {points, id});
+        }
+    };
+
+    // Claim blocks until none are left; the caller also publishes progress
+    auto run = [state, scan_block, &offer, &sorted, &progress, max_results](bool caller) {
+        auto last_publish = std::chrono::steady_clock::now();
+        std::vector<Candidate> heap;
+        while (true) {
+            size_t block;
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (state->cancelled || state->next_block >= state->blocks) return;
+                block = state->next_block++;
+                ++state->in_flight;
+            }
+            heap.clear();
+            heap.reserve(max_results);
+            scan_block(block, heap);
+
+            std::vector<Candidate> snapshot;
+            bool publish = false;
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                for (const Candidate& candidate : heap) offer(state->top, candidate);
+                --state->in_flight;
+                publish = caller && progress && state->next_block < state->blocks &&
+                          std::chrono::steady_clock::now() - last_publish >= kPublishInterval;
+                if (publish) snapshot = state->top;
+            }
+            state->idle.notify_all();
+            if (publish) {
+                last_publish = std::chrono::steady_clock::now();
+                if (!progress(sorted(std::move(snapshot)))) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->cancelled = true;
+                }
+            }
+        }
+    };
+
+    if (state->blocks > 1) {
+        ThreadPool& workers = ThreadPool::shared();
+        size_t helpers = std::min(workers.size(), state->blocks - 1);
+        for (size_t i = 0; i < helpers; ++i) {
+            // Helpers never publish, so they only need the shared pieces
+            workers.submit([run] { run(false); }, TaskPriority::Interactive);
+        }
+    }
+    run(true);
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->idle.wait(lock, [&] { return state->in_flight == 0; });
+    cancelled = state->cancelled;
+    if (!cancelled) {
+        last_query_ = folded;
+        last_version_ = version_;
+        last_matches_.clear();
+        for (const auto& block : state->matches) last_matches_.insert(last_matches_.end(), block.begin(), block.end());
+        has_last_ = true;
+    }
+    return sorted(std::move(state->top));
+}
+
+std::vector<QuickOpenMatch> QuickOpenIndex::materialize_locked(const std::vector<Candidate>& top,
+                                                               const std::string& query) const {
+    std::string folded = fold_query(query);
+    std::vector<QuickOpenMatch> results;
+    results.reserve(top.size());
+    for (const Candidate& candidate : top) {
+        const Entry& entry = entries_[candidate.id];
+        std::string_view path(entry.path, entry.length);
+        QuickOpenMatch match{std::string(path), 0, {}};
+        match.score = score_folded(path, entry.name_start, folded, query, &match.positions);
+        results.push_back(std::move(match));
+    }
+    return results;
+}
+
+std::vector<QuickOpenMatch> QuickOpenIndex::search(const std::string& query, size_t max_results) {
+    if (query.empty() || max_results == 0) return {};
+    std::string folded = fold_query(query);
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool cancelled = false;
+    return materialize_locked(scan_locked(folded, max_results, nullptr, cancelled), query);
+}
+
+void QuickOpenIndex::search_async(const std::string& query, size_t max_results, ResultCallback callback) {
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    async_query_ = query;
+    async_max_ = max_results;
+    async_callback_ = std::move(callback);
+    async_pending_ = true;
+    async_generation_.fetch_add(1);
+    if (!search_thread_.joinable()) search_thread_ = std::thread(&QuickOpenIndex::async_loop, this);
+    async_wake_.notify_one();
+}
+
+void QuickOpenIndex::cancel_async() {
+    std::lock_guard<std::mutex> lock(async_mutex_);
+    async_pending_ = false;
+    async_generation_.fetch_add(1);
+}
+
+void QuickOpenIndex::async_loop() {
+    while (true) {
+        std::string query;
+        size_t max_results;
+        ResultCallback callback;
+        uint64_t generation;
+        {
+            std::unique_lock<std::mutex> lock(async_mutex_);
+            async_wake_.wait(lock, [this] { return async_pending_ || async_stopping_; });
+            if (async_stopping_) return;
+            query = async_query_;
+            max_results = async_max_;
+            callback = async_callback_;
+            generation = async_generation_.load();
+            async_pending_ = false;
+        }
+        if (query.empty() || max_results == 0) {
+            callback({}, true);
+            continue;
+        }
+
+        std::string folded = fold_query(query);
+        std::lock_guard<std::mutex> lock(mutex_);
+        bool cancelled = false;
+        auto still_current = [this, generation] { return async_generation_.load() == generation; };
+        std::vector<Candidate> top = scan_locked(folded, max_results, [&](const std::vector<Candidate>& partial) {
+            if (!still_current()) return false;
+            callback(materialize_locked(partial, query), false);
+            return true;
+        }, cancelled);
+        if (!cancelled && still_current()) callback(materialize_locked(top, query), true);
+    }
+}
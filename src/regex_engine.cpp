@@ -0,0 +1,932 @@
+#include "regex_engine.h"
+#include "text_transcode.h"
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <mutex>
+
+namespace {
+
+bool is_word(int c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+bool is_alpha(int c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+} // namespace
+
+// ============================================================================
+// Parser: pattern -> syntax tree -> program
+// ============================================================================
+
+class RegexEngine::Parser {
+public:
+    Parser(const std::string& pattern, bool fold_case, RegexEngine& engine)
+        : pattern_(pattern), fold_case_(fold_case), engine_(engine) {}
+
+    bool compile() {
+        int root = alternation();
+        if (error_.empty() && pos_ < pattern_.size()) fail("Unmatched )");
+        if (!error_.empty()) return false;
+
+        engine_.slot_count_ = 2 * (static_cast<size_t>(groups_) + 1);
+        push({Op::Save, 0, 0, 0});
+        emit(root);
+        push({Op::Save, 0, 1, 0});
+        push({Op::Match, 0, 0, 0});
+        if (!error_.empty()) return false;
+
+        // Inside Iterate loops an instruction that does not consume gets an
+        // extra thread state per count of fresh loops it can be reached with
+        // (see add_thread)
+        const std::vector<Inst>& program = engine_.program_;
+        engine_.fresh_states_.assign(program.size(), 0);
+        size_t states = program.size();
+        for (size_t pc = 0; pc < program.size(); ++pc) {
+            Op op = program[pc].op;
+            if (depths_[pc] == 0 || op == Op::Byte || op == Op::Set || op == Op::Any || op == Op::Match) continue;
+            engine_.fresh_states_[pc] = static_cast<uint32_t>(states);
+            states += depths_[pc];
+        }
+        if (states > kMaxStates) {
+            fail("Pattern too large");
+            return false;
+        }
+        engine_.state_count_ = states;
+        return true;
+    }
+
+    const std::string& error() const { return error_; }
+
+private:
+    struct Node {
+        enum Kind {
+            Empty,
+            Byte,
+            Set,
+            Any,
+            Concat,
+            Alternate,
+            Repeat,
+            Group,
+            Assert
+        } kind;
+        int value = 0;          // Byte, set index, assertion or capture group
+        int min = 0;
+        int max = 0;            // Repeat; -1 for unbounded
+        bool greedy = true;
+        std::vector<int> children;
+    };
+
+    static constexpr int kMaxNesting = 500;
+    static constexpr size_t kMaxStates = 8 * kMaxProgram;
+
+    const std::string& pattern_;
+    bool fold_case_;
+    RegexEngine& engine_;
+    std::vector<Node> nodes_;
+    size_t pos_ = 0;
+    int groups_ = 0;
+    int depth_ = 0;
+    uint32_t loop_depth_ = 0;       // Iterate loops around what is emitted
+    std::vector<uint32_t> depths_;  // loop_depth_ per instruction
+    std::string error_;
+
+    int fail(const std::string& message) {
+        if (error_.empty()) error_ = message;
+        return -1;
+    }
+
+    int add(Node node) {
+        nodes_.push_back(std::move(node));
+        return static_cast<int>(nodes_.size() - 1);
+    }
+
+    int add(typename Node::Kind kind, int value = 0) {
+        Node node;
+        node.kind = kind;
+        node.value = value;
+        return add(std::move(node));
+    }
+
+    int set_node(ByteSet set) {
+        if (fold_case_) {
+            for (int c = 'a'; c <= 'z'; ++c) {
+                bool either = set.has[c] || set.has[c - 'a' + 'A'];
+                set.has[c] = set.has[c - 'a' + 'A'] = either;
+            }
+        }
+        engine_.sets_.push_back(set);
+        return add(Node::Set, static_cast<int>(engine_.sets_.size() - 1));
+    }
+
+    int byte_node(unsigned char c) {
+        if (fold_case_ && is_alpha(c)) {
+            ByteSet set{};
+            set.has[c] = true;
+            return set_node(set);
+        }
+        return add(Node::Byte, c);
+    }
+
+    // \d \w \s and their negations
+    static bool class_escape(char e, ByteSet& set) {
+        ByteSet members{};
+        switch (e) {
+            case 'd': case 'D':
+                for (int c = '0'; c <= '9'; ++c) members.has[c] = true;
+                break;
+            case 'w': case 'W':
+                for (int c = 0; c < 256; ++c) members.has[c] = is_word(c);
+                break;
+            case 's': case 'S':
+                for (char c : {' ', '\t', '\n', '\r', '\f', '\v'}) members.has[static_cast<unsigned char>(c)] = true;
+                break;
+            default:
+                return false;
+        }
+        bool negate = e == 'D' || e == 'W' || e == 'S';
+        for (int c = 0; c < 256; ++c) {
+            if (members.has[c] != negate) set.has[c] = true;
+        }
+        return true;
+    }
+
+    // count hex digits at pos_; pos_ only moves past them on success
+    bool hex_digits(int count, int& value) {
+        value = 0;
+        for (int i = 0; i < count; ++i) {
+            int digit = pos_ + i < pattern_.size() ? hex_value(pattern_[pos_ + i]) : -1;
+            if (digit < 0) return false;
+            value = value * 16 + digit;
+        }
+        pos_ += count;
+        return true;
+    }
+
+    // Escaped byte after a backslash (at pos_). Punctuation is itself; a
+    // letter or digit without a meaning here is an error, not a literal.
+    bool escape_byte(unsigned char& out) {
+        char e = pattern_[pos_++];
+        int value = 0;
+        switch (e) {
+            case 'n': out = '\n'; return true;
+            case 't': out = '\t'; return true;
+            case 'r': out = '\r'; return true;
+            case 'f': out = '\f'; return true;
+            case 'v': out = '\v'; return true;
+            case '0': out = '\0'; return true;
+            case 'x':
+                if (!hex_digits(2, value)) {
+                    fail("Bad \\x escape");
+                    return false;
+                }
+                out = static_cast<unsigned char>(value);
+                return true;
+            case 'u':
+                // A class holds bytes, so only ASCII fits in one
+                if (!hex_digits(4, value)) {
+                    fail("Bad \\u escape");
+                    return false;
+                }
+                if (value >= 0x80) {
+                    fail("Non-ASCII \\u escape in a class");
+                    return false;
+                }
+                out = static_cast<unsigned char>(value);
+                return true;
+            default:
+                if (is_alpha(e) || (e >= '0' && e <= '9')) {
+                    fail(std::string("Unknown escape \\") + e);
+                    return false;
+                }
+                out = static_cast<unsigned char>(e);
+                return true;
+        }
+    }
+
+    // \uXXXX outside a class (pos_ at the 'u'): the UTF-8 bytes of the code
+    // point, a surrogate pair taking two escapes
+    int unicode_atom() {
+        ++pos_;
+        char16_t units[2];
+        size_t count = 0;
+        int value = 0;
+        if (!hex_digits(4, value)) return fail("Bad \\u escape");
+        units[count++] = static_cast<char16_t>(value);
+        if (value >= 0xD800 && value <= 0xDBFF && pattern_.compare(pos_, 2, "\\u") == 0) {
+            pos_ += 2;
+            if (!hex_digits(4, value)) return fail("Bad \\u escape");
+            units[count++] = static_cast<char16_t>(value);
+        }
+        bool paired = count == 2 && value >= 0xDC00 && value <= 0xDFFF;
+        if (!paired && ((units[0] >= 0xD800 && units[0] <= 0xDFFF) || count == 2)) {
+            return fail("Unpaired surrogate in \\u escape");
+        }
+        std::string bytes = TextTranscode::utf16_to_utf8(units, count);
+        if (bytes.size() == 1) return byte_node(static_cast<unsigned char>(bytes[0]));
+        Node node;
+        node.kind = Node::Concat;
+        for (char byte : bytes) node.children.push_back(add(Node::Byte, static_cast<unsigned char>(byte)));
+        return add(std::move(node));
+    }
+
+    int alternation() {
+        std::vector<int> branches{concat()};
+        while (error_.empty() && pos_ < pattern_.size() && pattern_[pos_] == '|') {
+            ++pos_;
+            branches.push_back(concat());
+        }
+        if (branches.size() == 1) return branches[0];
+        Node node;
+        node.kind = Node::Alternate;
+        node.children = std::move(branches);
+        return add(std::move(node));
+    }
+
+    int concat() {
+        std::vector<int> items;
+        while (error_.empty() && pos_ < pattern_.size() && pattern_[pos_] != '|' && pattern_[pos_] != ')') {
+            int item = atom();
+            int min = 0;
+            int max = 0;
+            if (error_.empty() && quantifier(min, max)) {
+                if (nodes_[item].kind == Node::Assert) return fail("Nothing to repeat");
+                Node node;
+                node.kind = Node::Repeat;
+                node.min = min;
+                node.max = max;
+                if (pos_ < pattern_.size() && pattern_[pos_] == '?') {
+                    node.greedy = false;
+                    ++pos_;
+                }
+                node.children.push_back(item);
+                item = add(std::move(node));
+                // Only the lazy '?' may follow a quantifier: a{2}{3} is an error
+                if (error_.empty() && quantifier(min, max)) return fail("Nothing to repeat");
+            }
+            items.push_back(item);
+        }
+        if (!error_.empty()) return -1;
+        if (items.empty()) return add(Node::Empty);
+        if (items.size() == 1) return items[0];
+        Node node;
+        node.kind = Node::Concat;
+        node.children = std::move(items);
+        return add(std::move(node));
+    }
+
+    // * + ? {n} {n,} {n,m}; a '{' that does not form one is a literal
+    bool quantifier(int& min, int& max) {
+        if (pos_ >= pattern_.size()) return false;
+        switch (pattern_[pos_]) {
+            case '*': ++pos_; min = 0; max = -1; return true;
+            case '+': ++pos_; min = 1; max = -1; return true;
+            case '?': ++pos_; min = 0; max = 1; return true;
+            case '{': break;
+            default: return false;
+        }
+        size_t i = pos_ + 1;
+        auto number = [&](long& value) {
+            size_t begin = i;
+            value = 0;
+            while (i < pattern_.size() && pattern_[i] >= '0' && pattern_[i] <= '9') {
+                value = std::min<long>(value * 10 + (pattern_[i] - '0'), kMaxRepeat + 1L);
+                ++i;
+            }
+            return i > begin;
+        };
+        long low = 0;
+        long high = 0;
+        if (!number(low)) return false;
+        high = low;
+        if (i < pattern_.size() && pattern_[i] == ',') {
+            ++i;
+            if (!number(high)) high = -1;
+        }
+        if (i >= pattern_.size() || pattern_[i] != '}') return false;
+        pos_ = i + 1;
+        if (low > kMaxRepeat || high > kMaxRepeat) {
+            fail("Repetition count too large");
+            return false;
+        }
+        if (high >= 0 && high < low) {
+            fail("Bad repetition range");
+            return false;
+        }
+        min = static_cast<int>(low);
+        max = static_cast<int>(high);
+        return true;
+    }
+
+    int atom() {
+        char c = pattern_[pos_++];
+        switch (c) {
+            case '(': {
+                if (++depth_ > kMaxNesting) return fail("Pattern nests too deeply");
+                int group = -1;
+                if (pattern_.compare(pos_, 2, "?:") == 0) {
+                    pos_ += 2;
+                } else if (pos_ < pattern_.size() && pattern_[pos_] == '?') {
+                    return fail("Lookaround is not supported");
+                } else {
+                    group = ++groups_;
+                }
+                int inner = alternation();
+                if (!error_.empty()) return -1;
+                if (pos_ >= pattern_.size() || pattern_[pos_] != ')') return fail("Missing )");
+                ++pos_;
+                --depth_;
+                if (group < 0) return inner;
+                Node node;
+                node.kind = Node::Group;
+                node.value = group;
+                node.children.push_back(inner);
+                return add(std::move(node));
+            }
+            case '[':
+                return class_atom();
+            case '.':
+                return add(Node::Any);
+            case '^':
+                return add(Node::Assert, LineStart);
+            case '$':
+                return add(Node::Assert, LineEnd);
+            case '*':
+            case '+':
+            case '?':
+                return fail("Nothing to repeat");
+            case '\\': {
+                if (pos_ >= pattern_.size()) return fail("Trailing backslash");
+                char e = pattern_[pos_];
+                switch (e) {
+                    case 'b': ++pos_; return add(Node::Assert, WordBoundary);
+                    case 'B': ++pos_; return add(Node::Assert, NotWordBoundary);
+                    case 'A': ++pos_; return add(Node::Assert, TextStart);
+                    case 'z': ++pos_; return add(Node::Assert, TextEnd);
+                    default: break;
+                }
+                if (e >= '1' && e <= '9') return fail("Backreferences are not supported");
+                if (e == 'u') return unicode_atom();
+                ByteSet set{};
+                if (class_escape(e, set)) {
+                    ++pos_;
+                    return set_node(set);
+                }
+                unsigned char byte;
+                if (!escape_byte(byte)) return -1;
+                return byte_node(byte);
+            }
+            default:
+                return byte_node(static_cast<unsigned char>(c));
+        }
+    }
+
+    int class_atom() {
+        ByteSet set{};
+        bool negate = pos_ < pattern_.size() && pattern_[pos_] == '^';
+        if (negate) ++pos_;
+        // A ']' first is a member
+        for (bool first = true;; first = false) {
+            if (pos_ >= pattern_.size()) return fail("Missing ]");
+            char c = pattern_[pos_];
+            if (c == ']' && !first) {
+                ++pos_;
+                break;
+            }
+            unsigned char low = static_cast<unsigned char>(c);
+            ++pos_;
+            if (c == '\\') {
+                if (pos_ >= pattern_.size()) return fail("Missing ]");
+                if (class_escape(pattern_[pos_], set)) {
+                    ++pos_;
+                    continue;
+                }
+                if (pattern_[pos_] == 'b') {
+                    low = '\b';
+                    ++pos_;
+                } else if (!escape_byte(low)) {
+                    return -1;
+                }
+            }
+            unsigned char high = low;
+            if (pos_ + 1 < pattern_.size() && pattern_[pos_] == '-' && pattern_[pos_ + 1] != ']') {
+                ++pos_;
+                high = static_cast<unsigned char>(pattern_[pos_++]);
+                if (high == '\\') {
+                    if (pos_ >= pattern_.size()) return fail("Missing ]");
+                    if (!escape_byte(high)) return -1;
+                }
+                if (high < low) return fail("Bad class range");
+            }
+            for (int b = low; b <= high; ++b) set.has[b] = true;
+        }
+        if (negate) {
+            // Folding comes first, so [^a] excludes 'A' too
+            int node = set_node(set);
+            ByteSet& folded = engine_.sets_[nodes_[node].value];
+            for (bool& member : folded.has) member = !member;
+            return node;
+        }
+        return set_node(set);
+    }
+
+    // ------------------------------------------------------------------------
+
+    uint32_t push(Inst inst) {
+        if (engine_.program_.size() >= kMaxProgram) {
+            fail("Pattern too large");
+            return 0;
+        }
+        engine_.program_.push_back(inst);
+        depths_.push_back(loop_depth_);
+        return static_cast<uint32_t>(engine_.program_.size() - 1);
+    }
+
+    uint32_t here() const { return static_cast<uint32_t>(engine_.program_.size()); }
+
+    bool can_match_empty(int index) const {
+        const Node& node = nodes_[index];
+        switch (node.kind) {
+            case Node::Byte:
+            case Node::Set:
+            case Node::Any:
+                return false;
+            case Node::Concat:
+                for (int child : node.children) {
+                    if (!can_match_empty(child)) return false;
+                }
+                return true;
+            case Node::Alternate:
+                for (int child : node.children) {
+                    if (can_match_empty(child)) return true;
+                }
+                return false;
+            case Node::Repeat:
+                return node.min == 0 || can_match_empty(node.children[0]);
+            case Node::Group:
+                return can_match_empty(node.children[0]);
+            default:
+                return true;
+        }
+    }
+
+    void emit(int index) {
+        if (!error_.empty()) return;
+        const Node& node = nodes_[index];
+        std::vector<Inst>& program = engine_.program_;
+        switch (node.kind) {
+            case Node::Empty:
+                break;
+            case Node::Byte:
+                push({Op::Byte, static_cast<uint8_t>(node.value), 0, 0});
+                break;
+            case Node::Set:
+                push({Op::Set, 0, static_cast<uint32_t>(node.value), 0});
+                break;
+            case Node::Any:
+                push({Op::Any, 0, 0, 0});
+                break;
+            case Node::Assert:
+                push({Op::Assert, static_cast<uint8_t>(node.value), 0, 0});
+                break;
+            case Node::Concat:
+                for (int child : node.children) emit(child);
+                break;
+            case Node::Group:
+                push({Op::Save, 0, static_cast<uint32_t>(2 * node.value), 0});
+                emit(node.children[0]);
+                push({Op::Save, 0, static_cast<uint32_t>(2 * node.value + 1), 0});
+                break;
+            case Node::Alternate: {
+                std::vector<uint32_t> jumps;
+                for (size_t i = 0; i < node.children.size(); ++i) {
+                    if (i + 1 == node.children.size()) {
+                        emit(node.children[i]);
+                        break;
+                    }
+                    uint32_t split = push({Op::Split, 0, 0, 0});
+                    if (!error_.empty()) return;
+                    program[split].x = here();
+                    emit(node.children[i]);
+                    jumps.push_back(push({Op::Jump, 0, 0, 0}));
+                    if (!error_.empty()) return;
+                    program[split].y = here();
+                }
+                if (!error_.empty()) return;
+                for (uint32_t jump : jumps) program[jump].x = here();
+                break;
+            }
+            case Node::Repeat: {
+                // Splits prefer the body when greedy, the exit when lazy
+                auto patch = [&](uint32_t split, uint32_t body, uint32_t exit) {
+                    program[split].x = node.greedy ? body : exit;
+                    program[split].y = node.greedy ? exit : body;
+                };
+                for (int i = 0; i < node.min; ++i) emit(node.children[0]);
+                if (node.max < 0) {
+                    // A body that can match empty is bracketed by Iterate and
+                    // Progress, so an iteration that consumed nothing leaves
+                    // the loop (as backtracking does) instead of dying as a
+                    // duplicate of the thread that started it
+                    bool guard = can_match_empty(node.children[0]);
+                    uint32_t loop = push({Op::Split, 0, 0, 0});
+                    if (guard) {
+                        ++loop_depth_;
+                        push({Op::Iterate, 0, 0, 0});
+                    }
+                    emit(node.children[0]);
+                    uint32_t back = push({guard ? Op::Progress : Op::Jump, 0, loop, 0});
+                    if (guard) --loop_depth_;
+                    if (!error_.empty()) return;
+                    patch(loop, loop + 1, here());
+                    program[back].y = here();
+                } else {
+                    std::vector<uint32_t> splits;
+                    for (int i = node.min; i < node.max && error_.empty(); ++i) {
+                        splits.push_back(push({Op::Split, 0, 0, 0}));
+                        emit(node.children[0]);
+                    }
+                    if (!error_.empty()) return;
+                    for (uint32_t split : splits) patch(split, split + 1, here());
+                }
+                break;
+            }
+        }
+    }
+};
+
+// ============================================================================
+// Input: random access over consecutive chunks
+// ============================================================================
+
+class RegexEngine::Input {
+public:
+    explicit Input(const std::vector<std::string_view>& chunks) : chunks_(chunks) {
+        starts_.reserve(chunks.size());
+        for (std::string_view chunk : chunks) {
+            starts_.push_back(length_);
+            length_ += chunk.size();
+        }
+    }
+
+    size_t length() const { return length_; }
+
+    // Byte at pos, -1 past the end
+    int at(size_t pos) {
+        if (pos >= length_) return -1;
+        if (pos < starts_[chunk_] || pos - starts_[chunk_] >= chunks_[chunk_].size()) seek(pos);
+        return static_cast<unsigned char>(chunks_[chunk_][pos - starts_[chunk_]]);
+    }
+
+    // First position >= pos whose byte is in table, or length()
+    size_t skip(size_t pos, const bool* table, int single) {
+        while (pos < length_) {
+            seek(pos);
+            std::string_view chunk = chunks_[chunk_];
+            size_t offset = pos - starts_[chunk_];
+            const char* data = chunk.data();
+            if (single >= 0) {
+                const void* hit = std::memchr(data + offset, single, chunk.size() - offset);
+                if (hit) return starts_[chunk_] + static_cast<size_t>(static_cast<const char*>(hit) - data);
+            } else {
+                for (size_t i = offset; i < chunk.size(); ++i) {
+                    if (table[static_cast<unsigned char>(data[i])]) return starts_[chunk_] + i;
+                }
+            }
+            pos = starts_[chunk_] + chunk.size();
+        }
+        return length_;
+    }
+
+private:
+    void seek(size_t pos) {
+        // Last chunk starting at or before pos (skips empty chunks)
+        chunk_ = static_cast<size_t>(std::upper_bound(starts_.begin(), starts_.end(), pos) - starts_.begin()) - 1;
+    }
+
+    const std::vector<std::string_view>& chunks_;
+    std::vector<size_t> starts_;
+    size_t length_ = 0;
+    size_t chunk_ = 0;
+};
+
+// ============================================================================
+// Pike VM
+// ============================================================================
+
+// Threads at one position, in priority order, deduplicated by state (the
+// pc, or one of its extra states past the program)
+struct RegexEngine::Threads {
+    struct Frame {
+        uint32_t pc;
+        uint32_t fresh;     // Innermost Iterate loops yet to consume this iteration
+        uint32_t slot;      // Restore frames put caps[slot] back to value
+        size_t value;
+        bool restore;
+    };
+
+    std::vector<uint32_t> dense;
+    std::vector<uint32_t> sparse;
+    std::vector<size_t> caps;       // slots per pc
+    std::vector<Frame> stack;       // add_thread's worklist
+    size_t size = 0;
+    size_t slots;
+
+    Threads(size_t states, size_t program, size_t slot_count)
+        : dense(states), sparse(states), caps(program * slot_count), slots(slot_count) {}
+
+    bool contains(uint32_t state) const { return sparse[state] < size && dense[sparse[state]] == state; }
+    void insert(uint32_t state) {
+        sparse[state] = static_cast<uint32_t>(size);
+        dense[size++] = state;
+    }
+    void clear() { size = 0; }
+};
+
+RegexEngine::RegexEngine(const std::string& pattern, bool case_sensitive) {
+    Parser parser(pattern, !case_sensitive, *this);
+    if (!parser.compile()) {
+        error_ = parser.error();
+        program_.clear();
+        sets_.clear();
+        slot_count_ = 0;
+        return;
+    }
+    compute_first_bytes();
+}
+
+void RegexEngine::compute_first_bytes() {
+    // Closure of the start over non-consuming instructions; assertions are
+    // assumed to pass, which only widens the set
+    std::vector<bool> seen(program_.size());
+    std::vector<uint32_t> stack{0};
+    skip_ = true;
+    while (!stack.empty()) {
+        uint32_t pc = stack.back();
+        stack.pop_back();
+        if (seen[pc]) continue;
+        seen[pc] = true;
+        const Inst& inst = program_[pc];
+        switch (inst.op) {
+            case Op::Byte: first_byte_[inst.arg] = true; break;
+            case Op::Set:
+                for (int c = 0; c < 256; ++c) first_byte_[c] = first_byte_[c] || sets_[inst.x].has[c];
+                break;
+            case Op::Any:
+                for (int c = 0; c < 256; ++c) first_byte_[c] = first_byte_[c] || c != '\n';
+                break;
+            case Op::Split:
+                stack.push_back(inst.y);
+                stack.push_back(inst.x);
+                break;
+            case Op::Jump: stack.push_back(inst.x); break;
+            case Op::Progress:
+                stack.push_back(inst.y);
+                stack.push_back(inst.x);
+                break;
+            case Op::Save:
+            case Op::Assert:
+            case Op::Iterate: stack.push_back(pc + 1); break;
+            case Op::Match: skip_ = false; break;     // Empty match: every position counts
+        }
+    }
+    int count = 0;
+    for (int c = 0; c < 256; ++c) {
+        if (first_byte_[c]) {
+            ++count;
+            single_first_ = c;
+        }
+    }
+    if (count != 1) single_first_ = -1;
+}
+
+bool RegexEngine::holds(uint8_t assertion, size_t pos, Input& input) const {
+    int prev = pos > 0 ? input.at(pos - 1) : -1;
+    int next = input.at(pos);
+    switch (assertion) {
+        case LineStart: return prev < 0 || prev == '\n';
+        case LineEnd: return next < 0 || next == '\n' || (next == '\r' && input.at(pos + 1) == '\n');
+        case TextStart: return pos == 0;
+        case TextEnd: return next < 0;
+        case WordBoundary: return is_word(prev) != is_word(next);
+        case NotWordBoundary: return is_word(prev) == is_word(next);
+        default: return false;
+    }
+}
+
+void RegexEngine::add_thread(Threads& list, uint32_t start_pc, size_t pos, std::vector<size_t>& caps,
+                             Input& input) const {
+    // Depth-first in priority order; Save pushes a frame restoring the slot
+    // once everything explored after it is done.
+    // Where Progress leads depends on fresh, the count of innermost Iterate
+    // loops whose current iteration started at pos, so inside such loops a
+    // pc reached with a different count is a different thread (state()).
+    // Consuming resets the count, so threads at Byte, Set and Any need none.
+    std::vector<Threads::Frame>& stack = list.stack;
+    stack.clear();
+    stack.push_back({start_pc, 0, 0, 0, false});
+    while (!stack.empty()) {
+        Threads::Frame frame = stack.back();
+        stack.pop_back();
+        if (frame.restore) {
+            caps[frame.slot] = frame.value;
+            continue;
+        }
+        uint32_t pc = frame.pc;
+        uint32_t fresh = frame.fresh;
+        bool follow = true;
+        while (follow && !list.contains(state(pc, fresh))) {
+            list.insert(state(pc, fresh));
+            const Inst& inst = program_[pc];
+            switch (inst.op) {
+                case Op::Jump:
+                    pc = inst.x;
+                    break;
+                case Op::Split:
+                    stack.push_back({inst.y, fresh, 0, 0, false});
+                    pc = inst.x;
+                    break;
+                case Op::Iterate:
+                    ++fresh;
+                    ++pc;
+                    break;
+                case Op::Progress:
+                    // An empty iteration ends the loop
+                    if (fresh > 0) {
+                        --fresh;
+                        pc = inst.y;
+                    } else {
+                        pc = inst.x;
+                    }
+                    break;
+                case Op::Save:
+                    stack.push_back({0, 0, inst.x, caps[inst.x], true});
+                    caps[inst.x] = pos;
+                    ++pc;
+                    break;
+                case Op::Assert:
+                    if (holds(inst.arg, pos, input)) ++pc;
+                    else follow = false;
+                    break;
+                default:
+                    std::copy(caps.begin(), caps.end(), &list.caps[pc * list.slots]);
+                    follow = false;
+                    break;
+            }
+        }
+    }
+}
+
+bool RegexEngine::run(Input& input, size_t start, Threads& current, Threads& next, std::vector<size_t>& work,
+                      Match& match) const {
+    size_t length = input.length();
+    current.clear();
+    bool matched = false;
+    for (size_t pos = start;; ++pos) {
+        if (!matched) {
+            if (current.size == 0 && skip_) {
+                pos = input.skip(pos, first_byte_, single_first_);
+                if (pos >= length) break;
+            }
+            // The new thread starting here has the lowest priority
+            std::fill(work.begin(), work.end(), npos);
+            add_thread(current, 0, pos, work, input);
+        }
+        if (current.size == 0) break;
+
+        int c = input.at(pos);
+        next.clear();
+        for (size_t i = 0; i < current.size; ++i) {
+            uint32_t pc = current.dense[i];
+            if (pc >= program_.size()) continue;        // An extra state: never consumes
+            const Inst& inst = program_[pc];
+            const size_t* caps = &current.caps[pc * slot_count_];
+            bool step = false;
+            switch (inst.op) {
+                case Op::Byte: step = c == inst.arg; break;
+                case Op::Set: step = c >= 0 && sets_[inst.x].has[c]; break;
+                case Op::Any: step = c >= 0 && c != '\n'; break;
+                case Op::Match:
+                    // Lower-priority threads can no longer win
+                    matched = true;
+                    match.groups.assign(caps, caps + slot_count_);
+                    i = current.size;
+                    continue;
+                default: break;
+            }
+            if (step) {
+                std::copy(caps, caps + slot_count_, work.begin());
+                add_thread(next, pc + 1, pos + 1, work, input);
+            }
+        }
+        std::swap(current, next);
+        if (pos >= length) break;
+    }
+    if (matched) {
+        match.position = match.groups[0];
+        match.length = match.groups[1] - match.groups[0];
+    }
+    return matched;
+}
+
+bool RegexEngine::search(std::string_view text, size_t start, Match& match) const {
+    bool found = false;
+    for_each_match(text, start, [&](const Match& hit) {
+        match = hit;
+        found = true;
+        return false;
+    });
+    return found;
+}
+
+void RegexEngine::for_each_match(std::string_view text, size_t start, const Visitor& visit) const {
+    for_each_match(std::vector<std::string_view>{text}, start, visit);
+}
+
+void RegexEngine::for_each_match(const std::vector<std::string_view>& chunks, size_t start,
+                                 const Visitor& visit) const {
+    if (!ok()) return;
+    Input input(chunks);
+    Threads current(state_count_, program_.size(), slot_count_);
+    Threads next(state_count_, program_.size(), slot_count_);
+    std::vector<size_t> work(slot_count_);
+    Match match;
+    for (size_t pos = start; pos <= input.length();) {
+        if (!run(input, pos, current, next, work, match) || !visit(match)) return;
+        // An empty match moves on by one so the scan always advances
+        pos = match.position + std::max<size_t>(match.length, 1);
+    }
+}
+
+std::string RegexEngine::expand(std::string_view replacement, const Match& match, std::string_view text) {
+    std::string result;
+    auto append_group = [&](size_t group) {
+        if (match.has_group(group) && match.group_end(group) <= text.size()) {
+            result.append(text.substr(match.group_begin(group), match.group_end(group) - match.group_begin(group)));
+        }
+    };
+    for (size_t i = 0; i < replacement.size(); ++i) {
+        char c = replacement[i];
+        if (c != '$' || i + 1 >= replacement.size()) {
+            result += c;
+            continue;
+        }
+        char next = replacement[i + 1];
+        if (next == '$') {
+            result += '$';
+            ++i;
+        } else if (next >= '0' && next <= '9') {
+            append_group(static_cast<size_t>(next - '0'));
+            ++i;
+        } else if (next == '{') {
+            size_t close = replacement.find('}', i + 2);
+            size_t group = 0;
+            bool valid = close != std::string_view::npos && close > i + 2;
+            for (size_t j = i + 2; valid && j < close; ++j) {
+                valid = replacement[j] >= '0' && replacement[j] <= '9';
+                group = group * 10 + static_cast<size_t>(replacement[j] - '0');
+            }
+            if (valid) {
+                append_group(group);
+                i = close;
+            } else {
+                result += c;
+            }
+        } else {
+            result += c;
+        }
+    }
+    return result;
+}
+
+std::shared_ptr<const RegexEngine> RegexEngine::cached(const std::string& pattern, bool case_sensitive) {
+    static std::mutex mutex;
+    static std::list<std::pair<std::string, std::shared_ptr<const RegexEngine>>> entries;  // Most recent first
+
+    std::string key = (case_sensitive ? "c:" : "i:") + pattern;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (it->first == key) {
+                entries.splice(entries.begin(), entries, it);
+                return entries.front().second;
+            }
+        }
+    }
+    // Compile outside the lock; a racing duplicate is harmless
+    auto compiled = std::make_shared<const RegexEngine>(pattern, case_sensitive);
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.emplace_front(std::move(key), compiled);
+    if (entries.size() > kCacheSize) entries.pop_back();
+    return compiled;
+}
@@ -0,0 +1,213 @@
+#include "remote_agent.h"
+#include "indexer.h"
+#include "piece_table.h"
+#include "platform_file.h"
+#include <algorithm>
+#include <filesystem>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace editor {
+
+namespace {
+
+constexpr uint32_t kMaxLinesPerRead = 10000;
+constexpr uint32_t kMaxResults = 10000;
+
+} // namespace
+
+RemoteAgent::RemoteAgent(std::string root, SendFn send)
+    : root_(std::filesystem::path(root).lexically_normal().string()), send_(std::move(send)) {}
+
+RemoteAgent::~RemoteAgent() {
+    if (indexer_) indexer_->stop();
+}
+
+void RemoteAgent::start() {
+    send_(RemoteWriter(0, RemoteMessage::Hello).u32(kRemoteProtocolVersion).str(root_).finish());
+    indexer_ = std::make_unique<BackgroundIndexer>();
+    indexer_->start();
+    indexer_->index_workspace({root_});
+}
+
+void RemoteAgent::wait_for_index() {
+    if (indexer_) indexer_->wait_for_indexing();
+}
+
+bool RemoteAgent::receive(const char* data, size_t size) {
+    framing_.feed(data, size);
+    RemoteFrame frame;
+    while (framing_.next(frame)) handle(frame);
+    // One Ack per document for everything this read brought: typing that
+    // arrives in a burst is confirmed once
+    for (auto& entry : documents_) {
+        Document& document = entry.second;
+        if (!document.acknowledge) continue;
+        document.acknowledge = false;
+        send_(RemoteWriter(entry.first, RemoteMessage::Ack).u64(document.version).finish());
+    }
+    return !framing_.failed();
+}
+
+void RemoteAgent::handle(const RemoteFrame& frame) {
+    RemoteReader reader(frame.payload);
+    switch (frame.type) {
+    case RemoteMessage::Open:
+        open(frame.channel, reader);
+        return;
+    case RemoteMessage::List:
+        list(reader);
+        return;
+    case RemoteMessage::Search:
+        search(reader);
+        return;
+    default:
+        handle_document(frame.channel, frame);
+        return;
+    }
+}
+
+void RemoteAgent::open(uint32_t channel, RemoteReader& reader) {
+    std::string path;
+    if (channel == 0 || !reader.str(path)) return fail(channel, "bad open request");
+    std::string full = resolve(path);
+    std::shared_ptr<MappedFile> mapping = full.empty() ? nullptr : PlatformFile::map_file(full);
+    if (!mapping) return fail(channel, "cannot open " + path);
+    Document& document = documents_[channel];
+    document = Document();
+    document.path = full;
+    document.text = std::make_shared<PieceTable>(mapping);
+    send_(RemoteWriter(channel, RemoteMessage::Opened)
+              .u64(document.version)
+              .u64(document.text->get_line_count())
+              .u64(document.text->get_total_length())
+              .finish());
+}
+
+void RemoteAgent::handle_document(uint32_t channel, const RemoteFrame& frame) {
+    auto found = documents_.find(channel);
+    if (found == documents_.end()) return fail(channel, "no document on this channel");
+    Document& document = found->second;
+    PieceTable& text = *document.text;
+    RemoteReader reader(frame.payload);
+    switch (frame.type) {
+    case RemoteMessage::ReadLines: {
+        uint64_t first = 0;
+        uint32_t count = 0;
+        if (!reader.u64(first) || !reader.u32(count)) return fail(channel, "bad read request");
+        count = (std::min)(count, kMaxLinesPerRead);
+        RemoteWriter writer(channel, RemoteMessage::Lines);
+        writer.u64(document.version).u64(text.get_line_count()).u64(first);
+        // Each view is copied into the frame before the cursor moves on
+        PieceTable::LineCursor cursor = text.lines(static_cast<size_t>(first));
+        std::string_view line;
+        for (uint32_t sent = 0; sent < count && first < text.get_line_count() && cursor.next(line); ++sent) {
+            writer.str(line);
+        }
+        send_(writer.finish());
+        return;
+    }
+    case RemoteMessage::Edit: {
+        uint64_t version = 0, line = 0, column = 0, end_line = 0, end_column = 0;
+        std::string inserted;
+        if (!reader.u64(version) || !reader.u64(line) || !reader.u64(column) || !reader.u64(end_line) ||
+            !reader.u64(end_column) || !reader.str(inserted)) {
+            return fail(channel, "bad edit");
+        }
+        if (version != document.version + 1) return fail(channel, "edit out of order");
+        size_t start = text.line_col_to_offset(static_cast<size_t>(line), static_cast<size_t>(column));
+        size_t end = text.line_col_to_offset(static_cast<size_t>(end_line), static_cast<size_t>(end_column));
+        if (end > start) text.remove(start, end - start);
+        if (!inserted.empty()) text.insert(start, inserted);
+        document.version = version;
+        document.acknowledge = true;
+        return;
+    }
+    case RemoteMessage::Save: {
+        // As the editor saves: off the mapping first, then the pieces streamed
+        text.release_mapping();
+        std::vector<std::string_view> spans;
+        for (auto it = text.chunks(); !it.done(); ++it) spans.push_back(*it);
+        bool ok = PlatformFile::write_file_binary(document.path, spans);
+        send_(RemoteWriter(channel, RemoteMessage::Saved).u64(document.version).u8(ok ? 1 : 0).finish());
+        return;
+    }
+    case RemoteMessage::Close:
+        documents_.erase(found);
+        return;
+    default:
+        return fail(channel, "unexpected message");
+    }
+}
+
+void RemoteAgent::list(RemoteReader& reader) {
+    std::string directory;
+    if (!reader.str(directory)) return fail(0, "bad list request");
+    std::string full = resolve(directory);
+    if (full.empty()) return fail(0, "cannot list " + directory);
+    std::error_code error;
+    std::filesystem::directory_iterator it(full, error);
+    if (error) return fail(0, "cannot list " + directory);
+    struct Entry {
+        std::string name;
+        bool directory;
+        uint64_t size;
+    };
+    std::vector<Entry> entries;
+    for (; it != std::filesystem::directory_iterator(); it.increment(error)) {
+        if (error) break;
+        Entry entry{it->path().filename().string(), it->is_directory(error), 0};
+        if (!entry.directory) entry.size = it->file_size(error);
+        entries.push_back(std::move(entry));
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.name < b.name; });
+    RemoteWriter writer(0, RemoteMessage::Entries);
+    writer.str(directory).u32(static_cast<uint32_t>(entries.size()));
+    for (const Entry& entry : entries) writer.str(entry.name).u8(entry.directory ? 1 : 0).u64(entry.size);
+    send_(writer.finish());
+}
+
+void RemoteAgent::search(RemoteReader& reader) {
+    std::string pattern;
+    uint8_t regex = 0, case_sensitive = 0;
+    uint32_t max_results = 0;
+    if (!reader.str(pattern) || !reader.u8(regex) || !reader.u8(case_sensitive) || !reader.u32(max_results)) {
+        return fail(0, "bad search request");
+    }
+    std::vector<SearchResult> results;
+    if (indexer_) {
+        results = indexer_->find_in_files(pattern, regex != 0, case_sensitive != 0,
+                                          (std::min)(max_results, kMaxResults));
+    }
+    RemoteWriter writer(0, RemoteMessage::Results);
+    writer.u32(static_cast<uint32_t>(results.size()));
+    for (const SearchResult& result : results) {
+        writer.str(relative(result.file_path))
+            .u64(result.line_number)
+            .u64(result.column)
+            .u64(result.length)
+            .str(result.line_content);
+    }
+    send_(writer.finish());
+}
+
+void RemoteAgent::fail(uint32_t channel, const std::string& message) {
+    if (channel != 0) documents_.erase(channel);
+    send_(RemoteWriter(channel, RemoteMessage::Error).str(message).finish());
+}
+
+std::string RemoteAgent::resolve(const std::string& relative) const {
+    std::filesystem::path path = std::filesystem::path(relative).lexically_normal();
+    if (path.is_absolute() || path.has_root_name()) return "";
+    auto first = path.begin();
+    if (first != path.end() && *first == "..") return "";
+    return (std::filesystem::path(root_) / path).lexically_normal().string();
+}
+
+std::string RemoteAgent::relative(const std::string& path) const {
+    std::string result = std::filesystem::path(path).lexically_relative(root_).generic_string();
+    return result.empty() ? path : result;
+}
+
+} // namespace editor
@@ -0,0 +1,118 @@
+#include "remote_protocol.h"
+#include <cstring>
+
+namespace editor {
+
+namespace {
+
+constexpr size_t kHeader = 4 + 4 + 1;   // Size, channel, type
+
+void put_le(std::string& out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) out += static_cast<char>((value >> (8 * i)) & 0xFF);
+}
+
+uint64_t get_le(const char* data, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) value |= uint64_t(static_cast<unsigned char>(data[i])) << (8 * i);
+    return value;
+}
+
+} // namespace
+
+RemoteWriter::RemoteWriter(uint32_t channel, RemoteMessage type) {
+    frame_.assign(4, '\0');
+    put_le(frame_, channel, 4);
+    frame_ += static_cast<char>(type);
+}
+
+RemoteWriter& RemoteWriter::u8(uint8_t value) {
+    frame_ += static_cast<char>(value);
+    return *this;
+}
+
+RemoteWriter& RemoteWriter::u32(uint32_t value) {
+    put_le(frame_, value, 4);
+    return *this;
+}
+
+RemoteWriter& RemoteWriter::u64(uint64_t value) {
+    put_le(frame_, value, 8);
+    return *this;
+}
+
+RemoteWriter& RemoteWriter::str(std::string_view value) {
+    put_le(frame_, value.size(), 4);
+    frame_.append(value.data(), value.size());
+    return *this;
+}
+
+std::string RemoteWriter::finish() {
+    uint64_t size = frame_.size() - 4;
+    for (size_t i = 0; i < 4; ++i) frame_[i] = static_cast<char>((size >> (8 * i)) & 0xFF);
+    return std::move(frame_);
+}
+
+bool RemoteReader::take(void* out, size_t size) {
+    if (!ok_ || data_.size() - pos_ < size) return ok_ = false;
+    std::memcpy(out, data_.data() + pos_, size);
+    pos_ += size;
+    return true;
+}
+
+bool RemoteReader::u8(uint8_t& value) {
+    return take(&value, 1);
+}
+
+bool RemoteReader::u32(uint32_t& value) {
+    char bytes[4];
+    if (!take(bytes, 4)) return false;
+    value = static_cast<uint32_t>(get_le(bytes, 4));
+    return true;
+}
+
+bool RemoteReader::u64(uint64_t& value) {
+    char bytes[8];
+    if (!take(bytes, 8)) return false;
+    value = get_le(bytes, 8);
+    return true;
+}
+
+bool RemoteReader::str(std::string& value) {
+    uint32_t size = 0;
+    if (!u32(size)) return false;
+    if (data_.size() - pos_ < size) return ok_ = false;
+    value.assign(data_.data() + pos_, size);
+    pos_ += size;
+    return true;
+}
+
+void RemoteFraming::feed(const char* data, size_t size) {
+    // Consumed bytes are dropped once they outweigh what is left
+    if (begin_ > 0 && begin_ >= buffer_.size() - begin_) {
+        buffer_.erase(0, begin_);
+        begin_ = 0;
+    }
+    buffer_.append(data, size);
+}
+
+bool RemoteFraming::next(RemoteFrame& frame) {
+    if (failed_ || buffered() < 4) return false;
+    size_t size = static_cast<size_t>(get_le(buffer_.data() + begin_, 4));
+    if (size < kHeader - 4 || size > kMaxFrame) {
+        failed_ = true;
+        return false;
+    }
+    if (buffered() < 4 + size) return false;
+    const char* at = buffer_.data() + begin_ + 4;
+    frame.channel = static_cast<uint32_t>(get_le(at, 4));
+    frame.type = static_cast<RemoteMessage>(at[4]);
+    frame.payload.assign(at + 5, size - 5);
+    begin_ += 4 + size;
+    if (begin_ == buffer_.size()) {
+        buffer_.clear();
+        begin_ = 0;
+    }
+    return true;
+}
+
+} // namespace editor
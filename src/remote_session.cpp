@@ -0,0 +1,313 @@
+#include "remote_session.h"
+#include "platform_process.h"
+#include "process_io_loop.h"
+#include <algorithm>
+
+namespace editor {
+
+RemoteDocument::RemoteDocument(uint32_t channel, std::string path, std::function<void(std::string)> send)
+    : channel_(channel), path_(std::move(path)), send_(std::move(send)) {}
+
+void RemoteDocument::request_lines(size_t first, size_t count) {
+    if (failed() || count == 0) return;
+    if (window_valid_ && first >= first_ && first + count <= first_ + lines_.size()) return;
+    if (request_pending_) return;       // Asked again when it arrives, if still missing
+    size_t from = first > count ? first - count : 0;
+    request_pending_ = true;
+    send_(RemoteWriter(channel_, RemoteMessage::ReadLines).u64(from).u32(static_cast<uint32_t>(count * 3)).finish());
+}
+
+bool RemoteDocument::get_line(size_t line, std::string& text) const {
+    if (!window_valid_ || line < first_ || line >= first_ + lines_.size()) return false;
+    text = lines_[line - first_];
+    return true;
+}
+
+void RemoteDocument::edit(size_t line, size_t column, size_t end_line, size_t end_column, const std::string& text) {
+    if (failed()) return;
+    Edit change{++version_, line, column, end_line, end_column, text};
+    apply_to_window(change);
+    send_(RemoteWriter(channel_, RemoteMessage::Edit)
+              .u64(change.version)
+              .u64(line)
+              .u64(column)
+              .u64(end_line)
+              .u64(end_column)
+              .str(text)
+              .finish());
+    pending_.push_back(std::move(change));
+}
+
+void RemoteDocument::save() {
+    if (!failed()) send_(RemoteWriter(channel_, RemoteMessage::Save).finish());
+}
+
+void RemoteDocument::apply_to_window(const Edit& edit) {
+    size_t added = static_cast<size_t>(std::count(edit.text.begin(), edit.text.end(), '\n'));
+    size_t removed = edit.end_line - edit.line;
+    line_count_ = line_count_ + added - removed;
+    if (!window_valid_) return;
+    size_t end = first_ + lines_.size();
+    if (edit.end_line < first_) {
+        // Above the window: it only moves
+        first_ = first_ + added - removed;
+        return;
+    }
+    if (edit.line >= end) return;
+    if (edit.line < first_ || edit.end_line >= end) {
+        // Straddles an edge: the part outside is unknown here
+        window_valid_ = false;
+        return;
+    }
+    const std::string& head = lines_[edit.line - first_];
+    const std::string& tail = lines_[edit.end_line - first_];
+    std::string joined = head.substr(0, (std::min)(edit.column, head.size())) + edit.text +
+                         tail.substr((std::min)(edit.end_column, tail.size()));
+    std::vector<std::string> replaced;
+    for (size_t start = 0;;) {
+        size_t newline = joined.find('\n', start);
+        replaced.push_back(joined.substr(start, newline - start));
+        if (newline == std::string::npos) break;
+        start = newline + 1;
+    }
+    auto at = lines_.begin() + (edit.line - first_);
+    lines_.erase(at, at + (removed + 1));
+    lines_.insert(lines_.begin() + (edit.line - first_), std::make_move_iterator(replaced.begin()),
+                  std::make_move_iterator(replaced.end()));
+}
+
+void RemoteDocument::handle(const RemoteFrame& frame) {
+    RemoteReader reader(frame.payload);
+    switch (frame.type) {
+    case RemoteMessage::Opened: {
+        uint64_t version = 0, lines = 0, length = 0;
+        if (!reader.u64(version) || !reader.u64(lines) || !reader.u64(length)) break;
+        open_ = true;
+        acknowledged_ = version;
+        line_count_ = static_cast<size_t>(lines);
+        // Edits made before the document opened count from the agent's version
+        for (const Edit& edit : pending_) {
+            line_count_ += static_cast<size_t>(std::count(edit.text.begin(), edit.text.end(), '\n'));
+            line_count_ -= edit.end_line - edit.line;
+        }
+        break;
+    }
+    case RemoteMessage::Lines: {
+        uint64_t version = 0, lines = 0, first = 0;
+        if (!reader.u64(version) || !reader.u64(lines) || !reader.u64(first)) break;
+        request_pending_ = false;
+        lines_.clear();
+        std::string line;
+        while (!reader.at_end() && reader.str(line)) lines_.push_back(std::move(line));
+        first_ = static_cast<size_t>(first);
+        window_valid_ = true;
+        line_count_ = static_cast<size_t>(lines);
+        // The agent had not seen these yet
+        for (const Edit& edit : pending_) {
+            if (edit.version > version) apply_to_window(edit);
+        }
+        break;
+    }
+    case RemoteMessage::Ack: {
+        uint64_t version = 0;
+        if (!reader.u64(version)) break;
+        acknowledged_ = (std::max)(acknowledged_, version);
+        while (!pending_.empty() && pending_.front().version <= acknowledged_) pending_.pop_front();
+        break;
+    }
+    case RemoteMessage::Saved: {
+        uint64_t version = 0;
+        uint8_t ok = 0;
+        if (reader.u64(version) && reader.u8(ok) && ok) saved_version_ = version;
+        if (!ok) error_ = "cannot save " + path_;
+        break;
+    }
+    case RemoteMessage::Error:
+        open_ = false;
+        window_valid_ = false;
+        pending_.clear();
+        if (!reader.str(error_) || error_.empty()) error_ = "agent error";
+        break;
+    default:
+        break;
+    }
+}
+
+RemoteSession::RemoteSession() = default;
+
+RemoteSession::~RemoteSession() {
+    disconnect();
+}
+
+std::vector<std::string> RemoteSession::ssh_command(const std::string& host, const std::string& root,
+                                                    const std::string& agent) {
+    return {"ssh", "-C", "-T", host, agent, "--agent", root};
+}
+
+bool RemoteSession::connect(const std::vector<std::string>& command) {
+    disconnect();
+    if (command.empty()) return false;
+    ProcessOptions options;
+    options.hide_window = true;
+    options.io.redirect_stdin = true;
+    options.io.redirect_stdout = true;
+    options.io.async_output = true;
+    auto process = std::make_unique<PlatformProcess>();
+    if (!process->start(command[0], std::vector<std::string>(command.begin() + 1, command.end()), options)) {
+        return false;
+    }
+    io_loop_ = ProcessIoLoop::shared();
+    watch_id_ = io_loop_->watch(process->get_stdout_pipe(), [this](const char* data, size_t size) {
+        receive(data, size);
+    });
+    if (watch_id_ == 0) {
+        process->terminate(0);
+        return false;
+    }
+    PlatformProcess* raw = process.get();
+    process_ = std::move(process);
+    send_ = [raw](std::string frame) { raw->write_stdin(frame); };
+    return true;
+}
+
+void RemoteSession::attach(SendFn send) {
+    disconnect();
+    send_ = std::move(send);
+}
+
+void RemoteSession::disconnect() {
+    if (io_loop_ && watch_id_) io_loop_->unwatch(watch_id_);
+    watch_id_ = 0;
+    if (process_) {
+        // The agent exits at the end of its input
+        process_->close_stdin();
+        if (!process_->wait(2000)) process_->terminate(1000);
+        process_.reset();
+    }
+    send_ = nullptr;
+    connected_ = false;
+    documents_.clear();
+    requests_.clear();
+    std::lock_guard<std::mutex> lock(mutex_);
+    framing_ = RemoteFraming();
+    arrived_.clear();
+    lost_ = false;
+}
+
+void RemoteSession::receive(const char* data, size_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (size == 0) {
+        lost_ = true;
+        return;
+    }
+    framing_.feed(data, size);
+    RemoteFrame frame;
+    while (framing_.next(frame)) arrived_.push_back(std::move(frame));
+    if (framing_.failed()) lost_ = true;
+}
+
+bool RemoteSession::lost() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lost_;
+}
+
+size_t RemoteSession::poll() {
+    std::vector<RemoteFrame> frames;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        frames.swap(arrived_);
+    }
+    for (const RemoteFrame& frame : frames) {
+        if (frame.channel == 0) {
+            handle_workspace(frame);
+            continue;
+        }
+        auto found = documents_.find(frame.channel);
+        if (found != documents_.end()) found->second->handle(frame);
+    }
+    return frames.size();
+}
+
+void RemoteSession::send(std::string frame) {
+    if (send_) send_(std::move(frame));
+}
+
+std::shared_ptr<RemoteDocument> RemoteSession::open(const std::string& path) {
+    uint32_t channel = next_channel_++;
+    std::shared_ptr<RemoteDocument> document(
+        new RemoteDocument(channel, path, [this](std::string frame) { send(std::move(frame)); }));
+    documents_[channel] = document;
+    send(RemoteWriter(channel, RemoteMessage::Open).str(path).finish());
+    return document;
+}
+
+void RemoteSession::close(const std::shared_ptr<RemoteDocument>& document) {
+    if (!document || documents_.erase(document->channel_) == 0) return;
+    if (!document->failed()) send(RemoteWriter(document->channel_, RemoteMessage::Close).finish());
+    document->open_ = false;
+}
+
+void RemoteSession::list(const std::string& directory, ListFn done) {
+    requests_.push_back({RemoteMessage::Entries, std::move(done), nullptr});
+    send(RemoteWriter(0, RemoteMessage::List).str(directory).finish());
+}
+
+void RemoteSession::search(const std::string& pattern, bool regex, bool case_sensitive, size_t max_results,
+                           SearchFn done) {
+    requests_.push_back({RemoteMessage::Results, nullptr, std::move(done)});
+    send(RemoteWriter(0, RemoteMessage::Search)
+             .str(pattern)
+             .u8(regex ? 1 : 0)
+             .u8(case_sensitive ? 1 : 0)
+             .u32(static_cast<uint32_t>((std::min)(max_results, size_t(UINT32_MAX))))
+             .finish());
+}
+
+void RemoteSession::handle_workspace(const RemoteFrame& frame) {
+    RemoteReader reader(frame.payload);
+    if (frame.type == RemoteMessage::Hello) {
+        uint32_t version = 0;
+        connected_ = reader.u32(version) && version == kRemoteProtocolVersion && reader.str(root_);
+        if (!connected_) last_error_ = "agent speaks another protocol version";
+        return;
+    }
+    if (requests_.empty()) return;
+    Request request = std::move(requests_.front());
+    requests_.pop_front();
+    if (frame.type == RemoteMessage::Error) reader.str(last_error_);
+    if (request.answer == RemoteMessage::Entries) {
+        std::string directory;
+        std::vector<Entry> entries;
+        uint32_t count = 0;
+        if (frame.type == RemoteMessage::Entries && reader.str(directory) && reader.u32(count)) {
+            for (uint32_t i = 0; i < count; ++i) {
+                Entry entry;
+                uint8_t is_directory = 0;
+                if (!reader.str(entry.name) || !reader.u8(is_directory) || !reader.u64(entry.size)) break;
+                entry.directory = is_directory != 0;
+                entries.push_back(std::move(entry));
+            }
+        }
+        if (request.list) request.list(directory, std::move(entries));
+        return;
+    }
+    std::vector<SearchResult> results;
+    uint32_t count = 0;
+    if (frame.type == RemoteMessage::Results && reader.u32(count)) {
+        for (uint32_t i = 0; i < count; ++i) {
+            SearchResult result;
+            uint64_t line = 0, column = 0, length = 0;
+            if (!reader.str(result.file_path) || !reader.u64(line) || !reader.u64(column) || !reader.u64(length) ||
+                !reader.str(result.line_content)) {
+                break;
+            }
+            result.line_number = static_cast<size_t>(line);
+            result.column = static_cast<size_t>(column);
+            result.length = static_cast<size_t>(length);
+            results.push_back(std::move(result));
+        }
+    }
+    if (request.search) request.search(std::move(results));
+}
+
+} // namespace editor
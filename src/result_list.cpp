@@ -0,0 +1,201 @@
+#include "result_list.h"
+#include "indexer.h"
+#include "piece_table.h"
+#include "platform_file.h"
+#include <algorithm>
+#include <limits>
+
+namespace editor {
+
+namespace {
+
+uint32_t narrow(size_t value) {
+    return static_cast<uint32_t>((std::min)(value, size_t(std::numeric_limits<uint32_t>::max())));
+}
+
+bool is_diagnostic(ResultList::Kind kind) {
+    return kind == ResultList::Kind::Error || kind == ResultList::Kind::Warning || kind == ResultList::Kind::Note;
+}
+
+} // namespace
+
+ResultList::ResultList() = default;
+
+ResultList::~ResultList() = default;
+
+uint64_t ResultList::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    groups_.clear();
+    paths_.clear();
+    file_ids_.clear();
+    messages_.clear();
+    complete_ = false;
+    ++revision_;
+    return ++generation_;
+}
+
+bool ResultList::add(uint64_t generation, const std::string& path, const std::vector<Hit>& hits) {
+    if (hits.empty()) return generation == this->generation();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation != generation_) return false;
+    auto found = file_ids_.find(path);
+    uint32_t file = 0;
+    if (found != file_ids_.end()) {
+        file = found->second;
+    } else {
+        file = static_cast<uint32_t>(paths_.size());
+        paths_.push_back(path);
+        file_ids_.emplace(path, file);
+    }
+    // A file's second batch joins its group if nothing came in between
+    if (groups_.empty() || groups_.back().file != file) groups_.push_back({entries_.size(), file});
+    for (const Hit& hit : hits) {
+        Entry entry{file, narrow(hit.line), narrow(hit.column), narrow(hit.length), 0, 0, hit.kind};
+        if (!hit.message.empty()) {
+            entry.message = narrow(messages_.size());
+            entry.message_length = narrow(hit.message.size());
+            messages_.append(hit.message.data(), hit.message.size());
+        }
+        entries_.push_back(entry);
+    }
+    ++revision_;
+    return true;
+}
+
+bool ResultList::add(uint64_t generation, const std::vector<SearchResult>& results, Kind kind) {
+    std::vector<Hit> hits;
+    for (size_t i = 0; i < results.size(); ++i) {
+        hits.push_back({results[i].line_number, results[i].column, results[i].length, kind, {}});
+        if (i + 1 < results.size() && results[i + 1].file_path == results[i].file_path) continue;
+        if (!add(generation, results[i].file_path, hits)) return false;
+        hits.clear();
+    }
+    return true;
+}
+
+void ResultList::finish(uint64_t generation) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation != generation_) return;
+    complete_ = true;
+    ++revision_;
+}
+
+uint64_t ResultList::generation() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return generation_;
+}
+
+bool ResultList::complete() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return complete_;
+}
+
+size_t ResultList::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+size_t ResultList::file_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return paths_.size();
+}
+
+size_t ResultList::row_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size() + groups_.size();
+}
+
+uint64_t ResultList::revision() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return revision_;
+}
+
+void ResultList::fill(const Entry& entry, size_t index, Row& row) const {
+    row.header = false;
+    row.result = index;
+    row.path = paths_[entry.file];
+    row.line = entry.line;
+    row.column = entry.column;
+    row.length = entry.length;
+    row.kind = entry.kind;
+    row.text.assign(messages_, entry.message, entry.message_length);
+}
+
+void ResultList::rows(size_t first, size_t count, std::vector<Row>& out) {
+    out.clear();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t total = entries_.size() + groups_.size();
+        if (first >= total) return;
+        size_t end = (std::min)(total, first + count);
+        // The group holding the first row: the last whose header is at or before it
+        size_t lo = 0, hi = groups_.size();
+        while (hi - lo > 1) {
+            size_t mid = (lo + hi) / 2;
+            if (mid + groups_[mid].first <= first) lo = mid;
+            else hi = mid;
+        }
+        size_t group = lo;
+        for (size_t row = first; row < end; ++row) {
+            if (group + 1 < groups_.size() && row == group + 1 + groups_[group + 1].first) ++group;
+            Row item;
+            size_t header = group + groups_[group].first;
+            if (row == header) {
+                item.header = true;
+                item.result = groups_[group].first;
+                item.path = paths_[groups_[group].file];
+            } else {
+                size_t index = row - group - 1;
+                fill(entries_[index], index, item);
+            }
+            out.push_back(std::move(item));
+        }
+    }
+    // Files are read with the lock released: producers keep adding meanwhile
+    for (Row& row : out) {
+        if (!row.header && !is_diagnostic(row.kind)) row.text = preview(row.path, row.line);
+    }
+}
+
+bool ResultList::get(size_t result, Row& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (result >= entries_.size()) return false;
+    fill(entries_[result], result, out);
+    return true;
+}
+
+std::vector<std::string> ResultList::files() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return paths_;
+}
+
+size_t ResultList::memory_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t bytes = entries_.size() * sizeof(Entry) + groups_.capacity() * sizeof(Group) + messages_.capacity();
+    for (const std::string& path : paths_) bytes += sizeof(std::string) + path.capacity() + sizeof(uint32_t);
+    return bytes;
+}
+
+std::string ResultList::preview(const std::string& path, size_t line) {
+    std::shared_ptr<PieceTable> document = lookup_ ? lookup_(path) : nullptr;
+    if (!document) {
+        auto cached = std::find_if(preview_files_.begin(), preview_files_.end(),
+                                   [&path](const auto& file) { return file.first == path; });
+        if (cached != preview_files_.end()) {
+            preview_files_.splice(preview_files_.begin(), preview_files_, cached);
+        } else {
+            std::shared_ptr<MappedFile> mapping = PlatformFile::map_file(path);
+            if (!mapping) return std::string();
+            preview_files_.emplace_front(path, std::make_shared<PieceTable>(mapping));
+            if (preview_files_.size() > kPreviewFiles) preview_files_.pop_back();
+        }
+        document = preview_files_.front().second;
+    }
+    if (line >= document->get_line_count()) return std::string();
+    std::string text = document->get_line(line);
+    while (!text.empty() && (text.back() == '\n' || text.back() == '\r')) text.pop_back();
+    return text;
+}
+
+} // namespace editor
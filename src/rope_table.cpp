@@ -1,71 +1,312 @@
-
 #include "rope_table.h"
+#include "text_scan.h"
 #include <algorithm>
-#include <functional>
+#include <cstring>
 
-RopeTable::RopeTable() : root_(nullptr) {}
+namespace {
+
+using NodePtr = std::shared_ptr<const RopeNode>;
+
+int height(const NodePtr& node) { return node ? node->height : 0; }
+
+NodePtr make_leaf(std::string data) {
+    auto node = std::make_shared<RopeNode>();
+    node->length = data.size();
+    node->newlines = TextScan::count_newlines(data.data(), data.size());
+    node->height = 1;
+    node->data = std::move(data);
+    return node;
+}
+
+NodePtr make_node(NodePtr left, NodePtr right) {
+    auto node = std::make_shared<RopeNode>();
+    node->length = left->length + right->length;
+    node->newlines = left->newlines + right->newlines;
+    node->height = 1 + (std::max)(left->height, right->height);
+    node->left = std::move(left);
+    node->right = std::move(right);
+    return node;
+}
+
+// Perfectly balanced tree over `leaves` evenly sized leaves
+NodePtr build_leaves(const char* data, size_t length, size_t leaves) {
+    if (leaves == 1) return make_leaf(std::string(data, length));
+    size_t half = leaves / 2;
+    size_t split = length * half / leaves;
+    return make_node(build_leaves(data, split, half), build_leaves(data + split, length - split, leaves - half));
+}
 
-RopeTable::RopeTable(const std::string& initial_text) {
-    root_ = std::make_shared<RopeNode>(initial_text);
+NodePtr build(const char* data, size_t length) {
+    if (length == 0) return nullptr;
+    size_t leaves = (length + RopeTable::kMaxLeaf - 1) / RopeTable::kMaxLeaf;
+    return build_leaves(data, length, leaves);
 }
 
+// Node over two subtrees whose heights differ by at most two, rotated back
+// into AVL shape
+NodePtr balance(NodePtr left, NodePtr right) {
+    if (height(left) > height(right) + 1) {
+        if (height(left->left) >= height(left->right)) {
+            return make_node(left->left, make_node(left->right, std::move(right)));
+        }
+        const NodePtr& mid = left->right;
+        return make_node(make_node(left->left, mid->left), make_node(mid->right, std::move(right)));
+    }
+    if (height(right) > height(left) + 1) {
+        if (height(right->right) >= height(right->left)) {
+            return make_node(make_node(std::move(left), right->left), right->right);
+        }
+        const NodePtr& mid = right->left;
+        return make_node(make_node(std::move(left), mid->left), make_node(mid->right, right->right));
+    }
+    return make_node(std::move(left), std::move(right));
+}
+
+// Concatenate two balanced trees - O(height difference)
+NodePtr join(NodePtr left, NodePtr right) {
+    if (!left) return right;
+    if (!right) return left;
+    if (left->height > right->height + 1) {
+        return balance(left->left, join(left->right, std::move(right)));
+    }
+    if (right->height > left->height + 1) {
+        return balance(join(std::move(left), right->left), right->right);
+    }
+    if (left->is_leaf() && right->is_leaf() && left->length + right->length <= RopeTable::kMaxLeaf) {
+        return make_leaf(left->data + right->data);
+    }
+    return make_node(std::move(left), std::move(right));
+}
+
+// Split into [0, position) and [position, length) - O(log n)
+std::pair<NodePtr, NodePtr> split(const NodePtr& node, size_t position) {
+    if (!node || position == 0) return {nullptr, node};
+    if (position >= node->length) return {node, nullptr};
+    if (node->is_leaf()) {
+        return {make_leaf(node->data.substr(0, position)), make_leaf(node->data.substr(position))};
+    }
+    size_t left_length = node->left->length;
+    if (position == left_length) return {node->left, node->right};
+    if (position < left_length) {
+        auto parts = split(node->left, position);
+        return {parts.first, join(parts.second, node->right)};
+    }
+    auto parts = split(node->right, position - left_length);
+    return {join(node->left, parts.first), parts.second};
+}
+
+const RopeNode* first_leaf(const RopeNode* node) {
+    while (!node->is_leaf()) node = node->left.get();
+    return node;
+}
+
+const RopeNode* last_leaf(const RopeNode* node) {
+    while (!node->is_leaf()) node = node->right.get();
+    return node;
+}
+
+// join() that also re-chunks the two leaves meeting at the seam when
+// either fell below kMinLeaf, so edits don't leave slivers behind
+NodePtr join_seam(NodePtr left, NodePtr right) {
+    if (!left) return right;
+    if (!right) return left;
+    const RopeNode* tail = last_leaf(left.get());
+    const RopeNode* head = first_leaf(right.get());
+    if (tail->length >= RopeTable::kMinLeaf && head->length >= RopeTable::kMinLeaf) {
+        return join(std::move(left), std::move(right));
+    }
+    std::string seam = tail->data + head->data;
+    NodePtr rest_left = split(left, left->length - tail->length).first;
+    NodePtr rest_right = split(right, head->length).second;
+    NodePtr mid = build(seam.data(), seam.size());
+    if (seam.size() < RopeTable::kMinLeaf) {
+        // Still too small - merge with the next leaf over as well
+        if (rest_left) return join_seam(join_seam(std::move(rest_left), std::move(mid)), std::move(rest_right));
+        return join_seam(std::move(mid), std::move(rest_right));
+    }
+    return join(join(std::move(rest_left), std::move(mid)), std::move(rest_right));
+}
+
+void append_range(const RopeNode* node, size_t start, size_t length, std::string& out) {
+    while (length > 0) {
+        if (node->is_leaf()) {
+            out.append(node->data, start, length);
+            return;
+        }
+        size_t left_length = node->left->length;
+        if (start >= left_length) {
+            start -= left_length;
+            node = node->right.get();
+            continue;
+        }
+        size_t take = (std::min)(left_length - start, length);
+        append_range(node->left.get(), start, take, out);
+        start = 0;
+        length -= take;
+        node = node->right.get();
+    }
+}
+
+} // namespace
+
+RopeTable::RopeTable() : root_(nullptr) {}
+
+RopeTable::RopeTable(const std::string& initial_text)
+    : root_(build(initial_text.data(), initial_text.size())) {}
+
 size_t RopeTable::get_total_length() const {
-    return root_ ? root_->length() : 0;
+    return root_ ? root_->length : 0;
+}
+
+size_t RopeTable::get_line_count() const {
+    return (root_ ? root_->newlines : 0) + 1;
+}
+
+int RopeTable::get_height() const {
+    return height(root_);
+}
+
+size_t RopeTable::get_leaf_count() const {
+    if (!root_) return 0;
+    size_t count = 0;
+    std::vector<const RopeNode*> stack{root_.get()};
+    while (!stack.empty()) {
+        const RopeNode* node = stack.back();
+        stack.pop_back();
+        if (node->is_leaf()) {
+            ++count;
+        } else {
+            stack.push_back(node->left.get());
+            stack.push_back(node->right.get());
+        }
+    }
+    return count;
 }
 
 std::string RopeTable::get_text(size_t start, size_t length) const {
     std::string result;
+    size_t total = get_total_length();
+    if (start >= total || length == 0) return result;
+    length = (std::min)(length, total - start);
     result.reserve(length);
-    std::function<void(std::shared_ptr<RopeNode>, size_t, size_t)> collect = [&](std::shared_ptr<RopeNode> node, size_t s, size_t l) {
-        if (!node || l == 0) return;
-        if (!node->left && !node->right) {
-            result.append(node->data.substr(s, l));
-            return;
-        }
-        size_t left_len = node->left ? node->left->length() : 0;
-        if (s < left_len) {
-            size_t take = std::min(left_len - s, l);
-            collect(node->left, s, take);
-            if (l > take) collect(node->right, 0, l - take);
+    append_range(root_.get(), start, length, result);
+    return result;
+}
+
+size_t RopeTable::get_line_start(size_t line_number) const {
+    if (line_number == 0) return 0;
+    if (line_number >= get_line_count()) return get_total_length();
+    // Descend to the leaf holding the line_number-th newline
+    const RopeNode* node = root_.get();
+    size_t n = line_number;
+    size_t offset = 0;
+    while (!node->is_leaf()) {
+        if (node->left->newlines >= n) {
+            node = node->left.get();
         } else {
-            collect(node->right, s - left_len, l);
+            n -= node->left->newlines;
+            offset += node->left->length;
+            node = node->right.get();
         }
-    };
-    collect(root_, start, length);
-    return result;
+    }
+    const char* data = node->data.data();
+    const char* p = data;
+    while (true) {
+        p = static_cast<const char*>(std::memchr(p, '\n', node->data.size() - static_cast<size_t>(p - data)));
+        if (--n == 0) return offset + static_cast<size_t>(p - data) + 1;
+        ++p;
+    }
 }
 
-std::shared_ptr<RopeNode> RopeTable::concat(std::shared_ptr<RopeNode> left, std::shared_ptr<RopeNode> right) {
-    return std::make_shared<RopeNode>(left, right);
+size_t RopeTable::get_line_at(size_t position) const {
+    if (!root_) return 0;
+    position = (std::min)(position, get_total_length());
+    const RopeNode* node = root_.get();
+    size_t line = 0;
+    while (!node->is_leaf()) {
+        if (position < node->left->length) {
+            node = node->left.get();
+        } else {
+            line += node->left->newlines;
+            position -= node->left->length;
+            node = node->right.get();
+        }
+    }
+    return line + TextScan::count_newlines(node->data.data(), position);
 }
 
-std::pair<std::shared_ptr<RopeNode>, std::shared_ptr<RopeNode>> RopeTable::split(std::shared_ptr<RopeNode> node, size_t pos) {
-    if (!node) return {nullptr, nullptr};
-    if (!node->left && !node->right) {
-        if (pos >= node->data.length()) return {node, nullptr};
-        return {
-            std::make_shared<RopeNode>(node->data.substr(0, pos)),
-            std::make_shared<RopeNode>(node->data.substr(pos))
-        };
+std::string RopeTable::get_line(size_t line_number) const {
+    size_t line_count = get_line_count();
+    if (line_number >= line_count) return "";
+    size_t start = get_line_start(line_number);
+    size_t end = get_total_length();
+    if (line_number + 1 < line_count) {
+        end = get_line_start(line_number + 1) - 1;  // Exclude newline
     }
-    size_t left_len = node->left ? node->left->length() : 0;
-    if (pos < left_len) {
-        auto [l, r] = split(node->left, pos);
-        return {l, concat(r, node->right)};
-    } else {
-        auto [l, r] = split(node->right, pos - left_len);
-        return {concat(node->left, l), r};
+    std::string line = get_text(start, end - start);
+    if (line_number + 1 < line_count && !line.empty() && line.back() == '\r') line.pop_back();
+    return line;
+}
+
+std::vector<std::string> RopeTable::get_lines_range(size_t start_line, size_t count) const {
+    std::vector<std::string> lines;
+    size_t line_count = get_line_count();
+    if (count == 0 || start_line >= line_count) return lines;
+    size_t end_line = (std::min)(start_line + count, line_count);
+    size_t start = get_line_start(start_line);
+    std::string text = get_text(start, get_line_start(end_line) - start);
+    lines.reserve(end_line - start_line);
+
+    // Copy the range once, then cut it at newlines
+    size_t pos = 0;
+    while (lines.size() < end_line - start_line) {
+        size_t nl = text.find('\n', pos);
+        if (nl == std::string::npos) {
+            lines.push_back(text.substr(pos));  // Final, unterminated line
+            break;
+        }
+        size_t end = (nl > pos && text[nl - 1] == '\r') ? nl - 1 : nl;
+        lines.push_back(text.substr(pos, end - pos));
+        pos = nl + 1;
     }
+    return lines;
 }
 
 void RopeTable::insert(size_t position, const std::string& text) {
-    auto [left, right] = split(root_, position);
-    auto middle = std::make_shared<RopeNode>(text);
-    root_ = concat(concat(left, middle), right);
+    if (text.empty() || position > get_total_length()) return;
+    push_undo();
+    auto parts = split(root_, position);
+    NodePtr middle = build(text.data(), text.size());
+    root_ = join_seam(join_seam(std::move(parts.first), std::move(middle)), std::move(parts.second));
 }
 
 void RopeTable::remove(size_t position, size_t length) {
-    auto [left, mid] = split(root_, position);
-    auto [_, right] = split(mid, length);
-    root_ = concat(left, right);
+    size_t total = get_total_length();
+    if (length == 0 || position >= total) return;
+    length = (std::min)(length, total - position);
+    push_undo();
+    auto head = split(root_, position);
+    auto tail = split(head.second, length);
+    root_ = join_seam(std::move(head.first), std::move(tail.second));
+}
+
+void RopeTable::push_undo() {
+    // Old roots share all untouched nodes, so a step costs O(log n) nodes
+    undo_history_.push_back(root_);
+    if (undo_history_.size() > kMaxHistory) undo_history_.pop_front();
+    redo_history_.clear();
+}
+
+void RopeTable::undo() {
+    if (undo_history_.empty()) return;
+    redo_history_.push_back(root_);
+    root_ = undo_history_.back();
+    undo_history_.pop_back();
+}
+
+void RopeTable::redo() {
+    if (redo_history_.empty()) return;
+    undo_history_.push_back(root_);
+    root_ = redo_history_.back();
+    redo_history_.pop_back();
 }
@@ -0,0 +1,265 @@
+#include "search_session.h"
+#include "regex_engine.h"
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+unsigned char fold(unsigned char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<unsigned char>(c - 'A' + 'a') : c;
+}
+
+bool has_prefix(const std::string& text, const std::string& prefix, bool case_sensitive) {
+    if (prefix.size() > text.size()) return false;
+    for (size_t i = 0; i < prefix.size(); ++i) {
+        unsigned char a = static_cast<unsigned char>(text[i]);
+        unsigned char b = static_cast<unsigned char>(prefix[i]);
+        if (case_sensitive ? a != b : fold(a) != fold(b)) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+SearchSession::SearchSession(FindDialog* finder)
+    : finder_(finder)
+    , listener_id_(0)
+    , case_sensitive_(finder->is_case_sensitive())
+    , use_regex_(finder->is_use_regex())
+    , verify_next_(0)
+    , published_stale_(false)
+    , generation_(0)
+{}
+
+SearchSession::~SearchSession() {
+    if (document_) document_->remove_change_listener(listener_id_);
+}
+
+void SearchSession::set_document(const std::shared_ptr<PieceTable>& document) {
+    if (document == document_) return;
+    if (document_) document_->remove_change_listener(listener_id_);
+    document_ = document;
+    listener_id_ = 0;
+    if (document_) {
+        listener_id_ = document_->add_change_listener([this](const PieceTable::Change& change) {
+            on_change(change);
+        });
+    }
+    restart();
+}
+
+void SearchSession::set_query(const std::string& query) {
+    bool same_mode = case_sensitive_ == finder_->is_case_sensitive() && use_regex_ == finder_->is_use_regex();
+    if (query == query_ && same_mode) return;
+    // Every match of an extended literal query starts at a match of the old one
+    bool refine = same_mode && !use_regex_ && !query_.empty() && query.size() > query_.size() &&
+                  has_prefix(query, query_, case_sensitive_);
+    query_ = query;
+    case_sensitive_ = finder_->is_case_sensitive();
+    use_regex_ = finder_->is_use_regex();
+    if (!refine) {
+        restart();
+        return;
+    }
+    std::vector<SearchMatch> previous;
+    previous.reserve(candidates_.size() + verify_.size() - verify_next_);
+    auto by_position = [](const SearchMatch& a, const SearchMatch& b) { return a.position < b.position; };
+    std::merge(candidates_.begin(), candidates_.end(), verify_.begin() + verify_next_, verify_.end(),
+               std::back_inserter(previous), by_position);
+    verify_ = std::move(previous);
+    verify_next_ = 0;
+    candidates_.clear();
+    published_stale_ = true;
+    ++generation_;
+}
+
+void SearchSession::restart() {
+    candidates_.clear();
+    verify_.clear();
+    verify_next_ = 0;
+    pending_.clear();
+    bool searchable = document_ && !query_.empty() &&
+                      (!use_regex_ || RegexEngine::cached(query_, case_sensitive_)->ok());
+    if (searchable && document_->get_total_length() > 0) {
+        pending_.push_back({0, document_->get_total_length()});
+    }
+    published_stale_ = true;
+    ++generation_;
+}
+
+void SearchSession::cancel() {
+    verify_.clear();
+    verify_next_ = 0;
+    pending_.clear();
+}
+
+size_t SearchSession::pending_bytes() const {
+    size_t bytes = 0;
+    for (const Range& range : pending_) bytes += range.second - range.first;
+    return bytes;
+}
+
+bool SearchSession::step(size_t budget) {
+    if (!document_ || is_complete()) return false;
+    bool changed = false;
+
+    // Re-check the previous query's candidates first; survivors keep their place
+    while (budget > 0 && verify_next_ < verify_.size()) {
+        SearchMatch match = verify_[verify_next_++];
+        if (matches_at(match.position)) {
+            match.length = query_.size();
+            candidates_.push_back(match);
+            changed = true;
+        }
+        budget -= std::min(budget, query_.size() + 16);
+    }
+    if (verify_next_ == verify_.size()) {
+        verify_.clear();
+        verify_next_ = 0;
+    }
+
+    std::vector<SearchMatch> batch;
+    while (budget > 0 && verify_.empty() && !pending_.empty()) {
+        Range& range = pending_.front();
+        size_t end = range.second - range.first > budget ? range.first + budget : range.second;
+        batch.clear();
+        finder_->scan_range(*document_, query_, range.first, end, !use_regex_, [&](const SearchMatch& match) {
+            batch.push_back(match);
+            return true;
+        });
+        budget -= std::min(budget, end - range.first);
+        size_t next = end;
+        if (!batch.empty()) {
+            // A regex match may run past the slice; resume after it
+            if (use_regex_) next = std::max(next, batch.back().position + batch.back().length);
+            auto at = std::lower_bound(candidates_.begin(), candidates_.end(), batch.front().position,
+                                       [](const SearchMatch& m, size_t position) { return m.position < position; });
+            candidates_.insert(at, batch.begin(), batch.end());
+            changed = true;
+        }
+        if (next >= range.second || next >= document_->get_total_length()) {
+            pending_.erase(pending_.begin());
+        } else {
+            range.first = next;
+        }
+    }
+
+    if (changed) {
+        published_stale_ = true;
+        ++generation_;
+    }
+    return changed;
+}
+
+bool SearchSession::matches_at(size_t position) const {
+    size_t i = 0;
+    for (auto it = document_->chunks(position, query_.size()); !it.done() && i < query_.size(); ++it) {
+        for (char c : *it) {
+            unsigned char a = static_cast<unsigned char>(c);
+            unsigned char b = static_cast<unsigned char>(query_[i++]);
+            if (case_sensitive_ ? a != b : fold(a) != fold(b)) return false;
+        }
+    }
+    return i == query_.size();
+}
+
+void SearchSession::on_change(const PieceTable::Change& change) {
+    if (query_.empty()) return;
+    size_t position = change.position;
+    size_t removed_end = position + change.removed_length;
+    size_t inserted_end = position + change.inserted_length;
+
+    // Region to rescan, in pre-edit offsets: starts that could now match
+    size_t dirty_begin;
+    size_t dirty_end;
+    if (use_regex_) {
+        // Regex matches may have any length: rescan the edited lines
+        dirty_begin = position - change.column;
+        dirty_end = document_->get_total_length();
+        for (auto it = document_->chunks(inserted_end); !it.done(); ++it) {
+            size_t newline = (*it).find('\n');
+            if (newline != std::string_view::npos) {
+                dirty_end = it.position() + newline + 1;
+                break;
+            }
+        }
+        dirty_end = dirty_end + change.removed_length - change.inserted_length;
+    } else {
+        size_t reach = query_.size() - 1;
+        dirty_begin = position > reach ? position - reach : 0;
+        dirty_end = removed_end;
+    }
+
+    // Old offset -> new offset; offsets inside the removed text land after the insertion
+    auto map = [&](size_t offset) {
+        if (offset <= position) return offset;
+        if (offset >= removed_end) return offset - change.removed_length + change.inserted_length;
+        return inserted_end;
+    };
+    size_t edit_end_line = change.first_line + change.removed_newlines;
+
+    auto adjust = [&](std::vector<SearchMatch>& matches) {
+        size_t kept = 0;
+        for (SearchMatch& match : matches) {
+            size_t match_end = match.position + match.length;
+            bool touched = use_regex_ ? match.position < dirty_end && match_end > dirty_begin
+                                      : match.position < removed_end && match_end > position;
+            if (touched) {
+                // The rescan must cover the whole of a dropped match
+                dirty_begin = std::min(dirty_begin, match.position);
+                dirty_end = std::max(dirty_end, match_end);
+                continue;
+            }
+            if (match.position >= removed_end) {
+                bool same_line = match.line == edit_end_line;
+                match.position = match.position - change.removed_length + change.inserted_length;
+                match.line = match.line - change.removed_newlines + change.inserted_newlines;
+                if (same_line) match.column = match.position - document_->get_line_start(match.line);
+            }
+            matches[kept++] = match;
+        }
+        matches.resize(kept);
+    };
+    verify_.erase(verify_.begin(), verify_.begin() + verify_next_);
+    verify_next_ = 0;
+    adjust(candidates_);
+    adjust(verify_);
+
+    std::vector<Range> ranges;
+    ranges.swap(pending_);
+    for (const Range& range : ranges) add_pending(map(range.first), map(range.second));
+    add_pending(dirty_begin, dirty_end - change.removed_length + change.inserted_length);
+
+    published_stale_ = true;
+    ++generation_;
+}
+
+void SearchSession::add_pending(size_t begin, size_t end) {
+    if (begin >= end) return;
+    auto at = std::lower_bound(pending_.begin(), pending_.end(), Range{begin, end});
+    at = pending_.insert(at, {begin, end});
+    // Coalesce with the neighbours it touches
+    if (at != pending_.begin() && std::prev(at)->second >= at->first) {
+        std::prev(at)->second = std::max(std::prev(at)->second, at->second);
+        at = std::prev(pending_.erase(at));
+    }
+    while (std::next(at) != pending_.end() && std::next(at)->first <= at->second) {
+        at->second = std::max(at->second, std::next(at)->second);
+        pending_.erase(std::next(at));
+    }
+}
+
+const std::vector<SearchMatch>& SearchSession::matches() const {
+    if (published_stale_) {
+        // Leftmost non-overlapping candidates, as find_all reports them
+        published_.clear();
+        size_t next_start = 0;
+        for (const SearchMatch& match : candidates_) {
+            if (match.position < next_start) continue;
+            published_.push_back(match);
+            next_start = match.position + match.length;
+        }
+        published_stale_ = false;
+    }
+    return published_;
+}
@@ -0,0 +1,181 @@
+#include "semantic_tokens.h"
+#include <algorithm>
+
+namespace editor {
+
+namespace {
+
+// Past this many edits without a result the tokens are too stale to map
+constexpr size_t kMaxEdits = 256;
+
+// Byte offset of the units-th code unit of text (UTF-16 units, or bytes)
+size_t byte_of_unit(std::string_view text, size_t from_byte, size_t from_unit, size_t unit, PositionEncoding encoding) {
+    if (encoding == PositionEncoding::Utf8) return (std::min)(unit, text.size());
+    size_t i = from_byte;
+    for (size_t u = from_unit; u < unit && i < text.size();) {
+        unsigned char byte = static_cast<unsigned char>(text[i]);
+        size_t length = byte < 0x80 ? 1 : byte >= 0xF0 ? 4 : byte >= 0xE0 ? 3 : byte >= 0xC0 ? 2 : 1;
+        u += length == 4 ? 2 : 1;
+        i = (std::min)(i + length, text.size());
+    }
+    return i;
+}
+
+} // namespace
+
+SemanticKind SemanticTokenOverlay::kind_of(const std::string& token_type) {
+    if (token_type == "type" || token_type == "class" || token_type == "struct" || token_type == "enum" ||
+        token_type == "interface" || token_type == "typeParameter" || token_type == "namespace" ||
+        token_type == "concept") {
+        return SemanticKind::Type;
+    }
+    if (token_type == "function" || token_type == "method") return SemanticKind::Function;
+    if (token_type == "variable" || token_type == "parameter" || token_type == "property" ||
+        token_type == "enumMember" || token_type == "event") {
+        return SemanticKind::Variable;
+    }
+    if (token_type == "keyword" || token_type == "modifier") return SemanticKind::Keyword;
+    if (token_type == "string" || token_type == "regexp") return SemanticKind::String;
+    if (token_type == "number") return SemanticKind::Number;
+    if (token_type == "comment") return SemanticKind::Comment;
+    if (token_type == "macro") return SemanticKind::Macro;
+    return SemanticKind::None;
+}
+
+void SemanticTokenOverlay::set_legend(const std::vector<std::string>& token_types) {
+    kinds_.clear();
+    for (const std::string& type : token_types) kinds_.push_back(kind_of(type));
+    ++generation_;
+}
+
+void SemanticTokenOverlay::clear() {
+    data_.clear();
+    checkpoints_.clear();
+    result_id_.clear();
+    ++generation_;
+}
+
+bool SemanticTokenOverlay::apply(const LspSemanticTokens& result, size_t mark) {
+    // Edits the result cannot account for were dropped: it is stale
+    if (mark < edits_base_) {
+        clear();
+        return false;
+    }
+    size_t reflected = (std::min)(mark - edits_base_, edits_.size());
+    edits_.erase(edits_.begin(), edits_.begin() + reflected);
+    edits_base_ += reflected;
+
+    if (!result.delta) {
+        data_ = result.data;
+    } else {
+        // Edits refer to the previous array; apply back to front so earlier
+        // starts stay put
+        std::vector<const LspSemanticTokensEdit*> edits;
+        for (const auto& edit : result.edits) edits.push_back(&edit);
+        std::sort(edits.begin(), edits.end(), [](const LspSemanticTokensEdit* a, const LspSemanticTokensEdit* b) {
+            return a->start > b->start;
+        });
+        for (const LspSemanticTokensEdit* edit : edits) {
+            if (edit->start > data_.size() || edit->delete_count > data_.size() - edit->start) {
+                clear();
+                return false;
+            }
+            auto at = data_.begin() + edit->start;
+            at = data_.erase(at, at + edit->delete_count);
+            data_.insert(at, edit->data.begin(), edit->data.end());
+        }
+    }
+    data_.resize(data_.size() - data_.size() % 5);
+    result_id_ = result.result_id;
+    rebuild_checkpoints();
+    ++generation_;
+    return true;
+}
+
+void SemanticTokenOverlay::rebuild_checkpoints() {
+    checkpoints_.clear();
+    checkpoints_.reserve(token_count() / kCheckpointTokens + 1);
+    uint32_t line = 0;
+    uint32_t start = 0;
+    for (size_t token = 0, i = 0; i < data_.size(); ++token, i += 5) {
+        if (data_[i] != 0) start = 0;
+        line += data_[i];
+        start += data_[i + 1];
+        if (token % kCheckpointTokens == 0) checkpoints_.push_back({line, start});
+    }
+}
+
+void SemanticTokenOverlay::on_change(size_t first_line, size_t removed_newlines, size_t inserted_newlines) {
+    if (edits_.size() >= kMaxEdits) {
+        edits_base_ += edits_.size();
+        edits_.clear();
+        data_.clear();
+        checkpoints_.clear();
+        result_id_.clear();
+    }
+    edits_.push_back({first_line, removed_newlines, inserted_newlines});
+    ++generation_;
+}
+
+bool SemanticTokenOverlay::map_line(size_t line, size_t& data_line) const {
+    // Undo the edits newest first
+    for (size_t i = edits_.size(); i-- > 0;) {
+        const LineEdit& edit = edits_[i];
+        if (line < edit.first_line) continue;
+        if (line <= edit.first_line + edit.inserted) return false;
+        line = line - edit.inserted + edit.removed;
+    }
+    data_line = line;
+    return true;
+}
+
+void SemanticTokenOverlay::spans(size_t line, std::string_view line_text, std::vector<Span>& out) const {
+    out.clear();
+    size_t target = 0;
+    if (checkpoints_.empty() || !map_line(line, target)) return;
+
+    // Last checkpoint on an earlier line: no token of target comes before it
+    auto after = std::lower_bound(checkpoints_.begin(), checkpoints_.end(), target,
+                                  [](const Checkpoint& checkpoint, size_t value) { return checkpoint.line < value; });
+    size_t token = 0;
+    uint32_t current_line = 0;
+    uint32_t start = 0;
+    if (after != checkpoints_.begin()) {
+        --after;
+        token = static_cast<size_t>(after - checkpoints_.begin()) * kCheckpointTokens;
+        current_line = after->line;
+        start = after->start;
+    } else {
+        current_line = data_[0];
+        start = data_[1];
+    }
+
+    size_t byte = 0;
+    size_t unit = 0;
+    for (size_t i = token * 5; i < data_.size(); i += 5) {
+        if (i != token * 5) {
+            if (data_[i] != 0) start = 0;
+            current_line += data_[i];
+            start += data_[i + 1];
+        }
+        if (current_line < target) continue;
+        if (current_line > target) break;
+        // Tokens are in order, so the conversion carries on from the last one
+        size_t first = byte_of_unit(line_text, byte, unit, start, encoding_);
+        size_t last = byte_of_unit(line_text, first, start, start + data_[i + 2], encoding_);
+        byte = first;
+        unit = start;
+        uint32_t type = data_[i + 3];
+        SemanticKind kind = type < kinds_.size() ? kinds_[type] : SemanticKind::None;
+        if (kind != SemanticKind::None && last > first) {
+            out.push_back({static_cast<uint32_t>(first), static_cast<uint32_t>(last - first), kind});
+        }
+    }
+}
+
+size_t SemanticTokenOverlay::get_memory_bytes() const {
+    return data_.capacity() * sizeof(uint32_t) + checkpoints_.capacity() * sizeof(Checkpoint) +
+           edits_.capacity() * sizeof(LineEdit) + kinds_.capacity();
+}
+
+} // namespace editor
@@ -0,0 +1,119 @@
+#include "startup_scheduler.h"
+#include <algorithm>
+#include <cstdio>
+
+StartupTimeline::StartupTimeline(std::chrono::steady_clock::time_point origin) : origin_(origin) {}
+
+double StartupTimeline::elapsed_ms() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin_).count();
+}
+
+void StartupTimeline::mark(const std::string& name) {
+    double now = elapsed_ms();
+    std::lock_guard<std::mutex> lock(mutex_);
+    phases_.push_back({name, now, now, false});
+}
+
+size_t StartupTimeline::begin(const std::string& name, bool background) {
+    double now = elapsed_ms();
+    std::lock_guard<std::mutex> lock(mutex_);
+    phases_.push_back({name, now, now, background});
+    return phases_.size() - 1;
+}
+
+void StartupTimeline::end(size_t phase) {
+    double now = elapsed_ms();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (phase < phases_.size()) phases_[phase].end_ms = now;
+}
+
+double StartupTimeline::time_of(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const Phase& phase : phases_) {
+        if (phase.name == name) return phase.start_ms;
+    }
+    return -1;
+}
+
+std::vector<StartupTimeline::Phase> StartupTimeline::phases() const {
+    std::vector<Phase> sorted;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sorted = phases_;
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const Phase& a, const Phase& b) { return a.start_ms < b.start_ms; });
+    return sorted;
+}
+
+std::string StartupTimeline::format() const {
+    std::string out;
+    char line[64];
+    for (const Phase& phase : phases()) {
+        std::snprintf(line, sizeof(line), "%9.2f ms  %+9.2f ms  ", phase.start_ms, phase.end_ms - phase.start_ms);
+        out += line;
+        out += phase.name;
+        if (phase.background) out += " [bg]";
+        out += '\n';
+    }
+    return out;
+}
+
+StartupScheduler::~StartupScheduler() {
+    for (auto& thread : threads_) thread.join();
+}
+
+void StartupScheduler::add_background(const std::string& name, Task work, Task finish) {
+    background_.push_back({name, std::move(work), std::move(finish)});
+}
+
+void StartupScheduler::add_idle(const std::string& name, Task task) {
+    idle_.push_back({name, std::move(task), nullptr});
+}
+
+void StartupScheduler::start(std::function<void()> notify) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ += background_.size();
+    }
+    for (Item& item : background_) {
+        threads_.emplace_back([this, notify, item = std::move(item)]() mutable {
+            size_t phase = timeline_.begin(item.name, true);
+            item.work();
+            timeline_.end(phase);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                running_--;
+                if (item.finish) finished_.push_back(std::move(item));
+            }
+            if (notify) notify();
+        });
+    }
+    background_.clear();
+}
+
+bool StartupScheduler::step() {
+    std::vector<Item> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready.swap(finished_);
+    }
+    for (Item& item : ready) {
+        size_t phase = timeline_.begin(item.name + " (finish)");
+        item.finish();
+        timeline_.end(phase);
+    }
+    if (!idle_.empty()) {
+        Item item = std::move(idle_.front());
+        idle_.pop_front();
+        size_t phase = timeline_.begin(item.name);
+        item.work();
+        timeline_.end(phase);
+    }
+    return !is_done();
+}
+
+bool StartupScheduler::is_done() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return idle_.empty() && background_.empty() && running_ == 0 && finished_.empty();
+}
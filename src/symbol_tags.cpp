@@ -0,0 +1,189 @@
+#include "symbol_tags.h"
+#include <algorithm>
+#include <cctype>
+
+namespace {
+
+struct Piece {
+    std::string_view text;
+    uint32_t column;
+    bool identifier;
+};
+
+bool is_ident_start(char c) {
+    return std::isalpha(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+}
+
+bool is_ident_char(char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+}
+
+// Identifiers and punctuation of a line up to its comment; "::" and "=>"
+// are one piece, string literals are dropped
+void split(std::string_view line, bool hash_comments, std::vector<Piece>& out) {
+    out.clear();
+    for (size_t i = 0; i < line.size();) {
+        char c = line[i];
+        if (c == ' ' || c == '\t' || c == '\r') {
+            ++i;
+        } else if (is_ident_start(c)) {
+            size_t start = i;
+            while (i < line.size() && is_ident_char(line[i])) ++i;
+            out.push_back({line.substr(start, i - start), static_cast<uint32_t>(start), true});
+        } else if (c == '/' && i + 1 < line.size() && (line[i + 1] == '/' || line[i + 1] == '*')) {
+            break;
+        } else if (c == '#' && hash_comments) {
+            break;
+        } else if (c == '"' || c == '\'' || c == '`') {
+            for (++i; i < line.size() && line[i] != c; ++i) {
+                if (line[i] == '\\') ++i;
+            }
+            ++i;
+        } else if ((c == ':' || c == '=') && i + 1 < line.size() && line[i + 1] == (c == ':' ? ':' : '>')) {
+            out.push_back({line.substr(i, 2), static_cast<uint32_t>(i), false});
+            i += 2;
+        } else {
+            if (!std::isdigit(static_cast<unsigned char>(c))) out.push_back({line.substr(i, 1), static_cast<uint32_t>(i), false});
+            while (++i < line.size() && std::isdigit(static_cast<unsigned char>(c)) && is_ident_char(line[i])) {}
+        }
+    }
+}
+
+template <size_t N>
+bool one_of(std::string_view word, const std::string_view (&words)[N]) {
+    return std::find(std::begin(words), std::end(words), word) != std::end(words);
+}
+
+const std::string_view kCDefiners[] = {"class", "struct", "union", "enum", "namespace"};
+const std::string_view kCControl[] = {"if", "for", "while", "switch", "return", "else", "case", "do", "sizeof",
+                                      "new", "delete", "throw", "catch", "using", "typedef", "static_assert",
+                                      "decltype", "alignof", "co_return", "co_await", "goto", "template"};
+const std::string_view kPythonDefiners[] = {"def", "class"};
+const std::string_view kScriptDefiners[] = {"function", "class", "interface", "type", "enum", "namespace"};
+const std::string_view kScriptBindings[] = {"const", "let", "var"};
+const std::string_view kRustDefiners[] = {"fn", "struct", "enum", "trait", "type", "mod", "union"};
+const std::string_view kGoDefiners[] = {"func", "type"};
+
+void add(std::vector<SymbolTags::Definition>& out, const Piece& name, uint32_t line_number) {
+    out.push_back({std::string(name.text), line_number, name.column});
+}
+
+void scan_c_family(const std::vector<Piece>& pieces, std::string_view line, uint32_t line_number,
+                   std::vector<SymbolTags::Definition>& out) {
+    if (pieces.empty()) return;
+    if (pieces[0].text == "#") {
+        if (pieces.size() > 2 && pieces[1].text == "define" && pieces[2].identifier) add(out, pieces[2], line_number);
+        return;
+    }
+    if (pieces[0].text == "*") return;     // Inside a block comment
+
+    // class Name {, struct Name : Base, enum class Name - not "struct Name value;"
+    for (size_t i = 0; i + 1 < pieces.size(); ++i) {
+        if (!pieces[i].identifier || !one_of(pieces[i].text, kCDefiners)) continue;
+        size_t name = i + 1;
+        if (pieces[name].text == "class" || pieces[name].text == "struct") ++name;
+        if (name >= pieces.size() || !pieces[name].identifier) continue;
+        bool opens = name + 1 == pieces.size() || pieces[name + 1].text == "{" || pieces[name + 1].text == ":" ||
+                     pieces[name + 1].text == "final";
+        if (opens) add(out, pieces[name], line_number);
+        return;
+    }
+
+    // Function definitions: type name( or Scope::name( on a line not ending in ';'
+    size_t end = line.find_last_not_of(" \t\r");
+    if (end == std::string_view::npos || line[end] == ';' || line[end] == ',') return;
+    if (pieces[0].identifier && one_of(pieces[0].text, kCControl)) return;
+    auto paren = std::find_if(pieces.begin(), pieces.end(), [](const Piece& piece) { return piece.text == "("; });
+    if (paren == pieces.begin() || paren == pieces.end()) return;
+    const Piece& name = *(paren - 1);
+    if (!name.identifier || one_of(name.text, kCControl) || one_of(name.text, kCDefiners)) return;
+    size_t index = static_cast<size_t>(paren - pieces.begin()) - 1;
+    bool qualified = index >= 2 && pieces[index - 1].text == "::";
+    // Something must come before the name (its return type), unless it is qualified (a constructor)
+    if (index == 0) return;
+    const Piece& before = pieces[index - 1];
+    if (!qualified && !before.identifier && before.text != "*" && before.text != "&" && before.text != ">") return;
+    if (before.identifier && one_of(before.text, kCControl)) return;    // new Name(...)
+    add(out, name, line_number);
+}
+
+} // namespace
+
+SymbolTags::Language SymbolTags::language_for_path(std::string_view path) {
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string_view::npos || path.find_first_of("/\\", dot) != std::string_view::npos) return Language::None;
+    std::string ext(path.substr(dot + 1));
+    for (char& c : ext) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    if (ext == "c" || ext == "h" || ext == "cc" || ext == "cpp" || ext == "cxx" || ext == "hpp" || ext == "hh" ||
+        ext == "hxx" || ext == "inl" || ext == "m" || ext == "mm") {
+        return Language::CFamily;
+    }
+    if (ext == "py" || ext == "pyi") return Language::Python;
+    if (ext == "js" || ext == "jsx" || ext == "mjs" || ext == "ts" || ext == "tsx") return Language::JavaScript;
+    if (ext == "rs") return Language::Rust;
+    if (ext == "go") return Language::Go;
+    return Language::None;
+}
+
+void SymbolTags::scan_line(Language language, std::string_view line, uint32_t line_number,
+                           std::vector<Definition>& out) {
+    if (language == Language::None) return;
+    thread_local std::vector<Piece> pieces;
+    split(line, language == Language::Python, pieces);
+    if (pieces.empty()) return;
+
+    switch (language) {
+    case Language::CFamily:
+        scan_c_family(pieces, line, line_number, out);
+        break;
+    case Language::Python:
+        for (size_t i = 0; i + 1 < pieces.size(); ++i) {
+            if (pieces[i].text == "async") continue;
+            if (one_of(pieces[i].text, kPythonDefiners) && pieces[i + 1].identifier) add(out, pieces[i + 1], line_number);
+            break;
+        }
+        break;
+    case Language::JavaScript:
+        for (size_t i = 0; i + 1 < pieces.size(); ++i) {
+            std::string_view word = pieces[i].text;
+            if (word == "export" || word == "default" || word == "async" || word == "declare" || word == "abstract") continue;
+            if (one_of(word, kScriptDefiners) && pieces[i + 1].identifier) {
+                add(out, pieces[i + 1], line_number);
+            } else if (one_of(word, kScriptBindings) && pieces[i + 1].identifier) {
+                // const name = (...) => or = function: a function under another name
+                bool function = std::any_of(pieces.begin() + i + 2, pieces.end(), [](const Piece& piece) {
+                    return piece.text == "=>" || piece.text == "function";
+                });
+                if (function) add(out, pieces[i + 1], line_number);
+            }
+            break;
+        }
+        break;
+    case Language::Rust:
+        for (size_t i = 0; i + 1 < pieces.size(); ++i) {
+            std::string_view word = pieces[i].text;
+            if (word == "pub" || word == "async" || word == "unsafe" || word == "const" || word == "extern") continue;
+            if (word == "(" || word == ")" || word == "crate" || word == "super") continue;   // pub(crate)
+            if (word == "macro_rules" && i + 2 < pieces.size() && pieces[i + 1].text == "!") {
+                add(out, pieces[i + 2], line_number);
+            } else if (one_of(word, kRustDefiners) && pieces[i + 1].identifier) {
+                add(out, pieces[i + 1], line_number);
+            }
+            break;
+        }
+        break;
+    case Language::Go:
+        if (pieces.size() >= 2 && one_of(pieces[0].text, kGoDefiners)) {
+            size_t name = 1;
+            if (pieces[0].text == "func" && pieces[1].text == "(") {
+                // Method: skip the receiver
+                while (name < pieces.size() && pieces[name].text != ")") ++name;
+                ++name;
+            }
+            if (name < pieces.size() && pieces[name].identifier) add(out, pieces[name], line_number);
+        }
+        break;
+    case Language::None:
+        break;
+    }
+}
@@ -1,46 +1,304 @@
-
 #include "syntax_highlighter.h"
-#include <regex>
-#include <unordered_set>
+#include "keyword_table.h"
+#include "trace.h"
+#include <iterator>
+
+namespace {
+
+using editor::KeywordTable;
+
+// ============================================================================
+// Keyword tables - perfect hashes built by the compiler
+// ============================================================================
+
+constexpr std::string_view kCppWords[] = {
+    "alignas","alignof","and","and_eq","asm","auto","bitand","bitor","bool","break","case","catch","char","char16_t","char32_t","class","compl","const","constexpr","const_cast","continue","decltype","default","delete","do","double","dynamic_cast","else","enum","explicit","export","extern","false","float","for","friend","goto","if","inline","int","long","mutable","namespace","new","noexcept","not","not_eq","nullptr","operator","or","or_eq","private","protected","public","register","reinterpret_cast","return","short","signed","sizeof","static","static_assert","static_cast","struct","switch","template","this","thread_local","throw","true","try","typedef","typeid","typename","union","unsigned","using","virtual","void","volatile","wchar_t","while","xor","xor_eq","override","final"
+};
+constexpr std::string_view kPythonWords[] = {
+    "and","as","assert","break","class","continue","def","del","elif","else","except","False","finally","for","from","global","if","import","in","is","lambda","None","nonlocal","not","or","pass","raise","return","True","try","while","with","yield"
+};
+constexpr std::string_view kJavaScriptWords[] = {
+    "break","case","catch","class","const","continue","debugger","default","delete","do","else","export","extends","finally","for","function","if","import","in","instanceof","let","new","return","super","switch","this","throw","try","typeof","var","void","while","with","yield","true","false","null","undefined"
+};
+// JavaScript's plus the type-level ones
+constexpr std::string_view kTypeScriptWords[] = {
+    "break","case","catch","class","const","continue","debugger","default","delete","do","else","export","extends","finally","for","function","if","import","in","instanceof","let","new","return","super","switch","this","throw","try","typeof","var","void","while","with","yield","true","false","null","undefined",
+    "interface","type","enum","implements","readonly","keyof","unknown","never"
+};
+constexpr std::string_view kRustWords[] = {
+    "as","break","const","continue","crate","else","enum","extern","false","fn","for","if","impl","in","let","loop","match","mod","move","mut","pub","ref","return","self","Self","static","struct","super","trait","true","type","unsafe","use","where","while"
+};
+constexpr std::string_view kGoWords[] = {
+    "break","default","func","interface","select","case","defer","go","map","struct","chan","else","goto","package","switch","const","fallthrough","if","range","type","continue","for","import","return","var"
+};
+constexpr std::string_view kJsonWords[] = {"true","false","null"};
+constexpr std::string_view kYamlWords[] = {"true","false","null","y","n","on","off"};
+
+constexpr KeywordTable<std::size(kCppWords)> kCppKeywords(kCppWords);
+constexpr KeywordTable<std::size(kPythonWords)> kPythonKeywords(kPythonWords);
+constexpr KeywordTable<std::size(kJavaScriptWords)> kJavaScriptKeywords(kJavaScriptWords);
+constexpr KeywordTable<std::size(kTypeScriptWords)> kTypeScriptKeywords(kTypeScriptWords);
+constexpr KeywordTable<std::size(kRustWords)> kRustKeywords(kRustWords);
+constexpr KeywordTable<std::size(kGoWords)> kGoKeywords(kGoWords);
+constexpr KeywordTable<std::size(kJsonWords)> kJsonKeywords(kJsonWords);
+constexpr KeywordTable<std::size(kYamlWords)> kYamlKeywords(kYamlWords);
+constexpr editor::NoKeywords kNoKeywords;
+
+static_assert(kCppKeywords.valid() && kPythonKeywords.valid() && kJavaScriptKeywords.valid() &&
+              kTypeScriptKeywords.valid() && kRustKeywords.valid() && kGoKeywords.valid() &&
+              kJsonKeywords.valid() && kYamlKeywords.valid(), "keyword table without a perfect seed");
+static_assert(kCppKeywords.contains("static_assert") && !kCppKeywords.contains("static_asser"), "C++ keywords");
+static_assert(kTypeScriptKeywords.contains("keyof") && !kJavaScriptKeywords.contains("keyof"), "TypeScript extras");
+
+// ============================================================================
+// Character classes
+// ============================================================================
+
+enum CharClass : uint8_t {
+    kSpace = 1,         // Skipped; does not end "start of line"
+    kIdentStart = 2,
+    kIdentChar = 4,
+    kDigit = 8,
+    kSpecial = 16,      // May open a comment, string, directive or number
+};
+
+constexpr auto make_char_classes() {
+    struct Table { uint8_t classes[256] = {}; } table;
+    for (int c = 0; c < 256; ++c) {
+        uint8_t cls = 0;
+        bool alpha = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        bool digit = c >= '0' && c <= '9';
+        if (c == ' ' || c == '\t' || c == '\r') cls |= kSpace;
+        if (alpha || c == '_') cls |= kIdentStart | kIdentChar;
+        if (digit) cls |= kDigit | kIdentChar;
+        if (c == '/' || c == '#' || c == '"' || c == '\'' || c == '`' || c == '.') cls |= kSpecial;
+        table.classes[c] = cls;
+    }
+    return table;
+}
+
+constexpr auto kCharClasses = make_char_classes();
+
+inline uint8_t char_class(char c) {
+    return kCharClasses.classes[static_cast<unsigned char>(c)];
+}
+
+// ============================================================================
+// Per-language rules - each lexer instance has them as constants
+// ============================================================================
+
+enum class Directive { None, Hash, YamlMarker };
+
+template <bool SlashComments, bool BlockComments, bool HashComments, Directive Directives,
+          bool TemplateStrings, bool TripleStrings>
+struct Rules {
+    static constexpr bool kSlashComments = SlashComments;       // // to end of line
+    static constexpr bool kBlockComments = BlockComments;       // /* ... */
+    static constexpr bool kHashComments = HashComments;         // # to end of line
+    static constexpr Directive kDirectives = Directives;        // First thing on the line
+    static constexpr bool kTemplateStrings = TemplateStrings;   // `...`, may span lines
+    static constexpr bool kTripleStrings = TripleStrings;       // """...""" and '''...'''
+};
+
+using CLikeRules = Rules<true, true, false, Directive::Hash, false, false>;
+using ScriptRules = Rules<true, true, false, Directive::Hash, true, false>;
+using PythonRules = Rules<false, false, true, Directive::None, false, true>;
+using JsonRules = Rules<false, false, false, Directive::None, false, false>;
+using YamlRules = Rules<false, false, true, Directive::YamlMarker, false, false>;
+using MarkdownRules = Rules<true, false, false, Directive::Hash, false, false>;
+using PlainRules = Rules<true, true, false, Directive::None, false, false>;    // Auto
 
-// Minimal implementation for tokenize_line
-std::vector<Token> SyntaxHighlighter::tokenize_line(const std::string& line, const LineState& in_state, LineState& out_state) {
-    std::vector<Token> tokens;
+// Index just past the closing quote at or after i, or npos if the line ends first
+size_t find_string_end(const std::string& line, size_t i, char delim) {
+    while (i < line.size()) {
+        if (line[i] == '\\') {
+            i += 2;
+            continue;
+        }
+        if (line[i] == delim) return i + 1;
+        ++i;
+    }
+    return std::string::npos;
+}
+
+size_t find_triple_end(const std::string& line, size_t i, char delim) {
+    const char triple[] = {delim, delim, delim, 0};
+    size_t end = line.find(triple, i);
+    return end == std::string::npos ? end : end + 3;
+}
+
+// The body of a line from i on, once carried-over constructs are closed
+template <typename R, typename Keywords>
+void lex(const std::string& line, size_t i, const Keywords& keywords, SyntaxHighlighter::LineState& out_state,
+         std::vector<Token>& tokens) {
+    const size_t n = line.size();
+    const char* text = line.data();
+    bool line_start = true;    // Only whitespace seen so far
+    while (i < n) {
+        char c = text[i];
+        uint8_t cls = char_class(c);
+        if (cls & kSpace) {
+            ++i;
+            continue;
+        }
+
+        if (line_start) {
+            line_start = false;
+            bool directive = false;
+            if constexpr (R::kDirectives == Directive::Hash) directive = c == '#';
+            if constexpr (R::kDirectives == Directive::YamlMarker) {
+                directive = i + 2 < n && c == '-' && text[i + 1] == '-' && text[i + 2] == '-';
+            }
+            if (directive) {
+                tokens.push_back({Token::PREPROCESSOR, i, n - i});
+                return;
+            }
+        }
+
+        if (cls & kIdentStart) {
+            size_t start = i;
+            while (i < n && (char_class(text[i]) & kIdentChar)) ++i;
+            if (keywords.contains(text + start, i - start)) tokens.push_back({Token::KEYWORD, start, i - start});
+            continue;
+        }
+        if (!(cls & (kDigit | kSpecial))) {
+            ++i;
+            continue;
+        }
+
+        if constexpr (R::kHashComments) {
+            if (c == '#') {
+                tokens.push_back({Token::COMMENT, i, n - i});
+                return;
+            }
+        }
+        if constexpr (R::kSlashComments || R::kBlockComments) {
+            if (c == '/' && i + 1 < n) {
+                if (R::kSlashComments && text[i + 1] == '/') {
+                    tokens.push_back({Token::COMMENT, i, n - i});
+                    return;
+                }
+                if (R::kBlockComments && text[i + 1] == '*') {
+                    size_t end = line.find("*/", i + 2);
+                    if (end == std::string::npos) {
+                        tokens.push_back({Token::COMMENT, i, n - i});
+                        out_state.in_block_comment = true;
+                        return;
+                    }
+                    tokens.push_back({Token::COMMENT, i, end + 2 - i});
+                    i = end + 2;
+                    continue;
+                }
+            }
+        }
+
+        if (c == '"' || c == '\'' || (R::kTemplateStrings && c == '`')) {
+            if constexpr (R::kTripleStrings) {
+                if (i + 2 < n && text[i + 1] == c && text[i + 2] == c) {
+                    size_t end = find_triple_end(line, i + 3, c);
+                    if (end == std::string::npos) {
+                        tokens.push_back({Token::STRING, i, n - i});
+                        out_state.in_triple_string = true;
+                        out_state.string_delim = c;
+                        return;
+                    }
+                    tokens.push_back({Token::STRING, i, end - i});
+                    i = end;
+                    continue;
+                }
+            }
+            size_t end = find_string_end(line, i + 1, c);
+            if (end == std::string::npos) {
+                // Only template strings may span lines; others end at the line break
+                tokens.push_back({Token::STRING, i, n - i});
+                if (c == '`') out_state.string_delim = '`';
+                return;
+            }
+            tokens.push_back({Token::STRING, i, end - i});
+            i = end;
+            continue;
+        }
+
+        if ((cls & kDigit) || (c == '.' && i + 1 < n && (char_class(text[i + 1]) & kDigit))) {
+            size_t start = i;
+            while (i < n && ((char_class(text[i]) & kIdentChar) || text[i] == '.' || text[i] == '\'')) ++i;
+            tokens.push_back({Token::NUMBER, start, i - start});
+            continue;
+        }
+
+        ++i;
+    }
+}
+
+} // namespace
+
+// Single pass over the line. Block comments, Python triple-quoted strings,
+// Markdown code fences and JS template strings carry over via LineState, so
+// results can be cached per line and resumed from any line's in-state.
+// Tokens are emitted in order and never overlap; plain text is left uncovered.
+void SyntaxHighlighter::tokenize_line(const std::string& line, const LineState& in_state, LineState& out_state,
+                                      std::vector<Token>& tokens) const {
+    EDITOR_TRACE_SCOPE("highlight", "tokenize_line");
+    tokens.clear();
     out_state = in_state;
-    // C++ keywords
-    static const std::unordered_set<std::string> cpp_keywords = {
-        "int", "float", "double", "if", "else", "for", "while", "return", "class", "struct", "public", "private", "protected", "void", "const", "static", "virtual", "override", "namespace", "using", "include"
-    };
-    // Python keywords
-    static const std::unordered_set<std::string> python_keywords = {
-        "def", "class", "import", "from", "as", "if", "elif", "else", "for", "while", "return", "with", "try", "except", "finally", "lambda", "pass", "break", "continue", "global", "nonlocal", "assert", "yield", "del", "raise"
-    };
-    // Detect keywords
-    std::regex word_regex("[A-Za-z_][A-Za-z0-9_]*");
-    auto words_begin = std::sregex_iterator(line.begin(), line.end(), word_regex);
-    auto words_end = std::sregex_iterator();
-    for (auto it = words_begin; it != words_end; ++it) {
-        std::string word = it->str();
-        size_t pos = it->position();
-        Token::Type type = Token::NORMAL;
-        if (language_ == Language::Cpp && cpp_keywords.count(word)) type = Token::KEYWORD;
-        if (language_ == Language::Python && python_keywords.count(word)) type = Token::KEYWORD;
-        tokens.push_back({type, pos, word.length()});
+    size_t i = 0;
+    const size_t n = line.size();
+
+    // Continue constructs left open by the previous line
+    if (out_state.in_block_comment) {
+        size_t end = line.find("*/");
+        if (end == std::string::npos) {
+            if (n > 0) tokens.push_back({Token::COMMENT, 0, n});
+            return;
+        }
+        tokens.push_back({Token::COMMENT, 0, end + 2});
+        out_state.in_block_comment = false;
+        i = end + 2;
+    } else if (out_state.in_triple_string) {
+        if (language_ == Language::Markdown) {
+            // Inside a ``` fence until a closing fence line
+            if (line.compare(0, 3, "```") == 0) out_state.in_triple_string = false;
+            if (n > 0) tokens.push_back({Token::STRING, 0, n});
+            return;
+        }
+        size_t end = find_triple_end(line, 0, out_state.string_delim);
+        if (end == std::string::npos) {
+            if (n > 0) tokens.push_back({Token::STRING, 0, n});
+            return;
+        }
+        tokens.push_back({Token::STRING, 0, end});
+        out_state.in_triple_string = false;
+        out_state.string_delim = 0;
+        i = end;
+    } else if (out_state.string_delim == '`') {
+        size_t end = find_string_end(line, 0, '`');
+        if (end == std::string::npos) {
+            if (n > 0) tokens.push_back({Token::STRING, 0, n});
+            return;
+        }
+        tokens.push_back({Token::STRING, 0, end});
+        out_state.string_delim = 0;
+        i = end;
     }
-    // String literals
-    std::regex string_regex("\"([^\"]*)\"");
-    auto str_begin = std::sregex_iterator(line.begin(), line.end(), string_regex);
-    for (auto it = str_begin; it != words_end; ++it) {
-        size_t pos = it->position();
-        tokens.push_back({Token::STRING, pos, it->str().length()});
+
+    if (language_ == Language::Markdown && line.compare(0, 3, "```") == 0) {
+        out_state.in_triple_string = true;
+        out_state.string_delim = '`';
+        tokens.push_back({Token::STRING, 0, n});
+        return;
     }
-    // Comments
-    if (language_ == Language::Cpp) {
-        size_t comment_pos = line.find("//");
-        if (comment_pos != std::string::npos) tokens.push_back({Token::COMMENT, comment_pos, line.length() - comment_pos});
-    } else if (language_ == Language::Python) {
-        size_t comment_pos = line.find("#");
-        if (comment_pos != std::string::npos) tokens.push_back({Token::COMMENT, comment_pos, line.length() - comment_pos});
+
+    // The one language dispatch for the line
+    switch (language_) {
+        case Language::Cpp: lex<CLikeRules>(line, i, kCppKeywords, out_state, tokens); break;
+        case Language::Rust: lex<CLikeRules>(line, i, kRustKeywords, out_state, tokens); break;
+        case Language::Go: lex<CLikeRules>(line, i, kGoKeywords, out_state, tokens); break;
+        case Language::JavaScript: lex<ScriptRules>(line, i, kJavaScriptKeywords, out_state, tokens); break;
+        case Language::TypeScript: lex<ScriptRules>(line, i, kTypeScriptKeywords, out_state, tokens); break;
+        case Language::Python: lex<PythonRules>(line, i, kPythonKeywords, out_state, tokens); break;
+        case Language::JSON: lex<JsonRules>(line, i, kJsonKeywords, out_state, tokens); break;
+        case Language::YAML: lex<YamlRules>(line, i, kYamlKeywords, out_state, tokens); break;
+        case Language::Markdown: lex<MarkdownRules>(line, i, kNoKeywords, out_state, tokens); break;
+        case Language::Auto: lex<PlainRules>(line, i, kNoKeywords, out_state, tokens); break;
     }
-    return tokens;
 }
@@ -0,0 +1,249 @@
+#include "tab_manager.h"
+#include "document_journal.h"
+#include "platform_file.h"
+#include <algorithm>
+#include <thread>
+
+size_t TabManager::resident_bytes(const TextBuffer& document) {
+    size_t bytes = document.get_total_length();
+    if (auto* table = dynamic_cast<const PieceTable*>(&document)) {
+        bytes += table->get_index_bytes() + table->get_history_bytes();
+    }
+    return bytes;
+}
+
+size_t TabManager::get_resident_bytes() const {
+    size_t bytes = 0;
+    for (const auto& tab : tabs_) {
+        if (tab.document) bytes += resident_bytes(*tab.document);
+    }
+    return bytes;
+}
+
+bool TabManager::can_hibernate(const EditorTab& tab) const {
+    if (tab.is_hibernated() || &tab == &tabs_[active_tab_index_]) return false;
+    // Only text that is on disk as it stands can be dropped outright
+    if (!tab.is_modified && !tab.file_path.empty()) return true;
+    return !spill_workspace_.empty();
+}
+
+size_t TabManager::enforce_budget(const HibernateHook& before) {
+    if (memory_budget_ == 0) return 0;
+    size_t resident = get_resident_bytes();
+    if (resident <= memory_budget_) return 0;
+
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < tabs_.size(); ++i) {
+        if (can_hibernate(tabs_[i])) candidates.push_back(i);
+    }
+    std::sort(candidates.begin(), candidates.end(), [this](size_t a, size_t b) {
+        return tabs_[a].last_active < tabs_[b].last_active;
+    });
+
+    size_t hibernated = 0;
+    for (size_t index : candidates) {
+        if (resident <= memory_budget_) break;
+        size_t bytes = resident_bytes(*tabs_[index].document);
+        if (!hibernate_tab(index, before)) continue;
+        resident -= (std::min)(resident, bytes);
+        hibernated++;
+    }
+    return hibernated;
+}
+
+bool TabManager::hibernate_tab(size_t index, const HibernateHook& before) {
+    if (index >= tabs_.size() || !can_hibernate(tabs_[index])) return false;
+    EditorTab& tab = tabs_[index];
+
+    if (tab.is_modified || tab.file_path.empty()) {
+        // The journal keeps the whole text inline when it names no file
+        auto text = tab.piece_table();
+        if (!text) text = std::make_shared<PieceTable>(tab.document->get_text(0, tab.document->get_total_length()));
+        std::string key = "hibernated-tab:" + (tab.file_path.empty() ? std::to_string(tab.id) : tab.file_path);
+        std::string path = editor::DocumentJournal::journal_path_for(spill_workspace_, key);
+        editor::DocumentJournal journal;
+        if (!journal.open(*text, path, "")) return false;
+        journal.close(false);
+        tab.spill_path = path;
+    } else if (!editor::PlatformFile::get_modified_time(tab.file_path, tab.mtime)) {
+        return false;   // Gone from disk: dropping it would lose the text
+    }
+
+    if (before) before(tab);
+    tab.cursor_pos = (std::min)(tab.cursor_pos, tab.document->get_total_length());
+    tab.cursor_line = tab.document->get_line_at(tab.cursor_pos);
+    tab.view_state.reset();
+    tab.document.reset();
+    return true;
+}
+
+bool TabManager::wake_tab(size_t index) {
+    if (index >= tabs_.size() || !tabs_[index].is_hibernated()) return false;
+    EditorTab& tab = tabs_[index];
+    if (!tab.is_reloading()) {
+        queue_load(tab, false);
+        return true;
+    }
+    // Queued as a preload: move it to the front
+    tab.preloading = false;
+    std::lock_guard<std::mutex> lock(load_mutex_);
+    for (auto it = load_queue_.begin(); it != load_queue_.end(); ++it) {
+        if (it->tab_id != tab.id) continue;
+        LoadRequest request = std::move(*it);
+        load_queue_.erase(it);
+        request.preload = false;
+        load_queue_.push_front(std::move(request));
+        break;
+    }
+    return true;
+}
+
+size_t TabManager::add_hibernated_tab(const std::string& file_path, size_t cursor_pos, size_t top_line,
+                                      uint64_t last_active) {
+    tabs_.emplace_back(nullptr, file_path);
+    EditorTab& tab = tabs_.back();
+    tab.id = ++next_id_;
+    tab.backend = default_backend_;
+    tab.cursor_pos = cursor_pos;
+    tab.top_line = top_line;
+    tab.last_active = last_active;
+    clock_ = (std::max)(clock_, last_active);
+    return tabs_.size() - 1;
+}
+
+size_t TabManager::preload_tabs() {
+    std::vector<EditorTab*> waiting;
+    for (auto& tab : tabs_) {
+        if (tab.is_hibernated() && !tab.is_reloading() && tab.spill_path.empty()) waiting.push_back(&tab);
+    }
+    std::stable_sort(waiting.begin(), waiting.end(), [](const EditorTab* a, const EditorTab* b) {
+        return a->last_active > b->last_active;
+    });
+    for (EditorTab* tab : waiting) queue_load(*tab, true);
+    return waiting.size();
+}
+
+void TabManager::queue_load(EditorTab& tab, bool preload) {
+    LoadRequest request;
+    request.tab_id = tab.id;
+    request.preload = preload;
+    request.spill_path = tab.spill_path;
+    request.file_path = tab.file_path;
+    request.backend = tab.backend;
+    request.promise = std::make_shared<std::promise<std::shared_ptr<TextBuffer>>>();
+    tab.reload = request.promise->get_future().share();
+    tab.preloading = preload;
+
+    std::lock_guard<std::mutex> lock(load_mutex_);
+    if (preload) {
+        load_queue_.push_back(std::move(request));
+    } else {
+        load_queue_.push_front(std::move(request));
+    }
+    if (!loader_.joinable()) loader_ = std::thread(&TabManager::loader_loop, this);
+    load_wake_.notify_one();
+}
+
+void TabManager::cancel_load(uint64_t tab_id) {
+    std::lock_guard<std::mutex> lock(load_mutex_);
+    load_queue_.erase(std::remove_if(load_queue_.begin(), load_queue_.end(),
+                                     [tab_id](const LoadRequest& request) { return request.tab_id == tab_id; }),
+                      load_queue_.end());
+}
+
+void TabManager::cancel_preloads() {
+    std::vector<uint64_t> cancelled;
+    {
+        std::lock_guard<std::mutex> lock(load_mutex_);
+        for (auto it = load_queue_.begin(); it != load_queue_.end();) {
+            if (!it->preload) {
+                ++it;
+                continue;
+            }
+            cancelled.push_back(it->tab_id);
+            it = load_queue_.erase(it);
+        }
+    }
+    // Those tabs wait for an activation again
+    for (auto& tab : tabs_) {
+        if (std::find(cancelled.begin(), cancelled.end(), tab.id) != cancelled.end()) tab.reload = {};
+    }
+}
+
+void TabManager::loader_loop() {
+    std::unique_lock<std::mutex> lock(load_mutex_);
+    while (true) {
+        load_wake_.wait(lock, [this] { return load_stopping_ || !load_queue_.empty(); });
+        if (load_stopping_) return;
+        LoadRequest request = std::move(load_queue_.front());
+        load_queue_.pop_front();
+        ReloadNotify notify = reload_notify_;
+        lock.unlock();
+
+        std::string text;
+        bool ok;
+        if (!request.spill_path.empty()) {
+            editor::DocumentJournal::Recovered recovered;
+            std::string error;
+            ok = editor::DocumentJournal::recover(request.spill_path, recovered, error);
+            text = std::move(recovered.text);
+        } else {
+            ok = editor::PlatformFile::read_file(request.file_path, text);
+        }
+        request.promise->set_value(ok ? TextBuffer::create(text, request.backend) : nullptr);
+        if (notify) notify();
+        lock.lock();
+    }
+}
+
+TabManager::~TabManager() {
+    {
+        std::lock_guard<std::mutex> lock(load_mutex_);
+        load_stopping_ = true;
+        load_queue_.clear();
+    }
+    load_wake_.notify_one();
+    if (loader_.joinable()) loader_.join();
+}
+
+size_t TabManager::complete_reloads(bool wait) {
+    size_t installed = 0;
+    for (auto& tab : tabs_) {
+        if (!tab.is_reloading()) continue;
+        if (!wait && tab.reload.wait_for(std::chrono::seconds(0)) != std::future_status::ready) continue;
+        std::shared_ptr<TextBuffer> document = tab.reload.get();
+        tab.reload = {};
+        if (!document) continue;
+        // A preload that would overflow the budget is dropped, and so are
+        // the ones queued behind it
+        if (tab.preloading && memory_budget_ != 0 && &tab != &tabs_[active_tab_index_] &&
+            get_resident_bytes() + resident_bytes(*document) > memory_budget_) {
+            cancel_preloads();
+            continue;
+        }
+
+        tab.document = std::move(document);
+        if (!tab.spill_path.empty()) {
+            discard_spill(tab);
+        } else {
+            uint64_t mtime = 0;
+            // A restored session's tab has no mtime to compare
+            if (tab.mtime != 0 && editor::PlatformFile::get_modified_time(tab.file_path, mtime) && mtime != tab.mtime) {
+                // Edited elsewhere meanwhile: byte offsets mean little now,
+                // the cursor's line is the best guess
+                tab.cursor_pos = tab.document->get_line_start(
+                    (std::min)(tab.cursor_line, tab.document->get_line_count() - 1));
+            }
+        }
+        tab.cursor_pos = (std::min)(tab.cursor_pos, tab.document->get_total_length());
+        tab.top_line = (std::min)(tab.top_line, tab.document->get_line_count() - 1);
+        installed++;
+    }
+    return installed;
+}
+
+void TabManager::discard_spill(EditorTab& tab) {
+    if (tab.spill_path.empty()) return;
+    editor::PlatformFile::delete_file(tab.spill_path);
+    tab.spill_path.clear();
+}
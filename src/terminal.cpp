@@ -1,25 +1,18 @@
 #include "terminal.h"
-#include <iostream>
 
-EmbeddedTerminal::EmbeddedTerminal()
-    : process_handle_(nullptr)
-    , thread_handle_(nullptr)
-    , stdin_write_(nullptr)
-    , stdout_read_(nullptr)
+EmbeddedTerminal::EmbeddedTerminal(int columns, int rows)
+    : output_watch_(0)
     , process_running_(false)
-    , cursor_line_(0)
-    , cursor_col_(0)
+    , process_exited_(false)
+    , screen_(columns, rows)
     , scroll_offset_(0)
     , history_index_(-1)
-    , reader_thread_(nullptr)
+    , output_notified_(false)
 {
-    InitializeCriticalSection(&output_mutex_);
-    buffer_.push_back(""); // Start with one line
 }
 
 EmbeddedTerminal::~EmbeddedTerminal() {
     stop_shell();
-    DeleteCriticalSection(&output_mutex_);
 }
 
 bool EmbeddedTerminal::start_shell(const std::string& shell_path) {
@@ -27,76 +20,39 @@ bool EmbeddedTerminal::start_shell(const std::string& shell_path) {
         stop_shell();
     }
     
-    // Create pipes for stdin/stdout
-    HANDLE stdin_read = nullptr;
-    HANDLE stdout_write = nullptr;
-    
-    SECURITY_ATTRIBUTES sa{};
-    sa.nLength = sizeof(SECURITY_ATTRIBUTES);
-    sa.bInheritHandle = TRUE;
-    sa.lpSecurityDescriptor = nullptr;
-    
-    if (!CreatePipe(&stdin_read, &stdin_write_, &sa, 0)) {
-        return false;
-    }
-    if (!CreatePipe(&stdout_read_, &stdout_write, &sa, 0)) {
-        CloseHandle(stdin_read);
-        CloseHandle(stdin_write_);
+    std::string executable;
+    std::vector<std::string> args;
+    if (!editor::ProcessUtils::parse_command_line(
+            shell_path.empty() ? editor::ProcessUtils::get_shell() : shell_path, executable, args)) {
         return false;
     }
     
-    // Ensure child doesn't inherit our end of pipes
-    SetHandleInformation(stdin_write_, HANDLE_FLAG_INHERIT, 0);
-    SetHandleInformation(stdout_read_, HANDLE_FLAG_INHERIT, 0);
-    
-    // Create process
-    STARTUPINFOA si{};
-    si.cb = sizeof(STARTUPINFOA);
-    si.hStdInput = stdin_read;
-    si.hStdOutput = stdout_write;
-    si.hStdError = stdout_write;
-    si.dwFlags |= STARTF_USESTDHANDLES;
-    
-    PROCESS_INFORMATION pi{};
-    
-    std::string cmdline = shell_path;
-    char* cmd_buffer = new char[cmdline.size() + 1];
-    strcpy_s(cmd_buffer, cmdline.size() + 1, cmdline.c_str());
-    
-    BOOL success = CreateProcessA(
-        nullptr,
-        cmd_buffer,
-        nullptr,
-        nullptr,
-        TRUE,
-        CREATE_NO_WINDOW,
-        nullptr,
-        nullptr,
-        &si,
-        &pi
-    );
+    editor::ProcessOptions options;
+    options.hide_window = true;
+    options.io.pseudo_terminal = true;
+    options.io.columns = screen_.columns();
+    options.io.rows = screen_.rows();
+    options.environment.push_back({"TERM", "xterm-256color"});
     
-    delete[] cmd_buffer;
-    
-    // Close child's ends
-    CloseHandle(stdin_read);
-    CloseHandle(stdout_write);
+    auto process = std::make_unique<editor::PlatformProcess>();
+    if (!process->start(executable, args, options)) {
+        return false;
+    }
     
-    if (!success) {
-        CloseHandle(stdin_write_);
-        CloseHandle(stdout_read_);
-        stdin_write_ = nullptr;
-        stdout_read_ = nullptr;
+    if (!io_loop_) {
+        io_loop_ = editor::ProcessIoLoop::shared();
+    }
+    process_exited_ = false;
+    output_watch_ = io_loop_->watch(process->get_stdout_pipe(), [this](const char* data, size_t size) {
+        on_output(data, size);
+    });
+    if (output_watch_ == 0) {
+        process->terminate(0);
         return false;
     }
     
-    process_handle_ = pi.hProcess;
-    thread_handle_ = pi.hThread;
+    process_ = std::move(process);
     process_running_ = true;
-    
-    // Start background reader thread
-    reader_thread_ = CreateThread(nullptr, 0, read_output_thread, this, 0, nullptr);
-    
     return true;
 }
 
@@ -105,58 +61,96 @@ void EmbeddedTerminal::stop_shell() {
     
     process_running_ = false;
     
-    // Close pipes to signal EOF
-    if (stdin_write_) {
-        CloseHandle(stdin_write_);
-        stdin_write_ = nullptr;
-    }
-    
-    // Wait for process to exit
-    if (process_handle_) {
-        WaitForSingleObject(process_handle_, 2000);
-        TerminateProcess(process_handle_, 0);
-        CloseHandle(process_handle_);
-        CloseHandle(thread_handle_);
-        process_handle_ = nullptr;
-        thread_handle_ = nullptr;
-    }
-    
-    // Wait for reader thread
-    if (reader_thread_) {
-        WaitForSingleObject(reader_thread_, 1000);
-        CloseHandle(reader_thread_);
-        reader_thread_ = nullptr;
-    }
+    // No more callbacks once this returns; the terminal is closed with the process
+    io_loop_->unwatch(output_watch_);
+    output_watch_ = 0;
     
-    if (stdout_read_) {
-        CloseHandle(stdout_read_);
-        stdout_read_ = nullptr;
+    // Closing the terminal hangs the shell up; terminate if it lingers
+    process_->close_stdin();
+    if (!process_->wait(2000)) {
+        process_->terminate(1000);
     }
+    process_.reset();
 }
 
 void EmbeddedTerminal::send_input(const std::string& text) {
-    if (!process_running_ || !stdin_write_) return;
+    if (!is_running()) return;
     
-    DWORD written;
-    WriteFile(stdin_write_, text.c_str(), static_cast<DWORD>(text.size()), &written, nullptr);
+    process_->write_stdin(text);
 }
 
 void EmbeddedTerminal::send_line(const std::string& line) {
-    send_input(line + "\r\n");
+    send_input(line + "\r");
     add_to_history(line);
 }
 
-std::string EmbeddedTerminal::get_output() {
-    EnterCriticalSection(&output_mutex_);
-    std::string output = pending_output_;
-    pending_output_.clear();
-    LeaveCriticalSection(&output_mutex_);
+void EmbeddedTerminal::set_output_callback(OutputCallback callback) {
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    output_callback_ = std::move(callback);
+}
+
+void EmbeddedTerminal::on_output(const char* data, size_t size) {
+    OutputCallback notify;
+    {
+        std::lock_guard<std::mutex> lock(output_mutex_);
+        if (size == 0) {
+            process_exited_ = true;
+        } else {
+            pending_output_.append(data, size);
+        }
+        // Only the first chunk after an update() notifies; the rest join it
+        if (!output_notified_) {
+            output_notified_ = true;
+            notify = output_callback_;
+        }
+    }
+    if (notify) notify();
+}
+
+bool EmbeddedTerminal::update() {
+    bool more = false;
+    OutputCallback notify;
+    {
+        std::lock_guard<std::mutex> lock(output_mutex_);
+        if (pending_output_.size() <= kMaxOutputPerUpdate) {
+            parsing_.swap(pending_output_);
+        } else {
+            // A flood: parse a frame's worth and come back for the rest
+            parsing_.assign(pending_output_, 0, kMaxOutputPerUpdate);
+            pending_output_.erase(0, kMaxOutputPerUpdate);
+            more = true;
+            notify = output_callback_;
+        }
+        output_notified_ = more;
+    }
+    
+    bool changed = !parsing_.empty();
+    if (changed) {
+        screen_.feed(parsing_.data(), parsing_.size());
+        parsing_.clear();
+    }
     
-    if (!output.empty()) {
-        process_output(output);
+    if (process_running_) {
+        // Queries the program made (cursor position, device attributes)
+        std::string responses;
+        if (screen_.take_responses(responses)) {
+            process_->write_stdin(responses);
+        }
+        // ConPTY keeps its output open after the shell exits
+        if (!process_exited_ && process_->wait(0)) {
+            process_exited_ = true;
+        }
     }
     
-    return output;
+    if (notify) notify();
+    return changed;
+}
+
+void EmbeddedTerminal::resize(int columns, int rows) {
+    screen_.resize(columns, rows);
+    if (process_running_) {
+        process_->resize_terminal(screen_.columns(), screen_.rows());
+    }
 }
 
 void EmbeddedTerminal::add_to_history(const std::string& command) {
@@ -197,91 +191,13 @@ std::string EmbeddedTerminal::history_next() {
 }
 
 void EmbeddedTerminal::clear() {
-    buffer_.clear();
-    buffer_.push_back("");
-    cursor_line_ = 0;
-    cursor_col_ = 0;
+    // Screen and scrollback, leaving the modes the shell set
+    static const char kClear[] = "\x1b[H\x1b[2J\x1b[3J";
+    screen_.feed(kClear, sizeof(kClear) - 1);
     scroll_offset_ = 0;
 }
 
-void EmbeddedTerminal::process_output(const std::string& output) {
-    for (char c : output) {
-        if (c == '\r') {
-            cursor_col_ = 0;
-        } else if (c == '\n') {
-            cursor_line_++;
-            cursor_col_ = 0;
-            if (cursor_line_ >= buffer_.size()) {
-                buffer_.push_back("");
-            }
-        } else if (c == '\b') {
-            if (cursor_col_ > 0) {
-                cursor_col_--;
-            }
-        } else if (c == '\t') {
-            // Tab = 4 spaces
-            append_text("    ");
-        } else if (c >= 32 || c == 27) { // Printable or ESC
-            append_text(std::string(1, c));
-        }
-    }
-    
-    // Keep buffer from growing too large
-    const size_t MAX_BUFFER = 10000;
-    if (buffer_.size() > MAX_BUFFER) {
-        buffer_.erase(buffer_.begin(), buffer_.begin() + (buffer_.size() - MAX_BUFFER));
-        if (cursor_line_ >= MAX_BUFFER) {
-            cursor_line_ -= (buffer_.size() - MAX_BUFFER);
-        }
-    }
-}
-
-void EmbeddedTerminal::append_text(const std::string& text) {
-    if (cursor_line_ >= buffer_.size()) {
-        buffer_.push_back("");
-        cursor_line_ = buffer_.size() - 1;
-    }
-    
-    std::string& line = buffer_[cursor_line_];
-    
-    // Extend line if needed
-    if (cursor_col_ > line.size()) {
-        line.resize(cursor_col_, ' ');
-    }
-    
-    // Insert text at cursor
-    if (cursor_col_ >= line.size()) {
-        line += text;
-    } else {
-        line = line.substr(0, cursor_col_) + text + line.substr(cursor_col_);
-    }
-    
-    cursor_col_ += text.size();
-}
-
-void EmbeddedTerminal::parse_ansi_escape(const std::string& seq) {
-    // Basic ANSI escape sequence support (simplified)
-    // Full VT100 support would be much more complex
-    (void)seq; // TODO: Implement ANSI color codes, cursor movements, etc.
-}
-
-DWORD WINAPI EmbeddedTerminal::read_output_thread(LPVOID param) {
-    EmbeddedTerminal* term = static_cast<EmbeddedTerminal*>(param);
-    
-    char buffer[4096];
-    DWORD read;
-    
-    while (term->process_running_) {
-        if (ReadFile(term->stdout_read_, buffer, sizeof(buffer) - 1, &read, nullptr) && read > 0) {
-            buffer[read] = '\0';
-            
-            EnterCriticalSection(&term->output_mutex_);
-            term->pending_output_.append(buffer, read);
-            LeaveCriticalSection(&term->output_mutex_);
-        } else {
-            break;
-        }
-    }
-    
-    return 0;
+size_t EmbeddedTerminal::drop_scrollback() {
+    scroll_offset_ = 0;
+    return screen_.drop_history();
 }
@@ -0,0 +1,668 @@
+#include "terminal_screen.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace editor {
+
+namespace {
+
+void append_utf8(std::string& out, char32_t ch) {
+    if (ch < 0x80) {
+        out += static_cast<char>(ch);
+    } else if (ch < 0x800) {
+        out += static_cast<char>(0xC0 | (ch >> 6));
+        out += static_cast<char>(0x80 | (ch & 0x3F));
+    } else if (ch < 0x10000) {
+        out += static_cast<char>(0xE0 | (ch >> 12));
+        out += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (ch & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (ch >> 18));
+        out += static_cast<char>(0x80 | ((ch >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (ch & 0x3F));
+    }
+}
+
+} // namespace
+
+TerminalScreen::TerminalScreen(int columns, int rows, size_t scrollback)
+    : parser_(*this)
+    , columns_((std::max)(columns, 1))
+    , rows_((std::max)(rows, 1))
+    , active_(&main_) {
+    main_.scrollback = scrollback;
+    reset();
+}
+
+void TerminalScreen::feed(const char* data, size_t size) {
+    if (size == 0) return;
+    parser_.feed(data, size);
+    ++generation_;
+}
+
+void TerminalScreen::reset() {
+    parser_.reset();
+    init_buffer(main_, main_.scrollback);
+    init_buffer(alternate_, 0);
+    active_ = &main_;
+    cursor_row_ = 0;
+    cursor_column_ = 0;
+    cursor_visible_ = true;
+    autowrap_ = true;
+    origin_mode_ = false;
+    scroll_top_ = 0;
+    scroll_bottom_ = rows_ - 1;
+    pen_ = TerminalCell();
+    saved_ = SavedCursor();
+    saved_main_ = SavedCursor();
+    title_.clear();
+    ++generation_;
+}
+
+void TerminalScreen::init_buffer(Buffer& buffer, size_t scrollback) {
+    // The ring grows up to its capacity as output arrives; only the
+    // screen's rows exist at first
+    buffer.ring.clear();
+    buffer.ring.reserve(rows_ + scrollback);
+    buffer.ring.resize(rows_);
+    for (Row& r : buffer.ring) r.cells.assign(columns_, TerminalCell());
+    buffer.first = 0;
+    buffer.count = rows_;
+    buffer.scrollback = scrollback;
+}
+
+void TerminalScreen::resize(int columns, int rows) {
+    columns = (std::max)(columns, 1);
+    rows = (std::max)(rows, 1);
+    if (columns == columns_ && rows == rows_) return;
+
+    for (Buffer* buffer : {&main_, &alternate_}) {
+        std::vector<Row> lines;
+        lines.reserve(rows + buffer->scrollback);
+        for (size_t i = 0; i < buffer->count; ++i) {
+            lines.push_back(std::move(buffer->ring[(buffer->first + i) % buffer->ring.size()]));
+        }
+        bool active = buffer == active_;
+
+        // Shrinking drops blank rows below the cursor first; the rest of
+        // the difference scrolls into history, as far as the cursor's row
+        int excess = rows_ - rows;
+        int below_cursor = active ? rows_ - 1 - cursor_row_ : rows_;
+        while (excess > 0 && below_cursor > 0 &&
+               std::all_of(lines.back().cells.begin(), lines.back().cells.end(),
+                           [](const TerminalCell& cell) { return cell == TerminalCell(); })) {
+            lines.pop_back();
+            --excess;
+            --below_cursor;
+        }
+        if (active && excess > cursor_row_) {
+            // Not that many rows above the cursor: the bottom ones go
+            int dropped = excess - cursor_row_;
+            lines.resize(lines.size() - dropped);
+            excess -= dropped;
+        }
+        if (active) cursor_row_ -= excess;
+
+        // Growing adds blank rows at the bottom
+        while (static_cast<int>(lines.size()) < rows) lines.emplace_back();
+        if (lines.size() > rows + buffer->scrollback) {
+            lines.erase(lines.begin(), lines.end() - (rows + buffer->scrollback));
+        }
+        for (Row& line : lines) line.cells.resize(columns, TerminalCell());
+
+        buffer->ring = std::move(lines);
+        buffer->first = 0;
+        buffer->count = buffer->ring.size();
+    }
+
+    columns_ = columns;
+    rows_ = rows;
+    cursor_row_ = (std::min)((std::max)(cursor_row_, 0), rows_ - 1);
+    cursor_column_ = (std::min)(cursor_column_, columns_ - 1);
+    scroll_top_ = 0;
+    scroll_bottom_ = rows_ - 1;
+    ++generation_;
+}
+
+size_t TerminalScreen::get_memory_bytes() const {
+    size_t bytes = 0;
+    for (const Buffer* buffer : {&main_, &alternate_}) {
+        bytes += buffer->ring.capacity() * sizeof(Row);
+        for (const Row& row : buffer->ring) bytes += row.cells.capacity() * sizeof(TerminalCell);
+    }
+    return bytes;
+}
+
+size_t TerminalScreen::drop_history() {
+    size_t before = get_memory_bytes();
+    Buffer& buffer = main_;
+    std::vector<Row> screen;
+    screen.reserve(rows_);
+    for (size_t i = buffer.count - rows_; i < buffer.count; ++i) {
+        screen.push_back(std::move(buffer.ring[(buffer.first + i) % buffer.ring.size()]));
+    }
+    // Without the reserve of a fresh buffer: the ring grows back as needed
+    buffer.ring = std::move(screen);
+    buffer.first = 0;
+    buffer.count = rows_;
+    ++generation_;
+    size_t after = get_memory_bytes();
+    return before > after ? before - after : 0;
+}
+
+size_t TerminalScreen::history_size() const {
+    return active_->count - rows_;
+}
+
+const TerminalScreen::Row& TerminalScreen::line(size_t index) const {
+    const Buffer& buffer = *active_;
+    return buffer.ring[(buffer.first + index) % buffer.ring.size()];
+}
+
+std::string TerminalScreen::line_text(size_t index) const {
+    const Row& r = line(index);
+    size_t end = r.cells.size();
+    while (end > 0 && r.cells[end - 1].ch == U' ') --end;
+    std::string text;
+    text.reserve(end);
+    for (size_t i = 0; i < end; ++i) append_utf8(text, r.cells[i].ch);
+    return text;
+}
+
+bool TerminalScreen::take_responses(std::string& responses) {
+    if (responses_.empty()) return false;
+    responses.swap(responses_);
+    responses_.clear();
+    return true;
+}
+
+TerminalScreen::Row& TerminalScreen::row(int screen_row) {
+    Buffer& buffer = *active_;
+    return buffer.ring[(buffer.first + buffer.count - rows_ + screen_row) % buffer.ring.size()];
+}
+
+TerminalCell TerminalScreen::blank() const {
+    // Erased cells take the current background, as xterm's do
+    TerminalCell cell;
+    cell.background = pen_.background;
+    return cell;
+}
+
+void TerminalScreen::clear_row(Row& r, int from, int to) {
+    std::fill(r.cells.begin() + from, r.cells.begin() + to, blank());
+    if (to == columns_) r.wrapped = false;
+}
+
+void TerminalScreen::print_ascii(const char* text, size_t size) {
+    while (size > 0) {
+        if (cursor_column_ >= columns_) {
+            if (!autowrap_) {
+                cursor_column_ = columns_ - 1;
+            } else {
+                row(cursor_row_).wrapped = true;
+                cursor_column_ = 0;
+                line_feed();
+            }
+        }
+        Row& r = row(cursor_row_);
+        size_t n = (std::min)(size, static_cast<size_t>(columns_ - cursor_column_));
+        if (!autowrap_) n = 1;
+        TerminalCell* cell = &r.cells[cursor_column_];
+        for (size_t i = 0; i < n; ++i) {
+            cell[i] = pen_;
+            cell[i].ch = static_cast<unsigned char>(text[i]);
+        }
+        cursor_column_ += static_cast<int>(n);
+        text += n;
+        size -= n;
+    }
+}
+
+void TerminalScreen::print(char32_t ch) {
+    put(ch);
+}
+
+void TerminalScreen::put(char32_t ch) {
+    if (cursor_column_ >= columns_) {
+        if (!autowrap_) {
+            cursor_column_ = columns_ - 1;
+        } else {
+            row(cursor_row_).wrapped = true;
+            cursor_column_ = 0;
+            line_feed();
+        }
+    }
+    TerminalCell& cell = row(cursor_row_).cells[cursor_column_];
+    cell = pen_;
+    cell.ch = ch;
+    ++cursor_column_;
+}
+
+void TerminalScreen::execute(uint8_t control) {
+    switch (control) {
+    case 0x08:  // BS
+        if (cursor_column_ >= columns_) cursor_column_ = columns_ - 1;
+        if (cursor_column_ > 0) --cursor_column_;
+        break;
+    case 0x09:  // HT, stops every 8 columns
+        if (cursor_column_ < columns_) cursor_column_ = (std::min)((cursor_column_ / 8 + 1) * 8, columns_ - 1);
+        break;
+    case 0x0A:  // LF, VT, FF; the tty has already added CR where wanted
+    case 0x0B:
+    case 0x0C:
+        line_feed();
+        break;
+    case 0x0D:  // CR
+        cursor_column_ = 0;
+        break;
+    default:    // BEL, shift-in/out and the rest are ignored
+        break;
+    }
+}
+
+void TerminalScreen::line_feed() {
+    if (cursor_row_ == scroll_bottom_) {
+        if (scroll_top_ == 0 && scroll_bottom_ == rows_ - 1) {
+            scroll_up(1);
+        } else {
+            scroll_region(scroll_top_, scroll_bottom_, 1);
+        }
+    } else if (cursor_row_ < rows_ - 1) {
+        ++cursor_row_;
+    }
+}
+
+void TerminalScreen::reverse_index() {
+    if (cursor_row_ == scroll_top_) {
+        scroll_region(scroll_top_, scroll_bottom_, -1);
+    } else if (cursor_row_ > 0) {
+        --cursor_row_;
+    }
+}
+
+void TerminalScreen::scroll_up(int count) {
+    // The whole screen scrolls: the top row becomes history in place and
+    // a row past the end of the screen becomes the new bottom row
+    Buffer& buffer = *active_;
+    size_t capacity = rows_ + buffer.scrollback;
+    for (int i = 0; i < count; ++i) {
+        if (buffer.ring.size() < capacity) {
+            buffer.ring.emplace_back();
+            ++buffer.count;
+        } else {
+            buffer.first = (buffer.first + 1) % buffer.ring.size();
+        }
+        Row& bottom = row(rows_ - 1);
+        bottom.cells.assign(columns_, blank());
+        bottom.wrapped = false;
+    }
+}
+
+void TerminalScreen::scroll_region(int top, int bottom, int count) {
+    int height = bottom - top + 1;
+    if (height <= 0 || count == 0) return;
+    // Rows are swapped, not copied: each swap is two vector pointers
+    if (count > 0) {
+        count = (std::min)(count, height);
+        for (int i = top; i + count <= bottom; ++i) std::swap(row(i), row(i + count));
+        for (int i = bottom - count + 1; i <= bottom; ++i) clear_row(row(i), 0, columns_);
+    } else {
+        count = (std::min)(-count, height);
+        for (int i = bottom; i - count >= top; --i) std::swap(row(i), row(i - count));
+        for (int i = top; i < top + count; ++i) clear_row(row(i), 0, columns_);
+    }
+}
+
+void TerminalScreen::move_cursor(int r, int column) {
+    int top = origin_mode_ ? scroll_top_ : 0;
+    int bottom = origin_mode_ ? scroll_bottom_ : rows_ - 1;
+    cursor_row_ = (std::min)((std::max)(r + top, top), bottom);
+    cursor_column_ = (std::min)((std::max)(column, 0), columns_ - 1);
+}
+
+void TerminalScreen::csi_dispatch(const int* params, size_t count, uint8_t marker, uint8_t intermediate,
+                                  uint8_t final) {
+    // Missing and zero parameters both take the default
+    auto arg = [&](size_t i, int fallback) { return i < count && params[i] > 0 ? params[i] : fallback; };
+    int n = arg(0, 1);
+
+    if (marker == '?') {
+        if (final == 'h' || final == 'l') {
+            for (size_t i = 0; i < count; ++i) set_mode(params[i], final == 'h', true);
+        }
+        return;
+    }
+    if (marker == '>') {
+        if (final == 'c') responses_ += "\x1b[>0;10;1c";
+        return;
+    }
+    if (marker != 0) return;
+    if (intermediate != 0) {
+        if (intermediate == '!' && final == 'p') {
+            // Soft reset: modes and pen, not the screen
+            pen_ = TerminalCell();
+            autowrap_ = true;
+            origin_mode_ = false;
+            cursor_visible_ = true;
+            scroll_top_ = 0;
+            scroll_bottom_ = rows_ - 1;
+        }
+        return;
+    }
+
+    int in_region_top = cursor_row_ >= scroll_top_ ? scroll_top_ : 0;
+    int in_region_bottom = cursor_row_ <= scroll_bottom_ ? scroll_bottom_ : rows_ - 1;
+    if (cursor_column_ >= columns_ && final != 'm') cursor_column_ = columns_ - 1;
+
+    switch (final) {
+    case '@': {     // ICH
+        Row& r = row(cursor_row_);
+        n = (std::min)(n, columns_ - cursor_column_);
+        std::copy_backward(r.cells.begin() + cursor_column_, r.cells.end() - n, r.cells.end());
+        std::fill(r.cells.begin() + cursor_column_, r.cells.begin() + cursor_column_ + n, blank());
+        break;
+    }
+    case 'A':       // CUU
+        cursor_row_ = (std::max)(cursor_row_ - n, in_region_top);
+        break;
+    case 'B':       // CUD
+    case 'e':       // VPR
+        cursor_row_ = (std::min)(cursor_row_ + n, in_region_bottom);
+        break;
+    case 'C':       // CUF
+    case 'a':       // HPR
+        cursor_column_ = (std::min)(cursor_column_ + n, columns_ - 1);
+        break;
+    case 'D':       // CUB
+        cursor_column_ = (std::max)(cursor_column_ - n, 0);
+        break;
+    case 'E':       // CNL
+        cursor_row_ = (std::min)(cursor_row_ + n, in_region_bottom);
+        cursor_column_ = 0;
+        break;
+    case 'F':       // CPL
+        cursor_row_ = (std::max)(cursor_row_ - n, in_region_top);
+        cursor_column_ = 0;
+        break;
+    case 'G':       // CHA
+    case '`':       // HPA
+        cursor_column_ = (std::min)(n, columns_) - 1;
+        break;
+    case 'H':       // CUP
+    case 'f':       // HVP
+        move_cursor(arg(0, 1) - 1, arg(1, 1) - 1);
+        break;
+    case 'd':       // VPA
+        move_cursor(n - 1, cursor_column_);
+        break;
+    case 'J': {     // ED
+        int mode = count > 0 ? params[0] : 0;
+        if (mode == 0) {
+            clear_row(row(cursor_row_), cursor_column_, columns_);
+            for (int i = cursor_row_ + 1; i < rows_; ++i) clear_row(row(i), 0, columns_);
+        } else if (mode == 1) {
+            for (int i = 0; i < cursor_row_; ++i) clear_row(row(i), 0, columns_);
+            clear_row(row(cursor_row_), 0, cursor_column_ + 1);
+        } else if (mode == 2) {
+            for (int i = 0; i < rows_; ++i) clear_row(row(i), 0, columns_);
+        } else if (mode == 3) {
+            // Drop the scrollback: the screen's rows move to the front
+            Buffer& buffer = *active_;
+            std::vector<Row> screen;
+            screen.reserve(rows_ + buffer.scrollback);
+            for (int i = 0; i < rows_; ++i) screen.push_back(std::move(row(i)));
+            buffer.ring = std::move(screen);
+            buffer.first = 0;
+            buffer.count = rows_;
+        }
+        break;
+    }
+    case 'K': {     // EL
+        int mode = count > 0 ? params[0] : 0;
+        Row& r = row(cursor_row_);
+        if (mode == 0) clear_row(r, cursor_column_, columns_);
+        else if (mode == 1) clear_row(r, 0, cursor_column_ + 1);
+        else if (mode == 2) clear_row(r, 0, columns_);
+        break;
+    }
+    case 'L':       // IL
+        if (cursor_row_ >= scroll_top_ && cursor_row_ <= scroll_bottom_) {
+            scroll_region(cursor_row_, scroll_bottom_, -n);
+            cursor_column_ = 0;
+        }
+        break;
+    case 'M':       // DL
+        if (cursor_row_ >= scroll_top_ && cursor_row_ <= scroll_bottom_) {
+            scroll_region(cursor_row_, scroll_bottom_, n);
+            cursor_column_ = 0;
+        }
+        break;
+    case 'P': {     // DCH
+        Row& r = row(cursor_row_);
+        n = (std::min)(n, columns_ - cursor_column_);
+        std::copy(r.cells.begin() + cursor_column_ + n, r.cells.end(), r.cells.begin() + cursor_column_);
+        std::fill(r.cells.end() - n, r.cells.end(), blank());
+        break;
+    }
+    case 'X': {     // ECH
+        Row& r = row(cursor_row_);
+        n = (std::min)(n, columns_ - cursor_column_);
+        std::fill(r.cells.begin() + cursor_column_, r.cells.begin() + cursor_column_ + n, blank());
+        break;
+    }
+    case 'S':       // SU
+        scroll_region(scroll_top_, scroll_bottom_, n);
+        break;
+    case 'T':       // SD
+        scroll_region(scroll_top_, scroll_bottom_, -n);
+        break;
+    case 'h':
+    case 'l':
+        for (size_t i = 0; i < count; ++i) set_mode(params[i], final == 'h', false);
+        break;
+    case 'm':
+        select_graphic_rendition(params, count);
+        break;
+    case 'n':       // DSR
+        if (arg(0, 0) == 5) {
+            responses_ += "\x1b[0n";
+        } else if (arg(0, 0) == 6) {
+            char reply[32];
+            int reported_row = cursor_row_ - (origin_mode_ ? scroll_top_ : 0);
+            snprintf(reply, sizeof(reply), "\x1b[%d;%dR", reported_row + 1, cursor_column() + 1);
+            responses_ += reply;
+        }
+        break;
+    case 'c':       // DA: a VT100 with advanced video
+        if (arg(0, 0) == 0) responses_ += "\x1b[?1;2c";
+        break;
+    case 'r': {     // DECSTBM
+        int top = arg(0, 1) - 1;
+        int bottom = (std::min)(arg(1, rows_), rows_) - 1;
+        if (top < bottom) {
+            scroll_top_ = top;
+            scroll_bottom_ = bottom;
+            move_cursor(0, 0);
+        }
+        break;
+    }
+    case 's':       // SCOSC
+        saved_ = { cursor_row_, cursor_column_, pen_, origin_mode_ };
+        break;
+    case 'u':       // SCORC
+        cursor_row_ = saved_.row;
+        cursor_column_ = (std::min)(saved_.column, columns_ - 1);
+        pen_ = saved_.pen;
+        origin_mode_ = saved_.origin_mode;
+        break;
+    default:
+        break;
+    }
+}
+
+void TerminalScreen::set_mode(int mode, bool on, bool private_mode) {
+    if (!private_mode) return;      // IRM, LNM: not supported
+    switch (mode) {
+    case 6:         // DECOM
+        origin_mode_ = on;
+        move_cursor(0, 0);
+        break;
+    case 7:         // DECAWM
+        autowrap_ = on;
+        break;
+    case 25:        // DECTCEM
+        cursor_visible_ = on;
+        break;
+    case 47:
+    case 1047:
+        switch_screen(on);
+        break;
+    case 1048:
+        if (on) {
+            saved_ = { cursor_row_, cursor_column_, pen_, origin_mode_ };
+        } else {
+            cursor_row_ = (std::min)(saved_.row, rows_ - 1);
+            cursor_column_ = (std::min)(saved_.column, columns_ - 1);
+        }
+        break;
+    case 1049:      // Alternate screen, saving the cursor around it
+        if (on && !alternate_screen()) {
+            saved_main_ = { cursor_row_, cursor_column_, pen_, origin_mode_ };
+            switch_screen(true);
+        } else if (!on && alternate_screen()) {
+            switch_screen(false);
+            cursor_row_ = (std::min)(saved_main_.row, rows_ - 1);
+            cursor_column_ = (std::min)(saved_main_.column, columns_ - 1);
+            pen_ = saved_main_.pen;
+            origin_mode_ = saved_main_.origin_mode;
+        }
+        break;
+    default:        // Keypad and mouse modes are for input, which is not decoded here
+        break;
+    }
+}
+
+void TerminalScreen::switch_screen(bool alternate) {
+    if (alternate == alternate_screen()) return;
+    if (alternate) {
+        // A fresh screen each time it is entered
+        init_buffer(alternate_, 0);
+        active_ = &alternate_;
+    } else {
+        active_ = &main_;
+    }
+}
+
+void TerminalScreen::select_graphic_rendition(const int* params, size_t count) {
+    if (count == 0) {
+        pen_ = TerminalCell();
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        int p = params[i];
+        if (p == 0) {
+            pen_ = TerminalCell();
+        } else if (p == 1) {
+            pen_.attributes |= TerminalCell::Bold;
+        } else if (p == 2) {
+            pen_.attributes |= TerminalCell::Dim;
+        } else if (p == 3) {
+            pen_.attributes |= TerminalCell::Italic;
+        } else if (p == 4 || p == 21) {
+            pen_.attributes |= TerminalCell::Underline;
+        } else if (p == 7) {
+            pen_.attributes |= TerminalCell::Inverse;
+        } else if (p == 8) {
+            pen_.attributes |= TerminalCell::Hidden;
+        } else if (p == 9) {
+            pen_.attributes |= TerminalCell::Strikethrough;
+        } else if (p == 22) {
+            pen_.attributes &= ~(TerminalCell::Bold | TerminalCell::Dim);
+        } else if (p == 23) {
+            pen_.attributes &= ~TerminalCell::Italic;
+        } else if (p == 24) {
+            pen_.attributes &= ~TerminalCell::Underline;
+        } else if (p == 27) {
+            pen_.attributes &= ~TerminalCell::Inverse;
+        } else if (p == 28) {
+            pen_.attributes &= ~TerminalCell::Hidden;
+        } else if (p == 29) {
+            pen_.attributes &= ~TerminalCell::Strikethrough;
+        } else if (p >= 30 && p <= 37) {
+            pen_.foreground = TerminalCell::kPaletteColor | (p - 30);
+        } else if (p == 39) {
+            pen_.foreground = TerminalCell::kDefaultColor;
+        } else if (p >= 40 && p <= 47) {
+            pen_.background = TerminalCell::kPaletteColor | (p - 40);
+        } else if (p == 49) {
+            pen_.background = TerminalCell::kDefaultColor;
+        } else if (p >= 90 && p <= 97) {
+            pen_.foreground = TerminalCell::kPaletteColor | (p - 90 + 8);
+        } else if (p >= 100 && p <= 107) {
+            pen_.background = TerminalCell::kPaletteColor | (p - 100 + 8);
+        } else if (p == 38 || p == 48) {
+            // 38;5;index or 38;2;r;g;b (and 48 for the background)
+            uint32_t& color = p == 38 ? pen_.foreground : pen_.background;
+            if (i + 2 < count && params[i + 1] == 5) {
+                color = TerminalCell::kPaletteColor | (params[i + 2] & 0xFF);
+                i += 2;
+            } else if (i + 4 < count && params[i + 1] == 2) {
+                color = TerminalCell::kRgbColor | ((params[i + 2] & 0xFF) << 16) |
+                        ((params[i + 3] & 0xFF) << 8) | (params[i + 4] & 0xFF);
+                i += 4;
+            } else {
+                return;     // Malformed; the rest cannot be trusted
+            }
+        }
+    }
+}
+
+void TerminalScreen::esc_dispatch(uint8_t intermediate, uint8_t final) {
+    if (intermediate == '#') {
+        if (final == '8') {     // DECALN: fill the screen with E
+            TerminalCell filled;
+            filled.ch = U'E';
+            for (int i = 0; i < rows_; ++i) std::fill(row(i).cells.begin(), row(i).cells.end(), filled);
+        }
+        return;
+    }
+    if (intermediate != 0) return;      // Character set designations
+    switch (final) {
+    case '7':       // DECSC
+        saved_ = { cursor_row_, cursor_column_, pen_, origin_mode_ };
+        break;
+    case '8':       // DECRC
+        cursor_row_ = (std::min)(saved_.row, rows_ - 1);
+        cursor_column_ = (std::min)(saved_.column, columns_ - 1);
+        pen_ = saved_.pen;
+        origin_mode_ = saved_.origin_mode;
+        break;
+    case 'D':       // IND
+        line_feed();
+        break;
+    case 'E':       // NEL
+        cursor_column_ = 0;
+        line_feed();
+        break;
+    case 'M':       // RI
+        reverse_index();
+        break;
+    case 'c':       // RIS
+        reset();
+        break;
+    default:
+        break;
+    }
+}
+
+void TerminalScreen::osc_dispatch(const std::string& data) {
+    // 0 and 2 set the window title; the rest (colors, hyperlinks) are ignored
+    size_t semicolon = data.find(';');
+    if (semicolon == std::string::npos) return;
+    if (data.compare(0, semicolon, "0") == 0 || data.compare(0, semicolon, "2") == 0) {
+        title_ = data.substr(semicolon + 1);
+    }
+}
+
+} // namespace editor
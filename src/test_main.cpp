@@ -1,11 +1,94 @@
 #include "test_framework.h"
 #include "piece_table.h"
+#include "lz4_block.h"
+#include "document_snapshot.h"
+#include "rope_table.h"
+#include "gap_text_buffer.h"
+#include "hex_buffer.h"
+#include "editor_core.h"
+#include "slab_pool.h"
+#include "prefix_index.h"
+#include "tab_manager.h"
+#include "workspace.h"
 #include "undo_manager.h"
+#include "internal_clipboard.h"
 #include "find_dialog.h"
+#include "search_session.h"
+#include "indexer.h"
+#include "thread_pool.h"
+#include "task_coroutine.h"
+#include "file_watcher.h"
+#include "gitignore.h"
+#include "quick_open.h"
+#include "workspace_replace.h"
+#include "batch_edit.h"
+#include "document_transform.h"
+#include "remote_agent.h"
+#include "remote_session.h"
+#include "result_list.h"
+#include "regex_engine.h"
 #include "viewport.h"
+#include "document_view.h"
+#include "text_scan.h"
+#include "text_transcode.h"
+#include "platform_file.h"
+#include "highlight_cache.h"
+#include "keyword_table.h"
+#include "large_file_policy.h"
+#include "log_follower.h"
+#include "treesitter_bridge.h"
+#include "gpu_renderer.h"
+#include "damage_tracker.h"
+#include "line_run_cache.h"
+#include "minimap_density.h"
+#include "code_folding.h"
+#include "bracket_index.h"
+#include "document_outline.h"
+#include "wrap_layout.h"
+#include "column_layout.h"
+#include "lsp_document_sync.h"
+#include "lsp_framing.h"
+#include "lsp_decode.h"
+#include "lsp_encode.h"
+#include "lsp_io_reactor.h"
+#include "spsc_queue.h"
+#include "git_status_worker.h"
+#include "diff_gutter.h"
+#include "diff_engine.h"
+#include "blame_cache.h"
+#include "process_io_loop.h"
+#include "terminal.h"
+#include "terminal_screen.h"
+#include "build_error_parser.h"
+#include "build_system.h"
+#include "plugin_document_access.h"
+#include "plugin_worker.h"
+#include "plugin_catalog.h"
+#include "event_bus.h"
+#include "autocomplete.h"
+#include "document_journal.h"
+#include "startup_scheduler.h"
+#include "trace.h"
+#include "frame_stats.h"
+#include "memory_report.h"
+#include "memory_pressure.h"
+#include "edit_trace.h"
 #include <iostream>
 #include <cassert>
 #include <algorithm> // For std::min
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <future>
+#include <condition_variable>
+#include <mutex>
+#include <regex>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <cstdlib>
 
 // Undefine Windows macros that conflict
 #ifdef min
@@ -108,124 +191,4969 @@ void test_piece_table_get_line() {
     TestFramework::assert_equal(std::string("Line 3"), doc.get_line(2), "Get line 2");
 }
 
+void test_piece_table_random_edits_match_reference() {
+    // Differential test: the piece tree must always agree with a plain string
+    std::mt19937 rng(12345);
+    std::string reference = "alpha\nbeta\ngamma\n";
+    PieceTable doc(reference);
+    
+    for (int i = 0; i < 2000; ++i) {
+        size_t len = reference.size();
+        if (rng() % 3 != 0 || len == 0) {
+            size_t pos = rng() % (len + 1);
+            std::string text = (rng() % 4 == 0) ? "\n" : std::string(1 + rng() % 5, char('a' + rng() % 26));
+            doc.insert(pos, text);
+            reference.insert(pos, text);
+        } else {
+            size_t pos = rng() % len;
+            size_t count = 1 + rng() % 8;
+            doc.remove(pos, count);
+            reference.erase(pos, count);
+        }
+    }
+    
+    TestFramework::assert_equal(reference, doc.get_text(0, doc.get_total_length()), "Text after random edits");
+    size_t expected_lines = std::count(reference.begin(), reference.end(), '\n') + 1;
+    TestFramework::assert_equal(expected_lines, doc.get_line_count(), "Line count after random edits");
+    
+    size_t line_start = 0;
+    for (size_t line = 0; line < expected_lines; ++line) {
+        size_t line_end = reference.find('\n', line_start);
+        if (line_end == std::string::npos) line_end = reference.size();
+        TestFramework::assert_equal(reference.substr(line_start, line_end - line_start), doc.get_line(line),
+                                    "Line " + std::to_string(line));
+        line_start = line_end + 1;
+    }
+}
+
+void test_piece_table_lines_range() {
+    PieceTable doc("one\ntwo\nthree\n");
+    doc.insert(4, "inserted\n");
+    auto lines = doc.get_lines_range(1, 10);
+    TestFramework::assert_equal(size_t(4), lines.size(), "Range clipped to document");
+    TestFramework::assert_equal(std::string("inserted"), lines[0], "Range first line");
+    TestFramework::assert_equal(std::string("three"), lines[2], "Range third line");
+    TestFramework::assert_equal(std::string(""), lines[3], "Trailing empty line");
+    TestFramework::assert_equal(size_t(0), doc.get_lines_range(10, 5).size(), "Range past end");
+    TestFramework::assert_equal(size_t(13), doc.get_line_start(2), "Line start offset");
+    TestFramework::assert_equal(size_t(2), doc.get_line_at(13), "Line at line start");
+    TestFramework::assert_equal(size_t(1), doc.get_line_at(12), "Line at newline");
+}
+
+void test_piece_table_line_cursor() {
+    std::string text = "first\nsecond\r\nthird\n\nlast";
+    PieceTable doc(text);
+    std::vector<std::string> expected = {"first", "second", "third", "", "last"};
+    
+    // Lines inside the single original piece are views straight into the buffer
+    auto cursor = doc.lines();
+    std::string_view line;
+    const char* previous_end = nullptr;
+    size_t count = 0;
+    while (cursor.next(line)) {
+        TestFramework::assert_equal(expected[count], std::string(line), "Cursor line " + std::to_string(count));
+        TestFramework::assert_equal(count, cursor.line_number(), "Cursor line number");
+        if (previous_end && !line.empty()) {
+            TestFramework::assert_true(line.data() > previous_end, "Line view is not copied");
+        }
+        if (!line.empty()) previous_end = line.data() + line.size();
+        ++count;
+    }
+    TestFramework::assert_equal(expected.size(), count, "Cursor visits every line");
+    
+    // Split lines across pieces and join chunk views
+    doc.insert(3, "[x]");
+    doc.insert(doc.get_total_length(), "\n");
+    std::string joined;
+    for (auto it = doc.chunks(); !it.done(); ++it) joined += std::string(*it);
+    TestFramework::assert_equal(doc.get_text(0, doc.get_total_length()), joined, "Chunks cover document");
+    auto spanning = doc.lines(0);
+    TestFramework::assert_true(spanning.next(line), "Spanning line");
+    TestFramework::assert_equal(std::string("fir[x]st"), std::string(line), "Line assembled across pieces");
+    TestFramework::assert_equal(size_t(9), spanning.next_line_start(), "Next line start");
+    
+    auto tail = doc.lines(4);
+    TestFramework::assert_true(tail.next(line) && line == "last", "Cursor from middle");
+    TestFramework::assert_true(tail.next(line) && line.empty(), "Trailing empty line");
+    TestFramework::assert_true(!tail.next(line), "Cursor ends");
+    TestFramework::assert_true(!doc.lines(10).next(line), "Cursor past end");
+}
+
+void test_piece_table_line_column_mapping() {
+    // "é" is 2 bytes / 1 unit, "😀" 4 bytes / 2 units
+    PieceTable doc("ab\r\nc\xC3\xA9" "d\n\xF0\x9F\x98\x80x\n");
+    doc.insert(0, "z");     // Mapping must follow edits: "zab\r\n..."
+    PieceTable::LineColumn at = doc.offset_to_line_col(7);
+    TestFramework::assert_true(at.line == 1 && at.column == 2, "Byte line/column");
+    at = doc.offset_to_line_col(1000);
+    TestFramework::assert_true(at.line == 3 && at.column == 0, "Clamped past the end");
+    TestFramework::assert_equal(size_t(3), doc.line_col_to_offset(0, 99), "Clamped before CRLF");
+    TestFramework::assert_equal(size_t(8), doc.line_col_to_offset(1, 3), "Byte column to offset");
+    TestFramework::assert_equal(doc.get_total_length(), doc.line_col_to_offset(7, 0), "Line past the end");
+    
+    at = doc.offset_to_line_utf16(9);
+    TestFramework::assert_true(at.line == 1 && at.column == 3, "UTF-16 column after a 2-byte character");
+    at = doc.offset_to_line_utf16(15);
+    TestFramework::assert_true(at.line == 2 && at.column == 3, "Surrogate pair counts twice");
+    TestFramework::assert_equal(size_t(14), doc.line_utf16_to_offset(2, 2), "UTF-16 column to offset");
+    TestFramework::assert_equal(size_t(14), doc.line_utf16_to_offset(2, 1), "Inside a surrogate pair: after it");
+    TestFramework::assert_equal(size_t(15), doc.line_utf16_to_offset(2, 50), "Clamped to the line");
+    
+    // Agrees with summing line lengths on a larger document
+    std::string text;
+    for (int i = 0; i < 500; ++i) text += std::string(i % 37, 'x') + "\n";
+    PieceTable large(text);
+    bool agree = true;
+    size_t offset = 0;
+    for (size_t line = 0; line < 500 && agree; ++line) {
+        size_t length = large.get_line(line).size();
+        for (size_t column = 0; column <= length; column += 5) {
+            PieceTable::LineColumn found = large.offset_to_line_col(offset + column);
+            agree = agree && found.line == line && found.column == column &&
+                    large.line_col_to_offset(line, column) == offset + column;
+        }
+        offset += length + 1;
+    }
+    TestFramework::assert_true(agree, "Matches a linear scan");
+}
+
+void test_piece_table_mapped_file() {
+    std::string path = editor::PlatformFile::join_path(editor::PlatformFile::get_temp_directory(),
+                                                       "velocity_mapped_test.txt");
+    TestFramework::assert_true(editor::PlatformFile::write_file(path, "alpha\r\nbeta\r\ngamma", editor::LineEnding::CRLF),
+                               "Write temp file");
+    {
+        auto mapping = editor::PlatformFile::map_file(path);
+        TestFramework::assert_true(mapping != nullptr, "Map file");
+        PieceTable doc(mapping);
+        TestFramework::assert_equal(size_t(18), doc.get_total_length(), "Raw bytes are kept");
+        TestFramework::assert_equal(size_t(3), doc.get_line_count(), "Mapped line count");
+        TestFramework::assert_equal(std::string("beta"), doc.get_line(1), "CR stripped from line");
+        TestFramework::assert_equal(std::string("gamma"), doc.get_line(2), "Last line");
+        // Split the CRLF of line 0 across two pieces
+        doc.insert(6, "!");
+        doc.remove(6, 1);
+        auto lines = doc.get_lines_range(0, 3);
+        TestFramework::assert_equal(std::string("alpha"), lines[0], "Range strips CR at piece end");
+        TestFramework::assert_equal(std::string("beta"), lines[1], "Range strips CR");
+        doc.insert(5, "!");
+        TestFramework::assert_equal(std::string("alpha!"), doc.get_line(0), "Insert in mapped doc");
+        doc.remove(0, 7);
+        TestFramework::assert_equal(std::string("\nbeta\r\ngamma"), doc.get_text(0, doc.get_total_length()),
+                                    "Remove in mapped doc");
+        // Saving over the mapped file must not disturb the document
+        doc.release_mapping();
+        mapping.reset();
+        TestFramework::assert_true(!doc.is_mapped(), "Mapping released");
+        editor::PlatformFile::write_file(path, "x", editor::LineEnding::LF);
+        TestFramework::assert_equal(std::string("\nbeta\r\ngamma"), doc.get_text(0, doc.get_total_length()),
+                                    "Text survives overwrite");
+    }
+    TestFramework::assert_true(editor::PlatformFile::map_file(path + ".missing") == nullptr, "Missing file");
+    editor::PlatformFile::delete_file(path);
+}
+
+void test_platform_file_span_writes() {
+    using editor::LineEnding;
+    using editor::PlatformFile;
+    std::string path = PlatformFile::join_path(PlatformFile::get_temp_directory(), "velocity_span_write.txt");
+    auto read = [&]() {
+        std::vector<uint8_t> data;
+        PlatformFile::read_file_binary(path, data);
+        return std::string(data.begin(), data.end());
+    };
+    
+    // A \r\n split between spans is one line break
+    std::vector<std::string_view> spans = {"a\r", "\nb\r", "c\n", "", "d\r"};
+    TestFramework::assert_true(PlatformFile::write_file(path, spans, LineEnding::LF), "Spans written");
+    TestFramework::assert_equal(std::string("a\nb\nc\nd\n"), read(), "Converted to LF");
+    PlatformFile::write_file(path, spans, LineEnding::CRLF);
+    TestFramework::assert_equal(std::string("a\r\nb\r\nc\r\nd\r\n"), read(), "Converted to CRLF");
+    TestFramework::assert_true(!PlatformFile::exists(path + ".velocity-save.tmp"), "Temporary file renamed");
+    
+    // More spans than one gathered write takes, large and small
+    std::string large(100000, 'x');
+    std::string expected;
+    spans.clear();
+    for (int i = 0; i < 300; ++i) {
+        spans.push_back(i % 50 == 0 ? std::string_view(large) : std::string_view("piece\r\n"));
+        expected += spans.back();
+    }
+    TestFramework::assert_true(PlatformFile::write_file_binary(path, spans) && read() == expected, "Binary spans");
+    
+    PlatformFile::write_file(path, std::string("one\r\ntwo\n"), LineEnding::LF);
+    TestFramework::assert_equal(std::string("one\ntwo\n"), read(), "String write converts too");
+    PlatformFile::delete_file(path);
+}
+
+void test_piece_table_background_index() {
+    std::string path = editor::PlatformFile::join_path(editor::PlatformFile::get_temp_directory(),
+                                                       "velocity_background_index_test.txt");
+    std::string content;
+    for (int i = 0; i < 400000; ++i) {
+        content += "log line " + std::to_string(i) + " with some padding text\n";
+    }
+    editor::PlatformFile::write_file(path, content, editor::LineEnding::LF);
+    {
+        auto mapping = editor::PlatformFile::map_file(path);
+        PieceTable doc(mapping, PieceTable::LineIndexing::Background);
+        PieceTable reference(content);
+        TestFramework::assert_true(doc.is_indexing(), "Indexing in background");
+        TestFramework::assert_equal(std::string("log line 0 with some padding text"), doc.get_lines_range(0, 1)[0],
+                                    "First screen before indexing completes");
+        // The last indexed line may still be growing: neither reader starts on it
+        std::string_view partial;
+        size_t indexed = doc.get_indexed_line_count();
+        TestFramework::assert_true(!doc.is_indexing() || !doc.lines(indexed).next(partial),
+                                   "Line cursor stops where get_line does");
+        
+        // Edits on both sides of the indexing frontier
+        size_t tail = content.size() - 10;
+        for (PieceTable* d : {&doc, &reference}) {
+            d->insert(0, "head\n");
+            d->remove(20, 100);
+            d->insert(tail, "tail\nmore\n");
+        }
+        // Unindexed text cut from the end and pasted before the frontier
+        for (PieceTable* d : {&doc, &reference}) {
+            size_t from = d->get_total_length() - 500000;
+            PieceTable::Span cut = d->get_span(from, 300000);
+            d->remove(from, 300000);
+            d->insert_span(10, cut);
+        }
+        // A snapshot taken mid-indexing counts the rest itself
+        std::shared_ptr<const DocumentSnapshot> snap = doc.snapshot();
+        while (doc.is_indexing()) {
+            doc.poll_line_index();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        TestFramework::assert_equal(reference.get_line_count(), doc.get_line_count(), "Line count after indexing");
+        for (size_t line : {size_t(0), size_t(1), size_t(123456), reference.get_line_count() - 3}) {
+            TestFramework::assert_equal(reference.get_line(line), doc.get_line(line), "Line " + std::to_string(line));
+        }
+        TestFramework::assert_equal(reference.get_line_count(), snap->get_line_count(), "Snapshot line count");
+        TestFramework::assert_equal(reference.get_line(123456), snap->get_line(123456), "Snapshot line");
+    }
+    editor::PlatformFile::delete_file(path);
+}
+
+void test_piece_table_snapshot() {
+    std::string content;
+    for (int i = 0; i < 2000; ++i) {
+        content += "line " + std::to_string(i) + "\r\n";
+    }
+    auto doc = std::make_unique<PieceTable>(content);
+    doc->insert(0, "first\n");
+    std::shared_ptr<const DocumentSnapshot> snap = doc->snapshot();
+    std::string expected = doc->get_text(0, doc->get_total_length());
+    TestFramework::assert_equal(doc->get_version(), snap->get_version(), "Snapshot version");
+    
+    // Read on another thread while the table keeps changing; the typing runs
+    // well past one add buffer chunk
+    bool reader_ok = true;
+    std::thread reader([&]() {
+        for (int pass = 0; pass < 20; ++pass) {
+            std::string text;
+            for (size_t pos = 0; pos < snap->get_total_length();) {
+                std::string_view chunk = snap->chunk_at(pos);
+                text.append(chunk.data(), chunk.size());
+                pos += chunk.size();
+            }
+            if (text != expected || snap->get_line(1000) != "line 999") reader_ok = false;
+        }
+    });
+    for (int i = 0; i < 20000; ++i) {
+        doc->insert((i * 7919) % doc->get_total_length(), "abcd\n");
+        if (i % 3 == 0) doc->remove((i * 104729) % doc->get_total_length(), 3);
+    }
+    reader.join();
+    TestFramework::assert_true(reader_ok, "Concurrent reads see the snapshot version");
+    TestFramework::assert_true(doc->get_version() > snap->get_version(), "Edits advance the version");
+    
+    std::shared_ptr<const DocumentSnapshot> later = doc->snapshot();
+    std::string current = doc->get_text(0, doc->get_total_length());
+    PieceTable reference(current);
+    TestFramework::assert_equal(current, later->get_text(), "Later snapshot text");
+    TestFramework::assert_equal(reference.get_line_count(), later->get_line_count(), "Later snapshot line count");
+    for (size_t line : {size_t(0), size_t(1), size_t(5000), reference.get_line_count() - 1}) {
+        TestFramework::assert_equal(reference.get_line(line), later->get_line(line), "Snapshot line " + std::to_string(line));
+        TestFramework::assert_equal(reference.get_line_start(line), later->get_line_start(line), "Snapshot line start");
+    }
+    
+    // Snapshots outlive the table
+    doc.reset();
+    TestFramework::assert_equal(expected, snap->get_text(), "Snapshot after table destroyed");
+    TestFramework::assert_equal(std::string("first"), snap->get_line(0), "First line after table destroyed");
+}
+
+// ============================================================================
+// UNIT TESTS - RopeTable
+// ============================================================================
+
+void test_rope_table_matches_piece_table() {
+    // Differential test against PieceTable, with edits large enough to
+    // split and merge many leaves
+    std::mt19937 rng(777);
+    std::string initial;
+    for (int i = 0; i < 3000; ++i) initial += "row " + std::to_string(i) + "\r\n";
+    RopeTable rope(initial);
+    PieceTable doc(initial);
+    
+    for (int i = 0; i < 3000; ++i) {
+        size_t len = doc.get_total_length();
+        if (rng() % 3 != 0 || len == 0) {
+            size_t pos = rng() % (len + 1);
+            std::string text = (rng() % 10 == 0) ? std::string(1 + rng() % 3000, 'x') + "\n"
+                                                 : std::string(1 + rng() % 5, char('a' + rng() % 26));
+            rope.insert(pos, text);
+            doc.insert(pos, text);
+        } else {
+            size_t pos = rng() % len;
+            size_t count = 1 + rng() % ((rng() % 10 == 0) ? 5000 : 8);
+            rope.remove(pos, count);
+            doc.remove(pos, count);
+        }
+    }
+    
+    TestFramework::assert_equal(doc.get_text(0, doc.get_total_length()), rope.get_text(0, rope.get_total_length()),
+                                "Text after random edits");
+    TestFramework::assert_equal(doc.get_line_count(), rope.get_line_count(), "Line count");
+    for (size_t line = 0; line < doc.get_line_count(); line += 37) {
+        TestFramework::assert_equal(doc.get_line(line), rope.get_line(line), "Line " + std::to_string(line));
+        TestFramework::assert_equal(doc.get_line_start(line), rope.get_line_start(line), "Line start");
+    }
+    for (size_t pos = 0; pos < doc.get_total_length(); pos += 1009) {
+        TestFramework::assert_equal(doc.get_line_at(pos), rope.get_line_at(pos), "Line at offset");
+    }
+    TestFramework::assert_true(doc.get_lines_range(100, 50) == rope.get_lines_range(100, 50), "Lines range");
+    
+    // AVL height bound and no leaf slivers
+    size_t leaves = rope.get_leaf_count();
+    TestFramework::assert_true(rope.get_height() <= 1.45 * std::log2(double(leaves) + 2) + 2, "Rope stays balanced");
+    TestFramework::assert_true(leaves <= rope.get_total_length() / RopeTable::kMinLeaf + 1, "Leaves kept above minimum size");
+}
+
+void test_rope_table_snapshots_and_undo() {
+    RopeTable rope("hello\nworld\n");
+    RopeTable snapshot = rope;  // O(1), shares every node
+    rope.insert(5, ", there");
+    rope.remove(0, 1);
+    TestFramework::assert_equal(std::string("ello, there\nworld\n"), rope.get_text(0, rope.get_total_length()), "Edited");
+    TestFramework::assert_equal(std::string("hello\nworld\n"), snapshot.get_text(0, snapshot.get_total_length()),
+                                "Copy unaffected by later edits");
+    rope.undo();
+    TestFramework::assert_equal(std::string("hello, there"), rope.get_line(0), "Undo remove");
+    rope.undo();
+    TestFramework::assert_equal(std::string("hello"), rope.get_line(0), "Undo insert");
+    TestFramework::assert_true(!rope.can_undo(), "History exhausted");
+    rope.redo();
+    TestFramework::assert_equal(std::string("hello, there"), rope.get_line(0), "Redo");
+}
+
+// ============================================================================
+// UNIT TESTS - TextBuffer backends
+// ============================================================================
+
+void test_text_buffer_backends_agree() {
+    // Same edit script through the interface; every backend must agree
+    std::string initial = "one\r\ntwo\nthree";
+    std::vector<std::shared_ptr<TextBuffer>> buffers;
+    for (TextBufferBackend backend : {TextBufferBackend::GapBuffer, TextBufferBackend::PieceTable, TextBufferBackend::Rope}) {
+        buffers.push_back(TextBuffer::create(initial, backend));
+        TestFramework::assert_true(buffers.back()->backend() == backend, TextBuffer::backend_name(backend));
+    }
+    std::mt19937 rng(99);
+    for (int i = 0; i < 1500; ++i) {
+        size_t len = buffers[0]->get_total_length();
+        bool do_insert = rng() % 3 != 0 || len == 0;
+        size_t pos = rng() % (len + (do_insert ? 1 : 0));
+        std::string text = (rng() % 4 == 0) ? "\n" : std::string(1 + rng() % 6, char('a' + rng() % 26));
+        size_t count = 1 + rng() % 10;
+        for (auto& buffer : buffers) {
+            if (do_insert) buffer->insert(pos, text);
+            else buffer->remove(pos, count);
+        }
+    }
+    const TextBuffer& reference = *buffers[1];
+    for (const auto& buffer : buffers) {
+        std::string name = TextBuffer::backend_name(buffer->backend());
+        TestFramework::assert_equal(reference.get_text(0, reference.get_total_length()),
+                                    buffer->get_text(0, buffer->get_total_length()), name + " text");
+        TestFramework::assert_equal(reference.get_line_count(), buffer->get_line_count(), name + " line count");
+        TestFramework::assert_true(reference.get_lines_range(0, 1000) == buffer->get_lines_range(0, 1000), name + " lines");
+        for (size_t pos = 0; pos <= reference.get_total_length(); pos += 13) {
+            TestFramework::assert_equal(reference.get_line_at(pos), buffer->get_line_at(pos), name + " line at");
+        }
+        size_t last = reference.get_line_count() - 1;
+        TestFramework::assert_equal(reference.get_line_start(last), buffer->get_line_start(last), name + " line start");
+    }
+}
+
+void test_text_buffer_selection() {
+    TestFramework::assert_true(TextBuffer::choose_backend(1000) == TextBufferBackend::GapBuffer, "Small file gets gap buffer");
+    TestFramework::assert_true(TextBuffer::choose_backend(TextBuffer::kSmallFileLimit) == TextBufferBackend::PieceTable,
+                               "Large file gets piece table");
+    
+    TabManager tabs;
+    tabs.new_tab("small\nfile\n", "small.txt");
+    TestFramework::assert_true(tabs.get_active_tab()->document->backend() == TextBufferBackend::GapBuffer, "Auto tab backend");
+    TestFramework::assert_true(tabs.get_active_tab()->piece_table() == nullptr, "No piece table behind a gap buffer");
+    tabs.new_tab("text", "big.log", TextBufferBackend::PieceTable);
+    TestFramework::assert_true(tabs.get_active_tab()->piece_table() != nullptr, "Explicit piece table tab");
+    TabManager piece_tabs(TextBufferBackend::PieceTable);
+    TestFramework::assert_true(piece_tabs.get_active_tab()->piece_table() != nullptr, "Manager default backend");
+    
+    // Views work on any backend
+    Viewport viewport(2, 80);
+    viewport.set_document(tabs.get_tab(1)->document);
+    viewport.scroll_to_line(1);
+    std::vector<std::string> visible = viewport.get_visible_lines();
+    TestFramework::assert_equal(size_t(2), visible.size(), "Visible lines from gap buffer");
+    TestFramework::assert_equal(std::string("file"), visible[0], "Scrolled line");
+}
+
+void test_hex_buffer() {
+    std::string bytes = "Hello world\n";
+    bytes.append(4, '\0');
+    bytes += "\xde\xad\xbe\xef tail";
+    HexBuffer hex(bytes);
+    TestFramework::assert_equal(size_t(2), hex.get_line_count(), "Sixteen bytes a row");
+    TestFramework::assert_equal(std::string("00000000  48 65 6c 6c 6f 20 77 6f  72 6c 64 0a 00 00 00 00  |Hello world.....|"),
+                                hex.get_line(0), "hexdump -C layout");
+    TestFramework::assert_equal(std::string("00000010  de ad be ef 20 74 61 69  6c                       |.... tail       |"),
+                                hex.get_line(1), "Short last row padded to the width");
+
+    // Rows are addressed by arithmetic, and views read them like any buffer
+    size_t stride = hex.row_width() + 1;
+    TestFramework::assert_equal(stride, hex.get_line_start(1), "Fixed stride");
+    TestFramework::assert_equal(size_t(1), hex.get_line_at(stride + 5), "Line of a position");
+    TestFramework::assert_equal(hex.get_line(0) + "\n" + hex.get_line(1), hex.get_text(0, hex.get_total_length()),
+                                "Text is the rows");
+    Viewport viewport(10, 200);
+    viewport.set_document(std::shared_ptr<TextBuffer>(TextBuffer::create(bytes, TextBufferBackend::Hex)));
+    TestFramework::assert_equal(hex.get_line(1), viewport.get_visible_lines()[1], "Viewport shows hex rows");
+
+    uint64_t byte = 0;
+    size_t digits = hex.row_width() - 70;     // Offset column
+    TestFramework::assert_true(hex.byte_at_position(hex.position_of_byte(19), byte) && byte == 19, "Byte under its digits");
+    TestFramework::assert_true(hex.byte_at_position(stride + digits + 53 + 2, byte) && byte == 18, "Byte under its character");
+    TestFramework::assert_true(!hex.byte_at_position(digits + 2 + 24, byte), "Gap between the halves");
+
+    // Overwrites are patches over the bytes; undo and redo step through them
+    std::string pattern;
+    TestFramework::assert_true(HexBuffer::parse_hex("DE ad BEef", pattern) && pattern == "\xde\xad\xbe\xef", "Hex parsed");
+    std::string rejected;
+    TestFramework::assert_true(!HexBuffer::parse_hex("abc", rejected) && !HexBuffer::parse_hex("a b", rejected),
+                               "Odd digits rejected");
+    TestFramework::assert_equal(size_t(16), size_t(hex.find(pattern)), "Pattern found");
+    TestFramework::assert_true(hex.overwrite(17, std::string(1, '\0')), "Overwrite");
+    TestFramework::assert_true(!hex.overwrite(24, "long"), "Overwrite past the end refused");
+    TestFramework::assert_true(hex.find(pattern) == HexBuffer::npos, "Patch breaks the match");
+    hex.overwrite(2, "\xde\xad\xbe\xef");
+    TestFramework::assert_equal(size_t(5), hex.patch_count(), "One patch per changed byte");
+    TestFramework::assert_equal(size_t(2), size_t(hex.find(pattern)), "Patch makes a match");
+    TestFramework::assert_equal(bytes.size(), size_t(hex.byte_count()), "Length unchanged");
+    hex.undo();
+    hex.undo();
+    TestFramework::assert_equal(size_t(0), hex.patch_count(), "Undo drops the patches");
+    hex.redo();
+    TestFramework::assert_equal(std::string("00000010  de 00 be ef"), hex.get_line(1).substr(0, 21), "Redo");
+
+    // Patches go into the file in place and the mapping shows them
+    using editor::PlatformFile;
+    std::string path = PlatformFile::join_path(PlatformFile::get_temp_directory(), "velocity_hex_buffer.bin");
+    std::ofstream(path, std::ios::binary).write(bytes.data(), bytes.size());
+    auto mapped = HexBuffer::open(path);
+    TestFramework::assert_true(mapped && HexBuffer::looks_binary(bytes.data(), bytes.size()), "Mapped binary");
+    mapped->overwrite(0, "J");
+    TestFramework::assert_true(mapped->write_patches(path), "Patches written");
+    std::vector<uint8_t> written;
+    PlatformFile::read_file_binary(path, written);
+    TestFramework::assert_true(written.size() == bytes.size() && written[0] == 'J' && written[1] == 'e', "File patched in place");
+    TestFramework::assert_equal(size_t(0), mapped->patch_count(), "Mapping shows the written bytes");
+    mapped.reset();
+    PlatformFile::delete_file(path);
+}
+
+void test_viewport_skips_folds() {
+    // 10k four-line functions, all folded: each shows only its header
+    std::string text;
+    for (int i = 0; i < 10000; ++i) text += "void f() {\n  a();\n  b();\n}\n";
+    auto doc = std::make_shared<PieceTable>(text);
+    CodeFoldingManager folding;
+    folding.set_document(doc);
+    folding.fold_all();
+    
+    Viewport viewport(5, 80);
+    viewport.set_document(doc);
+    viewport.set_folding(&folding);
+    TestFramework::assert_equal(size_t(10001), viewport.get_display_line_count(), "Headers and the last line");
+    
+    std::vector<std::string> visible = viewport.get_visible_lines();
+    std::vector<size_t> numbers = viewport.get_visible_line_numbers();
+    TestFramework::assert_equal(size_t(5), visible.size(), "Screen stays full");
+    std::vector<size_t> expected = {0, 4, 8, 12, 16};
+    TestFramework::assert_true(numbers == expected, "Rows skip folded lines");
+    TestFramework::assert_equal(std::string("void f() {"), visible[1], "Next header follows");
+    
+    viewport.scroll_down(3);
+    TestFramework::assert_equal(size_t(12), viewport.get_top_line(), "Scrolling counts display lines");
+    TestFramework::assert_equal(size_t(2), viewport.row_of_line(20), "Row of a document line");
+    TestFramework::assert_equal(size_t(20), viewport.document_line_at(2), "Document line of a row");
+    
+    viewport.scroll_to_line(39998);
+    TestFramework::assert_equal(size_t(9996), viewport.get_top_display_line(), "Clamped to the last screen");
+    folding.unfold(viewport.get_top_line());
+    TestFramework::assert_equal(size_t(5), viewport.get_visible_lines().size(), "Unfolded run read");
+}
+
+void test_document_view_shares_document() {
+    std::string text;
+    for (int i = 0; i < 100; ++i) text += "void f() {\n  a();\n}\n";
+    auto doc = std::make_shared<PieceTable>(text);
+    DocumentView left(10, 80), right(10, 80);
+    left.set_document(doc);
+    right.set_document(doc);
+    TestFramework::assert_true(left.document() == right.document(), "One document, two views");
+    
+    // The right view sits further down with a selection
+    right.viewport().scroll_to_line(30);
+    right.cursor_pos = doc->get_line_start(31) + 2;
+    right.has_selection = true;
+    right.selection_start = doc->get_line_start(30);
+    right.selection_end = right.cursor_pos;
+    right.extra_cursors = {doc->get_line_start(40)};
+    
+    // Two lines typed through the left view, above the right one
+    left.cursor_pos = doc->get_line_start(3);
+    doc->insert(left.cursor_pos, "// one\n// two\n");
+    left.cursor_pos += 14;
+    left.update();
+    right.update();
+    TestFramework::assert_equal(size_t(32), right.viewport().get_top_line(), "Top line stays on its text");
+    TestFramework::assert_equal(std::string("  a();"), doc->get_line(doc->get_line_at(right.cursor_pos)),
+                                "Cursor moved with its text");
+    TestFramework::assert_equal(doc->get_line_start(32), right.selection_start, "Selection moved");
+    TestFramework::assert_equal(doc->get_line_start(42), right.extra_cursors[0], "Extra cursor moved");
+    TestFramework::assert_equal(size_t(0), left.viewport().get_top_line(), "Left view keeps its scroll");
+    
+    size_t first = 0, last = 0;
+    TestFramework::assert_true(right.take_damage(first, last) && first == 3 && last == SIZE_MAX,
+                               "Lines added: everything below is damaged");
+    doc->insert(doc->get_line_start(50), "x");
+    TestFramework::assert_true(right.take_damage(first, last) && first == 50 && last == 50, "Edit within a line");
+    TestFramework::assert_true(!right.take_damage(first, last), "Damage taken once");
+    
+    // Removing the right view's top line leaves it on the line the removal left
+    doc->remove(doc->get_line_start(31), doc->get_line_start(33) - doc->get_line_start(31));
+    right.update();
+    TestFramework::assert_equal(size_t(31), right.viewport().get_top_line(), "Removed top line");
+    
+    // Folds belong to the view that made them
+    right.folding().fold_all();
+    TestFramework::assert_true(right.folding().has_folds() && !left.has_folding(), "Folds per view");
+    TestFramework::assert_true(left.viewport().get_display_line_count() == doc->get_line_count() &&
+                               right.viewport().get_display_line_count() < doc->get_line_count(),
+                               "Only the folding view hides lines");
+    doc->insert(0, "// top\n");
+    TestFramework::assert_true(right.folding().has_folds(), "Folds follow shared edits");
+    
+    // A view dropped first leaves the document to the other
+    {
+        DocumentView temporary;
+        temporary.set_document(doc);
+    }
+    size_t before = left.cursor_pos;
+    doc->insert(0, "x");
+    TestFramework::assert_equal(before + 1, left.cursor_pos, "Remaining view still follows");
+}
+
+void test_lsp_document_sync() {
+    using editor::LspContentChange;
+    using editor::LspDocumentSync;
+    using editor::PositionEncoding;
+    auto doc = std::make_shared<PieceTable>("int main() {\n  r\xC3\xA9sultat = 1;\n}\n");
+    LspDocumentSync sync;
+    sync.set_document(doc, "file:///main.cpp");
+    sync.set_debounce(std::chrono::milliseconds(100), std::chrono::milliseconds(400));
+    std::vector<LspContentChange> changes;
+    
+    // Typing and a backspace after "  r\xC3\xA9sultat" (11 bytes, 10 UTF-16 units)
+    doc->insert(24, "x");
+    doc->insert(25, "y");
+    doc->insert(26, "z");
+    doc->remove(26, 1);
+    auto now = LspDocumentSync::Clock::now();
+    TestFramework::assert_true(sync.has_pending() && !sync.due(now + std::chrono::milliseconds(50)), "Debounced");
+    TestFramework::assert_true(sync.due(now + std::chrono::milliseconds(150)), "Due after the quiet period");
+    TestFramework::assert_true(sync.take(changes) && changes.size() == 1, "Burst coalesced");
+    TestFramework::assert_true(!changes[0].full && changes[0].start_line == 1 && changes[0].start_character == 10 &&
+                               changes[0].end_character == 10, "Insert position in UTF-16 units");
+    TestFramework::assert_equal(std::string("xy"), changes[0].text, "Coalesced text");
+    TestFramework::assert_true(!sync.has_pending(), "Taken");
+    
+    // Replacing "{\n  r\xC3\xA9" is a removal plus an insert, sent as one change
+    doc->remove(11, 7);
+    doc->insert(11, "X");
+    sync.take(changes);
+    TestFramework::assert_equal(size_t(1), changes.size(), "Replacement coalesced");
+    TestFramework::assert_true(changes[0].start_line == 0 && changes[0].start_character == 11 &&
+                               changes[0].end_line == 1 && changes[0].end_character == 4, "Removed range across lines");
+    TestFramework::assert_equal(std::string("X"), changes[0].text, "Replacement text");
+    
+    sync.set_encoding(PositionEncoding::Utf8);
+    doc->insert(0, "\xC3\xA9\n");
+    doc->remove(12, 5);
+    sync.take(changes);
+    TestFramework::assert_equal(size_t(2), changes.size(), "Separate edits stay separate");
+    TestFramework::assert_true(changes[1].start_line == 1 && changes[1].start_character == 9 &&
+                               changes[1].end_line == 1 && changes[1].end_character == 14, "Byte columns in UTF-8");
+    
+    // Scattered edits past the limit collapse to the full text
+    for (size_t i = 0; i <= LspDocumentSync::kMaxChanges; ++i) {
+        doc->insert((i % 2) ? 0 : doc->get_total_length(), "a");
+    }
+    sync.take(changes);
+    TestFramework::assert_true(changes.size() == 1 && changes[0].full, "Collapsed to full text");
+    TestFramework::assert_equal(doc->get_text(0, doc->get_total_length()), changes[0].text, "Full text is current");
+}
+
+void test_lsp_framing() {
+    using editor::LspFraming;
+    auto frame = [](const std::string& body) {
+        return "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    };
+    std::string stream = frame("{\"id\":1}") + "content-length:3\r\nContent-Type: x\r\n\r\nabc" +
+                         "X-Other: 1\r\n\r\n" + frame(std::string(100000, 'z'));
+    
+    // Delivered in awkward slices: messages and headers split across reads
+    LspFraming framing;
+    std::vector<std::string> messages;
+    std::string message;
+    for (size_t i = 0; i < stream.size(); i += 7) {
+        framing.feed(stream.data() + i, (std::min)(size_t(7), stream.size() - i));
+        while (framing.next(message)) messages.push_back(message);
+    }
+    TestFramework::assert_equal(size_t(3), messages.size(), "All messages decoded");
+    TestFramework::assert_equal(std::string("{\"id\":1}"), messages[0], "First body");
+    TestFramework::assert_equal(std::string("abc"), messages[1], "Header name is case-insensitive");
+    TestFramework::assert_equal(size_t(100000), messages[2].size(), "Large body; header without a length skipped");
+    TestFramework::assert_equal(size_t(0), framing.buffered(), "Nothing left over");
+    
+    // One big read holding a burst
+    std::string burst;
+    for (int i = 0; i < 1000; ++i) burst += frame("{\"n\":" + std::to_string(i) + "}");
+    size_t count = 0;
+    char* block = framing.prepare(burst.size());
+    std::copy(burst.begin(), burst.end(), block);
+    framing.commit(burst.size());
+    while (framing.next(message)) ++count;
+    TestFramework::assert_equal(size_t(1000), count, "Burst from one read");
+    
+    // Reader and UI threads through the queue; pushes wait while it is full
+    editor::SpscQueue<std::string> queue(8);
+    const int total = 20000;
+    std::thread producer([&queue] {
+        for (int i = 0; i < total; ++i) {
+            std::string value = std::to_string(i);
+            while (!queue.try_push(std::move(value))) std::this_thread::yield();
+        }
+    });
+    int expected = 0;
+    bool in_order = true;
+    std::string value;
+    while (expected < total) {
+        if (!queue.try_pop(value)) continue;
+        in_order = in_order && value == std::to_string(expected);
+        ++expected;
+    }
+    producer.join();
+    TestFramework::assert_true(in_order && queue.empty(), "Queue delivers every message in order");
+}
+
+void test_lsp_peek_message_head() {
+    editor::MessageHead head;
+    TestFramework::assert_true(editor::peek_message_head("{\"id\":42,\"jsonrpc\":\"2.0\",\"result\":null}", head) &&
+                               head.is_response() && head.id == 42, "Id of a response");
+    editor::peek_message_head(
+        "{ \"jsonrpc\": \"2.0\", \"result\": {\"items\": [{\"label\": \"}\\\"id\\\":1\"}], \"id\": 5}, \"id\": 7 }", head);
+    TestFramework::assert_true(head.is_response() && head.id == 7, "Nested and quoted ids are skipped");
+    editor::peek_message_head("{\"id\":3,\"method\":\"workspace/configuration\"}", head);
+    TestFramework::assert_true(!head.is_response() && head.method == "workspace/configuration", "Server request is not a response");
+    editor::peek_message_head("{\"params\":{\"method\":\"x\"},\"method\":\"textDocument/publishDiagnostics\"}", head);
+    TestFramework::assert_true(!head.has_id && head.method == "textDocument/publishDiagnostics", "Notification method");
+    editor::peek_message_head("{\"id\":\"abc\",\"result\":1}", head);
+    TestFramework::assert_true(!head.has_id, "String ids are not ours");
+}
+
+void test_lsp_streaming_decode() {
+    std::string completion = "{\"id\":9,\"jsonrpc\":\"2.0\",\"result\":{\"isIncomplete\":false,\"items\":["
+        "{\"label\":\"push_back\",\"kind\":2,\"detail\":\"void\",\"textEdit\":{\"newText\":\"x\",\"range\":{}},"
+        "\"documentation\":{\"kind\":\"markdown\",\"value\":\"Adds\"}},"
+        "{\"insertText\":\"size()\",\"label\":\"size\",\"data\":[{\"label\":\"nested\"}]}]}}";
+    std::vector<editor::LspCompletionItem> items;
+    TestFramework::assert_true(editor::decode_completion_response(completion, items) && items.size() == 2, "Completion list");
+    TestFramework::assert_true(items[0].label == "push_back" && items[0].kind == 2 && items[0].detail == "void" &&
+                               items[0].documentation == "Adds" && items[0].insertText == "push_back", "Item fields");
+    TestFramework::assert_equal(std::string("size()"), items[1].insertText, "insertText before label");
+    TestFramework::assert_equal(std::string("size"), items[1].label, "Nested members skipped");
+    TestFramework::assert_true(editor::decode_completion_response("{\"id\":1,\"result\":[{\"label\":\"a\"}]}", items) &&
+                               items.size() == 1, "Bare item array");
+    TestFramework::assert_true(!editor::decode_completion_response("{\"id\":1,\"error\":{\"code\":-32800}}", items),
+                               "Error response has no result");
+    TestFramework::assert_true(!editor::decode_completion_response("{\"id\":1,\"result\":[", items) && items.empty(),
+                               "Truncated body rejected");
+    
+    std::string diagnostics = "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{"
+        "\"uri\":\"file:///a.cpp\",\"version\":3,\"diagnostics\":[{\"range\":{\"start\":{\"line\":4,\"character\":2},"
+        "\"end\":{\"line\":4,\"character\":9}},\"severity\":2,\"code\":\"unused\",\"source\":\"clangd\","
+        "\"message\":\"unused variable\",\"relatedInformation\":[{\"message\":\"other\"}]}]}}";
+    std::string uri;
+    std::vector<editor::LspDiagnostic> diags;
+    TestFramework::assert_true(editor::decode_publish_diagnostics(diagnostics, uri, diags) && diags.size() == 1, "Diagnostics");
+    TestFramework::assert_equal(std::string("file:///a.cpp"), uri, "Diagnostics uri");
+    const editor::LspDiagnostic& d = diags[0];
+    TestFramework::assert_true(d.range.start.line == 4 && d.range.start.character == 2 && d.range.end.character == 9 &&
+                               d.severity == 2 && d.source == "clangd" && d.message == "unused variable", "Diagnostic fields");
+}
+
+void test_lsp_document_message() {
+    std::string escaped;
+    editor::append_json_escaped("a\"b\\c\n\t\x01", escaped);
+    TestFramework::assert_equal(std::string("a\\\"b\\\\c\\n\\t\\u0001"), escaped, "Escapes");
+    TestFramework::assert_equal(escaped.size(), editor::json_escaped_length("a\"b\\c\n\t\x01"), "Escaped length");
+    
+    PieceTable small("int x = \"y\";\n");
+    auto open = editor::LspDocumentMessage::did_open("file:///a \"b\".cpp", "cpp", 1, small);
+    std::string framed;
+    auto into = [&framed](const char* data, size_t size) {
+        framed.append(data, size);
+        return true;
+    };
+    TestFramework::assert_true(open.write(into), "Written");
+    editor::LspFraming framing;
+    framing.feed(framed.data(), framed.size());
+    std::string body;
+    TestFramework::assert_true(framing.next(body) && framing.buffered() == 0, "Content-Length matches the body");
+    TestFramework::assert_equal(std::string("{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didOpen\",\"params\":"
+                                            "{\"textDocument\":{\"uri\":\"file:///a \\\"b\\\".cpp\",\"languageId\":\"cpp\","
+                                            "\"version\":1,\"text\":\"int x = \\\"y\\\";\\n\"}}}"), body, "didOpen body");
+    
+    // A document of many pieces, larger than a block: written in blocks,
+    // the same bytes as escaping its text at once
+    PieceTable large;
+    std::string line = "\tline \"quoted\" \\ end\r\n";
+    for (int i = 0; i < 20000; ++i) large.insert(large.get_total_length() / 2, line);
+    auto change = editor::LspDocumentMessage::full_change("file:///big.txt", 7, large);
+    std::string expected = "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\",\"params\":{\"textDocument\":"
+                           "{\"uri\":\"file:///big.txt\",\"version\":7},\"contentChanges\":[{\"text\":\"";
+    editor::append_json_escaped(large.get_text(0, large.get_total_length()), expected);
+    expected += "\"}]}}";
+    body.clear();
+    size_t writes = 0, largest = 0;
+    TestFramework::assert_true(change.write([&](const char* data, size_t size) {
+        body.append(data, size);
+        ++writes;
+        largest = (std::max)(largest, size);
+        return true;
+    }, false), "Large document written");
+    TestFramework::assert_true(body == expected && change.body_length() == expected.size(), "Streamed body");
+    TestFramework::assert_true(writes > 5 && largest < 2 * editor::LspDocumentMessage::kBlockSize, "Written in blocks");
+    writes = 0;
+    TestFramework::assert_true(!change.write([&writes](const char*, size_t) { return ++writes > 2; }) && writes == 1,
+                               "A refused write stops it");
+}
+
+void test_lsp_io_reactor() {
+    using editor::LspIoReactor;
+    // Two fake servers on one reactor thread; reads hand out what was
+    // "written" so far, and -1 once the server has "exited"
+    struct FakePipe {
+        std::mutex mutex;
+        std::string data;
+        bool exited = false;
+        long long read(char* buffer, size_t size) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (data.empty()) return exited ? -1 : 0;
+            size_t n = (std::min)(size, data.size());
+            std::copy(data.begin(), data.begin() + n, buffer);
+            data.erase(0, n);
+            return (long long)n;
+        }
+        void write(const std::string& body, bool exit = false) {
+            std::lock_guard<std::mutex> lock(mutex);
+            data += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+            exited = exit;
+        }
+    };
+    FakePipe a, b;
+    auto wait_for = [](const std::function<bool()>& done) {
+        for (int i = 0; i < 2000 && !done(); ++i) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return done();
+    };
+    
+    LspIoReactor reactor;
+    auto channel_a = reactor.add_channel([&a](char* buffer, size_t size) { return a.read(buffer, size); });
+    auto channel_b = reactor.add_channel([&b](char* buffer, size_t size) { return b.read(buffer, size); });
+    TestFramework::assert_equal(size_t(2), reactor.channel_count(), "Channels share the reactor");
+    
+    // More messages than the inbox holds: the overflow waits, nothing is lost
+    const size_t burst = channel_a->inbox.capacity() + 100;
+    for (size_t i = 0; i < burst; ++i) a.write(std::to_string(i));
+    b.write("from b", true);
+    std::string message;
+    size_t received = 0;
+    bool in_order = true;
+    wait_for([&] {
+        while (channel_a->inbox.try_pop(message)) in_order = in_order && message == std::to_string(received++);
+        return received == burst;
+    });
+    TestFramework::assert_true(received == burst && in_order, "Burst delivered in order past a full inbox");
+    TestFramework::assert_true(wait_for([&] { return channel_b->closed.load(); }), "Exit detected");
+    TestFramework::assert_true(channel_b->inbox.try_pop(message) && message == "from b", "Output before exit kept");
+    TestFramework::assert_true(!channel_a->closed, "Other server unaffected");
+    
+    std::atomic<int> polls{0};
+    reactor.add_task([&polls](bool finish) { return finish || ++polls == 3; });
+    TestFramework::assert_true(wait_for([&] { return polls == 3; }), "Tasks polled until done");
+    
+    reactor.remove_channel(channel_a);
+    a.write("late");
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    TestFramework::assert_true(!channel_a->inbox.try_pop(message), "Removed channel no longer read");
+    TestFramework::assert_equal(size_t(1), reactor.channel_count(), "One channel left");
+}
+
+void test_git_status_worker() {
+    using editor::GitStatusWorker;
+    using editor::GitStatusEntry;
+    std::vector<GitStatusEntry> entries;
+    const char porcelain[] = " M src/a.cpp\0R  new.h\0old.h\0?? notes dir/x.txt\0";
+    GitStatusWorker::parse_porcelain(std::string(porcelain, sizeof(porcelain) - 1), entries);
+    TestFramework::assert_equal(size_t(3), entries.size(), "Rename's old path skipped");
+    TestFramework::assert_true(entries[0].worktree == 'M' && entries[0].path == "src/a.cpp", "Modified entry");
+    TestFramework::assert_true(entries[1].index == 'R' && entries[1].path == "new.h", "Rename keeps new path");
+    TestFramework::assert_true(entries[2].index == '?' && entries[2].path == "notes dir/x.txt", "Spaces kept unquoted");
+    
+    // The first query is held open so later requests pile up behind it
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool release = false;
+    std::vector<std::vector<std::string>> runs;
+    std::atomic<int> ready{0};
+    GitStatusWorker worker(
+        [&](const std::vector<std::string>& pathspecs, std::string& output) {
+            std::unique_lock<std::mutex> lock(mutex);
+            runs.push_back(pathspecs);
+            cv.notify_all();
+            cv.wait(lock, [&] { return release; });
+            for (const auto& path : pathspecs) output += std::string(" M ") + path + '\0';
+            return true;
+        },
+        [&ready] { ++ready; });
+    
+    worker.request_paths({"a.txt"});
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return runs.size() == 1; });
+    }
+    worker.request_paths({"b.txt", "c.txt"});
+    worker.request_paths({"b.txt", "d.txt"});
+    TestFramework::assert_true(worker.busy(), "Busy while a query runs");
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        release = true;
+    }
+    cv.notify_all();
+    worker.wait_idle();
+    TestFramework::assert_equal(size_t(2), runs.size(), "Requests during a query coalesce into one");
+    TestFramework::assert_true(runs[1] == std::vector<std::string>{"b.txt", "c.txt", "d.txt"}, "Paths merged without duplicates");
+    TestFramework::assert_equal(2, ready.load(), "Ready callback per result");
+    
+    GitStatusWorker::Result result;
+    TestFramework::assert_true(worker.take(result) && !result.full && result.entries.size() == 1, "First result");
+    TestFramework::assert_true(worker.take(result) && result.entries.size() == 3 && result.entries[2].path == "d.txt",
+                               "Second result");
+    TestFramework::assert_true(!worker.take(result), "Queue drained");
+    
+    // Too many paths for one command line: the whole tree instead
+    std::vector<std::string> many;
+    for (size_t i = 0; i <= GitStatusWorker::kMaxPaths; ++i) many.push_back("f" + std::to_string(i));
+    worker.request_paths(many);
+    worker.wait_idle();
+    TestFramework::assert_true(worker.take(result) && result.full && runs.back().empty(), "Overflow becomes a full query");
+}
+
+void test_diff_engine() {
+    using editor::DiffEngine;
+    using Hunks = std::vector<DiffEngine::Hunk>;
+    auto letters = [](const std::string& text) { return std::vector<uint64_t>(text.begin(), text.end()); };
+    // The hunks turn old into new, and the lines between them pair up
+    auto applies = [](const std::vector<uint64_t>& from, const std::vector<uint64_t>& to, const Hunks& hunks) {
+        std::vector<uint64_t> rebuilt;
+        size_t i = 0, j = 0;
+        for (const auto& hunk : hunks) {
+            if (hunk.old_start - i != hunk.new_start - j) return false;
+            rebuilt.insert(rebuilt.end(), from.begin() + i, from.begin() + hunk.old_start);
+            rebuilt.insert(rebuilt.end(), to.begin() + hunk.new_start, to.begin() + hunk.new_start + hunk.new_count);
+            i = hunk.old_start + hunk.old_count;
+            j = hunk.new_start + hunk.new_count;
+        }
+        rebuilt.insert(rebuilt.end(), from.begin() + i, from.end());
+        return rebuilt == to;
+    };
+    auto changed = [](const Hunks& hunks) {
+        size_t lines = 0;
+        for (const auto& hunk : hunks) lines += hunk.old_count + hunk.new_count;
+        return lines;
+    };
+
+    Hunks hunks = DiffEngine::diff(letters("abcdef"), letters("abXdefY"));
+    TestFramework::assert_equal(size_t(2), hunks.size(), "Change and append");
+    TestFramework::assert_true(hunks[0].old_start == 2 && hunks[0].old_count == 1 && hunks[0].new_count == 1 &&
+                               hunks[1].old_start == 6 && hunks[1].old_count == 0 && hunks[1].new_count == 1, "Hunk bounds");
+    TestFramework::assert_equal(size_t(6), DiffEngine::map_line(hunks, 7, false), "Past an insertion");
+    TestFramework::assert_equal(size_t(2), DiffEngine::map_line(hunks, 2, true), "Inside a change");
+    TestFramework::assert_true(DiffEngine::hunk_at(hunks, 6, false) == &hunks[1] && !DiffEngine::hunk_at(hunks, 6, true),
+                               "Insertion has no old lines");
+    TestFramework::assert_true(DiffEngine::diff(letters("same"), letters("same")).empty(), "Equal sides");
+    TestFramework::assert_true(applies(letters(""), letters("new"), DiffEngine::diff(letters(""), letters("new"))), "From empty");
+
+    // Snapshots: CRLF and LF lines hash alike
+    PieceTable before("one\r\ntwo\nthree");
+    PieceTable after("one\ntwo\nTHREE\n");
+    hunks = DiffEngine::diff(*before.snapshot(), *after.snapshot());
+    TestFramework::assert_true(hunks.size() == 1 && hunks[0].old_start == 2 && hunks[0].old_count == 1 &&
+                               hunks[0].new_count == 2, "Only the last lines differ");
+
+    // Unique lines with a few edits, diffed on a pool and inline
+    std::mt19937 rng(79);
+    std::vector<uint64_t> from;
+    for (uint64_t line = 0; line < 50000; ++line) from.push_back(line % 7 == 0 ? rng() % 20 : 1000 + line);
+    std::vector<uint64_t> to = from;
+    for (int edit = 0; edit < 200; ++edit) {
+        size_t at = rng() % to.size();
+        switch (edit % 3) {
+            case 0: to.erase(to.begin() + at, to.begin() + (std::min)(to.size(), at + 1 + rng() % 5)); break;
+            case 1: to.insert(to.begin() + at, 5 + rng() % 10, uint64_t(10000000 + edit)); break;
+            default: to[at] = 20000000 + edit; break;
+        }
+    }
+    ThreadPool pool(4);
+    Hunks inline_hunks = DiffEngine::diff(from, to);
+    Hunks pool_hunks = DiffEngine::diff(from, to, &pool);
+    TestFramework::assert_true(applies(from, to, inline_hunks), "Hunks rebuild the new side");
+    TestFramework::assert_true(changed(inline_hunks) < 4000, "Edits found, not the whole file");
+    TestFramework::assert_true(pool_hunks.size() == inline_hunks.size() && changed(pool_hunks) == changed(inline_hunks),
+                               "Pool gives the same diff");
+
+    // Only frequent lines: histogram hands over to Myers
+    std::vector<uint64_t> common;
+    for (int line = 0; line < 3000; ++line) common.push_back(rng() % 3);
+    std::vector<uint64_t> edited = common;
+    edited.erase(edited.begin() + 100, edited.begin() + 110);
+    edited.insert(edited.begin() + 2000, {7, 7, 7});
+    hunks = DiffEngine::diff(common, edited);
+    TestFramework::assert_true(applies(common, edited, hunks) && changed(hunks) <= 13, "Myers keeps the diff minimal");
+}
+
+void test_diff_gutter() {
+    using editor::DiffGutter;
+    auto hashes = [](const std::string& text) {
+        std::vector<uint64_t> lines;
+        DiffGutter::hash_lines(text, lines);
+        return lines;
+    };
+    std::vector<uint64_t> crlf = hashes("one\r\ntwo\r\n");
+    TestFramework::assert_true(crlf == hashes("one\ntwo\n") && crlf.size() == 3, "CRLF lines hash like LF lines");
+    TestFramework::assert_equal(DiffGutter::hash_line("two"), crlf[1], "Whole line and streamed hashes agree");
+    
+    std::vector<GitDiffHunk> hunks;
+    DiffGutter::diff_lines(hashes("a\nb\nc\nd\ne\n"), hashes("a\nB\nc\nnew\nd\n"), hunks);
+    TestFramework::assert_equal(size_t(3), hunks.size(), "Modified, added and deleted hunks");
+    TestFramework::assert_true(hunks[0].type == GitDiffHunk::Type::Modified && hunks[0].start_line == 1 &&
+                               hunks[0].line_count == 1, "Changed line");
+    TestFramework::assert_true(hunks[1].type == GitDiffHunk::Type::Added && hunks[1].start_line == 3, "Inserted line");
+    TestFramework::assert_true(hunks[2].type == GitDiffHunk::Type::Deleted && hunks[2].start_line == 4,
+                               "Deletion marked on the line above it");
+    
+    // HEAD has the file as it was first; blob text is loaded once per id
+    std::atomic<int> blob_loads{0};
+    DiffGutter gutter(
+        [](const std::string& path, std::string& blob_id) {
+            if (path != "tracked.txt") return false;
+            blob_id = "abc123";
+            return true;
+        },
+        [&blob_loads](const std::string&, std::string& text) {
+            ++blob_loads;
+            text = "alpha\nbeta\ngamma\n";
+            return true;
+        });
+    auto document = std::make_shared<PieceTable>("alpha\nbeta\ngamma\n");
+    auto settle = [&gutter] {
+        gutter.update();
+        gutter.wait_idle();
+        gutter.take_results();
+    };
+    gutter.set_document(document, "tracked.txt");
+    settle();
+    TestFramework::assert_true(gutter.hunks().empty(), "Unchanged file has no markers");
+    
+    document->insert(document->get_line_start(1), "inserted\n");
+    document->insert(document->get_line_start(3) + 1, "X");
+    settle();
+    TestFramework::assert_equal(size_t(2), gutter.hunks().size(), "Edits tracked incrementally");
+    TestFramework::assert_true(gutter.hunk_at(1) && gutter.hunk_at(1)->type == GitDiffHunk::Type::Added, "Added line");
+    TestFramework::assert_true(gutter.hunk_at(3) && gutter.hunk_at(3)->type == GitDiffHunk::Type::Modified,
+                               "Edited line");
+    TestFramework::assert_true(gutter.hunk_at(0) == nullptr && gutter.hunk_at(2) == nullptr, "Other lines unmarked");
+    
+    document->remove(document->get_line_start(1), 9);
+    document->remove(document->get_line_start(2) + 1, 1);
+    settle();
+    TestFramework::assert_true(gutter.hunks().empty(), "Undoing the edits clears the markers");
+    
+    document->insert(0, "top\n");
+    gutter.set_document(document, "untracked.txt");
+    settle();
+    TestFramework::assert_true(gutter.hunks().empty(), "Untracked file has no markers");
+    gutter.set_document(document, "tracked.txt");
+    gutter.invalidate_base();
+    settle();
+    TestFramework::assert_true(gutter.hunk_at(0) != nullptr, "Switching back diffs again");
+    TestFramework::assert_equal(1, blob_loads.load(), "Blob hashes cached by id");
+}
+
+void test_blame_cache() {
+    using editor::BlameCache;
+    const std::string first(40, 'a');
+    const std::string second(40, 'b');
+    // Groups in the order git finds them; headers only with a commit's first group
+    const std::string output =
+        second + " 2 2 1\nauthor Bo\nauthor-time 86400\nsummary Second\nfilename f.txt\n" +
+        first + " 1 1 1\nauthor Al\nauthor-time 1700000000\nsummary First\nfilename f.txt\n" +
+        first + " 3 3 1\nfilename f.txt\n";
+    BlameCache::Blame parsed;
+    TestFramework::assert_true(BlameCache::parse_incremental(output, parsed), "Incremental blame parses");
+    TestFramework::assert_equal(size_t(2), parsed.commits.size(), "One entry per commit");
+    TestFramework::assert_true(parsed.line_commits.size() == 3 && parsed.line_commits[0] == parsed.line_commits[2] &&
+                               parsed.line_commits[1] != parsed.line_commits[0], "Commit of each line");
+    TestFramework::assert_equal(std::string("bbbbbbbb Bo 1970-01-02"), parsed.commits[0].label, "Label");
+    TestFramework::assert_equal(std::string("aaaaaaaa Al 2023-11-14"), parsed.commits[1].label, "Label date");
+    TestFramework::assert_true(!BlameCache::parse_incremental(first + " 1 1 1\nauthor Al\n", parsed),
+                               "Truncated output rejected");
+    
+    // Blame runs once per blob id; edits remap the lines without it
+    std::atomic<int> blames{0};
+    BlameCache cache(
+        [](const std::string& path, std::string& blob_id) {
+            if (path != "f.txt") return false;
+            blob_id = "f00d";
+            return true;
+        },
+        [](const std::string&, std::string& text) {
+            text = "one\ntwo\nthree\n";
+            return true;
+        },
+        [&blames, &output](const std::string&, std::string& text) {
+            ++blames;
+            text = output;
+            return true;
+        });
+    auto document = std::make_shared<PieceTable>("one\nlocal\ntwo\nthree\n");
+    auto settle = [&cache] {
+        cache.update();
+        cache.wait_idle();
+        cache.take_results();
+    };
+    auto author = [&cache](size_t line) {
+        const BlameCache::Commit* commit = cache.commit_at(line);
+        return commit ? commit->author : std::string("-");
+    };
+    cache.set_document(document, "f.txt");
+    settle();
+    TestFramework::assert_true(author(0) == "Al" && author(1) == "-" && author(2) == "Bo" && author(3) == "Al",
+                               "HEAD's blame laid over the document");
+    
+    document->insert(0, "new\n");
+    document->insert(document->get_line_start(4), "X");
+    document->remove(document->get_line_start(2), 6);
+    TestFramework::assert_true(author(0) == "-" && author(1) == "Al" && author(2) == "Bo" && author(3) == "-",
+                               "Edits remap the lines in place");
+    
+    // An edit while the blame is in flight is replayed onto its result
+    cache.set_document(nullptr, std::string());
+    cache.set_document(document, "f.txt");
+    cache.update();
+    document->insert(0, "top\n");
+    cache.wait_idle();
+    cache.take_results();
+    TestFramework::assert_true(author(0) == "-" && author(1) == "-" && author(2) == "Al" && author(3) == "Bo",
+                               "Edits during a blame replayed");
+    TestFramework::assert_equal(1, blames.load(), "Blame cached by blob id");
+    
+    cache.set_document(document, "untracked.txt");
+    settle();
+    TestFramework::assert_true(cache.commit_at(2) == nullptr, "Untracked file has no blame");
+}
+
+void test_terminal_screen() {
+    using editor::TerminalCell;
+    using editor::TerminalScreen;
+    auto feed = [](TerminalScreen& screen, const std::string& text) { screen.feed(text.data(), text.size()); };
+    
+    // Text, colors and a sequence split across reads
+    TerminalScreen screen(10, 3, 5);
+    feed(screen, "ab\x1b[3");
+    feed(screen, "1mc\x1b[0m\xc3");
+    feed(screen, "\xa9");
+    TestFramework::assert_equal(std::string("abc\xc3\xa9"), screen.line_text(0), "Split sequence and UTF-8");
+    TestFramework::assert_true(screen.screen_row(0).cells[2].foreground == (TerminalCell::kPaletteColor | 1) &&
+                               screen.screen_row(0).cells[3].foreground == TerminalCell::kDefaultColor, "SGR colors");
+    feed(screen, "\x1b[2;5Hxy\x1b[1;2H\x1b[K");
+    TestFramework::assert_equal(std::string("a"), screen.line_text(0), "Erase to end of line");
+    TestFramework::assert_equal(std::string("    xy"), screen.line_text(1), "Cursor position");
+    feed(screen, "\x1b[6n\x1b]2;title\x07");
+    std::string responses;
+    TestFramework::assert_true(screen.take_responses(responses) && responses == "\x1b[1;2R", "Cursor report");
+    TestFramework::assert_equal(std::string("title"), screen.title(), "OSC title");
+    
+    // Scrolled-off lines fill the ring; the oldest go once it is full
+    feed(screen, "\x1b[2J\x1b[H");
+    for (int i = 0; i < 20; ++i) feed(screen, "L" + std::to_string(i) + "\r\n");
+    TestFramework::assert_equal(size_t(5), screen.history_size(), "Scrollback capped");
+    TestFramework::assert_equal(std::string("L13"), screen.line_text(0), "Oldest kept line");
+    TestFramework::assert_equal(std::string("L19"), screen.line_text(screen.history_size() + 1), "Newest line");
+    TestFramework::assert_equal(2, screen.cursor_row(), "Cursor on the last row");
+    
+    // Autowrap marks the row; a scroll region keeps lines out of history
+    feed(screen, "0123456789ab");
+    TestFramework::assert_true(screen.screen_row(1).wrapped && screen.line_text(screen.history_size() + 2) == "ab",
+                               "Wrapped at the margin");
+    feed(screen, "\x1b[1;2r\x1b[2;1H\nz");
+    TestFramework::assert_equal(size_t(5), screen.history_size(), "Region scroll adds no history");
+    TestFramework::assert_equal(std::string("z"), screen.line_text(screen.history_size() + 1), "Region scrolled");
+    feed(screen, "\x1b[r");
+    
+    // The alternate screen leaves the main one as it was
+    std::string before = screen.line_text(screen.history_size() + 2);
+    feed(screen, "\x1b[?1049h\x1b[Hfull");
+    TestFramework::assert_true(screen.alternate_screen() && screen.history_size() == 0 &&
+                               screen.line_text(0) == "full", "Alternate screen");
+    feed(screen, "\x1b[?1049l");
+    TestFramework::assert_true(!screen.alternate_screen() && screen.line_text(screen.history_size() + 2) == before,
+                               "Main screen restored");
+    
+    // Resizing keeps the cursor's line on screen
+    feed(screen, "\x1b[3;1H");
+    screen.resize(4, 2);
+    TestFramework::assert_true(screen.columns() == 4 && screen.rows() == 2 && screen.cursor_row() < 2, "Resized");
+    TestFramework::assert_equal(std::string("ab"), screen.line_text(screen.history_size() + screen.cursor_row()),
+                                "Cursor line kept");
+}
+
+void test_process_io_loop() {
+    using editor::ProcessIoLoop;
+    auto wait_for = [](const std::function<bool()>& done) {
+        for (int i = 0; i < 5000 && !done(); ++i) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return done();
+    };
+#ifdef _WIN32
+    const std::string shell = "cmd.exe";
+    const std::vector<std::string> first = {"/c", "echo one"};
+    const std::vector<std::string> second = {"/c", "echo two"};
+#else
+    const std::string shell = "/bin/sh";
+    const std::vector<std::string> first = {"-c", "echo one"};
+    const std::vector<std::string> second = {"-c", "echo two"};
+#endif
+    editor::ProcessOptions options;
+    options.hide_window = true;
+    options.io.redirect_stdout = true;
+    options.io.async_output = true;
+    
+    // Two children on one loop thread, each read to the end of its stream
+    auto loop = ProcessIoLoop::shared();
+    TestFramework::assert_true(loop == ProcessIoLoop::shared(), "One shared loop");
+    editor::PlatformProcess a, b;
+    TestFramework::assert_true(a.start(shell, first, options) && b.start(shell, second, options), "Children started");
+    std::mutex mutex;
+    std::string out_a, out_b;
+    std::atomic<int> ended{0};
+    auto collect = [&](std::string& out) {
+        return [&](const char* data, size_t size) {
+            if (size == 0) {
+                ++ended;
+                return;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            out.append(data, size);
+        };
+    };
+    TestFramework::assert_true(loop->watch(a.get_stdout_pipe(), collect(out_a)) != 0 &&
+                               loop->watch(b.get_stdout_pipe(), collect(out_b)) != 0, "Pipes watched");
+    TestFramework::assert_true(wait_for([&] { return ended == 2; }), "End of both streams seen");
+    TestFramework::assert_true(out_a.find("one") == 0 && out_b.find("two") == 0, "Output delivered per pipe");
+    TestFramework::assert_equal(size_t(0), loop->watch_count(), "Ended pipes unwatched");
+    a.wait(5000);
+    b.wait(5000);
+    
+    // The terminal reads its shell the same way
+    EmbeddedTerminal terminal;
+    TestFramework::assert_true(terminal.start_shell(shell), "Shell started");
+#ifdef _WIN32
+    terminal.send_line("echo terminal-%OS%");
+    const std::string expected = "terminal-Windows_NT";
+#else
+    terminal.send_line("echo terminal-$((40 + 2))");
+    const std::string expected = "terminal-42";
+#endif
+    // On a pseudo terminal the command line is echoed as well, and the
+    // prompt may be printed around it; only the output has the expansion
+    TestFramework::assert_true(wait_for([&] {
+        terminal.update();
+        const editor::TerminalScreen& screen = terminal.screen();
+        for (size_t i = 0; i < screen.line_count(); ++i) {
+            if (screen.line_text(i).find(expected) != std::string::npos) return true;
+        }
+        return false;
+    }), "Shell output reaches the terminal");
+    terminal.stop_shell();
+    TestFramework::assert_true(!terminal.is_running(), "Shell stopped");
+    TestFramework::assert_equal(size_t(0), loop->watch_count(), "Terminal pipe unwatched");
+}
+
+void test_build_error_parser_streaming() {
+    std::vector<BuildError> seen;
+    BuildErrorParser parser([&](const BuildError& error) { seen.push_back(error); });
+    const std::string output =
+        "[ 50%] Building CXX object src/a.cpp.o\n"
+        "src/a.cpp:12:5: error: 'x' was not declared in this scope\n"
+        "In file included from src/b.h:3:\n"
+        "src/b.h:7: warning: unused variable 'y'\n"
+        "C:\\proj\\main.cpp:40:1: fatal error: missing.h: No such file or directory\r\n"
+        "  C:\\Program Files (x86)\\x.cpp(101,7): warning C4244: conversion from 'double'\r\n"
+        "x.cpp(9): note: see declaration of 'f'\n"
+        "src/c.cpp:3:1: note: last line, no newline";
+    
+    // Lines split across chunks are joined; each error arrives once its
+    // line is complete
+    size_t split = output.find("was not");
+    parser.feed(output.data(), split);
+    TestFramework::assert_true(seen.empty(), "Partial line held back");
+    parser.feed(output.data() + split, 1);
+    for (size_t i = split + 1; i < output.size(); i += 5) {
+        parser.feed(output.data() + i, std::min<size_t>(5, output.size() - i));
+    }
+    TestFramework::assert_equal(size_t(5), seen.size(), "Unterminated line waits for finish()");
+    parser.finish();
+    TestFramework::assert_equal(size_t(6), seen.size(), "All diagnostics");
+    TestFramework::assert_equal(size_t(6), parser.errors().size(), "Kept in errors()");
+    
+    TestFramework::assert_true(seen[0].file == "src/a.cpp" && seen[0].line == 12 && seen[0].column == 5 &&
+                               seen[0].type == "error", "GCC location");
+    TestFramework::assert_equal(std::string("'x' was not declared in this scope"), seen[0].message, "GCC message");
+    TestFramework::assert_true(seen[1].file == "src/b.h" && seen[1].line == 7 && seen[1].column == 0 &&
+                               seen[1].type == "warning", "No column");
+    TestFramework::assert_true(seen[2].file == "C:\\proj\\main.cpp" && seen[2].line == 40 && seen[2].type == "error",
+                               "Drive letter, fatal error");
+    TestFramework::assert_equal(std::string("missing.h: No such file or directory"), seen[2].message, "CR dropped");
+    TestFramework::assert_true(seen[3].file == "C:\\Program Files (x86)\\x.cpp" && seen[3].line == 101 &&
+                               seen[3].column == 7 && seen[3].type == "warning", "MSVC location");
+    TestFramework::assert_equal(std::string("conversion from 'double'"), seen[3].message, "MSVC message");
+    TestFramework::assert_true(seen[4].file == "x.cpp" && seen[4].line == 9 && seen[4].type == "note", "MSVC note");
+    TestFramework::assert_true(seen[5].file == "src/c.cpp" && seen[5].line == 3, "Last line");
+    
+    // The one-shot form agrees
+    TestFramework::assert_equal(size_t(6), BuildErrorParser::parse(output).size(), "parse()");
+    
+    // Output from a running command is streamed to the parser
+    BuildSystem build(".");
+    BuildErrorParser streamed;
+    int chunks = 0;
+#ifdef _WIN32
+    BuildCommand command{"Build", "echo main.c:1:2: error: boom 1>&2", "."};
+#else
+    BuildCommand command{"Build", "echo 'main.c:1:2: error: boom' >&2; exit 3", "."};
+#endif
+    int exit_code = build.run_command(command, [&](const std::string& chunk) {
+        ++chunks;
+        streamed.feed(chunk);
+    });
+    streamed.finish();
+    TestFramework::assert_true(chunks > 0 && streamed.errors().size() == 1 && streamed.errors()[0].file == "main.c",
+                               "stderr streamed");
+#ifndef _WIN32
+    TestFramework::assert_equal(3, exit_code, "Exit code");
+#else
+    (void)exit_code;
+#endif
+}
+
+void test_plugin_document_access() {
+    using editor::PluginDocumentAccess;
+    using editor::TextEdit;
+    PieceTable doc("alpha\nbeta\ngamma\ndelta\n");
+    doc.insert(6, "BE");     // Lines now span pieces
+    
+    // Whole lines into a fixed region, as many as fit
+    char region[16];
+    size_t lines = 0;
+    size_t written = PluginDocumentAccess::copy_lines(doc, 1, 3, region, sizeof(region), lines);
+    TestFramework::assert_equal(size_t(2), lines, "Lines that fit");
+    TestFramework::assert_equal(std::string("BEbeta\ngamma\n"), std::string(region, written), "Copied lines");
+    written = PluginDocumentAccess::copy_lines(doc, 1, 3, region, 4, lines);
+    TestFramework::assert_true(written == 0 && lines == 0, "First line too long");
+    written = PluginDocumentAccess::copy_lines(doc, 3, 100, region, sizeof(region), lines);
+    TestFramework::assert_true(lines == 2 && std::string(region, written) == "delta\n", "Clamped to the document");
+    written = PluginDocumentAccess::copy_range(doc, 4, 100, region, 5);
+    TestFramework::assert_equal(std::string("a\nBEb"), std::string(region, written), "Byte range");
+    
+    // A batch round-trips through the binary encoding and is one undo step
+    std::vector<TextEdit> edits = {{0, 5, "ALPHA"}, {18, 0, "!"}, {19, 6, ""}};
+    std::vector<uint8_t> encoded;
+    PluginDocumentAccess::encode_edits(edits, encoded);
+    std::vector<TextEdit> decoded;
+    TestFramework::assert_true(PluginDocumentAccess::decode_edits(encoded.data(), encoded.size(), decoded) &&
+                               decoded.size() == 3 && decoded[0].text == "ALPHA" && decoded[2].length == 6,
+                               "Decoded");
+    std::vector<TextEdit> truncated;
+    TestFramework::assert_true(!PluginDocumentAccess::decode_edits(encoded.data(), encoded.size() - 1, truncated),
+                               "Truncated list rejected");
+    size_t undo_steps = doc.get_undo_count();
+    TestFramework::assert_true(PluginDocumentAccess::apply_edits(doc, decoded), "Applied");
+    TestFramework::assert_equal(std::string("ALPHA\nBEbeta\ngamma!\n"), doc.get_text(0, doc.get_total_length()),
+                                "Edited");
+    TestFramework::assert_equal(undo_steps + 1, doc.get_undo_count(), "One undo step");
+    
+    std::vector<TextEdit> overlapping = {{0, 3, "x"}, {2, 1, "y"}};
+    TestFramework::assert_true(!PluginDocumentAccess::apply_edits(doc, overlapping), "Overlap rejected");
+    std::vector<TextEdit> outside = {{100, 0, "x"}};
+    TestFramework::assert_true(!PluginDocumentAccess::apply_edits(doc, outside), "Out of range rejected");
+}
+
+void test_plugin_worker_budgets() {
+    using editor::PluginBudget;
+    using editor::PluginState;
+    using editor::PluginWorker;
+    using namespace std::chrono_literals;
+    
+    // A plugin whose "slow" export takes 20ms and whose "block" export
+    // waits for the test; "event" records its argument
+    std::mutex mutex;
+    std::condition_variable unblock;
+    bool blocked = true;
+    std::vector<int64_t> events;
+    std::atomic<int> entered_block{0};
+    std::atomic<int> left_block{0};
+    auto invoke = [&](const std::string& func, const std::vector<int64_t>& args, int64_t* result, std::string& error) {
+        if (func == "slow") {
+            std::this_thread::sleep_for(20ms);
+        } else if (func == "block") {
+            ++entered_block;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                unblock.wait(lock, [&] { return !blocked; });
+            }
+            ++left_block;
+        } else if (func == "event") {
+            std::lock_guard<std::mutex> lock(mutex);
+            events.push_back(args[0]);
+        } else if (func == "add") {
+            *result = args[0] + args[1];
+        } else {
+            error = "Failed to find function '" + func + "'";
+            return false;
+        }
+        return true;
+    };
+    PluginBudget budget;
+    budget.call_time = 10ms;
+    budget.hang_time = 300ms;
+    budget.throttle_pause = 1ms;
+    budget.disable_after = 3;
+    budget.recover_after = 2;
+    
+    {
+        PluginWorker worker(invoke, budget);
+        int64_t sum = 0;
+        std::string error;
+        TestFramework::assert_true(worker.call("add", {2, 3}, &sum, error) && sum == 5, "Synchronous call");
+        TestFramework::assert_true(!worker.call("missing", {}, nullptr, error) && !error.empty(), "Error reported");
+        
+        // Events queued behind a running call coalesce into the newest
+        blocked = true;
+        worker.post("block", {});
+        while (entered_block == 0) std::this_thread::sleep_for(1ms);
+        for (int64_t i = 1; i <= 50; ++i) worker.post("event", {i}, 7);
+        worker.post("event", {100});
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            blocked = false;
+        }
+        unblock.notify_all();
+        TestFramework::assert_true(worker.wait_idle(2000ms), "Queue drained");
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            TestFramework::assert_true(events == std::vector<int64_t>({50, 100}), "Coalesced to the newest");
+        }
+        editor::PluginMetrics metrics = worker.metrics();
+        TestFramework::assert_equal(uint64_t(49), metrics.coalesced, "Coalesced count");
+        TestFramework::assert_equal(uint64_t(1), metrics.failures, "Failure count");
+        
+        // An overrun throttles, calls within budget recover, repeated overruns disable
+        worker.post("slow", {});
+        worker.wait_idle(2000ms);
+        TestFramework::assert_true(worker.state() == PluginState::Throttled, "Throttled after an overrun");
+        worker.post("add", {1, 1});
+        worker.post("add", {1, 1});
+        worker.wait_idle(2000ms);
+        TestFramework::assert_true(worker.state() == PluginState::Running, "Recovered");
+        for (int i = 0; i < 3; ++i) worker.post("slow", {});
+        worker.wait_idle(2000ms);
+        TestFramework::assert_true(worker.state() == PluginState::Disabled, "Disabled after repeated overruns");
+        TestFramework::assert_true(!worker.post("add", {1, 1}), "Disabled plugin refuses calls");
+        TestFramework::assert_true(worker.metrics().overruns >= 4, "Overruns counted");
+    }
+    
+    // A call that never returns disables the plugin without blocking its
+    // caller past the hang limit, and stop() abandons the thread
+    entered_block = 0;
+    blocked = true;
+    auto start = std::chrono::steady_clock::now();
+    {
+        PluginWorker worker(invoke, budget);
+        std::string error;
+        TestFramework::assert_true(!worker.call("block", {}, nullptr, error), "Hung call fails");
+        TestFramework::assert_true(worker.state() == PluginState::Disabled, "Hung plugin disabled");
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    TestFramework::assert_true(elapsed < 1500ms, "Caller not held past the hang limit");
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        blocked = false;
+    }
+    unblock.notify_all();
+    // The detached thread uses this function's locals until it returns
+    while (left_block < 2) std::this_thread::sleep_for(1ms);
+}
+
+void test_plugin_catalog_scan_and_cache() {
+    using editor::PluginCatalog;
+    using editor::PluginDescriptor;
+    namespace fs = std::filesystem;
+    fs::path dir = fs::path(editor::PlatformFile::get_temp_directory()) / "velocity_plugin_catalog";
+    fs::remove_all(dir);
+    fs::create_directories(dir / "nested");
+    
+    // A module exporting "run", with activation events and the engine it
+    // asks for in custom sections
+    auto module = [](const std::string& events, const std::string& engine = "") {
+        std::vector<uint8_t> bytes = {0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+                                      0x01, 0x04, 0x01, 0x60, 0x00, 0x00,           // type () -> ()
+                                      0x03, 0x02, 0x01, 0x00,
+                                      0x07, 0x07, 0x01, 0x03, 'r', 'u', 'n', 0x00, 0x00,
+                                      0x0a, 0x04, 0x01, 0x02, 0x00, 0x0b};
+        auto custom = [&bytes](const std::string& name, const std::string& text) {
+            if (text.empty()) return;
+            bytes.push_back(0x00);
+            bytes.push_back(static_cast<uint8_t>(1 + name.size() + text.size() + 1));
+            bytes.push_back(static_cast<uint8_t>(name.size()));
+            bytes.insert(bytes.end(), name.begin(), name.end());
+            bytes.insert(bytes.end(), text.begin(), text.end());
+            bytes.push_back(0);     // The C string's terminator
+        };
+        custom(PluginCatalog::kActivationSection, events);
+        custom(PluginCatalog::kEngineSection, engine);
+        return bytes;
+    };
+    auto write = [](const fs::path& path, const std::vector<uint8_t>& bytes) {
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    };
+    write(dir / "eager.wasm", module(""));
+    write(dir / "nested" / "lazy.wasm", module("onLanguage:cpp, onCommand:lazy.run\nonEvent:DocumentSaved"));
+    write(dir / "broken.wasm", {0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00, 0x07, 0x40});
+    write(dir / "formatter.wasm", module("onCommand:format", "compiled"));
+    write(dir / "nested" / "odd.wasm", module("", "jit-please"));
+    std::string cache = (dir / "plugins.cache").string();
+    
+    ThreadPool pool(4);
+    std::vector<PluginDescriptor> found;
+    {
+        PluginCatalog catalog(cache);
+        found = catalog.scan(dir.string(), pool);
+        TestFramework::assert_true(catalog.save(), "Cache written");
+    }
+    TestFramework::assert_equal(size_t(5), found.size(), "Modules found");
+    auto by_id = [&](const std::string& id) -> const PluginDescriptor& {
+        for (const PluginDescriptor& descriptor : found) {
+            if (descriptor.id == id) return descriptor;
+        }
+        return found.front();
+    };
+    TestFramework::assert_true(!by_id("broken").valid && !by_id("broken").error.empty(), "Truncated module rejected");
+    const PluginDescriptor& eager = by_id("eager");
+    TestFramework::assert_true(eager.valid && eager.loads_at_startup() && !eager.from_cache, "No events: startup");
+    TestFramework::assert_true(eager.exports == std::vector<std::string>({"run"}), "Exports listed");
+    const PluginDescriptor& lazy = by_id("lazy");
+    TestFramework::assert_true(lazy.valid && !lazy.loads_at_startup() && lazy.activation_events.size() == 3,
+                               "Activation events read");
+    TestFramework::assert_true(lazy.activated_by("onCommand:lazy.run") && !lazy.activated_by("onLanguage:py"),
+                               "Event matching");
+    TestFramework::assert_true(by_id("formatter").valid && by_id("formatter").engine == editor::WasmEngineKind::Compiled &&
+                               lazy.engine == editor::WasmEngineKind::Interpreter, "Engine section read");
+    TestFramework::assert_true(!by_id("odd").valid, "Unknown engine rejected");
+    
+    // A fresh catalog takes unchanged modules from the cache file
+    {
+        PluginCatalog catalog(cache);
+        found = catalog.scan(dir.string(), pool);
+    }
+    TestFramework::assert_true(by_id("lazy").from_cache && by_id("eager").from_cache &&
+                               by_id("lazy").activation_events.size() == 3, "Warm scan from cache");
+    TestFramework::assert_true(by_id("formatter").from_cache && by_id("formatter").engine == editor::WasmEngineKind::Compiled,
+                               "Engine kept in the cache");
+    
+    // A changed module is validated again
+    write(dir / "eager.wasm", module("*"));
+    fs::last_write_time(dir / "eager.wasm", fs::last_write_time(dir / "eager.wasm") + std::chrono::seconds(5));
+    {
+        PluginCatalog catalog(cache);
+        found = catalog.scan(dir.string(), pool);
+    }
+    TestFramework::assert_true(!by_id("eager").from_cache && by_id("eager").loads_at_startup() &&
+                               by_id("eager").activation_events.size() == 1, "Changed module revalidated");
+    fs::remove_all(dir);
+}
+
+void test_event_bus_batched_delivery() {
+    using editor::EditorEvent;
+    using editor::EventBatch;
+    using editor::EventBus;
+    using editor::EventFilter;
+    using editor::EventRecord;
+    EventBus bus;
+    
+    std::vector<EventRecord> everything;
+    size_t everything_calls = 0;
+    bus.subscribe(EventFilter{}, [&](const EventBatch& batch) {
+        everything_calls++;
+        everything.assign(batch.begin(), batch.end());
+    });
+    std::vector<EventRecord> saves;
+    EventFilter save_filter;
+    save_filter.types = EventFilter::type_bit(EditorEvent::DocumentSaved);
+    size_t save_calls = 0;
+    bus.subscribe(save_filter, [&](const EventBatch& batch) {
+        save_calls++;
+        saves.assign(batch.begin(), batch.end());
+    });
+    std::vector<EventRecord> second_document;
+    EventFilter document_filter;
+    document_filter.document = 2;
+    bus.subscribe(document_filter, [&](const EventBatch& batch) {
+        second_document.assign(batch.begin(), batch.end());
+    });
+    
+    auto record = [](EditorEvent type, int document, size_t position, size_t length, size_t inserted) {
+        EventRecord r;
+        r.type = type;
+        r.document = document;
+        r.position = position;
+        r.length = length;
+        r.inserted = inserted;
+        return r;
+    };
+    
+    // Typing "abc" at 10, then backspacing twice, is one edit
+    bus.publish(record(EditorEvent::DocumentChanged, 1, 10, 0, 1));
+    bus.publish(record(EditorEvent::DocumentChanged, 1, 11, 0, 1));
+    bus.publish(record(EditorEvent::DocumentChanged, 1, 12, 0, 1));
+    bus.publish(record(EditorEvent::DocumentChanged, 1, 12, 1, 0));
+    bus.publish(record(EditorEvent::DocumentChanged, 1, 11, 1, 0));
+    // Backspacing from 5 over existing text is another
+    bus.publish(record(EditorEvent::DocumentChanged, 1, 4, 1, 0));
+    bus.publish(record(EditorEvent::DocumentChanged, 1, 3, 1, 0));
+    // Only the last cursor of each document is kept
+    for (size_t i = 0; i < 50; ++i) {
+        bus.publish(record(EditorEvent::CursorMoved, 1, i, 0, 0));
+    }
+    bus.publish(record(EditorEvent::CursorMoved, 2, 7, 0, 0));
+    TestFramework::assert_equal(size_t(4), bus.pending(), "Records merged while published");
+    
+    // The save listener has nothing to see and is not called
+    TestFramework::assert_equal(size_t(2), bus.flush(), "Only interested listeners called");
+    TestFramework::assert_equal(size_t(1), everything_calls, "One call per frame");
+    TestFramework::assert_equal(size_t(0), save_calls, "Save listener skipped");
+    TestFramework::assert_equal(size_t(4), everything.size(), "Whole batch delivered");
+    TestFramework::assert_true(everything[0].position == 10 && everything[0].length == 0 &&
+                               everything[0].inserted == 1, "Typing and backspace merged");
+    TestFramework::assert_true(everything[1].position == 3 && everything[1].length == 2 &&
+                               everything[1].inserted == 0, "Backspaces merged");
+    TestFramework::assert_true(everything[2].type == EditorEvent::CursorMoved && everything[2].position == 49,
+                               "Last cursor kept");
+    TestFramework::assert_equal(size_t(1), second_document.size(), "Filtered by document");
+    TestFramework::assert_equal(size_t(7), second_document[0].position, "Other document's cursor");
+    TestFramework::assert_equal(size_t(0), bus.flush(), "Empty frame calls nobody");
+    
+    // Edits far apart stay separate; subscribing and unsubscribing from a listener
+    size_t late_calls = 0;
+    size_t self_id = 0;
+    self_id = bus.subscribe(EventFilter{}, [&](const EventBatch&) {
+        bus.unsubscribe(self_id);
+        bus.subscribe(EventFilter{}, [&](const EventBatch&) { late_calls++; });
+    });
+    bus.publish(record(EditorEvent::DocumentChanged, 1, 0, 0, 1));
+    bus.publish(record(EditorEvent::DocumentChanged, 1, 100, 0, 1));
+    bus.publish(record(EditorEvent::DocumentSaved, 1, 0, 0, 0));
+    TestFramework::assert_equal(size_t(3), bus.flush(), "Listener for another document skipped");
+    TestFramework::assert_equal(size_t(3), everything.size(), "Distant edits not merged");
+    TestFramework::assert_equal(size_t(1), saves.size(), "Save listener given only the save");
+    TestFramework::assert_equal(size_t(0), late_calls, "Subscribed during flush: next frame");
+    
+    // A watched document publishes its edits
+    PieceTable document("hello");
+    size_t watch = bus.watch_document(document, 2);
+    document.insert(5, " ");
+    document.insert(6, "world");
+    document.remove_change_listener(watch);
+    document.insert(0, ">");
+    TestFramework::assert_equal(size_t(1), bus.pending(), "Watched edits merged, unwatched ignored");
+    bus.flush();
+    TestFramework::assert_equal(size_t(1), late_calls, "Late subscriber called");
+    TestFramework::assert_equal(size_t(1), second_document.size(), "Watched document's edit");
+    TestFramework::assert_equal(size_t(6), second_document[0].inserted, "Both insertions in one record");
+}
+
+void test_autocomplete_incremental() {
+    auto document = std::make_shared<PieceTable>("value valid value Value vacuum other va");
+    AutocompleteManager autocomplete;
+    autocomplete.attach(document);
+    std::vector<std::string> expected = {"value", "Value", "vacuum", "valid"};
+    TestFramework::assert_true(autocomplete.suggest("va") == expected, "Ranked by count, then bytes");
+    TestFramework::assert_true(autocomplete.suggest("VAL", 1) == std::vector<std::string>{"value"},
+                               "Case-insensitive, limited");
+    TestFramework::assert_true(autocomplete.suggest("value").empty(), "Exact matches not suggested");
+    
+    // Typing into a word recounts it; deleting counts it down
+    document->insert(11, "ity");    // valid -> validity
+    TestFramework::assert_equal(0, autocomplete.frequency("valid"), "Old word counted down");
+    TestFramework::assert_equal(1, autocomplete.frequency("validity"), "New word counted up");
+    document->remove(0, 6);         // First "value "
+    TestFramework::assert_equal(1, autocomplete.frequency("value"), "Removed word counted down");
+    document->insert(document->get_total_length(), "cuum");    // va -> vacuum
+    TestFramework::assert_equal(2, autocomplete.frequency("vacuum"), "Short word completed");
+    document->remove(0, document->get_total_length());
+    TestFramework::assert_true(autocomplete.suggest("v").empty(), "Everything counted down");
+    autocomplete.detach();
+    document->insert(0, "volume");
+    TestFramework::assert_equal(0, autocomplete.frequency("volume"), "Detached document ignored");
+    
+    // A range long enough for a cached list stays equal to a full scan
+    std::map<std::string, int> counts;
+    std::mt19937 rng(7);
+    AutocompleteManager large;
+    for (size_t i = 0; i < AutocompleteManager::kScanLimit * 2; ++i) {
+        std::string word = "word" + std::to_string(i);
+        int count = 1 + static_cast<int>(rng() % 5);
+        for (int c = 0; c < count; ++c) large.add_text(word);
+        counts[word] = count;
+    }
+    auto brute_force = [&](const std::string& prefix, size_t max_items) {
+        std::vector<std::pair<std::string, int>> candidates;
+        for (const auto& entry : counts) {
+            if (entry.second > 0 && entry.first.size() > prefix.size() && entry.first.compare(0, prefix.size(), prefix) == 0) {
+                candidates.push_back(entry);
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+        std::vector<std::string> words;
+        for (size_t i = 0; i < candidates.size() && i < max_items; ++i) words.push_back(candidates[i].first);
+        return words;
+    };
+    bool consistent = large.suggest("wor") == brute_force("wor", 8);
+    for (int round = 0; round < 2000 && consistent; ++round) {
+        std::string word = "word" + std::to_string(rng() % (AutocompleteManager::kScanLimit * 2 + 20));
+        if (rng() % 2 && counts[word] > 0) {
+            large.remove_text(word);
+            counts[word]--;
+        } else {
+            large.add_text(word);
+            counts[word]++;
+        }
+        if (round % 10 == 0) {
+            consistent = large.suggest("wor") == brute_force("wor", 8) &&
+                         large.suggest("word", AutocompleteManager::kTopK) == brute_force("word", AutocompleteManager::kTopK) &&
+                         large.suggest("word1", 5) == brute_force("word1", 5);
+        }
+    }
+    TestFramework::assert_true(consistent, "Cached lists match a full scan");
+}
+
+void test_autocomplete_workspace_vocabulary() {
+    BackgroundIndexer indexer;
+    TestFramework::assert_true(indexer.vocabulary() == nullptr, "Nothing published yet");
+    indexer.index_file("a.cpp", "PieceTable table; PieceTable other; render_frame(); render_frame(); render_frame();");
+    indexer.index_file("b.cpp", "render_text(); PieceTable* piece;");
+    indexer.publish_vocabulary();
+    auto vocabulary = indexer.vocabulary();
+    TestFramework::assert_true(vocabulary != nullptr, "Snapshot published");
+    const WorkspaceVocabulary::Word* word = vocabulary->find("piecetable");
+    TestFramework::assert_true(word && word->count == 3 && word->text == "PieceTable", "Counted with its spelling");
+    
+    indexer.remove_file("a.cpp");
+    indexer.publish_vocabulary();
+    TestFramework::assert_equal(uint32_t(1), indexer.vocabulary()->find("piecetable")->count, "Removed file uncounted");
+    TestFramework::assert_true(vocabulary->find("render_frame") != nullptr, "Old snapshot unchanged");
+    TestFramework::assert_true(indexer.vocabulary()->generation() > vocabulary->generation(), "Generations grow");
+    
+    // Document words come first, then workspace words it lacks
+    auto document = std::make_shared<PieceTable>("render_loop render_loop");
+    auto second = std::make_shared<PieceTable>("renderer");
+    AutocompleteManager autocomplete;
+    autocomplete.set_workspace_vocabulary(vocabulary);
+    autocomplete.attach(document);
+    std::vector<std::string> expected = {"render_loop", "render_frame", "render_text"};
+    TestFramework::assert_true(autocomplete.suggest("ren") == expected, "Local words layered over the workspace");
+    autocomplete.attach(second);
+    autocomplete.attach(document);
+    TestFramework::assert_equal(size_t(2), autocomplete.attached_count(), "Tabs keep their words");
+    document->insert(0, "Render_frame ");
+    TestFramework::assert_true(autocomplete.suggest("ren", 3) == std::vector<std::string>{"render_loop", "Render_frame", "render_text"},
+                               "Same key not offered twice");
+    autocomplete.release(document.get());
+    TestFramework::assert_equal(size_t(1), autocomplete.attached_count(), "Released tab dropped");
+    
+    // Long ranges come from lists computed at build time
+    std::vector<WorkspaceVocabulary::Word> words;
+    for (uint32_t i = 0; i < WorkspaceVocabulary::kScanLimit * 3; ++i) {
+        std::string text = "item" + std::to_string(i);
+        words.push_back({text, text, i % 97});
+    }
+    auto large = WorkspaceVocabulary::build(words, 1);
+    std::vector<const WorkspaceVocabulary::Word*> best;
+    large->suggest("ITEM", 3, best);
+    TestFramework::assert_true(best.size() == 3 && best[0]->count == 96 && best[2]->count == 96 &&
+                               best[0]->key < best[1]->key, "Best of a long range");
+}
+
+void test_viewport_soft_wrap() {
+    using editor::WrapLayout;
+    auto doc = std::make_shared<PieceTable>("short\naaaa bbbb cccc dddd\r\n" + std::string(25, 'x') + "\nend");
+    WrapLayout layout;
+    layout.set_document(doc);
+    layout.set_columns(10);
+    std::vector<uint32_t> words = {0, 10};
+    TestFramework::assert_true(layout.row_starts(1) == words, "Breaks after the last blank that fits");
+    std::vector<uint32_t> hard = {0, 10, 20};
+    TestFramework::assert_true(layout.row_starts(2) == hard, "Hard breaks inside a long word");
+    TestFramework::assert_equal(size_t(1), layout.row_of_column(2, 15), "Row of a column");
+    
+    auto utf8 = std::make_shared<PieceTable>("\xC3\xA9\xC3\xA9\xC3\xA9\xC3\xA9");
+    WrapLayout narrow;
+    narrow.set_document(utf8);
+    narrow.set_columns(5);
+    std::vector<uint32_t> whole_chars = {0, 4};
+    TestFramework::assert_true(narrow.row_starts(0) == whole_chars, "Never splits a UTF-8 sequence");
+    
+    // Rows: short | aaaa bbbb_ | cccc dddd | x*10 | x*10 | x*5 | end
+    Viewport viewport(3, 10);
+    viewport.set_document(doc);
+    viewport.set_soft_wrap(true);
+    std::vector<ViewRow> rows = viewport.get_visible_rows();
+    TestFramework::assert_equal(size_t(3), rows.size(), "Screen of rows");
+    TestFramework::assert_equal(std::string("aaaa bbbb "), rows[1].text, "First wrapped row");
+    TestFramework::assert_true(rows[1].continues && rows[2].column == 10, "Continuation row");
+    TestFramework::assert_equal(std::string("cccc dddd"), rows[2].text, "Terminator dropped");
+    
+    viewport.scroll_down(2);
+    TestFramework::assert_true(viewport.get_top_line() == 1 && viewport.get_top_row() == 1, "Scrolls by rows");
+    TestFramework::assert_equal(size_t(2), viewport.row_of_line(2, 15), "Row of a wrapped column");
+    size_t line = 0, column = 0;
+    TestFramework::assert_true(viewport.row_position(2, line, column) && line == 2 && column == 10, "Position of a row");
+    
+    viewport.scroll_down(100);
+    rows = viewport.get_visible_rows();
+    TestFramework::assert_true(viewport.get_top_line() == 2 && viewport.get_top_row() == 1, "Clamped to a full last screen");
+    TestFramework::assert_equal(std::string("end"), rows.back().text, "Last row");
+    viewport.scroll_up(1);
+    TestFramework::assert_equal(size_t(0), viewport.get_top_row(), "Scrolls up by rows");
+    
+    // Editing line 1 re-wraps it; the long line below keeps its layout
+    doc->remove(doc->get_line_start(1) + 9, 10);
+    viewport.scroll_to_line(0);
+    rows = viewport.get_visible_rows();
+    TestFramework::assert_equal(std::string("aaaa bbbb"), rows[1].text, "Edited line re-wrapped");
+    TestFramework::assert_equal(std::string(10, 'x'), rows[2].text, "Next line follows");
+    
+    // Without wrapping, rows start at the left column and read a screen width
+    viewport.set_soft_wrap(false);
+    viewport.set_left_column(20);
+    rows = viewport.get_visible_rows();
+    TestFramework::assert_true(rows[0].text.empty() && rows[2].text == std::string(5, 'x'), "Horizontal start column");
+}
+
+void test_viewport_parks_state() {
+    // Rows: line 0 | x*10 | x*10 | x*5 | end, for each of two documents
+    std::string text = "line 0\n" + std::string(25, 'x') + "\nend";
+    auto first = std::make_shared<PieceTable>(text);
+    auto second = std::make_shared<PieceTable>(text);
+    Viewport viewport(2, 10);
+    viewport.set_document(first);
+    viewport.set_soft_wrap(true);
+    viewport.scroll_down(2);
+    
+    Viewport::State parked = viewport.take_state();
+    TestFramework::assert_true(parked.document == first && parked.wrap != nullptr, "State handed over");
+    TestFramework::assert_true(viewport.is_soft_wrap() && viewport.get_top_line() == 0, "Viewport starts over");
+    viewport.set_document(second);
+    viewport.scroll_down(1);
+    TestFramework::assert_equal(std::string(10, 'x'), viewport.get_visible_rows()[0].text, "Other document scrolled");
+    
+    // The parked layout follows edits to its document
+    first->insert(first->get_line_start(1), "yyyyy");
+    Viewport::State other = viewport.take_state();
+    viewport.restore_state(std::move(parked));
+    TestFramework::assert_true(viewport.get_top_line() == 1 && viewport.get_top_row() == 1, "Scroll position restored");
+    TestFramework::assert_equal(std::string(10, 'x'), viewport.get_visible_rows()[0].text, "Rows re-wrapped after the edit");
+    
+    // Unwrapped meanwhile: the parked layout is dropped
+    viewport.set_soft_wrap(false);
+    viewport.take_state();
+    viewport.restore_state(std::move(other));
+    TestFramework::assert_true(!viewport.is_soft_wrap() && viewport.get_top_line() == 1, "Wrap mode kept");
+}
+
+void test_column_layout() {
+    using editor::ColumnLayout;
+    // Tab stops every 4; "e" + U+0301 is one cell, U+4E2D one character in two
+    ColumnLayout::LineMap map = ColumnLayout::map_text("a\tb" "e\xCC\x81" "\xE4\xB8\xAD" "z");
+    TestFramework::assert_equal(size_t(9), map.width(), "Width in cells");
+    TestFramework::assert_equal(size_t(4), map.column_of(2), "Tab runs to its stop");
+    TestFramework::assert_equal(size_t(5), map.column_of(5), "Combining mark shares its base's cell");
+    TestFramework::assert_equal(size_t(6), map.column_of(6), "Wide character starts");
+    TestFramework::assert_equal(size_t(8), map.column_of(9), "Wide character takes two cells");
+    TestFramework::assert_equal(size_t(6), map.byte_at(7), "Second cell maps to its character");
+    TestFramework::assert_equal(size_t(1), map.byte_at(2), "Inside a tab maps to the tab");
+    TestFramework::assert_true(map.next_boundary(3) == 6 && map.prev_boundary(9) == 6, "Caret steps by cluster");
+    TestFramework::assert_equal(size_t(12), map.column_of(13), "Virtual space past the end");
+    
+    TestFramework::assert_true(ColumnLayout::map_text(std::string(100, 'x')).simple(), "ASCII stores nothing");
+    // Emoji ZWJ sequence (man, ZWJ, laptop) and a flag: one two-cell cluster each
+    std::string emoji = "\xF0\x9F\x91\xA8\xE2\x80\x8D\xF0\x9F\x92\xBB" "\xF0\x9F\x87\xAB\xF0\x9F\x87\xB7";
+    TestFramework::assert_equal(size_t(4), ColumnLayout::display_width(emoji), "Emoji sequences");
+    TestFramework::assert_equal(size_t(1), ColumnLayout::display_width("\xFF"), "Malformed byte takes a cell");
+    TestFramework::assert_equal(size_t(2), ColumnLayout::fit_columns("ab\xE4\xB8\xAD", 5, 3), "Cut before a wide character");
+    
+    // Lines map from the document, and edits drop and shift cached maps
+    std::string long_line = std::string(ColumnLayout::kReadChunk - 1, 'x') + "\xE4\xB8\xAD" + "y";
+    auto doc = std::make_shared<PieceTable>("\t\xE4\xB8\xAD\r\n" + long_line + "\nplain");
+    ColumnLayout layout;
+    layout.set_document(doc);
+    TestFramework::assert_equal(size_t(6), layout.line(0).width(), "Terminator not counted");
+    const auto& streamed = layout.line(1);
+    TestFramework::assert_true(streamed.bytes == long_line.size() && streamed.width() == long_line.size() - 1,
+                               "Character across a read boundary");
+    layout.line(2);
+    doc->insert(0, "\xE4\xB8\xAD\n");
+    TestFramework::assert_equal(size_t(2), layout.cached_lines(), "Edited line dropped, others shifted");
+    TestFramework::assert_equal(size_t(2), layout.line(0).width(), "Inserted line mapped");
+    TestFramework::assert_equal(size_t(5), layout.line(3).width(), "Shifted line kept");
+    layout.set_tab_width(8);
+    TestFramework::assert_equal(size_t(10), layout.line(1).width(), "Tab width relays out");
+    
+    // Without wrapping, a row is cut at the width in cells
+    auto wide = std::make_shared<PieceTable>("\xE4\xB8\xAD\xE4\xB8\xAD\xE4\xB8\xAD\n\tab");
+    Viewport viewport(2, 5);
+    viewport.set_document(wide);
+    std::vector<ViewRow> rows = viewport.get_visible_rows();
+    TestFramework::assert_equal(std::string("\xE4\xB8\xAD\xE4\xB8\xAD"), rows[0].text, "Whole wide characters that fit");
+    TestFramework::assert_equal(std::string("\ta"), rows[1].text, "Tab counted to its stop");
+}
+
+void test_gap_buffer_matches_reference() {
+    // Differential test: bulk inserts, cursor jumps and range deletes that
+    // land before, after and across the gap
+    std::mt19937 rng(4242);
+    GapBuffer buffer(16);
+    std::string reference;
+    for (int i = 0; i < 5000; ++i) {
+        size_t len = reference.size();
+        switch (rng() % 4) {
+            case 0:
+            case 1: {
+                size_t pos = rng() % (len + 1);
+                std::string text(1 + rng() % ((rng() % 50 == 0) ? 4000 : 12), char('a' + rng() % 26));
+                buffer.insert(pos, text);
+                reference.insert(pos, text);
+                break;
+            }
+            case 2:
+                if (len > 0) {
+                    size_t pos = rng() % len;
+                    size_t count = 1 + rng() % 40;
+                    buffer.erase(pos, count);
+                    reference.erase(pos, count);
+                }
+                break;
+            default:
+                buffer.move_cursor(rng() % (len + 1));
+                if (buffer.cursor() > 0 && rng() % 2) {
+                    size_t count = 1 + rng() % 3;
+                    size_t from = buffer.cursor() - std::min(count, buffer.cursor());
+                    reference.erase(from, buffer.cursor() - from);
+                    buffer.erase_before(count);
+                }
+                break;
+        }
+    }
+    TestFramework::assert_equal(reference, buffer.get_text(), "Text after random edits");
+    TestFramework::assert_equal(reference.size(), buffer.length(), "Length");
+    for (size_t pos = 0; pos < reference.size(); pos += 97) {
+        TestFramework::assert_true(reference[pos] == buffer.at(pos), "Random access");
+    }
+}
+
+void test_editor_core_open_save() {
+    std::string dir = editor::PlatformFile::get_temp_directory();
+    std::string in_path = editor::PlatformFile::join_path(dir, "velocity_editor_core_in.txt");
+    std::string out_path = editor::PlatformFile::join_path(dir, "velocity_editor_core_out.txt");
+    editor::PlatformFile::write_file(in_path, "alpha\nbeta", editor::LineEnding::LF);
+    
+    EditorCore core;
+    TestFramework::assert_true(core.open(in_path), "Open");
+    core.insert(5, " one");
+    core.erase(0, 1);
+    core.move_cursor(core.length());
+    core.insert_text("!");
+    TestFramework::assert_equal(std::string("lpha one\nbeta!"), core.get_text(), "Edited text");
+    TestFramework::assert_true(core.save(out_path), "Save");
+    std::string saved;
+    editor::PlatformFile::read_file(out_path, saved, editor::LineEnding::LF);
+    TestFramework::assert_equal(core.get_text(), saved, "Saved bytes");
+    editor::PlatformFile::delete_file(in_path);
+    editor::PlatformFile::delete_file(out_path);
+}
+
+void test_slab_pool_reuses_slots() {
+    struct Node { size_t a; size_t b; };
+    SlabPool<Node, 4> pool;
+    std::vector<Node*> nodes;
+    for (size_t i = 0; i < 10; ++i) nodes.push_back(pool.create(Node{i, i * 2}));
+    TestFramework::assert_equal(size_t(3), pool.slab_count(), "Slabs allocated on demand");
+    TestFramework::assert_equal(size_t(7), nodes[7]->a, "Objects constructed in place");
+    
+    Node* freed = nodes[3];
+    pool.destroy(freed);
+    Node* reused = pool.create(Node{99, 0});
+    TestFramework::assert_true(reused == freed, "Freed slot reused first");
+    TestFramework::assert_equal(size_t(3), pool.slab_count(), "No new slab for a reused slot");
+    TestFramework::assert_equal(size_t(10), pool.live_count(), "Live count");
+    pool.clear();
+    TestFramework::assert_equal(size_t(0), pool.slab_count(), "Clear releases every slab");
+}
+
+void test_prefix_index_matches_std() {
+    std::mt19937 rng(5);
+    for (size_t max_value : {size_t(1) << 20, size_t(UINT32_MAX) + 1000}) {
+        std::vector<size_t> values;
+        size_t value = 0;
+        for (int i = 0; i < 1000; ++i) {
+            values.push_back(value);
+            value += rng() % 3 == 0 ? 0 : rng() % (max_value / 1000);   // Includes duplicates
+        }
+        PrefixIndex index;
+        index.reset(max_value, values.size());
+        for (size_t v : values) index.push_back(v);
+        TestFramework::assert_true(index.is_compact() == (max_value <= UINT32_MAX), "Width follows the largest value");
+        for (int i = 0; i < 2000; ++i) {
+            size_t probe = rng() % (max_value + 10);
+            if (i % 2 == 0) probe = values[size_t(i) % values.size()];   // Exact hits too
+            size_t upper = std::upper_bound(values.begin(), values.end(), probe) - values.begin();
+            size_t lower = std::lower_bound(values.begin(), values.end(), probe) - values.begin();
+            TestFramework::assert_equal(upper, index.upper_bound(probe), "upper_bound");
+            TestFramework::assert_equal(lower, index.lower_bound(probe), "lower_bound");
+        }
+    }
+}
+
+// ============================================================================
+// UNIT TESTS - HighlightCache
+// ============================================================================
+
+void test_syntax_highlighter_lexers() {
+    // Perfect-hash tables answer exactly for their word list
+    constexpr std::string_view words[] = {"fn", "let", "match"};
+    constexpr editor::KeywordTable<3> table(words);
+    static_assert(table.valid(), "three words always separate");
+    TestFramework::assert_true(table.contains("let") && table.contains("match"), "Keywords found");
+    TestFramework::assert_true(!table.contains("le") && !table.contains("lets") && !table.contains(""), "Near misses rejected");
+
+    SyntaxHighlighter highlighter;
+    SyntaxHighlighter::LineState in, out;
+    std::vector<Token> tokens;
+    auto types = [&](const std::string& line) {
+        highlighter.tokenize_line(line, in, out, tokens);
+        std::string result;
+        for (const Token& token : tokens) result += "NKSCMP"[token.type];
+        return result;
+    };
+
+    // Each language's rules: comments, directives, strings and keywords
+    highlighter.set_language(SyntaxHighlighter::Language::Cpp);
+    TestFramework::assert_equal(std::string("P"), types("#include <x>"), "C++ directive");
+    TestFramework::assert_equal(std::string("KSC"), types("return \"a\" // done"), "C++ keyword, string and comment");
+    highlighter.set_language(SyntaxHighlighter::Language::Python);
+    TestFramework::assert_equal(std::string("KC"), types("  def f(): # note"), "Python hash comment, not a directive");
+    TestFramework::assert_equal(std::string("S"), types("x = \"\"\"open"), "Python triple string");
+    TestFramework::assert_true(out.in_triple_string, "Triple string carries over");
+    highlighter.set_language(SyntaxHighlighter::Language::TypeScript);
+    TestFramework::assert_equal(std::string("KKS"), types("type T = keyof `a"), "TypeScript keywords and template string");
+    TestFramework::assert_true(out.string_delim == '`', "Template string carries over");
+    highlighter.set_language(SyntaxHighlighter::Language::YAML);
+    TestFramework::assert_equal(std::string("PK"), types("--- yaml") + types("a: true"), "YAML marker and keyword");
+    highlighter.set_language(SyntaxHighlighter::Language::JSON);
+    TestFramework::assert_equal(std::string("SKM"), types("\"k\": null, 1.5e3 // x"), "JSON has no comments");
+    highlighter.set_language(SyntaxHighlighter::Language::Markdown);
+    TestFramework::assert_equal(std::string("P"), types("# Title") + types("return #x"), "Markdown headings only");
+
+    // The output buffer is cleared and its capacity reused
+    highlighter.set_language(SyntaxHighlighter::Language::Cpp);
+    types("int a = 1; int b = 2; int c = 3; int d = 4;");
+    size_t capacity = tokens.capacity();
+    TestFramework::assert_equal(std::string("K"), types("int"), "Previous tokens cleared");
+    TestFramework::assert_equal(capacity, tokens.capacity(), "Capacity kept");
+}
+
+void test_log_follower() {
+    using editor::LogFollower;
+    using editor::PlatformFile;
+    std::string root = PlatformFile::join_path(PlatformFile::get_temp_directory(), "velocity_log_follower");
+    PlatformFile::delete_directory(root, true);
+    PlatformFile::create_directories(root);
+    std::string path = PlatformFile::join_path(root, "service.log");
+    auto append = [&](const std::string& text) {
+        std::ofstream(path, std::ios::binary | std::ios::app).write(text.data(), text.size());
+    };
+    append("boot\nready\n");
+
+    auto mapping = PlatformFile::map_file(path);
+    auto doc = std::make_shared<PieceTable>(mapping);
+    LogFollower follower;
+    TestFramework::assert_true(follower.start(path, doc), "Following started");
+    TestFramework::assert_true(follower.poll() == LogFollower::Result::Unchanged, "Nothing new yet");
+
+    // Appends come in as they are, partial lines included, off the undo history
+    doc->insert(0, "> ");
+    size_t undo_steps = doc->get_undo_count();
+    append("request 1\nrequest 2\nreq");
+    TestFramework::assert_true(follower.poll() == LogFollower::Result::Appended, "Append seen");
+    TestFramework::assert_equal(size_t(23), follower.last_appended(), "Only the new bytes read");
+    append("uest 3\n");
+    follower.poll();
+    TestFramework::assert_equal(std::string("> boot\nready\nrequest 1\nrequest 2\nrequest 3\n"),
+                                doc->get_text(0, doc->get_total_length()), "Text follows the file");
+    TestFramework::assert_equal(size_t(6), doc->get_line_count(), "Line index extended");
+    TestFramework::assert_equal(std::string("request 3"), doc->get_line(4), "New lines addressable");
+    TestFramework::assert_true(doc->is_mapped(), "Earlier text still read from the mapping");
+    TestFramework::assert_equal(undo_steps, doc->get_undo_count(), "Appends are not undo steps");
+    doc->undo();
+    TestFramework::assert_equal(std::string("boot"), doc->get_line(0), "Undo takes back only the user's edit");
+
+    // Truncated: a fresh document with what the file holds now
+    doc.reset();
+    mapping.reset();
+    PlatformFile::write_file(path, "restart\n", editor::LineEnding::LF);
+    TestFramework::assert_true(follower.poll() == LogFollower::Result::Reset, "Truncation resets");
+    TestFramework::assert_equal(std::string("restart\n"), follower.document()->get_text(0, 8), "New file read");
+    TestFramework::assert_equal(size_t(8), follower.offset(), "Offset restarted");
+
+    // Rotated to a file as long but different: the fingerprint tells them apart
+    PlatformFile::write_file(path, "rotated\nand longer\n", editor::LineEnding::LF);
+    TestFramework::assert_true(follower.poll() == LogFollower::Result::Reset, "Rotation resets");
+    TestFramework::assert_equal(size_t(2), follower.reset_count(), "Two resets");
+    TestFramework::assert_equal(std::string("and longer"), follower.document()->get_line(1), "Rotated file read");
+
+    PlatformFile::delete_file(path);
+    TestFramework::assert_true(follower.poll() == LogFollower::Result::Missing, "Removed file kept as is");
+    TestFramework::assert_true(follower.document()->get_total_length() == 19, "Document left alone");
+    PlatformFile::delete_directory(root, true);
+}
+
+void test_viewport_follow_end() {
+    auto doc = std::make_shared<PieceTable>("");
+    for (int i = 0; i < 100; ++i) doc->insert(doc->get_total_length(), "line\n");
+    Viewport viewport(20, 80);
+    viewport.set_document(doc);
+    TestFramework::assert_true(!viewport.is_at_end(), "Top of a long document");
+    viewport.scroll_to_end();
+    TestFramework::assert_true(viewport.is_at_end(), "Scrolled to the end");
+    TestFramework::assert_equal(size_t(101 - 20), viewport.get_top_line(), "Last screenful");
+    doc->append_external("more\nmore\n");
+    TestFramework::assert_true(!viewport.is_at_end(), "Appended past the screen");
+    viewport.scroll_to_end();
+    TestFramework::assert_equal(size_t(103 - 20), viewport.get_top_line(), "Follows the appends");
+}
+
+void test_large_file_policy() {
+    using editor::LargeFileFeature;
+    using editor::LargeFilePolicy;
+
+    // Workspace settings override thresholds and per-feature modes
+    LargeFilePolicy policy;
+    std::map<std::string, std::string> settings = {
+        {"large_file.max_bytes", "1MB"}, {"large_file.max_lines", "50000"}, {"large_file.max_line_length", "4k"},
+        {"large_file.folding", "off"}, {"large_file.autocomplete", "defer"}, {"large_file.minimap", "sideways"},
+        {"editor.font", "mono"},
+    };
+    policy.load(settings);
+    TestFramework::assert_equal(size_t(1024 * 1024), policy.max_bytes(), "Size with suffix");
+    TestFramework::assert_equal(size_t(4096), policy.max_line_length(), "Line length with suffix");
+    TestFramework::assert_true(policy.configured(LargeFileFeature::Folding) == editor::FeatureMode::Off, "Mode overridden");
+    TestFramework::assert_true(policy.configured(LargeFileFeature::Minimap) == editor::FeatureMode::Off, "Malformed mode keeps default");
+
+    // Small files keep everything
+    LargeFilePolicy::Decision small = policy.evaluate(1000, 10, 80);
+    TestFramework::assert_true(!small.large && small.allows(LargeFileFeature::LanguageServer) && small.message().empty(),
+                               "Small file unaffected");
+
+    // Any one threshold is enough
+    TestFramework::assert_true(policy.evaluate(2 * 1024 * 1024, 10, 80).large, "Too many bytes");
+    TestFramework::assert_true(policy.evaluate(1000, 60000, 80).large, "Too many lines");
+    LargeFilePolicy::Decision minified = policy.evaluate(100000, 1, 100000);
+    TestFramework::assert_true(minified.large, "One very long line");
+    TestFramework::assert_true(!minified.allows(LargeFileFeature::Folding) && !minified.allows(LargeFileFeature::Autocomplete),
+                               "Expensive features held back");
+    std::string message = minified.message();
+    TestFramework::assert_true(message.find("100000-character line") != std::string::npos &&
+                               message.find("Off: minimap, folding") != std::string::npos &&
+                               message.find("Starts when used: autocomplete") != std::string::npos,
+                               "Message says what was turned off: " + message);
+
+    // Deferred features start when asked for; off ones stay off
+    TestFramework::assert_true(minified.resume(LargeFileFeature::Autocomplete) && minified.allows(LargeFileFeature::Autocomplete),
+                               "Deferred feature resumes");
+    TestFramework::assert_true(!minified.resume(LargeFileFeature::Folding), "Off feature stays off");
+
+    // From a document: the longest line is sampled from its text
+    PieceTable doc("short\n" + std::string(5000, 'x') + "\nshort\n");
+    TestFramework::assert_true(policy.evaluate(doc).large, "Long line found in the document");
+    settings["large_file.enabled"] = "false";
+    policy.load(settings);
+    TestFramework::assert_true(!policy.evaluate(doc).large, "Disabled policy never degrades");
+
+    // Without the full pass, background highlighting stops near the viewport
+    std::string text;
+    for (int i = 0; i < 100000; ++i) text += "int value" + std::to_string(i) + ";\n";
+    auto big = std::make_shared<PieceTable>(text);
+    SyntaxHighlighter highlighter;
+    HighlightCache cache(&highlighter);
+    cache.set_document(big);
+    cache.set_background(true);
+    cache.set_full_pass(false);
+    cache.schedule(0, 40);
+    for (int i = 0; i < 200 && cache.get_ready_tokens(79).empty(); ++i) {
+        cache.poll();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    for (int i = 0; i < 20; ++i) {
+        cache.poll();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    TestFramework::assert_true(!cache.get_ready_tokens(79).empty(), "Viewport highlighted");
+    TestFramework::assert_true(cache.valid_lines() < big->get_line_count(), "No pass over the whole document");
+}
+
+void test_highlight_cache_invalidation() {
+    std::string text;
+    for (int i = 0; i < 100; ++i) text += "int value" + std::to_string(i) + " = " + std::to_string(i) + ";\n";
+    auto doc = std::make_shared<PieceTable>(text);
+    SyntaxHighlighter highlighter;
+    HighlightCache cache(&highlighter);
+    cache.set_document(doc);
+    
+    cache.state_before(50);
+    TestFramework::assert_equal(size_t(50), cache.valid_lines(), "States cached up to requested line");
+    cache.state_before(20);
+    TestFramework::assert_equal(size_t(50), cache.valid_lines(), "Earlier lines served from cache");
+    
+    // Edit on line 10 drops states from line 10 onward
+    doc->insert(doc->get_line_start(10) + 3, "x");
+    TestFramework::assert_equal(size_t(10), cache.valid_lines(), "Edit invalidates from edited line");
+    
+    highlighter.set_language(SyntaxHighlighter::Language::Python);
+    cache.state_before(5);
+    TestFramework::assert_equal(size_t(5), cache.valid_lines(), "Language change clears cache");
+}
+
+void test_highlight_cache_reuses_tokens() {
+    std::string text;
+    for (int i = 0; i < 200; ++i) text += "int value" + std::to_string(i) + " = " + std::to_string(i) + ";\n";
+    auto doc = std::make_shared<PieceTable>(text);
+    SyntaxHighlighter highlighter;
+    HighlightCache cache(&highlighter);
+    cache.set_document(doc);
+    
+    for (size_t line = 0; line < 100; ++line) cache.get_tokens(line);
+    size_t before = cache.tokenize_count();
+    for (size_t line = 0; line < 100; ++line) cache.get_tokens(line);
+    TestFramework::assert_equal(before, cache.tokenize_count(), "Revisited lines are not re-tokenized");
+    
+    // Typing inside a line re-tokenizes only that line
+    doc->insert(doc->get_line_start(40) + 4, "x");
+    before = cache.tokenize_count();
+    for (size_t line = 0; line < 100; ++line) cache.get_tokens(line);
+    TestFramework::assert_equal(before + 1, cache.tokenize_count(), "Only the edited line is re-tokenized");
+    TestFramework::assert_equal(size_t(100), cache.valid_lines(), "States converge after the edited line");
+    
+    // Inserted lines shift the cached entries below them
+    doc->insert(doc->get_line_start(10), "a\nb\n");
+    before = cache.tokenize_count();
+    const auto& shifted = cache.get_tokens(52);
+    TestFramework::assert_true(!shifted.empty() && shifted[0].type == Token::KEYWORD, "Shifted line keeps its tokens");
+    TestFramework::assert_equal(before + 3, cache.tokenize_count(), "Inserted lines and the edited line are tokenized");
+    
+    // Opening a block comment changes every following line's state
+    doc->insert(doc->get_line_start(5), "/*\n");
+    const auto& commented = cache.get_tokens(60);
+    TestFramework::assert_true(commented.size() == 1 && commented[0].type == Token::COMMENT, "Block comment propagates");
+    doc->insert(doc->get_line_start(80), "*/\n");
+    const auto& after = cache.get_tokens(90);
+    TestFramework::assert_true(!after.empty() && after[0].type == Token::KEYWORD, "Closed comment restores following lines");
+}
+
+void test_highlight_cache_semantic_tokens() {
+    auto doc = std::make_shared<PieceTable>("int foo = bar(x);\nint y;\nstruct Point p;\nauto s = \"\xc3\xa9\" + foo;\n");
+    SyntaxHighlighter highlighter;
+    HighlightCache cache(&highlighter);
+    cache.set_document(doc);
+    auto overlay = std::make_shared<editor::SemanticTokenOverlay>();
+    overlay->set_legend({"variable", "function", "type"});
+    cache.set_semantic_tokens(overlay);
+    auto type_at = [&](size_t line, size_t start) {
+        cache.get_tokens(line);
+        for (const Token& token : cache.get_display_tokens(line)) {
+            if (token.start == start) return size_t(token.type);
+        }
+        return size_t(-1);
+    };
+    
+    // foo, bar; Point two lines down; foo after a two-byte, one-unit character
+    editor::LspSemanticTokens full;
+    TestFramework::assert_true(editor::decode_semantic_tokens_response(
+        "{\"id\":4,\"result\":{\"resultId\":\"1\",\"data\":[0,4,3,0,0, 0,6,3,1,0, 2,7,5,2,0, 1,15,3,0,0]}}", full) &&
+        !full.delta && full.data.size() == 20, "Full result decoded");
+    TestFramework::assert_true(overlay->apply(full, overlay->mark()), "Full result applied");
+    TestFramework::assert_equal(std::string("1"), overlay->result_id(), "Result id kept");
+    TestFramework::assert_equal(size_t(Token::KEYWORD), type_at(0, 0), "Lexer token kept");
+    TestFramework::assert_equal(size_t(Token::VARIABLE), type_at(0, 4), "Variable over the lexer");
+    TestFramework::assert_equal(size_t(Token::FUNCTION), type_at(0, 10), "Function");
+    TestFramework::assert_equal(size_t(Token::VARIABLE), type_at(3, 16), "UTF-16 column to bytes");
+    
+    // An edit before the next result: lines below it shift, the edited lines drop out
+    doc->insert(doc->get_line_start(1), "y = 1;\n");
+    size_t mark = overlay->mark();
+    TestFramework::assert_equal(size_t(Token::FUNCTION), type_at(0, 10), "Line above the edit");
+    TestFramework::assert_equal(size_t(Token::TYPE), type_at(3, 7), "Line below the edit shifted");
+    TestFramework::assert_equal(size_t(Token::VARIABLE), type_at(4, 16), "Last line shifted");
+    TestFramework::assert_true(type_at(1, 0) != size_t(Token::VARIABLE), "Edited line has no semantic tokens");
+    
+    // The server answers with the one integer that changed
+    editor::LspSemanticTokens delta;
+    TestFramework::assert_true(editor::decode_semantic_tokens_response(
+        "{\"id\":5,\"result\":{\"resultId\":\"2\",\"edits\":[{\"start\":10,\"deleteCount\":1,\"data\":[3]}]}}", delta) &&
+        delta.delta && delta.edits.size() == 1, "Delta decoded");
+    TestFramework::assert_true(overlay->apply(delta, mark), "Delta applied");
+    TestFramework::assert_equal(size_t(Token::TYPE), type_at(3, 7), "Delta result");
+    TestFramework::assert_equal(size_t(4), overlay->token_count(), "Token count");
+    delta.edits[0].start = 100;
+    TestFramework::assert_true(!overlay->apply(delta, overlay->mark()) && overlay->result_id().empty(),
+                               "Delta past the data asks for a full result");
+    TestFramework::assert_true(type_at(3, 7) != size_t(Token::TYPE), "Cleared tokens leave the lexer's");
+}
+
+void test_highlight_cache_background() {
+    std::string text = "/*\n";
+    for (int i = 0; i < 5000; ++i) text += "int value" + std::to_string(i) + ";\n";
+    text += "*/\n";
+    for (int i = 0; i < 5000; ++i) text += "int value" + std::to_string(i) + ";\n";
+    auto doc = std::make_shared<PieceTable>(text);
+    SyntaxHighlighter highlighter;
+    HighlightCache cache(&highlighter);
+    cache.set_document(doc);
+    cache.set_background(true);
+    
+    auto wait_until = [&](const std::function<bool()>& done) {
+        for (int i = 0; i < 2000 && !done(); ++i) {
+            cache.poll();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return done();
+    };
+    
+    // Nothing is tokenized on the calling thread
+    cache.schedule(7000, 40);
+    TestFramework::assert_true(cache.get_ready_tokens(7000).empty(), "Viewport not ready before the worker runs");
+    TestFramework::assert_true(wait_until([&]() { return !cache.get_ready_tokens(7039).empty(); }),
+                               "Viewport lines become ready");
+    
+    // The whole document is eventually done in order, fixing guessed states
+    TestFramework::assert_true(wait_until([&]() { return cache.valid_lines() == doc->get_line_count(); }),
+                               "Background pass reaches the end");
+    cache.schedule(2000, 40);
+    TestFramework::assert_true(wait_until([&]() { return !cache.get_ready_tokens(2000).empty(); }),
+                               "Inside-comment line ready");
+    const auto& commented = cache.get_ready_tokens(2000);
+    TestFramework::assert_true(commented.size() == 1 && commented[0].type == Token::COMMENT,
+                               "Line inside the block comment highlighted as comment");
+    const auto& code = cache.get_ready_tokens(7000);
+    TestFramework::assert_true(!code.empty() && code[0].type == Token::KEYWORD, "Line after the comment keeps keyword tokens");
+    
+    // Edits drop results computed from the old text
+    doc->insert(doc->get_line_start(2010), "\"");
+    cache.schedule(2000, 40);
+    TestFramework::assert_true(wait_until([&]() { return cache.valid_lines() == doc->get_line_count(); }),
+                               "Background pass resumes after an edit");
+    TestFramework::assert_equal(size_t(1), cache.get_ready_tokens(2010).size(), "Edited line re-tokenized");
+    cache.set_background(false);
+}
+
+// ============================================================================
+// UNIT TESTS - TreeSitterBridge
+// ============================================================================
+
+void test_treesitter_bridge_apply_edit() {
+    PieceTable doc("int a;\nint b;\nint c;\n");
+    TreeSitterBridge bridge;
+    bridge.initialize("cpp");
+    bridge.set_document(&doc);
+    
+    std::vector<PieceTable::Change> changes;
+    std::vector<TreeSitterBridge::LineRange> ranges;
+    doc.add_change_listener([&](const PieceTable::Change& change) {
+        changes.push_back(change);
+        bridge.apply_edit(change, ranges);
+    });
+    
+    doc.insert(doc.get_line_start(1) + 4, "x\ny");
+    TestFramework::assert_equal(size_t(1), changes.back().first_line, "Edit line reported");
+    TestFramework::assert_equal(size_t(4), changes.back().column, "Edit column reported");
+    TestFramework::assert_true(!ranges.empty() && ranges[0].first == 1 && ranges[0].last == 3,
+                               "Edited lines reported as changed");
+    
+    // Remove "b;\nint " - the removed range ends at column 4 of old line 2
+    ranges.clear();
+    size_t start = doc.get_text(0, doc.get_total_length()).find("yb;");
+    doc.remove(start + 1, 7);
+    TestFramework::assert_equal(size_t(1), changes.back().removed_newlines, "Removed newline counted");
+    TestFramework::assert_equal(size_t(4), changes.back().old_end_column, "Old end column reported");
+    TestFramework::assert_true(!ranges.empty() && ranges[0].first == 2 && ranges[0].last == 3,
+                               "Removal reports the joined line");
+}
+
+// ============================================================================
+// UNIT TESTS - TextScan
+// ============================================================================
+
+void test_text_scan_matches_scalar() {
+    std::mt19937 rng(777);
+    std::string data(70000, 'a');
+    for (auto& c : data) {
+        c = (rng() % 9 == 0) ? '\n' : static_cast<char>('a' + rng() % 26);
+    }
+    // Exercise unaligned starts and tails shorter than one vector
+    for (size_t start : {size_t(0), size_t(1), size_t(7), size_t(31)}) {
+        for (size_t len : {size_t(0), size_t(5), size_t(33), size_t(4097), data.size() - start}) {
+            const char* p = data.data() + start;
+            TestFramework::assert_equal(TextScan::count_newlines_scalar(p, len),
+                                        TextScan::count_newlines(p, len),
+                                        std::string("count_newlines (") + TextScan::active_kernel() + ")");
+            std::vector<size_t> expected, actual;
+            TextScan::find_newlines_scalar(p, len, 100, expected);
+            TextScan::find_newlines(p, len, 100, actual);
+            TestFramework::assert_true(expected == actual, "find_newlines offsets differ from scalar");
+        }
+    }
+}
+
+void test_text_scan_find_bytes() {
+    // Binary-ish data: long zero runs, so the first byte alone matches a lot
+    std::mt19937 rng(99);
+    std::string data(20000, '\0');
+    for (auto& c : data) {
+        if (rng() % 4 == 0) c = static_cast<char>(rng() % 4);
+    }
+    const char* needles[] = {"\x01", "\x00\x01", "\x01\x02\x03", "\x00\x00\x00\x00\x00\x00\x03"};
+    const size_t lengths[] = {1, 2, 3, 7};
+    for (size_t n = 0; n < 4; ++n) {
+        for (size_t start : {size_t(0), size_t(1), size_t(13), size_t(19990)}) {
+            size_t expected = TextScan::find_bytes_scalar(data.data() + start, data.size() - start, needles[n], lengths[n]);
+            size_t actual = TextScan::find_bytes(data.data() + start, data.size() - start, needles[n], lengths[n]);
+            TestFramework::assert_equal(expected, actual, std::string("find_bytes (") + TextScan::active_kernel() + ")");
+        }
+    }
+    // A match straddling the vector tail, and none at all
+    std::string tail(100, 'x');
+    tail.replace(95, 5, "hello");
+    TestFramework::assert_equal(size_t(95), TextScan::find_bytes(tail.data(), tail.size(), "hello", 5), "Match at the end");
+    TestFramework::assert_true(TextScan::find_bytes(tail.data(), tail.size(), "hellp", 5) == TextScan::npos, "No match");
+    TestFramework::assert_true(TextScan::find_bytes(tail.data(), 3, "hello", 5) == TextScan::npos, "Needle longer than data");
+}
+
+void test_text_transcode() {
+    // Random text with every kind of line break, across block boundaries
+    std::mt19937 rng(4242);
+    const char* pieces[] = {"a", "bc", "\r\n", "\n", "\r", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80", "0123456789abcdef"};
+    std::string text;
+    while (text.size() < 5000) text += pieces[rng() % 9];
+    
+    std::string reference;
+    TextTranscode::LineBreaks expected;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '\r' && i + 1 < text.size() && text[i + 1] == '\n') {
+            expected.crlf++;
+            reference += '\n';
+            ++i;
+        } else if (text[i] == '\r' || text[i] == '\n') {
+            (text[i] == '\r' ? expected.cr : expected.lf)++;
+            reference += '\n';
+        } else {
+            reference += text[i];
+        }
+    }
+    TextTranscode::LineBreaks breaks = TextTranscode::count_line_breaks(text.data(), text.size());
+    TestFramework::assert_true(breaks.lf == expected.lf && breaks.crlf == expected.crlf && breaks.cr == expected.cr,
+                               std::string("Line breaks counted (") + TextTranscode::active_kernel() + ")");
+    std::string normalized = text;
+    TextTranscode::normalize_to_lf(normalized);
+    TestFramework::assert_equal(reference, normalized, "Normalized to LF");
+    
+    // UTF-8 to UTF-16 and back, with an ASCII run long enough for the fast path
+    TestFramework::assert_true(TextTranscode::is_valid_utf8(text.data(), text.size()), "Valid UTF-8");
+    std::u16string units = TextTranscode::utf8_to_utf16(text);
+    TestFramework::assert_true(TextTranscode::utf16_to_utf8(units.data(), units.size()) == text, "Round trip");
+    TestFramework::assert_true(TextTranscode::utf8_to_utf16("x\xE2\x82\xAC\xF0\x9F\x98\x80") ==
+                               std::u16string{u'x', 0x20AC, 0xD83D, 0xDE00}, "Surrogate pair");
+    
+    // Malformed input: a stray continuation byte, an overlong '/', a cut-off euro sign
+    std::string bad = "ok\x80" "\xC0\xAF" "\xE2\x82";
+    TestFramework::assert_true(!TextTranscode::is_valid_utf8(bad.data(), bad.size()), "Invalid UTF-8");
+    TestFramework::assert_true(TextTranscode::utf8_to_utf16(bad) ==
+                               std::u16string{u'o', u'k', 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD}, "One U+FFFD per bad byte");
+    const char16_t lone[] = {u'a', 0xD800, u'b'};
+    TestFramework::assert_equal(std::string("a\xEF\xBF\xBD" "b"), TextTranscode::utf16_to_utf8(lone, 3),
+                                "Unpaired surrogate");
+    
+    size_t bom = 0;
+    TestFramework::assert_true(TextTranscode::detect_bom("\xEF\xBB\xBFx", 4, bom) == TextTranscode::Encoding::UTF8_BOM &&
+                               bom == 3, "UTF-8 BOM");
+    TestFramework::assert_true(TextTranscode::detect_bom("\xFF\xFEx", 3, bom) == TextTranscode::Encoding::UTF16LE &&
+                               bom == 2, "UTF-16LE BOM");
+    TestFramework::assert_true(TextTranscode::detect_bom("x", 1, bom) == TextTranscode::Encoding::UTF8 && bom == 0,
+                               "No BOM");
+    
+    // Files in UTF-16 load as UTF-8
+    std::string path = editor::PlatformFile::join_path(editor::PlatformFile::get_temp_directory(),
+                                                       "velocity_transcode.txt");
+    std::vector<uint8_t> utf16 = {0xFE, 0xFF, 0x00, 'h', 0x00, 'i', 0x00, '\r', 0x00, '\n', 0x20, 0xAC};
+    editor::PlatformFile::write_file_binary(path, utf16);
+    std::string loaded;
+    TestFramework::assert_true(editor::PlatformFile::read_file(path, loaded, editor::LineEnding::LF) &&
+                               loaded == "hi\n\xE2\x82\xAC", "UTF-16BE file decoded");
+    editor::PlatformFile::delete_file(path);
+}
+
+// ============================================================================
+// UNIT TESTS - UndoManager
+// ============================================================================
+
+void test_undo_manager_single_insert() {
+    PieceTable doc("Hello");
+    UndoManager undo;
+    
+    auto cmd = std::make_unique<InsertCommand>(&doc, 5, " World");
+    undo.execute(std::move(cmd));
+    
+    TestFramework::assert_equal(std::string("Hello World"), 
+                                doc.get_text(0, doc.get_total_length()),
+                                "After insert");
+    
+    undo.undo();
+    TestFramework::assert_equal(std::string("Hello"), 
+                                doc.get_text(0, doc.get_total_length()),
+                                "After undo");
+}
+
+void test_undo_manager_single_delete() {
+    PieceTable doc("Hello World");
+    UndoManager undo;
+    
+    auto cmd = std::make_unique<DeleteCommand>(&doc, 5, 6);
+    undo.execute(std::move(cmd));
+    
+    TestFramework::assert_equal(std::string("Hello"), 
+                                doc.get_text(0, doc.get_total_length()),
+                                "After delete");
+    
+    undo.undo();
+    TestFramework::assert_equal(std::string("Hello World"), 
+                                doc.get_text(0, doc.get_total_length()),
+                                "After undo");
+}
+
+void test_undo_manager_multiple_operations() {
+    PieceTable doc("A");
+    UndoManager undo;
+    
+    undo.execute(std::make_unique<InsertCommand>(&doc, 1, "B"));
+    undo.execute(std::make_unique<InsertCommand>(&doc, 2, "C"));
+    undo.execute(std::make_unique<InsertCommand>(&doc, 3, "D"));
+    
+    TestFramework::assert_equal(std::string("ABCD"), 
+                                doc.get_text(0, doc.get_total_length()),
+                                "After inserts");
+    
+    undo.undo();
+    TestFramework::assert_equal(std::string("ABC"), 
+                                doc.get_text(0, doc.get_total_length()),
+                                "After 1 undo");
+    
+    undo.undo();
+    TestFramework::assert_equal(std::string("AB"), 
+                                doc.get_text(0, doc.get_total_length()),
+                                "After 2 undos");
+}
+
+void test_undo_manager_redo() {
+    PieceTable doc("Hello");
+    UndoManager undo;
+    
+    undo.execute(std::make_unique<InsertCommand>(&doc, 5, " World"));
+    undo.undo();
+    undo.redo();
+    
+    TestFramework::assert_equal(std::string("Hello World"), 
+                                doc.get_text(0, doc.get_total_length()),
+                                "After redo");
+}
+
+void test_undo_manager_coalesces_keystrokes() {
+    PieceTable doc("");
+    UndoManager undo;
+    
+    for (size_t i = 0; i < 5; ++i) {
+        undo.execute(std::make_unique<InsertCommand>(&doc, i, std::string(1, "hello"[i])), true);
+    }
+    undo.execute(std::make_unique<InsertCommand>(&doc, 5, "\n"), true);
+    TestFramework::assert_equal(size_t(2), undo.get_undo_count(), "Word typed as one step, newline starts another");
+    
+    // Backspace twice groups too
+    undo.execute(std::make_unique<DeleteCommand>(&doc, 5, 1), true);
+    undo.execute(std::make_unique<DeleteCommand>(&doc, 4, 1), true);
+    undo.execute(std::make_unique<DeleteCommand>(&doc, 3, 1), true);
+    TestFramework::assert_equal(std::string("hel"), doc.get_text(0, doc.get_total_length()), "After backspaces");
+    undo.undo();
+    TestFramework::assert_equal(std::string("hello"), doc.get_text(0, doc.get_total_length()), "Backspaces undone together");
+    undo.undo();    // Deleted newline back
+    undo.undo();    // Typed newline gone
+    undo.undo();
+    TestFramework::assert_equal(std::string(""), doc.get_text(0, doc.get_total_length()), "Word undone in one step");
+    undo.redo();
+    TestFramework::assert_equal(std::string("hello"), doc.get_text(0, doc.get_total_length()), "Word redone in one step");
+}
+
+void test_undo_manager_trims_history() {
+    PieceTable doc("");
+    UndoManager undo(5);
+    std::string block(1024, 'x');
+    for (size_t i = 0; i < 20; ++i) {
+        undo.execute(std::make_unique<InsertCommand>(&doc, doc.get_total_length(), block));
+    }
+    TestFramework::assert_equal(size_t(5), undo.get_undo_count(), "Oldest steps dropped");
+    
+    doc.set_history_limits(1000, 3 * sizeof(Piece));
+    TestFramework::assert_equal(size_t(3), doc.get_undo_count(), "Document history held under the byte cap");
+    
+    // PieceTable's own history: undo/redo replays are not recorded as new edits
+    PieceTable table("abc");
+    table.insert(3, "d");
+    table.insert(4, "e");
+    table.break_undo_group();
+    table.insert(5, "f");
+    TestFramework::assert_equal(size_t(2), table.get_undo_count(), "Contiguous inserts coalesced");
+    table.undo();
+    table.undo();
+    TestFramework::assert_equal(std::string("abc"), table.get_text(0, table.get_total_length()), "PieceTable undo");
+    table.redo();
+    table.redo();
+    TestFramework::assert_equal(std::string("abcdef"), table.get_text(0, table.get_total_length()), "PieceTable redo");
+}
+
+void test_undo_history_spills_to_disk() {
+    // The codec round-trips both what compresses and what does not
+    std::string repetitive;
+    for (int i = 0; i < 2000; ++i) repetitive += "line " + std::to_string(i % 17) + "\n";
+    std::string noise(5000, '\0');
+    uint32_t seed = 12345;
+    for (char& c : noise) {
+        seed = seed * 1103515245 + 12345;
+        c = static_cast<char>(seed >> 24);
+    }
+    for (const std::string& data : {repetitive, noise, std::string("short")}) {
+        std::string packed = editor::lz4_compress(data.data(), data.size());
+        std::string unpacked(data.size(), '\0');
+        TestFramework::assert_true(editor::lz4_decompress(packed.data(), packed.size(), &unpacked[0], unpacked.size()),
+                                   "LZ4 block decodes");
+        TestFramework::assert_equal(data, unpacked, "LZ4 round trip");
+    }
+    std::string repacked = editor::lz4_compress(repetitive.data(), repetitive.size());
+    TestFramework::assert_true(repacked.size() < repetitive.size() / 4, "Repetitive text compresses");
+    std::string out(repetitive.size(), '\0');
+    TestFramework::assert_true(!editor::lz4_decompress(repacked.data(), repacked.size() / 2, &out[0], out.size()),
+                               "Truncated block rejected");
+
+    std::string path = editor::PlatformFile::join_path(editor::PlatformFile::get_temp_directory(),
+                                                       "velocity_spill_test.history");
+    PieceTable doc("start\n");
+    doc.set_history_limits(8, 1 << 20);
+    doc.set_history_spill(path, 128 * 1024);
+    std::string block(20 * 1024, 'a');
+    for (size_t i = 0; i < 40; ++i) {
+        block[0] = static_cast<char>('a' + i % 26);
+        doc.insert(doc.get_total_length(), block);
+        doc.break_undo_group();
+        // Every other edit removes what came before it, so its text goes cold
+        if (i % 2 == 1) {
+            doc.remove(6, doc.get_total_length() - 6);
+            doc.break_undo_group();
+        }
+    }
+    TestFramework::assert_true(doc.get_undo_count() > 8, "Steps past the limit kept on disk");
+    TestFramework::assert_true(doc.get_memory_usage().spilled > 0, "Cold add-buffer text paged out");
+    std::string final_text = doc.get_text(0, doc.get_total_length());
+    size_t steps = doc.get_undo_count();
+    for (size_t i = 0; i < steps; ++i) doc.undo();
+    TestFramework::assert_true(!doc.can_undo(), "All of history replayed");
+    TestFramework::assert_equal(std::string("start\n"), doc.get_text(0, doc.get_total_length()), "Undone to the start");
+    for (size_t i = 0; i < steps; ++i) doc.redo();
+    TestFramework::assert_equal(final_text, doc.get_text(0, doc.get_total_length()), "Redone to the end");
+
+    doc.set_history_spill("");
+    TestFramework::assert_true(!editor::PlatformFile::exists(path), "Spill file deleted");
+    TestFramework::assert_true(doc.can_undo() && doc.get_undo_count() <= 8, "Back to the in-memory limit");
+    doc.undo();
+    // The last edit removed the two blocks before it; they were paged out
+    TestFramework::assert_equal(std::string("m"), doc.get_text(6, 1), "Paged-in text restored by undo");
+    
+    // Batches read back or cut off by a new edit do not stay in the file
+    PieceTable history("");
+    history.set_history_limits(4, 1 << 20);
+    history.set_history_spill(path);
+    for (int i = 0; i < 40; ++i) {
+        history.insert(history.get_total_length(), "step\n");
+        history.break_undo_group();
+    }
+    TestFramework::assert_true(history.get_memory_usage().spilled > 0, "Old steps spilled");
+    while (history.can_undo()) history.undo();
+    history.insert(0, "new\n");
+    TestFramework::assert_true(!history.can_redo() && history.get_memory_usage().spilled == 0, "Dead batches truncated");
+}
+
+void test_undo_manager_delete_keeps_pieces() {
+    std::string text(8 * 1024 * 1024, 'a');
+    for (size_t i = 0; i < text.size(); i += 80) text[i] = '\n';
+    PieceTable doc(text);
+    doc.insert(100, "XYZ");
+    doc.insert(5000000, "first\nsecond");
+    std::string before = doc.get_text(0, doc.get_total_length());
+    
+    UndoManager undo;
+    undo.execute(std::make_unique<DeleteCommand>(&doc, 50, 7000000));
+    TestFramework::assert_equal(before.size() - 7000000, doc.get_total_length(), "Range deleted");
+    TestFramework::assert_true(doc.get_history_bytes() < 1024, "Undo holds pieces, not 7 MB of text");
+    
+    undo.undo();
+    TestFramework::assert_true(before == doc.get_text(0, doc.get_total_length()), "Undo restores the text");
+    TestFramework::assert_equal(TextScan::count_newlines(before.data(), before.size()) + 1, doc.get_line_count(),
+                                "Undo restores line count");
+    undo.redo();
+    TestFramework::assert_equal(before.size() - 7000000, doc.get_total_length(), "Redo deletes again");
+    
+    // PieceTable's own history uses spans too
+    PieceTable table("0123456789");
+    table.insert(5, "abc");
+    table.break_undo_group();
+    table.remove(2, 8);
+    TestFramework::assert_equal(std::string("01789"), table.get_text(0, table.get_total_length()), "Remove across pieces");
+    table.undo();
+    TestFramework::assert_equal(std::string("01234abc56789"), table.get_text(0, table.get_total_length()), "Span re-inserted");
+}
+
+void test_undo_manager_transactions() {
+    PieceTable doc("a\nb\nc\n");
+    UndoManager undo;
+    
+    // Multi-cursor typing: one keystroke at three cursors, back to front
+    undo.begin_transaction(&doc);
+    for (size_t pos : {size_t(4), size_t(2), size_t(0)}) {
+        undo.execute(std::make_unique<InsertCommand>(&doc, pos, "> "));
+    }
+    undo.commit_transaction();
+    TestFramework::assert_equal(std::string("> a\n> b\n> c\n"), doc.get_text(0, doc.get_total_length()), "All cursors edited");
+    TestFramework::assert_equal(size_t(1), undo.get_undo_count(), "Multi-cursor edit is one step");
+    TestFramework::assert_equal(size_t(1), doc.get_undo_count(), "Edit recorded once, by the document");
+    
+    // Replace all: remove + insert per match inside one (nested) transaction
+    undo.begin_transaction(&doc);
+    undo.begin_transaction(&doc);
+    for (size_t pos : {size_t(8), size_t(4), size_t(0)}) {
+        undo.execute(std::make_unique<DeleteCommand>(&doc, pos, 2));
+        undo.execute(std::make_unique<InsertCommand>(&doc, pos, "* "));
+    }
+    undo.commit_transaction();
+    undo.commit_transaction();
+    TestFramework::assert_equal(std::string("* a\n* b\n* c\n"), doc.get_text(0, doc.get_total_length()), "Replace all");
+    TestFramework::assert_equal(size_t(2), undo.get_undo_count(), "Replace all is one step");
+    
+    undo.undo();
+    TestFramework::assert_equal(std::string("> a\n> b\n> c\n"), doc.get_text(0, doc.get_total_length()), "Replace all undone atomically");
+    undo.undo();
+    TestFramework::assert_equal(std::string("a\nb\nc\n"), doc.get_text(0, doc.get_total_length()), "Multi-cursor edit undone");
+    undo.redo();
+    undo.redo();
+    TestFramework::assert_equal(std::string("* a\n* b\n* c\n"), doc.get_text(0, doc.get_total_length()), "Both redone");
+    
+    // Typing after a transaction starts a new step
+    undo.execute(std::make_unique<InsertCommand>(&doc, doc.get_total_length(), "x"), true);
+    undo.execute(std::make_unique<InsertCommand>(&doc, doc.get_total_length(), "y"), true);
+    TestFramework::assert_equal(size_t(3), undo.get_undo_count(), "Keystrokes grouped after a transaction");
+}
+
+void test_undo_manager_multi_edit() {
+    PieceTable doc("one\ntwo\nthree\n");
+    UndoManager undo;
+    
+    // Typing at three cursors: one edit, one step, cursors moved in bulk
+    std::vector<PieceTable::Edit> edits = {{3, 0, "!"}, {7, 0, "!"}, {13, 0, "!"}};
+    undo.execute(std::make_unique<MultiEditCommand>(&doc, edits));
+    TestFramework::assert_equal(std::string("one!\ntwo!\nthree!\n"), doc.get_text(0, doc.get_total_length()), "Typed at every cursor");
+    TestFramework::assert_equal(size_t(1), doc.get_undo_count(), "One undo step");
+    std::vector<size_t> cursors = {13, 3, 7, 0, 14};
+    PieceTable::map_offsets(edits, cursors.data(), cursors.size());
+    TestFramework::assert_true(cursors == std::vector<size_t>{16, 4, 9, 0, 17}, "Cursors follow their text");
+    
+    // Backspace at the same cursors, then a replacement spanning a cursor
+    edits = {{3, 1, ""}, {8, 1, ""}, {15, 1, ""}};
+    undo.execute(std::make_unique<MultiEditCommand>(&doc, edits));
+    TestFramework::assert_equal(std::string("one\ntwo\nthree\n"), doc.get_text(0, doc.get_total_length()), "Removed at every cursor");
+    cursors = {6};
+    PieceTable::map_offsets({{4, 3, "2"}}, cursors.data(), cursors.size());
+    TestFramework::assert_equal(size_t(5), cursors[0], "Cursor inside a replacement ends after it");
+    
+    undo.undo();
+    TestFramework::assert_equal(std::string("one!\ntwo!\nthree!\n"), doc.get_text(0, doc.get_total_length()), "Backspaces undone together");
+    undo.undo();
+    TestFramework::assert_equal(std::string("one\ntwo\nthree\n"), doc.get_text(0, doc.get_total_length()), "Typing undone together");
+    undo.redo();
+    TestFramework::assert_equal(std::string("one!\ntwo!\nthree!\n"), doc.get_text(0, doc.get_total_length()), "Redone");
+    
+    // Overlapping or unsorted edits change nothing
+    TestFramework::assert_true(!doc.apply_edits({{5, 2, "x"}, {6, 0, "y"}}), "Overlap rejected");
+    TestFramework::assert_true(!doc.apply_edits({{5, 0, "x"}, {1, 0, "y"}}), "Unsorted rejected");
+    TestFramework::assert_true(doc.batch_insert({{8, "b"}, {0, "a"}, {8, "c"}}), "Batch insert in any order");
+    TestFramework::assert_equal(std::string("aone!\ntwobc!\nthree!\n"), doc.get_text(0, doc.get_total_length()), "Pre-batch offsets");
+    
+    // Many cursors: one pass, and the text matches editing one at a time
+    std::string text;
+    for (int i = 0; i < 5000; ++i) text += "line " + std::to_string(i) + "\n";
+    PieceTable many(text);
+    PieceTable reference(text);
+    std::vector<PieceTable::Edit> column;
+    for (size_t line = 0; line < 5000; ++line) column.push_back({many.get_line_start(line) + 4, 0, ":"});
+    many.apply_edits(column);
+    for (size_t line = 5000; line-- > 0;) reference.insert(reference.get_line_start(line) + 4, ":");
+    TestFramework::assert_true(many.get_text(0, many.get_total_length()) == reference.get_text(0, reference.get_total_length()),
+                               "Column edit matches sequential inserts");
+    many.undo();
+    TestFramework::assert_true(many.get_text(0, many.get_total_length()) == text, "Column edit undone in one step");
+}
+
 // ============================================================================
-// UNIT TESTS - UndoManager
+// UNIT TESTS - FindDialog
+// ============================================================================
+
+void test_internal_clipboard() {
+    std::string big(3 * PieceTable::kShareMinimum, 'a');
+    big[100] = '\n';
+    auto source = std::make_shared<PieceTable>("head\n" + big + "\ntail");
+    // A character split across two pieces
+    source->insert(2, "\xE4\xB8\xAD");
+    source->insert(3, "x");
+    source->remove(3, 1);
+    size_t length = source->get_total_length();
+    std::string text = source->get_text(0, length);
+    editor::InternalClipboard clipboard;
+    clipboard.copy(source, 0, length);
+    TestFramework::assert_equal(length, clipboard.length(), "Copied length");
+    
+    // Back into the same document: its own pieces, one undo step
+    UndoManager undo;
+    size_t pieces = source->get_piece_count();
+    undo.execute(std::make_unique<PasteCommand>(source.get(), length, clipboard));
+    TestFramework::assert_equal(text + text, source->get_text(0, source->get_total_length()), "Pasted into its document");
+    TestFramework::assert_true(source->get_piece_count() <= 2 * pieces, "Pieces reused, not text");
+    undo.undo();
+    TestFramework::assert_equal(text, source->get_text(0, source->get_total_length()), "Paste undone");
+    
+    // Into another document: the large piece is shared, not copied, and
+    // outlives its document and later edits there
+    auto target = std::make_shared<PieceTable>("[]");
+    source->remove(0, length);
+    source.reset();
+    undo.execute(std::make_unique<PasteCommand>(target.get(), 1, clipboard));
+    TestFramework::assert_equal("[" + text + "]", target->get_text(0, target->get_total_length()), "Pasted into another document");
+    PieceTable::MemoryUsage usage = target->get_memory_usage();
+    TestFramework::assert_true(usage.shared >= big.size(), "Large piece shared");
+    TestFramework::assert_equal(size_t(4), target->get_line_count(), "Shared newlines indexed");
+    TestFramework::assert_equal(std::string("tail]"), target->get_line(3), "Lines across shared text");
+    target->insert(target->get_total_length(), "!");
+    TestFramework::assert_equal(std::string("tail]!"), target->get_line(3), "Typing after a shared chunk");
+    target->undo();
+    target->undo();
+    TestFramework::assert_equal(std::string("[]"), target->get_text(0, target->get_total_length()), "Shared paste undone");
+    
+    // Streamed for the system clipboard: the split character decodes whole
+    std::vector<char16_t> units(clipboard.length());
+    units.resize(clipboard.write_utf16(units.data()));
+    TestFramework::assert_true(std::u16string(units.begin(), units.end()) == TextTranscode::utf8_to_utf16(text),
+                               "UTF-16 streamed across pieces");
+    clipboard.clear();
+    TestFramework::assert_true(clipboard.empty() && clipboard.paste(*target, 0) == 0, "Cleared");
+}
+
+void test_find_simple() {
+    FindDialog finder;
+    std::string text = "Hello World Hello";
+    
+    auto matches = finder.find_all(text, "Hello");
+    TestFramework::assert_equal(size_t(2), matches.size(), "Find 'Hello' count");
+    TestFramework::assert_equal(size_t(0), matches[0].position, "First match position");
+    TestFramework::assert_equal(size_t(12), matches[1].position, "Second match position");
+}
+
+void test_find_case_insensitive() {
+    FindDialog finder;
+    finder.set_case_sensitive(false);
+    std::string text = "Hello hello HELLO";
+    
+    auto matches = finder.find_all(text, "hello");
+    TestFramework::assert_equal(size_t(3), matches.size(), "Case insensitive count");
+}
+
+void test_find_case_sensitive() {
+    FindDialog finder;
+    finder.set_case_sensitive(true);
+    std::string text = "Hello hello HELLO";
+    
+    auto matches = finder.find_all(text, "hello");
+    TestFramework::assert_equal(size_t(1), matches.size(), "Case sensitive count");
+}
+
+void test_find_no_match() {
+    FindDialog finder;
+    std::string text = "Hello World";
+    
+    auto matches = finder.find_all(text, "xyz");
+    TestFramework::assert_equal(size_t(0), matches.size(), "No matches");
+}
+
+void test_find_streams_pieces() {
+    // Many small pieces, so matches straddle piece boundaries
+    PieceTable doc("");
+    std::string text;
+    std::mt19937 rng(7);
+    const char* words[] = {"needle", "Need", "le\n", "n", "eedle", "x", "NEEDLE\n"};
+    for (int i = 0; i < 2000; ++i) {
+        std::string word = words[rng() % 7];
+        size_t at = rng() % (text.size() + 1);
+        doc.insert(at, word);
+        text.insert(at, word);
+    }
+    TestFramework::assert_equal(text, doc.get_text(0, doc.get_total_length()), "Document built");
+    
+    // Reference: naive non-overlapping scan with lines from offset 0
+    FindDialog finder;
+    std::vector<size_t> expected;
+    for (size_t pos = 0; pos + 6 <= text.size();) {
+        bool hit = true;
+        for (size_t i = 0; i < 6 && hit; ++i) hit = std::tolower((unsigned char)text[pos + i]) == "needle"[i];
+        if (hit) {
+            expected.push_back(pos);
+            pos += 6;
+        } else {
+            ++pos;
+        }
+    }
+    auto from_pieces = finder.find_all(doc, "needle");
+    auto from_string = finder.find_all(text, "needle");
+    TestFramework::assert_equal(expected.size(), from_pieces.size(), "Piece stream finds every match");
+    TestFramework::assert_equal(expected.size(), from_string.size(), "String stream finds every match");
+    bool same = true;
+    for (size_t i = 0; i < expected.size() && i < from_pieces.size(); ++i) {
+        const SearchMatch& m = from_pieces[i];
+        size_t line_start = text.rfind('\n', m.position == 0 ? 0 : m.position - 1);
+        line_start = (m.position == 0 || line_start == std::string::npos) ? 0 : line_start + 1;
+        same = same && m.position == expected[i] && m.position == from_string[i].position &&
+               m.line == size_t(std::count(text.begin(), text.begin() + m.position, '\n')) &&
+               m.column == m.position - line_start && m.line == from_string[i].line;
+    }
+    TestFramework::assert_true(same, "Positions, lines and columns agree");
+    
+    SearchMatch match;
+    TestFramework::assert_true(finder.find_next(doc, "needle", expected[1], match) && match.position == expected[1],
+                               "find_next from a match start");
+    size_t last = expected.back();
+    TestFramework::assert_true(finder.find_previous(doc, "needle", doc.get_total_length(), match) &&
+                               match.position >= last, "find_previous from the end");
+    TestFramework::assert_true(!finder.find_previous(doc, "needle", expected[0], match), "Nothing before the first");
+    
+    finder.set_case_sensitive(true);
+    std::string replaced = text;
+    int count = finder.replace_all(replaced, "NEEDLE", "pin");
+    TestFramework::assert_equal(size_t(count), finder.find_all(doc, "NEEDLE").size(), "Case-sensitive replace count");
+    TestFramework::assert_equal(size_t(0), finder.find_all(replaced, "NEEDLE").size(), "Replaced everywhere");
+}
+
+void test_regex_engine_matches() {
+    auto first = [](const std::string& pattern, const std::string& text, bool case_sensitive = true) {
+        RegexEngine regex(pattern, case_sensitive);
+        RegexEngine::Match match;
+        if (!regex.search(text, 0, match)) return std::string("<none>");
+        return text.substr(match.position, match.length);
+    };
+    TestFramework::assert_equal(std::string("foo42"), first("[a-z]+\\d+", "-- foo42 --"), "Class and escape");
+    TestFramework::assert_equal(std::string("ab"), first("ab|abc", "abc"), "Leftmost-first alternation");
+    TestFramework::assert_equal(std::string("<a><b>"), first("<.*>", "<a><b>"), "Greedy");
+    TestFramework::assert_equal(std::string("<a>"), first("<.*?>", "<a><b>"), "Lazy");
+    TestFramework::assert_equal(std::string("cat"), first("\\bcat\\b", "concat cat"), "Word boundary");
+    TestFramework::assert_equal(std::string("Line"), first("^L\\w+$", "x\nLine\r\ny"), "Line anchors and CRLF");
+    TestFramework::assert_equal(std::string("HeLLo"), first("hel+o", "say HeLLo", false), "Case folding");
+    TestFramework::assert_equal(std::string("aaa"), first("a{2,3}", "aaaa"), "Counted repetition");
+    TestFramework::assert_equal(std::string("x{y}"), first("x{y}", "x{y}"), "Literal brace");
+    // An iteration that matched empty ends its loop, as backtracking does
+    TestFramework::assert_equal(std::string("ac"), first("[ab](?:c*?)*.", "cacc"), "Empty iteration ends the loop");
+    RegexEngine nested("(.?.*(c)*)*");
+    RegexEngine::Match last;
+    TestFramework::assert_true(nested.search("c", 0, last) && last.length == 1 && last.has_group(1) &&
+                               last.group_begin(1) == 1 && last.group_end(1) == 1 && !last.has_group(2),
+                               "Empty last iteration keeps its captures");
+
+    RegexEngine dates("(\\d{4})-(\\d\\d)-(\\d\\d)");
+    std::string text = "from 2024-01-31 to 2025-12-01";
+    std::vector<std::string> swapped;
+    dates.for_each_match(text, 0, [&](const RegexEngine::Match& match) {
+        swapped.push_back(RegexEngine::expand("$3.$2.${1} $$", match, text));
+        return true;
+    });
+    TestFramework::assert_true(swapped.size() == 2 && swapped[0] == "31.01.2024 $" && swapped[1] == "01.12.2025 $",
+                               "Captures and expansion");
+    
+    TestFramework::assert_equal(std::string("A"), first("\\u0041", "xAx"), "\\u escape");
+    TestFramework::assert_equal(std::string("\xC3\xA9\xF0\x9F\x98\x80"), first("\\u00e9\\uD83D\\uDE00", "caf\xC3\xA9\xF0\x9F\x98\x80"),
+                                "\\u escapes match UTF-8");
+    TestFramework::assert_true(!RegexEngine("(a)\\1").ok() && !RegexEngine("(?=a)").ok() && !RegexEngine("a(").ok() &&
+                               !RegexEngine("*a").ok() && !RegexEngine("[ab").ok(), "Unsupported syntax rejected");
+    TestFramework::assert_true(!RegexEngine("a{2}{3}").ok() && !RegexEngine("a**").ok() && !RegexEngine("a+?+").ok() &&
+                               !RegexEngine("a???").ok() && RegexEngine("a??").ok() && RegexEngine("a{2}{x").ok(),
+                               "Quantifier after a quantifier rejected");
+    TestFramework::assert_true(!RegexEngine("\\q").ok() && !RegexEngine("[\\B]").ok() && !RegexEngine("\\u004").ok() &&
+                               !RegexEngine("[\\u00e9]").ok() && !RegexEngine("\\uD83D").ok() && RegexEngine("\\.\\-\\/").ok(),
+                               "Escaped letters without a meaning rejected");
+    TestFramework::assert_true(RegexEngine::cached("a+b") == RegexEngine::cached("a+b"), "Compiled patterns cached");
+    
+    // Exponential for a backtracking engine, linear here
+    std::string n_a(40, 'a');
+    std::string pathological;
+    for (int i = 0; i < 40; ++i) pathological += "a?";
+    auto start = std::chrono::high_resolution_clock::now();
+    TestFramework::assert_equal(n_a, first(pathological + n_a, n_a), "Pathological pattern matches");
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    TestFramework::assert_true(elapsed < 1000.0, "Pathological pattern stays linear");
+    
+    // Differential check against std::regex on random patterns, and chunked
+    // input against contiguous input
+    std::mt19937 rng(31);
+    const char* atoms[] = {"a", "b", "(a|b)", "(?:ab|a)", "[ab]", "b*", "a+?", "(a?b)?", "."};
+    bool agree = true;
+    for (int round = 0; round < 300 && agree; ++round) {
+        std::string pattern;
+        for (int i = 0, n = 1 + rng() % 4; i < n; ++i) pattern += atoms[rng() % 9];
+        if (rng() % 3 == 0) pattern += "|" + std::string(atoms[rng() % 9]);
+        std::string subject;
+        for (int i = 0, n = rng() % 24; i < n; ++i) subject += "abx"[rng() % 3];
+        
+        RegexEngine regex(pattern);
+        std::vector<std::pair<size_t, size_t>> ours;
+        regex.for_each_match(subject, 0, [&](const RegexEngine::Match& match) {
+            ours.emplace_back(match.position, match.length);
+            return true;
+        });
+        std::vector<std::string_view> chunks;
+        for (size_t i = 0; i < subject.size(); i += 3) chunks.push_back(std::string_view(subject).substr(i, 3));
+        std::vector<std::pair<size_t, size_t>> chunked;
+        regex.for_each_match(chunks, 0, [&](const RegexEngine::Match& match) {
+            chunked.emplace_back(match.position, match.length);
+            return true;
+        });
+        
+        std::vector<std::pair<size_t, size_t>> reference;
+        std::regex std_regex(pattern, std::regex::ECMAScript);
+        for (size_t pos = 0; pos <= subject.size();) {
+            std::smatch match;
+            auto begin = subject.cbegin() + static_cast<std::ptrdiff_t>(pos);
+            auto flags = pos > 0 ? std::regex_constants::match_prev_avail : std::regex_constants::match_default;
+            if (!std::regex_search(begin, subject.cend(), match, std_regex, flags)) break;
+            size_t position = pos + static_cast<size_t>(match.position(0));
+            size_t length = static_cast<size_t>(match.length(0));
+            reference.emplace_back(position, length);
+            pos = position + std::max<size_t>(length, 1);
+        }
+        agree = ours == reference && chunked == ours;
+        if (!agree) std::cout << "  Mismatch: /" << pattern << "/ on \"" << subject << "\"\n";
+    }
+    TestFramework::assert_true(agree, "Matches agree with std::regex and across chunks");
+}
+
+void test_find_regex() {
+    PieceTable doc("");
+    doc.insert(0, "int count = 10;\n");
+    doc.insert(0, "int total = 3");
+    doc.insert(13, "2;\n");   // "int total = 32;\n" spread over pieces
+    
+    FindDialog finder;
+    finder.set_use_regex(true);
+    finder.set_case_sensitive(true);
+    auto matches = finder.find_all(doc, "(\\w+) = (\\d+)");
+    TestFramework::assert_equal(size_t(2), matches.size(), "Regex matches across pieces");
+    TestFramework::assert_true(matches.size() == 2 && matches[0].length == 10 && matches[1].line == 1 &&
+                               matches[1].column == 4, "Regex match lines and columns");
+    SearchMatch match;
+    TestFramework::assert_true(finder.find_previous(doc, "\\d+", doc.get_total_length(), match) &&
+                               match.line == 1 && match.length == 2, "Regex find_previous");
+    
+    std::string text = doc.get_text(0, doc.get_total_length());
+    TestFramework::assert_equal(2, finder.replace_all(text, "(\\w+) = (\\d+)", "$2 = $1"), "Regex replace count");
+    TestFramework::assert_equal(std::string("int 32 = total;\nint 10 = count;\n"), text, "Replace with captures");
+    
+    TestFramework::assert_true(finder.find_all(doc, "(unclosed").empty() && !finder.get_regex_error().empty(),
+                               "Invalid pattern reported");
+}
+
+void test_search_session_incremental() {
+    auto doc = std::make_shared<PieceTable>("");
+    std::string text;
+    for (int i = 0; i < 400; ++i) text += (i % 7 ? "abab aab Abba\n" : "xx ababab\n");
+    doc->insert(0, text);
+    
+    FindDialog finder;
+    SearchSession session(&finder);
+    session.set_document(doc);
+    auto run = [&](size_t budget) {
+        size_t steps = 0;
+        while (!session.is_complete()) {
+            session.step(budget);
+            ++steps;
+        }
+        return steps;
+    };
+    auto same = [](const std::vector<SearchMatch>& a, const std::vector<SearchMatch>& b) {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); ++i) {
+            if (a[i].position != b[i].position || a[i].line != b[i].line || a[i].column != b[i].column ||
+                a[i].length != b[i].length) {
+                return false;
+            }
+        }
+        return true;
+    };
+    
+    // Typing the query refines the previous matches; small budgets spread the work
+    bool agree = true;
+    for (const std::string query : {"a", "ab", "aba", "abab"}) {
+        session.set_query(query);
+        TestFramework::assert_true(run(512) > 1 || query.size() > 1, "Search is chunked");
+        agree = agree && same(session.matches(), finder.find_all(*doc, query));
+    }
+    TestFramework::assert_true(agree, "Refined matches equal find_all");
+    
+    // Edits rescan only around the change
+    std::mt19937 rng(7);
+    for (int round = 0; round < 200 && agree; ++round) {
+        size_t length = doc->get_total_length();
+        size_t position = rng() % (length + 1);
+        if (rng() % 3 == 0 && position < length) {
+            doc->remove(position, std::min<size_t>(1 + rng() % 6, length - position));
+        } else {
+            const char* pieces[] = {"ab", "\nab", "b", "ABAB", "x\n"};
+            doc->insert(position, pieces[rng() % 5]);
+        }
+        size_t pending = session.pending_bytes();
+        agree = pending < 64 && (run(64), same(session.matches(), finder.find_all(*doc, "abab")));
+    }
+    TestFramework::assert_true(agree, "Matches stay exact across edits");
+    
+    // Regex sessions rescan the edited lines
+    finder.set_use_regex(true);
+    session.set_query("a+b");
+    run(256);
+    doc->insert(3, "aaab\n");
+    doc->remove(20, 4);
+    TestFramework::assert_true(session.pending_bytes() < 100, "Regex dirties the edited lines");
+    run(256);
+    TestFramework::assert_true(same(session.matches(), finder.find_all(*doc, "a+b")), "Regex session matches");
+    
+    // Cancelling keeps what was found and stops
+    finder.set_use_regex(false);
+    session.set_query("Abba");
+    session.step(1024);
+    size_t found = session.matches().size();
+    session.cancel();
+    TestFramework::assert_true(session.is_complete() && !session.step() && session.matches().size() == found &&
+                               found > 0 && found < finder.find_all(*doc, "Abba").size(), "Cancel stops the scan");
+}
+
+// ============================================================================
+// UNIT TESTS - BackgroundIndexer
 // ============================================================================
 
-void test_undo_manager_single_insert() {
-    PieceTable doc("Hello");
-    UndoManager undo;
+void test_indexer_ranked_search() {
+    BackgroundIndexer indexer;
+    indexer.index_file("lib/d.cpp", "widget\n");
+    indexer.index_file("src/ui/b.cpp", "widget\nwidget\nint widget;\n");
+    indexer.index_file("src/core/a.cpp", "widget\n");
+    indexer.index_file("lib/c.cpp", "widget\n");
+    auto files = [&indexer](size_t max_results) {
+        std::string order;
+        for (const auto& result : indexer.search("Widget", max_results)) order += result.file_path + " ";
+        return order;
+    };
+    // Frequency first, then path: never the order files were indexed in
+    TestFramework::assert_equal(std::string("src/ui/b.cpp src/ui/b.cpp src/ui/b.cpp lib/c.cpp lib/d.cpp src/core/a.cpp "),
+                                files(10), "Ranked by frequency");
+    TestFramework::assert_equal(std::string("src/ui/b.cpp src/ui/b.cpp "), files(2), "Top K postings only");
+    
+    // Open files pull their neighbours up, recent files too
+    uint64_t generation = indexer.generation();
+    indexer.set_ranking_context({"src/core/main.cpp"}, {"lib/d.cpp", "lib/c.cpp"});
+    TestFramework::assert_true(indexer.generation() > generation, "Context change invalidates answers");
+    TestFramework::assert_equal(std::string("src/ui/b.cpp src/ui/b.cpp src/ui/b.cpp src/core/a.cpp lib/d.cpp lib/c.cpp "),
+                                files(10), "Proximity and recency");
+    
+    // Repeated queries are answered from the cache until the index changes
+    generation = indexer.generation();
+    auto first = indexer.search("widget", 10);
+    auto again = indexer.search("widget", 10);
+    TestFramework::assert_true(indexer.generation() == generation && again.size() == first.size() &&
+                                   again[3].file_path == first[3].file_path, "Same answer");
+    indexer.index_file("lib/c.cpp", "widget widget widget widget widget widget widget\n");
+    TestFramework::assert_equal(std::string("lib/c.cpp"), indexer.search("widget", 10)[0].file_path,
+                                "Re-indexing invalidates the cache");
+    indexer.remove_file("lib/c.cpp");
+    TestFramework::assert_equal(size_t(5), indexer.search("widget", 10).size(), "Removal invalidates the cache");
+}
+
+void test_indexer_reindex_and_remove() {
+    BackgroundIndexer indexer;
+    indexer.index_file("a.cpp", "int render_frame();\nvoid render(int frame);\n");
+    indexer.index_file("b.cpp", "render\n");
+    TestFramework::assert_equal(size_t(2), indexer.search("render").size(), "Whole words across files");
+    
+    // Re-indexing replaces the file's old postings
+    indexer.index_file("a.cpp", "// nothing here\nRender();\n");
+    auto results = indexer.search("render");
+    TestFramework::assert_equal(size_t(2), results.size(), "Old postings are gone");
+    TestFramework::assert_equal(std::string("a.cpp"), results[0].file_path, "Re-indexed file (ties by path)");
+    TestFramework::assert_equal(std::string("b.cpp"), results[1].file_path, "Untouched file");
+    TestFramework::assert_equal(size_t(1), results[0].line_number, "Line number");
+    TestFramework::assert_equal(std::string("Render();"), results[0].line_content, "Line content");
+    TestFramework::assert_equal(size_t(0), indexer.search("render_frame").size(), "Word only in old version");
+    
+    indexer.remove_file("b.cpp");
+    TestFramework::assert_equal(size_t(1), indexer.get_indexed_file_count(), "File count");
+    TestFramework::assert_equal(size_t(1), indexer.search("render").size(), "Removed file not found");
+}
+
+void test_indexer_symbol_definitions() {
+    BackgroundIndexer indexer;
+    indexer.index_file("shape.h", "#define SHAPE_MAX 8\nstruct Shape {\n    virtual double area() const = 0;\n};\n"
+                                  "enum class Color { Red };\nstruct Shape shape_value;\n");
+    indexer.index_file("shape.cpp", "#include \"shape.h\"\ndouble Circle::area() const {\n    return compute_area(r);\n}\n"
+                                    "static int helper(int x)\n{\n    if (x) {\n        helper(x - 1);\n    }\n}\n");
+    indexer.index_file("tool.py", "class Runner(Base):\n    async def run_all(self):\n        shape = Shape()\n");
+    indexer.index_file("notes.txt", "struct Shape {\n");
+    
+    auto shapes = indexer.find_definitions("Shape");
+    TestFramework::assert_equal(size_t(1), shapes.size(), "Struct definition, not the use or the text file");
+    TestFramework::assert_true(shapes[0].file_path == "shape.h" && shapes[0].line_number == 1 && shapes[0].column == 7,
+                               "Definition position");
+    TestFramework::assert_equal(size_t(1), indexer.find_definitions("SHAPE_MAX").size(), "Macro");
+    TestFramework::assert_equal(size_t(1), indexer.find_definitions("Color").size(), "enum class");
+    auto area = indexer.find_definitions("area");
+    TestFramework::assert_true(area.size() == 1 && area[0].file_path == "shape.cpp", "Qualified member function, not its declaration");
+    TestFramework::assert_equal(size_t(1), indexer.find_definitions("helper").size(), "Function, not its recursive call");
+    TestFramework::assert_equal(size_t(0), indexer.find_definitions("compute_area").size(), "Calls are not definitions");
+    TestFramework::assert_equal(size_t(1), indexer.find_definitions("run_all").size(), "Python method");
+    TestFramework::assert_equal(size_t(0), indexer.find_definitions("shape").size(), "Definitions are case-sensitive");
+    
+    // References match the exact spelling; definitions stay out of word search and the vocabulary
+    TestFramework::assert_equal(size_t(4), indexer.find_references("Shape").size(), "Case-sensitive references");
+    TestFramework::assert_equal(size_t(2), indexer.find_references("helper").size(), "Definition and call");
+    indexer.publish_vocabulary();
+    TestFramework::assert_true(indexer.vocabulary()->find(std::string(1, '\x01') + "Shape") == nullptr, "Not in the vocabulary");
+    
+    indexer.index_file("shape.cpp", "// moved\n");
+    TestFramework::assert_equal(size_t(0), indexer.find_definitions("helper").size(), "Re-indexed file drops its definitions");
+}
+
+void test_indexer_compacts_stale_postings() {
+    BackgroundIndexer indexer;
+    for (int i = 0; i < 100; ++i) {
+        indexer.index_file("file" + std::to_string(i), "shared_word\n");
+    }
+    // Saving one file over and over must not grow the index
+    for (int round = 0; round < 1000; ++round) {
+        indexer.index_file("file0", "shared_word\n");
+    }
+    TestFramework::assert_true(indexer.get_posting_count("shared_word") <= 200, "Stale postings are purged");
+    TestFramework::assert_equal(size_t(100), indexer.search("shared_word", 1000).size(), "Live postings kept");
+    
+    for (int i = 0; i < 100; ++i) indexer.remove_file("file" + std::to_string(i));
+    TestFramework::assert_equal(size_t(0), indexer.get_posting_count("shared_word"), "Empty list dropped");
+    TestFramework::assert_equal(size_t(0), indexer.search("shared_word").size(), "No results");
+}
+
+void test_indexer_find_in_files() {
+    BackgroundIndexer indexer;
+    indexer.index_file("a.cpp", "void HandleRequest(int id);\nint handler_count = 3;\n");
+    indexer.index_file("b.cpp", "// nothing relevant\nauto x = handle_request(7);\n");
+    indexer.index_file("c.cpp", "request queue\n");
+    
+    auto results = indexer.find_in_files("request");
+    TestFramework::assert_equal(size_t(3), results.size(), "Case-insensitive substring in every file");
+    results = indexer.find_in_files("Request", false, true);
+    TestFramework::assert_equal(size_t(1), results.size(), "Case-sensitive substring");
+    TestFramework::assert_equal(std::string("a.cpp"), results[0].file_path, "File");
+    TestFramework::assert_equal(size_t(11), results[0].column, "Column");
+    TestFramework::assert_equal(size_t(7), results[0].length, "Length");
+    
+    results = indexer.find_in_files("handle_?request\\(\\d+\\)", true);
+    TestFramework::assert_equal(size_t(1), results.size(), "Regex match");
+    TestFramework::assert_equal(std::string("b.cpp"), results[0].file_path, "Regex file");
+    TestFramework::assert_equal(std::string("handle_request(7)"), results[0].line_content.substr(results[0].column, results[0].length), "Regex span");
+    TestFramework::assert_equal(size_t(2), indexer.find_in_files("^(int|auto) ", true).size(), "Regex without literals scans");
+    TestFramework::assert_equal(size_t(0), indexer.find_in_files("[unclosed", true).size(), "Invalid regex");
+    
+    indexer.remove_file("b.cpp");
+    TestFramework::assert_equal(size_t(2), indexer.find_in_files("request").size(), "Removed file is not a candidate");
+    
+    typedef std::vector<std::string> Runs;
+    TestFramework::assert_true(BackgroundIndexer::regex_literals("foo\\.bar+x?baz") == Runs({"foo.bar", "baz"}), "Literal runs");
+    TestFramework::assert_true(BackgroundIndexer::regex_literals("ab[c]]de(fg|hi)jkl*") == Runs({"ab", "]de", "jk"}), "Classes and groups");
+    TestFramework::assert_true(BackgroundIndexer::regex_literals("abc|def").empty(), "Alternation");
+}
+
+void test_indexer_persistent_warm_start() {
+    using editor::PlatformFile;
+    std::string root = PlatformFile::join_path(PlatformFile::get_temp_directory(), "velocity_indexer_persist");
+    PlatformFile::delete_directory(root, true);
+    PlatformFile::create_directories(root);
+    auto file = [&](const std::string& name) { return PlatformFile::join_path(root, name); };
+    for (int i = 0; i < 10; ++i) {
+        PlatformFile::write_file(file("keep" + std::to_string(i) + ".cpp"),
+                                 "int persisted_value = 1;\nclass Kept" + std::to_string(i) + " {\n};\n", editor::LineEnding::LF);
+    }
+    PlatformFile::write_file(file("edit.cpp"), "int persisted_value = 2;\n", editor::LineEnding::LF);
+    PlatformFile::write_file(file("gone.cpp"), "int persisted_value = 3;\n", editor::LineEnding::LF);
+    
+    {
+        BackgroundIndexer cold;
+        TestFramework::assert_true(!cold.open_persistent_index(root), "No index yet");
+        cold.index_workspace({root});
+        cold.wait_for_indexing();
+    }
+    TestFramework::assert_true(PlatformFile::exists(BackgroundIndexer::get_persistent_index_file(root)), "Index saved under .velocity");
+    
+    // A new session can search before crawling anything
+    BackgroundIndexer warm;
+    TestFramework::assert_true(warm.open_persistent_index(root), "Index mapped");
+    TestFramework::assert_equal(size_t(12), warm.get_indexed_file_count(), "Files from disk");
+    TestFramework::assert_equal(size_t(12), warm.search("persisted_value").size(), "Word search from disk");
+    TestFramework::assert_equal(size_t(12), warm.find_in_files("isted_val").size(), "Substring search from disk");
+    TestFramework::assert_equal(size_t(1), warm.find_definitions("Kept3").size(), "Definitions from disk");
+    
+    PlatformFile::write_file(file("edit.cpp"), "// changed\nint persisted_value = 20;\n", editor::LineEnding::LF);
+    PlatformFile::delete_file(file("gone.cpp"));
+    PlatformFile::write_file(file("new.cpp"), "int persisted_value = 4;\n", editor::LineEnding::LF);
+    warm.index_workspace({root});
+    warm.wait_for_indexing();
+    auto results = warm.find_in_files("persisted_value = 2", false, true);
+    TestFramework::assert_equal(size_t(1), results.size(), "Changed file re-indexed");
+    TestFramework::assert_equal(size_t(1), results[0].line_number, "New content");
+    TestFramework::assert_equal(size_t(0), warm.find_in_files("value = 3").size(), "Deleted file dropped");
+    TestFramework::assert_equal(size_t(12), warm.search("persisted_value").size(), "Base and new files together");
+    warm.stop();
+    
+    BackgroundIndexer again;
+    TestFramework::assert_true(again.open_persistent_index(root), "Rewritten index mapped");
+    TestFramework::assert_equal(size_t(12), again.get_indexed_file_count(), "Merged index persisted");
+    TestFramework::assert_equal(size_t(1), again.find_in_files("value = 4").size(), "New file persisted");
+    
+    PlatformFile::write_file(BackgroundIndexer::get_persistent_index_file(root), "garbage", editor::LineEnding::LF);
+    BackgroundIndexer corrupt;
+    TestFramework::assert_true(!corrupt.open_persistent_index(root), "Corrupt index rejected");
+    PlatformFile::delete_directory(root, true);
+}
+
+void test_indexer_reads_lines_on_demand() {
+    using editor::PlatformFile;
+    std::string root = PlatformFile::join_path(PlatformFile::get_temp_directory(), "velocity_indexer_lines");
+    PlatformFile::delete_directory(root, true);
+    PlatformFile::create_directories(root);
+    std::string path = PlatformFile::join_path(root, "crlf.cpp");
+    std::string content;
+    for (int i = 0; i < 2000; ++i) content += "int on_demand_" + std::to_string(i) + " = lookup_value(" + std::to_string(i) + ");\r\n";
+    PlatformFile::write_file(path, content, editor::LineEnding::CRLF);
+    
+    BackgroundIndexer indexer;
+    indexer.index_workspace({root});
+    indexer.wait_for_indexing();
+    auto results = indexer.search("on_demand_1234");
+    TestFramework::assert_equal(size_t(1), results.size(), "Word found");
+    TestFramework::assert_equal(std::string("int on_demand_1234 = lookup_value(1234);"), results[0].line_content, "Line read from disk without CR");
+    TestFramework::assert_true(indexer.get_line_table_bytes() * 10 < content.size(), "Only line offsets are held");
+    
+    // An open tab wins over the file on disk
+    TabManager tabs;
+    tabs.new_tab("edited line 0\nedited line 1\n", path);
+    indexer.set_document_lookup([&tabs](const std::string& p) { return tabs.find_document(p); });
+    TestFramework::assert_equal(size_t(0), indexer.find_in_files("lookup_value(1)").size(), "Verified against the open buffer");
+    TestFramework::assert_equal(size_t(0), indexer.find_in_files("edited line").size(), "Candidates come from the indexed text");
+    TestFramework::assert_equal(std::string("edited line 1"), indexer.search("on_demand_1")[0].line_content, "Line from the open buffer");
+    
+    indexer.stop();
+    PlatformFile::delete_directory(root, true);
+}
+
+void test_thread_pool_runs_nested_tasks() {
+    ThreadPool pool(4);
+    std::atomic<size_t> done{0};
+    std::atomic<bool> off_pool{false};
+    std::function<void(int)> spawn = [&](int depth) {
+        done.fetch_add(1);
+        if (pool.current_worker() >= pool.size()) off_pool.store(true);
+        if (depth == 0) return;
+        pool.submit([&, depth] { spawn(depth - 1); });
+        pool.submit([&, depth] { spawn(depth - 1); });
+    };
+    pool.submit([&] { spawn(10); });
+    pool.wait_idle();
+    TestFramework::assert_equal(size_t(2047), done.load(), "Every nested task ran");
+    TestFramework::assert_true(!off_pool.load(), "Tasks run on pool workers");
+    TestFramework::assert_equal(ThreadPool::npos, pool.current_worker(), "Caller is not a worker");
+}
+
+void test_thread_pool_priorities_and_cancellation() {
+    // Two workers: background work may hold one, never both
+    ThreadPool pool(2);
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool release = false;
+    bool background_started = false;
+    bool second_background = false;
+    bool visible_ran = false;
+    auto wait_for = [&](const std::function<bool()>& ready) {
+        std::unique_lock<std::mutex> lock(mutex);
+        return changed.wait_for(lock, std::chrono::seconds(5), ready);
+    };
+    pool.submit([&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        background_started = true;
+        changed.notify_all();
+        changed.wait(lock, [&] { return release; });
+    }, TaskPriority::Background);
+    TestFramework::assert_true(wait_for([&] { return background_started; }), "Background task runs");
+    pool.submit([&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        second_background = true;
+        changed.notify_all();
+    }, TaskPriority::Idle);
+    pool.submit([&] {
+        std::lock_guard<std::mutex> lock(mutex);
+        visible_ran = true;
+        changed.notify_all();
+    }, TaskPriority::Visible);
+    TestFramework::assert_true(wait_for([&] { return visible_ran; }), "Visible work gets the free worker");
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        TestFramework::assert_true(!second_background, "Low work waits for the low slot");
+        release = true;
+        changed.notify_all();
+    }
+    pool.wait_idle();
+    TestFramework::assert_true(second_background, "Low work runs once the slot is free");
+    
+    // Cancelled before a worker takes it: dropped, and still counted done
+    CancellationSource source;
+    std::atomic<int> ran{0};
+    source.cancel();
+    pool.submit([&] { ++ran; }, TaskPriority::Visible, source.token());
+    TaskGroup group(pool);
+    group.submit([&] { ++ran; }, TaskPriority::Background, source.token());
+    group.submit([&] { ++ran; });
+    group.wait();
+    pool.wait_idle();
+    TestFramework::assert_equal(1, ran.load(), "Cancelled tasks skipped");
+    
+    // Results come back through the UI queue, which wakes its owner once
+    MainThreadQueue ui;
+    std::atomic<int> wakes{0};
+    ui.set_notify([&] { ++wakes; });
+    int answer = 0;
+    bool cancelled_then = false;
+    CancellationSource stale;
+    run_then(group, ui, [] { return 6 * 7; }, [&](int value) { answer = value; });
+    run_then(group, ui, [] { return 1; }, [&](int) { cancelled_then = true; }, TaskPriority::Visible, stale.token());
+    stale.cancel();
+    group.wait();
+    TestFramework::assert_true(wakes.load() <= 1, "One wake for a batch of continuations");
+    ui.drain();
+    TestFramework::assert_equal(42, answer, "Continuation ran with the result");
+    TestFramework::assert_true(!cancelled_then, "Cancelled continuation dropped");
+    
+#if defined(EDITOR_COROUTINES)
+    std::thread::id worker_thread;
+    std::thread::id ui_thread;
+    auto job = [&]() -> DetachedTask {
+        if (!co_await resume_on(group, TaskPriority::Background)) co_return;
+        worker_thread = std::this_thread::get_id();
+        if (!co_await resume_on(ui)) co_return;
+        ui_thread = std::this_thread::get_id();
+    };
+    job();
+    group.wait();
+    ui.drain();
+    TestFramework::assert_true(worker_thread != std::this_thread::get_id() && ui_thread == std::this_thread::get_id(),
+                               "Coroutine hops to a worker and back");
+#endif
+}
+
+void test_indexer_crawls_workspace() {
+    std::string root = editor::PlatformFile::join_path(editor::PlatformFile::get_temp_directory(), "velocity_indexer_crawl");
+    editor::PlatformFile::delete_directory(root, true);
+    for (int d = 0; d < 8; ++d) {
+        std::string dir = editor::PlatformFile::join_path(root, "dir" + std::to_string(d));
+        editor::PlatformFile::create_directories(dir);
+        for (int f = 0; f < 25; ++f) {
+            editor::PlatformFile::write_file(editor::PlatformFile::join_path(dir, "f" + std::to_string(f) + ".cpp"),
+                                             "void crawl_target();\nint other;\n", editor::LineEnding::LF);
+        }
+    }
+    std::string hidden = editor::PlatformFile::join_path(root, ".velocity");
+    editor::PlatformFile::create_directories(hidden);
+    editor::PlatformFile::write_file(editor::PlatformFile::join_path(hidden, "cache.txt"), "crawl_target", editor::LineEnding::LF);
     
-    auto cmd = std::make_unique<InsertCommand>(&doc, 5, " World");
-    undo.execute(std::move(cmd));
+    BackgroundIndexer indexer;
+    indexer.index_workspace({root});
+    indexer.wait_for_indexing();
+    TestFramework::assert_true(!indexer.is_indexing(), "Crawl finished");
+    TestFramework::assert_equal(size_t(200), indexer.get_indexed_file_count(), "Every file indexed, hidden dirs skipped");
+    auto results = indexer.search("crawl_target", 1000);
+    TestFramework::assert_equal(size_t(200), results.size(), "Postings merged from every shard");
+    TestFramework::assert_equal(std::string("void crawl_target();"), results[0].line_content, "Line content");
     
-    TestFramework::assert_equal(std::string("Hello World"), 
-                                doc.get_text(0, doc.get_total_length()),
-                                "After insert");
+    indexer.stop();
+    editor::PlatformFile::delete_directory(root, true);
+}
+
+void test_workspace_replace_applies_atomically() {
+    using editor::PlatformFile;
+    std::string root = PlatformFile::join_path(PlatformFile::get_temp_directory(), "velocity_workspace_replace");
+    PlatformFile::delete_directory(root, true);
+    PlatformFile::create_directories(root);
+    std::vector<std::string> paths;
+    for (int f = 0; f < 40; ++f) {
+        paths.push_back(PlatformFile::join_path(root, "f" + std::to_string(f) + ".cpp"));
+        PlatformFile::write_file(paths.back(), f % 4 ? "int old_name = 1;\nold_name++;\n" : "int other;\n",
+                                 editor::LineEnding::LF);
+    }
+    auto read = [](const std::string& path) {
+        std::string content;
+        PlatformFile::read_file(path, content);
+        return content;
+    };
     
-    undo.undo();
-    TestFramework::assert_equal(std::string("Hello"), 
-                                doc.get_text(0, doc.get_total_length()),
-                                "After undo");
+    BackgroundIndexer indexer;
+    indexer.index_workspace({root});
+    indexer.wait_for_indexing();
+    WorkspaceReplace::Options options;
+    auto candidates = WorkspaceReplace::candidate_files(indexer, "old_name", options);
+    TestFramework::assert_equal(size_t(30), candidates.size(), "Indexer pre-filters the files");
+    
+    // One file is open in the editor with unsaved text
+    auto open = std::make_shared<PieceTable>("old_name(); // open\n");
+    auto lookup = [&](const std::string& path) { return path == paths[1] ? open : nullptr; };
+    WorkspaceReplace replace;
+    
+    // A file changed after planning aborts the whole apply
+    auto plan = replace.plan(candidates, "old_name", "new_name", options, lookup);
+    TestFramework::assert_equal(size_t(30), plan.size(), "Every candidate has edits");
+    PlatformFile::write_file(paths[2], "int old_name = 22;\n", editor::LineEnding::LF);
+    auto result = replace.apply(plan);
+    TestFramework::assert_true(!result.ok && read(paths[3]) == "int old_name = 1;\nold_name++;\n" &&
+                               !PlatformFile::exists(paths[3] + ".velocity-replace.tmp") &&
+                               open->get_text(0, 8) == "old_name", "Stale plan changes nothing");
+    
+    options.use_regex = true;
+    plan = replace.plan(candidates, "old_(\\w+)", "new_$1", options, lookup);
+    result = replace.apply(plan);
+    TestFramework::assert_true(result.ok && result.files == 30 && result.replacements == 58, "Replacement counts");
+    TestFramework::assert_equal(std::string("int new_name = 1;\nnew_name++;\n"), read(paths[3]), "File rewritten");
+    TestFramework::assert_equal(std::string("int new_name = 22;\n"), read(paths[2]), "Changed file replanned");
+    TestFramework::assert_equal(std::string("new_name(); // open\n"), open->get_text(0, open->get_total_length()),
+                                "Open document edited in place");
+    open->undo();
+    TestFramework::assert_equal(std::string("old_name(); // open\n"), open->get_text(0, open->get_total_length()),
+                                "One undo step per document");
+    
+    indexer.stop();
+    PlatformFile::delete_directory(root, true);
 }
 
-void test_undo_manager_single_delete() {
-    PieceTable doc("Hello World");
-    UndoManager undo;
+void test_batch_edit_runs_programs() {
+    using editor::BatchEdit;
+    using editor::PlatformFile;
+    BatchEdit batch;
+    TestFramework::assert_true(!batch.parse("s/a/b/\n2,x d\n") && batch.error().rfind("line 2", 0) == 0,
+                               "Errors name their line");
+    TestFramework::assert_true(!batch.parse("s/(a/b/") && !batch.error().empty(), "Bad regex rejected");
     
-    auto cmd = std::make_unique<DeleteCommand>(&doc, 5, 6);
-    undo.execute(std::move(cmd));
+    // Commands run in order; addresses are 1-based lines, ranges and anchors
+    TestFramework::assert_true(batch.parse("# rename\n"
+                                           "s/old_(\\w+)/new_$1/g\n"
+                                           "3,4s|x|X|\n"
+                                           "/^$/d\n"
+                                           "/^#include/i // header\n"
+                                           "$a // end\n"), "Program parses");
+    TestFramework::assert_equal(size_t(5), batch.commands().size(), "Comments skipped");
+    PieceTable document("#include <a>\nold_x = old_y;\nx x\n\nx old_z\n");
+    size_t edits = batch.apply(document);
+    TestFramework::assert_equal(std::string("// header\n#include <a>\nnew_x = new_y;\nX x\nx new_z\n// end\n"),
+                                document.get_text(0, document.get_total_length()), "Program applied");
+    TestFramework::assert_equal(size_t(7), edits, "Edits counted");
+    document.undo();
+    TestFramework::assert_equal(std::string("#include <a>\nold_x = old_y;\nx x\n\nx old_z\n"),
+                                document.get_text(0, document.get_total_length()), "One undo step");
     
-    TestFramework::assert_equal(std::string("Hello"), 
-                                doc.get_text(0, doc.get_total_length()),
-                                "After delete");
+    // Files in parallel; only changed ones are rewritten
+    std::string root = PlatformFile::join_path(PlatformFile::get_temp_directory(), "velocity_batch_edit");
+    PlatformFile::delete_directory(root, true);
+    PlatformFile::create_directories(PlatformFile::join_path(root, "sub"));
+    PlatformFile::create_directories(PlatformFile::join_path(root, ".git"));
+    for (int f = 0; f < 30; ++f) {
+        std::string dir = PlatformFile::join_path(root, f % 2 ? "sub" : "");
+        PlatformFile::write_file(PlatformFile::join_path(dir, "f" + std::to_string(f) + ".txt"),
+                                 f % 3 ? "keep\r\nTODO: one\r\n" : "keep\r\n", editor::LineEnding::CRLF);
+    }
+    PlatformFile::write_file(PlatformFile::join_path(root, ".git/config"), "TODO\n", editor::LineEnding::LF);
+    auto files = BatchEdit::expand_paths({root});
+    TestFramework::assert_equal(size_t(30), files.size(), "Hidden entries skipped");
+    TestFramework::assert_true(batch.parse("/TODO/i // reviewed\ns/todo: /DONE /i"), "Second program parses");
+    BatchEdit::Result dry = batch.run(files, true);
+    std::string content;
+    PlatformFile::read_file(PlatformFile::join_path(root, "sub/f1.txt"), content);
+    TestFramework::assert_true(dry.ok() && dry.changed == 20 && content.find("TODO") != std::string::npos,
+                               "Dry run writes nothing");
+    BatchEdit::Result result = batch.run(files);
+    TestFramework::assert_true(result.ok() && result.files == 30 && result.changed == 20 && result.edits == 40,
+                               "Batch counts");
+    std::vector<uint8_t> bytes;
+    PlatformFile::read_file_binary(PlatformFile::join_path(root, "sub/f1.txt"), bytes);
+    TestFramework::assert_equal(std::string("keep\r\n// reviewed\r\nDONE one\r\n"),
+                                std::string(bytes.begin(), bytes.end()), "Line breaks kept");
+    TestFramework::assert_true(!PlatformFile::exists(PlatformFile::join_path(root, "sub/f1.txt.velocity-batch.tmp")),
+                               "Temp renamed");
+    PlatformFile::delete_directory(root, true);
+}
+
+void test_document_transforms_run_in_chunks() {
+    using editor::DocumentTransform;
+    using editor::TransformPipeline;
+    // Many small chunks, so every stage crosses chunk boundaries
+    std::string lines;
+    std::vector<std::string> expected;
+    uint32_t seed = 7;
+    for (int i = 0; i < 500; ++i) {
+        seed = seed * 1103515245 + 12345;
+        std::string line = "line " + std::to_string((seed >> 16) % 97);
+        lines += line + "\n";
+        expected.push_back(line);
+    }
+    lines += "last";
+    expected.push_back("last");
+    PieceTable doc(lines);
+    TestFramework::assert_true(TransformPipeline::transform(doc, DocumentTransform::sort_lines(), 256), "Sort applied");
+    std::sort(expected.begin(), expected.end());
+    std::string sorted;
+    for (const std::string& line : expected) sorted += (sorted.empty() ? "" : "\n") + line;
+    TestFramework::assert_equal(sorted, doc.get_text(0, doc.get_total_length()), "Sorted across chunks");
+    TestFramework::assert_equal(size_t(1), doc.get_undo_count(), "One undo step");
+    doc.undo();
+    TestFramework::assert_equal(lines, doc.get_text(0, doc.get_total_length()), "Sort undone");
     
-    undo.undo();
-    TestFramework::assert_equal(std::string("Hello World"), 
-                                doc.get_text(0, doc.get_total_length()),
-                                "After undo");
+    expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+    TestFramework::assert_true(TransformPipeline::transform(doc, DocumentTransform::unique_lines(), 256), "Unique applied");
+    std::vector<std::string> kept;
+    std::string text = doc.get_text(0, doc.get_total_length());
+    for (size_t start = 0; start <= text.size();) {
+        size_t end = (std::min)(text.find('\n', start), text.size());
+        kept.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+    TestFramework::assert_equal(expected.size(), kept.size(), "Each line once");
+    TestFramework::assert_equal(std::string("line "), text.substr(0, 5), "First occurrence kept in place");
+    
+    PieceTable code("if (x) {\n\tcall();\n  \tnested();\n}\n");
+    TestFramework::assert_true(TransformPipeline::transform(code, DocumentTransform::reindent(4, true), 8), "Reindented");
+    TestFramework::assert_equal(std::string("if (x) {\n    call();\n    nested();\n}\n"),
+                                code.get_text(0, code.get_total_length()), "Tabs to spaces");
+    
+    // JSON is cut anywhere, even inside strings and escapes
+    std::string json = R"({"a":[1,2,{"b":"x\"}{,"}],"c":{},"d" : true})";
+    std::string pretty = "{\n  \"a\": [\n    1,\n    2,\n    {\n      \"b\": \"x\\\"}{,\"\n    }\n  ],\n"
+                         "  \"c\": {},\n  \"d\": true\n}\n";
+    for (size_t chunk : {size_t(1), size_t(3), size_t(1000)}) {
+        PieceTable data(json);
+        TestFramework::assert_true(TransformPipeline::transform(data, DocumentTransform::pretty_json(), chunk),
+                                   "JSON formatted");
+        TestFramework::assert_equal(pretty, data.get_text(0, data.get_total_length()), "Same at any chunk size");
+    }
+    PieceTable broken("{\"a\": [1, 2}");
+    auto rejected = TransformPipeline::run(*broken.snapshot(), DocumentTransform::pretty_json());
+    TestFramework::assert_true(!rejected.error.empty() && !TransformPipeline::apply(broken, rejected), "Bad JSON rejected");
+    
+    // A result is only applied to the version it was computed from
+    PieceTable moved("b\na\n");
+    auto result = TransformPipeline::run(*moved.snapshot(), DocumentTransform::sort_lines());
+    moved.insert(0, "c\n");
+    TestFramework::assert_true(!TransformPipeline::apply(moved, result), "Stale result dropped");
+    CancellationSource cancel;
+    cancel.cancel();
+    size_t reported = 0;
+    result = TransformPipeline::run(*moved.snapshot(), DocumentTransform::sort_lines(), cancel.token(),
+                                    [&](size_t, size_t) { ++reported; });
+    TestFramework::assert_true(result.cancelled && reported == 0 && !TransformPipeline::apply(moved, result),
+                               "Cancelled before any chunk ran");
+    
+    // Run from pool tasks, as the GUI does, with every worker busy in one
+    std::string many;
+    for (int i = 0; i < 2000; ++i) many += std::to_string(2000 - i) + "\n";
+    PieceTable source(many);
+    auto shared = source.snapshot();
+    size_t workers = ThreadPool::shared().size();
+    std::vector<std::promise<size_t>> finished(workers);
+    std::vector<std::future<size_t>> results;
+    for (auto& promise : finished) results.push_back(promise.get_future());
+    for (size_t i = 0; i < workers; ++i) {
+        ThreadPool::shared().submit([&shared, &finished, i]() {
+            finished[i].set_value(TransformPipeline::run(*shared, DocumentTransform::sort_lines(), CancellationToken(),
+                                                         nullptr, 512).edits.size());
+        });
+    }
+    bool all_done = true;
+    for (auto& future : results) {
+        all_done = all_done && future.wait_for(std::chrono::seconds(10)) == std::future_status::ready && future.get() > 0;
+    }
+    TestFramework::assert_true(all_done, "Runs inside pool tasks without starving the pool");
+    
+    editor::TransformRegistry registry;
+    DocumentTransform upper;
+    upper.id = "example.upper";
+    upper.map = [](editor::TransformChunk& chunk, const CancellationToken&) {
+        chunk.output = chunk.text;
+        for (char& c : chunk.output) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    };
+    TestFramework::assert_true(registry.add(upper) && registry.find("sort_lines"), "Plugin transform registered");
+    TestFramework::assert_true(TransformPipeline::transform(moved, *registry.find("example.upper")), "Plugin transform ran");
+    TestFramework::assert_equal(std::string("C\nB\nA\n"), moved.get_text(0, moved.get_total_length()), "Plugin output");
 }
 
-void test_undo_manager_multiple_operations() {
-    PieceTable doc("A");
-    UndoManager undo;
+void test_remote_workspace_syncs_deltas() {
+    using namespace editor;
+    std::string root = PlatformFile::join_path(PlatformFile::get_temp_directory(), "velocity_remote_agent");
+    PlatformFile::delete_directory(root, true);
+    PlatformFile::create_directories(PlatformFile::join_path(root, "src"));
+    PlatformFile::write_file(PlatformFile::join_path(root, "notes.txt"), "one\ntwo\nthree\n", LineEnding::LF);
+    PlatformFile::write_file(PlatformFile::join_path(root, "src/main.cpp"), "int remote_marker;\n", LineEnding::LF);
     
-    undo.execute(std::make_unique<InsertCommand>(&doc, 1, "B"));
-    undo.execute(std::make_unique<InsertCommand>(&doc, 2, "C"));
-    undo.execute(std::make_unique<InsertCommand>(&doc, 3, "D"));
+    // Frames survive being cut anywhere
+    RemoteFraming framing;
+    std::string frame = RemoteWriter(7, RemoteMessage::Edit).u64(3).str("text").finish();
+    RemoteFrame parsed;
+    for (char c : frame) framing.feed(&c, 1);
+    bool whole = framing.next(parsed);
+    RemoteReader payload(parsed.payload);
+    uint64_t number = 0;
+    uint8_t past_end = 0;
+    std::string text;
+    TestFramework::assert_true(whole && parsed.channel == 7 && parsed.type == RemoteMessage::Edit && payload.u64(number) &&
+                               number == 3 && payload.str(text) && text == "text" && payload.at_end() &&
+                               !payload.u8(past_end), "Frame round trip");
     
-    TestFramework::assert_equal(std::string("ABCD"), 
-                                doc.get_text(0, doc.get_total_length()),
-                                "After inserts");
+    // The agent's answers are held back until flushed, like a slow link
+    RemoteSession session;
+    std::vector<std::string> to_agent;
+    RemoteAgent agent(root, [&session](std::string bytes) { session.receive(bytes.data(), bytes.size()); });
+    session.attach([&to_agent](std::string bytes) { to_agent.push_back(std::move(bytes)); });
+    auto flush = [&]() {
+        std::vector<std::string> frames;
+        frames.swap(to_agent);
+        std::string batch;
+        for (const std::string& bytes : frames) batch += bytes;
+        agent.receive(batch.data(), batch.size());
+        session.poll();
+    };
+    agent.start();
+    agent.wait_for_index();
+    session.poll();
+    TestFramework::assert_true(session.connected(), "Hello received");
     
-    undo.undo();
-    TestFramework::assert_equal(std::string("ABC"), 
-                                doc.get_text(0, doc.get_total_length()),
-                                "After 1 undo");
+    std::vector<RemoteSession::Entry> entries;
+    session.list("", [&](const std::string&, std::vector<RemoteSession::Entry> listed) { entries = std::move(listed); });
+    std::vector<SearchResult> results;
+    session.search("remote_marker", false, true, 10, [&](std::vector<SearchResult> found) { results = std::move(found); });
+    flush();
+    TestFramework::assert_true(entries.size() == 2 && entries[0].name == "notes.txt" && entries[0].size == 14 &&
+                               entries[1].name == "src" && entries[1].directory, "One round trip lists a directory");
+    TestFramework::assert_true(results.size() == 1 && results[0].file_path == "src/main.cpp", "Searched remotely");
     
-    undo.undo();
-    TestFramework::assert_equal(std::string("AB"), 
-                                doc.get_text(0, doc.get_total_length()),
-                                "After 2 undos");
+    auto document = session.open("notes.txt");
+    document->request_lines(0, 2);
+    flush();
+    std::string line;
+    TestFramework::assert_true(document->is_open() && document->line_count() == 4 && document->get_line(2, line) &&
+                               line == "three", "Viewport lines fetched");
+    
+    // Typing shows at once and is confirmed later, in one Ack
+    document->edit(0, 3, 0, 3, "!");
+    document->edit(1, 0, 1, 0, "new\n");
+    TestFramework::assert_true(document->get_line(0, line) && line == "one!" && document->line_count() == 5 &&
+                               document->get_line(2, line) && line == "two" && document->pending_edits() == 2,
+                               "Edits predicted");
+    flush();
+    TestFramework::assert_true(document->pending_edits() == 0 && document->acknowledged() == 2, "Edits acknowledged");
+    
+    // Lines the agent read before a later keystroke get that keystroke too
+    document->request_lines(4, 3);
+    std::vector<std::string> in_flight;
+    in_flight.swap(to_agent);
+    for (const std::string& bytes : in_flight) agent.receive(bytes.data(), bytes.size());
+    document->edit(2, 0, 3, 0, "");
+    TestFramework::assert_true(document->get_line(2, line) && line == "three", "Deletion predicted");
+    session.poll();
+    TestFramework::assert_true(document->get_line(2, line) && line == "three" && document->get_line(1, line) &&
+                               line == "new" && document->line_count() == 4, "Pending edit replayed on the fresh window");
+    flush();
+    document->save();
+    flush();
+    std::string saved;
+    PlatformFile::read_file(PlatformFile::join_path(root, "notes.txt"), saved);
+    TestFramework::assert_true(document->saved_version() == 3 && saved == "one!\nnew\nthree\n", "Saved remotely");
+    
+    // Paths stay under the root; an edit out of order closes the document
+    auto outside = session.open("../escape.txt");
+    flush();
+    TestFramework::assert_true(outside->failed() && !outside->is_open(), "Paths outside the root refused");
+    std::string skipped = RemoteWriter(1, RemoteMessage::Edit).u64(9).u64(0).u64(0).u64(0).u64(0).str("x").finish();
+    agent.receive(skipped.data(), skipped.size());
+    session.poll();
+    TestFramework::assert_true(document->failed() && agent.open_documents() == 0, "Out-of-order edit rejected");
+    session.disconnect();
+    PlatformFile::delete_directory(root, true);
 }
 
-void test_undo_manager_redo() {
-    PieceTable doc("Hello");
-    UndoManager undo;
+void test_result_list_streams_and_virtualizes() {
+    using editor::ResultList;
+    using editor::PlatformFile;
+    std::string root = PlatformFile::join_path(PlatformFile::get_temp_directory(), "velocity_result_list");
+    PlatformFile::delete_directory(root, true);
+    PlatformFile::create_directories(root);
+    std::string on_disk = PlatformFile::join_path(root, "a.txt");
+    PlatformFile::write_file(on_disk, "first\r\nneedle here\r\nlast\r\n", editor::LineEnding::CRLF);
     
-    undo.execute(std::make_unique<InsertCommand>(&doc, 5, " World"));
-    undo.undo();
-    undo.redo();
+    // Producers on several threads: each file stays one group
+    ResultList list;
+    uint64_t stale = list.reset();
+    uint64_t generation = list.reset();
+    TestFramework::assert_true(!list.add(stale, "old.txt", {{0, 0, 1}}), "Stale generation dropped");
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 4; ++t) {
+        producers.emplace_back([&list, generation, t]() {
+            for (int f = 0; f < 50; ++f) {
+                std::vector<ResultList::Hit> hits;
+                for (size_t h = 0; h < 3; ++h) hits.push_back({h, h + 1, 2});
+                list.add(generation, "t" + std::to_string(t) + "/f" + std::to_string(f), hits);
+            }
+        });
+    }
+    for (auto& producer : producers) producer.join();
+    list.finish(generation);
+    TestFramework::assert_true(list.complete() && list.size() == 600 && list.file_count() == 200,
+                               "All results counted");
+    TestFramework::assert_equal(size_t(800), list.row_count(), "One header row per group");
     
-    TestFramework::assert_equal(std::string("Hello World"), 
-                                doc.get_text(0, doc.get_total_length()),
-                                "After redo");
+    // Any window of rows: headers every fourth row, results in order
+    std::vector<ResultList::Row> rows;
+    list.rows(401, 6, rows);
+    TestFramework::assert_true(rows.size() == 6 && !rows[0].header && rows[0].result == 300 && rows[0].line == 0 &&
+                                   !rows[2].header && rows[3].header && rows[3].result == 303 && rows[4].column == 1,
+                               "Window of rows");
+    ResultList::Row one;
+    TestFramework::assert_true(list.get(302, one) && one.path == rows[2].path && one.line == 2 &&
+                                   !list.get(600, one), "Results by index");
+    list.rows(799, 10, rows);
+    TestFramework::assert_equal(size_t(1), rows.size(), "Window clipped at the end");
+    TestFramework::assert_true(list.memory_bytes() < 600 * 40 + 200 * 80, "Results held compactly");
+    
+    // Previews: from the open document when there is one, else from the file
+    generation = list.reset();
+    auto open = std::make_shared<PieceTable>("edited\nneedle moved\n");
+    list.set_document_lookup([&](const std::string& path) {
+        return path == "open.txt" ? open : nullptr;
+    });
+    list.add(generation, on_disk, {{1, 0, 6}});
+    list.add(generation, "open.txt", {{1, 0, 6}});
+    list.add(generation, on_disk, {{2, 0, 4}});
+    list.rows(0, 10, rows);
+    TestFramework::assert_true(rows.size() == 6 && rows[1].text == "needle here" && rows[3].text == "needle moved" &&
+                                   rows[4].header && rows[5].text == "last", "Previews read on demand");
+    TestFramework::assert_equal(size_t(2), list.files().size(), "Distinct files");
+    
+    // Diagnostics keep their message instead
+    generation = list.reset();
+    auto errors = BuildErrorParser::parse("main.cpp:3:5: error: expected ';'\nmain.cpp:9:1: warning: unused\n");
+    std::vector<ResultList::Hit> hits;
+    for (const auto& error : errors) {
+        hits.push_back({size_t(error.line - 1), size_t(error.column - 1), 0,
+                        error.type == "error" ? ResultList::Kind::Error : ResultList::Kind::Warning, error.message});
+    }
+    list.add(generation, "main.cpp", hits);
+    list.rows(0, 3, rows);
+    TestFramework::assert_true(rows.size() == 3 && rows[1].kind == ResultList::Kind::Error &&
+                                   rows[1].text == errors[0].message && rows[2].line == 8, "Diagnostic rows");
+    PlatformFile::delete_directory(root, true);
 }
 
-// ============================================================================
-// UNIT TESTS - FindDialog
-// ============================================================================
+void test_document_journal_recovers_edits() {
+    using editor::DocumentJournal;
+    using editor::PlatformFile;
+    std::string root = PlatformFile::join_path(PlatformFile::get_temp_directory(), "velocity_document_journal");
+    PlatformFile::delete_directory(root, true);
+    PlatformFile::create_directories(root);
+    std::string file = PlatformFile::join_path(root, "notes.txt");
+    PlatformFile::write_file(file, "alpha\nbeta\n", editor::LineEnding::LF);
+    std::string journal_path = DocumentJournal::journal_path_for(root, file);
+    auto read = [](const std::string& path) {
+        std::string content;
+        PlatformFile::read_file(path, content);
+        return content;
+    };
+    
+    // A long interval: the edits share one sync, forced by flush()
+    PieceTable doc("alpha\nbeta\n");
+    DocumentJournal journal;
+    TestFramework::assert_true(journal.open(doc, journal_path, file, std::chrono::seconds(60)), "Journal opened");
+    doc.insert(5, " one");
+    doc.remove(0, 1);
+    doc.insert(0, "A");
+    for (char c : std::string("gamma\n")) doc.insert(doc.get_total_length(), std::string(1, c));
+    journal.flush();
+    TestFramework::assert_equal(size_t(9), journal.records_written(), "One record per insert or removal");
+    TestFramework::assert_equal(size_t(1), journal.sync_count(), "Edits synced together");
+    auto journals = DocumentJournal::find_journals(root);
+    TestFramework::assert_true(journals.size() == 1 && journals[0] == journal_path, "Journal kept under .velocity");
+    
+    DocumentJournal::Recovered recovered;
+    std::string error;
+    TestFramework::assert_true(DocumentJournal::recover(journal_path, recovered, error), "Journal recovered");
+    TestFramework::assert_equal(std::string("Alpha one\nbeta\ngamma\n"), recovered.text, "Edits replayed");
+    TestFramework::assert_true(recovered.file_path == file && recovered.records == 9 && !recovered.torn,
+                               "Every record intact");
+    
+    // A record cut off by a crash ends the replay before it
+    std::string bytes = read(journal_path);
+    std::ofstream(journal_path, std::ios::binary).write(bytes.data(), bytes.size() - 3);
+    TestFramework::assert_true(DocumentJournal::recover(journal_path, recovered, error) && recovered.torn &&
+                               recovered.text == "Alpha one\nbeta\ngamma", "Torn tail dropped");
+    
+    // A save replaces the file and restarts the journal against it
+    std::promise<bool> saved;
+    journal.save_async(file, [&](bool ok) { saved.set_value(ok); });
+    TestFramework::assert_true(saved.get_future().get(), "Saved off the calling thread");
+    TestFramework::assert_equal(std::string("Alpha one\nbeta\ngamma\n"), read(file), "File written from pieces");
+    TestFramework::assert_true(!PlatformFile::exists(file + ".velocity-save.tmp"), "Temporary file renamed");
+    doc.insert(0, "> ");
+    journal.flush();
+    TestFramework::assert_true(DocumentJournal::recover(journal_path, recovered, error) && recovered.records == 1 &&
+                               recovered.text == "> Alpha one\nbeta\ngamma\n", "Replayed onto the saved file");
+    
+    // Edits based on a file that has changed since cannot be replayed
+    PlatformFile::write_file(file, "rewritten\n", editor::LineEnding::LF);
+    TestFramework::assert_true(!DocumentJournal::recover(journal_path, recovered, error) && !error.empty(),
+                               "Changed base file refused");
+    journal.close(true);
+    TestFramework::assert_true(!PlatformFile::exists(journal_path), "Clean close discards the journal");
+    
+    // Untitled documents carry their text in the journal
+    PieceTable untitled("draft");
+    std::string untitled_path = DocumentJournal::journal_path_for(root, "untitled-1");
+    journal.open(untitled, untitled_path, "");
+    untitled.insert(5, "ed");
+    journal.close(false);
+    TestFramework::assert_true(DocumentJournal::recover(untitled_path, recovered, error) &&
+                               recovered.file_path.empty() && recovered.text == "drafted", "Untitled recovered");
+    
+    PlatformFile::delete_directory(root, true);
+}
 
-void test_find_simple() {
-    FindDialog finder;
-    std::string text = "Hello World Hello";
+void test_tab_manager_hibernates_tabs() {
+    using editor::PlatformFile;
+    std::string root = PlatformFile::join_path(PlatformFile::get_temp_directory(), "velocity_tab_hibernation");
+    PlatformFile::delete_directory(root, true);
+    PlatformFile::create_directories(root);
+    std::string a = PlatformFile::join_path(root, "a.txt");
+    std::string b = PlatformFile::join_path(root, "b.txt");
+    std::string big(64 * 1024, 'x');
+    PlatformFile::write_file(a, big + "\nend\n", editor::LineEnding::LF);
+    PlatformFile::write_file(b, big + "\n", editor::LineEnding::LF);
     
-    auto matches = finder.find_all(text, "Hello");
-    TestFramework::assert_equal(size_t(2), matches.size(), "Find 'Hello' count");
-    TestFramework::assert_equal(size_t(0), matches[0].position, "First match position");
-    TestFramework::assert_equal(size_t(12), matches[1].position, "Second match position");
+    TabManager tabs(TextBufferBackend::PieceTable);
+    tabs.set_spill_workspace(root);
+    tabs.new_tab(big + "\nend\n", a);
+    tabs.get_tab(1)->cursor_pos = big.size() + 2;
+    tabs.new_tab(big + "\n", b);
+    tabs.get_tab(2)->document->insert(0, "edit ");
+    tabs.get_tab(2)->is_modified = true;
+    tabs.new_tab("scratch", "");
+    
+    // Unlimited by default; then everything but the active tab goes
+    TestFramework::assert_equal(size_t(0), tabs.enforce_budget(), "No budget, no hibernation");
+    tabs.set_memory_budget(1024);
+    size_t hooked = 0;
+    TestFramework::assert_equal(size_t(3), tabs.enforce_budget([&](EditorTab&) { hooked++; }), "Inactive tabs hibernated");
+    TestFramework::assert_equal(size_t(3), hooked, "Hook saw each tab");
+    TestFramework::assert_true(tabs.get_tab(1)->is_hibernated() && tabs.get_tab(1)->spill_path.empty(), "Clean file dropped");
+    TestFramework::assert_true(!tabs.get_tab(2)->spill_path.empty(), "Modified file spilled");
+    TestFramework::assert_true(!tabs.get_tab(3)->is_hibernated(), "Active tab stays");
+    TestFramework::assert_true(tabs.get_resident_bytes() <= 1024, "Within budget");
+    TestFramework::assert_true(tabs.find_document(a) == nullptr, "Hibernated tab has no document");
+    
+    // Switching wakes a tab in the background
+    std::atomic<int> notified{0};
+    tabs.set_reload_notify([&] { notified++; });
+    tabs.set_active_tab(1);
+    TestFramework::assert_true(tabs.get_active_tab()->is_reloading(), "Reload started");
+    tabs.set_active_tab(2);
+    TestFramework::assert_equal(size_t(2), tabs.complete_reloads(true), "Reloads installed");
+    TestFramework::assert_equal(size_t(2), size_t(notified.load()), "Each reload notified");
+    TestFramework::assert_equal(std::string("end"), tabs.get_tab(1)->document->get_line(1), "Clean file reloaded");
+    TestFramework::assert_equal(big.size() + 2, tabs.get_tab(1)->cursor_pos, "Cursor kept");
+    TestFramework::assert_equal(std::string("edit xxx"), tabs.get_tab(2)->document->get_text(0, 8), "Edits survive the spill");
+    TestFramework::assert_true(tabs.get_tab(2)->is_modified && tabs.get_tab(2)->spill_path.empty(), "Spill consumed");
+    TestFramework::assert_true(!PlatformFile::exists(editor::DocumentJournal::journal_path_for(root, "hibernated-tab:" + b)),
+                               "Spill journal deleted");
+    
+    // The untitled tab comes back from its spill too
+    TestFramework::assert_equal(size_t(2), tabs.enforce_budget(), "Least recently active go first");
+    TestFramework::assert_true(tabs.get_tab(3)->is_hibernated(), "Scratch tab spilled");
+    tabs.set_active_tab(3);
+    tabs.complete_reloads(true);
+    TestFramework::assert_equal(std::string("scratch"), tabs.get_active_tab()->document->get_text(0, 7), "Untitled tab restored");
+    PlatformFile::delete_directory(root, true);
 }
 
-void test_find_case_insensitive() {
-    FindDialog finder;
-    finder.set_case_sensitive(false);
-    std::string text = "Hello hello HELLO";
+void test_tab_manager_restores_session() {
+    using editor::PlatformFile;
+    std::string root = PlatformFile::join_path(PlatformFile::get_temp_directory(), "velocity_session_restore");
+    PlatformFile::delete_directory(root, true);
+    PlatformFile::create_directories(root);
+    std::string big(64 * 1024, 'x');
     
-    auto matches = finder.find_all(text, "hello");
-    TestFramework::assert_equal(size_t(3), matches.size(), "Case insensitive count");
+    // The session file keeps the order tabs were last active in
+    WorkspaceState saved;
+    for (int i = 0; i < 4; ++i) {
+        std::string path = PlatformFile::join_path(root, "f" + std::to_string(i) + ".txt");
+        PlatformFile::write_file(path, "file " + std::to_string(i) + "\n" + big, editor::LineEnding::LF);
+        saved.open_files.emplace_back(path, 2, 1);
+        saved.open_files.back().last_active = 10 + i;
+    }
+    std::string session = PlatformFile::join_path(root, "workspace.vel");
+    saved.save(session);
+    WorkspaceState state;
+    TestFramework::assert_true(state.load(session) && state.open_files.size() == 4, "Session loaded");
+    TestFramework::assert_equal(size_t(13), size_t(state.open_files[3].last_active), "MRU order kept");
+    
+    // Placeholders read nothing until activated or preloaded
+    TabManager tabs(TextBufferBackend::PieceTable);
+    for (const auto& file : state.open_files) {
+        tabs.add_hibernated_tab(file.path, file.cursor_pos, file.scroll_offset, file.last_active);
+    }
+    TestFramework::assert_true(tabs.get_tab(1)->is_hibernated() && !tabs.get_tab(1)->is_reloading(), "Placeholder");
+    TestFramework::assert_equal(std::string("f0.txt"), tabs.get_tab(1)->display_name, "Placeholder named");
+    tabs.set_active_tab(2);
+    TestFramework::assert_true(tabs.close_tab(0), "Empty tab closed");
+    TestFramework::assert_equal(size_t(1), tabs.get_active_tab_index(), "Active tab follows the close");
+    TestFramework::assert_equal(size_t(1), tabs.complete_reloads(true), "Active tab loaded first");
+    TestFramework::assert_equal(std::string("file 1"), tabs.get_active_tab()->document->get_line(0), "Active document");
+    TestFramework::assert_equal(size_t(2), tabs.get_active_tab()->cursor_pos, "Cursor restored");
+    
+    // Preloads stop at the budget: room for one more document
+    tabs.set_memory_budget(2 * big.size() + 4096);
+    TestFramework::assert_equal(size_t(3), tabs.preload_tabs(), "Others queued");
+    tabs.complete_reloads(true);
+    size_t resident = 0;
+    for (size_t i = 0; i < tabs.get_tab_count(); ++i) {
+        if (!tabs.get_tab(i)->is_hibernated()) resident++;
+        TestFramework::assert_true(!tabs.get_tab(i)->is_reloading(), "Nothing left queued");
+    }
+    TestFramework::assert_equal(size_t(2), resident, "Within the budget");
+    tabs.set_active_tab(0);
+    TestFramework::assert_true(tabs.complete_reloads(true) <= 1, "Activation still loads");
+    TestFramework::assert_true(!tabs.get_active_tab()->is_hibernated(), "Switched-to tab loaded");
+    PlatformFile::delete_directory(root, true);
 }
 
-void test_find_case_sensitive() {
-    FindDialog finder;
-    finder.set_case_sensitive(true);
-    std::string text = "Hello hello HELLO";
+void test_startup_scheduler() {
+    StartupTimeline timeline;
+    StartupScheduler startup(timeline);
+
+    // Two background tasks that each wait for the other: only concurrent
+    // work gets past the rendezvous
+    std::mutex mutex;
+    std::condition_variable cv;
+    int arrived = 0;
+    bool both_ran = true;
+    auto rendezvous = [&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        arrived++;
+        cv.notify_all();
+        if (!cv.wait_for(lock, std::chrono::seconds(5), [&] { return arrived == 2; })) both_ran = false;
+    };
+    std::thread::id ui_thread = std::this_thread::get_id();
+    std::thread::id finish_thread;
+    std::vector<std::string> order;
+    startup.add_background("tree", rendezvous, [&] { finish_thread = std::this_thread::get_id(); order.push_back("tree"); });
+    startup.add_background("git", rendezvous);
+    startup.add_idle("lsp", [&] { order.push_back("lsp"); });
+    startup.add_idle("tooltip", [&] { order.push_back("tooltip"); });
+
+    // Nothing runs before start()
+    TestFramework::assert_true(!startup.is_done(), "Work waits for start");
+    TestFramework::assert_equal(size_t(0), order.size(), "No task before start");
+    timeline.mark("first frame");
+
+    std::atomic<int> notified{0};
+    startup.start([&] { notified++; });
+    // Idle tasks go one per step, so input is handled between them
+    startup.step();
+    TestFramework::assert_true(std::count(order.begin(), order.end(), "lsp") == 1 &&
+                               std::count(order.begin(), order.end(), "tooltip") == 0, "One idle task per step");
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (startup.step() && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    TestFramework::assert_true(startup.is_done(), "Startup completes");
+    TestFramework::assert_true(both_ran, "Background tasks run concurrently");
+    TestFramework::assert_true(notified == 2, "Each finished background task notifies");
+    TestFramework::assert_true(finish_thread == ui_thread, "Finish step runs on the stepping thread");
+    TestFramework::assert_equal(size_t(3), order.size(), "Every task ran once");
+
+    // The trace lists phases by start time, background ones marked
+    auto phases = timeline.phases();
+    TestFramework::assert_equal(std::string("first frame"), phases.front().name, "Phases after the first frame");
+    for (size_t i = 1; i < phases.size(); ++i) {
+        TestFramework::assert_true(phases[i - 1].start_ms <= phases[i].start_ms, "Phases ordered by start");
+    }
+    TestFramework::assert_true(timeline.time_of("tree") >= timeline.time_of("first frame"), "Deferred past the first frame");
+    TestFramework::assert_true(timeline.time_of("tree (finish)") >= 0 && timeline.time_of("missing") < 0, "Finish steps recorded");
+    std::string trace = timeline.format();
+    TestFramework::assert_true(trace.find("git [bg]") != std::string::npos, "Background phase marked");
+    TestFramework::assert_true(trace.find("lsp [bg]") == std::string::npos && trace.find("lsp") != std::string::npos,
+                               "Idle phase on the UI thread");
+}
+
+void test_tracer() {
+    editor::Tracer& tracer = editor::Tracer::instance();
+    tracer.clear();
+    {
+        EDITOR_TRACE_SCOPE("test", "before start");
+    }
+    TestFramework::assert_equal(size_t(0), tracer.snapshot().size(), "Nothing recorded while off");
+
+    tracer.start(4);
+    {
+        EDITOR_TRACE_SCOPE_DETAIL("test", "outer", std::string("say \"hi\"\n"));
+        EDITOR_TRACE_COUNTER("test", "items", 42);
+        // A buffer edit records its own span
+        PieceTable pt("hello");
+        pt.insert(5, " world");
+    }
+    // A busy thread keeps only its newest events
+    std::thread worker([] {
+        editor::Tracer::instance().set_thread_name("worker");
+        for (int i = 0; i < 10; ++i) {
+            EDITOR_TRACE_COUNTER("test", "tick", i);
+        }
+    });
+    worker.join();
+    tracer.stop();
+
+    auto events = tracer.snapshot();
+    size_t spans = 0, ticks = 0;
+    uint32_t main_tid = 0, worker_tid = 0;
+    int64_t first_tick = -1;
+    bool saw_insert = false;
+    for (const auto& [tid, event] : events) {
+        std::string name = event.name;
+        if (name == "outer") {
+            spans++;
+            main_tid = tid;
+            TestFramework::assert_true(event.phase == 'X' && event.detail == "say \"hi\"\n", "Span keeps its detail");
+        } else if (name == "PieceTable::insert") {
+            saw_insert = true;
+        } else if (name == "tick") {
+            if (first_tick < 0) first_tick = event.value;
+            ticks++;
+            worker_tid = tid;
+        }
+    }
+    TestFramework::assert_equal(size_t(1), spans, "One outer span");
+    TestFramework::assert_true(saw_insert, "PieceTable edits are instrumented");
+    TestFramework::assert_equal(size_t(4), ticks, "Ring keeps the newest events");
+    TestFramework::assert_true(first_tick == 6, "Oldest events overwritten first");
+    TestFramework::assert_true(main_tid != 0 && worker_tid != 0 && main_tid != worker_tid, "Threads get their own ids");
+
+    std::ostringstream out;
+    tracer.write_chrome_trace(out);
+    std::string json = out.str();
+    TestFramework::assert_true(json.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0) == 0, "Trace Event JSON");
+    TestFramework::assert_true(json.find("\"ph\":\"X\",\"cat\":\"test\",\"name\":\"outer\"") != std::string::npos, "Span exported");
+    TestFramework::assert_true(json.find("\"detail\":\"say \\\"hi\\\"\\u000a\"") != std::string::npos, "Detail escaped");
+    TestFramework::assert_true(json.find("\"args\":{\"value\":42}") != std::string::npos, "Counter exported");
+    TestFramework::assert_true(json.find("\"args\":{\"name\":\"worker\"}") != std::string::npos, "Thread name exported");
+    tracer.clear();
+}
+
+void test_frame_stats() {
+    using editor::LatencyHistogram;
+    // Exact below 32 us, within about 3% above
+    TestFramework::assert_equal(size_t(7), LatencyHistogram::bucket_of(7), "Small values exact");
+    bool bounded = true;
+    for (uint64_t v : {32ull, 33ull, 100ull, 1000ull, 16666ull, 123456789ull}) {
+        uint64_t upper = LatencyHistogram::bucket_upper(LatencyHistogram::bucket_of(v));
+        if (upper < v || upper > v + v / 32 + 1) bounded = false;
+    }
+    TestFramework::assert_true(bounded, "Bucket edges within 1/32");
+
+    LatencyHistogram h;
+    TestFramework::assert_true(h.percentile(99) == 0, "Empty histogram reports 0");
+    for (uint64_t i = 1; i <= 1000; ++i) h.record(i * 10);    // 10 us .. 10 ms
+    TestFramework::assert_equal(size_t(1000), static_cast<size_t>(h.count()), "Samples counted");
+    uint64_t p50 = h.percentile(50);
+    uint64_t p99 = h.percentile(99);
+    TestFramework::assert_true(p50 >= 5000 && p50 <= 5000 + 5000 / 32 + 1, "p50 near the median");
+    TestFramework::assert_true(p99 >= 9900 && p99 <= 9900 + 9900 / 32 + 1, "p99 near the tail");
+    TestFramework::assert_true(h.percentile(100) == 10000 && h.max() == 10000, "Max exact");
+
+    editor::FrameStats stats;
+    using Metric = editor::FrameStats::Metric;
+    auto t0 = editor::FrameStats::Clock::now();
+    using std::chrono::milliseconds;
+    // Two keystrokes before one present: the older one's wait counts
+    stats.note_input(t0);
+    stats.note_input(t0 + milliseconds(5));
+    stats.frame_presented(t0 + milliseconds(12));
+    stats.frame_presented(t0 + milliseconds(28));
+    // After an idle stretch the next present is not a frame interval
+    stats.frame_presented(t0 + milliseconds(2000));
+    // A keystroke that changed nothing is not measured
+    stats.note_input(t0 + milliseconds(2100));
+    stats.drop_input();
+    stats.frame_presented(t0 + milliseconds(3000));
+    const auto& latency = stats.histogram(Metric::InputLatency);
+    TestFramework::assert_equal(size_t(1), static_cast<size_t>(latency.count()), "One latency sample");
+    TestFramework::assert_true(latency.max() == 12000, "Latency from the oldest input");
+    TestFramework::assert_equal(size_t(1), static_cast<size_t>(stats.histogram(Metric::FrameInterval).count()),
+                                "Idle gaps are not frames");
+    {
+        editor::FrameStats::Timer timer(stats, Metric::Minimap);
+    }
+    TestFramework::assert_equal(size_t(1), static_cast<size_t>(stats.histogram(Metric::Minimap).count()), "Phase timed");
+
+    // Readable as settings for a plugin host
+    std::string value;
+    TestFramework::assert_true(stats.get_setting("perf.input_latency.max", value), "Known setting");
+    TestFramework::assert_equal(std::string("12.000"), value, "Milliseconds");
+    TestFramework::assert_true(stats.get_setting("perf.frame_interval.count", value) && value == "1", "Count setting");
+    TestFramework::assert_true(!stats.get_setting("perf.bogus.p50", value) && !stats.get_setting("editor.font", value),
+                               "Unknown keys rejected");
+    TestFramework::assert_equal(size_t(editor::FrameStats::kMetrics * 4), stats.setting_keys().size(), "Every key listed");
+    TestFramework::assert_equal(std::string("p50 12.00  p99 12.00  max 12.00 ms"), stats.summary(Metric::InputLatency),
+                                "HUD summary");
+    editor::Command reset = stats.reset_command();
+    reset.handler();
+    TestFramework::assert_true(stats.histogram(Metric::InputLatency).count() == 0, "Reset command clears");
+}
+
+void test_memory_report() {
+    // A document accounts for its buffers, index, tree and history
+    std::string text;
+    for (int i = 0; i < 1000; ++i) text += "line " + std::to_string(i) + "\n";
+    PieceTable pt(text);
+    PieceTable::MemoryUsage before = pt.get_memory_usage();
+    TestFramework::assert_true(before.original >= text.size() && before.mapped == 0, "Owned original counted");
+    TestFramework::assert_true(before.line_index >= 1000 * sizeof(size_t), "Newline index counted");
+    TestFramework::assert_true(before.piece_tree > 0 && before.add_buffer == 0, "Tree counted, no add buffer yet");
+    for (int i = 0; i < 50; ++i) pt.insert(pt.get_total_length() / 2, "x\n");
+    PieceTable::MemoryUsage after = pt.get_memory_usage();
+    TestFramework::assert_true(after.add_buffer > 0 && after.undo_history > before.undo_history, "Edits grow add buffer and history");
+    TestFramework::assert_equal(after.original + after.add_buffer + after.line_index + after.piece_tree + after.undo_history,
+                                after.heap(), "Heap sums the parts");
+
+    // Scrollback and cached tokens are counted as they fill
+    editor::TerminalScreen screen(80, 24, 1000);
+    size_t empty_screen = screen.get_memory_bytes();
+    std::string output;
+    for (int i = 0; i < 500; ++i) output += "output line " + std::to_string(i) + "\r\n";
+    screen.feed(output.data(), output.size());
+    TestFramework::assert_true(empty_screen > 0 && screen.get_memory_bytes() >= empty_screen, "Terminal rows counted");
+
+    SyntaxHighlighter highlighter;
+    highlighter.set_language(SyntaxHighlighter::Language::Cpp);
+    HighlightCache cache(&highlighter);
+    auto doc = std::make_shared<PieceTable>("int a = 1;\nint b = 2;\n");
+    cache.set_document(doc);
+    size_t empty_cache = cache.get_memory_bytes();
+    cache.get_tokens(0);
+    cache.get_tokens(1);
+    TestFramework::assert_true(cache.get_memory_bytes() > empty_cache, "Highlight tokens counted");
+
+    BackgroundIndexer indexer;
+    BackgroundIndexer::MemoryUsage idle = indexer.get_memory_usage();
+    indexer.index_file("a.cpp", "int alpha_value = beta_value;\nreturn alpha_value;\n");
+    BackgroundIndexer::MemoryUsage indexed = indexer.get_memory_usage();
+    TestFramework::assert_true(indexed.words > idle.words && indexed.files > idle.files && indexed.line_tables > 0,
+                               "Index parts counted");
+
+    // The report breaks the total down by owner and by subsystem
+    editor::MemoryReport report;
+    report.add("a.cpp", "add buffer", 2048);
+    report.add("a.cpp", "original buffer", 1 << 20, true);
+    report.add("b.cpp", "add buffer", 1024);
+    report.add("b.cpp", "undo history", 0);     // Dropped
+    report.add("workspace", "index words", 3 * 1024 * 1024);
+    TestFramework::assert_equal(size_t(4), report.entries().size(), "Empty entries dropped");
+    TestFramework::assert_equal(size_t(3 * 1024 * 1024 + 3072), report.total(), "Mapped bytes kept apart");
+    TestFramework::assert_equal(size_t(1 << 20), report.mapped_total(), "Mapped total");
+    TestFramework::assert_equal(size_t(3072), report.subsystem_total("add buffer"), "Subsystem total");
+    TestFramework::assert_equal(size_t(2048), report.owner_total("a.cpp"), "Owner total");
+    std::string formatted = report.format();
+    TestFramework::assert_true(formatted.rfind("Memory: 3.0 MB (+1.0 MB mapped)", 0) == 0, "Headline total");
+    size_t by_subsystem = formatted.find("By subsystem");
+    TestFramework::assert_true(by_subsystem != std::string::npos &&
+                               formatted.find("index words: 3.0 MB", by_subsystem) <
+                               formatted.find("add buffer: 3.0 KB", by_subsystem), "Subsystems largest first");
+    TestFramework::assert_equal(std::string("512 B"), editor::MemoryReport::format_bytes(512), "Bytes formatted");
+
+    TestFramework::assert_equal(size_t(0), editor::heap_bytes(std::string("short")), "Inline strings hold no heap");
+    TestFramework::assert_true(editor::heap_bytes(std::string(100, 'x')) > 100, "Long strings counted");
+}
+
+void test_memory_pressure_sheds_in_order() {
+    using editor::MemoryPressureLevel;
+    editor::MemoryPressureMonitor monitor;
+    std::vector<std::string> shed;
+    monitor.add_cache("line cache", [&shed] { shed.push_back("line cache"); return size_t(4096); });
+    monitor.add_cache("empty cache", [&shed] { shed.push_back("empty cache"); return size_t(0); });
+    monitor.add_cache("tabs", [&shed] { shed.push_back("tabs"); return size_t(1 << 20); },
+                      MemoryPressureLevel::Critical);
+
+    // Nothing signalled: nothing shed
+    TestFramework::assert_equal(size_t(0), monitor.poll(), "Idle poll sheds nothing");
+    TestFramework::assert_true(monitor.level() == MemoryPressureLevel::Normal, "Normal without signals");
+
+    // Moderate pressure reaches only the caches added for it, in order
+    int wakes = 0;
+    monitor.start([&wakes] { ++wakes; });
+    monitor.signal(MemoryPressureLevel::Moderate);
+    monitor.signal(MemoryPressureLevel::Moderate);
+    TestFramework::assert_equal(1, wakes, "One wake per rise in level");
+    TestFramework::assert_true(monitor.level() == MemoryPressureLevel::Moderate, "Level raised");
+    TestFramework::assert_equal(size_t(4096), monitor.poll(), "Moderate sheds the cheap caches");
+    TestFramework::assert_equal(size_t(2), shed.size(), "Critical cache kept");
+    TestFramework::assert_equal(std::string("line cache"), shed[0], "Cheapest first");
+    monitor.signal(MemoryPressureLevel::Moderate);
+    TestFramework::assert_equal(size_t(0), monitor.poll(), "Same level within the cooldown waits");
+
+    // Critical pressure sheds everything, the critical caches last
+    shed.clear();
+    monitor.signal(MemoryPressureLevel::Critical);
+    TestFramework::assert_equal(size_t(4096 + (1 << 20)), monitor.poll(), "Critical sheds all");
+    TestFramework::assert_equal(std::string("tabs"), shed.back(), "Tabs last");
+    monitor.stop();
+
+    // Evictions reach the report apart from what is held
+    editor::MemoryReport report;
+    report.add("editor", "undo steps", 1024);
+    monitor.report(report);
+    TestFramework::assert_equal(size_t(2), report.shed().size(), "Caches that freed nothing left out");
+    TestFramework::assert_equal(size_t(1024), report.total(), "Shed bytes not in the total");
+    std::string formatted = report.format();
+    TestFramework::assert_true(formatted.find("Shed under memory pressure") != std::string::npos &&
+                               formatted.find("line cache: 8.0 KB in 2 evictions") != std::string::npos,
+                               "Evictions formatted");
+
+    // Terminal scrollback goes, the screen stays
+    editor::TerminalScreen screen(40, 5, 1000);
+    std::string output;
+    for (int i = 0; i < 300; ++i) output += "line " + std::to_string(i) + "\r\n";
+    screen.feed(output.data(), output.size());
+    std::string bottom = screen.line_text(screen.line_count() - 2);
+    TestFramework::assert_true(screen.drop_history() > 0, "Scrollback freed");
+    TestFramework::assert_equal(size_t(0), screen.history_size(), "No history left");
+    TestFramework::assert_equal(bottom, screen.line_text(screen.line_count() - 2), "Screen kept");
+    screen.feed(output.data(), output.size());
+    TestFramework::assert_true(screen.history_size() > 0, "Scrollback fills again");
+
+    // Index line tables go; results find their lines from the text
+    BackgroundIndexer indexer;
+    indexer.index_file("a.cpp", "int first;\r\nint second_value;\nreturn second_value;");
+    TestFramework::assert_true(indexer.drop_line_tables() > 0, "Line tables freed");
+    TestFramework::assert_equal(size_t(0), indexer.get_line_table_bytes(), "No tables left");
+    std::vector<SearchResult> results = indexer.search("second_value");
+    TestFramework::assert_equal(size_t(2), results.size(), "Still found");
+    TestFramework::assert_equal(std::string("int second_value;"), results[0].line_content, "Line from the text");
+    TestFramework::assert_equal(std::string("return second_value;"), results[1].line_content, "Last line");
+}
+
+void test_indexer_applies_file_changes() {
+    using editor::FileChange;
+    using editor::PlatformFile;
+    std::string root = PlatformFile::join_path(PlatformFile::get_temp_directory(), "velocity_indexer_changes");
+    PlatformFile::delete_directory(root, true);
+    std::string dir = PlatformFile::join_path(root, "dir");
+    PlatformFile::create_directories(dir);
+    std::string a = PlatformFile::join_path(root, "a.cpp");
+    std::string b = PlatformFile::join_path(dir, "b.cpp");
+    PlatformFile::write_file(a, "int old_name;\n", editor::LineEnding::LF);
+    PlatformFile::write_file(b, "int in_dir;\n", editor::LineEnding::LF);
     
-    auto matches = finder.find_all(text, "hello");
-    TestFramework::assert_equal(size_t(1), matches.size(), "Case sensitive count");
+    BackgroundIndexer indexer;
+    indexer.index_workspace({root});
+    indexer.wait_for_indexing();
+    TestFramework::assert_equal(size_t(2), indexer.get_indexed_file_count(), "Initial crawl");
+    
+    // Edited file: re-read, old words gone
+    PlatformFile::write_file(a, "int new_name;\n", editor::LineEnding::LF);
+    indexer.apply_file_changes({{FileChange::Kind::Modified, a, false}});
+    indexer.wait_for_indexing();
+    TestFramework::assert_equal(size_t(0), indexer.search("old_name").size(), "Old content dropped");
+    TestFramework::assert_equal(size_t(1), indexer.search("new_name").size(), "New content indexed");
+    
+    // New directory: crawled; removed directory: everything below dropped
+    std::string added = PlatformFile::join_path(root, "added");
+    PlatformFile::create_directories(added);
+    PlatformFile::write_file(PlatformFile::join_path(added, "c.cpp"), "int in_added;\n", editor::LineEnding::LF);
+    PlatformFile::delete_directory(dir, true);
+    indexer.apply_file_changes({{FileChange::Kind::Created, added, true}, {FileChange::Kind::Removed, dir, false}});
+    indexer.wait_for_indexing();
+    TestFramework::assert_equal(size_t(1), indexer.search("in_added").size(), "New directory crawled");
+    TestFramework::assert_equal(size_t(0), indexer.search("in_dir").size(), "Removed directory dropped");
+    
+    // Hidden paths and editor buffers are left alone
+    indexer.index_file(a, "int from_buffer;\n");
+    indexer.apply_file_changes({{FileChange::Kind::Modified, a, false},
+                                {FileChange::Kind::Created, PlatformFile::join_path(root, ".velocity"), true}});
+    indexer.wait_for_indexing();
+    TestFramework::assert_equal(size_t(1), indexer.search("from_buffer").size(), "Buffer kept over disk");
+    TestFramework::assert_equal(size_t(2), indexer.get_indexed_file_count(), "Files after changes");
+    
+    indexer.stop();
+    PlatformFile::delete_directory(root, true);
 }
 
-void test_find_no_match() {
-    FindDialog finder;
-    std::string text = "Hello World";
+void test_file_watcher_batches_changes() {
+    using editor::FileChange;
+    using editor::PlatformFile;
+    std::string root = PlatformFile::join_path(PlatformFile::get_temp_directory(), "velocity_file_watcher");
+    PlatformFile::delete_directory(root, true);
+    PlatformFile::create_directories(root);
+    std::string doomed = PlatformFile::join_path(root, "doomed.txt");
+    PlatformFile::write_file(doomed, "x", editor::LineEnding::LF);
     
-    auto matches = finder.find_all(text, "xyz");
-    TestFramework::assert_equal(size_t(0), matches.size(), "No matches");
+    std::mutex mutex;
+    std::condition_variable delivered;
+    std::vector<std::vector<FileChange>> batches;
+    editor::FileWatcher watcher;
+    bool started = watcher.start(root, [&](const std::vector<FileChange>& changes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        batches.push_back(changes);
+        delivered.notify_all();
+    }, std::chrono::milliseconds(50));
+    TestFramework::assert_true(started, "Watch started");
+    
+    // A burst: one file written repeatedly, a directory with a file, an
+    // ignored directory and a deletion
+    std::string file = PlatformFile::join_path(root, "a.txt");
+    for (int i = 0; i < 5; ++i) PlatformFile::write_file(file, std::string(i + 1, 'a'), editor::LineEnding::LF);
+    std::string dir = PlatformFile::join_path(root, "sub");
+    PlatformFile::create_directories(dir);
+    PlatformFile::create_directories(PlatformFile::join_path(root, "node_modules"));
+    PlatformFile::delete_file(doomed);
+    
+    std::vector<FileChange> changes;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        // Keep collecting until the burst's events have all arrived
+        delivered.wait_for(lock, std::chrono::seconds(5), [&] {
+            size_t count = 0;
+            for (const auto& batch : batches) count += batch.size();
+            return count >= 3;
+        });
+        for (const auto& batch : batches) changes.insert(changes.end(), batch.begin(), batch.end());
+    }
+    watcher.stop();
+    
+    auto find = [&](const std::string& path) -> const FileChange* {
+        for (const FileChange& change : changes) {
+            if (change.path == path) return &change;
+        }
+        return nullptr;
+    };
+    const FileChange* created = find(file);
+    TestFramework::assert_true(created && created->kind == FileChange::Kind::Created, "Writes coalesced into Created");
+    size_t file_entries = std::count_if(changes.begin(), changes.end(), [&](const FileChange& c) { return c.path == file; });
+    TestFramework::assert_equal(size_t(1), file_entries, "One entry per path");
+    const FileChange* sub = find(dir);
+    TestFramework::assert_true(sub && sub->kind == FileChange::Kind::Created && sub->is_directory, "Directory created");
+    const FileChange* removed = find(doomed);
+    TestFramework::assert_true(removed && removed->kind == FileChange::Kind::Removed, "Deletion reported");
+    TestFramework::assert_true(!find(PlatformFile::join_path(root, "node_modules")), "Ignored directory skipped");
+    TestFramework::assert_true(editor::FileWatcher::is_ignored(".git/objects/ab") &&
+                               !editor::FileWatcher::is_ignored(".git/HEAD") &&
+                               editor::FileWatcher::is_ignored("src/.cache"), "Ignore rules");
+    
+    PlatformFile::delete_directory(root, true);
+}
+
+void test_gitignore_patterns() {
+    GitIgnore ignore;
+    ignore.add_patterns("# build output\n"
+                        "build/\n"
+                        "*.o\n"
+                        "/local.cfg\n"
+                        "docs/**/*.tmp\n"
+                        "log[0-9].txt\n"
+                        "!keep.o\n");
+    ignore.add_patterns("generated_*\n", "src");
+    
+    TestFramework::assert_true(ignore.is_ignored("build", true), "Directory pattern");
+    TestFramework::assert_true(!ignore.is_ignored("build", false), "Directory pattern skips files");
+    TestFramework::assert_true(ignore.is_ignored("src/deep/main.o", false), "Unanchored matches at any depth");
+    TestFramework::assert_true(!ignore.is_ignored("src/keep.o", false), "Negation wins when later");
+    TestFramework::assert_true(ignore.is_ignored("local.cfg", false), "Anchored at root");
+    TestFramework::assert_true(!ignore.is_ignored("sub/local.cfg", false), "Anchored pattern not below");
+    TestFramework::assert_true(ignore.is_ignored("docs/a.tmp", false) && ignore.is_ignored("docs/x/y/a.tmp", false),
+                               "Double star spans zero or more directories");
+    TestFramework::assert_true(ignore.is_ignored("log3.txt", false) && !ignore.is_ignored("logx.txt", false),
+                               "Character class");
+    TestFramework::assert_true(ignore.is_ignored("src/generated_api.h", false), "Nested .gitignore applies below");
+    TestFramework::assert_true(!ignore.is_ignored("generated_api.h", false), "Nested .gitignore not above");
+    TestFramework::assert_true(!GitIgnore::match("*.o", "dir/a.o"), "Single star stays in one component");
+}
+
+void test_quick_open_ranks_paths() {
+    QuickOpenIndex index;
+    for (const char* path : {"src/piece_table.cpp", "include/piece_table.h", "src/main.cpp",
+                             "docs/pieces/table_notes.md", "src/platform_file.cpp"}) {
+        index.add_path(path);
+    }
+    // Enough filler to split the scan into several blocks
+    for (int i = 0; i < 20000; ++i) index.add_path("gen/module_" + std::to_string(i) + "/data.txt");
+    
+    auto results = index.search("ptcpp");
+    TestFramework::assert_true(!results.empty() && results[0].path == "src/piece_table.cpp", "Boundary match ranks first");
+    TestFramework::assert_equal(size_t(5), results[0].positions.size(), "One position per query character");
+    TestFramework::assert_true(index.search("piecetable").size() == 3, "Subsequence across directories");
+    TestFramework::assert_true(QuickOpenIndex::score("src/main.cpp", "xyz") < 0, "Non-subsequence rejected");
+    TestFramework::assert_true(QuickOpenIndex::score("src/table.cpp", "table") > QuickOpenIndex::score("table/src.cpp", "table"),
+                               "File name beats directory");
+    
+    // Refining an extended query must agree with a cold scan
+    index.search("pie");
+    size_t refined = index.search("pie.").size();
+    index.search("zz");
+    TestFramework::assert_equal(index.search("pie.").size(), refined, "Refined query");
+    index.remove_path("src/piece_table.cpp");
+    results = index.search("pie.");
+    TestFramework::assert_true(results.size() == refined - 1 &&
+                               std::none_of(results.begin(), results.end(),
+                                            [](const QuickOpenMatch& m) { return m.path == "src/piece_table.cpp"; }),
+                               "Removed path dropped");
+    TestFramework::assert_equal(size_t(20004), index.get_path_count(), "Path count");
+    
+    std::mutex mutex;
+    std::condition_variable done;
+    std::vector<QuickOpenMatch> final_results;
+    bool complete = false;
+    index.search_async("stale", 10, [](const std::vector<QuickOpenMatch>&, bool) {});
+    index.search_async("mod12data", 10, [&](const std::vector<QuickOpenMatch>& found, bool is_complete) {
+        if (!is_complete) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        final_results = found;
+        complete = true;
+        done.notify_all();
+    });
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait_for(lock, std::chrono::seconds(10), [&] { return complete; });
+    TestFramework::assert_true(complete && final_results.size() == 10, "Async search completes with top-K");
+    TestFramework::assert_true(complete && final_results[0].path.find("module_12/") != std::string::npos,
+                               "Async results ranked");
+}
+
+void test_gpu_renderer_batches_frame() {
+    using namespace editor;
+    // Solid 4x6 boxes for letters; space is blank; everything else has no glyph
+    GlyphRasterizer boxes = [](uint32_t codepoint, GlyphBitmap& glyph) {
+        glyph.advance = 6;
+        if (codepoint == ' ') return true;
+        if (codepoint < 'A' || codepoint > 'z') return false;
+        glyph.width = 4;
+        glyph.height = 6;
+        glyph.offset_x = 1;
+        glyph.offset_y = 2;
+        glyph.coverage.assign(24, 255);
+        return true;
+    };
+    GpuRendererConfig config;
+    config.backend = GpuBackend::Software;
+    config.width = 64;
+    config.height = 40;
+    config.rasterizer = boxes;
+    config.clear_color = 0xFF000000;
+    std::unique_ptr<GpuRenderer> renderer(GpuRenderer::create(config));
+    TestFramework::assert_true(renderer && renderer->initialize(config), "Software backend initializes");
+    TestFramework::assert_true(renderer->backend() == GpuBackend::Software, "Backend reported");
+    
+    auto draw = [&]() {
+        renderer->begin_frame();
+        renderer->draw_rect(0, 0, 4, 4, 0xFFFF0000);
+        renderer->draw_text("AB A", 10, 10, 0xFF00FF00);
+        renderer->draw_rect(40, 0, 2, 2, 0x80FFFFFF);
+        renderer->draw_line(0, 20, 9, 29, 0xFF0000FF);
+        renderer->end_frame();
+    };
+    auto pixel = [&](int x, int y) { return renderer->framebuffer()[y * config.width + x]; };
+    draw();
+    const GpuFrameStats& stats = renderer->frame_stats();
+    TestFramework::assert_equal(size_t(1), stats.draw_calls, "One draw call per frame");
+    TestFramework::assert_equal(size_t(15), stats.quads, "Blank glyphs emit no quads");
+    TestFramework::assert_true(stats.atlas_upload_bytes > 0, "First frame uploads the atlas");
+    TestFramework::assert_equal(0xFFFF0000u, pixel(1, 1), "Rect filled");
+    TestFramework::assert_equal(0xFF00FF00u, pixel(11, 12), "Glyph drawn at its offset");
+    TestFramework::assert_equal(0xFF000000u, pixel(23, 12), "Space advances without drawing");
+    TestFramework::assert_equal(0xFF00FF00u, pixel(29, 15), "Pen advanced past the space");
+    TestFramework::assert_equal(0xFF808080u, pixel(40, 0), "Alpha blended");
+    TestFramework::assert_true(pixel(5, 25) == 0xFF0000FFu && pixel(5, 24) == 0xFF000000u, "Diagonal line");
+    
+    draw();
+    TestFramework::assert_equal(size_t(0), renderer->frame_stats().atlas_upload_bytes, "Glyphs packed once");
+    TestFramework::assert_equal(0xFF00FF00u, pixel(11, 12), "Second frame matches");
+    
+    // Past its size the atlas doubles; packed glyphs keep their texels
+    GlyphAtlas atlas([](uint32_t codepoint, GlyphBitmap& glyph) {
+        glyph.width = glyph.height = 15;
+        glyph.advance = 16;
+        glyph.coverage.assign(225, static_cast<uint8_t>(codepoint));
+        return true;
+    }, 64);
+    AtlasGlyph first = *atlas.glyph(1);
+    for (uint32_t codepoint = 2; codepoint <= 40; ++codepoint) atlas.glyph(codepoint);
+    TestFramework::assert_true(atlas.size() > 64 && atlas.glyph_count() == 40, "Atlas grows");
+    const AtlasGlyph* again = atlas.glyph(1);
+    TestFramework::assert_true(again->x == first.x && again->y == first.y &&
+                               atlas.pixels()[first.y * atlas.size() + first.x] == 1, "Texels survive growth");
+    TestFramework::assert_equal(0xFFu, static_cast<unsigned>(atlas.pixels()[0]), "White texel kept");
+}
+
+void test_draw_list_records_runs() {
+    using namespace editor;
+    DrawList list;
+    list.add_rect(0, 0, 10, 2, 0xFF112233);
+    list.add_rect(0, 0, 0, 5, 0xFF112233);      // Empty: dropped
+    list.begin_run(5, 20, 8);
+    list.append_run("int", 0xFF0000FF);
+    list.append_run(" ", 0xFFDDDDDD);
+    list.append_run("x", 0xFFDDDDDD);
+    list.add_line(0, 0, 3, 0, 0xFFFFFFFF);
+    list.append_run("lost", 0xFF000000);        // No open run
+    
+    TestFramework::assert_equal(size_t(3), list.commands().size(), "Commands recorded in order");
+    const DrawCommand& run = list.commands()[1];
+    TestFramework::assert_true(run.kind == DrawKind::Run && run.x1 == 8, "Run keeps its cell advance");
+    TestFramework::assert_equal(std::string("int x"), std::string(list.run_text(run)), "Run text contiguous");
+    TestFramework::assert_equal(uint32_t(2), run.span_count, "Same-color pieces share a span");
+    TestFramework::assert_equal(uint32_t(2), list.spans()[run.span_offset + 1].length, "Merged span length");
+    
+    // Capacity survives clear(): a warm list records a frame without allocating
+    const DrawCommand* storage = list.commands().data();
+    list.clear();
+    list.add_text("again", 0, 0, 0xFFFFFFFF);
+    TestFramework::assert_true(list.commands().data() == storage && list.text() == "again", "Storage reused");
+    
+    // A submitted list draws what the immediate calls would
+    GpuRendererConfig config;
+    config.backend = GpuBackend::Software;
+    config.width = 32;
+    config.height = 16;
+    config.clear_color = 0xFF000000;
+    config.rasterizer = [](uint32_t codepoint, GlyphBitmap& glyph) {
+        glyph.advance = 3;
+        if (codepoint == ' ') return true;
+        glyph.width = glyph.height = 2;
+        glyph.coverage.assign(4, 255);
+        return true;
+    };
+    std::unique_ptr<GpuRenderer> renderer(GpuRenderer::create(config));
+    renderer->initialize(config);
+    list.clear();
+    list.add_rect(0, 0, 2, 2, 0xFFFF0000);
+    list.begin_run(0, 8, 5);
+    list.append_run("a ", 0xFF00FF00);
+    list.append_run("b", 0xFF0000FF);
+    renderer->begin_frame();
+    renderer->submit(list);
+    renderer->end_frame();
+    const uint32_t* pixels = renderer->framebuffer();
+    TestFramework::assert_equal(size_t(1), renderer->frame_stats().draw_calls, "Submitted in one draw");
+    TestFramework::assert_equal(size_t(3), renderer->frame_stats().quads, "Rect plus two glyphs");
+    TestFramework::assert_equal(0xFF00FF00u, pixels[8 * 32 + 0], "First span color");
+    TestFramework::assert_equal(0xFF0000FFu, pixels[8 * 32 + 10], "Run advances on the cell grid");
+}
+
+void test_damage_tracker_merges_and_scrolls() {
+    using editor::DamageRect;
+    editor::DamageTracker damage;
+    TestFramework::assert_true(damage.empty(), "Starts clean");
+    
+    // Adjacent rows of one width merge; a caret cell far below stays separate
+    damage.invalidate({0, 0, 100, 16});
+    damage.invalidate({0, 16, 100, 32});
+    damage.invalidate({40, 200, 42, 216});
+    damage.invalidate({10, 4, 20, 8});          // Already covered
+    TestFramework::assert_equal(size_t(2), damage.rects().size(), "Rows merged, caret kept apart");
+    TestFramework::assert_true(damage.intersects({50, 20, 60, 24}) && !damage.intersects({50, 100, 60, 120}),
+                               "Row test");
+    
+    // Scrolling moves pending damage along with the pixels and exposes a band
+    damage.clear();
+    damage.invalidate({0, 32, 100, 48});
+    damage.scroll({0, 0, 100, 160}, -16);
+    TestFramework::assert_equal(size_t(1), damage.scrolls().size(), "Scroll recorded");
+    TestFramework::assert_true(damage.intersects({0, 16, 100, 32}), "Pending damage moved up");
+    TestFramework::assert_true(damage.intersects({0, 144, 100, 160}), "Exposed rows damaged");
+    TestFramework::assert_true(!damage.intersects({0, 80, 100, 96}), "Moved rows not redrawn");
+    
+    // Scrolling a screen or more is a plain redraw of the area
+    damage.clear();
+    damage.scroll({0, 0, 100, 160}, 400);
+    TestFramework::assert_true(damage.scrolls().empty() && damage.intersects({0, 80, 100, 96}), "Far scroll redraws");
+    
+    // Too many scattered rects collapse to their bounds
+    damage.clear();
+    for (int i = 0; i < 20; ++i) damage.invalidate({i * 10, i * 10, i * 10 + 2, i * 10 + 2});
+    TestFramework::assert_true(damage.rects().size() <= editor::DamageTracker::kMaxRects, "Rect count bounded");
+    TestFramework::assert_true(damage.intersects({0, 0, 1, 1}) && damage.intersects({190, 190, 192, 192}),
+                               "Collapsed bounds cover all");
+    
+    damage.invalidate_all();
+    TestFramework::assert_true(damage.full() && damage.intersects({5000, 5000, 5001, 5001}), "Full damage");
+}
+
+void test_line_run_cache_reuses_slots() {
+    using namespace editor;
+    DrawList list;
+    auto key = [&](std::string_view keyword, uint32_t keyword_color, uint32_t background) {
+        list.clear();
+        list.begin_run(10, 0, 8, background);
+        list.append_run(keyword, keyword_color);
+        list.append_run(" x;", 0xFFDDDDDD);
+        return LineRunCache::key_of(list, list.commands()[0], background);
+    };
+    uint64_t base = key("int", 0xFF569CD6, 0xFF1E1E1E);
+    TestFramework::assert_true(base == key("int", 0xFF569CD6, 0xFF1E1E1E), "Same run, same key");
+    TestFramework::assert_true(base != key("int", 0xFF00FF00, 0xFF1E1E1E), "Theme colors are part of the key");
+    TestFramework::assert_true(base != key("int", 0xFF569CD6, 0xFF000000), "Background is part of the key");
+    TestFramework::assert_true(base != key("Int", 0xFF569CD6, 0xFF1E1E1E), "Text is part of the key");
+    
+    LineRunCache cache(3);
+    bool hit = true;
+    size_t a = cache.acquire(1, hit);
+    TestFramework::assert_true(!hit, "First use draws");
+    size_t b = cache.acquire(2, hit);
+    size_t c = cache.acquire(3, hit);
+    TestFramework::assert_true(a != b && b != c && a != c, "Distinct slots");
+    TestFramework::assert_true(cache.acquire(1, hit) == a && hit, "Unchanged line reuses its image");
+    // Key 2 is now least recently used
+    size_t d = cache.acquire(4, hit);
+    TestFramework::assert_true(!hit && d == b, "LRU slot recycled");
+    cache.acquire(2, hit);
+    TestFramework::assert_true(!hit, "Evicted key redraws");
+    TestFramework::assert_equal(size_t(1), cache.hits(), "Hit count");
+}
+
+void test_minimap_density_incremental() {
+    using namespace editor;
+    // 8 lines over 4 rows: row r is lines 2r and 2r + 1
+    auto doc = std::make_shared<PieceTable>("int a;\nint b;\n\n\nx\ny\nz\nw");
+    size_t colored = 0;
+    MinimapDensity density([&](const std::string&) { colored++; return 0xFFFF0000u; });
+    density.resize(12, 4);
+    density.set_document(doc);
+    TestFramework::assert_true(!density.is_complete(), "New document dirties every row");
+    TestFramework::assert_true(density.update(), "Rows derived");
+    TestFramework::assert_true(density.is_complete(), "All rows derived in one budget");
+    
+    const uint32_t* px = density.pixels();
+    auto at = [&](int x, int y) { return density.pixels()[y * density.width() + x]; };
+    TestFramework::assert_equal(MinimapDensity::kBorder, px[0], "Border column");
+    TestFramework::assert_equal(0xFFFF0000u, at(MinimapDensity::kTextLeft, 0), "Both sampled lines inked");
+    TestFramework::assert_equal(MinimapDensity::kBackground, at(MinimapDensity::kTextLeft, 1), "Blank lines stay background");
+    
+    // Same line count: only the edited line's rows are redone
+    colored = 0;
+    doc->insert(doc->get_line_start(6), "q");
+    TestFramework::assert_true(!density.is_complete(), "Edit dirties rows");
+    density.update();
+    TestFramework::assert_true(colored > 0 && colored < 8, "Edit re-derives only nearby rows");
+    
+    // A new line moves every bucket: all rows, in budgeted slices
+    doc->insert(0, "\n");
+    TestFramework::assert_true(density.update(1) && !density.is_complete(), "Budget limits rows per update");
+    while (density.update(1)) {}
+    TestFramework::assert_true(density.is_complete(), "Slices finish the pass");
+    // Row 0 is now a blank line over "int a;": half density
+    uint32_t half = at(MinimapDensity::kTextLeft, 0);
+    TestFramework::assert_true(half != 0xFFFF0000u && half != MinimapDensity::kBackground, "Rows follow the shifted lines");
+    
+    int first = 0, last = 0;
+    density.viewport_rows(0, 1, first, last);
+    TestFramework::assert_true(first == 0 && last == 3, "Visible band is at least 3 rows");
+    std::vector<uint32_t> band;
+    density.blend_rows(first, last, 0xFF0000FF, band);
+    TestFramework::assert_equal(size_t(3 * 12), band.size(), "Band covers its rows");
+    TestFramework::assert_true(band[5] != at(5, 0), "Band is tinted");
+}
+
+void test_code_folding_incremental() {
+    // 0 void a() {      regions: [0,4] [1,3] [6,9]
+    // 1   if (x) {
+    // 2     y();
+    // 3   }
+    // 4 }
+    // 5
+    // 6 void b() {
+    // 7   z();
+    // 8   w();
+    // 9 }
+    auto doc = std::make_shared<PieceTable>(
+        "void a() {\n  if (x) {\n    y();\n  }\n}\n\nvoid b() {\n  z();\n  w();\n}");
+    CodeFoldingManager folding;
+    folding.set_document(doc);
+    TestFramework::assert_equal(size_t(3), folding.get_regions().size(), "Regions detected");
+    
+    folding.fold(1);
+    folding.fold(6);
+    TestFramework::assert_true(!folding.is_line_visible(2) && folding.is_line_visible(4) && !folding.is_line_visible(9), "Folded lines hidden");
+    TestFramework::assert_equal(size_t(5), folding.visible_line_count(10), "Visible count");
+    TestFramework::assert_equal(size_t(4), folding.display_to_document_line(2), "Display -> document line");
+    TestFramework::assert_equal(size_t(6), folding.display_to_document_line(4), "Past the second fold header");
+    TestFramework::assert_equal(size_t(1), folding.document_to_display_line(3), "Hidden line maps to its header");
+    TestFramework::assert_equal(size_t(3), folding.document_to_display_line(5), "Document -> display line");
+    TestFramework::assert_equal(size_t(10), folding.next_visible_line(7), "Skips a fold");
+    std::vector<size_t> expected = {0, 1, 4, 5, 6};
+    TestFramework::assert_true(folding.get_visible_lines(10) == expected, "Visible lines");
+    
+    // A new line inside a(): b() shifts down and stays folded
+    doc->insert(doc->get_line_start(2), "    v();\n");
+    TestFramework::assert_equal(size_t(3), folding.get_regions().size(), "Regions kept");
+    const FoldRegion* b = folding.get_region_at_line(7);
+    TestFramework::assert_true(b && b->end_line == 10 && b->is_folded, "Later region shifted, still folded");
+    const FoldRegion* inner = folding.get_region_at_line(1);
+    TestFramework::assert_true(inner && inner->end_line == 4 && inner->is_folded, "Edited region re-derived, fold kept");
+    
+    // A stray close inside the if unbalances the span: braces re-pair across the document
+    doc->insert(doc->get_line_start(3), "  }\n");
+    const FoldRegion* outer = folding.get_region_at_line(0);
+    inner = folding.get_region_at_line(1);
+    TestFramework::assert_true(outer && outer->end_line == 5 && inner && inner->end_line == 3, "Re-paired after unbalancing edit");
+    const FoldRegion* shifted = folding.get_region_at_line(8);
+    TestFramework::assert_true(shifted && shifted->is_folded && inner->is_folded, "Folds survive a rescan");
+    
+    folding.unfold_all();
+    TestFramework::assert_true(!folding.has_folds() && folding.is_line_visible(9), "Unfold all");
+}
+
+void test_bracket_index() {
+    // Brackets in strings and comments don't count
+    auto doc = std::make_shared<PieceTable>(
+        "int f(int a) {\n"                          // 0
+        "    const char* s = \"}(\";  // )\n"       // 1
+        "    if (a) {\n"                            // 2
+        "        g(a, [1, 2]);\n"                   // 3
+        "    }\n"                                   // 4
+        "    /* { */\n"                             // 5
+        "}");                                       // 6
+    SyntaxHighlighter highlighter;
+    auto brackets = std::make_shared<BracketIndex>(&highlighter);
+    CodeFoldingManager folding;
+    folding.set_line_source(brackets);
+    folding.set_document(doc);
+    TestFramework::assert_true(brackets->brackets(1).empty() && brackets->brackets(5).empty(), "Strings and comments skipped");
+    TestFramework::assert_equal(size_t(2), folding.get_regions().size(), "Folding from the lexer's braces");
+
+    BracketIndex::Pair pair;
+    TestFramework::assert_true(brackets->match(0, 13, pair) && pair.close_line == 6 && pair.close_column == 0, "Open matches close");
+    TestFramework::assert_true(brackets->match(6, 0, pair) && pair.open_line == 0 && pair.open_column == 13, "Close matches open");
+    TestFramework::assert_true(brackets->match(3, 13, pair) && pair.kind == BracketIndex::Kind::Square &&
+                               pair.close_line == 3 && pair.close_column == 18, "Square pair");
+    TestFramework::assert_true(!brackets->match(3, 10, pair), "No bracket there");
+    TestFramework::assert_true(brackets->enclosing(3, 11, pair) && pair.kind == BracketIndex::Kind::Round &&
+                               pair.open_column == 9, "Innermost enclosing pair");
+    TestFramework::assert_true(brackets->enclosing(3, 11, BracketIndex::Kind::Curly, pair) && pair.open_line == 2 &&
+                               pair.close_line == 4, "Enclosing block");
+    std::vector<size_t> headers;
+    brackets->headers(3, headers);
+    TestFramework::assert_true(headers == std::vector<size_t>({0, 2}), "Sticky headers, outermost first");
+    TestFramework::assert_equal(size_t(2), brackets->depth(3, 13, BracketIndex::Kind::Curly), "Curly depth");
+
+    // Opening a comment takes the braces below it out, up to the */
+    doc->insert(doc->get_line_start(2), "/*");
+    TestFramework::assert_true(brackets->brackets(3).empty() && brackets->changed_end() == 6, "Lines below re-lexed");
+    TestFramework::assert_true(brackets->match(0, 13, pair) && pair.close_line == 6, "Outer pair intact");
+    TestFramework::assert_true(folding.get_region_at_line(2) == nullptr && folding.get_regions().size() == 1, "Block folded away");
+    doc->remove(doc->get_line_start(2), 2);
+    TestFramework::assert_equal(size_t(2), folding.get_regions().size(), "Block back");
+
+    // Against a plain stack after many edits
+    std::string text;
+    for (int i = 0; i < 400; ++i) text += "x{(\n}[])\n";
+    auto big = std::make_shared<PieceTable>(text);
+    BracketIndex index(&highlighter);
+    index.set_document(big);
+    std::mt19937 rng(78);
+    const char* pieces[] = {"{", "}", "(", ")", "[", "]", "\n", "{\n", "}\n", "ab"};
+    for (int i = 0; i < 300; ++i) {
+        size_t at = rng() % (big->get_total_length() + 1);
+        if (rng() % 3 == 0 && at < big->get_total_length()) {
+            big->remove(at, (std::min)(size_t(1 + rng() % 3), big->get_total_length() - at));
+        } else {
+            big->insert(at, pieces[rng() % 10]);
+        }
+    }
+    TestFramework::assert_equal(big->get_line_count(), index.line_count(), "Lines followed");
+    std::vector<std::vector<std::pair<size_t, size_t>>> stacks(BracketIndex::kKinds);
+    size_t mismatches = 0;
+    size_t checked = 0;
+    for (size_t line = 0; line < index.line_count(); ++line) {
+        for (const auto& bracket : index.brackets(line)) {
+            auto& stack = stacks[static_cast<size_t>(bracket.kind)];
+            if (bracket.open) {
+                stack.push_back({line, bracket.column});
+            } else if (!stack.empty()) {
+                BracketIndex::Pair expected;
+                expected.open_line = stack.back().first;
+                expected.open_column = stack.back().second;
+                stack.pop_back();
+                bool ok = index.match(line, bracket.column, pair) && pair.open_line == expected.open_line &&
+                          pair.open_column == expected.open_column &&
+                          index.match(expected.open_line, expected.open_column, pair) && pair.close_line == line &&
+                          pair.close_column == bracket.column;
+                if (!ok) ++mismatches;
+                ++checked;
+            } else if (index.match(line, bracket.column, pair)) {
+                ++mismatches;       // Unmatched close
+            }
+        }
+    }
+    TestFramework::assert_true(checked > 100, "Pairs checked");
+    TestFramework::assert_equal(size_t(0), mismatches, "Matches agree with a stack");
 }
 
 // ============================================================================
 // PROPERTY-BASED TESTS
 // ============================================================================
 
+void test_document_outline() {
+    auto doc = std::make_shared<PieceTable>(
+        "namespace app {\n"                         // 0
+        "class Widget {\n"                          // 1
+        "public:\n"                                 // 2
+        "    void draw(int x) {\n"                  // 3
+        "        if (x) {\n"                        // 4
+        "            paint();\n"                    // 5
+        "        }\n"                               // 6
+        "    }\n"                                   // 7
+        "};\n"                                      // 8
+        "int helper(int a)\n"                       // 9
+        "{\n"                                       // 10
+        "    return a;\n"                           // 11
+        "}\n"                                       // 12
+        "}");                                       // 13
+    SyntaxHighlighter highlighter;
+    auto brackets = std::make_shared<BracketIndex>(&highlighter);
+    CodeFoldingManager folding;
+    folding.set_line_source(brackets);
+    folding.set_document(doc);
+    editor::DocumentOutline outline;
+    outline.set_document(doc, SymbolTags::Language::CFamily);
+    auto names = [](const std::vector<editor::DocumentOutline::Symbol>& symbols) {
+        std::string joined;
+        for (const auto& symbol : symbols) joined += (joined.empty() ? "" : ">") + symbol.name;
+        return joined;
+    };
+    TestFramework::assert_equal(std::string("app>Widget>draw"), names(outline.path_at(5, *brackets)), "Path inside a method");
+    TestFramework::assert_equal(std::string("app>helper"), names(outline.path_at(11, *brackets)), "Brace on its own line");
+    TestFramework::assert_equal(std::string("app>Widget"), names(outline.path_at(1, *brackets)), "A definition's own line");
+    const auto& all = outline.symbols(*brackets);
+    TestFramework::assert_equal(std::string("app>Widget>draw>helper"), names(all), "Outline in order");
+    TestFramework::assert_true(all.size() == 4 && all[0].end_line == 13 && all[2].end_line == 7 && all[2].depth == 2 &&
+                               all[3].line == 9 && all[3].end_line == 12 && all[3].depth == 1, "Blocks and nesting");
+    
+    // Edits move the definitions after them and rescan only their lines
+    doc->insert(0, "// header\n\n");
+    TestFramework::assert_equal(std::string("app>Widget>draw"), names(outline.path_at(7, *brackets)), "Shifted by an edit above");
+    doc->insert(doc->get_line_start(5), "    void resize() {}\n");
+    TestFramework::assert_equal(size_t(5), outline.definition_count(), "Added method scanned");
+    TestFramework::assert_equal(std::string("app>Widget>resize"), names(outline.path_at(5, *brackets)), "New definition's line");
+    TestFramework::assert_equal(std::string("app>Widget>draw"), names(outline.path_at(8, *brackets)), "Method below it moved");
+    doc->remove(doc->get_line_start(5), doc->get_line_start(6) - doc->get_line_start(5));
+    TestFramework::assert_equal(size_t(4), outline.definition_count(), "Removed line's definition gone");
+    TestFramework::assert_equal(size_t(11), outline.symbols(*brackets).back().line, "Helper moved up");
+}
+
 void test_property_insert_increases_length() {
     PropertyTester tester;
     
@@ -426,6 +5354,34 @@ void test_performance_large_file_insert() {
     TestFramework::assert_true(duration < 1000.0, "Inserts should be fast (< 1s for 10k)");
 }
 
+void test_performance_line_lookup_after_edit() {
+    std::cout << "Performance test: Line lookup after single-character edits (1M lines)\n";
+    
+    std::string text;
+    text.reserve(12 * 1000000);
+    for (int i = 0; i < 1000000; ++i) {
+        text += "line ";
+        text += std::to_string(i % 1000);
+        text += "\n";
+    }
+    PieceTable doc(text);
+    
+    auto start = std::chrono::high_resolution_clock::now();
+    size_t lines = 0;
+    for (int i = 0; i < 1000; ++i) {
+        doc.insert(doc.get_total_length() / 2 + i * 7, (i % 10 == 0) ? "\n" : "x");
+        lines = doc.get_line_count();
+        doc.get_line(lines / 2);
+        doc.get_line(lines - 2);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration<double, std::milli>(end - start).count();
+    
+    std::cout << "  1,000 edit + lookup rounds: " << duration << "ms\n";
+    TestFramework::assert_equal(size_t(1000001 + 100), lines, "Line count tracks inserted newlines");
+    TestFramework::assert_true(duration < 100.0, "Edit + line lookup should not rescan the document");
+}
+
 void test_performance_search() {
     std::cout << "Performance test: Search in large document\n";
     
@@ -448,6 +5404,74 @@ void test_performance_search() {
     TestFramework::assert_true(duration < 100.0, "Search should be fast (< 100ms)");
 }
 
+// Replays synthetic and recorded sessions on every backend and through the
+// edit pipeline. They must all end on the same text; with
+// EDITOR_PERF_THRESHOLDS set, throughput and p99 latency are checked too.
+void test_edit_trace_replay() {
+    using editor::EditTrace;
+    std::string initial;
+    for (int i = 0; i < 2000; ++i) initial += "    int value_" + std::to_string(i) + " = compute(" + std::to_string(i) + ");\n";
+    std::vector<EditTrace> traces = {
+        EditTrace::typing(initial.size(), 5000),
+        EditTrace::random(initial.size(), 5000),
+        EditTrace::paste_storm(initial.size(), 200, 2048),
+        EditTrace::multi_cursor(initial.size(), 100, 16),
+    };
+
+    // Recorded sessions come from the document's change listener
+    auto live = std::make_shared<PieceTable>(initial);
+    editor::EditTraceRecorder recorder;
+    recorder.attach(live);
+    live->insert(10, "abc");
+    live->remove(5, 20);
+    live->apply_edits({{0, 0, "x"}, {100, 4, "yy\n"}});
+    live->undo();
+    recorder.attach(nullptr);
+    live->insert(0, "not recorded");
+    recorder.trace().name = "recorded";
+    TestFramework::assert_equal(editor::replay(recorder.trace(), initial, TextBufferBackend::PieceTable).final_text,
+                                live->get_text(12, live->get_total_length() - 12), "Recorded trace replays the session");
+    traces.push_back(recorder.trace());
+
+    // The file format round-trips, escapes included
+    std::stringstream written;
+    traces[1].write(written);
+    EditTrace parsed;
+    std::string error;
+    TestFramework::assert_true(parsed.read(written, &error), "Trace parses: " + error);
+    std::stringstream rewritten;
+    parsed.write(rewritten);
+    TestFramework::assert_equal(written.str(), rewritten.str(), "Trace round-trips");
+    std::stringstream malformed("# edit-trace 1\ni 3 ok\nd 4\n");
+    TestFramework::assert_true(!parsed.read(malformed, &error) && error.find("line 3") == 0, "Malformed line reported");
+
+    const bool check = std::getenv("EDITOR_PERF_THRESHOLDS") != nullptr;
+    for (const EditTrace& trace : traces) {
+        std::vector<editor::ReplayResult> results;
+        for (TextBufferBackend backend : {TextBufferBackend::PieceTable, TextBufferBackend::Rope, TextBufferBackend::GapBuffer}) {
+            results.push_back(editor::replay(trace, initial, backend));
+        }
+        editor::PipelineCounters counters;
+        results.push_back(editor::replay_pipeline(trace, initial, 8, &counters));
+        TestFramework::assert_true(counters.tokenized_lines > 0 && counters.lsp_changes > 0 && counters.undo_steps > 0,
+                                   trace.name + ": pipeline highlighted, synced and recorded undo");
+
+        for (const editor::ReplayResult& result : results) {
+            std::cout << "  " << result.format() << "\n";
+            TestFramework::assert_equal(results[0].final_text, result.final_text,
+                                        result.target + " replays " + trace.name + " to the same text");
+            TestFramework::assert_true(result.ops >= trace.edit_count(), "Every edit timed");
+            if (!check) continue;
+            // Generous floors: these catch complexity regressions, not noise
+            bool pipeline = result.target == "pipeline";
+            double min_rate = pipeline ? 5000.0 : 10000.0;
+            uint64_t max_p99 = pipeline ? 2000000 : 200000;
+            TestFramework::assert_true(result.ops_per_second() >= min_rate, result.target + "/" + trace.name + " throughput");
+            TestFramework::assert_true(result.latency_ns.percentile(99) <= max_p99, result.target + "/" + trace.name + " p99 latency");
+        }
+    }
+}
+
 // ============================================================================
 // MAIN TEST RUNNER
 // ============================================================================
@@ -470,18 +5494,123 @@ int main() {
     tests.add_test("PieceTable: Delete from end", test_piece_table_delete_end);
     tests.add_test("PieceTable: Multiple operations", test_piece_table_multiple_operations);
     tests.add_test("PieceTable: Get line", test_piece_table_get_line);
+    tests.add_test("PieceTable: Random edits match reference", test_piece_table_random_edits_match_reference);
+    tests.add_test("PieceTable: Lines range", test_piece_table_lines_range);
+    tests.add_test("PieceTable: Line cursor", test_piece_table_line_cursor);
+    tests.add_test("PieceTable: Line/column mapping", test_piece_table_line_column_mapping);
+    tests.add_test("PieceTable: Mapped file", test_piece_table_mapped_file);
+    tests.add_test("PlatformFile: Span writes", test_platform_file_span_writes);
+    tests.add_test("PieceTable: Background line index", test_piece_table_background_index);
+    tests.add_test("PieceTable: Snapshot", test_piece_table_snapshot);
+    tests.add_test("RopeTable: Matches PieceTable", test_rope_table_matches_piece_table);
+    tests.add_test("RopeTable: Snapshots and undo", test_rope_table_snapshots_and_undo);
+    tests.add_test("TextBuffer: Backends agree", test_text_buffer_backends_agree);
+    tests.add_test("TextBuffer: Backend selection", test_text_buffer_selection);
+    tests.add_test("HexBuffer: Rows, search and patches", test_hex_buffer);
+    tests.add_test("GapBuffer: Matches reference", test_gap_buffer_matches_reference);
+    tests.add_test("EditorCore: Open and save", test_editor_core_open_save);
+    tests.add_test("SlabPool: Reuses slots", test_slab_pool_reuses_slots);
+    tests.add_test("PrefixIndex: Matches std searches", test_prefix_index_matches_std);
+    tests.add_test("SyntaxHighlighter: Per-language lexers and keyword tables", test_syntax_highlighter_lexers);
+    tests.add_test("HighlightCache: Invalidation", test_highlight_cache_invalidation);
+    tests.add_test("LargeFilePolicy: Degrades features past thresholds", test_large_file_policy);
+    tests.add_test("LogFollower: Appends, truncation and rotation", test_log_follower);
+    tests.add_test("Viewport: Scroll to end for followed files", test_viewport_follow_end);
+    tests.add_test("HighlightCache: Reuses Tokens", test_highlight_cache_reuses_tokens);
+    tests.add_test("HighlightCache: Semantic Tokens", test_highlight_cache_semantic_tokens);
+    tests.add_test("HighlightCache: Background Worker", test_highlight_cache_background);
+    tests.add_test("TreeSitterBridge: Apply Edit", test_treesitter_bridge_apply_edit);
+    tests.add_test("GpuRenderer: Batches frame", test_gpu_renderer_batches_frame);
+    tests.add_test("DrawList: Records runs", test_draw_list_records_runs);
+    tests.add_test("DamageTracker: Merges and scrolls", test_damage_tracker_merges_and_scrolls);
+    tests.add_test("LineRunCache: Reuses slots", test_line_run_cache_reuses_slots);
+    tests.add_test("MinimapDensity: Incremental rows", test_minimap_density_incremental);
+    tests.add_test("CodeFolding: Incremental regions", test_code_folding_incremental);
+    tests.add_test("BracketIndex: Matching, enclosing and folding", test_bracket_index);
+    tests.add_test("DocumentOutline: Symbol paths and incremental outline", test_document_outline);
+    tests.add_test("Viewport: Skips folds", test_viewport_skips_folds);
+    tests.add_test("Viewport: Soft wrap", test_viewport_soft_wrap);
+    tests.add_test("Viewport: Parks per-document state", test_viewport_parks_state);
+    tests.add_test("ColumnLayout: Clusters, wide characters and tabs", test_column_layout);
+    tests.add_test("DocumentView: Split views share one document", test_document_view_shares_document);
+    tests.add_test("LspDocumentSync: Coalesced incremental changes", test_lsp_document_sync);
+    tests.add_test("LspFraming: Buffered framing and queue", test_lsp_framing);
+    tests.add_test("LspFraming: Message head without parsing", test_lsp_peek_message_head);
+    tests.add_test("LspDecode: Streaming completion and diagnostics", test_lsp_streaming_decode);
+    tests.add_test("LspEncode: Document messages streamed from pieces", test_lsp_document_message);
+    tests.add_test("LspIoReactor: Shared reader thread", test_lsp_io_reactor);
+    tests.add_test("GitStatusWorker: Coalesced background status", test_git_status_worker);
+    tests.add_test("DiffEngine: Histogram, patience and Myers", test_diff_engine);
+    tests.add_test("DiffGutter: Incremental in-process diff", test_diff_gutter);
+    tests.add_test("BlameCache: Incremental parse and edit remapping", test_blame_cache);
+    tests.add_test("TerminalScreen: VT parsing and ring scrollback", test_terminal_screen);
+    tests.add_test("ProcessIoLoop: Child output on one thread", test_process_io_loop);
+    tests.add_test("BuildErrorParser: Streaming line parsing", test_build_error_parser_streaming);
+    tests.add_test("PluginDocumentAccess: Line ranges and edit batches", test_plugin_document_access);
+    tests.add_test("PluginWorker: Coalescing and budgets", test_plugin_worker_budgets);
+    tests.add_test("PluginCatalog: Scan and cache", test_plugin_catalog_scan_and_cache);
+    tests.add_test("EventBus: Batched, filtered delivery", test_event_bus_batched_delivery);
+    tests.add_test("AutocompleteManager: Prefix ranges and incremental counts", test_autocomplete_incremental);
+    tests.add_test("AutocompleteManager: Workspace vocabulary under the document", test_autocomplete_workspace_vocabulary);
+    
+    // TextScan unit tests
+    tests.add_test("TextScan: Kernel matches scalar", test_text_scan_matches_scalar);
+    tests.add_test("TextScan: Byte pattern search", test_text_scan_find_bytes);
+    tests.add_test("TextTranscode: Line breaks and UTF-8/UTF-16", test_text_transcode);
     
     // UndoManager unit tests
     tests.add_test("UndoManager: Single insert", test_undo_manager_single_insert);
     tests.add_test("UndoManager: Single delete", test_undo_manager_single_delete);
     tests.add_test("UndoManager: Multiple operations", test_undo_manager_multiple_operations);
     tests.add_test("UndoManager: Redo", test_undo_manager_redo);
+    tests.add_test("UndoManager: Coalesces Keystrokes", test_undo_manager_coalesces_keystrokes);
+    tests.add_test("UndoManager: Trims History", test_undo_manager_trims_history);
+    tests.add_test("UndoManager: History Spills To Disk", test_undo_history_spills_to_disk);
+    tests.add_test("UndoManager: Delete Keeps Pieces", test_undo_manager_delete_keeps_pieces);
+    tests.add_test("UndoManager: Transactions", test_undo_manager_transactions);
+    tests.add_test("UndoManager: Multi-range edits", test_undo_manager_multi_edit);
+    tests.add_test("InternalClipboard: Pieces shared between documents", test_internal_clipboard);
     
     // FindDialog unit tests
     tests.add_test("FindDialog: Simple find", test_find_simple);
     tests.add_test("FindDialog: Case insensitive", test_find_case_insensitive);
     tests.add_test("FindDialog: Case sensitive", test_find_case_sensitive);
     tests.add_test("FindDialog: No match", test_find_no_match);
+    tests.add_test("FindDialog: Streams pieces", test_find_streams_pieces);
+    tests.add_test("FindDialog: Regex", test_find_regex);
+    tests.add_test("SearchSession: Incremental", test_search_session_incremental);
+    tests.add_test("RegexEngine: Matches", test_regex_engine_matches);
+    
+    // BackgroundIndexer unit tests
+    tests.add_test("BackgroundIndexer: Re-index and remove", test_indexer_reindex_and_remove);
+    tests.add_test("BackgroundIndexer: Ranked search with query cache", test_indexer_ranked_search);
+    tests.add_test("BackgroundIndexer: Symbol definitions", test_indexer_symbol_definitions);
+    tests.add_test("BackgroundIndexer: Compacts stale postings", test_indexer_compacts_stale_postings);
+    tests.add_test("BackgroundIndexer: Find in files", test_indexer_find_in_files);
+    tests.add_test("BackgroundIndexer: Persistent warm start", test_indexer_persistent_warm_start);
+    tests.add_test("BackgroundIndexer: Reads lines on demand", test_indexer_reads_lines_on_demand);
+    tests.add_test("ThreadPool: Runs nested tasks", test_thread_pool_runs_nested_tasks);
+    tests.add_test("ThreadPool: Priorities, cancellation and continuations", test_thread_pool_priorities_and_cancellation);
+    tests.add_test("BackgroundIndexer: Crawls workspace", test_indexer_crawls_workspace);
+    tests.add_test("BackgroundIndexer: Applies file changes", test_indexer_applies_file_changes);
+    tests.add_test("FileWatcher: Batches changes", test_file_watcher_batches_changes);
+    tests.add_test("GitIgnore: Patterns", test_gitignore_patterns);
+    tests.add_test("QuickOpenIndex: Ranks paths", test_quick_open_ranks_paths);
+    tests.add_test("WorkspaceReplace: Applies atomically", test_workspace_replace_applies_atomically);
+    tests.add_test("BatchEdit: Runs edit programs over files", test_batch_edit_runs_programs);
+    tests.add_test("DocumentTransform: Runs in chunks", test_document_transforms_run_in_chunks);
+    tests.add_test("RemoteAgent: Syncs viewport lines and edit deltas", test_remote_workspace_syncs_deltas);
+    tests.add_test("ResultList: Streams and virtualizes result rows", test_result_list_streams_and_virtualizes);
+    tests.add_test("DocumentJournal: Recovers edits", test_document_journal_recovers_edits);
+    tests.add_test("TabManager: Hibernates tabs", test_tab_manager_hibernates_tabs);
+    tests.add_test("TabManager: Restores a session progressively", test_tab_manager_restores_session);
+    tests.add_test("StartupScheduler: Runs background and idle tasks", test_startup_scheduler);
+#ifndef DISABLE_TRACING
+    tests.add_test("Tracer: Records spans and exports a Chrome trace", test_tracer);
+#endif
+    tests.add_test("FrameStats: Histograms latency and frame phases", test_frame_stats);
+    tests.add_test("MemoryReport: Accounts memory per document and subsystem", test_memory_report);
+    tests.add_test("MemoryPressure: Sheds caches in order and reports it", test_memory_pressure_sheds_in_order);
     
     // Property-based tests
     tests.add_test("Property: Insert increases length", test_property_insert_increases_length);
@@ -494,7 +5623,9 @@ int main() {
     
     // Performance tests
     tests.add_test("Performance: Large file inserts", test_performance_large_file_insert);
+    tests.add_test("Performance: Line lookup after edit", test_performance_line_lookup_after_edit);
     tests.add_test("Performance: Search", test_performance_search);
+    tests.add_test("Performance: Edit trace replay", test_edit_trace_replay);
     
     // Run all tests
     auto results = tests.run_all();
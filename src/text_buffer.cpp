@@ -0,0 +1,36 @@
+#include "text_buffer.h"
+#include "piece_table.h"
+#include "rope_table.h"
+#include "gap_text_buffer.h"
+#include "hex_buffer.h"
+#include "platform_file.h"
+
+TextBufferBackend TextBuffer::choose_backend(size_t size) {
+    return size < kSmallFileLimit ? TextBufferBackend::GapBuffer : TextBufferBackend::PieceTable;
+}
+
+const char* TextBuffer::backend_name(TextBufferBackend backend) {
+    switch (backend) {
+        case TextBufferBackend::GapBuffer:  return "gap buffer";
+        case TextBufferBackend::PieceTable: return "piece table";
+        case TextBufferBackend::Rope:       return "rope";
+        case TextBufferBackend::Hex:        return "hex";
+        case TextBufferBackend::Auto:
+        default:                            return "auto";
+    }
+}
+
+std::shared_ptr<TextBuffer> TextBuffer::create(const std::string& content, TextBufferBackend backend) {
+    if (backend == TextBufferBackend::Auto) backend = choose_backend(content.size());
+    switch (backend) {
+        case TextBufferBackend::GapBuffer: return std::make_shared<GapTextBuffer>(content);
+        case TextBufferBackend::Rope:      return std::make_shared<RopeTable>(content);
+        case TextBufferBackend::Hex:       return std::make_shared<HexBuffer>(content);
+        case TextBufferBackend::PieceTable:
+        default:                           return std::make_shared<PieceTable>(content);
+    }
+}
+
+std::shared_ptr<TextBuffer> TextBuffer::open_mapped(std::shared_ptr<editor::MappedFile> mapping) {
+    return std::make_shared<PieceTable>(std::move(mapping), PieceTable::LineIndexing::Background);
+}
@@ -0,0 +1,319 @@
+#include "text_scan.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define TEXT_SCAN_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define TEXT_SCAN_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TEXT_SCAN_TARGET_AVX2
+#else
+#define TEXT_SCAN_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace {
+
+inline unsigned trailing_zeros(uint64_t bits) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+#if defined(_M_X64) || defined(_M_ARM64)
+    _BitScanForward64(&index, bits);
+#else
+    if (static_cast<uint32_t>(bits) != 0) {
+        _BitScanForward(&index, static_cast<uint32_t>(bits));
+    } else {
+        _BitScanForward(&index, static_cast<uint32_t>(bits >> 32));
+        index += 32;
+    }
+#endif
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(bits));
+#endif
+}
+
+// Emit every set bit of a block mask as an absolute offset
+inline void emit_mask(uint64_t mask, size_t block_offset, std::vector<size_t>& out) {
+    while (mask) {
+        out.push_back(block_offset + trailing_zeros(mask));
+        mask &= mask - 1;
+    }
+}
+
+#ifdef TEXT_SCAN_X86
+
+size_t count_newlines_sse2(const char* data, size_t length) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i zero = _mm_setzero_si128();
+    size_t total = 0;
+    size_t i = 0;
+    while (i + 16 <= length) {
+        // Byte counters can absorb at most 255 hits before they must be summed
+        __m128i acc = _mm_setzero_si128();
+        size_t block_end = i + 255 * 16;
+        if (block_end > length) block_end = length;
+        for (; i + 16 <= block_end; i += 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(chunk, newline));
+        }
+        __m128i sums = _mm_sad_epu8(acc, zero);
+        total += static_cast<size_t>(_mm_cvtsi128_si32(sums)) +
+                 static_cast<size_t>(_mm_cvtsi128_si32(_mm_srli_si128(sums, 8)));
+    }
+    return total + TextScan::count_newlines_scalar(data + i, length - i);
+}
+
+void find_newlines_sse2(const char* data, size_t length, size_t base, std::vector<size_t>& out) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+        emit_mask(mask, base + i, out);
+    }
+    TextScan::find_newlines_scalar(data + i, length - i, base + i, out);
+}
+
+size_t find_bytes_sse2(const char* data, size_t length, const char* needle, size_t needle_length) {
+    if (needle_length == 0) return 0;
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_length - 1]);
+    size_t i = 0;
+    for (; i + needle_length - 1 + 16 <= length; i += 16) {
+        __m128i head = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i tail = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + needle_length - 1));
+        uint32_t mask = static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(head, first), _mm_cmpeq_epi8(tail, last))));
+        while (mask) {
+            size_t at = i + trailing_zeros(mask);
+            if (std::memcmp(data + at, needle, needle_length) == 0) return at;
+            mask &= mask - 1;
+        }
+    }
+    size_t rest = TextScan::find_bytes_scalar(data + i, length - i, needle, needle_length);
+    return rest == TextScan::npos ? rest : i + rest;
+}
+
+TEXT_SCAN_TARGET_AVX2
+size_t count_newlines_avx2(const char* data, size_t length) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i zero = _mm256_setzero_si256();
+    size_t total = 0;
+    size_t i = 0;
+    while (i + 32 <= length) {
+        __m256i acc = _mm256_setzero_si256();
+        size_t block_end = i + 255 * 32;
+        if (block_end > length) block_end = length;
+        for (; i + 32 <= block_end; i += 32) {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(chunk, newline));
+        }
+        __m256i sums = _mm256_sad_epu8(acc, zero);
+        total += static_cast<size_t>(_mm256_extract_epi64(sums, 0)) +
+                 static_cast<size_t>(_mm256_extract_epi64(sums, 1)) +
+                 static_cast<size_t>(_mm256_extract_epi64(sums, 2)) +
+                 static_cast<size_t>(_mm256_extract_epi64(sums, 3));
+    }
+    return total + count_newlines_sse2(data + i, length - i);
+}
+
+TEXT_SCAN_TARGET_AVX2
+void find_newlines_avx2(const char* data, size_t length, size_t base, std::vector<size_t>& out) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline)));
+        emit_mask(mask, base + i, out);
+    }
+    find_newlines_sse2(data + i, length - i, base + i, out);
+}
+
+TEXT_SCAN_TARGET_AVX2
+size_t find_bytes_avx2(const char* data, size_t length, const char* needle, size_t needle_length) {
+    if (needle_length == 0) return 0;
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needle_length - 1]);
+    size_t i = 0;
+    for (; i + needle_length - 1 + 32 <= length; i += 32) {
+        __m256i head = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        __m256i tail = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + needle_length - 1));
+        uint32_t mask = static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(head, first), _mm256_cmpeq_epi8(tail, last))));
+        while (mask) {
+            size_t at = i + trailing_zeros(mask);
+            if (std::memcmp(data + at, needle, needle_length) == 0) return at;
+            mask &= mask - 1;
+        }
+    }
+    size_t rest = find_bytes_sse2(data + i, length - i, needle, needle_length);
+    return rest == TextScan::npos ? rest : i + rest;
+}
+
+bool cpu_has_avx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7) return false;
+    __cpuid(regs, 1);
+    bool osxsave = (regs[2] & (1 << 27)) != 0;
+    bool avx = (regs[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) return false;
+    if ((_xgetbv(0) & 0x6) != 0x6) return false;  // OS saves YMM state
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // TEXT_SCAN_X86
+
+#ifdef TEXT_SCAN_NEON
+
+size_t count_newlines_neon(const char* data, size_t length) {
+    const uint8x16_t newline = vdupq_n_u8('\n');
+    size_t total = 0;
+    size_t i = 0;
+    while (i + 16 <= length) {
+        uint8x16_t acc = vdupq_n_u8(0);
+        size_t block_end = i + 255 * 16;
+        if (block_end > length) block_end = length;
+        for (; i + 16 <= block_end; i += 16) {
+            uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t*>(data + i));
+            acc = vsubq_u8(acc, vceqq_u8(chunk, newline));
+        }
+        total += vaddlvq_u8(acc);
+    }
+    return total + TextScan::count_newlines_scalar(data + i, length - i);
+}
+
+void find_newlines_neon(const char* data, size_t length, size_t base, std::vector<size_t>& out) {
+    const uint8x16_t newline = vdupq_n_u8('\n');
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t*>(data + i));
+        uint8x16_t eq = vceqq_u8(chunk, newline);
+        // Narrow to a 64-bit mask with 4 bits per input byte
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        mask &= 0x1111111111111111ULL;
+        while (mask) {
+            out.push_back(base + i + (trailing_zeros(mask) >> 2));
+            mask &= mask - 1;
+        }
+    }
+    TextScan::find_newlines_scalar(data + i, length - i, base + i, out);
+}
+
+size_t find_bytes_neon(const char* data, size_t length, const char* needle, size_t needle_length) {
+    if (needle_length == 0) return 0;
+    const uint8x16_t first = vdupq_n_u8(static_cast<uint8_t>(needle[0]));
+    const uint8x16_t last = vdupq_n_u8(static_cast<uint8_t>(needle[needle_length - 1]));
+    size_t i = 0;
+    for (; i + needle_length - 1 + 16 <= length; i += 16) {
+        uint8x16_t head = vld1q_u8(reinterpret_cast<const uint8_t*>(data + i));
+        uint8x16_t tail = vld1q_u8(reinterpret_cast<const uint8_t*>(data + i + needle_length - 1));
+        uint8x16_t eq = vandq_u8(vceqq_u8(head, first), vceqq_u8(tail, last));
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        mask &= 0x1111111111111111ULL;
+        while (mask) {
+            size_t at = i + (trailing_zeros(mask) >> 2);
+            if (std::memcmp(data + at, needle, needle_length) == 0) return at;
+            mask &= mask - 1;
+        }
+    }
+    size_t rest = TextScan::find_bytes_scalar(data + i, length - i, needle, needle_length);
+    return rest == TextScan::npos ? rest : i + rest;
+}
+
+#endif // TEXT_SCAN_NEON
+
+struct Kernel {
+    size_t (*count)(const char*, size_t);
+    void (*find)(const char*, size_t, size_t, std::vector<size_t>&);
+    size_t (*find_bytes)(const char*, size_t, const char*, size_t);
+    const char* name;
+};
+
+Kernel select_kernel() {
+#if defined(TEXT_SCAN_X86)
+    if (cpu_has_avx2()) return {count_newlines_avx2, find_newlines_avx2, find_bytes_avx2, "avx2"};
+    return {count_newlines_sse2, find_newlines_sse2, find_bytes_sse2, "sse2"};
+#elif defined(TEXT_SCAN_NEON)
+    return {count_newlines_neon, find_newlines_neon, find_bytes_neon, "neon"};
+#else
+    return {TextScan::count_newlines_scalar, TextScan::find_newlines_scalar, TextScan::find_bytes_scalar, "scalar"};
+#endif
+}
+
+const Kernel& kernel() {
+    static const Kernel selected = select_kernel();
+    return selected;
+}
+
+} // namespace
+
+size_t TextScan::count_newlines(const char* data, size_t length) {
+    return kernel().count(data, length);
+}
+
+void TextScan::find_newlines(const char* data, size_t length, size_t base, std::vector<size_t>& out) {
+    kernel().find(data, length, base, out);
+}
+
+size_t TextScan::find_bytes(const char* data, size_t length, const char* needle, size_t needle_length) {
+    if (needle_length > length) return npos;
+    return kernel().find_bytes(data, length, needle, needle_length);
+}
+
+const char* TextScan::active_kernel() {
+    return kernel().name;
+}
+
+size_t TextScan::count_newlines_scalar(const char* data, size_t length) {
+    size_t total = 0;
+    const char* p = data;
+    const char* end = data + length;
+    while (p < end) {
+        p = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!p) break;
+        ++total;
+        ++p;
+    }
+    return total;
+}
+
+void TextScan::find_newlines_scalar(const char* data, size_t length, size_t base, std::vector<size_t>& out) {
+    const char* p = data;
+    const char* end = data + length;
+    while (p < end) {
+        p = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!p) break;
+        out.push_back(base + static_cast<size_t>(p - data));
+        ++p;
+    }
+}
+
+size_t TextScan::find_bytes_scalar(const char* data, size_t length, const char* needle, size_t needle_length) {
+    if (needle_length == 0) return 0;
+    if (needle_length > length) return npos;
+    const char* p = data;
+    const char* end = data + length - needle_length + 1;    // Last possible start, plus one
+    while (p < end) {
+        p = static_cast<const char*>(std::memchr(p, needle[0], end - p));
+        if (!p) break;
+        if (std::memcmp(p, needle, needle_length) == 0) return static_cast<size_t>(p - data);
+        ++p;
+    }
+    return npos;
+}
@@ -0,0 +1,295 @@
+#include "text_transcode.h"
+#include "text_scan.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__) || defined(_M_IX86) || defined(__i386__)
+#define TEXT_TRANSCODE_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define TEXT_TRANSCODE_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+const char16_t kReplacement = 0xFFFD;
+
+// Block predicates over the 16 bytes at p. No runtime dispatch: SSE2 is
+// part of x86-64 and NEON of AArch64, and wider vectors buy little here
+// since the blocks that need work are handled byte by byte anyway.
+#if defined(TEXT_TRANSCODE_SSE2)
+
+inline __m128i load16(const char* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+inline bool any_high(const char* p) {
+    return _mm_movemask_epi8(load16(p)) != 0;
+}
+
+inline bool any_equal(const char* p, char c) {
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(load16(p), _mm_set1_epi8(c))) != 0;
+}
+
+inline void widen16(const char* p, char16_t* out) {
+    __m128i bytes = load16(p);
+    __m128i zero = _mm_setzero_si128();
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi8(bytes, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_unpackhi_epi8(bytes, zero));
+}
+
+// Narrows 8 units to bytes if all are ASCII
+inline bool narrow8(const char16_t* p, char* out) {
+    __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i high = _mm_and_si128(units, _mm_set1_epi16(static_cast<short>(0xFF80)));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) != 0xFFFF) return false;
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(units, units));
+    return true;
+}
+
+#elif defined(TEXT_TRANSCODE_NEON)
+
+inline uint8x16_t load16(const char* p) {
+    return vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+}
+
+inline bool any_high(const char* p) {
+    return vmaxvq_u8(load16(p)) >= 0x80;
+}
+
+inline bool any_equal(const char* p, char c) {
+    return vmaxvq_u8(vceqq_u8(load16(p), vdupq_n_u8(static_cast<uint8_t>(c)))) != 0;
+}
+
+inline void widen16(const char* p, char16_t* out) {
+    uint8x16_t bytes = load16(p);
+    vst1q_u16(reinterpret_cast<uint16_t*>(out), vmovl_u8(vget_low_u8(bytes)));
+    vst1q_u16(reinterpret_cast<uint16_t*>(out + 8), vmovl_u8(vget_high_u8(bytes)));
+}
+
+inline bool narrow8(const char16_t* p, char* out) {
+    uint16x8_t units = vld1q_u16(reinterpret_cast<const uint16_t*>(p));
+    if (vmaxvq_u16(units) >= 0x80) return false;
+    vst1_u8(reinterpret_cast<uint8_t*>(out), vmovn_u16(units));
+    return true;
+}
+
+#else
+
+inline bool any_high(const char* p) {
+    uint64_t words[2];
+    std::memcpy(words, p, 16);
+    return ((words[0] | words[1]) & 0x8080808080808080ULL) != 0;
+}
+
+inline bool any_equal(const char* p, char c) {
+    return std::memchr(p, c, 16) != nullptr;
+}
+
+inline void widen16(const char* p, char16_t* out) {
+    for (int i = 0; i < 16; ++i) out[i] = static_cast<unsigned char>(p[i]);
+}
+
+inline bool narrow8(const char16_t* p, char* out) {
+    for (int i = 0; i < 8; ++i) {
+        if (p[i] >= 0x80) return false;
+    }
+    for (int i = 0; i < 8; ++i) out[i] = static_cast<char>(p[i]);
+    return true;
+}
+
+#endif
+
+// Offset of the first c at or after from, or length
+size_t find_byte(const char* data, size_t from, size_t length, char c) {
+    size_t i = from;
+    while (i + 16 <= length && !any_equal(data + i, c)) i += 16;
+    for (; i < length; ++i) {
+        if (data[i] == c) return i;
+    }
+    return length;
+}
+
+// Decodes the sequence at p; malformed input (overlong forms, surrogates,
+// code points past U+10FFFF, cut-off sequences) gives U+FFFD for one byte
+uint32_t decode(const unsigned char* p, size_t left, size_t& used) {
+    used = 1;
+    unsigned char lead = p[0];
+    size_t count;
+    uint32_t cp, min;
+    if (lead < 0x80) return lead;
+    if ((lead & 0xE0) == 0xC0) {
+        count = 2, cp = lead & 0x1F, min = 0x80;
+    } else if ((lead & 0xF0) == 0xE0) {
+        count = 3, cp = lead & 0x0F, min = 0x800;
+    } else if ((lead & 0xF8) == 0xF0) {
+        count = 4, cp = lead & 0x07, min = 0x10000;
+    } else {
+        return kReplacement;
+    }
+    if (left < count) return kReplacement;
+    for (size_t i = 1; i < count; ++i) {
+        if ((p[i] & 0xC0) != 0x80) return kReplacement;
+        cp = (cp << 6) | (p[i] & 0x3F);
+    }
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return kReplacement;
+    used = count;
+    return cp;
+}
+
+} // namespace
+
+TextTranscode::Encoding TextTranscode::detect_bom(const char* data, size_t length, size_t& bom_length) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+    bom_length = 0;
+    if (length >= 3 && p[0] == 0xEF && p[1] == 0xBB && p[2] == 0xBF) {
+        bom_length = 3;
+        return Encoding::UTF8_BOM;
+    }
+    if (length >= 2 && p[0] == 0xFF && p[1] == 0xFE) {
+        bom_length = 2;
+        return Encoding::UTF16LE;
+    }
+    if (length >= 2 && p[0] == 0xFE && p[1] == 0xFF) {
+        bom_length = 2;
+        return Encoding::UTF16BE;
+    }
+    return Encoding::UTF8;
+}
+
+TextTranscode::LineBreaks TextTranscode::count_line_breaks(const char* data, size_t length) {
+    LineBreaks breaks;
+    size_t newlines = TextScan::count_newlines(data, length);
+    size_t returns = 0;
+    for (size_t i = find_byte(data, 0, length, '\r'); i < length; i = find_byte(data, i + 1, length, '\r')) {
+        returns++;
+        if (i + 1 < length && data[i + 1] == '\n') breaks.crlf++;
+    }
+    breaks.lf = newlines - breaks.crlf;
+    breaks.cr = returns - breaks.crlf;
+    return breaks;
+}
+
+size_t TextTranscode::normalize_to_lf(char* data, size_t length) {
+    // Text between '\r's moves down as whole runs; until the first one
+    // nothing moves at all
+    size_t read = find_byte(data, 0, length, '\r');
+    size_t write = read;
+    while (read < length) {
+        data[write++] = '\n';
+        read++;
+        if (read < length && data[read] == '\n') read++;
+        size_t next = find_byte(data, read, length, '\r');
+        std::memmove(data + write, data + read, next - read);
+        write += next - read;
+        read = next;
+    }
+    return write;
+}
+
+bool TextTranscode::is_valid_utf8(const char* data, size_t length) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    size_t i = 0;
+    while (i < length) {
+        if (i + 16 <= length && !any_high(data + i)) {
+            i += 16;
+            continue;
+        }
+        if (bytes[i] < 0x80) {
+            i++;
+            continue;
+        }
+        size_t used;
+        if (decode(bytes + i, length - i, used) == kReplacement && used == 1) return false;
+        i += used;
+    }
+    return true;
+}
+
+size_t TextTranscode::utf8_to_utf16(const char* data, size_t length, char16_t* out) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    size_t i = 0, written = 0;
+    while (i < length) {
+        if (i + 16 <= length && !any_high(data + i)) {
+            widen16(data + i, out + written);
+            i += 16;
+            written += 16;
+            continue;
+        }
+        if (bytes[i] < 0x80) {
+            out[written++] = bytes[i++];
+            continue;
+        }
+        size_t used;
+        uint32_t cp = decode(bytes + i, length - i, used);
+        i += used;
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            out[written++] = static_cast<char16_t>(0xD800 + (cp >> 10));
+            out[written++] = static_cast<char16_t>(0xDC00 + (cp & 0x3FF));
+        } else {
+            out[written++] = static_cast<char16_t>(cp);
+        }
+    }
+    return written;
+}
+
+std::u16string TextTranscode::utf8_to_utf16(const std::string& text) {
+    std::u16string out(text.size(), u'\0');
+    out.resize(utf8_to_utf16(text.data(), text.size(), &out[0]));
+    return out;
+}
+
+std::string TextTranscode::utf16_to_utf8(const char16_t* data, size_t length) {
+    // Three bytes per unit at most: a surrogate pair is four for two
+    std::string out(length * 3, '\0');
+    char* p = &out[0];
+    size_t i = 0;
+    while (i < length) {
+        if (i + 8 <= length && narrow8(data + i, p)) {
+            i += 8;
+            p += 8;
+            continue;
+        }
+        uint32_t cp = data[i++];
+        if (cp >= 0xD800 && cp <= 0xDBFF && i < length && data[i] >= 0xDC00 && data[i] <= 0xDFFF) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (data[i++] - 0xDC00);
+        } else if (cp >= 0xD800 && cp <= 0xDFFF) {
+            cp = kReplacement;
+        }
+        if (cp < 0x80) {
+            *p++ = static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            *p++ = static_cast<char>(0xC0 | (cp >> 6));
+            *p++ = static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            *p++ = static_cast<char>(0xE0 | (cp >> 12));
+            *p++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            *p++ = static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            *p++ = static_cast<char>(0xF0 | (cp >> 18));
+            *p++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            *p++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            *p++ = static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+    out.resize(static_cast<size_t>(p - out.data()));
+    return out;
+}
+
+void TextTranscode::widen_bytes(const char* data, size_t length, char16_t* out) {
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) widen16(data + i, out + i);
+    for (; i < length; ++i) out[i] = static_cast<unsigned char>(data[i]);
+}
+
+const char* TextTranscode::active_kernel() {
+#if defined(TEXT_TRANSCODE_SSE2)
+    return "sse2";
+#elif defined(TEXT_TRANSCODE_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
@@ -19,6 +19,7 @@ void Theme::load_theme(const std::string& name) {
     if (it != built_in_themes_.end()) {
         current_scheme_ = it->second;
         current_theme_name_ = name;
+        ++revision_;
     }
 }
 
@@ -0,0 +1,189 @@
+#include "thread_pool.h"
+
+namespace {
+// Which pool (and slot in it) the current thread works for
+thread_local const ThreadPool* t_pool = nullptr;
+thread_local size_t t_worker = ThreadPool::npos;
+}
+
+ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+    low_limit_ = threads > 1 ? threads - 1 : 1;
+
+    for (size_t i = 0; i < threads; ++i) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::submit(std::function<void()> task, TaskPriority priority, CancellationToken cancel) {
+    size_t index = current_worker();
+    if (index == npos) {
+        index = next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    }
+    size_t level = static_cast<size_t>(priority);
+
+    pending_.fetch_add(1);
+    {
+        // Counted first (under the wake mutex, so a worker about to sleep
+        // can't miss it) so a fast thief never drives the count below zero
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        (is_low(level) ? queued_low_ : queued_urgent_).fetch_add(1);
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        queues_[index]->tasks[level].push_back(Task{std::move(task), std::move(cancel)});
+    }
+    wake_.notify_one();
+}
+
+void ThreadPool::wait_idle() {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    idle_.wait(lock, [this] { return pending_.load() == 0; });
+}
+
+size_t ThreadPool::current_worker() const {
+    return t_pool == this ? t_worker : npos;
+}
+
+bool ThreadPool::runnable() const {
+    return queued_urgent_.load() > 0 || (queued_low_.load() > 0 && running_low_.load() < low_limit_);
+}
+
+bool ThreadPool::pop_class(size_t index, size_t priority, Task& task) {
+    // Own work first, newest first
+    {
+        Queue& own = *queues_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        auto& tasks = own.tasks[priority];
+        if (!tasks.empty()) {
+            task = std::move(tasks.back());
+            tasks.pop_back();
+            return true;
+        }
+    }
+
+    // Then steal the oldest task from the others
+    for (size_t offset = 1; offset < queues_.size(); ++offset) {
+        Queue& victim = *queues_[(index + offset) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        auto& tasks = victim.tasks[priority];
+        if (!tasks.empty()) {
+            task = std::move(tasks.front());
+            tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::try_pop(size_t index, Task& task, bool& low) {
+    for (size_t priority = 0; priority < kPriorities; ++priority) {
+        low = is_low(priority);
+        if (low) {
+            // Claim a low slot before looking, so two workers can't both take the last one
+            size_t running = running_low_.load();
+            do {
+                if (running >= low_limit_) return false;
+            } while (!running_low_.compare_exchange_weak(running, running + 1));
+        }
+        if (pop_class(index, priority, task)) return true;
+        if (low) running_low_.fetch_sub(1);
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(size_t index) {
+    t_pool = this;
+    t_worker = index;
+
+    Task task;
+    bool low = false;
+    while (true) {
+        if (try_pop(index, task, low)) {
+            (low ? queued_low_ : queued_urgent_).fetch_sub(1);
+            if (!task.cancel.cancelled()) task.run();
+            task = Task();
+            if (low) {
+                running_low_.fetch_sub(1);
+                // A low task held back by the limit may go now
+                if (queued_low_.load() > 0) {
+                    std::lock_guard<std::mutex> lock(wake_mutex_);
+                    wake_.notify_one();
+                }
+            }
+            if (pending_.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(wake_mutex_);
+                idle_.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        auto drained = [this] { return queued_urgent_.load() == 0 && queued_low_.load() == 0; };
+        wake_.wait(lock, [&] { return runnable() || (stopping_ && drained()); });
+        if (stopping_ && drained()) return;
+    }
+}
+
+void TaskGroup::submit(std::function<void()> task, TaskPriority priority, CancellationToken cancel) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++pending_;
+    }
+    pool_.submit([this, task = std::move(task), cancel = std::move(cancel)] {
+        if (!cancel.cancelled()) task();
+        // Notified under the lock: wait() can't return (and the group go) before this is done
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_ == 0) done_.notify_all();
+    }, priority);
+}
+
+void TaskGroup::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return pending_ == 0; });
+}
+
+void MainThreadQueue::set_notify(std::function<void()> notify) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    notify_ = std::move(notify);
+}
+
+void MainThreadQueue::post(std::function<void()> task) {
+    std::function<void()> notify;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (tasks_.empty()) notify = notify_;
+        tasks_.push_back(std::move(task));
+    }
+    if (notify) notify();
+}
+
+size_t MainThreadQueue::drain() {
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks.swap(tasks_);
+    }
+    for (auto& task : tasks) task();
+    return tasks.size();
+}
@@ -0,0 +1,171 @@
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+namespace editor {
+
+std::atomic<bool> Tracer::enabled_{false};
+
+namespace {
+
+const std::chrono::steady_clock::time_point g_origin = std::chrono::steady_clock::now();
+
+// Buffers outlive their threads (the registry shares them), so a plain
+// pointer is enough here
+thread_local void* t_buffer = nullptr;
+
+void write_json_string(std::ostream& out, const char* text) {
+    out << '"';
+    for (const char* p = text; *p; ++p) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c == '"' || c == '\\') {
+            out << '\\' << *p;
+        } else if (c < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        } else {
+            out << *p;
+        }
+    }
+    out << '"';
+}
+
+// Trace Event timestamps are microseconds; fractions keep the nanoseconds
+void write_micros(std::ostream& out, uint64_t ns) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%llu.%03u", static_cast<unsigned long long>(ns / 1000),
+                  static_cast<unsigned>(ns % 1000));
+    out << text;
+}
+
+} // namespace
+
+Tracer& Tracer::instance() {
+    // Never destroyed: threads still running at exit may record
+    static Tracer* tracer = new Tracer();
+    return *tracer;
+}
+
+void Tracer::start(size_t events_per_thread) {
+    capacity_.store((std::max)(events_per_thread, size_t(1)));
+    enabled_.store(true);
+}
+
+void Tracer::stop() {
+    enabled_.store(false);
+}
+
+void Tracer::clear() {
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    for (auto& buffer : buffers_) {
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        buffer->written = 0;
+    }
+}
+
+uint64_t Tracer::now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_origin).count();
+}
+
+Tracer::ThreadBuffer& Tracer::buffer() {
+    if (t_buffer) return *static_cast<ThreadBuffer*>(t_buffer);
+    auto buffer = std::make_shared<ThreadBuffer>();
+    buffer->events.resize(capacity_.load());
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    buffer->tid = static_cast<uint32_t>(buffers_.size() + 1);
+    buffers_.push_back(buffer);
+    t_buffer = buffer.get();
+    return *buffer;
+}
+
+void Tracer::record(Event&& event) {
+    ThreadBuffer& ring = buffer();
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    ring.events[ring.written % ring.events.size()] = std::move(event);
+    ring.written++;
+}
+
+void Tracer::set_thread_name(const std::string& name) {
+    ThreadBuffer& ring = buffer();
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    ring.thread_name = name;
+}
+
+std::vector<std::pair<uint32_t, Tracer::Event>> Tracer::snapshot() const {
+    std::vector<std::pair<uint32_t, Event>> events;
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    for (const auto& buffer : buffers_) {
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        size_t size = buffer->events.size();
+        uint64_t first = buffer->written > size ? buffer->written - size : 0;
+        for (uint64_t i = first; i < buffer->written; ++i) {
+            events.emplace_back(buffer->tid, buffer->events[i % size]);
+        }
+    }
+    return events;
+}
+
+void Tracer::write_chrome_trace(std::ostream& out) const {
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    auto separate = [&] {
+        if (!first) out << ",\n";
+        first = false;
+    };
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex_);
+        for (const auto& buffer : buffers_) {
+            std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+            if (buffer->thread_name.empty()) continue;
+            separate();
+            out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->tid << ",\"args\":{\"name\":";
+            write_json_string(out, buffer->thread_name.c_str());
+            out << "}}";
+        }
+    }
+    for (const auto& [tid, event] : snapshot()) {
+        separate();
+        out << "{\"ph\":\"" << event.phase << "\",\"cat\":";
+        write_json_string(out, event.category);
+        out << ",\"name\":";
+        write_json_string(out, event.name);
+        out << ",\"pid\":1,\"tid\":" << tid << ",\"ts\":";
+        write_micros(out, event.start_ns);
+        if (event.phase == 'C') {
+            out << ",\"args\":{\"value\":" << event.value << "}";
+        } else {
+            out << ",\"dur\":";
+            write_micros(out, event.duration_ns);
+            if (!event.detail.empty()) {
+                out << ",\"args\":{\"detail\":";
+                write_json_string(out, event.detail.c_str());
+                out << "}";
+            }
+        }
+        out << "}";
+    }
+    out << "]}\n";
+}
+
+bool Tracer::export_chrome_trace(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+    write_chrome_trace(out);
+    return static_cast<bool>(out);
+}
+
+TraceScope::~TraceScope() {
+    if (!name_) return;
+    Tracer::Event event;
+    event.category = category_;
+    event.name = name_;
+    event.start_ns = start_ns_;
+    event.duration_ns = Tracer::now_ns() - start_ns_;
+    event.detail = std::move(detail_);
+    Tracer::instance().record(std::move(event));
+}
+
+} // namespace editor
@@ -1,5 +1,8 @@
 ﻿#include "treesitter_bridge.h"
 #include "syntax_highlighter.h" // for Token
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
 
 #ifdef ENABLE_TREESITTER
 #include <tree_sitter/api.h>
@@ -20,17 +23,47 @@ extern "C" {
 struct TreeSitterBridge::Impl {
     bool available = false;
     std::string language;
-    std::vector<std::string> lines;
+    const PieceTable* document = nullptr;
+    std::unique_ptr<PieceTable> owned;    // Backs set_document_text
 #ifdef ENABLE_TREESITTER
     TSParser* parser = nullptr;
     TSTree* tree = nullptr;
-    std::string joined_text;
-    std::vector<size_t> line_offsets; // byte offset at start of each line
 #endif
 };
 
+#ifdef ENABLE_TREESITTER
+// TSInput read callback: hand Tree-sitter the piece holding byte_index.
+// Views point into the piece table's buffers, which stay put while parsing.
+static const char* read_piece_table(void* payload, uint32_t byte_index, TSPoint position, uint32_t* bytes_read) {
+    (void)position;
+    const PieceTable* document = static_cast<const PieceTable*>(payload);
+    PieceTable::ChunkIterator it = document->chunks(byte_index);
+    if (it.done()) {
+        *bytes_read = 0;
+        return "";
+    }
+    std::string_view view = *it;
+    *bytes_read = static_cast<uint32_t>((std::min)(view.size(), size_t(UINT32_MAX)));
+    return view.data();
+}
+
+static TSTree* parse_document(TSParser* parser, TSTree* old_tree, const PieceTable* document) {
+    TSInput input;
+    input.payload = const_cast<PieceTable*>(document);
+    input.read = read_piece_table;
+    input.encoding = TSInputEncodingUTF8;
+    return ts_parser_parse(parser, old_tree, input);
+}
+#endif
+
 TreeSitterBridge::TreeSitterBridge() : impl_(new Impl) {}
-TreeSitterBridge::~TreeSitterBridge() = default;
+
+TreeSitterBridge::~TreeSitterBridge() {
+#ifdef ENABLE_TREESITTER
+    if (impl_->tree) ts_tree_delete(impl_->tree);
+    if (impl_->parser) ts_parser_delete(impl_->parser);
+#endif
+}
 
 bool TreeSitterBridge::initialize(const std::string& lang_id) {
 #ifdef ENABLE_TREESITTER
@@ -72,43 +105,88 @@ bool TreeSitterBridge::initialize(const std::string& lang_id) {
 }
 
 void TreeSitterBridge::set_document_text(const std::vector<std::string>& lines) {
-    impl_->lines = lines;
 #ifdef ENABLE_TREESITTER
     if (!impl_->available || !impl_->parser) return;
-    impl_->joined_text.clear();
-    impl_->line_offsets.clear();
-    impl_->line_offsets.reserve(lines.size() + 1);
-    size_t offset = 0;
-    for (size_t i = 0; i < lines.size(); ++i) {
-        impl_->line_offsets.push_back(offset);
-        impl_->joined_text.append(lines[i]);
-        impl_->joined_text.push_back('\n');
-        offset += lines[i].size() + 1; // assume 1 byte per char; fine for ASCII
+    std::string joined;
+    for (const auto& line : lines) {
+        joined.append(line);
+        joined.push_back('\n');
     }
-    impl_->line_offsets.push_back(offset);
+    impl_->owned.reset(new PieceTable(joined));
+    set_document(impl_->owned.get());
+#else
+    (void)lines;
+#endif
+}
 
+void TreeSitterBridge::set_document(const PieceTable* document) {
+    if (!impl_->owned || document != impl_->owned.get()) impl_->owned.reset();
+    impl_->document = document;
+#ifdef ENABLE_TREESITTER
     if (impl_->tree) { ts_tree_delete(impl_->tree); impl_->tree = nullptr; }
-    impl_->tree = ts_parser_parse_string(impl_->parser, nullptr, impl_->joined_text.c_str(), (uint32_t)impl_->joined_text.size());
+    if (!impl_->available || !impl_->parser || !document) return;
+    impl_->tree = parse_document(impl_->parser, nullptr, document);
 #endif
 }
 
-static bool node_overlaps_range(const TSNode& n, uint32_t start_byte, uint32_t end_byte) {
+void TreeSitterBridge::apply_edit(const PieceTable::Change& change, std::vector<LineRange>& changed_lines) {
+    const PieceTable* document = impl_->document;
+    if (!document) return;
+    // The edited lines always need new tokens, even when the tree's shape
+    // (and so Tree-sitter's changed ranges) stays the same
+    size_t new_end_line = change.first_line + change.inserted_newlines;
+    changed_lines.push_back({change.first_line, new_end_line + 1});
 #ifdef ENABLE_TREESITTER
+    if (!impl_->available || !impl_->parser) return;
+    if (!impl_->tree) {
+        impl_->tree = parse_document(impl_->parser, nullptr, document);
+        return;
+    }
+
+    size_t new_end = change.position + change.inserted_length;
+    size_t new_end_column = change.inserted_newlines == 0
+        ? change.column + change.inserted_length
+        : new_end - document->get_line_start(new_end_line);
+    TSInputEdit edit;
+    edit.start_byte = static_cast<uint32_t>(change.position);
+    edit.old_end_byte = static_cast<uint32_t>(change.position + change.removed_length);
+    edit.new_end_byte = static_cast<uint32_t>(new_end);
+    edit.start_point = {static_cast<uint32_t>(change.first_line), static_cast<uint32_t>(change.column)};
+    edit.old_end_point = {static_cast<uint32_t>(change.first_line + change.removed_newlines),
+                          static_cast<uint32_t>(change.old_end_column)};
+    edit.new_end_point = {static_cast<uint32_t>(new_end_line), static_cast<uint32_t>(new_end_column)};
+    ts_tree_edit(impl_->tree, &edit);
+
+    TSTree* old_tree = impl_->tree;
+    impl_->tree = parse_document(impl_->parser, old_tree, document);
+    if (impl_->tree) {
+        uint32_t count = 0;
+        TSRange* ranges = ts_tree_get_changed_ranges(old_tree, impl_->tree, &count);
+        for (uint32_t i = 0; i < count; ++i) {
+            changed_lines.push_back({ranges[i].start_point.row, size_t(ranges[i].end_point.row) + 1});
+        }
+        free(ranges);
+    }
+    ts_tree_delete(old_tree);
+#endif
+}
+
+#ifdef ENABLE_TREESITTER
+static bool node_overlaps_range(const TSNode& n, uint32_t start_byte, uint32_t end_byte) {
     uint32_t ns = ts_node_start_byte(n);
     uint32_t ne = ts_node_end_byte(n);
     return !(ne <= start_byte || ns >= end_byte);
-#else
-    (void)n; (void)start_byte; (void)end_byte; return false;
-#endif
 }
+#endif
 
 bool TreeSitterBridge::get_line_tokens(size_t line_index, std::vector<Token>& out_tokens) const {
     out_tokens.clear();
     if (!impl_->available) return false;
 #ifdef ENABLE_TREESITTER
-    if (!impl_->tree || line_index >= impl_->lines.size()) return false;
-    uint32_t start_b = (uint32_t)impl_->line_offsets[line_index];
-    uint32_t end_b = (uint32_t)impl_->line_offsets[line_index + 1];
+    const PieceTable* document = impl_->document;
+    if (!impl_->tree || !document || line_index >= document->get_line_count()) return false;
+    uint32_t start_b = (uint32_t)document->get_line_start(line_index);
+    uint32_t end_b = (uint32_t)document->get_line_start(line_index + 1);
 
     TSNode root = ts_tree_root_node(impl_->tree);
 
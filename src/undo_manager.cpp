@@ -1,43 +1,102 @@
 #include "undo_manager.h"
 #include "piece_table.h"
+#include "internal_clipboard.h"
 
 // InsertCommand implementation
 void InsertCommand::execute() {
     document_->insert(position_, text_);
+    // The document's history references the add buffer copy from here on
+    std::string().swap(text_);
 }
 
 void InsertCommand::undo() {
-    document_->remove(position_, text_.length());
+    document_->undo();
 }
 
 // DeleteCommand implementation
 void DeleteCommand::execute() {
-    // Save the text being deleted so we can restore it
-    deleted_text_ = document_->get_text(position_, length_);
+    // The document records the removed pieces for undo
     document_->remove(position_, length_);
 }
 
 void DeleteCommand::undo() {
-    // Restore the deleted text
-    document_->insert(position_, deleted_text_);
+    document_->undo();
+}
+
+// MultiEditCommand implementation
+void MultiEditCommand::execute() {
+    document_->apply_edits(edits_);
+    std::vector<PieceTable::Edit>().swap(edits_);
+}
+
+void MultiEditCommand::undo() {
+    document_->undo();
+}
+
+// PasteCommand implementation
+void PasteCommand::execute() {
+    clipboard_->paste(*document_, position_);
+    clipboard_ = nullptr;
+}
+
+void PasteCommand::undo() {
+    document_->undo();
 }
 
 // UndoManager implementation
-void UndoManager::execute(std::unique_ptr<Command> cmd) {
-    // If we're not at the end of the undo stack, discard any "future" commands
-    if (current_index_ < commands_.size()) {
-        commands_.erase(commands_.begin() + current_index_, commands_.end());
+void UndoManager::execute(std::unique_ptr<Command> cmd, bool mergeable) {
+    // If we're not at the end of the undo stack, discard any "future" steps
+    if (current_index_ < steps_.size()) {
+        steps_.erase(steps_.begin() + current_index_, steps_.end());
     }
     
-    // Execute the command
-    cmd->execute();
+    PieceTable* doc = cmd->document();
+    if (!doc) {
+        cmd->execute();
+        push_step({nullptr, std::move(cmd)});
+        return;
+    }
+    if (transaction_depth_ > 0 && doc == transaction_) {
+        // Recorded into the open transaction's step
+        cmd->execute();
+        return;
+    }
     
-    // Add to history
-    commands_.push_back(std::move(cmd));
-    current_index_ = commands_.size();
+    // A keystroke may only extend the document's step if that is also our latest
+    bool extend = mergeable && current_index_ > 0 && steps_[current_index_ - 1].document == doc;
+    if (!extend) doc->break_undo_group();
+    size_t serial = doc->get_undo_serial();
+    cmd->execute();
+    if (!mergeable) doc->break_undo_group();
     
-    // Trim if we exceeded max depth
-    trim_to_depth();
+    // No new serial: the edit coalesced into the previous step (or was a no-op)
+    if (doc->get_undo_serial() != serial) push_step({doc, nullptr});
+}
+
+void UndoManager::break_group() {
+    if (current_index_ > 0 && steps_[current_index_ - 1].document) {
+        steps_[current_index_ - 1].document->break_undo_group();
+    }
+}
+
+void UndoManager::begin_transaction(PieceTable* doc) {
+    if (transaction_depth_++ == 0) {
+        if (current_index_ < steps_.size()) {
+            steps_.erase(steps_.begin() + current_index_, steps_.end());
+        }
+        transaction_ = doc;
+        transaction_serial_ = doc->get_undo_serial();
+    }
+    transaction_->begin_transaction();
+}
+
+void UndoManager::commit_transaction() {
+    if (transaction_depth_ == 0) return;
+    transaction_->commit_transaction();
+    if (--transaction_depth_ == 0) {
+        if (transaction_->get_undo_serial() != transaction_serial_) push_step({transaction_, nullptr});
+        transaction_ = nullptr;
+    }
 }
 
 void UndoManager::undo() {
@@ -48,8 +107,12 @@ void UndoManager::undo() {
     // Move back one step
     current_index_--;
     
-    // Undo the command at current index
-    commands_[current_index_]->undo();
+    Step& step = steps_[current_index_];
+    if (step.document) {
+        step.document->undo();
+    } else {
+        step.command->undo();
+    }
 }
 
 void UndoManager::redo() {
@@ -57,17 +120,29 @@ void UndoManager::redo() {
         return;
     }
     
-    // Redo the command at current index
-    commands_[current_index_]->redo();
+    Step& step = steps_[current_index_];
+    if (step.document) {
+        step.document->redo();
+    } else {
+        step.command->redo();
+    }
     
     // Move forward one step
     current_index_++;
 }
 
+void UndoManager::push_step(Step step) {
+    steps_.push_back(std::move(step));
+    current_index_ = steps_.size();
+    
+    // Trim if we exceeded max depth
+    trim_to_depth();
+}
+
 void UndoManager::trim_to_depth() {
-    if (commands_.size() > max_depth_) {
-        size_t to_remove = commands_.size() - max_depth_;
-        commands_.erase(commands_.begin(), commands_.begin() + to_remove);
-        current_index_ -= to_remove;
+    // Oldest first; the newest step is always kept
+    while (steps_.size() > 1 && steps_.size() > max_depth_) {
+        steps_.pop_front();
+        current_index_--;
     }
 }
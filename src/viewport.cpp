@@ -1,74 +1,368 @@
 #include "viewport.h"
+#include "code_folding.h"
+#include "column_layout.h"
+#include "wrap_layout.h"
 #include <chrono>
 #include <algorithm>
+#include <cstdint>
 
 Viewport::Viewport(size_t visible_lines, size_t visible_columns)
     : top_line_(0)
     , visible_lines_(visible_lines)
     , visible_columns_(visible_columns)
+    , columns_(std::make_unique<editor::ColumnLayout>())
     , last_render_time_ms_(0.0) {
 }
 
-void Viewport::set_document(std::shared_ptr<PieceTable> document) {
+Viewport::~Viewport() = default;
+
+void Viewport::set_document(std::shared_ptr<TextBuffer> document) {
     document_ = document;
     top_line_ = 0;
+    top_row_ = 0;
+    if (wrap_) wrap_->set_document(document_);
+    columns_->set_document(document_);
 }
 
-void Viewport::scroll_up(size_t lines) {
-    if (top_line_ >= lines) {
-        top_line_ -= lines;
+void Viewport::set_tab_width(size_t tab_width) {
+    columns_->set_tab_width(tab_width);
+}
+
+Viewport::State::State() = default;
+Viewport::State::~State() = default;
+Viewport::State::State(State&&) = default;
+Viewport::State& Viewport::State::operator=(State&&) = default;
+
+Viewport::State Viewport::take_state() {
+    State state;
+    state.document = std::move(document_);
+    state.top_line = top_line_;
+    state.top_row = top_row_;
+    state.left_column = left_column_;
+    state.wrap = std::move(wrap_);
+    state.columns = std::move(columns_);
+    columns_ = std::make_unique<editor::ColumnLayout>();
+    columns_->set_tab_width(state.columns->tab_width());
+    document_.reset();
+    top_line_ = 0;
+    top_row_ = 0;
+    left_column_ = 0;
+    if (state.wrap) {
+        wrap_ = std::make_unique<editor::WrapLayout>();
+        wrap_->set_columns(visible_columns_);
+    }
+    return state;
+}
+
+void Viewport::restore_state(State state) {
+    bool soft_wrap = is_soft_wrap();
+    document_ = std::move(state.document);
+    top_line_ = state.top_line;
+    top_row_ = state.top_row;
+    left_column_ = state.left_column;
+    size_t tab_width = columns_->tab_width();
+    if (state.columns) columns_ = std::move(state.columns);
+    columns_->set_document(document_);
+    columns_->set_tab_width(tab_width);         // Remaps only if it changed
+    if (!soft_wrap) {
+        wrap_.reset();
+        top_row_ = 0;
+    } else if (state.wrap) {
+        wrap_ = std::move(state.wrap);
+        wrap_->set_columns(visible_columns_);   // Relays out only if the width changed
     } else {
-        top_line_ = 0;
+        wrap_ = std::make_unique<editor::WrapLayout>();
+        wrap_->set_document(document_);
+        wrap_->set_columns(visible_columns_);
+        top_row_ = 0;
+    }
+    clamp_scroll_position();
+}
+
+void Viewport::set_size(size_t visible_lines, size_t visible_columns) {
+    visible_lines_ = (std::max)(visible_lines, size_t(1));
+    visible_columns_ = (std::max)(visible_columns, size_t(1));
+    if (wrap_) wrap_->set_columns(visible_columns_);
+    clamp_scroll_position();
+}
+
+void Viewport::set_soft_wrap(bool enabled) {
+    if (enabled == is_soft_wrap()) return;
+    top_row_ = 0;
+    if (!enabled) {
+        wrap_.reset();
+        return;
+    }
+    wrap_ = std::make_unique<editor::WrapLayout>();
+    wrap_->set_document(document_);
+    wrap_->set_columns(visible_columns_);
+    clamp_scroll_position();
+}
+
+size_t Viewport::to_display(size_t line) const {
+    return folding_ ? folding_->document_to_display_line(line) : line;
+}
+
+size_t Viewport::to_document(size_t display_line) const {
+    return folding_ ? folding_->display_to_document_line(display_line) : display_line;
+}
+
+size_t Viewport::next_line(size_t line) const {
+    return folding_ ? folding_->next_visible_line(line + 1) : line + 1;
+}
+
+size_t Viewport::prev_line(size_t line) const {
+    return to_document(to_display(line) - 1);
+}
+
+size_t Viewport::get_top_line() const {
+    // A fold closed over the top line: its header is on the first row
+    return folding_ ? to_document(to_display(top_line_)) : top_line_;
+}
+
+size_t Viewport::get_top_display_line() const {
+    return to_display(top_line_);
+}
+
+size_t Viewport::get_display_line_count() const {
+    if (!document_) return 0;
+    size_t lines = document_->get_line_count();
+    return folding_ ? folding_->visible_line_count(lines) : lines;
+}
+
+void Viewport::layout_rows(size_t count, std::vector<ViewRow>& rows) const {
+    rows.clear();
+    if (!document_) return;
+    size_t line_count = document_->get_line_count();
+    size_t line = get_top_line();
+    size_t row = line == top_line_ ? top_row_ : 0;
+    while (rows.size() < count && line < line_count) {
+        if (!wrap_) {
+            ViewRow view_row;
+            view_row.line = line;
+            view_row.column = left_column_;
+            rows.push_back(std::move(view_row));
+        } else {
+            const auto& starts = wrap_->row_starts(line);
+            for (row = (std::min)(row, starts.size() - 1); row < starts.size() && rows.size() < count; ++row) {
+                ViewRow view_row;
+                view_row.line = line;
+                view_row.column = starts[row];
+                view_row.continues = row + 1 < starts.size();
+                rows.push_back(std::move(view_row));
+            }
+        }
+        line = next_line(line);
+        row = 0;
+    }
+}
+
+std::string Viewport::read_row(size_t line, size_t column, size_t length, size_t max_columns) const {
+    size_t line_start = document_->get_line_start(line);
+    size_t line_end = line + 1 < document_->get_line_count() ? document_->get_line_start(line + 1)
+                                                               : document_->get_total_length();
+    size_t begin = (std::min)(line_start + column, line_end);
+    std::string text = document_->get_text(begin, (std::min)(length, line_end - begin));
+    // Reached the line's end: drop its terminator
+    size_t newline = text.find('\n');
+    if (newline != std::string::npos) {
+        text.resize(newline);
+        if (!text.empty() && text.back() == '\r') text.pop_back();
+    }
+    if (max_columns > 0) {
+        // Whole clusters up to the width, with tab stops counted from the line's start
+        auto& columns = *columns_;
+        size_t start_column = columns.line(line).column_of(column);
+        text.resize(editor::ColumnLayout::fit_columns(text.data(), text.size(), max_columns, columns.tab_width(),
+                                                      start_column));
     }
+    return text;
+}
+
+void Viewport::scroll_up(size_t lines) {
+    size_t line = get_top_line();
+    if (!wrap_) {
+        size_t top = to_display(line);
+        top_line_ = to_document(top >= lines ? top - lines : 0);
+        return;
+    }
+    size_t row = line == top_line_ ? top_row_ : 0;
+    while (lines > 0) {
+        if (row > 0) {
+            size_t step = (std::min)(row, lines);
+            row -= step;
+            lines -= step;
+            continue;
+        }
+        if (to_display(line) == 0) break;
+        line = prev_line(line);
+        row = wrap_->row_count(line) - 1;
+        lines--;
+    }
+    top_line_ = line;
+    top_row_ = row;
 }
 
 void Viewport::scroll_down(size_t lines) {
-    top_line_ += lines;
+    if (!wrap_) {
+        top_line_ = to_document(get_top_display_line() + lines);
+        clamp_scroll_position();
+        return;
+    }
+    if (!document_) return;
+    size_t line_count = document_->get_line_count();
+    size_t line = get_top_line();
+    size_t row = line == top_line_ ? top_row_ : 0;
+    while (lines > 0 && line < line_count) {
+        size_t rows = wrap_->row_count(line);
+        if (row + lines < rows) {
+            row += lines;
+            break;
+        }
+        size_t next = next_line(line);
+        if (next >= line_count) {
+            row = rows - 1;
+            break;
+        }
+        lines -= rows - row;
+        line = next;
+        row = 0;
+    }
+    top_line_ = line;
+    top_row_ = row;
     clamp_scroll_position();
 }
 
 void Viewport::scroll_to_line(size_t line) {
     top_line_ = line;
+    top_row_ = 0;
     clamp_scroll_position();
 }
 
+void Viewport::scroll_to_end() {
+    if (!document_) return;
+    size_t line_count = document_->get_line_count();
+    scroll_to_line(line_count > 0 ? line_count - 1 : 0);
+}
+
+bool Viewport::is_at_end() const {
+    if (!document_) return true;
+    size_t line_count = document_->get_line_count();
+    size_t row = row_of_line(line_count > 0 ? line_count - 1 : 0);
+    return row != SIZE_MAX && row < visible_lines_;
+}
+
 void Viewport::clamp_scroll_position() {
     if (!document_) {
         top_line_ = 0;
+        top_row_ = 0;
         return;
     }
     
-    size_t max_line = document_->get_line_count();
+    size_t max_line = get_display_line_count();
+    if (wrap_) {
+        // Last position that still fills the screen: a screen up from the last row
+        if (max_line == 0) {
+            top_line_ = 0;
+            top_row_ = 0;
+            return;
+        }
+        size_t last = to_document(max_line - 1);
+        size_t saved_line = top_line_;
+        size_t saved_row = top_row_;
+        top_line_ = last;
+        top_row_ = wrap_->row_count(last) - 1;
+        scroll_up(visible_lines_ > 0 ? visible_lines_ - 1 : 0);
+        size_t end_display = to_display(top_line_);
+        size_t end_row = top_row_;
+        size_t display = to_display(saved_line);
+        size_t line = to_document(display);
+        size_t row = line == saved_line ? (std::min)(saved_row, wrap_->row_count(line) - 1) : 0;
+        if (display > end_display || (display == end_display && row > end_row)) return;    // Stay at the end
+        top_line_ = line;
+        top_row_ = row;
+        return;
+    }
     if (max_line > visible_lines_) {
         max_line -= visible_lines_;
     } else {
         max_line = 0;
     }
     
-    if (top_line_ > max_line) {
-        top_line_ = max_line;
+    size_t top = get_top_display_line();
+    top_line_ = to_document((std::min)(top, max_line));
+}
+
+size_t Viewport::document_line_at(size_t row) const {
+    if (!wrap_) return to_document(get_top_display_line() + row);
+    size_t line = 0;
+    size_t column = 0;
+    return row_position(row, line, column) ? line : (document_ ? document_->get_line_count() : 0);
+}
+
+bool Viewport::row_position(size_t row, size_t& line, size_t& column) const {
+    if (!document_) return false;
+    if (!wrap_) {
+        line = document_line_at(row);
+        column = left_column_;
+        return line < document_->get_line_count();
+    }
+    std::vector<ViewRow> rows;
+    layout_rows(row + 1, rows);
+    if (rows.size() <= row) return false;
+    line = rows[row].line;
+    column = rows[row].column;
+    return true;
+}
+
+size_t Viewport::row_of_line(size_t line, size_t column) const {
+    size_t top = get_top_display_line();
+    size_t display = to_display(line);
+    if (display < top) return SIZE_MAX;
+    if (!wrap_) return display - top;
+    
+    // Count rows down from the top; a line below the screen gets the row past it
+    size_t top_line = get_top_line();
+    size_t row_in_line = line == to_document(display) ? wrap_->row_of_column(line, column) : 0;
+    size_t top_row = top_line == top_line_ ? top_row_ : 0;
+    if (display == top) return row_in_line >= top_row ? row_in_line - top_row : SIZE_MAX;
+    size_t rows = wrap_->row_count(top_line) - (std::min)(top_row, wrap_->row_count(top_line) - 1);
+    for (size_t l = next_line(top_line); rows < visible_lines_ && to_display(l) < display; l = next_line(l)) {
+        rows += wrap_->row_count(l);
     }
+    return (std::min)(rows + row_in_line, visible_lines_);
 }
 
-std::vector<std::string> Viewport::get_visible_lines() const {
+std::vector<ViewRow> Viewport::get_visible_rows() const {
     auto start_time = std::chrono::high_resolution_clock::now();
     
-    std::vector<std::string> result;
+    std::vector<ViewRow> rows;
     
     if (!document_) {
-        return result;
+        return rows;
     }
     
-    // Only fetch visible lines - this is the key to performance
-    // Even with 1M lines in document, we only process ~50 lines
-    result = document_->get_lines_range(top_line_, visible_lines_);
-    
-    // Truncate lines that are too long for the viewport
-    for (auto& line : result) {
-        if (line.length() > visible_columns_) {
-            line = line.substr(0, visible_columns_);
+    // Only fetch visible rows - this is the key to performance
+    // Even with 1M lines in document, we only process ~50 rows,
+    // each a bounded read however long its line is
+    layout_rows(visible_lines_, rows);
+    for (size_t i = 0; i < rows.size(); ++i) {
+        if (rows[i].continues) {
+            const auto& starts = wrap_->row_starts(rows[i].line);
+            size_t next = wrap_->row_of_column(rows[i].line, rows[i].column) + 1;
+            rows[i].text = read_row(rows[i].line, rows[i].column, starts[next] - rows[i].column, 0);
+        } else if (wrap_) {
+            // The last row may be followed by "\r\n"
+            rows[i].text = read_row(rows[i].line, rows[i].column, visible_columns_ + 2, 0);
+        } else {
+            // Bytes for the width in four-byte characters, cut at the width
+            rows[i].text = read_row(rows[i].line, rows[i].column, visible_columns_ * 4 + 2, visible_columns_);
         }
     }
+    if (!rows.empty()) {
+        if (wrap_) wrap_->trim(rows.front().line, rows.back().line);
+        columns_->trim(rows.front().line, rows.back().line);
+    }
     
     auto end_time = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
@@ -76,5 +370,20 @@ std::vector<std::string> Viewport::get_visible_lines() const {
     // Store render time for performance monitoring
     const_cast<Viewport*>(this)->last_render_time_ms_ = duration.count() / 1000.0;
     
+    return rows;
+}
+
+std::vector<std::string> Viewport::get_visible_lines() const {
+    std::vector<std::string> result;
+    for (auto& row : get_visible_rows()) result.push_back(std::move(row.text));
+    return result;
+}
+
+std::vector<size_t> Viewport::get_visible_line_numbers() const {
+    std::vector<ViewRow> rows;
+    layout_rows(visible_lines_, rows);
+    std::vector<size_t> result;
+    result.reserve(rows.size());
+    for (const auto& row : rows) result.push_back(row.line);
     return result;
 }
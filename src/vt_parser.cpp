@@ -0,0 +1,201 @@
+#include "vt_parser.h"
+
+namespace editor {
+
+VtParser::VtParser(Handler& handler) : handler_(handler) {
+    reset();
+}
+
+void VtParser::reset() {
+    state_ = Ground;
+    perform(Clear, 0);
+    utf8_remaining_ = 0;
+}
+
+const VtParser::Table& VtParser::table() {
+    static const struct Built {
+        Table t;
+
+        void set(State state, int first, int last, Action action, State next) {
+            for (int byte = first; byte <= last; ++byte) {
+                t[state][byte] = { action, static_cast<uint8_t>(next) };
+            }
+        }
+
+        // C0 controls run in the middle of a sequence without ending it
+        void controls(State state) {
+            set(state, 0x00, 0x1F, Execute, state);
+        }
+
+        Built() {
+            for (int state = 0; state < kStateCount; ++state) {
+                set(static_cast<State>(state), 0x00, 0xFF, None, static_cast<State>(state));
+            }
+
+            controls(Ground);
+            set(Ground, 0x20, 0x7E, Print, Ground);
+            set(Ground, 0x80, 0xFF, Utf8, Ground);
+
+            controls(Escape);
+            set(Escape, 0x20, 0x2F, Collect, EscapeIntermediate);
+            set(Escape, 0x30, 0x7E, EscDispatch, Ground);
+            set(Escape, '[', '[', None, CsiEntry);
+            set(Escape, ']', ']', None, OscString);
+            for (int introducer : {'P', 'X', '^', '_'}) {
+                set(Escape, introducer, introducer, None, IgnoreString);
+            }
+            set(Escape, 0x7F, 0x7F, None, Escape);
+
+            controls(EscapeIntermediate);
+            set(EscapeIntermediate, 0x20, 0x2F, Collect, EscapeIntermediate);
+            set(EscapeIntermediate, 0x30, 0x7E, EscDispatch, Ground);
+
+            controls(CsiEntry);
+            set(CsiEntry, 0x20, 0x2F, Collect, CsiIntermediate);
+            set(CsiEntry, 0x30, 0x3B, Param, CsiParam);
+            set(CsiEntry, 0x3C, 0x3F, Collect, CsiParam);
+            set(CsiEntry, 0x40, 0x7E, CsiDispatch, Ground);
+
+            controls(CsiParam);
+            set(CsiParam, 0x20, 0x2F, Collect, CsiIntermediate);
+            set(CsiParam, 0x30, 0x3B, Param, CsiParam);
+            set(CsiParam, 0x3C, 0x3F, None, CsiIgnore);
+            set(CsiParam, 0x40, 0x7E, CsiDispatch, Ground);
+
+            controls(CsiIntermediate);
+            set(CsiIntermediate, 0x20, 0x2F, Collect, CsiIntermediate);
+            set(CsiIntermediate, 0x30, 0x3F, None, CsiIgnore);
+            set(CsiIntermediate, 0x40, 0x7E, CsiDispatch, Ground);
+
+            controls(CsiIgnore);
+            set(CsiIgnore, 0x40, 0x7E, None, Ground);
+
+            set(OscString, 0x20, 0xFF, OscPut, OscString);
+            set(OscString, 0x07, 0x07, OscEnd, Ground);
+
+            // From anywhere: CAN and SUB abort a sequence, ESC starts one
+            for (int state = 0; state < kStateCount; ++state) {
+                set(static_cast<State>(state), 0x18, 0x18, Execute, Ground);
+                set(static_cast<State>(state), 0x1A, 0x1A, Execute, Ground);
+                set(static_cast<State>(state), 0x1B, 0x1B, Clear, Escape);
+            }
+        }
+    } built;
+    return built.t;
+}
+
+void VtParser::feed(const char* data, size_t size) {
+    const Table& t = table();
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    const uint8_t* end = p + size;
+    while (p < end) {
+        if (state_ == Ground && utf8_remaining_ == 0 && *p >= 0x20 && *p < 0x7F) {
+            const uint8_t* run = p;
+            while (p < end && *p >= 0x20 && *p < 0x7F) ++p;
+            handler_.print_ascii(reinterpret_cast<const char*>(run), static_cast<size_t>(p - run));
+            continue;
+        }
+        uint8_t byte = *p++;
+        if (utf8_remaining_ > 0 && (byte & 0xC0) != 0x80) {
+            // A character cut short
+            utf8_remaining_ = 0;
+            handler_.print(0xFFFD);
+        }
+        // ESC \ (ST) ends an OSC string as BEL does
+        if (state_ == OscString && byte == 0x1B) {
+            handler_.osc_dispatch(osc_);
+        }
+        const Transition& transition = t[state_][byte];
+        perform(static_cast<Action>(transition.action), byte);
+        state_ = static_cast<State>(transition.next);
+    }
+}
+
+void VtParser::perform(Action action, uint8_t byte) {
+    switch (action) {
+    case None:
+        break;
+    case Print:
+        handler_.print_ascii(reinterpret_cast<const char*>(&byte), 1);
+        break;
+    case Utf8:
+        print_utf8(byte);
+        break;
+    case Execute:
+        handler_.execute(byte);
+        break;
+    case Clear:
+        param_count_ = 0;
+        param_overflow_ = false;
+        marker_ = 0;
+        intermediate_ = 0;
+        osc_.clear();
+        break;
+    case Collect:
+        if (byte >= 0x3C && byte <= 0x3F) {
+            marker_ = byte;
+        } else {
+            intermediate_ = byte;
+        }
+        break;
+    case Param:
+        if (param_overflow_) break;
+        if (param_count_ == 0) {
+            params_[0] = 0;
+            param_count_ = 1;
+        }
+        if (byte == ';' || byte == ':') {
+            if (param_count_ == kMaxParams) {
+                param_overflow_ = true;
+            } else {
+                params_[param_count_++] = 0;
+            }
+        } else {
+            int& value = params_[param_count_ - 1];
+            value = value * 10 + (byte - '0');
+            if (value > 65535) value = 65535;
+        }
+        break;
+    case EscDispatch:
+        handler_.esc_dispatch(intermediate_, byte);
+        break;
+    case CsiDispatch:
+        handler_.csi_dispatch(params_, param_count_, marker_, intermediate_, byte);
+        break;
+    case OscPut:
+        if (osc_.size() < kMaxOscLength) osc_ += static_cast<char>(byte);
+        break;
+    case OscEnd:
+        handler_.osc_dispatch(osc_);
+        break;
+    }
+}
+
+void VtParser::print_utf8(uint8_t byte) {
+    if (utf8_remaining_ > 0) {
+        utf8_code_ = (utf8_code_ << 6) | (byte & 0x3F);
+        if (--utf8_remaining_ > 0) return;
+        bool valid = utf8_code_ >= utf8_min_ && utf8_code_ <= 0x10FFFF &&
+                     !(utf8_code_ >= 0xD800 && utf8_code_ <= 0xDFFF);
+        handler_.print(valid ? utf8_code_ : 0xFFFD);
+        return;
+    }
+    if (byte >= 0xC2 && byte <= 0xDF) {
+        utf8_code_ = byte & 0x1F;
+        utf8_remaining_ = 1;
+        utf8_min_ = 0x80;
+    } else if (byte >= 0xE0 && byte <= 0xEF) {
+        utf8_code_ = byte & 0x0F;
+        utf8_remaining_ = 2;
+        utf8_min_ = 0x800;
+    } else if (byte >= 0xF0 && byte <= 0xF4) {
+        utf8_code_ = byte & 0x07;
+        utf8_remaining_ = 3;
+        utf8_min_ = 0x10000;
+    } else {
+        // Stray continuation byte, or a lead byte UTF-8 never uses
+        handler_.print(0xFFFD);
+    }
+}
+
+} // namespace editor
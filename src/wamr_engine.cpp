@@ -0,0 +1,188 @@
+#include "wasm_engine.h"
+#include <mutex>
+
+// WAMR headers
+#include "../third_party/wamr/core/iwasm/include/wasm_export.h"
+
+namespace editor {
+
+namespace {
+
+WasmValueType value_type(wasm_valkind_t kind) {
+    switch (kind) {
+    case WASM_I32: return WasmValueType::I32;
+    case WASM_F32: return WasmValueType::F32;
+    case WASM_F64: return WasmValueType::F64;
+    default: return WasmValueType::I64;
+    }
+}
+
+// The process-wide WAMR runtime, started once and never torn down:
+// engines on any thread share it
+bool init_wamr() {
+    static std::once_flag once;
+    static bool ready = false;
+    std::call_once(once, [] {
+        RuntimeInitArgs args = {};
+        args.mem_alloc_type = Alloc_With_System_Allocator;
+#if defined(WASM_ENABLE_FAST_JIT) && WASM_ENABLE_FAST_JIT != 0
+        // Plain .wasm is compiled rather than interpreted
+        args.running_mode = Mode_Fast_JIT;
+#endif
+        ready = wasm_runtime_full_init(&args);
+    });
+    return ready;
+}
+
+// Compiled code: a module built ahead of time by wamrc runs as loaded,
+// a plain .wasm is compiled by WAMR's fast JIT (interpreted where the
+// JIT is not built, as on ARM)
+class WamrEngine : public WasmEngine {
+public:
+    ~WamrEngine() override {
+        if (exec_env_) wasm_runtime_destroy_exec_env(exec_env_);
+        if (instance_) wasm_runtime_deinstantiate(instance_);
+        if (module_) wasm_runtime_unload(module_);
+    }
+
+    WasmEngineKind kind() const override { return WasmEngineKind::Compiled; }
+
+    bool initialize(size_t stack_size_bytes) override {
+        stack_size_ = static_cast<uint32_t>(stack_size_bytes);
+        if (!init_wamr()) {
+            error_ = "Failed to initialize WAMR";
+            return false;
+        }
+        return true;
+    }
+
+    bool load(const uint8_t* bytes, size_t size) override {
+        if (module_) {
+            error_ = "WAMR engine holds one module";
+            return false;
+        }
+        // WAMR keeps pointers into the buffer, and may patch it as it loads
+        bytes_.assign(bytes, bytes + size);
+        char error[128] = "";
+        module_ = wasm_runtime_load(bytes_.data(), static_cast<uint32_t>(bytes_.size()), error, sizeof(error));
+        if (!module_) {
+            error_ = std::string("Failed to load WASM module: ") + error;
+            return false;
+        }
+        instance_ = wasm_runtime_instantiate(module_, stack_size_, 0, error, sizeof(error));
+        if (!instance_) {
+            error_ = std::string("Failed to instantiate WASM module: ") + error;
+            return false;
+        }
+        exec_env_ = wasm_runtime_create_exec_env(instance_, stack_size_);
+        if (!exec_env_) {
+            error_ = "Failed to create WAMR execution environment";
+            return false;
+        }
+        return true;
+    }
+
+    void exports(std::vector<std::string>& names) const override {
+        if (!module_) return;
+        int32_t count = wasm_runtime_get_export_count(module_);
+        for (int32_t i = 0; i < count; ++i) {
+            wasm_export_t info;
+            wasm_runtime_get_export_type(module_, i, &info);
+            if (info.kind == WASM_IMPORT_EXPORT_KIND_FUNC) names.push_back(info.name);
+        }
+    }
+
+    bool resolve(const std::string& name, Function& function) override {
+        wasm_function_inst_t func = instance_ ? wasm_runtime_lookup_function(instance_, name.c_str()) : nullptr;
+        if (!func) {
+            error_ = "Failed to find function '" + name + "'";
+            return false;
+        }
+        uint32_t arg_count = wasm_func_get_param_count(func, instance_);
+        uint32_t result_count = wasm_func_get_result_count(func, instance_);
+        if (arg_count > kMaxArgs) {
+            error_ = "Function '" + name + "' takes more than " + std::to_string(kMaxArgs) + " arguments";
+            return false;
+        }
+        wasm_valkind_t kinds[kMaxArgs];
+        wasm_func_get_param_types(func, instance_, kinds);
+        function.native = func;
+        function.arg_count = arg_count;
+        for (uint32_t i = 0; i < arg_count; ++i) {
+            function.arg_types[i] = value_type(kinds[i]);
+        }
+        function.result_count = result_count;
+        if (result_count == 1) {
+            wasm_func_get_result_types(func, instance_, kinds);
+            function.result_type = value_type(kinds[0]);
+        }
+        return true;
+    }
+
+    bool call(const Function& function, const WasmValue* args, WasmValue* result) override {
+        // JIT and AOT code needs WAMR's per-thread state on the calling thread
+        thread_local bool thread_ready = wasm_runtime_init_thread_env();
+        if (!thread_ready) {
+            error_ = "Failed to initialize the WAMR thread environment";
+            return false;
+        }
+        wasm_val_t values[kMaxArgs];
+        for (uint32_t i = 0; i < function.arg_count; ++i) {
+            switch (function.arg_types[i]) {
+            case WasmValueType::I32: values[i].kind = WASM_I32; values[i].of.i32 = args[i].i32; break;
+            case WasmValueType::I64: values[i].kind = WASM_I64; values[i].of.i64 = args[i].i64; break;
+            case WasmValueType::F32: values[i].kind = WASM_F32; values[i].of.f32 = args[i].f32; break;
+            case WasmValueType::F64: values[i].kind = WASM_F64; values[i].of.f64 = args[i].f64; break;
+            }
+        }
+        wasm_val_t out[1];
+        uint32_t result_count = function.result_count == 1 ? 1 : 0;
+        if (!wasm_runtime_call_wasm_a(exec_env_, static_cast<wasm_function_inst_t>(function.native), result_count, out,
+                                      function.arg_count, values)) {
+            const char* exception = wasm_runtime_get_exception(instance_);
+            error_ = exception ? exception : "call failed";
+            wasm_runtime_clear_exception(instance_);
+            return false;
+        }
+        if (result && result_count == 1) {
+            switch (out[0].kind) {
+            case WASM_I32: result->i32 = out[0].of.i32; break;
+            case WASM_F32: result->f32 = out[0].of.f32; break;
+            case WASM_F64: result->f64 = out[0].of.f64; break;
+            default: result->i64 = out[0].of.i64; break;
+            }
+        }
+        return true;
+    }
+
+    uint8_t* memory_region(uint32_t offset, uint32_t size) override {
+        if (!instance_ || !wasm_runtime_validate_app_addr(instance_, offset, size)) {
+            return nullptr;
+        }
+        return static_cast<uint8_t*>(wasm_runtime_addr_app_to_native(instance_, offset));
+    }
+
+    size_t memory_usage() const override {
+        size_t bytes = bytes_.capacity() + 2 * static_cast<size_t>(stack_size_);
+        wasm_memory_inst_t memory = instance_ ? wasm_runtime_get_default_memory(instance_) : nullptr;
+        if (memory) {
+            bytes += static_cast<size_t>(wasm_memory_get_cur_page_count(memory)) * wasm_memory_get_bytes_per_page(memory);
+        }
+        return bytes;
+    }
+
+private:
+    std::vector<uint8_t> bytes_;
+    wasm_module_t module_ = nullptr;
+    wasm_module_inst_t instance_ = nullptr;
+    wasm_exec_env_t exec_env_ = nullptr;
+    uint32_t stack_size_ = 0;
+};
+
+} // namespace
+
+std::unique_ptr<WasmEngine> make_wamr_engine() {
+    return std::make_unique<WamrEngine>();
+}
+
+} // namespace editor
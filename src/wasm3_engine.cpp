@@ -0,0 +1,150 @@
+#include "wasm_engine.h"
+
+// wasm3 headers
+#include "../third_party/wasm3/source/wasm3.h"
+#include "../third_party/wasm3/source/m3_env.h"
+
+namespace editor {
+
+namespace {
+
+WasmValueType value_type(M3ValueType type) {
+    switch (type) {
+    case c_m3Type_i32: return WasmValueType::I32;
+    case c_m3Type_f32: return WasmValueType::F32;
+    case c_m3Type_f64: return WasmValueType::F64;
+    default: return WasmValueType::I64;
+    }
+}
+
+// The interpreter. Functions are compiled to wasm3's threaded code on
+// first call, out of the module bytes, which are kept for that.
+class Wasm3Engine : public WasmEngine {
+public:
+    ~Wasm3Engine() override {
+        // Modules are owned by the runtime and freed with it
+        if (runtime_) m3_FreeRuntime(runtime_);
+        if (env_) m3_FreeEnvironment(env_);
+    }
+
+    WasmEngineKind kind() const override { return WasmEngineKind::Interpreter; }
+
+    bool initialize(size_t stack_size_bytes) override {
+        stack_size_ = stack_size_bytes;
+        env_ = m3_NewEnvironment();
+        if (!env_) {
+            error_ = "Failed to create wasm3 environment";
+            return false;
+        }
+        runtime_ = m3_NewRuntime(env_, static_cast<uint32_t>(stack_size_bytes), nullptr);
+        if (!runtime_) {
+            error_ = "Failed to create wasm3 runtime";
+            return false;
+        }
+        return true;
+    }
+
+    bool load(const uint8_t* bytes, size_t size) override {
+        module_bytes_.emplace_back(bytes, bytes + size);
+        const std::vector<uint8_t>& kept = module_bytes_.back();
+
+        M3Module* module = nullptr;
+        M3Result result = m3_ParseModule(env_, &module, kept.data(), static_cast<uint32_t>(kept.size()));
+        if (result) {
+            error_ = std::string("Failed to parse WASM module: ") + result;
+            module_bytes_.pop_back();
+            return false;
+        }
+        result = m3_LoadModule(runtime_, module);
+        if (result) {
+            error_ = std::string("Failed to load WASM module: ") + result;
+            m3_FreeModule(module);
+            module_bytes_.pop_back();
+            return false;
+        }
+        modules_.push_back(module);
+        return true;
+    }
+
+    void exports(std::vector<std::string>& names) const override {
+        for (M3Module* module : modules_) {
+            for (uint32_t i = 0; i < module->numFunctions; ++i) {
+                if (module->functions[i].export_name) names.push_back(module->functions[i].export_name);
+            }
+        }
+    }
+
+    bool resolve(const std::string& name, Function& function) override {
+        M3Function* func = nullptr;
+        M3Result result = m3_FindFunction(&func, runtime_, name.c_str());
+        if (result) {
+            error_ = std::string("Failed to find function '") + name + "': " + result;
+            return false;
+        }
+        uint32_t arg_count = m3_GetArgCount(func);
+        if (arg_count > kMaxArgs) {
+            error_ = "Function '" + name + "' takes more than " + std::to_string(kMaxArgs) + " arguments";
+            return false;
+        }
+        function.native = func;
+        function.arg_count = arg_count;
+        for (uint32_t i = 0; i < arg_count; ++i) {
+            function.arg_types[i] = value_type(m3_GetArgType(func, i));
+        }
+        function.result_count = m3_GetRetCount(func);
+        if (function.result_count > 0) function.result_type = value_type(m3_GetRetType(func, 0));
+        return true;
+    }
+
+    bool call(const Function& function, const WasmValue* args, WasmValue* result) override {
+        auto* func = static_cast<M3Function*>(function.native);
+        const void* pointers[kMaxArgs];
+        for (uint32_t i = 0; i < function.arg_count; ++i) {
+            pointers[i] = &args[i];
+        }
+        M3Result m3_result = m3_Call(func, function.arg_count, pointers);
+        if (m3_result) {
+            error_ = m3_result;
+            return false;
+        }
+        if (result && function.result_count == 1) {
+            const void* result_pointer[] = { result };
+            m3_GetResults(func, 1, result_pointer);
+        }
+        return true;
+    }
+
+    uint8_t* memory_region(uint32_t offset, uint32_t size) override {
+        uint32_t memory_size = 0;
+        uint8_t* memory = m3_GetMemory(runtime_, &memory_size, 0);
+        if (!memory || offset > memory_size || size > memory_size - offset) {
+            return nullptr;
+        }
+        return memory + offset;
+    }
+
+    size_t memory_usage() const override {
+        uint32_t memory_size = 0;
+        m3_GetMemory(runtime_, &memory_size, 0);
+        size_t bytes = memory_size + stack_size_;
+        for (const auto& module : module_bytes_) {
+            bytes += module.capacity();
+        }
+        return bytes;
+    }
+
+private:
+    M3Environment* env_ = nullptr;
+    M3Runtime* runtime_ = nullptr;
+    std::vector<M3Module*> modules_;
+    std::vector<std::vector<uint8_t>> module_bytes_;
+    size_t stack_size_ = 0;
+};
+
+} // namespace
+
+std::unique_ptr<WasmEngine> make_wasm3_engine() {
+    return std::make_unique<Wasm3Engine>();
+}
+
+} // namespace editor
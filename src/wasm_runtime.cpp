@@ -1,18 +1,36 @@
 #include "wasm_runtime.h"
+#include <filesystem>
 #include <fstream>
-#include <sstream>
-
-// wasm3 headers
-#include "../third_party/wasm3/source/wasm3.h"
-#include "../third_party/wasm3/source/m3_env.h"
 
 namespace editor {
 
-WasmRuntime::WasmRuntime()
-    : env_(nullptr)
-    , runtime_(nullptr)
-    , module_(nullptr)
-    , stack_size_(0)
+std::unique_ptr<WasmEngine> make_wasm3_engine();
+#ifdef VELOCITY_HAVE_WAMR
+std::unique_ptr<WasmEngine> make_wamr_engine();
+#endif
+
+std::unique_ptr<WasmEngine> make_wasm_engine(WasmEngineKind kind) {
+    if (kind == WasmEngineKind::Interpreter) {
+        return make_wasm3_engine();
+    }
+#ifdef VELOCITY_HAVE_WAMR
+    return make_wamr_engine();
+#else
+    return nullptr;
+#endif
+}
+
+bool wasm_engine_available(WasmEngineKind kind) {
+#ifdef VELOCITY_HAVE_WAMR
+    (void)kind;
+    return true;
+#else
+    return kind == WasmEngineKind::Interpreter;
+#endif
+}
+
+WasmRuntime::WasmRuntime(WasmEngineKind engine)
+    : requested_(engine)
 {
 }
 
@@ -21,43 +39,47 @@ WasmRuntime::~WasmRuntime() {
 }
 
 bool WasmRuntime::initialize(size_t stack_size_bytes) {
-    if (runtime_) {
+    if (engine_) {
         set_error("Runtime already initialized");
         return false;
     }
 
-    stack_size_ = stack_size_bytes;
-    
-    // Create environment
-    env_ = m3_NewEnvironment();
-    if (!env_) {
-        set_error("Failed to create wasm3 environment");
-        return false;
+    // Without the compiled engine built in, the interpreter runs the plugin
+    std::unique_ptr<WasmEngine> engine = make_wasm_engine(requested_);
+    if (!engine) {
+        engine = make_wasm_engine(WasmEngineKind::Interpreter);
     }
-
-    // Create runtime with stack size
-    runtime_ = m3_NewRuntime(env_, stack_size_bytes, nullptr);
-    if (!runtime_) {
-        set_error("Failed to create wasm3 runtime");
-        m3_FreeEnvironment(env_);
-        env_ = nullptr;
+    if (!engine->initialize(stack_size_bytes)) {
+        set_error(engine->error());
         return false;
     }
+    engine_ = std::move(engine);
 
     error_message_.clear();
     return true;
 }
 
 bool WasmRuntime::load_module(const std::string& path) {
-    if (!runtime_) {
+    if (!engine_) {
         set_error("Runtime not initialized");
         return false;
     }
 
+    // The compiled engine takes a module wamrc built ahead of time over
+    // compiling the .wasm itself
+    std::string module_path = path;
+    if (engine_->kind() == WasmEngineKind::Compiled) {
+        std::string aot_path = std::filesystem::path(path).replace_extension(".aot").string();
+        std::error_code code;
+        if (std::filesystem::is_regular_file(aot_path, code)) {
+            module_path = aot_path;
+        }
+    }
+
     // Read file
-    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    std::ifstream file(module_path, std::ios::binary | std::ios::ate);
     if (!file) {
-        set_error("Failed to open WASM file: " + path);
+        set_error("Failed to open WASM file: " + module_path);
         return false;
     }
 
@@ -66,7 +88,7 @@ bool WasmRuntime::load_module(const std::string& path) {
 
     std::vector<uint8_t> buffer(size);
     if (!file.read(reinterpret_cast<char*>(buffer.data()), size)) {
-        set_error("Failed to read WASM file: " + path);
+        set_error("Failed to read WASM file: " + module_path);
         return false;
     }
 
@@ -74,78 +96,100 @@ bool WasmRuntime::load_module(const std::string& path) {
 }
 
 bool WasmRuntime::load_module_from_memory(const uint8_t* wasm_bytes, size_t size) {
-    if (!runtime_) {
+    if (!engine_) {
         set_error("Runtime not initialized");
         return false;
     }
 
-    // Parse module
-    M3Result result = m3_ParseModule(env_, &module_, wasm_bytes, static_cast<uint32_t>(size));
-    if (result) {
-        set_error(std::string("Failed to parse WASM module: ") + result);
+    if (!engine_->load(wasm_bytes, size)) {
+        set_error(engine_->error());
         return false;
     }
+    has_module_ = true;
 
-    // Load module into runtime
-    result = m3_LoadModule(runtime_, module_);
-    if (result) {
-        set_error(std::string("Failed to load WASM module: ") + result);
-        m3_FreeModule(module_);
-        module_ = nullptr;
-        return false;
+    // Resolve the exports now rather than by name on every call. One that
+    // fails to compile is left to report its error when it is called.
+    std::vector<std::string> exports;
+    engine_->exports(exports);
+    for (const std::string& name : exports) {
+        if (functions_.count(name)) {
+            continue;
+        }
+        FunctionHandle handle;
+        if (resolve(name, handle)) {
+            auto it = functions_.emplace(name, handle).first;
+            it->second.name = it->first.c_str();
+        }
     }
 
     error_message_.clear();
     return true;
 }
 
-bool WasmRuntime::call_function(const std::string& func_name, const std::vector<int64_t>& args, int64_t* result) {
-    if (!runtime_ || !module_) {
-        set_error("Runtime or module not initialized");
+bool WasmRuntime::resolve(const std::string& func_name, FunctionHandle& handle) {
+    if (!engine_->resolve(func_name, handle)) {
+        set_error(engine_->error());
         return false;
     }
+    return true;
+}
+
+const WasmRuntime::FunctionHandle* WasmRuntime::find_function(const std::string& func_name) {
+    if (!engine_ || !has_module_) {
+        set_error("Runtime or module not initialized");
+        return nullptr;
+    }
+    auto it = functions_.find(func_name);
+    if (it != functions_.end()) {
+        return &it->second;
+    }
+    FunctionHandle handle;
+    if (!resolve(func_name, handle)) {
+        return nullptr;
+    }
+    it = functions_.emplace(func_name, handle).first;
+    it->second.name = it->first.c_str();
+    return &it->second;
+}
 
-    // Find function
-    M3Function* func = nullptr;
-    M3Result m3_result = m3_FindFunction(&func, runtime_, func_name.c_str());
-    if (m3_result) {
-        set_error(std::string("Failed to find function '") + func_name + "': " + m3_result);
+bool WasmRuntime::call(const FunctionHandle& function, const int64_t* args, size_t arg_count, int64_t* result) {
+    if (!engine_ || !function.native) {
+        set_error("Invalid function handle");
+        return false;
+    }
+    if (arg_count != function.arg_count) {
+        set_error(std::string("Failed to call function '") + function.name + "': expected " +
+                  std::to_string(function.arg_count) + " arguments, got " + std::to_string(arg_count));
         return false;
     }
 
-    // wasm3 expects arguments as string array
-    // For now, we'll use m3_Call for simple no-arg functions
-    if (args.empty()) {
-        m3_result = m3_Call(func, 0, nullptr);
-    } else {
-        // Convert args to string format that wasm3 expects
-        std::vector<std::string> arg_strings;
-        std::vector<const char*> arg_ptrs;
-        
-        for (const auto& arg : args) {
-            arg_strings.push_back(std::to_string(arg));
-        }
-        
-        for (const auto& arg_str : arg_strings) {
-            arg_ptrs.push_back(arg_str.c_str());
+    // Each argument in its parameter's type
+    WasmValue values[kMaxArgs];
+    for (uint32_t i = 0; i < function.arg_count; ++i) {
+        switch (function.arg_types[i]) {
+        case WasmValueType::I32: values[i].i32 = static_cast<int32_t>(args[i]); break;
+        case WasmValueType::F32: values[i].f32 = static_cast<float>(args[i]); break;
+        case WasmValueType::F64: values[i].f64 = static_cast<double>(args[i]); break;
+        case WasmValueType::I64: values[i].i64 = args[i]; break;
         }
-        
-        m3_result = m3_CallArgv(func, static_cast<uint32_t>(args.size()), arg_ptrs.data());
     }
-    
-    if (m3_result) {
-        set_error(std::string("Failed to call function '") + func_name + "': " + m3_result);
+
+    WasmValue value{};
+    if (!engine_->call(function, values, &value)) {
+        set_error(std::string("Failed to call function '") + function.name + "': " + engine_->error());
         return false;
     }
 
     // Get result if requested
     if (result) {
-        uint64_t ret_val = 0;
-        m3_result = m3_GetResultsV(func, &ret_val);
-        if (m3_result == nullptr) {
-            *result = static_cast<int64_t>(ret_val);
-        } else {
-            *result = 0;
+        *result = 0;
+        if (function.result_count == 1) {
+            switch (function.result_type) {
+            case WasmValueType::I32: *result = value.i32; break;
+            case WasmValueType::F32: *result = static_cast<int64_t>(value.f32); break;
+            case WasmValueType::F64: *result = static_cast<int64_t>(value.f64); break;
+            case WasmValueType::I64: *result = value.i64; break;
+            }
         }
     }
 
@@ -153,8 +197,30 @@ bool WasmRuntime::call_function(const std::string& func_name, const std::vector<
     return true;
 }
 
+bool WasmRuntime::call_function(const std::string& func_name, const std::vector<int64_t>& args, int64_t* result) {
+    const FunctionHandle* function = find_function(func_name);
+    if (!function) {
+        return false;
+    }
+    return call(*function, args.data(), args.size(), result);
+}
+
+uint8_t* WasmRuntime::memory_region(uint32_t offset, uint32_t size) {
+    if (!engine_) {
+        return nullptr;
+    }
+    return engine_->memory_region(offset, size);
+}
+
+size_t WasmRuntime::get_memory_usage() const {
+    if (!engine_) {
+        return 0;
+    }
+    return engine_->memory_usage();
+}
+
 bool WasmRuntime::link_host_function(const std::string& /*module_name*/, const std::string& /*func_name*/, HostFunction /*func*/) {
-    if (!runtime_) {
+    if (!engine_) {
         set_error("Runtime not initialized");
         return false;
     }
@@ -166,20 +232,9 @@ bool WasmRuntime::link_host_function(const std::string& /*module_name*/, const s
 }
 
 void WasmRuntime::reset() {
-    if (module_) {
-        // Module is owned by runtime, will be freed with it
-        module_ = nullptr;
-    }
-    
-    if (runtime_) {
-        m3_FreeRuntime(runtime_);
-        runtime_ = nullptr;
-    }
-    
-    if (env_) {
-        m3_FreeEnvironment(env_);
-        env_ = nullptr;
-    }
+    functions_.clear();
+    has_module_ = false;
+    engine_.reset();
     
     error_message_.clear();
 }
@@ -0,0 +1,158 @@
+#include "workspace_replace.h"
+#include "indexer.h"
+#include "piece_table.h"
+#include "platform_file.h"
+#include "thread_pool.h"
+#include <cstdio>
+#include <system_error>
+
+namespace {
+
+// Written next to the original so the rename stays on one volume
+std::string temp_path_for(const std::string& path) {
+    return path + ".velocity-replace.tmp";
+}
+
+} // namespace
+
+WorkspaceReplace::WorkspaceReplace() = default;
+
+WorkspaceReplace::~WorkspaceReplace() = default;
+
+std::vector<std::string> WorkspaceReplace::candidate_files(const BackgroundIndexer& indexer,
+                                                           const std::string& pattern, const Options& options) {
+    return indexer.candidate_files(pattern, options.use_regex);
+}
+
+std::vector<WorkspaceReplace::FileEdits> WorkspaceReplace::plan(const std::vector<std::string>& files,
+                                                                const std::string& pattern,
+                                                                const std::string& replacement,
+                                                                const Options& options,
+                                                                const DocumentLookup& lookup) {
+    std::vector<FileEdits> planned(files.size());
+    if (pattern.empty()) return {};
+
+    // Open buffers are looked up here: the lookup need not be thread-safe
+    for (size_t i = 0; i < files.size(); ++i) {
+        planned[i].path = files[i];
+        if (lookup) planned[i].document = lookup(files[i]);
+    }
+
+    // The user is waiting on the plan
+    TaskGroup workers;
+    for (FileEdits& file : planned) {
+        workers.submit([&file, &pattern, &replacement, &options]() {
+            FindDialog finder;
+            finder.set_use_regex(options.use_regex);
+            finder.set_case_sensitive(options.case_sensitive);
+            if (file.document) {
+                file.edits = finder.plan_replace_all(*file.document, pattern, replacement);
+                return;
+            }
+            std::error_code error;
+            file.mtime = std::filesystem::last_write_time(file.path, error);
+            if (error) return;
+            file.mapping = editor::PlatformFile::map_file(file.path);
+            if (!file.mapping) return;
+            PieceTable text(file.mapping);
+            file.edits = finder.plan_replace_all(text, pattern, replacement);
+            if (file.edits.empty()) file.mapping.reset();
+        }, TaskPriority::Interactive);
+    }
+    workers.wait();
+
+    std::vector<FileEdits> result;
+    for (FileEdits& file : planned) {
+        if (!file.edits.empty()) result.push_back(std::move(file));
+    }
+    return result;
+}
+
+bool WorkspaceReplace::write_edited(const std::string& path, const char* data, size_t size,
+                                    const std::vector<ReplaceEdit>& edits) {
+    std::FILE* out = std::fopen(path.c_str(), "wb");
+    if (!out) return false;
+    bool ok = true;
+    auto write = [&](const char* bytes, size_t length) {
+        if (ok && length > 0) ok = std::fwrite(bytes, 1, length, out) == length;
+    };
+    size_t copied = 0;
+    for (const ReplaceEdit& edit : edits) {
+        if (edit.position < copied || edit.position + edit.length > size) {
+            ok = false;
+            break;
+        }
+        write(data + copied, edit.position - copied);
+        write(edit.text.data(), edit.text.size());
+        copied = edit.position + edit.length;
+    }
+    write(data + copied, size - copied);
+    if (std::fclose(out) != 0) ok = false;
+    return ok;
+}
+
+WorkspaceReplace::Result WorkspaceReplace::apply(std::vector<FileEdits>& plan, const DocumentApply& apply_document) {
+    Result result;
+    std::vector<FileEdits*> on_disk;
+    for (FileEdits& file : plan) {
+        if (!file.document) on_disk.push_back(&file);
+    }
+
+    // Phase 1: every disk file into its temp, in parallel; nothing renamed yet
+    std::vector<std::string> errors(on_disk.size());
+    TaskGroup workers;
+    for (size_t i = 0; i < on_disk.size(); ++i) {
+        workers.submit([file = on_disk[i], &error = errors[i]]() {
+            std::error_code code;
+            std::error_code size_code;
+            auto mtime = std::filesystem::last_write_time(file->path, code);
+            auto size = std::filesystem::file_size(file->path, size_code);
+            if (code || size_code || !file->mapping || mtime != file->mtime || size != file->mapping->size()) {
+                error = file->path + " changed since the search";
+                return;
+            }
+            std::string temp = temp_path_for(file->path);
+            if (!write_edited(temp, file->mapping->data(), file->mapping->size(), file->edits)) {
+                error = "cannot write " + temp;
+                return;
+            }
+            auto permissions = std::filesystem::status(file->path, code).permissions();
+            if (!code) std::filesystem::permissions(temp, permissions, code);
+        }, TaskPriority::Interactive);
+    }
+    workers.wait();
+
+    for (size_t i = 0; i < on_disk.size() && result.error.empty(); ++i) result.error = errors[i];
+    if (!result.error.empty()) {
+        for (FileEdits* file : on_disk) editor::PlatformFile::delete_file(temp_path_for(file->path));
+        return result;
+    }
+
+    // Phase 2: drop the mappings (a mapped file cannot be replaced on Windows) and rename
+    for (FileEdits* file : on_disk) {
+        file->mapping.reset();
+        if (!editor::PlatformFile::rename_file(temp_path_for(file->path), file->path)) {
+            if (result.error.empty()) result.error = "cannot replace " + file->path;
+            editor::PlatformFile::delete_file(temp_path_for(file->path));
+            continue;
+        }
+        result.files++;
+        result.replacements += file->edits.size();
+    }
+
+    // Open documents last: one transaction (one undo step) per document
+    for (FileEdits& file : plan) {
+        if (!file.document) continue;
+        if (apply_document) {
+            apply_document(*file.document, file.edits);
+        } else {
+            file.document->begin_transaction();
+            FindDialog::apply_edits(*file.document, file.edits);
+            file.document->commit_transaction();
+        }
+        result.files++;
+        result.replacements += file.edits.size();
+    }
+    result.ok = result.error.empty();
+    return result;
+}
@@ -0,0 +1,84 @@
+#include "workspace_vocabulary.h"
+#include <algorithm>
+#include <cctype>
+
+std::shared_ptr<const WorkspaceVocabulary> WorkspaceVocabulary::build(std::vector<Word> words, uint64_t generation) {
+    auto vocabulary = std::make_shared<WorkspaceVocabulary>();
+    vocabulary->generation_ = generation;
+    std::sort(words.begin(), words.end(), [](const Word& a, const Word& b) { return a.key < b.key; });
+    vocabulary->words_ = std::move(words);
+    const std::vector<Word>& sorted = vocabulary->words_;
+
+    // Every prefix whose range is too long to scan gets its list; such
+    // ranges nest, so lengthening stops once none is left at some length
+    for (size_t length = 1;; ++length) {
+        bool any = false;
+        size_t first = 0;
+        while (first < sorted.size()) {
+            if (sorted[first].key.size() < length) {
+                ++first;
+                continue;
+            }
+            size_t last = first + 1;
+            while (last < sorted.size() && sorted[last].key.compare(0, length, sorted[first].key, 0, length) == 0) {
+                ++last;
+            }
+            if (last - first > kScanLimit) {
+                any = true;
+                std::vector<uint32_t>& top = vocabulary->tops_[sorted[first].key.substr(0, length)];
+                vocabulary->best(length, first, last, kTopK, top);
+            }
+            first = last;
+        }
+        if (!any) break;
+    }
+    return vocabulary;
+}
+
+void WorkspaceVocabulary::suggest(const std::string& prefix, size_t max_items, std::vector<const Word*>& out) const {
+    out.clear();
+    if (prefix.empty() || max_items == 0) return;
+    std::string key(prefix);
+    for (char& c : key) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    std::pair<size_t, size_t> found = range(key);
+
+    std::vector<uint32_t> scanned;
+    const std::vector<uint32_t>* best_words = &scanned;
+    auto cached = tops_.find(key);
+    if (cached != tops_.end() && max_items <= kTopK) {
+        best_words = &cached->second;
+    } else {
+        best(key.size(), found.first, found.second, max_items, scanned);
+    }
+    for (size_t i = 0; i < best_words->size() && out.size() < max_items; ++i) {
+        out.push_back(&words_[(*best_words)[i]]);
+    }
+}
+
+const WorkspaceVocabulary::Word* WorkspaceVocabulary::find(const std::string& key) const {
+    auto at = std::lower_bound(words_.begin(), words_.end(), key,
+                               [](const Word& word, const std::string& k) { return word.key < k; });
+    return at != words_.end() && at->key == key ? &*at : nullptr;
+}
+
+std::pair<size_t, size_t> WorkspaceVocabulary::range(const std::string& key) const {
+    auto first = std::lower_bound(words_.begin(), words_.end(), key,
+                                  [](const Word& word, const std::string& k) { return word.key < k; });
+    auto last = std::partition_point(first, words_.end(), [&](const Word& word) {
+        return word.key.compare(0, key.size(), key) == 0;
+    });
+    return {static_cast<size_t>(first - words_.begin()), static_cast<size_t>(last - words_.begin())};
+}
+
+void WorkspaceVocabulary::best(size_t key_length, size_t first, size_t last, size_t max_items,
+                               std::vector<uint32_t>& out) const {
+    out.clear();
+    for (size_t i = first; i < last; ++i) {
+        if (words_[i].count > 0 && words_[i].key.size() > key_length) out.push_back(static_cast<uint32_t>(i));
+    }
+    size_t keep = std::min(max_items, out.size());
+    std::partial_sort(out.begin(), out.begin() + keep, out.end(), [this](uint32_t a, uint32_t b) {
+        return words_[a].count != words_[b].count ? words_[a].count > words_[b].count : a < b;
+    });
+    out.resize(keep);
+}
@@ -0,0 +1,100 @@
+#include "wrap_layout.h"
+#include "piece_table.h"
+#include <algorithm>
+#include <string>
+
+namespace editor {
+
+WrapLayout::~WrapLayout() {
+    if (listened_) listened_->remove_change_listener(listener_id_);
+}
+
+void WrapLayout::set_document(const std::shared_ptr<TextBuffer>& document) {
+    if (document == document_) return;
+    if (listened_) listened_->remove_change_listener(listener_id_);
+    listened_.reset();
+    listener_id_ = 0;
+    document_ = document;
+    lines_.clear();
+    listened_ = std::dynamic_pointer_cast<PieceTable>(document_);
+    if (listened_) {
+        listener_id_ = listened_->add_change_listener([this](const PieceTable::Change& change) {
+            on_change(change.first_line, change.removed_newlines, change.inserted_newlines);
+        });
+    }
+}
+
+void WrapLayout::set_columns(size_t columns) {
+    columns = (std::max)(columns, size_t(1));
+    if (columns == columns_) return;
+    columns_ = columns;
+    lines_.clear();
+}
+
+void WrapLayout::on_change(size_t first_line, size_t removed_newlines, size_t inserted_newlines) {
+    size_t old_last = first_line + removed_newlines;
+    std::unordered_map<size_t, std::vector<uint32_t>> shifted;
+    shifted.reserve(lines_.size());
+    for (auto& entry : lines_) {
+        if (entry.first < first_line) {
+            shifted.emplace(entry.first, std::move(entry.second));
+        } else if (entry.first > old_last) {
+            shifted.emplace(entry.first - removed_newlines + inserted_newlines, std::move(entry.second));
+        }
+    }
+    lines_.swap(shifted);
+}
+
+const std::vector<uint32_t>& WrapLayout::row_starts(size_t line) {
+    auto it = lines_.find(line);
+    if (it == lines_.end()) it = lines_.emplace(line, layout_line(line)).first;
+    return it->second;
+}
+
+size_t WrapLayout::row_of_column(size_t line, size_t column) {
+    const auto& starts = row_starts(line);
+    auto it = std::upper_bound(starts.begin(), starts.end(), static_cast<uint32_t>(column));
+    return static_cast<size_t>(it - starts.begin()) - 1;
+}
+
+std::vector<uint32_t> WrapLayout::layout_line(size_t line) const {
+    std::vector<uint32_t> starts{0};
+    if (!document_ || line >= document_->get_line_count()) return starts;
+
+    size_t line_start = document_->get_line_start(line);
+    size_t total = document_->get_total_length();
+    size_t row_start = 0;       // Byte columns within the line
+    size_t last_break = 0;      // Just after the latest space or tab, 0 if none in this row
+    size_t char_start = 0;      // Start of the latest UTF-8 sequence
+    for (size_t offset = 0; line_start + offset < total;) {
+        std::string chunk = document_->get_text(line_start + offset, (std::min)(kReadChunk, total - line_start - offset));
+        if (chunk.empty()) break;
+        for (size_t i = 0; i < chunk.size(); ++i) {
+            size_t column = offset + i;
+            unsigned char c = static_cast<unsigned char>(chunk[i]);
+            if (c == '\n' || (c == '\r' && (i + 1 >= chunk.size() || chunk[i + 1] == '\n'))) return starts;
+            if ((c & 0xC0) != 0x80) char_start = column;
+            if (column - row_start >= columns_) {
+                // This byte no longer fits: break after a blank if the row has one
+                size_t wrap = last_break > row_start ? last_break : char_start;
+                if (wrap <= row_start) wrap = column;
+                starts.push_back(static_cast<uint32_t>(wrap));
+                row_start = wrap;
+            }
+            if (c == ' ' || c == '\t') last_break = column + 1;
+        }
+        offset += chunk.size();
+    }
+    return starts;
+}
+
+void WrapLayout::trim(size_t first, size_t last) {
+    size_t low = first > kSlack ? first - kSlack : 0;
+    size_t high = last + kSlack;
+    for (auto it = lines_.begin(); it != lines_.end();) {
+        if (it->first < low || it->first > high) it = lines_.erase(it);
+        else ++it;
+    }
+}
+
+} // namespace editor